@@ -19,19 +19,36 @@
  * MA 02110-1301 USA
  */
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <time.h>
+#include <sys/stat.h>
+#ifdef HAVE_SYS_RESOURCE_H
+#include <sys/resource.h>
+#endif
 
 #ifdef _WIN32
 #include <io.h>
 #include <fcntl.h>
+#include <windows.h>
+#endif
+
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_MMAP)
+#include <sys/mman.h>
+#define USE_MMAP
 #endif
 
 #include <libdivecomputer/serial.h>
 #include <libdivecomputer/bluetooth.h>
 #include <libdivecomputer/irda.h>
 #include <libdivecomputer/usbhid.h>
+#include <libdivecomputer/remote.h>
+#include <libdivecomputer/capture.h>
 
 #include "common.h"
 #include "utils.h"
@@ -103,6 +120,9 @@ static const transport_table_t g_transports[] = {
 	{"usbstorage",DC_TRANSPORT_USBSTORAGE},
 };
 
+// Name of the capture file, or NULL to disable the capture.
+static const char *g_capture = NULL;
+
 const char *
 dctool_errmsg (dc_status_t status)
 {
@@ -202,6 +222,26 @@ dctool_transport_default (dc_descriptor_t *descriptor)
 	return DC_TRANSPORT_NONE;
 }
 
+static const char *
+dctool_phase_name (dc_phase_t phase)
+{
+	static const char *names[] = {
+		"other",
+		"handshake",
+		"version",
+		"logbook",
+		"profile",
+		"decompress",
+		"checksum",
+		"callback",
+	};
+
+	if ((unsigned int) phase >= C_ARRAY_SIZE (names))
+		return "unknown";
+
+	return names[phase];
+}
+
 void
 dctool_event_cb (dc_device_t *device, dc_event_type_t event, const void *data, void *userdata)
 {
@@ -209,6 +249,11 @@ dctool_event_cb (dc_device_t *device, dc_event_type_t event, const void *data, v
 	const dc_event_devinfo_t *devinfo = (const dc_event_devinfo_t *) data;
 	const dc_event_clock_t *clock = (const dc_event_clock_t *) data;
 	const dc_event_vendor_t *vendor = (const dc_event_vendor_t *) data;
+	const dc_event_cache_t *cache = (const dc_event_cache_t *) data;
+	const dc_iostream_stats_t *iostats = (const dc_iostream_stats_t *) data;
+	const dc_event_checkpoint_t *checkpoint = (const dc_event_checkpoint_t *) data;
+	const dc_event_profile_t *profile = (const dc_event_profile_t *) data;
+	const dc_event_memory_t *memory = (const dc_event_memory_t *) data;
 
 	switch (event) {
 	case DC_EVENT_WAITING:
@@ -235,6 +280,37 @@ dctool_event_cb (dc_device_t *device, dc_event_type_t event, const void *data, v
 			message ("%02X", vendor->data[i]);
 		message ("\n");
 		break;
+	case DC_EVENT_CACHE:
+		message ("Event: cache hits=%u, misses=%u\n",
+			cache->hits, cache->misses);
+		break;
+	case DC_EVENT_IOSTATS:
+		message ("Event: iostats read=%llu (%u calls, %llu us), written=%llu (%u calls), timeouts=%u, purges=%u\n",
+			iostats->nread, iostats->readcalls, iostats->readtime,
+			iostats->nwritten, iostats->writecalls,
+			iostats->timeouts, iostats->purges);
+		message ("Event: iostats histogram=");
+		for (unsigned int i = 0; i < DC_IOSTREAM_STATS_NBINS; ++i)
+			message ("%s%u", i ? "," : "", iostats->histogram[i]);
+		message ("\n");
+		message ("Event: iostats transactions=%u, turnaround=%llu us\n",
+			iostats->transactions, iostats->turnaround);
+		break;
+	case DC_EVENT_CHECKPOINT:
+		message ("Event: checkpoint=");
+		for (unsigned int i = 0; i < checkpoint->size; ++i)
+			message ("%02X", checkpoint->data[i]);
+		message ("\n");
+		break;
+	case DC_EVENT_PROFILE:
+		message ("Event: profile phase=%s, count=%u, time=%llu us\n",
+			dctool_phase_name (profile->phase), profile->count, profile->time);
+		break;
+	case DC_EVENT_MEMORY:
+		message ("Event: memory current=%lu, peak=%lu, budget=%lu\n",
+			(unsigned long) memory->current, (unsigned long) memory->peak,
+			(unsigned long) memory->budget);
+		break;
 	default:
 		break;
 	}
@@ -326,14 +402,17 @@ dctool_convert_hex2bin (const char *str)
 
 	// Allocate a memory buffer.
 	dc_buffer_t *buffer = dc_buffer_new (nbytes);
+	if (!dc_buffer_resize (buffer, nbytes)) {
+		dc_buffer_free (buffer);
+		return NULL;
+	}
 
 	// Convert the hexadecimal string.
-	for (unsigned int i = 0; i < nbytes; ++i) {
+	unsigned char *data = dc_buffer_get_data (buffer);
+	for (size_t i = 0; i < nbytes; ++i) {
 		unsigned char msn = hex2dec (str[i * 2 + 0]);
 		unsigned char lsn = hex2dec (str[i * 2 + 1]);
-		unsigned char byte = (msn << 4) + lsn;
-
-		dc_buffer_append (buffer, &byte, 1);
+		data[i] = (msn << 4) + lsn;
 	}
 
 	return buffer;
@@ -385,9 +464,30 @@ dctool_file_read (const char *filename)
 	// Allocate a memory buffer.
 	dc_buffer_t *buffer = dc_buffer_new (0);
 
+	// Pre-allocate the required amount of memory, when the file size is
+	// known. Otherwise the buffer is expanded while reading the data.
+	struct stat st;
+	if (buffer && fstat (fileno (fp), &st) == 0 && st.st_size > 0 &&
+		dc_buffer_reserve (buffer, st.st_size)) {
+#ifdef USE_MMAP
+		// Map the file into memory, and copy the contents with a single
+		// append. If mapping fails (e.g. for a pipe, or a stream that is
+		// not at the start), fall back to the read loop below.
+		void *map = MAP_FAILED;
+		if (ftell (fp) == 0)
+			map = mmap (NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno (fp), 0);
+		if (map != MAP_FAILED) {
+			dc_buffer_append (buffer, map, st.st_size);
+			munmap (map, st.st_size);
+			fclose (fp);
+			return buffer;
+		}
+#endif
+	}
+
 	// Read the entire file into the buffer.
 	size_t n = 0;
-	unsigned char block[1024] = {0};
+	unsigned char block[4096] = {0};
 	while ((n = fread (block, 1, sizeof (block), fp)) > 0) {
 		dc_buffer_append (buffer, block, n);
 	}
@@ -490,16 +590,20 @@ dctool_bluetooth_open (dc_iostream_t **out, dc_context_t *context, dc_descriptor
 		// Use the address.
 		address = dc_bluetooth_str2addr(devname);
 	} else {
-		// Discover the device address.
-		dc_iterator_t *iterator = NULL;
-		dc_bluetooth_device_t *device = NULL;
-		dc_bluetooth_iterator_new (&iterator, context, descriptor);
-		while (dc_iterator_next (iterator, &device) == DC_STATUS_SUCCESS) {
-			address = dc_bluetooth_device_get_address (device);
-			dc_bluetooth_device_free (device);
-			break;
+		// Discover the device address. The paired devices are tried
+		// first, to avoid the slow inquiry.
+		static const unsigned int flags[] = {DC_BLUETOOTH_PAIRED, 0};
+		for (unsigned int i = 0; i < C_ARRAY_SIZE (flags) && address == 0; ++i) {
+			dc_iterator_t *iterator = NULL;
+			dc_bluetooth_device_t *device = NULL;
+			dc_bluetooth_iterator_new2 (&iterator, context, descriptor, flags[i]);
+			while (dc_iterator_next (iterator, &device) == DC_STATUS_SUCCESS) {
+				address = dc_bluetooth_device_get_address (device);
+				dc_bluetooth_device_free (device);
+				break;
+			}
+			dc_iterator_free (iterator);
 		}
-		dc_iterator_free (iterator);
 	}
 
 	if (address == 0) {
@@ -525,9 +629,40 @@ cleanup:
 	return status;
 }
 
-dc_status_t
-dctool_iostream_open (dc_iostream_t **iostream, dc_context_t *context, dc_descriptor_t *descriptor, dc_transport_t transport, const char *devname)
+static dc_status_t
+dctool_remote_open (dc_iostream_t **out, dc_context_t *context, const char *devname)
 {
+	// Split the devname in the host name and the port number.
+	const char *separator = strrchr (devname, ':');
+	if (separator == NULL || separator == devname) {
+		ERROR ("No valid remote address specified.");
+		return DC_STATUS_INVALIDARGS;
+	}
+
+	char hostname[256];
+	size_t length = separator - devname;
+	if (length >= sizeof (hostname)) {
+		ERROR ("No valid remote address specified.");
+		return DC_STATUS_INVALIDARGS;
+	}
+
+	memcpy (hostname, devname, length);
+	hostname[length] = 0;
+
+	return dc_remote_open (out, context, hostname, strtoul (separator + 1, NULL, 10));
+}
+
+static dc_status_t
+dctool_transport_open (dc_iostream_t **iostream, dc_context_t *context, dc_descriptor_t *descriptor, dc_transport_t transport, const char *devname)
+{
+	// An I/O stream provided by the serve command.
+	if (devname && strncmp (devname, "remote:", 7) == 0)
+		return dctool_remote_open (iostream, context, devname + 7);
+
+	// An I/O stream recorded with the capture option.
+	if (devname && strncmp (devname, "replay:", 7) == 0)
+		return dc_replay_open (iostream, context, devname + 7, 0);
+
 	switch (transport) {
 	case DC_TRANSPORT_SERIAL:
 		return dc_serial_open (iostream, context, devname);
@@ -545,3 +680,197 @@ dctool_iostream_open (dc_iostream_t **iostream, dc_context_t *context, dc_descri
 		return DC_STATUS_UNSUPPORTED;
 	}
 }
+
+void
+dctool_set_capture (const char *filename)
+{
+	g_capture = filename;
+}
+
+dc_status_t
+dctool_iostream_open (dc_iostream_t **iostream, dc_context_t *context, dc_descriptor_t *descriptor, dc_transport_t transport, const char *devname)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_iostream_t *base = NULL;
+
+	status = dctool_transport_open (&base, context, descriptor, transport, devname);
+	if (status != DC_STATUS_SUCCESS || base == NULL || g_capture == NULL) {
+		*iostream = base;
+		return status;
+	}
+
+	status = dc_capture_open (iostream, context, base, g_capture);
+	if (status != DC_STATUS_SUCCESS) {
+		dc_iostream_close (base);
+		return status;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+double
+dctool_timestamp (void)
+{
+#if defined (_WIN32)
+	LARGE_INTEGER frequency, now;
+	QueryPerformanceFrequency (&frequency);
+	QueryPerformanceCounter (&now);
+	return (double) now.QuadPart / frequency.QuadPart;
+#elif defined (HAVE_CLOCK_GETTIME)
+	struct timespec now;
+	clock_gettime (CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / 1000000000.0;
+#else
+	return (double) clock () / CLOCKS_PER_SEC;
+#endif
+}
+
+double
+dctool_cputime (void)
+{
+#if defined (HAVE_SYS_RESOURCE_H) && defined (HAVE_GETRUSAGE)
+	struct rusage usage;
+	if (getrusage (RUSAGE_SELF, &usage) == 0) {
+		return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1000000.0 +
+			usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1000000.0;
+	}
+#endif
+	return (double) clock () / CLOCKS_PER_SEC;
+}
+
+typedef union allocation_t {
+	size_t size;
+	double align_double;
+	long double align_long_double;
+	void *align_pointer;
+} allocation_t;
+
+void *
+dctool_allocstats_func (dc_context_t *context, void *ptr, size_t size, void *userdata)
+{
+	dctool_allocstats_t *statistics = (dctool_allocstats_t *) userdata;
+	allocation_t *header = NULL;
+
+	if (ptr) {
+		header = (allocation_t *) ptr - 1;
+		statistics->current -= header->size;
+	}
+
+	if (size == 0) {
+		statistics->frees++;
+		free (header);
+		return NULL;
+	}
+
+	if (header)
+		statistics->reallocations++;
+	else
+		statistics->allocations++;
+
+	allocation_t *result = (allocation_t *) realloc (header, sizeof (allocation_t) + size);
+	if (result == NULL) {
+		if (header)
+			statistics->current += header->size;
+		return NULL;
+	}
+
+	result->size = size;
+	statistics->current += size;
+	if (statistics->peak < statistics->current)
+		statistics->peak = statistics->current;
+
+	return result + 1;
+}
+
+#define NSTRINGS 100
+
+static void
+dctool_sample_cb (dc_sample_type_t type, dc_sample_value_t value, void *userdata)
+{
+	dctool_samplestats_t *stats = (dctool_samplestats_t *) userdata;
+
+	if (type == DC_SAMPLE_TIME)
+		stats->samples++;
+	else if (type == DC_SAMPLE_EVENT)
+		stats->events++;
+}
+
+dc_status_t
+dctool_parser_exercise (dc_parser_t *parser, const unsigned char data[], unsigned int size, dctool_samplestats_t *stats)
+{
+	dc_status_t rc = DC_STATUS_SUCCESS;
+
+	rc = dc_parser_set_data (parser, data, size);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	dc_datetime_t datetime = {0};
+	rc = dc_parser_get_datetime (parser, &datetime);
+	if (rc != DC_STATUS_SUCCESS && rc != DC_STATUS_UNSUPPORTED)
+		return rc;
+
+	// Query all the fields, the same way an application would do.
+	static const dc_field_type_t fields[] = {
+		DC_FIELD_DIVETIME,
+		DC_FIELD_MAXDEPTH,
+		DC_FIELD_AVGDEPTH,
+		DC_FIELD_SALINITY,
+		DC_FIELD_ATMOSPHERIC,
+		DC_FIELD_TEMPERATURE_SURFACE,
+		DC_FIELD_TEMPERATURE_MINIMUM,
+		DC_FIELD_TEMPERATURE_MAXIMUM,
+		DC_FIELD_DIVEMODE,
+		DC_FIELD_LOCATION,
+	};
+	for (unsigned int i = 0; i < C_ARRAY_SIZE (fields); ++i) {
+		union {
+			unsigned int number;
+			double real;
+			dc_salinity_t salinity;
+			dc_divemode_t divemode;
+			dc_location_t location;
+		} value;
+		rc = dc_parser_get_field (parser, fields[i], 0, &value);
+		if (rc != DC_STATUS_SUCCESS && rc != DC_STATUS_UNSUPPORTED)
+			return rc;
+	}
+
+	unsigned int ngases = 0;
+	rc = dc_parser_get_field (parser, DC_FIELD_GASMIX_COUNT, 0, &ngases);
+	if (rc != DC_STATUS_SUCCESS && rc != DC_STATUS_UNSUPPORTED)
+		return rc;
+	for (unsigned int i = 0; i < ngases; ++i) {
+		dc_gasmix_t gasmix = {0};
+		rc = dc_parser_get_field (parser, DC_FIELD_GASMIX, i, &gasmix);
+		if (rc != DC_STATUS_SUCCESS && rc != DC_STATUS_UNSUPPORTED)
+			return rc;
+	}
+
+	unsigned int ntanks = 0;
+	rc = dc_parser_get_field (parser, DC_FIELD_TANK_COUNT, 0, &ntanks);
+	if (rc != DC_STATUS_SUCCESS && rc != DC_STATUS_UNSUPPORTED)
+		return rc;
+	for (unsigned int i = 0; i < ntanks; ++i) {
+		dc_tank_t tank = {0};
+		rc = dc_parser_get_field (parser, DC_FIELD_TANK, i, &tank);
+		if (rc != DC_STATUS_SUCCESS && rc != DC_STATUS_UNSUPPORTED)
+			return rc;
+	}
+
+	for (unsigned int i = 0; i < NSTRINGS; ++i) {
+		dc_field_string_t str = {NULL};
+		rc = dc_parser_get_field (parser, DC_FIELD_STRING, i, &str);
+		if (rc == DC_STATUS_UNSUPPORTED)
+			break;
+		if (rc != DC_STATUS_SUCCESS)
+			return rc;
+		if (!str.desc || !str.value)
+			break;
+	}
+
+	rc = dc_parser_samples_foreach (parser, dctool_sample_cb, stats);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	return DC_STATUS_SUCCESS;
+}
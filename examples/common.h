@@ -26,6 +26,7 @@
 #include <libdivecomputer/descriptor.h>
 #include <libdivecomputer/iostream.h>
 #include <libdivecomputer/device.h>
+#include <libdivecomputer/parser.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -67,9 +68,56 @@ dctool_file_write (const char *filename, dc_buffer_t *buffer);
 dc_buffer_t *
 dctool_file_read (const char *filename);
 
+/*
+ * Record the communication of all I/O streams opened with
+ * dctool_iostream_open in a capture file.
+ */
+void
+dctool_set_capture (const char *filename);
+
 dc_status_t
 dctool_iostream_open (dc_iostream_t **iostream, dc_context_t *context, dc_descriptor_t *descriptor, dc_transport_t transport, const char *devname);
 
+/*
+ * Monotonic time in seconds, for measuring elapsed times.
+ */
+double
+dctool_timestamp (void);
+
+/*
+ * Processor time of the process in seconds, user and system time
+ * combined.
+ */
+double
+dctool_cputime (void);
+
+/*
+ * Memory allocation statistics, collected by registering
+ * dctool_allocstats_func as the allocator of a context.
+ */
+typedef struct dctool_allocstats_t {
+	unsigned long long allocations;
+	unsigned long long reallocations;
+	unsigned long long frees;
+	size_t current;
+	size_t peak;
+} dctool_allocstats_t;
+
+void *
+dctool_allocstats_func (dc_context_t *context, void *ptr, size_t size, void *userdata);
+
+typedef struct dctool_samplestats_t {
+	unsigned long long samples;
+	unsigned long long events;
+} dctool_samplestats_t;
+
+/*
+ * Parse a dive completely, the same way an application would do: the
+ * date/time, all fields, and all samples.
+ */
+dc_status_t
+dctool_parser_exercise (dc_parser_t *parser, const unsigned char data[], unsigned int size, dctool_samplestats_t *stats);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -62,10 +62,16 @@ static const dctool_command_t *g_commands[] = {
 	&dctool_download,
 	&dctool_dump,
 	&dctool_parse,
+	&dctool_bench,
 	&dctool_read,
 	&dctool_write,
 	&dctool_timesync,
 	&dctool_fwupdate,
+	&dctool_benchmark,
+	&dctool_fuzz,
+	&dctool_serve,
+	&dctool_simulate,
+	&dctool_verify,
 	NULL
 };
 
@@ -111,6 +117,7 @@ dctool_command_showhelp (const dctool_command_t *command)
 			"   -f, --family <family>     Device family type\n"
 			"   -m, --model <model>       Device model number\n"
 			"   -l, --logfile <logfile>   Logfile\n"
+			"   -c, --capture <filename>  Record the communication\n"
 			"   -q, --quiet               Quiet mode\n"
 			"   -v, --verbose             Verbose mode\n"
 #else
@@ -119,6 +126,7 @@ dctool_command_showhelp (const dctool_command_t *command)
 			"   -f <family>    Family type\n"
 			"   -m <model>     Model number\n"
 			"   -l <logfile>   Logfile\n"
+			"   -c <filename>  Record the communication\n"
 			"   -q             Quiet mode\n"
 			"   -v             Verbose mode\n"
 #endif
@@ -181,7 +189,7 @@ main (int argc, char *argv[])
 
 	// Parse the command-line options.
 	int opt = 0;
-	const char *optstring = NOPERMUTATION "hd:f:m:l:qv";
+	const char *optstring = NOPERMUTATION "hd:f:m:l:c:qv";
 #ifdef HAVE_GETOPT_LONG
 	struct option options[] = {
 		{"help",        no_argument,       0, 'h'},
@@ -189,6 +197,7 @@ main (int argc, char *argv[])
 		{"family",      required_argument, 0, 'f'},
 		{"model",       required_argument, 0, 'm'},
 		{"logfile",     required_argument, 0, 'l'},
+		{"capture",     required_argument, 0, 'c'},
 		{"quiet",       no_argument,       0, 'q'},
 		{"verbose",     no_argument,       0, 'v'},
 		{0,             0,                 0,  0 }
@@ -215,6 +224,9 @@ main (int argc, char *argv[])
 		case 'l':
 			logfile = optarg;
 			break;
+		case 'c':
+			dctool_set_capture (optarg);
+			break;
 		case 'q':
 			loglevel = DC_LOGLEVEL_NONE;
 			break;
@@ -49,10 +49,16 @@ extern const dctool_command_t dctool_scan;
 extern const dctool_command_t dctool_download;
 extern const dctool_command_t dctool_dump;
 extern const dctool_command_t dctool_parse;
+extern const dctool_command_t dctool_bench;
 extern const dctool_command_t dctool_read;
 extern const dctool_command_t dctool_write;
 extern const dctool_command_t dctool_timesync;
 extern const dctool_command_t dctool_fwupdate;
+extern const dctool_command_t dctool_benchmark;
+extern const dctool_command_t dctool_fuzz;
+extern const dctool_command_t dctool_serve;
+extern const dctool_command_t dctool_simulate;
+extern const dctool_command_t dctool_verify;
 
 const dctool_command_t *
 dctool_command_find (const char *name);
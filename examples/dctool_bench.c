@@ -0,0 +1,586 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#ifdef HAVE_GETOPT_H
+#include <getopt.h>
+#endif
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <dirent.h>
+#endif
+
+#include <libdivecomputer/context.h>
+#include <libdivecomputer/descriptor.h>
+#include <libdivecomputer/device.h>
+#include <libdivecomputer/parser.h>
+#include <libdivecomputer/capture.h>
+
+#include "dctool.h"
+#include "common.h"
+#include "utils.h"
+
+typedef struct phase_t {
+	double seconds;
+	double cputime;
+	unsigned long long allocations;
+	unsigned long long reallocations;
+	unsigned long long frees;
+	size_t peak;
+	// State at the start of the phase.
+	double begin;
+	double cpubegin;
+	dctool_allocstats_t memory;
+} phase_t;
+
+typedef struct result_t {
+	const char *name;
+	dc_family_t family;
+	dc_status_t status;
+	unsigned int sessions;
+	unsigned long long dives;
+	unsigned long long bytes;
+	unsigned long long errors;
+	dctool_samplestats_t samples;
+	phase_t download;
+	phase_t parse;
+} result_t;
+
+typedef struct session_t {
+	dc_buffer_t *data;
+	unsigned int *sizes;
+	unsigned int count;
+	unsigned int capacity;
+} session_t;
+
+static void
+phase_begin (phase_t *phase, dctool_allocstats_t *memory)
+{
+	// Track the peak of this phase only.
+	memory->peak = memory->current;
+
+	phase->memory = *memory;
+	phase->cpubegin = dctool_cputime ();
+	phase->begin = dctool_timestamp ();
+}
+
+static void
+phase_end (phase_t *phase, const dctool_allocstats_t *memory)
+{
+	phase->seconds += dctool_timestamp () - phase->begin;
+	phase->cputime += dctool_cputime () - phase->cpubegin;
+	phase->allocations += memory->allocations - phase->memory.allocations;
+	phase->reallocations += memory->reallocations - phase->memory.reallocations;
+	phase->frees += memory->frees - phase->memory.frees;
+	if (phase->peak < memory->peak - phase->memory.current)
+		phase->peak = memory->peak - phase->memory.current;
+}
+
+static void
+phase_add (phase_t *total, const phase_t *phase)
+{
+	total->seconds += phase->seconds;
+	total->cputime += phase->cputime;
+	total->allocations += phase->allocations;
+	total->reallocations += phase->reallocations;
+	total->frees += phase->frees;
+	if (total->peak < phase->peak)
+		total->peak = phase->peak;
+}
+
+static void
+result_add (result_t *total, const result_t *result)
+{
+	if (result->status != DC_STATUS_SUCCESS && total->status == DC_STATUS_SUCCESS)
+		total->status = result->status;
+	total->sessions += result->sessions;
+	total->dives += result->dives;
+	total->bytes += result->bytes;
+	total->errors += result->errors;
+	total->samples.samples += result->samples.samples;
+	total->samples.events += result->samples.events;
+	phase_add (&total->download, &result->download);
+	phase_add (&total->parse, &result->parse);
+}
+
+static int
+dive_cb (const unsigned char *data, unsigned int size, const unsigned char *fingerprint, unsigned int fsize, void *userdata)
+{
+	session_t *session = (session_t *) userdata;
+
+	if (session->count == session->capacity) {
+		unsigned int capacity = session->capacity ? session->capacity * 2 : 64;
+		unsigned int *sizes = (unsigned int *) realloc (session->sizes, capacity * sizeof (unsigned int));
+		if (sizes == NULL)
+			return 0;
+		session->sizes = sizes;
+		session->capacity = capacity;
+	}
+
+	if (!dc_buffer_append (session->data, data, size))
+		return 0;
+
+	session->sizes[session->count++] = size;
+
+	return 1;
+}
+
+/*
+ * Download all dives from a recorded session, with the replay running
+ * at full speed, and parse them afterwards.
+ */
+static dc_status_t
+bench (dc_context_t *context, dctool_allocstats_t *memory, dc_descriptor_t *descriptor, const char *filename, result_t *result)
+{
+	dc_status_t rc = DC_STATUS_SUCCESS;
+	dc_iostream_t *iostream = NULL;
+	dc_device_t *device = NULL;
+	dc_parser_t *parser = NULL;
+	session_t session = {0};
+
+	session.data = dc_buffer_new (0);
+	if (session.data == NULL) {
+		rc = DC_STATUS_NOMEMORY;
+		goto cleanup;
+	}
+
+	phase_begin (&result->download, memory);
+
+	rc = dc_replay_open (&iostream, context, filename, 0);
+	if (rc != DC_STATUS_SUCCESS) {
+		phase_end (&result->download, memory);
+		goto cleanup;
+	}
+
+	rc = dc_device_open (&device, context, descriptor, iostream);
+	if (rc == DC_STATUS_SUCCESS)
+		rc = dc_device_foreach (device, dive_cb, &session);
+
+	// The parser needs the device info, so it's created before the
+	// device is closed.
+	if (rc == DC_STATUS_SUCCESS)
+		rc = dc_parser_new (&parser, device);
+
+	dc_device_close (device);
+	dc_iostream_close (iostream);
+
+	phase_end (&result->download, memory);
+
+	if (rc != DC_STATUS_SUCCESS)
+		goto cleanup;
+
+	phase_begin (&result->parse, memory);
+
+	const unsigned char *data = dc_buffer_get_data (session.data);
+	for (unsigned int i = 0; i < session.count; ++i) {
+		dc_status_t status = dctool_parser_exercise (parser, data, session.sizes[i], &result->samples);
+		if (status != DC_STATUS_SUCCESS)
+			result->errors++;
+		data += session.sizes[i];
+	}
+
+	dc_parser_destroy (parser);
+
+	phase_end (&result->parse, memory);
+
+	result->dives = session.count;
+	result->bytes = dc_buffer_get_size (session.data);
+
+cleanup:
+	free (session.sizes);
+	dc_buffer_free (session.data);
+	return rc;
+}
+
+static int
+name_cmp (const void *a, const void *b)
+{
+	return strcmp (*(char * const *) a, *(char * const *) b);
+}
+
+/*
+ * Get the names of all the files in the directory, sorted by name.
+ */
+static char **
+list_directory (const char *dirname, unsigned int *count)
+{
+	char **names = NULL;
+	unsigned int n = 0, capacity = 0;
+
+#ifdef _WIN32
+	char pattern[1024];
+	snprintf (pattern, sizeof (pattern), "%s\\*", dirname);
+
+	struct _finddata_t entry;
+	intptr_t handle = _findfirst (pattern, &entry);
+	if (handle == -1)
+		return NULL;
+
+	do {
+		if (entry.attrib & _A_SUBDIR)
+			continue;
+		const char *name = entry.name;
+#else
+	DIR *dir = opendir (dirname);
+	if (dir == NULL)
+		return NULL;
+
+	struct dirent *entry = NULL;
+	while ((entry = readdir (dir)) != NULL) {
+		const char *name = entry->d_name;
+#endif
+		if (name[0] == '.')
+			continue;
+
+		if (n == capacity) {
+			capacity = capacity ? capacity * 2 : 16;
+			char **p = (char **) realloc (names, capacity * sizeof (char *));
+			if (p == NULL)
+				break;
+			names = p;
+		}
+
+		names[n] = strdup (name);
+		if (names[n] == NULL)
+			break;
+		n++;
+#ifdef _WIN32
+	} while (_findnext (handle, &entry) == 0);
+
+	_findclose (handle);
+#else
+	}
+
+	closedir (dir);
+#endif
+
+	if (names == NULL)
+		names = (char **) malloc (sizeof (char *));
+
+	qsort (names, n, sizeof (char *), name_cmp);
+
+	*count = n;
+
+	return names;
+}
+
+/*
+ * Find the device of a session. The name of the file, without the
+ * extension and an optional suffix after a '#', contains the vendor and
+ * product name, with underscores instead of spaces.
+ */
+static dc_descriptor_t *
+session_descriptor (const char *filename)
+{
+	char name[256];
+	size_t n = 0;
+	while (filename[n] && filename[n] != '#' && n < sizeof (name) - 1) {
+		name[n] = filename[n] == '_' ? ' ' : filename[n];
+		n++;
+	}
+	name[n] = 0;
+
+	if (filename[n] != '#') {
+		char *dot = strrchr (name, '.');
+		if (dot)
+			*dot = 0;
+	}
+
+	dc_descriptor_t *descriptor = NULL;
+	if (dctool_descriptor_search (&descriptor, name, DC_FAMILY_NULL, 0) != DC_STATUS_SUCCESS)
+		return NULL;
+
+	return descriptor;
+}
+
+static void
+print_string (FILE *fp, const char *str)
+{
+	fputc ('"', fp);
+	for (const char *p = str; *p; ++p) {
+		unsigned char c = *p;
+		if (c == '"' || c == '\\')
+			fprintf (fp, "\\%c", c);
+		else if (c < 0x20)
+			fprintf (fp, "\\u%04x", c);
+		else
+			fputc (c, fp);
+	}
+	fputc ('"', fp);
+}
+
+static void
+print_phase (FILE *fp, const char *indent, const char *name, const phase_t *phase, unsigned long long dives, unsigned long long bytes)
+{
+	fprintf (fp,
+		"%s\"%s\": {\n"
+		"%s   \"seconds\": %.6f,\n"
+		"%s   \"cpu_seconds\": %.6f,\n"
+		"%s   \"dives_per_second\": %.1f,\n"
+		"%s   \"bytes_per_second\": %.1f,\n"
+		"%s   \"allocations\": %llu,\n"
+		"%s   \"reallocations\": %llu,\n"
+		"%s   \"frees\": %llu,\n"
+		"%s   \"peak_heap_bytes\": %lu\n"
+		"%s}",
+		indent, name,
+		indent, phase->seconds,
+		indent, phase->cputime,
+		indent, phase->seconds > 0.0 ? dives / phase->seconds : 0.0,
+		indent, phase->seconds > 0.0 ? bytes / phase->seconds : 0.0,
+		indent, phase->allocations,
+		indent, phase->reallocations,
+		indent, phase->frees,
+		indent, (unsigned long) phase->peak,
+		indent);
+}
+
+static void
+print_result (FILE *fp, const char *indent, const result_t *result)
+{
+	fprintf (fp,
+		"%s\"sessions\": %u,\n"
+		"%s\"dives\": %llu,\n"
+		"%s\"dive_bytes\": %llu,\n"
+		"%s\"samples\": %llu,\n"
+		"%s\"events\": %llu,\n"
+		"%s\"parse_errors\": %llu,\n",
+		indent, result->sessions,
+		indent, result->dives,
+		indent, result->bytes,
+		indent, result->samples.samples,
+		indent, result->samples.events,
+		indent, result->errors);
+	print_phase (fp, indent, "download", &result->download, result->dives, result->bytes);
+	fprintf (fp, ",\n");
+	print_phase (fp, indent, "parse", &result->parse, result->dives, result->bytes);
+}
+
+static int
+dctool_bench_run (int argc, char *argv[], dc_context_t *context, dc_descriptor_t *descriptor)
+{
+	// Default values.
+	int exitcode = EXIT_SUCCESS;
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_context_t *bcontext = NULL;
+	dctool_allocstats_t memory = {0};
+	char **names = NULL;
+	unsigned int count = 0;
+	result_t *results = NULL;
+	result_t *families = NULL;
+	unsigned int nfamilies = 0;
+	FILE *ostream = NULL;
+
+	// Default option values.
+	unsigned int help = 0;
+	const char *filename = NULL;
+
+	// Parse the command-line options.
+	int opt = 0;
+	const char *optstring = "ho:";
+#ifdef HAVE_GETOPT_LONG
+	struct option options[] = {
+		{"help",        no_argument,       0, 'h'},
+		{"output",      required_argument, 0, 'o'},
+		{0,             0,                 0,  0 }
+	};
+	while ((opt = getopt_long (argc, argv, optstring, options, NULL)) != -1) {
+#else
+	while ((opt = getopt (argc, argv, optstring)) != -1) {
+#endif
+		switch (opt) {
+		case 'h':
+			help = 1;
+			break;
+		case 'o':
+			filename = optarg;
+			break;
+		default:
+			return EXIT_FAILURE;
+		}
+	}
+
+	argc -= optind;
+	argv += optind;
+
+	// Show help message.
+	if (help) {
+		dctool_command_showhelp (&dctool_bench);
+		return EXIT_SUCCESS;
+	}
+
+	if (argc != 1) {
+		dctool_command_showhelp (&dctool_bench);
+		return EXIT_FAILURE;
+	}
+
+	const char *dirname = argv[0];
+
+	names = list_directory (dirname, &count);
+	if (names == NULL) {
+		message ("Failed to open the directory '%s'.\n", dirname);
+		exitcode = EXIT_FAILURE;
+		goto cleanup;
+	}
+
+	results = (result_t *) calloc (count ? count : 1, sizeof (result_t));
+	families = (result_t *) calloc (count ? count : 1, sizeof (result_t));
+	if (results == NULL || families == NULL) {
+		message ("Failed to allocate memory.\n");
+		exitcode = EXIT_FAILURE;
+		goto cleanup;
+	}
+
+	// Use a separate context, with an allocator that keeps track of all
+	// the memory allocations of the library. Logging is disabled, to
+	// keep the output of warnings out of the measurements.
+	status = dc_context_new (&bcontext);
+	if (status != DC_STATUS_SUCCESS) {
+		message ("ERROR: %s\n", dctool_errmsg (status));
+		exitcode = EXIT_FAILURE;
+		goto cleanup;
+	}
+	dc_context_set_loglevel (bcontext, DC_LOGLEVEL_NONE);
+	dc_context_set_allocator (bcontext, dctool_allocstats_func, &memory);
+
+	result_t total = {0};
+	for (unsigned int i = 0; i < count; ++i) {
+		result_t *result = results + i;
+		result->name = names[i];
+		result->sessions = 1;
+
+		// The device given on the command line is used for all the
+		// sessions, otherwise it's derived from the filename.
+		dc_descriptor_t *current = descriptor;
+		if (current == NULL)
+			current = session_descriptor (names[i]);
+
+		if (current == NULL) {
+			message ("ERROR: %s: No supported device found.\n", names[i]);
+			result->status = DC_STATUS_UNSUPPORTED;
+		} else {
+			char path[1024];
+			snprintf (path, sizeof (path), "%s/%s", dirname, names[i]);
+
+			result->family = dc_descriptor_get_type (current);
+			result->status = bench (bcontext, &memory, current, path, result);
+			if (result->status != DC_STATUS_SUCCESS)
+				message ("ERROR: %s: %s\n", names[i], dctool_errmsg (result->status));
+			if (result->errors)
+				message ("ERROR: %s: %llu dives failed to parse.\n", names[i], result->errors);
+
+			if (current != descriptor)
+				dc_descriptor_free (current);
+		}
+
+		// Add to the totals of the family.
+		unsigned int j = 0;
+		while (j < nfamilies && families[j].family != result->family)
+			j++;
+		if (j == nfamilies) {
+			families[j].family = result->family;
+			nfamilies++;
+		}
+		result_add (families + j, result);
+		result_add (&total, result);
+	}
+
+	// Open the output file.
+	if (filename) {
+		ostream = fopen (filename, "w");
+		if (ostream == NULL) {
+			message ("Failed to open the output file.\n");
+			exitcode = EXIT_FAILURE;
+			goto cleanup;
+		}
+	}
+
+	FILE *fp = ostream ? ostream : stdout;
+	fprintf (fp, "{\n");
+	print_result (fp, "   ", &total);
+	fprintf (fp, ",\n   \"families\": [\n");
+	for (unsigned int i = 0; i < nfamilies; ++i) {
+		fprintf (fp, "      {\n         \"family\": ");
+		print_string (fp, dctool_family_name (families[i].family) ? dctool_family_name (families[i].family) : "unknown");
+		fprintf (fp, ",\n");
+		print_result (fp, "         ", families + i);
+		fprintf (fp, "\n      }%s\n", i + 1 < nfamilies ? "," : "");
+	}
+	fprintf (fp, "   ],\n   \"results\": [\n");
+	for (unsigned int i = 0; i < count; ++i) {
+		fprintf (fp, "      {\n         \"session\": ");
+		print_string (fp, results[i].name);
+		fprintf (fp, ",\n         \"status\": ");
+		print_string (fp, dctool_errmsg (results[i].status));
+		fprintf (fp, ",\n");
+		print_result (fp, "         ", results + i);
+		fprintf (fp, "\n      }%s\n", i + 1 < count ? "," : "");
+	}
+	fprintf (fp, "   ]\n}\n");
+
+	if (total.status != DC_STATUS_SUCCESS || total.errors)
+		exitcode = EXIT_FAILURE;
+
+cleanup:
+	if (ostream)
+		fclose (ostream);
+	dc_context_free (bcontext);
+	free (families);
+	free (results);
+	for (unsigned int i = 0; i < count; ++i) {
+		free (names[i]);
+	}
+	free (names);
+	return exitcode;
+}
+
+const dctool_command_t dctool_bench = {
+	dctool_bench_run,
+	DCTOOL_CONFIG_NONE,
+	"bench",
+	"Benchmark the download and parsing of recorded sessions",
+	"Usage:\n"
+	"   dctool bench [options] <directory>\n"
+	"\n"
+	"The directory contains the capture files of recorded sessions, as\n"
+	"written with the --capture option. Each session is downloaded again\n"
+	"from a replay at full speed, and all dives are parsed afterwards.\n"
+	"The device is taken from the filename, without the extension and an\n"
+	"optional suffix after a '#', with underscores instead of spaces (e.g.\n"
+	"Suunto_D9#1.cap), unless it's specified on the command line. The\n"
+	"report is written in JSON format.\n"
+	"\n"
+	"Options:\n"
+#ifdef HAVE_GETOPT_LONG
+	"   -h, --help                 Show help message\n"
+	"   -o, --output <filename>    Output filename\n"
+#else
+	"   -h              Show help message\n"
+	"   -o <filename>   Output filename\n"
+#endif
+};
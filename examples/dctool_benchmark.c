@@ -0,0 +1,286 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#ifdef HAVE_GETOPT_H
+#include <getopt.h>
+#endif
+#ifdef HAVE_SYS_RESOURCE_H
+#include <sys/resource.h>
+#endif
+
+#include <libdivecomputer/context.h>
+#include <libdivecomputer/descriptor.h>
+#include <libdivecomputer/parser.h>
+
+#include "dctool.h"
+#include "common.h"
+#include "utils.h"
+
+typedef struct statistics_t {
+	// Memory allocations.
+	dctool_allocstats_t memory;
+	// Parse results.
+	unsigned long long dives;
+	dctool_samplestats_t samples;
+	unsigned long long errors;
+} statistics_t;
+
+static long
+peak_rss (void)
+{
+#if defined (HAVE_SYS_RESOURCE_H) && defined (HAVE_GETRUSAGE)
+	struct rusage usage;
+	if (getrusage (RUSAGE_SELF, &usage) != 0)
+		return -1;
+#ifdef __APPLE__
+	return usage.ru_maxrss / 1024; // Bytes
+#else
+	return usage.ru_maxrss; // Kilobytes
+#endif
+#else
+	return -1;
+#endif
+}
+
+static int
+dctool_benchmark_run (int argc, char *argv[], dc_context_t *context, dc_descriptor_t *descriptor)
+{
+	// Default values.
+	int exitcode = EXIT_SUCCESS;
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_context_t *bcontext = NULL;
+	dc_parser_t *parser = NULL;
+	dc_buffer_t **buffers = NULL;
+	unsigned int nbuffers = 0;
+	FILE *ostream = NULL;
+	statistics_t statistics = {0};
+
+	// Default option values.
+	unsigned int help = 0;
+	const char *filename = NULL;
+	unsigned int iterations = 10;
+	unsigned int devtime = 0;
+	dc_ticks_t systime = 0;
+
+	// Parse the command-line options.
+	int opt = 0;
+	const char *optstring = "ho:n:d:s:";
+#ifdef HAVE_GETOPT_LONG
+	struct option options[] = {
+		{"help",        no_argument,       0, 'h'},
+		{"output",      required_argument, 0, 'o'},
+		{"iterations",  required_argument, 0, 'n'},
+		{"devtime",     required_argument, 0, 'd'},
+		{"systime",     required_argument, 0, 's'},
+		{0,             0,                 0,  0 }
+	};
+	while ((opt = getopt_long (argc, argv, optstring, options, NULL)) != -1) {
+#else
+	while ((opt = getopt (argc, argv, optstring)) != -1) {
+#endif
+		switch (opt) {
+		case 'h':
+			help = 1;
+			break;
+		case 'o':
+			filename = optarg;
+			break;
+		case 'n':
+			iterations = strtoul (optarg, NULL, 0);
+			break;
+		case 'd':
+			devtime = strtoul (optarg, NULL, 0);
+			break;
+		case 's':
+			systime = strtoll (optarg, NULL, 0);
+			break;
+		default:
+			return EXIT_FAILURE;
+		}
+	}
+
+	argc -= optind;
+	argv += optind;
+
+	// Show help message.
+	if (help) {
+		dctool_command_showhelp (&dctool_benchmark);
+		return EXIT_SUCCESS;
+	}
+
+	if (argc == 0 || iterations == 0) {
+		dctool_command_showhelp (&dctool_benchmark);
+		return EXIT_FAILURE;
+	}
+
+	// Read all the input files upfront, to keep the file I/O out of the
+	// measurements.
+	buffers = (dc_buffer_t **) calloc (argc, sizeof (dc_buffer_t *));
+	if (buffers == NULL) {
+		message ("Failed to allocate memory.\n");
+		exitcode = EXIT_FAILURE;
+		goto cleanup;
+	}
+	for (int i = 0; i < argc; ++i) {
+		buffers[i] = dctool_file_read (argv[i]);
+		if (buffers[i] == NULL) {
+			message ("Failed to open the input file '%s'.\n", argv[i]);
+			exitcode = EXIT_FAILURE;
+			goto cleanup;
+		}
+		nbuffers++;
+	}
+
+	// Use a separate context, with an allocator that keeps track of all
+	// the memory allocations of the library. Logging is disabled, to
+	// avoid measuring the output of warnings for each iteration.
+	status = dc_context_new (&bcontext);
+	if (status != DC_STATUS_SUCCESS) {
+		message ("ERROR: %s\n", dctool_errmsg (status));
+		exitcode = EXIT_FAILURE;
+		goto cleanup;
+	}
+	dc_context_set_loglevel (bcontext, DC_LOGLEVEL_NONE);
+	dc_context_set_allocator (bcontext, dctool_allocstats_func, &statistics.memory);
+
+	// Create the parser. The same parser is reused for all dives.
+	status = dc_parser_new2 (&parser, bcontext, descriptor, devtime, systime);
+	if (status != DC_STATUS_SUCCESS) {
+		message ("ERROR: %s\n", dctool_errmsg (status));
+		exitcode = EXIT_FAILURE;
+		goto cleanup;
+	}
+
+	// Exclude the creation of the parser.
+	statistics.memory.allocations = statistics.memory.reallocations = statistics.memory.frees = 0;
+	statistics.memory.peak = statistics.memory.current;
+
+	double begin = dctool_timestamp ();
+	for (unsigned int n = 0; n < iterations; ++n) {
+		for (unsigned int i = 0; i < nbuffers; ++i) {
+			status = dctool_parser_exercise (parser, dc_buffer_get_data (buffers[i]), dc_buffer_get_size (buffers[i]), &statistics.samples);
+			if (status != DC_STATUS_SUCCESS) {
+				if (n == 0)
+					message ("ERROR: %s: %s\n", argv[i], dctool_errmsg (status));
+				statistics.errors++;
+			}
+			statistics.dives++;
+		}
+	}
+	double elapsed = dctool_timestamp () - begin;
+
+	// Open the output file.
+	if (filename) {
+		ostream = fopen (filename, "w");
+		if (ostream == NULL) {
+			message ("Failed to open the output file.\n");
+			exitcode = EXIT_FAILURE;
+			goto cleanup;
+		}
+	}
+
+	FILE *fp = ostream ? ostream : stdout;
+	fprintf (fp,
+		"{\n"
+		"   \"vendor\": \"%s\",\n"
+		"   \"product\": \"%s\",\n"
+		"   \"family\": \"%s\",\n"
+		"   \"model\": %u,\n"
+		"   \"files\": %u,\n"
+		"   \"iterations\": %u,\n"
+		"   \"dives\": %llu,\n"
+		"   \"errors\": %llu,\n"
+		"   \"samples\": %llu,\n"
+		"   \"events\": %llu,\n"
+		"   \"seconds\": %.6f,\n"
+		"   \"dives_per_second\": %.1f,\n"
+		"   \"samples_per_second\": %.1f,\n"
+		"   \"allocations\": %llu,\n"
+		"   \"reallocations\": %llu,\n"
+		"   \"frees\": %llu,\n"
+		"   \"allocations_per_dive\": %.2f,\n"
+		"   \"peak_heap_bytes\": %lu,\n"
+		"   \"peak_rss_kb\": %ld\n"
+		"}\n",
+		dc_descriptor_get_vendor (descriptor),
+		dc_descriptor_get_product (descriptor),
+		dctool_family_name (dc_descriptor_get_type (descriptor)),
+		dc_descriptor_get_model (descriptor),
+		nbuffers, iterations,
+		statistics.dives, statistics.errors,
+		statistics.samples.samples, statistics.samples.events,
+		elapsed,
+		elapsed > 0.0 ? statistics.dives / elapsed : 0.0,
+		elapsed > 0.0 ? statistics.samples.samples / elapsed : 0.0,
+		statistics.memory.allocations, statistics.memory.reallocations, statistics.memory.frees,
+		(double) (statistics.memory.allocations + statistics.memory.reallocations) / statistics.dives,
+		(unsigned long) statistics.memory.peak,
+		peak_rss ());
+
+	if (statistics.errors)
+		exitcode = EXIT_FAILURE;
+
+cleanup:
+	if (ostream)
+		fclose (ostream);
+	dc_parser_destroy (parser);
+	dc_context_free (bcontext);
+	for (unsigned int i = 0; i < nbuffers; ++i) {
+		dc_buffer_free (buffers[i]);
+	}
+	free (buffers);
+	return exitcode;
+}
+
+const dctool_command_t dctool_benchmark = {
+	dctool_benchmark_run,
+	DCTOOL_CONFIG_DESCRIPTOR,
+	"benchmark",
+	"Measure the parser performance on previously downloaded dives",
+	"Usage:\n"
+	"   dctool benchmark [options] <filename> [<filename> ...]\n"
+	"\n"
+	"Each file contains one raw dive, as written by the raw output of the\n"
+	"download command. The report is written in JSON format.\n"
+	"\n"
+	"Options:\n"
+#ifdef HAVE_GETOPT_LONG
+	"   -h, --help                 Show help message\n"
+	"   -o, --output <filename>    Output filename\n"
+	"   -n, --iterations <count>   Number of iterations (default 10)\n"
+	"   -d, --devtime <timestamp>  Device time\n"
+	"   -s, --systime <timestamp>  System time\n"
+#else
+	"   -h              Show help message\n"
+	"   -o <filename>   Output filename\n"
+	"   -n <count>      Number of iterations (default 10)\n"
+	"   -d <devtime>    Device time\n"
+	"   -s <systime>    System time\n"
+#endif
+};
@@ -30,11 +30,15 @@
 #ifdef HAVE_GETOPT_H
 #include <getopt.h>
 #endif
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
 
 #include <libdivecomputer/context.h>
 #include <libdivecomputer/descriptor.h>
 #include <libdivecomputer/device.h>
 #include <libdivecomputer/parser.h>
+#include <libdivecomputer/divestore.h>
 
 #include "dctool.h"
 #include "common.h"
@@ -46,19 +50,223 @@ typedef struct event_data_t {
 	dc_event_devinfo_t devinfo;
 } event_data_t;
 
+// Maximum number of dives waiting for the output writer.
+#define QUEUESIZE 16
+
+typedef struct dive_item_t {
+	dc_parser_t *parser;
+	unsigned char *data;
+	unsigned int size;
+	unsigned char *fingerprint;
+	unsigned int fsize;
+} dive_item_t;
+
 typedef struct dive_data_t {
 	dc_device_t *device;
 	dc_buffer_t **fingerprint;
 	unsigned int number;
 	dctool_output_t *output;
+	dc_divestore_t *store;
+	const dc_event_devinfo_t *devinfo;
+#ifdef HAVE_PTHREAD_H
+	// Queue of the dives for the output writer thread.
+	dive_item_t *queue[QUEUESIZE];
+	unsigned int head;
+	unsigned int count;
+	unsigned int done;
+	unsigned int started;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t notempty;
+	pthread_cond_t notfull;
+	// The store is accessed from both threads.
+	pthread_mutex_t storelock;
+#endif
 } dive_data_t;
 
+static void
+dive_lock_store (dive_data_t *divedata)
+{
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_lock (&divedata->storelock);
+#endif
+}
+
+static void
+dive_unlock_store (dive_data_t *divedata)
+{
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_unlock (&divedata->storelock);
+#endif
+}
+
+static void
+dive_item_free (dive_item_t *item)
+{
+	if (item == NULL)
+		return;
+
+	dc_parser_destroy (item->parser);
+	free (item->data);
+	free (item);
+}
+
+/*
+ * Write a downloaded dive to the output and the store. With threads,
+ * this runs on the output writer thread, concurrently with the
+ * download of the next dives.
+ */
+static void
+dive_write (dive_data_t *divedata, dive_item_t *item)
+{
+	dc_status_t rc = DC_STATUS_SUCCESS;
+
+	// Parse the dive data.
+	message ("Parsing the dive data.\n");
+	rc = dctool_output_write (divedata->output, item->parser, item->data, item->size, item->fingerprint, item->fsize);
+	if (rc != DC_STATUS_SUCCESS) {
+		ERROR ("Error parsing the dive data.");
+		goto cleanup;
+	}
+
+	// Add the dive to the store.
+	if (divedata->store) {
+		dc_divestore_summary_t summary;
+		rc = dc_divestore_summarize (item->parser, &summary);
+		if (rc != DC_STATUS_SUCCESS) {
+			ERROR ("Error summarizing the dive.");
+			goto cleanup;
+		}
+
+		message ("Adding the dive to the store.\n");
+		dive_lock_store (divedata);
+		rc = dc_divestore_add (divedata->store, dc_device_get_type (divedata->device),
+			divedata->devinfo->model, divedata->devinfo->serial, item->fingerprint, item->fsize,
+			item->data, item->size, &summary);
+		dive_unlock_store (divedata);
+		if (rc != DC_STATUS_SUCCESS) {
+			ERROR ("Error adding the dive to the store.");
+			goto cleanup;
+		}
+	}
+
+cleanup:
+	dive_item_free (item);
+}
+
+#ifdef HAVE_PTHREAD_H
+static void *
+dive_writer (void *userdata)
+{
+	dive_data_t *divedata = (dive_data_t *) userdata;
+
+	pthread_mutex_lock (&divedata->lock);
+	for (;;) {
+		while (divedata->count == 0 && !divedata->done) {
+			pthread_cond_wait (&divedata->notempty, &divedata->lock);
+		}
+
+		if (divedata->count == 0)
+			break;
+
+		dive_item_t *item = divedata->queue[divedata->head];
+		divedata->head = (divedata->head + 1) % QUEUESIZE;
+		divedata->count--;
+		pthread_cond_signal (&divedata->notfull);
+
+		pthread_mutex_unlock (&divedata->lock);
+		dive_write (divedata, item);
+		pthread_mutex_lock (&divedata->lock);
+	}
+	pthread_mutex_unlock (&divedata->lock);
+
+	return NULL;
+}
+#endif
+
+/*
+ * Start the output writer thread. If the thread can't be created, the
+ * dives are written synchronously from the dive callback instead.
+ */
+static void
+dive_writer_start (dive_data_t *divedata)
+{
+#ifdef HAVE_PTHREAD_H
+	divedata->head = 0;
+	divedata->count = 0;
+	divedata->done = 0;
+	divedata->started = 0;
+	pthread_mutex_init (&divedata->lock, NULL);
+	pthread_cond_init (&divedata->notempty, NULL);
+	pthread_cond_init (&divedata->notfull, NULL);
+	pthread_mutex_init (&divedata->storelock, NULL);
+
+	if (pthread_create (&divedata->thread, NULL, dive_writer, divedata) != 0) {
+		WARNING ("Failed to create the output writer thread.");
+		return;
+	}
+
+	divedata->started = 1;
+#endif
+}
+
+/*
+ * Wait until all queued dives are written, and stop the output writer
+ * thread.
+ */
+static void
+dive_writer_stop (dive_data_t *divedata)
+{
+#ifdef HAVE_PTHREAD_H
+	if (divedata->started) {
+		pthread_mutex_lock (&divedata->lock);
+		divedata->done = 1;
+		pthread_cond_signal (&divedata->notempty);
+		pthread_mutex_unlock (&divedata->lock);
+
+		pthread_join (divedata->thread, NULL);
+	}
+
+	pthread_mutex_destroy (&divedata->storelock);
+	pthread_cond_destroy (&divedata->notfull);
+	pthread_cond_destroy (&divedata->notempty);
+	pthread_mutex_destroy (&divedata->lock);
+#else
+	(void) divedata;
+#endif
+}
+
+/*
+ * Hand a dive over to the output writer thread. When the queue is
+ * full, the download waits until the writer catches up.
+ */
+static void
+dive_enqueue (dive_data_t *divedata, dive_item_t *item)
+{
+#ifdef HAVE_PTHREAD_H
+	if (divedata->started) {
+		pthread_mutex_lock (&divedata->lock);
+		while (divedata->count == QUEUESIZE) {
+			pthread_cond_wait (&divedata->notfull, &divedata->lock);
+		}
+
+		divedata->queue[(divedata->head + divedata->count) % QUEUESIZE] = item;
+		divedata->count++;
+		pthread_cond_signal (&divedata->notempty);
+		pthread_mutex_unlock (&divedata->lock);
+		return;
+	}
+#endif
+
+	dive_write (divedata, item);
+}
+
 static int
 dive_cb (const unsigned char *data, unsigned int size, const unsigned char *fingerprint, unsigned int fsize, void *userdata)
 {
 	dive_data_t *divedata = (dive_data_t *) userdata;
 	dc_status_t rc = DC_STATUS_SUCCESS;
-	dc_parser_t *parser = NULL;
+	dive_item_t *item = NULL;
 
 	divedata->number++;
 
@@ -67,6 +275,21 @@ dive_cb (const unsigned char *data, unsigned int size, const unsigned char *fing
 		message ("%02X", fingerprint[i]);
 	message ("\n");
 
+	// Stop at the first dive which is already in the store. Because the
+	// dives are downloaded in reverse order, all remaining dives are
+	// already present too.
+	if (divedata->store) {
+		dive_lock_store (divedata);
+		rc = dc_divestore_lookup (divedata->store, dc_device_get_type (divedata->device),
+			divedata->devinfo->model, divedata->devinfo->serial, fingerprint, fsize,
+			NULL, NULL, NULL);
+		dive_unlock_store (divedata);
+		if (rc == DC_STATUS_SUCCESS) {
+			message ("Dive already present in the store.\n");
+			return 0;
+		}
+	}
+
 	// Keep a copy of the most recent fingerprint. Because dives are
 	// guaranteed to be downloaded in reverse order, the most recent
 	// dive is always the first dive.
@@ -76,32 +299,49 @@ dive_cb (const unsigned char *data, unsigned int size, const unsigned char *fing
 		*divedata->fingerprint = fp;
 	}
 
-	// Create the parser.
+	// Copy the dive, because the data is only valid during the callback.
+	item = (dive_item_t *) malloc (sizeof (dive_item_t));
+	if (item == NULL) {
+		ERROR ("Failed to allocate memory.");
+		return 1;
+	}
+
+	item->parser = NULL;
+	item->data = (unsigned char *) malloc (size + fsize);
+	item->size = size;
+	item->fsize = fsize;
+	if (item->data == NULL) {
+		ERROR ("Failed to allocate memory.");
+		goto error;
+	}
+
+	item->fingerprint = item->data + size;
+	memcpy (item->data, data, size);
+	memcpy (item->fingerprint, fingerprint, fsize);
+
+	// Create the parser. This captures the current state of the device,
+	// so it's done here rather than on the writer thread.
 	message ("Creating the parser.\n");
-	rc = dc_parser_new (&parser, divedata->device);
+	rc = dc_parser_new (&item->parser, divedata->device);
 	if (rc != DC_STATUS_SUCCESS) {
 		ERROR ("Error creating the parser.");
-		goto cleanup;
+		goto error;
 	}
 
 	// Register the data.
 	message ("Registering the data.\n");
-	rc = dc_parser_set_data (parser, data, size);
+	rc = dc_parser_set_data (item->parser, item->data, item->size);
 	if (rc != DC_STATUS_SUCCESS) {
 		ERROR ("Error registering the data.");
-		goto cleanup;
+		goto error;
 	}
 
-	// Parse the dive data.
-	message ("Parsing the dive data.\n");
-	rc = dctool_output_write (divedata->output, parser, data, size, fingerprint, fsize);
-	if (rc != DC_STATUS_SUCCESS) {
-		ERROR ("Error parsing the dive data.");
-		goto cleanup;
-	}
+	dive_enqueue (divedata, item);
 
-cleanup:
-	dc_parser_destroy (parser);
+	return 1;
+
+error:
+	dive_item_free (item);
 	return 1;
 }
 
@@ -152,7 +392,7 @@ event_cb (dc_device_t *device, dc_event_type_t event, const void *data, void *us
 }
 
 static dc_status_t
-download (dc_context_t *context, dc_descriptor_t *descriptor, dc_transport_t transport, const char *devname, const char *cachedir, dc_buffer_t *fingerprint, dctool_output_t *output)
+download (dc_context_t *context, dc_descriptor_t *descriptor, dc_transport_t transport, const char *devname, const char *cachedir, dc_buffer_t *fingerprint, dc_divestore_t *store, dctool_output_t *output)
 {
 	dc_status_t rc = DC_STATUS_SUCCESS;
 	dc_iostream_t *iostream = NULL;
@@ -169,6 +409,9 @@ download (dc_context_t *context, dc_descriptor_t *descriptor, dc_transport_t tra
 		goto cleanup;
 	}
 
+	// Enable the I/O statistics.
+	dc_iostream_set_stats (iostream, 1);
+
 	// Open the device.
 	message ("Opening the device (%s %s).\n",
 		dc_descriptor_get_vendor (descriptor),
@@ -189,7 +432,7 @@ download (dc_context_t *context, dc_descriptor_t *descriptor, dc_transport_t tra
 
 	// Register the event handler.
 	message ("Registering the event handler.\n");
-	int events = DC_EVENT_WAITING | DC_EVENT_PROGRESS | DC_EVENT_DEVINFO | DC_EVENT_CLOCK | DC_EVENT_VENDOR;
+	int events = DC_EVENT_WAITING | DC_EVENT_PROGRESS | DC_EVENT_DEVINFO | DC_EVENT_CLOCK | DC_EVENT_VENDOR | DC_EVENT_CACHE | DC_EVENT_IOSTATS | DC_EVENT_CHECKPOINT | DC_EVENT_PROFILE | DC_EVENT_MEMORY;
 	rc = dc_device_set_events (device, events, event_cb, &eventdata);
 	if (rc != DC_STATUS_SUCCESS) {
 		ERROR ("Error registering the event handler.");
@@ -220,10 +463,14 @@ download (dc_context_t *context, dc_descriptor_t *descriptor, dc_transport_t tra
 	divedata.fingerprint = &ofingerprint;
 	divedata.number = 0;
 	divedata.output = output;
+	divedata.store = store;
+	divedata.devinfo = &eventdata.devinfo;
 
-	// Download the dives.
+	// Download the dives, while the output is written by another thread.
 	message ("Downloading the dives.\n");
+	dive_writer_start (&divedata);
 	rc = dc_device_foreach (device, dive_cb, &divedata);
+	dive_writer_stop (&divedata);
 	if (rc != DC_STATUS_SUCCESS) {
 		ERROR ("Error downloading the dives.");
 		goto cleanup;
@@ -257,6 +504,7 @@ dctool_download_run (int argc, char *argv[], dc_context_t *context, dc_descripto
 	dc_status_t status = DC_STATUS_SUCCESS;
 	dc_buffer_t *fingerprint = NULL;
 	dctool_output_t *output = NULL;
+	dc_divestore_t *store = NULL;
 	dctool_units_t units = DCTOOL_UNITS_METRIC;
 	dc_transport_t transport = dctool_transport_default (descriptor);
 
@@ -265,11 +513,12 @@ dctool_download_run (int argc, char *argv[], dc_context_t *context, dc_descripto
 	const char *fphex = NULL;
 	const char *filename = NULL;
 	const char *cachedir = NULL;
+	const char *storename = NULL;
 	const char *format = "xml";
 
 	// Parse the command-line options.
 	int opt = 0;
-	const char *optstring = "ht:o:p:c:f:u:";
+	const char *optstring = "ht:o:p:c:s:f:u:";
 #ifdef HAVE_GETOPT_LONG
 	struct option options[] = {
 		{"help",        no_argument,       0, 'h'},
@@ -277,6 +526,7 @@ dctool_download_run (int argc, char *argv[], dc_context_t *context, dc_descripto
 		{"output",      required_argument, 0, 'o'},
 		{"fingerprint", required_argument, 0, 'p'},
 		{"cache",       required_argument, 0, 'c'},
+		{"store",       required_argument, 0, 's'},
 		{"format",      required_argument, 0, 'f'},
 		{"units",       required_argument, 0, 'u'},
 		{0,             0,                 0,  0 }
@@ -301,6 +551,9 @@ dctool_download_run (int argc, char *argv[], dc_context_t *context, dc_descripto
 		case 'c':
 			cachedir = optarg;
 			break;
+		case 's':
+			storename = optarg;
+			break;
 		case 'f':
 			format = optarg;
 			break;
@@ -337,8 +590,14 @@ dctool_download_run (int argc, char *argv[], dc_context_t *context, dc_descripto
 	// Create the output.
 	if (strcasecmp(format, "raw") == 0) {
 		output = dctool_raw_output_new (filename);
+	} else if (strcasecmp(format, "pack") == 0) {
+		output = dctool_pack_output_new (filename);
 	} else if (strcasecmp(format, "xml") == 0) {
 		output = dctool_xml_output_new (filename, units);
+	} else if (strcasecmp(format, "json") == 0) {
+		output = dctool_json_output_new (filename, units);
+	} else if (strcasecmp(format, "columnar") == 0) {
+		output = dctool_columnar_output_new (filename);
 	} else {
 		message ("Unknown output format: %s\n", format);
 		exitcode = EXIT_FAILURE;
@@ -350,8 +609,18 @@ dctool_download_run (int argc, char *argv[], dc_context_t *context, dc_descripto
 		goto cleanup;
 	}
 
+	// Open the dive store.
+	if (storename) {
+		status = dc_divestore_open (&store, context, storename);
+		if (status != DC_STATUS_SUCCESS) {
+			message ("Failed to open the dive store.\n");
+			exitcode = EXIT_FAILURE;
+			goto cleanup;
+		}
+	}
+
 	// Download the dives.
-	status = download (context, descriptor, transport, argv[0], cachedir, fingerprint, output);
+	status = download (context, descriptor, transport, argv[0], cachedir, fingerprint, store, output);
 	if (status != DC_STATUS_SUCCESS) {
 		message ("ERROR: %s\n", dctool_errmsg (status));
 		exitcode = EXIT_FAILURE;
@@ -359,6 +628,7 @@ dctool_download_run (int argc, char *argv[], dc_context_t *context, dc_descripto
 	}
 
 cleanup:
+	dc_divestore_close (store);
 	dctool_output_free (output);
 	dc_buffer_free (fingerprint);
 	return exitcode;
@@ -379,6 +649,7 @@ const dctool_command_t dctool_download = {
 	"   -o, --output <filename>    Output filename\n"
 	"   -p, --fingerprint <data>   Fingerprint data (hexadecimal)\n"
 	"   -c, --cache <directory>    Cache directory\n"
+	"   -s, --store <filename>     Dive store\n"
 	"   -f, --format <format>      Output format\n"
 	"   -u, --units <units>        Set units (metric or imperial)\n"
 #else
@@ -387,6 +658,7 @@ const dctool_command_t dctool_download = {
 	"   -o <filename>      Output filename\n"
 	"   -p <fingerprint>   Fingerprint data (hexadecimal)\n"
 	"   -c <directory>     Cache directory\n"
+	"   -s <filename>      Dive store\n"
 	"   -f <format>        Output format\n"
 	"   -u <units>         Set units (metric or imperial)\n"
 #endif
@@ -397,12 +669,27 @@ const dctool_command_t dctool_download = {
 	"\n"
 	"      All dives are exported to a single xml file.\n"
 	"\n"
+	"   JSON\n"
+	"\n"
+	"      All dives are exported to a single file, with one json object\n"
+	"      per line (JSON Lines).\n"
+	"\n"
+	"   COLUMNAR\n"
+	"\n"
+	"      The samples of all dives are exported to a single binary file,\n"
+	"      in the columnar sample format of the library.\n"
+	"\n"
 	"   RAW\n"
 	"\n"
 	"      Each dive is exported to a raw (binary) file. To output multiple\n"
 	"      files, the filename is interpreted as a template and should\n"
 	"      contain one or more placeholders.\n"
 	"\n"
+	"   PACK\n"
+	"\n"
+	"      All raw dives are appended to a single packed archive, which\n"
+	"      can be parsed again with the --pack option of the parse command.\n"
+	"\n"
 	"Supported template placeholders:\n"
 	"\n"
 	"   %f   Fingerprint (hexadecimal format)\n"
@@ -101,6 +101,9 @@ dump (dc_context_t *context, dc_descriptor_t *descriptor, dc_transport_t transpo
 		goto cleanup;
 	}
 
+	message ("Downloaded %u bytes (%u allocations).\n",
+		(unsigned int) dc_buffer_get_size (buffer), dc_buffer_get_allocations (buffer));
+
 cleanup:
 	dc_device_close (device);
 	dc_iostream_close (iostream);
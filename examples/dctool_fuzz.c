@@ -0,0 +1,417 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#ifdef HAVE_GETOPT_H
+#include <getopt.h>
+#endif
+
+#include <libdivecomputer/context.h>
+#include <libdivecomputer/descriptor.h>
+#include <libdivecomputer/parser.h>
+
+#include "dctool.h"
+#include "common.h"
+#include "utils.h"
+
+#define NSTRINGS 100
+
+// Upper limit for the number of gas mixes and tanks which are queried.
+// Corrupted data can easily report an absurd number of items, and
+// querying them all would measure the harness instead of the parser.
+#define NITEMS 256
+
+typedef struct fuzz_t {
+	unsigned long long state;
+	unsigned long long inputs;
+	unsigned long long errors;
+	unsigned long long slow;
+	unsigned long long samples;
+	double slowest;
+} fuzz_t;
+
+/*
+ * A small xorshift generator, to get the same sequence of mutations
+ * for the same seed on every platform.
+ */
+static unsigned int
+fuzz_random (fuzz_t *fuzz)
+{
+	unsigned long long x = fuzz->state;
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	fuzz->state = x;
+	return (unsigned int) ((x * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+static unsigned int
+fuzz_range (fuzz_t *fuzz, unsigned int n)
+{
+	return n ? fuzz_random (fuzz) % n : 0;
+}
+
+/*
+ * Apply a random mutation to the input. The mutations mimic the typical
+ * corruptions of a dump: flipped bits, overwritten or erased runs of
+ * bytes, repeated blocks and truncated data.
+ */
+static dc_status_t
+fuzz_mutate (fuzz_t *fuzz, dc_buffer_t *buffer, dc_buffer_t *input, unsigned int mutate)
+{
+	const unsigned char *data = dc_buffer_get_data (input);
+	size_t size = dc_buffer_get_size (input);
+
+	if (!dc_buffer_clear (buffer) ||
+		!dc_buffer_append (buffer, data, size))
+		return DC_STATUS_NOMEMORY;
+
+	if (!mutate || size == 0)
+		return DC_STATUS_SUCCESS;
+
+	unsigned char *p = dc_buffer_get_data (buffer);
+	unsigned int offset = fuzz_range (fuzz, size);
+	unsigned int length = 1 + fuzz_range (fuzz, size - offset < 64 ? size - offset : 64);
+
+	switch (fuzz_range (fuzz, 5)) {
+	case 0: // Flip some bits.
+		for (unsigned int i = 0, n = 1 + fuzz_range (fuzz, 8); i < n; ++i) {
+			unsigned int bit = fuzz_range (fuzz, size * 8);
+			p[bit / 8] ^= 1 << (bit % 8);
+		}
+		break;
+	case 1: // Overwrite a run with a constant.
+		memset (p + offset, fuzz_range (fuzz, 2) ? 0xFF : 0x00, length);
+		break;
+	case 2: // Overwrite a run with random data.
+		for (unsigned int i = 0; i < length; ++i)
+			p[offset + i] = fuzz_random (fuzz) & 0xFF;
+		break;
+	case 3: // Repeat a block.
+		if (!dc_buffer_slice (buffer, 0, offset + length) ||
+			!dc_buffer_append (buffer, data + offset, size - offset))
+			return DC_STATUS_NOMEMORY;
+		break;
+	default: // Truncate.
+		if (!dc_buffer_slice (buffer, 0, offset))
+			return DC_STATUS_NOMEMORY;
+		break;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+static void
+sample_cb (dc_sample_type_t type, dc_sample_value_t value, void *userdata)
+{
+	fuzz_t *fuzz = (fuzz_t *) userdata;
+
+	if (type == DC_SAMPLE_TIME)
+		fuzz->samples++;
+}
+
+/*
+ * Exercise the parser the same way an application would do. Errors are
+ * expected for corrupted data, and only counted.
+ */
+static dc_status_t
+fuzz_parse (dc_parser_t *parser, dc_buffer_t *buffer, fuzz_t *fuzz)
+{
+	dc_status_t rc = DC_STATUS_SUCCESS;
+
+	rc = dc_parser_set_data (parser, dc_buffer_get_data (buffer), dc_buffer_get_size (buffer));
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	dc_datetime_t datetime = {0};
+	dc_parser_get_datetime (parser, &datetime);
+
+	static const dc_field_type_t fields[] = {
+		DC_FIELD_DIVETIME,
+		DC_FIELD_MAXDEPTH,
+		DC_FIELD_AVGDEPTH,
+		DC_FIELD_SALINITY,
+		DC_FIELD_ATMOSPHERIC,
+		DC_FIELD_TEMPERATURE_SURFACE,
+		DC_FIELD_TEMPERATURE_MINIMUM,
+		DC_FIELD_TEMPERATURE_MAXIMUM,
+		DC_FIELD_DIVEMODE,
+		DC_FIELD_LOCATION,
+	};
+	for (unsigned int i = 0; i < sizeof (fields) / sizeof (fields[0]); ++i) {
+		union {
+			unsigned int number;
+			double real;
+			dc_salinity_t salinity;
+			dc_divemode_t divemode;
+			dc_location_t location;
+		} value;
+		dc_parser_get_field (parser, fields[i], 0, &value);
+	}
+
+	unsigned int ngases = 0;
+	if (dc_parser_get_field (parser, DC_FIELD_GASMIX_COUNT, 0, &ngases) != DC_STATUS_SUCCESS)
+		ngases = 0;
+	for (unsigned int i = 0; i < ngases && i < NITEMS; ++i) {
+		dc_gasmix_t gasmix = {0};
+		dc_parser_get_field (parser, DC_FIELD_GASMIX, i, &gasmix);
+	}
+
+	unsigned int ntanks = 0;
+	if (dc_parser_get_field (parser, DC_FIELD_TANK_COUNT, 0, &ntanks) != DC_STATUS_SUCCESS)
+		ntanks = 0;
+	for (unsigned int i = 0; i < ntanks && i < NITEMS; ++i) {
+		dc_tank_t tank = {0};
+		dc_parser_get_field (parser, DC_FIELD_TANK, i, &tank);
+	}
+
+	for (unsigned int i = 0; i < NSTRINGS; ++i) {
+		dc_field_string_t str = {NULL};
+		rc = dc_parser_get_field (parser, DC_FIELD_STRING, i, &str);
+		if (rc != DC_STATUS_SUCCESS || !str.desc || !str.value)
+			break;
+	}
+
+	return dc_parser_samples_foreach (parser, sample_cb, fuzz);
+}
+
+static int
+dctool_fuzz_run (int argc, char *argv[], dc_context_t *context, dc_descriptor_t *descriptor)
+{
+	// Default values.
+	int exitcode = EXIT_SUCCESS;
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_context_t *fcontext = NULL;
+	dc_parser_t *parser = NULL;
+	dc_buffer_t *input = NULL;
+	dc_buffer_t *buffer = NULL;
+	dc_buffer_t *slowest = NULL;
+	fuzz_t fuzz = {0};
+
+	// Default option values.
+	unsigned int help = 0;
+	const char *filename = NULL;
+	unsigned int iterations = 1000;
+	unsigned int budget = 100;
+	unsigned long long seed = 1;
+
+	// Parse the command-line options.
+	int opt = 0;
+	const char *optstring = "ho:n:b:S:";
+#ifdef HAVE_GETOPT_LONG
+	struct option options[] = {
+		{"help",        no_argument,       0, 'h'},
+		{"output",      required_argument, 0, 'o'},
+		{"iterations",  required_argument, 0, 'n'},
+		{"budget",      required_argument, 0, 'b'},
+		{"seed",        required_argument, 0, 'S'},
+		{0,             0,                 0,  0 }
+	};
+	while ((opt = getopt_long (argc, argv, optstring, options, NULL)) != -1) {
+#else
+	while ((opt = getopt (argc, argv, optstring)) != -1) {
+#endif
+		switch (opt) {
+		case 'h':
+			help = 1;
+			break;
+		case 'o':
+			filename = optarg;
+			break;
+		case 'n':
+			iterations = strtoul (optarg, NULL, 0);
+			break;
+		case 'b':
+			budget = strtoul (optarg, NULL, 0);
+			break;
+		case 'S':
+			seed = strtoull (optarg, NULL, 0);
+			break;
+		default:
+			return EXIT_FAILURE;
+		}
+	}
+
+	argc -= optind;
+	argv += optind;
+
+	// Show help message.
+	if (help) {
+		dctool_command_showhelp (&dctool_fuzz);
+		return EXIT_SUCCESS;
+	}
+
+	if (argc == 0) {
+		dctool_command_showhelp (&dctool_fuzz);
+		return EXIT_FAILURE;
+	}
+
+	// The xorshift generator gets stuck on a zero state.
+	fuzz.state = seed ? seed : 1;
+
+	buffer = dc_buffer_new (0);
+	slowest = dc_buffer_new (0);
+	if (buffer == NULL || slowest == NULL) {
+		message ("Failed to allocate memory.\n");
+		exitcode = EXIT_FAILURE;
+		goto cleanup;
+	}
+
+	// Use a separate context with logging disabled, because corrupted
+	// data produces a flood of warnings.
+	status = dc_context_new (&fcontext);
+	if (status != DC_STATUS_SUCCESS) {
+		message ("ERROR: %s\n", dctool_errmsg (status));
+		exitcode = EXIT_FAILURE;
+		goto cleanup;
+	}
+	dc_context_set_loglevel (fcontext, DC_LOGLEVEL_NONE);
+
+	// Create the parser. The same parser is reused for all inputs, to
+	// catch state which leaks from one dive into the next one.
+	status = dc_parser_new2 (&parser, fcontext, descriptor, 0, 0);
+	if (status != DC_STATUS_SUCCESS) {
+		message ("ERROR: %s\n", dctool_errmsg (status));
+		exitcode = EXIT_FAILURE;
+		goto cleanup;
+	}
+
+	for (int i = 0; i < argc; ++i) {
+		input = dctool_file_read (argv[i]);
+		if (input == NULL) {
+			message ("Failed to open the input file '%s'.\n", argv[i]);
+			exitcode = EXIT_FAILURE;
+			goto cleanup;
+		}
+
+		// The unmodified input is parsed first.
+		for (unsigned int n = 0; n <= iterations; ++n) {
+			status = fuzz_mutate (&fuzz, buffer, input, n);
+			if (status != DC_STATUS_SUCCESS) {
+				message ("ERROR: %s\n", dctool_errmsg (status));
+				exitcode = EXIT_FAILURE;
+				goto cleanup;
+			}
+
+			double begin = dctool_timestamp ();
+			status = fuzz_parse (parser, buffer, &fuzz);
+			double elapsed = (dctool_timestamp () - begin) * 1000.0;
+
+			fuzz.inputs++;
+			if (status != DC_STATUS_SUCCESS)
+				fuzz.errors++;
+
+			if (elapsed > budget) {
+				message ("%s: input %u took %.1f ms (budget %u ms)\n",
+					argv[i], n, elapsed, budget);
+				fuzz.slow++;
+			}
+
+			if (elapsed > fuzz.slowest) {
+				fuzz.slowest = elapsed;
+				if (!dc_buffer_clear (slowest) ||
+					!dc_buffer_append (slowest, dc_buffer_get_data (buffer), dc_buffer_get_size (buffer))) {
+					message ("Failed to allocate memory.\n");
+					exitcode = EXIT_FAILURE;
+					goto cleanup;
+				}
+			}
+		}
+
+		dc_buffer_free (input);
+		input = NULL;
+	}
+
+	// Keep the slowest input, to reproduce the problem with the parse
+	// or benchmark command.
+	if (filename) {
+		dctool_file_write (filename, slowest);
+	}
+
+	printf (
+		"{\n"
+		"   \"vendor\": \"%s\",\n"
+		"   \"product\": \"%s\",\n"
+		"   \"family\": \"%s\",\n"
+		"   \"model\": %u,\n"
+		"   \"seed\": %llu,\n"
+		"   \"inputs\": %llu,\n"
+		"   \"errors\": %llu,\n"
+		"   \"samples\": %llu,\n"
+		"   \"budget_ms\": %u,\n"
+		"   \"slowest_ms\": %.3f,\n"
+		"   \"over_budget\": %llu\n"
+		"}\n",
+		dc_descriptor_get_vendor (descriptor),
+		dc_descriptor_get_product (descriptor),
+		dctool_family_name (dc_descriptor_get_type (descriptor)),
+		dc_descriptor_get_model (descriptor),
+		seed, fuzz.inputs, fuzz.errors, fuzz.samples,
+		budget, fuzz.slowest, fuzz.slow);
+
+	if (fuzz.slow)
+		exitcode = EXIT_FAILURE;
+
+cleanup:
+	dc_parser_destroy (parser);
+	dc_context_free (fcontext);
+	dc_buffer_free (input);
+	dc_buffer_free (slowest);
+	dc_buffer_free (buffer);
+	return exitcode;
+}
+
+const dctool_command_t dctool_fuzz = {
+	dctool_fuzz_run,
+	DCTOOL_CONFIG_DESCRIPTOR,
+	"fuzz",
+	"Parse corrupted copies of previously downloaded dives",
+	"Usage:\n"
+	"   dctool fuzz [options] <filename> [<filename> ...]\n"
+	"\n"
+	"Each file contains one raw dive, as written by the raw output of the\n"
+	"download command. Every dive is parsed once unmodified, followed by\n"
+	"the requested number of randomly corrupted copies. Inputs which take\n"
+	"longer to parse than the time budget are reported, and cause a non-zero\n"
+	"exit code. The summary is written in JSON format.\n"
+	"\n"
+	"Options:\n"
+#ifdef HAVE_GETOPT_LONG
+	"   -h, --help                 Show help message\n"
+	"   -o, --output <filename>    Save the slowest input\n"
+	"   -n, --iterations <count>   Number of corrupted copies (default 1000)\n"
+	"   -b, --budget <ms>          Time budget per input (default 100)\n"
+	"   -S, --seed <value>         Random seed (default 1)\n"
+#else
+	"   -h              Show help message\n"
+	"   -o <filename>   Save the slowest input\n"
+	"   -n <count>      Number of corrupted copies (default 1000)\n"
+	"   -b <ms>         Time budget per input (default 100)\n"
+	"   -S <value>      Random seed (default 1)\n"
+#endif
+};
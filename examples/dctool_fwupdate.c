@@ -87,12 +87,14 @@ fwupdate (dc_context_t *context, dc_descriptor_t *descriptor, dc_transport_t tra
 	// Update the firmware.
 	message ("Updating the firmware.\n");
 	switch (dc_device_get_type (device)) {
+#ifndef DISABLE_BACKEND_HW
 	case DC_FAMILY_HW_OSTC:
 		rc = hw_ostc_device_fwupdate (device, hexfile);
 		break;
 	case DC_FAMILY_HW_OSTC3:
 		rc = hw_ostc3_device_fwupdate (device, hexfile);
 		break;
+#endif
 	default:
 		rc = DC_STATUS_UNSUPPORTED;
 		break;
@@ -30,6 +30,9 @@
 #ifdef HAVE_GETOPT_H
 #include <getopt.h>
 #endif
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
 
 #include <libdivecomputer/context.h>
 #include <libdivecomputer/descriptor.h>
@@ -38,45 +41,198 @@
 #include "dctool.h"
 #include "output.h"
 #include "common.h"
+#include "pack.h"
 #include "utils.h"
 
 #define REACTPROWHITE 0x4354
 
+typedef struct parse_state_t {
+	dc_context_t *context;
+	dc_descriptor_t *descriptor;
+	unsigned int devtime;
+	dc_ticks_t systime;
+	dctool_output_t *output;
+	char **filenames;
+	// In pack mode, the dives of all archives instead of the files.
+	dctool_pack_dive_t *dives;
+	unsigned int count;
+	unsigned int parallel;
+	// Index of the next file to parse, and of the next file to write.
+	unsigned int next;
+	unsigned int written;
+	dc_status_t status;
+	// Statistics.
+	unsigned int parsed;
+	unsigned long long bytes;
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+#endif
+} parse_state_t;
+
 static dc_status_t
-parse (dc_buffer_t *buffer, dc_context_t *context, dc_descriptor_t *descriptor, unsigned int devtime, dc_ticks_t systime, dctool_output_t *output)
+parse (const dctool_pack_dive_t *dive, dc_parser_t *parser, dctool_output_t *output)
 {
 	dc_status_t rc = DC_STATUS_SUCCESS;
-	dc_parser_t *parser = NULL;
-	unsigned char *data = dc_buffer_get_data (buffer);
-	unsigned int size = dc_buffer_get_size (buffer);
-
-	// Create the parser.
-	message ("Creating the parser.\n");
-	rc = dc_parser_new2 (&parser, context, descriptor, devtime, systime);
-	if (rc != DC_STATUS_SUCCESS) {
-		ERROR ("Error creating the parser.");
-		goto cleanup;
-	}
+	const unsigned char *data = dive->data;
+	unsigned int size = dive->size;
 
 	// Register the data.
 	message ("Registering the data.\n");
 	rc = dc_parser_set_data (parser, data, size);
 	if (rc != DC_STATUS_SUCCESS) {
 		ERROR ("Error registering the data.");
-		goto cleanup;
+		return rc;
 	}
 
 	// Parse the dive data.
 	message ("Parsing the dive data.\n");
-	rc = dctool_output_write (output, parser, data, size, NULL, 0);
+	rc = dctool_output_write (output, parser, data, size, dive->fingerprint, dive->fsize);
 	if (rc != DC_STATUS_SUCCESS) {
 		ERROR ("Error parsing the dive data.");
+		return rc;
+	}
+
+	return rc;
+}
+
+static void
+parse_lock (parse_state_t *state)
+{
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_lock (&state->lock);
+#endif
+}
+
+static void
+parse_unlock (parse_state_t *state)
+{
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_unlock (&state->lock);
+#endif
+}
+
+/*
+ * Wait until all files before the given index are written. Without
+ * threads, the files are parsed in order and there is nothing to wait
+ * for.
+ */
+static void
+parse_wait (parse_state_t *state, unsigned int index)
+{
+#ifdef HAVE_PTHREAD_H
+	while (state->written != index) {
+		pthread_cond_wait (&state->cond, &state->lock);
+	}
+#endif
+}
+
+static void
+parse_done (parse_state_t *state)
+{
+	state->written++;
+#ifdef HAVE_PTHREAD_H
+	pthread_cond_broadcast (&state->cond);
+#endif
+}
+
+/*
+ * Parse files from the work queue until it's empty. In parallel mode,
+ * every worker renders its dives into a fork of the output, which is
+ * appended to the real output in the order of the input files.
+ */
+static void *
+parse_worker (void *userdata)
+{
+	parse_state_t *state = (parse_state_t *) userdata;
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_parser_t *parser = NULL;
+	dctool_output_t *fork = NULL;
+
+	// Create the parser. The same parser is reused for all dives.
+	message ("Creating the parser.\n");
+	status = dc_parser_new2 (&parser, state->context, state->descriptor, state->devtime, state->systime);
+	if (status != DC_STATUS_SUCCESS) {
+		message ("ERROR: %s\n", dctool_errmsg (status));
 		goto cleanup;
 	}
 
+	if (state->parallel) {
+		fork = dctool_output_fork (state->output);
+		if (fork == NULL) {
+			message ("Failed to create the output.\n");
+			status = DC_STATUS_NOMEMORY;
+			goto cleanup;
+		}
+	}
+
+	for (;;) {
+		parse_lock (state);
+		if (state->next >= state->count || state->status != DC_STATUS_SUCCESS) {
+			parse_unlock (state);
+			break;
+		}
+		unsigned int index = state->next++;
+		parse_unlock (state);
+
+		// Read the input file, or take the dive from the archive.
+		dc_buffer_t *buffer = NULL;
+		dctool_pack_dive_t dive = {0};
+		if (state->dives) {
+			dive = state->dives[index];
+			status = DC_STATUS_SUCCESS;
+		} else if ((buffer = dctool_file_read (state->filenames[index])) == NULL) {
+			message ("Failed to open the input file.\n");
+			status = DC_STATUS_IO;
+		} else {
+			dive.data = dc_buffer_get_data (buffer);
+			dive.size = dc_buffer_get_size (buffer);
+			status = DC_STATUS_SUCCESS;
+		}
+
+		if (status == DC_STATUS_SUCCESS && fork) {
+			// Parse the dive, outside the lock.
+			dctool_output_set_number (fork, index);
+			status = parse (&dive, parser, fork);
+		}
+
+		parse_lock (state);
+		parse_wait (state, index);
+		if (state->status == DC_STATUS_SUCCESS) {
+			if (status == DC_STATUS_SUCCESS) {
+				if (fork) {
+					status = dctool_output_join (state->output, fork);
+				} else {
+					status = parse (&dive, parser, state->output);
+				}
+			}
+			if (status == DC_STATUS_SUCCESS) {
+				state->parsed++;
+				state->bytes += dive.size;
+			} else if (state->dives) {
+				message ("ERROR: dive %u: %s\n", index, dctool_errmsg (status));
+				state->status = status;
+			} else {
+				message ("ERROR: %s: %s\n", state->filenames[index], dctool_errmsg (status));
+				state->status = status;
+			}
+		}
+		parse_done (state);
+		parse_unlock (state);
+
+		dc_buffer_free (buffer);
+	}
+
 cleanup:
+	if (status != DC_STATUS_SUCCESS) {
+		parse_lock (state);
+		if (state->status == DC_STATUS_SUCCESS)
+			state->status = status;
+		parse_unlock (state);
+	}
+	dctool_output_free (fork);
 	dc_parser_destroy (parser);
-	return rc;
+	return NULL;
 }
 
 static int
@@ -84,20 +240,25 @@ dctool_parse_run (int argc, char *argv[], dc_context_t *context, dc_descriptor_t
 {
 	// Default values.
 	int exitcode = EXIT_SUCCESS;
-	dc_status_t status = DC_STATUS_SUCCESS;
-	dc_buffer_t *buffer = NULL;
 	dctool_output_t *output = NULL;
 	dctool_units_t units = DCTOOL_UNITS_METRIC;
+	dctool_pack_t **packs = NULL;
+	dctool_pack_dive_t *dives = NULL;
+	unsigned int npacks = 0;
+	unsigned int count = 0;
 
 	// Default option values.
 	unsigned int help = 0;
+	unsigned int pack = 0;
 	const char *filename = NULL;
 	unsigned int devtime = 0;
 	dc_ticks_t systime = 0;
+	unsigned int njobs = 1;
+	const char *format = "xml";
 
 	// Parse the command-line options.
 	int opt = 0;
-	const char *optstring = "ho:d:s:u:";
+	const char *optstring = "ho:d:s:u:j:f:p";
 #ifdef HAVE_GETOPT_LONG
 	struct option options[] = {
 		{"help",        no_argument,       0, 'h'},
@@ -105,6 +266,9 @@ dctool_parse_run (int argc, char *argv[], dc_context_t *context, dc_descriptor_t
 		{"devtime",     required_argument, 0, 'd'},
 		{"systime",     required_argument, 0, 's'},
 		{"units",       required_argument, 0, 'u'},
+		{"jobs",        required_argument, 0, 'j'},
+		{"format",      required_argument, 0, 'f'},
+		{"pack",        no_argument,       0, 'p'},
 		{0,             0,                 0,  0 }
 	};
 	while ((opt = getopt_long (argc, argv, optstring, options, NULL)) != -1) {
@@ -130,6 +294,15 @@ dctool_parse_run (int argc, char *argv[], dc_context_t *context, dc_descriptor_t
 			if (strcmp (optarg, "imperial") == 0)
 				units = DCTOOL_UNITS_IMPERIAL;
 			break;
+		case 'j':
+			njobs = strtoul (optarg, NULL, 0);
+			break;
+		case 'f':
+			format = optarg;
+			break;
+		case 'p':
+			pack = 1;
+			break;
 		default:
 			return EXIT_FAILURE;
 		}
@@ -145,37 +318,144 @@ dctool_parse_run (int argc, char *argv[], dc_context_t *context, dc_descriptor_t
 	}
 
 	// Create the output.
-	output = dctool_xml_output_new (filename, units);
+	if (strcasecmp(format, "xml") == 0) {
+		output = dctool_xml_output_new (filename, units);
+	} else if (strcasecmp(format, "json") == 0) {
+		output = dctool_json_output_new (filename, units);
+	} else if (strcasecmp(format, "columnar") == 0) {
+		output = dctool_columnar_output_new (filename);
+	} else {
+		message ("Unknown output format: %s\n", format);
+		exitcode = EXIT_FAILURE;
+		goto cleanup;
+	}
 	if (output == NULL) {
 		message ("Failed to create the output.\n");
 		exitcode = EXIT_FAILURE;
 		goto cleanup;
 	}
 
-	for (unsigned int i = 0; i < argc; ++i) {
-		// Read the input file.
-		buffer = dctool_file_read (argv[i]);
-		if (buffer == NULL) {
-			message ("Failed to open the input file.\n");
+	// Open the packed archives, and collect all their dives. The dive
+	// data is parsed directly from the archives.
+	count = argc;
+	if (pack) {
+		packs = (dctool_pack_t **) malloc ((argc ? argc : 1) * sizeof (dctool_pack_t *));
+		if (packs == NULL) {
+			message ("Failed to allocate memory.\n");
 			exitcode = EXIT_FAILURE;
 			goto cleanup;
 		}
 
-		// Parse the dive.
-		status = parse (buffer, context, descriptor, devtime, systime, output);
-		if (status != DC_STATUS_SUCCESS) {
-			message ("ERROR: %s\n", dctool_errmsg (status));
+		count = 0;
+		for (int i = 0; i < argc; ++i) {
+			dc_status_t rc = dctool_pack_open (&packs[npacks], argv[i]);
+			if (rc != DC_STATUS_SUCCESS) {
+				message ("ERROR: %s: %s\n", argv[i], dctool_errmsg (rc));
+				exitcode = EXIT_FAILURE;
+				goto cleanup;
+			}
+			count += dctool_pack_get_count (packs[npacks]);
+			npacks++;
+		}
+
+		dives = (dctool_pack_dive_t *) malloc ((count ? count : 1) * sizeof (dctool_pack_dive_t));
+		if (dives == NULL) {
+			message ("Failed to allocate memory.\n");
 			exitcode = EXIT_FAILURE;
 			goto cleanup;
 		}
 
-		// Cleanup.
-		dc_buffer_free (buffer);
-		buffer = NULL;
+		unsigned int n = 0;
+		for (unsigned int i = 0; i < npacks; ++i) {
+			unsigned int ndives = dctool_pack_get_count (packs[i]);
+			for (unsigned int j = 0; j < ndives; ++j) {
+				dctool_pack_get_dive (packs[i], j, &dives[n++]);
+			}
+		}
+	}
+
+#ifdef HAVE_PTHREAD_H
+	if (njobs == 0)
+		njobs = 1;
+	if (njobs > count)
+		njobs = count ? count : 1;
+#else
+	njobs = 1;
+#endif
+
+	parse_state_t state;
+	state.context = context;
+	state.descriptor = descriptor;
+	state.devtime = devtime;
+	state.systime = systime;
+	state.output = output;
+	state.filenames = argv;
+	state.dives = dives;
+	state.count = count;
+	state.parallel = njobs > 1;
+	state.next = 0;
+	state.written = 0;
+	state.status = DC_STATUS_SUCCESS;
+	state.parsed = 0;
+	state.bytes = 0;
+
+	double begin = dctool_timestamp ();
+
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_init (&state.lock, NULL);
+	pthread_cond_init (&state.cond, NULL);
+
+	pthread_t *threads = NULL;
+	if (njobs > 1) {
+		threads = (pthread_t *) malloc ((njobs - 1) * sizeof (pthread_t));
+		if (threads == NULL)
+			njobs = 1;
+	}
+
+	// Start the extra workers. If a thread can't be created, the files
+	// are simply shared by fewer workers.
+	unsigned int nstarted = 0;
+	for (unsigned int i = 1; i < njobs; ++i) {
+		if (pthread_create (&threads[nstarted], NULL, parse_worker, &state) != 0) {
+			WARNING ("Failed to create a worker thread.");
+			break;
+		}
+		nstarted++;
+	}
+
+	// The calling thread is one of the workers.
+	parse_worker (&state);
+
+	for (unsigned int i = 0; i < nstarted; ++i) {
+		pthread_join (threads[i], NULL);
+	}
+
+	free (threads);
+
+	pthread_cond_destroy (&state.cond);
+	pthread_mutex_destroy (&state.lock);
+#else
+	parse_worker (&state);
+#endif
+
+	double elapsed = dctool_timestamp () - begin;
+
+	if (state.status != DC_STATUS_SUCCESS) {
+		exitcode = EXIT_FAILURE;
 	}
 
+	const char *unit = dives ? "dives" : "files";
+	message ("Parsed %u of %u %s (%llu bytes) in %.3f seconds with %u jobs: %.1f %s/s, %.2f MB/s.\n",
+		state.parsed, state.count, unit, state.bytes, elapsed, njobs,
+		elapsed > 0.0 ? state.parsed / elapsed : 0.0, unit,
+		elapsed > 0.0 ? state.bytes / elapsed / 1000000.0 : 0.0);
+
 cleanup:
-	dc_buffer_free (buffer);
+	for (unsigned int i = 0; i < npacks; ++i) {
+		dctool_pack_close (packs[i]);
+	}
+	free (packs);
+	free (dives);
 	dctool_output_free (output);
 	return exitcode;
 }
@@ -186,7 +466,8 @@ const dctool_command_t dctool_parse = {
 	"parse",
 	"Parse previously downloaded dives",
 	"Usage:\n"
-	"   dctool parse [options] <filename>\n"
+	"   dctool parse [options] <filename> [<filename> ...]\n"
+	"   dctool parse [options] --pack <archive> [<archive> ...]\n"
 	"\n"
 	"Options:\n"
 #ifdef HAVE_GETOPT_LONG
@@ -195,11 +476,17 @@ const dctool_command_t dctool_parse = {
 	"   -d, --devtime <timestamp>  Device time\n"
 	"   -s, --systime <timestamp>  System time\n"
 	"   -u, --units <units>        Set units (metric or imperial)\n"
+	"   -j, --jobs <count>         Number of files parsed in parallel\n"
+	"   -f, --format <format>      Output format (xml, json or columnar)\n"
+	"   -p, --pack                 Parse all dives in packed archives\n"
 #else
 	"   -h              Show help message\n"
 	"   -o <filename>   Output filename\n"
 	"   -d <devtime>    Device time\n"
 	"   -s <systime>    System time\n"
 	"   -u <units>      Set units (metric or imperial)\n"
+	"   -j <count>      Number of files parsed in parallel\n"
+	"   -f <format>     Output format (xml, json or columnar)\n"
+	"   -p              Parse all dives in packed archives\n"
 #endif
 };
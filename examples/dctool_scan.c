@@ -37,13 +37,78 @@
 #include <libdivecomputer/irda.h>
 #include <libdivecomputer/bluetooth.h>
 #include <libdivecomputer/usbhid.h>
+#include <libdivecomputer/scan.h>
 
 #include "dctool.h"
 #include "common.h"
 #include "utils.h"
 
+static void
+scan_print (dc_transport_t transport, void *device)
+{
+	char buffer[DC_BLUETOOTH_SIZE];
+
+	switch (transport) {
+	case DC_TRANSPORT_SERIAL:
+		printf ("%s\n", dc_serial_device_get_name (device));
+		dc_serial_device_free (device);
+		break;
+	case DC_TRANSPORT_IRDA:
+		printf ("%08x\t%s\n", dc_irda_device_get_address (device), dc_irda_device_get_name (device));
+		dc_irda_device_free (device);
+		break;
+	case DC_TRANSPORT_BLUETOOTH:
+		printf ("%s\t%s\n",
+			dc_bluetooth_addr2str(dc_bluetooth_device_get_address (device), buffer, sizeof(buffer)),
+			dc_bluetooth_device_get_name (device));
+		dc_bluetooth_device_free (device);
+		break;
+	case DC_TRANSPORT_USBHID:
+		printf ("%04x:%04x\n", dc_usbhid_device_get_vid (device), dc_usbhid_device_get_pid (device));
+		dc_usbhid_device_free (device);
+		break;
+	default:
+		break;
+	}
+}
+
+static int
+scan_all_cb (dc_transport_t transport, void *device, void *userdata)
+{
+	// Prefix the devices with their transport, and print them right
+	// away, so the fast transports show up before a slow inquiry ends.
+	printf ("%s\t", dctool_transport_name (transport));
+	scan_print (transport, device);
+	fflush (stdout);
+
+	return 1;
+}
+
 static dc_status_t
-scan (dc_context_t *context, dc_descriptor_t *descriptor, dc_transport_t transport)
+scan_all (dc_context_t *context, dc_descriptor_t *descriptor, unsigned int paired, unsigned int timeout)
+{
+	unsigned int transports =
+		DC_TRANSPORT_SERIAL | DC_TRANSPORT_IRDA |
+		DC_TRANSPORT_BLUETOOTH | DC_TRANSPORT_USBHID;
+
+	// Scan only the transports supported by the device.
+	if (descriptor)
+		transports &= dc_descriptor_get_transports (descriptor);
+
+	dc_status_t status = dc_scan_all (context, descriptor, transports,
+		paired ? DC_BLUETOOTH_PAIRED : 0, timeout, scan_all_cb, NULL);
+	if (status == DC_STATUS_TIMEOUT) {
+		message ("Scan stopped after %u ms.\n", timeout);
+		status = DC_STATUS_SUCCESS;
+	} else if (status != DC_STATUS_SUCCESS) {
+		ERROR ("Failed to enumerate the devices.");
+	}
+
+	return status;
+}
+
+static dc_status_t
+scan (dc_context_t *context, dc_descriptor_t *descriptor, dc_transport_t transport, unsigned int paired)
 {
 	dc_status_t status = DC_STATUS_SUCCESS;
 	dc_iterator_t *iterator = NULL;
@@ -57,7 +122,7 @@ scan (dc_context_t *context, dc_descriptor_t *descriptor, dc_transport_t transpo
 		status = dc_irda_iterator_new (&iterator, context, descriptor);
 		break;
 	case DC_TRANSPORT_BLUETOOTH:
-		status = dc_bluetooth_iterator_new (&iterator, context, descriptor);
+		status = dc_bluetooth_iterator_new2 (&iterator, context, descriptor, paired ? DC_BLUETOOTH_PAIRED : 0);
 		break;
 	case DC_TRANSPORT_USBHID:
 		status = dc_usbhid_iterator_new (&iterator, context, descriptor);
@@ -74,29 +139,7 @@ scan (dc_context_t *context, dc_descriptor_t *descriptor, dc_transport_t transpo
 	// Enumerate the devices.
 	void *device = NULL;
 	while ((status = dc_iterator_next (iterator, &device)) == DC_STATUS_SUCCESS) {
-		char buffer[DC_BLUETOOTH_SIZE];
-		switch (transport) {
-		case DC_TRANSPORT_SERIAL:
-			printf ("%s\n", dc_serial_device_get_name (device));
-			dc_serial_device_free (device);
-			break;
-		case DC_TRANSPORT_IRDA:
-			printf ("%08x\t%s\n", dc_irda_device_get_address (device), dc_irda_device_get_name (device));
-			dc_irda_device_free (device);
-			break;
-		case DC_TRANSPORT_BLUETOOTH:
-			printf ("%s\t%s\n",
-				dc_bluetooth_addr2str(dc_bluetooth_device_get_address (device), buffer, sizeof(buffer)),
-				dc_bluetooth_device_get_name (device));
-			dc_bluetooth_device_free (device);
-			break;
-		case DC_TRANSPORT_USBHID:
-			printf ("%04x:%04x\n", dc_usbhid_device_get_vid (device), dc_usbhid_device_get_pid (device));
-			dc_usbhid_device_free (device);
-			break;
-		default:
-			break;
-		}
+		scan_print (transport, device);
 	}
 	if (status != DC_STATUS_SUCCESS && status != DC_STATUS_DONE) {
 		ERROR ("Failed to enumerate the devices.");
@@ -118,15 +161,21 @@ dctool_scan_run (int argc, char *argv[], dc_context_t *context, dc_descriptor_t
 
 	// Default option values.
 	unsigned int help = 0;
+	unsigned int all = 0;
+	unsigned int paired = 0;
+	unsigned int timeout = 0;
 	dc_transport_t transport = dctool_transport_default (descriptor);
 
 	// Parse the command-line options.
 	int opt = 0;
-	const char *optstring = "ht:";
+	const char *optstring = "hapt:T:";
 #ifdef HAVE_GETOPT_LONG
 	struct option options[] = {
 		{"help",        no_argument,       0, 'h'},
+		{"all",         no_argument,       0, 'a'},
+		{"paired",      no_argument,       0, 'p'},
 		{"transport",   required_argument, 0, 't'},
+		{"timeout",     required_argument, 0, 'T'},
 		{0,             0,                 0,  0 }
 	};
 	while ((opt = getopt_long (argc, argv, optstring, options, NULL)) != -1) {
@@ -137,9 +186,18 @@ dctool_scan_run (int argc, char *argv[], dc_context_t *context, dc_descriptor_t
 		case 'h':
 			help = 1;
 			break;
+		case 'a':
+			all = 1;
+			break;
+		case 'p':
+			paired = 1;
+			break;
 		case 't':
 			transport = dctool_transport_type (optarg);
 			break;
+		case 'T':
+			timeout = strtoul (optarg, NULL, 0);
+			break;
 		default:
 			return EXIT_FAILURE;
 		}
@@ -154,6 +212,16 @@ dctool_scan_run (int argc, char *argv[], dc_context_t *context, dc_descriptor_t
 		return EXIT_SUCCESS;
 	}
 
+	// Scan all transports at the same time.
+	if (all) {
+		status = scan_all (context, descriptor, paired, timeout);
+		if (status != DC_STATUS_SUCCESS) {
+			message ("ERROR: %s\n", dctool_errmsg (status));
+			exitcode = EXIT_FAILURE;
+		}
+		goto cleanup;
+	}
+
 	// Check the transport type.
 	if (transport == DC_TRANSPORT_NONE) {
 		message ("No valid transport type specified.\n");
@@ -162,7 +230,7 @@ dctool_scan_run (int argc, char *argv[], dc_context_t *context, dc_descriptor_t
 	}
 
 	// Scan for supported devices.
-	status = scan (context, descriptor, transport);
+	status = scan (context, descriptor, transport, paired);
 	if (status != DC_STATUS_SUCCESS) {
 		message ("ERROR: %s\n", dctool_errmsg (status));
 		exitcode = EXIT_FAILURE;
@@ -184,9 +252,15 @@ const dctool_command_t dctool_scan = {
 	"Options:\n"
 #ifdef HAVE_GETOPT_LONG
 	"   -h, --help               Show help message\n"
+	"   -a, --all                Scan all transports concurrently\n"
+	"   -p, --paired             Paired bluetooth devices only\n"
 	"   -t, --transport <name>   Transport type\n"
+	"   -T, --timeout <ms>       Timeout for scanning all transports\n"
 #else
 	"   -h               Show help message\n"
+	"   -a               Scan all transports concurrently\n"
+	"   -p               Paired bluetooth devices only\n"
 	"   -t <transport>   Transport type\n"
+	"   -T <ms>          Timeout for scanning all transports\n"
 #endif
 };
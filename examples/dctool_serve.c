@@ -0,0 +1,180 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#ifdef HAVE_GETOPT_H
+#include <getopt.h>
+#endif
+
+#include <libdivecomputer/context.h>
+#include <libdivecomputer/descriptor.h>
+#include <libdivecomputer/iostream.h>
+#include <libdivecomputer/tcp.h>
+#include <libdivecomputer/remote.h>
+
+#include "dctool.h"
+#include "common.h"
+#include "utils.h"
+
+#define PORT 6510
+
+static dc_status_t
+do_serve (dc_context_t *context, dc_descriptor_t *descriptor, dc_transport_t transport, const char *devname, unsigned int port)
+{
+	dc_status_t rc = DC_STATUS_SUCCESS;
+	dc_iostream_t *connection = NULL;
+	dc_iostream_t *iostream = NULL;
+
+	// Wait for a client.
+	message ("Waiting for a client (port %u).\n", port);
+	rc = dc_tcp_accept (&connection, context, port);
+	if (rc != DC_STATUS_SUCCESS) {
+		ERROR ("Error accepting the connection.");
+		goto cleanup;
+	}
+
+	// Open the I/O stream.
+	message ("Opening the I/O stream (%s, %s).\n",
+		dctool_transport_name (transport),
+		devname ? devname : "null");
+	rc = dctool_iostream_open (&iostream, context, descriptor, transport, devname);
+	if (rc != DC_STATUS_SUCCESS) {
+		ERROR ("Error opening the I/O stream.");
+		goto cleanup;
+	}
+
+	// Forward all operations of the client.
+	message ("Serving the client.\n");
+	rc = dc_remote_serve (connection, iostream);
+	if (rc != DC_STATUS_SUCCESS) {
+		ERROR ("Error serving the client.");
+		goto cleanup;
+	}
+
+cleanup:
+	dc_iostream_close (iostream);
+	dc_iostream_close (connection);
+	return rc;
+}
+
+static int
+dctool_serve_run (int argc, char *argv[], dc_context_t *context, dc_descriptor_t *descriptor)
+{
+	int exitcode = EXIT_SUCCESS;
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_transport_t transport = dctool_transport_default (descriptor);
+
+	// Default option values.
+	unsigned int help = 0;
+	unsigned int port = PORT;
+	unsigned int once = 0;
+
+	// Parse the command-line options.
+	int opt = 0;
+	const char *optstring = "ht:p:1";
+#ifdef HAVE_GETOPT_LONG
+	struct option options[] = {
+		{"help",        no_argument,       0, 'h'},
+		{"transport",   required_argument, 0, 't'},
+		{"port",        required_argument, 0, 'p'},
+		{"once",        no_argument,       0, '1'},
+		{0,             0,                 0,  0 }
+	};
+	while ((opt = getopt_long (argc, argv, optstring, options, NULL)) != -1) {
+#else
+	while ((opt = getopt (argc, argv, optstring)) != -1) {
+#endif
+		switch (opt) {
+		case 'h':
+			help = 1;
+			break;
+		case 't':
+			transport = dctool_transport_type (optarg);
+			break;
+		case 'p':
+			port = strtoul (optarg, NULL, 0);
+			break;
+		case '1':
+			once = 1;
+			break;
+		default:
+			return EXIT_FAILURE;
+		}
+	}
+
+	argc -= optind;
+	argv += optind;
+
+	// Show help message.
+	if (help) {
+		dctool_command_showhelp (&dctool_serve);
+		return EXIT_SUCCESS;
+	}
+
+	// Check the transport type.
+	if (transport == DC_TRANSPORT_NONE) {
+		message ("No valid transport type specified.\n");
+		exitcode = EXIT_FAILURE;
+		goto cleanup;
+	}
+
+	// Serve the clients, one at a time.
+	do {
+		status = do_serve (context, descriptor, transport, argv[0], port);
+		if (status != DC_STATUS_SUCCESS) {
+			message ("ERROR: %s\n", dctool_errmsg (status));
+			exitcode = EXIT_FAILURE;
+		}
+	} while (!once && !dctool_cancel_cb (NULL));
+
+cleanup:
+	return exitcode;
+}
+
+const dctool_command_t dctool_serve = {
+	dctool_serve_run,
+	DCTOOL_CONFIG_DESCRIPTOR,
+	"serve",
+	"Make the I/O stream available over the network",
+	"Usage:\n"
+	"   dctool serve [options] <devname>\n"
+	"\n"
+	"The clients connect with a devname of the form remote:<host>:<port>.\n"
+	"\n"
+	"Options:\n"
+#ifdef HAVE_GETOPT_LONG
+	"   -h, --help               Show help message\n"
+	"   -t, --transport <name>   Transport type\n"
+	"   -p, --port <port>        TCP port number (default 6510)\n"
+	"   -1, --once               Serve a single client only\n"
+#else
+	"   -h               Show help message\n"
+	"   -t <transport>   Transport type\n"
+	"   -p <port>        TCP port number (default 6510)\n"
+	"   -1               Serve a single client only\n"
+#endif
+};
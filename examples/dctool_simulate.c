@@ -0,0 +1,357 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#ifdef HAVE_GETOPT_H
+#include <getopt.h>
+#endif
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+#include <libdivecomputer/context.h>
+#include <libdivecomputer/descriptor.h>
+#include <libdivecomputer/device.h>
+
+#include "dctool.h"
+#include "common.h"
+#include "simulator.h"
+#include "utils.h"
+
+typedef struct worker_t {
+	dc_descriptor_t *descriptor;
+	dc_buffer_t *memory;
+	dc_buffer_t *version;
+	unsigned int repeat;
+	// Results.
+	dctool_simulator_stats_t stats;
+	unsigned long long downloads;
+	unsigned long long dives;
+	unsigned long long bytes;
+	unsigned long long errors;
+	dc_status_t status;
+#ifdef HAVE_PTHREAD_H
+	pthread_t thread;
+#endif
+} worker_t;
+
+static int
+dive_cb (const unsigned char *data, unsigned int size, const unsigned char *fingerprint, unsigned int fsize, void *userdata)
+{
+	worker_t *worker = (worker_t *) userdata;
+
+	worker->dives++;
+	worker->bytes += size;
+
+	return 1;
+}
+
+static dc_status_t
+simulate (dc_context_t *context, worker_t *worker)
+{
+	dc_status_t rc = DC_STATUS_SUCCESS;
+	dc_iostream_t *iostream = NULL;
+	dc_device_t *device = NULL;
+
+	rc = dctool_simulator_open (&iostream, context, worker->descriptor, worker->memory, worker->version, &worker->stats);
+	if (rc != DC_STATUS_SUCCESS)
+		goto cleanup;
+
+	rc = dc_device_open (&device, context, worker->descriptor, iostream);
+	if (rc != DC_STATUS_SUCCESS)
+		goto cleanup;
+
+	rc = dc_device_set_cancel (device, dctool_cancel_cb, NULL);
+	if (rc != DC_STATUS_SUCCESS)
+		goto cleanup;
+
+	rc = dc_device_foreach (device, dive_cb, worker);
+	if (rc != DC_STATUS_SUCCESS)
+		goto cleanup;
+
+cleanup:
+	dc_device_close (device);
+	dc_iostream_close (iostream);
+	return rc;
+}
+
+static void *
+worker_run (void *userdata)
+{
+	worker_t *worker = (worker_t *) userdata;
+	dc_context_t *context = NULL;
+
+	// Each simulated device gets its own context, the same way
+	// independent downloads in an application would.
+	worker->status = dc_context_new (&context);
+	if (worker->status != DC_STATUS_SUCCESS)
+		return NULL;
+	dc_context_set_loglevel (context, DC_LOGLEVEL_NONE);
+
+	for (unsigned int i = 0; i < worker->repeat; ++i) {
+		dc_status_t rc = simulate (context, worker);
+		if (rc != DC_STATUS_SUCCESS) {
+			if (worker->status == DC_STATUS_SUCCESS)
+				worker->status = rc;
+			worker->errors++;
+			if (rc == DC_STATUS_CANCELLED)
+				break;
+		}
+		worker->downloads++;
+	}
+
+	dc_context_free (context);
+
+	return NULL;
+}
+
+static int
+dctool_simulate_run (int argc, char *argv[], dc_context_t *context, dc_descriptor_t *descriptor)
+{
+	// Default values.
+	int exitcode = EXIT_SUCCESS;
+	dc_buffer_t *memory = NULL;
+	dc_buffer_t *version = NULL;
+	worker_t *workers = NULL;
+	unsigned int nworkers = 0;
+	FILE *ostream = NULL;
+
+	// Default option values.
+	unsigned int help = 0;
+	const char *filename = NULL;
+	const char *hexversion = NULL;
+	unsigned int ndevices = 1;
+	unsigned int repeat = 1;
+
+	// Parse the command-line options.
+	int opt = 0;
+	const char *optstring = "ho:n:r:V:";
+#ifdef HAVE_GETOPT_LONG
+	struct option options[] = {
+		{"help",        no_argument,       0, 'h'},
+		{"output",      required_argument, 0, 'o'},
+		{"devices",     required_argument, 0, 'n'},
+		{"repeat",      required_argument, 0, 'r'},
+		{"version",     required_argument, 0, 'V'},
+		{0,             0,                 0,  0 }
+	};
+	while ((opt = getopt_long (argc, argv, optstring, options, NULL)) != -1) {
+#else
+	while ((opt = getopt (argc, argv, optstring)) != -1) {
+#endif
+		switch (opt) {
+		case 'h':
+			help = 1;
+			break;
+		case 'o':
+			filename = optarg;
+			break;
+		case 'n':
+			ndevices = strtoul (optarg, NULL, 0);
+			break;
+		case 'r':
+			repeat = strtoul (optarg, NULL, 0);
+			break;
+		case 'V':
+			hexversion = optarg;
+			break;
+		default:
+			return EXIT_FAILURE;
+		}
+	}
+
+	argc -= optind;
+	argv += optind;
+
+	// Show help message.
+	if (help) {
+		dctool_command_showhelp (&dctool_simulate);
+		return EXIT_SUCCESS;
+	}
+
+	if (argc != 1 || ndevices == 0 || repeat == 0) {
+		dctool_command_showhelp (&dctool_simulate);
+		return EXIT_FAILURE;
+	}
+
+	if (!dctool_simulator_supported (dc_descriptor_get_type (descriptor))) {
+		message ("No simulator available for the '%s' family.\n",
+			dctool_family_name (dc_descriptor_get_type (descriptor)));
+		return EXIT_FAILURE;
+	}
+
+	// Read the memory image.
+	memory = dctool_file_read (argv[0]);
+	if (memory == NULL) {
+		message ("Failed to open the input file '%s'.\n", argv[0]);
+		exitcode = EXIT_FAILURE;
+		goto cleanup;
+	}
+
+	// Convert the version to binary.
+	if (hexversion) {
+		version = dctool_convert_hex2bin (hexversion);
+		if (version == NULL) {
+			message ("Invalid version data.\n");
+			exitcode = EXIT_FAILURE;
+			goto cleanup;
+		}
+	}
+
+	workers = (worker_t *) calloc (ndevices, sizeof (worker_t));
+	if (workers == NULL) {
+		message ("Failed to allocate memory.\n");
+		exitcode = EXIT_FAILURE;
+		goto cleanup;
+	}
+
+	for (unsigned int i = 0; i < ndevices; ++i) {
+		workers[i].descriptor = descriptor;
+		workers[i].memory = memory;
+		workers[i].version = version;
+		workers[i].repeat = repeat;
+	}
+
+	// All simulated devices download concurrently, each in its own
+	// thread. Without thread support, they run one after the other.
+	double begin = dctool_timestamp ();
+	for (nworkers = 0; nworkers < ndevices; ++nworkers) {
+#ifdef HAVE_PTHREAD_H
+		if (pthread_create (&workers[nworkers].thread, NULL, worker_run, workers + nworkers) != 0) {
+			message ("Failed to start the simulated device %u.\n", nworkers);
+			exitcode = EXIT_FAILURE;
+			break;
+		}
+#else
+		worker_run (workers + nworkers);
+#endif
+	}
+#ifdef HAVE_PTHREAD_H
+	for (unsigned int i = 0; i < nworkers; ++i) {
+		pthread_join (workers[i].thread, NULL);
+	}
+#endif
+	double elapsed = dctool_timestamp () - begin;
+
+	worker_t total = {0};
+	for (unsigned int i = 0; i < nworkers; ++i) {
+		if (workers[i].status != DC_STATUS_SUCCESS) {
+			if (total.status == DC_STATUS_SUCCESS)
+				message ("ERROR: %s\n", dctool_errmsg (workers[i].status));
+			total.status = workers[i].status;
+		}
+		total.downloads += workers[i].downloads;
+		total.dives += workers[i].dives;
+		total.bytes += workers[i].bytes;
+		total.errors += workers[i].errors;
+		total.stats.commands += workers[i].stats.commands;
+		total.stats.received += workers[i].stats.received;
+		total.stats.sent += workers[i].stats.sent;
+	}
+
+	// Open the output file.
+	if (filename) {
+		ostream = fopen (filename, "w");
+		if (ostream == NULL) {
+			message ("Failed to open the output file.\n");
+			exitcode = EXIT_FAILURE;
+			goto cleanup;
+		}
+	}
+
+	FILE *fp = ostream ? ostream : stdout;
+	fprintf (fp,
+		"{\n"
+		"   \"vendor\": \"%s\",\n"
+		"   \"product\": \"%s\",\n"
+		"   \"family\": \"%s\",\n"
+		"   \"model\": %u,\n"
+		"   \"devices\": %u,\n"
+		"   \"downloads\": %llu,\n"
+		"   \"errors\": %llu,\n"
+		"   \"dives\": %llu,\n"
+		"   \"dive_bytes\": %llu,\n"
+		"   \"commands\": %llu,\n"
+		"   \"bytes_received\": %llu,\n"
+		"   \"bytes_sent\": %llu,\n"
+		"   \"seconds\": %.6f,\n"
+		"   \"downloads_per_second\": %.1f,\n"
+		"   \"commands_per_second\": %.1f,\n"
+		"   \"bytes_per_second\": %.1f\n"
+		"}\n",
+		dc_descriptor_get_vendor (descriptor),
+		dc_descriptor_get_product (descriptor),
+		dctool_family_name (dc_descriptor_get_type (descriptor)),
+		dc_descriptor_get_model (descriptor),
+		nworkers,
+		total.downloads, total.errors,
+		total.dives, total.bytes,
+		total.stats.commands, total.stats.received, total.stats.sent,
+		elapsed,
+		elapsed > 0.0 ? total.downloads / elapsed : 0.0,
+		elapsed > 0.0 ? total.stats.commands / elapsed : 0.0,
+		elapsed > 0.0 ? total.stats.sent / elapsed : 0.0);
+
+	if (total.errors)
+		exitcode = EXIT_FAILURE;
+
+cleanup:
+	if (ostream)
+		fclose (ostream);
+	free (workers);
+	dc_buffer_free (version);
+	dc_buffer_free (memory);
+	return exitcode;
+}
+
+const dctool_command_t dctool_simulate = {
+	dctool_simulate_run,
+	DCTOOL_CONFIG_DESCRIPTOR,
+	"simulate",
+	"Download from simulated devices, to measure the download performance",
+	"Usage:\n"
+	"   dctool simulate [options] <filename>\n"
+	"\n"
+	"The file contains a memory image, as written by the dump command.\n"
+	"Simulators are available for the suunto d9, suunto vyper2 and oceanic\n"
+	"atom2 families. The report is written in JSON format.\n"
+	"\n"
+	"Options:\n"
+#ifdef HAVE_GETOPT_LONG
+	"   -h, --help                 Show help message\n"
+	"   -o, --output <filename>    Output filename\n"
+	"   -n, --devices <count>      Number of concurrent devices (default 1)\n"
+	"   -r, --repeat <count>       Downloads per device (default 1)\n"
+	"   -V, --version <hexdata>    Answer to the version command\n"
+#else
+	"   -h              Show help message\n"
+	"   -o <filename>   Output filename\n"
+	"   -n <count>      Number of concurrent devices (default 1)\n"
+	"   -r <count>      Downloads per device (default 1)\n"
+	"   -V <hexdata>    Answer to the version command\n"
+#endif
+};
@@ -0,0 +1,430 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#ifdef HAVE_GETOPT_H
+#include <getopt.h>
+#endif
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+#include <libdivecomputer/context.h>
+#include <libdivecomputer/descriptor.h>
+#include <libdivecomputer/parser.h>
+
+#include "dctool.h"
+#include "common.h"
+#include "pack.h"
+#include "utils.h"
+
+typedef enum verify_mode_t {
+	VERIFY_FILES,
+	VERIFY_PACK,
+	VERIFY_DUMP,
+} verify_mode_t;
+
+/*
+ * A single dive to verify. Plain dive files are only read by the worker,
+ * the dives of an archive point into the mapping, and the dives of a
+ * memory dump are copied.
+ */
+typedef struct verify_entry_t {
+	const char *source;
+	unsigned int number;
+	const unsigned char *data;
+	unsigned int size;
+	unsigned char *copy;
+	dc_status_t status;
+} verify_entry_t;
+
+typedef struct verify_state_t {
+	dc_context_t *context;
+	dc_descriptor_t *descriptor;
+	verify_entry_t *entries;
+	unsigned int count;
+	unsigned int next;
+	// Statistics.
+	unsigned long long bytes;
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_t lock;
+#endif
+} verify_state_t;
+
+typedef struct verify_list_t {
+	verify_entry_t *entries;
+	unsigned int count;
+	unsigned int capacity;
+} verify_list_t;
+
+static verify_entry_t *
+verify_list_add (verify_list_t *list, const char *source, unsigned int number)
+{
+	if (list->count == list->capacity) {
+		unsigned int capacity = list->capacity ? 2 * list->capacity : 64;
+		verify_entry_t *entries = (verify_entry_t *) realloc (list->entries, capacity * sizeof (verify_entry_t));
+		if (entries == NULL)
+			return NULL;
+		list->entries = entries;
+		list->capacity = capacity;
+	}
+
+	verify_entry_t *entry = list->entries + list->count++;
+	memset (entry, 0, sizeof (verify_entry_t));
+	entry->source = source;
+	entry->number = number;
+	entry->status = DC_STATUS_SUCCESS;
+
+	return entry;
+}
+
+typedef struct verify_dump_t {
+	verify_list_t *list;
+	const char *source;
+	unsigned int number;
+	unsigned int error;
+} verify_dump_t;
+
+/*
+ * Collect the dives of a memory dump. The dive data is only valid
+ * during the callback, hence the copy.
+ */
+static int
+verify_dump_cb (dc_parser_t *parser, const unsigned char *data, unsigned int size, const unsigned char *fingerprint, unsigned int fsize, void *userdata)
+{
+	verify_dump_t *dump = (verify_dump_t *) userdata;
+
+	verify_entry_t *entry = verify_list_add (dump->list, dump->source, dump->number++);
+	if (entry == NULL || (entry->copy = (unsigned char *) malloc (size ? size : 1)) == NULL) {
+		dump->error = 1;
+		return 0;
+	}
+
+	memcpy (entry->copy, data, size);
+	entry->data = entry->copy;
+	entry->size = size;
+
+	return 1;
+}
+
+static void *
+verify_worker (void *userdata)
+{
+	verify_state_t *state = (verify_state_t *) userdata;
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_parser_t *parser = NULL;
+
+	// Create the parser. The same parser is reused for all dives.
+	status = dc_parser_new2 (&parser, state->context, state->descriptor, 0, 0);
+	if (status != DC_STATUS_SUCCESS) {
+		message ("ERROR: %s\n", dctool_errmsg (status));
+	}
+
+	for (;;) {
+#ifdef HAVE_PTHREAD_H
+		pthread_mutex_lock (&state->lock);
+#endif
+		unsigned int index = state->next < state->count ? state->next++ : state->count;
+#ifdef HAVE_PTHREAD_H
+		pthread_mutex_unlock (&state->lock);
+#endif
+		if (index >= state->count)
+			break;
+
+		verify_entry_t *entry = state->entries + index;
+		if (entry->status != DC_STATUS_SUCCESS)
+			continue;
+		if (parser == NULL) {
+			entry->status = status;
+			continue;
+		}
+
+		// Read the input file, or take the dive from the archive.
+		dc_buffer_t *buffer = NULL;
+		const unsigned char *data = entry->data;
+		unsigned int size = entry->size;
+		if (data == NULL) {
+			buffer = dctool_file_read (entry->source);
+			if (buffer == NULL) {
+				entry->status = DC_STATUS_IO;
+				continue;
+			}
+			data = dc_buffer_get_data (buffer);
+			size = dc_buffer_get_size (buffer);
+		}
+
+		entry->status = dc_parser_set_data (parser, data, size);
+		if (entry->status == DC_STATUS_SUCCESS)
+			entry->status = dc_parser_verify (parser);
+
+#ifdef HAVE_PTHREAD_H
+		pthread_mutex_lock (&state->lock);
+#endif
+		state->bytes += size;
+#ifdef HAVE_PTHREAD_H
+		pthread_mutex_unlock (&state->lock);
+#endif
+
+		dc_buffer_free (buffer);
+	}
+
+	dc_parser_destroy (parser);
+	return NULL;
+}
+
+static int
+dctool_verify_run (int argc, char *argv[], dc_context_t *context, dc_descriptor_t *descriptor)
+{
+	// Default values.
+	int exitcode = EXIT_SUCCESS;
+	dctool_pack_t **packs = NULL;
+	unsigned int npacks = 0;
+	verify_list_t list = {NULL, 0, 0};
+
+	// Default option values.
+	unsigned int help = 0;
+	verify_mode_t mode = VERIFY_FILES;
+	unsigned int njobs = 1;
+
+	// Parse the command-line options.
+	int opt = 0;
+	const char *optstring = "hj:pm";
+#ifdef HAVE_GETOPT_LONG
+	struct option options[] = {
+		{"help",        no_argument,       0, 'h'},
+		{"jobs",        required_argument, 0, 'j'},
+		{"pack",        no_argument,       0, 'p'},
+		{"dump",        no_argument,       0, 'm'},
+		{0,             0,                 0,  0 }
+	};
+	while ((opt = getopt_long (argc, argv, optstring, options, NULL)) != -1) {
+#else
+	while ((opt = getopt (argc, argv, optstring)) != -1) {
+#endif
+		switch (opt) {
+		case 'h':
+			help = 1;
+			break;
+		case 'j':
+			njobs = strtoul (optarg, NULL, 0);
+			break;
+		case 'p':
+			mode = VERIFY_PACK;
+			break;
+		case 'm':
+			mode = VERIFY_DUMP;
+			break;
+		default:
+			return EXIT_FAILURE;
+		}
+	}
+
+	argc -= optind;
+	argv += optind;
+
+	// Show help message.
+	if (help) {
+		dctool_command_showhelp (&dctool_verify);
+		return EXIT_SUCCESS;
+	}
+
+#ifdef HAVE_PTHREAD_H
+	if (njobs == 0)
+		njobs = 1;
+#else
+	njobs = 1;
+#endif
+
+	// Collect the dives to verify.
+	if (mode == VERIFY_PACK) {
+		packs = (dctool_pack_t **) malloc ((argc ? argc : 1) * sizeof (dctool_pack_t *));
+		if (packs == NULL) {
+			message ("Failed to allocate memory.\n");
+			exitcode = EXIT_FAILURE;
+			goto cleanup;
+		}
+	}
+
+	for (int i = 0; i < argc; ++i) {
+		if (mode == VERIFY_FILES) {
+			if (verify_list_add (&list, argv[i], 0) == NULL) {
+				message ("Failed to allocate memory.\n");
+				exitcode = EXIT_FAILURE;
+				goto cleanup;
+			}
+		} else if (mode == VERIFY_PACK) {
+			// An archive which can't be opened at all is reported,
+			// but doesn't stop the verification of the others.
+			dc_status_t rc = dctool_pack_open (&packs[npacks], argv[i]);
+			if (rc != DC_STATUS_SUCCESS) {
+				message ("%s: %s\n", argv[i], dctool_errmsg (rc));
+				exitcode = EXIT_FAILURE;
+				continue;
+			}
+
+			unsigned int ndives = dctool_pack_get_count (packs[npacks]);
+			for (unsigned int j = 0; j < ndives; ++j) {
+				dctool_pack_dive_t dive;
+				verify_entry_t *entry = verify_list_add (&list, argv[i], j);
+				if (entry == NULL) {
+					message ("Failed to allocate memory.\n");
+					exitcode = EXIT_FAILURE;
+					goto cleanup;
+				}
+				entry->status = dctool_pack_get_dive (packs[npacks], j, &dive);
+				entry->data = dive.data;
+				entry->size = dive.size;
+			}
+			npacks++;
+		} else {
+			dc_buffer_t *buffer = dctool_file_read (argv[i]);
+			if (buffer == NULL) {
+				message ("%s: %s\n", argv[i], dctool_errmsg (DC_STATUS_IO));
+				exitcode = EXIT_FAILURE;
+				continue;
+			}
+
+			verify_dump_t dump = {&list, argv[i], 0, 0};
+			dc_status_t rc = dc_parser_foreach_dive_in_dump (context, descriptor, buffer, 0, verify_dump_cb, &dump);
+			dc_buffer_free (buffer);
+			if (rc == DC_STATUS_SUCCESS && dump.error)
+				rc = DC_STATUS_NOMEMORY;
+			if (rc != DC_STATUS_SUCCESS) {
+				message ("%s: %s\n", argv[i], dctool_errmsg (rc));
+				exitcode = EXIT_FAILURE;
+			}
+		}
+	}
+
+	if (njobs > list.count)
+		njobs = list.count ? list.count : 1;
+
+	verify_state_t state;
+	state.context = context;
+	state.descriptor = descriptor;
+	state.entries = list.entries;
+	state.count = list.count;
+	state.next = 0;
+	state.bytes = 0;
+
+	double begin = dctool_timestamp ();
+
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_init (&state.lock, NULL);
+
+	pthread_t *threads = NULL;
+	if (njobs > 1) {
+		threads = (pthread_t *) malloc ((njobs - 1) * sizeof (pthread_t));
+		if (threads == NULL)
+			njobs = 1;
+	}
+
+	// Start the extra workers. If a thread can't be created, the dives
+	// are simply shared by fewer workers.
+	unsigned int nstarted = 0;
+	for (unsigned int i = 1; i < njobs; ++i) {
+		if (pthread_create (&threads[nstarted], NULL, verify_worker, &state) != 0) {
+			WARNING ("Failed to create a worker thread.");
+			break;
+		}
+		nstarted++;
+	}
+
+	// The calling thread is one of the workers.
+	verify_worker (&state);
+
+	for (unsigned int i = 0; i < nstarted; ++i) {
+		pthread_join (threads[i], NULL);
+	}
+
+	free (threads);
+
+	pthread_mutex_destroy (&state.lock);
+#else
+	verify_worker (&state);
+#endif
+
+	double elapsed = dctool_timestamp () - begin;
+
+	// Report the corrupt dives, in the order of the input.
+	unsigned int ncorrupt = 0;
+	for (unsigned int i = 0; i < list.count; ++i) {
+		const verify_entry_t *entry = list.entries + i;
+		if (entry->status == DC_STATUS_SUCCESS)
+			continue;
+
+		if (mode == VERIFY_FILES) {
+			message ("%s: %s\n", entry->source, dctool_errmsg (entry->status));
+		} else {
+			message ("%s: dive %u: %s\n", entry->source, entry->number, dctool_errmsg (entry->status));
+		}
+		ncorrupt++;
+	}
+
+	if (ncorrupt) {
+		exitcode = EXIT_FAILURE;
+	}
+
+	message ("Verified %u dives (%llu bytes) in %.3f seconds with %u jobs: %u corrupt.\n",
+		list.count, state.bytes, elapsed, njobs, ncorrupt);
+
+cleanup:
+	for (unsigned int i = 0; i < list.count; ++i) {
+		free (list.entries[i].copy);
+	}
+	free (list.entries);
+	for (unsigned int i = 0; i < npacks; ++i) {
+		dctool_pack_close (packs[i]);
+	}
+	free (packs);
+	return exitcode;
+}
+
+const dctool_command_t dctool_verify = {
+	dctool_verify_run,
+	DCTOOL_CONFIG_DESCRIPTOR,
+	"verify",
+	"Verify the integrity of previously downloaded dives",
+	"Usage:\n"
+	"   dctool verify [options] <filename> [<filename> ...]\n"
+	"   dctool verify [options] --pack <archive> [<archive> ...]\n"
+	"   dctool verify [options] --dump <filename> [<filename> ...]\n"
+	"\n"
+	"Options:\n"
+#ifdef HAVE_GETOPT_LONG
+	"   -h, --help                 Show help message\n"
+	"   -j, --jobs <count>         Number of dives verified in parallel\n"
+	"   -p, --pack                 Verify all dives in packed archives\n"
+	"   -m, --dump                 Verify all dives in memory dumps\n"
+#else
+	"   -h              Show help message\n"
+	"   -j <count>      Number of dives verified in parallel\n"
+	"   -p              Verify all dives in packed archives\n"
+	"   -m              Verify all dives in memory dumps\n"
+#endif
+};
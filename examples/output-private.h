@@ -43,6 +43,10 @@ struct dctool_output_vtable_t {
 
 	dc_status_t (*write) (dctool_output_t *output, dc_parser_t *parser, const unsigned char data[], unsigned int size, const unsigned char fingerprint[], unsigned int fsize);
 
+	dctool_output_t *(*fork) (dctool_output_t *output);
+
+	dc_status_t (*join) (dctool_output_t *output, dctool_output_t *fork);
+
 	dc_status_t (*free) (dctool_output_t *output);
 };
 
@@ -52,6 +56,33 @@ dctool_output_allocate (const dctool_output_vtable_t *vtable);
 void
 dctool_output_deallocate (dctool_output_t *output);
 
+/*
+ * Helpers shared by the text outputs.
+ */
+double
+dctool_convert_depth (double value, dctool_units_t units);
+
+double
+dctool_convert_temperature (double value, dctool_units_t units);
+
+double
+dctool_convert_pressure (double value, dctool_units_t units);
+
+double
+dctool_convert_volume (double value, dctool_units_t units);
+
+const char *
+dctool_event_name (unsigned int type);
+
+const char *
+dctool_decostop_name (unsigned int type);
+
+const char *
+dctool_divemode_name (unsigned int type);
+
+const char *
+dctool_tankvolume_name (unsigned int type);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
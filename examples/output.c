@@ -22,8 +22,12 @@
 #include <stdlib.h>
 #include <assert.h>
 
+#include <libdivecomputer/units.h>
+
 #include "output-private.h"
 
+#define C_ARRAY_SIZE(array) (sizeof (array) / sizeof *(array))
+
 dctool_output_t *
 dctool_output_allocate (const dctool_output_vtable_t *vtable)
 {
@@ -61,6 +65,50 @@ dctool_output_write (dctool_output_t *output, dc_parser_t *parser, const unsigne
 	return output->vtable->write (output, parser, data, size, fingerprint, fsize);
 }
 
+dctool_output_t *
+dctool_output_fork (dctool_output_t *output)
+{
+	if (output == NULL || output->vtable->fork == NULL)
+		return NULL;
+
+	dctool_output_t *fork = output->vtable->fork (output);
+	if (fork == NULL)
+		return NULL;
+
+	fork->number = output->number;
+
+	return fork;
+}
+
+void
+dctool_output_set_number (dctool_output_t *output, unsigned int number)
+{
+	if (output == NULL)
+		return;
+
+	output->number = number;
+}
+
+dc_status_t
+dctool_output_join (dctool_output_t *output, dctool_output_t *fork)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (output == NULL || fork == NULL || output->vtable != fork->vtable)
+		return DC_STATUS_INVALIDARGS;
+
+	if (output->vtable->join == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	status = output->vtable->join (output, fork);
+	if (status != DC_STATUS_SUCCESS)
+		return status;
+
+	output->number = fork->number;
+
+	return DC_STATUS_SUCCESS;
+}
+
 dc_status_t
 dctool_output_free (dctool_output_t *output)
 {
@@ -77,3 +125,96 @@ dctool_output_free (dctool_output_t *output)
 
 	return status;
 }
+
+double
+dctool_convert_depth (double value, dctool_units_t units)
+{
+	if (units == DCTOOL_UNITS_IMPERIAL) {
+		return value / FEET;
+	} else {
+		return value;
+	}
+}
+
+double
+dctool_convert_temperature (double value, dctool_units_t units)
+{
+	if (units == DCTOOL_UNITS_IMPERIAL) {
+		return value * (9.0 / 5.0) + 32.0;
+	} else {
+		return value;
+	}
+}
+
+double
+dctool_convert_pressure (double value, dctool_units_t units)
+{
+	if (units == DCTOOL_UNITS_IMPERIAL) {
+		return value * BAR / PSI;
+	} else {
+		return value;
+	}
+}
+
+double
+dctool_convert_volume (double value, dctool_units_t units)
+{
+	if (units == DCTOOL_UNITS_IMPERIAL) {
+		return value / 1000.0 / CUFT;
+	} else {
+		return value;
+	}
+}
+
+const char *
+dctool_event_name (unsigned int type)
+{
+	static const char *names[] = {
+		"none", "deco", "rbt", "ascent", "ceiling", "workload", "transmitter",
+		"violation", "bookmark", "surface", "safety stop", "gaschange",
+		"safety stop (voluntary)", "safety stop (mandatory)", "deepstop",
+		"ceiling (safety stop)", "floor", "divetime", "maxdepth",
+		"OLF", "PO2", "airtime", "rgbm", "heading", "tissue level warning",
+		"gaschange2"};
+
+	if (type >= C_ARRAY_SIZE(names))
+		return "unknown";
+
+	return names[type];
+}
+
+const char *
+dctool_decostop_name (unsigned int type)
+{
+	static const char *names[] = {
+		"ndl", "safety", "deco", "deep"};
+
+	if (type >= C_ARRAY_SIZE(names))
+		return "unknown";
+
+	return names[type];
+}
+
+const char *
+dctool_divemode_name (unsigned int type)
+{
+	static const char *names[] = {
+		"freedive", "gauge", "oc", "ccr", "scr"};
+
+	if (type >= C_ARRAY_SIZE(names))
+		return "unknown";
+
+	return names[type];
+}
+
+const char *
+dctool_tankvolume_name (unsigned int type)
+{
+	static const char *names[] = {
+		"none", "metric", "imperial"};
+
+	if (type >= C_ARRAY_SIZE(names))
+		return "unknown";
+
+	return names[type];
+}
@@ -39,12 +39,44 @@ typedef enum dctool_units_t {
 dctool_output_t *
 dctool_xml_output_new (const char *filename, dctool_units_t units);
 
+dctool_output_t *
+dctool_json_output_new (const char *filename, dctool_units_t units);
+
 dctool_output_t *
 dctool_raw_output_new (const char *template);
 
+dctool_output_t *
+dctool_columnar_output_new (const char *filename);
+
+dctool_output_t *
+dctool_pack_output_new (const char *filename);
+
 dc_status_t
 dctool_output_write (dctool_output_t *output, dc_parser_t *parser, const unsigned char data[], unsigned int size, const unsigned char fingerprint[], unsigned int fsize);
 
+/*
+ * Create an output which renders into a private buffer, with the same
+ * settings as the parent output. The dives written to the fork are
+ * appended to the parent with dctool_output_join(), which allows the
+ * dives to be rendered in parallel while keeping the output ordered.
+ */
+dctool_output_t *
+dctool_output_fork (dctool_output_t *output);
+
+/*
+ * Set the number of the last written dive. The next dive is numbered
+ * one higher.
+ */
+void
+dctool_output_set_number (dctool_output_t *output, unsigned int number);
+
+/*
+ * Append the dives written to the fork since the previous join, and
+ * empty the fork again.
+ */
+dc_status_t
+dctool_output_join (dctool_output_t *output, dctool_output_t *fork);
+
 dc_status_t
 dctool_output_free (dctool_output_t *output);
 
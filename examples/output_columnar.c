@@ -0,0 +1,157 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <libdivecomputer/columnar.h>
+
+#include "output-private.h"
+#include "writer.h"
+#include "utils.h"
+
+/*
+ * Columnar output: the samples of each dive are encoded with
+ * dc_parser_export_columnar(), and the blocks are written to a single
+ * binary file.
+ */
+
+static dc_status_t dctool_columnar_output_write (dctool_output_t *output, dc_parser_t *parser, const unsigned char data[], unsigned int size, const unsigned char fingerprint[], unsigned int fsize);
+static dctool_output_t *dctool_columnar_output_fork (dctool_output_t *output);
+static dc_status_t dctool_columnar_output_join (dctool_output_t *output, dctool_output_t *fork);
+static dc_status_t dctool_columnar_output_free (dctool_output_t *output);
+
+typedef struct dctool_columnar_output_t {
+	dctool_output_t base;
+	FILE *ostream;
+	dctool_writer_t *writer;
+	dc_buffer_t *buffer;
+} dctool_columnar_output_t;
+
+static const dctool_output_vtable_t columnar_vtable = {
+	sizeof(dctool_columnar_output_t), /* size */
+	dctool_columnar_output_write, /* write */
+	dctool_columnar_output_fork, /* fork */
+	dctool_columnar_output_join, /* join */
+	dctool_columnar_output_free, /* free */
+};
+
+static dctool_columnar_output_t *
+dctool_columnar_output_create (FILE *ostream)
+{
+	dctool_columnar_output_t *output = NULL;
+
+	output = (dctool_columnar_output_t *) dctool_output_allocate (&columnar_vtable);
+	if (output == NULL) {
+		return NULL;
+	}
+
+	output->ostream = ostream;
+	output->writer = dctool_writer_new (ostream);
+	output->buffer = dc_buffer_new (0);
+
+	if (output->writer == NULL || output->buffer == NULL) {
+		dc_buffer_free (output->buffer);
+		dctool_writer_free (output->writer);
+		dctool_output_deallocate ((dctool_output_t *) output);
+		return NULL;
+	}
+
+	return output;
+}
+
+dctool_output_t *
+dctool_columnar_output_new (const char *filename)
+{
+	dctool_columnar_output_t *output = NULL;
+
+	if (filename == NULL)
+		return NULL;
+
+	// Open the output file.
+	FILE *ostream = fopen (filename, "wb");
+	if (ostream == NULL) {
+		return NULL;
+	}
+
+	output = dctool_columnar_output_create (ostream);
+	if (output == NULL) {
+		fclose (ostream);
+		return NULL;
+	}
+
+	return (dctool_output_t *) output;
+}
+
+static dc_status_t
+dctool_columnar_output_write (dctool_output_t *abstract, dc_parser_t *parser, const unsigned char data[], unsigned int size, const unsigned char fingerprint[], unsigned int fsize)
+{
+	dctool_columnar_output_t *output = (dctool_columnar_output_t *) abstract;
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	// Encode the sample data.
+	message ("Encoding the sample data.\n");
+	dc_buffer_clear (output->buffer);
+	status = dc_parser_export_columnar (parser, output->buffer);
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR ("Error encoding the sample data.");
+		return status;
+	}
+
+	dctool_writer_write (output->writer,
+		dc_buffer_get_data (output->buffer),
+		dc_buffer_get_size (output->buffer));
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dctool_output_t *
+dctool_columnar_output_fork (dctool_output_t *abstract)
+{
+	// A fork encodes into memory.
+	return (dctool_output_t *) dctool_columnar_output_create (NULL);
+}
+
+static dc_status_t
+dctool_columnar_output_join (dctool_output_t *abstract, dctool_output_t *abstract_fork)
+{
+	dctool_columnar_output_t *output = (dctool_columnar_output_t *) abstract;
+	dctool_columnar_output_t *fork = (dctool_columnar_output_t *) abstract_fork;
+
+	dctool_writer_append (output->writer, fork->writer);
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dctool_columnar_output_free (dctool_output_t *abstract)
+{
+	dctool_columnar_output_t *output = (dctool_columnar_output_t *) abstract;
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	dc_buffer_free (output->buffer);
+	status = dctool_writer_free (output->writer);
+
+	if (output->ostream)
+		fclose (output->ostream);
+
+	return status;
+}
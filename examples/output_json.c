@@ -0,0 +1,694 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+
+#include "output-private.h"
+#include "writer.h"
+#include "utils.h"
+
+/*
+ * JSON Lines output: one JSON object per dive, on a single line. The
+ * values use the same units and precision as the XML output.
+ */
+
+static dc_status_t dctool_json_output_write (dctool_output_t *output, dc_parser_t *parser, const unsigned char data[], unsigned int size, const unsigned char fingerprint[], unsigned int fsize);
+static dctool_output_t *dctool_json_output_fork (dctool_output_t *output);
+static dc_status_t dctool_json_output_join (dctool_output_t *output, dctool_output_t *fork);
+static dc_status_t dctool_json_output_free (dctool_output_t *output);
+
+typedef struct dctool_json_output_t {
+	dctool_output_t base;
+	FILE *ostream;
+	dctool_writer_t *writer;
+	// Scratch buffers for the sample values which can occur more than
+	// once per sample, and are collected into arrays.
+	dctool_writer_t *pressures;
+	dctool_writer_t *events;
+	dctool_units_t units;
+} dctool_json_output_t;
+
+static const dctool_output_vtable_t json_vtable = {
+	sizeof(dctool_json_output_t), /* size */
+	dctool_json_output_write, /* write */
+	dctool_json_output_fork, /* fork */
+	dctool_json_output_join, /* join */
+	dctool_json_output_free, /* free */
+};
+
+typedef struct sample_data_t {
+	dctool_json_output_t *output;
+	unsigned int nsamples;
+	// Number of members in the current object.
+	unsigned int nmembers;
+	unsigned int npressures;
+	unsigned int nevents;
+	unsigned int open;
+} sample_data_t;
+
+static void
+json_key (dctool_writer_t *writer, unsigned int *count, const char *name)
+{
+	if ((*count)++)
+		dctool_writer_putc (writer, ',');
+	dctool_writer_putc (writer, '"');
+	dctool_writer_puts (writer, name);
+	dctool_writer_puts (writer, "\":");
+}
+
+static void
+json_number (dctool_writer_t *writer, double value, unsigned int decimals)
+{
+	if (isfinite (value)) {
+		dctool_writer_fixed (writer, value, decimals);
+	} else {
+		dctool_writer_puts (writer, "null");
+	}
+}
+
+static void
+json_string (dctool_writer_t *writer, const char *str)
+{
+	const char ascii[] = "0123456789abcdef";
+
+	dctool_writer_putc (writer, '"');
+
+	const char *begin = str;
+	for (const char *p = str; *p; ++p) {
+		unsigned char c = *p;
+		if (c >= 0x20 && c != '"' && c != '\\')
+			continue;
+
+		dctool_writer_write (writer, begin, p - begin);
+		begin = p + 1;
+
+		switch (c) {
+		case '"':
+			dctool_writer_puts (writer, "\\\"");
+			break;
+		case '\\':
+			dctool_writer_puts (writer, "\\\\");
+			break;
+		case '\n':
+			dctool_writer_puts (writer, "\\n");
+			break;
+		case '\r':
+			dctool_writer_puts (writer, "\\r");
+			break;
+		case '\t':
+			dctool_writer_puts (writer, "\\t");
+			break;
+		default:
+			dctool_writer_puts (writer, "\\u00");
+			dctool_writer_putc (writer, ascii[c >> 4]);
+			dctool_writer_putc (writer, ascii[c & 0x0F]);
+			break;
+		}
+	}
+	dctool_writer_puts (writer, begin);
+
+	dctool_writer_putc (writer, '"');
+}
+
+static void
+sample_begin (sample_data_t *sampledata)
+{
+	dctool_writer_t *writer = sampledata->output->writer;
+
+	if (sampledata->nsamples++)
+		dctool_writer_putc (writer, ',');
+	dctool_writer_putc (writer, '{');
+
+	sampledata->nmembers = 0;
+	sampledata->npressures = 0;
+	sampledata->nevents = 0;
+	sampledata->open = 1;
+}
+
+static void
+sample_end (sample_data_t *sampledata)
+{
+	dctool_json_output_t *output = sampledata->output;
+	dctool_writer_t *writer = output->writer;
+
+	if (!sampledata->open)
+		return;
+
+	if (sampledata->npressures) {
+		json_key (writer, &sampledata->nmembers, "pressure");
+		dctool_writer_putc (writer, '[');
+		dctool_writer_append (writer, output->pressures);
+		dctool_writer_putc (writer, ']');
+	}
+
+	if (sampledata->nevents) {
+		json_key (writer, &sampledata->nmembers, "events");
+		dctool_writer_putc (writer, '[');
+		dctool_writer_append (writer, output->events);
+		dctool_writer_putc (writer, ']');
+	}
+
+	dctool_writer_putc (writer, '}');
+
+	sampledata->open = 0;
+}
+
+static void
+sample_cb (dc_sample_type_t type, dc_sample_value_t value, void *userdata)
+{
+	sample_data_t *sampledata = (sample_data_t *) userdata;
+	dctool_json_output_t *output = sampledata->output;
+	dctool_writer_t *writer = output->writer;
+	dctool_units_t units = output->units;
+
+	if (type == DC_SAMPLE_TIME) {
+		sample_end (sampledata);
+	}
+
+	// Values before the first time sample get a sample of their own.
+	if (!sampledata->open) {
+		sample_begin (sampledata);
+	}
+
+	unsigned int *n = &sampledata->nmembers;
+
+	switch (type) {
+	case DC_SAMPLE_TIME:
+		json_key (writer, n, "time");
+		dctool_writer_uint (writer, value.time, 0);
+		break;
+	case DC_SAMPLE_DEPTH:
+		json_key (writer, n, "depth");
+		json_number (writer, dctool_convert_depth(value.depth, units), 2);
+		break;
+	case DC_SAMPLE_PRESSURE:
+		if (sampledata->npressures++)
+			dctool_writer_putc (output->pressures, ',');
+		dctool_writer_puts (output->pressures, "{\"tank\":");
+		dctool_writer_uint (output->pressures, value.pressure.tank, 0);
+		dctool_writer_puts (output->pressures, ",\"value\":");
+		json_number (output->pressures, dctool_convert_pressure(value.pressure.value, units), 2);
+		dctool_writer_putc (output->pressures, '}');
+		break;
+	case DC_SAMPLE_TEMPERATURE:
+		json_key (writer, n, "temperature");
+		json_number (writer, dctool_convert_temperature(value.temperature, units), 2);
+		break;
+	case DC_SAMPLE_EVENT:
+		if (value.event.type != SAMPLE_EVENT_GASCHANGE && value.event.type != SAMPLE_EVENT_GASCHANGE2) {
+			if (sampledata->nevents++)
+				dctool_writer_putc (output->events, ',');
+			dctool_writer_puts (output->events, "{\"type\":");
+			dctool_writer_uint (output->events, value.event.type, 0);
+			dctool_writer_puts (output->events, ",\"time\":");
+			dctool_writer_uint (output->events, value.event.time, 0);
+			dctool_writer_puts (output->events, ",\"flags\":");
+			dctool_writer_uint (output->events, value.event.flags, 0);
+			dctool_writer_puts (output->events, ",\"value\":");
+			dctool_writer_uint (output->events, value.event.value, 0);
+			dctool_writer_puts (output->events, ",\"name\":");
+			json_string (output->events, dctool_event_name (value.event.type));
+			dctool_writer_putc (output->events, '}');
+		}
+		break;
+	case DC_SAMPLE_RBT:
+		json_key (writer, n, "rbt");
+		dctool_writer_uint (writer, value.rbt, 0);
+		break;
+	case DC_SAMPLE_HEARTBEAT:
+		json_key (writer, n, "heartbeat");
+		dctool_writer_uint (writer, value.heartbeat, 0);
+		break;
+	case DC_SAMPLE_BEARING:
+		json_key (writer, n, "bearing");
+		dctool_writer_uint (writer, value.bearing, 0);
+		break;
+	case DC_SAMPLE_VENDOR:
+		json_key (writer, n, "vendor");
+		dctool_writer_puts (writer, "{\"type\":");
+		dctool_writer_uint (writer, value.vendor.type, 0);
+		dctool_writer_puts (writer, ",\"data\":\"");
+		dctool_writer_hex (writer, (const unsigned char *) value.vendor.data, value.vendor.size);
+		dctool_writer_puts (writer, "\"}");
+		break;
+	case DC_SAMPLE_SETPOINT:
+		json_key (writer, n, "setpoint");
+		json_number (writer, value.setpoint, 2);
+		break;
+	case DC_SAMPLE_PPO2:
+		json_key (writer, n, "ppo2");
+		json_number (writer, value.ppo2, 2);
+		break;
+	case DC_SAMPLE_CNS:
+		json_key (writer, n, "cns");
+		json_number (writer, value.cns * 100.0, 1);
+		break;
+	case DC_SAMPLE_DECO:
+		json_key (writer, n, "deco");
+		dctool_writer_puts (writer, "{\"type\":");
+		json_string (writer, dctool_decostop_name (value.deco.type));
+		dctool_writer_puts (writer, ",\"time\":");
+		dctool_writer_uint (writer, value.deco.time, 0);
+		dctool_writer_puts (writer, ",\"depth\":");
+		json_number (writer, dctool_convert_depth(value.deco.depth, units), 2);
+		dctool_writer_putc (writer, '}');
+		break;
+	case DC_SAMPLE_GASMIX:
+		json_key (writer, n, "gasmix");
+		dctool_writer_uint (writer, value.gasmix, 0);
+		break;
+	case DC_SAMPLE_LOCATION:
+		json_key (writer, n, "location");
+		dctool_writer_puts (writer, "{\"latitude\":");
+		json_number (writer, value.location.latitude, 6);
+		dctool_writer_puts (writer, ",\"longitude\":");
+		json_number (writer, value.location.longitude, 6);
+		dctool_writer_putc (writer, '}');
+		break;
+	default:
+		break;
+	}
+}
+
+static dctool_json_output_t *
+dctool_json_output_create (FILE *ostream, dctool_units_t units)
+{
+	dctool_json_output_t *output = NULL;
+
+	output = (dctool_json_output_t *) dctool_output_allocate (&json_vtable);
+	if (output == NULL) {
+		return NULL;
+	}
+
+	output->ostream = ostream;
+	output->writer = dctool_writer_new (ostream);
+	output->pressures = dctool_writer_new (NULL);
+	output->events = dctool_writer_new (NULL);
+	output->units = units;
+
+	if (output->writer == NULL || output->pressures == NULL || output->events == NULL) {
+		dctool_writer_free (output->events);
+		dctool_writer_free (output->pressures);
+		dctool_writer_free (output->writer);
+		dctool_output_deallocate ((dctool_output_t *) output);
+		return NULL;
+	}
+
+	return output;
+}
+
+dctool_output_t *
+dctool_json_output_new (const char *filename, dctool_units_t units)
+{
+	dctool_json_output_t *output = NULL;
+
+	if (filename == NULL)
+		return NULL;
+
+	// Open the output file.
+	FILE *ostream = fopen (filename, "w");
+	if (ostream == NULL) {
+		return NULL;
+	}
+
+	output = dctool_json_output_create (ostream, units);
+	if (output == NULL) {
+		fclose (ostream);
+		return NULL;
+	}
+
+	return (dctool_output_t *) output;
+}
+
+static dc_status_t
+dctool_json_output_write (dctool_output_t *abstract, dc_parser_t *parser, const unsigned char data[], unsigned int size, const unsigned char fingerprint[], unsigned int fsize)
+{
+	dctool_json_output_t *output = (dctool_json_output_t *) abstract;
+	dctool_writer_t *writer = output->writer;
+	dc_status_t status = DC_STATUS_SUCCESS;
+	unsigned int n = 0, nsamples = 0;
+
+	// Initialize the sample data.
+	sample_data_t sampledata = {0};
+	sampledata.output = output;
+
+	dctool_writer_putc (writer, '{');
+
+	json_key (writer, &n, "number");
+	dctool_writer_uint (writer, abstract->number, 0);
+	json_key (writer, &n, "size");
+	dctool_writer_uint (writer, size, 0);
+
+	if (fingerprint) {
+		json_key (writer, &n, "fingerprint");
+		dctool_writer_putc (writer, '"');
+		dctool_writer_hex (writer, fingerprint, fsize);
+		dctool_writer_putc (writer, '"');
+	}
+
+	// Parse the datetime.
+	message ("Parsing the datetime.\n");
+	dc_datetime_t dt = {0};
+	status = dc_parser_get_datetime (parser, &dt);
+	if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED) {
+		ERROR ("Error parsing the datetime.");
+		goto cleanup;
+	}
+
+	json_key (writer, &n, "datetime");
+	if (dt.timezone == DC_TIMEZONE_NONE) {
+		dctool_writer_printf (writer, "\"%04i-%02i-%02iT%02i:%02i:%02i\"",
+			dt.year, dt.month, dt.day,
+			dt.hour, dt.minute, dt.second);
+	} else {
+		dctool_writer_printf (writer, "\"%04i-%02i-%02iT%02i:%02i:%02i%+03i:%02i\"",
+			dt.year, dt.month, dt.day,
+			dt.hour, dt.minute, dt.second,
+			dt.timezone / 3600, abs (dt.timezone % 3600) / 60);
+	}
+
+	// Parse the divetime.
+	message ("Parsing the divetime.\n");
+	unsigned int divetime = 0;
+	status = dc_parser_get_field (parser, DC_FIELD_DIVETIME, 0, &divetime);
+	if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED) {
+		ERROR ("Error parsing the divetime.");
+		goto cleanup;
+	}
+
+	json_key (writer, &n, "divetime");
+	dctool_writer_uint (writer, divetime, 0);
+
+	// Parse the maxdepth.
+	message ("Parsing the maxdepth.\n");
+	double maxdepth = 0.0;
+	status = dc_parser_get_field (parser, DC_FIELD_MAXDEPTH, 0, &maxdepth);
+	if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED) {
+		ERROR ("Error parsing the maxdepth.");
+		goto cleanup;
+	}
+
+	json_key (writer, &n, "maxdepth");
+	json_number (writer, dctool_convert_depth(maxdepth, output->units), 2);
+
+	// Parse the avgdepth.
+	message ("Parsing the avgdepth.\n");
+	double avgdepth = 0.0;
+	status = dc_parser_get_field (parser, DC_FIELD_AVGDEPTH, 0, &avgdepth);
+	if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED) {
+		ERROR ("Error parsing the avgdepth.");
+		goto cleanup;
+	}
+
+	if (status != DC_STATUS_UNSUPPORTED) {
+		json_key (writer, &n, "avgdepth");
+		json_number (writer, dctool_convert_depth(avgdepth, output->units), 2);
+	}
+
+	// Parse the temperature.
+	message ("Parsing the temperature.\n");
+	unsigned int ntemperatures = 0;
+	for (unsigned int i = 0; i < 3; ++i) {
+		dc_field_type_t fields[] = {DC_FIELD_TEMPERATURE_SURFACE,
+			DC_FIELD_TEMPERATURE_MINIMUM,
+			DC_FIELD_TEMPERATURE_MAXIMUM};
+		const char *names[] = {"surface", "minimum", "maximum"};
+
+		double temperature = 0.0;
+		status = dc_parser_get_field (parser, fields[i], 0, &temperature);
+		if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED) {
+			ERROR ("Error parsing the temperature.");
+			goto cleanup;
+		}
+
+		if (status != DC_STATUS_UNSUPPORTED) {
+			if (ntemperatures == 0) {
+				json_key (writer, &n, "temperature");
+				dctool_writer_putc (writer, '{');
+			}
+			json_key (writer, &ntemperatures, names[i]);
+			json_number (writer, dctool_convert_temperature(temperature, output->units), 1);
+		}
+	}
+	if (ntemperatures) {
+		dctool_writer_putc (writer, '}');
+	}
+
+	// Parse the gas mixes.
+	message ("Parsing the gas mixes.\n");
+	unsigned int ngases = 0;
+	status = dc_parser_get_field (parser, DC_FIELD_GASMIX_COUNT, 0, &ngases);
+	if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED) {
+		ERROR ("Error parsing the gas mix count.");
+		goto cleanup;
+	}
+
+	if (ngases) {
+		json_key (writer, &n, "gasmixes");
+		dctool_writer_putc (writer, '[');
+	}
+	for (unsigned int i = 0; i < ngases; ++i) {
+		dc_gasmix_t gasmix = {0};
+		status = dc_parser_get_field (parser, DC_FIELD_GASMIX, i, &gasmix);
+		if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED) {
+			ERROR ("Error parsing the gas mix.");
+			dctool_writer_putc (writer, ']');
+			goto cleanup;
+		}
+
+		if (i)
+			dctool_writer_putc (writer, ',');
+		dctool_writer_puts (writer, "{\"he\":");
+		json_number (writer, gasmix.helium * 100.0, 1);
+		dctool_writer_puts (writer, ",\"o2\":");
+		json_number (writer, gasmix.oxygen * 100.0, 1);
+		dctool_writer_puts (writer, ",\"n2\":");
+		json_number (writer, gasmix.nitrogen * 100.0, 1);
+		dctool_writer_putc (writer, '}');
+	}
+	if (ngases) {
+		dctool_writer_putc (writer, ']');
+	}
+
+	// Parse the tanks.
+	message ("Parsing the tanks.\n");
+	unsigned int ntanks = 0;
+	status = dc_parser_get_field (parser, DC_FIELD_TANK_COUNT, 0, &ntanks);
+	if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED) {
+		ERROR ("Error parsing the tank count.");
+		goto cleanup;
+	}
+
+	if (ntanks) {
+		json_key (writer, &n, "tanks");
+		dctool_writer_putc (writer, '[');
+	}
+	for (unsigned int i = 0; i < ntanks; ++i) {
+		dc_tank_t tank = {0};
+		status = dc_parser_get_field (parser, DC_FIELD_TANK, i, &tank);
+		if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED) {
+			ERROR ("Error parsing the tank.");
+			dctool_writer_putc (writer, ']');
+			goto cleanup;
+		}
+
+		unsigned int m = 0;
+		if (i)
+			dctool_writer_putc (writer, ',');
+		dctool_writer_putc (writer, '{');
+		if (tank.gasmix != DC_GASMIX_UNKNOWN) {
+			json_key (writer, &m, "gasmix");
+			dctool_writer_uint (writer, tank.gasmix, 0);
+		}
+		if (tank.type != DC_TANKVOLUME_NONE) {
+			json_key (writer, &m, "type");
+			json_string (writer, dctool_tankvolume_name (tank.type));
+			json_key (writer, &m, "volume");
+			json_number (writer, dctool_convert_volume(tank.volume, output->units), 1);
+			json_key (writer, &m, "workpressure");
+			json_number (writer, dctool_convert_pressure(tank.workpressure, output->units), 2);
+		}
+		json_key (writer, &m, "beginpressure");
+		json_number (writer, dctool_convert_pressure(tank.beginpressure, output->units), 2);
+		json_key (writer, &m, "endpressure");
+		json_number (writer, dctool_convert_pressure(tank.endpressure, output->units), 2);
+		dctool_writer_putc (writer, '}');
+	}
+	if (ntanks) {
+		dctool_writer_putc (writer, ']');
+	}
+
+	// Parse the dive mode.
+	message ("Parsing the dive mode.\n");
+	dc_divemode_t divemode = DC_DIVEMODE_OC;
+	status = dc_parser_get_field (parser, DC_FIELD_DIVEMODE, 0, &divemode);
+	if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED) {
+		ERROR ("Error parsing the dive mode.");
+		goto cleanup;
+	}
+
+	if (status != DC_STATUS_UNSUPPORTED) {
+		json_key (writer, &n, "divemode");
+		json_string (writer, dctool_divemode_name (divemode));
+	}
+
+	// Parse the salinity.
+	message ("Parsing the salinity.\n");
+	dc_salinity_t salinity = {DC_WATER_FRESH, 0.0};
+	status = dc_parser_get_field (parser, DC_FIELD_SALINITY, 0, &salinity);
+	if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED) {
+		ERROR ("Error parsing the salinity.");
+		goto cleanup;
+	}
+
+	if (status != DC_STATUS_UNSUPPORTED) {
+		json_key (writer, &n, "salinity");
+		dctool_writer_puts (writer, "{\"type\":");
+		dctool_writer_uint (writer, salinity.type, 0);
+		dctool_writer_puts (writer, ",\"density\":");
+		json_number (writer, salinity.density, 1);
+		dctool_writer_putc (writer, '}');
+	}
+
+	// Parse the atmospheric pressure.
+	message ("Parsing the atmospheric pressure.\n");
+	double atmospheric = 0.0;
+	status = dc_parser_get_field (parser, DC_FIELD_ATMOSPHERIC, 0, &atmospheric);
+	if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED) {
+		ERROR ("Error parsing the atmospheric pressure.");
+		goto cleanup;
+	}
+
+	if (status != DC_STATUS_UNSUPPORTED) {
+		json_key (writer, &n, "atmospheric");
+		json_number (writer, dctool_convert_pressure(atmospheric, output->units), 5);
+	}
+
+	// Parse the location.
+	message ("Parsing the location.\n");
+	dc_location_t location = {0};
+	status = dc_parser_get_field (parser, DC_FIELD_LOCATION, 0, &location);
+	if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED) {
+		ERROR ("Error parsing the location.");
+		goto cleanup;
+	}
+
+	if (status != DC_STATUS_UNSUPPORTED) {
+		json_key (writer, &n, "location");
+		dctool_writer_puts (writer, "{\"latitude\":");
+		json_number (writer, location.latitude, 6);
+		dctool_writer_puts (writer, ",\"longitude\":");
+		json_number (writer, location.longitude, 6);
+		dctool_writer_puts (writer, ",\"altitude\":");
+		json_number (writer, dctool_convert_depth(location.altitude, output->units), 1);
+		dctool_writer_putc (writer, '}');
+	}
+
+	message ("Parsing strings.\n");
+	unsigned int nstrings = 0;
+	for (unsigned int i = 0; i < 100; i++) {
+		dc_field_string_t str = { NULL };
+		status = dc_parser_get_field(parser, DC_FIELD_STRING, i, &str);
+		if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED) {
+			ERROR ("Error parsing strings");
+			break;
+		}
+		if (status == DC_STATUS_UNSUPPORTED)
+			break;
+		if (!str.desc || !str.value)
+			break;
+		if (nstrings == 0) {
+			json_key (writer, &n, "extradata");
+			dctool_writer_putc (writer, '{');
+		}
+		if (nstrings++)
+			dctool_writer_putc (writer, ',');
+		json_string (writer, str.desc);
+		dctool_writer_putc (writer, ':');
+		json_string (writer, str.value);
+	}
+	if (nstrings) {
+		dctool_writer_putc (writer, '}');
+	}
+	if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED) {
+		goto cleanup;
+	}
+
+	// Parse the sample data.
+	message ("Parsing the sample data.\n");
+	json_key (writer, &n, "samples");
+	dctool_writer_putc (writer, '[');
+	nsamples = 1;
+	status = dc_parser_samples_foreach (parser, sample_cb, &sampledata);
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR ("Error parsing the sample data.");
+		goto cleanup;
+	}
+
+cleanup:
+
+	if (nsamples) {
+		sample_end (&sampledata);
+		dctool_writer_putc (writer, ']');
+	}
+	dctool_writer_puts (writer, "}\n");
+
+	return status;
+}
+
+static dctool_output_t *
+dctool_json_output_fork (dctool_output_t *abstract)
+{
+	dctool_json_output_t *output = (dctool_json_output_t *) abstract;
+
+	// A fork renders into memory.
+	return (dctool_output_t *) dctool_json_output_create (NULL, output->units);
+}
+
+static dc_status_t
+dctool_json_output_join (dctool_output_t *abstract, dctool_output_t *abstract_fork)
+{
+	dctool_json_output_t *output = (dctool_json_output_t *) abstract;
+	dctool_json_output_t *fork = (dctool_json_output_t *) abstract_fork;
+
+	dctool_writer_append (output->writer, fork->writer);
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dctool_json_output_free (dctool_output_t *abstract)
+{
+	dctool_json_output_t *output = (dctool_json_output_t *) abstract;
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	dctool_writer_free (output->events);
+	dctool_writer_free (output->pressures);
+	status = dctool_writer_free (output->writer);
+
+	if (output->ostream)
+		fclose (output->ostream);
+
+	return status;
+}
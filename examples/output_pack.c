@@ -0,0 +1,262 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "output-private.h"
+#include "pack.h"
+#include "utils.h"
+
+/*
+ * Packed output: the raw dives are appended to a single archive file,
+ * instead of writing every dive to a file of its own. The index is
+ * written when the output is closed.
+ */
+
+static dc_status_t dctool_pack_output_write (dctool_output_t *output, dc_parser_t *parser, const unsigned char data[], unsigned int size, const unsigned char fingerprint[], unsigned int fsize);
+static dc_status_t dctool_pack_output_free (dctool_output_t *output);
+
+typedef struct dctool_pack_output_t {
+	dctool_output_t base;
+	FILE *ostream;
+	unsigned long long offset;
+	unsigned long long *offsets;
+	unsigned int count;
+	unsigned int capacity;
+	int error;
+} dctool_pack_output_t;
+
+static const dctool_output_vtable_t pack_vtable = {
+	sizeof(dctool_pack_output_t), /* size */
+	dctool_pack_output_write, /* write */
+	NULL, /* fork */
+	NULL, /* join */
+	dctool_pack_output_free, /* free */
+};
+
+static void
+pack_put_uint32_le (unsigned char data[], unsigned int value)
+{
+	data[0] = (value      ) & 0xFF;
+	data[1] = (value >>  8) & 0xFF;
+	data[2] = (value >> 16) & 0xFF;
+	data[3] = (value >> 24) & 0xFF;
+}
+
+static void
+pack_put_uint64_le (unsigned char data[], unsigned long long value)
+{
+	pack_put_uint32_le (data, value & 0xFFFFFFFF);
+	pack_put_uint32_le (data + 4, value >> 32);
+}
+
+static int
+dctool_pack_output_reserve (dctool_pack_output_t *output, unsigned int count)
+{
+	if (count <= output->capacity)
+		return 0;
+
+	unsigned int capacity = output->capacity ? output->capacity : 64;
+	while (capacity < count)
+		capacity *= 2;
+
+	unsigned long long *offsets = (unsigned long long *) realloc (output->offsets, capacity * sizeof (unsigned long long));
+	if (offsets == NULL)
+		return -1;
+
+	output->offsets = offsets;
+	output->capacity = capacity;
+
+	return 0;
+}
+
+/*
+ * Continue an existing archive. The new dives overwrite the old index,
+ * which is written again, with the new dives included, when the output
+ * is closed.
+ */
+static int
+dctool_pack_output_resume (dctool_pack_output_t *output, const char *filename)
+{
+	dctool_pack_t *pack = NULL;
+	if (dctool_pack_open (&pack, filename) != DC_STATUS_SUCCESS) {
+		ERROR ("The output file is not a packed archive.");
+		return -1;
+	}
+
+	unsigned int count = dctool_pack_get_count (pack);
+	if (dctool_pack_output_reserve (output, count) != 0) {
+		dctool_pack_close (pack);
+		return -1;
+	}
+
+	for (unsigned int i = 0; i < count; ++i) {
+		dctool_pack_dive_t dive;
+		dctool_pack_get_dive (pack, i, &dive);
+		output->offsets[i] = dive.offset;
+	}
+
+	output->count = count;
+	output->offset = dctool_pack_get_end (pack);
+
+	dctool_pack_close (pack);
+
+	output->ostream = fopen (filename, "r+b");
+	if (output->ostream == NULL)
+		return -1;
+
+	if (fseek (output->ostream, (long) output->offset, SEEK_SET) != 0)
+		return -1;
+
+	return 0;
+}
+
+dctool_output_t *
+dctool_pack_output_new (const char *filename)
+{
+	dctool_pack_output_t *output = NULL;
+
+	if (filename == NULL)
+		goto error_exit;
+
+	// Allocate memory.
+	output = (dctool_pack_output_t *) dctool_output_allocate (&pack_vtable);
+	if (output == NULL) {
+		goto error_exit;
+	}
+
+	output->ostream = NULL;
+	output->offset = DCTOOL_PACK_HEADER_SIZE;
+	output->offsets = NULL;
+	output->count = 0;
+	output->capacity = 0;
+	output->error = 0;
+
+	// Check whether the archive exists already.
+	long size = 0;
+	FILE *fp = fopen (filename, "rb");
+	if (fp) {
+		if (fseek (fp, 0, SEEK_END) == 0)
+			size = ftell (fp);
+		fclose (fp);
+	}
+
+	if (size > 0) {
+		if (dctool_pack_output_resume (output, filename) != 0)
+			goto error_free;
+	} else {
+		output->ostream = fopen (filename, "wb");
+		if (output->ostream == NULL)
+			goto error_free;
+
+		unsigned char header[DCTOOL_PACK_HEADER_SIZE] = {'D', 'C', 'P', 'K'};
+		pack_put_uint32_le (header + 4, DCTOOL_PACK_VERSION);
+		if (fwrite (header, 1, sizeof (header), output->ostream) != sizeof (header))
+			goto error_free;
+	}
+
+	return (dctool_output_t *) output;
+
+error_free:
+	if (output->ostream)
+		fclose (output->ostream);
+	free (output->offsets);
+	dctool_output_deallocate ((dctool_output_t *) output);
+error_exit:
+	return NULL;
+}
+
+static dc_status_t
+dctool_pack_output_write (dctool_output_t *abstract, dc_parser_t *parser, const unsigned char data[], unsigned int size, const unsigned char fingerprint[], unsigned int fsize)
+{
+	dctool_pack_output_t *output = (dctool_pack_output_t *) abstract;
+
+	if (output->error)
+		return DC_STATUS_IO;
+
+	if (dctool_pack_output_reserve (output, output->count + 1) != 0) {
+		ERROR ("Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	unsigned char header[DCTOOL_PACK_DIVE_SIZE] = {'D', 'C', 'P', 'D'};
+	pack_put_uint32_le (header + 4, size);
+	pack_put_uint32_le (header + 8, fsize);
+
+	if (fwrite (header, 1, sizeof (header), output->ostream) != sizeof (header) ||
+		fwrite (data, 1, size, output->ostream) != size ||
+		fwrite (fingerprint, 1, fsize, output->ostream) != fsize) {
+		ERROR ("Failed to write the output file.");
+		output->error = 1;
+		return DC_STATUS_IO;
+	}
+
+	output->offsets[output->count++] = output->offset;
+	output->offset += sizeof (header) + size + fsize;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dctool_pack_output_free (dctool_output_t *abstract)
+{
+	dctool_pack_output_t *output = (dctool_pack_output_t *) abstract;
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	// Write the index and the trailer.
+	if (!output->error) {
+		for (unsigned int i = 0; i < output->count; ++i) {
+			unsigned char offset[8];
+			pack_put_uint64_le (offset, output->offsets[i]);
+			if (fwrite (offset, 1, sizeof (offset), output->ostream) != sizeof (offset)) {
+				status = DC_STATUS_IO;
+				break;
+			}
+		}
+
+		unsigned char trailer[DCTOOL_PACK_TRAILER_SIZE] = {0};
+		pack_put_uint64_le (trailer, output->offset);
+		pack_put_uint32_le (trailer + 8, output->count);
+		trailer[12] = 'D';
+		trailer[13] = 'C';
+		trailer[14] = 'P';
+		trailer[15] = 'X';
+		if (status == DC_STATUS_SUCCESS &&
+			fwrite (trailer, 1, sizeof (trailer), output->ostream) != sizeof (trailer))
+			status = DC_STATUS_IO;
+
+		// Discard anything after the trailer, such as the remains of an
+		// interrupted download in a resumed archive.
+		unsigned long long end = output->offset + output->count * 8ULL + sizeof (trailer);
+		if (status == DC_STATUS_SUCCESS &&
+			(fflush (output->ostream) != 0 || ftruncate (fileno (output->ostream), end) != 0))
+			status = DC_STATUS_IO;
+	}
+
+	if (fclose (output->ostream) != 0)
+		status = DC_STATUS_IO;
+
+	free (output->offsets);
+
+	return status;
+}
@@ -37,6 +37,8 @@ typedef struct dctool_raw_output_t {
 static const dctool_output_vtable_t raw_vtable = {
 	sizeof(dctool_raw_output_t), /* size */
 	dctool_raw_output_write, /* write */
+	NULL, /* fork */
+	NULL, /* join */
 	dctool_raw_output_free, /* free */
 };
 
@@ -23,145 +23,162 @@
 #include <string.h>
 #include <stdio.h>
 
-#include <libdivecomputer/units.h>
-
 #include "output-private.h"
+#include "writer.h"
 #include "utils.h"
 
 static dc_status_t dctool_xml_output_write (dctool_output_t *output, dc_parser_t *parser, const unsigned char data[], unsigned int size, const unsigned char fingerprint[], unsigned int fsize);
+static dctool_output_t *dctool_xml_output_fork (dctool_output_t *output);
+static dc_status_t dctool_xml_output_join (dctool_output_t *output, dctool_output_t *fork);
 static dc_status_t dctool_xml_output_free (dctool_output_t *output);
 
 typedef struct dctool_xml_output_t {
 	dctool_output_t base;
 	FILE *ostream;
+	dctool_writer_t *writer;
 	dctool_units_t units;
 } dctool_xml_output_t;
 
 static const dctool_output_vtable_t xml_vtable = {
 	sizeof(dctool_xml_output_t), /* size */
 	dctool_xml_output_write, /* write */
+	dctool_xml_output_fork, /* fork */
+	dctool_xml_output_join, /* join */
 	dctool_xml_output_free, /* free */
 };
 
 typedef struct sample_data_t {
-	FILE *ostream;
+	dctool_writer_t *writer;
 	dctool_units_t units;
 	unsigned int nsamples;
 } sample_data_t;
 
-static double
-convert_depth (double value, dctool_units_t units)
-{
-	if (units == DCTOOL_UNITS_IMPERIAL) {
-		return value / FEET;
-	} else {
-		return value;
-	}
-}
-
-static double
-convert_temperature (double value, dctool_units_t units)
+static void
+write_element_uint (dctool_writer_t *writer, const char *name, unsigned int value)
 {
-	if (units == DCTOOL_UNITS_IMPERIAL) {
-		return value * (9.0 / 5.0) + 32.0;
-	} else {
-		return value;
-	}
+	dctool_writer_puts (writer, "<");
+	dctool_writer_puts (writer, name);
+	dctool_writer_puts (writer, ">");
+	dctool_writer_uint (writer, value, 0);
+	dctool_writer_puts (writer, "</");
+	dctool_writer_puts (writer, name);
+	dctool_writer_puts (writer, ">\n");
 }
 
-static double
-convert_pressure (double value, dctool_units_t units)
-{
-	if (units == DCTOOL_UNITS_IMPERIAL) {
-		return value * BAR / PSI;
-	} else {
-		return value;
-	}
-}
-
-static double
-convert_volume (double value, dctool_units_t units)
+static void
+write_element_fixed (dctool_writer_t *writer, const char *name, double value, unsigned int decimals)
 {
-	if (units == DCTOOL_UNITS_IMPERIAL) {
-		return value / 1000.0 / CUFT;
-	} else {
-		return value;
-	}
+	dctool_writer_puts (writer, "<");
+	dctool_writer_puts (writer, name);
+	dctool_writer_puts (writer, ">");
+	dctool_writer_fixed (writer, value, decimals);
+	dctool_writer_puts (writer, "</");
+	dctool_writer_puts (writer, name);
+	dctool_writer_puts (writer, ">\n");
 }
 
 static void
 sample_cb (dc_sample_type_t type, dc_sample_value_t value, void *userdata)
 {
-	static const char *events[] = {
-		"none", "deco", "rbt", "ascent", "ceiling", "workload", "transmitter",
-		"violation", "bookmark", "surface", "safety stop", "gaschange",
-		"safety stop (voluntary)", "safety stop (mandatory)", "deepstop",
-		"ceiling (safety stop)", "floor", "divetime", "maxdepth",
-		"OLF", "PO2", "airtime", "rgbm", "heading", "tissue level warning",
-		"gaschange2"};
-	static const char *decostop[] = {
-		"ndl", "safety", "deco", "deep"};
-
 	sample_data_t *sampledata = (sample_data_t *) userdata;
+	dctool_writer_t *writer = sampledata->writer;
 
 	switch (type) {
 	case DC_SAMPLE_TIME:
 		if (sampledata->nsamples++)
-			fprintf (sampledata->ostream, "</sample>\n");
-		fprintf (sampledata->ostream, "<sample>\n");
-		fprintf (sampledata->ostream, "   <time>%02u:%02u</time>\n", value.time / 60, value.time % 60);
+			dctool_writer_puts (writer, "</sample>\n");
+		dctool_writer_puts (writer, "<sample>\n   <time>");
+		dctool_writer_uint (writer, value.time / 60, 2);
+		dctool_writer_putc (writer, ':');
+		dctool_writer_uint (writer, value.time % 60, 2);
+		dctool_writer_puts (writer, "</time>\n");
 		break;
 	case DC_SAMPLE_DEPTH:
-		fprintf (sampledata->ostream, "   <depth>%.2f</depth>\n",
-			convert_depth(value.depth, sampledata->units));
+		dctool_writer_puts (writer, "   ");
+		write_element_fixed (writer, "depth",
+			dctool_convert_depth(value.depth, sampledata->units), 2);
 		break;
 	case DC_SAMPLE_PRESSURE:
-		fprintf (sampledata->ostream, "   <pressure tank=\"%u\">%.2f</pressure>\n",
-			value.pressure.tank,
-			convert_pressure(value.pressure.value, sampledata->units));
+		dctool_writer_puts (writer, "   <pressure tank=\"");
+		dctool_writer_uint (writer, value.pressure.tank, 0);
+		dctool_writer_puts (writer, "\">");
+		dctool_writer_fixed (writer,
+			dctool_convert_pressure(value.pressure.value, sampledata->units), 2);
+		dctool_writer_puts (writer, "</pressure>\n");
 		break;
 	case DC_SAMPLE_TEMPERATURE:
-		fprintf (sampledata->ostream, "   <temperature>%.2f</temperature>\n",
-			convert_temperature(value.temperature, sampledata->units));
+		dctool_writer_puts (writer, "   ");
+		write_element_fixed (writer, "temperature",
+			dctool_convert_temperature(value.temperature, sampledata->units), 2);
 		break;
 	case DC_SAMPLE_EVENT:
 		if (value.event.type != SAMPLE_EVENT_GASCHANGE && value.event.type != SAMPLE_EVENT_GASCHANGE2) {
-			fprintf (sampledata->ostream, "   <event type=\"%u\" time=\"%u\" flags=\"%u\" value=\"%u\">%s</event>\n",
-				value.event.type, value.event.time, value.event.flags, value.event.value, events[value.event.type]);
+			dctool_writer_puts (writer, "   <event type=\"");
+			dctool_writer_uint (writer, value.event.type, 0);
+			dctool_writer_puts (writer, "\" time=\"");
+			dctool_writer_uint (writer, value.event.time, 0);
+			dctool_writer_puts (writer, "\" flags=\"");
+			dctool_writer_uint (writer, value.event.flags, 0);
+			dctool_writer_puts (writer, "\" value=\"");
+			dctool_writer_uint (writer, value.event.value, 0);
+			dctool_writer_puts (writer, "\">");
+			dctool_writer_puts (writer, dctool_event_name (value.event.type));
+			dctool_writer_puts (writer, "</event>\n");
 		}
 		break;
 	case DC_SAMPLE_RBT:
-		fprintf (sampledata->ostream, "   <rbt>%u</rbt>\n", value.rbt);
+		dctool_writer_puts (writer, "   ");
+		write_element_uint (writer, "rbt", value.rbt);
 		break;
 	case DC_SAMPLE_HEARTBEAT:
-		fprintf (sampledata->ostream, "   <heartbeat>%u</heartbeat>\n", value.heartbeat);
+		dctool_writer_puts (writer, "   ");
+		write_element_uint (writer, "heartbeat", value.heartbeat);
 		break;
 	case DC_SAMPLE_BEARING:
-		fprintf (sampledata->ostream, "   <bearing>%u</bearing>\n", value.bearing);
+		dctool_writer_puts (writer, "   ");
+		write_element_uint (writer, "bearing", value.bearing);
 		break;
 	case DC_SAMPLE_VENDOR:
-		fprintf (sampledata->ostream, "   <vendor type=\"%u\" size=\"%u\">", value.vendor.type, value.vendor.size);
-		for (unsigned int i = 0; i < value.vendor.size; ++i)
-			fprintf (sampledata->ostream, "%02X", ((const unsigned char *) value.vendor.data)[i]);
-		fprintf (sampledata->ostream, "</vendor>\n");
+		dctool_writer_puts (writer, "   <vendor type=\"");
+		dctool_writer_uint (writer, value.vendor.type, 0);
+		dctool_writer_puts (writer, "\" size=\"");
+		dctool_writer_uint (writer, value.vendor.size, 0);
+		dctool_writer_puts (writer, "\">");
+		dctool_writer_hex (writer, (const unsigned char *) value.vendor.data, value.vendor.size);
+		dctool_writer_puts (writer, "</vendor>\n");
 		break;
 	case DC_SAMPLE_SETPOINT:
-		fprintf (sampledata->ostream, "   <setpoint>%.2f</setpoint>\n", value.setpoint);
+		dctool_writer_puts (writer, "   ");
+		write_element_fixed (writer, "setpoint", value.setpoint, 2);
 		break;
 	case DC_SAMPLE_PPO2:
-		fprintf (sampledata->ostream, "   <ppo2>%.2f</ppo2>\n", value.ppo2);
+		dctool_writer_puts (writer, "   ");
+		write_element_fixed (writer, "ppo2", value.ppo2, 2);
 		break;
 	case DC_SAMPLE_CNS:
-		fprintf (sampledata->ostream, "   <cns>%.1f</cns>\n", value.cns * 100.0);
+		dctool_writer_puts (writer, "   ");
+		write_element_fixed (writer, "cns", value.cns * 100.0, 1);
 		break;
 	case DC_SAMPLE_DECO:
-		fprintf (sampledata->ostream, "   <deco time=\"%u\" depth=\"%.2f\">%s</deco>\n",
-			value.deco.time,
-			convert_depth(value.deco.depth, sampledata->units),
-			decostop[value.deco.type]);
+		dctool_writer_puts (writer, "   <deco time=\"");
+		dctool_writer_uint (writer, value.deco.time, 0);
+		dctool_writer_puts (writer, "\" depth=\"");
+		dctool_writer_fixed (writer,
+			dctool_convert_depth(value.deco.depth, sampledata->units), 2);
+		dctool_writer_puts (writer, "\">");
+		dctool_writer_puts (writer, dctool_decostop_name (value.deco.type));
+		dctool_writer_puts (writer, "</deco>\n");
 		break;
 	case DC_SAMPLE_GASMIX:
-		fprintf (sampledata->ostream, "   <gasmix>%u</gasmix>\n", value.gasmix);
+		dctool_writer_puts (writer, "   ");
+		write_element_uint (writer, "gasmix", value.gasmix);
+		break;
+	case DC_SAMPLE_LOCATION:
+		dctool_writer_puts (writer, "   <location latitude=\"");
+		dctool_writer_fixed (writer, value.location.latitude, 6);
+		dctool_writer_puts (writer, "\" longitude=\"");
+		dctool_writer_fixed (writer, value.location.longitude, 6);
+		dctool_writer_puts (writer, "\" />\n");
 		break;
 	default:
 		break;
@@ -188,12 +205,19 @@ dctool_xml_output_new (const char *filename, dctool_units_t units)
 		goto error_free;
 	}
 
+	output->writer = dctool_writer_new (output->ostream);
+	if (output->writer == NULL) {
+		goto error_close;
+	}
+
 	output->units = units;
 
-	fprintf (output->ostream, "<device>\n");
+	dctool_writer_puts (output->writer, "<device>\n");
 
 	return (dctool_output_t *) output;
 
+error_close:
+	fclose (output->ostream);
 error_free:
 	dctool_output_deallocate ((dctool_output_t *) output);
 error_exit:
@@ -204,21 +228,23 @@ static dc_status_t
 dctool_xml_output_write (dctool_output_t *abstract, dc_parser_t *parser, const unsigned char data[], unsigned int size, const unsigned char fingerprint[], unsigned int fsize)
 {
 	dctool_xml_output_t *output = (dctool_xml_output_t *) abstract;
+	dctool_writer_t *writer = output->writer;
 	dc_status_t status = DC_STATUS_SUCCESS;
 
 	// Initialize the sample data.
 	sample_data_t sampledata = {0};
 	sampledata.nsamples = 0;
-	sampledata.ostream = output->ostream;
+	sampledata.writer = writer;
 	sampledata.units = output->units;
 
-	fprintf (output->ostream, "<dive>\n<number>%u</number>\n<size>%u</size>\n", abstract->number, size);
+	dctool_writer_puts (writer, "<dive>\n");
+	write_element_uint (writer, "number", abstract->number);
+	write_element_uint (writer, "size", size);
 
 	if (fingerprint) {
-		fprintf (output->ostream, "<fingerprint>");
-		for (unsigned int i = 0; i < fsize; ++i)
-			fprintf (output->ostream, "%02X", fingerprint[i]);
-		fprintf (output->ostream, "</fingerprint>\n");
+		dctool_writer_puts (writer, "<fingerprint>");
+		dctool_writer_hex (writer, fingerprint, fsize);
+		dctool_writer_puts (writer, "</fingerprint>\n");
 	}
 
 	// Parse the datetime.
@@ -231,11 +257,11 @@ dctool_xml_output_write (dctool_output_t *abstract, dc_parser_t *parser, const u
 	}
 
 	if (dt.timezone == DC_TIMEZONE_NONE) {
-		fprintf (output->ostream, "<datetime>%04i-%02i-%02i %02i:%02i:%02i</datetime>\n",
+		dctool_writer_printf (writer, "<datetime>%04i-%02i-%02i %02i:%02i:%02i</datetime>\n",
 			dt.year, dt.month, dt.day,
 			dt.hour, dt.minute, dt.second);
 	} else {
-		fprintf (output->ostream, "<datetime>%04i-%02i-%02i %02i:%02i:%02i %+03i:%02i</datetime>\n",
+		dctool_writer_printf (writer, "<datetime>%04i-%02i-%02i %02i:%02i:%02i %+03i:%02i</datetime>\n",
 			dt.year, dt.month, dt.day,
 			dt.hour, dt.minute, dt.second,
 			dt.timezone / 3600, (dt.timezone % 3600) / 60);
@@ -250,8 +276,11 @@ dctool_xml_output_write (dctool_output_t *abstract, dc_parser_t *parser, const u
 		goto cleanup;
 	}
 
-	fprintf (output->ostream, "<divetime>%02u:%02u</divetime>\n",
-		divetime / 60, divetime % 60);
+	dctool_writer_puts (writer, "<divetime>");
+	dctool_writer_uint (writer, divetime / 60, 2);
+	dctool_writer_putc (writer, ':');
+	dctool_writer_uint (writer, divetime % 60, 2);
+	dctool_writer_puts (writer, "</divetime>\n");
 
 	// Parse the maxdepth.
 	message ("Parsing the maxdepth.\n");
@@ -262,8 +291,8 @@ dctool_xml_output_write (dctool_output_t *abstract, dc_parser_t *parser, const u
 		goto cleanup;
 	}
 
-	fprintf (output->ostream, "<maxdepth>%.2f</maxdepth>\n",
-		convert_depth(maxdepth, output->units));
+	write_element_fixed (writer, "maxdepth",
+		dctool_convert_depth(maxdepth, output->units), 2);
 
 	// Parse the avgdepth.
 	message ("Parsing the avgdepth.\n");
@@ -275,8 +304,8 @@ dctool_xml_output_write (dctool_output_t *abstract, dc_parser_t *parser, const u
 	}
 
 	if (status != DC_STATUS_UNSUPPORTED) {
-		fprintf (output->ostream, "<avgdepth>%.2f</avgdepth>\n",
-			convert_depth(avgdepth, output->units));
+		write_element_fixed (writer, "avgdepth",
+			dctool_convert_depth(avgdepth, output->units), 2);
 	}
 
 	// Parse the temperature.
@@ -295,9 +324,12 @@ dctool_xml_output_write (dctool_output_t *abstract, dc_parser_t *parser, const u
 		}
 
 		if (status != DC_STATUS_UNSUPPORTED) {
-			fprintf (output->ostream, "<temperature type=\"%s\">%.1f</temperature>\n",
-				names[i],
-				convert_temperature(temperature, output->units));
+			dctool_writer_puts (writer, "<temperature type=\"");
+			dctool_writer_puts (writer, names[i]);
+			dctool_writer_puts (writer, "\">");
+			dctool_writer_fixed (writer,
+				dctool_convert_temperature(temperature, output->units), 1);
+			dctool_writer_puts (writer, "</temperature>\n");
 		}
 	}
 
@@ -318,15 +350,13 @@ dctool_xml_output_write (dctool_output_t *abstract, dc_parser_t *parser, const u
 			goto cleanup;
 		}
 
-		fprintf (output->ostream,
-			"<gasmix>\n"
-			"   <he>%.1f</he>\n"
-			"   <o2>%.1f</o2>\n"
-			"   <n2>%.1f</n2>\n"
-			"</gasmix>\n",
-			gasmix.helium * 100.0,
-			gasmix.oxygen * 100.0,
-			gasmix.nitrogen * 100.0);
+		dctool_writer_puts (writer, "<gasmix>\n   ");
+		write_element_fixed (writer, "he", gasmix.helium * 100.0, 1);
+		dctool_writer_puts (writer, "   ");
+		write_element_fixed (writer, "o2", gasmix.oxygen * 100.0, 1);
+		dctool_writer_puts (writer, "   ");
+		write_element_fixed (writer, "n2", gasmix.nitrogen * 100.0, 1);
+		dctool_writer_puts (writer, "</gasmix>\n");
 	}
 
 	// Parse the tanks.
@@ -339,8 +369,6 @@ dctool_xml_output_write (dctool_output_t *abstract, dc_parser_t *parser, const u
 	}
 
 	for (unsigned int i = 0; i < ntanks; ++i) {
-		const char *names[] = {"none", "metric", "imperial"};
-
 		dc_tank_t tank = {0};
 		status = dc_parser_get_field (parser, DC_FIELD_TANK, i, &tank);
 		if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED) {
@@ -348,27 +376,28 @@ dctool_xml_output_write (dctool_output_t *abstract, dc_parser_t *parser, const u
 			goto cleanup;
 		}
 
-		fprintf (output->ostream, "<tank>\n");
+		dctool_writer_puts (writer, "<tank>\n");
 		if (tank.gasmix != DC_GASMIX_UNKNOWN) {
-			fprintf (output->ostream,
-				"   <gasmix>%u</gasmix>\n",
-				tank.gasmix);
+			dctool_writer_puts (writer, "   ");
+			write_element_uint (writer, "gasmix", tank.gasmix);
 		}
 		if (tank.type != DC_TANKVOLUME_NONE) {
-			fprintf (output->ostream,
-				"   <type>%s</type>\n"
-				"   <volume>%.1f</volume>\n"
-				"   <workpressure>%.2f</workpressure>\n",
-				names[tank.type],
-				convert_volume(tank.volume, output->units),
-				convert_pressure(tank.workpressure, output->units));
+			dctool_writer_puts (writer, "   <type>");
+			dctool_writer_puts (writer, dctool_tankvolume_name (tank.type));
+			dctool_writer_puts (writer, "</type>\n   ");
+			write_element_fixed (writer, "volume",
+				dctool_convert_volume(tank.volume, output->units), 1);
+			dctool_writer_puts (writer, "   ");
+			write_element_fixed (writer, "workpressure",
+				dctool_convert_pressure(tank.workpressure, output->units), 2);
 		}
-		fprintf (output->ostream,
-			"   <beginpressure>%.2f</beginpressure>\n"
-			"   <endpressure>%.2f</endpressure>\n"
-			"</tank>\n",
-			convert_pressure(tank.beginpressure, output->units),
-			convert_pressure(tank.endpressure, output->units));
+		dctool_writer_puts (writer, "   ");
+		write_element_fixed (writer, "beginpressure",
+			dctool_convert_pressure(tank.beginpressure, output->units), 2);
+		dctool_writer_puts (writer, "   ");
+		write_element_fixed (writer, "endpressure",
+			dctool_convert_pressure(tank.endpressure, output->units), 2);
+		dctool_writer_puts (writer, "</tank>\n");
 	}
 
 	// Parse the dive mode.
@@ -381,9 +410,9 @@ dctool_xml_output_write (dctool_output_t *abstract, dc_parser_t *parser, const u
 	}
 
 	if (status != DC_STATUS_UNSUPPORTED) {
-		const char *names[] = {"freedive", "gauge", "oc", "ccr", "scr"};
-		fprintf (output->ostream, "<divemode>%s</divemode>\n",
-			names[divemode]);
+		dctool_writer_puts (writer, "<divemode>");
+		dctool_writer_puts (writer, dctool_divemode_name (divemode));
+		dctool_writer_puts (writer, "</divemode>\n");
 	}
 
 	// Parse the salinity.
@@ -396,8 +425,11 @@ dctool_xml_output_write (dctool_output_t *abstract, dc_parser_t *parser, const u
 	}
 
 	if (status != DC_STATUS_UNSUPPORTED) {
-		fprintf (output->ostream, "<salinity type=\"%u\">%.1f</salinity>\n",
-			salinity.type, salinity.density);
+		dctool_writer_puts (writer, "<salinity type=\"");
+		dctool_writer_uint (writer, salinity.type, 0);
+		dctool_writer_puts (writer, "\">");
+		dctool_writer_fixed (writer, salinity.density, 1);
+		dctool_writer_puts (writer, "</salinity>\n");
 	}
 
 	// Parse the atmospheric pressure.
@@ -410,8 +442,28 @@ dctool_xml_output_write (dctool_output_t *abstract, dc_parser_t *parser, const u
 	}
 
 	if (status != DC_STATUS_UNSUPPORTED) {
-		fprintf (output->ostream, "<atmospheric>%.5f</atmospheric>\n",
-			convert_pressure(atmospheric, output->units));
+		write_element_fixed (writer, "atmospheric",
+			dctool_convert_pressure(atmospheric, output->units), 5);
+	}
+
+	// Parse the location.
+	message ("Parsing the location.\n");
+	dc_location_t location = {0};
+	status = dc_parser_get_field (parser, DC_FIELD_LOCATION, 0, &location);
+	if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED) {
+		ERROR ("Error parsing the location.");
+		goto cleanup;
+	}
+
+	if (status != DC_STATUS_UNSUPPORTED) {
+		dctool_writer_puts (writer, "<location latitude=\"");
+		dctool_writer_fixed (writer, location.latitude, 6);
+		dctool_writer_puts (writer, "\" longitude=\"");
+		dctool_writer_fixed (writer, location.longitude, 6);
+		dctool_writer_puts (writer, "\" altitude=\"");
+		dctool_writer_fixed (writer,
+			dctool_convert_depth(location.altitude, output->units), 1);
+		dctool_writer_puts (writer, "\" />\n");
 	}
 
 	message ("Parsing strings.\n");
@@ -427,8 +479,11 @@ dctool_xml_output_write (dctool_output_t *abstract, dc_parser_t *parser, const u
 			break;
 		if (!str.desc || !str.value)
 			break;
-		fprintf (output->ostream, "<extradata key='%s' value='%s' />\n",
-			str.desc, str.value);
+		dctool_writer_puts (writer, "<extradata key='");
+		dctool_writer_puts (writer, str.desc);
+		dctool_writer_puts (writer, "' value='");
+		dctool_writer_puts (writer, str.value);
+		dctool_writer_puts (writer, "' />\n");
 
 	}
 
@@ -443,20 +498,60 @@ dctool_xml_output_write (dctool_output_t *abstract, dc_parser_t *parser, const u
 cleanup:
 
 	if (sampledata.nsamples)
-		fprintf (output->ostream, "</sample>\n");
-	fprintf (output->ostream, "</dive>\n");
+		dctool_writer_puts (writer, "</sample>\n");
+	dctool_writer_puts (writer, "</dive>\n");
 
 	return status;
 }
 
+static dctool_output_t *
+dctool_xml_output_fork (dctool_output_t *abstract)
+{
+	dctool_xml_output_t *output = (dctool_xml_output_t *) abstract;
+	dctool_xml_output_t *fork = NULL;
+
+	fork = (dctool_xml_output_t *) dctool_output_allocate (&xml_vtable);
+	if (fork == NULL) {
+		return NULL;
+	}
+
+	// A fork renders into memory, without the device element.
+	fork->ostream = NULL;
+	fork->writer = dctool_writer_new (NULL);
+	if (fork->writer == NULL) {
+		dctool_output_deallocate ((dctool_output_t *) fork);
+		return NULL;
+	}
+
+	fork->units = output->units;
+
+	return (dctool_output_t *) fork;
+}
+
+static dc_status_t
+dctool_xml_output_join (dctool_output_t *abstract, dctool_output_t *abstract_fork)
+{
+	dctool_xml_output_t *output = (dctool_xml_output_t *) abstract;
+	dctool_xml_output_t *fork = (dctool_xml_output_t *) abstract_fork;
+
+	dctool_writer_append (output->writer, fork->writer);
+
+	return DC_STATUS_SUCCESS;
+}
+
 static dc_status_t
 dctool_xml_output_free (dctool_output_t *abstract)
 {
 	dctool_xml_output_t *output = (dctool_xml_output_t *) abstract;
+	dc_status_t status = DC_STATUS_SUCCESS;
 
-	fprintf (output->ostream, "</device>\n");
+	if (output->ostream)
+		dctool_writer_puts (output->writer, "</device>\n");
 
-	fclose (output->ostream);
+	status = dctool_writer_free (output->writer);
 
-	return DC_STATUS_SUCCESS;
+	if (output->ostream)
+		fclose (output->ostream);
+
+	return status;
 }
@@ -0,0 +1,287 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_MMAP)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define USE_MMAP
+#endif
+
+#include <libdivecomputer/buffer.h>
+
+#include "pack.h"
+#include "common.h"
+#include "utils.h"
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+struct dctool_pack_t {
+	const unsigned char *data;
+	size_t size;
+	int mapped;
+	dc_buffer_t *buffer;
+	// Offsets of the dives.
+	unsigned long long *offsets;
+	unsigned int count;
+	unsigned long long end;
+};
+
+static unsigned int
+pack_uint32_le (const unsigned char data[])
+{
+	return data[0] | (data[1] << 8) | (data[2] << 16) | ((unsigned int) data[3] << 24);
+}
+
+static unsigned long long
+pack_uint64_le (const unsigned char data[])
+{
+	return pack_uint32_le (data) | ((unsigned long long) pack_uint32_le (data + 4) << 32);
+}
+
+/*
+ * Check whether a complete dive is present at the offset, before the
+ * given limit, and return the offset of the next dive.
+ */
+static unsigned long long
+pack_check_dive (dctool_pack_t *pack, unsigned long long offset, unsigned long long limit)
+{
+	if (offset < DCTOOL_PACK_HEADER_SIZE || offset > limit || limit - offset < DCTOOL_PACK_DIVE_SIZE)
+		return 0;
+
+	if (memcmp (pack->data + offset, "DCPD", 4) != 0)
+		return 0;
+
+	unsigned long long size = pack_uint32_le (pack->data + offset + 4);
+	unsigned long long fsize = pack_uint32_le (pack->data + offset + 8);
+	if (limit - offset - DCTOOL_PACK_DIVE_SIZE < size + fsize)
+		return 0;
+
+	return offset + DCTOOL_PACK_DIVE_SIZE + size + fsize;
+}
+
+static dc_status_t
+pack_load_index (dctool_pack_t *pack)
+{
+	if (pack->size < DCTOOL_PACK_HEADER_SIZE + DCTOOL_PACK_TRAILER_SIZE)
+		return DC_STATUS_DATAFORMAT;
+
+	const unsigned char *trailer = pack->data + pack->size - DCTOOL_PACK_TRAILER_SIZE;
+	if (memcmp (trailer + 12, "DCPX", 4) != 0)
+		return DC_STATUS_DATAFORMAT;
+
+	unsigned long long index = pack_uint64_le (trailer);
+	unsigned int count = pack_uint32_le (trailer + 8);
+	if (index < DCTOOL_PACK_HEADER_SIZE ||
+		index + count * 8ULL + DCTOOL_PACK_TRAILER_SIZE != pack->size)
+		return DC_STATUS_DATAFORMAT;
+
+	pack->offsets = (unsigned long long *) malloc ((count ? count : 1) * sizeof (unsigned long long));
+	if (pack->offsets == NULL)
+		return DC_STATUS_NOMEMORY;
+
+	pack->end = DCTOOL_PACK_HEADER_SIZE;
+	for (unsigned int i = 0; i < count; ++i) {
+		unsigned long long offset = pack_uint64_le (pack->data + index + i * 8);
+		unsigned long long next = pack_check_dive (pack, offset, index);
+		if (next == 0) {
+			free (pack->offsets);
+			pack->offsets = NULL;
+			return DC_STATUS_DATAFORMAT;
+		}
+
+		pack->offsets[i] = offset;
+		if (next > pack->end)
+			pack->end = next;
+	}
+
+	pack->count = count;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+pack_scan (dctool_pack_t *pack)
+{
+	unsigned int capacity = 0;
+	unsigned long long offset = DCTOOL_PACK_HEADER_SIZE;
+	unsigned long long next = 0;
+
+	while ((next = pack_check_dive (pack, offset, pack->size)) != 0) {
+		if (pack->count == capacity) {
+			capacity = capacity ? capacity * 2 : 64;
+			unsigned long long *offsets = (unsigned long long *) realloc (pack->offsets, capacity * sizeof (unsigned long long));
+			if (offsets == NULL)
+				return DC_STATUS_NOMEMORY;
+			pack->offsets = offsets;
+		}
+
+		pack->offsets[pack->count++] = offset;
+		offset = next;
+	}
+
+	pack->end = offset;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+pack_load (dctool_pack_t *pack, const char *filename)
+{
+#ifdef USE_MMAP
+	int fd = open (filename, O_RDONLY | O_BINARY);
+	if (fd < 0)
+		return DC_STATUS_IO;
+
+	struct stat st;
+	if (fstat (fd, &st) == 0 && st.st_size > 0) {
+		void *map = mmap (NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (map != MAP_FAILED) {
+			pack->data = (const unsigned char *) map;
+			pack->size = st.st_size;
+			pack->mapped = 1;
+			close (fd);
+			return DC_STATUS_SUCCESS;
+		}
+	}
+
+	close (fd);
+#endif
+
+	// Without mmap support, read the entire file into memory.
+	pack->buffer = dctool_file_read (filename);
+	if (pack->buffer == NULL)
+		return DC_STATUS_IO;
+
+	pack->data = dc_buffer_get_data (pack->buffer);
+	pack->size = dc_buffer_get_size (pack->buffer);
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dctool_pack_open (dctool_pack_t **out, const char *filename)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (out == NULL || filename == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	dctool_pack_t *pack = (dctool_pack_t *) malloc (sizeof (dctool_pack_t));
+	if (pack == NULL)
+		return DC_STATUS_NOMEMORY;
+
+	pack->data = NULL;
+	pack->size = 0;
+	pack->mapped = 0;
+	pack->buffer = NULL;
+	pack->offsets = NULL;
+	pack->count = 0;
+	pack->end = DCTOOL_PACK_HEADER_SIZE;
+
+	status = pack_load (pack, filename);
+	if (status != DC_STATUS_SUCCESS)
+		goto error;
+
+	if (pack->size < DCTOOL_PACK_HEADER_SIZE ||
+		memcmp (pack->data, "DCPK", 4) != 0 ||
+		pack_uint32_le (pack->data + 4) != DCTOOL_PACK_VERSION) {
+		status = DC_STATUS_DATAFORMAT;
+		goto error;
+	}
+
+	// Use the index, or recover the dives from an incomplete file.
+	status = pack_load_index (pack);
+	if (status == DC_STATUS_DATAFORMAT) {
+		WARNING ("Missing or invalid index, scanning the dives.");
+		status = pack_scan (pack);
+	}
+	if (status != DC_STATUS_SUCCESS)
+		goto error;
+
+	*out = pack;
+
+	return DC_STATUS_SUCCESS;
+
+error:
+	dctool_pack_close (pack);
+	return status;
+}
+
+unsigned int
+dctool_pack_get_count (dctool_pack_t *pack)
+{
+	if (pack == NULL)
+		return 0;
+
+	return pack->count;
+}
+
+dc_status_t
+dctool_pack_get_dive (dctool_pack_t *pack, unsigned int index, dctool_pack_dive_t *dive)
+{
+	if (pack == NULL || dive == NULL || index >= pack->count)
+		return DC_STATUS_INVALIDARGS;
+
+	const unsigned char *p = pack->data + pack->offsets[index];
+
+	dive->offset = pack->offsets[index];
+	dive->size = pack_uint32_le (p + 4);
+	dive->fsize = pack_uint32_le (p + 8);
+	dive->data = p + DCTOOL_PACK_DIVE_SIZE;
+	dive->fingerprint = dive->data + dive->size;
+
+	return DC_STATUS_SUCCESS;
+}
+
+unsigned long long
+dctool_pack_get_end (dctool_pack_t *pack)
+{
+	if (pack == NULL)
+		return 0;
+
+	return pack->end;
+}
+
+void
+dctool_pack_close (dctool_pack_t *pack)
+{
+	if (pack == NULL)
+		return;
+
+#ifdef USE_MMAP
+	if (pack->mapped)
+		munmap ((void *) pack->data, pack->size);
+#endif
+
+	dc_buffer_free (pack->buffer);
+	free (pack->offsets);
+	free (pack);
+}
@@ -0,0 +1,87 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DCTOOL_PACK_H
+#define DCTOOL_PACK_H
+
+#include <libdivecomputer/common.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * A packed dive archive stores the raw data and the fingerprint of many
+ * dives in a single file. New dives are appended, and an index with the
+ * offset of every dive is written at the end:
+ *
+ *   header   "DCPK", version (4 bytes)
+ *   dive     "DCPD", size (4 bytes), fsize (4 bytes), data, fingerprint
+ *   ...
+ *   index    offset of each dive (8 bytes)
+ *   trailer  offset of the index (8 bytes), count (4 bytes), "DCPX"
+ *
+ * All integers are stored in little endian. If the trailer is missing,
+ * for example after an interrupted download, the dives are located by
+ * scanning the file from the start.
+ */
+#define DCTOOL_PACK_VERSION 1
+#define DCTOOL_PACK_HEADER_SIZE 8
+#define DCTOOL_PACK_DIVE_SIZE 12
+#define DCTOOL_PACK_TRAILER_SIZE 16
+
+typedef struct dctool_pack_t dctool_pack_t;
+
+typedef struct dctool_pack_dive_t {
+	unsigned long long offset;
+	const unsigned char *data;
+	unsigned int size;
+	const unsigned char *fingerprint;
+	unsigned int fsize;
+} dctool_pack_dive_t;
+
+/*
+ * Open a packed dive archive for reading. The file is mapped into
+ * memory where possible, and the data of the dives points directly
+ * into the mapping.
+ */
+dc_status_t
+dctool_pack_open (dctool_pack_t **pack, const char *filename);
+
+unsigned int
+dctool_pack_get_count (dctool_pack_t *pack);
+
+dc_status_t
+dctool_pack_get_dive (dctool_pack_t *pack, unsigned int index, dctool_pack_dive_t *dive);
+
+/*
+ * Get the offset just past the last dive, where new dives are appended.
+ */
+unsigned long long
+dctool_pack_get_end (dctool_pack_t *pack);
+
+void
+dctool_pack_close (dctool_pack_t *pack);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DCTOOL_PACK_H */
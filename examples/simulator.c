@@ -0,0 +1,430 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <libdivecomputer/custom.h>
+
+#include "simulator.h"
+
+#define OUTSIZE 512
+
+// Suunto D9 and Vyper2.
+#define SUUNTO_VERSION  0x0F
+#define SUUNTO_READ     0x05
+#define SUUNTO_WRITE    0x06
+#define SUUNTO_RESET    0x20
+#define SUUNTO_PACKET   0x78
+
+// Oceanic Atom2.
+#define OCEANIC_INIT      0xA8
+#define OCEANIC_VERSION   0x84
+#define OCEANIC_READ1     0xB1
+#define OCEANIC_READ8     0xB4
+#define OCEANIC_READ16    0xB8
+#define OCEANIC_READ16HI  0xF6
+#define OCEANIC_WRITE     0xB2
+#define OCEANIC_KEEPALIVE 0x91
+#define OCEANIC_QUIT      0x6A
+#define OCEANIC_ACK       0x5A
+#define OCEANIC_NAK       0xA5
+#define OCEANIC_PAGESIZE  0x10
+#define OCEANIC_HIGHMEM   0x40000
+
+#define MAXVERSION OCEANIC_PAGESIZE
+
+typedef struct dctool_simulator_t dctool_simulator_t;
+
+typedef void (*dctool_simulator_command_t) (dctool_simulator_t *simulator, const unsigned char data[], size_t size);
+
+struct dctool_simulator_t {
+	dctool_simulator_command_t command;
+	const unsigned char *memory;
+	unsigned char *copy;
+	size_t size;
+	unsigned char version[MAXVERSION];
+	size_t vsize;
+	// Suunto: commands are echoed by the interface.
+	unsigned int echo;
+	// Oceanic: page number of the pending write, plus one.
+	unsigned int pending;
+	unsigned char output[OUTSIZE];
+	size_t offset;
+	size_t length;
+	dctool_simulator_stats_t *stats;
+};
+
+static unsigned char
+simulator_xor (const unsigned char data[], size_t size)
+{
+	unsigned char crc = 0x00;
+	for (size_t i = 0; i < size; ++i)
+		crc ^= data[i];
+	return crc;
+}
+
+static unsigned int
+simulator_add (const unsigned char data[], size_t size)
+{
+	unsigned int crc = 0;
+	for (size_t i = 0; i < size; ++i)
+		crc += data[i];
+	return crc;
+}
+
+static void
+simulator_answer (dctool_simulator_t *simulator, const unsigned char data[], size_t size)
+{
+	if (simulator->offset + simulator->length + size > sizeof (simulator->output)) {
+		memmove (simulator->output, simulator->output + simulator->offset, simulator->length);
+		simulator->offset = 0;
+	}
+
+	// The host never reads the answers. Drop them, like a real device
+	// would once its buffers overflow.
+	if (simulator->length + size > sizeof (simulator->output))
+		return;
+
+	memcpy (simulator->output + simulator->offset + simulator->length, data, size);
+	simulator->length += size;
+}
+
+/*
+ * Make the memory writable, without touching the shared image.
+ */
+static int
+simulator_writable (dctool_simulator_t *simulator)
+{
+	if (simulator->copy)
+		return 0;
+
+	simulator->copy = (unsigned char *) malloc (simulator->size ? simulator->size : 1);
+	if (simulator->copy == NULL)
+		return -1;
+
+	memcpy (simulator->copy, simulator->memory, simulator->size);
+	simulator->memory = simulator->copy;
+
+	return 0;
+}
+
+static void
+simulator_suunto_command (dctool_simulator_t *simulator, const unsigned char data[], size_t size)
+{
+	unsigned char answer[SUUNTO_PACKET + 7] = {0};
+	unsigned int n = 0;
+
+	if (simulator->echo)
+		simulator_answer (simulator, data, size);
+
+	// A corrupted command is ignored.
+	if (size < 4 || data[1] != 0x00 || data[2] + 4u != size ||
+		simulator_xor (data, size - 1) != data[size - 1])
+		return;
+
+	if (data[0] == SUUNTO_VERSION && size == 4) {
+		memcpy (answer + 3, simulator->version, simulator->vsize);
+		n = simulator->vsize;
+	} else if ((data[0] == SUUNTO_READ || data[0] == SUUNTO_WRITE) && size >= 7) {
+		unsigned int address = (data[3] << 8) | data[4];
+		unsigned int length = data[5];
+		if (length > SUUNTO_PACKET || address + length > simulator->size)
+			return;
+
+		if (data[0] == SUUNTO_READ) {
+			if (size != 7)
+				return;
+			memcpy (answer + 6, simulator->memory + address, length);
+			n = length;
+		} else {
+			if (size != length + 7 || simulator_writable (simulator) != 0)
+				return;
+			memcpy (simulator->copy + address, data + 6, length);
+		}
+
+		memcpy (answer + 3, data + 3, 3);
+		n += 3;
+	} else if (data[0] != SUUNTO_RESET || size != 4) {
+		return;
+	}
+
+	answer[0] = data[0];
+	answer[1] = (n >> 8) & 0xFF;
+	answer[2] = (n     ) & 0xFF;
+	answer[n + 3] = simulator_xor (answer, n + 3);
+	simulator_answer (simulator, answer, n + 4);
+}
+
+static void
+simulator_oceanic_command (dctool_simulator_t *simulator, const unsigned char data[], size_t size)
+{
+	unsigned char answer[1 + 16 * OCEANIC_PAGESIZE + 2] = {OCEANIC_ACK};
+	unsigned int n = 0;
+
+	// The page following a write command.
+	if (simulator->pending) {
+		unsigned int address = (simulator->pending - 1) * OCEANIC_PAGESIZE;
+		simulator->pending = 0;
+		if (size == OCEANIC_PAGESIZE + 2 &&
+			(simulator_add (data, OCEANIC_PAGESIZE) & 0xFF) == data[OCEANIC_PAGESIZE] &&
+			address + OCEANIC_PAGESIZE <= simulator->size &&
+			simulator_writable (simulator) == 0) {
+			memcpy (simulator->copy + address, data, OCEANIC_PAGESIZE);
+		} else {
+			answer[0] = OCEANIC_NAK;
+		}
+		simulator_answer (simulator, answer, 1);
+		return;
+	}
+
+	if (size == 0)
+		return;
+
+	unsigned int number = size >= 3 ? (data[1] << 8) | data[2] : 0;
+	unsigned int address = number * OCEANIC_PAGESIZE;
+	unsigned int length = 0, crc_size = 1;
+
+	switch (data[0]) {
+	case OCEANIC_INIT:
+	case OCEANIC_QUIT:
+		answer[0] = OCEANIC_NAK;
+		break;
+	case OCEANIC_KEEPALIVE:
+		break;
+	case OCEANIC_VERSION:
+		memcpy (answer + 1, simulator->version, OCEANIC_PAGESIZE);
+		length = OCEANIC_PAGESIZE;
+		break;
+	case OCEANIC_READ1:
+		length = OCEANIC_PAGESIZE;
+		break;
+	case OCEANIC_READ8:
+		length = 8 * OCEANIC_PAGESIZE;
+		break;
+	case OCEANIC_READ16:
+		length = 16 * OCEANIC_PAGESIZE;
+		crc_size = 2;
+		break;
+	case OCEANIC_READ16HI:
+		// The page number is relative to the virtual high memory area,
+		// in units of the packet size.
+		address = OCEANIC_HIGHMEM + number * 16 * OCEANIC_PAGESIZE;
+		length = 16 * OCEANIC_PAGESIZE;
+		crc_size = 2;
+		break;
+	case OCEANIC_WRITE:
+		if (size == 4 && address + OCEANIC_PAGESIZE <= simulator->size)
+			simulator->pending = number + 1;
+		else
+			answer[0] = OCEANIC_NAK;
+		break;
+	default:
+		answer[0] = OCEANIC_NAK;
+		break;
+	}
+
+	if (data[0] != OCEANIC_VERSION && length) {
+		if (size == 4 && address + length <= simulator->size) {
+			memcpy (answer + 1, simulator->memory + address, length);
+		} else {
+			answer[0] = OCEANIC_NAK;
+			length = 0;
+		}
+	}
+
+	if (length) {
+		unsigned int crc = simulator_add (answer + 1, length);
+		answer[length + 1] = crc & 0xFF;
+		if (crc_size == 2)
+			answer[length + 2] = (crc >> 8) & 0xFF;
+		n = length + crc_size;
+	}
+
+	simulator_answer (simulator, answer, n + 1);
+}
+
+static dc_status_t
+simulator_get_available (void *userdata, size_t *value)
+{
+	dctool_simulator_t *simulator = (dctool_simulator_t *) userdata;
+
+	*value = simulator->length;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+simulator_read (void *userdata, void *data, size_t size, size_t *actual)
+{
+	dctool_simulator_t *simulator = (dctool_simulator_t *) userdata;
+
+	// A missing answer times out immediately.
+	size_t n = size < simulator->length ? size : simulator->length;
+	memcpy (data, simulator->output + simulator->offset, n);
+	simulator->offset += n;
+	simulator->length -= n;
+	if (simulator->length == 0)
+		simulator->offset = 0;
+
+	if (simulator->stats)
+		simulator->stats->sent += n;
+
+	if (actual)
+		*actual = n;
+
+	return n == size ? DC_STATUS_SUCCESS : DC_STATUS_TIMEOUT;
+}
+
+static dc_status_t
+simulator_write (void *userdata, const void *data, size_t size, size_t *actual)
+{
+	dctool_simulator_t *simulator = (dctool_simulator_t *) userdata;
+
+	// Both protocols send each command with a single write.
+	simulator->command (simulator, (const unsigned char *) data, size);
+
+	if (simulator->stats) {
+		simulator->stats->commands++;
+		simulator->stats->received += size;
+	}
+
+	if (actual)
+		*actual = size;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+simulator_purge (void *userdata, dc_direction_t direction)
+{
+	dctool_simulator_t *simulator = (dctool_simulator_t *) userdata;
+
+	if (direction & DC_DIRECTION_INPUT) {
+		simulator->offset = 0;
+		simulator->length = 0;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+simulator_close (void *userdata)
+{
+	dctool_simulator_t *simulator = (dctool_simulator_t *) userdata;
+
+	free (simulator->copy);
+	free (simulator);
+
+	return DC_STATUS_SUCCESS;
+}
+
+static const dc_custom_cbs_t g_simulator_cbs = {
+	NULL, /* set_timeout */
+	NULL, /* set_latency */
+	NULL, /* set_break */
+	NULL, /* set_dtr */
+	NULL, /* set_rts */
+	NULL, /* get_lines */
+	simulator_get_available, /* get_available */
+	NULL, /* configure */
+	simulator_read, /* read */
+	simulator_write, /* write */
+	NULL, /* flush */
+	simulator_purge, /* purge */
+	NULL, /* sleep */
+	simulator_close, /* close */
+	NULL, /* get_name */
+};
+
+int
+dctool_simulator_supported (dc_family_t family)
+{
+	return family == DC_FAMILY_SUUNTO_D9 ||
+		family == DC_FAMILY_SUUNTO_VYPER2 ||
+		family == DC_FAMILY_OCEANIC_ATOM2;
+}
+
+dc_status_t
+dctool_simulator_open (dc_iostream_t **out, dc_context_t *context, dc_descriptor_t *descriptor, dc_buffer_t *memory, dc_buffer_t *version, dctool_simulator_stats_t *stats)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dctool_simulator_t *simulator = NULL;
+
+	if (out == NULL || descriptor == NULL || memory == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	dc_family_t family = dc_descriptor_get_type (descriptor);
+	if (!dctool_simulator_supported (family))
+		return DC_STATUS_UNSUPPORTED;
+
+	simulator = (dctool_simulator_t *) calloc (1, sizeof (dctool_simulator_t));
+	if (simulator == NULL)
+		return DC_STATUS_NOMEMORY;
+
+	simulator->memory = dc_buffer_get_data (memory);
+	simulator->size = dc_buffer_get_size (memory);
+	simulator->stats = stats;
+
+	if (family == DC_FAMILY_OCEANIC_ATOM2) {
+		simulator->command = simulator_oceanic_command;
+		simulator->vsize = OCEANIC_PAGESIZE;
+		if (version == NULL) {
+			// An unknown version string, with the memory size at the
+			// end. The device backend picks a layout of that size.
+			const char *suffix = "512K";
+			if (simulator->size <= 0x40000)
+				suffix = "256K";
+			else if (simulator->size > 0x100000)
+				suffix = "2048";
+			else if (simulator->size > 0x80000)
+				suffix = "1024";
+			memcpy (simulator->version, "DCTOOL SIM  ", 12);
+			memcpy (simulator->version + 12, suffix, 4);
+		}
+	} else {
+		simulator->command = simulator_suunto_command;
+		simulator->vsize = 4;
+		simulator->echo = (family == DC_FAMILY_SUUNTO_D9);
+		if (version == NULL) {
+			// The first byte is the model number.
+			simulator->version[0] = dc_descriptor_get_model (descriptor);
+		}
+	}
+
+	if (version) {
+		if (dc_buffer_get_size (version) != simulator->vsize) {
+			status = DC_STATUS_INVALIDARGS;
+			goto error_free;
+		}
+		memcpy (simulator->version, dc_buffer_get_data (version), simulator->vsize);
+	}
+
+	status = dc_custom_open (out, context, DC_TRANSPORT_SERIAL, &g_simulator_cbs, simulator);
+	if (status != DC_STATUS_SUCCESS)
+		goto error_free;
+
+	return DC_STATUS_SUCCESS;
+
+error_free:
+	free (simulator);
+	return status;
+}
@@ -0,0 +1,66 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DCTOOL_SIMULATOR_H
+#define DCTOOL_SIMULATOR_H
+
+#include <libdivecomputer/context.h>
+#include <libdivecomputer/descriptor.h>
+#include <libdivecomputer/iostream.h>
+#include <libdivecomputer/buffer.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+typedef struct dctool_simulator_stats_t {
+	unsigned long long commands;
+	unsigned long long received;
+	unsigned long long sent;
+} dctool_simulator_stats_t;
+
+/*
+ * Check whether a simulator is available for the device family.
+ */
+int
+dctool_simulator_supported (dc_family_t family);
+
+/*
+ * Open an I/O stream which answers the protocol commands of the device
+ * from a memory image, as written by the dump command. Nothing is
+ * slowed down to the speed of a real device, and the sleep calls return
+ * immediately.
+ *
+ * The version contains the answer to the version command. Without one,
+ * a default is derived from the model number and the memory size. The
+ * memory image is shared, and must remain valid until the I/O stream is
+ * closed. Writes go to a private copy.
+ *
+ * The statistics are optional, and are only updated from the thread
+ * using the I/O stream.
+ */
+dc_status_t
+dctool_simulator_open (dc_iostream_t **iostream, dc_context_t *context, dc_descriptor_t *descriptor, dc_buffer_t *memory, dc_buffer_t *version, dctool_simulator_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DCTOOL_SIMULATOR_H */
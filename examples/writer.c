@@ -0,0 +1,282 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <math.h>
+
+#include "writer.h"
+
+#define BUFSIZE 65536
+
+// Largest scaled value that is formatted without printf. Far below the
+// range where a double can no longer represent every integer.
+#define MAXSCALED 1e12
+
+// Distance from a rounding tie, below which printf decides.
+#define TIEMARGIN 1e-6
+
+struct dctool_writer_t {
+	FILE *ostream;
+	char *data;
+	size_t size;
+	size_t capacity;
+	int error;
+};
+
+static const double g_pow10[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9
+};
+
+dctool_writer_t *
+dctool_writer_new (FILE *ostream)
+{
+	dctool_writer_t *writer = (dctool_writer_t *) malloc (sizeof (dctool_writer_t));
+	if (writer == NULL)
+		return NULL;
+
+	writer->data = (char *) malloc (BUFSIZE);
+	if (writer->data == NULL) {
+		free (writer);
+		return NULL;
+	}
+
+	writer->ostream = ostream;
+	writer->size = 0;
+	writer->capacity = BUFSIZE;
+	writer->error = 0;
+
+	return writer;
+}
+
+static int
+dctool_writer_drain (dctool_writer_t *writer)
+{
+	if (writer->size && fwrite (writer->data, 1, writer->size, writer->ostream) != writer->size) {
+		writer->error = 1;
+		return -1;
+	}
+
+	writer->size = 0;
+
+	return 0;
+}
+
+/*
+ * Make room for the given number of bytes. A writer with a stream
+ * drains the buffer, a memory writer grows it.
+ */
+static int
+dctool_writer_reserve (dctool_writer_t *writer, size_t size)
+{
+	if (writer->error)
+		return -1;
+
+	if (writer->size + size <= writer->capacity)
+		return 0;
+
+	if (writer->ostream) {
+		if (dctool_writer_drain (writer) != 0)
+			return -1;
+		if (size <= writer->capacity)
+			return 0;
+	}
+
+	size_t capacity = writer->capacity;
+	while (capacity < writer->size + size)
+		capacity *= 2;
+
+	char *data = (char *) realloc (writer->data, capacity);
+	if (data == NULL) {
+		writer->error = 1;
+		return -1;
+	}
+
+	writer->data = data;
+	writer->capacity = capacity;
+
+	return 0;
+}
+
+void
+dctool_writer_write (dctool_writer_t *writer, const void *data, size_t size)
+{
+	if (dctool_writer_reserve (writer, size) != 0)
+		return;
+
+	memcpy (writer->data + writer->size, data, size);
+	writer->size += size;
+}
+
+void
+dctool_writer_putc (dctool_writer_t *writer, char c)
+{
+	if (dctool_writer_reserve (writer, 1) != 0)
+		return;
+
+	writer->data[writer->size++] = c;
+}
+
+void
+dctool_writer_puts (dctool_writer_t *writer, const char *str)
+{
+	dctool_writer_write (writer, str, strlen (str));
+}
+
+static void
+dctool_writer_digits (dctool_writer_t *writer, unsigned long long value, unsigned int width)
+{
+	char buffer[32];
+	size_t n = sizeof (buffer);
+
+	do {
+		buffer[--n] = '0' + value % 10;
+		value /= 10;
+	} while (value && n);
+
+	while (sizeof (buffer) - n < width && n)
+		buffer[--n] = '0';
+
+	dctool_writer_write (writer, buffer + n, sizeof (buffer) - n);
+}
+
+void
+dctool_writer_uint (dctool_writer_t *writer, unsigned int value, unsigned int width)
+{
+	dctool_writer_digits (writer, value, width);
+}
+
+void
+dctool_writer_fixed (dctool_writer_t *writer, double value, unsigned int decimals)
+{
+	if (decimals >= sizeof (g_pow10) / sizeof (g_pow10[0]) || !isfinite (value)) {
+		dctool_writer_printf (writer, "%.*f", decimals, value);
+		return;
+	}
+
+	double scaled = fabs (value) * g_pow10[decimals];
+	double integer = floor (scaled);
+	double fraction = scaled - integer;
+
+	// The multiplication is not exact, so values close to a tie could
+	// be rounded differently than printf does on the exact value.
+	if (scaled >= MAXSCALED || fabs (fraction - 0.5) < TIEMARGIN) {
+		dctool_writer_printf (writer, "%.*f", decimals, value);
+		return;
+	}
+
+	unsigned long long rounded = (unsigned long long) integer + (fraction > 0.5);
+	unsigned long long divisor = (unsigned long long) g_pow10[decimals];
+
+	// Like printf, the sign is kept for negative values which round to zero.
+	if (signbit (value))
+		dctool_writer_putc (writer, '-');
+
+	dctool_writer_digits (writer, rounded / divisor, 0);
+	if (decimals) {
+		dctool_writer_putc (writer, '.');
+		dctool_writer_digits (writer, rounded % divisor, decimals);
+	}
+}
+
+void
+dctool_writer_hex (dctool_writer_t *writer, const unsigned char data[], size_t size)
+{
+	const char ascii[] = "0123456789ABCDEF";
+
+	if (dctool_writer_reserve (writer, size * 2) != 0)
+		return;
+
+	for (size_t i = 0; i < size; ++i) {
+		writer->data[writer->size++] = ascii[(data[i] >> 4) & 0x0F];
+		writer->data[writer->size++] = ascii[data[i] & 0x0F];
+	}
+}
+
+void
+dctool_writer_printf (dctool_writer_t *writer, const char *format, ...)
+{
+	char buffer[256];
+	va_list ap;
+
+	va_start (ap, format);
+	int n = vsnprintf (buffer, sizeof (buffer), format, ap);
+	va_end (ap);
+
+	if (n < 0) {
+		writer->error = 1;
+		return;
+	}
+
+	if ((size_t) n < sizeof (buffer)) {
+		dctool_writer_write (writer, buffer, n);
+		return;
+	}
+
+	if (dctool_writer_reserve (writer, n + 1) != 0)
+		return;
+
+	va_start (ap, format);
+	vsnprintf (writer->data + writer->size, n + 1, format, ap);
+	va_end (ap);
+
+	writer->size += n;
+}
+
+void
+dctool_writer_append (dctool_writer_t *writer, dctool_writer_t *other)
+{
+	if (other->error)
+		writer->error = 1;
+
+	dctool_writer_write (writer, other->data, other->size);
+
+	other->size = 0;
+	other->error = 0;
+}
+
+dc_status_t
+dctool_writer_flush (dctool_writer_t *writer)
+{
+	if (writer->ostream) {
+		if (!writer->error)
+			dctool_writer_drain (writer);
+		if (!writer->error && fflush (writer->ostream) != 0)
+			writer->error = 1;
+	}
+
+	return writer->error ? DC_STATUS_IO : DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dctool_writer_free (dctool_writer_t *writer)
+{
+	if (writer == NULL)
+		return DC_STATUS_SUCCESS;
+
+	dc_status_t status = dctool_writer_flush (writer);
+
+	free (writer->data);
+	free (writer);
+
+	return status;
+}
@@ -0,0 +1,99 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DCTOOL_WRITER_H
+#define DCTOOL_WRITER_H
+
+#include <stdio.h>
+
+#include <libdivecomputer/common.h>
+
+#include "utils.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * A buffered writer for the text outputs. The data is collected in a
+ * large buffer and written to the stream in big chunks. Without a
+ * stream, the writer keeps everything in memory, until it's appended
+ * to another writer.
+ *
+ * The numbers are formatted without printf, but produce exactly the same
+ * text as the corresponding printf conversion.
+ *
+ * Errors are sticky, and reported by dctool_writer_flush().
+ */
+typedef struct dctool_writer_t dctool_writer_t;
+
+dctool_writer_t *
+dctool_writer_new (FILE *ostream);
+
+void
+dctool_writer_write (dctool_writer_t *writer, const void *data, size_t size);
+
+void
+dctool_writer_putc (dctool_writer_t *writer, char c);
+
+void
+dctool_writer_puts (dctool_writer_t *writer, const char *str);
+
+/*
+ * Equivalent to the "%0*u" conversion.
+ */
+void
+dctool_writer_uint (dctool_writer_t *writer, unsigned int value, unsigned int width);
+
+/*
+ * Equivalent to the "%.*f" conversion.
+ */
+void
+dctool_writer_fixed (dctool_writer_t *writer, double value, unsigned int decimals);
+
+/*
+ * Write the data as uppercase hexadecimal digits.
+ */
+void
+dctool_writer_hex (dctool_writer_t *writer, const unsigned char data[], size_t size);
+
+void
+dctool_writer_printf (dctool_writer_t *writer, const char *format, ...) ATTR_FORMAT_PRINTF(2, 3);
+
+/*
+ * Move the contents of the other writer to the end of this writer.
+ */
+void
+dctool_writer_append (dctool_writer_t *writer, dctool_writer_t *other);
+
+dc_status_t
+dctool_writer_flush (dctool_writer_t *writer);
+
+/*
+ * Flush the buffer and free the writer. The stream is not closed.
+ */
+dc_status_t
+dctool_writer_free (dctool_writer_t *writer);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DCTOOL_WRITER_H */
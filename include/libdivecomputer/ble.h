@@ -0,0 +1,203 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_BLE_H
+#define DC_BLE_H
+
+#include "common.h"
+#include "context.h"
+#include "iostream.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/**
+ * The default ATT MTU, before any negotiation.
+ */
+#define DC_BLE_MTU_DEFAULT 23
+
+/**
+ * The largest ATT MTU.
+ */
+#define DC_BLE_MTU_MAX 517
+
+/**
+ * The shortest connection interval (in microseconds).
+ */
+#define DC_BLE_INTERVAL_MIN 7500
+
+/**
+ * The physical layers.
+ */
+typedef enum dc_ble_phy_t {
+	DC_BLE_PHY_1M = 0x01, /**< 1 Mbit/s */
+	DC_BLE_PHY_2M = 0x02, /**< 2 Mbit/s */
+	DC_BLE_PHY_CODED = 0x04 /**< Coded (long range) */
+} dc_ble_phy_t;
+
+/**
+ * The GATT write types.
+ */
+typedef enum dc_ble_write_t {
+	DC_BLE_WRITE_WITH_RESPONSE, /**< Write request */
+	DC_BLE_WRITE_WITHOUT_RESPONSE /**< Write command */
+} dc_ble_write_t;
+
+/**
+ * The callbacks of a BLE I/O stream.
+ *
+ * The data is written to the characteristic which receives the
+ * commands, and read from the notifications of the characteristic
+ * which sends the answers. The read callback receives exactly one
+ * notification. Notifications arriving in between reads need to be
+ * queued by the application, and the get_available callback reports
+ * the number of queued bytes.
+ *
+ * If the characteristic doesn't support writes without response, the
+ * write callback should fall back to a write request.
+ *
+ * All callbacks are optional. The negotiation callbacks return
+ * #DC_STATUS_UNSUPPORTED when missing, the others succeed without
+ * doing anything.
+ */
+typedef struct dc_ble_cbs_t {
+	dc_status_t (*set_timeout) (void *userdata, int timeout);
+	dc_status_t (*get_available) (void *userdata, size_t *value);
+	dc_status_t (*read) (void *userdata, void *data, size_t size, size_t *actual);
+	dc_status_t (*write) (void *userdata, const void *data, size_t size, dc_ble_write_t type, size_t *actual);
+	dc_status_t (*purge) (void *userdata, dc_direction_t direction);
+	dc_status_t (*sleep) (void *userdata, unsigned int milliseconds);
+	dc_status_t (*close) (void *userdata);
+	const char *(*get_name) (void *userdata);
+	dc_status_t (*get_mtu) (void *userdata, unsigned int *mtu);
+	dc_status_t (*request_mtu) (void *userdata, unsigned int mtu);
+	dc_status_t (*set_interval) (void *userdata, unsigned int minimum, unsigned int maximum);
+	dc_status_t (*set_phy) (void *userdata, unsigned int phy);
+} dc_ble_cbs_t;
+
+/**
+ * Create a BLE I/O stream.
+ *
+ * The other BLE functions return #DC_STATUS_UNSUPPORTED for all other
+ * I/O streams, including custom I/O streams with the BLE transport.
+ * Backends use them where available, and keep working without.
+ *
+ * @param[out]  iostream   A location to store the BLE I/O stream.
+ * @param[in]   context    A valid context object.
+ * @param[in]   callbacks  The callback functions to call.
+ * @param[in]   userdata   User data to pass to the callback functions.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_ble_open (dc_iostream_t **iostream, dc_context_t *context, const dc_ble_cbs_t *callbacks, void *userdata);
+
+/**
+ * Get the negotiated ATT MTU. The largest notification or write
+ * carries three bytes less.
+ *
+ * @param[in]   iostream  A valid BLE I/O stream.
+ * @param[out]  mtu       A location to store the MTU.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_ble_get_mtu (dc_iostream_t *iostream, unsigned int *mtu);
+
+/**
+ * Negotiate the ATT MTU. The result can be smaller than requested,
+ * and is available with #dc_ble_get_mtu.
+ *
+ * @param[in]   iostream  A valid BLE I/O stream.
+ * @param[in]   mtu       The requested MTU.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_ble_request_mtu (dc_iostream_t *iostream, unsigned int mtu);
+
+/**
+ * Request a connection interval.
+ *
+ * @param[in]   iostream  A valid BLE I/O stream.
+ * @param[in]   minimum   The minimum interval (in microseconds).
+ * @param[in]   maximum   The maximum interval (in microseconds).
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_ble_set_interval (dc_iostream_t *iostream, unsigned int minimum, unsigned int maximum);
+
+/**
+ * Request the physical layer.
+ *
+ * @param[in]   iostream  A valid BLE I/O stream.
+ * @param[in]   phy       The preferred physical layers, as a bitmask
+ *                        of #dc_ble_phy_t values.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_ble_set_phy (dc_iostream_t *iostream, unsigned int phy);
+
+/**
+ * Set the write type of all following writes. The default is a write
+ * with response.
+ *
+ * @param[in]   iostream  A valid BLE I/O stream.
+ * @param[in]   type      The write type.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_ble_set_write_type (dc_iostream_t *iostream, dc_ble_write_t type);
+
+/**
+ * Read all queued notifications at once.
+ *
+ * The first notification is waited for, like a normal read. All
+ * notifications which are already queued are appended, as long as
+ * there is room for another notification of the maximum size. The
+ * notifications are stored back to back.
+ *
+ * @param[in]   iostream  A valid BLE I/O stream.
+ * @param[out]  data      The notification data.
+ * @param[in]   size      The size of the data buffer.
+ * @param[out]  lengths   An optional array to store the length of each
+ *                        notification.
+ * @param[in]   count     The number of elements in the lengths array.
+ *                        Without an array, the number of notifications
+ *                        is not limited.
+ * @param[out]  npackets  An optional location to store the number of
+ *                        notifications.
+ * @param[out]  actual    An optional location to store the total number
+ *                        of bytes.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_ble_read_packets (dc_iostream_t *iostream, void *data, size_t size, size_t lengths[], size_t count, size_t *npackets, size_t *actual);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_BLE_H */
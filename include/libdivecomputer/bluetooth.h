@@ -116,13 +116,40 @@ dc_bluetooth_device_free (dc_bluetooth_device_t *device);
 dc_status_t
 dc_bluetooth_iterator_new (dc_iterator_t **iterator, dc_context_t *context, dc_descriptor_t *descriptor);
 
+/**
+ * Bluetooth iterator flags.
+ */
+typedef enum dc_bluetooth_flags_t {
+	/**
+	 * Return the paired devices, without performing a (slow) inquiry.
+	 * If the list of paired devices is not available, the devices
+	 * remembered from a recent inquiry are returned instead.
+	 */
+	DC_BLUETOOTH_PAIRED = 0x01
+} dc_bluetooth_flags_t;
+
+/**
+ * Create an iterator to enumerate the bluetooth devices.
+ *
+ * @param[out] iterator    A location to store the iterator.
+ * @param[in]  context     A valid context object.
+ * @param[in]  descriptor  A valid device descriptor or NULL.
+ * @param[in]  flags       A bitmask of #dc_bluetooth_flags_t values.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_bluetooth_iterator_new2 (dc_iterator_t **iterator, dc_context_t *context, dc_descriptor_t *descriptor, unsigned int flags);
+
 /**
  * Open an bluetooth connection.
  *
  * @param[out]  iostream   A location to store the bluetooth connection.
  * @param[in]   context    A valid context object.
  * @param[in]   address    The bluetooth device address.
- * @param[in]   port       The bluetooth port number.
+ * @param[in]   port       The bluetooth port number, or zero to look
+ *                         up the serial port service. The result of the
+ *                         lookup is cached in the context.
  * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
  * on failure.
  */
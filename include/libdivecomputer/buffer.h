@@ -30,6 +30,17 @@ extern "C" {
 
 typedef struct dc_buffer_t dc_buffer_t;
 
+/*
+ * A buffer view is a non-owning reference to a range of bytes, for
+ * example a part of a dc_buffer_t or a memory mapped file. The view
+ * does not keep the underlying memory alive, and becomes invalid as
+ * soon as the memory is freed or the buffer is modified.
+ */
+typedef struct dc_buffer_view_t {
+	const unsigned char *data;
+	size_t size;
+} dc_buffer_view_t;
+
 dc_buffer_t *
 dc_buffer_new (size_t capacity);
 
@@ -42,6 +53,16 @@ dc_buffer_clear (dc_buffer_t *buffer);
 int
 dc_buffer_reserve (dc_buffer_t *buffer, size_t capacity);
 
+/*
+ * Limit the amount of memory added by a single automatic expansion of the
+ * buffer. By default (a maximum step of zero) the capacity is doubled
+ * every time, which keeps the number of allocations logarithmic in the
+ * final size. When the final size is known in advance, use
+ * dc_buffer_reserve instead to allocate the exact amount at once.
+ */
+int
+dc_buffer_set_growth (dc_buffer_t *buffer, size_t maxstep);
+
 int
 dc_buffer_resize (dc_buffer_t *buffer, size_t size);
 
@@ -60,6 +81,25 @@ dc_buffer_get_size (dc_buffer_t *buffer);
 unsigned char *
 dc_buffer_get_data (dc_buffer_t *buffer);
 
+size_t
+dc_buffer_get_capacity (dc_buffer_t *buffer);
+
+/*
+ * Number of times memory was allocated for the buffer data, which is
+ * useful for checking the effectiveness of the reservation hints.
+ */
+unsigned int
+dc_buffer_get_allocations (dc_buffer_t *buffer);
+
+int
+dc_buffer_get_view (dc_buffer_t *buffer, size_t offset, size_t size, dc_buffer_view_t *view);
+
+int
+dc_buffer_view_init (dc_buffer_view_t *view, const unsigned char data[], size_t size);
+
+int
+dc_buffer_view_slice (dc_buffer_view_t *view, size_t offset, size_t size);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -0,0 +1,74 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_CAPTURE_H
+#define DC_CAPTURE_H
+
+#include "common.h"
+#include "context.h"
+#include "iostream.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/**
+ * Open a capture I/O stream.
+ *
+ * All operations are forwarded to the underlying I/O stream, and recorded
+ * together with their result and a timestamp. The capture file can be
+ * replayed with #dc_replay_open, to run exactly the same communication
+ * again without any hardware. The underlying I/O stream is owned by the
+ * capture I/O stream, and closed together with it.
+ *
+ * @param[out]  iostream  A location to store the capture I/O stream.
+ * @param[in]   context   A valid context object.
+ * @param[in]   base      A valid I/O stream to forward the operations to.
+ * @param[in]   filename  The name of the capture file.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_capture_open (dc_iostream_t **iostream, dc_context_t *context, dc_iostream_t *base, const char *filename);
+
+/**
+ * Open a replay I/O stream.
+ *
+ * All operations are answered from a capture file, recorded with
+ * #dc_capture_open. The operations need to arrive in the same order,
+ * and the written data needs to be identical, otherwise the replay fails
+ * with #DC_STATUS_PROTOCOL.
+ *
+ * @param[out]  iostream  A location to store the replay I/O stream.
+ * @param[in]   context   A valid context object.
+ * @param[in]   filename  The name of the capture file.
+ * @param[in]   realtime  Non-zero to return the results with the original
+ *                        timing, or zero to return them immediately.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_replay_open (dc_iostream_t **iostream, dc_context_t *context, const char *filename, unsigned int realtime);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_CAPTURE_H */
@@ -0,0 +1,103 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_COLUMNAR_H
+#define DC_COLUMNAR_H
+
+#include "common.h"
+#include "context.h"
+#include "buffer.h"
+#include "parser.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * Columnar sample format
+ *
+ * A compact binary encoding of the sample data of a dive, which can be
+ * loaded again much faster than parsing the original dive data. Each
+ * dive is encoded into a self-contained block, and a file is simply a
+ * sequence of blocks.
+ *
+ * Within a block, each sample type is stored in its own column, with a
+ * separate column per tank for the pressure samples. The values are
+ * delta encoded against the previous value in the same column. The
+ * event types, flags and names are stored once in a dictionary, and the
+ * event column only refers to the dictionary entries.
+ *
+ * The floating point values are stored with a fixed resolution:
+ * depth 1 mm, temperature 0.01 °C, pressure 1 mbar, ppo2 and setpoint
+ * 1 mbar, and cns 0.0001. Vendor samples and samples before the first
+ * time sample are not stored.
+ */
+#define DC_COLUMNAR_VERSION 1
+
+typedef struct dc_columnar_t dc_columnar_t;
+
+/*
+ * Encode the samples of the parser, and append the block to the buffer.
+ */
+dc_status_t
+dc_parser_export_columnar (dc_parser_t *parser, dc_buffer_t *buffer);
+
+/*
+ * Open a file with columnar blocks. The file is mapped into memory, and
+ * the samples are decoded directly from the mapping. The event names
+ * returned by the reader remain valid until the reader is closed.
+ */
+dc_status_t
+dc_columnar_open (dc_columnar_t **reader, dc_context_t *context, const char *filename);
+
+/*
+ * Get the number of dives in the file.
+ */
+unsigned int
+dc_columnar_get_count (dc_columnar_t *reader);
+
+/*
+ * Get the number of rows (time samples) of the dive.
+ */
+dc_status_t
+dc_columnar_get_rows (dc_columnar_t *reader, unsigned int dive, unsigned int *rows);
+
+/*
+ * Fill the columns of the batch with the rows of the dive, starting at
+ * the given row. This works exactly like dc_parser_samples_get_batch().
+ */
+dc_status_t
+dc_columnar_get_batch (dc_columnar_t *reader, unsigned int dive, unsigned int offset, dc_sample_batch_t *batch);
+
+/*
+ * Replay the samples of the dive. Within each row, the time sample is
+ * reported first, followed by the other samples ordered by type.
+ */
+dc_status_t
+dc_columnar_samples_foreach (dc_columnar_t *reader, unsigned int dive, dc_sample_callback_t callback, void *userdata);
+
+dc_status_t
+dc_columnar_close (dc_columnar_t *reader);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_COLUMNAR_H */
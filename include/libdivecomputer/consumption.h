@@ -0,0 +1,133 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_CONSUMPTION_H
+#define DC_CONSUMPTION_H
+
+#include "common.h"
+#include "context.h"
+#include "parser.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * Gas consumption analysis
+ *
+ * Calculate the gas consumption from the DC_SAMPLE_PRESSURE samples in
+ * a single pass over the profile. The consumption is normalized to the
+ * surface pressure of 1 atm, as the surface air consumption (SAC) in
+ * bar/min and the respiratory minute volume (RMV) in liter/min. The
+ * RMV needs the volume of the tank, and is zero if it's not available.
+ * The gas is treated as an ideal gas. The totals of a tank only count
+ * the time while its pressure was dropping.
+ *
+ * The dive is split into segments at every gas switch. The tank of a
+ * segment is the first tank with the gas mix of the segment.
+ */
+
+#define DC_CONSUMPTION_UNKNOWN 0xFFFFFFFF
+
+typedef struct dc_consumption_t dc_consumption_t;
+
+typedef struct dc_consumption_segment_t {
+	unsigned int gasmix;   /* Gas mix index, or DC_CONSUMPTION_UNKNOWN */
+	unsigned int tank;     /* Tank index, or DC_CONSUMPTION_UNKNOWN */
+	unsigned int begin;    /* Begin time (seconds) */
+	unsigned int end;      /* End time (seconds) */
+	double avgdepth;       /* Average depth (meters) */
+	double pressure;       /* Pressure drop of the tank (bar) */
+	double sac;            /* Surface air consumption (bar/min) */
+	double rmv;            /* Respiratory minute volume (liter/min) */
+} dc_consumption_segment_t;
+
+typedef struct dc_consumption_tank_t {
+	unsigned int gasmix;   /* Gas mix index, or DC_CONSUMPTION_UNKNOWN */
+	unsigned int begin;    /* Time of the first pressure (seconds) */
+	unsigned int end;      /* Time of the last pressure (seconds) */
+	double beginpressure;  /* First pressure (bar) */
+	double endpressure;    /* Last pressure (bar) */
+	double volume;         /* Volume (liter), or zero if unknown */
+	double consumed;       /* Gas used, at the surface (liter) */
+	double sac;            /* Surface air consumption (bar/min) */
+	double rmv;            /* Respiratory minute volume (liter/min) */
+} dc_consumption_tank_t;
+
+/*
+ * The callback receives each segment as soon as it's complete.
+ */
+typedef void (*dc_consumption_callback_t) (const dc_consumption_segment_t *segment, void *userdata);
+
+dc_status_t
+dc_consumption_new (dc_consumption_t **consumption, dc_context_t *context);
+
+dc_status_t
+dc_consumption_set_callback (dc_consumption_t *consumption, dc_consumption_callback_t callback, void *userdata);
+
+/*
+ * Start a new dive, for feeding the samples manually. The atmospheric
+ * pressure is in bar, and the water density in kg/m³. Zero selects the
+ * default of 1.01325 bar and 1025 kg/m³. The tanks provide the volumes,
+ * the gas mixes of the tanks, and the begin and end pressures for the
+ * tanks without pressure samples. The first segment uses the first gas
+ * mix, if there are any.
+ */
+dc_status_t
+dc_consumption_reset (dc_consumption_t *consumption, double atmospheric, double density, const dc_tank_t tanks[], unsigned int ntanks, unsigned int ngasmixes);
+
+/*
+ * Sample callback, to pass to dc_parser_samples_foreach together with
+ * the analysis as the userdata, after a call to dc_consumption_reset.
+ */
+void
+dc_consumption_sample_cb (dc_sample_type_t type, dc_sample_value_t value, void *userdata);
+
+/*
+ * Report the last segment of the dive, and calculate the totals.
+ */
+dc_status_t
+dc_consumption_finish (dc_consumption_t *consumption);
+
+/*
+ * Analyse the dive registered with the parser. The surface pressure,
+ * water density, tanks and gas mixes are taken from the parser.
+ */
+dc_status_t
+dc_consumption_process (dc_consumption_t *consumption, dc_parser_t *parser);
+
+/*
+ * Get the totals of the tanks, after the dive is finished. Tanks which
+ * only appear in the samples are included as well.
+ */
+unsigned int
+dc_consumption_get_tank_count (dc_consumption_t *consumption);
+
+dc_status_t
+dc_consumption_get_tank (dc_consumption_t *consumption, unsigned int index, dc_consumption_tank_t *tank);
+
+dc_status_t
+dc_consumption_free (dc_consumption_t *consumption);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_CONSUMPTION_H */
@@ -22,12 +22,23 @@
 #ifndef DC_CONTEXT_H
 #define DC_CONTEXT_H
 
+#include <stddef.h>
+#include <stdarg.h>
+
 #include "common.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif /* __cplusplus */
 
+/*
+ * A context can be shared by devices, parsers and I/O streams used from
+ * different threads at the same time. The log function (or sink) is
+ * never called concurrently for the same context, and the allocator
+ * must be thread-safe, as documented below. The configuration functions
+ * (log level, log function, allocator) are not synchronized, and should
+ * only be called before the context is shared.
+ */
 typedef struct dc_context_t dc_context_t;
 
 typedef enum dc_loglevel_t {
@@ -39,23 +50,143 @@ typedef enum dc_loglevel_t {
 	DC_LOGLEVEL_ALL
 } dc_loglevel_t;
 
+typedef enum dc_logsubsystem_t {
+	DC_LOGSUBSYSTEM_IOSTREAM,
+	DC_LOGSUBSYSTEM_DEVICE,
+	DC_LOGSUBSYSTEM_PARSER
+} dc_logsubsystem_t;
+
 typedef void (*dc_logfunc_t) (dc_context_t *context, dc_loglevel_t loglevel, const char *file, unsigned int line, const char *function, const char *message, void *userdata);
 
+/*
+ * Unformatted log record.
+ *
+ * For a text message, the format string and its arguments are passed
+ * as is, and the data pointer is NULL. For a hexdump, the format field
+ * contains the prefix, and the data field the raw bytes. All pointers
+ * are only valid for the duration of the call to the log sink.
+ */
+typedef struct dc_logrecord_t {
+	dc_logsubsystem_t subsystem;
+	dc_loglevel_t loglevel;
+	const char *file;
+	unsigned int line;
+	const char *function;
+	const char *format;
+	va_list *args;
+	const unsigned char *data;
+	unsigned int size;
+} dc_logrecord_t;
+
+typedef void (*dc_logsink_t) (dc_context_t *context, const dc_logrecord_t *record, void *userdata);
+
+/*
+ * Memory allocation function.
+ *
+ * The function has the same semantics as the standard realloc function,
+ * except that a size of zero always means the memory should be freed.
+ * Thus, a NULL pointer requests a new allocation, and a non-NULL pointer
+ * with a non-zero size a reallocation. Returning NULL indicates an
+ * allocation failure (e.g. because a memory limit has been reached).
+ *
+ * The allocator needs to be installed before any object is created
+ * with the context, and remain valid until all those objects have been
+ * destroyed. When the context is shared between threads, the function
+ * can be called from all of them simultaneously.
+ */
+typedef void *(*dc_allocfunc_t) (dc_context_t *context, void *ptr, size_t size, void *userdata);
+
+/*
+ * Hot path counters.
+ */
+typedef struct dc_context_stats_t {
+	unsigned long long buffer_allocs;  /* Buffer (re)allocations */
+	unsigned long long buffer_moved;   /* Buffer contents moved (bytes) */
+	unsigned long long checksum_bytes; /* Checksum input (bytes) */
+	unsigned long long device_reads;   /* dc_device_read calls */
+	unsigned long long device_bytes;   /* dc_device_read data (bytes) */
+	unsigned long long iostream_reads; /* dc_iostream_read calls */
+	unsigned long long samples;        /* Samples emitted by the parsers */
+	unsigned long long callbacks;      /* Dive and sample callbacks invoked */
+} dc_context_stats_t;
+
 dc_status_t
 dc_context_new (dc_context_t **context);
 
 dc_status_t
 dc_context_free (dc_context_t *context);
 
+/*
+ * Create a lightweight child context, for example for a worker thread.
+ * The clone starts with a copy of the log and allocator settings of the
+ * parent, which can then be changed independently. The internal caches,
+ * the log queue and the serialization of the log function are shared
+ * with the parent, which needs to outlive all its clones. The clone of
+ * a clone shares the state of the same parent.
+ */
+dc_status_t
+dc_context_clone (dc_context_t **context, dc_context_t *parent);
+
 dc_status_t
 dc_context_set_loglevel (dc_context_t *context, dc_loglevel_t loglevel);
 
+/*
+ * Set the log level of a single subsystem (the I/O streams, device
+ * protocols or parsers). Setting the global log level above resets the
+ * log level of all subsystems.
+ */
+dc_status_t
+dc_context_set_subsystem_loglevel (dc_context_t *context, dc_logsubsystem_t subsystem, dc_loglevel_t loglevel);
+
 dc_status_t
 dc_context_set_logfunc (dc_context_t *context, dc_logfunc_t logfunc, void *userdata);
 
+/*
+ * Install a structured log sink.
+ *
+ * When installed, the sink receives the log records unformatted, and
+ * replaces the log function. Formatting is left to the sink, which can
+ * postpone it with dc_logrecord_format(), or store the raw data. The
+ * sink is always called synchronously.
+ */
+dc_status_t
+dc_context_set_logsink (dc_context_t *context, dc_logsink_t sink, void *userdata);
+
+/*
+ * Format a log record into a null terminated message, the same as the
+ * one passed to the log function. Long messages are truncated.
+ */
+dc_status_t
+dc_logrecord_format (const dc_logrecord_t *record, char *buffer, size_t size);
+
+/*
+ * Deliver the log messages asynchronously.
+ *
+ * With a non-zero capacity, the logging calls only format the message
+ * and append it to a bounded queue, and the log function is called
+ * from a background thread. Messages which don't fit, for example
+ * because the queue is full, are still delivered synchronously. A zero
+ * capacity flushes the pending messages and restores the default,
+ * synchronous delivery. Not every platform supports the queue.
+ */
+dc_status_t
+dc_context_set_logqueue (dc_context_t *context, unsigned int capacity);
+
+dc_status_t
+dc_context_set_allocator (dc_context_t *context, dc_allocfunc_t allocfunc, void *userdata);
+
 unsigned int
 dc_context_get_transports (dc_context_t *context);
 
+/*
+ * Get the hot path counters. The counters are only compiled in with the
+ * --enable-perf-stats build option, and DC_STATUS_UNSUPPORTED is
+ * returned otherwise. Not every function takes a context, so the
+ * counters are shared by all contexts in the process.
+ */
+dc_status_t
+dc_context_get_stats (dc_context_t *context, dc_context_stats_t *stats);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -30,6 +30,15 @@
 extern "C" {
 #endif /* __cplusplus */
 
+/**
+ * Completion callback for the asynchronous custom transfers.
+ *
+ * @param[in]  cbdata  The callback data passed to the transfer.
+ * @param[in]  status  The status of the transfer.
+ * @param[in]  actual  The number of bytes transferred.
+ */
+typedef void (*dc_custom_callback_t) (void *cbdata, dc_status_t status, size_t actual);
+
 typedef struct dc_custom_cbs_t {
 	dc_status_t (*set_timeout) (void *userdata, int timeout);
 	dc_status_t (*set_latency) (void *userdata, unsigned int value);
@@ -46,6 +55,12 @@ typedef struct dc_custom_cbs_t {
 	dc_status_t (*sleep) (void *userdata, unsigned int milliseconds);
 	dc_status_t (*close) (void *userdata);
 	const char *(*get_name) (void *userdata);
+	/* Optional, only used with dc_custom_open2(). */
+	dc_status_t (*readv) (void *userdata, const dc_iovec_t iov[], size_t count, size_t *actual);
+	dc_status_t (*writev) (void *userdata, const dc_iovec_t iov[], size_t count, size_t *actual);
+	dc_status_t (*read_async) (void *userdata, void *data, size_t size, dc_custom_callback_t callback, void *cbdata);
+	dc_status_t (*write_async) (void *userdata, const void *data, size_t size, dc_custom_callback_t callback, void *cbdata);
+	dc_status_t (*cancel) (void *userdata);
 } dc_custom_cbs_t;
 
 /**
@@ -61,6 +76,29 @@ typedef struct dc_custom_cbs_t {
 dc_status_t
 dc_custom_open (dc_iostream_t **iostream, dc_context_t *context, dc_transport_t transport, const dc_custom_cbs_t *callbacks, void *userdata);
 
+/**
+ * Create a custom I/O stream, with the optional callback functions.
+ *
+ * The size of the callback structure allows applications built against
+ * an older version of the structure to keep working. Callbacks missing
+ * from the structure, or set to NULL, fall back to the synchronous read
+ * and write callbacks. The asynchronous callbacks must invoke the
+ * completion callback exactly once, when they return #DC_STATUS_SUCCESS,
+ * and it can be invoked from any thread. Returning #DC_STATUS_UNSUPPORTED
+ * from an optional callback also falls back to the synchronous callbacks.
+ *
+ * @param[out]  iostream   A location to store the custom I/O stream.
+ * @param[in]   context    A valid context object.
+ * @param[in]   transport  The transport type.
+ * @param[in]   callbacks  The callback functions to call.
+ * @param[in]   size       The size of the callback structure, in bytes.
+ * @param[in]   userdata   User data to pass to the callback functions.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_custom_open2 (dc_iostream_t **iostream, dc_context_t *context, dc_transport_t transport, const dc_custom_cbs_t *callbacks, size_t size, void *userdata);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -55,6 +55,16 @@ dc_datetime_t *
 dc_datetime_gmtime (dc_datetime_t *result,
                     dc_ticks_t ticks);
 
+/*
+ * Convert to the time at a fixed offset from UTC (in seconds). Unlike
+ * dc_datetime_localtime, no timezone database is involved. With
+ * DC_TIMEZONE_NONE, the result is the UTC time without a timezone.
+ */
+dc_datetime_t *
+dc_datetime_gmtime2 (dc_datetime_t *result,
+                     dc_ticks_t ticks,
+                     int timezone);
+
 dc_ticks_t
 dc_datetime_mktime (const dc_datetime_t *dt);
 
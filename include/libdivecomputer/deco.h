@@ -0,0 +1,130 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_DECO_H
+#define DC_DECO_H
+
+#include "common.h"
+#include "context.h"
+#include "parser.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * Decompression analysis
+ *
+ * Recompute the tissue loading of a dive from its profile, independent
+ * of what the dive computer reported, with the Bühlmann ZHL-16C model
+ * and gradient factors. The tissues start saturated with air at the
+ * surface, so repetitive dives are not taken into account. The gas
+ * changes are taken from the DC_SAMPLE_GASMIX samples, and in closed
+ * circuit mode the inspired oxygen from the DC_SAMPLE_SETPOINT samples.
+ *
+ * The time to surface assumes an ascent at 9 m/min on the current gas,
+ * with stops every 3 m. The CNS oxygen toxicity is based on the NOAA
+ * exposure limits.
+ */
+
+typedef struct dc_deco_t dc_deco_t;
+
+typedef struct dc_deco_row_t {
+	unsigned int time; /* Time (seconds) */
+	double depth;      /* Depth (meters) */
+	double ceiling;    /* Ceiling (meters) */
+	unsigned int tts;  /* Time to surface (seconds) */
+	double cns;        /* CNS oxygen toxicity (fraction) */
+} dc_deco_row_t;
+
+/*
+ * The callback receives one row for each DC_SAMPLE_TIME sample, in
+ * order. The dive is the index of the parser for dc_deco_process_many,
+ * and zero otherwise.
+ */
+typedef void (*dc_deco_callback_t) (unsigned int dive, const dc_deco_row_t *row, void *userdata);
+
+dc_status_t
+dc_deco_new (dc_deco_t **deco, dc_context_t *context);
+
+/*
+ * Set the gradient factors (percent). The default is 100/100, which is
+ * the plain Bühlmann model.
+ */
+dc_status_t
+dc_deco_set_gradient (dc_deco_t *deco, unsigned int low, unsigned int high);
+
+dc_status_t
+dc_deco_set_callback (dc_deco_t *deco, dc_deco_callback_t callback, void *userdata);
+
+/*
+ * Start a new dive, for feeding the samples manually. The atmospheric
+ * pressure is in bar, and the water density in kg/m³. Zero selects the
+ * default of 1.01325 bar and 1025 kg/m³. The gas mixes are copied.
+ */
+dc_status_t
+dc_deco_reset (dc_deco_t *deco, double atmospheric, double density, dc_divemode_t divemode, const dc_gasmix_t gasmixes[], unsigned int ngasmixes);
+
+/*
+ * Sample callback, to pass to dc_parser_samples_foreach together with
+ * the analysis as the userdata, after a call to dc_deco_reset.
+ */
+void
+dc_deco_sample_cb (dc_sample_type_t type, dc_sample_value_t value, void *userdata);
+
+/*
+ * Feed the rows of a columnar batch, after a call to dc_deco_reset. The
+ * gas mix column is only used together with the mask column, because a
+ * zero index can't be distinguished from a missing value otherwise.
+ */
+dc_status_t
+dc_deco_process_batch (dc_deco_t *deco, const dc_sample_batch_t *batch);
+
+/*
+ * Report the last row of the dive.
+ */
+dc_status_t
+dc_deco_finish (dc_deco_t *deco);
+
+/*
+ * Analyse the dive registered with the parser. The surface pressure,
+ * water density, dive mode and gas mixes are taken from the parser.
+ */
+dc_status_t
+dc_deco_process (dc_deco_t *deco, dc_parser_t *parser);
+
+/*
+ * Analyse many dives at once, with up to the given number of threads.
+ * Each dive needs its own parser. With more than one thread, the
+ * callback is called from the worker threads, and can run concurrently
+ * for different dives. The rows of a single dive are always reported
+ * in order, from the same thread. Dives which fail are skipped.
+ */
+dc_status_t
+dc_deco_process_many (dc_deco_t *deco, dc_parser_t *parsers[], unsigned int count, unsigned int nthreads);
+
+dc_status_t
+dc_deco_free (dc_deco_t *deco);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_DECO_H */
@@ -31,9 +31,51 @@ extern "C" {
 
 typedef struct dc_descriptor_t dc_descriptor_t;
 
+/*
+ * The optional features of a backend. The memory access flags indicate
+ * that the dc_device_read, dc_device_write and dc_device_dump functions
+ * are supported. The other flags indicate that the backend specific
+ * function to enable the feature is available.
+ */
+typedef enum dc_capability_t {
+	DC_CAPABILITY_READ       = (1 << 0),
+	DC_CAPABILITY_WRITE      = (1 << 1),
+	DC_CAPABILITY_DUMP       = (1 << 2),
+	DC_CAPABILITY_TIMESYNC   = (1 << 3),
+	DC_CAPABILITY_THREADS    = (1 << 4), /* garmin_device_set_threads */
+	DC_CAPABILITY_PIPELINING = (1 << 5), /* *_device_set_pipelining */
+	DC_CAPABILITY_STREAMING  = (1 << 6), /* uwatec_smart_device_set_streaming */
+} dc_capability_t;
+
 dc_status_t
 dc_descriptor_iterator (dc_iterator_t **iterator);
 
+/*
+ * Look up a single descriptor by its vendor and product name (case
+ * insensitive), by its family and model number, or by the USB vendor
+ * and product id. If there is more than one match, the first one in
+ * the iteration order is returned. DC_STATUS_NODEVICE is returned if
+ * there is no match.
+ */
+dc_status_t
+dc_descriptor_find_by_name (dc_descriptor_t **descriptor, const char *vendor, const char *product);
+
+dc_status_t
+dc_descriptor_find_by_model (dc_descriptor_t **descriptor, dc_family_t family, unsigned int model);
+
+dc_status_t
+dc_descriptor_find_by_usb (dc_descriptor_t **descriptor, unsigned int vid, unsigned int pid);
+
+/*
+ * Find all descriptors which accept the advertised bluetooth name, on
+ * any of the given transports (DC_TRANSPORT_BLUETOOTH and/or
+ * DC_TRANSPORT_BLE). Descriptors without a name filter are not
+ * included. At most size descriptors are stored in the array, but the
+ * total number of matches is returned in the count parameter.
+ */
+dc_status_t
+dc_descriptor_match_bluetooth (const char *name, unsigned int transports, dc_descriptor_t *descriptors[], size_t size, size_t *count);
+
 void
 dc_descriptor_free (dc_descriptor_t *descriptor);
 
@@ -52,6 +94,13 @@ dc_descriptor_get_model (dc_descriptor_t *descriptor);
 unsigned int
 dc_descriptor_get_transports (dc_descriptor_t *descriptor);
 
+/*
+ * Get the capabilities of the backend, as a bitmask of dc_capability_t
+ * flags.
+ */
+unsigned int
+dc_descriptor_get_capabilities (dc_descriptor_t *descriptor);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
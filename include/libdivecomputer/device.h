@@ -28,6 +28,7 @@
 #include "iostream.h"
 #include "buffer.h"
 #include "datetime.h"
+#include "fingerprints.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -38,9 +39,31 @@ typedef enum dc_event_type_t {
 	DC_EVENT_PROGRESS = (1 << 1),
 	DC_EVENT_DEVINFO = (1 << 2),
 	DC_EVENT_CLOCK = (1 << 3),
-	DC_EVENT_VENDOR = (1 << 4)
+	DC_EVENT_VENDOR = (1 << 4),
+	DC_EVENT_CACHE = (1 << 5),
+	DC_EVENT_IOSTATS = (1 << 6),
+	DC_EVENT_LATENCY = (1 << 7),
+	DC_EVENT_CHECKPOINT = (1 << 8),
+	DC_EVENT_PROFILE = (1 << 9),
+	DC_EVENT_DIVEHASH = (1 << 10),
+	DC_EVENT_MEMORY = (1 << 11)
 } dc_event_type_t;
 
+/*
+ * Phases of a download. Time outside the phases annotated by the
+ * backend is accounted to DC_PHASE_OTHER.
+ */
+typedef enum dc_phase_t {
+	DC_PHASE_OTHER,
+	DC_PHASE_HANDSHAKE,
+	DC_PHASE_VERSION,
+	DC_PHASE_LOGBOOK,
+	DC_PHASE_PROFILE,
+	DC_PHASE_DECOMPRESS,
+	DC_PHASE_CHECKSUM,
+	DC_PHASE_CALLBACK
+} dc_phase_t;
+
 typedef struct dc_device_t dc_device_t;
 
 typedef struct dc_event_progress_t {
@@ -64,6 +87,59 @@ typedef struct dc_event_vendor_t {
 	unsigned int size;
 } dc_event_vendor_t;
 
+typedef struct dc_event_cache_t {
+	unsigned int hits;
+	unsigned int misses;
+} dc_event_cache_t;
+
+typedef struct dc_event_latency_t {
+	unsigned int command; /* Command opcode */
+	unsigned int size;    /* Response size (bytes) */
+	unsigned int latency; /* Round-trip time (microseconds) */
+} dc_event_latency_t;
+
+typedef struct dc_event_checkpoint_t {
+	const unsigned char *data; /* Opaque resume token */
+	unsigned int size;
+} dc_event_checkpoint_t;
+
+/*
+ * At the end of every dc_device_foreach call, a DC_EVENT_PROFILE event
+ * is emitted for each phase of the download that took time. The phases
+ * don't overlap, and add up to the duration of the download.
+ */
+typedef struct dc_event_profile_t {
+	dc_phase_t phase;
+	unsigned int count;      /* Number of times the phase was entered */
+	unsigned long long time; /* Total time (microseconds) */
+} dc_event_profile_t;
+
+/*
+ * When enabled, a DC_EVENT_DIVEHASH event is emitted for each dive,
+ * right before it's passed to the dive callback. The hash is a 64 bit
+ * xxHash (XXH64) of the raw dive data, and identical to the value
+ * returned by dc_dive_hash for the same data.
+ */
+typedef struct dc_event_divehash_t {
+	unsigned long long hash;
+	unsigned int size;
+	const unsigned char *fingerprint;
+	unsigned int fsize;
+} dc_event_divehash_t;
+
+/*
+ * At the end of every dc_device_foreach and dc_device_dump call, a
+ * DC_EVENT_MEMORY event reports the memory held by the backend for the
+ * session: the large buffers, such as the logbook caches and the
+ * downloaded memory images, but not the small bookkeeping structures.
+ * The peak is the maximum since the device was opened.
+ */
+typedef struct dc_event_memory_t {
+	size_t current; /* Bytes in use */
+	size_t peak;    /* Maximum bytes in use */
+	size_t budget;  /* Memory budget (zero for none) */
+} dc_event_memory_t;
+
 typedef int (*dc_cancel_callback_t) (void *userdata);
 
 typedef void (*dc_event_callback_t) (dc_device_t *device, dc_event_type_t event, const void *data, void *userdata);
@@ -79,12 +155,94 @@ dc_device_get_type (dc_device_t *device);
 dc_status_t
 dc_device_set_cancel (dc_device_t *device, dc_cancel_callback_t callback, void *userdata);
 
+/*
+ * Cancel the operation in progress. This function can be called from
+ * another thread. Unlike the cancel callback, which is only checked
+ * between the packets or dives, it also interrupts a transfer which is
+ * blocked in the I/O stream, if supported by the transport (see
+ * dc_iostream_interrupt). The device can only be closed afterwards.
+ */
+dc_status_t
+dc_device_cancel (dc_device_t *device);
+
 dc_status_t
 dc_device_set_events (dc_device_t *device, unsigned int events, dc_event_callback_t callback, void *userdata);
 
 dc_status_t
 dc_device_set_fingerprint (dc_device_t *device, const unsigned char data[], unsigned int size);
 
+/*
+ * Limit the rate of the progress events. An event is only delivered once
+ * at least the minimum interval (in milliseconds) has elapsed, or the
+ * progress has advanced by at least the minimum delta (in percent),
+ * since the previous event that was delivered. A zero value disables
+ * the corresponding limit, and with both disabled (the default) every
+ * event is delivered. The first event, events where the maximum changes
+ * or the progress goes backwards, and the final event at 100% are always
+ * delivered.
+ */
+dc_status_t
+dc_device_set_progress (dc_device_t *device, unsigned int interval, unsigned int delta);
+
+/*
+ * Deliver the events asynchronously, to keep a slow event callback from
+ * stalling the communication with the device. With a non-zero capacity,
+ * the events are copied into a bounded queue, and the event callback is
+ * only called from dc_device_poll_events, typically from another thread
+ * than the one running the download. The progress events don't take
+ * space in the queue: only the most recent progress is kept, and
+ * delivered after the other pending events. Events which don't fit are
+ * dropped. A zero capacity delivers the pending events, and restores the
+ * default, synchronous delivery. The queue can only be changed while no
+ * other operation is in progress. Not every platform supports the queue.
+ */
+dc_status_t
+dc_device_set_eventqueue (dc_device_t *device, unsigned int capacity);
+
+/*
+ * Deliver the events queued so far to the event callback, from the
+ * calling thread. Only a single thread can poll for the events.
+ */
+dc_status_t
+dc_device_poll_events (dc_device_t *device);
+
+/*
+ * Limit the memory the backend holds for the session (in bytes). The
+ * backends which can download the data in smaller pieces switch to
+ * that mode once the larger buffers would exceed the budget, at the
+ * cost of more round trips, and the other ones fail with
+ * DC_STATUS_NOMEMORY. A zero budget (the default) removes the limit.
+ */
+dc_status_t
+dc_device_set_memory_budget (dc_device_t *device, size_t budget);
+
+/*
+ * Register a set with the fingerprints of the dives to skip. Unlike the
+ * single fingerprint, which stops the download, the dives in the set are
+ * skipped and the download continues with the next dive. Both can be
+ * used together. The set is not copied, and needs to remain valid until
+ * the device is closed, or another set is registered. Pass NULL to
+ * remove the set.
+ */
+dc_status_t
+dc_device_set_fingerprints (dc_device_t *device, dc_fingerprints_t *fingerprints);
+
+/*
+ * Register a resume token, previously received with a
+ * DC_EVENT_CHECKPOINT event, to continue an interrupted download from
+ * that point. The token is only used by the next dc_device_foreach
+ * call, and ignored by backends without support for resuming.
+ */
+dc_status_t
+dc_device_set_resume (dc_device_t *device, const unsigned char data[], unsigned int size);
+
+/*
+ * Calculate the hash of the raw dive data, for example to deduplicate
+ * dives from a memory dump against those of a download.
+ */
+unsigned long long
+dc_dive_hash (const unsigned char data[], unsigned int size);
+
 dc_status_t
 dc_device_read (dc_device_t *device, unsigned int address, unsigned char data[], unsigned int size);
 
@@ -94,6 +252,15 @@ dc_device_write (dc_device_t *device, unsigned int address, const unsigned char
 dc_status_t
 dc_device_dump (dc_device_t *device, dc_buffer_t *buffer);
 
+/*
+ * Download a memory dump, reusing a previous dump of the same device.
+ * Only the parts of the memory that may have changed are downloaded
+ * and patched into a copy of the previous image. If that's not
+ * possible, a full memory dump is downloaded instead.
+ */
+dc_status_t
+dc_device_dump_incremental (dc_device_t *device, dc_buffer_t *previous, dc_buffer_t *buffer);
+
 dc_status_t
 dc_device_foreach (dc_device_t *device, dc_dive_callback_t callback, void *userdata);
 
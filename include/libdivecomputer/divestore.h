@@ -0,0 +1,157 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_DIVESTORE_H
+#define DC_DIVESTORE_H
+
+#include "common.h"
+#include "context.h"
+#include "datetime.h"
+#include "parser.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * A dive store keeps the raw dive data, together with a summary of the
+ * parsed dive, in a single file on disk. The dives are indexed by the
+ * family, model and serial number of the device, and their fingerprint.
+ * An application can skip the dives which are already present, or use
+ * the stored data and summary without downloading or parsing the dive
+ * again.
+ *
+ * The file is only ever appended to. The existing contents are mapped
+ * into memory when the store is opened. An incomplete record at the end
+ * of the file, for example after a crash, is discarded. A file created
+ * by an older version keeps its format, and doesn't store the location.
+ *
+ * The date and time, the maximum depth, the dive time and the location of
+ * the summaries are also indexed in memory, such that the dives can be
+ * queried on those fields without decoding or parsing the stored dives.
+ *
+ * A store is not safe for concurrent use, neither from multiple threads
+ * nor from multiple processes.
+ */
+typedef struct dc_divestore_t dc_divestore_t;
+
+#define DC_DIVESTORE_MAXGASMIXES 16
+
+typedef struct dc_divestore_summary_t {
+	dc_datetime_t datetime;
+	unsigned int divetime;
+	double maxdepth;
+	unsigned int ngasmixes;
+	dc_gasmix_t gasmixes[DC_DIVESTORE_MAXGASMIXES];
+	dc_location_t location;
+} dc_divestore_summary_t;
+
+typedef int (*dc_divestore_callback_t) (const unsigned char *data, unsigned int size, const unsigned char *fingerprint, unsigned int fsize, const dc_divestore_summary_t *summary, void *userdata);
+
+typedef enum dc_divestore_query_flags_t {
+	DC_DIVESTORE_QUERY_DATETIME = (1 << 0),
+	DC_DIVESTORE_QUERY_MAXDEPTH = (1 << 1),
+	DC_DIVESTORE_QUERY_DIVETIME = (1 << 2),
+	DC_DIVESTORE_QUERY_LOCATION = (1 << 3),
+} dc_divestore_query_flags_t;
+
+/*
+ * The criteria of a query. Only the criteria selected in the flags are
+ * used, and a dive has to match all of them. All ranges include both
+ * limits. The begin and end time are compared with the date and time of
+ * the dive converted with dc_datetime_mktime. A zero maximum depth or
+ * dive time means there is no upper limit. The location matches the
+ * dives inside the box between the south-west and north-east corner,
+ * which crosses the antimeridian if the western longitude is larger
+ * than the eastern one. The altitude is ignored.
+ */
+typedef struct dc_divestore_query_t {
+	unsigned int flags;
+	dc_ticks_t begin, end;
+	double mindepth, maxdepth;
+	unsigned int mindivetime, maxdivetime;
+	dc_location_t southwest, northeast;
+} dc_divestore_query_t;
+
+typedef int (*dc_divestore_query_callback_t) (dc_family_t family, unsigned int model, unsigned int serial, const unsigned char *data, unsigned int size, const unsigned char *fingerprint, unsigned int fsize, const dc_divestore_summary_t *summary, void *userdata);
+
+/*
+ * Open the store, and create the file if it doesn't exist yet.
+ */
+dc_status_t
+dc_divestore_open (dc_divestore_t **store, dc_context_t *context, const char *filename);
+
+/*
+ * Fill the summary with the fields of the parser. The fields which are
+ * not supported by the parser are left at zero. A zero latitude and
+ * longitude means the location is not known.
+ */
+dc_status_t
+dc_divestore_summarize (dc_parser_t *parser, dc_divestore_summary_t *summary);
+
+/*
+ * Append a dive to the store. A dive which is already present is not
+ * stored again. The summary is optional.
+ */
+dc_status_t
+dc_divestore_add (dc_divestore_t *store, dc_family_t family, unsigned int model, unsigned int serial,
+	const unsigned char fingerprint[], unsigned int fsize,
+	const unsigned char data[], unsigned int size,
+	const dc_divestore_summary_t *summary);
+
+/*
+ * Find a dive. If the dive is present, the data and summary are returned
+ * in the optional output parameters. The data remains valid until the
+ * store is closed. If the dive is not present, DC_STATUS_DONE is returned.
+ */
+dc_status_t
+dc_divestore_lookup (dc_divestore_t *store, dc_family_t family, unsigned int model, unsigned int serial,
+	const unsigned char fingerprint[], unsigned int fsize,
+	const unsigned char **data, unsigned int *size,
+	dc_divestore_summary_t *summary);
+
+/*
+ * Call the callback for all dives of the device, in the order they were
+ * added. Returning zero from the callback stops the iteration.
+ */
+dc_status_t
+dc_divestore_foreach (dc_divestore_t *store, dc_family_t family, unsigned int model, unsigned int serial,
+	dc_divestore_callback_t callback, void *userdata);
+
+/*
+ * Call the callback for all dives of all devices matching the query.
+ * The dives are reported in chronological order if the date and time
+ * are part of the query, and in no particular order otherwise. Dives
+ * without a date and time (or location) never match a query on the
+ * date and time (or location). Returning zero from the callback stops
+ * the iteration.
+ */
+dc_status_t
+dc_divestore_query (dc_divestore_t *store, const dc_divestore_query_t *query,
+	dc_divestore_query_callback_t callback, void *userdata);
+
+dc_status_t
+dc_divestore_close (dc_divestore_t *store);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_DIVESTORE_H */
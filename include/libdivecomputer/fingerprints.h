@@ -0,0 +1,73 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_FINGERPRINTS_H
+#define DC_FINGERPRINTS_H
+
+#include "common.h"
+#include "context.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * A set of fingerprints, for skipping all the dives which have been
+ * downloaded before, instead of stopping at the single most recent dive
+ * registered with dc_device_set_fingerprint().
+ *
+ * Lookups first check a Bloom filter, such that the common case of a
+ * new dive is answered without touching the stored fingerprints. Any
+ * match of the filter is confirmed against the exact set, so there are
+ * never any false positives.
+ *
+ * The fingerprints are not tied to a device. An application should use
+ * a separate set for each device, and can register the right one from
+ * the DC_EVENT_DEVINFO event.
+ */
+typedef struct dc_fingerprints_t dc_fingerprints_t;
+
+dc_status_t
+dc_fingerprints_new (dc_fingerprints_t **fingerprints, dc_context_t *context);
+
+/*
+ * Add a fingerprint to the set. Adding a fingerprint which is already
+ * present has no effect.
+ */
+dc_status_t
+dc_fingerprints_add (dc_fingerprints_t *fingerprints, const unsigned char data[], unsigned int size);
+
+/*
+ * Check whether the fingerprint is present in the set.
+ */
+int
+dc_fingerprints_contains (dc_fingerprints_t *fingerprints, const unsigned char data[], unsigned int size);
+
+unsigned int
+dc_fingerprints_get_count (dc_fingerprints_t *fingerprints);
+
+dc_status_t
+dc_fingerprints_free (dc_fingerprints_t *fingerprints);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_FINGERPRINTS_H */
@@ -0,0 +1,53 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_GARMIN_H
+#define DC_GARMIN_H
+
+#include "common.h"
+#include "device.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * Set the name of the index file, which caches whether each FIT file is
+ * a dive (keyed by the file name, size and modification time). Files that
+ * are known not to be dives are skipped on the next download without
+ * reading them again.
+ * Pass NULL to disable the index.
+ */
+dc_status_t
+garmin_device_set_index (dc_device_t *device, const char *filename);
+
+/*
+ * Set the number of worker threads used to read and classify the FIT
+ * files in parallel. The dives are still delivered to the callback in
+ * the same order. A value of zero or one disables the worker threads.
+ */
+dc_status_t
+garmin_device_set_threads (dc_device_t *device, unsigned int nthreads);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_GARMIN_H */
@@ -0,0 +1,80 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_HOTPLUG_H
+#define DC_HOTPLUG_H
+
+#include "common.h"
+#include "context.h"
+#include "descriptor.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * A hotplug monitor reports the devices which are plugged in or removed,
+ * as an alternative to polling the iterators. Only the devices accepted
+ * by the filter of the descriptor are reported.
+ *
+ * The devices which are already present are reported as arrivals from
+ * dc_hotplug_new() itself. All other events are reported from a
+ * background thread. The callbacks are never called concurrently.
+ *
+ * For an arrival, the callback receives a new device object, which is
+ * owned by the application and needs to be freed with the free function
+ * of its transport (for example dc_usbhid_device_free()), exactly like
+ * the devices returned by an iterator. For a removal, the device is
+ * always NULL, and the id matches the id of the arrival.
+ *
+ * The callback should return quickly. It must not open the device, nor
+ * free the monitor. Devices should be opened from another thread.
+ */
+typedef struct dc_hotplug_t dc_hotplug_t;
+
+typedef enum dc_hotplug_event_t {
+	DC_HOTPLUG_ARRIVED,
+	DC_HOTPLUG_LEFT
+} dc_hotplug_event_t;
+
+typedef void (*dc_hotplug_callback_t) (dc_hotplug_event_t event, dc_transport_t transport, unsigned int id, void *device, void *userdata);
+
+/*
+ * Start monitoring the transports in the bitmask. The transports which
+ * are not supported on this platform are ignored, unless none of them is
+ * supported at all.
+ *
+ * Supported are DC_TRANSPORT_USBHID (libusb with hotplug support) and
+ * DC_TRANSPORT_SERIAL (Linux).
+ */
+dc_status_t
+dc_hotplug_new (dc_hotplug_t **hotplug, dc_context_t *context, dc_descriptor_t *descriptor, unsigned int transports, dc_hotplug_callback_t callback, void *userdata);
+
+/*
+ * Stop monitoring. No callbacks are called after this function returns.
+ */
+dc_status_t
+dc_hotplug_free (dc_hotplug_t *hotplug);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_HOTPLUG_H */
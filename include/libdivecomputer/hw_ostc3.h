@@ -32,6 +32,26 @@ extern "C" {
 
 #define HW_OSTC3_DISPLAY_SIZE    16
 #define HW_OSTC3_CUSTOMTEXT_SIZE 60
+#define HW_OSTC3_LOGBOOK_SIZE (16 * 256)
+
+/*
+ * Selection of the dives to download. The dives are selected with the
+ * information in the logbook headers, and all other dives are skipped
+ * without transferring them.
+ *
+ * The begin and end time define the half-open interval [begin, end),
+ * with a resolution of one minute. A year of zero leaves that side of
+ * the interval open. The numbers are the dive numbers shown on the
+ * device. With a limit, at most that many dives are downloaded, starting
+ * with the most recent dive. Zero means no limit.
+ */
+typedef struct hw_ostc3_query_t {
+	dc_datetime_t begin;
+	dc_datetime_t end;
+	const unsigned int *numbers;
+	unsigned int nnumbers;
+	unsigned int limit;
+} hw_ostc3_query_t;
 
 dc_status_t
 hw_ostc3_device_version (dc_device_t *device, unsigned char data[], unsigned int size);
@@ -57,6 +77,31 @@ hw_ostc3_device_config_reset (dc_device_t *abstract);
 dc_status_t
 hw_ostc3_device_fwupdate (dc_device_t *abstract, const char *filename);
 
+/*
+ * Retrieve the compact logbook headers from the last download, along with
+ * the internal dive counter of the most recent dive, for caching by the
+ * application. Returns DC_STATUS_UNSUPPORTED if no compact headers were
+ * downloaded.
+ */
+dc_status_t
+hw_ostc3_device_get_logbook (dc_device_t *abstract, unsigned char data[], unsigned int size, unsigned int *counter);
+
+/*
+ * Supply previously cached logbook headers, along with the current value
+ * of the internal dive counter of the device. If the counter still
+ * matches the most recent dive in the cached headers, the headers are
+ * not downloaded again. Pass NULL to remove the cache.
+ */
+dc_status_t
+hw_ostc3_device_set_logbook (dc_device_t *abstract, const unsigned char data[], unsigned int size, unsigned int counter);
+
+/*
+ * Register the selection for the next downloads. The query, including
+ * the numbers, is copied. Pass NULL to download all dives again.
+ */
+dc_status_t
+hw_ostc3_device_set_query (dc_device_t *abstract, const hw_ostc3_query_t *query);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -83,6 +83,55 @@ typedef enum dc_line_t {
 	DC_LINE_RNG = 0x08, /**< Ring indicator */
 } dc_line_t;
 
+/**
+ * Completion callback for the asynchronous transfers.
+ *
+ * @param[in]  iostream  The I/O stream.
+ * @param[in]  status    The result of the transfer.
+ * @param[in]  actual    The number of bytes transferred.
+ * @param[in]  userdata  Pointer to the user data.
+ */
+/**
+ * Buffer descriptor for scatter/gather I/O.
+ */
+typedef struct dc_iovec_t {
+	void *data;  /**< Pointer to the buffer */
+	size_t size; /**< Size of the buffer (in bytes) */
+} dc_iovec_t;
+
+/**
+ * Number of bins in the read latency histogram.
+ */
+#define DC_IOSTREAM_STATS_NBINS 12
+
+/**
+ * I/O statistics.
+ *
+ * Bin 0 of the histogram counts the reads that blocked for less than
+ * 1 millisecond, bin i (with 0 < i < DC_IOSTREAM_STATS_NBINS - 1) the
+ * reads that blocked for 2^(i-1) up to 2^i milliseconds, and the last
+ * bin all longer reads.
+ *
+ * A transaction is a write followed by a read which returns data. The
+ * average turnaround time per transaction includes the response time of
+ * the device and the latency of the transport, for example the latency
+ * timer of a USB serial converter.
+ */
+typedef struct dc_iostream_stats_t {
+	unsigned long long nread;    /**< Number of bytes read */
+	unsigned long long nwritten; /**< Number of bytes written */
+	unsigned int readcalls;      /**< Number of read calls */
+	unsigned int writecalls;     /**< Number of write calls */
+	unsigned int timeouts;       /**< Number of calls that timed out */
+	unsigned int purges;         /**< Number of purge calls */
+	unsigned long long readtime; /**< Total time blocked in read (microseconds) */
+	unsigned int histogram[DC_IOSTREAM_STATS_NBINS]; /**< Read latency histogram */
+	unsigned int transactions;   /**< Number of writes answered by a read */
+	unsigned long long turnaround; /**< Total time from the end of those writes until the answer (microseconds) */
+} dc_iostream_stats_t;
+
+typedef void (*dc_iostream_callback_t) (dc_iostream_t *iostream, dc_status_t status, size_t actual, void *userdata);
+
 /**
  * Get the transport type.
  *
@@ -196,6 +245,26 @@ dc_iostream_get_lines (dc_iostream_t *iostream, unsigned int *value);
 dc_status_t
 dc_iostream_get_available (dc_iostream_t *iostream, size_t *value);
 
+/**
+ * Wait until data is available in the input buffer.
+ *
+ * The function returns as soon as at least one byte can be read, which
+ * makes it a better alternative to a fixed delay while waiting for the
+ * device to respond. The timeout has the same meaning as for
+ * #dc_iostream_set_timeout, but doesn't change the timeout of the read
+ * operations. Without native support, the input buffer is polled with
+ * #dc_iostream_get_available.
+ *
+ * @param[in]  iostream  A valid I/O stream.
+ * @param[in]  timeout   The timeout in milliseconds.
+ * @returns #DC_STATUS_SUCCESS if data is available, #DC_STATUS_TIMEOUT
+ * if no data arrived within the specified amount of time,
+ * #DC_STATUS_UNSUPPORTED if the I/O stream can't wait for data, or
+ * another #dc_status_t code on failure.
+ */
+dc_status_t
+dc_iostream_wait_readable (dc_iostream_t *iostream, int timeout);
+
 /**
  * Configure the line settings.
  *
@@ -239,6 +308,137 @@ dc_iostream_read (dc_iostream_t *iostream, void *data, size_t size, size_t *actu
 dc_status_t
 dc_iostream_write (dc_iostream_t *iostream, const void *data, size_t size, size_t *actual);
 
+/**
+ * Read data from the I/O stream into multiple buffers.
+ *
+ * The buffers are filled in order, as if the data was read into a
+ * single contiguous buffer with dc_iostream_read(). Transports without
+ * native support read into a temporary buffer, and scatter the data
+ * afterwards.
+ *
+ * @param[in]  iostream  A valid I/O stream.
+ * @param[in]  iov       The array of buffers to read the data into.
+ * @param[in]  count     The number of buffers in the array.
+ * @param[out] actual    A location to store the total number of bytes
+ *                       actually read.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_iostream_readv (dc_iostream_t *iostream, const dc_iovec_t iov[], size_t count, size_t *actual);
+
+/**
+ * Write data from multiple buffers to the I/O stream.
+ *
+ * The buffers are written in order, as if they were concatenated into
+ * a single contiguous buffer and written with dc_iostream_write().
+ * Transports without native support gather the data into a temporary
+ * buffer first.
+ *
+ * @param[in]  iostream  A valid I/O stream.
+ * @param[in]  iov       The array of buffers to write the data from.
+ * @param[in]  count     The number of buffers in the array.
+ * @param[out] actual    A location to store the total number of bytes
+ *                       actually written.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_iostream_writev (dc_iostream_t *iostream, const dc_iovec_t iov[], size_t count, size_t *actual);
+
+/**
+ * Enable or disable the collection of I/O statistics.
+ *
+ * The statistics are disabled by default. Enabling them resets all
+ * counters to zero. Only the synchronous transfers are accounted.
+ *
+ * @param[in]  iostream  A valid I/O stream.
+ * @param[in]  value     The statistics state (1 to enable, 0 to disable).
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_iostream_set_stats (dc_iostream_t *iostream, unsigned int value);
+
+/**
+ * Get the I/O statistics.
+ *
+ * @param[in]  iostream  A valid I/O stream.
+ * @param[out] stats     A location to store the statistics.
+ * @returns #DC_STATUS_SUCCESS on success, #DC_STATUS_UNSUPPORTED if the
+ * statistics are not enabled, or another #dc_status_t code on failure.
+ */
+dc_status_t
+dc_iostream_get_stats (dc_iostream_t *iostream, dc_iostream_stats_t *stats);
+
+/**
+ * Start an asynchronous read from the I/O stream.
+ *
+ * The callback is invoked once all bytes have been received, the timeout
+ * expired or an error occurred. Depending on the transport, this happens
+ * from a background thread. Transports without native support complete
+ * the transfer synchronously, and invoke the callback before returning.
+ * The buffer must remain valid until the callback has been invoked.
+ *
+ * @param[in]  iostream  A valid I/O stream.
+ * @param[out] data      The memory buffer to read the data into.
+ * @param[in]  size      The number of bytes to read.
+ * @param[in]  callback  The completion callback.
+ * @param[in]  userdata  Pointer to user data passed to the callback.
+ * @returns #DC_STATUS_SUCCESS if the transfer was started, or another
+ * #dc_status_t code on failure (in which case the callback is not
+ * invoked).
+ */
+dc_status_t
+dc_iostream_read_async (dc_iostream_t *iostream, void *data, size_t size, dc_iostream_callback_t callback, void *userdata);
+
+/**
+ * Start an asynchronous write to the I/O stream.
+ *
+ * See dc_iostream_read_async() for the completion semantics.
+ *
+ * @param[in]  iostream  A valid I/O stream.
+ * @param[in]  data      The memory buffer to write the data from.
+ * @param[in]  size      The number of bytes to write.
+ * @param[in]  callback  The completion callback.
+ * @param[in]  userdata  Pointer to user data passed to the callback.
+ * @returns #DC_STATUS_SUCCESS if the transfer was started, or another
+ * #dc_status_t code on failure (in which case the callback is not
+ * invoked).
+ */
+dc_status_t
+dc_iostream_write_async (dc_iostream_t *iostream, const void *data, size_t size, dc_iostream_callback_t callback, void *userdata);
+
+/**
+ * Cancel all pending asynchronous transfers.
+ *
+ * The callbacks of the cancelled transfers receive #DC_STATUS_CANCELLED.
+ *
+ * @param[in]  iostream  A valid I/O stream.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_iostream_cancel (dc_iostream_t *iostream);
+
+/**
+ * Abort the blocking transfers in progress.
+ *
+ * Unlike all other functions, this function can be called from another
+ * thread, while a read, write or sleep is blocked in the I/O stream.
+ * The blocked transfer returns #DC_STATUS_CANCELLED immediately,
+ * instead of waiting for the timeout. The interruption is permanent:
+ * all subsequent transfers fail as well, and the only remaining
+ * operation is to close the I/O stream.
+ *
+ * @param[in]  iostream  A valid I/O stream.
+ * @returns #DC_STATUS_SUCCESS on success, #DC_STATUS_UNSUPPORTED if
+ * the I/O stream can't be interrupted, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_iostream_interrupt (dc_iostream_t *iostream);
+
 /**
  * Flush the internal output buffer and wait until the data has been
  * transmitted.
@@ -296,9 +496,60 @@ dc_iostream_close (dc_iostream_t *iostream);
 const char *
 dc_iostream_get_name (dc_iostream_t *iostream);
 
+/**
+ * Open a usb storage device.
+ *
+ * @param[out]  iostream  A location to store the I/O stream.
+ * @param[in]   context   A valid context object.
+ * @param[in]   name      The pathname of the mount point.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
 dc_status_t
 dc_usb_storage_open (dc_iostream_t **out, dc_context_t *context, const char *name);
 
+/**
+ * Directory listing callback.
+ *
+ * @param[in]  name      The name of the directory entry.
+ * @param[in]  userdata  The user data.
+ * @returns Non-zero to continue the listing, or zero to stop.
+ */
+typedef int (*dc_usb_storage_list_callback_t) (const char *name, void *userdata);
+
+/**
+ * The callback functions of a custom usb storage device.
+ *
+ * All names are relative to the root of the device, with '/' as the
+ * separator. The callbacks can be called from multiple threads at the
+ * same time, except for the close callback.
+ */
+typedef struct dc_usb_storage_cbs_t {
+	/* Call the callback for each entry in the directory. */
+	dc_status_t (*list) (void *userdata, const char *dirname, dc_usb_storage_list_callback_t callback, void *cbdata);
+	/* Get the size and modification time (or -1) of the file. */
+	dc_status_t (*stat) (void *userdata, const char *filename, unsigned long long *size, long long *mtime);
+	/* Read a range of the file, with fewer bytes at the end of the file. */
+	dc_status_t (*read) (void *userdata, const char *filename, unsigned long long offset, void *data, size_t size, size_t *actual);
+	dc_status_t (*close) (void *userdata);
+} dc_usb_storage_cbs_t;
+
+/**
+ * Open a custom usb storage device.
+ *
+ * The files of the device are accessed through the callback functions,
+ * for example to read them from a virtual or remote filesystem.
+ *
+ * @param[out]  iostream   A location to store the I/O stream.
+ * @param[in]   context    A valid context object.
+ * @param[in]   callbacks  The callback functions to call.
+ * @param[in]   userdata   User data to pass to the callback functions.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_usb_storage_custom_open (dc_iostream_t **out, dc_context_t *context, const dc_usb_storage_cbs_t *callbacks, void *userdata);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
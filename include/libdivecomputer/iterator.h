@@ -22,6 +22,8 @@
 #ifndef DC_ITERATOR_H
 #define DC_ITERATOR_H
 
+#include <stddef.h>
+
 #include "common.h"
 
 #ifdef __cplusplus
@@ -33,6 +35,18 @@ typedef struct dc_iterator_t dc_iterator_t;
 dc_status_t
 dc_iterator_next (dc_iterator_t *iterator, void *item);
 
+/*
+ * Get up to n items at once. On success, the number of items stored in
+ * the array is at least one, and DC_STATUS_DONE is returned once the
+ * enumeration is finished.
+ *
+ * Unlike the items returned by dc_iterator_next(), the items of a batch
+ * are owned by the iterator, and must not be freed by the application.
+ * They remain valid until the next call, or until the iterator is freed.
+ */
+dc_status_t
+dc_iterator_next_batch (dc_iterator_t *iterator, void *items[], size_t n, size_t *count);
+
 dc_status_t
 dc_iterator_free (dc_iterator_t *iterator);
 
@@ -0,0 +1,446 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+
+#ifndef DC_LIBDIVECOMPUTER_HPP
+#define DC_LIBDIVECOMPUTER_HPP
+
+/*
+ * Optional C++11 wrapper around the C API. The objects own the
+ * underlying handles and release them in their destructor. Errors are
+ * reported with a dc::error exception, carrying the dc_status_t code.
+ *
+ * This header is not used by the library itself, and everything is
+ * defined inline.
+ */
+
+#include <cstddef>
+#include <exception>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "common.h"
+#include "context.h"
+#include "buffer.h"
+#include "descriptor.h"
+#include "iostream.h"
+#include "device.h"
+#include "parser.h"
+
+namespace dc {
+
+class error : public std::runtime_error {
+public:
+	explicit error (dc_status_t status) :
+		std::runtime_error ("libdivecomputer error"), m_status (status) {}
+
+	dc_status_t status () const { return m_status; }
+
+private:
+	dc_status_t m_status;
+};
+
+inline void
+check (dc_status_t status)
+{
+	if (status != DC_STATUS_SUCCESS)
+		throw error (status);
+}
+
+namespace detail {
+
+/*
+ * Move-only owner of a C handle, released with the given function.
+ */
+template <typename T, typename R, R (*Release) (T *)>
+class handle {
+public:
+	handle () : m_ptr (nullptr) {}
+	explicit handle (T *ptr) : m_ptr (ptr) {}
+	handle (handle &&other) : m_ptr (other.release ()) {}
+	~handle () { reset (); }
+
+	handle &operator= (handle &&other)
+	{
+		if (this != &other)
+			reset (other.release ());
+		return *this;
+	}
+
+	handle (const handle &) = delete;
+	handle &operator= (const handle &) = delete;
+
+	T *get () const { return m_ptr; }
+	explicit operator bool () const { return m_ptr != nullptr; }
+
+	T *release ()
+	{
+		T *ptr = m_ptr;
+		m_ptr = nullptr;
+		return ptr;
+	}
+
+	void reset (T *ptr = nullptr)
+	{
+		if (m_ptr)
+			Release (m_ptr);
+		m_ptr = ptr;
+	}
+
+private:
+	T *m_ptr;
+};
+
+} /* namespace detail */
+
+class context : public detail::handle<dc_context_t, dc_status_t, dc_context_free> {
+public:
+	context ()
+	{
+		dc_context_t *ptr = nullptr;
+		check (dc_context_new (&ptr));
+		reset (ptr);
+	}
+
+	void set_loglevel (dc_loglevel_t loglevel)
+	{
+		check (dc_context_set_loglevel (get (), loglevel));
+	}
+};
+
+class buffer : public detail::handle<dc_buffer_t, void, dc_buffer_free> {
+public:
+	explicit buffer (size_t capacity = 0)
+	{
+		dc_buffer_t *ptr = dc_buffer_new (capacity);
+		if (ptr == nullptr)
+			throw error (DC_STATUS_NOMEMORY);
+		reset (ptr);
+	}
+
+	const unsigned char *data () const { return dc_buffer_get_data (get ()); }
+	unsigned char *data () { return dc_buffer_get_data (get ()); }
+	size_t size () const { return dc_buffer_get_size (get ()); }
+
+	void clear () { dc_buffer_clear (get ()); }
+
+	void append (const unsigned char data[], size_t size)
+	{
+		if (!dc_buffer_append (get (), data, size))
+			throw error (DC_STATUS_NOMEMORY);
+	}
+};
+
+class device : public detail::handle<dc_device_t, dc_status_t, dc_device_close> {
+public:
+	/*
+	 * The iostream is not owned by the device, and needs to stay open
+	 * until the device is closed.
+	 */
+	device (context &ctx, dc_descriptor_t *descriptor, dc_iostream_t *iostream)
+	{
+		dc_device_t *ptr = nullptr;
+		check (dc_device_open (&ptr, ctx.get (), descriptor, iostream));
+		reset (ptr);
+	}
+
+	void set_fingerprint (const unsigned char data[], unsigned int size)
+	{
+		check (dc_device_set_fingerprint (get (), data, size));
+	}
+
+	void dump (buffer &buf)
+	{
+		check (dc_device_dump (get (), buf.get ()));
+	}
+
+	/*
+	 * Download the dives. The function is called as
+	 * f (data, size, fingerprint, fpsize) and returns false to stop.
+	 * An exception thrown by the function stops the download, and is
+	 * rethrown here.
+	 */
+	template <typename F>
+	void foreach (F &&f)
+	{
+		state<F> s = {f, nullptr};
+		dc_status_t status = dc_device_foreach (get (), &callback<F>, &s);
+		if (s.exception)
+			std::rethrow_exception (s.exception);
+		check (status);
+	}
+
+private:
+	template <typename F>
+	struct state {
+		F &f;
+		std::exception_ptr exception;
+	};
+
+	template <typename F>
+	static int callback (const unsigned char *data, unsigned int size, const unsigned char *fingerprint, unsigned int fsize, void *userdata)
+	{
+		state<F> *s = static_cast<state<F> *> (userdata);
+		try {
+			return s->f (data, size, fingerprint, fsize) ? 1 : 0;
+		} catch (...) {
+			s->exception = std::current_exception ();
+			return 0;
+		}
+	}
+};
+
+/*
+ * Tag types for the sample visitor. The visitor passed to
+ * parser::samples_foreach provides an overload for each sample type it
+ * wants:
+ *
+ *   v (dc::sample::time, unsigned int seconds)
+ *   v (dc::sample::depth, double meters)
+ *   v (dc::sample::temperature, double celsius)
+ *   v (dc::sample::pressure, unsigned int tank, double bar)
+ *   v (dc::sample::ppo2, double bar)
+ *   v (dc::sample::setpoint, double bar)
+ *   v (dc::sample::cns, double fraction)
+ *   v (dc::sample::rbt, unsigned int minutes)
+ *   v (dc::sample::heartbeat, unsigned int bpm)
+ *   v (dc::sample::bearing, unsigned int degrees)
+ *   v (dc::sample::gasmix, unsigned int index)
+ *   v (dc::sample::deco, unsigned int type, unsigned int time, double depth)
+ *   v (dc::sample::tts, unsigned int seconds)
+ *
+ * Only the columns with an overload are requested from the parser.
+ */
+namespace sample {
+struct time {};
+struct depth {};
+struct temperature {};
+struct pressure {};
+struct ppo2 {};
+struct setpoint {};
+struct cns {};
+struct rbt {};
+struct heartbeat {};
+struct bearing {};
+struct gasmix {};
+struct deco {};
+struct tts {};
+} /* namespace sample */
+
+namespace detail {
+
+template <typename V, typename... Args>
+struct accepts {
+	template <typename U>
+	static auto test (int) -> decltype (std::declval<U &> () (std::declval<Args> ()...), std::true_type ());
+	template <typename U>
+	static std::false_type test (...);
+
+	typedef decltype (test<V> (0)) type;
+	static const bool value = type::value;
+};
+
+template <typename V, typename... Args>
+inline void
+invoke (std::true_type, V &v, Args... args)
+{
+	v (args...);
+}
+
+template <typename V, typename... Args>
+inline void
+invoke (std::false_type, V &, Args...)
+{
+}
+
+/*
+ * A column is only allocated when the visitor asks for it.
+ */
+template <typename T>
+inline T *
+column (std::vector<T> &storage, bool wanted, size_t size)
+{
+	if (!wanted)
+		return nullptr;
+	storage.resize (size);
+	return storage.data ();
+}
+
+} /* namespace detail */
+
+class parser : public detail::handle<dc_parser_t, dc_status_t, dc_parser_destroy> {
+public:
+	explicit parser (device &dev)
+	{
+		dc_parser_t *ptr = nullptr;
+		check (dc_parser_new (&ptr, dev.get ()));
+		reset (ptr);
+	}
+
+	parser (context &ctx, dc_descriptor_t *descriptor, unsigned int devtime = 0, dc_ticks_t systime = 0)
+	{
+		dc_parser_t *ptr = nullptr;
+		check (dc_parser_new2 (&ptr, ctx.get (), descriptor, devtime, systime));
+		reset (ptr);
+	}
+
+	/*
+	 * The data is not copied, and needs to stay valid while the parser
+	 * uses it.
+	 */
+	void set_data (const unsigned char *data, unsigned int size)
+	{
+		check (dc_parser_set_data (get (), data, size));
+	}
+
+	void set_data (const buffer &buf)
+	{
+		set_data (buf.data (), buf.size ());
+	}
+
+	dc_datetime_t datetime ()
+	{
+		dc_datetime_t value;
+		check (dc_parser_get_datetime (get (), &value));
+		return value;
+	}
+
+	template <typename T>
+	T field (dc_field_type_t type, unsigned int flags = 0)
+	{
+		T value;
+		check (dc_parser_get_field (get (), type, flags, &value));
+		return value;
+	}
+
+	/*
+	 * Pass the samples to the visitor, row by row, using the columnar
+	 * batch interface. The overloads are resolved at compile time, so
+	 * the visitor can be inlined completely, and the unused sample types
+	 * cost nothing. The event and vendor samples are not part of the
+	 * batch interface; use dc_parser_samples_foreach for those.
+	 */
+	template <typename V>
+	void samples_foreach (V &&visitor, unsigned int capacity = 1024)
+	{
+		typedef typename std::remove_reference<V>::type visitor_t;
+		typedef typename detail::accepts<visitor_t, sample::time, unsigned int>::type has_time;
+		typedef typename detail::accepts<visitor_t, sample::depth, double>::type has_depth;
+		typedef typename detail::accepts<visitor_t, sample::temperature, double>::type has_temperature;
+		typedef typename detail::accepts<visitor_t, sample::pressure, unsigned int, double>::type has_pressure;
+		typedef typename detail::accepts<visitor_t, sample::ppo2, double>::type has_ppo2;
+		typedef typename detail::accepts<visitor_t, sample::setpoint, double>::type has_setpoint;
+		typedef typename detail::accepts<visitor_t, sample::cns, double>::type has_cns;
+		typedef typename detail::accepts<visitor_t, sample::rbt, unsigned int>::type has_rbt;
+		typedef typename detail::accepts<visitor_t, sample::heartbeat, unsigned int>::type has_heartbeat;
+		typedef typename detail::accepts<visitor_t, sample::bearing, unsigned int>::type has_bearing;
+		typedef typename detail::accepts<visitor_t, sample::gasmix, unsigned int>::type has_gasmix;
+		typedef typename detail::accepts<visitor_t, sample::deco, unsigned int, unsigned int, double>::type has_deco;
+		typedef typename detail::accepts<visitor_t, sample::tts, unsigned int>::type has_tts;
+
+		if (capacity == 0)
+			capacity = 1;
+
+		unsigned int ntanks = 0;
+		if (has_pressure::value &&
+			dc_parser_get_field (get (), DC_FIELD_TANK_COUNT, 0, &ntanks) != DC_STATUS_SUCCESS)
+			ntanks = 0;
+		if (ntanks == 0)
+			ntanks = 1;
+
+		std::vector<unsigned int> mask, time, rbt, heartbeat, bearing, gasmix, deco_type, deco_time, tts;
+		std::vector<double> depth, temperature, pressure, ppo2, setpoint, cns, deco_depth;
+
+		dc_sample_batch_t batch = dc_sample_batch_t ();
+		batch.capacity = capacity;
+		batch.ntanks = has_pressure::value ? ntanks : 0;
+		batch.mask = detail::column (mask, true, capacity);
+		batch.time = detail::column (time, has_time::value, capacity);
+		batch.depth = detail::column (depth, has_depth::value, capacity);
+		batch.temperature = detail::column (temperature, has_temperature::value, capacity);
+		batch.pressure = detail::column (pressure, has_pressure::value, (size_t) ntanks * capacity);
+		batch.ppo2 = detail::column (ppo2, has_ppo2::value, capacity);
+		batch.setpoint = detail::column (setpoint, has_setpoint::value, capacity);
+		batch.cns = detail::column (cns, has_cns::value, capacity);
+		batch.rbt = detail::column (rbt, has_rbt::value, capacity);
+		batch.heartbeat = detail::column (heartbeat, has_heartbeat::value, capacity);
+		batch.bearing = detail::column (bearing, has_bearing::value, capacity);
+		batch.gasmix = detail::column (gasmix, has_gasmix::value, capacity);
+		batch.deco_type = detail::column (deco_type, has_deco::value, capacity);
+		batch.deco_time = detail::column (deco_time, has_deco::value, capacity);
+		batch.deco_depth = detail::column (deco_depth, has_deco::value, capacity);
+		batch.tts = detail::column (tts, has_tts::value, capacity);
+
+		unsigned int offset = 0;
+		for (;;) {
+			check (dc_parser_samples_get_batch (get (), offset, &batch));
+
+			for (unsigned int i = 0; i < batch.count; ++i) {
+				const unsigned int m = batch.mask[i];
+				if (m & (1u << DC_SAMPLE_TIME))
+					detail::invoke (has_time (), visitor, sample::time (), has_time::value ? batch.time[i] : 0u);
+				if (m & (1u << DC_SAMPLE_DEPTH))
+					detail::invoke (has_depth (), visitor, sample::depth (), has_depth::value ? batch.depth[i] : 0.0);
+				if (has_pressure::value && (m & (1u << DC_SAMPLE_PRESSURE))) {
+					for (unsigned int t = 0; t < ntanks; ++t) {
+						double value = batch.pressure[t * capacity + i];
+						if (value != 0.0)
+							detail::invoke (has_pressure (), visitor, sample::pressure (), t, value);
+					}
+				}
+				if (m & (1u << DC_SAMPLE_TEMPERATURE))
+					detail::invoke (has_temperature (), visitor, sample::temperature (), has_temperature::value ? batch.temperature[i] : 0.0);
+				if (m & (1u << DC_SAMPLE_RBT))
+					detail::invoke (has_rbt (), visitor, sample::rbt (), has_rbt::value ? batch.rbt[i] : 0u);
+				if (m & (1u << DC_SAMPLE_HEARTBEAT))
+					detail::invoke (has_heartbeat (), visitor, sample::heartbeat (), has_heartbeat::value ? batch.heartbeat[i] : 0u);
+				if (m & (1u << DC_SAMPLE_BEARING))
+					detail::invoke (has_bearing (), visitor, sample::bearing (), has_bearing::value ? batch.bearing[i] : 0u);
+				if (m & (1u << DC_SAMPLE_SETPOINT))
+					detail::invoke (has_setpoint (), visitor, sample::setpoint (), has_setpoint::value ? batch.setpoint[i] : 0.0);
+				if (m & (1u << DC_SAMPLE_PPO2))
+					detail::invoke (has_ppo2 (), visitor, sample::ppo2 (), has_ppo2::value ? batch.ppo2[i] : 0.0);
+				if (m & (1u << DC_SAMPLE_CNS))
+					detail::invoke (has_cns (), visitor, sample::cns (), has_cns::value ? batch.cns[i] : 0.0);
+				if (m & (1u << DC_SAMPLE_DECO))
+					detail::invoke (has_deco (), visitor, sample::deco (),
+						has_deco::value ? batch.deco_type[i] : 0u,
+						has_deco::value ? batch.deco_time[i] : 0u,
+						has_deco::value ? batch.deco_depth[i] : 0.0);
+				if (m & (1u << DC_SAMPLE_GASMIX))
+					detail::invoke (has_gasmix (), visitor, sample::gasmix (), has_gasmix::value ? batch.gasmix[i] : 0u);
+				if (m & (1u << DC_SAMPLE_TTS))
+					detail::invoke (has_tts (), visitor, sample::tts (), has_tts::value ? batch.tts[i] : 0u);
+			}
+
+			if (batch.count < capacity)
+				break;
+
+			offset += batch.count;
+		}
+	}
+};
+
+} /* namespace dc */
+
+#endif /* DC_LIBDIVECOMPUTER_HPP */
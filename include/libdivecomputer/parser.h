@@ -27,6 +27,7 @@
 #include "descriptor.h"
 #include "device.h"
 #include "datetime.h"
+#include "buffer.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -48,10 +49,12 @@ typedef enum dc_sample_type_t {
 	DC_SAMPLE_DECO,
 	DC_SAMPLE_GASMIX,
 	DC_SAMPLE_TTS,		// time to surface in seconds
+	DC_SAMPLE_LOCATION,
 } dc_sample_type_t;
 
 // Make it easy to test support compile-time with "#ifdef DC_SAMPLE_TTS"
 #define DC_SAMPLE_TTS DC_SAMPLE_TTS
+#define DC_SAMPLE_LOCATION DC_SAMPLE_LOCATION
 
 typedef enum dc_field_type_t {
 	DC_FIELD_DIVETIME,
@@ -68,10 +71,12 @@ typedef enum dc_field_type_t {
 	DC_FIELD_TANK,
 	DC_FIELD_DIVEMODE,
 	DC_FIELD_STRING,
+	DC_FIELD_LOCATION,
 } dc_field_type_t;
 
 // Make it easy to test support compile-time with "#ifdef DC_FIELD_STRING"
 #define DC_FIELD_STRING DC_FIELD_STRING
+#define DC_FIELD_LOCATION DC_FIELD_LOCATION
 
 typedef enum parser_sample_event_t {
 	SAMPLE_EVENT_NONE,
@@ -228,6 +233,21 @@ typedef struct dc_field_string_t {
 	const char *value;
 } dc_field_string_t;
 
+/*
+ * Geographic location
+ *
+ * The latitude and longitude are in degrees (WGS 84), with positive
+ * values for north and east. The altitude is in meters, and zero when
+ * not available. The DC_FIELD_LOCATION field is the location of the
+ * dive site, while the DC_SAMPLE_LOCATION samples contain the position
+ * during the dive, for devices with GPS tracking.
+ */
+typedef struct dc_location_t {
+	double latitude;
+	double longitude;
+	double altitude;
+} dc_location_t;
+
 typedef union dc_sample_value_t {
 	unsigned int time;
 	double depth;
@@ -260,12 +280,109 @@ typedef union dc_sample_value_t {
 		double depth;
 	} deco;
 	unsigned int gasmix; /* Gas mix index */
+	dc_location_t location;
 } dc_sample_value_t;
 
+/*
+ * The data of a DC_SAMPLE_VENDOR sample always points directly into the
+ * buffer registered with dc_parser_set_data, and is never a temporary
+ * copy. It remains valid for as long as that buffer, until the next
+ * call to dc_parser_set_data. Applications which keep the buffer alive
+ * can store the pointer without copying the payload. Test for this
+ * guarantee at compile-time with "#ifdef DC_SAMPLE_VENDOR_BYREF".
+ */
+#define DC_SAMPLE_VENDOR_BYREF 1
+
+/*
+ * Summary of a dive
+ *
+ * The fields member contains a bitmap with the fields that are
+ * available, using (1 << DC_FIELD_xxx) as the bit values, and the
+ * has_datetime member indicates whether the date and time are
+ * available. Members which are not available are set to zero. The
+ * gas mix, tank and string arrays are owned by the parser, and remain
+ * valid until the next call to dc_parser_set_data. The strings follow
+ * the same rules as the DC_FIELD_STRING field.
+ */
+typedef struct dc_parser_summary_t {
+	unsigned int fields;
+	unsigned int has_datetime;
+	dc_datetime_t datetime;
+	unsigned int divetime;
+	double maxdepth;
+	double avgdepth;
+	dc_salinity_t salinity;
+	double atmospheric;
+	double temperature_surface;
+	double temperature_minimum;
+	double temperature_maximum;
+	dc_divemode_t divemode;
+	dc_location_t location;
+	unsigned int ngasmixes;
+	const dc_gasmix_t *gasmixes;
+	unsigned int ntanks;
+	const dc_tank_t *tanks;
+	unsigned int nstrings;
+	const dc_field_string_t *strings;
+} dc_parser_summary_t;
+
 typedef struct dc_parser_t dc_parser_t;
 
 typedef void (*dc_sample_callback_t) (dc_sample_type_t type, dc_sample_value_t value, void *userdata);
 
+/*
+ * Columnar sample batch
+ *
+ * The caller provides the column arrays, each with room for capacity
+ * rows. A row corresponds with one DC_SAMPLE_TIME sample and all the
+ * samples that follow it. Columns that are not needed can be left NULL.
+ * The pressure column holds ntanks sub-columns of capacity rows each,
+ * with the value for tank i and row j stored at pressure[i * capacity + j].
+ * The (optional) mask column contains a bitmap with the sample types
+ * present in each row, using (1 << DC_SAMPLE_xxx) as the bit values.
+ * Values that are not present in a row are set to zero.
+ *
+ * The depth, temperature, pressure, ppo2, setpoint and deco depth are
+ * optionally also available as fixed point integers, in millimeters,
+ * millikelvin and millibar. The columnar reader fills them from the
+ * stored integers, which round-trips exactly and without any floating
+ * point conversion. For a parser, each value is rounded once. The
+ * pressure_mbar column has the same layout as the pressure column.
+ */
+typedef struct dc_sample_batch_t {
+	unsigned int capacity;
+	unsigned int ntanks;
+	unsigned int count;
+	unsigned int *mask;
+	unsigned int *time;
+	double *depth;
+	double *temperature;
+	double *pressure;
+	double *ppo2;
+	double *setpoint;
+	double *cns;
+	unsigned int *rbt;
+	unsigned int *heartbeat;
+	unsigned int *bearing;
+	unsigned int *gasmix;
+	unsigned int *deco_type;
+	unsigned int *deco_time;
+	double *deco_depth;
+	unsigned int *tts;
+	int *depth_mm;
+	int *temperature_mk;
+	int *pressure_mbar;
+	int *ppo2_mbar;
+	int *setpoint_mbar;
+	int *deco_depth_mm;
+} dc_sample_batch_t;
+
+/*
+ * Parsers can be created and used from different threads at the same
+ * time, also when they share the context and descriptor. A single
+ * parser is not synchronized, and should only be used by one thread at
+ * a time.
+ */
 dc_status_t
 dc_parser_new (dc_parser_t **parser, dc_device_t *device);
 
@@ -275,6 +392,12 @@ dc_parser_new2 (dc_parser_t **parser, dc_context_t *context, dc_descriptor_t *de
 dc_family_t
 dc_parser_get_type (dc_parser_t *parser);
 
+/*
+ * Register the dive data. A parser can be reused for several dives
+ * by registering new data. This invalidates everything returned for
+ * the previous dive (e.g. string fields), but the internal memory of
+ * the parser is kept for reuse, instead of being reallocated.
+ */
 dc_status_t
 dc_parser_set_data (dc_parser_t *parser, const unsigned char *data, unsigned int size);
 
@@ -284,12 +407,174 @@ dc_parser_get_datetime (dc_parser_t *parser, dc_datetime_t *datetime);
 dc_status_t
 dc_parser_get_field (dc_parser_t *parser, dc_field_type_t type, unsigned int flags, void *value);
 
+/*
+ * Get the date and time, and all the fields supported by the backend,
+ * in a single call. The summary is only collected the first time, and
+ * the result is cached until the next dc_parser_set_data call. Fields
+ * which the backend doesn't support, or fails to decode, are left out.
+ */
+dc_status_t
+dc_parser_get_summary (dc_parser_t *parser, dc_parser_summary_t *summary);
+
+/*
+ * Limit the samples passed to the callback of dc_parser_samples_foreach
+ * (and dc_parser_samples_get_batch) to the given sample types, using
+ * (1 << DC_SAMPLE_xxx) as the bit values. Some backends skip decoding
+ * the unwanted samples entirely. By default all samples are returned.
+ */
+dc_status_t
+dc_parser_set_sample_mask (dc_parser_t *parser, unsigned int mask);
+
+/*
+ * With the trusted flag, the dive data is known to have been parsed
+ * successfully before, for example when dives are parsed again from an
+ * archive. The backends then skip the consistency checks that only
+ * exist to reject malformed data. The bounds checks are always kept, so
+ * malformed data never results in an access out of bounds, but it may
+ * result in garbage instead of an error. The flags are kept when new
+ * data is registered.
+ */
+typedef enum dc_parser_flags_t {
+	DC_PARSER_FLAG_TRUSTED = (1 << 0),
+} dc_parser_flags_t;
+
+dc_status_t
+dc_parser_set_flags (dc_parser_t *parser, unsigned int flags);
+
+typedef enum dc_decimation_t {
+	DC_DECIMATION_NONE,   /* All rows */
+	DC_DECIMATION_NTH,    /* Every Nth row */
+	DC_DECIMATION_TIME,   /* First row of every N seconds */
+	DC_DECIMATION_MINMAX  /* Shallowest and deepest row of every N seconds */
+} dc_decimation_t;
+
+/*
+ * Downsample the profile passed to the callback of
+ * dc_parser_samples_foreach (and dc_parser_samples_get_batch). A row is
+ * one DC_SAMPLE_TIME sample and all the samples that follow it, and the
+ * rows are either passed or dropped as a whole. With the min/max
+ * method, the rows are held back until the end of each time slot, and
+ * the event and vendor samples are dropped, because they can refer to
+ * memory that is only valid during the callback.
+ */
+dc_status_t
+dc_parser_set_decimation (dc_parser_t *parser, dc_decimation_t type, unsigned int value);
+
 dc_status_t
 dc_parser_samples_foreach (dc_parser_t *parser, dc_sample_callback_t callback, void *userdata);
 
+/*
+ * Pass only the rows with a time between begin and end (inclusive, in
+ * seconds) to the callback. Samples before the first time sample belong
+ * to time zero. After dc_parser_materialize, the rows are located with
+ * an index, which is built once. Otherwise the entire profile is
+ * decoded and filtered.
+ */
+dc_status_t
+dc_parser_samples_range (dc_parser_t *parser, unsigned int begin, unsigned int end, dc_sample_callback_t callback, void *userdata);
+
+/*
+ * Register a longer version of the dive data, for a dive that is still
+ * being recorded, and pass only the samples that were not passed by
+ * the previous calls. The new buffer must start with the data that was
+ * registered before (but may be located at a different address). The
+ * first call after dc_parser_set_data passes all samples. Backends
+ * that support it resume decoding where they stopped, and may hold
+ * back a record until it is complete. The other backends decode the
+ * entire profile again. The decimation setting is not applied.
+ */
+dc_status_t
+dc_parser_append_data (dc_parser_t *parser, const unsigned char *data, unsigned int size, dc_sample_callback_t callback, void *userdata);
+
+/*
+ * Fill the columns of the batch with at most batch->capacity rows,
+ * starting at the sample with the given index. On return, batch->count
+ * contains the number of rows. A count smaller than the capacity
+ * indicates the end of the profile has been reached.
+ */
+dc_status_t
+dc_parser_samples_get_batch (dc_parser_t *parser, unsigned int offset, dc_sample_batch_t *batch);
+
+/*
+ * Decode the samples once into an array owned by the parser. All
+ * subsequent dc_parser_samples_foreach calls replay the samples from
+ * memory, until new data is registered. On success, memsize receives
+ * the size of the array in bytes. Applications that traverse the
+ * samples only once should not call this function.
+ */
+dc_status_t
+dc_parser_materialize (dc_parser_t *parser, size_t *memsize);
+
+/*
+ * Verify the registered dive data. Backends whose dive data carries an
+ * integrity check of its own (for example the crc of a Garmin FIT file)
+ * recompute it, and all the samples are decoded, with the consistency
+ * checks of the backend enabled even for a trusted parser. Corrupt data
+ * is reported with DC_STATUS_DATAFORMAT (or the error of the backend).
+ */
+dc_status_t
+dc_parser_verify (dc_parser_t *parser);
+
 dc_status_t
 dc_parser_destroy (dc_parser_t *parser);
 
+typedef int (*dc_parser_dive_callback_t) (dc_parser_t *parser, const unsigned char *data, unsigned int size, const unsigned char *fingerprint, unsigned int fsize, void *userdata);
+
+/*
+ * Split a memory dump into dives and pass each dive to the callback,
+ * in the order of the dump, with a parser that already has the dive
+ * data registered. The parser is owned by the library and only valid
+ * for the duration of the callback. With more than one thread, the
+ * dives are registered and their samples decoded on worker threads.
+ * Return zero from the callback to stop. Only the backends with a
+ * memory dump download support this function.
+ */
+dc_status_t
+dc_parser_foreach_dive_in_dump (dc_context_t *context, dc_descriptor_t *descriptor, dc_buffer_t *dump, unsigned int nthreads, dc_parser_dive_callback_t callback, void *userdata);
+
+/*
+ * Batch of dives
+ *
+ * Parse a list of dives of the same model on a pool of worker threads,
+ * and pass them to the callback in the order they were added, with a
+ * parser that already has the dive data registered. The parser is
+ * owned by the batch and only valid for the duration of the callback.
+ * Each worker has its own parsers, which are re-used for all dives and
+ * runs. The callback is always called from the calling thread.
+ *
+ * The flags select the work done on the worker threads in advance,
+ * besides registering the data. Without worker threads, everything is
+ * done on demand by the callback.
+ */
+typedef struct dc_parser_batch_t dc_parser_batch_t;
+
+typedef enum dc_parser_batch_flags_t {
+	DC_PARSER_BATCH_SUMMARY = (1 << 0), /* dc_parser_get_summary */
+	DC_PARSER_BATCH_SAMPLES = (1 << 1), /* dc_parser_materialize */
+	DC_PARSER_BATCH_TRUSTED = (1 << 2), /* DC_PARSER_FLAG_TRUSTED */
+} dc_parser_batch_flags_t;
+
+dc_status_t
+dc_parser_batch_new (dc_parser_batch_t **batch, dc_context_t *context, dc_descriptor_t *descriptor, unsigned int nthreads, unsigned int flags);
+
+/*
+ * Add a dive to the batch. The data is not copied, and needs to remain
+ * valid until the batch has been run.
+ */
+dc_status_t
+dc_parser_batch_add (dc_parser_batch_t *batch, const unsigned char data[], unsigned int size, const unsigned char fingerprint[], unsigned int fsize);
+
+/*
+ * Parse all dives added since the previous run. Dives which fail to
+ * register are skipped. Return zero from the callback to stop. The
+ * list of dives is empty again afterwards.
+ */
+dc_status_t
+dc_parser_batch_run (dc_parser_batch_t *batch, dc_parser_dive_callback_t callback, void *userdata);
+
+dc_status_t
+dc_parser_batch_free (dc_parser_batch_t *batch);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -0,0 +1,76 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_REMOTE_H
+#define DC_REMOTE_H
+
+#include "common.h"
+#include "context.h"
+#include "iostream.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/**
+ * Open a connection to a remote I/O stream.
+ *
+ * The remote I/O stream is provided by a server, which forwards all
+ * operations to a local I/O stream (see #dc_remote_serve). The reported
+ * transport type is the one of the I/O stream on the server.
+ *
+ * To avoid a network round trip for every operation, the writes and the
+ * configuration calls are queued, and sent together with the next
+ * operation that needs an answer from the server, like a read. Settings
+ * which don't change the current value are dropped. As a consequence, an
+ * error of a queued operation is reported by the next operation that
+ * waits for the server. The server also returns the data that is already
+ * available after a read, such that small consecutive reads are answered
+ * locally.
+ *
+ * @param[out]  iostream  A location to store the remote I/O stream.
+ * @param[in]   context   A valid context object.
+ * @param[in]   hostname  The host name or numeric address of the server.
+ * @param[in]   port      The TCP port number of the server.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_remote_open (dc_iostream_t **iostream, dc_context_t *context, const char *hostname, unsigned int port);
+
+/**
+ * Serve a single remote client.
+ *
+ * All operations received over the connection are executed on the local
+ * I/O stream, until the client closes the connection.
+ *
+ * @param[in]   connection  A valid connection to the client.
+ * @param[in]   iostream    A valid I/O stream to forward the operations to.
+ * @returns #DC_STATUS_SUCCESS when the client closed the connection, or
+ * another #dc_status_t code on failure.
+ */
+dc_status_t
+dc_remote_serve (dc_iostream_t *connection, dc_iostream_t *iostream);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_REMOTE_H */
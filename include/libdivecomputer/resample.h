@@ -0,0 +1,78 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_RESAMPLE_H
+#define DC_RESAMPLE_H
+
+#include "common.h"
+#include "parser.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * Profile resampling
+ *
+ * Convert a columnar batch with an irregular sample interval into a
+ * batch on a uniform time grid, for comparing or merging the profiles
+ * of several dive computers on the same dive. The input batch should
+ * contain the entire profile, because the first and last rows of a
+ * partial batch can't be interpolated with the rows outside of it.
+ */
+
+/*
+ * Resample the rows of the input batch at the times begin, begin +
+ * interval, begin + 2 * interval, ... (in seconds), up to the last row of
+ * the input or the capacity of the output. The output provides the
+ * column arrays, like for dc_parser_samples_get_batch, and only the
+ * columns present in both batches are filled. The pressures are
+ * resampled for the tanks present in both batches.
+ *
+ * The depth, temperature, pressure, ppo2 and cns columns (and their
+ * fixed point variants) are interpolated linearly. The other columns,
+ * such as the setpoint and the deco stop, change in steps, and hold the
+ * value of the last row at or before the grid time. With a mask column
+ * in the input, each column only uses the rows where the sample is
+ * present, and a grid time outside the range of those rows leaves the
+ * value missing. The mask column of the output, if any, reports the
+ * values that are present.
+ */
+dc_status_t
+dc_resample_batch (const dc_sample_batch_t *input, unsigned int begin, unsigned int interval, dc_sample_batch_t *output);
+
+/*
+ * Estimate the time offset between two series sampled on the same
+ * uniform grid, typically the depth columns of two resampled batches,
+ * with an FFT based cross-correlation. The lag is the number of grid
+ * intervals the second series needs to be delayed to line up with the
+ * first one, so that a[i] corresponds with b[i - lag]. Only lags up to
+ * maxlag in either direction are considered, or all of them if maxlag
+ * is zero. The optional score is the normalized correlation at the
+ * lag, between zero and one for non-negative series such as depths.
+ */
+dc_status_t
+dc_resample_align (const double a[], unsigned int na, const double b[], unsigned int nb, unsigned int maxlag, int *lag, double *score);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_RESAMPLE_H */
@@ -0,0 +1,67 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_SCAN_H
+#define DC_SCAN_H
+
+#include "common.h"
+#include "context.h"
+#include "descriptor.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * Callback for the devices found by dc_scan_all(). The device is an
+ * object of the transport (e.g. a dc_serial_device_t for the serial
+ * transport), and is owned by the callback, which needs to free it
+ * with the matching function. Return zero to stop the scan.
+ */
+typedef int (*dc_scan_callback_t) (dc_transport_t transport, void *device, void *userdata);
+
+/*
+ * Scan for supported devices on several transports at the same time.
+ *
+ * The transports parameter is a bitmask of transports to scan. Only the
+ * serial, usbhid, irda and bluetooth transports are supported, and the
+ * transports which are not available on the platform are skipped. The
+ * flags are passed to dc_bluetooth_iterator_new2().
+ *
+ * Each transport is scanned on a thread of its own, and the devices are
+ * reported as soon as they are found, so a slow bluetooth inquiry no
+ * longer delays the other transports. The callback may be called from
+ * any of the threads, but never concurrently. Without thread support,
+ * the transports are scanned one after the other.
+ *
+ * After the timeout (in milliseconds, or zero for no timeout), no more
+ * devices are reported, and DC_STATUS_TIMEOUT is returned. A transport
+ * which is busy enumerating a device can't be interrupted, so the
+ * function only returns once all transports finished their current
+ * step.
+ */
+dc_status_t
+dc_scan_all (dc_context_t *context, dc_descriptor_t *descriptor, unsigned int transports, unsigned int flags, unsigned int timeout, dc_scan_callback_t callback, void *userdata);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_SCAN_H */
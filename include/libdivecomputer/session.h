@@ -0,0 +1,106 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_SESSION_H
+#define DC_SESSION_H
+
+#include "common.h"
+#include "context.h"
+#include "descriptor.h"
+#include "iostream.h"
+#include "device.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * A session downloads the dives of several devices in parallel, on a
+ * bounded pool of worker threads which share a single context.
+ *
+ * Each job opens its device on an already opened I/O stream, downloads
+ * the dives and closes the device again. The I/O stream remains owned
+ * by the caller. The callbacks of a job receive the userdata of that
+ * job, and are always called from the worker thread running the job.
+ * The callbacks of different jobs can run concurrently.
+ */
+typedef struct dc_session_t dc_session_t;
+
+typedef struct dc_session_job_t {
+	dc_descriptor_t *descriptor;
+	dc_iostream_t *iostream;
+	const unsigned char *fingerprint;
+	unsigned int fsize;
+	unsigned int events;
+	dc_event_callback_t event_callback;
+	dc_dive_callback_t dive_callback;
+	void *userdata;
+} dc_session_job_t;
+
+/*
+ * Create a new session, running at most nthreads jobs at the same
+ * time. A value of zero runs all jobs at the same time. Without thread
+ * support, the jobs are run one after the other.
+ */
+dc_status_t
+dc_session_new (dc_session_t **session, dc_context_t *context, unsigned int nthreads);
+
+/*
+ * Add a job to the session. The job is copied, but the descriptor, I/O
+ * stream and fingerprint need to remain valid until the session has
+ * been run. The index of the job is returned in the id parameter.
+ */
+dc_status_t
+dc_session_add (dc_session_t *session, const dc_session_job_t *job, unsigned int *id);
+
+/*
+ * Run all jobs, and wait until they are finished. The result of the
+ * individual jobs is available with dc_session_get_status().
+ */
+dc_status_t
+dc_session_run (dc_session_t *session);
+
+/*
+ * Cancel all jobs. Running downloads are aborted, and jobs which didn't
+ * start yet fail with DC_STATUS_CANCELLED. Safe to call from any thread,
+ * including the callbacks.
+ */
+dc_status_t
+dc_session_cancel (dc_session_t *session);
+
+dc_status_t
+dc_session_get_status (dc_session_t *session, unsigned int id, dc_status_t *status);
+
+/*
+ * Get the aggregate progress of all jobs. Every job counts equally,
+ * regardless of the units of its own progress events. Safe to call from
+ * any thread while the session is running.
+ */
+dc_status_t
+dc_session_get_progress (dc_session_t *session, dc_event_progress_t *progress);
+
+dc_status_t
+dc_session_free (dc_session_t *session);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_SESSION_H */
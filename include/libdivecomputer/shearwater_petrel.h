@@ -0,0 +1,60 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_SHEARWATER_PETREL_H
+#define DC_SHEARWATER_PETREL_H
+
+#include "common.h"
+#include "device.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * Set the maximum number of block requests which are sent ahead of the
+ * responses during a download. The default of one waits for every block
+ * before requesting the next one. Larger values hide the latency of slow
+ * links (e.g. BLE), but require firmware that queues the requests.
+ */
+dc_status_t
+shearwater_petrel_device_set_window (dc_device_t *device, unsigned int window);
+
+/*
+ * Dive selection callback. Called with the dive number and the start
+ * time of the dive, as stored in the manifest. Return zero to skip the
+ * dive.
+ */
+typedef int (*shearwater_petrel_filter_t) (unsigned int number, dc_ticks_t timestamp, void *userdata);
+
+/*
+ * Select the dives to download (e.g. by date range, or dive number).
+ * The filter is applied to the manifest, before any dive is
+ * downloaded, and only the selected dives are transferred. Pass NULL to
+ * download all dives.
+ */
+dc_status_t
+shearwater_petrel_device_set_filter (dc_device_t *device, shearwater_petrel_filter_t filter, void *userdata);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_SHEARWATER_PETREL_H */
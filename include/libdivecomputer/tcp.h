@@ -0,0 +1,96 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_TCP_H
+#define DC_TCP_H
+
+#include "common.h"
+#include "context.h"
+#include "iostream.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/**
+ * Open a TCP connection.
+ *
+ * The connection is intended for a serial port which is made available
+ * over the network, for example by a remote cradle or a serial device
+ * server in raw mode. It's reported as a serial transport, such that it
+ * can be used with all serial backends. The serial line settings are
+ * ignored, and need to be configured on the remote side.
+ *
+ * The Nagle algorithm is disabled, because the protocols exchange many
+ * small request and response packets.
+ *
+ * @param[out]  iostream  A location to store the TCP connection.
+ * @param[in]   context   A valid context object.
+ * @param[in]   hostname  The host name or numeric address.
+ * @param[in]   port      The TCP port number.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_tcp_open (dc_iostream_t **iostream, dc_context_t *context, const char *hostname, unsigned int port);
+
+/**
+ * Wait for an incoming TCP connection.
+ *
+ * A listening socket is created on all local addresses, and closed again
+ * once the first client is connected. The Nagle algorithm is disabled.
+ *
+ * @param[out]  iostream  A location to store the TCP connection.
+ * @param[in]   context   A valid context object.
+ * @param[in]   port      The TCP port number to listen on.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_tcp_accept (dc_iostream_t **iostream, dc_context_t *context, unsigned int port);
+
+/**
+ * Enable or disable the Nagle algorithm (TCP_NODELAY).
+ *
+ * @param[in]   iostream  A valid TCP connection.
+ * @param[in]   value     Non-zero to send small packets immediately.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_tcp_set_nodelay (dc_iostream_t *iostream, unsigned int value);
+
+/**
+ * Set the size of the kernel socket buffers (SO_RCVBUF and SO_SNDBUF).
+ *
+ * @param[in]   iostream  A valid TCP connection.
+ * @param[in]   input     The receive buffer size, or zero to keep the default.
+ * @param[in]   output    The send buffer size, or zero to keep the default.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_tcp_set_bufsize (dc_iostream_t *iostream, unsigned int input, unsigned int output);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_TCP_H */
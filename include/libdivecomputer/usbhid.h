@@ -34,6 +34,10 @@ extern "C" {
 
 /**
  * Opaque object representing a USB HID device.
+ *
+ * Several USB HID connections can be open, and used from different
+ * threads, at the same time. The underlying USB library session is
+ * reference counted and shared between them in a thread-safe way.
  */
 typedef struct dc_usbhid_device_t dc_usbhid_device_t;
 
@@ -1,6 +1,6 @@
 /*
 
-This is an implementation of the AES128 algorithm, specifically ECB and CBC mode.
+This is an implementation of the AES128 algorithm, specifically ECB, CBC and CFB mode.
 
 The implementation is verified against the test vectors in:
   National Institute of Standards and Technology Special Publication 800-38A 2001 ED
@@ -587,3 +587,46 @@ void AES128_CBC_decrypt_buffer(uint8_t* output, uint8_t* input, uint32_t length,
 #endif // #if defined(CBC) && CBC
 
 
+
+
+#if defined(CFB) && CFB
+
+
+// Decrypt a buffer in CFB-128 mode. The key is expanded only once for all
+// blocks. The output may point to the same buffer as the input, and the
+// length doesn't need to be a multiple of the block size.
+void AES128_CFB_decrypt_buffer(uint8_t* output, uint8_t* input, uint32_t length, const uint8_t* key, const uint8_t* iv)
+{
+  uint32_t i, j, n;
+  uint8_t keystream[KEYLEN];
+  uint8_t previous[KEYLEN];
+  aes_state_t state;
+
+  state.Key = key;
+  KeyExpansion(&state);
+
+  memcpy(previous, iv, KEYLEN);
+
+  for(i = 0; i < length; i += KEYLEN)
+  {
+    n = length - i < KEYLEN ? length - i : KEYLEN;
+
+    // The keystream is the encryption of the previous cipher block.
+    BlockCopy(keystream, previous);
+    state.state = (state_t*)keystream;
+    Cipher(&state);
+
+    if(n == KEYLEN)
+    {
+      BlockCopy(previous, input + i);
+    }
+
+    for(j = 0; j < n; ++j)
+    {
+      output[i + j] = input[i + j] ^ keystream[j];
+    }
+  }
+}
+
+
+#endif // #if defined(CFB) && CFB
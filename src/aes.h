@@ -23,6 +23,10 @@ typedef unsigned int  uint32_t;
   #define ECB 1
 #endif
 
+#ifndef CFB
+  #define CFB 1
+#endif
+
 
 
 #if defined(ECB) && ECB
@@ -41,5 +45,12 @@ void AES128_CBC_decrypt_buffer(uint8_t* output, uint8_t* input, uint32_t length,
 #endif // #if defined(CBC) && CBC
 
 
+#if defined(CFB) && CFB
+
+void AES128_CFB_decrypt_buffer(uint8_t* output, uint8_t* input, uint32_t length, const uint8_t* key, const uint8_t* iv);
+
+#endif // #if defined(CFB) && CFB
+
+
 
 #endif //_AES_H_
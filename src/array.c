@@ -20,42 +20,132 @@
  */
 
 #include <string.h>
+#include <stdint.h>
 
 #include "array.h"
 
+static uint64_t
+array_bswap64 (uint64_t x)
+{
+#if defined(__GNUC__)
+	return __builtin_bswap64 (x);
+#else
+	x = ((x & 0x00FF00FF00FF00FFULL) << 8)  | ((x >> 8)  & 0x00FF00FF00FF00FFULL);
+	x = ((x & 0x0000FFFF0000FFFFULL) << 16) | ((x >> 16) & 0x0000FFFF0000FFFFULL);
+	return (x << 32) | (x >> 32);
+#endif
+}
+
 void
 array_reverse_bytes (unsigned char data[], unsigned int size)
 {
-	for (unsigned int i = 0; i < size / 2; ++i) {
-		unsigned char hlp = data[i];
-		data[i] = data[size - 1 - i];
-		data[size - 1 - i] = hlp;
+	unsigned int head = 0, tail = size;
+
+	// Swap and byteswap a word from both ends at once, as long as
+	// the two words don't overlap.
+	while (tail - head >= 2 * sizeof (uint64_t)) {
+		uint64_t a, b;
+		tail -= sizeof (uint64_t);
+		memcpy (&a, data + head, sizeof (a));
+		memcpy (&b, data + tail, sizeof (b));
+		a = array_bswap64 (a);
+		b = array_bswap64 (b);
+		memcpy (data + head, &b, sizeof (b));
+		memcpy (data + tail, &a, sizeof (a));
+		head += sizeof (uint64_t);
+	}
+
+	// Reverse the remaining bytes in the middle.
+	while (tail - head >= 2) {
+		tail--;
+		unsigned char hlp = data[head];
+		data[head] = data[tail];
+		data[tail] = hlp;
+		head++;
 	}
 }
 
 
+static const unsigned char g_reverse_bits[256] = {
+	0x00, 0x80, 0x40, 0xC0, 0x20, 0xA0, 0x60, 0xE0, 0x10, 0x90, 0x50, 0xD0, 0x30, 0xB0, 0x70, 0xF0,
+	0x08, 0x88, 0x48, 0xC8, 0x28, 0xA8, 0x68, 0xE8, 0x18, 0x98, 0x58, 0xD8, 0x38, 0xB8, 0x78, 0xF8,
+	0x04, 0x84, 0x44, 0xC4, 0x24, 0xA4, 0x64, 0xE4, 0x14, 0x94, 0x54, 0xD4, 0x34, 0xB4, 0x74, 0xF4,
+	0x0C, 0x8C, 0x4C, 0xCC, 0x2C, 0xAC, 0x6C, 0xEC, 0x1C, 0x9C, 0x5C, 0xDC, 0x3C, 0xBC, 0x7C, 0xFC,
+	0x02, 0x82, 0x42, 0xC2, 0x22, 0xA2, 0x62, 0xE2, 0x12, 0x92, 0x52, 0xD2, 0x32, 0xB2, 0x72, 0xF2,
+	0x0A, 0x8A, 0x4A, 0xCA, 0x2A, 0xAA, 0x6A, 0xEA, 0x1A, 0x9A, 0x5A, 0xDA, 0x3A, 0xBA, 0x7A, 0xFA,
+	0x06, 0x86, 0x46, 0xC6, 0x26, 0xA6, 0x66, 0xE6, 0x16, 0x96, 0x56, 0xD6, 0x36, 0xB6, 0x76, 0xF6,
+	0x0E, 0x8E, 0x4E, 0xCE, 0x2E, 0xAE, 0x6E, 0xEE, 0x1E, 0x9E, 0x5E, 0xDE, 0x3E, 0xBE, 0x7E, 0xFE,
+	0x01, 0x81, 0x41, 0xC1, 0x21, 0xA1, 0x61, 0xE1, 0x11, 0x91, 0x51, 0xD1, 0x31, 0xB1, 0x71, 0xF1,
+	0x09, 0x89, 0x49, 0xC9, 0x29, 0xA9, 0x69, 0xE9, 0x19, 0x99, 0x59, 0xD9, 0x39, 0xB9, 0x79, 0xF9,
+	0x05, 0x85, 0x45, 0xC5, 0x25, 0xA5, 0x65, 0xE5, 0x15, 0x95, 0x55, 0xD5, 0x35, 0xB5, 0x75, 0xF5,
+	0x0D, 0x8D, 0x4D, 0xCD, 0x2D, 0xAD, 0x6D, 0xED, 0x1D, 0x9D, 0x5D, 0xDD, 0x3D, 0xBD, 0x7D, 0xFD,
+	0x03, 0x83, 0x43, 0xC3, 0x23, 0xA3, 0x63, 0xE3, 0x13, 0x93, 0x53, 0xD3, 0x33, 0xB3, 0x73, 0xF3,
+	0x0B, 0x8B, 0x4B, 0xCB, 0x2B, 0xAB, 0x6B, 0xEB, 0x1B, 0x9B, 0x5B, 0xDB, 0x3B, 0xBB, 0x7B, 0xFB,
+	0x07, 0x87, 0x47, 0xC7, 0x27, 0xA7, 0x67, 0xE7, 0x17, 0x97, 0x57, 0xD7, 0x37, 0xB7, 0x77, 0xF7,
+	0x0F, 0x8F, 0x4F, 0xCF, 0x2F, 0xAF, 0x6F, 0xEF, 0x1F, 0x9F, 0x5F, 0xDF, 0x3F, 0xBF, 0x7F, 0xFF
+};
+
 void
 array_reverse_bits (unsigned char data[], unsigned int size)
 {
 	for (unsigned int i = 0; i < size; ++i) {
-		unsigned char j = 0;
-		j  = (data[i] & 0x01) << 7;
-		j += (data[i] & 0x02) << 5;
-		j += (data[i] & 0x04) << 3;
-		j += (data[i] & 0x08) << 1;
-		j += (data[i] & 0x10) >> 1;
-		j += (data[i] & 0x20) >> 3;
-		j += (data[i] & 0x40) >> 5;
-		j += (data[i] & 0x80) >> 7;
-		data[i] = j;
+		data[i] = g_reverse_bits[data[i]];
+	}
+}
+
+
+unsigned char
+array_reverse_bits_xor (unsigned char data[], unsigned int size, unsigned char init)
+{
+	unsigned char crc = init;
+	for (unsigned int i = 0; i < size; ++i) {
+		data[i] = g_reverse_bits[data[i]];
+		crc ^= data[i];
 	}
+	return crc;
+}
+
+
+/*
+ * Word-at-a-time helpers. A word is loaded with memcpy to avoid alignment
+ * and aliasing issues, and compared against a pattern containing the same
+ * byte value in every position.
+ */
+
+typedef size_t array_word_t;
+
+#define ARRAY_WORD_SIZE sizeof (array_word_t)
+#define ARRAY_WORD_ONES ((array_word_t) -1 / 0xFF)
+#define ARRAY_WORD_HIGH (ARRAY_WORD_ONES * 0x80)
+
+static array_word_t
+array_word_load (const unsigned char data[])
+{
+	array_word_t word;
+	memcpy (&word, data, sizeof (word));
+	return word;
 }
 
+static int
+array_word_hasbyte (array_word_t word, array_word_t pattern)
+{
+	array_word_t x = word ^ pattern;
+	return ((x - ARRAY_WORD_ONES) & ~x & ARRAY_WORD_HIGH) != 0;
+}
 
 int
 array_isequal (const unsigned char data[], unsigned int size, unsigned char value)
 {
-	for (unsigned int i = 0; i < size; ++i) {
+	const array_word_t pattern = ARRAY_WORD_ONES * value;
+
+	unsigned int i = 0;
+	while (i + ARRAY_WORD_SIZE <= size) {
+		if (array_word_load (data + i) != pattern)
+			return 0;
+		i += ARRAY_WORD_SIZE;
+	}
+
+	for (; i < size; ++i) {
 		if (data[i] != value)
 			return 0;
 	}
@@ -68,11 +158,19 @@ const unsigned char *
 array_search_forward (const unsigned char *data, unsigned int size,
                       const unsigned char *marker, unsigned int msize)
 {
+	if (msize == 0)
+		return data;
+
+	// Use memchr to locate candidates for the first byte of the marker,
+	// and only verify the remaining bytes at those positions.
 	while (size >= msize) {
-		if (memcmp (data, marker, msize) == 0)
-			return data;
-		size--;
-		data++;
+		const unsigned char *p = (const unsigned char *) memchr (data, marker[0], size - msize + 1);
+		if (p == NULL)
+			break;
+		if (memcmp (p + 1, marker + 1, msize - 1) == 0)
+			return p;
+		size -= p - data + 1;
+		data = p + 1;
 	}
 	return NULL;
 }
@@ -82,41 +180,137 @@ const unsigned char *
 array_search_backward (const unsigned char *data, unsigned int size,
                        const unsigned char *marker, unsigned int msize)
 {
-	data += size;
+	if (msize == 0)
+		return data + size;
+
+	const unsigned char last = marker[msize - 1];
+	const array_word_t pattern = ARRAY_WORD_ONES * last;
+
+	// The variable 'size' is the offset of the end of the candidate match,
+	// thus the byte at offset 'size - 1' needs to match the last byte of
+	// the marker. Entire words without that byte are skipped.
 	while (size >= msize) {
-		if (memcmp (data - msize, marker, msize) == 0)
-			return data;
+		if (size >= msize - 1 + ARRAY_WORD_SIZE &&
+			!array_word_hasbyte (array_word_load (data + size - ARRAY_WORD_SIZE), pattern)) {
+			size -= ARRAY_WORD_SIZE;
+			continue;
+		}
+
+		if (data[size - 1] == last &&
+			memcmp (data + size - msize, marker, msize - 1) == 0)
+			return data + size;
 		size--;
-		data--;
 	}
 	return NULL;
 }
 
 
+const unsigned char *
+array_search_forward_multi (const unsigned char *data, unsigned int size,
+                            const unsigned char *const markers[], const unsigned int msizes[],
+                            unsigned int count, unsigned int *index)
+{
+	unsigned char first[256] = {0};
+	unsigned int minsize = 0;
+
+	if (count == 0)
+		return NULL;
+
+	// Build a lookup table with the first byte of every marker, such that
+	// most positions can be rejected with a single lookup.
+	for (unsigned int i = 0; i < count; ++i) {
+		if (msizes[i] == 0) {
+			if (index)
+				*index = i;
+			return data;
+		}
+		first[markers[i][0]] = 1;
+		if (minsize == 0 || msizes[i] < minsize)
+			minsize = msizes[i];
+	}
+
+	for (unsigned int offset = 0; offset + minsize <= size; ++offset) {
+		if (!first[data[offset]])
+			continue;
+
+		for (unsigned int i = 0; i < count; ++i) {
+			if (msizes[i] <= size - offset &&
+				markers[i][0] == data[offset] &&
+				memcmp (data + offset, markers[i], msizes[i]) == 0) {
+				if (index)
+					*index = i;
+				return data + offset;
+			}
+		}
+	}
+
+	return NULL;
+}
+
+
+/*
+ * Lookup table with the two hexadecimal digits of each byte value.
+ */
+static const char g_bin2hex[2 * 256 + 1] =
+	"000102030405060708090A0B0C0D0E0F"
+	"101112131415161718191A1B1C1D1E1F"
+	"202122232425262728292A2B2C2D2E2F"
+	"303132333435363738393A3B3C3D3E3F"
+	"404142434445464748494A4B4C4D4E4F"
+	"505152535455565758595A5B5C5D5E5F"
+	"606162636465666768696A6B6C6D6E6F"
+	"707172737475767778797A7B7C7D7E7F"
+	"808182838485868788898A8B8C8D8E8F"
+	"909192939495969798999A9B9C9D9E9F"
+	"A0A1A2A3A4A5A6A7A8A9AAABACADAEAF"
+	"B0B1B2B3B4B5B6B7B8B9BABBBCBDBEBF"
+	"C0C1C2C3C4C5C6C7C8C9CACBCCCDCECF"
+	"D0D1D2D3D4D5D6D7D8D9DADBDCDDDEDF"
+	"E0E1E2E3E4E5E6E7E8E9EAEBECEDEEEF"
+	"F0F1F2F3F4F5F6F7F8F9FAFBFCFDFEFF";
+
 int
 array_convert_bin2hex (const unsigned char input[], unsigned int isize, unsigned char output[], unsigned int osize)
 {
 	if (osize != 2 * isize)
 		return -1;
 
-	const unsigned char ascii[] = {
-		'0', '1', '2', '3', '4', '5', '6', '7',
-		'8', '9', 'A', 'B', 'C', 'D', 'E', 'F'};
-
 	for (unsigned int i = 0; i < isize; ++i) {
-		// Set the most-significant nibble.
-		unsigned char msn = (input[i] >> 4) & 0x0F;
-		output[i * 2 + 0] = ascii[msn];
-
-		// Set the least-significant nibble.
-		unsigned char lsn = input[i] & 0x0F;
-		output[i * 2 + 1] = ascii[lsn];
+		const char *digits = g_bin2hex + 2 * input[i];
+		output[i * 2 + 0] = digits[0];
+		output[i * 2 + 1] = digits[1];
 	}
 
 	return 0;
 }
 
 
+/*
+ * Lookup table with the value of each hexadecimal digit. All other
+ * characters have the high bit set, such that an invalid character can
+ * be detected once for a whole byte, instead of testing each digit.
+ */
+static const unsigned char g_hex2bin[256] = {
+#define XX 0x80
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+	 0,  1,  2,  3,  4,  5,  6,  7,  8,  9, XX, XX, XX, XX, XX, XX,
+	XX, 10, 11, 12, 13, 14, 15, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+	XX, 10, 11, 12, 13, 14, 15, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+#undef XX
+};
+
 int
 array_convert_hex2bin (const unsigned char input[], unsigned int isize, unsigned char output[], unsigned int osize)
 {
@@ -124,25 +318,59 @@ array_convert_hex2bin (const unsigned char input[], unsigned int isize, unsigned
 		return -1;
 
 	for (unsigned int i = 0; i < osize; ++i) {
-		unsigned char value = 0;
-		for (unsigned int j = 0; j < 2; ++j) {
-			unsigned char number = 0;
-			unsigned char ascii = input[i * 2 + j];
-			if (ascii >= '0' && ascii <= '9')
-				number = ascii - '0';
-			else if (ascii >= 'A' && ascii <= 'F')
-				number = 10 + ascii - 'A';
-			else if (ascii >= 'a' && ascii <= 'f')
-				number = 10 + ascii - 'a';
-			else
-				return -1; /* Invalid character */
-
-			value <<= 4;
-			value += number;
-		}
-		output[i] = value;
+		unsigned char msn = g_hex2bin[input[i * 2 + 0]];
+		unsigned char lsn = g_hex2bin[input[i * 2 + 1]];
+		if ((msn | lsn) & 0x80)
+			return -1; /* Invalid character */
+
+		output[i] = (msn << 4) | lsn;
+	}
+
+	return 0;
+}
+
+int
+array_convert_bin2hex_sum (const unsigned char input[], unsigned int isize, unsigned char output[], unsigned int osize, unsigned char *checksum)
+{
+	if (osize != 2 * isize)
+		return -1;
+
+	unsigned int sum = *checksum;
+	for (unsigned int i = 0; i < isize; ++i) {
+		const char *digits = g_bin2hex + 2 * input[i];
+		output[i * 2 + 0] = digits[0];
+		output[i * 2 + 1] = digits[1];
+		sum += (unsigned char) digits[0] + (unsigned char) digits[1];
+	}
+
+	*checksum = sum & 0xFF;
+
+	return 0;
+}
+
+int
+array_convert_hex2bin_sum (const unsigned char input[], unsigned int isize, unsigned char output[], unsigned int osize, unsigned char *checksum)
+{
+	if (isize != 2 * osize)
+		return -1;
+
+	unsigned int sum = *checksum;
+	for (unsigned int i = 0; i < osize; ++i) {
+		unsigned char msd = input[i * 2 + 0];
+		unsigned char lsd = input[i * 2 + 1];
+		unsigned char msn = g_hex2bin[msd];
+		unsigned char lsn = g_hex2bin[lsd];
+		if ((msn | lsn) & 0x80)
+			return -1; /* Invalid character */
+
+		// Both digits are read before the output byte is written, which
+		// is never past the current input position.
+		output[i] = (msn << 4) | lsn;
+		sum += msd + lsd;
 	}
 
+	*checksum = sum & 0xFF;
+
 	return 0;
 }
 
@@ -184,87 +412,6 @@ array_uint_le (const unsigned char data[], unsigned int n)
 	return value;
 }
 
-unsigned int
-array_uint32_be (const unsigned char data[])
-{
-	return ((unsigned int) data[0] << 24) |
-	       ((unsigned int) data[1] << 16) |
-	       ((unsigned int) data[2] <<  8) |
-	       ((unsigned int) data[3] <<  0);
-}
-
-
-unsigned int
-array_uint32_le (const unsigned char data[])
-{
-	return ((unsigned int) data[0] <<  0) |
-	       ((unsigned int) data[1] <<  8) |
-	       ((unsigned int) data[2] << 16) |
-	       ((unsigned int) data[3] << 24);
-}
-
-
-unsigned int
-array_uint32_word_be (const unsigned char data[])
-{
-	return ((unsigned int) data[0] <<  8) |
-	       ((unsigned int) data[1] <<  0) |
-	       ((unsigned int) data[2] << 24) |
-	       ((unsigned int) data[3] << 16);
-}
-
-
-void
-array_uint32_le_set (unsigned char data[], const unsigned int input)
-{
-	data[0] = input & 0xFF;
-	data[1] = (input >>  8) & 0xFF;
-	data[2] = (input >> 16) & 0xFF;
-	data[3] = (input >> 24) & 0xFF;
-}
-
-
-unsigned int
-array_uint24_be (const unsigned char data[])
-{
-	return ((unsigned int) data[0] << 16) |
-	       ((unsigned int) data[1] <<  8) |
-	       ((unsigned int) data[2] <<  0);
-}
-
-
-void
-array_uint24_be_set (unsigned char data[], const unsigned int input)
-{
-	data[0] = (input >> 16) & 0xFF;
-	data[1] = (input >>  8) & 0xFF;
-	data[2] = input & 0xFF;
-}
-
-
-unsigned int
-array_uint24_le (const unsigned char data[])
-{
-	return ((unsigned int) data[0] <<  0) |
-	       ((unsigned int) data[1] <<  8) |
-	       ((unsigned int) data[2] << 16);
-}
-
-unsigned short
-array_uint16_be (const unsigned char data[])
-{
-	return ((unsigned int) data[0] <<  8) |
-	       ((unsigned int) data[1] <<  0);
-}
-
-
-unsigned short
-array_uint16_le (const unsigned char data[])
-{
-	return ((unsigned int) data[0] <<  0) |
-	       ((unsigned int) data[1] <<  8);
-}
-
 unsigned char
 bcd2dec (unsigned char value)
 {
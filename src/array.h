@@ -22,16 +22,72 @@
 #ifndef ARRAY_H
 #define ARRAY_H
 
+#include <string.h>
+#include <stdint.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif /* __cplusplus */
 
+#ifdef _MSC_VER
+#define ARRAY_INLINE static __inline
+#else
+#define ARRAY_INLINE static inline
+#endif
+
+/*
+ * With a known byte order, the fixed size integers are read with a
+ * single (unaligned) load and a byteswap where needed. Otherwise they
+ * are assembled from the individual bytes.
+ */
+#if defined(__GNUC__) && defined(__BYTE_ORDER__)
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define ARRAY_LE16(x) (x)
+#define ARRAY_LE32(x) (x)
+#define ARRAY_BE16(x) __builtin_bswap16 (x)
+#define ARRAY_BE32(x) __builtin_bswap32 (x)
+#define ARRAY_NATIVE_LOADS
+#elif __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define ARRAY_LE16(x) __builtin_bswap16 (x)
+#define ARRAY_LE32(x) __builtin_bswap32 (x)
+#define ARRAY_BE16(x) (x)
+#define ARRAY_BE32(x) (x)
+#define ARRAY_NATIVE_LOADS
+#endif
+#endif
+
+#ifdef ARRAY_NATIVE_LOADS
+ARRAY_INLINE uint16_t
+array_load16 (const unsigned char data[])
+{
+	uint16_t value;
+	memcpy (&value, data, sizeof (value));
+	return value;
+}
+
+ARRAY_INLINE uint32_t
+array_load32 (const unsigned char data[])
+{
+	uint32_t value;
+	memcpy (&value, data, sizeof (value));
+	return value;
+}
+#endif
+
 void
 array_reverse_bytes (unsigned char data[], unsigned int size);
 
 void
 array_reverse_bits (unsigned char data[], unsigned int size);
 
+/*
+ * Reverse the bits of every byte, and return the xor of the reversed
+ * bytes and the initial value. This verifies a xor checksum in the same
+ * pass over the data.
+ */
+unsigned char
+array_reverse_bits_xor (unsigned char data[], unsigned int size, unsigned char init);
+
 int
 array_isequal (const unsigned char data[], unsigned int size, unsigned char value);
 
@@ -43,12 +99,34 @@ const unsigned char *
 array_search_backward (const unsigned char *data, unsigned int size,
                        const unsigned char *marker, unsigned int msize);
 
+/*
+ * Search for the first occurrence of any of the markers. On success, a
+ * pointer to the start of the match is returned, and the index of the
+ * matching marker is stored in the optional index parameter. If several
+ * markers match at the same position, the first one in the list wins.
+ */
+const unsigned char *
+array_search_forward_multi (const unsigned char *data, unsigned int size,
+                            const unsigned char *const markers[], const unsigned int msizes[],
+                            unsigned int count, unsigned int *index);
+
 int
 array_convert_bin2hex (const unsigned char input[], unsigned int isize, unsigned char output[], unsigned int osize);
 
 int
 array_convert_hex2bin (const unsigned char input[], unsigned int isize, unsigned char output[], unsigned int osize);
 
+/*
+ * Same as the conversion functions above, but the additive checksum of
+ * the hexadecimal characters is updated in the same pass. The output of
+ * the hex2bin conversion may overlap with the start of the input.
+ */
+int
+array_convert_bin2hex_sum (const unsigned char input[], unsigned int isize, unsigned char output[], unsigned int osize, unsigned char *checksum);
+
+int
+array_convert_hex2bin_sum (const unsigned char input[], unsigned int isize, unsigned char output[], unsigned int osize, unsigned char *checksum);
+
 unsigned int
 array_convert_str2num (const unsigned char data[], unsigned int size);
 
@@ -58,32 +136,95 @@ array_uint_be (const unsigned char data[], unsigned int n);
 unsigned int
 array_uint_le (const unsigned char data[], unsigned int n);
 
-unsigned int
-array_uint32_be (const unsigned char data[]);
+ARRAY_INLINE unsigned int
+array_uint32_be (const unsigned char data[])
+{
+#ifdef ARRAY_NATIVE_LOADS
+	return ARRAY_BE32 (array_load32 (data));
+#else
+	return ((unsigned int) data[0] << 24) |
+	       ((unsigned int) data[1] << 16) |
+	       ((unsigned int) data[2] <<  8) |
+	       ((unsigned int) data[3] <<  0);
+#endif
+}
 
-unsigned int
-array_uint32_le (const unsigned char data[]);
+ARRAY_INLINE unsigned int
+array_uint32_le (const unsigned char data[])
+{
+#ifdef ARRAY_NATIVE_LOADS
+	return ARRAY_LE32 (array_load32 (data));
+#else
+	return ((unsigned int) data[0] <<  0) |
+	       ((unsigned int) data[1] <<  8) |
+	       ((unsigned int) data[2] << 16) |
+	       ((unsigned int) data[3] << 24);
+#endif
+}
 
-unsigned int
-array_uint32_word_be (const unsigned char data[]);
+ARRAY_INLINE unsigned int
+array_uint32_word_be (const unsigned char data[])
+{
+	return ((unsigned int) data[0] <<  8) |
+	       ((unsigned int) data[1] <<  0) |
+	       ((unsigned int) data[2] << 24) |
+	       ((unsigned int) data[3] << 16);
+}
 
-void
-array_uint32_le_set (unsigned char data[], const unsigned int input);
+ARRAY_INLINE void
+array_uint32_le_set (unsigned char data[], const unsigned int input)
+{
+	data[0] = input & 0xFF;
+	data[1] = (input >>  8) & 0xFF;
+	data[2] = (input >> 16) & 0xFF;
+	data[3] = (input >> 24) & 0xFF;
+}
 
-unsigned int
-array_uint24_be (const unsigned char data[]);
+ARRAY_INLINE unsigned int
+array_uint24_be (const unsigned char data[])
+{
+	return ((unsigned int) data[0] << 16) |
+	       ((unsigned int) data[1] <<  8) |
+	       ((unsigned int) data[2] <<  0);
+}
 
-void
-array_uint24_be_set (unsigned char data[], const unsigned int input);
+ARRAY_INLINE void
+array_uint24_be_set (unsigned char data[], const unsigned int input)
+{
+	data[0] = (input >> 16) & 0xFF;
+	data[1] = (input >>  8) & 0xFF;
+	data[2] = input & 0xFF;
+}
 
-unsigned int
-array_uint24_le (const unsigned char data[]);
+ARRAY_INLINE unsigned int
+array_uint24_le (const unsigned char data[])
+{
+	return ((unsigned int) data[0] <<  0) |
+	       ((unsigned int) data[1] <<  8) |
+	       ((unsigned int) data[2] << 16);
+}
 
-unsigned short
-array_uint16_be (const unsigned char data[]);
+ARRAY_INLINE unsigned short
+array_uint16_be (const unsigned char data[])
+{
+#ifdef ARRAY_NATIVE_LOADS
+	return ARRAY_BE16 (array_load16 (data));
+#else
+	return ((unsigned int) data[0] <<  8) |
+	       ((unsigned int) data[1] <<  0);
+#endif
+}
 
-unsigned short
-array_uint16_le (const unsigned char data[]);
+ARRAY_INLINE unsigned short
+array_uint16_le (const unsigned char data[])
+{
+#ifdef ARRAY_NATIVE_LOADS
+	return ARRAY_LE16 (array_load16 (data));
+#else
+	return ((unsigned int) data[0] <<  0) |
+	       ((unsigned int) data[1] <<  8);
+#endif
+}
 
 unsigned char
 bcd2dec (unsigned char value);
@@ -36,6 +36,7 @@
 #include "atomics_cobalt.h"
 #include "context-private.h"
 #include "device-private.h"
+#include "usbhid-private.h"
 #include "checksum.h"
 #include "array.h"
 
@@ -56,9 +57,16 @@
 #define SZ_MEMORY2 (41 * 64 * 1024) // Cobalt 2
 #define SZ_VERSION 14
 
+#define NTRANSFERS 4
+#define SZ_TRANSFER (64 * 1024)
+
 typedef struct atomics_cobalt_device_t {
 	dc_device_t base;
 #ifdef HAVE_LIBUSB
+#ifdef USBHID_LIBUSB
+	dc_usbhid_session_t *session;
+	dc_timer_t *timer;
+#endif
 	libusb_context *context;
 	libusb_device_handle *handle;
 #endif
@@ -104,17 +112,42 @@ atomics_cobalt_device_open (dc_device_t **out, dc_context_t *context)
 	}
 
 	// Set the default values.
+#ifdef USBHID_LIBUSB
+	device->session = NULL;
+	device->timer = NULL;
+#endif
 	device->context = NULL;
 	device->handle = NULL;
 	device->simulation = 0;
 	memset (device->fingerprint, 0, sizeof (device->fingerprint));
 
-	int rc = libusb_init (&device->context);
+	int rc = 0;
+#ifdef USBHID_LIBUSB
+	// Share the libusb session of the usbhid transport, such that the
+	// asynchronous transfers are handled by its event thread.
+	status = dc_usbhid_session_new (&device->session, context);
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR (context, "Failed to initialize usb support.");
+		goto error_free;
+	}
+
+	dc_usbhid_session_start (device->session, context);
+
+	device->context = dc_usbhid_session_get_handle (device->session);
+
+	status = dc_timer_new (&device->timer);
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR (context, "Failed to create a high resolution timer.");
+		goto error_usb_exit;
+	}
+#else
+	rc = libusb_init (&device->context);
 	if (rc < 0) {
 		ERROR (context, "Failed to initialize usb support.");
 		status = DC_STATUS_IO;
 		goto error_free;
 	}
+#endif
 
 	device->handle = libusb_open_device_with_vid_pid (device->context, VID, PID);
 	if (device->handle == NULL) {
@@ -143,7 +176,12 @@ atomics_cobalt_device_open (dc_device_t **out, dc_context_t *context)
 error_usb_close:
 	libusb_close (device->handle);
 error_usb_exit:
+#ifdef USBHID_LIBUSB
+	dc_timer_free (device->timer);
+	dc_usbhid_session_unref (device->session);
+#else
 	libusb_exit (device->context);
+#endif
 error_free:
 	dc_device_deallocate ((dc_device_t *) device);
 	return status;
@@ -161,7 +199,12 @@ atomics_cobalt_device_close (dc_device_t *abstract)
 #ifdef HAVE_LIBUSB
 	libusb_release_interface(device->handle, 0);
 	libusb_close (device->handle);
+#ifdef USBHID_LIBUSB
+	dc_timer_free (device->timer);
+	dc_usbhid_session_unref (device->session);
+#else
 	libusb_exit (device->context);
+#endif
 #endif
 
 	return DC_STATUS_SUCCESS;
@@ -252,6 +295,142 @@ atomics_cobalt_device_version (dc_device_t *abstract, unsigned char data[], unsi
 }
 
 
+#ifdef USBHID_LIBUSB
+/*
+ * Receive the data phase with a queue of asynchronous bulk transfers.
+ * While the oldest transfer is being processed, the next ones are
+ * already pending, such that the device never has to wait for the next
+ * request. The data ends with a short transfer, or a timeout.
+ */
+static dc_status_t
+atomics_cobalt_device_receive (atomics_cobalt_device_t *device, dc_buffer_t *buffer, unsigned int *nbytes, dc_event_progress_t *progress)
+{
+	dc_device_t *abstract = (dc_device_t *) device;
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_usbhid_report_t reports[NTRANSFERS];
+	unsigned int count = 0;
+	int rc = LIBUSB_SUCCESS;
+
+	// Allocate and submit all transfers.
+	for (unsigned int i = 0; i < NTRANSFERS; ++i) {
+		reports[i].session = device->session;
+		reports[i].transfer = libusb_alloc_transfer (0);
+		reports[i].submitted = 0;
+		reports[i].completed = 0;
+
+		unsigned char *data = (unsigned char *) malloc (SZ_TRANSFER);
+		if (reports[i].transfer == NULL || data == NULL) {
+			ERROR (abstract->context, "Failed to allocate memory.");
+			libusb_free_transfer (reports[i].transfer);
+			free (data);
+			status = DC_STATUS_NOMEMORY;
+			goto error;
+		}
+
+		libusb_fill_bulk_transfer (reports[i].transfer, device->handle, 0x82,
+			data, SZ_TRANSFER, dc_usbhid_transfer_callback, reports + i, 0);
+		count++;
+
+		rc = dc_usbhid_transfer_submit (reports + i);
+		if (rc != LIBUSB_SUCCESS) {
+			ERROR (abstract->context, "Failed to submit the transfer (%s).",
+				libusb_error_name (rc));
+			status = EXITCODE(rc);
+			goto error;
+		}
+	}
+
+	unsigned int head = 0;
+	while (1) {
+		dc_usbhid_report_t *report = reports + head;
+		struct libusb_transfer *transfer = report->transfer;
+
+		// Wait for the oldest transfer. When the device stops sending
+		// data, the transfer is cancelled to retrieve the partial data.
+		rc = dc_usbhid_transfer_wait (report, device->timer, TIMEOUT);
+		if (rc == LIBUSB_ERROR_TIMEOUT) {
+			libusb_cancel_transfer (transfer);
+			rc = dc_usbhid_transfer_wait (report, device->timer, TIMEOUT);
+		}
+		if (rc != LIBUSB_SUCCESS) {
+			ERROR (abstract->context, "Failed to receive the answer.");
+			status = EXITCODE(rc);
+			goto error;
+		}
+
+		if (transfer->status != LIBUSB_TRANSFER_COMPLETED &&
+			transfer->status != LIBUSB_TRANSFER_TIMED_OUT &&
+			transfer->status != LIBUSB_TRANSFER_CANCELLED) {
+			ERROR (abstract->context, "Failed to receive the answer.");
+			status = DC_STATUS_IO;
+			goto error;
+		}
+
+		unsigned int length = transfer->actual_length;
+
+		HEXDUMP (abstract->context, DC_LOGLEVEL_INFO, "Read", transfer->buffer, length);
+
+		// Update and emit a progress event.
+		if (progress) {
+			progress->current += length;
+			device_event_emit (abstract, DC_EVENT_PROGRESS, progress);
+		}
+
+		// Append the packet to the output buffer.
+		dc_buffer_append (buffer, transfer->buffer, length);
+		*nbytes += length;
+
+		// If we received fewer bytes than requested, the transfer is finished.
+		if (transfer->status != LIBUSB_TRANSFER_COMPLETED || length < SZ_TRANSFER)
+			break;
+
+		if (device_is_cancelled (abstract)) {
+			status = DC_STATUS_CANCELLED;
+			goto error;
+		}
+
+		// Queue the transfer again, behind the pending ones.
+		rc = dc_usbhid_transfer_submit (report);
+		if (rc != LIBUSB_SUCCESS) {
+			ERROR (abstract->context, "Failed to submit the transfer (%s).",
+				libusb_error_name (rc));
+			status = EXITCODE(rc);
+			goto error;
+		}
+
+		head = (head + 1) % NTRANSFERS;
+	}
+
+error:
+	// Cancel the transfers which are still pending.
+	for (unsigned int i = 0; i < count; ++i) {
+		if (reports[i].submitted) {
+			libusb_cancel_transfer (reports[i].transfer);
+		}
+	}
+
+	// Wait until the cancellation has been processed, because the
+	// transfers can't be freed while they are still in flight.
+	for (unsigned int i = 0; i < count; ++i) {
+		if (reports[i].submitted) {
+			dc_usbhid_transfer_wait (reports + i, device->timer, TIMEOUT);
+		}
+	}
+
+	for (unsigned int i = 0; i < count; ++i) {
+		// Transfers that are still in flight are leaked on purpose,
+		// because freeing them would result in a use after free.
+		if (reports[i].submitted)
+			continue;
+
+		free (reports[i].transfer->buffer);
+		libusb_free_transfer (reports[i].transfer);
+	}
+
+	return status;
+}
+#endif
+
 static dc_status_t
 atomics_cobalt_read_dive (dc_device_t *abstract, dc_buffer_t *buffer, int init, dc_event_progress_t *progress)
 {
@@ -284,6 +463,11 @@ atomics_cobalt_read_dive (dc_device_t *abstract, dc_buffer_t *buffer, int init,
 	HEXDUMP (abstract->context, DC_LOGLEVEL_INFO, "Write", &bRequest, 1);
 
 	unsigned int nbytes = 0;
+#ifdef USBHID_LIBUSB
+	dc_status_t status = atomics_cobalt_device_receive (device, buffer, &nbytes, progress);
+	if (status != DC_STATUS_SUCCESS)
+		return status;
+#else
 	while (1) {
 		// Receive the answer from the dive computer.
 		int length = 0;
@@ -311,6 +495,7 @@ atomics_cobalt_read_dive (dc_device_t *abstract, dc_buffer_t *buffer, int init,
 		if (length < sizeof (packet))
 			break;
 	}
+#endif
 
 	// Check for a buffer error.
 	if (dc_buffer_get_size (buffer) != nbytes) {
@@ -332,8 +517,10 @@ atomics_cobalt_read_dive (dc_device_t *abstract, dc_buffer_t *buffer, int init,
 	}
 
 	// Verify the checksum of the packet.
+	dc_phase_t phase = device_profile_phase (abstract, DC_PHASE_CHECKSUM);
 	unsigned short crc = array_uint16_le (data + nbytes - 2);
 	unsigned short ccrc = checksum_add_uint16 (data, nbytes - 2, 0x0);
+	device_profile_phase (abstract, phase);
 	if (crc != ccrc) {
 		ERROR (abstract->context, "Unexpected answer checksum.");
 		return DC_STATUS_PROTOCOL;
@@ -385,6 +572,8 @@ atomics_cobalt_device_foreach (dc_device_t *abstract, dc_dive_callback_t callbac
 	if (buffer == NULL)
 		return DC_STATUS_NOMEMORY;
 
+	device_profile_phase (abstract, DC_PHASE_PROFILE);
+
 	unsigned int ndives = 0;
 	dc_status_t rc = DC_STATUS_SUCCESS;
 	while ((rc = atomics_cobalt_read_dive (abstract, buffer, (ndives == 0), &progress)) == DC_STATUS_SUCCESS) {
@@ -19,6 +19,8 @@
  * MA 02110-1301 USA
  */
 
+#define LOG_SUBSYSTEM DC_LOGSUBSYSTEM_PARSER
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
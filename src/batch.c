@@ -0,0 +1,327 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#define USE_THREADS
+#endif
+
+#include <libdivecomputer/parser.h>
+
+#include "context-private.h"
+
+#define MAXTHREADS 8
+
+typedef struct batch_dive_t {
+	const unsigned char *data;
+	unsigned int size;
+	const unsigned char *fingerprint;
+	unsigned int fsize;
+} batch_dive_t;
+
+typedef struct batch_slot_t {
+	dc_parser_t *parser;
+	dc_status_t status;
+	unsigned int ready;
+} batch_slot_t;
+
+struct dc_parser_batch_t {
+	dc_context_t *context;
+	unsigned int nthreads;
+	unsigned int flags;
+	dc_buffer_t *dives;
+	// One parser per job slot, re-used for all the dives in that slot.
+	batch_slot_t slots[2 * MAXTHREADS];
+	size_t nslots;
+};
+
+static void
+batch_prepare (batch_slot_t *slot, const batch_dive_t *dive, unsigned int flags)
+{
+	slot->status = dc_parser_set_data (slot->parser, dive->data, dive->size);
+	if (slot->status != DC_STATUS_SUCCESS)
+		return;
+
+	// A failure is not fatal here. The error is reported again when the
+	// callback asks for the same data.
+	if (flags & DC_PARSER_BATCH_SUMMARY) {
+		dc_parser_summary_t summary;
+		dc_parser_get_summary (slot->parser, &summary);
+	}
+
+	if (flags & DC_PARSER_BATCH_SAMPLES) {
+		dc_parser_materialize (slot->parser, NULL);
+	}
+}
+
+#ifdef USE_THREADS
+/*
+ * The dives are registered and decoded by a pool of worker threads,
+ * while the calling thread passes them to the callback in the original
+ * order. The workers never get more than the number of slots ahead of
+ * the calling thread.
+ */
+typedef struct batch_pool_t {
+	const batch_dive_t *dives;
+	size_t ndives;
+	batch_slot_t *slots;
+	size_t nslots;
+	unsigned int flags;
+	size_t next, consumed;
+	unsigned int abort;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+} batch_pool_t;
+
+static void *
+batch_worker (void *arg)
+{
+	batch_pool_t *pool = (batch_pool_t *) arg;
+
+	while (1) {
+		pthread_mutex_lock (&pool->lock);
+		while (!pool->abort && pool->next < pool->ndives &&
+			pool->next >= pool->consumed + pool->nslots)
+			pthread_cond_wait (&pool->cond, &pool->lock);
+		if (pool->abort || pool->next >= pool->ndives) {
+			pthread_mutex_unlock (&pool->lock);
+			break;
+		}
+		size_t i = pool->next++;
+		pthread_mutex_unlock (&pool->lock);
+
+		batch_slot_t *slot = pool->slots + i % pool->nslots;
+		batch_prepare (slot, pool->dives + i, pool->flags);
+
+		pthread_mutex_lock (&pool->lock);
+		slot->ready = 1;
+		pthread_cond_broadcast (&pool->cond);
+		pthread_mutex_unlock (&pool->lock);
+	}
+
+	return NULL;
+}
+#endif
+
+dc_status_t
+dc_parser_batch_new (dc_parser_batch_t **out, dc_context_t *context, dc_descriptor_t *descriptor, unsigned int nthreads, unsigned int flags)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_parser_batch_t *batch = NULL;
+
+	if (out == NULL || descriptor == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	batch = (dc_parser_batch_t *) dc_malloc (context, sizeof (dc_parser_batch_t));
+	if (batch == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	memset (batch, 0, sizeof (dc_parser_batch_t));
+	batch->context = context;
+	batch->flags = flags;
+
+	if (nthreads > MAXTHREADS)
+		nthreads = MAXTHREADS;
+#ifdef USE_THREADS
+	if (nthreads < 2)
+		nthreads = 0;
+#else
+	nthreads = 0;
+#endif
+	batch->nthreads = nthreads;
+
+	batch->dives = dc_buffer_new (0);
+	if (batch->dives == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		status = DC_STATUS_NOMEMORY;
+		goto error_free;
+	}
+
+	size_t count = nthreads ? 2 * nthreads : 1;
+	for (batch->nslots = 0; batch->nslots < count; ++batch->nslots) {
+		batch_slot_t *slot = batch->slots + batch->nslots;
+		slot->status = DC_STATUS_SUCCESS;
+		slot->ready = 0;
+		status = dc_parser_new2 (&slot->parser, context, descriptor, 0, 0);
+		if (status != DC_STATUS_SUCCESS) {
+			ERROR (context, "Failed to create the parser.");
+			goto error_free;
+		}
+
+		if (flags & DC_PARSER_BATCH_TRUSTED)
+			dc_parser_set_flags (slot->parser, DC_PARSER_FLAG_TRUSTED);
+	}
+
+	*out = batch;
+
+	return DC_STATUS_SUCCESS;
+
+error_free:
+	dc_parser_batch_free (batch);
+	return status;
+}
+
+dc_status_t
+dc_parser_batch_add (dc_parser_batch_t *batch, const unsigned char data[], unsigned int size, const unsigned char fingerprint[], unsigned int fsize)
+{
+	if (batch == NULL || (data == NULL && size) || (fingerprint == NULL && fsize))
+		return DC_STATUS_INVALIDARGS;
+
+	batch_dive_t dive = {data, size, fingerprint, fsize};
+	if (!dc_buffer_append (batch->dives, (const unsigned char *) &dive, sizeof (dive))) {
+		ERROR (batch->context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_parser_batch_run (dc_parser_batch_t *batch, dc_parser_dive_callback_t callback, void *userdata)
+{
+	if (batch == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	const batch_dive_t *dives = (const batch_dive_t *) dc_buffer_get_data (batch->dives);
+	size_t ndives = dc_buffer_get_size (batch->dives) / sizeof (batch_dive_t);
+	if (ndives == 0)
+		return DC_STATUS_SUCCESS;
+
+	// There is no point in starting more threads than dives.
+	unsigned int nthreads = batch->nthreads;
+	if (nthreads > ndives)
+		nthreads = ndives;
+	if (nthreads < 2)
+		nthreads = 0;
+
+	size_t nslots = nthreads ? batch->nslots : 1;
+	for (size_t i = 0; i < nslots; ++i)
+		batch->slots[i].ready = 0;
+
+#ifdef USE_THREADS
+	pthread_t threads[MAXTHREADS];
+	unsigned int nstarted = 0;
+	batch_pool_t pool;
+	if (nthreads) {
+		pool.dives = dives;
+		pool.ndives = ndives;
+		pool.slots = batch->slots;
+		pool.nslots = nslots;
+		pool.flags = batch->flags;
+		pool.next = 0;
+		pool.consumed = 0;
+		pool.abort = 0;
+		pthread_mutex_init (&pool.lock, NULL);
+		pthread_cond_init (&pool.cond, NULL);
+
+		for (nstarted = 0; nstarted < nthreads; ++nstarted) {
+			if (pthread_create (&threads[nstarted], NULL, batch_worker, &pool) != 0)
+				break;
+		}
+
+		if (nstarted == 0) {
+			// Fall back to the calling thread.
+			WARNING (batch->context, "Failed to start the worker threads.");
+			pthread_cond_destroy (&pool.cond);
+			pthread_mutex_destroy (&pool.lock);
+			nthreads = 0;
+			nslots = 1;
+		}
+	}
+#endif
+
+	for (size_t i = 0; i < ndives; ++i) {
+		batch_slot_t *slot = batch->slots + i % nslots;
+
+#ifdef USE_THREADS
+		if (nthreads) {
+			pthread_mutex_lock (&pool.lock);
+			while (!slot->ready)
+				pthread_cond_wait (&pool.cond, &pool.lock);
+			pthread_mutex_unlock (&pool.lock);
+		} else
+#endif
+		batch_prepare (slot, dives + i, 0);
+
+		int proceed = 1;
+		if (slot->status != DC_STATUS_SUCCESS) {
+			WARNING (batch->context, "Skipping dive %u (%d).", (unsigned int) i, slot->status);
+		} else if (callback) {
+			proceed = callback (slot->parser, dives[i].data, dives[i].size, dives[i].fingerprint, dives[i].fsize, userdata);
+		}
+
+#ifdef USE_THREADS
+		if (nthreads) {
+			// Hand the job slot back to the workers.
+			pthread_mutex_lock (&pool.lock);
+			slot->ready = 0;
+			pool.consumed++;
+			if (!proceed)
+				pool.abort = 1;
+			pthread_cond_broadcast (&pool.cond);
+			pthread_mutex_unlock (&pool.lock);
+		}
+#endif
+
+		if (!proceed)
+			break;
+	}
+
+#ifdef USE_THREADS
+	if (nthreads) {
+		pthread_mutex_lock (&pool.lock);
+		pool.abort = 1;
+		pthread_cond_broadcast (&pool.cond);
+		pthread_mutex_unlock (&pool.lock);
+		for (unsigned int i = 0; i < nstarted; ++i)
+			pthread_join (threads[i], NULL);
+		pthread_cond_destroy (&pool.cond);
+		pthread_mutex_destroy (&pool.lock);
+	}
+#endif
+
+	dc_buffer_clear (batch->dives);
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_parser_batch_free (dc_parser_batch_t *batch)
+{
+	if (batch == NULL)
+		return DC_STATUS_SUCCESS;
+
+	for (size_t i = 0; i < batch->nslots; ++i)
+		dc_parser_destroy (batch->slots[i].parser);
+	dc_buffer_free (batch->dives);
+	dc_free (batch->context, batch);
+
+	return DC_STATUS_SUCCESS;
+}
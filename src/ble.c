@@ -0,0 +1,357 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#define LOG_SUBSYSTEM DC_LOGSUBSYSTEM_IOSTREAM
+
+#include <stdlib.h> // malloc, free
+
+#include <libdivecomputer/ble.h>
+
+#include "iostream-private.h"
+#include "common-private.h"
+#include "context-private.h"
+
+#define ISINSTANCE(device) dc_iostream_isinstance((device), &dc_ble_vtable)
+
+// Room for the ATT opcode and handle in each packet.
+#define ATT_OVERHEAD 3
+
+static dc_status_t dc_ble_set_timeout (dc_iostream_t *abstract, int timeout);
+static dc_status_t dc_ble_get_available (dc_iostream_t *abstract, size_t *value);
+static dc_status_t dc_ble_read (dc_iostream_t *abstract, void *data, size_t size, size_t *actual);
+static dc_status_t dc_ble_write (dc_iostream_t *abstract, const void *data, size_t size, size_t *actual);
+static dc_status_t dc_ble_purge (dc_iostream_t *abstract, dc_direction_t direction);
+static dc_status_t dc_ble_sleep (dc_iostream_t *abstract, unsigned int milliseconds);
+static dc_status_t dc_ble_close (dc_iostream_t *abstract);
+static const char *dc_ble_get_name (dc_iostream_t *abstract);
+
+typedef struct dc_ble_t {
+	/* Base class. */
+	dc_iostream_t base;
+	/* Internal state. */
+	dc_ble_cbs_t callbacks;
+	void *userdata;
+	unsigned int mtu;
+	dc_ble_write_t type;
+} dc_ble_t;
+
+static const dc_iostream_vtable_t dc_ble_vtable = {
+	sizeof(dc_ble_t),
+	dc_ble_set_timeout, /* set_timeout */
+	NULL, /* set_latency */
+	NULL, /* set_break */
+	NULL, /* set_dtr */
+	NULL, /* set_rts */
+	NULL, /* get_lines */
+	dc_ble_get_available, /* get_available */
+	NULL, /* configure */
+	dc_ble_read, /* read */
+	dc_ble_write, /* write */
+	NULL, /* flush */
+	dc_ble_purge, /* purge */
+	dc_ble_sleep, /* sleep */
+	dc_ble_close, /* close */
+	dc_ble_get_name, /* get_name */
+};
+
+dc_status_t
+dc_ble_open (dc_iostream_t **out, dc_context_t *context, const dc_ble_cbs_t *callbacks, void *userdata)
+{
+	dc_ble_t *ble = NULL;
+
+	if (out == NULL || callbacks == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	INFO (context, "Open: ble");
+
+	// Allocate memory.
+	ble = (dc_ble_t *) dc_iostream_allocate (context, &dc_ble_vtable, DC_TRANSPORT_BLE);
+	if (ble == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	ble->callbacks = *callbacks;
+	ble->userdata = userdata;
+	ble->mtu = 0;
+	ble->type = DC_BLE_WRITE_WITH_RESPONSE;
+
+	*out = (dc_iostream_t *) ble;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_ble_get_mtu (dc_iostream_t *abstract, unsigned int *mtu)
+{
+	dc_ble_t *ble = (dc_ble_t *) abstract;
+
+	if (!ISINSTANCE (abstract))
+		return DC_STATUS_UNSUPPORTED;
+
+	if (mtu == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	if (ble->mtu == 0) {
+		if (ble->callbacks.get_mtu == NULL)
+			return DC_STATUS_UNSUPPORTED;
+
+		unsigned int value = 0;
+		dc_status_t status = ble->callbacks.get_mtu (ble->userdata, &value);
+		if (status != DC_STATUS_SUCCESS)
+			return status;
+
+		if (value < DC_BLE_MTU_DEFAULT || value > DC_BLE_MTU_MAX) {
+			ERROR (abstract->context, "Invalid MTU (%u).", value);
+			return DC_STATUS_PROTOCOL;
+		}
+
+		ble->mtu = value;
+	}
+
+	*mtu = ble->mtu;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_ble_request_mtu (dc_iostream_t *abstract, unsigned int mtu)
+{
+	dc_ble_t *ble = (dc_ble_t *) abstract;
+
+	if (!ISINSTANCE (abstract))
+		return DC_STATUS_UNSUPPORTED;
+
+	if (mtu < DC_BLE_MTU_DEFAULT || mtu > DC_BLE_MTU_MAX)
+		return DC_STATUS_INVALIDARGS;
+
+	if (ble->callbacks.request_mtu == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	INFO (abstract->context, "MTU: value=%u", mtu);
+
+	// The negotiated value is queried again when needed.
+	ble->mtu = 0;
+
+	return ble->callbacks.request_mtu (ble->userdata, mtu);
+}
+
+dc_status_t
+dc_ble_set_interval (dc_iostream_t *abstract, unsigned int minimum, unsigned int maximum)
+{
+	dc_ble_t *ble = (dc_ble_t *) abstract;
+
+	if (!ISINSTANCE (abstract))
+		return DC_STATUS_UNSUPPORTED;
+
+	if (minimum > maximum)
+		return DC_STATUS_INVALIDARGS;
+
+	if (ble->callbacks.set_interval == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	INFO (abstract->context, "Interval: minimum=%u, maximum=%u", minimum, maximum);
+
+	return ble->callbacks.set_interval (ble->userdata, minimum, maximum);
+}
+
+dc_status_t
+dc_ble_set_phy (dc_iostream_t *abstract, unsigned int phy)
+{
+	dc_ble_t *ble = (dc_ble_t *) abstract;
+
+	if (!ISINSTANCE (abstract))
+		return DC_STATUS_UNSUPPORTED;
+
+	if (phy == 0 || (phy & ~(DC_BLE_PHY_1M | DC_BLE_PHY_2M | DC_BLE_PHY_CODED)))
+		return DC_STATUS_INVALIDARGS;
+
+	if (ble->callbacks.set_phy == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	INFO (abstract->context, "PHY: value=0x%02x", phy);
+
+	return ble->callbacks.set_phy (ble->userdata, phy);
+}
+
+dc_status_t
+dc_ble_set_write_type (dc_iostream_t *abstract, dc_ble_write_t type)
+{
+	dc_ble_t *ble = (dc_ble_t *) abstract;
+
+	if (!ISINSTANCE (abstract))
+		return DC_STATUS_UNSUPPORTED;
+
+	if (type != DC_BLE_WRITE_WITH_RESPONSE && type != DC_BLE_WRITE_WITHOUT_RESPONSE)
+		return DC_STATUS_INVALIDARGS;
+
+	ble->type = type;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_ble_read_packets (dc_iostream_t *abstract, void *data, size_t size, size_t lengths[], size_t count, size_t *npackets, size_t *actual)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	unsigned char *buffer = (unsigned char *) data;
+	size_t nbytes = 0;
+	size_t n = 0;
+
+	if (npackets)
+		*npackets = 0;
+	if (actual)
+		*actual = 0;
+
+	if (!ISINSTANCE (abstract))
+		return DC_STATUS_UNSUPPORTED;
+
+	if (data == NULL || size == 0 || (lengths && count == 0))
+		return DC_STATUS_INVALIDARGS;
+
+	// The largest notification which can arrive.
+	unsigned int mtu = DC_BLE_MTU_MAX;
+	dc_ble_get_mtu (abstract, &mtu);
+	size_t maximum = mtu - ATT_OVERHEAD;
+
+	while (1) {
+		// The reads go through the iostream layer, to keep the
+		// statistics and the logging complete.
+		size_t transferred = 0;
+		status = dc_iostream_read (abstract, buffer + nbytes, size - nbytes, &transferred);
+		if (status != DC_STATUS_SUCCESS) {
+			// Packets which are already stored are not lost.
+			if (n)
+				status = DC_STATUS_SUCCESS;
+			break;
+		}
+
+		if (lengths)
+			lengths[n] = transferred;
+		nbytes += transferred;
+		n++;
+
+		if ((lengths && n >= count) || size - nbytes < maximum)
+			break;
+
+		size_t available = 0;
+		if (dc_iostream_get_available (abstract, &available) != DC_STATUS_SUCCESS ||
+			available == 0)
+			break;
+	}
+
+	if (npackets)
+		*npackets = n;
+	if (actual)
+		*actual = nbytes;
+
+	return status;
+}
+
+static dc_status_t
+dc_ble_set_timeout (dc_iostream_t *abstract, int timeout)
+{
+	dc_ble_t *ble = (dc_ble_t *) abstract;
+
+	if (ble->callbacks.set_timeout == NULL)
+		return DC_STATUS_SUCCESS;
+
+	return ble->callbacks.set_timeout (ble->userdata, timeout);
+}
+
+static dc_status_t
+dc_ble_get_available (dc_iostream_t *abstract, size_t *value)
+{
+	dc_ble_t *ble = (dc_ble_t *) abstract;
+
+	if (ble->callbacks.get_available == NULL) {
+		*value = 0;
+		return DC_STATUS_SUCCESS;
+	}
+
+	return ble->callbacks.get_available (ble->userdata, value);
+}
+
+static dc_status_t
+dc_ble_read (dc_iostream_t *abstract, void *data, size_t size, size_t *actual)
+{
+	dc_ble_t *ble = (dc_ble_t *) abstract;
+
+	if (ble->callbacks.read == NULL)
+		return DC_STATUS_SUCCESS;
+
+	return ble->callbacks.read (ble->userdata, data, size, actual);
+}
+
+static dc_status_t
+dc_ble_write (dc_iostream_t *abstract, const void *data, size_t size, size_t *actual)
+{
+	dc_ble_t *ble = (dc_ble_t *) abstract;
+
+	if (ble->callbacks.write == NULL)
+		return DC_STATUS_SUCCESS;
+
+	return ble->callbacks.write (ble->userdata, data, size, ble->type, actual);
+}
+
+static dc_status_t
+dc_ble_purge (dc_iostream_t *abstract, dc_direction_t direction)
+{
+	dc_ble_t *ble = (dc_ble_t *) abstract;
+
+	if (ble->callbacks.purge == NULL)
+		return DC_STATUS_SUCCESS;
+
+	return ble->callbacks.purge (ble->userdata, direction);
+}
+
+static dc_status_t
+dc_ble_sleep (dc_iostream_t *abstract, unsigned int milliseconds)
+{
+	dc_ble_t *ble = (dc_ble_t *) abstract;
+
+	if (ble->callbacks.sleep == NULL)
+		return DC_STATUS_SUCCESS;
+
+	return ble->callbacks.sleep (ble->userdata, milliseconds);
+}
+
+static dc_status_t
+dc_ble_close (dc_iostream_t *abstract)
+{
+	dc_ble_t *ble = (dc_ble_t *) abstract;
+
+	if (ble->callbacks.close == NULL)
+		return DC_STATUS_SUCCESS;
+
+	return ble->callbacks.close (ble->userdata);
+}
+
+static const char *
+dc_ble_get_name (dc_iostream_t *abstract)
+{
+	dc_ble_t *ble = (dc_ble_t *) abstract;
+
+	if (ble->callbacks.get_name == NULL)
+		return NULL;
+
+	return ble->callbacks.get_name (ble->userdata);
+}
@@ -19,11 +19,14 @@
  * MA 02110-1301 USA
  */
 
+#define LOG_SUBSYSTEM DC_LOGSUBSYSTEM_IOSTREAM
+
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif
 
 #include <stdlib.h> // malloc, free
+#include <string.h> // memcpy, memset, strlen
 #include <stdio.h>
 
 #include "socket.h"
@@ -43,6 +46,7 @@
 #include <bluetooth/hci_lib.h>
 #include <bluetooth/sdp.h>
 #include <bluetooth/sdp_lib.h>
+#include <dirent.h>
 #endif
 #endif
 
@@ -66,6 +70,9 @@
 #define MAX_DEVICES 255
 #define MAX_PERIODS 8
 
+// The directory where BlueZ stores the paired devices.
+#define BLUEZ_STORAGE "/var/lib/bluetooth"
+
 #define ISINSTANCE(device) dc_iostream_isinstance((device), &dc_bluetooth_vtable)
 
 struct dc_bluetooth_device_t {
@@ -76,6 +83,7 @@ struct dc_bluetooth_device_t {
 #ifdef BLUETOOTH
 static dc_status_t dc_bluetooth_iterator_next (dc_iterator_t *iterator, void *item);
 static dc_status_t dc_bluetooth_iterator_free (dc_iterator_t *iterator);
+static void dc_bluetooth_iterator_release (void *item);
 
 typedef struct dc_bluetooth_iterator_t {
 	dc_iterator_t base;
@@ -85,6 +93,7 @@ typedef struct dc_bluetooth_iterator_t {
 #else
 	int fd;
 	inquiry_info *devices;
+	dc_bluetooth_device_t *paired;
 	size_t count;
 	size_t current;
 #endif
@@ -94,6 +103,8 @@ static const dc_iterator_vtable_t dc_bluetooth_iterator_vtable = {
 	sizeof(dc_bluetooth_iterator_t),
 	dc_bluetooth_iterator_next,
 	dc_bluetooth_iterator_free,
+	NULL,
+	dc_bluetooth_iterator_release,
 };
 
 static const dc_iostream_vtable_t dc_bluetooth_vtable = {
@@ -112,6 +123,13 @@ static const dc_iostream_vtable_t dc_bluetooth_vtable = {
 	NULL, /* purge */
 	dc_socket_sleep, /* sleep */
 	dc_socket_close, /* close */
+	NULL, /* get_name */
+	dc_socket_read_async, /* read_async */
+	dc_socket_write_async, /* write_async */
+	dc_socket_cancel, /* cancel */
+	dc_socket_readv, /* readv */
+	dc_socket_writev, /* writev */
+	dc_socket_interrupt, /* interrupt */	dc_socket_wait_readable, /* wait_readable */
 };
 
 #ifdef HAVE_BLUEZ
@@ -221,6 +239,161 @@ error:
 
 	return status;
 }
+
+/*
+ * Look up the RFCOMM channel of the serial port service. The result of
+ * the slow SDP query is kept in the context, and re-used for the next
+ * connection, unless a refresh is requested.
+ */
+static dc_status_t
+dc_bluetooth_channel (unsigned int *port, unsigned int *cached, dc_context_t *context, dc_bluetooth_address_t address, unsigned int refresh)
+{
+	unsigned char key[6 + sizeof (address)];
+	memcpy (key, "RFCOMM", 6);
+	memcpy (key + 6, &address, sizeof (address));
+
+	if (!refresh && dc_context_cache_get (context, key, sizeof (key), port)) {
+		INFO (context, "SDP: channel=%u (cached)", *port);
+		*cached = 1;
+		return DC_STATUS_SUCCESS;
+	}
+
+	bdaddr_t ba;
+	uint8_t channel = 0;
+	dc_address_set (&ba, address);
+	dc_status_t status = dc_bluetooth_sdp (&channel, context, &ba);
+	if (status != DC_STATUS_SUCCESS)
+		return status;
+
+	dc_context_cache_set (context, key, sizeof (key), channel);
+
+	*port = channel;
+	*cached = 0;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_bluetooth_connect (dc_socket_t *device, dc_bluetooth_address_t address, unsigned int port)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	status = dc_socket_open (&device->base, AF_BLUETOOTH, SOCK_STREAM, BTPROTO_RFCOMM);
+	if (status != DC_STATUS_SUCCESS)
+		return status;
+
+	struct sockaddr_rc sa;
+	sa.rc_family = AF_BLUETOOTH;
+	sa.rc_channel = port;
+	dc_address_set (&sa.rc_bdaddr, address);
+
+	status = dc_socket_connect (&device->base, (struct sockaddr *) &sa, sizeof (sa));
+	if (status != DC_STATUS_SUCCESS) {
+		dc_socket_close (&device->base);
+		return status;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+/*
+ * Read the paired devices from the storage of BlueZ. Each device has a
+ * directory named after its address, and the info file of a paired
+ * device contains a link key.
+ */
+static dc_status_t
+dc_bluetooth_paired (dc_bluetooth_iterator_t *iterator, dc_context_t *context, int dev)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	bdaddr_t ba;
+	if (hci_devba (dev, &ba) < 0) {
+		s_errcode_t errcode = S_ERRNO;
+		SYSERROR (context, errcode);
+		return dc_socket_syserror(errcode);
+	}
+
+	char adapter[DC_BLUETOOTH_SIZE];
+	ba2str (&ba, adapter);
+
+	char dirname[sizeof (BLUEZ_STORAGE) + DC_BLUETOOTH_SIZE];
+	snprintf (dirname, sizeof (dirname), "%s/%s", BLUEZ_STORAGE, adapter);
+
+	DIR *dp = opendir (dirname);
+	if (dp == NULL) {
+		s_errcode_t errcode = S_ERRNO;
+		SYSERROR (context, errcode);
+		return dc_socket_syserror(errcode);
+	}
+
+	size_t capacity = 0;
+	struct dirent *ep = NULL;
+	while ((ep = readdir (dp)) != NULL) {
+		if (strlen (ep->d_name) != DC_BLUETOOTH_SIZE - 1 || bachk (ep->d_name) < 0)
+			continue;
+
+		char filename[sizeof (dirname) + DC_BLUETOOTH_SIZE + 5];
+		snprintf (filename, sizeof (filename), "%s/%s/info", dirname, ep->d_name);
+
+		FILE *fp = fopen (filename, "r");
+		if (fp == NULL)
+			continue;
+
+		dc_bluetooth_device_t device;
+		memset (&device, 0, sizeof (device));
+		device.address = dc_bluetooth_str2addr (ep->d_name);
+
+		unsigned int paired = 0;
+		char line[512];
+		while (fgets (line, sizeof (line), fp)) {
+			if (strncmp (line, "[LinkKey]", 9) == 0) {
+				paired = 1;
+			} else if (strncmp (line, "Name=", 5) == 0 && device.name[0] == '\0') {
+				line[strcspn (line, "\r\n")] = '\0';
+				strncpy (device.name, line + 5, sizeof (device.name) - 1);
+			}
+		}
+
+		fclose (fp);
+
+		if (!paired)
+			continue;
+
+		if (iterator->count == capacity) {
+			size_t n = capacity ? capacity * 2 : 8;
+			dc_bluetooth_device_t *paired = (dc_bluetooth_device_t *) realloc (iterator->paired, n * sizeof (dc_bluetooth_device_t));
+			if (paired == NULL) {
+				SYSERROR (context, S_ENOMEM);
+				status = DC_STATUS_NOMEMORY;
+				break;
+			}
+			iterator->paired = paired;
+			capacity = n;
+		}
+
+		iterator->paired[iterator->count++] = device;
+	}
+
+	closedir (dp);
+
+	if (status != DC_STATUS_SUCCESS) {
+		free (iterator->paired);
+		iterator->paired = NULL;
+		iterator->count = 0;
+		return status;
+	}
+
+	// An empty list is still a valid list.
+	if (iterator->paired == NULL) {
+		iterator->paired = (dc_bluetooth_device_t *) malloc (sizeof (dc_bluetooth_device_t));
+		if (iterator->paired == NULL) {
+			SYSERROR (context, S_ENOMEM);
+			return DC_STATUS_NOMEMORY;
+		}
+	}
+
+	return DC_STATUS_SUCCESS;
+}
 #endif
 #endif
 
@@ -298,6 +471,12 @@ dc_bluetooth_device_free (dc_bluetooth_device_t *device)
 
 dc_status_t
 dc_bluetooth_iterator_new (dc_iterator_t **out, dc_context_t *context, dc_descriptor_t *descriptor)
+{
+	return dc_bluetooth_iterator_new2 (out, context, descriptor, 0);
+}
+
+dc_status_t
+dc_bluetooth_iterator_new2 (dc_iterator_t **out, dc_context_t *context, dc_descriptor_t *descriptor, unsigned int flags)
 {
 #ifdef BLUETOOTH
 	dc_status_t status = DC_STATUS_SUCCESS;
@@ -325,8 +504,14 @@ dc_bluetooth_iterator_new (dc_iterator_t **out, dc_context_t *context, dc_descri
 	wsaq.dwNameSpace = NS_BTH;
 	wsaq.lpcsaBuffer = NULL;
 
+	// Without a flush, only the remembered devices are returned, and no
+	// inquiry is performed.
+	DWORD dwFlags = LUP_CONTAINERS;
+	if ((flags & DC_BLUETOOTH_PAIRED) == 0)
+		dwFlags |= LUP_FLUSHCACHE;
+
 	HANDLE hLookup = NULL;
-	if (WSALookupServiceBegin(&wsaq, LUP_CONTAINERS | LUP_FLUSHCACHE, &hLookup) != 0) {
+	if (WSALookupServiceBegin(&wsaq, dwFlags, &hLookup) != 0) {
 		s_errcode_t errcode = S_ERRNO;
 		if (errcode == WSASERVICE_NOT_FOUND) {
 			// No remote bluetooth devices found.
@@ -358,22 +543,41 @@ dc_bluetooth_iterator_new (dc_iterator_t **out, dc_context_t *context, dc_descri
 		goto error_socket_exit;
 	}
 
-	// Perform the bluetooth device discovery. The inquiry lasts for at
-	// most MAX_PERIODS * 1.28 seconds, and at most MAX_DEVICES devices
-	// will be returned.
-	inquiry_info *devices = NULL;
-	int ndevices = hci_inquiry (dev, MAX_PERIODS, MAX_DEVICES, NULL, &devices, IREQ_CACHE_FLUSH);
-	if (ndevices < 0) {
-		s_errcode_t errcode = S_ERRNO;
-		SYSERROR (context, errcode);
-		status = dc_socket_syserror(errcode);
-		goto error_close;
-	}
-
 	iterator->fd = fd;
-	iterator->devices = devices;
-	iterator->count = ndevices;
+	iterator->devices = NULL;
+	iterator->paired = NULL;
+	iterator->count = 0;
 	iterator->current = 0;
+
+	if (flags & DC_BLUETOOTH_PAIRED) {
+		// The storage of BlueZ is usually readable by root only. Without
+		// access, the devices in the inquiry cache of the kernel are used
+		// instead.
+		status = dc_bluetooth_paired (iterator, context, dev);
+		if (status == DC_STATUS_NOMEMORY) {
+			goto error_close;
+		} else if (status != DC_STATUS_SUCCESS) {
+			WARNING (context, "Failed to read the paired devices.");
+		}
+	}
+
+	if (iterator->paired == NULL) {
+		// Perform the bluetooth device discovery. The inquiry lasts for at
+		// most MAX_PERIODS * 1.28 seconds, and at most MAX_DEVICES devices
+		// will be returned.
+		inquiry_info *devices = NULL;
+		long iflags = (flags & DC_BLUETOOTH_PAIRED) ? 0 : IREQ_CACHE_FLUSH;
+		int ndevices = hci_inquiry (dev, MAX_PERIODS, MAX_DEVICES, NULL, &devices, iflags);
+		if (ndevices < 0) {
+			s_errcode_t errcode = S_ERRNO;
+			SYSERROR (context, errcode);
+			status = dc_socket_syserror(errcode);
+			goto error_close;
+		}
+
+		iterator->devices = devices;
+		iterator->count = ndevices;
+	}
 #endif
 	iterator->filter = dc_descriptor_get_filter (descriptor);
 
@@ -436,7 +640,33 @@ dc_bluetooth_iterator_next (dc_iterator_t *abstract, void *out)
 		dc_bluetooth_address_t address = sa->btAddr;
 		const char *name = (char *) pwsaResults->lpszServiceInstanceName;
 #else
-	while (iterator->current < iterator->count) {
+	while (iterator->paired && iterator->current < iterator->count) {
+		dc_bluetooth_device_t *dev = &iterator->paired[iterator->current++];
+
+		dc_bluetooth_address_t address = dev->address;
+		const char *name = dev->name[0] ? dev->name : NULL;
+
+		INFO (abstract->context, "Paired: address=" DC_ADDRESS_FORMAT ", name=%s",
+			address, name ? name : "");
+
+		if (iterator->filter && !iterator->filter (DC_TRANSPORT_BLUETOOTH, name)) {
+			continue;
+		}
+
+		device = (dc_bluetooth_device_t *) malloc (sizeof(dc_bluetooth_device_t));
+		if (device == NULL) {
+			SYSERROR (abstract->context, S_ENOMEM);
+			return DC_STATUS_NOMEMORY;
+		}
+
+		*device = *dev;
+
+		*(dc_bluetooth_device_t **) out = device;
+
+		return DC_STATUS_SUCCESS;
+	}
+
+	while (iterator->devices && iterator->current < iterator->count) {
 		inquiry_info *dev = &iterator->devices[iterator->current++];
 
 		dc_bluetooth_address_t address = dc_address_get (&dev->bdaddr);
@@ -491,6 +721,7 @@ dc_bluetooth_iterator_free (dc_iterator_t *abstract)
 		WSALookupServiceEnd (iterator->hLookup);
 	}
 #else
+	free(iterator->paired);
 	bt_free(iterator->devices);
 	hci_close_dev(iterator->fd);
 #endif
@@ -498,6 +729,12 @@ dc_bluetooth_iterator_free (dc_iterator_t *abstract)
 
 	return DC_STATUS_SUCCESS;
 }
+
+static void
+dc_bluetooth_iterator_release (void *item)
+{
+	dc_bluetooth_device_free ((dc_bluetooth_device_t *) item);
+}
 #endif
 
 dc_status_t
@@ -519,17 +756,13 @@ dc_bluetooth_open (dc_iostream_t **out, dc_context_t *context, dc_bluetooth_addr
 		return DC_STATUS_NOMEMORY;
 	}
 
-	// Open the socket.
 #ifdef _WIN32
+	// Open the socket.
 	status = dc_socket_open (&device->base, AF_BTH, SOCK_STREAM, BTHPROTO_RFCOMM);
-#else
-	status = dc_socket_open (&device->base, AF_BLUETOOTH, SOCK_STREAM, BTPROTO_RFCOMM);
-#endif
 	if (status != DC_STATUS_SUCCESS) {
 		goto error_free;
 	}
 
-#ifdef _WIN32
 	SOCKADDR_BTH sa;
 	sa.addressFamily = AF_BTH;
 	sa.btAddr = address;
@@ -539,31 +772,43 @@ dc_bluetooth_open (dc_iostream_t **out, dc_context_t *context, dc_bluetooth_addr
 	} else {
 		memset(&sa.serviceClassId, 0, sizeof(sa.serviceClassId));
 	}
+
+	status = dc_socket_connect (&device->base, (struct sockaddr *) &sa, sizeof (sa));
+	if (status != DC_STATUS_SUCCESS) {
+		dc_socket_close (&device->base);
+		goto error_free;
+	}
 #else
-	struct sockaddr_rc sa;
-	sa.rc_family = AF_BLUETOOTH;
-	dc_address_set (&sa.rc_bdaddr, address);
+	unsigned int channel = port;
+	unsigned int cached = 0;
 	if (port == 0) {
-		status = dc_bluetooth_sdp (&sa.rc_channel, context, &sa.rc_bdaddr);
+		status = dc_bluetooth_channel (&channel, &cached, context, address, 0);
 		if (status != DC_STATUS_SUCCESS) {
-			goto error_close;
+			goto error_free;
 		}
-	} else {
-		sa.rc_channel = port;
 	}
-#endif
 
-	status = dc_socket_connect (&device->base, (struct sockaddr *) &sa, sizeof (sa));
+	status = dc_bluetooth_connect (device, address, channel);
+	if (status != DC_STATUS_SUCCESS && cached) {
+		// The channel of the service may have changed since it was
+		// cached, for example after a firmware update.
+		WARNING (context, "Failed to connect to the cached channel %u.", channel);
+		status = dc_bluetooth_channel (&channel, &cached, context, address, 1);
+		if (status != DC_STATUS_SUCCESS) {
+			goto error_free;
+		}
+
+		status = dc_bluetooth_connect (device, address, channel);
+	}
 	if (status != DC_STATUS_SUCCESS) {
-		goto error_close;
+		goto error_free;
 	}
+#endif
 
 	*out = (dc_iostream_t *) device;
 
 	return DC_STATUS_SUCCESS;
 
-error_close:
-	dc_socket_close (&device->base);
 error_free:
 	dc_iostream_deallocate ((dc_iostream_t *) device);
 	return status;
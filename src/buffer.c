@@ -24,9 +24,13 @@
 
 #include <libdivecomputer/buffer.h>
 
+#include "perfstats.h"
+
 struct dc_buffer_t {
 	unsigned char *data;
 	size_t capacity, offset, size;
+	size_t maxstep;
+	unsigned int nallocs;
 };
 
 dc_buffer_t *
@@ -49,6 +53,8 @@ dc_buffer_new (size_t capacity)
 	buffer->capacity = capacity;
 	buffer->offset = 0;
 	buffer->size = 0;
+	buffer->maxstep = 0;
+	buffer->nallocs = capacity ? 1 : 0;
 
 	return buffer;
 }
@@ -85,8 +91,16 @@ dc_buffer_expand_calc (dc_buffer_t *buffer, size_t n)
 {
 	size_t oldsize = buffer->capacity;
 	size_t newsize = (oldsize ? oldsize : n);
-	while (newsize < n)
-		newsize *= 2;
+	while (newsize < n) {
+		// Grow geometrically, but limit the size of a single step to the
+		// maximum step size (if any), to avoid over-allocating huge buffers.
+		size_t step = newsize;
+		if (buffer->maxstep && step > buffer->maxstep)
+			step = buffer->maxstep;
+		if (step > (size_t) -1 - newsize)
+			return n;
+		newsize += step;
+	}
 
 	return newsize;
 }
@@ -99,22 +113,40 @@ dc_buffer_expand_append (dc_buffer_t *buffer, size_t n)
 		if (n > buffer->capacity) {
 			size_t capacity = dc_buffer_expand_calc (buffer, n);
 
-			unsigned char *data = (unsigned char *) malloc (capacity);
-			if (data == NULL)
-				return 0;
+			if (buffer->offset == 0) {
+				// The data is already at the start of the buffer, so a
+				// realloc (which may grow in place) is sufficient.
+				unsigned char *data = (unsigned char *) realloc (buffer->data, capacity);
+				if (data == NULL)
+					return 0;
 
-			if (buffer->size)
-				memcpy (data, buffer->data + buffer->offset, buffer->size);
+				buffer->data = data;
+			} else {
+				unsigned char *data = (unsigned char *) malloc (capacity);
+				if (data == NULL)
+					return 0;
 
-			free (buffer->data);
+				if (buffer->size)
+					memcpy (data, buffer->data + buffer->offset, buffer->size);
+
+				free (buffer->data);
+
+				buffer->data = data;
+
+				PERFSTATS_ADD (buffer_moved, buffer->size);
+			}
 
-			buffer->data = data;
 			buffer->capacity = capacity;
 			buffer->offset = 0;
+			buffer->nallocs++;
+
+			PERFSTATS_ADD (buffer_allocs, 1);
 		} else {
 			if (buffer->size)
 				memmove (buffer->data, buffer->data + buffer->offset, buffer->size);
 
+			PERFSTATS_ADD (buffer_moved, buffer->size);
+
 			buffer->offset = 0;
 		}
 	}
@@ -144,10 +176,16 @@ dc_buffer_expand_prepend (dc_buffer_t *buffer, size_t n)
 			buffer->data = data;
 			buffer->capacity = capacity;
 			buffer->offset = capacity - buffer->size;
+			buffer->nallocs++;
+
+			PERFSTATS_ADD (buffer_allocs, 1);
+			PERFSTATS_ADD (buffer_moved, buffer->size);
 		} else {
 			if (buffer->size)
 				memmove (buffer->data + available, buffer->data + buffer->offset, buffer->size);
 
+			PERFSTATS_ADD (buffer_moved, buffer->size);
+
 			buffer->offset = available;
 		}
 	}
@@ -171,6 +209,21 @@ dc_buffer_reserve (dc_buffer_t *buffer, size_t capacity)
 
 	buffer->data = data;
 	buffer->capacity = capacity;
+	buffer->nallocs++;
+
+	PERFSTATS_ADD (buffer_allocs, 1);
+
+	return 1;
+}
+
+
+int
+dc_buffer_set_growth (dc_buffer_t *buffer, size_t maxstep)
+{
+	if (buffer == NULL)
+		return 0;
+
+	buffer->maxstep = maxstep;
 
 	return 1;
 }
@@ -237,9 +290,10 @@ dc_buffer_slice (dc_buffer_t *buffer, size_t offset, size_t size)
 	if (buffer == NULL)
 		return 0;
 
-	if (offset + size > buffer->size)
+	if (offset > buffer->size || size > buffer->size - offset)
 		return 0;
 
+	// Only the offset and size are adjusted, the data is never moved.
 	buffer->offset += offset;
 	buffer->size = size;
 
@@ -265,3 +319,68 @@ dc_buffer_get_data (dc_buffer_t *buffer)
 
 	return buffer->size ? buffer->data + buffer->offset : NULL;
 }
+
+
+size_t
+dc_buffer_get_capacity (dc_buffer_t *buffer)
+{
+	if (buffer == NULL)
+		return 0;
+
+	return buffer->capacity;
+}
+
+
+unsigned int
+dc_buffer_get_allocations (dc_buffer_t *buffer)
+{
+	if (buffer == NULL)
+		return 0;
+
+	return buffer->nallocs;
+}
+
+
+int
+dc_buffer_get_view (dc_buffer_t *buffer, size_t offset, size_t size, dc_buffer_view_t *view)
+{
+	if (buffer == NULL || view == NULL)
+		return 0;
+
+	if (offset > buffer->size || size > buffer->size - offset)
+		return 0;
+
+	view->data = size ? buffer->data + buffer->offset + offset : NULL;
+	view->size = size;
+
+	return 1;
+}
+
+
+int
+dc_buffer_view_init (dc_buffer_view_t *view, const unsigned char data[], size_t size)
+{
+	if (view == NULL || (data == NULL && size))
+		return 0;
+
+	view->data = size ? data : NULL;
+	view->size = size;
+
+	return 1;
+}
+
+
+int
+dc_buffer_view_slice (dc_buffer_view_t *view, size_t offset, size_t size)
+{
+	if (view == NULL)
+		return 0;
+
+	if (offset > view->size || size > view->size - offset)
+		return 0;
+
+	view->data = size ? view->data + offset : NULL;
+	view->size = size;
+
+	return 1;
+}
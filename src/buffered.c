@@ -0,0 +1,340 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#define LOG_SUBSYSTEM DC_LOGSUBSYSTEM_IOSTREAM
+
+#include <stdlib.h> // malloc, free
+#include <string.h>
+
+#include "buffered.h"
+#include "common-private.h"
+#include "context-private.h"
+#include "iostream-private.h"
+
+// Default size of the buffer.
+#define BUFSIZE 4096
+
+typedef struct dc_buffered_t {
+	dc_iostream_t base;
+	dc_iostream_t *iostream;
+	/* Data received in excess of the read requests. */
+	unsigned char *data;
+	size_t capacity;
+	size_t offset;
+	size_t size;
+} dc_buffered_t;
+
+static dc_status_t dc_buffered_set_timeout (dc_iostream_t *iostream, int timeout);
+static dc_status_t dc_buffered_set_latency (dc_iostream_t *iostream, unsigned int value);
+static dc_status_t dc_buffered_set_break (dc_iostream_t *iostream, unsigned int value);
+static dc_status_t dc_buffered_set_dtr (dc_iostream_t *iostream, unsigned int value);
+static dc_status_t dc_buffered_set_rts (dc_iostream_t *iostream, unsigned int value);
+static dc_status_t dc_buffered_get_lines (dc_iostream_t *iostream, unsigned int *value);
+static dc_status_t dc_buffered_get_available (dc_iostream_t *iostream, size_t *value);
+static dc_status_t dc_buffered_configure (dc_iostream_t *iostream, unsigned int baudrate, unsigned int databits, dc_parity_t parity, dc_stopbits_t stopbits, dc_flowcontrol_t flowcontrol);
+static dc_status_t dc_buffered_read (dc_iostream_t *iostream, void *data, size_t size, size_t *actual);
+static dc_status_t dc_buffered_write (dc_iostream_t *iostream, const void *data, size_t size, size_t *actual);
+static dc_status_t dc_buffered_flush (dc_iostream_t *iostream);
+static dc_status_t dc_buffered_purge (dc_iostream_t *iostream, dc_direction_t direction);
+static dc_status_t dc_buffered_sleep (dc_iostream_t *iostream, unsigned int milliseconds);
+static dc_status_t dc_buffered_close (dc_iostream_t *iostream);
+static const char *dc_buffered_get_name (dc_iostream_t *iostream);
+static dc_status_t dc_buffered_interrupt (dc_iostream_t *iostream);
+static dc_status_t dc_buffered_wait_readable (dc_iostream_t *iostream, int timeout);
+
+static const dc_iostream_vtable_t dc_buffered_vtable = {
+	sizeof(dc_buffered_t),
+	dc_buffered_set_timeout, /* set_timeout */
+	dc_buffered_set_latency, /* set_latency */
+	dc_buffered_set_break, /* set_break */
+	dc_buffered_set_dtr, /* set_dtr */
+	dc_buffered_set_rts, /* set_rts */
+	dc_buffered_get_lines, /* get_lines */
+	dc_buffered_get_available, /* get_available */
+	dc_buffered_configure, /* configure */
+	dc_buffered_read, /* read */
+	dc_buffered_write, /* write */
+	dc_buffered_flush, /* flush */
+	dc_buffered_purge, /* purge */
+	dc_buffered_sleep, /* sleep */
+	dc_buffered_close, /* close */
+	dc_buffered_get_name, /* get_name */
+	NULL, /* read_async */
+	NULL, /* write_async */
+	NULL, /* cancel */
+	NULL, /* readv */
+	NULL, /* writev */
+	dc_buffered_interrupt, /* interrupt */	dc_buffered_wait_readable, /* wait_readable */
+};
+
+dc_status_t
+dc_buffered_open (dc_iostream_t **out, dc_context_t *context, dc_iostream_t *base, size_t size)
+{
+	dc_buffered_t *device = NULL;
+
+	if (out == NULL || base == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	if (size == 0)
+		size = BUFSIZE;
+
+	// Allocate memory.
+	device = (dc_buffered_t *) dc_iostream_allocate (context, &dc_buffered_vtable, dc_iostream_get_transport (base));
+	if (device == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	device->data = (unsigned char *) malloc (size);
+	if (device->data == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		dc_iostream_deallocate ((dc_iostream_t *) device);
+		return DC_STATUS_NOMEMORY;
+	}
+
+	device->iostream = base;
+	device->capacity = size;
+	device->offset = 0;
+	device->size = 0;
+
+	*out = (dc_iostream_t *) device;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_buffered_close (dc_iostream_t *abstract)
+{
+	dc_buffered_t *device = (dc_buffered_t *) abstract;
+
+	// The underlying I/O stream is owned by the caller.
+	free (device->data);
+
+	return DC_STATUS_SUCCESS;
+}
+
+static const char *
+dc_buffered_get_name (dc_iostream_t *abstract)
+{
+	dc_buffered_t *device = (dc_buffered_t *) abstract;
+
+	return dc_iostream_get_name (device->iostream);
+}
+
+static dc_status_t
+dc_buffered_set_timeout (dc_iostream_t *abstract, int timeout)
+{
+	dc_buffered_t *device = (dc_buffered_t *) abstract;
+
+	return dc_iostream_set_timeout (device->iostream, timeout);
+}
+
+static dc_status_t
+dc_buffered_set_latency (dc_iostream_t *abstract, unsigned int value)
+{
+	dc_buffered_t *device = (dc_buffered_t *) abstract;
+
+	return dc_iostream_set_latency (device->iostream, value);
+}
+
+static dc_status_t
+dc_buffered_set_break (dc_iostream_t *abstract, unsigned int value)
+{
+	dc_buffered_t *device = (dc_buffered_t *) abstract;
+
+	return dc_iostream_set_break (device->iostream, value);
+}
+
+static dc_status_t
+dc_buffered_set_dtr (dc_iostream_t *abstract, unsigned int value)
+{
+	dc_buffered_t *device = (dc_buffered_t *) abstract;
+
+	return dc_iostream_set_dtr (device->iostream, value);
+}
+
+static dc_status_t
+dc_buffered_set_rts (dc_iostream_t *abstract, unsigned int value)
+{
+	dc_buffered_t *device = (dc_buffered_t *) abstract;
+
+	return dc_iostream_set_rts (device->iostream, value);
+}
+
+static dc_status_t
+dc_buffered_get_lines (dc_iostream_t *abstract, unsigned int *value)
+{
+	dc_buffered_t *device = (dc_buffered_t *) abstract;
+
+	return dc_iostream_get_lines (device->iostream, value);
+}
+
+static dc_status_t
+dc_buffered_get_available (dc_iostream_t *abstract, size_t *value)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_buffered_t *device = (dc_buffered_t *) abstract;
+	size_t available = 0;
+
+	status = dc_iostream_get_available (device->iostream, &available);
+	if (status != DC_STATUS_SUCCESS)
+		return status;
+
+	if (value)
+		*value = device->size - device->offset + available;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_buffered_wait_readable (dc_iostream_t *abstract, int timeout)
+{
+	dc_buffered_t *device = (dc_buffered_t *) abstract;
+
+	if (device->offset < device->size)
+		return DC_STATUS_SUCCESS;
+
+	return dc_iostream_wait_readable (device->iostream, timeout);
+}
+
+static dc_status_t
+dc_buffered_configure (dc_iostream_t *abstract, unsigned int baudrate, unsigned int databits, dc_parity_t parity, dc_stopbits_t stopbits, dc_flowcontrol_t flowcontrol)
+{
+	dc_buffered_t *device = (dc_buffered_t *) abstract;
+
+	return dc_iostream_configure (device->iostream, baudrate, databits, parity, stopbits, flowcontrol);
+}
+
+static size_t
+dc_buffered_consume (dc_buffered_t *device, unsigned char data[], size_t size)
+{
+	size_t available = device->size - device->offset;
+	size_t n = size < available ? size : available;
+
+	memcpy (data, device->data + device->offset, n);
+	device->offset += n;
+
+	if (device->offset == device->size) {
+		device->offset = 0;
+		device->size = 0;
+	}
+
+	return n;
+}
+
+static dc_status_t
+dc_buffered_read (dc_iostream_t *abstract, void *data, size_t size, size_t *actual)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_buffered_t *device = (dc_buffered_t *) abstract;
+	unsigned char *buffer = (unsigned char *) data;
+
+	// Consume the buffered data first.
+	size_t nbytes = dc_buffered_consume (device, buffer, size);
+	if (nbytes == size)
+		goto out;
+
+	size_t remaining = size - nbytes;
+	if (remaining >= device->capacity) {
+		// Large reads bypass the buffer.
+		size_t n = 0;
+		status = dc_iostream_read (device->iostream, buffer + nbytes, remaining, &n);
+		nbytes += n;
+		goto out;
+	}
+
+	// Fetch the data which is already available as well, but never less
+	// than requested. The query is not logged, because it's done for
+	// every read. Failures are harmless, and only disable the read-ahead.
+	size_t available = 0;
+	if (device->iostream->vtable->get_available == NULL ||
+		device->iostream->vtable->get_available (device->iostream, &available) != DC_STATUS_SUCCESS) {
+		available = 0;
+	}
+
+	size_t length = available < device->capacity ? available : device->capacity;
+	if (length < remaining)
+		length = remaining;
+
+	size_t n = 0;
+	status = dc_iostream_read (device->iostream, device->data, length, &n);
+	device->offset = 0;
+	device->size = n;
+
+	nbytes += dc_buffered_consume (device, buffer + nbytes, remaining);
+
+	// Exceeding the request is not required, so a timeout after the
+	// requested amount of data is not an error.
+	if (status == DC_STATUS_TIMEOUT && nbytes == size)
+		status = DC_STATUS_SUCCESS;
+
+out:
+	if (actual)
+		*actual = nbytes;
+
+	return status;
+}
+
+static dc_status_t
+dc_buffered_write (dc_iostream_t *abstract, const void *data, size_t size, size_t *actual)
+{
+	dc_buffered_t *device = (dc_buffered_t *) abstract;
+
+	return dc_iostream_write (device->iostream, data, size, actual);
+}
+
+static dc_status_t
+dc_buffered_flush (dc_iostream_t *abstract)
+{
+	dc_buffered_t *device = (dc_buffered_t *) abstract;
+
+	return dc_iostream_flush (device->iostream);
+}
+
+static dc_status_t
+dc_buffered_purge (dc_iostream_t *abstract, dc_direction_t direction)
+{
+	dc_buffered_t *device = (dc_buffered_t *) abstract;
+
+	// The buffered data is part of the input queue.
+	if (direction & DC_DIRECTION_INPUT) {
+		device->offset = 0;
+		device->size = 0;
+	}
+
+	return dc_iostream_purge (device->iostream, direction);
+}
+
+static dc_status_t
+dc_buffered_sleep (dc_iostream_t *abstract, unsigned int milliseconds)
+{
+	dc_buffered_t *device = (dc_buffered_t *) abstract;
+
+	return dc_iostream_sleep (device->iostream, milliseconds);
+}
+
+static dc_status_t
+dc_buffered_interrupt (dc_iostream_t *abstract)
+{
+	dc_buffered_t *device = (dc_buffered_t *) abstract;
+
+	return dc_iostream_interrupt (device->iostream);
+}
@@ -0,0 +1,51 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_BUFFERED_H
+#define DC_BUFFERED_H
+
+#include <libdivecomputer/common.h>
+#include <libdivecomputer/context.h>
+#include <libdivecomputer/iostream.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * Open a buffered I/O stream on top of another I/O stream.
+ *
+ * Small reads fetch all the data which is already available, up to the
+ * size of the buffer, with a single read on the underlying I/O stream.
+ * The following reads are served from the buffer. Reads larger than
+ * the buffer bypass it. Purging the input also drops the buffered data.
+ * Writes and all other operations are passed through unchanged.
+ *
+ * The underlying I/O stream is not closed together with the buffered
+ * I/O stream. A zero size selects the default size.
+ */
+dc_status_t
+dc_buffered_open (dc_iostream_t **iostream, dc_context_t *context, dc_iostream_t *base, size_t size);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_BUFFERED_H */
@@ -0,0 +1,821 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#define LOG_SUBSYSTEM DC_LOGSUBSYSTEM_IOSTREAM
+
+#include <stdlib.h> // malloc, free
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>   // nanosleep
+#ifdef _WIN32
+#define NOGDI
+#include <windows.h>
+#endif
+
+#include <libdivecomputer/capture.h>
+#include <libdivecomputer/buffer.h>
+
+#include "iostream-private.h"
+#include "common-private.h"
+#include "context-private.h"
+#include "timer.h"
+#include "array.h"
+#include "platform.h"
+
+/*
+ * The capture file starts with a header, containing a magic string and
+ * the transport type. Every operation is stored as a record, with the
+ * following fields:
+ *
+ *  - type (1 byte)
+ *  - status (1 byte, signed)
+ *  - time since the previous record (4 bytes, microseconds)
+ *  - argument (4 bytes)
+ *  - length (4 bytes)
+ *  - data (length bytes)
+ *
+ * All numbers are stored in little endian byte order. The time is taken
+ * at the end of the operation.
+ */
+#define MAGIC "DCCAPTR1"
+
+#define SZ_MAGIC  8
+#define SZ_HEADER (SZ_MAGIC + 4)
+#define SZ_RECORD 14
+
+#define REC_TIMEOUT   0x01
+#define REC_LATENCY   0x02
+#define REC_BREAK     0x03
+#define REC_DTR       0x04
+#define REC_RTS       0x05
+#define REC_LINES     0x06
+#define REC_AVAILABLE 0x07
+#define REC_CONFIGURE 0x08
+#define REC_READ      0x09
+#define REC_WRITE     0x0A
+#define REC_FLUSH     0x0B
+#define REC_PURGE     0x0C
+#define REC_SLEEP     0x0D
+#define REC_WAIT      0x0E
+
+static dc_status_t dc_capture_set_timeout (dc_iostream_t *abstract, int timeout);
+static dc_status_t dc_capture_set_latency (dc_iostream_t *abstract, unsigned int value);
+static dc_status_t dc_capture_set_break (dc_iostream_t *abstract, unsigned int value);
+static dc_status_t dc_capture_set_dtr (dc_iostream_t *abstract, unsigned int value);
+static dc_status_t dc_capture_set_rts (dc_iostream_t *abstract, unsigned int value);
+static dc_status_t dc_capture_get_lines (dc_iostream_t *abstract, unsigned int *value);
+static dc_status_t dc_capture_get_available (dc_iostream_t *abstract, size_t *value);
+static dc_status_t dc_capture_configure (dc_iostream_t *abstract, unsigned int baudrate, unsigned int databits, dc_parity_t parity, dc_stopbits_t stopbits, dc_flowcontrol_t flowcontrol);
+static dc_status_t dc_capture_read (dc_iostream_t *abstract, void *data, size_t size, size_t *actual);
+static dc_status_t dc_capture_write (dc_iostream_t *abstract, const void *data, size_t size, size_t *actual);
+static dc_status_t dc_capture_flush (dc_iostream_t *abstract);
+static dc_status_t dc_capture_purge (dc_iostream_t *abstract, dc_direction_t direction);
+static dc_status_t dc_capture_sleep (dc_iostream_t *abstract, unsigned int milliseconds);
+static dc_status_t dc_capture_close (dc_iostream_t *abstract);
+static const char *dc_capture_get_name (dc_iostream_t *abstract);
+static dc_status_t dc_capture_wait_readable (dc_iostream_t *abstract, int timeout);
+
+static dc_status_t dc_replay_set_timeout (dc_iostream_t *abstract, int timeout);
+static dc_status_t dc_replay_set_latency (dc_iostream_t *abstract, unsigned int value);
+static dc_status_t dc_replay_set_break (dc_iostream_t *abstract, unsigned int value);
+static dc_status_t dc_replay_set_dtr (dc_iostream_t *abstract, unsigned int value);
+static dc_status_t dc_replay_set_rts (dc_iostream_t *abstract, unsigned int value);
+static dc_status_t dc_replay_get_lines (dc_iostream_t *abstract, unsigned int *value);
+static dc_status_t dc_replay_get_available (dc_iostream_t *abstract, size_t *value);
+static dc_status_t dc_replay_configure (dc_iostream_t *abstract, unsigned int baudrate, unsigned int databits, dc_parity_t parity, dc_stopbits_t stopbits, dc_flowcontrol_t flowcontrol);
+static dc_status_t dc_replay_read (dc_iostream_t *abstract, void *data, size_t size, size_t *actual);
+static dc_status_t dc_replay_write (dc_iostream_t *abstract, const void *data, size_t size, size_t *actual);
+static dc_status_t dc_replay_flush (dc_iostream_t *abstract);
+static dc_status_t dc_replay_purge (dc_iostream_t *abstract, dc_direction_t direction);
+static dc_status_t dc_replay_sleep (dc_iostream_t *abstract, unsigned int milliseconds);
+static dc_status_t dc_replay_close (dc_iostream_t *abstract);
+static dc_status_t dc_replay_wait_readable (dc_iostream_t *abstract, int timeout);
+
+typedef struct dc_capture_t {
+	/* Base class. */
+	dc_iostream_t base;
+	/* Internal state. */
+	dc_iostream_t *iostream;
+	dc_timer_t *timer;
+	dc_usecs_t timestamp;
+	FILE *fp;
+	int error;
+} dc_capture_t;
+
+typedef struct dc_replay_t {
+	/* Base class. */
+	dc_iostream_t base;
+	/* Internal state. */
+	dc_buffer_t *buffer;
+	size_t offset;
+	dc_timer_t *timer;
+	dc_usecs_t timestamp;
+	unsigned int realtime;
+} dc_replay_t;
+
+typedef struct dc_record_t {
+	unsigned int type;
+	dc_status_t status;
+	unsigned int argument;
+	const unsigned char *data;
+	unsigned int length;
+} dc_record_t;
+
+static const dc_iostream_vtable_t dc_capture_vtable = {
+	sizeof(dc_capture_t),
+	dc_capture_set_timeout, /* set_timeout */
+	dc_capture_set_latency, /* set_latency */
+	dc_capture_set_break, /* set_break */
+	dc_capture_set_dtr, /* set_dtr */
+	dc_capture_set_rts, /* set_rts */
+	dc_capture_get_lines, /* get_lines */
+	dc_capture_get_available, /* get_available */
+	dc_capture_configure, /* configure */
+	dc_capture_read, /* read */
+	dc_capture_write, /* write */
+	dc_capture_flush, /* flush */
+	dc_capture_purge, /* purge */
+	dc_capture_sleep, /* sleep */
+	dc_capture_close, /* close */
+	dc_capture_get_name, /* get_name */
+	NULL, /* read_async */
+	NULL, /* write_async */
+	NULL, /* cancel */
+	NULL, /* readv */
+	NULL, /* writev */
+	NULL, /* interrupt */
+	dc_capture_wait_readable, /* wait_readable */
+};
+
+static const dc_iostream_vtable_t dc_replay_vtable = {
+	sizeof(dc_replay_t),
+	dc_replay_set_timeout, /* set_timeout */
+	dc_replay_set_latency, /* set_latency */
+	dc_replay_set_break, /* set_break */
+	dc_replay_set_dtr, /* set_dtr */
+	dc_replay_set_rts, /* set_rts */
+	dc_replay_get_lines, /* get_lines */
+	dc_replay_get_available, /* get_available */
+	dc_replay_configure, /* configure */
+	dc_replay_read, /* read */
+	dc_replay_write, /* write */
+	dc_replay_flush, /* flush */
+	dc_replay_purge, /* purge */
+	dc_replay_sleep, /* sleep */
+	dc_replay_close, /* close */
+	NULL, /* get_name */
+	NULL, /* read_async */
+	NULL, /* write_async */
+	NULL, /* cancel */
+	NULL, /* readv */
+	NULL, /* writev */
+	NULL, /* interrupt */
+	dc_replay_wait_readable, /* wait_readable */
+};
+
+dc_status_t
+dc_capture_open (dc_iostream_t **out, dc_context_t *context, dc_iostream_t *base, const char *filename)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_capture_t *capture = NULL;
+
+	if (out == NULL || base == NULL || filename == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	INFO (context, "Open: filename=%s", filename);
+
+	// Allocate memory.
+	capture = (dc_capture_t *) dc_iostream_allocate (context, &dc_capture_vtable, dc_iostream_get_transport (base));
+	if (capture == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	capture->iostream = base;
+	capture->timer = NULL;
+	capture->timestamp = 0;
+	capture->error = 0;
+
+	status = dc_timer_new (&capture->timer);
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR (context, "Failed to create a high resolution timer.");
+		goto error_free;
+	}
+
+	capture->fp = fopen (filename, "wb");
+	if (capture->fp == NULL) {
+		ERROR (context, "Failed to open the file.");
+		status = DC_STATUS_IO;
+		goto error_timer_free;
+	}
+
+	unsigned char header[SZ_HEADER];
+	memcpy (header, MAGIC, SZ_MAGIC);
+	array_uint32_le_set (header + SZ_MAGIC, dc_iostream_get_transport (base));
+	if (fwrite (header, sizeof (header), 1, capture->fp) != 1) {
+		ERROR (context, "Failed to write the file.");
+		status = DC_STATUS_IO;
+		goto error_fclose;
+	}
+
+	*out = (dc_iostream_t *) capture;
+
+	return DC_STATUS_SUCCESS;
+
+error_fclose:
+	fclose (capture->fp);
+error_timer_free:
+	dc_timer_free (capture->timer);
+error_free:
+	dc_iostream_deallocate ((dc_iostream_t *) capture);
+	return status;
+}
+
+static void
+dc_capture_record (dc_capture_t *capture, unsigned int type, dc_status_t status, unsigned int argument, const void *data, size_t size)
+{
+	dc_usecs_t now = 0, delta = 0;
+
+	if (capture->error)
+		return;
+
+	if (dc_timer_now (capture->timer, &now) == DC_STATUS_SUCCESS && now > capture->timestamp) {
+		delta = now - capture->timestamp;
+		capture->timestamp = now;
+	}
+
+	unsigned char header[SZ_RECORD];
+	header[0] = type;
+	header[1] = (unsigned char) (signed char) status;
+	array_uint32_le_set (header + 2, delta > 0xFFFFFFFF ? 0xFFFFFFFF : delta);
+	array_uint32_le_set (header + 6, argument);
+	array_uint32_le_set (header + 10, size);
+
+	if (fwrite (header, sizeof (header), 1, capture->fp) != 1 ||
+		(size && fwrite (data, size, 1, capture->fp) != 1)) {
+		ERROR (capture->base.context, "Failed to write the file.");
+		capture->error = 1;
+	}
+}
+
+static dc_status_t
+dc_capture_set_timeout (dc_iostream_t *abstract, int timeout)
+{
+	dc_capture_t *capture = (dc_capture_t *) abstract;
+
+	dc_status_t status = dc_iostream_set_timeout (capture->iostream, timeout);
+	dc_capture_record (capture, REC_TIMEOUT, status, (unsigned int) timeout, NULL, 0);
+
+	return status;
+}
+
+static dc_status_t
+dc_capture_set_latency (dc_iostream_t *abstract, unsigned int value)
+{
+	dc_capture_t *capture = (dc_capture_t *) abstract;
+
+	dc_status_t status = dc_iostream_set_latency (capture->iostream, value);
+	dc_capture_record (capture, REC_LATENCY, status, value, NULL, 0);
+
+	return status;
+}
+
+static dc_status_t
+dc_capture_set_break (dc_iostream_t *abstract, unsigned int value)
+{
+	dc_capture_t *capture = (dc_capture_t *) abstract;
+
+	dc_status_t status = dc_iostream_set_break (capture->iostream, value);
+	dc_capture_record (capture, REC_BREAK, status, value, NULL, 0);
+
+	return status;
+}
+
+static dc_status_t
+dc_capture_set_dtr (dc_iostream_t *abstract, unsigned int value)
+{
+	dc_capture_t *capture = (dc_capture_t *) abstract;
+
+	dc_status_t status = dc_iostream_set_dtr (capture->iostream, value);
+	dc_capture_record (capture, REC_DTR, status, value, NULL, 0);
+
+	return status;
+}
+
+static dc_status_t
+dc_capture_set_rts (dc_iostream_t *abstract, unsigned int value)
+{
+	dc_capture_t *capture = (dc_capture_t *) abstract;
+
+	dc_status_t status = dc_iostream_set_rts (capture->iostream, value);
+	dc_capture_record (capture, REC_RTS, status, value, NULL, 0);
+
+	return status;
+}
+
+static dc_status_t
+dc_capture_get_lines (dc_iostream_t *abstract, unsigned int *value)
+{
+	dc_capture_t *capture = (dc_capture_t *) abstract;
+	unsigned int lines = 0;
+
+	dc_status_t status = dc_iostream_get_lines (capture->iostream, &lines);
+	dc_capture_record (capture, REC_LINES, status, lines, NULL, 0);
+
+	if (value)
+		*value = lines;
+
+	return status;
+}
+
+static dc_status_t
+dc_capture_get_available (dc_iostream_t *abstract, size_t *value)
+{
+	dc_capture_t *capture = (dc_capture_t *) abstract;
+	size_t available = 0;
+
+	dc_status_t status = dc_iostream_get_available (capture->iostream, &available);
+	dc_capture_record (capture, REC_AVAILABLE, status, available, NULL, 0);
+
+	if (value)
+		*value = available;
+
+	return status;
+}
+
+static dc_status_t
+dc_capture_configure (dc_iostream_t *abstract, unsigned int baudrate, unsigned int databits, dc_parity_t parity, dc_stopbits_t stopbits, dc_flowcontrol_t flowcontrol)
+{
+	dc_capture_t *capture = (dc_capture_t *) abstract;
+
+	unsigned char data[16];
+	array_uint32_le_set (data +  0, databits);
+	array_uint32_le_set (data +  4, parity);
+	array_uint32_le_set (data +  8, stopbits);
+	array_uint32_le_set (data + 12, flowcontrol);
+
+	dc_status_t status = dc_iostream_configure (capture->iostream, baudrate, databits, parity, stopbits, flowcontrol);
+	dc_capture_record (capture, REC_CONFIGURE, status, baudrate, data, sizeof (data));
+
+	return status;
+}
+
+static dc_status_t
+dc_capture_read (dc_iostream_t *abstract, void *data, size_t size, size_t *actual)
+{
+	dc_capture_t *capture = (dc_capture_t *) abstract;
+	size_t nbytes = 0;
+
+	dc_status_t status = dc_iostream_read (capture->iostream, data, size, &nbytes);
+	dc_capture_record (capture, REC_READ, status, size, data, nbytes);
+
+	if (actual)
+		*actual = nbytes;
+
+	return status;
+}
+
+static dc_status_t
+dc_capture_write (dc_iostream_t *abstract, const void *data, size_t size, size_t *actual)
+{
+	dc_capture_t *capture = (dc_capture_t *) abstract;
+	size_t nbytes = 0;
+
+	dc_status_t status = dc_iostream_write (capture->iostream, data, size, &nbytes);
+	dc_capture_record (capture, REC_WRITE, status, nbytes, data, size);
+
+	if (actual)
+		*actual = nbytes;
+
+	return status;
+}
+
+static dc_status_t
+dc_capture_flush (dc_iostream_t *abstract)
+{
+	dc_capture_t *capture = (dc_capture_t *) abstract;
+
+	dc_status_t status = dc_iostream_flush (capture->iostream);
+	dc_capture_record (capture, REC_FLUSH, status, 0, NULL, 0);
+
+	return status;
+}
+
+static dc_status_t
+dc_capture_purge (dc_iostream_t *abstract, dc_direction_t direction)
+{
+	dc_capture_t *capture = (dc_capture_t *) abstract;
+
+	dc_status_t status = dc_iostream_purge (capture->iostream, direction);
+	dc_capture_record (capture, REC_PURGE, status, direction, NULL, 0);
+
+	return status;
+}
+
+static dc_status_t
+dc_capture_sleep (dc_iostream_t *abstract, unsigned int milliseconds)
+{
+	dc_capture_t *capture = (dc_capture_t *) abstract;
+
+	dc_status_t status = dc_iostream_sleep (capture->iostream, milliseconds);
+	dc_capture_record (capture, REC_SLEEP, status, milliseconds, NULL, 0);
+
+	return status;
+}
+
+static dc_status_t
+dc_capture_wait_readable (dc_iostream_t *abstract, int timeout)
+{
+	dc_capture_t *capture = (dc_capture_t *) abstract;
+
+	dc_status_t status = dc_iostream_wait_readable (capture->iostream, timeout);
+	dc_capture_record (capture, REC_WAIT, status, (unsigned int) timeout, NULL, 0);
+
+	return status;
+}
+
+static dc_status_t
+dc_capture_close (dc_iostream_t *abstract)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_capture_t *capture = (dc_capture_t *) abstract;
+	dc_status_t rc = DC_STATUS_SUCCESS;
+
+	rc = dc_iostream_close (capture->iostream);
+	if (rc != DC_STATUS_SUCCESS) {
+		dc_status_set_error(&status, rc);
+	}
+
+	if (fclose (capture->fp) != 0 || capture->error) {
+		ERROR (abstract->context, "Failed to write the file.");
+		dc_status_set_error(&status, DC_STATUS_IO);
+	}
+
+	dc_timer_free (capture->timer);
+
+	return status;
+}
+
+static const char *
+dc_capture_get_name (dc_iostream_t *abstract)
+{
+	dc_capture_t *capture = (dc_capture_t *) abstract;
+
+	return dc_iostream_get_name (capture->iostream);
+}
+
+dc_status_t
+dc_replay_open (dc_iostream_t **out, dc_context_t *context, const char *filename, unsigned int realtime)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_replay_t *replay = NULL;
+	dc_buffer_t *buffer = NULL;
+	FILE *fp = NULL;
+
+	if (out == NULL || filename == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	INFO (context, "Open: filename=%s, realtime=%u", filename, realtime);
+
+	buffer = dc_buffer_new (0);
+	if (buffer == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	// Read the entire file into memory.
+	fp = fopen (filename, "rb");
+	if (fp == NULL) {
+		ERROR (context, "Failed to open the file.");
+		status = DC_STATUS_IO;
+		goto error_buffer_free;
+	}
+
+	size_t n = 0;
+	unsigned char block[4096];
+	while ((n = fread (block, 1, sizeof (block), fp)) > 0) {
+		if (!dc_buffer_append (buffer, block, n)) {
+			ERROR (context, "Failed to allocate memory.");
+			fclose (fp);
+			status = DC_STATUS_NOMEMORY;
+			goto error_buffer_free;
+		}
+	}
+
+	fclose (fp);
+
+	const unsigned char *data = dc_buffer_get_data (buffer);
+	if (dc_buffer_get_size (buffer) < SZ_HEADER || memcmp (data, MAGIC, SZ_MAGIC) != 0) {
+		ERROR (context, "Invalid capture file.");
+		status = DC_STATUS_DATAFORMAT;
+		goto error_buffer_free;
+	}
+
+	// Allocate memory.
+	replay = (dc_replay_t *) dc_iostream_allocate (context, &dc_replay_vtable, array_uint32_le (data + SZ_MAGIC));
+	if (replay == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		status = DC_STATUS_NOMEMORY;
+		goto error_buffer_free;
+	}
+
+	replay->buffer = buffer;
+	replay->offset = SZ_HEADER;
+	replay->timer = NULL;
+	replay->timestamp = 0;
+	replay->realtime = realtime;
+
+	if (realtime) {
+		status = dc_timer_new (&replay->timer);
+		if (status != DC_STATUS_SUCCESS) {
+			ERROR (context, "Failed to create a high resolution timer.");
+			goto error_free;
+		}
+	}
+
+	*out = (dc_iostream_t *) replay;
+
+	return DC_STATUS_SUCCESS;
+
+error_free:
+	dc_iostream_deallocate ((dc_iostream_t *) replay);
+error_buffer_free:
+	dc_buffer_free (buffer);
+	return status;
+}
+
+static void
+dc_replay_wait (dc_replay_t *replay, dc_usecs_t timestamp)
+{
+	dc_usecs_t now = 0;
+
+	if (dc_timer_now (replay->timer, &now) != DC_STATUS_SUCCESS || now >= timestamp)
+		return;
+
+	dc_usecs_t delta = timestamp - now;
+#ifdef _WIN32
+	Sleep ((DWORD) (delta / 1000));
+#else
+	struct timespec ts;
+	ts.tv_sec  = (delta / 1000000);
+	ts.tv_nsec = (delta % 1000000) * 1000;
+
+	while (nanosleep (&ts, &ts) != 0) {
+		if (errno != EINTR)
+			break;
+	}
+#endif
+}
+
+/*
+ * Get the next record, and verify that it's the expected operation.
+ */
+static dc_status_t
+dc_replay_next (dc_replay_t *replay, unsigned int type, dc_record_t *record)
+{
+	const unsigned char *data = dc_buffer_get_data (replay->buffer);
+	size_t size = dc_buffer_get_size (replay->buffer);
+
+	if (size - replay->offset < SZ_RECORD) {
+		ERROR (replay->base.context, "Unexpected end of the capture file.");
+		return DC_STATUS_PROTOCOL;
+	}
+
+	const unsigned char *header = data + replay->offset;
+	unsigned int length = array_uint32_le (header + 10);
+	if (size - replay->offset - SZ_RECORD < length) {
+		ERROR (replay->base.context, "Unexpected end of the capture file.");
+		return DC_STATUS_PROTOCOL;
+	}
+
+	if (header[0] != type) {
+		ERROR (replay->base.context, "Unexpected operation (%u, %u).", header[0], type);
+		return DC_STATUS_PROTOCOL;
+	}
+
+	record->type = header[0];
+	record->status = (dc_status_t) (signed char) header[1];
+	record->argument = array_uint32_le (header + 6);
+	record->data = header + SZ_RECORD;
+	record->length = length;
+
+	replay->offset += SZ_RECORD + length;
+	replay->timestamp += array_uint32_le (header + 2);
+
+	if (replay->realtime)
+		dc_replay_wait (replay, replay->timestamp);
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_replay_simple (dc_iostream_t *abstract, unsigned int type, unsigned int argument)
+{
+	dc_replay_t *replay = (dc_replay_t *) abstract;
+	dc_record_t record;
+
+	dc_status_t status = dc_replay_next (replay, type, &record);
+	if (status != DC_STATUS_SUCCESS)
+		return status;
+
+	if (record.argument != argument) {
+		ERROR (abstract->context, "Unexpected argument (%u, %u).", argument, record.argument);
+		return DC_STATUS_PROTOCOL;
+	}
+
+	return record.status;
+}
+
+static dc_status_t
+dc_replay_set_timeout (dc_iostream_t *abstract, int timeout)
+{
+	return dc_replay_simple (abstract, REC_TIMEOUT, (unsigned int) timeout);
+}
+
+static dc_status_t
+dc_replay_set_latency (dc_iostream_t *abstract, unsigned int value)
+{
+	return dc_replay_simple (abstract, REC_LATENCY, value);
+}
+
+static dc_status_t
+dc_replay_set_break (dc_iostream_t *abstract, unsigned int value)
+{
+	return dc_replay_simple (abstract, REC_BREAK, value);
+}
+
+static dc_status_t
+dc_replay_set_dtr (dc_iostream_t *abstract, unsigned int value)
+{
+	return dc_replay_simple (abstract, REC_DTR, value);
+}
+
+static dc_status_t
+dc_replay_set_rts (dc_iostream_t *abstract, unsigned int value)
+{
+	return dc_replay_simple (abstract, REC_RTS, value);
+}
+
+static dc_status_t
+dc_replay_get_lines (dc_iostream_t *abstract, unsigned int *value)
+{
+	dc_replay_t *replay = (dc_replay_t *) abstract;
+	dc_record_t record;
+
+	dc_status_t status = dc_replay_next (replay, REC_LINES, &record);
+	if (status != DC_STATUS_SUCCESS)
+		return status;
+
+	if (value)
+		*value = record.argument;
+
+	return record.status;
+}
+
+static dc_status_t
+dc_replay_get_available (dc_iostream_t *abstract, size_t *value)
+{
+	dc_replay_t *replay = (dc_replay_t *) abstract;
+	dc_record_t record;
+
+	dc_status_t status = dc_replay_next (replay, REC_AVAILABLE, &record);
+	if (status != DC_STATUS_SUCCESS)
+		return status;
+
+	if (value)
+		*value = record.argument;
+
+	return record.status;
+}
+
+static dc_status_t
+dc_replay_configure (dc_iostream_t *abstract, unsigned int baudrate, unsigned int databits, dc_parity_t parity, dc_stopbits_t stopbits, dc_flowcontrol_t flowcontrol)
+{
+	dc_replay_t *replay = (dc_replay_t *) abstract;
+	dc_record_t record;
+
+	dc_status_t status = dc_replay_next (replay, REC_CONFIGURE, &record);
+	if (status != DC_STATUS_SUCCESS)
+		return status;
+
+	if (record.argument != baudrate || record.length != 16 ||
+		array_uint32_le (record.data +  0) != databits ||
+		array_uint32_le (record.data +  4) != (unsigned int) parity ||
+		array_uint32_le (record.data +  8) != (unsigned int) stopbits ||
+		array_uint32_le (record.data + 12) != (unsigned int) flowcontrol) {
+		ERROR (abstract->context, "Unexpected line settings.");
+		return DC_STATUS_PROTOCOL;
+	}
+
+	return record.status;
+}
+
+static dc_status_t
+dc_replay_read (dc_iostream_t *abstract, void *data, size_t size, size_t *actual)
+{
+	dc_replay_t *replay = (dc_replay_t *) abstract;
+	dc_record_t record;
+
+	if (actual)
+		*actual = 0;
+
+	dc_status_t status = dc_replay_next (replay, REC_READ, &record);
+	if (status != DC_STATUS_SUCCESS)
+		return status;
+
+	if (record.argument != size || record.length > size) {
+		ERROR (abstract->context, "Unexpected read size (" DC_PRINTF_SIZE ", %u).", size, record.argument);
+		return DC_STATUS_PROTOCOL;
+	}
+
+	memcpy (data, record.data, record.length);
+
+	if (actual)
+		*actual = record.length;
+
+	return record.status;
+}
+
+static dc_status_t
+dc_replay_write (dc_iostream_t *abstract, const void *data, size_t size, size_t *actual)
+{
+	dc_replay_t *replay = (dc_replay_t *) abstract;
+	dc_record_t record;
+
+	if (actual)
+		*actual = 0;
+
+	dc_status_t status = dc_replay_next (replay, REC_WRITE, &record);
+	if (status != DC_STATUS_SUCCESS)
+		return status;
+
+	if (record.length != size || memcmp (record.data, data, size) != 0) {
+		ERROR (abstract->context, "Unexpected write data.");
+		HEXDUMP (abstract->context, DC_LOGLEVEL_DEBUG, "Expected", record.data, record.length);
+		return DC_STATUS_PROTOCOL;
+	}
+
+	if (actual)
+		*actual = record.argument;
+
+	return record.status;
+}
+
+static dc_status_t
+dc_replay_flush (dc_iostream_t *abstract)
+{
+	return dc_replay_simple (abstract, REC_FLUSH, 0);
+}
+
+static dc_status_t
+dc_replay_purge (dc_iostream_t *abstract, dc_direction_t direction)
+{
+	return dc_replay_simple (abstract, REC_PURGE, direction);
+}
+
+static dc_status_t
+dc_replay_sleep (dc_iostream_t *abstract, unsigned int milliseconds)
+{
+	// Without the original timing, the sleep is skipped as well.
+	return dc_replay_simple (abstract, REC_SLEEP, milliseconds);
+}
+
+static dc_status_t
+dc_replay_wait_readable (dc_iostream_t *abstract, int timeout)
+{
+	return dc_replay_simple (abstract, REC_WAIT, (unsigned int) timeout);
+}
+
+static dc_status_t
+dc_replay_close (dc_iostream_t *abstract)
+{
+	dc_replay_t *replay = (dc_replay_t *) abstract;
+
+	if (replay->offset != dc_buffer_get_size (replay->buffer)) {
+		WARNING (abstract->context, "Capture file not replayed completely.");
+	}
+
+	dc_buffer_free (replay->buffer);
+	dc_timer_free (replay->timer);
+
+	return DC_STATUS_SUCCESS;
+}
@@ -41,9 +41,31 @@ checksum_xor_uint8 (const unsigned char data[], unsigned int size, unsigned char
 unsigned short
 checksum_crc16_ccitt (const unsigned char data[], unsigned int size, unsigned short init);
 
+unsigned short
+checksum_crc16r_ansi (const unsigned char data[], unsigned int size, unsigned short init);
+
 unsigned int
 checksum_crc32 (const unsigned char data[], unsigned int size);
 
+/*
+ * The 64 bit xxHash (XXH64) of the data. A fast non-cryptographic hash,
+ * compatible with the reference implementation.
+ */
+unsigned long long
+checksum_xxh64 (const unsigned char data[], unsigned int size, unsigned long long seed);
+
+/*
+ * Straightforward byte-at-a-time implementations of the crc algorithms
+ * above. They are kept as the reference for validating the optimized
+ * versions, and always return the same result.
+ */
+
+unsigned short
+checksum_crc16_ccitt_reference (const unsigned char data[], unsigned int size, unsigned short init);
+
+unsigned int
+checksum_crc32_reference (const unsigned char data[], unsigned int size);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -29,6 +29,7 @@
 #include "array.h"
 #include "ringbuffer.h"
 #include "rbstream.h"
+#include "buffered.h"
 
 #define C_ARRAY_SIZE(array) (sizeof (array) / sizeof *(array))
 
@@ -63,12 +64,18 @@ typedef struct cochran_data_t {
 	unsigned int logbook_size;
 } cochran_data_t;
 
+typedef struct cochran_dive_t {
+	unsigned int idx;
+	unsigned int sample_size;
+} cochran_dive_t;
+
 typedef struct cochran_device_layout_t {
 	unsigned int model;
 	unsigned int address_bits;
 	cochran_endian_t endian;
 	unsigned int baudrate;
 	unsigned int rbstream_size;
+	unsigned int rbstream_maxsize;
 	// Config data.
 	unsigned int cf_dive_count;
 	unsigned int cf_last_log;
@@ -94,6 +101,7 @@ typedef struct cochran_device_layout_t {
 typedef struct cochran_commander_device_t {
 	dc_device_t base;
 	dc_iostream_t *iostream;
+	dc_iostream_t *buffered;
 	const cochran_device_layout_t *layout;
 	unsigned char id[67];
 	unsigned char fingerprint[6];
@@ -103,6 +111,7 @@ static dc_status_t cochran_commander_device_set_fingerprint (dc_device_t *device
 static dc_status_t cochran_commander_device_read (dc_device_t *device, unsigned int address, unsigned char data[], unsigned int size);
 static dc_status_t cochran_commander_device_dump (dc_device_t *device, dc_buffer_t *data);
 static dc_status_t cochran_commander_device_foreach (dc_device_t *device, dc_dive_callback_t callback, void *userdata);
+static dc_status_t cochran_commander_device_close (dc_device_t *device);
 
 static const dc_device_vtable_t cochran_commander_device_vtable = {
 	sizeof (cochran_commander_device_t),
@@ -113,7 +122,7 @@ static const dc_device_vtable_t cochran_commander_device_vtable = {
 	cochran_commander_device_dump, /* dump */
 	cochran_commander_device_foreach, /* foreach */
 	NULL, /* timesync */
-	NULL /* close */
+	cochran_commander_device_close /* close */
 };
 
 // Cochran Commander TM, pre-dates pre-21000 s/n
@@ -123,6 +132,7 @@ static const cochran_device_layout_t cochran_cmdr_tm_device_layout = {
 	ENDIAN_WORD_BE,	// endian
 	9600,       // baudrate
 	4096,       // rbstream_size
+	0xF000,     // rbstream_maxsize
 	0x146,      // cf_dive_count
 	0x158,      // cf_last_log
 	0xffffff,   // cf_last_interdive
@@ -148,6 +158,7 @@ static const cochran_device_layout_t cochran_cmdr_1_device_layout = {
 	ENDIAN_WORD_BE,  // endian
 	115200,     // baudrate
 	32768,      // rbstream_size
+	0x40000,    // rbstream_maxsize
 	0x046,      // cf_dive_count
 	0x6c,       // cf_last_log
 	0x70,       // cf_last_interdive
@@ -174,6 +185,7 @@ static const cochran_device_layout_t cochran_cmdr_device_layout = {
 	ENDIAN_WORD_BE,  // endian
 	115200,     // baudrate
 	32768,      // rbstream_size
+	0x40000,    // rbstream_maxsize
 	0x046,      // cf_dive_count
 	0x06C,      // cf_last_log
 	0x070,      // cf_last_interdive
@@ -199,6 +211,7 @@ static const cochran_device_layout_t cochran_emc14_device_layout = {
 	ENDIAN_LE,  // endian
 	850000,     // baudrate
 	32768,      // rbstream_size
+	0x40000,    // rbstream_maxsize
 	0x0D2,      // cf_dive_count
 	0x13E,      // cf_last_log
 	0x142,      // cf_last_interdive
@@ -224,6 +237,7 @@ static const cochran_device_layout_t cochran_emc16_device_layout = {
 	ENDIAN_LE,  // endian
 	850000,     // baudrate
 	32768,      // rbstream_size
+	0x40000,    // rbstream_maxsize
 	0x0D2,      // cf_dive_count
 	0x13E,      // cf_last_log
 	0x142,      // cf_last_interdive
@@ -249,6 +263,7 @@ static const cochran_device_layout_t cochran_emc20_device_layout = {
 	ENDIAN_LE,  // endian
 	850000,     // baudrate
 	32768,      // rbstream_size
+	0x40000,    // rbstream_maxsize
 	0x0D2,      // cf_dive_count
 	0x13E,      // cf_last_log
 	0x142,      // cf_last_interdive
@@ -366,6 +381,9 @@ cochran_commander_packet (cochran_commander_device_t *device, dc_event_progress_
 		}
 	}
 
+	// Time the response, without the pacing of the command bytes.
+	dc_usecs_t start = device_latency_start (abstract);
+
 	if (high_speed && device->layout->baudrate != 9600) {
 		// Give the DC time to process the command.
 		dc_iostream_sleep(device->iostream, 45);
@@ -400,6 +418,8 @@ cochran_commander_packet (cochran_commander_device_t *device, dc_event_progress_
 		}
 	}
 
+	device_latency_emit (abstract, command[0], asize, start);
+
 	return DC_STATUS_SUCCESS;
 }
 
@@ -554,14 +574,25 @@ cochran_commander_read_retry (cochran_commander_device_t *device, dc_event_progr
 		if (rc != DC_STATUS_PROTOCOL && rc != DC_STATUS_TIMEOUT)
 			return rc;
 
-		// Abort if the maximum number of retries is reached.
-		if (nretries++ >= MAXRETRIES)
-			return rc;
-
 		// Restore the state of the progress events.
 		if (progress) {
 			progress->current = saved;
 		}
+
+		// Split a large block in two halves, such that another
+		// failure only needs to read one of them again.
+		if (size > device->layout->rbstream_size) {
+			unsigned int half = size / 2;
+			rc = cochran_commander_read_retry (device, progress, address, data, half);
+			if (rc != DC_STATUS_SUCCESS)
+				return rc;
+
+			return cochran_commander_read_retry (device, progress, address + half, data + half, size - half);
+		}
+
+		// Abort if the maximum number of retries is reached.
+		if (nretries++ >= MAXRETRIES)
+			return rc;
 	}
 
 	return rc;
@@ -731,8 +762,19 @@ cochran_commander_device_open (dc_device_t **out, dc_context_t *context, dc_iost
 
 	// Set the default values.
 	device->iostream = iostream;
+	device->buffered = NULL;
 	cochran_commander_device_set_fingerprint((dc_device_t *) device, NULL, 0);
 
+	// Buffer the small reads on the serial port.
+	if (dc_iostream_get_transport (iostream) == DC_TRANSPORT_SERIAL) {
+		status = dc_buffered_open (&device->buffered, context, iostream, 0);
+		if (status != DC_STATUS_SUCCESS) {
+			ERROR (context, "Failed to open the buffered I/O stream.");
+			goto error_free;
+		}
+		device->iostream = device->buffered;
+	}
+
 	status = cochran_commander_serial_setup(device);
 	if (status != DC_STATUS_SUCCESS) {
 		goto error_free;
@@ -776,10 +818,19 @@ cochran_commander_device_open (dc_device_t **out, dc_context_t *context, dc_iost
 	return DC_STATUS_SUCCESS;
 
 error_free:
+	dc_iostream_close (device->buffered);
 	dc_device_deallocate ((dc_device_t *) device);
 	return status;
 }
 
+static dc_status_t
+cochran_commander_device_close (dc_device_t *abstract)
+{
+	cochran_commander_device_t *device = (cochran_commander_device_t *) abstract;
+
+	return dc_iostream_close (device->buffered);
+}
+
 static dc_status_t
 cochran_commander_device_set_fingerprint (dc_device_t *abstract, const unsigned char data[], unsigned int size)
 {
@@ -857,6 +908,11 @@ cochran_commander_device_foreach (dc_device_t *abstract, dc_dive_callback_t call
 	const cochran_device_layout_t *layout = device->layout;
 	dc_status_t status = DC_STATUS_SUCCESS;
 	dc_rbstream_t *rbstream = NULL;
+	dc_rbstream_extent_t *extents = NULL;
+	cochran_dive_t *dives = NULL;
+	dc_buffer_t *profiles = NULL;
+	dc_buffer_t *dive = NULL;
+	size_t charged = 0;
 
 	cochran_data_t data;
 	data.logbook = NULL;
@@ -910,7 +966,7 @@ cochran_commander_device_foreach (dc_device_t *abstract, dc_dive_callback_t call
 	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
 
 	// Allocate space for log book.
-	data.logbook = (unsigned char *) malloc(data.logbook_size);
+	data.logbook = (unsigned char *) device_malloc(abstract, data.logbook_size);
 	if (data.logbook == NULL) {
 		ERROR (abstract->context, "Failed to allocate memory.");
 		return DC_STATUS_NOMEMORY;
@@ -966,15 +1022,40 @@ cochran_commander_device_foreach (dc_device_t *abstract, dc_dive_callback_t call
 		last_start_address = base + array_uint32_le(data.config + layout->cf_last_log );
 
 	// Create the ringbuffer stream.
-	status = dc_rbstream_new (&rbstream, abstract, 1, layout->rbstream_size, layout->rb_profile_begin, layout->rb_profile_end, last_start_address);
+	status = dc_rbstream_new (&rbstream, abstract, 1, layout->rbstream_size, layout->rb_profile_begin, layout->rb_profile_end, last_start_address, DC_RBSTREAM_BACKWARD);
 	if (status != DC_STATUS_SUCCESS) {
 		ERROR (abstract->context, "Failed to create the ringbuffer stream.");
 		goto error;
 	}
 
+	// Every read costs a baudrate change and a sleep, so read ahead.
+	status = dc_rbstream_set_maxsize (rbstream, layout->rbstream_maxsize);
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR (abstract->context, "Failed to set the read-ahead size.");
+		goto error;
+	}
+
+	if (dive_count == 0)
+		goto error;
+
+	// Allocate memory for the profile ranges.
+	extents = (dc_rbstream_extent_t *) malloc (dive_count * sizeof (dc_rbstream_extent_t));
+	dives = (cochran_dive_t *) malloc (dive_count * sizeof (cochran_dive_t));
+	profiles = dc_buffer_new (0);
+	dive = dc_buffer_new (0);
+	if (extents == NULL || dives == NULL || profiles == NULL || dive == NULL) {
+		ERROR (abstract->context, "Failed to allocate memory.");
+		status = DC_STATUS_NOMEMORY;
+		goto error;
+	}
+
 	int invalid_profile_flag = 0;
+	unsigned int position = last_start_address;
+	unsigned int count = 0;
 
-	// Loop through each dive
+	// Locate the profile data of each dive. The profiles are stored
+	// backwards from the most recent one, and each range also includes
+	// the pre-dive events of the next dive.
 	for (unsigned int i = 0; i < dive_count; ++i) {
 		unsigned int idx = (layout->rb_logbook_entry_count + head_dive - (i + 1)) % layout->rb_logbook_entry_count;
 
@@ -998,7 +1079,7 @@ cochran_commander_device_foreach (dc_device_t *abstract, dc_dive_callback_t call
 			sample_end_address = base + array_uint32_le (log_entry + layout->pt_profile_end);
 		}
 
-		int sample_size = 0, pre_size = 0;
+		unsigned int sample_size = 0, pre_size = 0;
 
 		// Determine if profile exists
 		if (idx == data.invalid_profile_dive_num)
@@ -1010,37 +1091,86 @@ cochran_commander_device_foreach (dc_device_t *abstract, dc_dive_callback_t call
 			last_start_address = sample_start_address;
 		}
 
-		// Build dive blob
-		unsigned int dive_size = layout->rb_logbook_entry_size + sample_size;
-		unsigned char *dive = (unsigned char *) malloc(dive_size + pre_size);
-		if (dive == NULL) {
-			status = DC_STATUS_NOMEMORY;
+		if (sample_size && sample_size + pre_size > max_sample) {
+			ERROR (abstract->context, "Profile size out of range (%u).", sample_size + pre_size);
+			sample_size = pre_size = 0;
+		}
+
+		// The profile is skipped if it doesn't exist, but the pre-dive
+		// events are only read together with a profile.
+		unsigned int size = sample_size ? sample_size + pre_size : 0;
+		if (size) {
+			position = ringbuffer_decrement (position, size, layout->rb_profile_begin, layout->rb_profile_end);
+		}
+
+		extents[count].address = position;
+		extents[count].size = size;
+		extents[count].data = NULL;
+		dives[count].idx = idx;
+		dives[count].sample_size = size ? sample_size : 0;
+		count++;
+	}
+
+	// Read all profiles at once, with as few high speed reads as possible.
+	// If that exceeds the memory budget, each profile is read separately
+	// instead, right before the dive is delivered.
+	unsigned int total = 0;
+	for (unsigned int i = 0; i < count; ++i) {
+		total += extents[i].size;
+	}
+
+	unsigned int batched = device_memory_fits (abstract, total);
+	if (batched) {
+		status = dc_rbstream_read_extents (rbstream, &progress, extents, count, profiles);
+		if (status != DC_STATUS_SUCCESS) {
+			ERROR (abstract->context, "Failed to read the sample data.");
 			goto error;
 		}
+	} else {
+		INFO (abstract->context, "Reading the profiles separately (%u bytes).", total);
+	}
 
-		memcpy(dive, log_entry, layout->rb_logbook_entry_size); // log
+	// Deliver each dive, with its slice of the profile data.
+	for (unsigned int i = 0; i < count; ++i) {
+		unsigned char *log_entry = data.logbook + dives[i].idx * layout->rb_logbook_entry_size;
 
-		// Read profile data
-		if (sample_size) {
-			rc = dc_rbstream_read(rbstream, &progress, dive + layout->rb_logbook_entry_size, sample_size + pre_size);
-			if (rc != DC_STATUS_SUCCESS) {
+		if (!batched) {
+			status = dc_rbstream_read_extents (rbstream, &progress, extents + i, 1, profiles);
+			if (status != DC_STATUS_SUCCESS) {
 				ERROR (abstract->context, "Failed to read the sample data.");
-				status = rc;
-				free(dive);
 				goto error;
 			}
 		}
 
-		if (callback && !callback (dive, dive_size, dive + layout->pt_fingerprint, layout->fingerprint_size, userdata)) {
-			free(dive);
-			break;
+		// Build dive blob, without the pre-dive events of the next dive.
+		unsigned int dive_size = layout->rb_logbook_entry_size + dives[i].sample_size;
+		if (!dc_buffer_clear (dive) ||
+			!dc_buffer_append (dive, log_entry, layout->rb_logbook_entry_size) ||
+			!dc_buffer_append (dive, extents[i].data, dives[i].sample_size)) {
+			ERROR (abstract->context, "Insufficient buffer space available.");
+			status = DC_STATUS_NOMEMORY;
+			goto error;
 		}
 
-		free(dive);
+		// Account the memory of the profile data.
+		size_t capacity = dc_buffer_get_capacity (profiles) + dc_buffer_get_capacity (dive);
+		if (capacity > charged) {
+			device_memory_charge (abstract, capacity - charged);
+			charged = capacity;
+		}
+
+		unsigned char *blob = dc_buffer_get_data (dive);
+		if (callback && !callback (blob, dive_size, blob + layout->pt_fingerprint, layout->fingerprint_size, userdata))
+			break;
 	}
 
 error:
+	device_memory_release(abstract, charged);
+	dc_buffer_free(dive);
+	dc_buffer_free(profiles);
+	free(dives);
+	free(extents);
 	dc_rbstream_free(rbstream);
-	free(data.logbook);
+	device_free(abstract, data.logbook);
 	return status;
 }
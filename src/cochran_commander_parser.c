@@ -19,7 +19,10 @@
  * MA 02110-1301 USA
  */
 
+#define LOG_SUBSYSTEM DC_LOGSUBSYSTEM_PARSER
+
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 
 #include <libdivecomputer/units.h>
@@ -99,6 +102,9 @@ typedef struct cochran_commander_parser_t {
 	const cochran_parser_layout_t *layout;
 	const event_size_t *events;
 	unsigned int nevents;
+	// Cached fields.
+	unsigned int corrupt;
+	unsigned int profile_size;
 } cochran_commander_parser_t ;
 
 static dc_status_t cochran_commander_parser_set_data (dc_parser_t *parser, const unsigned char *data, unsigned int size);
@@ -325,28 +331,46 @@ cochran_commander_handle_event (cochran_commander_parser_t *parser, unsigned cha
 /*
  * Used to find the end of a dive that has an incomplete dive-end
  * block. It parses backwards past inter-dive events.
+ *
+ * Because the events vary in size, a byte that matches an event code
+ * can also be data from inside a longer or shorter event. Instead of
+ * trying every combination, all positions that can be reached from the
+ * end by stepping back over whole events are marked in a single pass,
+ * and the smallest one is returned.
  */
-static int
-cochran_commander_backparse(cochran_commander_parser_t *parser, const unsigned char *samples, int size)
+static dc_status_t
+cochran_commander_backparse(cochran_commander_parser_t *parser, const unsigned char *samples, unsigned int size, unsigned int *result)
 {
-	int result = size, best_result = size;
-
-	for (unsigned int i = 0; i < parser->nevents; i++) {
-		int ptr = size - parser->events[i].size;
-		if (ptr > 0 && samples[ptr] == parser->events[i].code) {
-			// Recurse to find the largest match. Because we are parsing backwards
-			// and the events vary in size we can't be sure the byte that matches
-			// the event code is an event code or data from inside a longer or shorter
-			// event.
-			result = cochran_commander_backparse(parser, samples, ptr);
-		}
+	dc_context_t *context = parser->base.context;
+
+	unsigned char *reachable = (unsigned char *) dc_malloc (context, size + 1);
+	if (reachable == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+	memset (reachable, 0, size + 1);
+	reachable[size] = 1;
 
-		if (result < best_result) {
-			best_result = result;
+	unsigned int best = size;
+	for (unsigned int ptr = size; ptr > 0; --ptr) {
+		if (!reachable[ptr])
+			continue;
+
+		best = ptr;
+
+		for (unsigned int i = 0; i < parser->nevents; i++) {
+			unsigned int n = parser->events[i].size;
+			if (ptr > n && samples[ptr - n] == parser->events[i].code) {
+				reachable[ptr - n] = 1;
+			}
 		}
 	}
 
-	return best_result;
+	dc_free (context, reachable);
+
+	*result = best;
+
+	return DC_STATUS_SUCCESS;
 }
 
 
@@ -367,6 +391,8 @@ cochran_commander_parser_create (dc_parser_t **out, dc_context_t *context, unsig
 	}
 
 	parser->model = model;
+	parser->corrupt = 0;
+	parser->profile_size = 0;
 
 	switch (model) {
 	case COCHRAN_MODEL_COMMANDER_TM:
@@ -409,6 +435,27 @@ error_free:
 static dc_status_t
 cochran_commander_parser_set_data (dc_parser_t *abstract, const unsigned char *data, unsigned int size)
 {
+	cochran_commander_parser_t *parser = (cochran_commander_parser_t *) abstract;
+	const cochran_parser_layout_t *layout = parser->layout;
+
+	parser->corrupt = 0;
+	parser->profile_size = 0;
+
+	if (layout->format == SAMPLE_TM || size < layout->headersize)
+		return DC_STATUS_SUCCESS;
+
+	parser->profile_size = size - layout->headersize;
+
+	// In rare circumstances Cochran computers won't record the end-of-dive
+	// log entry block. When the end-sample pointer is 0xFFFFFFFF it's corrupt.
+	// That means we don't really know where the dive samples end, so the
+	// inter-dive events are eliminated from the end of the profile.
+	if (array_uint32_le(data + layout->pt_profile_end) == 0xFFFFFFFF) {
+		parser->corrupt = 1;
+		return cochran_commander_backparse (parser, data + layout->headersize,
+			parser->profile_size, &parser->profile_size);
+	}
+
 	return DC_STATUS_SUCCESS;
 }
 
@@ -448,7 +495,7 @@ cochran_commander_parser_get_datetime (dc_parser_t *abstract, dc_datetime_t *dat
 			break;
 		case DATE_ENCODING_TICKS:
 			ts = array_uint32_le(data + layout->datetime) + COCHRAN_EPOCH;
-			dc_datetime_localtime(datetime, ts);
+			dc_context_localtime (abstract->context, datetime, ts);
 			break;
 		}
 	}
@@ -673,7 +720,7 @@ cochran_commander_parser_samples_foreach_emc (dc_parser_t *abstract, dc_sample_c
 	if (abstract->size < layout->headersize)
 		return DC_STATUS_DATAFORMAT;
 
-	unsigned int size = abstract->size - layout->headersize;
+	unsigned int size = parser->profile_size;
 
 	dc_sample_value_t sample = {0};
 	unsigned int time = 0, last_sample_time = 0;
@@ -682,22 +729,18 @@ cochran_commander_parser_samples_foreach_emc (dc_parser_t *abstract, dc_sample_c
 	int depth = 0;
 	unsigned int deco_obligation = 0;
 	unsigned int deco_ceiling = 0;
-	unsigned int corrupt_dive = 0;
+	unsigned int corrupt_dive = parser->corrupt;
 
 	// In rare circumstances Cochran computers won't record the end-of-dive
 	// log entry block. When the end-sample pointer is 0xFFFFFFFF it's corrupt.
 	// That means we don't really know where the dive samples end and we don't
 	// know what the dive summary values are (i.e. max depth, min temp)
-	if (array_uint32_le(data + layout->pt_profile_end) == 0xFFFFFFFF) {
-		corrupt_dive = 1;
+	if (corrupt_dive) {
 		dc_datetime_t d;
 		cochran_commander_parser_get_datetime(abstract, &d);
 
 		WARNING(abstract->context, "Incomplete dive on %02d/%02d/%02d at %02d:%02d:%02d, trying to parse samples",
 				d.year, d.month, d.day, d.hour, d.minute, d.second);
-
-		// Eliminate inter-dive events
-		size = cochran_commander_backparse(parser, samples, size);
 	}
 
 	// Cochran samples depth every second and varies between ascent rate
@@ -0,0 +1,1015 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_MMAP)
+#include <sys/mman.h>
+#define USE_MMAP
+#endif
+
+#include <libdivecomputer/columnar.h>
+
+#include "context-private.h"
+#include "parser-private.h"
+#include "array.h"
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+#define C_ARRAY_SIZE(array) (sizeof (array) / sizeof *(array))
+
+#define MAGIC 0x53434344 /* "DCCS" */
+
+#define SZ_HEADER     28
+#define SZ_DIRECTORY  16
+#define SZ_DICTIONARY 12
+
+#define NONAME    0xFFFFFFFF
+#define MAXFIELDS 3
+
+// Resolution of the floating point values.
+#define SCALE_DEPTH       1000.0
+#define SCALE_TEMPERATURE 100.0
+#define SCALE_PRESSURE    1000.0
+#define SCALE_PPO2        1000.0
+#define SCALE_CNS         10000.0
+#define SCALE_LOCATION    10000000.0
+
+/*
+ * The number of values per entry, for each sample type. Sample types
+ * without any values are not stored.
+ */
+static const unsigned int g_nfields[] = {
+	1, /* DC_SAMPLE_TIME */
+	1, /* DC_SAMPLE_DEPTH */
+	1, /* DC_SAMPLE_PRESSURE */
+	1, /* DC_SAMPLE_TEMPERATURE */
+	3, /* DC_SAMPLE_EVENT */
+	1, /* DC_SAMPLE_RBT */
+	1, /* DC_SAMPLE_HEARTBEAT */
+	1, /* DC_SAMPLE_BEARING */
+	0, /* DC_SAMPLE_VENDOR */
+	1, /* DC_SAMPLE_SETPOINT */
+	1, /* DC_SAMPLE_PPO2 */
+	1, /* DC_SAMPLE_CNS */
+	3, /* DC_SAMPLE_DECO */
+	1, /* DC_SAMPLE_GASMIX */
+	1, /* DC_SAMPLE_TTS */
+	3, /* DC_SAMPLE_LOCATION */
+};
+
+typedef struct columnar_column_t {
+	unsigned int type;
+	unsigned int index;
+	unsigned int count;
+	unsigned int row;
+	long long last[MAXFIELDS];
+	dc_buffer_t *data;
+} columnar_column_t;
+
+typedef struct columnar_event_t {
+	unsigned int type;
+	unsigned int flags;
+	unsigned int name;
+} columnar_event_t;
+
+typedef struct columnar_encoder_t {
+	dc_context_t *context;
+	columnar_column_t *columns;
+	unsigned int ncolumns;
+	unsigned int capacity;
+	columnar_event_t *events;
+	unsigned int nevents;
+	unsigned int maxevents;
+	dc_buffer_t *strings;
+	unsigned int nrows;
+	dc_status_t status;
+} columnar_encoder_t;
+
+typedef struct columnar_cursor_t {
+	const unsigned char *data;
+	const unsigned char *end;
+	unsigned int type;
+	unsigned int index;
+	unsigned int remaining;
+	unsigned int row;
+	long long value[MAXFIELDS];
+} columnar_cursor_t;
+
+struct dc_columnar_t {
+	dc_context_t *context;
+	unsigned char *data;
+	size_t size;
+	int mapped;
+	// Offsets of the blocks.
+	size_t *blocks;
+	unsigned int count;
+};
+
+static long long
+columnar_quantize (double value, double scale)
+{
+	if (!isfinite (value))
+		return 0;
+
+	return llround (value * scale);
+}
+
+static int
+columnar_put_varint (dc_buffer_t *buffer, unsigned long long value)
+{
+	unsigned char data[10];
+	unsigned int n = 0;
+
+	while (value >= 0x80) {
+		data[n++] = (value & 0x7F) | 0x80;
+		value >>= 7;
+	}
+	data[n++] = value;
+
+	return dc_buffer_append (buffer, data, n);
+}
+
+static int
+columnar_get_varint (const unsigned char **data, const unsigned char *end, unsigned long long *value)
+{
+	const unsigned char *p = *data;
+	unsigned long long result = 0;
+	unsigned int shift = 0;
+
+	for (;;) {
+		if (p == end || shift > 63)
+			return 0;
+		unsigned char c = *p++;
+		result |= (unsigned long long) (c & 0x7F) << shift;
+		if ((c & 0x80) == 0)
+			break;
+		shift += 7;
+	}
+
+	*data = p;
+	*value = result;
+
+	return 1;
+}
+
+static dc_status_t
+columnar_event_lookup (columnar_encoder_t *encoder, unsigned int type, unsigned int flags, const char *name, unsigned int *index)
+{
+	for (unsigned int i = 0; i < encoder->nevents; ++i) {
+		const columnar_event_t *event = encoder->events + i;
+		if (event->type != type || event->flags != flags)
+			continue;
+		if (name == NULL && event->name == NONAME)
+			goto found;
+		if (name != NULL && event->name != NONAME &&
+			strcmp (name, (const char *) dc_buffer_get_data (encoder->strings) + event->name) == 0)
+			goto found;
+		continue;
+found:
+		*index = i;
+		return DC_STATUS_SUCCESS;
+	}
+
+	if (encoder->nevents == encoder->maxevents) {
+		unsigned int maxevents = encoder->maxevents ? encoder->maxevents * 2 : 16;
+		columnar_event_t *events = (columnar_event_t *) dc_realloc (encoder->context,
+			encoder->events, maxevents * sizeof (columnar_event_t));
+		if (events == NULL)
+			return DC_STATUS_NOMEMORY;
+		encoder->events = events;
+		encoder->maxevents = maxevents;
+	}
+
+	columnar_event_t *event = encoder->events + encoder->nevents;
+	event->type = type;
+	event->flags = flags;
+	event->name = NONAME;
+	if (name) {
+		event->name = dc_buffer_get_size (encoder->strings);
+		if (!dc_buffer_append (encoder->strings, (const unsigned char *) name, strlen (name) + 1))
+			return DC_STATUS_NOMEMORY;
+	}
+
+	*index = encoder->nevents++;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static columnar_column_t *
+columnar_column_lookup (columnar_encoder_t *encoder, unsigned int type, unsigned int index)
+{
+	for (unsigned int i = 0; i < encoder->ncolumns; ++i) {
+		if (encoder->columns[i].type == type && encoder->columns[i].index == index)
+			return encoder->columns + i;
+	}
+
+	if (encoder->ncolumns == encoder->capacity) {
+		unsigned int capacity = encoder->capacity ? encoder->capacity * 2 : 16;
+		columnar_column_t *columns = (columnar_column_t *) dc_realloc (encoder->context,
+			encoder->columns, capacity * sizeof (columnar_column_t));
+		if (columns == NULL)
+			return NULL;
+		encoder->columns = columns;
+		encoder->capacity = capacity;
+	}
+
+	columnar_column_t *column = encoder->columns + encoder->ncolumns;
+	memset (column, 0, sizeof (columnar_column_t));
+	column->type = type;
+	column->index = index;
+	column->data = dc_buffer_new (0);
+	if (column->data == NULL)
+		return NULL;
+
+	encoder->ncolumns++;
+
+	return column;
+}
+
+static void
+columnar_encode_cb (dc_sample_type_t type, dc_sample_value_t value, void *userdata)
+{
+	columnar_encoder_t *encoder = (columnar_encoder_t *) userdata;
+	long long fields[MAXFIELDS] = {0};
+	unsigned int index = 0;
+
+	if (encoder->status != DC_STATUS_SUCCESS)
+		return;
+
+	if (type == DC_SAMPLE_TIME)
+		encoder->nrows++;
+
+	if (encoder->nrows == 0 || (unsigned int) type >= C_ARRAY_SIZE (g_nfields) || g_nfields[type] == 0)
+		return;
+
+	switch (type) {
+	case DC_SAMPLE_TIME:
+		fields[0] = value.time;
+		break;
+	case DC_SAMPLE_DEPTH:
+		fields[0] = columnar_quantize (value.depth, SCALE_DEPTH);
+		break;
+	case DC_SAMPLE_PRESSURE:
+		index = value.pressure.tank;
+		fields[0] = columnar_quantize (value.pressure.value, SCALE_PRESSURE);
+		break;
+	case DC_SAMPLE_TEMPERATURE:
+		fields[0] = columnar_quantize (value.temperature, SCALE_TEMPERATURE);
+		break;
+	case DC_SAMPLE_EVENT:
+		{
+			unsigned int event = 0;
+			const char *name = value.event.type == SAMPLE_EVENT_STRING ? value.event.name : NULL;
+			encoder->status = columnar_event_lookup (encoder, value.event.type, value.event.flags, name, &event);
+			if (encoder->status != DC_STATUS_SUCCESS) {
+				ERROR (encoder->context, "Failed to allocate memory.");
+				return;
+			}
+			fields[0] = event;
+			fields[1] = value.event.time;
+			fields[2] = value.event.value;
+		}
+		break;
+	case DC_SAMPLE_RBT:
+		fields[0] = value.rbt;
+		break;
+	case DC_SAMPLE_HEARTBEAT:
+		fields[0] = value.heartbeat;
+		break;
+	case DC_SAMPLE_BEARING:
+		fields[0] = value.bearing;
+		break;
+	case DC_SAMPLE_SETPOINT:
+		fields[0] = columnar_quantize (value.setpoint, SCALE_PPO2);
+		break;
+	case DC_SAMPLE_PPO2:
+		fields[0] = columnar_quantize (value.ppo2, SCALE_PPO2);
+		break;
+	case DC_SAMPLE_CNS:
+		fields[0] = columnar_quantize (value.cns, SCALE_CNS);
+		break;
+	case DC_SAMPLE_DECO:
+		fields[0] = value.deco.type;
+		fields[1] = value.deco.time;
+		fields[2] = columnar_quantize (value.deco.depth, SCALE_DEPTH);
+		break;
+	case DC_SAMPLE_GASMIX:
+		fields[0] = value.gasmix;
+		break;
+	case DC_SAMPLE_TTS:
+		fields[0] = value.time;
+		break;
+	case DC_SAMPLE_LOCATION:
+		fields[0] = columnar_quantize (value.location.latitude, SCALE_LOCATION);
+		fields[1] = columnar_quantize (value.location.longitude, SCALE_LOCATION);
+		fields[2] = columnar_quantize (value.location.altitude, SCALE_DEPTH);
+		break;
+	default:
+		return;
+	}
+
+	columnar_column_t *column = columnar_column_lookup (encoder, type, index);
+	if (column == NULL) {
+		ERROR (encoder->context, "Failed to allocate memory.");
+		encoder->status = DC_STATUS_NOMEMORY;
+		return;
+	}
+
+	unsigned int row = encoder->nrows - 1;
+	int success = columnar_put_varint (column->data, row - column->row);
+	for (unsigned int i = 0; i < g_nfields[type]; ++i) {
+		// Zigzag encoding of the signed difference.
+		unsigned long long delta = (unsigned long long) fields[i] - (unsigned long long) column->last[i];
+		success &= columnar_put_varint (column->data, (delta << 1) ^ (0 - (delta >> 63)));
+		column->last[i] = fields[i];
+	}
+	if (!success) {
+		ERROR (encoder->context, "Failed to allocate memory.");
+		encoder->status = DC_STATUS_NOMEMORY;
+		return;
+	}
+
+	column->row = row;
+	column->count++;
+}
+
+static int
+columnar_column_compare (const void *a, const void *b)
+{
+	const columnar_column_t *ca = (const columnar_column_t *) a;
+	const columnar_column_t *cb = (const columnar_column_t *) b;
+
+	if (ca->type != cb->type)
+		return ca->type < cb->type ? -1 : 1;
+	if (ca->index != cb->index)
+		return ca->index < cb->index ? -1 : 1;
+	return 0;
+}
+
+dc_status_t
+dc_parser_export_columnar (dc_parser_t *parser, dc_buffer_t *buffer)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (parser == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (buffer == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	columnar_encoder_t encoder = {0};
+	encoder.context = parser->context;
+	encoder.status = DC_STATUS_SUCCESS;
+	encoder.strings = dc_buffer_new (0);
+	if (encoder.strings == NULL) {
+		ERROR (parser->context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	status = dc_parser_samples_foreach (parser, columnar_encode_cb, &encoder);
+	if (status == DC_STATUS_SUCCESS)
+		status = encoder.status;
+	if (status != DC_STATUS_SUCCESS)
+		goto cleanup;
+
+	qsort (encoder.columns, encoder.ncolumns, sizeof (columnar_column_t), columnar_column_compare);
+
+	unsigned long long size = SZ_HEADER +
+		encoder.ncolumns * SZ_DIRECTORY +
+		encoder.nevents * SZ_DICTIONARY +
+		dc_buffer_get_size (encoder.strings);
+	for (unsigned int i = 0; i < encoder.ncolumns; ++i) {
+		size += dc_buffer_get_size (encoder.columns[i].data);
+	}
+
+	if (size > 0xFFFFFFFF) {
+		ERROR (parser->context, "Sample data too large.");
+		status = DC_STATUS_DATAFORMAT;
+		goto cleanup;
+	}
+
+	size_t offset = dc_buffer_get_size (buffer);
+	if (!dc_buffer_resize (buffer, offset + size)) {
+		ERROR (parser->context, "Failed to allocate memory.");
+		status = DC_STATUS_NOMEMORY;
+		goto cleanup;
+	}
+
+	unsigned char *p = dc_buffer_get_data (buffer) + offset;
+	array_uint32_le_set (p + 0, MAGIC);
+	array_uint32_le_set (p + 4, DC_COLUMNAR_VERSION);
+	array_uint32_le_set (p + 8, size);
+	array_uint32_le_set (p + 12, encoder.nrows);
+	array_uint32_le_set (p + 16, encoder.ncolumns);
+	array_uint32_le_set (p + 20, encoder.nevents);
+	array_uint32_le_set (p + 24, dc_buffer_get_size (encoder.strings));
+	p += SZ_HEADER;
+
+	for (unsigned int i = 0; i < encoder.ncolumns; ++i) {
+		array_uint32_le_set (p + 0, encoder.columns[i].type);
+		array_uint32_le_set (p + 4, encoder.columns[i].index);
+		array_uint32_le_set (p + 8, encoder.columns[i].count);
+		array_uint32_le_set (p + 12, dc_buffer_get_size (encoder.columns[i].data));
+		p += SZ_DIRECTORY;
+	}
+
+	for (unsigned int i = 0; i < encoder.nevents; ++i) {
+		array_uint32_le_set (p + 0, encoder.events[i].type);
+		array_uint32_le_set (p + 4, encoder.events[i].flags);
+		array_uint32_le_set (p + 8, encoder.events[i].name);
+		p += SZ_DICTIONARY;
+	}
+
+	memcpy (p, dc_buffer_get_data (encoder.strings), dc_buffer_get_size (encoder.strings));
+	p += dc_buffer_get_size (encoder.strings);
+
+	for (unsigned int i = 0; i < encoder.ncolumns; ++i) {
+		memcpy (p, dc_buffer_get_data (encoder.columns[i].data), dc_buffer_get_size (encoder.columns[i].data));
+		p += dc_buffer_get_size (encoder.columns[i].data);
+	}
+
+cleanup:
+	for (unsigned int i = 0; i < encoder.ncolumns; ++i) {
+		dc_buffer_free (encoder.columns[i].data);
+	}
+	dc_free (encoder.context, encoder.columns);
+	dc_free (encoder.context, encoder.events);
+	dc_buffer_free (encoder.strings);
+
+	return status;
+}
+
+/*
+ * Check the block at the start of the data, and return its size, or zero
+ * if the block is invalid.
+ */
+static size_t
+columnar_validate (const unsigned char *data, size_t size)
+{
+	if (size < SZ_HEADER ||
+		array_uint32_le (data + 0) != MAGIC ||
+		array_uint32_le (data + 4) != DC_COLUMNAR_VERSION)
+		return 0;
+
+	size_t length = array_uint32_le (data + 8);
+	unsigned int ncolumns = array_uint32_le (data + 16);
+	unsigned int nevents = array_uint32_le (data + 20);
+	unsigned int nstrings = array_uint32_le (data + 24);
+	if (length < SZ_HEADER || length > size)
+		return 0;
+
+	unsigned long long total = SZ_HEADER +
+		(unsigned long long) ncolumns * SZ_DIRECTORY +
+		(unsigned long long) nevents * SZ_DICTIONARY +
+		nstrings;
+	if (total > length)
+		return 0;
+
+	const unsigned char *directory = data + SZ_HEADER;
+	for (unsigned int i = 0; i < ncolumns; ++i) {
+		unsigned int type = array_uint32_le (directory + i * SZ_DIRECTORY);
+		if (type >= C_ARRAY_SIZE (g_nfields) || g_nfields[type] == 0)
+			return 0;
+		total += array_uint32_le (directory + i * SZ_DIRECTORY + 12);
+	}
+	if (total != length)
+		return 0;
+
+	// The names are null terminated strings in the string area.
+	const unsigned char *dictionary = directory + ncolumns * SZ_DIRECTORY;
+	const unsigned char *strings = dictionary + nevents * SZ_DICTIONARY;
+	if (nstrings && strings[nstrings - 1] != 0)
+		return 0;
+	for (unsigned int i = 0; i < nevents; ++i) {
+		unsigned int name = array_uint32_le (dictionary + i * SZ_DICTIONARY + 8);
+		if (name != NONAME && name >= nstrings)
+			return 0;
+	}
+
+	return length;
+}
+
+dc_status_t
+dc_columnar_open (dc_columnar_t **out, dc_context_t *context, const char *filename)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_columnar_t *reader = NULL;
+
+	if (out == NULL || filename == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	reader = (dc_columnar_t *) dc_malloc (context, sizeof (dc_columnar_t));
+	if (reader == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	memset (reader, 0, sizeof (dc_columnar_t));
+	reader->context = context;
+
+	int fd = open (filename, O_RDONLY | O_BINARY);
+	if (fd < 0) {
+		SYSERROR (context, errno);
+		ERROR (context, "Failed to open the file '%s'.", filename);
+		dc_free (context, reader);
+		return DC_STATUS_IO;
+	}
+
+	struct stat st;
+	if (fstat (fd, &st) != 0) {
+		SYSERROR (context, errno);
+		status = DC_STATUS_IO;
+		goto error_close;
+	}
+
+	reader->size = st.st_size;
+	if (reader->size) {
+#ifdef USE_MMAP
+		void *map = mmap (NULL, reader->size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (map != MAP_FAILED) {
+			reader->data = (unsigned char *) map;
+			reader->mapped = 1;
+		}
+#endif
+		if (reader->data == NULL) {
+			// Without mmap support, read the entire file into memory.
+			reader->data = (unsigned char *) dc_malloc (context, reader->size);
+			if (reader->data == NULL) {
+				ERROR (context, "Failed to allocate memory.");
+				status = DC_STATUS_NOMEMORY;
+				goto error_close;
+			}
+
+			size_t nbytes = 0;
+			while (nbytes < reader->size) {
+				int n = read (fd, reader->data + nbytes, reader->size - nbytes);
+				if (n <= 0) {
+					if (n < 0 && errno == EINTR)
+						continue;
+					ERROR (context, "Failed to read the file '%s'.", filename);
+					status = DC_STATUS_IO;
+					goto error_close;
+				}
+				nbytes += n;
+			}
+		}
+	}
+
+	// Index the blocks.
+	unsigned int capacity = 0;
+	size_t offset = 0;
+	while (offset < reader->size) {
+		size_t n = columnar_validate (reader->data + offset, reader->size - offset);
+		if (n == 0) {
+			ERROR (context, "Invalid block at offset %lu.", (unsigned long) offset);
+			status = DC_STATUS_DATAFORMAT;
+			goto error_close;
+		}
+
+		if (reader->count == capacity) {
+			capacity = capacity ? capacity * 2 : 256;
+			size_t *blocks = (size_t *) dc_realloc (context, reader->blocks, capacity * sizeof (size_t));
+			if (blocks == NULL) {
+				ERROR (context, "Failed to allocate memory.");
+				status = DC_STATUS_NOMEMORY;
+				goto error_close;
+			}
+			reader->blocks = blocks;
+		}
+
+		reader->blocks[reader->count++] = offset;
+		offset += n;
+	}
+
+	close (fd);
+
+	*out = reader;
+
+	return DC_STATUS_SUCCESS;
+
+error_close:
+	close (fd);
+	dc_columnar_close (reader);
+	return status;
+}
+
+unsigned int
+dc_columnar_get_count (dc_columnar_t *reader)
+{
+	if (reader == NULL)
+		return 0;
+
+	return reader->count;
+}
+
+dc_status_t
+dc_columnar_get_rows (dc_columnar_t *reader, unsigned int dive, unsigned int *rows)
+{
+	if (reader == NULL || dive >= reader->count || rows == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	*rows = array_uint32_le (reader->data + reader->blocks[dive] + 12);
+
+	return DC_STATUS_SUCCESS;
+}
+
+/*
+ * Initialize the cursor for the given column of the block.
+ */
+static void
+columnar_cursor_init (const unsigned char *block, unsigned int column, columnar_cursor_t *cursor)
+{
+	unsigned int ncolumns = array_uint32_le (block + 16);
+	unsigned int nevents = array_uint32_le (block + 20);
+	unsigned int nstrings = array_uint32_le (block + 24);
+
+	const unsigned char *directory = block + SZ_HEADER;
+	const unsigned char *data = directory + ncolumns * SZ_DIRECTORY + nevents * SZ_DICTIONARY + nstrings;
+	for (unsigned int i = 0; i < column; ++i) {
+		data += array_uint32_le (directory + i * SZ_DIRECTORY + 12);
+	}
+
+	directory += column * SZ_DIRECTORY;
+	memset (cursor, 0, sizeof (columnar_cursor_t));
+	cursor->type = array_uint32_le (directory + 0);
+	cursor->index = array_uint32_le (directory + 4);
+	cursor->remaining = array_uint32_le (directory + 8);
+	cursor->data = data;
+	cursor->end = data + array_uint32_le (directory + 12);
+}
+
+/*
+ * Decode the next entry of the column. Returns one on success, zero at
+ * the end of the column and a negative value for corrupt data.
+ */
+static int
+columnar_cursor_next (columnar_cursor_t *cursor)
+{
+	unsigned long long value = 0;
+
+	if (cursor->remaining == 0)
+		return 0;
+
+	if (!columnar_get_varint (&cursor->data, cursor->end, &value))
+		return -1;
+	cursor->row += value;
+
+	for (unsigned int i = 0; i < g_nfields[cursor->type]; ++i) {
+		if (!columnar_get_varint (&cursor->data, cursor->end, &value))
+			return -1;
+		unsigned long long delta = (value >> 1) ^ (0 - (value & 1));
+		cursor->value[i] = (long long) ((unsigned long long) cursor->value[i] + delta);
+	}
+
+	cursor->remaining--;
+
+	return 1;
+}
+
+static void
+columnar_cursor_sample (const unsigned char *block, const columnar_cursor_t *cursor, dc_sample_value_t *value)
+{
+	memset (value, 0, sizeof (dc_sample_value_t));
+
+	switch (cursor->type) {
+	case DC_SAMPLE_TIME:
+		value->time = cursor->value[0];
+		break;
+	case DC_SAMPLE_DEPTH:
+		value->depth = cursor->value[0] / SCALE_DEPTH;
+		break;
+	case DC_SAMPLE_PRESSURE:
+		value->pressure.tank = cursor->index;
+		value->pressure.value = cursor->value[0] / SCALE_PRESSURE;
+		break;
+	case DC_SAMPLE_TEMPERATURE:
+		value->temperature = cursor->value[0] / SCALE_TEMPERATURE;
+		break;
+	case DC_SAMPLE_EVENT:
+		{
+			unsigned int ncolumns = array_uint32_le (block + 16);
+			unsigned int nevents = array_uint32_le (block + 20);
+			const unsigned char *dictionary = block + SZ_HEADER + ncolumns * SZ_DIRECTORY;
+			const char *strings = (const char *) dictionary + nevents * SZ_DICTIONARY;
+			unsigned long long event = cursor->value[0];
+			if (event < nevents) {
+				unsigned int name = array_uint32_le (dictionary + event * SZ_DICTIONARY + 8);
+				value->event.type = array_uint32_le (dictionary + event * SZ_DICTIONARY + 0);
+				value->event.flags = array_uint32_le (dictionary + event * SZ_DICTIONARY + 4);
+				value->event.name = name != NONAME ? strings + name : NULL;
+			}
+			value->event.time = cursor->value[1];
+			value->event.value = cursor->value[2];
+		}
+		break;
+	case DC_SAMPLE_RBT:
+		value->rbt = cursor->value[0];
+		break;
+	case DC_SAMPLE_HEARTBEAT:
+		value->heartbeat = cursor->value[0];
+		break;
+	case DC_SAMPLE_BEARING:
+		value->bearing = cursor->value[0];
+		break;
+	case DC_SAMPLE_SETPOINT:
+		value->setpoint = cursor->value[0] / SCALE_PPO2;
+		break;
+	case DC_SAMPLE_PPO2:
+		value->ppo2 = cursor->value[0] / SCALE_PPO2;
+		break;
+	case DC_SAMPLE_CNS:
+		value->cns = cursor->value[0] / SCALE_CNS;
+		break;
+	case DC_SAMPLE_DECO:
+		value->deco.type = cursor->value[0];
+		value->deco.time = cursor->value[1];
+		value->deco.depth = cursor->value[2] / SCALE_DEPTH;
+		break;
+	case DC_SAMPLE_GASMIX:
+		value->gasmix = cursor->value[0];
+		break;
+	case DC_SAMPLE_TTS:
+		value->time = cursor->value[0];
+		break;
+	case DC_SAMPLE_LOCATION:
+		value->location.latitude = cursor->value[0] / SCALE_LOCATION;
+		value->location.longitude = cursor->value[1] / SCALE_LOCATION;
+		value->location.altitude = cursor->value[2] / SCALE_DEPTH;
+		break;
+	default:
+		break;
+	}
+}
+
+static void
+columnar_batch_store (dc_sample_batch_t *batch, unsigned int row, dc_sample_type_t type, const dc_sample_value_t *value)
+{
+	switch (type) {
+	case DC_SAMPLE_TIME:
+		if (batch->time)
+			batch->time[row] = value->time;
+		break;
+	case DC_SAMPLE_DEPTH:
+		if (batch->depth)
+			batch->depth[row] = value->depth;
+		break;
+	case DC_SAMPLE_TEMPERATURE:
+		if (batch->temperature)
+			batch->temperature[row] = value->temperature;
+		break;
+	case DC_SAMPLE_PRESSURE:
+		if (batch->pressure && value->pressure.tank < batch->ntanks)
+			batch->pressure[value->pressure.tank * batch->capacity + row] = value->pressure.value;
+		break;
+	case DC_SAMPLE_PPO2:
+		if (batch->ppo2)
+			batch->ppo2[row] = value->ppo2;
+		break;
+	case DC_SAMPLE_SETPOINT:
+		if (batch->setpoint)
+			batch->setpoint[row] = value->setpoint;
+		break;
+	case DC_SAMPLE_CNS:
+		if (batch->cns)
+			batch->cns[row] = value->cns;
+		break;
+	case DC_SAMPLE_RBT:
+		if (batch->rbt)
+			batch->rbt[row] = value->rbt;
+		break;
+	case DC_SAMPLE_HEARTBEAT:
+		if (batch->heartbeat)
+			batch->heartbeat[row] = value->heartbeat;
+		break;
+	case DC_SAMPLE_BEARING:
+		if (batch->bearing)
+			batch->bearing[row] = value->bearing;
+		break;
+	case DC_SAMPLE_GASMIX:
+		if (batch->gasmix)
+			batch->gasmix[row] = value->gasmix;
+		break;
+	case DC_SAMPLE_DECO:
+		if (batch->deco_type)
+			batch->deco_type[row] = value->deco.type;
+		if (batch->deco_time)
+			batch->deco_time[row] = value->deco.time;
+		if (batch->deco_depth)
+			batch->deco_depth[row] = value->deco.depth;
+		break;
+	case DC_SAMPLE_TTS:
+		if (batch->tts)
+			batch->tts[row] = value->time;
+		break;
+	default:
+		return;
+	}
+
+	if (batch->mask)
+		batch->mask[row] |= (1u << type);
+}
+
+/*
+ * Store the fixed point columns straight from the decoded integers,
+ * without going through the floating point sample value.
+ */
+static void
+columnar_batch_store_fixed (dc_sample_batch_t *batch, unsigned int row, const columnar_cursor_t *cursor)
+{
+	switch (cursor->type) {
+	case DC_SAMPLE_DEPTH:
+		if (batch->depth_mm)
+			batch->depth_mm[row] = cursor->value[0];
+		break;
+	case DC_SAMPLE_TEMPERATURE:
+		if (batch->temperature_mk)
+			batch->temperature_mk[row] = cursor->value[0] * 10 + 273150;
+		break;
+	case DC_SAMPLE_PRESSURE:
+		if (batch->pressure_mbar && cursor->index < batch->ntanks)
+			batch->pressure_mbar[cursor->index * batch->capacity + row] = cursor->value[0];
+		break;
+	case DC_SAMPLE_PPO2:
+		if (batch->ppo2_mbar)
+			batch->ppo2_mbar[row] = cursor->value[0];
+		break;
+	case DC_SAMPLE_SETPOINT:
+		if (batch->setpoint_mbar)
+			batch->setpoint_mbar[row] = cursor->value[0];
+		break;
+	case DC_SAMPLE_DECO:
+		if (batch->deco_depth_mm)
+			batch->deco_depth_mm[row] = cursor->value[2];
+		break;
+	default:
+		break;
+	}
+}
+
+dc_status_t
+dc_columnar_get_batch (dc_columnar_t *reader, unsigned int dive, unsigned int offset, dc_sample_batch_t *batch)
+{
+	if (reader == NULL || dive >= reader->count ||
+		batch == NULL || (batch->pressure && batch->ntanks == 0))
+		return DC_STATUS_INVALIDARGS;
+
+	const unsigned char *block = reader->data + reader->blocks[dive];
+	unsigned int nrows = array_uint32_le (block + 12);
+	unsigned int ncolumns = array_uint32_le (block + 16);
+
+	batch->count = 0;
+	if (offset < nrows)
+		batch->count = nrows - offset < batch->capacity ? nrows - offset : batch->capacity;
+
+	if (batch->count == 0)
+		return DC_STATUS_SUCCESS;
+
+	for (unsigned int i = 0; i < batch->count; ++i) {
+		sample_batch_clear (batch, i);
+	}
+
+	// Decode one column at a time.
+	for (unsigned int i = 0; i < ncolumns; ++i) {
+		columnar_cursor_t cursor;
+		columnar_cursor_init (block, i, &cursor);
+
+		int rc = 0;
+		while ((rc = columnar_cursor_next (&cursor)) > 0) {
+			if (cursor.row < offset)
+				continue;
+			if (cursor.row >= offset + batch->count)
+				break;
+
+			dc_sample_value_t value;
+			columnar_cursor_sample (block, &cursor, &value);
+			columnar_batch_store (batch, cursor.row - offset, cursor.type, &value);
+			columnar_batch_store_fixed (batch, cursor.row - offset, &cursor);
+		}
+
+		if (rc < 0) {
+			ERROR (reader->context, "Corrupt column data.");
+			return DC_STATUS_DATAFORMAT;
+		}
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_columnar_samples_foreach (dc_columnar_t *reader, unsigned int dive, dc_sample_callback_t callback, void *userdata)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (reader == NULL || dive >= reader->count)
+		return DC_STATUS_INVALIDARGS;
+
+	const unsigned char *block = reader->data + reader->blocks[dive];
+	unsigned int nrows = array_uint32_le (block + 12);
+	unsigned int ncolumns = array_uint32_le (block + 16);
+	if (ncolumns == 0)
+		return DC_STATUS_SUCCESS;
+
+	columnar_cursor_t *cursors = (columnar_cursor_t *) dc_malloc (reader->context, ncolumns * sizeof (columnar_cursor_t));
+	if (cursors == NULL) {
+		ERROR (reader->context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	// Load the first entry of each column. Exhausted columns are marked
+	// with a row past the end of the dive.
+	for (unsigned int i = 0; i < ncolumns; ++i) {
+		columnar_cursor_init (block, i, cursors + i);
+		int rc = columnar_cursor_next (cursors + i);
+		if (rc < 0) {
+			status = DC_STATUS_DATAFORMAT;
+			goto cleanup;
+		}
+		if (rc == 0)
+			cursors[i].row = nrows;
+	}
+
+	// The columns are sorted by sample type, so the time column comes
+	// first within each row.
+	for (unsigned int row = 0; row < nrows; ++row) {
+		for (unsigned int i = 0; i < ncolumns; ++i) {
+			columnar_cursor_t *cursor = cursors + i;
+			while (cursor->row == row) {
+				if (callback) {
+					dc_sample_value_t value;
+					columnar_cursor_sample (block, cursor, &value);
+					callback ((dc_sample_type_t) cursor->type, value, userdata);
+				}
+
+				int rc = columnar_cursor_next (cursor);
+				if (rc < 0) {
+					status = DC_STATUS_DATAFORMAT;
+					goto cleanup;
+				}
+				if (rc == 0)
+					cursor->row = nrows;
+			}
+		}
+	}
+
+cleanup:
+	if (status != DC_STATUS_SUCCESS)
+		ERROR (reader->context, "Corrupt column data.");
+	dc_free (reader->context, cursors);
+	return status;
+}
+
+dc_status_t
+dc_columnar_close (dc_columnar_t *reader)
+{
+	if (reader == NULL)
+		return DC_STATUS_SUCCESS;
+
+	if (reader->data) {
+#ifdef USE_MMAP
+		if (reader->mapped)
+			munmap (reader->data, reader->size);
+		else
+#endif
+			dc_free (reader->context, reader->data);
+	}
+
+	dc_free (reader->context, reader->blocks);
+	dc_free (reader->context, reader);
+
+	return DC_STATUS_SUCCESS;
+}
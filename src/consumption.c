@@ -0,0 +1,465 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <libdivecomputer/consumption.h>
+#include <libdivecomputer/units.h>
+
+#include "context-private.h"
+
+// Upper limit for the tank index of a pressure sample, to ignore
+// garbage instead of allocating a huge number of tanks.
+#define MAXTANKS 64
+
+typedef struct consumption_tank_t {
+	dc_consumption_tank_t info;
+	unsigned int nsamples;
+	// Ambient pressure integral at the last sample. The consumption of
+	// the tank is only accounted while the pressure is dropping, from
+	// the last sample before the first drop until the last drop.
+	double end_integral;
+	unsigned int active;
+	double active_begin, active_end;
+	// Pressure and ambient pressure integral at the start of the
+	// current segment.
+	unsigned int segment_valid;
+	double segment_pressure, segment_integral;
+	// Pressure of the row in progress.
+	unsigned int pending;
+	double pending_pressure;
+} consumption_tank_t;
+
+struct dc_consumption_t {
+	dc_context_t *context;
+	dc_consumption_callback_t callback;
+	void *userdata;
+	// Dive parameters.
+	double atmospheric;
+	double hydrostatic; /* bar/m */
+	dc_buffer_t *tanks;
+	// State after the last row. The integral of the ambient pressure
+	// (atm) is in minutes, the integral of the depth in seconds.
+	unsigned int nrows;
+	unsigned int time;
+	double depth;
+	double integral;
+	double depth_integral;
+	// Current segment.
+	unsigned int gasmix;
+	unsigned int segment_begin;
+	double segment_depth_integral;
+	// Row in progress.
+	unsigned int pending;
+	unsigned int row_time;
+	double row_depth;
+	unsigned int row_gasmix;
+};
+
+static consumption_tank_t *
+consumption_get_tanks (dc_consumption_t *consumption, unsigned int *ntanks)
+{
+	if (ntanks)
+		*ntanks = dc_buffer_get_size (consumption->tanks) / sizeof (consumption_tank_t);
+
+	return (consumption_tank_t *) dc_buffer_get_data (consumption->tanks);
+}
+
+static void
+consumption_tank_init (consumption_tank_t *tank, const dc_tank_t *info)
+{
+	memset (tank, 0, sizeof (*tank));
+	tank->info.gasmix = DC_CONSUMPTION_UNKNOWN;
+	if (info) {
+		tank->info.gasmix = info->gasmix == DC_GASMIX_UNKNOWN ? DC_CONSUMPTION_UNKNOWN : info->gasmix;
+		tank->info.volume = info->volume;
+		tank->info.beginpressure = info->beginpressure;
+		tank->info.endpressure = info->endpressure;
+	}
+}
+
+static double
+consumption_ambient (const dc_consumption_t *consumption, double depth)
+{
+	return (consumption->atmospheric + depth * consumption->hydrostatic) / (ATM / BAR);
+}
+
+static void
+consumption_close_segment (dc_consumption_t *consumption)
+{
+	unsigned int ntanks = 0;
+	consumption_tank_t *tanks = consumption_get_tanks (consumption, &ntanks);
+
+	if (consumption->callback == NULL)
+		return;
+
+	dc_consumption_segment_t segment;
+	memset (&segment, 0, sizeof (segment));
+	segment.gasmix = consumption->gasmix;
+	segment.tank = DC_CONSUMPTION_UNKNOWN;
+	segment.begin = consumption->segment_begin;
+	segment.end = consumption->time;
+
+	unsigned int duration = segment.end - segment.begin;
+	if (duration)
+		segment.avgdepth = (consumption->depth_integral - consumption->segment_depth_integral) / duration;
+	else
+		segment.avgdepth = consumption->depth;
+
+	for (unsigned int i = 0; i < ntanks; ++i) {
+		if (segment.gasmix == DC_CONSUMPTION_UNKNOWN || tanks[i].info.gasmix != segment.gasmix)
+			continue;
+
+		segment.tank = i;
+		if (tanks[i].segment_valid) {
+			double minutes = tanks[i].end_integral - tanks[i].segment_integral;
+			segment.pressure = tanks[i].segment_pressure - tanks[i].info.endpressure;
+			if (minutes > 0.0) {
+				segment.sac = segment.pressure / minutes;
+				segment.rmv = segment.sac * tanks[i].info.volume;
+			}
+		}
+		break;
+	}
+
+	consumption->callback (&segment, consumption->userdata);
+}
+
+static void
+consumption_start_segment (dc_consumption_t *consumption, unsigned int gasmix)
+{
+	unsigned int ntanks = 0;
+	consumption_tank_t *tanks = consumption_get_tanks (consumption, &ntanks);
+
+	consumption->gasmix = gasmix;
+	consumption->segment_begin = consumption->time;
+	consumption->segment_depth_integral = consumption->depth_integral;
+
+	for (unsigned int i = 0; i < ntanks; ++i) {
+		tanks[i].segment_valid = tanks[i].nsamples != 0;
+		tanks[i].segment_pressure = tanks[i].info.endpressure;
+		tanks[i].segment_integral = tanks[i].end_integral;
+	}
+}
+
+static void
+consumption_complete_row (dc_consumption_t *consumption)
+{
+	if (!consumption->pending)
+		return;
+
+	// Integrate the ambient pressure and depth, with a linear change
+	// between the rows.
+	unsigned int dt = consumption->row_time > consumption->time ? consumption->row_time - consumption->time : 0;
+	double ambient0 = consumption_ambient (consumption, consumption->depth);
+	double ambient1 = consumption_ambient (consumption, consumption->row_depth);
+	consumption->integral += (ambient0 + ambient1) / 2.0 * dt / 60.0;
+	consumption->depth_integral += (consumption->depth + consumption->row_depth) / 2.0 * dt;
+	consumption->time += dt;
+	consumption->depth = consumption->row_depth;
+	consumption->pending = 0;
+
+	unsigned int ntanks = 0;
+	consumption_tank_t *tanks = consumption_get_tanks (consumption, &ntanks);
+	for (unsigned int i = 0; i < ntanks; ++i) {
+		consumption_tank_t *tank = tanks + i;
+		if (!tank->pending)
+			continue;
+
+		if (tank->nsamples == 0) {
+			tank->info.begin = consumption->time;
+			tank->info.beginpressure = tank->pending_pressure;
+			tank->active_begin = consumption->integral;
+		} else if (tank->pending_pressure < tank->info.endpressure) {
+			tank->active = 1;
+			tank->active_end = consumption->integral;
+		} else if (!tank->active) {
+			tank->active_begin = consumption->integral;
+		}
+		tank->info.end = consumption->time;
+		tank->info.endpressure = tank->pending_pressure;
+		tank->end_integral = consumption->integral;
+		tank->nsamples++;
+		tank->pending = 0;
+
+		if (!tank->segment_valid) {
+			tank->segment_valid = 1;
+			tank->segment_pressure = tank->info.endpressure;
+			tank->segment_integral = tank->end_integral;
+		}
+	}
+
+	// The gas mix reported with the first row is the initial gas mix,
+	// rather than a switch.
+	if (consumption->nrows++ == 0) {
+		consumption->gasmix = consumption->row_gasmix;
+	} else if (consumption->row_gasmix != consumption->gasmix) {
+		consumption_close_segment (consumption);
+		consumption_start_segment (consumption, consumption->row_gasmix);
+	}
+}
+
+dc_status_t
+dc_consumption_new (dc_consumption_t **out, dc_context_t *context)
+{
+	dc_consumption_t *consumption = NULL;
+
+	if (out == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	consumption = (dc_consumption_t *) dc_malloc (context, sizeof (dc_consumption_t));
+	if (consumption == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	memset (consumption, 0, sizeof (dc_consumption_t));
+	consumption->context = context;
+
+	consumption->tanks = dc_buffer_new (0);
+	if (consumption->tanks == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		dc_free (context, consumption);
+		return DC_STATUS_NOMEMORY;
+	}
+
+	dc_consumption_reset (consumption, 0.0, 0.0, NULL, 0, 0);
+
+	*out = consumption;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_consumption_set_callback (dc_consumption_t *consumption, dc_consumption_callback_t callback, void *userdata)
+{
+	if (consumption == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	consumption->callback = callback;
+	consumption->userdata = userdata;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_consumption_reset (dc_consumption_t *consumption, double atmospheric, double density, const dc_tank_t tanks[], unsigned int ntanks, unsigned int ngasmixes)
+{
+	if (consumption == NULL || (tanks == NULL && ntanks))
+		return DC_STATUS_INVALIDARGS;
+
+	if (atmospheric <= 0.0)
+		atmospheric = ATM / BAR;
+	if (density <= 0.0)
+		density = 1025.0;
+
+	if (!dc_buffer_resize (consumption->tanks, ntanks * sizeof (consumption_tank_t))) {
+		ERROR (consumption->context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	consumption_tank_t *state = consumption_get_tanks (consumption, NULL);
+	for (unsigned int i = 0; i < ntanks; ++i)
+		consumption_tank_init (state + i, tanks + i);
+
+	consumption->atmospheric = atmospheric;
+	consumption->hydrostatic = density * GRAVITY / BAR;
+
+	consumption->nrows = 0;
+	consumption->time = 0;
+	consumption->depth = 0.0;
+	consumption->integral = 0.0;
+	consumption->depth_integral = 0.0;
+
+	consumption->gasmix = ngasmixes ? 0 : DC_CONSUMPTION_UNKNOWN;
+	consumption->segment_begin = 0;
+	consumption->segment_depth_integral = 0.0;
+
+	consumption->pending = 0;
+	consumption->row_time = 0;
+	consumption->row_depth = 0.0;
+	consumption->row_gasmix = consumption->gasmix;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static void
+consumption_pressure (dc_consumption_t *consumption, unsigned int index, double pressure)
+{
+	unsigned int ntanks = 0;
+	consumption_get_tanks (consumption, &ntanks);
+
+	if (index >= ntanks) {
+		if (index >= MAXTANKS) {
+			WARNING (consumption->context, "Invalid tank index (%u).", index);
+			return;
+		}
+
+		if (!dc_buffer_resize (consumption->tanks, (index + 1) * sizeof (consumption_tank_t))) {
+			ERROR (consumption->context, "Failed to allocate memory.");
+			return;
+		}
+
+		consumption_tank_t *tanks = consumption_get_tanks (consumption, NULL);
+		for (unsigned int i = ntanks; i <= index; ++i)
+			consumption_tank_init (tanks + i, NULL);
+	}
+
+	consumption_tank_t *tank = consumption_get_tanks (consumption, NULL) + index;
+	tank->pending = 1;
+	tank->pending_pressure = pressure;
+}
+
+void
+dc_consumption_sample_cb (dc_sample_type_t type, dc_sample_value_t value, void *userdata)
+{
+	dc_consumption_t *consumption = (dc_consumption_t *) userdata;
+
+	switch (type) {
+	case DC_SAMPLE_TIME:
+		consumption_complete_row (consumption);
+		consumption->pending = 1;
+		consumption->row_time = value.time;
+		break;
+	case DC_SAMPLE_DEPTH:
+		consumption->row_depth = value.depth > 0.0 ? value.depth : 0.0;
+		break;
+	case DC_SAMPLE_PRESSURE:
+		if (consumption->pending)
+			consumption_pressure (consumption, value.pressure.tank, value.pressure.value);
+		break;
+	case DC_SAMPLE_GASMIX:
+		consumption->row_gasmix = value.gasmix;
+		break;
+	default:
+		break;
+	}
+}
+
+dc_status_t
+dc_consumption_finish (dc_consumption_t *consumption)
+{
+	if (consumption == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	consumption_complete_row (consumption);
+	if (consumption->nrows)
+		consumption_close_segment (consumption);
+
+	unsigned int ntanks = 0;
+	consumption_tank_t *tanks = consumption_get_tanks (consumption, &ntanks);
+	for (unsigned int i = 0; i < ntanks; ++i) {
+		consumption_tank_t *tank = tanks + i;
+
+		// Without samples, the begin and end pressure of the tank are
+		// assumed to cover the entire dive.
+		if (tank->nsamples == 0) {
+			tank->info.begin = 0;
+			tank->info.end = consumption->time;
+			tank->active = 1;
+			tank->active_begin = 0.0;
+			tank->active_end = consumption->integral;
+		}
+
+		double pressure = tank->info.beginpressure - tank->info.endpressure;
+		double minutes = tank->active ? tank->active_end - tank->active_begin : 0.0;
+		tank->info.consumed = pressure * tank->info.volume;
+		tank->info.sac = minutes > 0.0 ? pressure / minutes : 0.0;
+		tank->info.rmv = tank->info.sac * tank->info.volume;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_consumption_process (dc_consumption_t *consumption, dc_parser_t *parser)
+{
+	if (consumption == NULL || parser == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	dc_parser_summary_t summary;
+	dc_status_t rc = dc_parser_get_summary (parser, &summary);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	double atmospheric = 0.0, density = 0.0;
+	if (summary.fields & (1u << DC_FIELD_ATMOSPHERIC))
+		atmospheric = summary.atmospheric;
+	if (summary.fields & (1u << DC_FIELD_SALINITY))
+		density = summary.salinity.density;
+
+	rc = dc_consumption_reset (consumption, atmospheric, density, summary.tanks, summary.ntanks, summary.ngasmixes);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	rc = dc_parser_samples_foreach (parser, dc_consumption_sample_cb, consumption);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	return dc_consumption_finish (consumption);
+}
+
+unsigned int
+dc_consumption_get_tank_count (dc_consumption_t *consumption)
+{
+	unsigned int ntanks = 0;
+
+	if (consumption == NULL)
+		return 0;
+
+	consumption_get_tanks (consumption, &ntanks);
+
+	return ntanks;
+}
+
+dc_status_t
+dc_consumption_get_tank (dc_consumption_t *consumption, unsigned int index, dc_consumption_tank_t *tank)
+{
+	unsigned int ntanks = 0;
+
+	if (consumption == NULL || tank == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	const consumption_tank_t *tanks = consumption_get_tanks (consumption, &ntanks);
+	if (index >= ntanks)
+		return DC_STATUS_INVALIDARGS;
+
+	*tank = tanks[index].info;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_consumption_free (dc_consumption_t *consumption)
+{
+	if (consumption == NULL)
+		return DC_STATUS_SUCCESS;
+
+	dc_buffer_free (consumption->tanks);
+	dc_free (consumption->context, consumption);
+
+	return DC_STATUS_SUCCESS;
+}
@@ -26,7 +26,10 @@
 #include "config.h"
 #endif
 
+#include <stddef.h>
+
 #include <libdivecomputer/context.h>
+#include <libdivecomputer/datetime.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -46,30 +49,104 @@ extern "C" {
 #define ATTR_FORMAT_PRINTF(a,b)
 #endif
 
-#ifdef ENABLE_LOGGING
-#define HEXDUMP(context, loglevel, prefix, data, size) dc_context_hexdump (context, loglevel, __FILE__, __LINE__, FUNCTION, prefix, data, size)
-#define SYSERROR(context, errcode) dc_context_syserror (context, DC_LOGLEVEL_ERROR, __FILE__, __LINE__, FUNCTION, errcode)
-#define ERROR(context, ...) dc_context_log (context, DC_LOGLEVEL_ERROR, __FILE__, __LINE__, FUNCTION, __VA_ARGS__)
-#define WARNING(context, ...) dc_context_log (context, DC_LOGLEVEL_WARNING, __FILE__, __LINE__, FUNCTION, __VA_ARGS__)
-#define INFO(context, ...) dc_context_log (context, DC_LOGLEVEL_INFO, __FILE__, __LINE__, FUNCTION, __VA_ARGS__)
-#define DEBUG(context, ...) dc_context_log (context, DC_LOGLEVEL_DEBUG, __FILE__, __LINE__, FUNCTION, __VA_ARGS__)
+/*
+ * The most verbose log level compiled in. The logging calls above that
+ * level compile to nothing.
+ */
+#ifndef LOG_MAXLEVEL
+#define LOG_MAXLEVEL 5
+#endif
+
+/*
+ * The subsystem of the logging calls. Source files outside the device
+ * layer define it before including any header.
+ */
+#ifndef LOG_SUBSYSTEM
+#define LOG_SUBSYSTEM DC_LOGSUBSYSTEM_DEVICE
+#endif
+
+#if defined(ENABLE_LOGGING)
+#define HEXDUMP(context, loglevel, prefix, data, size) ((loglevel) <= LOG_MAXLEVEL ? (void) dc_context_hexdump (context, LOG_SUBSYSTEM, loglevel, __FILE__, __LINE__, FUNCTION, prefix, data, size) : (void) 0)
 #else
 #define HEXDUMP(context, loglevel, prefix, data, size) UNUSED(context)
+#endif
+
+#if defined(ENABLE_LOGGING) && LOG_MAXLEVEL >= 1
+#define SYSERROR(context, errcode) dc_context_syserror (context, LOG_SUBSYSTEM, DC_LOGLEVEL_ERROR, __FILE__, __LINE__, FUNCTION, errcode)
+#define ERROR(context, ...) dc_context_log (context, LOG_SUBSYSTEM, DC_LOGLEVEL_ERROR, __FILE__, __LINE__, FUNCTION, __VA_ARGS__)
+#else
 #define SYSERROR(context, errcode) UNUSED(context)
 #define ERROR(context, ...) UNUSED(context)
+#endif
+
+#if defined(ENABLE_LOGGING) && LOG_MAXLEVEL >= 2
+#define WARNING(context, ...) dc_context_log (context, LOG_SUBSYSTEM, DC_LOGLEVEL_WARNING, __FILE__, __LINE__, FUNCTION, __VA_ARGS__)
+#else
 #define WARNING(context, ...) UNUSED(context)
+#endif
+
+#if defined(ENABLE_LOGGING) && LOG_MAXLEVEL >= 3
+#define INFO(context, ...) dc_context_log (context, LOG_SUBSYSTEM, DC_LOGLEVEL_INFO, __FILE__, __LINE__, FUNCTION, __VA_ARGS__)
+#else
 #define INFO(context, ...) UNUSED(context)
+#endif
+
+#if defined(ENABLE_LOGGING) && LOG_MAXLEVEL >= 4
+#define DEBUG(context, ...) dc_context_log (context, LOG_SUBSYSTEM, DC_LOGLEVEL_DEBUG, __FILE__, __LINE__, FUNCTION, __VA_ARGS__)
+#else
 #define DEBUG(context, ...) UNUSED(context)
 #endif
 
+/*
+ * Whether a debug message would be delivered at all, to skip the work
+ * of preparing one (for example a hex dump of unknown data) when not.
+ */
+#if defined(ENABLE_LOGGING) && LOG_MAXLEVEL >= 4
+#define DEBUG_ENABLED(context) dc_context_log_enabled (context, LOG_SUBSYSTEM, DC_LOGLEVEL_DEBUG)
+#else
+#define DEBUG_ENABLED(context) 0
+#endif
+
+int
+dc_context_log_enabled (dc_context_t *context, dc_logsubsystem_t subsystem, dc_loglevel_t loglevel);
+
 dc_status_t
-dc_context_log (dc_context_t *context, dc_loglevel_t loglevel, const char *file, unsigned int line, const char *function, const char *format, ...) ATTR_FORMAT_PRINTF(6, 7);
+dc_context_log (dc_context_t *context, dc_logsubsystem_t subsystem, dc_loglevel_t loglevel, const char *file, unsigned int line, const char *function, const char *format, ...) ATTR_FORMAT_PRINTF(7, 8);
 
 dc_status_t
-dc_context_syserror (dc_context_t *context, dc_loglevel_t loglevel, const char *file, unsigned int line, const char *function, int errcode);
+dc_context_syserror (dc_context_t *context, dc_logsubsystem_t subsystem, dc_loglevel_t loglevel, const char *file, unsigned int line, const char *function, int errcode);
+
+void *
+dc_malloc (dc_context_t *context, size_t size);
+
+void *
+dc_realloc (dc_context_t *context, void *ptr, size_t size);
+
+void
+dc_free (dc_context_t *context, void *ptr);
+
+/*
+ * A small store for values which are discovered at runtime, for example
+ * the capabilities of a firmware version. The values are kept until the
+ * context is freed. The key is an arbitrary byte string.
+ */
+int
+dc_context_cache_get (dc_context_t *context, const void *key, size_t size, unsigned int *value);
+
+dc_status_t
+dc_context_cache_set (dc_context_t *context, const void *key, size_t size, unsigned int value);
+
+/*
+ * Convert to the local time, like dc_datetime_localtime, but with the
+ * timezone offset cached in the context, per period of 15 minutes. All
+ * timezone transitions in use fall on such a boundary. Only a cache miss
+ * goes through the (locked) timezone database of the C library.
+ */
+dc_datetime_t *
+dc_context_localtime (dc_context_t *context, dc_datetime_t *result, dc_ticks_t ticks);
 
 dc_status_t
-dc_context_hexdump (dc_context_t *context, dc_loglevel_t loglevel, const char *file, unsigned int line, const char *function, const char *prefix, const unsigned char data[], unsigned int size);
+dc_context_hexdump (dc_context_t *context, dc_logsubsystem_t subsystem, dc_loglevel_t loglevel, const char *file, unsigned int line, const char *function, const char *prefix, const unsigned char data[], unsigned int size);
 
 #ifdef __cplusplus
 }
@@ -28,22 +28,110 @@
 #include <stdarg.h>
 #include <string.h>
 
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#define CACHE_LOCKING
+#endif
+
+#if defined(ENABLE_LOGGING) && defined(HAVE_PTHREAD_H)
+#define LOG_LOCKING
+#if defined(__GNUC__)
+#define LOG_QUEUE
+#endif
+#endif
+
 #ifdef _WIN32
 #define NOGDI
 #include <windows.h>
 #endif
 
 #include "context-private.h"
+#include "perfstats.h"
 #include "timer.h"
+#include "array.h"
 
-struct dc_context_t {
+#define C_ARRAY_SIZE(array) (sizeof (array) / sizeof *(array))
+
+#define MSGSIZE (16384 + 32)
+
+#define TZCACHE_SIZE   64
+#define TZCACHE_PERIOD 900
+
+#ifdef LOG_QUEUE
+#define SLOTSIZE 512
+
+typedef struct dc_logslot_t {
+	size_t sequence;
 	dc_loglevel_t loglevel;
+	const char *file;
+	unsigned int line;
+	const char *function;
+	char msg[SLOTSIZE];
+} dc_logslot_t;
+
+/*
+ * Bounded multi-producer, single-consumer message queue. Each slot
+ * carries a sequence number, which tells the producers whether the slot
+ * is free, and the consumer whether it has been published. Producers
+ * only contend on the atomic increment of the enqueue position.
+ */
+typedef struct dc_logqueue_t {
+	dc_logslot_t *slots;
+	size_t mask;
+	size_t enqueue;
+	size_t dequeue;
+	int waiting;
+	int stop;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	pthread_t thread;
+} dc_logqueue_t;
+#endif
+
+typedef struct dc_cacheentry_t {
+	struct dc_cacheentry_t *next;
+	unsigned int value;
+	size_t size;
+	unsigned char key[1];
+} dc_cacheentry_t;
+
+typedef struct dc_tzentry_t {
+	dc_ticks_t period;
+	int offset;
+	int valid;
+} dc_tzentry_t;
+
+/*
+ * The log and allocator settings are per context. The remaining state
+ * is only used from the root context, which is the context itself, or
+ * the parent of a clone.
+ */
+struct dc_context_t {
+	dc_context_t *root;
+	dc_loglevel_t loglevel[DC_LOGSUBSYSTEM_PARSER + 1];
 	dc_logfunc_t logfunc;
 	void *userdata;
+	dc_logsink_t logsink;
+	void *sinkdata;
+	dc_allocfunc_t allocfunc;
+	void *allocdata;
 #ifdef ENABLE_LOGGING
-	char msg[16384 + 32];
 	dc_timer_t *timer;
 #endif
+#ifdef LOG_LOCKING
+	// Serializes the calls to the log function, for backends which
+	// log from more than one thread. The messages are formatted on the
+	// stack of the caller, outside the lock.
+	pthread_mutex_t lock;
+#endif
+#ifdef LOG_QUEUE
+	dc_logqueue_t *queue;
+#endif
+	dc_cacheentry_t *cache;
+	dc_tzentry_t tzcache[TZCACHE_SIZE];
+#ifdef CACHE_LOCKING
+	pthread_mutex_t cachelock;
+#endif
 };
 
 #ifdef ENABLE_LOGGING
@@ -99,10 +187,6 @@ l_snprintf (char *str, size_t size, const char *format, ...)
 static int
 l_hexdump (char *str, size_t size, const unsigned char data[], size_t n)
 {
-	const unsigned char ascii[] = {
-		'0', '1', '2', '3', '4', '5', '6', '7',
-		'8', '9', 'A', 'B', 'C', 'D', 'E', 'F'};
-
 	if (size == 0)
 		return -1;
 
@@ -112,15 +196,7 @@ l_hexdump (char *str, size_t size, const unsigned char data[], size_t n)
 	/* The actual number of bytes. */
 	size_t length = (n > maxlength ? maxlength : n);
 
-	for (size_t i = 0; i < length; ++i) {
-		/* Set the most-significant nibble. */
-		unsigned char msn = (data[i] >> 4) & 0x0F;
-		str[i * 2 + 0] = ascii[msn];
-
-		/* Set the least-significant nibble. */
-		unsigned char lsn = data[i] & 0x0F;
-		str[i * 2 + 1] = ascii[lsn];
-	}
+	array_convert_bin2hex (data, length, (unsigned char *) str, length * 2);
 
 	/* Null terminate the hex string. */
 	str[length * 2] = 0;
@@ -134,7 +210,7 @@ logfunc (dc_context_t *context, dc_loglevel_t loglevel, const char *file, unsign
 	const char *loglevels[] = {"NONE", "ERROR", "WARNING", "INFO", "DEBUG", "ALL"};
 
 	dc_usecs_t now = 0;
-	dc_timer_now (context->timer, &now);
+	dc_timer_now (context->root->timer, &now);
 
 	unsigned long seconds = now / 1000000;
 	unsigned long microseconds = now % 1000000;
@@ -149,6 +225,160 @@ logfunc (dc_context_t *context, dc_loglevel_t loglevel, const char *file, unsign
 			loglevels[loglevel], msg);
 	}
 }
+
+#ifdef LOG_QUEUE
+static int
+dc_logqueue_push (dc_logqueue_t *queue, dc_loglevel_t loglevel, const char *file, unsigned int line, const char *function, const char *msg)
+{
+	size_t length = strlen (msg);
+	if (length >= SLOTSIZE)
+		return 0;
+
+	dc_logslot_t *slot = NULL;
+	size_t pos = __atomic_load_n (&queue->enqueue, __ATOMIC_RELAXED);
+	for (;;) {
+		slot = queue->slots + (pos & queue->mask);
+		size_t sequence = __atomic_load_n (&slot->sequence, __ATOMIC_ACQUIRE);
+		ptrdiff_t diff = (ptrdiff_t) sequence - (ptrdiff_t) pos;
+		if (diff == 0) {
+			if (__atomic_compare_exchange_n (&queue->enqueue, &pos, pos + 1, 1,
+				__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		} else if (diff < 0) {
+			// The queue is full.
+			return 0;
+		} else {
+			pos = __atomic_load_n (&queue->enqueue, __ATOMIC_RELAXED);
+		}
+	}
+
+	slot->loglevel = loglevel;
+	slot->file = file;
+	slot->line = line;
+	slot->function = function;
+	memcpy (slot->msg, msg, length + 1);
+	__atomic_store_n (&slot->sequence, pos + 1, __ATOMIC_SEQ_CST);
+
+	// Only wake up the consumer if it's sleeping.
+	if (__atomic_load_n (&queue->waiting, __ATOMIC_SEQ_CST)) {
+		pthread_mutex_lock (&queue->mutex);
+		pthread_cond_signal (&queue->cond);
+		pthread_mutex_unlock (&queue->mutex);
+	}
+
+	return 1;
+}
+
+static dc_logslot_t *
+dc_logqueue_peek (dc_logqueue_t *queue)
+{
+	dc_logslot_t *slot = queue->slots + (queue->dequeue & queue->mask);
+	size_t sequence = __atomic_load_n (&slot->sequence, __ATOMIC_SEQ_CST);
+	if (sequence != queue->dequeue + 1)
+		return NULL;
+
+	return slot;
+}
+
+static void
+dc_logqueue_release (dc_logqueue_t *queue, dc_logslot_t *slot)
+{
+	__atomic_store_n (&slot->sequence, queue->dequeue + queue->mask + 1, __ATOMIC_RELEASE);
+	queue->dequeue++;
+}
+
+static void *
+dc_logqueue_run (void *arg)
+{
+	dc_context_t *context = (dc_context_t *) arg;
+	dc_logqueue_t *queue = context->queue;
+
+	for (;;) {
+		dc_logslot_t *slot = NULL;
+		while ((slot = dc_logqueue_peek (queue)) != NULL) {
+			pthread_mutex_lock (&context->lock);
+			if (context->logfunc) {
+				context->logfunc (context, slot->loglevel, slot->file, slot->line, slot->function, slot->msg, context->userdata);
+			}
+			pthread_mutex_unlock (&context->lock);
+			dc_logqueue_release (queue, slot);
+		}
+
+		pthread_mutex_lock (&queue->mutex);
+		__atomic_store_n (&queue->waiting, 1, __ATOMIC_SEQ_CST);
+		while (!queue->stop && dc_logqueue_peek (queue) == NULL) {
+			pthread_cond_wait (&queue->cond, &queue->mutex);
+		}
+		__atomic_store_n (&queue->waiting, 0, __ATOMIC_SEQ_CST);
+		int stop = queue->stop && dc_logqueue_peek (queue) == NULL;
+		pthread_mutex_unlock (&queue->mutex);
+
+		if (stop)
+			break;
+	}
+
+	return NULL;
+}
+
+static void
+dc_logqueue_stop (dc_context_t *context)
+{
+	dc_logqueue_t *queue = context->queue;
+	if (queue == NULL)
+		return;
+
+	pthread_mutex_lock (&queue->mutex);
+	queue->stop = 1;
+	pthread_cond_signal (&queue->cond);
+	pthread_mutex_unlock (&queue->mutex);
+
+	pthread_join (queue->thread, NULL);
+
+	pthread_cond_destroy (&queue->cond);
+	pthread_mutex_destroy (&queue->mutex);
+	free (queue->slots);
+	free (queue);
+
+	context->queue = NULL;
+}
+#endif
+
+static void
+dc_context_deliver (dc_context_t *context, dc_loglevel_t loglevel, const char *file, unsigned int line, const char *function, const char *msg)
+{
+	dc_context_t *root = context->root;
+
+#ifdef LOG_QUEUE
+	// Messages which don't fit in a slot, or overflow the queue, are
+	// delivered synchronously instead of being dropped.
+	if (root->queue && dc_logqueue_push (root->queue, loglevel, file, line, function, msg))
+		return;
+#endif
+
+#ifdef LOG_LOCKING
+	pthread_mutex_lock (&root->lock);
+#endif
+
+	context->logfunc (context, loglevel, file, line, function, msg, context->userdata);
+
+#ifdef LOG_LOCKING
+	pthread_mutex_unlock (&root->lock);
+#endif
+}
+
+static void
+dc_context_record (dc_context_t *context, const dc_logrecord_t *record)
+{
+#ifdef LOG_LOCKING
+	pthread_mutex_lock (&context->root->lock);
+#endif
+
+	context->logsink (context, record, context->sinkdata);
+
+#ifdef LOG_LOCKING
+	pthread_mutex_unlock (&context->root->lock);
+#endif
+}
 #endif
 
 dc_status_t
@@ -163,20 +393,75 @@ dc_context_new (dc_context_t **out)
 	if (context == NULL)
 		return DC_STATUS_NOMEMORY;
 
+	context->root = context;
+
 #ifdef ENABLE_LOGGING
-	context->loglevel = DC_LOGLEVEL_WARNING;
+	for (unsigned int i = 0; i < C_ARRAY_SIZE (context->loglevel); ++i) {
+		context->loglevel[i] = DC_LOGLEVEL_WARNING;
+	}
 	context->logfunc = logfunc;
 #else
-	context->loglevel = DC_LOGLEVEL_NONE;
+	for (unsigned int i = 0; i < C_ARRAY_SIZE (context->loglevel); ++i) {
+		context->loglevel[i] = DC_LOGLEVEL_NONE;
+	}
 	context->logfunc = NULL;
 #endif
 	context->userdata = NULL;
+	context->logsink = NULL;
+	context->sinkdata = NULL;
+	context->allocfunc = NULL;
+	context->allocdata = NULL;
 
 #ifdef ENABLE_LOGGING
-	memset (context->msg, 0, sizeof (context->msg));
 	context->timer = NULL;
 	dc_timer_new (&context->timer);
 #endif
+#ifdef LOG_LOCKING
+	pthread_mutex_init (&context->lock, NULL);
+#endif
+#ifdef LOG_QUEUE
+	context->queue = NULL;
+#endif
+	context->cache = NULL;
+	memset (context->tzcache, 0, sizeof (context->tzcache));
+#ifdef CACHE_LOCKING
+	pthread_mutex_init (&context->cachelock, NULL);
+#endif
+
+	*out = context;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_context_clone (dc_context_t **out, dc_context_t *parent)
+{
+	dc_context_t *context = NULL;
+
+	if (out == NULL || parent == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	context = (dc_context_t *) malloc (sizeof (dc_context_t));
+	if (context == NULL)
+		return DC_STATUS_NOMEMORY;
+
+	context->root = parent->root;
+	memcpy (context->loglevel, parent->loglevel, sizeof (context->loglevel));
+	context->logfunc = parent->logfunc;
+	context->userdata = parent->userdata;
+	context->logsink = parent->logsink;
+	context->sinkdata = parent->sinkdata;
+	context->allocfunc = parent->allocfunc;
+	context->allocdata = parent->allocdata;
+
+	// The shared state is never used from a clone.
+#ifdef ENABLE_LOGGING
+	context->timer = NULL;
+#endif
+#ifdef LOG_QUEUE
+	context->queue = NULL;
+#endif
+	context->cache = NULL;
 
 	*out = context;
 
@@ -189,8 +474,27 @@ dc_context_free (dc_context_t *context)
 	if (context == NULL)
 		return DC_STATUS_SUCCESS;
 
+	if (context->root != context) {
+		free (context);
+		return DC_STATUS_SUCCESS;
+	}
+
+#ifdef LOG_QUEUE
+	dc_logqueue_stop (context);
+#endif
 #ifdef ENABLE_LOGGING
 	dc_timer_free (context->timer);
+#endif
+#ifdef LOG_LOCKING
+	pthread_mutex_destroy (&context->lock);
+#endif
+	while (context->cache) {
+		dc_cacheentry_t *next = context->cache->next;
+		free (context->cache);
+		context->cache = next;
+	}
+#ifdef CACHE_LOCKING
+	pthread_mutex_destroy (&context->cachelock);
 #endif
 	free (context);
 
@@ -204,7 +508,22 @@ dc_context_set_loglevel (dc_context_t *context, dc_loglevel_t loglevel)
 		return DC_STATUS_INVALIDARGS;
 
 #ifdef ENABLE_LOGGING
-	context->loglevel = loglevel;
+	for (unsigned int i = 0; i < C_ARRAY_SIZE (context->loglevel); ++i) {
+		context->loglevel[i] = loglevel;
+	}
+#endif
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_context_set_subsystem_loglevel (dc_context_t *context, dc_logsubsystem_t subsystem, dc_loglevel_t loglevel)
+{
+	if (context == NULL || subsystem >= C_ARRAY_SIZE (context->loglevel))
+		return DC_STATUS_INVALIDARGS;
+
+#ifdef ENABLE_LOGGING
+	context->loglevel[subsystem] = loglevel;
 #endif
 
 	return DC_STATUS_SUCCESS;
@@ -225,34 +544,311 @@ dc_context_set_logfunc (dc_context_t *context, dc_logfunc_t logfunc, void *userd
 }
 
 dc_status_t
-dc_context_log (dc_context_t *context, dc_loglevel_t loglevel, const char *file, unsigned int line, const char *function, const char *format, ...)
+dc_context_set_logsink (dc_context_t *context, dc_logsink_t sink, void *userdata)
 {
+	if (context == NULL)
+		return DC_STATUS_INVALIDARGS;
+
 #ifdef ENABLE_LOGGING
-	va_list ap;
+	context->logsink = sink;
+	context->sinkdata = userdata;
+#endif
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_context_set_logqueue (dc_context_t *context, unsigned int capacity)
+{
+	if (context == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	// The queue is shared, and can only be changed on the parent.
+	if (context->root != context)
+		return DC_STATUS_UNSUPPORTED;
+
+#ifdef LOG_QUEUE
+	// Flush and stop the existing queue.
+	dc_logqueue_stop (context);
+
+	if (capacity == 0)
+		return DC_STATUS_SUCCESS;
+
+	// Round the capacity up to a power of two.
+	size_t count = 1;
+	while (count < capacity)
+		count <<= 1;
+
+	dc_logqueue_t *queue = (dc_logqueue_t *) malloc (sizeof (dc_logqueue_t));
+	if (queue == NULL)
+		return DC_STATUS_NOMEMORY;
+
+	queue->slots = (dc_logslot_t *) malloc (count * sizeof (dc_logslot_t));
+	if (queue->slots == NULL) {
+		free (queue);
+		return DC_STATUS_NOMEMORY;
+	}
+
+	for (size_t i = 0; i < count; ++i) {
+		queue->slots[i].sequence = i;
+	}
+
+	queue->mask = count - 1;
+	queue->enqueue = 0;
+	queue->dequeue = 0;
+	queue->waiting = 0;
+	queue->stop = 0;
+	pthread_mutex_init (&queue->mutex, NULL);
+	pthread_cond_init (&queue->cond, NULL);
+
+	context->queue = queue;
+
+	if (pthread_create (&queue->thread, NULL, dc_logqueue_run, context) != 0) {
+		context->queue = NULL;
+		pthread_cond_destroy (&queue->cond);
+		pthread_mutex_destroy (&queue->mutex);
+		free (queue->slots);
+		free (queue);
+		return DC_STATUS_IO;
+	}
+
+	return DC_STATUS_SUCCESS;
+#else
+	if (capacity == 0)
+		return DC_STATUS_SUCCESS;
+
+	return DC_STATUS_UNSUPPORTED;
 #endif
+}
 
+dc_status_t
+dc_context_set_allocator (dc_context_t *context, dc_allocfunc_t allocfunc, void *userdata)
+{
 	if (context == NULL)
 		return DC_STATUS_INVALIDARGS;
 
+	context->allocfunc = allocfunc;
+	context->allocdata = userdata;
+
+	return DC_STATUS_SUCCESS;
+}
+
+void *
+dc_malloc (dc_context_t *context, size_t size)
+{
+	if (context && context->allocfunc) {
+		if (size == 0)
+			return NULL;
+		return context->allocfunc (context, NULL, size, context->allocdata);
+	}
+
+	return malloc (size);
+}
+
+void *
+dc_realloc (dc_context_t *context, void *ptr, size_t size)
+{
+	if (context && context->allocfunc) {
+		if (size == 0)
+			return NULL;
+		return context->allocfunc (context, ptr, size, context->allocdata);
+	}
+
+	return realloc (ptr, size);
+}
+
+void
+dc_free (dc_context_t *context, void *ptr)
+{
+	if (ptr == NULL)
+		return;
+
+	if (context && context->allocfunc) {
+		context->allocfunc (context, ptr, 0, context->allocdata);
+		return;
+	}
+
+	free (ptr);
+}
+
+static dc_cacheentry_t *
+dc_context_cache_find (dc_context_t *context, const void *key, size_t size)
+{
+	for (dc_cacheentry_t *entry = context->cache; entry; entry = entry->next) {
+		if (entry->size == size && memcmp (entry->key, key, size) == 0)
+			return entry;
+	}
+
+	return NULL;
+}
+
+int
+dc_context_cache_get (dc_context_t *context, const void *key, size_t size, unsigned int *value)
+{
+	if (context == NULL || key == NULL)
+		return 0;
+
+	context = context->root;
+
+#ifdef CACHE_LOCKING
+	pthread_mutex_lock (&context->cachelock);
+#endif
+
+	dc_cacheentry_t *entry = dc_context_cache_find (context, key, size);
+	if (entry && value)
+		*value = entry->value;
+
+#ifdef CACHE_LOCKING
+	pthread_mutex_unlock (&context->cachelock);
+#endif
+
+	return entry != NULL;
+}
+
+dc_status_t
+dc_context_cache_set (dc_context_t *context, const void *key, size_t size, unsigned int value)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (context == NULL || key == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	context = context->root;
+
+#ifdef CACHE_LOCKING
+	pthread_mutex_lock (&context->cachelock);
+#endif
+
+	dc_cacheentry_t *entry = dc_context_cache_find (context, key, size);
+	if (entry == NULL) {
+		entry = (dc_cacheentry_t *) malloc (sizeof (dc_cacheentry_t) + size);
+		if (entry) {
+			memcpy (entry->key, key, size);
+			entry->size = size;
+			entry->next = context->cache;
+			context->cache = entry;
+		} else {
+			status = DC_STATUS_NOMEMORY;
+		}
+	}
+
+	if (entry)
+		entry->value = value;
+
+#ifdef CACHE_LOCKING
+	pthread_mutex_unlock (&context->cachelock);
+#endif
+
+	return status;
+}
+
+dc_datetime_t *
+dc_context_localtime (dc_context_t *context, dc_datetime_t *result, dc_ticks_t ticks)
+{
+	if (context == NULL)
+		return dc_datetime_localtime (result, ticks);
+
+	context = context->root;
+
+	dc_ticks_t period = ticks / TZCACHE_PERIOD - (ticks % TZCACHE_PERIOD < 0);
+	dc_tzentry_t *entry = &context->tzcache[(unsigned long long) period % TZCACHE_SIZE];
+
+	int found = 0, offset = 0;
+
+#ifdef CACHE_LOCKING
+	pthread_mutex_lock (&context->cachelock);
+#endif
+	if (entry->valid && entry->period == period) {
+		offset = entry->offset;
+		found = 1;
+	}
+#ifdef CACHE_LOCKING
+	pthread_mutex_unlock (&context->cachelock);
+#endif
+
+	if (!found) {
+		// The offset at the start of the period applies to the entire
+		// period.
+		dc_datetime_t dt;
+		if (dc_datetime_localtime (&dt, period * TZCACHE_PERIOD) == NULL)
+			return NULL;
+
+		offset = dt.timezone;
+
+#ifdef CACHE_LOCKING
+		pthread_mutex_lock (&context->cachelock);
+#endif
+		entry->period = period;
+		entry->offset = offset;
+		entry->valid = 1;
+#ifdef CACHE_LOCKING
+		pthread_mutex_unlock (&context->cachelock);
+#endif
+	}
+
+	return dc_datetime_gmtime2 (result, ticks, offset);
+}
+
+int
+dc_context_log_enabled (dc_context_t *context, dc_logsubsystem_t subsystem, dc_loglevel_t loglevel)
+{
+	if (context == NULL || subsystem >= C_ARRAY_SIZE (context->loglevel))
+		return 0;
+
 #ifdef ENABLE_LOGGING
-	if (loglevel > context->loglevel)
+	return loglevel <= context->loglevel[subsystem];
+#else
+	return 0;
+#endif
+}
+
+dc_status_t
+dc_context_log (dc_context_t *context, dc_logsubsystem_t subsystem, dc_loglevel_t loglevel, const char *file, unsigned int line, const char *function, const char *format, ...)
+{
+#ifdef ENABLE_LOGGING
+	char msg[MSGSIZE];
+	va_list ap;
+#endif
+
+	if (context == NULL || subsystem >= C_ARRAY_SIZE (context->loglevel))
+		return DC_STATUS_INVALIDARGS;
+
+#ifdef ENABLE_LOGGING
+	if (loglevel > context->loglevel[subsystem])
+		return DC_STATUS_SUCCESS;
+
+	if (context->logsink) {
+		dc_logrecord_t record;
+		va_start (ap, format);
+		record.subsystem = subsystem;
+		record.loglevel = loglevel;
+		record.file = file;
+		record.line = line;
+		record.function = function;
+		record.format = format;
+		record.args = &ap;
+		record.data = NULL;
+		record.size = 0;
+		dc_context_record (context, &record);
+		va_end (ap);
 		return DC_STATUS_SUCCESS;
+	}
 
 	if (context->logfunc == NULL)
 		return DC_STATUS_SUCCESS;
 
 	va_start (ap, format);
-	l_vsnprintf (context->msg, sizeof (context->msg), format, ap);
+	l_vsnprintf (msg, sizeof (msg), format, ap);
 	va_end (ap);
 
-	context->logfunc (context, loglevel, file, line, function, context->msg, context->userdata);
+	dc_context_deliver (context, loglevel, file, line, function, msg);
 #endif
 
 	return DC_STATUS_SUCCESS;
 }
 
 dc_status_t
-dc_context_syserror (dc_context_t *context, dc_loglevel_t loglevel, const char *file, unsigned int line, const char *function, int errcode)
+dc_context_syserror (dc_context_t *context, dc_logsubsystem_t subsystem, dc_loglevel_t loglevel, const char *file, unsigned int line, const char *function, int errcode)
 {
 	const char *errmsg = NULL;
 
@@ -288,38 +884,123 @@ dc_context_syserror (dc_context_t *context, dc_loglevel_t loglevel, const char *
 	if (errmsg == NULL)
 		errmsg = "Unknown system error";
 
-	return dc_context_log (context, loglevel, file, line, function, "%s (%d)", errmsg, errcode);
+	return dc_context_log (context, subsystem, loglevel, file, line, function, "%s (%d)", errmsg, errcode);
 }
 
 dc_status_t
-dc_context_hexdump (dc_context_t *context, dc_loglevel_t loglevel, const char *file, unsigned int line, const char *function, const char *prefix, const unsigned char data[], unsigned int size)
+dc_context_hexdump (dc_context_t *context, dc_logsubsystem_t subsystem, dc_loglevel_t loglevel, const char *file, unsigned int line, const char *function, const char *prefix, const unsigned char data[], unsigned int size)
 {
 #ifdef ENABLE_LOGGING
+	char msg[MSGSIZE];
 	int n;
 #endif
 
-	if (context == NULL || prefix == NULL)
+	if (context == NULL || prefix == NULL || subsystem >= C_ARRAY_SIZE (context->loglevel))
 		return DC_STATUS_INVALIDARGS;
 
 #ifdef ENABLE_LOGGING
-	if (loglevel > context->loglevel)
+	if (loglevel > context->loglevel[subsystem])
+		return DC_STATUS_SUCCESS;
+
+	if (context->logsink) {
+		dc_logrecord_t record;
+		record.subsystem = subsystem;
+		record.loglevel = loglevel;
+		record.file = file;
+		record.line = line;
+		record.function = function;
+		record.format = prefix;
+		record.args = NULL;
+		record.data = data;
+		record.size = size;
+		dc_context_record (context, &record);
 		return DC_STATUS_SUCCESS;
+	}
 
 	if (context->logfunc == NULL)
 		return DC_STATUS_SUCCESS;
 
-	n = l_snprintf (context->msg, sizeof (context->msg), "%s: size=%u, data=", prefix, size);
+	n = l_snprintf (msg, sizeof (msg), "%s: size=%u, data=", prefix, size);
 
 	if (n >= 0) {
-		n = l_hexdump (context->msg + n, sizeof (context->msg) - n, data, size);
+		n = l_hexdump (msg + n, sizeof (msg) - n, data, size);
 	}
 
-	context->logfunc (context, loglevel, file, line, function, context->msg, context->userdata);
+	dc_context_deliver (context, loglevel, file, line, function, msg);
 #endif
 
 	return DC_STATUS_SUCCESS;
 }
 
+dc_status_t
+dc_logrecord_format (const dc_logrecord_t *record, char *buffer, size_t size)
+{
+	if (record == NULL || record->format == NULL || buffer == NULL || size == 0)
+		return DC_STATUS_INVALIDARGS;
+
+#ifdef ENABLE_LOGGING
+	if (record->data) {
+		int n = l_snprintf (buffer, size, "%s: size=%u, data=", record->format, record->size);
+		if (n >= 0) {
+			l_hexdump (buffer + n, size - n, record->data, record->size);
+		}
+	} else if (record->args) {
+		va_list ap;
+		va_copy (ap, *record->args);
+		l_vsnprintf (buffer, size, record->format, ap);
+		va_end (ap);
+	} else {
+		l_snprintf (buffer, size, "%s", record->format);
+	}
+
+	return DC_STATUS_SUCCESS;
+#else
+	buffer[0] = 0;
+
+	return DC_STATUS_UNSUPPORTED;
+#endif
+}
+
+#ifdef ENABLE_PERF_STATS
+dc_context_stats_t g_perfstats;
+
+static unsigned long long
+dc_context_stats_load (unsigned long long *counter)
+{
+#if defined(__GNUC__)
+	return __atomic_load_n (counter, __ATOMIC_RELAXED);
+#else
+	return *counter;
+#endif
+}
+#endif
+
+dc_status_t
+dc_context_get_stats (dc_context_t *context, dc_context_stats_t *stats)
+{
+	UNUSED(context);
+
+	if (stats == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+#ifdef ENABLE_PERF_STATS
+	stats->buffer_allocs = dc_context_stats_load (&g_perfstats.buffer_allocs);
+	stats->buffer_moved = dc_context_stats_load (&g_perfstats.buffer_moved);
+	stats->checksum_bytes = dc_context_stats_load (&g_perfstats.checksum_bytes);
+	stats->device_reads = dc_context_stats_load (&g_perfstats.device_reads);
+	stats->device_bytes = dc_context_stats_load (&g_perfstats.device_bytes);
+	stats->iostream_reads = dc_context_stats_load (&g_perfstats.iostream_reads);
+	stats->samples = dc_context_stats_load (&g_perfstats.samples);
+	stats->callbacks = dc_context_stats_load (&g_perfstats.callbacks);
+
+	return DC_STATUS_SUCCESS;
+#else
+	memset (stats, 0, sizeof (*stats));
+
+	return DC_STATUS_UNSUPPORTED;
+#endif
+}
+
 unsigned int
 dc_context_get_transports (dc_context_t *context)
 {
@@ -75,7 +75,8 @@ static const dc_device_vtable_t cressi_edy_device_vtable = {
 	cressi_edy_device_dump, /* dump */
 	cressi_edy_device_foreach, /* foreach */
 	NULL, /* timesync */
-	cressi_edy_device_close /* close */
+	cressi_edy_device_close, /* close */
+	SZ_PACKET /* pagesize */
 };
 
 static const cressi_edy_layout_t cressi_edy_layout = {
@@ -109,6 +110,8 @@ cressi_edy_packet (cressi_edy_device_t *device, const unsigned char command[], u
 	if (device_is_cancelled (abstract))
 		return DC_STATUS_CANCELLED;
 
+	dc_usecs_t start = device_latency_start (abstract);
+
 	for (unsigned int i = 0; i < csize; ++i) {
 		// Send the command to the device.
 		status = dc_iostream_write (device->iostream, command + i, 1, NULL);
@@ -147,6 +150,8 @@ cressi_edy_packet (cressi_edy_device_t *device, const unsigned char command[], u
 		}
 	}
 
+	device_latency_emit (abstract, command[0], asize, start);
+
 	return DC_STATUS_SUCCESS;
 }
 
@@ -472,7 +477,7 @@ cressi_edy_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, v
 
 	// Create the ringbuffer stream.
 	dc_rbstream_t *rbstream = NULL;
-	rc = dc_rbstream_new (&rbstream, abstract, SZ_PAGE, SZ_PACKET, layout->rb_profile_begin, layout->rb_profile_end, eop);
+	rc = dc_rbstream_new (&rbstream, abstract, SZ_PAGE, SZ_PACKET, layout->rb_profile_begin, layout->rb_profile_end, eop, DC_RBSTREAM_BACKWARD);
 	if (rc != DC_STATUS_SUCCESS) {
 		ERROR (abstract->context, "Failed to create the ringbuffer stream.");
 		return rc;
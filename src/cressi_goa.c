@@ -216,9 +216,14 @@ cressi_goa_device_download (cressi_goa_device_t *device, dc_buffer_t *buffer, dc
 			return status;
 		}
 
-		// Get the total size from the first data packet.
+		// Get the total size from the first data packet, and allocate
+		// the buffer at once.
 		if (nbytes == 0) {
 			size += array_uint16_le (packet + 3);
+			if (!dc_buffer_reserve (buffer, size - skip)) {
+				ERROR (abstract->context, "Insufficient buffer space available.");
+				return DC_STATUS_NOMEMORY;
+			}
 		}
 
 		// Calculate the payload size of the packet.
@@ -267,6 +272,31 @@ cressi_goa_device_download (cressi_goa_device_t *device, dc_buffer_t *buffer, dc
 	return status;
 }
 
+static dc_status_t
+cressi_goa_device_response (cressi_goa_device_t *device,
+                            unsigned char output[], unsigned int osize,
+                            dc_buffer_t *buffer,
+                            dc_event_progress_t *progress)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	// Receive the answer from the dive computer.
+	status = cressi_goa_device_receive (device, output, osize);
+	if (status != DC_STATUS_SUCCESS) {
+		return status;
+	}
+
+	// Download the optional and variable sized payload.
+	if (buffer) {
+		status = cressi_goa_device_download (device, buffer, progress);
+		if (status != DC_STATUS_SUCCESS) {
+			return status;
+		}
+	}
+
+	return status;
+}
+
 static dc_status_t
 cressi_goa_device_transfer (cressi_goa_device_t *device,
                             unsigned char cmd,
@@ -276,6 +306,9 @@ cressi_goa_device_transfer (cressi_goa_device_t *device,
                             dc_event_progress_t *progress)
 {
 	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_device_t *abstract = (dc_device_t *) device;
+
+	dc_usecs_t start = device_latency_start (abstract);
 
 	// Send the command to the dive computer.
 	status = cressi_goa_device_send (device, cmd, input, isize);
@@ -284,20 +317,32 @@ cressi_goa_device_transfer (cressi_goa_device_t *device,
 	}
 
 	// Receive the answer from the dive computer.
-	status = cressi_goa_device_receive (device, output, osize);
+	status = cressi_goa_device_response (device, output, osize, buffer, progress);
 	if (status != DC_STATUS_SUCCESS) {
 		return status;
 	}
 
-	// Download the optional and variable sized payload.
-	if (buffer) {
-		status = cressi_goa_device_download (device, buffer, progress);
-		if (status != DC_STATUS_SUCCESS) {
-			return status;
-		}
+	device_latency_emit (abstract, cmd, buffer ? dc_buffer_get_size (buffer) : osize, start);
+
+	return DC_STATUS_SUCCESS;
+}
+
+/*
+ * Find the next logbook entry to download, starting at the given index.
+ * The entries are stored from the end of the logbook, most recent first.
+ * Dives in the set of known fingerprints are skipped.
+ */
+static unsigned int
+cressi_goa_device_next (cressi_goa_device_t *device, const unsigned char logbook[], size_t size, unsigned int index, unsigned int count)
+{
+	while (index < count) {
+		unsigned int offset = size - (index + 1) * SZ_HEADER;
+		if (!device_is_known ((dc_device_t *) device, logbook + offset + FP_OFFSET, FP_SIZE))
+			break;
+		index++;
 	}
 
-	return status;
+	return index;
 }
 
 
@@ -428,7 +473,7 @@ cressi_goa_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, v
 	size_t logbook_size = dc_buffer_get_size(logbook);
 
 	// Count the number of dives.
-	unsigned int count = 0;
+	unsigned int count = 0, ndives = 0;
 	unsigned int offset = logbook_size;
 	while (offset > SZ_HEADER) {
 		// Move to the start of the logbook entry.
@@ -444,11 +489,16 @@ cressi_goa_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, v
 			break;
 		}
 
+		// Skip dives which are already known.
+		if (!device_is_known (abstract, logbook_data + offset + FP_OFFSET, FP_SIZE)) {
+			ndives++;
+		}
+
 		count++;
 	}
 
 	// Update and emit a progress event.
-	progress.maximum = (count + 1) * NSTEPS;
+	progress.maximum = (ndives + 1) * NSTEPS;
 	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
 
 	// Allocate memory for the dive data.
@@ -458,14 +508,23 @@ cressi_goa_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, v
 		goto error_free_logbook;
 	}
 
+	// Request the first dive.
+	unsigned int index = cressi_goa_device_next (device, logbook_data, logbook_size, 0, count);
+	if (index < count) {
+		offset = logbook_size - (index + 1) * SZ_HEADER;
+		status = cressi_goa_device_send (device, CMD_DIVE, logbook_data + offset, 2);
+		if (status != DC_STATUS_SUCCESS) {
+			ERROR (abstract->context, "Failed to read the dive data.");
+			goto error_free_dive;
+		}
+	}
+
 	// Download the dives.
-	offset = logbook_size;
-	for (unsigned int i = 0; i < count; ++i) {
-		// Move to the start of the logbook entry.
-		offset -= SZ_HEADER;
+	while (index < count) {
+		offset = logbook_size - (index + 1) * SZ_HEADER;
 
 		// Read the dive data.
-		status = cressi_goa_device_transfer (device, CMD_DIVE, logbook_data + offset, 2, NULL, 0, dive, &progress);
+		status = cressi_goa_device_response (device, NULL, 0, dive, &progress);
 		if (status != DC_STATUS_SUCCESS) {
 			ERROR (abstract->context, "Failed to read the dive data.");
 			goto error_free_dive;
@@ -485,8 +544,32 @@ cressi_goa_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, v
 			goto error_free_dive;
 		}
 
-		if (callback && !callback(dive_data, dive_size, dive_data + FP_OFFSET - 5, sizeof(device->fingerprint), userdata))
+		// Request the next dive before processing this one. The device
+		// is idle after the last ack, and can already prepare the next
+		// dive while the callback runs.
+		unsigned int next = cressi_goa_device_next (device, logbook_data, logbook_size, index + 1, count);
+		if (next < count) {
+			unsigned int noffset = logbook_size - (next + 1) * SZ_HEADER;
+			status = cressi_goa_device_send (device, CMD_DIVE, logbook_data + noffset, 2);
+			if (status != DC_STATUS_SUCCESS) {
+				ERROR (abstract->context, "Failed to read the dive data.");
+				goto error_free_dive;
+			}
+		}
+
+		if (callback && !callback(dive_data, dive_size, dive_data + FP_OFFSET - 5, sizeof(device->fingerprint), userdata)) {
+			// The device has no command to abort a transfer, so the
+			// data of the request in flight is received and discarded.
+			if (next < count) {
+				status = cressi_goa_device_response (device, NULL, 0, dive, NULL);
+				if (status != DC_STATUS_SUCCESS) {
+					ERROR (abstract->context, "Failed to read the dive data.");
+				}
+			}
 			break;
+		}
+
+		index = next;
 	}
 
 error_free_dive:
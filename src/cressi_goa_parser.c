@@ -19,6 +19,8 @@
  * MA 02110-1301 USA
  */
 
+#define LOG_SUBSYSTEM DC_LOGSUBSYSTEM_PARSER
+
 #include <stdlib.h>
 
 #include "cressi_goa.h"
@@ -38,9 +40,6 @@ typedef struct cressi_goa_parser_t cressi_goa_parser_t;
 struct cressi_goa_parser_t {
 	dc_parser_t base;
 	unsigned int model;
-	// Cached fields.
-	unsigned int cached;
-	double maxdepth;
 };
 
 static dc_status_t cressi_goa_parser_set_data (dc_parser_t *abstract, const unsigned char *data, unsigned int size);
@@ -74,8 +73,6 @@ cressi_goa_parser_create (dc_parser_t **out, dc_context_t *context, unsigned int
 	}
 
 	parser->model = model;
-	parser->cached = 0;
-	parser->maxdepth = 0.0;
 
 	*out = (dc_parser_t*) parser;
 
@@ -85,12 +82,6 @@ cressi_goa_parser_create (dc_parser_t **out, dc_context_t *context, unsigned int
 static dc_status_t
 cressi_goa_parser_set_data (dc_parser_t *abstract, const unsigned char *data, unsigned int size)
 {
-	cressi_goa_parser_t *parser = (cressi_goa_parser_t *) abstract;
-
-	// Reset the cache.
-	parser->cached = 0;
-	parser->maxdepth = 0.0;
-
 	return DC_STATUS_SUCCESS;
 }
 
@@ -118,22 +109,16 @@ cressi_goa_parser_get_datetime (dc_parser_t *abstract, dc_datetime_t *datetime)
 static dc_status_t
 cressi_goa_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, unsigned int flags, void *value)
 {
-	cressi_goa_parser_t *parser = (cressi_goa_parser_t *) abstract;
 	if (abstract->size < SZ_HEADER)
 		return DC_STATUS_DATAFORMAT;
 
 	const unsigned char *data = abstract->data;
 
-	if (!parser->cached) {
-		sample_statistics_t statistics = SAMPLE_STATISTICS_INITIALIZER;
-		dc_status_t rc = cressi_goa_parser_samples_foreach (
-			abstract, sample_statistics_cb, &statistics);
-		if (rc != DC_STATUS_SUCCESS)
-			return rc;
-
-		parser->cached = 1;
-		parser->maxdepth = statistics.maxdepth;
-	}
+	// Get the sample statistics.
+	sample_statistics_t statistics = SAMPLE_STATISTICS_INITIALIZER;
+	dc_status_t rc = parser_get_statistics (abstract, &statistics);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
 
 	dc_gasmix_t *gasmix = (dc_gasmix_t *) value;
 
@@ -143,7 +128,7 @@ cressi_goa_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, unsign
 			*((unsigned int *) value) = array_uint16_le (data + 0x14);
 			break;
 		case DC_FIELD_MAXDEPTH:
-			*((double *) value) = parser->maxdepth;
+			*((double *) value) = statistics.maxdepth;
 			break;
 		case DC_FIELD_GASMIX_COUNT:
 			*((unsigned int *) value) = 2;
@@ -153,6 +138,21 @@ cressi_goa_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, unsign
 			gasmix->oxygen = data[0x1B + 2 * flags] / 100.0;
 			gasmix->nitrogen = 1.0 - gasmix->oxygen - gasmix->helium;
 			break;
+		case DC_FIELD_AVGDEPTH:
+			if (statistics.ndepths == 0)
+				return DC_STATUS_UNSUPPORTED;
+			*((double *) value) = statistics.avgdepth;
+			break;
+		case DC_FIELD_TEMPERATURE_MINIMUM:
+			if (statistics.ntemperatures == 0)
+				return DC_STATUS_UNSUPPORTED;
+			*((double *) value) = statistics.temperature_minimum;
+			break;
+		case DC_FIELD_TEMPERATURE_MAXIMUM:
+			if (statistics.ntemperatures == 0)
+				return DC_STATUS_UNSUPPORTED;
+			*((double *) value) = statistics.temperature_maximum;
+			break;
 		default:
 			return DC_STATUS_UNSUPPORTED;
 		}
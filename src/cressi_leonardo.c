@@ -33,6 +33,7 @@
 #define ISINSTANCE(device) dc_device_isinstance((device), &cressi_leonardo_device_vtable)
 
 #define SZ_MEMORY 32000
+#define SZ_HEADER 0x68
 
 #define RB_LOGBOOK_BEGIN 0x0100
 #define RB_LOGBOOK_END   0x1438
@@ -69,9 +70,6 @@ static const dc_device_vtable_t cressi_leonardo_device_vtable = {
 	NULL /* close */
 };
 
-static dc_status_t
-cressi_leonardo_extract_dives (dc_device_t *abstract, const unsigned char data[], unsigned int size, dc_dive_callback_t callback, void *userdata);
-
 static void
 cressi_leonardo_make_ascii (const unsigned char raw[], unsigned int rsize, unsigned char ascii[], unsigned int asize)
 {
@@ -103,6 +101,8 @@ cressi_leonardo_packet (cressi_leonardo_device_t *device, const unsigned char co
 	if (device_is_cancelled (abstract))
 		return DC_STATUS_CANCELLED;
 
+	dc_usecs_t start = device_latency_start (abstract);
+
 	// Send the command to the device.
 	status = dc_iostream_write (device->iostream, command, csize, NULL);
 	if (status != DC_STATUS_SUCCESS) {
@@ -135,6 +135,9 @@ cressi_leonardo_packet (cressi_leonardo_device_t *device, const unsigned char co
 		return DC_STATUS_PROTOCOL;
 	}
 
+	// The read command is the only command, and has no opcode.
+	device_latency_emit (abstract, 0, asize, start);
+
 	return DC_STATUS_SUCCESS;
 }
 
@@ -381,26 +384,227 @@ cressi_leonardo_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 	return DC_STATUS_SUCCESS;
 }
 
+/*
+ * Read a region of the profile ringbuffer, which may wrap around the end.
+ */
+static dc_status_t
+cressi_leonardo_device_read_profile (dc_device_t *abstract, unsigned int address, unsigned int size, unsigned char data[], dc_event_progress_t *progress)
+{
+	dc_status_t rc = DC_STATUS_SUCCESS;
+
+	ringbuffer_span_t spans[2];
+	unsigned int end = ringbuffer_increment (address, size, RB_PROFILE_BEGIN, RB_PROFILE_END);
+	unsigned int nspans = ringbuffer_span (address, end, 1, RB_PROFILE_BEGIN, RB_PROFILE_END, spans);
+	for (unsigned int i = 0; i < nspans; ++i) {
+		rc = cressi_leonardo_device_read (abstract, spans[i].address, data, spans[i].size);
+		if (rc != DC_STATUS_SUCCESS) {
+			ERROR (abstract->context, "Failed to read the profile data.");
+			return rc;
+		}
+
+		data += spans[i].size;
+
+		// Update and emit a progress event.
+		progress->current += spans[i].size;
+		device_event_emit (abstract, DC_EVENT_PROGRESS, progress);
+	}
+
+	return rc;
+}
+
+/*
+ * Download only the dives newer than the fingerprint. The logbook is
+ * read first, until the fingerprint is found, followed by the profile
+ * data of the new dives. The small packets of the read command are
+ * much slower than the bulk transfer of the full memory dump, so once
+ * the new data exceeds a quarter of the memory, the caller falls back
+ * to the full dump instead (DC_STATUS_UNSUPPORTED).
+ */
+static dc_status_t
+cressi_leonardo_device_foreach_partial (dc_device_t *abstract, const unsigned char header[], dc_dive_callback_t callback, void *userdata)
+{
+	dc_status_t rc = DC_STATUS_SUCCESS;
+	cressi_leonardo_device_t *device = (cressi_leonardo_device_t *) abstract;
+
+	// Enable progress notifications.
+	dc_event_progress_t progress = EVENT_PROGRESS_INITIALIZER;
+	progress.current = SZ_HEADER;
+	progress.maximum = SZ_HEADER + RB_LOGBOOK_END - RB_LOGBOOK_BEGIN;
+	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
+
+	// Get the logbook pointer.
+	unsigned int last = array_uint16_le(header + 0x64);
+	if (last < RB_LOGBOOK_BEGIN || last > RB_LOGBOOK_END ||
+		((last - RB_LOGBOOK_BEGIN) % RB_LOGBOOK_SIZE) != 0) {
+		ERROR (abstract->context, "Invalid logbook pointer (0x%04x).", last);
+		return DC_STATUS_DATAFORMAT;
+	}
+
+	// Convert to an index.
+	unsigned int latest = (last - RB_LOGBOOK_BEGIN) / RB_LOGBOOK_SIZE;
+
+	// Get the profile pointer.
+	unsigned int eop = array_uint16_le(header + 0x66);
+	if (eop < RB_PROFILE_BEGIN || eop > RB_PROFILE_END) {
+		ERROR (abstract->context, "Invalid profile pointer (0x%04x).", eop);
+		return DC_STATUS_DATAFORMAT;
+	}
+
+	unsigned char *logbook = (unsigned char *) malloc (RB_LOGBOOK_END - RB_LOGBOOK_BEGIN);
+	unsigned char *buffer = (unsigned char *) malloc (RB_LOGBOOK_SIZE + RB_PROFILE_END - RB_PROFILE_BEGIN);
+	if (logbook == NULL || buffer == NULL) {
+		ERROR (abstract->context, "Failed to allocate memory.");
+		rc = DC_STATUS_NOMEMORY;
+		goto error_free;
+	}
+
+	// Read the logbook entries of the new dives, and calculate the total
+	// amount of profile data.
+	unsigned int ndives = 0;
+	unsigned int nbytes = 0;
+	unsigned int previous = eop;
+	unsigned int remaining = RB_PROFILE_END - RB_PROFILE_BEGIN;
+	for (unsigned int i = 0; i < RB_LOGBOOK_COUNT; ++i) {
+		unsigned int idx = (latest + RB_LOGBOOK_COUNT - i) % RB_LOGBOOK_COUNT;
+		unsigned int offset = RB_LOGBOOK_BEGIN + idx * RB_LOGBOOK_SIZE;
+		unsigned char *entry = logbook + ndives * RB_LOGBOOK_SIZE;
+
+		rc = cressi_leonardo_device_read (abstract, offset, entry, RB_LOGBOOK_SIZE);
+		if (rc != DC_STATUS_SUCCESS) {
+			ERROR (abstract->context, "Failed to read the logbook entry.");
+			goto error_free;
+		}
+
+		// Update and emit a progress event.
+		progress.current += RB_LOGBOOK_SIZE;
+		device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
+
+		// Ignore uninitialized header entries.
+		if (array_isequal (entry, RB_LOGBOOK_SIZE, 0xFF))
+			break;
+
+		// Get the ringbuffer pointers.
+		unsigned int begin = array_uint16_le (entry + 2);
+		unsigned int end = array_uint16_le (entry + 4);
+		if (begin < RB_PROFILE_BEGIN || begin + 2 > RB_PROFILE_END ||
+			end < RB_PROFILE_BEGIN || end + 2 > RB_PROFILE_END)
+		{
+			ERROR (abstract->context, "Invalid ringbuffer pointer detected (0x%04x 0x%04x).", begin, end);
+			rc = DC_STATUS_DATAFORMAT;
+			goto error_free;
+		}
+
+		if (previous && previous != end + 2) {
+			ERROR (abstract->context, "Profiles are not continuous (0x%04x 0x%04x 0x%04x).", begin, end, previous);
+			rc = DC_STATUS_DATAFORMAT;
+			goto error_free;
+		}
+
+		// Check the fingerprint data.
+		if (memcmp (entry + 8, device->fingerprint, sizeof (device->fingerprint)) == 0)
+			break;
+
+		unsigned int length = RB_PROFILE_DISTANCE (begin, end) - 2;
+		if (remaining && remaining >= length + 4) {
+			nbytes += length + 4;
+			remaining -= length + 4;
+		} else {
+			remaining = 0;
+		}
+
+		previous = begin;
+		ndives++;
+	}
+
+	if (nbytes > SZ_MEMORY / 4) {
+		rc = DC_STATUS_UNSUPPORTED;
+		goto error_free;
+	}
+
+	// Update and emit a progress event.
+	progress.maximum = progress.current + nbytes;
+	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
+
+	for (unsigned int i = 0; i < ndives; ++i) {
+		const unsigned char *entry = logbook + i * RB_LOGBOOK_SIZE;
+		unsigned int begin = array_uint16_le (entry + 2);
+		unsigned int end = array_uint16_le (entry + 4);
+		unsigned int length = RB_PROFILE_DISTANCE (begin, end) - 2;
+
+		if (nbytes >= length + 4) {
+			// Read the profile data, including the pointers at both ends.
+			// The leading pointer is overwritten by the logbook entry.
+			unsigned char *profile = buffer + RB_LOGBOOK_SIZE - 2;
+			rc = cressi_leonardo_device_read_profile (abstract, begin, length + 4, profile, &progress);
+			if (rc != DC_STATUS_SUCCESS)
+				goto error_free;
+
+			// Get the same pointers from the profile.
+			unsigned int end2 = array_uint16_le (profile);
+			unsigned int begin2 = array_uint16_le (profile + length + 2);
+			if (begin2 != begin || end2 != end) {
+				ERROR (abstract->context, "Invalid ringbuffer pointer detected (0x%04x 0x%04x).", begin2, end2);
+				rc = DC_STATUS_DATAFORMAT;
+				goto error_free;
+			}
+
+			nbytes -= length + 4;
+		} else {
+			// No more profile data available!
+			nbytes = 0;
+			length = 0;
+		}
+
+		// Copy the logbook entry.
+		memcpy (buffer, entry, RB_LOGBOOK_SIZE);
+
+		if (callback && !callback (buffer, RB_LOGBOOK_SIZE + length, buffer + 8, sizeof (device->fingerprint), userdata)) {
+			break;
+		}
+	}
+
+error_free:
+	free (buffer);
+	free (logbook);
+	return rc;
+}
+
 static dc_status_t
 cressi_leonardo_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, void *userdata)
 {
-	dc_buffer_t *buffer = dc_buffer_new (SZ_MEMORY);
-	if (buffer == NULL)
-		return DC_STATUS_NOMEMORY;
+	cressi_leonardo_device_t *device = (cressi_leonardo_device_t *) abstract;
 
-	dc_status_t rc = cressi_leonardo_device_dump (abstract, buffer);
+	// Read the header with the device info and the ringbuffer pointers.
+	unsigned char header[SZ_HEADER] = {0};
+	dc_status_t rc = cressi_leonardo_device_read (abstract, 0, header, sizeof (header));
 	if (rc != DC_STATUS_SUCCESS) {
-		dc_buffer_free (buffer);
+		ERROR (abstract->context, "Failed to read the header.");
 		return rc;
 	}
 
-	unsigned char *data = dc_buffer_get_data (buffer);
 	dc_event_devinfo_t devinfo;
-	devinfo.model = data[0];
+	devinfo.model = header[0];
 	devinfo.firmware = 0;
-	devinfo.serial = array_uint24_le (data + 1);
+	devinfo.serial = array_uint24_le (header + 1);
 	device_event_emit (abstract, DC_EVENT_DEVINFO, &devinfo);
 
+	// With a fingerprint, try to download only the new dives.
+	if (!array_isequal (device->fingerprint, sizeof (device->fingerprint), 0x00)) {
+		rc = cressi_leonardo_device_foreach_partial (abstract, header, callback, userdata);
+		if (rc != DC_STATUS_UNSUPPORTED)
+			return rc;
+	}
+
+	dc_buffer_t *buffer = dc_buffer_new (SZ_MEMORY);
+	if (buffer == NULL)
+		return DC_STATUS_NOMEMORY;
+
+	rc = cressi_leonardo_device_dump (abstract, buffer);
+	if (rc != DC_STATUS_SUCCESS) {
+		dc_buffer_free (buffer);
+		return rc;
+	}
+
 	rc = cressi_leonardo_extract_dives (abstract, dc_buffer_get_data (buffer),
 		dc_buffer_get_size (buffer), callback, userdata);
 
@@ -409,7 +613,7 @@ cressi_leonardo_device_foreach (dc_device_t *abstract, dc_dive_callback_t callba
 	return rc;
 }
 
-static dc_status_t
+dc_status_t
 cressi_leonardo_extract_dives (dc_device_t *abstract, const unsigned char data[], unsigned int size, dc_dive_callback_t callback, void *userdata)
 {
 	cressi_leonardo_device_t *device = (cressi_leonardo_device_t *) abstract;
@@ -497,13 +701,13 @@ cressi_leonardo_extract_dives (dc_device_t *abstract, const unsigned char data[]
 			}
 
 			// Copy the profile data.
-			if (address + length > RB_PROFILE_END) {
-				unsigned int len_a = RB_PROFILE_END - address;
-				unsigned int len_b = length - len_a;
-				memcpy (buffer + RB_LOGBOOK_SIZE, data + address, len_a);
-				memcpy (buffer + RB_LOGBOOK_SIZE + len_a, data + RB_PROFILE_BEGIN, len_b);
-			} else {
-				memcpy (buffer + RB_LOGBOOK_SIZE, data + address, length);
+			ringbuffer_span_t spans[2];
+			unsigned int end = ringbuffer_increment (address, length, RB_PROFILE_BEGIN, RB_PROFILE_END);
+			unsigned int nspans = ringbuffer_span (address, end, 0, RB_PROFILE_BEGIN, RB_PROFILE_END, spans);
+			unsigned int n = RB_LOGBOOK_SIZE;
+			for (unsigned int i = 0; i < nspans; ++i) {
+				memcpy (buffer + n, data + spans[i].address, spans[i].size);
+				n += spans[i].size;
 			}
 
 			remaining -= length + 4;
@@ -37,6 +37,9 @@ cressi_leonardo_device_open (dc_device_t **device, dc_context_t *context, dc_ios
 dc_status_t
 cressi_leonardo_parser_create (dc_parser_t **parser, dc_context_t *context, unsigned int model);
 
+dc_status_t
+cressi_leonardo_extract_dives (dc_device_t *device, const unsigned char data[], unsigned int size, dc_dive_callback_t callback, void *userdata);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -19,7 +19,11 @@
  * MA 02110-1301 USA
  */
 
+#define LOG_SUBSYSTEM DC_LOGSUBSYSTEM_IOSTREAM
+
+#include <stddef.h> // offsetof
 #include <stdlib.h> // malloc, free
+#include <string.h> // memcpy, memset
 
 #include <libdivecomputer/custom.h>
 
@@ -42,6 +46,11 @@ static dc_status_t dc_custom_purge (dc_iostream_t *abstract, dc_direction_t dire
 static dc_status_t dc_custom_sleep (dc_iostream_t *abstract, unsigned int milliseconds);
 static dc_status_t dc_custom_close (dc_iostream_t *abstract);
 static const char *dc_custom_get_name (dc_iostream_t *abstract);
+static dc_status_t dc_custom_read_async (dc_iostream_t *abstract, void *data, size_t size, dc_iostream_callback_t callback, void *userdata);
+static dc_status_t dc_custom_write_async (dc_iostream_t *abstract, const void *data, size_t size, dc_iostream_callback_t callback, void *userdata);
+static dc_status_t dc_custom_cancel (dc_iostream_t *abstract);
+static dc_status_t dc_custom_readv (dc_iostream_t *abstract, const dc_iovec_t iov[], size_t count, size_t *actual);
+static dc_status_t dc_custom_writev (dc_iostream_t *abstract, const dc_iovec_t iov[], size_t count, size_t *actual);
 
 typedef struct dc_custom_t {
 	/* Base class. */
@@ -51,6 +60,16 @@ typedef struct dc_custom_t {
 	void *userdata;
 } dc_custom_t;
 
+/* Pending asynchronous transfer. */
+typedef struct dc_custom_transfer_t {
+	dc_iostream_t *iostream;
+	dc_iostream_callback_t callback;
+	void *userdata;
+} dc_custom_transfer_t;
+
+/* Size of the callback structure before the optional callbacks. */
+#define SZ_CALLBACKS_V1 offsetof (dc_custom_cbs_t, readv)
+
 static const dc_iostream_vtable_t dc_custom_vtable = {
 	sizeof(dc_custom_t),
 	dc_custom_set_timeout, /* set_timeout */
@@ -68,14 +87,20 @@ static const dc_iostream_vtable_t dc_custom_vtable = {
 	dc_custom_sleep, /* sleep */
 	dc_custom_close, /* close */
 	dc_custom_get_name, /* get_name */
+	dc_custom_read_async, /* read_async */
+	dc_custom_write_async, /* write_async */
+	dc_custom_cancel, /* cancel */
+	dc_custom_readv, /* readv */
+	dc_custom_writev, /* writev */
+	NULL, /* interrupt */	NULL, /* wait_readable */
 };
 
 dc_status_t
-dc_custom_open (dc_iostream_t **out, dc_context_t *context, dc_transport_t transport, const dc_custom_cbs_t *callbacks, void *userdata)
+dc_custom_open2 (dc_iostream_t **out, dc_context_t *context, dc_transport_t transport, const dc_custom_cbs_t *callbacks, size_t size, void *userdata)
 {
 	dc_custom_t *custom = NULL;
 
-	if (out == NULL || callbacks == NULL)
+	if (out == NULL || callbacks == NULL || size < SZ_CALLBACKS_V1)
 		return DC_STATUS_INVALIDARGS;
 
 	INFO (context, "Open: transport=%u", transport);
@@ -87,7 +112,11 @@ dc_custom_open (dc_iostream_t **out, dc_context_t *context, dc_transport_t trans
 		return DC_STATUS_NOMEMORY;
 	}
 
-	custom->callbacks = *callbacks;
+	// Copy only the callbacks known to the application.
+	if (size > sizeof (custom->callbacks))
+		size = sizeof (custom->callbacks);
+	memset (&custom->callbacks, 0, sizeof (custom->callbacks));
+	memcpy (&custom->callbacks, callbacks, size);
 	custom->userdata = userdata;
 
 	*out = (dc_iostream_t *) custom;
@@ -95,6 +124,12 @@ dc_custom_open (dc_iostream_t **out, dc_context_t *context, dc_transport_t trans
 	return DC_STATUS_SUCCESS;
 }
 
+dc_status_t
+dc_custom_open (dc_iostream_t **out, dc_context_t *context, dc_transport_t transport, const dc_custom_cbs_t *callbacks, void *userdata)
+{
+	return dc_custom_open2 (out, context, transport, callbacks, SZ_CALLBACKS_V1, userdata);
+}
+
 static dc_status_t
 dc_custom_set_timeout (dc_iostream_t *abstract, int timeout)
 {
@@ -259,3 +294,100 @@ dc_custom_get_name (dc_iostream_t *abstract)
 
 	return custom->callbacks.get_name (custom->userdata);
 }
+
+static void
+dc_custom_complete (void *cbdata, dc_status_t status, size_t actual)
+{
+	dc_custom_transfer_t *transfer = (dc_custom_transfer_t *) cbdata;
+
+	transfer->callback (transfer->iostream, status, actual, transfer->userdata);
+
+	free (transfer);
+}
+
+static dc_custom_transfer_t *
+dc_custom_transfer_new (dc_iostream_t *abstract, dc_iostream_callback_t callback, void *userdata)
+{
+	dc_custom_transfer_t *transfer = (dc_custom_transfer_t *) malloc (sizeof (dc_custom_transfer_t));
+	if (transfer == NULL) {
+		ERROR (abstract->context, "Failed to allocate memory.");
+		return NULL;
+	}
+
+	transfer->iostream = abstract;
+	transfer->callback = callback;
+	transfer->userdata = userdata;
+
+	return transfer;
+}
+
+static dc_status_t
+dc_custom_read_async (dc_iostream_t *abstract, void *data, size_t size, dc_iostream_callback_t callback, void *userdata)
+{
+	dc_custom_t *custom = (dc_custom_t *) abstract;
+
+	if (custom->callbacks.read_async == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	dc_custom_transfer_t *transfer = dc_custom_transfer_new (abstract, callback, userdata);
+	if (transfer == NULL)
+		return DC_STATUS_NOMEMORY;
+
+	dc_status_t status = custom->callbacks.read_async (custom->userdata, data, size, dc_custom_complete, transfer);
+	if (status != DC_STATUS_SUCCESS)
+		free (transfer);
+
+	return status;
+}
+
+static dc_status_t
+dc_custom_write_async (dc_iostream_t *abstract, const void *data, size_t size, dc_iostream_callback_t callback, void *userdata)
+{
+	dc_custom_t *custom = (dc_custom_t *) abstract;
+
+	if (custom->callbacks.write_async == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	dc_custom_transfer_t *transfer = dc_custom_transfer_new (abstract, callback, userdata);
+	if (transfer == NULL)
+		return DC_STATUS_NOMEMORY;
+
+	dc_status_t status = custom->callbacks.write_async (custom->userdata, data, size, dc_custom_complete, transfer);
+	if (status != DC_STATUS_SUCCESS)
+		free (transfer);
+
+	return status;
+}
+
+static dc_status_t
+dc_custom_cancel (dc_iostream_t *abstract)
+{
+	dc_custom_t *custom = (dc_custom_t *) abstract;
+
+	if (custom->callbacks.cancel == NULL)
+		return DC_STATUS_SUCCESS;
+
+	return custom->callbacks.cancel (custom->userdata);
+}
+
+static dc_status_t
+dc_custom_readv (dc_iostream_t *abstract, const dc_iovec_t iov[], size_t count, size_t *actual)
+{
+	dc_custom_t *custom = (dc_custom_t *) abstract;
+
+	if (custom->callbacks.readv == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	return custom->callbacks.readv (custom->userdata, iov, count, actual);
+}
+
+static dc_status_t
+dc_custom_writev (dc_iostream_t *abstract, const dc_iovec_t iov[], size_t count, size_t *actual)
+{
+	dc_custom_t *custom = (dc_custom_t *) abstract;
+
+	if (custom->callbacks.writev == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	return custom->callbacks.writev (custom->userdata, iov, count, actual);
+}
@@ -44,62 +44,54 @@ dc_localtime_r (const time_t *t, struct tm *tm)
 #endif
 }
 
-static struct tm *
-dc_gmtime_r (const time_t *t, struct tm *tm)
+/*
+ * Number of days since 1970-01-01 for the given date in the proleptic
+ * Gregorian calendar. The year is shifted to start in March, so the leap
+ * day is the last day of the year, and the days are counted per 400 year
+ * era of 146097 days.
+ */
+static dc_ticks_t
+dc_days_from_civil (dc_ticks_t year, unsigned int month, unsigned int day)
 {
-#ifdef HAVE_GMTIME_R
-	return gmtime_r (t, tm);
-#else
-	struct tm *p = gmtime (t);
-	if (p == NULL)
-		return NULL;
-
-	if (tm)
-		*tm = *p;
-
-	return tm;
-#endif
+	year -= month <= 2;
+	dc_ticks_t era = (year >= 0 ? year : year - 399) / 400;
+	unsigned int yoe = (unsigned int) (year - era * 400);
+	unsigned int doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+	unsigned int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	return era * 146097 + doe - 719468;
 }
 
-static time_t
-dc_timegm (struct tm *tm)
+/*
+ * Inverse of dc_days_from_civil.
+ */
+static void
+dc_civil_from_days (dc_ticks_t days, dc_ticks_t *year, unsigned int *month, unsigned int *day)
 {
-#if defined(HAVE_TIMEGM)
-	return timegm (tm);
-#elif defined (HAVE__MKGMTIME)
-	return _mkgmtime (tm);
-#else
-	static const unsigned int mdays[] = {
-		0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334
-	};
+	days += 719468;
+	dc_ticks_t era = (days >= 0 ? days : days - 146096) / 146097;
+	unsigned int doe = (unsigned int) (days - era * 146097);
+	unsigned int yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+	unsigned int doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+	unsigned int mp = (5 * doy + 2) / 153;
+	*day = doy - (153 * mp + 2) / 5 + 1;
+	*month = mp < 10 ? mp + 3 : mp - 9;
+	*year = yoe + era * 400 + (*month <= 2);
+}
 
+static dc_ticks_t
+dc_timegm (const struct tm *tm)
+{
 	if (tm == NULL ||
 		tm->tm_mon  < 0 || tm->tm_mon  > 11 ||
 		tm->tm_mday < 1 || tm->tm_mday > 31 ||
 		tm->tm_hour < 0 || tm->tm_hour > 23 ||
 		tm->tm_min  < 0 || tm->tm_min  > 59 ||
 		tm->tm_sec  < 0 || tm->tm_sec  > 60)
-		return (time_t) -1;
-
-	/* Number of leap days since 1970-01-01. */
-	int year = tm->tm_year + 1900 - (tm->tm_mon < 2);
-	int leapdays =
-		((year / 4) - (year / 100) + (year / 400)) -
-		((1969 / 4) - (1969 / 100) + (1969 / 400));
-
-	time_t result = 0;
-	result += (tm->tm_year - 70) * 365;
-	result += leapdays;
-	result += mdays[tm->tm_mon];
-	result += tm->tm_mday - 1;
-	result *= 24;
-	result += tm->tm_hour;
-	result *= 60;
-	result += tm->tm_min;
-	result *= 60;
-	result += tm->tm_sec;
-	return result;
-#endif
+		return -1;
+
+	dc_ticks_t days = dc_days_from_civil ((dc_ticks_t) tm->tm_year + 1900, tm->tm_mon + 1, 1) + tm->tm_mday - 1;
+
+	return ((days * 24 + tm->tm_hour) * 60 + tm->tm_min) * 60 + tm->tm_sec;
 }
 
 dc_ticks_t
@@ -122,9 +114,8 @@ dc_datetime_localtime (dc_datetime_t *result,
 #ifdef HAVE_STRUCT_TM_TM_GMTOFF
 	offset = tm.tm_gmtoff;
 #else
-	struct tm tmp = tm;
-	time_t t_local = dc_timegm (&tmp);
-	if (t_local == (time_t) -1)
+	dc_ticks_t t_local = dc_timegm (&tm);
+	if (t_local == -1)
 		return NULL;
 
 	offset = t_local - t;
@@ -147,20 +138,38 @@ dc_datetime_t *
 dc_datetime_gmtime (dc_datetime_t *result,
                     dc_ticks_t ticks)
 {
-	time_t t = ticks;
+	return dc_datetime_gmtime2 (result, ticks, 0);
+}
 
-	struct tm tm;
-	if (dc_gmtime_r (&t, &tm) == NULL)
+dc_datetime_t *
+dc_datetime_gmtime2 (dc_datetime_t *result,
+                     dc_ticks_t ticks,
+                     int timezone)
+{
+	if (timezone != DC_TIMEZONE_NONE)
+		ticks += timezone;
+
+	dc_ticks_t days = ticks / 86400;
+	dc_ticks_t seconds = ticks % 86400;
+	if (seconds < 0) {
+		seconds += 86400;
+		days--;
+	}
+
+	dc_ticks_t year = 0;
+	unsigned int month = 0, day = 0;
+	dc_civil_from_days (days, &year, &month, &day);
+	if (year < -2147483647 || year > 2147483647)
 		return NULL;
 
 	if (result) {
-		result->year = tm.tm_year + 1900;
-		result->month = tm.tm_mon + 1;
-		result->day = tm.tm_mday;
-		result->hour = tm.tm_hour;
-		result->minute = tm.tm_min;
-		result->second = tm.tm_sec;
-		result->timezone = 0;
+		result->year = year;
+		result->month = month;
+		result->day = day;
+		result->hour = seconds / 3600;
+		result->minute = (seconds % 3600) / 60;
+		result->second = seconds % 60;
+		result->timezone = timezone;
 	}
 
 	return result;
@@ -181,8 +190,8 @@ dc_datetime_mktime (const dc_datetime_t *dt)
 	tm.tm_sec = dt->second;
 	tm.tm_isdst = 0;
 
-	time_t t = dc_timegm (&tm);
-	if (t == (time_t) -1)
+	dc_ticks_t t = dc_timegm (&tm);
+	if (t == -1)
 		return t;
 
 	if (dt->timezone != DC_TIMEZONE_NONE) {
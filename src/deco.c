@@ -0,0 +1,735 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#define USE_THREADS
+#endif
+
+#include <libdivecomputer/deco.h>
+#include <libdivecomputer/units.h>
+
+#include "context-private.h"
+
+#define C_ARRAY_SIZE(array) (sizeof (array) / sizeof *(array))
+
+#define MAXTHREADS 8
+
+#define NCOMPARTMENTS 16
+#define NFACTORS      4
+
+#define WATERVAPOUR   0.0627   /* bar */
+#define AIR_N2        0.7902
+#define ASCENTRATE    (9.0 / 60.0) /* m/s */
+#define STOPINTERVAL  3.0      /* m */
+#define STOPTIME      60.0     /* s */
+#define MAXTTS        (24 * 3600.0)
+#define CNS_HALFTIME  (90 * 60.0)
+#define GF_ITERATIONS 4
+
+#define LN2 0.69314718055994530942
+
+/*
+ * Bühlmann ZHL-16C, with compartment 1b.
+ */
+static const double g_n2_halftime[NCOMPARTMENTS] = {
+	5.0, 8.0, 12.5, 18.5, 27.0, 38.3, 54.3, 77.0,
+	109.0, 146.0, 187.0, 239.0, 305.0, 390.0, 498.0, 635.0
+};
+
+static const double g_n2_a[NCOMPARTMENTS] = {
+	1.1696, 1.0000, 0.8618, 0.7562, 0.6200, 0.5043, 0.4410, 0.4000,
+	0.3750, 0.3500, 0.3295, 0.3065, 0.2835, 0.2610, 0.2480, 0.2327
+};
+
+static const double g_n2_b[NCOMPARTMENTS] = {
+	0.5578, 0.6514, 0.7222, 0.7825, 0.8126, 0.8434, 0.8693, 0.8910,
+	0.9092, 0.9222, 0.9319, 0.9403, 0.9477, 0.9544, 0.9602, 0.9653
+};
+
+static const double g_he_halftime[NCOMPARTMENTS] = {
+	1.88, 3.02, 4.72, 6.99, 10.21, 14.48, 20.53, 29.11,
+	41.20, 55.19, 70.69, 90.34, 115.29, 147.42, 188.24, 240.03
+};
+
+static const double g_he_a[NCOMPARTMENTS] = {
+	1.6189, 1.3830, 1.1919, 1.0458, 0.9220, 0.8205, 0.7305, 0.6502,
+	0.5950, 0.5545, 0.5333, 0.5189, 0.5181, 0.5176, 0.5172, 0.5119
+};
+
+static const double g_he_b[NCOMPARTMENTS] = {
+	0.4770, 0.5747, 0.6527, 0.7223, 0.7582, 0.7957, 0.8279, 0.8553,
+	0.8757, 0.8903, 0.8997, 0.9073, 0.9122, 0.9171, 0.9217, 0.9267
+};
+
+/*
+ * NOAA oxygen exposure limits (minutes) for a single dive.
+ */
+static const struct {
+	double ppo2;
+	double limit;
+} g_cns_limits[] = {
+	{0.6, 720}, {0.7, 570}, {0.8, 450}, {0.9, 360}, {1.0, 300}, {1.1, 240},
+	{1.2, 210}, {1.3, 180}, {1.4, 150}, {1.5, 120}, {1.6, 45},
+};
+
+/*
+ * The compartments are stored as separate arrays per gas, and all the
+ * loops run over the full arrays, so the compiler can process several
+ * compartments at once with the vector instructions of the target.
+ */
+typedef struct deco_tissues_t {
+	double n2[NCOMPARTMENTS];
+	double he[NCOMPARTMENTS];
+} deco_tissues_t;
+
+/*
+ * The exponential factors of the Schreiner equation only depend on the
+ * duration of the segment. Most profiles have a fixed sample interval,
+ * and the ascent simulation uses a few fixed durations, so the factors
+ * are cached for the most recent durations.
+ */
+typedef struct deco_factors_t {
+	double dt;
+	double n2_f[NCOMPARTMENTS], n2_g[NCOMPARTMENTS];
+	double he_f[NCOMPARTMENTS], he_g[NCOMPARTMENTS];
+} deco_factors_t;
+
+struct dc_deco_t {
+	dc_context_t *context;
+	double gflow, gfhigh;
+	dc_deco_callback_t callback;
+	void *userdata;
+	unsigned int dive;
+	// Dive parameters.
+	double atmospheric;
+	double hydrostatic; /* bar/m */
+	dc_divemode_t divemode;
+	dc_buffer_t *gasmixes;
+	// State after the last row.
+	deco_tissues_t tissues;
+	double anchor; /* Ambient pressure of the deepest ceiling at gflow */
+	double cns;
+	double time, depth;
+	dc_gasmix_t gasmix;
+	double setpoint;
+	// Row in progress.
+	unsigned int pending;
+	unsigned int row_time;
+	double row_depth;
+	dc_gasmix_t row_gasmix;
+	double row_setpoint;
+	// Cached exponential factors.
+	deco_factors_t factors[NFACTORS];
+	unsigned int nfactors, nextfactor;
+};
+
+static const deco_factors_t *
+deco_get_factors (dc_deco_t *deco, double dt)
+{
+	for (unsigned int i = 0; i < deco->nfactors; ++i) {
+		if (deco->factors[i].dt == dt)
+			return deco->factors + i;
+	}
+
+	deco_factors_t *f = deco->factors + deco->nextfactor;
+	deco->nextfactor = (deco->nextfactor + 1) % NFACTORS;
+	if (deco->nfactors < NFACTORS)
+		deco->nfactors++;
+
+	f->dt = dt;
+	for (unsigned int i = 0; i < NCOMPARTMENTS; ++i) {
+		double n2_k = LN2 / (g_n2_halftime[i] * 60.0);
+		double he_k = LN2 / (g_he_halftime[i] * 60.0);
+		f->n2_f[i] = exp (-n2_k * dt);
+		f->he_f[i] = exp (-he_k * dt);
+		f->n2_g[i] = (1.0 - f->n2_f[i]) / n2_k;
+		f->he_g[i] = (1.0 - f->he_f[i]) / he_k;
+	}
+
+	return f;
+}
+
+static double
+deco_ambient (const dc_deco_t *deco, double depth)
+{
+	return deco->atmospheric + depth * deco->hydrostatic;
+}
+
+/*
+ * Inspired partial pressures of the inert gases at the given ambient
+ * pressure. In closed circuit mode, the oxygen is kept at the setpoint
+ * and the rest of the loop has the inert gas ratio of the diluent.
+ */
+static void
+deco_inspired (const dc_deco_t *deco, const dc_gasmix_t *gasmix, double setpoint, double ambient, double *n2, double *he)
+{
+	double pressure = ambient - WATERVAPOUR;
+	if (pressure < 0.0)
+		pressure = 0.0;
+
+	if (setpoint > 0.0) {
+		double inert = gasmix->nitrogen + gasmix->helium;
+		if (inert <= 0.0 || pressure <= setpoint) {
+			*n2 = *he = 0.0;
+		} else {
+			*n2 = (pressure - setpoint) * gasmix->nitrogen / inert;
+			*he = (pressure - setpoint) * gasmix->helium / inert;
+		}
+		return;
+	}
+
+	*n2 = pressure * gasmix->nitrogen;
+	*he = pressure * gasmix->helium;
+}
+
+/*
+ * Load the tissues for a segment with a linear change of the depth,
+ * with the Schreiner equation:
+ *
+ *   P = Pi + R t + (P0 - Pi) f - R (1 - f) / k, with f = exp (-k t)
+ */
+static void
+deco_segment (dc_deco_t *deco, deco_tissues_t *tissues, const dc_gasmix_t *gasmix, double setpoint, double depth0, double depth1, double dt)
+{
+	if (dt <= 0.0)
+		return;
+
+	double n2_0, he_0, n2_1, he_1;
+	deco_inspired (deco, gasmix, setpoint, deco_ambient (deco, depth0), &n2_0, &he_0);
+	deco_inspired (deco, gasmix, setpoint, deco_ambient (deco, depth1), &n2_1, &he_1);
+	double n2_rate = (n2_1 - n2_0) / dt;
+	double he_rate = (he_1 - he_0) / dt;
+
+	const deco_factors_t *f = deco_get_factors (deco, dt);
+	for (unsigned int i = 0; i < NCOMPARTMENTS; ++i) {
+		tissues->n2[i] = n2_0 + n2_rate * dt + (tissues->n2[i] - n2_0) * f->n2_f[i] - n2_rate * f->n2_g[i];
+		tissues->he[i] = he_0 + he_rate * dt + (tissues->he[i] - he_0) * f->he_f[i] - he_rate * f->he_g[i];
+	}
+}
+
+/*
+ * Lowest tolerated ambient pressure for the given gradient factor.
+ */
+static double
+deco_tolerated (const deco_tissues_t *tissues, double gf)
+{
+	double tolerated[NCOMPARTMENTS];
+
+	for (unsigned int i = 0; i < NCOMPARTMENTS; ++i) {
+		double n2 = tissues->n2[i], he = tissues->he[i];
+		double p = n2 + he;
+		double a = (g_n2_a[i] * n2 + g_he_a[i] * he) / p;
+		double b = (g_n2_b[i] * n2 + g_he_b[i] * he) / p;
+		tolerated[i] = (p - a * gf) / (gf / b + 1.0 - gf);
+	}
+
+	double result = tolerated[0];
+	for (unsigned int i = 1; i < NCOMPARTMENTS; ++i) {
+		if (result < tolerated[i])
+			result = tolerated[i];
+	}
+
+	return result;
+}
+
+/*
+ * Ambient pressure of the ceiling. The gradient factor goes linearly
+ * from the low value at the deepest ceiling to the high value at the
+ * surface. Because the factor depends on the depth of the ceiling, the
+ * solution is found with a few fixed point iterations.
+ */
+static double
+deco_ceiling (const dc_deco_t *deco, const deco_tissues_t *tissues, double anchor)
+{
+	double range = anchor - deco->atmospheric;
+	if (range <= 0.0 || deco->gflow == deco->gfhigh)
+		return deco_tolerated (tissues, deco->gfhigh);
+
+	double pressure = deco_tolerated (tissues, deco->gflow);
+	for (unsigned int i = 0; i < GF_ITERATIONS; ++i) {
+		double fraction = (pressure - deco->atmospheric) / range;
+		if (fraction < 0.0)
+			fraction = 0.0;
+		else if (fraction > 1.0)
+			fraction = 1.0;
+		double gf = deco->gfhigh + (deco->gflow - deco->gfhigh) * fraction;
+		pressure = deco_tolerated (tissues, gf);
+	}
+
+	return pressure;
+}
+
+static double
+deco_ceiling_depth (const dc_deco_t *deco, double pressure)
+{
+	double depth = (pressure - deco->atmospheric) / deco->hydrostatic;
+	return depth > 0.0 ? depth : 0.0;
+}
+
+/*
+ * Simulate the ascent from the current state.
+ */
+static unsigned int
+deco_tts (dc_deco_t *deco, double depth)
+{
+	deco_tissues_t tissues = deco->tissues;
+	double time = 0.0;
+
+	while (depth > 0.0 && time < MAXTTS) {
+		double ceiling = deco_ceiling_depth (deco, deco_ceiling (deco, &tissues, deco->anchor));
+		double target = ceil (ceiling / STOPINTERVAL) * STOPINTERVAL;
+		if (target < depth) {
+			double dt = (depth - target) / ASCENTRATE;
+			deco_segment (deco, &tissues, &deco->gasmix, deco->setpoint, depth, target, dt);
+			depth = target;
+			time += dt;
+		} else {
+			deco_segment (deco, &tissues, &deco->gasmix, deco->setpoint, depth, depth, STOPTIME);
+			time += STOPTIME;
+		}
+	}
+
+	return (unsigned int) (time + 0.5);
+}
+
+static double
+deco_cns_rate (double ppo2)
+{
+	if (ppo2 <= 0.5)
+		return 0.0;
+
+	// Linear in the rate (1/limit), starting from zero at 0.5 bar, and
+	// extrapolated beyond the end of the table.
+	double x0 = 0.5, y0 = 0.0;
+	size_t n = C_ARRAY_SIZE (g_cns_limits);
+	for (size_t i = 0; i < n; ++i) {
+		double x1 = g_cns_limits[i].ppo2, y1 = 1.0 / (g_cns_limits[i].limit * 60.0);
+		if (ppo2 <= x1 || i == n - 1)
+			return y0 + (y1 - y0) * (ppo2 - x0) / (x1 - x0);
+		x0 = x1;
+		y0 = y1;
+	}
+
+	return 0.0;
+}
+
+static void
+deco_cns (dc_deco_t *deco, double depth0, double depth1, double dt)
+{
+	if (dt <= 0.0)
+		return;
+
+	double ambient = deco_ambient (deco, (depth0 + depth1) / 2.0);
+	double ppo2 = ambient * deco->gasmix.oxygen;
+	if (deco->setpoint > 0.0)
+		ppo2 = deco->setpoint < ambient ? deco->setpoint : ambient;
+
+	if (ppo2 <= 0.5)
+		deco->cns *= exp2 (-dt / CNS_HALFTIME);
+	else
+		deco->cns += dt * deco_cns_rate (ppo2);
+}
+
+static void
+deco_complete_row (dc_deco_t *deco)
+{
+	if (!deco->pending)
+		return;
+
+	double dt = deco->row_time > deco->time ? deco->row_time - deco->time : 0.0;
+	deco_segment (deco, &deco->tissues, &deco->gasmix, deco->setpoint, deco->depth, deco->row_depth, dt);
+	deco_cns (deco, deco->depth, deco->row_depth, dt);
+
+	deco->time = deco->row_time;
+	deco->depth = deco->row_depth;
+	deco->gasmix = deco->row_gasmix;
+	deco->setpoint = deco->row_setpoint;
+	deco->pending = 0;
+
+	double low = deco_tolerated (&deco->tissues, deco->gflow);
+	if (deco->anchor < low)
+		deco->anchor = low;
+
+	if (deco->callback == NULL)
+		return;
+
+	dc_deco_row_t row;
+	row.time = deco->row_time;
+	row.depth = deco->depth;
+	row.ceiling = deco_ceiling_depth (deco, deco_ceiling (deco, &deco->tissues, deco->anchor));
+	row.tts = deco_tts (deco, deco->depth);
+	row.cns = deco->cns;
+	deco->callback (deco->dive, &row, deco->userdata);
+}
+
+dc_status_t
+dc_deco_new (dc_deco_t **out, dc_context_t *context)
+{
+	dc_deco_t *deco = NULL;
+
+	if (out == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	deco = (dc_deco_t *) dc_malloc (context, sizeof (dc_deco_t));
+	if (deco == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	memset (deco, 0, sizeof (dc_deco_t));
+	deco->context = context;
+	deco->gflow = 1.0;
+	deco->gfhigh = 1.0;
+
+	deco->gasmixes = dc_buffer_new (0);
+	if (deco->gasmixes == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		dc_free (context, deco);
+		return DC_STATUS_NOMEMORY;
+	}
+
+	dc_deco_reset (deco, 0.0, 0.0, DC_DIVEMODE_OC, NULL, 0);
+
+	*out = deco;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_deco_set_gradient (dc_deco_t *deco, unsigned int low, unsigned int high)
+{
+	if (deco == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	if (low == 0 || high == 0 || low > high || high > 100)
+		return DC_STATUS_INVALIDARGS;
+
+	deco->gflow = low / 100.0;
+	deco->gfhigh = high / 100.0;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_deco_set_callback (dc_deco_t *deco, dc_deco_callback_t callback, void *userdata)
+{
+	if (deco == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	deco->callback = callback;
+	deco->userdata = userdata;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_deco_reset (dc_deco_t *deco, double atmospheric, double density, dc_divemode_t divemode, const dc_gasmix_t gasmixes[], unsigned int ngasmixes)
+{
+	if (deco == NULL || (gasmixes == NULL && ngasmixes))
+		return DC_STATUS_INVALIDARGS;
+
+	if (atmospheric <= 0.0)
+		atmospheric = ATM / BAR;
+	if (density <= 0.0)
+		density = 1025.0;
+
+	dc_buffer_clear (deco->gasmixes);
+	if (!dc_buffer_append (deco->gasmixes, (const unsigned char *) gasmixes, ngasmixes * sizeof (dc_gasmix_t))) {
+		ERROR (deco->context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	deco->atmospheric = atmospheric;
+	deco->hydrostatic = density * GRAVITY / BAR;
+	deco->divemode = divemode;
+
+	// Saturated with air at the surface.
+	double n2 = (atmospheric - WATERVAPOUR) * AIR_N2;
+	for (unsigned int i = 0; i < NCOMPARTMENTS; ++i) {
+		deco->tissues.n2[i] = n2;
+		deco->tissues.he[i] = 0.0;
+	}
+
+	deco->anchor = 0.0;
+	deco->cns = 0.0;
+	deco->time = 0.0;
+	deco->depth = 0.0;
+	if (ngasmixes) {
+		deco->gasmix = gasmixes[0];
+	} else {
+		deco->gasmix.oxygen = 1.0 - AIR_N2;
+		deco->gasmix.helium = 0.0;
+		deco->gasmix.nitrogen = AIR_N2;
+	}
+	deco->setpoint = 0.0;
+
+	deco->pending = 0;
+	deco->row_time = 0;
+	deco->row_depth = 0.0;
+	deco->row_gasmix = deco->gasmix;
+	deco->row_setpoint = 0.0;
+
+	// The factors depend on the sample interval of the dive.
+	deco->nfactors = 0;
+	deco->nextfactor = 0;
+
+	return DC_STATUS_SUCCESS;
+}
+
+void
+dc_deco_sample_cb (dc_sample_type_t type, dc_sample_value_t value, void *userdata)
+{
+	dc_deco_t *deco = (dc_deco_t *) userdata;
+
+	switch (type) {
+	case DC_SAMPLE_TIME:
+		deco_complete_row (deco);
+		deco->pending = 1;
+		deco->row_time = value.time;
+		break;
+	case DC_SAMPLE_DEPTH:
+		deco->row_depth = value.depth > 0.0 ? value.depth : 0.0;
+		break;
+	case DC_SAMPLE_GASMIX:
+		if (value.gasmix < dc_buffer_get_size (deco->gasmixes) / sizeof (dc_gasmix_t)) {
+			const dc_gasmix_t *gasmixes = (const dc_gasmix_t *) dc_buffer_get_data (deco->gasmixes);
+			deco->row_gasmix = gasmixes[value.gasmix];
+		} else {
+			WARNING (deco->context, "Invalid gas mix index (%u).", value.gasmix);
+		}
+		break;
+	case DC_SAMPLE_SETPOINT:
+		if (deco->divemode == DC_DIVEMODE_CCR || deco->divemode == DC_DIVEMODE_SCR)
+			deco->row_setpoint = value.setpoint;
+		break;
+	default:
+		break;
+	}
+}
+
+dc_status_t
+dc_deco_process_batch (dc_deco_t *deco, const dc_sample_batch_t *batch)
+{
+	if (deco == NULL || batch == NULL || batch->time == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	for (unsigned int i = 0; i < batch->count; ++i) {
+		unsigned int mask = batch->mask ? batch->mask[i] : 0xFFFFFFFF;
+		dc_sample_value_t value;
+
+		value.time = batch->time[i];
+		dc_deco_sample_cb (DC_SAMPLE_TIME, value, deco);
+
+		if (batch->depth && (mask & (1u << DC_SAMPLE_DEPTH))) {
+			value.depth = batch->depth[i];
+			dc_deco_sample_cb (DC_SAMPLE_DEPTH, value, deco);
+		}
+
+		if (batch->gasmix && batch->mask && (mask & (1u << DC_SAMPLE_GASMIX))) {
+			value.gasmix = batch->gasmix[i];
+			dc_deco_sample_cb (DC_SAMPLE_GASMIX, value, deco);
+		}
+
+		if (batch->setpoint && (mask & (1u << DC_SAMPLE_SETPOINT))) {
+			value.setpoint = batch->setpoint[i];
+			dc_deco_sample_cb (DC_SAMPLE_SETPOINT, value, deco);
+		}
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_deco_finish (dc_deco_t *deco)
+{
+	if (deco == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	deco_complete_row (deco);
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+deco_process (dc_deco_t *deco, dc_parser_t *parser, unsigned int dive)
+{
+	dc_parser_summary_t summary;
+	dc_status_t rc = dc_parser_get_summary (parser, &summary);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	double atmospheric = 0.0, density = 0.0;
+	dc_divemode_t divemode = DC_DIVEMODE_OC;
+	if (summary.fields & (1u << DC_FIELD_ATMOSPHERIC))
+		atmospheric = summary.atmospheric;
+	if (summary.fields & (1u << DC_FIELD_SALINITY))
+		density = summary.salinity.density;
+	if (summary.fields & (1u << DC_FIELD_DIVEMODE))
+		divemode = summary.divemode;
+
+	rc = dc_deco_reset (deco, atmospheric, density, divemode, summary.gasmixes, summary.ngasmixes);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	deco->dive = dive;
+
+	rc = dc_parser_samples_foreach (parser, dc_deco_sample_cb, deco);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	return dc_deco_finish (deco);
+}
+
+dc_status_t
+dc_deco_process (dc_deco_t *deco, dc_parser_t *parser)
+{
+	if (deco == NULL || parser == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	return deco_process (deco, parser, 0);
+}
+
+typedef struct deco_job_t {
+	dc_deco_t *deco;
+	dc_parser_t **parsers;
+	unsigned int count;
+	unsigned int next;
+#ifdef USE_THREADS
+	pthread_mutex_t lock;
+#endif
+} deco_job_t;
+
+static void
+deco_run (deco_job_t *job, dc_deco_t *deco)
+{
+	while (1) {
+#ifdef USE_THREADS
+		pthread_mutex_lock (&job->lock);
+#endif
+		unsigned int i = job->next;
+		if (i < job->count)
+			job->next++;
+#ifdef USE_THREADS
+		pthread_mutex_unlock (&job->lock);
+#endif
+		if (i >= job->count)
+			break;
+
+		dc_status_t rc = deco_process (deco, job->parsers[i], i);
+		if (rc != DC_STATUS_SUCCESS)
+			WARNING (deco->context, "Skipping dive %u (%d).", i, rc);
+	}
+}
+
+#ifdef USE_THREADS
+typedef struct deco_worker_t {
+	deco_job_t *job;
+	dc_deco_t *deco;
+	pthread_t thread;
+} deco_worker_t;
+
+static void *
+deco_worker (void *arg)
+{
+	deco_worker_t *worker = (deco_worker_t *) arg;
+
+	deco_run (worker->job, worker->deco);
+
+	return NULL;
+}
+#endif
+
+dc_status_t
+dc_deco_process_many (dc_deco_t *deco, dc_parser_t *parsers[], unsigned int count, unsigned int nthreads)
+{
+	if (deco == NULL || (parsers == NULL && count))
+		return DC_STATUS_INVALIDARGS;
+
+	deco_job_t job;
+	job.deco = deco;
+	job.parsers = parsers;
+	job.count = count;
+	job.next = 0;
+
+	if (nthreads > MAXTHREADS)
+		nthreads = MAXTHREADS;
+	if (nthreads > count)
+		nthreads = count;
+
+#ifdef USE_THREADS
+	pthread_mutex_init (&job.lock, NULL);
+
+	// The calling thread processes dives as well, with the analysis of
+	// the caller, and each worker gets its own copy.
+	deco_worker_t workers[MAXTHREADS];
+	unsigned int nstarted = 0;
+	for (unsigned int i = 1; i < nthreads; ++i) {
+		deco_worker_t *worker = workers + nstarted;
+		if (dc_deco_new (&worker->deco, deco->context) != DC_STATUS_SUCCESS)
+			break;
+		worker->deco->gflow = deco->gflow;
+		worker->deco->gfhigh = deco->gfhigh;
+		worker->deco->callback = deco->callback;
+		worker->deco->userdata = deco->userdata;
+		worker->job = &job;
+		if (pthread_create (&worker->thread, NULL, deco_worker, worker) != 0) {
+			WARNING (deco->context, "Failed to start the worker threads.");
+			dc_deco_free (worker->deco);
+			break;
+		}
+		nstarted++;
+	}
+#endif
+
+	deco_run (&job, deco);
+
+#ifdef USE_THREADS
+	for (unsigned int i = 0; i < nstarted; ++i) {
+		pthread_join (workers[i].thread, NULL);
+		dc_deco_free (workers[i].deco);
+	}
+
+	pthread_mutex_destroy (&job.lock);
+#endif
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_deco_free (dc_deco_t *deco)
+{
+	if (deco == NULL)
+		return DC_STATUS_SUCCESS;
+
+	dc_buffer_free (deco->gasmixes);
+	dc_free (deco->context, deco);
+
+	return DC_STATUS_SUCCESS;
+}
@@ -19,11 +19,22 @@
  * MA 02110-1301 USA
  */
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
 #include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
+
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#define DESCRIPTOR_INDEX
+#endif
 
 #include "descriptor-private.h"
+#include "family.h"
 #include "iterator-private.h"
 #include "platform.h"
 
@@ -48,6 +59,22 @@ struct dc_descriptor_t {
 	dc_filter_t filter;
 };
 
+typedef struct dc_usb_entry_t {
+	dc_usb_desc_t desc;
+	dc_family_t type;
+	const char *vendor;
+	const char *product;
+} dc_usb_entry_t;
+
+typedef struct dc_bluetooth_entry_t {
+	const char *name;
+	unsigned int prefix;
+	unsigned int transports;
+	dc_filter_t filter;
+} dc_bluetooth_entry_t;
+
+typedef unsigned long long dc_bluetooth_mask_t;
+
 typedef struct dc_descriptor_iterator_t {
 	dc_iterator_t base;
 	size_t current;
@@ -57,6 +84,8 @@ static const dc_iterator_vtable_t dc_descriptor_iterator_vtable = {
 	sizeof(dc_descriptor_iterator_t),
 	dc_descriptor_iterator_next,
 	NULL,
+	NULL,
+	NULL,
 };
 
 /*
@@ -67,6 +96,7 @@ static const dc_iterator_vtable_t dc_descriptor_iterator_vtable = {
  */
 
 static const dc_descriptor_t g_descriptors[] = {
+#ifndef DISABLE_BACKEND_SUUNTO
 	/* Suunto Solution */
 	{"Suunto", "Solution", DC_FAMILY_SUUNTO_SOLUTION, 0, DC_TRANSPORT_SERIAL, NULL},
 	/* Suunto Eon */
@@ -103,6 +133,8 @@ static const dc_descriptor_t g_descriptors[] = {
 	/* Suunto EON Steel */
 	{"Suunto", "EON Steel", DC_FAMILY_SUUNTO_EONSTEEL, 0, DC_TRANSPORT_USBHID | DC_TRANSPORT_BLE, dc_filter_suunto},
 	{"Suunto", "EON Core",  DC_FAMILY_SUUNTO_EONSTEEL, 1, DC_TRANSPORT_USBHID | DC_TRANSPORT_BLE, dc_filter_suunto},
+#endif
+#ifndef DISABLE_BACKEND_UWATEC
 	/* Uwatec Aladin */
 	{"Uwatec", "Aladin Air Twin",     DC_FAMILY_UWATEC_ALADIN, 0x1C, DC_TRANSPORT_SERIAL, NULL},
 	{"Uwatec", "Aladin Sport Plus",   DC_FAMILY_UWATEC_ALADIN, 0x3E, DC_TRANSPORT_SERIAL, NULL},
@@ -142,10 +174,14 @@ static const dc_descriptor_t g_descriptors[] = {
 	{"Scubapro", "G2",                  DC_FAMILY_UWATEC_SMART, 0x32, DC_TRANSPORT_USBHID | DC_TRANSPORT_BLE, dc_filter_uwatec},
 	{"Scubapro", "G2 Console",          DC_FAMILY_UWATEC_SMART, 0x32, DC_TRANSPORT_USBHID | DC_TRANSPORT_BLE, dc_filter_uwatec},
 	{"Scubapro", "G2 HUD",              DC_FAMILY_UWATEC_SMART, 0x42, DC_TRANSPORT_USBHID | DC_TRANSPORT_BLE, dc_filter_uwatec},
+#endif
+#ifndef DISABLE_BACKEND_REEFNET
 	/* Reefnet */
 	{"Reefnet", "Sensus",       DC_FAMILY_REEFNET_SENSUS, 1, DC_TRANSPORT_SERIAL, NULL},
 	{"Reefnet", "Sensus Pro",   DC_FAMILY_REEFNET_SENSUSPRO, 2, DC_TRANSPORT_SERIAL, NULL},
 	{"Reefnet", "Sensus Ultra", DC_FAMILY_REEFNET_SENSUSULTRA, 3, DC_TRANSPORT_SERIAL, NULL},
+#endif
+#ifndef DISABLE_BACKEND_OCEANIC
 	/* Oceanic VT Pro */
 	{"Aeris",    "500 AI",     DC_FAMILY_OCEANIC_VTPRO, 0x4151, DC_TRANSPORT_SERIAL, NULL},
 	{"Oceanic",  "Versa Pro",  DC_FAMILY_OCEANIC_VTPRO, 0x4155, DC_TRANSPORT_SERIAL, NULL},
@@ -226,6 +262,8 @@ static const dc_descriptor_t g_descriptors[] = {
 	{"Aqualung", "i300C",               DC_FAMILY_OCEANIC_ATOM2, 0x4648, DC_TRANSPORT_SERIAL | DC_TRANSPORT_BLE, NULL},
 	{"Aqualung", "i100",                DC_FAMILY_OCEANIC_ATOM2, 0x464E, DC_TRANSPORT_SERIAL, NULL},
 	{"Aqualung", "i770R",               DC_FAMILY_OCEANIC_ATOM2, 0x4651, DC_TRANSPORT_SERIAL | DC_TRANSPORT_BLE, NULL},
+#endif
+#ifndef DISABLE_BACKEND_MARES
 	/* Mares Nemo */
 	{"Mares", "Nemo",         DC_FAMILY_MARES_NEMO, 0, DC_TRANSPORT_SERIAL, NULL},
 	{"Mares", "Nemo Steel",   DC_FAMILY_MARES_NEMO, 0, DC_TRANSPORT_SERIAL, NULL},
@@ -255,6 +293,8 @@ static const dc_descriptor_t g_descriptors[] = {
 	{"Mares", "Quad Air",          DC_FAMILY_MARES_ICONHD , 0x23, DC_TRANSPORT_SERIAL | DC_TRANSPORT_BLE, dc_filter_mares},
 	{"Mares", "Smart Air",         DC_FAMILY_MARES_ICONHD , 0x24, DC_TRANSPORT_SERIAL | DC_TRANSPORT_BLE, dc_filter_mares},
 	{"Mares", "Quad",              DC_FAMILY_MARES_ICONHD , 0x29, DC_TRANSPORT_SERIAL | DC_TRANSPORT_BLE, dc_filter_mares},
+#endif
+#ifndef DISABLE_BACKEND_HW
 	/* Heinrichs Weikamp */
 	{"Heinrichs Weikamp", "OSTC",     DC_FAMILY_HW_OSTC, 0, DC_TRANSPORT_SERIAL, NULL},
 	{"Heinrichs Weikamp", "OSTC Mk2", DC_FAMILY_HW_OSTC, 1, DC_TRANSPORT_SERIAL, NULL},
@@ -273,6 +313,8 @@ static const dc_descriptor_t g_descriptors[] = {
 	{"Heinrichs Weikamp", "OSTC Sport", DC_FAMILY_HW_OSTC3, 0x12, DC_TRANSPORT_SERIAL | DC_TRANSPORT_BLUETOOTH | DC_TRANSPORT_BLE, dc_filter_hw},
 	{"Heinrichs Weikamp", "OSTC Sport", DC_FAMILY_HW_OSTC3, 0x13, DC_TRANSPORT_SERIAL | DC_TRANSPORT_BLUETOOTH | DC_TRANSPORT_BLE, dc_filter_hw},
 	{"Heinrichs Weikamp", "OSTC 2 TR",  DC_FAMILY_HW_OSTC3, 0x33, DC_TRANSPORT_SERIAL | DC_TRANSPORT_BLUETOOTH | DC_TRANSPORT_BLE, dc_filter_hw},
+#endif
+#ifndef DISABLE_BACKEND_CRESSI
 	/* Cressi Edy */
 	{"Tusa",   "IQ-700", DC_FAMILY_CRESSI_EDY, 0x05, DC_TRANSPORT_SERIAL, NULL},
 	{"Cressi", "Edy",    DC_FAMILY_CRESSI_EDY, 0x08, DC_TRANSPORT_SERIAL, NULL},
@@ -284,14 +326,20 @@ static const dc_descriptor_t g_descriptors[] = {
 	/* Cressi Goa */
 	{"Cressi", "Cartesio", DC_FAMILY_CRESSI_GOA, 1, DC_TRANSPORT_SERIAL, NULL},
 	{"Cressi", "Goa",      DC_FAMILY_CRESSI_GOA, 2, DC_TRANSPORT_SERIAL, NULL},
+#endif
+#ifndef DISABLE_BACKEND_ZEAGLE
 	/* Zeagle N2iTiON3 */
 	{"Zeagle",    "N2iTiON3",   DC_FAMILY_ZEAGLE_N2ITION3, 0, DC_TRANSPORT_SERIAL, NULL},
 	{"Apeks",     "Quantum X",  DC_FAMILY_ZEAGLE_N2ITION3, 0, DC_TRANSPORT_SERIAL, NULL},
 	{"Dive Rite", "NiTek Trio", DC_FAMILY_ZEAGLE_N2ITION3, 0, DC_TRANSPORT_SERIAL, NULL},
 	{"Scubapro",  "XTender 5",  DC_FAMILY_ZEAGLE_N2ITION3, 0, DC_TRANSPORT_SERIAL, NULL},
+#endif
+#ifndef DISABLE_BACKEND_ATOMICS
 	/* Atomic Aquatics Cobalt */
 	{"Atomic Aquatics", "Cobalt", DC_FAMILY_ATOMICS_COBALT, 0, DC_TRANSPORT_USB, NULL},
 	{"Atomic Aquatics", "Cobalt 2", DC_FAMILY_ATOMICS_COBALT, 2, DC_TRANSPORT_USB, NULL},
+#endif
+#ifndef DISABLE_BACKEND_SHEARWATER
 	/* Shearwater Predator */
 	{"Shearwater", "Predator", DC_FAMILY_SHEARWATER_PREDATOR, 2, DC_TRANSPORT_SERIAL | DC_TRANSPORT_BLUETOOTH, dc_filter_shearwater},
 	/* Shearwater Petrel */
@@ -302,10 +350,16 @@ static const dc_descriptor_t g_descriptors[] = {
 	{"Shearwater", "Perdix AI", DC_FAMILY_SHEARWATER_PETREL, 6, DC_TRANSPORT_BLE, dc_filter_shearwater},
 	{"Shearwater", "Nerd 2",    DC_FAMILY_SHEARWATER_PETREL, 7, DC_TRANSPORT_BLE, dc_filter_shearwater},
 	{"Shearwater", "Teric",     DC_FAMILY_SHEARWATER_PETREL, 8, DC_TRANSPORT_BLE, dc_filter_shearwater},
+#endif
+#ifndef DISABLE_BACKEND_DIVERITE
 	/* Dive Rite NiTek Q */
 	{"Dive Rite", "NiTek Q",   DC_FAMILY_DIVERITE_NITEKQ, 0, DC_TRANSPORT_SERIAL, NULL},
+#endif
+#ifndef DISABLE_BACKEND_CITIZEN
 	/* Citizen Hyper Aqualand */
 	{"Citizen", "Hyper Aqualand", DC_FAMILY_CITIZEN_AQUALAND, 0, DC_TRANSPORT_SERIAL, NULL},
+#endif
+#ifndef DISABLE_BACKEND_DIVESYSTEM
 	/* DiveSystem/Ratio iDive */
 	{"DiveSystem", "Orca",          DC_FAMILY_DIVESYSTEM_IDIVE, 0x02, DC_TRANSPORT_SERIAL, NULL},
 	{"DiveSystem", "iDive Pro",     DC_FAMILY_DIVESYSTEM_IDIVE, 0x03, DC_TRANSPORT_SERIAL, NULL},
@@ -345,6 +399,8 @@ static const dc_descriptor_t g_descriptors[] = {
 	{"Ratio",      "iDive Color Reb",  DC_FAMILY_DIVESYSTEM_IDIVE, 0x56, DC_TRANSPORT_SERIAL, NULL},
 	{"Seac",       "Jack",          DC_FAMILY_DIVESYSTEM_IDIVE, 0x1000, DC_TRANSPORT_SERIAL, NULL},
 	{"Seac",       "Guru",          DC_FAMILY_DIVESYSTEM_IDIVE, 0x1002, DC_TRANSPORT_SERIAL, NULL},
+#endif
+#ifndef DISABLE_BACKEND_COCHRAN
 	/* Cochran Commander */
 	{"Cochran", "Commander TM", DC_FAMILY_COCHRAN_COMMANDER, 0, DC_TRANSPORT_SERIAL, NULL},
 	{"Cochran", "Commander I",  DC_FAMILY_COCHRAN_COMMANDER, 1, DC_TRANSPORT_SERIAL, NULL},
@@ -352,10 +408,15 @@ static const dc_descriptor_t g_descriptors[] = {
 	{"Cochran", "EMC-14",       DC_FAMILY_COCHRAN_COMMANDER, 3, DC_TRANSPORT_SERIAL, NULL},
 	{"Cochran", "EMC-16",       DC_FAMILY_COCHRAN_COMMANDER, 4, DC_TRANSPORT_SERIAL, NULL},
 	{"Cochran", "EMC-20H",      DC_FAMILY_COCHRAN_COMMANDER, 5, DC_TRANSPORT_SERIAL, NULL},
+#endif
+#ifndef DISABLE_BACKEND_TECDIVING
 	/* Tecdiving DiveComputer.eu */
 	{"Tecdiving", "DiveComputer.eu", DC_FAMILY_TECDIVING_DIVECOMPUTEREU, 0, DC_TRANSPORT_SERIAL | DC_TRANSPORT_BLUETOOTH, dc_filter_tecdiving},
+#endif
+#ifndef DISABLE_BACKEND_GARMIN
 	/* Garmin */
 	{"Garmin", "Descent Mk1", DC_FAMILY_GARMIN, 2859, DC_TRANSPORT_USBSTORAGE, dc_filter_garmin},
+#endif
 };
 
 static int
@@ -373,15 +434,190 @@ dc_filter_internal_name (const char *name, const char *values[], size_t count)
 	return 0;
 }
 
+/*
+ * The USB identifiers of the supported devices, sorted on the vendor and
+ * product id. The vendor and product names refer to the corresponding
+ * entry in the descriptor table.
+ */
+static const dc_usb_entry_t g_usb[] = {
+	{{0x091e, 0x2b2b}, DC_FAMILY_GARMIN,          "Garmin",   "Descent Mk1"},
+	{{0x1493, 0x0030}, DC_FAMILY_SUUNTO_EONSTEEL, "Suunto",   "EON Steel"},
+	{{0x1493, 0x0033}, DC_FAMILY_SUUNTO_EONSTEEL, "Suunto",   "EON Core"},
+	{{0x2e6c, 0x3201}, DC_FAMILY_UWATEC_SMART,    "Scubapro", "G2"},
+	{{0x2e6c, 0x3211}, DC_FAMILY_UWATEC_SMART,    "Scubapro", "G2 Console"},
+	{{0x2e6c, 0x4201}, DC_FAMILY_UWATEC_SMART,    "Scubapro", "G2 HUD"},
+	{{0xc251, 0x2006}, DC_FAMILY_UWATEC_SMART,    "Scubapro", "Aladin Square"},
+};
+
+static const dc_usb_entry_t *
+dc_usb_lookup (unsigned int vid, unsigned int pid)
+{
+	unsigned int key = (vid << 16) | pid;
+
+	size_t lo = 0, hi = C_ARRAY_SIZE (g_usb);
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		unsigned int value = (g_usb[mid].desc.vid << 16) | g_usb[mid].desc.pid;
+		if (value < key) {
+			lo = mid + 1;
+		} else if (value > key) {
+			hi = mid;
+		} else {
+			return g_usb + mid;
+		}
+	}
+
+	return NULL;
+}
+
 static int
-dc_filter_internal_usb (const dc_usb_desc_t *desc, const dc_usb_desc_t values[], size_t count)
+dc_filter_internal_usb (const dc_usb_desc_t *desc, dc_family_t type)
 {
 	if (desc == NULL)
 		return 0;
 
-	for (size_t i = 0; i < count; ++i) {
-		if (desc->vid == values[i].vid &&
-			desc->pid == values[i].pid) {
+	const dc_usb_entry_t *entry = dc_usb_lookup (desc->vid, desc->pid);
+
+	return entry != NULL && entry->type == type;
+}
+
+/*
+ * The bluetooth names advertised by the supported devices, either as the
+ * exact name or as a prefix of the name, and the filter they belong to.
+ * The matching is case insensitive. The table is limited to 64 entries,
+ * because the matches are returned as a bitmask.
+ */
+static const dc_bluetooth_entry_t g_bluetooth[] = {
+	{"G2",                 0, DC_TRANSPORT_BLE, dc_filter_uwatec},
+	{"Aladin",             0, DC_TRANSPORT_BLE, dc_filter_uwatec},
+	{"EON Steel",          0, DC_TRANSPORT_BLE, dc_filter_suunto},
+	{"EON Core",           0, DC_TRANSPORT_BLE, dc_filter_suunto},
+	{"OSTC",               1, DC_TRANSPORT_BLUETOOTH | DC_TRANSPORT_BLE, dc_filter_hw},
+	{"FROG",               1, DC_TRANSPORT_BLUETOOTH | DC_TRANSPORT_BLE, dc_filter_hw},
+	{"Predator",           0, DC_TRANSPORT_BLUETOOTH | DC_TRANSPORT_BLE, dc_filter_shearwater},
+	{"Petrel",             0, DC_TRANSPORT_BLUETOOTH | DC_TRANSPORT_BLE, dc_filter_shearwater},
+	{"Nerd",               0, DC_TRANSPORT_BLUETOOTH | DC_TRANSPORT_BLE, dc_filter_shearwater},
+	{"Perdix",             0, DC_TRANSPORT_BLUETOOTH | DC_TRANSPORT_BLE, dc_filter_shearwater},
+	{"Teric",              0, DC_TRANSPORT_BLUETOOTH | DC_TRANSPORT_BLE, dc_filter_shearwater},
+	{"DiveComputer",       0, DC_TRANSPORT_BLUETOOTH, dc_filter_tecdiving},
+	{"Mares bluelink pro", 0, DC_TRANSPORT_BLE, dc_filter_mares},
+};
+
+#ifdef DESCRIPTOR_INDEX
+#define TRIE_MAXNODES 256
+
+/*
+ * Prefix trie over the lowercase bluetooth names. Each node stores the
+ * entries ending at that node, for exact and prefix matches, so a name
+ * is matched against all entries in a single pass over its characters.
+ * Node zero is the root, and doubles as the "none" child or sibling.
+ */
+typedef struct dc_bluetooth_node_t {
+	unsigned char c;
+	unsigned short child;
+	unsigned short sibling;
+	dc_bluetooth_mask_t exact;
+	dc_bluetooth_mask_t prefix;
+} dc_bluetooth_node_t;
+
+static dc_bluetooth_node_t g_trie[TRIE_MAXNODES];
+static unsigned int g_trie_size = 0;
+static pthread_once_t g_trie_once = PTHREAD_ONCE_INIT;
+
+static void
+dc_bluetooth_trie_init (void)
+{
+	unsigned int size = 1;
+
+	memset (g_trie, 0, sizeof (g_trie));
+
+	for (size_t i = 0; i < C_ARRAY_SIZE (g_bluetooth); ++i) {
+		unsigned int node = 0;
+		for (const char *p = g_bluetooth[i].name; *p; ++p) {
+			unsigned char c = tolower ((unsigned char) *p);
+
+			unsigned int child = g_trie[node].child;
+			while (child && g_trie[child].c != c)
+				child = g_trie[child].sibling;
+
+			if (child == 0) {
+				if (size >= TRIE_MAXNODES) {
+					// Leave the trie unused, and fall back to
+					// the linear search.
+					return;
+				}
+				child = size++;
+				g_trie[child].c = c;
+				g_trie[child].sibling = g_trie[node].child;
+				g_trie[node].child = child;
+			}
+
+			node = child;
+		}
+
+		if (g_bluetooth[i].prefix)
+			g_trie[node].prefix |= 1ULL << i;
+		else
+			g_trie[node].exact |= 1ULL << i;
+	}
+
+	g_trie_size = size;
+}
+#endif
+
+static dc_bluetooth_mask_t
+dc_bluetooth_match (const char *name)
+{
+	dc_bluetooth_mask_t mask = 0;
+
+	if (name == NULL)
+		return 0;
+
+#ifdef DESCRIPTOR_INDEX
+	pthread_once (&g_trie_once, dc_bluetooth_trie_init);
+
+	if (g_trie_size) {
+		unsigned int node = 0;
+		for (const char *p = name; *p; ++p) {
+			unsigned char c = tolower ((unsigned char) *p);
+
+			mask |= g_trie[node].prefix;
+
+			unsigned int child = g_trie[node].child;
+			while (child && g_trie[child].c != c)
+				child = g_trie[child].sibling;
+
+			if (child == 0)
+				return mask;
+
+			node = child;
+		}
+
+		return mask | g_trie[node].exact | g_trie[node].prefix;
+	}
+#endif
+
+	for (size_t i = 0; i < C_ARRAY_SIZE (g_bluetooth); ++i) {
+		const char *value = g_bluetooth[i].name;
+		if (g_bluetooth[i].prefix) {
+			if (strncasecmp (name, value, strlen (value)) == 0)
+				mask |= 1ULL << i;
+		} else {
+			if (strcasecmp (name, value) == 0)
+				mask |= 1ULL << i;
+		}
+	}
+
+	return mask;
+}
+
+static int
+dc_bluetooth_accept (dc_bluetooth_mask_t mask, dc_transport_t transport, dc_filter_t filter)
+{
+	for (size_t i = 0; mask; ++i, mask >>= 1) {
+		if ((mask & 1) &&
+			(g_bluetooth[i].transports & transport) &&
+			g_bluetooth[i].filter == filter) {
 			return 1;
 		}
 	}
@@ -389,6 +625,12 @@ dc_filter_internal_usb (const dc_usb_desc_t *desc, const dc_usb_desc_t values[],
 	return 0;
 }
 
+static int
+dc_filter_internal_bluetooth (dc_transport_t transport, const char *name, dc_filter_t filter)
+{
+	return dc_bluetooth_accept (dc_bluetooth_match (name), transport, filter);
+}
+
 static int
 dc_filter_internal_rfcomm (const char *name)
 {
@@ -421,23 +663,13 @@ static int dc_filter_uwatec (dc_transport_t transport, const void *userdata)
 		"UWATEC Galileo",
 		"UWATEC Galileo Sol",
 	};
-	static const dc_usb_desc_t usbhid[] = {
-		{0x2e6c, 0x3201}, // G2
-		{0x2e6c, 0x3211}, // G2 Console
-		{0x2e6c, 0x4201}, // G2 HUD
-		{0xc251, 0x2006}, // Aladin Square
-	};
-	static const char *bluetooth[] = {
-		"G2",
-		"Aladin",
-	};
 
 	if (transport == DC_TRANSPORT_IRDA) {
 		return dc_filter_internal_name ((const char *) userdata, irda, C_ARRAY_SIZE(irda));
 	} else if (transport == DC_TRANSPORT_USBHID) {
-		return dc_filter_internal_usb ((const dc_usb_desc_t *) userdata, usbhid, C_ARRAY_SIZE(usbhid));
+		return dc_filter_internal_usb ((const dc_usb_desc_t *) userdata, DC_FAMILY_UWATEC_SMART);
 	} else if (transport == DC_TRANSPORT_BLE) {
-		return dc_filter_internal_name ((const char *) userdata, bluetooth, C_ARRAY_SIZE(bluetooth));
+		return dc_filter_internal_bluetooth (transport, (const char *) userdata, dc_filter_uwatec);
 	}
 
 	return 1;
@@ -445,19 +677,10 @@ static int dc_filter_uwatec (dc_transport_t transport, const void *userdata)
 
 static int dc_filter_suunto (dc_transport_t transport, const void *userdata)
 {
-	static const dc_usb_desc_t usbhid[] = {
-		{0x1493, 0x0030}, // Eon Steel
-		{0x1493, 0x0033}, // Eon Core
-	};
-	static const char *bluetooth[] = {
-		"EON Steel",
-		"EON Core",
-	};
-
 	if (transport == DC_TRANSPORT_USBHID) {
-		return dc_filter_internal_usb ((const dc_usb_desc_t *) userdata, usbhid, C_ARRAY_SIZE(usbhid));
+		return dc_filter_internal_usb ((const dc_usb_desc_t *) userdata, DC_FAMILY_SUUNTO_EONSTEEL);
 	} else if (transport == DC_TRANSPORT_BLE) {
-		return dc_filter_internal_name ((const char *) userdata, bluetooth, C_ARRAY_SIZE(bluetooth));
+		return dc_filter_internal_bluetooth (transport, (const char *) userdata, dc_filter_suunto);
 	}
 
 	return 1;
@@ -466,8 +689,7 @@ static int dc_filter_suunto (dc_transport_t transport, const void *userdata)
 static int dc_filter_hw (dc_transport_t transport, const void *userdata)
 {
 	if (transport == DC_TRANSPORT_BLUETOOTH || transport == DC_TRANSPORT_BLE) {
-		return strncasecmp ((const char *) userdata, "OSTC", 4) == 0 ||
-			strncasecmp ((const char *) userdata, "FROG", 4) == 0;
+		return dc_filter_internal_bluetooth (transport, (const char *) userdata, dc_filter_hw);
 	} else if (transport == DC_TRANSPORT_SERIAL) {
 		return dc_filter_internal_rfcomm ((const char *) userdata);
 	}
@@ -477,16 +699,8 @@ static int dc_filter_hw (dc_transport_t transport, const void *userdata)
 
 static int dc_filter_shearwater (dc_transport_t transport, const void *userdata)
 {
-	static const char *bluetooth[] = {
-		"Predator",
-		"Petrel",
-		"Nerd",
-		"Perdix",
-		"Teric",
-	};
-
 	if (transport == DC_TRANSPORT_BLUETOOTH || transport == DC_TRANSPORT_BLE) {
-		return dc_filter_internal_name ((const char *) userdata, bluetooth, C_ARRAY_SIZE(bluetooth));
+		return dc_filter_internal_bluetooth (transport, (const char *) userdata, dc_filter_shearwater);
 	} else if (transport == DC_TRANSPORT_SERIAL) {
 		return dc_filter_internal_rfcomm ((const char *) userdata);
 	}
@@ -496,12 +710,8 @@ static int dc_filter_shearwater (dc_transport_t transport, const void *userdata)
 
 static int dc_filter_tecdiving (dc_transport_t transport, const void *userdata)
 {
-	static const char *bluetooth[] = {
-		"DiveComputer",
-	};
-
 	if (transport == DC_TRANSPORT_BLUETOOTH) {
-		return dc_filter_internal_name ((const char *) userdata, bluetooth, C_ARRAY_SIZE(bluetooth));
+		return dc_filter_internal_bluetooth (transport, (const char *) userdata, dc_filter_tecdiving);
 	} else if (transport == DC_TRANSPORT_SERIAL) {
 		return dc_filter_internal_rfcomm ((const char *) userdata);
 	}
@@ -511,12 +721,8 @@ static int dc_filter_tecdiving (dc_transport_t transport, const void *userdata)
 
 static int dc_filter_garmin (dc_transport_t transport, const void *userdata)
 {
-	static const dc_usb_desc_t usbhid[] = {
-		{0x091e, 0x2b2b}, // Garmin Descent Mk1
-	};
-
 	if (transport == DC_TRANSPORT_USBSTORAGE) {
-		return dc_filter_internal_usb ((const dc_usb_desc_t *) userdata, usbhid, C_ARRAY_SIZE(usbhid));
+		return dc_filter_internal_usb ((const dc_usb_desc_t *) userdata, DC_FAMILY_GARMIN);
 	}
 
 	return 1;
@@ -524,12 +730,8 @@ static int dc_filter_garmin (dc_transport_t transport, const void *userdata)
 
 static int dc_filter_mares (dc_transport_t transport, const void *userdata)
 {
-	static const char *bluetooth[] = {
-		"Mares bluelink pro",
-	};
-
 	if (transport == DC_TRANSPORT_BLE) {
-		return dc_filter_internal_name ((const char *) userdata, bluetooth, C_ARRAY_SIZE(bluetooth));
+		return dc_filter_internal_bluetooth (transport, (const char *) userdata, dc_filter_mares);
 	}
 
 	return 1;
@@ -575,6 +777,205 @@ dc_descriptor_iterator_next (dc_iterator_t *abstract, void *out)
 	return DC_STATUS_SUCCESS;
 }
 
+#ifdef DESCRIPTOR_INDEX
+/*
+ * Indices into the descriptor table, sorted on the vendor and product
+ * name, and on the family and model number. Equal keys keep the order of
+ * the descriptor table, so a lookup returns the first matching entry,
+ * exactly like a linear scan would. Both indices are built only once, on
+ * the first lookup.
+ */
+static unsigned short g_index_name[C_ARRAY_SIZE (g_descriptors)];
+static unsigned short g_index_model[C_ARRAY_SIZE (g_descriptors)];
+static pthread_once_t g_index_once = PTHREAD_ONCE_INIT;
+
+static int
+dc_descriptor_cmp_name (const dc_descriptor_t *descriptor, const char *vendor, const char *product)
+{
+	int rc = strcasecmp (descriptor->vendor, vendor);
+	if (rc)
+		return rc;
+
+	return strcasecmp (descriptor->product, product);
+}
+
+static int
+dc_descriptor_cmp_model (const dc_descriptor_t *descriptor, dc_family_t type, unsigned int model)
+{
+	if (descriptor->type != type)
+		return descriptor->type < type ? -1 : 1;
+
+	if (descriptor->model != model)
+		return descriptor->model < model ? -1 : 1;
+
+	return 0;
+}
+
+static int
+dc_descriptor_qsort_name (const void *a, const void *b)
+{
+	unsigned int i = *(const unsigned short *) a;
+	unsigned int j = *(const unsigned short *) b;
+
+	int rc = dc_descriptor_cmp_name (g_descriptors + i, g_descriptors[j].vendor, g_descriptors[j].product);
+	if (rc)
+		return rc;
+
+	return (int) i - (int) j;
+}
+
+static int
+dc_descriptor_qsort_model (const void *a, const void *b)
+{
+	unsigned int i = *(const unsigned short *) a;
+	unsigned int j = *(const unsigned short *) b;
+
+	int rc = dc_descriptor_cmp_model (g_descriptors + i, g_descriptors[j].type, g_descriptors[j].model);
+	if (rc)
+		return rc;
+
+	return (int) i - (int) j;
+}
+
+static void
+dc_descriptor_index_init (void)
+{
+	for (size_t i = 0; i < C_ARRAY_SIZE (g_descriptors); ++i) {
+		g_index_name[i] = i;
+		g_index_model[i] = i;
+	}
+
+	qsort (g_index_name, C_ARRAY_SIZE (g_index_name), sizeof (g_index_name[0]), dc_descriptor_qsort_name);
+	qsort (g_index_model, C_ARRAY_SIZE (g_index_model), sizeof (g_index_model[0]), dc_descriptor_qsort_model);
+}
+#endif
+
+dc_status_t
+dc_descriptor_find_by_name (dc_descriptor_t **out, const char *vendor, const char *product)
+{
+	const dc_descriptor_t *descriptor = NULL;
+
+	if (out == NULL || vendor == NULL || product == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+#ifdef DESCRIPTOR_INDEX
+	pthread_once (&g_index_once, dc_descriptor_index_init);
+
+	size_t lo = 0, hi = C_ARRAY_SIZE (g_index_name);
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (dc_descriptor_cmp_name (g_descriptors + g_index_name[mid], vendor, product) < 0) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	if (lo < C_ARRAY_SIZE (g_index_name) &&
+		dc_descriptor_cmp_name (g_descriptors + g_index_name[lo], vendor, product) == 0) {
+		descriptor = g_descriptors + g_index_name[lo];
+	}
+#else
+	for (size_t i = 0; i < C_ARRAY_SIZE (g_descriptors); ++i) {
+		if (dc_descriptor_cmp_name (g_descriptors + i, vendor, product) == 0) {
+			descriptor = g_descriptors + i;
+			break;
+		}
+	}
+#endif
+
+	if (descriptor == NULL)
+		return DC_STATUS_NODEVICE;
+
+	*out = (dc_descriptor_t *) descriptor;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_descriptor_find_by_model (dc_descriptor_t **out, dc_family_t family, unsigned int model)
+{
+	const dc_descriptor_t *descriptor = NULL;
+
+	if (out == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+#ifdef DESCRIPTOR_INDEX
+	pthread_once (&g_index_once, dc_descriptor_index_init);
+
+	size_t lo = 0, hi = C_ARRAY_SIZE (g_index_model);
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (dc_descriptor_cmp_model (g_descriptors + g_index_model[mid], family, model) < 0) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	if (lo < C_ARRAY_SIZE (g_index_model) &&
+		dc_descriptor_cmp_model (g_descriptors + g_index_model[lo], family, model) == 0) {
+		descriptor = g_descriptors + g_index_model[lo];
+	}
+#else
+	for (size_t i = 0; i < C_ARRAY_SIZE (g_descriptors); ++i) {
+		if (dc_descriptor_cmp_model (g_descriptors + i, family, model) == 0) {
+			descriptor = g_descriptors + i;
+			break;
+		}
+	}
+#endif
+
+	if (descriptor == NULL)
+		return DC_STATUS_NODEVICE;
+
+	*out = (dc_descriptor_t *) descriptor;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_descriptor_find_by_usb (dc_descriptor_t **out, unsigned int vid, unsigned int pid)
+{
+	if (out == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	const dc_usb_entry_t *entry = dc_usb_lookup (vid, pid);
+	if (entry == NULL)
+		return DC_STATUS_NODEVICE;
+
+	return dc_descriptor_find_by_name (out, entry->vendor, entry->product);
+}
+
+dc_status_t
+dc_descriptor_match_bluetooth (const char *name, unsigned int transports, dc_descriptor_t *descriptors[], size_t size, size_t *count)
+{
+	size_t n = 0;
+
+	if (name == NULL || (descriptors == NULL && size != 0))
+		return DC_STATUS_INVALIDARGS;
+
+	dc_bluetooth_mask_t mask = dc_bluetooth_match (name);
+
+	for (size_t i = 0; mask && i < C_ARRAY_SIZE (g_descriptors); ++i) {
+		const dc_descriptor_t *descriptor = g_descriptors + i;
+		unsigned int transport = descriptor->transports & transports;
+		if (descriptor->filter == NULL)
+			continue;
+
+		if (dc_bluetooth_accept (mask, transport, descriptor->filter)) {
+			if (n < size)
+				descriptors[n] = (dc_descriptor_t *) descriptor;
+			n++;
+		}
+	}
+
+	if (count)
+		*count = n;
+
+	return DC_STATUS_SUCCESS;
+}
+
 void
 dc_descriptor_free (dc_descriptor_t *descriptor)
 {
@@ -626,6 +1027,19 @@ dc_descriptor_get_transports (dc_descriptor_t *descriptor)
 	return descriptor->transports;
 }
 
+unsigned int
+dc_descriptor_get_capabilities (dc_descriptor_t *descriptor)
+{
+	if (descriptor == NULL)
+		return 0;
+
+	const dc_family_entry_t *entry = dc_family_lookup (descriptor->type);
+	if (entry == NULL)
+		return 0;
+
+	return entry->capabilities;
+}
+
 dc_filter_t
 dc_descriptor_get_filter (dc_descriptor_t *descriptor)
 {
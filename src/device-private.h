@@ -26,8 +26,10 @@
 
 #include <libdivecomputer/context.h>
 #include <libdivecomputer/device.h>
+#include <libdivecomputer/fingerprints.h>
 
 #include "common-private.h"
+#include "timer.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -35,11 +37,34 @@ extern "C" {
 
 #define EVENT_PROGRESS_INITIALIZER {0, UINT_MAX}
 
+// Maximum size of a resume token (family header and backend data).
+#define DEVICE_RESUME_MAXSIZE 32
+
+// Maximum size of the identification data cached for the session.
+#define DEVICE_SESSION_MAXSIZE 64
+
+#define DEVICE_PHASE_COUNT (DC_PHASE_CALLBACK + 1)
+
 struct dc_device_t;
 struct dc_device_vtable_t;
+struct dc_pagecache_t;
+struct device_eventqueue_t;
 
 typedef struct dc_device_vtable_t dc_device_vtable_t;
 
+/*
+ * Round-trip time estimator (RFC 6298 style). All times are in
+ * microseconds, except the timeout bounds (milliseconds).
+ */
+typedef struct dc_rtt_t {
+	unsigned int minimum;
+	unsigned int maximum;
+	unsigned int timeout;
+	unsigned int nsamples;
+	dc_usecs_t srtt;
+	dc_usecs_t rttvar;
+} dc_rtt_t;
+
 struct dc_device_t {
 	const dc_device_vtable_t *vtable;
 	// Library context.
@@ -51,9 +76,45 @@ struct dc_device_t {
 	// Cancellation support.
 	dc_cancel_callback_t cancel_callback;
 	void *cancel_userdata;
+	volatile int cancelled;
+	// Progress throttling.
+	unsigned int progress_interval;
+	unsigned int progress_delta;
+	unsigned int progress_valid;
+	dc_event_progress_t progress_last;
+	dc_usecs_t progress_time;
 	// Cached events for the parsers.
 	dc_event_devinfo_t devinfo;
 	dc_event_clock_t clock;
+	// Read cache.
+	struct dc_pagecache_t *cache;
+	// I/O stream (for the statistics).
+	dc_iostream_t *iostream;
+	// Timer for the latency events and the round-trip estimator.
+	dc_timer_t *timer;
+	// Adaptive timeouts.
+	dc_rtt_t rtt;
+	// Download profiling.
+	int profiling;
+	dc_phase_t phase;
+	dc_usecs_t phase_start;
+	dc_usecs_t phase_time[DEVICE_PHASE_COUNT];
+	unsigned int phase_count[DEVICE_PHASE_COUNT];
+	// Resume token.
+	unsigned char resume[DEVICE_RESUME_MAXSIZE];
+	unsigned int resume_size;
+	// Session state.
+	unsigned int session_mode;
+	unsigned char session_id[DEVICE_SESSION_MAXSIZE];
+	unsigned int session_idsize;
+	// Fingerprints of the dives to skip.
+	dc_fingerprints_t *fingerprints;
+	// Queue for the asynchronous event delivery.
+	struct device_eventqueue_t *eventqueue;
+	// Memory accounting.
+	size_t memory_current;
+	size_t memory_peak;
+	size_t memory_budget;
 };
 
 struct dc_device_vtable_t {
@@ -74,6 +135,11 @@ struct dc_device_vtable_t {
 	dc_status_t (*timesync) (dc_device_t *device, const dc_datetime_t *datetime);
 
 	dc_status_t (*close) (dc_device_t *device);
+
+	// Page size of the read cache, or zero to disable the cache.
+	unsigned int pagesize;
+
+	dc_status_t (*dump_incremental) (dc_device_t *device, dc_buffer_t *previous, dc_buffer_t *buffer);
 };
 
 int
@@ -88,12 +154,184 @@ dc_device_deallocate (dc_device_t *device);
 void
 device_event_emit (dc_device_t *device, dc_event_type_t event, const void *data);
 
+void
+device_event_emit_iostats (dc_device_t *device);
+
+/*
+ * Resumable downloads. The backend emits a checkpoint after every
+ * dive passed to the application, with enough data to continue from
+ * that point, and retrieves the data again with device_resume_get().
+ * The library prefixes the data with the device family, such that
+ * tokens from other backends are never handed to the backend.
+ */
+void
+device_event_emit_checkpoint (dc_device_t *device, const unsigned char data[], unsigned int size);
+
+const unsigned char *
+device_resume_get (dc_device_t *device, unsigned int size);
+
+/*
+ * Session state. The mode established by the handshake of the backend
+ * (zero before the first handshake), and the identification data of
+ * the device, are kept for the lifetime of the connection. Consecutive
+ * operations on the same device handle check the state, and skip the
+ * setup round trips when the device is already in the right mode, and
+ * the identification data is already known. Backends reset the state
+ * when the device leaves the mode, for example after a reboot.
+ */
+unsigned int
+device_session_mode (dc_device_t *device);
+
+void
+device_session_set_mode (dc_device_t *device, unsigned int mode);
+
+const unsigned char *
+device_session_id (dc_device_t *device, unsigned int size);
+
+void
+device_session_set_id (dc_device_t *device, const unsigned char data[], unsigned int size);
+
+void
+device_session_reset (dc_device_t *device);
+
+/*
+ * Memory accounting of the session. The large allocations of a backend
+ * are made with device_malloc(), which goes through the allocator of
+ * the context, and fails once the memory budget would be exceeded.
+ * Memory held in a dc_buffer_t object is accounted explicitly with
+ * device_memory_charge() and device_memory_release(). Backends with a
+ * mode that needs less memory check device_memory_fits() before
+ * allocating, and switch to that mode if the allocation doesn't fit.
+ */
+void *
+device_malloc (dc_device_t *device, size_t size);
+
+void
+device_free (dc_device_t *device, void *ptr);
+
+int
+device_memory_fits (dc_device_t *device, size_t size);
+
+void
+device_memory_charge (dc_device_t *device, size_t size);
+
+void
+device_memory_release (dc_device_t *device, size_t size);
+
+void
+device_event_emit_memory (dc_device_t *device);
+
+/*
+ * Round-trip timing of the backend transfer functions. Call
+ * device_latency_start() before sending the command, and
+ * device_latency_emit() once the complete response has been received,
+ * to emit a DC_EVENT_LATENCY event. Both are cheap no-ops unless the
+ * application subscribed to the event.
+ */
+dc_usecs_t
+device_latency_start (dc_device_t *device);
+
+void
+device_latency_emit (dc_device_t *device, unsigned int command, unsigned int size, dc_usecs_t start);
+
+/*
+ * Download profiling. Switch to another phase of the download, and
+ * return the previous phase, to restore it once the nested phase is
+ * finished. The time until the next switch is accounted to the new
+ * phase. The dive callback is accounted automatically. A cheap no-op
+ * unless the application subscribed to the DC_EVENT_PROFILE event.
+ */
+dc_phase_t
+device_profile_phase (dc_device_t *device, dc_phase_t phase);
+
+/*
+ * Adaptive timeouts and retries. After device_rtt_init(), the round-trip
+ * time of every request that succeeded at the first attempt is added to
+ * a smoothed estimate (samples of retried requests are ambiguous, and
+ * are discarded). The timeout for a request is derived from the
+ * estimate, doubled for every retry, and bounded by the minimum and
+ * maximum timeout (in milliseconds). Until the first sample, and for
+ * devices without an estimator, the maximum timeout is used.
+ */
+void
+device_rtt_init (dc_device_t *device, unsigned int minimum, unsigned int maximum);
+
+dc_usecs_t
+device_rtt_start (dc_device_t *device);
+
+void
+device_rtt_sample (dc_device_t *device, dc_usecs_t start);
+
+unsigned int
+device_rtt_timeout (dc_device_t *device, unsigned int attempt);
+
+dc_status_t
+device_rtt_set_timeout (dc_device_t *device, dc_iostream_t *iostream, unsigned int attempt);
+
+/*
+ * Delay (in milliseconds) before the next attempt. The nominal delay is
+ * shortened to the estimated round-trip time, and doubled for every
+ * retry, up to the maximum timeout.
+ */
+unsigned int
+device_rtt_backoff (dc_device_t *device, unsigned int attempt, unsigned int delay);
+
+typedef dc_status_t (*device_baudrate_callback_t) (dc_device_t *device, unsigned int baudrate, void *userdata);
+
+/*
+ * Negotiate the fastest working baudrate. The baudrates are tried in
+ * order of preference. For each candidate, the optional request
+ * callback asks the device to switch (still at the current baudrate;
+ * DC_STATUS_UNSUPPORTED means no switch is needed), the serial line is
+ * reconfigured, and the verify callback checks the communication. The
+ * first candidate that verifies successfully is kept, and the next one
+ * is tried otherwise. The last candidate should be the default
+ * baudrate of the device, to fall back to.
+ */
+dc_status_t
+device_negotiate_baudrate (dc_device_t *device, dc_iostream_t *iostream,
+	const unsigned int baudrates[], unsigned int count,
+	unsigned int databits, dc_parity_t parity, dc_stopbits_t stopbits, dc_flowcontrol_t flowcontrol,
+	device_baudrate_callback_t request, device_baudrate_callback_t verify, void *userdata,
+	unsigned int *baudrate);
+
 int
 device_is_cancelled (dc_device_t *device);
 
+/*
+ * Check whether the dive with the given fingerprint is in the set of
+ * dives to skip. Backends which download the dives one by one should
+ * skip those dives before downloading them. All other dives are
+ * filtered by dc_device_foreach() itself.
+ */
+int
+device_is_known (dc_device_t *device, const unsigned char data[], unsigned int size);
+
 dc_status_t
 device_dump_read (dc_device_t *device, unsigned char data[], unsigned int size, unsigned int blocksize);
 
+/*
+ * A range of the memory which isn't in use, and doesn't need to be
+ * downloaded.
+ */
+typedef struct device_range_t {
+	unsigned int address;
+	unsigned int size;
+} device_range_t;
+
+/*
+ * Download a memory dump directly into the buffer, which is resized to
+ * the full size first. The unused ranges, sorted by address and without
+ * any overlap, are not read but filled with the fill byte, and excluded
+ * from the progress events. Backends can use this to skip, for example,
+ * the free space of a ringbuffer.
+ */
+dc_status_t
+device_dump_read_sparse (dc_device_t *device, dc_buffer_t *buffer, unsigned int size, unsigned int blocksize, const device_range_t unused[], unsigned int count, unsigned char fill);
+
+dc_status_t
+device_dump_read_range (dc_device_t *device, dc_event_progress_t *progress, unsigned int address, unsigned char data[], unsigned int size, unsigned int blocksize);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
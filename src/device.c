@@ -22,45 +22,72 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <string.h>
-
-#include "suunto_d9.h"
-#include "suunto_eon.h"
-#include "suunto_eonsteel.h"
-#include "suunto_solution.h"
-#include "suunto_vyper2.h"
-#include "suunto_vyper.h"
-#include "reefnet_sensus.h"
-#include "reefnet_sensuspro.h"
-#include "reefnet_sensusultra.h"
-#include "uwatec_aladin.h"
-#include "uwatec_memomouse.h"
-#include "uwatec_smart.h"
-#include "oceanic_atom2.h"
-#include "oceanic_veo250.h"
-#include "oceanic_vtpro.h"
-#include "mares_darwin.h"
-#include "mares_iconhd.h"
-#include "mares_nemo.h"
-#include "mares_puck.h"
-#include "hw_frog.h"
-#include "hw_ostc.h"
-#include "hw_ostc3.h"
-#include "cressi_edy.h"
-#include "cressi_leonardo.h"
-#include "cressi_goa.h"
-#include "zeagle_n2ition3.h"
-#include "atomics_cobalt.h"
-#include "shearwater_petrel.h"
-#include "shearwater_predator.h"
-#include "diverite_nitekq.h"
-#include "citizen_aqualand.h"
-#include "divesystem_idive.h"
-#include "cochran_commander.h"
-#include "tecdiving_divecomputereu.h"
-#include "garmin.h"
+#include <stdint.h> // SIZE_MAX
 
 #include "device-private.h"
+#include "family.h"
 #include "context-private.h"
+#include "iostream-private.h"
+#include "pagecache.h"
+#include "perfstats.h"
+#include "tracepoint.h"
+#include "array.h"
+#include "checksum.h"
+
+// Maximum size of the read cache.
+#define CACHE_SIZE 0x40000
+
+// Minimum interval between two I/O statistics events (milliseconds).
+#define IOSTATS_INTERVAL 1000
+
+#if defined(__GNUC__)
+#define EVENT_QUEUE
+#endif
+
+#ifdef EVENT_QUEUE
+// Maximum size of the variable length data of a queued event.
+#define EVENT_PAYLOAD 512
+
+typedef union device_eventdata_t {
+	dc_event_devinfo_t devinfo;
+	dc_event_clock_t clock;
+	dc_event_vendor_t vendor;
+	dc_event_cache_t cache;
+	dc_iostream_stats_t iostats;
+	dc_event_latency_t latency;
+	dc_event_checkpoint_t checkpoint;
+	dc_event_profile_t profile;
+	dc_event_divehash_t divehash;
+	dc_event_memory_t memory;
+} device_eventdata_t;
+
+typedef struct device_eventslot_t {
+	dc_event_type_t type;
+	device_eventdata_t data;
+	unsigned char payload[EVENT_PAYLOAD];
+} device_eventslot_t;
+
+/*
+ * Bounded single-producer, single-consumer event queue. The protocol
+ * thread only advances the head, and the application thread only the
+ * tail. The progress events are not queued, but coalesced into a single
+ * value protected by a sequence counter, which always holds the most
+ * recent progress.
+ */
+struct device_eventqueue_t {
+	device_eventslot_t *slots;
+	size_t mask;
+	size_t head;
+	size_t tail;
+	unsigned int progress_sequence;
+	unsigned int progress_current;
+	unsigned int progress_maximum;
+	unsigned int progress_pending;
+	unsigned int dropped;
+};
+#endif
+
+static dc_usecs_t device_timer_now (dc_device_t *device);
 
 dc_device_t *
 dc_device_allocate (dc_context_t *context, const dc_device_vtable_t *vtable)
@@ -71,7 +98,7 @@ dc_device_allocate (dc_context_t *context, const dc_device_vtable_t *vtable)
 	assert(vtable->size >= sizeof(dc_device_t));
 
 	// Allocate memory.
-	device = (dc_device_t *) malloc (vtable->size);
+	device = (dc_device_t *) dc_malloc (context, vtable->size);
 	if (device == NULL) {
 		ERROR (context, "Failed to allocate memory.");
 		return device;
@@ -87,17 +114,78 @@ dc_device_allocate (dc_context_t *context, const dc_device_vtable_t *vtable)
 
 	device->cancel_callback = NULL;
 	device->cancel_userdata = NULL;
+	device->cancelled = 0;
+
+	device->progress_interval = 0;
+	device->progress_delta = 0;
+	device->progress_valid = 0;
+	memset (&device->progress_last, 0, sizeof (device->progress_last));
+	device->progress_time = 0;
 
 	memset (&device->devinfo, 0, sizeof (device->devinfo));
 	memset (&device->clock, 0, sizeof (device->clock));
 
+	device->cache = NULL;
+
+	device->iostream = NULL;
+
+	device->timer = NULL;
+
+	memset (&device->rtt, 0, sizeof (device->rtt));
+
+	device->profiling = 0;
+	device->phase = DC_PHASE_OTHER;
+	device->phase_start = 0;
+	memset (device->phase_time, 0, sizeof (device->phase_time));
+	memset (device->phase_count, 0, sizeof (device->phase_count));
+
+	memset (device->resume, 0, sizeof (device->resume));
+	device->resume_size = 0;
+
+	device->session_mode = 0;
+	memset (device->session_id, 0, sizeof (device->session_id));
+	device->session_idsize = 0;
+
+	device->fingerprints = NULL;
+
+	device->eventqueue = NULL;
+
+	device->memory_current = 0;
+	device->memory_peak = 0;
+	device->memory_budget = 0;
+
 	return device;
 }
 
+#ifdef EVENT_QUEUE
+static void
+device_eventqueue_free (dc_device_t *device)
+{
+	if (device->eventqueue == NULL)
+		return;
+
+	dc_free (device->context, device->eventqueue->slots);
+	dc_free (device->context, device->eventqueue);
+	device->eventqueue = NULL;
+}
+#endif
+
 void
 dc_device_deallocate (dc_device_t *device)
 {
-	free (device);
+	if (device == NULL)
+		return;
+
+	dc_pagecache_free (device->cache);
+
+#ifdef EVENT_QUEUE
+	device_eventqueue_free (device);
+#endif
+
+	if (device->timer)
+		dc_timer_free (device->timer);
+
+	dc_free (device->context, device);
 }
 
 dc_status_t
@@ -109,114 +197,14 @@ dc_device_open (dc_device_t **out, dc_context_t *context, dc_descriptor_t *descr
 	if (out == NULL || descriptor == NULL)
 		return DC_STATUS_INVALIDARGS;
 
-	switch (dc_descriptor_get_type (descriptor)) {
-	case DC_FAMILY_SUUNTO_SOLUTION:
-		rc = suunto_solution_device_open (&device, context, iostream);
-		break;
-	case DC_FAMILY_SUUNTO_EON:
-		rc = suunto_eon_device_open (&device, context, iostream);
-		break;
-	case DC_FAMILY_SUUNTO_VYPER:
-		rc = suunto_vyper_device_open (&device, context, iostream);
-		break;
-	case DC_FAMILY_SUUNTO_VYPER2:
-		rc = suunto_vyper2_device_open (&device, context, iostream);
-		break;
-	case DC_FAMILY_SUUNTO_D9:
-		rc = suunto_d9_device_open (&device, context, iostream, dc_descriptor_get_model (descriptor));
-		break;
-	case DC_FAMILY_SUUNTO_EONSTEEL:
-		rc = suunto_eonsteel_device_open (&device, context, iostream, dc_descriptor_get_model (descriptor));
-		break;
-	case DC_FAMILY_UWATEC_ALADIN:
-		rc = uwatec_aladin_device_open (&device, context, iostream);
-		break;
-	case DC_FAMILY_UWATEC_MEMOMOUSE:
-		rc = uwatec_memomouse_device_open (&device, context, iostream);
-		break;
-	case DC_FAMILY_UWATEC_SMART:
-		rc = uwatec_smart_device_open (&device, context, iostream);
-		break;
-	case DC_FAMILY_REEFNET_SENSUS:
-		rc = reefnet_sensus_device_open (&device, context, iostream);
-		break;
-	case DC_FAMILY_REEFNET_SENSUSPRO:
-		rc = reefnet_sensuspro_device_open (&device, context, iostream);
-		break;
-	case DC_FAMILY_REEFNET_SENSUSULTRA:
-		rc = reefnet_sensusultra_device_open (&device, context, iostream);
-		break;
-	case DC_FAMILY_OCEANIC_VTPRO:
-		rc = oceanic_vtpro_device_open (&device, context, iostream, dc_descriptor_get_model (descriptor));
-		break;
-	case DC_FAMILY_OCEANIC_VEO250:
-		rc = oceanic_veo250_device_open (&device, context, iostream);
-		break;
-	case DC_FAMILY_OCEANIC_ATOM2:
-		rc = oceanic_atom2_device_open (&device, context, iostream, dc_descriptor_get_model (descriptor));
-		break;
-	case DC_FAMILY_MARES_NEMO:
-		rc = mares_nemo_device_open (&device, context, iostream);
-		break;
-	case DC_FAMILY_MARES_PUCK:
-		rc = mares_puck_device_open (&device, context, iostream);
-		break;
-	case DC_FAMILY_MARES_DARWIN:
-		rc = mares_darwin_device_open (&device, context, iostream, dc_descriptor_get_model (descriptor));
-		break;
-	case DC_FAMILY_MARES_ICONHD:
-		rc = mares_iconhd_device_open (&device, context, iostream);
-		break;
-	case DC_FAMILY_HW_OSTC:
-		rc = hw_ostc_device_open (&device, context, iostream);
-		break;
-	case DC_FAMILY_HW_FROG:
-		rc = hw_frog_device_open (&device, context, iostream);
-		break;
-	case DC_FAMILY_HW_OSTC3:
-		rc = hw_ostc3_device_open (&device, context, iostream);
-		break;
-	case DC_FAMILY_CRESSI_EDY:
-		rc = cressi_edy_device_open (&device, context, iostream);
-		break;
-	case DC_FAMILY_CRESSI_LEONARDO:
-		rc = cressi_leonardo_device_open (&device, context, iostream);
-		break;
-	case DC_FAMILY_CRESSI_GOA:
-		rc = cressi_goa_device_open (&device, context, iostream);
-		break;
-	case DC_FAMILY_ZEAGLE_N2ITION3:
-		rc = zeagle_n2ition3_device_open (&device, context, iostream);
-		break;
-	case DC_FAMILY_ATOMICS_COBALT:
-		rc = atomics_cobalt_device_open (&device, context);
-		break;
-	case DC_FAMILY_SHEARWATER_PREDATOR:
-		rc = shearwater_predator_device_open (&device, context, iostream);
-		break;
-	case DC_FAMILY_SHEARWATER_PETREL:
-		rc = shearwater_petrel_device_open (&device, context, iostream);
-		break;
-	case DC_FAMILY_DIVERITE_NITEKQ:
-		rc = diverite_nitekq_device_open (&device, context, iostream);
-		break;
-	case DC_FAMILY_CITIZEN_AQUALAND:
-		rc = citizen_aqualand_device_open (&device, context, iostream);
-		break;
-	case DC_FAMILY_DIVESYSTEM_IDIVE:
-		rc = divesystem_idive_device_open (&device, context, iostream, dc_descriptor_get_model (descriptor));
-		break;
-	case DC_FAMILY_COCHRAN_COMMANDER:
-		rc = cochran_commander_device_open (&device, context, iostream);
-		break;
-	case DC_FAMILY_TECDIVING_DIVECOMPUTEREU:
-		rc = tecdiving_divecomputereu_device_open (&device, context, iostream);
-		break;
-	case DC_FAMILY_GARMIN:
-		rc = garmin_device_open (&device, context, iostream);
-		break;
-	default:
+	const dc_family_entry_t *entry = dc_family_lookup (dc_descriptor_get_type (descriptor));
+	if (entry == NULL)
 		return DC_STATUS_INVALIDARGS;
+
+	rc = entry->device_open (&device, context, iostream, dc_descriptor_get_model (descriptor));
+
+	if (rc == DC_STATUS_SUCCESS && device) {
+		device->iostream = iostream;
 	}
 
 	*out = device;
@@ -258,6 +246,22 @@ dc_device_set_cancel (dc_device_t *device, dc_cancel_callback_t callback, void *
 }
 
 
+dc_status_t
+dc_device_cancel (dc_device_t *device)
+{
+	if (device == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	device->cancelled = 1;
+
+	// Without support for interrupting the I/O stream, the
+	// cancellation is still noticed at the next check.
+	dc_iostream_interrupt (device->iostream);
+
+	return DC_STATUS_SUCCESS;
+}
+
+
 dc_status_t
 dc_device_set_events (dc_device_t *device, unsigned int events, dc_event_callback_t callback, void *userdata)
 {
@@ -272,6 +276,140 @@ dc_device_set_events (dc_device_t *device, unsigned int events, dc_event_callbac
 }
 
 
+dc_status_t
+dc_device_set_progress (dc_device_t *device, unsigned int interval, unsigned int delta)
+{
+	if (device == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (delta > 100)
+		return DC_STATUS_INVALIDARGS;
+
+	device->progress_interval = interval;
+	device->progress_delta = delta;
+	device->progress_valid = 0;
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+dc_status_t
+dc_device_set_eventqueue (dc_device_t *device, unsigned int capacity)
+{
+	if (device == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+#ifdef EVENT_QUEUE
+	// Deliver the pending events, and remove the existing queue.
+	if (device->eventqueue) {
+		dc_device_poll_events (device);
+		device_eventqueue_free (device);
+	}
+
+	if (capacity == 0)
+		return DC_STATUS_SUCCESS;
+
+	// Round the capacity up to a power of two.
+	size_t count = 1;
+	while (count < capacity)
+		count <<= 1;
+
+	struct device_eventqueue_t *queue = (struct device_eventqueue_t *) dc_malloc (device->context, sizeof (struct device_eventqueue_t));
+	if (queue == NULL) {
+		ERROR (device->context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	queue->slots = (device_eventslot_t *) dc_malloc (device->context, count * sizeof (device_eventslot_t));
+	if (queue->slots == NULL) {
+		ERROR (device->context, "Failed to allocate memory.");
+		dc_free (device->context, queue);
+		return DC_STATUS_NOMEMORY;
+	}
+
+	queue->mask = count - 1;
+	queue->head = 0;
+	queue->tail = 0;
+	queue->progress_sequence = 0;
+	queue->progress_current = 0;
+	queue->progress_maximum = 0;
+	queue->progress_pending = 0;
+	queue->dropped = 0;
+
+	device->eventqueue = queue;
+
+	return DC_STATUS_SUCCESS;
+#else
+	if (capacity == 0)
+		return DC_STATUS_SUCCESS;
+
+	return DC_STATUS_UNSUPPORTED;
+#endif
+}
+
+
+dc_status_t
+dc_device_poll_events (dc_device_t *device)
+{
+	if (device == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+#ifdef EVENT_QUEUE
+	struct device_eventqueue_t *queue = device->eventqueue;
+	if (queue == NULL)
+		return DC_STATUS_SUCCESS;
+
+	// Only the events queued so far are delivered, such that a busy
+	// producer can't keep the application thread in the loop.
+	size_t head = __atomic_load_n (&queue->head, __ATOMIC_ACQUIRE);
+	while (queue->tail != head) {
+		device_eventslot_t *slot = queue->slots + (queue->tail & queue->mask);
+		if (device->event_callback) {
+			const void *data = (slot->type == DC_EVENT_WAITING ? NULL : &slot->data);
+			device->event_callback (device, slot->type, data, device->event_userdata);
+		}
+		__atomic_store_n (&queue->tail, queue->tail + 1, __ATOMIC_RELEASE);
+	}
+
+	// Deliver the most recent progress.
+	if (__atomic_exchange_n (&queue->progress_pending, 0, __ATOMIC_ACQ_REL)) {
+		dc_event_progress_t progress;
+		unsigned int sequence = 0;
+		do {
+			sequence = __atomic_load_n (&queue->progress_sequence, __ATOMIC_ACQUIRE);
+			progress.current = __atomic_load_n (&queue->progress_current, __ATOMIC_RELAXED);
+			progress.maximum = __atomic_load_n (&queue->progress_maximum, __ATOMIC_RELAXED);
+			__atomic_thread_fence (__ATOMIC_ACQUIRE);
+		} while ((sequence & 1) || sequence != __atomic_load_n (&queue->progress_sequence, __ATOMIC_RELAXED));
+
+		if (device->event_callback) {
+			device->event_callback (device, DC_EVENT_PROGRESS, &progress, device->event_userdata);
+		}
+	}
+
+	unsigned int dropped = __atomic_exchange_n (&queue->dropped, 0, __ATOMIC_RELAXED);
+	if (dropped) {
+		WARNING (device->context, "Dropped %u events.", dropped);
+	}
+
+	return DC_STATUS_SUCCESS;
+#else
+	return DC_STATUS_UNSUPPORTED;
+#endif
+}
+
+dc_status_t
+dc_device_set_memory_budget (dc_device_t *device, size_t budget)
+{
+	if (device == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	device->memory_budget = budget;
+
+	return DC_STATUS_SUCCESS;
+}
+
+
 dc_status_t
 dc_device_set_fingerprint (dc_device_t *device, const unsigned char data[], unsigned int size)
 {
@@ -285,6 +423,45 @@ dc_device_set_fingerprint (dc_device_t *device, const unsigned char data[], unsi
 }
 
 
+dc_status_t
+dc_device_set_fingerprints (dc_device_t *device, dc_fingerprints_t *fingerprints)
+{
+	if (device == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	device->fingerprints = fingerprints;
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+dc_status_t
+dc_device_set_resume (dc_device_t *device, const unsigned char data[], unsigned int size)
+{
+	if (device == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (size == 0) {
+		device->resume_size = 0;
+		return DC_STATUS_SUCCESS;
+	}
+
+	if (data == NULL || size <= 4 || size > sizeof (device->resume))
+		return DC_STATUS_INVALIDARGS;
+
+	// Reject tokens from a different device family.
+	if (array_uint32_le (data) != (unsigned int) device->vtable->type) {
+		ERROR (device->context, "Resume token for a different device family.");
+		return DC_STATUS_INVALIDARGS;
+	}
+
+	memcpy (device->resume, data, size);
+	device->resume_size = size;
+
+	return DC_STATUS_SUCCESS;
+}
+
+
 dc_status_t
 dc_device_read (dc_device_t *device, unsigned int address, unsigned char data[], unsigned int size)
 {
@@ -294,7 +471,26 @@ dc_device_read (dc_device_t *device, unsigned int address, unsigned char data[],
 	if (device->vtable->read == NULL)
 		return DC_STATUS_UNSUPPORTED;
 
-	return device->vtable->read (device, address, data, size);
+	PERFSTATS_ADD (device_reads, 1);
+	PERFSTATS_ADD (device_bytes, size);
+
+	// Create the read cache on first use, if the backend supports it.
+	if (device->cache == NULL && device->vtable->pagesize) {
+		if (dc_pagecache_new (&device->cache, device, device->vtable->pagesize, CACHE_SIZE) != DC_STATUS_SUCCESS)
+			WARNING (device->context, "Failed to create the read cache.");
+	}
+
+	TRACEPOINT3 (device__read__start, device->vtable->type, address, size);
+
+	dc_status_t status = DC_STATUS_SUCCESS;
+	if (device->cache)
+		status = dc_pagecache_read (device->cache, address, data, size);
+	else
+		status = device->vtable->read (device, address, data, size);
+
+	TRACEPOINT4 (device__read__done, device->vtable->type, address, size, status);
+
+	return status;
 }
 
 
@@ -307,6 +503,9 @@ dc_device_write (dc_device_t *device, unsigned int address, const unsigned char
 	if (device->vtable->write == NULL)
 		return DC_STATUS_UNSUPPORTED;
 
+	// Discard the cached copy of the modified data.
+	dc_pagecache_invalidate (device->cache, address, size);
+
 	return device->vtable->write (device, address, data, size);
 }
 
@@ -325,12 +524,58 @@ dc_device_dump (dc_device_t *device, dc_buffer_t *buffer)
 
 	dc_buffer_clear (buffer);
 
-	return device->vtable->dump (device, buffer);
+	dc_status_t status = device->vtable->dump (device, buffer);
+
+	// Report the final I/O statistics.
+	device_event_emit_iostats (device);
+
+	// Report the memory usage, including the memory image.
+	device_memory_charge (device, dc_buffer_get_size (buffer));
+	device_event_emit_memory (device);
+	device_memory_release (device, dc_buffer_get_size (buffer));
+
+	return status;
 }
 
 
 dc_status_t
-device_dump_read (dc_device_t *device, unsigned char data[], unsigned int size, unsigned int blocksize)
+dc_device_dump_incremental (dc_device_t *device, dc_buffer_t *previous, dc_buffer_t *buffer)
+{
+	if (device == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (buffer == NULL || buffer == previous)
+		return DC_STATUS_INVALIDARGS;
+
+	// Without a previous image, or without native support from the
+	// backend, there is nothing to compare against.
+	if (previous == NULL || dc_buffer_get_size (previous) == 0 ||
+		device->vtable->dump_incremental == NULL)
+		return dc_device_dump (device, buffer);
+
+	dc_buffer_clear (buffer);
+
+	dc_status_t status = device->vtable->dump_incremental (device, previous, buffer);
+	if (status == DC_STATUS_UNSUPPORTED) {
+		// The previous image can't be reused.
+		INFO (device->context, "Falling back to a full memory dump.");
+		return dc_device_dump (device, buffer);
+	}
+
+	// Report the final I/O statistics.
+	device_event_emit_iostats (device);
+
+	// Report the memory usage, including the memory image.
+	device_memory_charge (device, dc_buffer_get_size (buffer));
+	device_event_emit_memory (device);
+	device_memory_release (device, dc_buffer_get_size (buffer));
+
+	return status;
+}
+
+
+static dc_status_t
+device_dump_read_ranges (dc_device_t *device, unsigned char data[], unsigned int size, unsigned int blocksize, const device_range_t unused[], unsigned int count, unsigned char fill)
 {
 	if (device == NULL)
 		return DC_STATUS_UNSUPPORTED;
@@ -338,28 +583,37 @@ device_dump_read (dc_device_t *device, unsigned char data[], unsigned int size,
 	if (device->vtable->read == NULL)
 		return DC_STATUS_UNSUPPORTED;
 
+	if (blocksize == 0)
+		return DC_STATUS_INVALIDARGS;
+
+	// Validate the unused ranges, and exclude them from the progress.
+	unsigned int skipped = 0;
+	for (unsigned int i = 0; i < count; ++i) {
+		unsigned int previous = i ? unused[i - 1].address + unused[i - 1].size : 0;
+		if (unused[i].address < previous ||
+			unused[i].address > size ||
+			unused[i].size > size - unused[i].address)
+			return DC_STATUS_INVALIDARGS;
+		skipped += unused[i].size;
+	}
+
 	// Enable progress notifications.
 	dc_event_progress_t progress = EVENT_PROGRESS_INITIALIZER;
-	progress.maximum = size;
+	progress.maximum = size - skipped;
 	device_event_emit (device, DC_EVENT_PROGRESS, &progress);
 
 	unsigned int nbytes = 0;
-	while (nbytes < size) {
-		// Calculate the packet size.
-		unsigned int len = size - nbytes;
-		if (len > blocksize)
-			len = blocksize;
-
-		// Read the packet.
-		dc_status_t rc = device->vtable->read (device, nbytes, data + nbytes, len);
+	for (unsigned int i = 0; i <= count; ++i) {
+		// Read everything up to the next unused range.
+		unsigned int end = i < count ? unused[i].address : size;
+		dc_status_t rc = device_dump_read_range (device, &progress, nbytes, data + nbytes, end - nbytes, blocksize);
 		if (rc != DC_STATUS_SUCCESS)
 			return rc;
 
-		// Update and emit a progress event.
-		progress.current += len;
-		device_event_emit (device, DC_EVENT_PROGRESS, &progress);
-
-		nbytes += len;
+		if (i < count) {
+			memset (data + end, fill, unused[i].size);
+			nbytes = end + unused[i].size;
+		}
 	}
 
 	return DC_STATUS_SUCCESS;
@@ -367,55 +621,393 @@ device_dump_read (dc_device_t *device, unsigned char data[], unsigned int size,
 
 
 dc_status_t
-dc_device_foreach (dc_device_t *device, dc_dive_callback_t callback, void *userdata)
+device_dump_read (dc_device_t *device, unsigned char data[], unsigned int size, unsigned int blocksize)
 {
-	if (device == NULL)
-		return DC_STATUS_UNSUPPORTED;
+	return device_dump_read_ranges (device, data, size, blocksize, NULL, 0, 0);
+}
 
-	if (device->vtable->foreach == NULL)
-		return DC_STATUS_UNSUPPORTED;
 
-	return device->vtable->foreach (device, callback, userdata);
+dc_status_t
+device_dump_read_sparse (dc_device_t *device, dc_buffer_t *buffer, unsigned int size, unsigned int blocksize, const device_range_t unused[], unsigned int count, unsigned char fill)
+{
+	// Allocate the required amount of memory at once, and read
+	// directly into the buffer.
+	if (!dc_buffer_clear (buffer) || !dc_buffer_resize (buffer, size)) {
+		ERROR (device->context, "Insufficient buffer space available.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	return device_dump_read_ranges (device, dc_buffer_get_data (buffer), size, blocksize, unused, count, fill);
 }
 
 
 dc_status_t
-dc_device_timesync (dc_device_t *device, const dc_datetime_t *datetime)
+device_dump_read_range (dc_device_t *device, dc_event_progress_t *progress, unsigned int address, unsigned char data[], unsigned int size, unsigned int blocksize)
 {
 	if (device == NULL)
 		return DC_STATUS_UNSUPPORTED;
 
-	if (device->vtable->timesync == NULL)
+	if (device->vtable->read == NULL)
 		return DC_STATUS_UNSUPPORTED;
 
-	return device->vtable->timesync (device, datetime);
-}
+	unsigned int nbytes = 0;
+	while (nbytes < size) {
+		// Calculate the packet size.
+		unsigned int len = size - nbytes;
+		if (len > blocksize)
+			len = blocksize;
 
+		// Read the packet.
+		dc_status_t rc = device->vtable->read (device, address + nbytes, data + nbytes, len);
+		if (rc != DC_STATUS_SUCCESS)
+			return rc;
 
-dc_status_t
-dc_device_close (dc_device_t *device)
-{
-	dc_status_t status = DC_STATUS_SUCCESS;
+		// Update and emit a progress event.
+		if (progress) {
+			progress->current += len;
+			device_event_emit (device, DC_EVENT_PROGRESS, progress);
+		}
 
-	if (device == NULL)
-		return DC_STATUS_SUCCESS;
+		nbytes += len;
+	}
 
-	// Disable the cancellation callback.
-	device->cancel_callback = NULL;
-	device->cancel_userdata = NULL;
+	return DC_STATUS_SUCCESS;
+}
 
-	if (device->vtable->close) {
-		status = device->vtable->close (device);
-	}
 
-	dc_device_deallocate (device);
+unsigned long long
+dc_dive_hash (const unsigned char data[], unsigned int size)
+{
+	if (data == NULL)
+		size = 0;
 
-	return status;
+	return checksum_xxh64 (data, size, 0);
 }
 
 
-void
-device_event_emit (dc_device_t *device, dc_event_type_t event, const void *data)
+typedef struct device_skip_t {
+	dc_device_t *device;
+	dc_dive_callback_t callback;
+	void *userdata;
+} device_skip_t;
+
+static int
+device_skip_cb (const unsigned char *data, unsigned int size, const unsigned char *fingerprint, unsigned int fsize, void *userdata)
+{
+	device_skip_t *skip = (device_skip_t *) userdata;
+
+	if (device_is_known (skip->device, fingerprint, fsize))
+		return 1;
+
+	if (skip->callback == NULL)
+		return 1;
+
+	return skip->callback (data, size, fingerprint, fsize, skip->userdata);
+}
+
+typedef struct device_hash_t {
+	dc_device_t *device;
+	dc_dive_callback_t callback;
+	void *userdata;
+} device_hash_t;
+
+static int
+device_hash_cb (const unsigned char *data, unsigned int size, const unsigned char *fingerprint, unsigned int fsize, void *userdata)
+{
+	device_hash_t *hash = (device_hash_t *) userdata;
+
+	dc_phase_t phase = device_profile_phase (hash->device, DC_PHASE_CHECKSUM);
+	dc_event_divehash_t divehash;
+	divehash.hash = dc_dive_hash (data, size);
+	divehash.size = size;
+	divehash.fingerprint = fingerprint;
+	divehash.fsize = fsize;
+	device_profile_phase (hash->device, phase);
+
+	device_event_emit (hash->device, DC_EVENT_DIVEHASH, &divehash);
+
+	return hash->callback (data, size, fingerprint, fsize, hash->userdata);
+}
+
+typedef struct device_profile_t {
+	dc_device_t *device;
+	dc_dive_callback_t callback;
+	void *userdata;
+} device_profile_t;
+
+static int
+device_profile_cb (const unsigned char *data, unsigned int size, const unsigned char *fingerprint, unsigned int fsize, void *userdata)
+{
+	device_profile_t *profile = (device_profile_t *) userdata;
+
+	PERFSTATS_ADD (callbacks, 1);
+
+	TRACEPOINT2 (dive__callback__start, profile->device->vtable->type, size);
+
+	dc_phase_t phase = device_profile_phase (profile->device, DC_PHASE_CALLBACK);
+	int rc = profile->callback (data, size, fingerprint, fsize, profile->userdata);
+	device_profile_phase (profile->device, phase);
+
+	TRACEPOINT3 (dive__callback__done, profile->device->vtable->type, size, rc);
+
+	return rc;
+}
+
+static void
+device_profile_start (dc_device_t *device)
+{
+	device->profiling = device->event_callback != NULL &&
+		(device->event_mask & DC_EVENT_PROFILE) != 0;
+	if (!device->profiling)
+		return;
+
+	memset (device->phase_time, 0, sizeof (device->phase_time));
+	memset (device->phase_count, 0, sizeof (device->phase_count));
+	device->phase = DC_PHASE_OTHER;
+	device->phase_count[DC_PHASE_OTHER] = 1;
+	device->phase_start = device_timer_now (device);
+}
+
+static void
+device_profile_stop (dc_device_t *device)
+{
+	if (!device->profiling)
+		return;
+
+	// Account the remaining time.
+	device_profile_phase (device, DC_PHASE_OTHER);
+	device->profiling = 0;
+
+	for (unsigned int i = 0; i < DEVICE_PHASE_COUNT; ++i) {
+		if (device->phase_count[i] == 0)
+			continue;
+
+		dc_event_profile_t profile;
+		profile.phase = (dc_phase_t) i;
+		profile.count = device->phase_count[i];
+		profile.time = device->phase_time[i];
+		device_event_emit (device, DC_EVENT_PROFILE, &profile);
+	}
+}
+
+dc_status_t
+dc_device_foreach (dc_device_t *device, dc_dive_callback_t callback, void *userdata)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (device == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (device->vtable->foreach == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	// Account the time spent in the application.
+	device_profile_t profile = {device, callback, userdata};
+	device_profile_start (device);
+	if ((device->profiling || PERFSTATS_ENABLED || TRACEPOINTS_ENABLED) && callback) {
+		callback = device_profile_cb;
+		userdata = &profile;
+	}
+
+	// Hash the dives, before they are passed to the application.
+	device_hash_t hash = {device, callback, userdata};
+	if (device->event_callback && (device->event_mask & DC_EVENT_DIVEHASH) && callback) {
+		callback = device_hash_cb;
+		userdata = &hash;
+	}
+
+	if (device->fingerprints) {
+		// Filter the known dives, for the backends which don't skip
+		// them already.
+		device_skip_t skip = {device, callback, userdata};
+		status = device->vtable->foreach (device, device_skip_cb, &skip);
+	} else {
+		status = device->vtable->foreach (device, callback, userdata);
+	}
+
+	// Report the time spent in each phase.
+	device_profile_stop (device);
+
+	// The resume token is only valid for a single download.
+	device->resume_size = 0;
+
+	// Report the effectiveness of the read cache.
+	if (device->cache) {
+		dc_event_cache_t cache;
+		dc_pagecache_get_stats (device->cache, &cache.hits, &cache.misses);
+		device_event_emit (device, DC_EVENT_CACHE, &cache);
+	}
+
+	// Report the final I/O statistics.
+	device_event_emit_iostats (device);
+
+	// Report the memory usage.
+	device_event_emit_memory (device);
+
+	return status;
+}
+
+
+dc_status_t
+dc_device_timesync (dc_device_t *device, const dc_datetime_t *datetime)
+{
+	if (device == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (device->vtable->timesync == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	return device->vtable->timesync (device, datetime);
+}
+
+
+dc_status_t
+dc_device_close (dc_device_t *device)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (device == NULL)
+		return DC_STATUS_SUCCESS;
+
+	// Disable the cancellation callback.
+	device->cancel_callback = NULL;
+	device->cancel_userdata = NULL;
+
+	if (device->vtable->close) {
+		status = device->vtable->close (device);
+	}
+
+	dc_device_deallocate (device);
+
+	return status;
+}
+
+
+/*
+ * Check whether the progress event should be delivered, and if so,
+ * remember it as the reference for the next events.
+ */
+static int
+device_progress_expired (dc_device_t *device, const dc_event_progress_t *progress)
+{
+	if (device->progress_interval == 0 && device->progress_delta == 0)
+		return 1;
+
+	const dc_event_progress_t *last = &device->progress_last;
+	dc_usecs_t now = device->progress_interval ? device_timer_now (device) : 0;
+
+	int expired =
+		!device->progress_valid ||
+		progress->maximum != last->maximum ||
+		progress->current < last->current ||
+		progress->current == progress->maximum;
+
+	if (!expired && device->progress_interval &&
+		now - device->progress_time >= (dc_usecs_t) device->progress_interval * 1000)
+		expired = 1;
+
+	if (!expired && device->progress_delta &&
+		(unsigned long long) (progress->current - last->current) * 100 >=
+		(unsigned long long) device->progress_delta * progress->maximum)
+		expired = 1;
+
+	if (expired) {
+		device->progress_valid = 1;
+		device->progress_last = *progress;
+		device->progress_time = now;
+	}
+
+	return expired;
+}
+
+
+#ifdef EVENT_QUEUE
+static void
+device_eventqueue_push (struct device_eventqueue_t *queue, dc_event_type_t event, const void *data)
+{
+	// Coalesce the progress events.
+	if (event == DC_EVENT_PROGRESS) {
+		const dc_event_progress_t *progress = (const dc_event_progress_t *) data;
+		unsigned int sequence = __atomic_load_n (&queue->progress_sequence, __ATOMIC_RELAXED);
+		__atomic_store_n (&queue->progress_sequence, sequence + 1, __ATOMIC_RELAXED);
+		__atomic_thread_fence (__ATOMIC_RELEASE);
+		__atomic_store_n (&queue->progress_current, progress->current, __ATOMIC_RELAXED);
+		__atomic_store_n (&queue->progress_maximum, progress->maximum, __ATOMIC_RELAXED);
+		__atomic_store_n (&queue->progress_sequence, sequence + 2, __ATOMIC_RELEASE);
+		__atomic_store_n (&queue->progress_pending, 1, __ATOMIC_RELEASE);
+		return;
+	}
+
+	size_t head = __atomic_load_n (&queue->head, __ATOMIC_RELAXED);
+	size_t tail = __atomic_load_n (&queue->tail, __ATOMIC_ACQUIRE);
+	if (head - tail > queue->mask)
+		goto dropped;
+
+	// Copy the event data, including the data it points to.
+	device_eventslot_t *slot = queue->slots + (head & queue->mask);
+	slot->type = event;
+	switch (event) {
+	case DC_EVENT_WAITING:
+		break;
+	case DC_EVENT_DEVINFO:
+		slot->data.devinfo = *(const dc_event_devinfo_t *) data;
+		break;
+	case DC_EVENT_CLOCK:
+		slot->data.clock = *(const dc_event_clock_t *) data;
+		break;
+	case DC_EVENT_VENDOR:
+		slot->data.vendor = *(const dc_event_vendor_t *) data;
+		if (slot->data.vendor.size > sizeof (slot->payload))
+			goto dropped;
+		if (slot->data.vendor.size)
+			memcpy (slot->payload, slot->data.vendor.data, slot->data.vendor.size);
+		slot->data.vendor.data = slot->payload;
+		break;
+	case DC_EVENT_CACHE:
+		slot->data.cache = *(const dc_event_cache_t *) data;
+		break;
+	case DC_EVENT_IOSTATS:
+		slot->data.iostats = *(const dc_iostream_stats_t *) data;
+		break;
+	case DC_EVENT_LATENCY:
+		slot->data.latency = *(const dc_event_latency_t *) data;
+		break;
+	case DC_EVENT_CHECKPOINT:
+		slot->data.checkpoint = *(const dc_event_checkpoint_t *) data;
+		if (slot->data.checkpoint.size > sizeof (slot->payload))
+			goto dropped;
+		memcpy (slot->payload, slot->data.checkpoint.data, slot->data.checkpoint.size);
+		slot->data.checkpoint.data = slot->payload;
+		break;
+	case DC_EVENT_PROFILE:
+		slot->data.profile = *(const dc_event_profile_t *) data;
+		break;
+	case DC_EVENT_DIVEHASH:
+		slot->data.divehash = *(const dc_event_divehash_t *) data;
+		if (slot->data.divehash.fsize > sizeof (slot->payload))
+			goto dropped;
+		if (slot->data.divehash.fsize)
+			memcpy (slot->payload, slot->data.divehash.fingerprint, slot->data.divehash.fsize);
+		slot->data.divehash.fingerprint = slot->payload;
+		break;
+	case DC_EVENT_MEMORY:
+		slot->data.memory = *(const dc_event_memory_t *) data;
+		break;
+	default:
+		goto dropped;
+	}
+
+	__atomic_store_n (&queue->head, head + 1, __ATOMIC_RELEASE);
+	return;
+
+dropped:
+	__atomic_fetch_add (&queue->dropped, 1, __ATOMIC_RELAXED);
+}
+#endif
+
+
+void
+device_event_emit (dc_device_t *device, dc_event_type_t event, const void *data)
 {
 	const dc_event_progress_t *progress = (const dc_event_progress_t *) data;
 
@@ -435,6 +1027,27 @@ device_event_emit (dc_device_t *device, dc_event_type_t event, const void *data)
 	case DC_EVENT_CLOCK:
 		assert (data != NULL);
 		break;
+	case DC_EVENT_CACHE:
+		assert (data != NULL);
+		break;
+	case DC_EVENT_IOSTATS:
+		assert (data != NULL);
+		break;
+	case DC_EVENT_LATENCY:
+		assert (data != NULL);
+		break;
+	case DC_EVENT_CHECKPOINT:
+		assert (data != NULL);
+		break;
+	case DC_EVENT_PROFILE:
+		assert (data != NULL);
+		break;
+	case DC_EVENT_DIVEHASH:
+		assert (data != NULL);
+		break;
+	case DC_EVENT_MEMORY:
+		assert (data != NULL);
+		break;
 	default:
 		break;
 	}
@@ -454,6 +1067,12 @@ device_event_emit (dc_device_t *device, dc_event_type_t event, const void *data)
 		break;
 	}
 
+	// Report the I/O statistics periodically, along with the progress.
+	if (event == DC_EVENT_PROGRESS &&
+		dc_iostream_stats_expired (device->iostream, IOSTATS_INTERVAL)) {
+		device_event_emit_iostats (device);
+	}
+
 	// Check if there is a callback function registered.
 	if (device->event_callback == NULL)
 		return;
@@ -462,16 +1081,501 @@ device_event_emit (dc_device_t *device, dc_event_type_t event, const void *data)
 	if ((event & device->event_mask) == 0)
 		return;
 
+	// Coalesce the progress events.
+	if (event == DC_EVENT_PROGRESS && !device_progress_expired (device, progress))
+		return;
+
+#ifdef EVENT_QUEUE
+	// Leave the delivery to the application thread.
+	if (device->eventqueue) {
+		device_eventqueue_push (device->eventqueue, event, data);
+		return;
+	}
+#endif
+
 	device->event_callback (device, event, data, device->event_userdata);
 }
 
 
+void
+device_event_emit_iostats (dc_device_t *device)
+{
+	dc_iostream_stats_t stats;
+
+	if (device == NULL || device->iostream == NULL)
+		return;
+
+	if (dc_iostream_get_stats (device->iostream, &stats) != DC_STATUS_SUCCESS)
+		return;
+
+	device_event_emit (device, DC_EVENT_IOSTATS, &stats);
+}
+
+
+void
+device_event_emit_checkpoint (dc_device_t *device, const unsigned char data[], unsigned int size)
+{
+	unsigned char token[DEVICE_RESUME_MAXSIZE] = {0};
+
+	if (device == NULL || device->event_callback == NULL ||
+		(device->event_mask & DC_EVENT_CHECKPOINT) == 0)
+		return;
+
+	assert (size + 4 <= sizeof (token));
+
+	array_uint32_le_set (token, device->vtable->type);
+	memcpy (token + 4, data, size);
+
+	dc_event_checkpoint_t checkpoint;
+	checkpoint.data = token;
+	checkpoint.size = size + 4;
+	device_event_emit (device, DC_EVENT_CHECKPOINT, &checkpoint);
+}
+
+
+const unsigned char *
+device_resume_get (dc_device_t *device, unsigned int size)
+{
+	if (device == NULL || device->resume_size != size + 4)
+		return NULL;
+
+	return device->resume + 4;
+}
+
+
+unsigned int
+device_session_mode (dc_device_t *device)
+{
+	if (device == NULL)
+		return 0;
+
+	return device->session_mode;
+}
+
+
+void
+device_session_set_mode (dc_device_t *device, unsigned int mode)
+{
+	if (device == NULL)
+		return;
+
+	device->session_mode = mode;
+}
+
+
+const unsigned char *
+device_session_id (dc_device_t *device, unsigned int size)
+{
+	if (device == NULL || device->session_idsize == 0 || device->session_idsize != size)
+		return NULL;
+
+	return device->session_id;
+}
+
+
+void
+device_session_set_id (dc_device_t *device, const unsigned char data[], unsigned int size)
+{
+	if (device == NULL)
+		return;
+
+	if (data == NULL || size > sizeof (device->session_id)) {
+		device->session_idsize = 0;
+		return;
+	}
+
+	memcpy (device->session_id, data, size);
+	device->session_idsize = size;
+}
+
+
+void
+device_session_reset (dc_device_t *device)
+{
+	if (device == NULL)
+		return;
+
+	device->session_mode = 0;
+	device->session_idsize = 0;
+}
+
+
+/*
+ * The size of each allocation is stored in front of the memory, with
+ * the alignment of the largest scalar types.
+ */
+typedef union device_memheader_t {
+	size_t size;
+	long double align_double;
+	unsigned long long align_integer;
+	void *align_pointer;
+} device_memheader_t;
+
+
+void *
+device_malloc (dc_device_t *device, size_t size)
+{
+	dc_context_t *context = (device ? device->context : NULL);
+
+	if (size == 0 || size > SIZE_MAX - sizeof (device_memheader_t))
+		return NULL;
+
+	if (!device_memory_fits (device, size)) {
+		ERROR (context, "Memory budget exceeded (%lu bytes).", (unsigned long) size);
+		return NULL;
+	}
+
+	device_memheader_t *header = (device_memheader_t *) dc_malloc (context, sizeof (device_memheader_t) + size);
+	if (header == NULL)
+		return NULL;
+
+	header->size = size;
+	device_memory_charge (device, size);
+
+	return header + 1;
+}
+
+
+void
+device_free (dc_device_t *device, void *ptr)
+{
+	if (ptr == NULL)
+		return;
+
+	device_memheader_t *header = (device_memheader_t *) ptr - 1;
+	device_memory_release (device, header->size);
+	dc_free (device ? device->context : NULL, header);
+}
+
+
+int
+device_memory_fits (dc_device_t *device, size_t size)
+{
+	if (device == NULL || device->memory_budget == 0)
+		return 1;
+
+	return device->memory_current <= device->memory_budget &&
+		size <= device->memory_budget - device->memory_current;
+}
+
+
+void
+device_memory_charge (dc_device_t *device, size_t size)
+{
+	if (device == NULL)
+		return;
+
+	device->memory_current += size;
+	if (device->memory_peak < device->memory_current)
+		device->memory_peak = device->memory_current;
+}
+
+
+void
+device_memory_release (dc_device_t *device, size_t size)
+{
+	if (device == NULL)
+		return;
+
+	assert (size <= device->memory_current);
+	device->memory_current -= size;
+}
+
+
+void
+device_event_emit_memory (dc_device_t *device)
+{
+	if (device == NULL || device->event_callback == NULL ||
+		(device->event_mask & DC_EVENT_MEMORY) == 0)
+		return;
+
+	dc_event_memory_t memory;
+	memory.current = device->memory_current;
+	memory.peak = device->memory_peak;
+	memory.budget = device->memory_budget;
+	device_event_emit (device, DC_EVENT_MEMORY, &memory);
+}
+
+
+static int
+device_latency_enabled (dc_device_t *device)
+{
+	if (device == NULL || device->event_callback == NULL)
+		return 0;
+
+	return (device->event_mask & DC_EVENT_LATENCY) != 0;
+}
+
+
+static dc_usecs_t
+device_timer_now (dc_device_t *device)
+{
+	dc_usecs_t now = 0;
+
+	// Create the timer on first use.
+	if (device->timer == NULL) {
+		if (dc_timer_new (&device->timer) != DC_STATUS_SUCCESS) {
+			device->timer = NULL;
+			return 0;
+		}
+	}
+
+	dc_timer_now (device->timer, &now);
+
+	return now;
+}
+
+
+dc_usecs_t
+device_latency_start (dc_device_t *device)
+{
+	TRACEPOINT1 (transfer__start, dc_device_get_type (device));
+
+	if (!device_latency_enabled (device))
+		return 0;
+
+	return device_timer_now (device);
+}
+
+
+void
+device_latency_emit (dc_device_t *device, unsigned int command, unsigned int size, dc_usecs_t start)
+{
+	dc_usecs_t now = 0;
+
+	TRACEPOINT3 (transfer__done, dc_device_get_type (device), command, size);
+
+	if (!device_latency_enabled (device) || device->timer == NULL)
+		return;
+
+	if (dc_timer_now (device->timer, &now) != DC_STATUS_SUCCESS || now < start)
+		return;
+
+	dc_event_latency_t latency;
+	latency.command = command;
+	latency.size = size;
+	latency.latency = now - start;
+	device_event_emit (device, DC_EVENT_LATENCY, &latency);
+}
+
+
+dc_phase_t
+device_profile_phase (dc_device_t *device, dc_phase_t phase)
+{
+	if (device == NULL || !device->profiling || (unsigned int) phase >= DEVICE_PHASE_COUNT)
+		return DC_PHASE_OTHER;
+
+	dc_phase_t previous = device->phase;
+	if (phase == previous)
+		return previous;
+
+	dc_usecs_t now = device_timer_now (device);
+	if (now > device->phase_start)
+		device->phase_time[previous] += now - device->phase_start;
+
+	device->phase_start = now;
+	device->phase_count[phase]++;
+	device->phase = phase;
+
+	return previous;
+}
+
+
+void
+device_rtt_init (dc_device_t *device, unsigned int minimum, unsigned int maximum)
+{
+	if (device == NULL)
+		return;
+
+	if (minimum > maximum)
+		minimum = maximum;
+
+	memset (&device->rtt, 0, sizeof (device->rtt));
+	device->rtt.minimum = minimum;
+	device->rtt.maximum = maximum;
+	device->rtt.timeout = maximum;
+}
+
+
+dc_usecs_t
+device_rtt_start (dc_device_t *device)
+{
+	if (device == NULL || device->rtt.maximum == 0)
+		return 0;
+
+	return device_timer_now (device);
+}
+
+
+void
+device_rtt_sample (dc_device_t *device, dc_usecs_t start)
+{
+	if (device == NULL || device->rtt.maximum == 0 || device->timer == NULL)
+		return;
+
+	dc_usecs_t now = device_timer_now (device);
+	if (now < start)
+		return;
+
+	dc_usecs_t rtt = now - start;
+	dc_rtt_t *estimator = &device->rtt;
+
+	if (estimator->nsamples == 0) {
+		estimator->srtt = rtt;
+		estimator->rttvar = rtt / 2;
+	} else {
+		dc_usecs_t delta = estimator->srtt > rtt ?
+			estimator->srtt - rtt : rtt - estimator->srtt;
+		estimator->rttvar = (3 * estimator->rttvar + delta) / 4;
+		estimator->srtt = (7 * estimator->srtt + rtt) / 8;
+	}
+
+	estimator->nsamples++;
+}
+
+
+unsigned int
+device_rtt_timeout (dc_device_t *device, unsigned int attempt)
+{
+	if (device == NULL || device->rtt.maximum == 0)
+		return 0;
+
+	const dc_rtt_t *estimator = &device->rtt;
+
+	if (estimator->nsamples == 0)
+		return estimator->maximum;
+
+	// Retransmission timeout, rounded up to the next millisecond.
+	dc_usecs_t rto = (estimator->srtt + 4 * estimator->rttvar + 999) / 1000;
+	if (rto < estimator->minimum)
+		rto = estimator->minimum;
+
+	// Exponential backoff.
+	while (attempt-- && rto < estimator->maximum)
+		rto *= 2;
+
+	if (rto > estimator->maximum)
+		rto = estimator->maximum;
+
+	return rto;
+}
+
+
+dc_status_t
+device_rtt_set_timeout (dc_device_t *device, dc_iostream_t *iostream, unsigned int attempt)
+{
+	if (device == NULL || device->rtt.maximum == 0)
+		return DC_STATUS_SUCCESS;
+
+	unsigned int timeout = device_rtt_timeout (device, attempt);
+
+	// Avoid reconfiguring the I/O stream for every request.
+	if (timeout == device->rtt.timeout)
+		return DC_STATUS_SUCCESS;
+
+	dc_status_t status = dc_iostream_set_timeout (iostream, timeout);
+	if (status != DC_STATUS_SUCCESS)
+		return status;
+
+	device->rtt.timeout = timeout;
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+unsigned int
+device_rtt_backoff (dc_device_t *device, unsigned int attempt, unsigned int delay)
+{
+	if (device == NULL || device->rtt.maximum == 0 || device->rtt.nsamples == 0)
+		return delay;
+
+	const dc_rtt_t *estimator = &device->rtt;
+
+	unsigned int value = (estimator->srtt + 999) / 1000;
+	if (value > delay)
+		value = delay;
+
+	while (attempt-- > 1 && value < estimator->maximum)
+		value *= 2;
+
+	if (value > estimator->maximum)
+		value = estimator->maximum;
+
+	return value;
+}
+
+
+dc_status_t
+device_negotiate_baudrate (dc_device_t *device, dc_iostream_t *iostream,
+	const unsigned int baudrates[], unsigned int count,
+	unsigned int databits, dc_parity_t parity, dc_stopbits_t stopbits, dc_flowcontrol_t flowcontrol,
+	device_baudrate_callback_t request, device_baudrate_callback_t verify, void *userdata,
+	unsigned int *baudrate)
+{
+	dc_status_t status = DC_STATUS_UNSUPPORTED;
+
+	if (device == NULL || baudrates == NULL || count == 0 || verify == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	for (unsigned int i = 0; i < count; ++i) {
+		if (device_is_cancelled (device))
+			return DC_STATUS_CANCELLED;
+
+		// Ask the device to switch to the new baudrate.
+		if (request) {
+			status = request (device, baudrates[i], userdata);
+			if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED) {
+				WARNING (device->context, "Failed to request the baudrate %u.", baudrates[i]);
+				continue;
+			}
+		}
+
+		// Adjust the baudrate.
+		status = dc_iostream_configure (iostream, baudrates[i], databits, parity, stopbits, flowcontrol);
+		if (status != DC_STATUS_SUCCESS) {
+			ERROR (device->context, "Failed to set the terminal attributes.");
+			return status;
+		}
+
+		// Verify the communication.
+		status = verify (device, baudrates[i], userdata);
+		if (status == DC_STATUS_SUCCESS) {
+			INFO (device->context, "Baudrate: %u", baudrates[i]);
+			if (baudrate)
+				*baudrate = baudrates[i];
+			return DC_STATUS_SUCCESS;
+		}
+
+		if (status == DC_STATUS_CANCELLED)
+			return status;
+
+		// Discard any garbage bytes.
+		dc_iostream_purge (iostream, DC_DIRECTION_INPUT);
+	}
+
+	return status;
+}
+
+
+int
+device_is_known (dc_device_t *device, const unsigned char data[], unsigned int size)
+{
+	if (device == NULL || device->fingerprints == NULL)
+		return 0;
+
+	return dc_fingerprints_contains (device->fingerprints, data, size);
+}
+
+
 int
 device_is_cancelled (dc_device_t *device)
 {
 	if (device == NULL)
 		return 0;
 
+	if (device->cancelled)
+		return 1;
+
 	if (device->cancel_callback == NULL)
 		return 0;
 
@@ -42,6 +42,9 @@
 #define SZ_MEMORY (128 * SZ_PACKET)
 #define SZ_LOGBOOK 6
 
+#define NBLOCKS        (SZ_MEMORY / SZ_PACKET)
+#define NBLOCKS_HEADER ((EOP + 2 + SZ_PACKET - 1) / SZ_PACKET)
+
 #define LOGBOOK          0x0320
 #define ADDRESS          0x0384
 #define EOP              0x03E6
@@ -72,9 +75,6 @@ static const dc_device_vtable_t diverite_nitekq_device_vtable = {
 	diverite_nitekq_device_close /* close */
 };
 
-static dc_status_t
-diverite_nitekq_extract_dives (dc_device_t *device, const unsigned char data[], unsigned int size, dc_dive_callback_t callback, void *userdata);
-
 static dc_status_t
 diverite_nitekq_send (diverite_nitekq_device_t *device, unsigned char cmd)
 {
@@ -236,23 +236,12 @@ diverite_nitekq_device_set_fingerprint (dc_device_t *abstract, const unsigned ch
 
 
 static dc_status_t
-diverite_nitekq_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
+diverite_nitekq_download_begin (diverite_nitekq_device_t *device, dc_buffer_t *buffer, dc_event_progress_t *progress)
 {
-	diverite_nitekq_device_t *device = (diverite_nitekq_device_t*) abstract;
+	dc_device_t *abstract = (dc_device_t *) device;
 	dc_status_t rc = DC_STATUS_SUCCESS;
 	unsigned char packet[256] = {0};
 
-	// Pre-allocate the required amount of memory.
-	if (!dc_buffer_reserve (buffer, SZ_PACKET + SZ_MEMORY)) {
-		ERROR (abstract->context, "Insufficient buffer space available.");
-		return DC_STATUS_NOMEMORY;
-	}
-
-	// Enable progress notifications.
-	dc_event_progress_t progress = EVENT_PROGRESS_INITIALIZER;
-	progress.maximum = SZ_PACKET + SZ_MEMORY;
-	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
-
 	// Emit a vendor event.
 	dc_event_vendor_t vendor;
 	vendor.data = device->version;
@@ -284,8 +273,8 @@ diverite_nitekq_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 	dc_buffer_append (buffer, packet, sizeof (packet));
 
 	// Update and emit a progress event.
-	progress.current += SZ_PACKET;
-	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
+	progress->current += SZ_PACKET;
+	device_event_emit (abstract, DC_EVENT_PROGRESS, progress);
 
 	// Send the request to initiate downloading memory blocks.
 	rc = diverite_nitekq_send (device, RESET);
@@ -293,7 +282,18 @@ diverite_nitekq_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 		return rc;
 	}
 
-	for (unsigned int i = 0; i < 128; ++i) {
+	return DC_STATUS_SUCCESS;
+}
+
+
+static dc_status_t
+diverite_nitekq_download_blocks (diverite_nitekq_device_t *device, dc_buffer_t *buffer, unsigned int count, dc_event_progress_t *progress)
+{
+	dc_device_t *abstract = (dc_device_t *) device;
+	dc_status_t rc = DC_STATUS_SUCCESS;
+	unsigned char packet[256] = {0};
+
+	for (unsigned int i = 0; i < count; ++i) {
 		// Request the next memory block.
 		rc = diverite_nitekq_send (device, BLOCK);
 		if (rc != DC_STATUS_SUCCESS) {
@@ -309,27 +309,130 @@ diverite_nitekq_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 		dc_buffer_append (buffer, packet, sizeof (packet));
 
 		// Update and emit a progress event.
-		progress.current += SZ_PACKET;
-		device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
+		progress->current += SZ_PACKET;
+		device_event_emit (abstract, DC_EVENT_PROGRESS, progress);
 	}
 
 	return DC_STATUS_SUCCESS;
 }
 
 
+/*
+ * Get the number of memory blocks that contain the logbook entries and
+ * the profile data of all dives newer than the fingerprint. The blocks
+ * can only be downloaded sequentially, so as soon as one of the new
+ * profiles wraps around the end of the ringbuffer, the entire memory is
+ * needed. Invalid pointers are reported later, when extracting the dives.
+ */
+static unsigned int
+diverite_nitekq_download_needed (diverite_nitekq_device_t *device, const unsigned char data[])
+{
+	unsigned int eop = array_uint16_be(data + EOP);
+	if (eop < RB_PROFILE_BEGIN || eop >= RB_PROFILE_END)
+		return NBLOCKS;
+
+	unsigned int previous = eop;
+	for (unsigned int i = 0; i < 10; ++i) {
+		const unsigned char *p = data + LOGBOOK + i * SZ_LOGBOOK;
+
+		if (array_isequal (p, SZ_LOGBOOK, 0x00))
+			break;
+
+		unsigned int address = array_uint16_be(data + ADDRESS + i * 2);
+		if (address < RB_PROFILE_BEGIN || address >= RB_PROFILE_END)
+			return NBLOCKS;
+
+		if (memcmp (p, device->fingerprint, sizeof (device->fingerprint)) == 0)
+			break;
+
+		if (previous <= address)
+			return NBLOCKS;
+
+		previous = address;
+	}
+
+	// The most recent profile ends at the end of profile pointer.
+	unsigned int nblocks = (eop + SZ_PACKET - 1) / SZ_PACKET;
+	if (nblocks < NBLOCKS_HEADER)
+		nblocks = NBLOCKS_HEADER;
+
+	return nblocks;
+}
+
+
+static dc_status_t
+diverite_nitekq_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
+{
+	diverite_nitekq_device_t *device = (diverite_nitekq_device_t*) abstract;
+	dc_status_t rc = DC_STATUS_SUCCESS;
+
+	// Pre-allocate the required amount of memory.
+	if (!dc_buffer_reserve (buffer, SZ_PACKET + SZ_MEMORY)) {
+		ERROR (abstract->context, "Insufficient buffer space available.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	// Enable progress notifications.
+	dc_event_progress_t progress = EVENT_PROGRESS_INITIALIZER;
+	progress.maximum = SZ_PACKET + SZ_MEMORY;
+	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
+
+	rc = diverite_nitekq_download_begin (device, buffer, &progress);
+	if (rc != DC_STATUS_SUCCESS) {
+		return rc;
+	}
+
+	return diverite_nitekq_download_blocks (device, buffer, NBLOCKS, &progress);
+}
+
+
 static dc_status_t
 diverite_nitekq_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, void *userdata)
 {
-	dc_buffer_t *buffer = dc_buffer_new (0);
+	diverite_nitekq_device_t *device = (diverite_nitekq_device_t*) abstract;
+
+	dc_buffer_t *buffer = dc_buffer_new (SZ_PACKET + SZ_MEMORY);
 	if (buffer == NULL)
 		return DC_STATUS_NOMEMORY;
 
-	dc_status_t rc = diverite_nitekq_device_dump (abstract, buffer);
+	// Enable progress notifications.
+	dc_event_progress_t progress = EVENT_PROGRESS_INITIALIZER;
+	progress.maximum = SZ_PACKET + SZ_MEMORY;
+	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
+
+	dc_status_t rc = diverite_nitekq_download_begin (device, buffer, &progress);
 	if (rc != DC_STATUS_SUCCESS) {
 		dc_buffer_free (buffer);
 		return rc;
 	}
 
+	// Download the blocks with the logbook and pointers first.
+	rc = diverite_nitekq_download_blocks (device, buffer, NBLOCKS_HEADER, &progress);
+	if (rc != DC_STATUS_SUCCESS) {
+		dc_buffer_free (buffer);
+		return rc;
+	}
+
+	// Download only the remaining blocks with new profile data.
+	unsigned int nblocks = diverite_nitekq_download_needed (device,
+		dc_buffer_get_data (buffer) + SZ_PACKET);
+
+	progress.maximum = SZ_PACKET + nblocks * SZ_PACKET;
+	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
+
+	rc = diverite_nitekq_download_blocks (device, buffer, nblocks - NBLOCKS_HEADER, &progress);
+	if (rc != DC_STATUS_SUCCESS) {
+		dc_buffer_free (buffer);
+		return rc;
+	}
+
+	// The blocks that were not downloaded contain no new dives.
+	if (!dc_buffer_resize (buffer, SZ_PACKET + SZ_MEMORY)) {
+		ERROR (abstract->context, "Insufficient buffer space available.");
+		dc_buffer_free (buffer);
+		return DC_STATUS_NOMEMORY;
+	}
+
 	rc = diverite_nitekq_extract_dives (abstract,
 		dc_buffer_get_data (buffer), dc_buffer_get_size (buffer), callback, userdata);
 
@@ -339,7 +442,7 @@ diverite_nitekq_device_foreach (dc_device_t *abstract, dc_dive_callback_t callba
 }
 
 
-static dc_status_t
+dc_status_t
 diverite_nitekq_extract_dives (dc_device_t *abstract, const unsigned char data[], unsigned int size, dc_dive_callback_t callback, void *userdata)
 {
 	diverite_nitekq_device_t *device = (diverite_nitekq_device_t *) abstract;
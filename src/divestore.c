@@ -0,0 +1,1189 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_MMAP)
+#include <sys/mman.h>
+#define USE_MMAP
+#endif
+
+#include <libdivecomputer/divestore.h>
+
+#include "context-private.h"
+#include "checksum.h"
+#include "array.h"
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+#ifdef _WIN32
+#define ftruncate _chsize
+#endif
+
+#define FILE_MAGIC   0x53444344 /* "DCDS" */
+#define RECORD_MAGIC 0x52444344 /* "DCDR" */
+#define FILE_VERSION 2
+
+#define SZ_HEADER    8
+#define SZ_RECORD    8
+#define SZ_CHECKSUM  4
+#define SZ_FIXED_V1  64
+#define SZ_FIXED     88
+#define SZ_GASMIX    24
+
+// Offsets in the payload of a record.
+#define OFS_FAMILY      0
+#define OFS_MODEL       4
+#define OFS_SERIAL      8
+#define OFS_FSIZE       12
+#define OFS_DSIZE       16
+#define OFS_DATETIME    20
+#define OFS_DIVETIME    48
+#define OFS_MAXDEPTH    52
+#define OFS_NGASMIXES   60
+#define OFS_LOCATION    64
+
+// The number of entries per block of the range index.
+#define RANGESIZE 256
+
+// The maximum number of geohash cells covering the box of a query.
+#define MAXCELLS 16
+
+#define TICKS_NONE   ((dc_ticks_t) -1)
+#define GEOHASH_NONE 0xFFFFFFFFFFFFFFFFULL
+
+typedef struct dc_divestore_entry_t {
+	// The payload of the record.
+	const unsigned char *payload;
+	unsigned int hash;
+	// The indexed fields of the summary.
+	unsigned int divetime;
+	double maxdepth;
+	dc_ticks_t ticks;
+	unsigned long long geohash;
+} dc_divestore_entry_t;
+
+/*
+ * An element of a sorted index, with the key and the index of the entry.
+ */
+typedef struct dc_divestore_key_t {
+	unsigned long long key;
+	unsigned int index;
+} dc_divestore_key_t;
+
+/*
+ * The minimum and maximum depth and dive time of a block of consecutive
+ * entries, to skip the entire block when it can't match a query.
+ */
+typedef struct dc_divestore_range_t {
+	double mindepth, maxdepth;
+	unsigned int mindivetime, maxdivetime;
+} dc_divestore_range_t;
+
+/*
+ * The box of a query, quantized like the geohash. A box crossing the
+ * antimeridian is split in two longitude ranges.
+ */
+typedef struct dc_divestore_box_t {
+	unsigned int minlatitude, maxlatitude;
+	unsigned int minlongitude[2], maxlongitude[2];
+	unsigned int nlongitudes;
+} dc_divestore_box_t;
+
+struct dc_divestore_t {
+	dc_context_t *context;
+	int fd;
+	// The contents of the file at the time it was opened.
+	unsigned char *map;
+	size_t mapsize;
+	int mapped;
+	// The size of the valid part of the file.
+	size_t size;
+	// The size of the fixed part of the records.
+	unsigned int fixed;
+	// The records added after the file was opened.
+	unsigned char **blocks;
+	unsigned int nblocks;
+	dc_divestore_entry_t *entries;
+	unsigned int count;
+	unsigned int capacity;
+	// Open addressing hash table, with the index of the entry plus one.
+	unsigned int *table;
+	unsigned int tablesize;
+	// The secondary indexes, with the entries sorted on the date and
+	// time, and on the geohash, and the range index with one block for
+	// every RANGESIZE entries. The entries without a date and time, or
+	// location, are left out of the sorted indexes.
+	dc_divestore_key_t *bytime;
+	unsigned int nbytime;
+	dc_divestore_key_t *bygeohash;
+	unsigned int nbygeohash;
+	dc_divestore_range_t *ranges;
+};
+
+static unsigned int
+dc_divestore_hash (dc_family_t family, unsigned int model, unsigned int serial, const unsigned char fingerprint[], unsigned int fsize)
+{
+	unsigned char key[12];
+	array_uint32_le_set (key + 0, family);
+	array_uint32_le_set (key + 4, model);
+	array_uint32_le_set (key + 8, serial);
+
+	// FNV-1a
+	unsigned int hash = 2166136261u;
+	for (unsigned int i = 0; i < sizeof (key); ++i) {
+		hash = (hash ^ key[i]) * 16777619u;
+	}
+	for (unsigned int i = 0; i < fsize; ++i) {
+		hash = (hash ^ fingerprint[i]) * 16777619u;
+	}
+
+	return hash;
+}
+
+static void
+dc_divestore_double_set (unsigned char data[], double value)
+{
+	unsigned long long bits = 0;
+	memcpy (&bits, &value, sizeof (bits));
+	array_uint32_le_set (data + 0, bits & 0xFFFFFFFF);
+	array_uint32_le_set (data + 4, bits >> 32);
+}
+
+static double
+dc_divestore_double (const unsigned char data[])
+{
+	unsigned long long bits =
+		((unsigned long long) array_uint32_le (data + 4) << 32) |
+		array_uint32_le (data + 0);
+	double value = 0.0;
+	memcpy (&value, &bits, sizeof (value));
+	return value;
+}
+
+static unsigned long long
+dc_divestore_spread (unsigned int value)
+{
+	unsigned long long x = value;
+	x = (x | (x << 16)) & 0x0000FFFF0000FFFFULL;
+	x = (x | (x << 8))  & 0x00FF00FF00FF00FFULL;
+	x = (x | (x << 4))  & 0x0F0F0F0F0F0F0F0FULL;
+	x = (x | (x << 2))  & 0x3333333333333333ULL;
+	x = (x | (x << 1))  & 0x5555555555555555ULL;
+	return x;
+}
+
+static unsigned int
+dc_divestore_compact (unsigned long long x)
+{
+	x &= 0x5555555555555555ULL;
+	x = (x | (x >> 1))  & 0x3333333333333333ULL;
+	x = (x | (x >> 2))  & 0x0F0F0F0F0F0F0F0FULL;
+	x = (x | (x >> 4))  & 0x00FF00FF00FF00FFULL;
+	x = (x | (x >> 8))  & 0x0000FFFF0000FFFFULL;
+	x = (x | (x >> 16)) & 0x00000000FFFFFFFFULL;
+	return (unsigned int) x;
+}
+
+/*
+ * Map a coordinate onto 32 bits. The highest value is never used, such
+ * that the geohash of a location is never equal to GEOHASH_NONE.
+ */
+static unsigned int
+dc_divestore_quantize (double value, double minimum, double maximum)
+{
+	if (!(value > minimum))
+		return 0;
+
+	double q = (value - minimum) / (maximum - minimum) * 4294967295.0;
+	if (q >= 4294967294.0)
+		return 0xFFFFFFFE;
+
+	return (unsigned int) q;
+}
+
+/*
+ * The geohash interleaves the bits of the quantized longitude and
+ * latitude, starting with the longitude. The locations inside the same
+ * cell share a common prefix, and are adjacent in the sorted index.
+ */
+static unsigned long long
+dc_divestore_geohash (unsigned int longitude, unsigned int latitude)
+{
+	return (dc_divestore_spread (longitude) << 1) | dc_divestore_spread (latitude);
+}
+
+static unsigned long long
+dc_divestore_ticks_key (dc_ticks_t ticks)
+{
+	// Flip the sign bit, to sort the negative values first.
+	return (unsigned long long) ticks ^ 0x8000000000000000ULL;
+}
+
+static int
+dc_divestore_key_cmp (const void *a, const void *b)
+{
+	const dc_divestore_key_t *ka = (const dc_divestore_key_t *) a;
+	const dc_divestore_key_t *kb = (const dc_divestore_key_t *) b;
+
+	if (ka->key != kb->key)
+		return ka->key < kb->key ? -1 : 1;
+	if (ka->index != kb->index)
+		return ka->index < kb->index ? -1 : 1;
+	return 0;
+}
+
+/*
+ * Return the position of the first element with a key equal to or
+ * (with upper set) larger than the key.
+ */
+static unsigned int
+dc_divestore_bound (const dc_divestore_key_t index[], unsigned int count, unsigned long long key, int upper)
+{
+	unsigned int lo = 0, hi = count;
+	while (lo < hi) {
+		unsigned int mid = lo + (hi - lo) / 2;
+		if (index[mid].key < key || (upper && index[mid].key == key))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+static void
+dc_divestore_index_insert (dc_divestore_key_t index[], unsigned int *count, unsigned long long key, unsigned int value, int sorted)
+{
+	unsigned int i = *count;
+	if (sorted) {
+		// The new entry has the highest index, and goes after the
+		// entries with the same key.
+		i = dc_divestore_bound (index, *count, key, 1);
+		memmove (index + i + 1, index + i, (*count - i) * sizeof (dc_divestore_key_t));
+	}
+
+	index[i].key = key;
+	index[i].index = value;
+	(*count)++;
+}
+
+static int
+dc_divestore_match (const unsigned char *payload, unsigned int fixed, dc_family_t family, unsigned int model, unsigned int serial, const unsigned char fingerprint[], unsigned int fsize)
+{
+	if (array_uint32_le (payload + OFS_FAMILY) != family ||
+		array_uint32_le (payload + OFS_MODEL) != model ||
+		array_uint32_le (payload + OFS_SERIAL) != serial ||
+		array_uint32_le (payload + OFS_FSIZE) != fsize)
+		return 0;
+
+	unsigned int ngasmixes = array_uint32_le (payload + OFS_NGASMIXES);
+
+	return memcmp (payload + fixed + ngasmixes * SZ_GASMIX, fingerprint, fsize) == 0;
+}
+
+static void
+dc_divestore_decode (const unsigned char *payload, unsigned int fixed, const unsigned char **fingerprint, unsigned int *fsize, const unsigned char **data, unsigned int *dsize, dc_divestore_summary_t *summary)
+{
+	unsigned int ngasmixes = array_uint32_le (payload + OFS_NGASMIXES);
+	unsigned int fs = array_uint32_le (payload + OFS_FSIZE);
+	const unsigned char *fp = payload + fixed + ngasmixes * SZ_GASMIX;
+
+	if (fingerprint)
+		*fingerprint = fp;
+	if (fsize)
+		*fsize = fs;
+	if (data)
+		*data = fp + fs;
+	if (dsize)
+		*dsize = array_uint32_le (payload + OFS_DSIZE);
+
+	if (summary) {
+		const unsigned char *p = payload + OFS_DATETIME;
+		memset (summary, 0, sizeof (*summary));
+		summary->datetime.year     = (int) array_uint32_le (p + 0);
+		summary->datetime.month    = (int) array_uint32_le (p + 4);
+		summary->datetime.day      = (int) array_uint32_le (p + 8);
+		summary->datetime.hour     = (int) array_uint32_le (p + 12);
+		summary->datetime.minute   = (int) array_uint32_le (p + 16);
+		summary->datetime.second   = (int) array_uint32_le (p + 20);
+		summary->datetime.timezone = (int) array_uint32_le (p + 24);
+		summary->divetime = array_uint32_le (payload + OFS_DIVETIME);
+		summary->maxdepth = dc_divestore_double (payload + OFS_MAXDEPTH);
+		summary->ngasmixes = ngasmixes;
+		for (unsigned int i = 0; i < ngasmixes; ++i) {
+			const unsigned char *g = payload + fixed + i * SZ_GASMIX;
+			summary->gasmixes[i].helium   = dc_divestore_double (g + 0);
+			summary->gasmixes[i].oxygen   = dc_divestore_double (g + 8);
+			summary->gasmixes[i].nitrogen = dc_divestore_double (g + 16);
+		}
+		if (fixed >= SZ_FIXED) {
+			summary->location.latitude  = dc_divestore_double (payload + OFS_LOCATION + 0);
+			summary->location.longitude = dc_divestore_double (payload + OFS_LOCATION + 8);
+			summary->location.altitude  = dc_divestore_double (payload + OFS_LOCATION + 16);
+		}
+	}
+}
+
+static dc_status_t
+dc_divestore_rehash (dc_divestore_t *store, unsigned int tablesize)
+{
+	unsigned int *table = (unsigned int *) dc_malloc (store->context, tablesize * sizeof (unsigned int));
+	if (table == NULL) {
+		ERROR (store->context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	memset (table, 0, tablesize * sizeof (unsigned int));
+
+	for (unsigned int i = 0; i < store->count; ++i) {
+		unsigned int slot = store->entries[i].hash & (tablesize - 1);
+		while (table[slot])
+			slot = (slot + 1) & (tablesize - 1);
+		table[slot] = i + 1;
+	}
+
+	dc_free (store->context, store->table);
+	store->table = table;
+	store->tablesize = tablesize;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_divestore_entry_t *
+dc_divestore_find (dc_divestore_t *store, dc_family_t family, unsigned int model, unsigned int serial, const unsigned char fingerprint[], unsigned int fsize)
+{
+	if (store->tablesize == 0)
+		return NULL;
+
+	unsigned int hash = dc_divestore_hash (family, model, serial, fingerprint, fsize);
+	unsigned int slot = hash & (store->tablesize - 1);
+	while (store->table[slot]) {
+		dc_divestore_entry_t *entry = store->entries + store->table[slot] - 1;
+		if (entry->hash == hash && dc_divestore_match (entry->payload, store->fixed, family, model, serial, fingerprint, fsize))
+			return entry;
+		slot = (slot + 1) & (store->tablesize - 1);
+	}
+
+	return NULL;
+}
+
+/*
+ * Make room for one more entry, such that the next insert can't fail.
+ */
+static dc_status_t
+dc_divestore_reserve (dc_divestore_t *store)
+{
+	if (store->count == store->capacity) {
+		unsigned int capacity = store->capacity ? store->capacity * 2 : 64;
+		dc_divestore_entry_t *entries = (dc_divestore_entry_t *) dc_realloc (store->context,
+			store->entries, capacity * sizeof (dc_divestore_entry_t));
+		if (entries == NULL) {
+			ERROR (store->context, "Failed to allocate memory.");
+			return DC_STATUS_NOMEMORY;
+		}
+		store->entries = entries;
+
+		dc_divestore_key_t *bytime = (dc_divestore_key_t *) dc_realloc (store->context,
+			store->bytime, capacity * sizeof (dc_divestore_key_t));
+		if (bytime == NULL) {
+			ERROR (store->context, "Failed to allocate memory.");
+			return DC_STATUS_NOMEMORY;
+		}
+		store->bytime = bytime;
+
+		dc_divestore_key_t *bygeohash = (dc_divestore_key_t *) dc_realloc (store->context,
+			store->bygeohash, capacity * sizeof (dc_divestore_key_t));
+		if (bygeohash == NULL) {
+			ERROR (store->context, "Failed to allocate memory.");
+			return DC_STATUS_NOMEMORY;
+		}
+		store->bygeohash = bygeohash;
+
+		dc_divestore_range_t *ranges = (dc_divestore_range_t *) dc_realloc (store->context,
+			store->ranges, (capacity / RANGESIZE + 1) * sizeof (dc_divestore_range_t));
+		if (ranges == NULL) {
+			ERROR (store->context, "Failed to allocate memory.");
+			return DC_STATUS_NOMEMORY;
+		}
+		store->ranges = ranges;
+
+		store->capacity = capacity;
+	}
+
+	// Keep the load factor of the hash table below one half.
+	if (2 * (store->count + 1) > store->tablesize) {
+		return dc_divestore_rehash (store, store->tablesize ? store->tablesize * 2 : 128);
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+/*
+ * Add the entry to the hash table and the secondary indexes. While the
+ * file is being indexed, the sorted indexes are only appended to, and
+ * sorted once at the end.
+ */
+static void
+dc_divestore_insert (dc_divestore_t *store, const unsigned char *payload, int sorted)
+{
+	unsigned int ngasmixes = array_uint32_le (payload + OFS_NGASMIXES);
+	unsigned int fsize = array_uint32_le (payload + OFS_FSIZE);
+	unsigned int index = store->count;
+
+	dc_divestore_summary_t summary;
+	dc_divestore_decode (payload, store->fixed, NULL, NULL, NULL, NULL, &summary);
+
+	dc_divestore_entry_t *entry = store->entries + index;
+	entry->payload = payload;
+	entry->hash = dc_divestore_hash (
+		array_uint32_le (payload + OFS_FAMILY),
+		array_uint32_le (payload + OFS_MODEL),
+		array_uint32_le (payload + OFS_SERIAL),
+		payload + store->fixed + ngasmixes * SZ_GASMIX, fsize);
+	entry->divetime = summary.divetime;
+	entry->maxdepth = summary.maxdepth;
+	entry->ticks = summary.datetime.year ? dc_datetime_mktime (&summary.datetime) : TICKS_NONE;
+	if (summary.location.latitude != 0.0 || summary.location.longitude != 0.0) {
+		entry->geohash = dc_divestore_geohash (
+			dc_divestore_quantize (summary.location.longitude, -180.0, 180.0),
+			dc_divestore_quantize (summary.location.latitude, -90.0, 90.0));
+	} else {
+		entry->geohash = GEOHASH_NONE;
+	}
+
+	unsigned int slot = entry->hash & (store->tablesize - 1);
+	while (store->table[slot])
+		slot = (slot + 1) & (store->tablesize - 1);
+	store->table[slot] = ++store->count;
+
+	if (entry->ticks != TICKS_NONE) {
+		dc_divestore_index_insert (store->bytime, &store->nbytime,
+			dc_divestore_ticks_key (entry->ticks), index, sorted);
+	}
+
+	if (entry->geohash != GEOHASH_NONE) {
+		dc_divestore_index_insert (store->bygeohash, &store->nbygeohash,
+			entry->geohash, index, sorted);
+	}
+
+	dc_divestore_range_t *range = store->ranges + index / RANGESIZE;
+	if (index % RANGESIZE == 0) {
+		range->mindepth = range->maxdepth = entry->maxdepth;
+		range->mindivetime = range->maxdivetime = entry->divetime;
+	} else {
+		if (range->mindepth > entry->maxdepth)
+			range->mindepth = entry->maxdepth;
+		if (range->maxdepth < entry->maxdepth)
+			range->maxdepth = entry->maxdepth;
+		if (range->mindivetime > entry->divetime)
+			range->mindivetime = entry->divetime;
+		if (range->maxdivetime < entry->divetime)
+			range->maxdivetime = entry->divetime;
+	}
+}
+
+/*
+ * Check the record at the given offset, and return its total size, or
+ * zero if the record is incomplete or corrupt.
+ */
+static size_t
+dc_divestore_validate (const unsigned char *data, size_t size, unsigned int fixed)
+{
+	if (size < SZ_RECORD + fixed + SZ_CHECKSUM)
+		return 0;
+
+	if (array_uint32_le (data) != RECORD_MAGIC)
+		return 0;
+
+	size_t length = array_uint32_le (data + 4);
+	if (length < fixed || length > size - SZ_RECORD - SZ_CHECKSUM)
+		return 0;
+
+	const unsigned char *payload = data + SZ_RECORD;
+	unsigned int ngasmixes = array_uint32_le (payload + OFS_NGASMIXES);
+	unsigned int fsize = array_uint32_le (payload + OFS_FSIZE);
+	unsigned int dsize = array_uint32_le (payload + OFS_DSIZE);
+	if (ngasmixes > DC_DIVESTORE_MAXGASMIXES ||
+		(unsigned long long) fixed + ngasmixes * SZ_GASMIX + fsize + dsize != length)
+		return 0;
+
+	if (checksum_crc32 (payload, length) != array_uint32_le (payload + length))
+		return 0;
+
+	return SZ_RECORD + length + SZ_CHECKSUM;
+}
+
+static dc_status_t
+dc_divestore_load (dc_divestore_t *store, size_t size)
+{
+	if (size == 0)
+		return DC_STATUS_SUCCESS;
+
+#ifdef USE_MMAP
+	void *map = mmap (NULL, size, PROT_READ, MAP_PRIVATE, store->fd, 0);
+	if (map != MAP_FAILED) {
+		store->map = (unsigned char *) map;
+		store->mapsize = size;
+		store->mapped = 1;
+		return DC_STATUS_SUCCESS;
+	}
+#endif
+
+	// Without mmap support, read the entire file into memory.
+	store->map = (unsigned char *) dc_malloc (store->context, size);
+	if (store->map == NULL) {
+		ERROR (store->context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	size_t nbytes = 0;
+	while (nbytes < size) {
+		int n = read (store->fd, store->map + nbytes, size - nbytes);
+		if (n <= 0) {
+			if (n < 0 && errno == EINTR)
+				continue;
+			ERROR (store->context, "Failed to read the file.");
+			return DC_STATUS_IO;
+		}
+		nbytes += n;
+	}
+
+	store->mapsize = size;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_divestore_write (dc_divestore_t *store, const unsigned char data[], size_t size)
+{
+	if (lseek (store->fd, store->size, SEEK_SET) < 0) {
+		SYSERROR (store->context, errno);
+		return DC_STATUS_IO;
+	}
+
+	size_t nbytes = 0;
+	while (nbytes < size) {
+		int n = write (store->fd, data + nbytes, size - nbytes);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			SYSERROR (store->context, errno);
+			// Remove the partial record again.
+			if (ftruncate (store->fd, store->size) != 0) {
+				SYSERROR (store->context, errno);
+			}
+			return DC_STATUS_IO;
+		}
+		nbytes += n;
+	}
+
+	store->size += size;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_divestore_open (dc_divestore_t **out, dc_context_t *context, const char *filename)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_divestore_t *store = NULL;
+
+	if (out == NULL || filename == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	store = (dc_divestore_t *) dc_malloc (context, sizeof (dc_divestore_t));
+	if (store == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	memset (store, 0, sizeof (dc_divestore_t));
+	store->context = context;
+	store->fixed = SZ_FIXED;
+
+	store->fd = open (filename, O_RDWR | O_CREAT | O_BINARY, 0666);
+	if (store->fd < 0) {
+		SYSERROR (context, errno);
+		ERROR (context, "Failed to open the file '%s'.", filename);
+		dc_free (context, store);
+		return DC_STATUS_IO;
+	}
+
+	struct stat st;
+	if (fstat (store->fd, &st) != 0) {
+		SYSERROR (context, errno);
+		status = DC_STATUS_IO;
+		goto error_close;
+	}
+
+	status = dc_divestore_load (store, st.st_size);
+	if (status != DC_STATUS_SUCCESS)
+		goto error_close;
+
+	if (store->mapsize == 0) {
+		// Write the header of a new file.
+		unsigned char header[SZ_HEADER];
+		array_uint32_le_set (header + 0, FILE_MAGIC);
+		array_uint32_le_set (header + 4, FILE_VERSION);
+		status = dc_divestore_write (store, header, sizeof (header));
+		if (status != DC_STATUS_SUCCESS)
+			goto error_close;
+	} else {
+		unsigned int version = store->mapsize < SZ_HEADER ? 0 : array_uint32_le (store->map + 4);
+		if (store->mapsize < SZ_HEADER ||
+			array_uint32_le (store->map + 0) != FILE_MAGIC ||
+			version < 1 || version > FILE_VERSION) {
+			ERROR (context, "The file '%s' is not a dive store.", filename);
+			status = DC_STATUS_DATAFORMAT;
+			goto error_close;
+		}
+
+		// The records of a version 1 file have no location.
+		if (version == 1)
+			store->fixed = SZ_FIXED_V1;
+
+		// Index the records.
+		size_t offset = SZ_HEADER;
+		while (offset < store->mapsize) {
+			size_t n = dc_divestore_validate (store->map + offset, store->mapsize - offset, store->fixed);
+			if (n == 0)
+				break;
+
+			status = dc_divestore_reserve (store);
+			if (status != DC_STATUS_SUCCESS)
+				goto error_close;
+
+			dc_divestore_insert (store, store->map + offset + SZ_RECORD, 0);
+
+			offset += n;
+		}
+
+		qsort (store->bytime, store->nbytime, sizeof (dc_divestore_key_t), dc_divestore_key_cmp);
+		qsort (store->bygeohash, store->nbygeohash, sizeof (dc_divestore_key_t), dc_divestore_key_cmp);
+
+		store->size = offset;
+
+		// Discard the incomplete record at the end, so the next record is
+		// appended directly after the last valid one.
+		if (offset != store->mapsize) {
+			WARNING (context, "Discarding %lu bytes of incomplete data at the end of the dive store.",
+				(unsigned long) (store->mapsize - offset));
+			if (ftruncate (store->fd, offset) != 0) {
+				SYSERROR (context, errno);
+				status = DC_STATUS_IO;
+				goto error_close;
+			}
+		}
+	}
+
+	*out = store;
+
+	return DC_STATUS_SUCCESS;
+
+error_close:
+	dc_divestore_close (store);
+	return status;
+}
+
+dc_status_t
+dc_divestore_summarize (dc_parser_t *parser, dc_divestore_summary_t *summary)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (parser == NULL || summary == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	memset (summary, 0, sizeof (*summary));
+	summary->datetime.timezone = DC_TIMEZONE_NONE;
+
+	status = dc_parser_get_datetime (parser, &summary->datetime);
+	if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED)
+		return status;
+
+	status = dc_parser_get_field (parser, DC_FIELD_DIVETIME, 0, &summary->divetime);
+	if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED)
+		return status;
+
+	status = dc_parser_get_field (parser, DC_FIELD_MAXDEPTH, 0, &summary->maxdepth);
+	if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED)
+		return status;
+
+	unsigned int ngasmixes = 0;
+	status = dc_parser_get_field (parser, DC_FIELD_GASMIX_COUNT, 0, &ngasmixes);
+	if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED)
+		return status;
+
+	if (ngasmixes > DC_DIVESTORE_MAXGASMIXES)
+		ngasmixes = DC_DIVESTORE_MAXGASMIXES;
+
+	for (unsigned int i = 0; i < ngasmixes; ++i) {
+		status = dc_parser_get_field (parser, DC_FIELD_GASMIX, i, &summary->gasmixes[i]);
+		if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED)
+			return status;
+	}
+
+	summary->ngasmixes = ngasmixes;
+
+	status = dc_parser_get_field (parser, DC_FIELD_LOCATION, 0, &summary->location);
+	if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED)
+		return status;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_divestore_add (dc_divestore_t *store, dc_family_t family, unsigned int model, unsigned int serial,
+	const unsigned char fingerprint[], unsigned int fsize,
+	const unsigned char data[], unsigned int size,
+	const dc_divestore_summary_t *summary)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (store == NULL || (fingerprint == NULL && fsize) || (data == NULL && size))
+		return DC_STATUS_INVALIDARGS;
+
+	if (dc_divestore_find (store, family, model, serial, fingerprint, fsize))
+		return DC_STATUS_SUCCESS;
+
+	unsigned int ngasmixes = summary ? summary->ngasmixes : 0;
+	if (ngasmixes > DC_DIVESTORE_MAXGASMIXES)
+		return DC_STATUS_INVALIDARGS;
+
+	unsigned int fixed = store->fixed;
+	unsigned long long length = (unsigned long long) fixed + ngasmixes * SZ_GASMIX + fsize + size;
+	if (length > 0xFFFFFFFF - SZ_RECORD - SZ_CHECKSUM)
+		return DC_STATUS_INVALIDARGS;
+
+	// Make room for the new entry first, such that the record is never
+	// written to the file without being indexed.
+	status = dc_divestore_reserve (store);
+	if (status != DC_STATUS_SUCCESS)
+		return status;
+
+	unsigned char **blocks = (unsigned char **) dc_realloc (store->context,
+		store->blocks, (store->nblocks + 1) * sizeof (unsigned char *));
+	if (blocks == NULL) {
+		ERROR (store->context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+	store->blocks = blocks;
+
+	unsigned char *record = (unsigned char *) dc_malloc (store->context, SZ_RECORD + length + SZ_CHECKSUM);
+	if (record == NULL) {
+		ERROR (store->context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	unsigned char *payload = record + SZ_RECORD;
+	memset (payload, 0, fixed);
+	array_uint32_le_set (record + 0, RECORD_MAGIC);
+	array_uint32_le_set (record + 4, length);
+	array_uint32_le_set (payload + OFS_FAMILY, family);
+	array_uint32_le_set (payload + OFS_MODEL, model);
+	array_uint32_le_set (payload + OFS_SERIAL, serial);
+	array_uint32_le_set (payload + OFS_FSIZE, fsize);
+	array_uint32_le_set (payload + OFS_DSIZE, size);
+	if (summary) {
+		unsigned char *p = payload + OFS_DATETIME;
+		array_uint32_le_set (p + 0, summary->datetime.year);
+		array_uint32_le_set (p + 4, summary->datetime.month);
+		array_uint32_le_set (p + 8, summary->datetime.day);
+		array_uint32_le_set (p + 12, summary->datetime.hour);
+		array_uint32_le_set (p + 16, summary->datetime.minute);
+		array_uint32_le_set (p + 20, summary->datetime.second);
+		array_uint32_le_set (p + 24, summary->datetime.timezone);
+		array_uint32_le_set (payload + OFS_DIVETIME, summary->divetime);
+		dc_divestore_double_set (payload + OFS_MAXDEPTH, summary->maxdepth);
+		array_uint32_le_set (payload + OFS_NGASMIXES, ngasmixes);
+		for (unsigned int i = 0; i < ngasmixes; ++i) {
+			unsigned char *g = payload + fixed + i * SZ_GASMIX;
+			dc_divestore_double_set (g + 0, summary->gasmixes[i].helium);
+			dc_divestore_double_set (g + 8, summary->gasmixes[i].oxygen);
+			dc_divestore_double_set (g + 16, summary->gasmixes[i].nitrogen);
+		}
+		if (fixed >= SZ_FIXED) {
+			dc_divestore_double_set (payload + OFS_LOCATION + 0, summary->location.latitude);
+			dc_divestore_double_set (payload + OFS_LOCATION + 8, summary->location.longitude);
+			dc_divestore_double_set (payload + OFS_LOCATION + 16, summary->location.altitude);
+		}
+	} else {
+		array_uint32_le_set (payload + OFS_DATETIME + 24, DC_TIMEZONE_NONE);
+	}
+	if (fsize)
+		memcpy (payload + fixed + ngasmixes * SZ_GASMIX, fingerprint, fsize);
+	if (size)
+		memcpy (payload + fixed + ngasmixes * SZ_GASMIX + fsize, data, size);
+	array_uint32_le_set (payload + length, checksum_crc32 (payload, length));
+
+	status = dc_divestore_write (store, record, SZ_RECORD + length + SZ_CHECKSUM);
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR (store->context, "Failed to write the dive.");
+		dc_free (store->context, record);
+		return status;
+	}
+
+	dc_divestore_insert (store, payload, 1);
+	store->blocks[store->nblocks++] = record;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_divestore_lookup (dc_divestore_t *store, dc_family_t family, unsigned int model, unsigned int serial,
+	const unsigned char fingerprint[], unsigned int fsize,
+	const unsigned char **data, unsigned int *size,
+	dc_divestore_summary_t *summary)
+{
+	if (store == NULL || (fingerprint == NULL && fsize))
+		return DC_STATUS_INVALIDARGS;
+
+	dc_divestore_entry_t *entry = dc_divestore_find (store, family, model, serial, fingerprint, fsize);
+	if (entry == NULL)
+		return DC_STATUS_DONE;
+
+	dc_divestore_decode (entry->payload, store->fixed, NULL, NULL, data, size, summary);
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_divestore_foreach (dc_divestore_t *store, dc_family_t family, unsigned int model, unsigned int serial,
+	dc_divestore_callback_t callback, void *userdata)
+{
+	if (store == NULL || callback == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	for (unsigned int i = 0; i < store->count; ++i) {
+		const unsigned char *payload = store->entries[i].payload;
+		if (array_uint32_le (payload + OFS_FAMILY) != family ||
+			array_uint32_le (payload + OFS_MODEL) != model ||
+			array_uint32_le (payload + OFS_SERIAL) != serial)
+			continue;
+
+		const unsigned char *fingerprint = NULL, *data = NULL;
+		unsigned int fsize = 0, size = 0;
+		dc_divestore_summary_t summary;
+		dc_divestore_decode (payload, store->fixed, &fingerprint, &fsize, &data, &size, &summary);
+
+		if (!callback (data, size, fingerprint, fsize, &summary, userdata))
+			break;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+static int
+dc_divestore_accept (const dc_divestore_entry_t *entry, const dc_divestore_query_t *query, const dc_divestore_box_t *box)
+{
+	if (query->flags & DC_DIVESTORE_QUERY_DATETIME) {
+		if (entry->ticks == TICKS_NONE ||
+			entry->ticks < query->begin || entry->ticks > query->end)
+			return 0;
+	}
+
+	if (query->flags & DC_DIVESTORE_QUERY_MAXDEPTH) {
+		if (entry->maxdepth < query->mindepth ||
+			(query->maxdepth > 0.0 && entry->maxdepth > query->maxdepth))
+			return 0;
+	}
+
+	if (query->flags & DC_DIVESTORE_QUERY_DIVETIME) {
+		if (entry->divetime < query->mindivetime ||
+			(query->maxdivetime && entry->divetime > query->maxdivetime))
+			return 0;
+	}
+
+	if (query->flags & DC_DIVESTORE_QUERY_LOCATION) {
+		if (entry->geohash == GEOHASH_NONE)
+			return 0;
+
+		unsigned int latitude = dc_divestore_compact (entry->geohash);
+		unsigned int longitude = dc_divestore_compact (entry->geohash >> 1);
+		if (latitude < box->minlatitude || latitude > box->maxlatitude)
+			return 0;
+
+		unsigned int i = 0;
+		while (i < box->nlongitudes &&
+			(longitude < box->minlongitude[i] || longitude > box->maxlongitude[i]))
+			i++;
+		if (i == box->nlongitudes)
+			return 0;
+	}
+
+	return 1;
+}
+
+static int
+dc_divestore_overlap (const dc_divestore_range_t *range, const dc_divestore_query_t *query)
+{
+	if (query->flags & DC_DIVESTORE_QUERY_MAXDEPTH) {
+		if (range->maxdepth < query->mindepth ||
+			(query->maxdepth > 0.0 && range->mindepth > query->maxdepth))
+			return 0;
+	}
+
+	if (query->flags & DC_DIVESTORE_QUERY_DIVETIME) {
+		if (range->maxdivetime < query->mindivetime ||
+			(query->maxdivetime && range->mindivetime > query->maxdivetime))
+			return 0;
+	}
+
+	return 1;
+}
+
+/*
+ * Cover the box with the cells of the finest geohash level, for which
+ * no more than MAXCELLS cells are needed. A cell of level n contains
+ * all geohashes with the same 2 * n leading bits. The cells are returned
+ * sorted and without duplicates, which can occur when the two halves of
+ * a box crossing the antimeridian fall into the same coarse cell.
+ */
+static unsigned int
+dc_divestore_cells (const dc_divestore_box_t *box, unsigned long long cells[], unsigned int *shift)
+{
+	unsigned int level = 32;
+	while (level > 1) {
+		unsigned int s = 32 - level;
+		unsigned long long nlatitudes = (box->maxlatitude >> s) - (box->minlatitude >> s) + 1;
+		unsigned long long n = 0;
+		for (unsigned int i = 0; i < box->nlongitudes; ++i) {
+			n += nlatitudes * ((box->maxlongitude[i] >> s) - (box->minlongitude[i] >> s) + 1);
+		}
+		if (n <= MAXCELLS)
+			break;
+		level--;
+	}
+
+	unsigned int s = 32 - level;
+	unsigned int ncells = 0;
+	for (unsigned int i = 0; i < box->nlongitudes; ++i) {
+		for (unsigned int x = box->minlongitude[i] >> s; x <= box->maxlongitude[i] >> s; ++x) {
+			for (unsigned int y = box->minlatitude >> s; y <= box->maxlatitude >> s; ++y) {
+				unsigned long long cell = dc_divestore_geohash (x, y);
+				unsigned int j = ncells;
+				while (j > 0 && cells[j - 1] > cell) {
+					cells[j] = cells[j - 1];
+					j--;
+				}
+				if (j > 0 && cells[j - 1] == cell) {
+					memmove (cells + j, cells + j + 1, (ncells - j) * sizeof (cells[0]));
+					continue;
+				}
+				cells[j] = cell;
+				ncells++;
+			}
+		}
+	}
+
+	*shift = 64 - 2 * level;
+
+	return ncells;
+}
+
+static int
+dc_divestore_report (const dc_divestore_t *store, const dc_divestore_entry_t *entry, dc_divestore_query_callback_t callback, void *userdata)
+{
+	const unsigned char *fingerprint = NULL, *data = NULL;
+	unsigned int fsize = 0, size = 0;
+	dc_divestore_summary_t summary;
+	dc_divestore_decode (entry->payload, store->fixed, &fingerprint, &fsize, &data, &size, &summary);
+
+	return callback (
+		(dc_family_t) array_uint32_le (entry->payload + OFS_FAMILY),
+		array_uint32_le (entry->payload + OFS_MODEL),
+		array_uint32_le (entry->payload + OFS_SERIAL),
+		data, size, fingerprint, fsize, &summary, userdata);
+}
+
+dc_status_t
+dc_divestore_query (dc_divestore_t *store, const dc_divestore_query_t *query,
+	dc_divestore_query_callback_t callback, void *userdata)
+{
+	if (store == NULL || query == NULL || callback == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	// The candidates of the datetime index.
+	unsigned int tbegin = 0, tend = 0;
+	if (query->flags & DC_DIVESTORE_QUERY_DATETIME) {
+		if (query->begin > query->end)
+			return DC_STATUS_SUCCESS;
+		tbegin = dc_divestore_bound (store->bytime, store->nbytime, dc_divestore_ticks_key (query->begin), 0);
+		tend = dc_divestore_bound (store->bytime, store->nbytime, dc_divestore_ticks_key (query->end), 1);
+	}
+
+	// The candidates of the geohash index, one range per cell.
+	dc_divestore_box_t box = {0};
+	unsigned int gbegin[MAXCELLS], gend[MAXCELLS];
+	unsigned int ncells = 0, ngeohash = 0;
+	if (query->flags & DC_DIVESTORE_QUERY_LOCATION) {
+		if (query->southwest.latitude > query->northeast.latitude)
+			return DC_STATUS_INVALIDARGS;
+
+		box.minlatitude = dc_divestore_quantize (query->southwest.latitude, -90.0, 90.0);
+		box.maxlatitude = dc_divestore_quantize (query->northeast.latitude, -90.0, 90.0);
+		unsigned int west = dc_divestore_quantize (query->southwest.longitude, -180.0, 180.0);
+		unsigned int east = dc_divestore_quantize (query->northeast.longitude, -180.0, 180.0);
+		if (west <= east) {
+			box.minlongitude[0] = west;
+			box.maxlongitude[0] = east;
+			box.nlongitudes = 1;
+		} else {
+			box.minlongitude[0] = west;
+			box.maxlongitude[0] = 0xFFFFFFFE;
+			box.minlongitude[1] = 0;
+			box.maxlongitude[1] = east;
+			box.nlongitudes = 2;
+		}
+
+		unsigned long long cells[MAXCELLS];
+		unsigned int shift = 0;
+		ncells = dc_divestore_cells (&box, cells, &shift);
+		for (unsigned int i = 0; i < ncells; ++i) {
+			gbegin[i] = dc_divestore_bound (store->bygeohash, store->nbygeohash, cells[i] << shift, 0);
+			if (cells[i] == (0xFFFFFFFFFFFFFFFFULL >> shift))
+				gend[i] = store->nbygeohash;
+			else
+				gend[i] = dc_divestore_bound (store->bygeohash, store->nbygeohash, (cells[i] + 1) << shift, 0);
+			ngeohash += gend[i] - gbegin[i];
+		}
+	}
+
+	// Walk the smallest set of candidates, and check the remaining
+	// criteria on the indexed fields of the entries.
+	if ((query->flags & DC_DIVESTORE_QUERY_DATETIME) &&
+		(!(query->flags & DC_DIVESTORE_QUERY_LOCATION) || tend - tbegin <= ngeohash)) {
+		for (unsigned int i = tbegin; i < tend; ++i) {
+			const dc_divestore_entry_t *entry = store->entries + store->bytime[i].index;
+			if (dc_divestore_accept (entry, query, &box) &&
+				!dc_divestore_report (store, entry, callback, userdata))
+				break;
+		}
+	} else if (query->flags & DC_DIVESTORE_QUERY_DATETIME) {
+		// Collect the matches of the geohash index, and sort them on the
+		// date and time, to report them in chronological order.
+		if (ngeohash == 0)
+			return DC_STATUS_SUCCESS;
+
+		dc_divestore_key_t *matches = (dc_divestore_key_t *) dc_malloc (store->context, ngeohash * sizeof (dc_divestore_key_t));
+		if (matches == NULL) {
+			ERROR (store->context, "Failed to allocate memory.");
+			return DC_STATUS_NOMEMORY;
+		}
+
+		unsigned int nmatches = 0;
+		for (unsigned int c = 0; c < ncells; ++c) {
+			for (unsigned int i = gbegin[c]; i < gend[c]; ++i) {
+				unsigned int index = store->bygeohash[i].index;
+				if (dc_divestore_accept (store->entries + index, query, &box)) {
+					matches[nmatches].key = dc_divestore_ticks_key (store->entries[index].ticks);
+					matches[nmatches].index = index;
+					nmatches++;
+				}
+			}
+		}
+
+		qsort (matches, nmatches, sizeof (dc_divestore_key_t), dc_divestore_key_cmp);
+
+		for (unsigned int i = 0; i < nmatches; ++i) {
+			if (!dc_divestore_report (store, store->entries + matches[i].index, callback, userdata))
+				break;
+		}
+
+		dc_free (store->context, matches);
+	} else if (query->flags & DC_DIVESTORE_QUERY_LOCATION) {
+		for (unsigned int c = 0; c < ncells; ++c) {
+			for (unsigned int i = gbegin[c]; i < gend[c]; ++i) {
+				const dc_divestore_entry_t *entry = store->entries + store->bygeohash[i].index;
+				if (dc_divestore_accept (entry, query, &box) &&
+					!dc_divestore_report (store, entry, callback, userdata))
+					return DC_STATUS_SUCCESS;
+			}
+		}
+	} else {
+		for (unsigned int i = 0; i < store->count; i += RANGESIZE) {
+			if (!dc_divestore_overlap (store->ranges + i / RANGESIZE, query))
+				continue;
+
+			unsigned int n = store->count - i < RANGESIZE ? store->count - i : RANGESIZE;
+			for (unsigned int j = i; j < i + n; ++j) {
+				const dc_divestore_entry_t *entry = store->entries + j;
+				if (dc_divestore_accept (entry, query, &box) &&
+					!dc_divestore_report (store, entry, callback, userdata))
+					return DC_STATUS_SUCCESS;
+			}
+		}
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_divestore_close (dc_divestore_t *store)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (store == NULL)
+		return DC_STATUS_SUCCESS;
+
+	if (store->map) {
+#ifdef USE_MMAP
+		if (store->mapped)
+			munmap (store->map, store->mapsize);
+		else
+#endif
+			dc_free (store->context, store->map);
+	}
+
+	if (store->fd >= 0 && close (store->fd) != 0) {
+		SYSERROR (store->context, errno);
+		status = DC_STATUS_IO;
+	}
+
+	for (unsigned int i = 0; i < store->nblocks; ++i) {
+		dc_free (store->context, store->blocks[i]);
+	}
+
+	dc_free (store->context, store->blocks);
+	dc_free (store->context, store->entries);
+	dc_free (store->context, store->table);
+	dc_free (store->context, store->bytime);
+	dc_free (store->context, store->bygeohash);
+	dc_free (store->context, store->ranges);
+	dc_free (store->context, store);
+
+	return status;
+}
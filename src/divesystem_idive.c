@@ -85,6 +85,7 @@ typedef struct divesystem_idive_device_t {
 	dc_iostream_t *iostream;
 	unsigned char fingerprint[4];
 	unsigned int model;
+	unsigned int pipelining;
 } divesystem_idive_device_t;
 
 static dc_status_t divesystem_idive_device_set_fingerprint (dc_device_t *abstract, const unsigned char data[], unsigned int size);
@@ -147,6 +148,7 @@ divesystem_idive_device_open (dc_device_t **out, dc_context_t *context, dc_iostr
 	device->iostream = iostream;
 	memset (device->fingerprint, 0, sizeof (device->fingerprint));
 	device->model = model;
+	device->pipelining = 0;
 
 	// Set the serial communication protocol (115200 8N1).
 	status = dc_iostream_configure (device->iostream, 115200, 8, DC_PARITY_NONE, DC_STOPBITS_ONE, DC_FLOWCONTROL_NONE);
@@ -285,8 +287,22 @@ divesystem_idive_receive (divesystem_idive_device_t *device, unsigned char answe
 }
 
 
+dc_status_t
+divesystem_idive_device_set_pipelining (dc_device_t *abstract, unsigned int value)
+{
+	divesystem_idive_device_t *device = (divesystem_idive_device_t *) abstract;
+
+	if (!ISINSTANCE (abstract))
+		return DC_STATUS_INVALIDARGS;
+
+	device->pipelining = value;
+
+	return DC_STATUS_SUCCESS;
+}
+
+
 static dc_status_t
-divesystem_idive_packet (divesystem_idive_device_t *device, const unsigned char command[], unsigned int csize, unsigned char answer[], unsigned int asize, unsigned int *errorcode)
+divesystem_idive_response (divesystem_idive_device_t *device, const unsigned char command[], unsigned char answer[], unsigned int asize, unsigned int *errorcode)
 {
 	dc_status_t status = DC_STATUS_SUCCESS;
 	dc_device_t *abstract = (dc_device_t *) device;
@@ -294,12 +310,6 @@ divesystem_idive_packet (divesystem_idive_device_t *device, const unsigned char
 	unsigned int length = sizeof(packet);
 	unsigned int errcode = 0;
 
-	// Send the command.
-	status = divesystem_idive_send (device, command, csize);
-	if (status != DC_STATUS_SUCCESS) {
-		goto error;
-	}
-
 	// Receive the answer.
 	status = divesystem_idive_receive (device, packet, &length);
 	if (status != DC_STATUS_SUCCESS) {
@@ -350,6 +360,35 @@ error:
 }
 
 
+static dc_status_t
+divesystem_idive_packet (divesystem_idive_device_t *device, const unsigned char command[], unsigned int csize, unsigned char answer[], unsigned int asize, unsigned int *errorcode)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_device_t *abstract = (dc_device_t *) device;
+
+	dc_usecs_t start = device_latency_start (abstract);
+
+	// Send the command.
+	status = divesystem_idive_send (device, command, csize);
+	if (status != DC_STATUS_SUCCESS) {
+		if (errorcode) {
+			*errorcode = 0;
+		}
+		return status;
+	}
+
+	// Receive the answer.
+	status = divesystem_idive_response (device, command, answer, asize, errorcode);
+	if (status != DC_STATUS_SUCCESS) {
+		return status;
+	}
+
+	device_latency_emit (abstract, command[0], asize, start);
+
+	return DC_STATUS_SUCCESS;
+}
+
+
 static dc_status_t
 divesystem_idive_transfer (divesystem_idive_device_t *device, const unsigned char command[], unsigned int csize, unsigned char answer[], unsigned int asize, unsigned int *errorcode)
 {
@@ -382,6 +421,66 @@ divesystem_idive_transfer (divesystem_idive_device_t *device, const unsigned cha
 	return status;
 }
 
+
+/*
+ * Download one sample packet with the next request already in flight. The
+ * device queues the request, so the link stays busy while the current
+ * packet is being validated. After a failure, the response to the
+ * request ahead is discarded, and the packet is downloaded again with a
+ * normal transfer, including the retries.
+ */
+static dc_status_t
+divesystem_idive_pipelined (divesystem_idive_device_t *device, const unsigned char command[], const unsigned char next[], unsigned int csize, unsigned int *pending, unsigned char answer[], unsigned int asize, unsigned int *errorcode)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	unsigned int errcode = 0;
+	unsigned char discard[MAXPACKET - 2];
+
+	// Send the request, unless it's already in flight.
+	if (!*pending) {
+		status = divesystem_idive_send (device, command, csize);
+		if (status != DC_STATUS_SUCCESS)
+			goto done;
+	}
+
+	// Send the next request ahead of the response.
+	*pending = 0;
+	if (next) {
+		status = divesystem_idive_send (device, next, csize);
+		if (status != DC_STATUS_SUCCESS)
+			goto done;
+		*pending = 1;
+	}
+
+	status = divesystem_idive_response (device, command, answer, asize, &errcode);
+	if (status == DC_STATUS_SUCCESS)
+		goto done;
+
+	// Don't retry if the error can't be recovered.
+	if ((status != DC_STATUS_PROTOCOL && status != DC_STATUS_TIMEOUT) ||
+		(errcode && errcode != ERR_BUSY))
+		goto done;
+
+	// Drop the response to the next request. Both responses have the same
+	// command byte, so it would otherwise be mistaken for this one.
+	if (*pending) {
+		divesystem_idive_response (device, next, discard, asize, NULL);
+		*pending = 0;
+	}
+
+	dc_iostream_sleep (device->iostream, 100);
+	dc_iostream_purge (device->iostream, DC_DIRECTION_INPUT);
+
+	status = divesystem_idive_transfer (device, command, csize, answer, asize, &errcode);
+
+done:
+	if (errorcode) {
+		*errorcode = errcode;
+	}
+
+	return status;
+}
+
 static dc_status_t
 divesystem_idive_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, void *userdata)
 {
@@ -480,21 +579,35 @@ divesystem_idive_device_foreach (dc_device_t *abstract, dc_dive_callback_t callb
 		progress.current = i * NSTEPS + STEP(1, nsamples + 1);
 		device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
 
-		dc_buffer_clear(buffer);
-		dc_buffer_reserve(buffer, commands->header.size + commands->sample.size * nsamples);
-
-		if (!dc_buffer_append(buffer, packet, commands->header.size)) {
+		// Allocate the buffer for the header and all samples at once. The
+		// samples are copied straight into place.
+		unsigned int length = commands->header.size + commands->sample.size * nsamples;
+		if (!dc_buffer_clear(buffer) || !dc_buffer_resize(buffer, length)) {
 			ERROR (abstract->context, "Insufficient buffer space available.");
 			dc_buffer_free(buffer);
-			return rc;
+			return DC_STATUS_NOMEMORY;
 		}
 
+		unsigned char *data = dc_buffer_get_data(buffer);
+		unsigned int   size = commands->header.size;
+		memcpy (data, packet, commands->header.size);
+
+		unsigned int pending = 0;
 		for (unsigned int j = 0; j < nsamples; j += commands->nsamples) {
 			unsigned int idx = j + 1;
+			unsigned int nxt = idx + commands->nsamples;
 			unsigned char cmd_sample[] = {commands->sample.cmd,
 				(idx     ) & 0xFF,
 				(idx >> 8) & 0xFF};
-			rc = divesystem_idive_transfer (device, cmd_sample, sizeof(cmd_sample), packet, commands->sample.size * commands->nsamples, &errcode);
+			unsigned char cmd_next[] = {commands->sample.cmd,
+				(nxt     ) & 0xFF,
+				(nxt >> 8) & 0xFF};
+			if (device->pipelining) {
+				rc = divesystem_idive_pipelined (device, cmd_sample, j + commands->nsamples < nsamples ? cmd_next : NULL,
+					sizeof(cmd_sample), &pending, packet, commands->sample.size * commands->nsamples, &errcode);
+			} else {
+				rc = divesystem_idive_transfer (device, cmd_sample, sizeof(cmd_sample), packet, commands->sample.size * commands->nsamples, &errcode);
+			}
 			if (rc != DC_STATUS_SUCCESS) {
 				dc_buffer_free(buffer);
 				return rc;
@@ -512,15 +625,10 @@ divesystem_idive_device_foreach (dc_device_t *abstract, dc_dive_callback_t callb
 			progress.current = i * NSTEPS + STEP(j + n + 1, nsamples + 1);
 			device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
 
-			if (!dc_buffer_append(buffer, packet, commands->sample.size * n)) {
-				ERROR (abstract->context, "Insufficient buffer space available.");
-				dc_buffer_free(buffer);
-				return rc;
-			}
+			memcpy (data + size, packet, commands->sample.size * n);
+			size += commands->sample.size * n;
 		}
 
-		unsigned char *data = dc_buffer_get_data(buffer);
-		unsigned int   size = dc_buffer_get_size(buffer);
 		if (callback && !callback (data, size, data + 7, sizeof(device->fingerprint), userdata)) {
 			dc_buffer_free (buffer);
 			return DC_STATUS_SUCCESS;
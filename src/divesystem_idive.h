@@ -26,6 +26,7 @@
 #include <libdivecomputer/iostream.h>
 #include <libdivecomputer/device.h>
 #include <libdivecomputer/parser.h>
+#include <libdivecomputer/divesystem_idive.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -19,6 +19,8 @@
  * MA 02110-1301 USA
  */
 
+#define LOG_SUBSYSTEM DC_LOGSUBSYSTEM_PARSER
+
 #include <stdlib.h>
 
 #include "divesystem_idive.h"
@@ -49,12 +51,31 @@
 #define FREEDIVE 4
 #define INVALID  0xFFFFFFFF
 
+typedef struct divesystem_idive_sample_layout_t {
+	unsigned int samplesize;
+	unsigned int decotime;
+	unsigned int tts;
+	unsigned int tts_invalid;
+	unsigned int pressure;
+} divesystem_idive_sample_layout_t;
+
+typedef struct divesystem_idive_layout_t {
+	unsigned int headersize;
+	unsigned int firmware;
+	unsigned int atmospheric;
+	unsigned int apos4;
+	const divesystem_idive_sample_layout_t *samples;
+} divesystem_idive_layout_t;
+
 typedef struct divesystem_idive_parser_t divesystem_idive_parser_t;
 
 struct divesystem_idive_parser_t {
 	dc_parser_t base;
 	unsigned int model;
-	unsigned int headersize;
+	const divesystem_idive_layout_t *layout;
+	// Sample layout of the dive.
+	const divesystem_idive_sample_layout_t *sample;
+	unsigned int apos4;
 	// Cached fields.
 	unsigned int cached;
 	unsigned int divemode;
@@ -71,6 +92,7 @@ static dc_status_t divesystem_idive_parser_set_data (dc_parser_t *abstract, cons
 static dc_status_t divesystem_idive_parser_get_datetime (dc_parser_t *abstract, dc_datetime_t *datetime);
 static dc_status_t divesystem_idive_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, unsigned int flags, void *value);
 static dc_status_t divesystem_idive_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t callback, void *userdata);
+static dc_status_t divesystem_idive_parser_samples_batch (dc_parser_t *abstract, unsigned int offset, dc_sample_batch_t *batch);
 
 static const dc_parser_vtable_t divesystem_idive_parser_vtable = {
 	sizeof(divesystem_idive_parser_t),
@@ -79,7 +101,44 @@ static const dc_parser_vtable_t divesystem_idive_parser_vtable = {
 	divesystem_idive_parser_get_datetime, /* datetime */
 	divesystem_idive_parser_get_field, /* fields */
 	divesystem_idive_parser_samples_foreach, /* samples_foreach */
-	NULL /* destroy */
+	NULL, /* destroy */
+	divesystem_idive_parser_samples_batch, /* samples_batch */
+};
+
+// The older firmware stores the time to surface in place of the deco
+// time, and the APOS4 firmware adds the tank pressure. Dives recorded
+// with an older firmware, but downloaded with the APOS4 firmware, have
+// the larger samples with the old deco fields.
+static const divesystem_idive_sample_layout_t idive_samples = {
+	SZ_SAMPLE_IDIVE, 23, 23, 0xFFFF, 0
+};
+
+static const divesystem_idive_sample_layout_t ix3m_samples = {
+	SZ_SAMPLE_IX3M, 23, 23, 0xFFFF, 0
+};
+
+static const divesystem_idive_sample_layout_t ix3m_apos3_samples = {
+	SZ_SAMPLE_IX3M_APOS4, 23, 23, 0xFFFF, 49
+};
+
+static const divesystem_idive_sample_layout_t ix3m_apos4_samples = {
+	SZ_SAMPLE_IX3M_APOS4, 23, 25, 0x7FFF, 49
+};
+
+static const divesystem_idive_layout_t idive_layout = {
+	SZ_HEADER_IDIVE, /* headersize */
+	0x2E, /* firmware */
+	1000, /* atmospheric */
+	0, /* apos4 */
+	&idive_samples, /* samples */
+};
+
+static const divesystem_idive_layout_t ix3m_layout = {
+	SZ_HEADER_IX3M, /* headersize */
+	0x2A, /* firmware */
+	10000, /* atmospheric */
+	1, /* apos4 */
+	&ix3m_samples, /* samples */
 };
 
 
@@ -101,10 +160,12 @@ divesystem_idive_parser_create (dc_parser_t **out, dc_context_t *context, unsign
 	// Set the default values.
 	parser->model = model;
 	if (ISIX3M(model)) {
-		parser->headersize = SZ_HEADER_IX3M;
+		parser->layout = &ix3m_layout;
 	} else {
-		parser->headersize = SZ_HEADER_IDIVE;
+		parser->layout = &idive_layout;
 	}
+	parser->sample = parser->layout->samples;
+	parser->apos4 = 0;
 	parser->cached = 0;
 	parser->divemode = INVALID;
 	parser->divetime = 0;
@@ -127,6 +188,24 @@ static dc_status_t
 divesystem_idive_parser_set_data (dc_parser_t *abstract, const unsigned char *data, unsigned int size)
 {
 	divesystem_idive_parser_t *parser = (divesystem_idive_parser_t *) abstract;
+	const divesystem_idive_layout_t *layout = parser->layout;
+
+	// Resolve the sample layout of the dive.
+	parser->apos4 = 0;
+	parser->sample = layout->samples;
+	if (layout->apos4 && size >= layout->headersize) {
+		unsigned int firmware = array_uint32_le (data + layout->firmware);
+		unsigned int nsamples = array_uint16_le (data + 1);
+		if ((firmware / 10000000) >= 4) {
+			// Dive downloaded and recorded with the APOS4 firmware.
+			parser->apos4 = 1;
+			parser->sample = &ix3m_apos4_samples;
+		} else if (size == layout->headersize + nsamples * SZ_SAMPLE_IX3M_APOS4) {
+			// Dive downloaded with the APOS4 firmware, but recorded
+			// with an older firmware.
+			parser->sample = &ix3m_apos3_samples;
+		}
+	}
 
 	// Reset the cache.
 	parser->cached = 0;
@@ -195,23 +274,12 @@ divesystem_idive_parser_get_datetime (dc_parser_t *abstract, dc_datetime_t *date
 		 14,  0     /* UTC+14    */
 	};
 
-	if (abstract->size < parser->headersize)
+	if (abstract->size < parser->layout->headersize)
 		return DC_STATUS_DATAFORMAT;
 
 	dc_ticks_t ticks = array_uint32_le(abstract->data + 7) + EPOCH;
 
-	// Detect the APOS4 firmware.
-	unsigned int firmware = 0;
-	unsigned int apos4 = 0;
-	if (ISIX3M(parser->model)) {
-		firmware = array_uint32_le(abstract->data + 0x2A);
-		apos4 = (firmware / 10000000) >= 4;
-	} else {
-		firmware = array_uint32_le(abstract->data + 0x2E);
-		apos4 = 0;
-	}
-
-	if (apos4) {
+	if (parser->apos4) {
 		// For devices with timezone support, the UTC offset of the
 		// device is used. The UTC offset is stored as an index in the
 		// timezone table.
@@ -237,7 +305,7 @@ divesystem_idive_parser_get_datetime (dc_parser_t *abstract, dc_datetime_t *date
 	} else {
 		// For devices without timezone support, the current timezone of
 		// the host system is used.
-		if (!dc_datetime_localtime (datetime, ticks))
+		if (!dc_context_localtime (abstract->context, datetime, ticks))
 			return DC_STATUS_DATAFORMAT;
 	}
 
@@ -251,7 +319,7 @@ divesystem_idive_parser_get_field (dc_parser_t *abstract, dc_field_type_t type,
 	divesystem_idive_parser_t *parser = (divesystem_idive_parser_t *) abstract;
 	const unsigned char *data = abstract->data;
 
-	if (abstract->size < parser->headersize)
+	if (abstract->size < parser->layout->headersize)
 		return DC_STATUS_DATAFORMAT;
 
 	if (!parser->cached) {
@@ -294,11 +362,7 @@ divesystem_idive_parser_get_field (dc_parser_t *abstract, dc_field_type_t type,
 			tank->gasmix = DC_GASMIX_UNKNOWN;
 			break;
 		case DC_FIELD_ATMOSPHERIC:
-			if (ISIX3M(parser->model)) {
-				*((double *) value) = array_uint16_le (data + 11) / 10000.0;
-			} else {
-				*((double *) value) = array_uint16_le (data + 11) / 1000.0;
-			}
+			*((double *) value) = array_uint16_le (data + 11) / (double) parser->layout->atmospheric;
 			break;
 		case DC_FIELD_SALINITY:
 			water->type = data[34] == 0 ? DC_WATER_SALT : DC_WATER_FRESH;
@@ -356,36 +420,19 @@ divesystem_idive_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callba
 	unsigned int beginpressure = 0;
 	unsigned int endpressure = 0;
 
-	unsigned int firmware = 0;
-	unsigned int apos4 = 0;
-	unsigned int nsamples = array_uint16_le (data + 1);
-	unsigned int samplesize = SZ_SAMPLE_IDIVE;
-	if (ISIX3M(parser->model)) {
-		// Detect the APOS4 firmware.
-		firmware = array_uint32_le(data + 0x2A);
-		apos4 = (firmware / 10000000) >= 4;
-		if (apos4) {
-			// Dive downloaded and recorded with the APOS4 firmware.
-			samplesize = SZ_SAMPLE_IX3M_APOS4;
-		} else if (size == parser->headersize + nsamples * SZ_SAMPLE_IX3M_APOS4) {
-			// Dive downloaded with the APOS4 firmware, but recorded
-			// with an older firmware.
-			samplesize = SZ_SAMPLE_IX3M_APOS4;
-		} else {
-			// Dive downloaded and recorded with an older firmware.
-			samplesize = SZ_SAMPLE_IX3M;
-		}
-	} else {
-		firmware = array_uint32_le(data + 0x2E);
-	}
+	const divesystem_idive_sample_layout_t *layout = parser->sample;
+	const unsigned int samplesize = layout->samplesize;
+
+	if (size < parser->layout->headersize)
+		return DC_STATUS_DATAFORMAT;
 
-	unsigned int offset = parser->headersize;
+	unsigned int offset = parser->layout->headersize;
 	while (offset + samplesize <= size) {
 		dc_sample_value_t sample = {0};
 
 		// Time (seconds).
 		unsigned int timestamp = array_uint32_le (data + offset + 2);
-		if (timestamp <= time) {
+		if (timestamp <= time && !(abstract->flags & DC_PARSER_FLAG_TRUSTED)) {
 			ERROR (abstract->context, "Timestamp moved backwards.");
 			return DC_STATUS_DATAFORMAT;
 		}
@@ -454,26 +501,14 @@ divesystem_idive_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callba
 		}
 
 		// Deco stop / NDL.
-		unsigned int decostop = 0, decotime = 0, tts = 0;
-		if (apos4) {
-			decostop = array_uint16_le (data + offset + 21);
-			decotime = array_uint16_le (data + offset + 23);
-			tts      = array_uint16_le (data + offset + 25);
-			if (tts == 0x7FFF) {
-				tts = INVALID;
-			}
-		} else {
-			decostop = array_uint16_le (data + offset + 21);
-			tts      = array_uint16_le (data + offset + 23);
-			if (tts == 0xFFFF) {
-				tts = INVALID;
-			}
-		}
-		if (tts != INVALID) {
+		unsigned int decostop = array_uint16_le (data + offset + 21);
+		unsigned int decotime = array_uint16_le (data + offset + layout->decotime);
+		unsigned int tts      = array_uint16_le (data + offset + layout->tts);
+		if (tts != layout->tts_invalid) {
 			if (decostop) {
 				sample.deco.type = DC_DECO_DECOSTOP;
 				sample.deco.depth = decostop / 10.0;
-				sample.deco.time = apos4 ? decotime : tts;
+				sample.deco.time = decotime;
 			} else {
 				sample.deco.type = DC_DECO_NDL;
 				sample.deco.depth = 0.0;
@@ -488,8 +523,8 @@ divesystem_idive_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callba
 		if (callback) callback (DC_SAMPLE_CNS, sample, userdata);
 
 		// Tank Pressure
-		if (samplesize == SZ_SAMPLE_IX3M_APOS4) {
-			unsigned int pressure = data[offset + 49];
+		if (layout->pressure) {
+			unsigned int pressure = data[offset + layout->pressure];
 			if (beginpressure == 0 && pressure != 0) {
 				beginpressure = pressure;
 			}
@@ -519,3 +554,177 @@ divesystem_idive_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callba
 
 	return DC_STATUS_SUCCESS;
 }
+
+
+static dc_status_t
+divesystem_idive_parser_samples_batch (dc_parser_t *abstract, unsigned int offset, dc_sample_batch_t *batch)
+{
+	divesystem_idive_parser_t *parser = (divesystem_idive_parser_t *) abstract;
+	const divesystem_idive_sample_layout_t *layout = parser->sample;
+	const unsigned int samplesize = layout->samplesize;
+	unsigned int headersize = parser->layout->headersize;
+	unsigned int size = abstract->size;
+
+	if (size < headersize)
+		return DC_STATUS_DATAFORMAT;
+
+	// The timestamps are validated, and the gas mixes numbered in order
+	// of appearance, by a single pass over the entire profile.
+	if (!parser->cached) {
+		dc_status_t rc = divesystem_idive_parser_samples_foreach (abstract, NULL, NULL);
+		if (rc != DC_STATUS_SUCCESS)
+			return rc;
+	}
+
+	unsigned int nsamples = (size - headersize) / samplesize;
+	if (offset >= nsamples)
+		return DC_STATUS_SUCCESS;
+
+	unsigned int count = nsamples - offset;
+	if (count > batch->capacity)
+		count = batch->capacity;
+
+	for (unsigned int i = 0; i < count; ++i) {
+		sample_batch_clear (batch, i);
+	}
+
+	// The samples have a fixed size, so each column is decoded with a
+	// separate pass over the rows.
+	const unsigned char *data = abstract->data + headersize + offset * samplesize;
+
+	if (batch->time) {
+		for (unsigned int i = 0; i < count; ++i)
+			batch->time[i] = array_uint32_le (data + i * samplesize + 2);
+	}
+
+	if (batch->depth) {
+		for (unsigned int i = 0; i < count; ++i)
+			batch->depth[i] = array_uint16_le (data + i * samplesize + 6) / 10.0;
+	}
+
+	if (batch->depth_mm) {
+		for (unsigned int i = 0; i < count; ++i)
+			batch->depth_mm[i] = array_uint16_le (data + i * samplesize + 6) * 100;
+	}
+
+	if (batch->temperature) {
+		for (unsigned int i = 0; i < count; ++i)
+			batch->temperature[i] = (signed short) array_uint16_le (data + i * samplesize + 8) / 10.0;
+	}
+
+	if (batch->temperature_mk) {
+		for (unsigned int i = 0; i < count; ++i)
+			batch->temperature_mk[i] = (signed short) array_uint16_le (data + i * samplesize + 8) * 100 + 273150;
+	}
+
+	if (batch->cns) {
+		for (unsigned int i = 0; i < count; ++i)
+			batch->cns[i] = array_uint16_le (data + i * samplesize + 29) / 100.0;
+	}
+
+	if (batch->mask) {
+		for (unsigned int i = 0; i < count; ++i)
+			batch->mask[i] = (1u << DC_SAMPLE_TIME) | (1u << DC_SAMPLE_DEPTH) |
+				(1u << DC_SAMPLE_TEMPERATURE) | (1u << DC_SAMPLE_CNS);
+	}
+
+	// Setpoint
+	if (batch->setpoint || batch->setpoint_mbar || batch->mask) {
+		for (unsigned int i = 0; i < count; ++i) {
+			const unsigned char *sample = data + i * samplesize;
+			unsigned int mode = sample[18];
+			if (mode != SCR && mode != CCR)
+				continue;
+
+			unsigned int setpoint = array_uint16_le (sample + 19);
+			if (batch->setpoint)
+				batch->setpoint[i] = setpoint / 1000.0;
+			if (batch->setpoint_mbar)
+				batch->setpoint_mbar[i] = setpoint;
+			if (batch->mask)
+				batch->mask[i] |= (1u << DC_SAMPLE_SETPOINT);
+		}
+	}
+
+	// Gaschange.
+	if (batch->gasmix || batch->mask) {
+		unsigned int o2_previous = 0xFFFFFFFF;
+		unsigned int he_previous = 0xFFFFFFFF;
+		if (offset) {
+			const unsigned char *previous = data - samplesize;
+			o2_previous = previous[10];
+			he_previous = previous[11];
+		}
+
+		for (unsigned int i = 0; i < count; ++i) {
+			const unsigned char *sample = data + i * samplesize;
+			unsigned int o2 = sample[10];
+			unsigned int he = sample[11];
+			if (o2 == o2_previous && he == he_previous)
+				continue;
+
+			// Find the gasmix in the cached list.
+			unsigned int idx = 0;
+			while (idx < parser->ngasmixes) {
+				if (o2 == parser->oxygen[idx] && he == parser->helium[idx])
+					break;
+				idx++;
+			}
+
+			if (batch->gasmix)
+				batch->gasmix[i] = idx;
+			if (batch->mask)
+				batch->mask[i] |= (1u << DC_SAMPLE_GASMIX);
+			o2_previous = o2;
+			he_previous = he;
+		}
+	}
+
+	// Deco stop / NDL.
+	if (batch->deco_type || batch->deco_time || batch->deco_depth ||
+		batch->deco_depth_mm || batch->mask) {
+		for (unsigned int i = 0; i < count; ++i) {
+			const unsigned char *sample = data + i * samplesize;
+			unsigned int tts = array_uint16_le (sample + layout->tts);
+			if (tts == layout->tts_invalid)
+				continue;
+
+			unsigned int decostop = array_uint16_le (sample + 21);
+			if (batch->deco_type)
+				batch->deco_type[i] = decostop ? DC_DECO_DECOSTOP : DC_DECO_NDL;
+			if (batch->deco_time)
+				batch->deco_time[i] = decostop ? array_uint16_le (sample + layout->decotime) : tts;
+			if (batch->deco_depth)
+				batch->deco_depth[i] = decostop / 10.0;
+			if (batch->deco_depth_mm)
+				batch->deco_depth_mm[i] = decostop * 100;
+			if (batch->mask)
+				batch->mask[i] |= (1u << DC_SAMPLE_DECO);
+		}
+	}
+
+	// Tank Pressure
+	if (layout->pressure && parser->beginpressure &&
+		(batch->pressure || batch->pressure_mbar || batch->mask)) {
+		// The pressure is only reported from the first non-zero value
+		// onwards, which may be located before the first row.
+		unsigned int first = 0;
+		while (first < offset + count &&
+			abstract->data[headersize + first * samplesize + layout->pressure] == 0)
+			first++;
+
+		for (unsigned int i = first > offset ? first - offset : 0; i < count; ++i) {
+			unsigned int pressure = data[i * samplesize + layout->pressure];
+			if (batch->pressure)
+				batch->pressure[i] = pressure;
+			if (batch->pressure_mbar)
+				batch->pressure_mbar[i] = pressure * 1000;
+			if (batch->mask)
+				batch->mask[i] |= (1u << DC_SAMPLE_PRESSURE);
+		}
+	}
+
+	batch->count = count;
+
+	return DC_STATUS_SUCCESS;
+}
@@ -0,0 +1,203 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+
+#include <libdivecomputer/parser.h>
+
+#ifndef DISABLE_BACKEND_CRESSI
+#include "cressi_leonardo.h"
+#endif
+#ifndef DISABLE_BACKEND_DIVERITE
+#include "diverite_nitekq.h"
+#endif
+#ifndef DISABLE_BACKEND_HW
+#include "hw_ostc.h"
+#endif
+#ifndef DISABLE_BACKEND_REEFNET
+#include "reefnet_sensus.h"
+#include "reefnet_sensuspro.h"
+#endif
+#ifndef DISABLE_BACKEND_SHEARWATER
+#include "shearwater_predator.h"
+#endif
+#ifndef DISABLE_BACKEND_SUUNTO
+#include "suunto_solution.h"
+#endif
+#ifndef DISABLE_BACKEND_UWATEC
+#include "uwatec_aladin.h"
+#include "uwatec_memomouse.h"
+#include "uwatec_smart.h"
+#endif
+
+#include "context-private.h"
+
+#define C_ARRAY_SIZE(array) (sizeof (array) / sizeof *(array))
+
+typedef dc_status_t (*dc_extract_func_t) (dc_device_t *device, const unsigned char data[], unsigned int size, dc_dive_callback_t callback, void *userdata);
+
+/*
+ * The backends which can split a memory dump without a connection to
+ * the device.
+ */
+static const struct {
+	dc_family_t family;
+	dc_extract_func_t extract;
+} g_extractors[] = {
+#ifndef DISABLE_BACKEND_SUUNTO
+	{DC_FAMILY_SUUNTO_SOLUTION,     suunto_solution_extract_dives},
+#endif
+#ifndef DISABLE_BACKEND_UWATEC
+	{DC_FAMILY_UWATEC_ALADIN,       uwatec_aladin_extract_dives},
+	{DC_FAMILY_UWATEC_MEMOMOUSE,    uwatec_memomouse_extract_dives},
+	{DC_FAMILY_UWATEC_SMART,        uwatec_smart_extract_dives},
+#endif
+#ifndef DISABLE_BACKEND_REEFNET
+	{DC_FAMILY_REEFNET_SENSUS,      reefnet_sensus_extract_dives},
+	{DC_FAMILY_REEFNET_SENSUSPRO,   reefnet_sensuspro_extract_dives},
+#endif
+#ifndef DISABLE_BACKEND_HW
+	{DC_FAMILY_HW_OSTC,             hw_ostc_extract_dives},
+#endif
+#ifndef DISABLE_BACKEND_CRESSI
+	{DC_FAMILY_CRESSI_LEONARDO,     cressi_leonardo_extract_dives},
+#endif
+#ifndef DISABLE_BACKEND_SHEARWATER
+	{DC_FAMILY_SHEARWATER_PREDATOR, shearwater_predator_extract_dives},
+#endif
+#ifndef DISABLE_BACKEND_DIVERITE
+	{DC_FAMILY_DIVERITE_NITEKQ,     diverite_nitekq_extract_dives},
+#endif
+	// Keeps the table valid when all the above backends are disabled.
+	{DC_FAMILY_NULL,                NULL},
+};
+
+typedef struct extract_dive_t {
+	size_t offset;
+	unsigned int size;
+	unsigned int fsize;
+} extract_dive_t;
+
+/*
+ * Some backends pass the dives in a temporary buffer, so the dives are
+ * copied, with the fingerprint stored right after the dive data.
+ */
+typedef struct extract_list_t {
+	dc_buffer_t *data;
+	dc_buffer_t *dives;
+	unsigned int error;
+} extract_list_t;
+
+static int
+extract_dive_cb (const unsigned char *data, unsigned int size, const unsigned char *fingerprint, unsigned int fsize, void *userdata)
+{
+	extract_list_t *list = (extract_list_t *) userdata;
+
+	extract_dive_t dive;
+	dive.offset = dc_buffer_get_size (list->data);
+	dive.size = size;
+	dive.fsize = fsize;
+
+	if (!dc_buffer_append (list->data, data, size) ||
+		!dc_buffer_append (list->data, fingerprint, fsize) ||
+		!dc_buffer_append (list->dives, (const unsigned char *) &dive, sizeof (dive))) {
+		list->error = 1;
+		return 0;
+	}
+
+	return 1;
+}
+
+dc_status_t
+dc_parser_foreach_dive_in_dump (dc_context_t *context, dc_descriptor_t *descriptor, dc_buffer_t *dump, unsigned int nthreads, dc_parser_dive_callback_t callback, void *userdata)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_parser_batch_t *batch = NULL;
+
+	if (descriptor == NULL || dump == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	dc_extract_func_t extract = NULL;
+	dc_family_t family = dc_descriptor_get_type (descriptor);
+	for (size_t i = 0; i < C_ARRAY_SIZE (g_extractors); ++i) {
+		if (g_extractors[i].family == family) {
+			extract = g_extractors[i].extract;
+			break;
+		}
+	}
+	if (extract == NULL) {
+		ERROR (context, "Memory dumps are not supported for this backend.");
+		return DC_STATUS_UNSUPPORTED;
+	}
+
+	// Split the memory dump into dives.
+	extract_list_t list = {NULL, NULL, 0};
+	list.data = dc_buffer_new (dc_buffer_get_size (dump));
+	list.dives = dc_buffer_new (0);
+	if (list.data == NULL || list.dives == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		status = DC_STATUS_NOMEMORY;
+		goto cleanup;
+	}
+
+	status = extract (NULL, dc_buffer_get_data (dump), dc_buffer_get_size (dump), extract_dive_cb, &list);
+	if (status == DC_STATUS_SUCCESS && list.error) {
+		ERROR (context, "Failed to allocate memory.");
+		status = DC_STATUS_NOMEMORY;
+	}
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR (context, "Failed to extract the dives.");
+		goto cleanup;
+	}
+
+	const unsigned char *data = dc_buffer_get_data (list.data);
+	const extract_dive_t *dives = (const extract_dive_t *) dc_buffer_get_data (list.dives);
+	size_t ndives = dc_buffer_get_size (list.dives) / sizeof (extract_dive_t);
+	if (ndives == 0)
+		goto cleanup;
+
+	// There is no point in starting more threads than dives.
+	if (nthreads > ndives)
+		nthreads = ndives;
+
+	status = dc_parser_batch_new (&batch, context, descriptor, nthreads, DC_PARSER_BATCH_SAMPLES);
+	if (status != DC_STATUS_SUCCESS)
+		goto cleanup;
+
+	for (size_t i = 0; i < ndives; ++i) {
+		const unsigned char *dive = data + dives[i].offset;
+		status = dc_parser_batch_add (batch, dive, dives[i].size, dive + dives[i].size, dives[i].fsize);
+		if (status != DC_STATUS_SUCCESS)
+			goto cleanup;
+	}
+
+	status = dc_parser_batch_run (batch, callback, userdata);
+
+cleanup:
+	dc_parser_batch_free (batch);
+	dc_buffer_free (list.dives);
+	dc_buffer_free (list.data);
+	return status;
+}
@@ -0,0 +1,644 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stddef.h>
+
+#include "family.h"
+
+#ifndef DISABLE_BACKEND_SUUNTO
+#include "suunto_d9.h"
+#include "suunto_eon.h"
+#include "suunto_eonsteel.h"
+#include "suunto_solution.h"
+#include "suunto_vyper2.h"
+#include "suunto_vyper.h"
+#endif
+#ifndef DISABLE_BACKEND_REEFNET
+#include "reefnet_sensus.h"
+#include "reefnet_sensuspro.h"
+#include "reefnet_sensusultra.h"
+#endif
+#ifndef DISABLE_BACKEND_UWATEC
+#include "uwatec_aladin.h"
+#include "uwatec_memomouse.h"
+#include "uwatec_smart.h"
+#endif
+#ifndef DISABLE_BACKEND_OCEANIC
+#include "oceanic_atom2.h"
+#include "oceanic_veo250.h"
+#include "oceanic_vtpro.h"
+#endif
+#ifndef DISABLE_BACKEND_MARES
+#include "mares_darwin.h"
+#include "mares_iconhd.h"
+#include "mares_nemo.h"
+#include "mares_puck.h"
+#endif
+#ifndef DISABLE_BACKEND_HW
+#include "hw_frog.h"
+#include "hw_ostc.h"
+#include "hw_ostc3.h"
+#endif
+#ifndef DISABLE_BACKEND_CRESSI
+#include "cressi_edy.h"
+#include "cressi_leonardo.h"
+#include "cressi_goa.h"
+#endif
+#ifndef DISABLE_BACKEND_ZEAGLE
+#include "zeagle_n2ition3.h"
+#endif
+#ifndef DISABLE_BACKEND_ATOMICS
+#include "atomics_cobalt.h"
+#endif
+#ifndef DISABLE_BACKEND_SHEARWATER
+#include "shearwater_petrel.h"
+#include "shearwater_predator.h"
+#endif
+#ifndef DISABLE_BACKEND_DIVERITE
+#include "diverite_nitekq.h"
+#endif
+#ifndef DISABLE_BACKEND_CITIZEN
+#include "citizen_aqualand.h"
+#endif
+#ifndef DISABLE_BACKEND_DIVESYSTEM
+#include "divesystem_idive.h"
+#endif
+#ifndef DISABLE_BACKEND_COCHRAN
+#include "cochran_commander.h"
+#endif
+#ifndef DISABLE_BACKEND_TECDIVING
+#include "tecdiving_divecomputereu.h"
+#endif
+#ifndef DISABLE_BACKEND_GARMIN
+#include "garmin.h"
+#endif
+
+#define C_ARRAY_SIZE(array) (sizeof (array) / sizeof *(array))
+
+#define REACTPROWHITE 0x4354
+
+/*
+ * The backends don't share a common signature for their open and create
+ * functions. These thin wrappers map the common arguments onto the ones
+ * each backend needs.
+ */
+#ifndef DISABLE_BACKEND_SUUNTO
+static dc_status_t
+suunto_solution_open (dc_device_t **out, dc_context_t *context, dc_iostream_t *iostream, unsigned int model)
+{
+	return suunto_solution_device_open (out, context, iostream);
+}
+
+static dc_status_t
+suunto_solution_parser (dc_parser_t **out, dc_context_t *context, unsigned int model, unsigned int serial, unsigned int devtime, dc_ticks_t systime)
+{
+	return suunto_solution_parser_create (out, context);
+}
+
+static dc_status_t
+suunto_eon_open (dc_device_t **out, dc_context_t *context, dc_iostream_t *iostream, unsigned int model)
+{
+	return suunto_eon_device_open (out, context, iostream);
+}
+
+static dc_status_t
+suunto_eon_parser (dc_parser_t **out, dc_context_t *context, unsigned int model, unsigned int serial, unsigned int devtime, dc_ticks_t systime)
+{
+	return suunto_eon_parser_create (out, context, 0);
+}
+
+static dc_status_t
+suunto_vyper_open (dc_device_t **out, dc_context_t *context, dc_iostream_t *iostream, unsigned int model)
+{
+	return suunto_vyper_device_open (out, context, iostream);
+}
+
+static dc_status_t
+suunto_vyper_parser (dc_parser_t **out, dc_context_t *context, unsigned int model, unsigned int serial, unsigned int devtime, dc_ticks_t systime)
+{
+	if (model == 0x01)
+		return suunto_eon_parser_create (out, context, 1);
+
+	return suunto_vyper_parser_create (out, context);
+}
+
+static dc_status_t
+suunto_vyper2_open (dc_device_t **out, dc_context_t *context, dc_iostream_t *iostream, unsigned int model)
+{
+	return suunto_vyper2_device_open (out, context, iostream);
+}
+
+static dc_status_t
+suunto_vyper2_parser (dc_parser_t **out, dc_context_t *context, unsigned int model, unsigned int serial, unsigned int devtime, dc_ticks_t systime)
+{
+	return suunto_d9_parser_create (out, context, model, serial);
+}
+
+static dc_status_t
+suunto_d9_open (dc_device_t **out, dc_context_t *context, dc_iostream_t *iostream, unsigned int model)
+{
+	return suunto_d9_device_open (out, context, iostream, model);
+}
+
+static dc_status_t
+suunto_d9_parser (dc_parser_t **out, dc_context_t *context, unsigned int model, unsigned int serial, unsigned int devtime, dc_ticks_t systime)
+{
+	return suunto_d9_parser_create (out, context, model, serial);
+}
+
+static dc_status_t
+suunto_eonsteel_open (dc_device_t **out, dc_context_t *context, dc_iostream_t *iostream, unsigned int model)
+{
+	return suunto_eonsteel_device_open (out, context, iostream, model);
+}
+
+static dc_status_t
+suunto_eonsteel_parser (dc_parser_t **out, dc_context_t *context, unsigned int model, unsigned int serial, unsigned int devtime, dc_ticks_t systime)
+{
+	return suunto_eonsteel_parser_create (out, context, model);
+}
+#endif
+
+#ifndef DISABLE_BACKEND_UWATEC
+static dc_status_t
+uwatec_aladin_open (dc_device_t **out, dc_context_t *context, dc_iostream_t *iostream, unsigned int model)
+{
+	return uwatec_aladin_device_open (out, context, iostream);
+}
+
+static dc_status_t
+uwatec_aladin_parser (dc_parser_t **out, dc_context_t *context, unsigned int model, unsigned int serial, unsigned int devtime, dc_ticks_t systime)
+{
+	return uwatec_memomouse_parser_create (out, context, devtime, systime);
+}
+
+static dc_status_t
+uwatec_memomouse_open (dc_device_t **out, dc_context_t *context, dc_iostream_t *iostream, unsigned int model)
+{
+	return uwatec_memomouse_device_open (out, context, iostream);
+}
+
+static dc_status_t
+uwatec_memomouse_parser (dc_parser_t **out, dc_context_t *context, unsigned int model, unsigned int serial, unsigned int devtime, dc_ticks_t systime)
+{
+	return uwatec_memomouse_parser_create (out, context, devtime, systime);
+}
+
+static dc_status_t
+uwatec_smart_open (dc_device_t **out, dc_context_t *context, dc_iostream_t *iostream, unsigned int model)
+{
+	return uwatec_smart_device_open (out, context, iostream);
+}
+
+static dc_status_t
+uwatec_smart_parser (dc_parser_t **out, dc_context_t *context, unsigned int model, unsigned int serial, unsigned int devtime, dc_ticks_t systime)
+{
+	return uwatec_smart_parser_create (out, context, model, devtime, systime);
+}
+#endif
+
+#ifndef DISABLE_BACKEND_REEFNET
+static dc_status_t
+reefnet_sensus_open (dc_device_t **out, dc_context_t *context, dc_iostream_t *iostream, unsigned int model)
+{
+	return reefnet_sensus_device_open (out, context, iostream);
+}
+
+static dc_status_t
+reefnet_sensus_parser (dc_parser_t **out, dc_context_t *context, unsigned int model, unsigned int serial, unsigned int devtime, dc_ticks_t systime)
+{
+	return reefnet_sensus_parser_create (out, context, devtime, systime);
+}
+
+static dc_status_t
+reefnet_sensuspro_open (dc_device_t **out, dc_context_t *context, dc_iostream_t *iostream, unsigned int model)
+{
+	return reefnet_sensuspro_device_open (out, context, iostream);
+}
+
+static dc_status_t
+reefnet_sensuspro_parser (dc_parser_t **out, dc_context_t *context, unsigned int model, unsigned int serial, unsigned int devtime, dc_ticks_t systime)
+{
+	return reefnet_sensuspro_parser_create (out, context, devtime, systime);
+}
+
+static dc_status_t
+reefnet_sensusultra_open (dc_device_t **out, dc_context_t *context, dc_iostream_t *iostream, unsigned int model)
+{
+	return reefnet_sensusultra_device_open (out, context, iostream);
+}
+
+static dc_status_t
+reefnet_sensusultra_parser (dc_parser_t **out, dc_context_t *context, unsigned int model, unsigned int serial, unsigned int devtime, dc_ticks_t systime)
+{
+	return reefnet_sensusultra_parser_create (out, context, devtime, systime);
+}
+#endif
+
+#ifndef DISABLE_BACKEND_OCEANIC
+static dc_status_t
+oceanic_vtpro_open (dc_device_t **out, dc_context_t *context, dc_iostream_t *iostream, unsigned int model)
+{
+	return oceanic_vtpro_device_open (out, context, iostream, model);
+}
+
+static dc_status_t
+oceanic_vtpro_parser (dc_parser_t **out, dc_context_t *context, unsigned int model, unsigned int serial, unsigned int devtime, dc_ticks_t systime)
+{
+	return oceanic_vtpro_parser_create (out, context, model);
+}
+
+static dc_status_t
+oceanic_veo250_open (dc_device_t **out, dc_context_t *context, dc_iostream_t *iostream, unsigned int model)
+{
+	return oceanic_veo250_device_open (out, context, iostream);
+}
+
+static dc_status_t
+oceanic_veo250_parser (dc_parser_t **out, dc_context_t *context, unsigned int model, unsigned int serial, unsigned int devtime, dc_ticks_t systime)
+{
+	return oceanic_veo250_parser_create (out, context, model);
+}
+
+static dc_status_t
+oceanic_atom2_open (dc_device_t **out, dc_context_t *context, dc_iostream_t *iostream, unsigned int model)
+{
+	return oceanic_atom2_device_open (out, context, iostream, model);
+}
+
+static dc_status_t
+oceanic_atom2_parser (dc_parser_t **out, dc_context_t *context, unsigned int model, unsigned int serial, unsigned int devtime, dc_ticks_t systime)
+{
+	if (model == REACTPROWHITE)
+		return oceanic_veo250_parser_create (out, context, model);
+
+	return oceanic_atom2_parser_create (out, context, model, serial);
+}
+#endif
+
+#ifndef DISABLE_BACKEND_MARES
+static dc_status_t
+mares_nemo_open (dc_device_t **out, dc_context_t *context, dc_iostream_t *iostream, unsigned int model)
+{
+	return mares_nemo_device_open (out, context, iostream);
+}
+
+static dc_status_t
+mares_nemo_parser (dc_parser_t **out, dc_context_t *context, unsigned int model, unsigned int serial, unsigned int devtime, dc_ticks_t systime)
+{
+	return mares_nemo_parser_create (out, context, model);
+}
+
+static dc_status_t
+mares_puck_open (dc_device_t **out, dc_context_t *context, dc_iostream_t *iostream, unsigned int model)
+{
+	return mares_puck_device_open (out, context, iostream);
+}
+
+static dc_status_t
+mares_puck_parser (dc_parser_t **out, dc_context_t *context, unsigned int model, unsigned int serial, unsigned int devtime, dc_ticks_t systime)
+{
+	return mares_nemo_parser_create (out, context, model);
+}
+
+static dc_status_t
+mares_darwin_open (dc_device_t **out, dc_context_t *context, dc_iostream_t *iostream, unsigned int model)
+{
+	return mares_darwin_device_open (out, context, iostream, model);
+}
+
+static dc_status_t
+mares_darwin_parser (dc_parser_t **out, dc_context_t *context, unsigned int model, unsigned int serial, unsigned int devtime, dc_ticks_t systime)
+{
+	return mares_darwin_parser_create (out, context, model);
+}
+
+static dc_status_t
+mares_iconhd_open (dc_device_t **out, dc_context_t *context, dc_iostream_t *iostream, unsigned int model)
+{
+	return mares_iconhd_device_open (out, context, iostream);
+}
+
+static dc_status_t
+mares_iconhd_parser (dc_parser_t **out, dc_context_t *context, unsigned int model, unsigned int serial, unsigned int devtime, dc_ticks_t systime)
+{
+	return mares_iconhd_parser_create (out, context, model);
+}
+#endif
+
+#ifndef DISABLE_BACKEND_HW
+static dc_status_t
+hw_ostc_open (dc_device_t **out, dc_context_t *context, dc_iostream_t *iostream, unsigned int model)
+{
+	return hw_ostc_device_open (out, context, iostream);
+}
+
+static dc_status_t
+hw_ostc_parser (dc_parser_t **out, dc_context_t *context, unsigned int model, unsigned int serial, unsigned int devtime, dc_ticks_t systime)
+{
+	return hw_ostc_parser_create (out, context, serial, 0);
+}
+
+static dc_status_t
+hw_frog_open (dc_device_t **out, dc_context_t *context, dc_iostream_t *iostream, unsigned int model)
+{
+	return hw_frog_device_open (out, context, iostream);
+}
+
+static dc_status_t
+hw_frog_parser (dc_parser_t **out, dc_context_t *context, unsigned int model, unsigned int serial, unsigned int devtime, dc_ticks_t systime)
+{
+	return hw_ostc3_parser_create (out, context, serial, model);
+}
+
+static dc_status_t
+hw_ostc3_open (dc_device_t **out, dc_context_t *context, dc_iostream_t *iostream, unsigned int model)
+{
+	return hw_ostc3_device_open (out, context, iostream);
+}
+
+static dc_status_t
+hw_ostc3_parser (dc_parser_t **out, dc_context_t *context, unsigned int model, unsigned int serial, unsigned int devtime, dc_ticks_t systime)
+{
+	return hw_ostc3_parser_create (out, context, serial, model);
+}
+#endif
+
+#ifndef DISABLE_BACKEND_CRESSI
+static dc_status_t
+cressi_edy_open (dc_device_t **out, dc_context_t *context, dc_iostream_t *iostream, unsigned int model)
+{
+	return cressi_edy_device_open (out, context, iostream);
+}
+
+static dc_status_t
+cressi_edy_parser (dc_parser_t **out, dc_context_t *context, unsigned int model, unsigned int serial, unsigned int devtime, dc_ticks_t systime)
+{
+	return cressi_edy_parser_create (out, context, model);
+}
+
+static dc_status_t
+cressi_leonardo_open (dc_device_t **out, dc_context_t *context, dc_iostream_t *iostream, unsigned int model)
+{
+	return cressi_leonardo_device_open (out, context, iostream);
+}
+
+static dc_status_t
+cressi_leonardo_parser (dc_parser_t **out, dc_context_t *context, unsigned int model, unsigned int serial, unsigned int devtime, dc_ticks_t systime)
+{
+	return cressi_leonardo_parser_create (out, context, model);
+}
+
+static dc_status_t
+cressi_goa_open (dc_device_t **out, dc_context_t *context, dc_iostream_t *iostream, unsigned int model)
+{
+	return cressi_goa_device_open (out, context, iostream);
+}
+
+static dc_status_t
+cressi_goa_parser (dc_parser_t **out, dc_context_t *context, unsigned int model, unsigned int serial, unsigned int devtime, dc_ticks_t systime)
+{
+	return cressi_goa_parser_create (out, context, model);
+}
+#endif
+
+#ifndef DISABLE_BACKEND_ZEAGLE
+static dc_status_t
+zeagle_n2ition3_open (dc_device_t **out, dc_context_t *context, dc_iostream_t *iostream, unsigned int model)
+{
+	return zeagle_n2ition3_device_open (out, context, iostream);
+}
+
+static dc_status_t
+zeagle_n2ition3_parser (dc_parser_t **out, dc_context_t *context, unsigned int model, unsigned int serial, unsigned int devtime, dc_ticks_t systime)
+{
+	return cressi_edy_parser_create (out, context, model);
+}
+#endif
+
+#ifndef DISABLE_BACKEND_ATOMICS
+static dc_status_t
+atomics_cobalt_open (dc_device_t **out, dc_context_t *context, dc_iostream_t *iostream, unsigned int model)
+{
+	return atomics_cobalt_device_open (out, context);
+}
+
+static dc_status_t
+atomics_cobalt_parser (dc_parser_t **out, dc_context_t *context, unsigned int model, unsigned int serial, unsigned int devtime, dc_ticks_t systime)
+{
+	return atomics_cobalt_parser_create (out, context);
+}
+#endif
+
+#ifndef DISABLE_BACKEND_SHEARWATER
+static dc_status_t
+shearwater_predator_open (dc_device_t **out, dc_context_t *context, dc_iostream_t *iostream, unsigned int model)
+{
+	return shearwater_predator_device_open (out, context, iostream);
+}
+
+static dc_status_t
+shearwater_predator_parser (dc_parser_t **out, dc_context_t *context, unsigned int model, unsigned int serial, unsigned int devtime, dc_ticks_t systime)
+{
+	return shearwater_predator_parser_create (out, context, model, serial);
+}
+
+static dc_status_t
+shearwater_petrel_open (dc_device_t **out, dc_context_t *context, dc_iostream_t *iostream, unsigned int model)
+{
+	return shearwater_petrel_device_open (out, context, iostream);
+}
+
+static dc_status_t
+shearwater_petrel_parser (dc_parser_t **out, dc_context_t *context, unsigned int model, unsigned int serial, unsigned int devtime, dc_ticks_t systime)
+{
+	return shearwater_petrel_parser_create (out, context, model, serial);
+}
+#endif
+
+#ifndef DISABLE_BACKEND_DIVERITE
+static dc_status_t
+diverite_nitekq_open (dc_device_t **out, dc_context_t *context, dc_iostream_t *iostream, unsigned int model)
+{
+	return diverite_nitekq_device_open (out, context, iostream);
+}
+
+static dc_status_t
+diverite_nitekq_parser (dc_parser_t **out, dc_context_t *context, unsigned int model, unsigned int serial, unsigned int devtime, dc_ticks_t systime)
+{
+	return diverite_nitekq_parser_create (out, context);
+}
+#endif
+
+#ifndef DISABLE_BACKEND_CITIZEN
+static dc_status_t
+citizen_aqualand_open (dc_device_t **out, dc_context_t *context, dc_iostream_t *iostream, unsigned int model)
+{
+	return citizen_aqualand_device_open (out, context, iostream);
+}
+
+static dc_status_t
+citizen_aqualand_parser (dc_parser_t **out, dc_context_t *context, unsigned int model, unsigned int serial, unsigned int devtime, dc_ticks_t systime)
+{
+	return citizen_aqualand_parser_create (out, context);
+}
+#endif
+
+#ifndef DISABLE_BACKEND_DIVESYSTEM
+static dc_status_t
+divesystem_idive_open (dc_device_t **out, dc_context_t *context, dc_iostream_t *iostream, unsigned int model)
+{
+	return divesystem_idive_device_open (out, context, iostream, model);
+}
+
+static dc_status_t
+divesystem_idive_parser (dc_parser_t **out, dc_context_t *context, unsigned int model, unsigned int serial, unsigned int devtime, dc_ticks_t systime)
+{
+	return divesystem_idive_parser_create (out, context, model);
+}
+#endif
+
+#ifndef DISABLE_BACKEND_COCHRAN
+static dc_status_t
+cochran_commander_open (dc_device_t **out, dc_context_t *context, dc_iostream_t *iostream, unsigned int model)
+{
+	return cochran_commander_device_open (out, context, iostream);
+}
+
+static dc_status_t
+cochran_commander_parser (dc_parser_t **out, dc_context_t *context, unsigned int model, unsigned int serial, unsigned int devtime, dc_ticks_t systime)
+{
+	return cochran_commander_parser_create (out, context, model);
+}
+#endif
+
+#ifndef DISABLE_BACKEND_TECDIVING
+static dc_status_t
+tecdiving_divecomputereu_open (dc_device_t **out, dc_context_t *context, dc_iostream_t *iostream, unsigned int model)
+{
+	return tecdiving_divecomputereu_device_open (out, context, iostream);
+}
+
+static dc_status_t
+tecdiving_divecomputereu_parser (dc_parser_t **out, dc_context_t *context, unsigned int model, unsigned int serial, unsigned int devtime, dc_ticks_t systime)
+{
+	return tecdiving_divecomputereu_parser_create (out, context);
+}
+#endif
+
+#ifndef DISABLE_BACKEND_GARMIN
+static dc_status_t
+garmin_open (dc_device_t **out, dc_context_t *context, dc_iostream_t *iostream, unsigned int model)
+{
+	return garmin_device_open (out, context, iostream);
+}
+
+static dc_status_t
+garmin_parser (dc_parser_t **out, dc_context_t *context, unsigned int model, unsigned int serial, unsigned int devtime, dc_ticks_t systime)
+{
+	return garmin_parser_create (out, context);
+}
+#endif
+
+static const dc_family_entry_t g_families[] = {
+#ifndef DISABLE_BACKEND_SUUNTO
+	{DC_FAMILY_SUUNTO_SOLUTION, suunto_solution_open, suunto_solution_parser, DC_CAPABILITY_DUMP},
+	{DC_FAMILY_SUUNTO_EON, suunto_eon_open, suunto_eon_parser, DC_CAPABILITY_DUMP},
+	{DC_FAMILY_SUUNTO_VYPER, suunto_vyper_open, suunto_vyper_parser, DC_CAPABILITY_READ | DC_CAPABILITY_WRITE | DC_CAPABILITY_DUMP},
+	{DC_FAMILY_SUUNTO_VYPER2, suunto_vyper2_open, suunto_vyper2_parser, DC_CAPABILITY_READ | DC_CAPABILITY_WRITE | DC_CAPABILITY_DUMP},
+	{DC_FAMILY_SUUNTO_D9, suunto_d9_open, suunto_d9_parser, DC_CAPABILITY_READ | DC_CAPABILITY_WRITE | DC_CAPABILITY_DUMP},
+	{DC_FAMILY_SUUNTO_EONSTEEL, suunto_eonsteel_open, suunto_eonsteel_parser, DC_CAPABILITY_TIMESYNC},
+#endif
+#ifndef DISABLE_BACKEND_UWATEC
+	{DC_FAMILY_UWATEC_ALADIN, uwatec_aladin_open, uwatec_aladin_parser, DC_CAPABILITY_DUMP},
+	{DC_FAMILY_UWATEC_MEMOMOUSE, uwatec_memomouse_open, uwatec_memomouse_parser, DC_CAPABILITY_DUMP},
+	{DC_FAMILY_UWATEC_SMART, uwatec_smart_open, uwatec_smart_parser, DC_CAPABILITY_DUMP | DC_CAPABILITY_STREAMING},
+#endif
+#ifndef DISABLE_BACKEND_REEFNET
+	{DC_FAMILY_REEFNET_SENSUS, reefnet_sensus_open, reefnet_sensus_parser, DC_CAPABILITY_DUMP},
+	{DC_FAMILY_REEFNET_SENSUSPRO, reefnet_sensuspro_open, reefnet_sensuspro_parser, DC_CAPABILITY_DUMP},
+	{DC_FAMILY_REEFNET_SENSUSULTRA, reefnet_sensusultra_open, reefnet_sensusultra_parser, DC_CAPABILITY_DUMP},
+#endif
+#ifndef DISABLE_BACKEND_OCEANIC
+	{DC_FAMILY_OCEANIC_VTPRO, oceanic_vtpro_open, oceanic_vtpro_parser, DC_CAPABILITY_READ | DC_CAPABILITY_DUMP},
+	{DC_FAMILY_OCEANIC_VEO250, oceanic_veo250_open, oceanic_veo250_parser, DC_CAPABILITY_READ | DC_CAPABILITY_DUMP},
+	{DC_FAMILY_OCEANIC_ATOM2, oceanic_atom2_open, oceanic_atom2_parser, DC_CAPABILITY_READ | DC_CAPABILITY_WRITE | DC_CAPABILITY_DUMP},
+#endif
+#ifndef DISABLE_BACKEND_MARES
+	{DC_FAMILY_MARES_NEMO, mares_nemo_open, mares_nemo_parser, DC_CAPABILITY_DUMP},
+	{DC_FAMILY_MARES_PUCK, mares_puck_open, mares_puck_parser, DC_CAPABILITY_READ | DC_CAPABILITY_DUMP},
+	{DC_FAMILY_MARES_DARWIN, mares_darwin_open, mares_darwin_parser, DC_CAPABILITY_READ | DC_CAPABILITY_DUMP},
+	{DC_FAMILY_MARES_ICONHD, mares_iconhd_open, mares_iconhd_parser, DC_CAPABILITY_READ | DC_CAPABILITY_DUMP | DC_CAPABILITY_PIPELINING},
+#endif
+#ifndef DISABLE_BACKEND_HW
+	{DC_FAMILY_HW_OSTC, hw_ostc_open, hw_ostc_parser, DC_CAPABILITY_DUMP | DC_CAPABILITY_TIMESYNC},
+	{DC_FAMILY_HW_FROG, hw_frog_open, hw_frog_parser, DC_CAPABILITY_TIMESYNC},
+	{DC_FAMILY_HW_OSTC3, hw_ostc3_open, hw_ostc3_parser, DC_CAPABILITY_READ | DC_CAPABILITY_WRITE | DC_CAPABILITY_DUMP | DC_CAPABILITY_TIMESYNC},
+#endif
+#ifndef DISABLE_BACKEND_CRESSI
+	{DC_FAMILY_CRESSI_EDY, cressi_edy_open, cressi_edy_parser, DC_CAPABILITY_READ | DC_CAPABILITY_DUMP},
+	{DC_FAMILY_CRESSI_LEONARDO, cressi_leonardo_open, cressi_leonardo_parser, DC_CAPABILITY_READ | DC_CAPABILITY_DUMP},
+	{DC_FAMILY_CRESSI_GOA, cressi_goa_open, cressi_goa_parser, 0},
+#endif
+#ifndef DISABLE_BACKEND_ZEAGLE
+	{DC_FAMILY_ZEAGLE_N2ITION3, zeagle_n2ition3_open, zeagle_n2ition3_parser, DC_CAPABILITY_READ | DC_CAPABILITY_DUMP},
+#endif
+#ifndef DISABLE_BACKEND_ATOMICS
+	{DC_FAMILY_ATOMICS_COBALT, atomics_cobalt_open, atomics_cobalt_parser, 0},
+#endif
+#ifndef DISABLE_BACKEND_SHEARWATER
+	{DC_FAMILY_SHEARWATER_PREDATOR, shearwater_predator_open, shearwater_predator_parser, DC_CAPABILITY_DUMP},
+	{DC_FAMILY_SHEARWATER_PETREL, shearwater_petrel_open, shearwater_petrel_parser, 0},
+#endif
+#ifndef DISABLE_BACKEND_DIVERITE
+	{DC_FAMILY_DIVERITE_NITEKQ, diverite_nitekq_open, diverite_nitekq_parser, DC_CAPABILITY_DUMP},
+#endif
+#ifndef DISABLE_BACKEND_CITIZEN
+	{DC_FAMILY_CITIZEN_AQUALAND, citizen_aqualand_open, citizen_aqualand_parser, DC_CAPABILITY_DUMP},
+#endif
+#ifndef DISABLE_BACKEND_DIVESYSTEM
+	{DC_FAMILY_DIVESYSTEM_IDIVE, divesystem_idive_open, divesystem_idive_parser, DC_CAPABILITY_TIMESYNC | DC_CAPABILITY_PIPELINING},
+#endif
+#ifndef DISABLE_BACKEND_COCHRAN
+	{DC_FAMILY_COCHRAN_COMMANDER, cochran_commander_open, cochran_commander_parser, DC_CAPABILITY_READ | DC_CAPABILITY_DUMP},
+#endif
+#ifndef DISABLE_BACKEND_TECDIVING
+	{DC_FAMILY_TECDIVING_DIVECOMPUTEREU, tecdiving_divecomputereu_open, tecdiving_divecomputereu_parser, 0},
+#endif
+#ifndef DISABLE_BACKEND_GARMIN
+	{DC_FAMILY_GARMIN, garmin_open, garmin_parser, DC_CAPABILITY_THREADS},
+#endif
+};
+
+const dc_family_entry_t *
+dc_family_lookup (dc_family_t family)
+{
+	for (size_t i = 0; i < C_ARRAY_SIZE (g_families); ++i) {
+		if (g_families[i].type == family)
+			return g_families + i;
+	}
+
+	return NULL;
+}
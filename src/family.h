@@ -0,0 +1,62 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_FAMILY_H
+#define DC_FAMILY_H
+
+#include <libdivecomputer/common.h>
+#include <libdivecomputer/context.h>
+#include <libdivecomputer/iostream.h>
+#include <libdivecomputer/device.h>
+#include <libdivecomputer/parser.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+typedef dc_status_t (*dc_family_open_t) (dc_device_t **out, dc_context_t *context, dc_iostream_t *iostream, unsigned int model);
+
+typedef dc_status_t (*dc_family_parser_t) (dc_parser_t **out, dc_context_t *context, unsigned int model, unsigned int serial, unsigned int devtime, dc_ticks_t systime);
+
+/*
+ * The registry of all backends. Each family has an entry with the
+ * functions to open a device and create a parser, with the common set
+ * of arguments, and the capabilities (a bitmask of dc_capability_t) of
+ * the backend.
+ */
+typedef struct dc_family_entry_t {
+	dc_family_t type;
+	dc_family_open_t device_open;
+	dc_family_parser_t parser_create;
+	unsigned int capabilities;
+} dc_family_entry_t;
+
+/*
+ * Look up the registry entry of a family. Returns NULL for an unknown
+ * family.
+ */
+const dc_family_entry_t *
+dc_family_lookup (dc_family_t family);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_FAMILY_H */
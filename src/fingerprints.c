@@ -0,0 +1,279 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <libdivecomputer/fingerprints.h>
+#include <libdivecomputer/buffer.h>
+
+#include "context-private.h"
+
+// Number of bits set in the Bloom filter for each fingerprint.
+#define NPROBES 4
+
+// Number of Bloom filter bits for each slot of the hash table. With the
+// table at most half full, this is at least 16 bits per fingerprint,
+// for a false positive rate below 0.3%.
+#define BITS_PER_SLOT 8
+
+typedef struct dc_fingerprints_entry_t {
+	unsigned int used;
+	unsigned int size;
+	unsigned long long hash;
+	size_t offset;
+} dc_fingerprints_entry_t;
+
+struct dc_fingerprints_t {
+	dc_context_t *context;
+	// The fingerprints, stored one after the other.
+	dc_buffer_t *data;
+	// Open addressing hash table.
+	dc_fingerprints_entry_t *table;
+	unsigned int tablesize;
+	unsigned int count;
+	// Bloom filter, with BITS_PER_SLOT bits for each slot of the table.
+	unsigned int *bloom;
+};
+
+static unsigned long long
+dc_fingerprints_hash (const unsigned char data[], unsigned int size)
+{
+	// FNV-1a
+	unsigned long long hash = 14695981039346656037ull;
+	for (unsigned int i = 0; i < size; ++i) {
+		hash = (hash ^ data[i]) * 1099511628211ull;
+	}
+
+	return hash;
+}
+
+/*
+ * The probes of the Bloom filter are derived from the two halves of the
+ * hash (double hashing).
+ */
+static void
+dc_fingerprints_bloom_add (unsigned int bloom[], unsigned int nbits, unsigned long long hash)
+{
+	unsigned int h1 = hash & 0xFFFFFFFF;
+	unsigned int h2 = (hash >> 32) | 1;
+
+	for (unsigned int i = 0; i < NPROBES; ++i) {
+		unsigned int bit = (h1 + i * h2) & (nbits - 1);
+		bloom[bit / 32] |= 1u << (bit % 32);
+	}
+}
+
+static int
+dc_fingerprints_bloom_test (const unsigned int bloom[], unsigned int nbits, unsigned long long hash)
+{
+	unsigned int h1 = hash & 0xFFFFFFFF;
+	unsigned int h2 = (hash >> 32) | 1;
+
+	for (unsigned int i = 0; i < NPROBES; ++i) {
+		unsigned int bit = (h1 + i * h2) & (nbits - 1);
+		if ((bloom[bit / 32] & (1u << (bit % 32))) == 0)
+			return 0;
+	}
+
+	return 1;
+}
+
+static dc_status_t
+dc_fingerprints_resize (dc_fingerprints_t *fingerprints, unsigned int tablesize)
+{
+	unsigned int nbits = tablesize * BITS_PER_SLOT;
+
+	dc_fingerprints_entry_t *table = (dc_fingerprints_entry_t *) dc_malloc (fingerprints->context, tablesize * sizeof (dc_fingerprints_entry_t));
+	unsigned int *bloom = (unsigned int *) dc_malloc (fingerprints->context, nbits / 8);
+	if (table == NULL || bloom == NULL) {
+		ERROR (fingerprints->context, "Failed to allocate memory.");
+		dc_free (fingerprints->context, table);
+		dc_free (fingerprints->context, bloom);
+		return DC_STATUS_NOMEMORY;
+	}
+
+	memset (table, 0, tablesize * sizeof (dc_fingerprints_entry_t));
+	memset (bloom, 0, nbits / 8);
+
+	for (unsigned int i = 0; i < fingerprints->tablesize; ++i) {
+		const dc_fingerprints_entry_t *entry = fingerprints->table + i;
+		if (!entry->used)
+			continue;
+
+		unsigned int slot = entry->hash & (tablesize - 1);
+		while (table[slot].used)
+			slot = (slot + 1) & (tablesize - 1);
+		table[slot] = *entry;
+
+		dc_fingerprints_bloom_add (bloom, nbits, entry->hash);
+	}
+
+	dc_free (fingerprints->context, fingerprints->table);
+	dc_free (fingerprints->context, fingerprints->bloom);
+	fingerprints->table = table;
+	fingerprints->bloom = bloom;
+	fingerprints->tablesize = tablesize;
+
+	return DC_STATUS_SUCCESS;
+}
+
+/*
+ * Find the slot of the fingerprint, or the empty slot where it should be
+ * inserted.
+ */
+static unsigned int
+dc_fingerprints_find (dc_fingerprints_t *fingerprints, const unsigned char data[], unsigned int size, unsigned long long hash)
+{
+	const unsigned char *base = dc_buffer_get_data (fingerprints->data);
+
+	unsigned int slot = hash & (fingerprints->tablesize - 1);
+	while (fingerprints->table[slot].used) {
+		const dc_fingerprints_entry_t *entry = fingerprints->table + slot;
+		if (entry->hash == hash && entry->size == size &&
+			memcmp (base + entry->offset, data, size) == 0)
+			break;
+		slot = (slot + 1) & (fingerprints->tablesize - 1);
+	}
+
+	return slot;
+}
+
+dc_status_t
+dc_fingerprints_new (dc_fingerprints_t **out, dc_context_t *context)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_fingerprints_t *fingerprints = NULL;
+
+	if (out == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	fingerprints = (dc_fingerprints_t *) dc_malloc (context, sizeof (dc_fingerprints_t));
+	if (fingerprints == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	memset (fingerprints, 0, sizeof (dc_fingerprints_t));
+	fingerprints->context = context;
+
+	fingerprints->data = dc_buffer_new (0);
+	if (fingerprints->data == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		status = DC_STATUS_NOMEMORY;
+		goto error_free;
+	}
+
+	status = dc_fingerprints_resize (fingerprints, 64);
+	if (status != DC_STATUS_SUCCESS)
+		goto error_free;
+
+	*out = fingerprints;
+
+	return DC_STATUS_SUCCESS;
+
+error_free:
+	dc_fingerprints_free (fingerprints);
+	return status;
+}
+
+dc_status_t
+dc_fingerprints_add (dc_fingerprints_t *fingerprints, const unsigned char data[], unsigned int size)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (fingerprints == NULL || data == NULL || size == 0)
+		return DC_STATUS_INVALIDARGS;
+
+	unsigned long long hash = dc_fingerprints_hash (data, size);
+
+	if (dc_fingerprints_bloom_test (fingerprints->bloom, fingerprints->tablesize * BITS_PER_SLOT, hash) &&
+		fingerprints->table[dc_fingerprints_find (fingerprints, data, size, hash)].used)
+		return DC_STATUS_SUCCESS;
+
+	// Keep the load factor of the hash table below one half.
+	if (2 * (fingerprints->count + 1) > fingerprints->tablesize) {
+		status = dc_fingerprints_resize (fingerprints, fingerprints->tablesize * 2);
+		if (status != DC_STATUS_SUCCESS)
+			return status;
+	}
+
+	size_t offset = dc_buffer_get_size (fingerprints->data);
+	if (!dc_buffer_append (fingerprints->data, data, size)) {
+		ERROR (fingerprints->context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	unsigned int slot = dc_fingerprints_find (fingerprints, data, size, hash);
+	dc_fingerprints_entry_t *entry = fingerprints->table + slot;
+	entry->used = 1;
+	entry->size = size;
+	entry->hash = hash;
+	entry->offset = offset;
+	fingerprints->count++;
+
+	dc_fingerprints_bloom_add (fingerprints->bloom, fingerprints->tablesize * BITS_PER_SLOT, hash);
+
+	return DC_STATUS_SUCCESS;
+}
+
+int
+dc_fingerprints_contains (dc_fingerprints_t *fingerprints, const unsigned char data[], unsigned int size)
+{
+	if (fingerprints == NULL || data == NULL || size == 0)
+		return 0;
+
+	unsigned long long hash = dc_fingerprints_hash (data, size);
+
+	if (!dc_fingerprints_bloom_test (fingerprints->bloom, fingerprints->tablesize * BITS_PER_SLOT, hash))
+		return 0;
+
+	unsigned int slot = dc_fingerprints_find (fingerprints, data, size, hash);
+
+	return fingerprints->table[slot].used;
+}
+
+unsigned int
+dc_fingerprints_get_count (dc_fingerprints_t *fingerprints)
+{
+	if (fingerprints == NULL)
+		return 0;
+
+	return fingerprints->count;
+}
+
+dc_status_t
+dc_fingerprints_free (dc_fingerprints_t *fingerprints)
+{
+	if (fingerprints == NULL)
+		return DC_STATUS_SUCCESS;
+
+	dc_buffer_free (fingerprints->data);
+	dc_free (fingerprints->context, fingerprints->table);
+	dc_free (fingerprints->context, fingerprints->bloom);
+	dc_free (fingerprints->context, fingerprints);
+
+	return DC_STATUS_SUCCESS;
+}
@@ -19,26 +19,37 @@
  * MA 02110-1301 USA
  */
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <dirent.h>
-#include <sys/types.h>
-#include <dirent.h>
-#include <sys/types.h>
-#include <sys/stat.h>
-#include <fcntl.h>
-#include <unistd.h>
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#define USE_THREADS
+#endif
+
+#include <libdivecomputer/garmin.h>
 
 #include "garmin.h"
 #include "context-private.h"
 #include "device-private.h"
+#include "usb_storage-private.h"
 #include "array.h"
 
+#define ISINSTANCE(device) dc_device_isinstance((device), &garmin_device_vtable)
+
+#define GARMIN_MAX_THREADS 8
+#define GARMIN_DEFAULT_THREADS 4
+
 typedef struct garmin_device_t {
 	dc_device_t base;
 	dc_iostream_t *iostream;
 	unsigned char fingerprint[FIT_NAME_SIZE];
+	char *indexname;
+	unsigned int nthreads;
 } garmin_device_t;
 
 static dc_status_t garmin_device_set_fingerprint (dc_device_t *abstract, const unsigned char data[], unsigned int size);
@@ -76,6 +87,8 @@ garmin_device_open (dc_device_t **out, dc_context_t *context, dc_iostream_t *ios
 	// Set the default values.
 	device->iostream = iostream;
 	memset(device->fingerprint, 0, sizeof(device->fingerprint));
+	device->indexname = NULL;
+	device->nthreads = GARMIN_DEFAULT_THREADS;
 
 	*out = (dc_device_t *) device;
 
@@ -99,17 +112,206 @@ garmin_device_set_fingerprint (dc_device_t *abstract, const unsigned char data[]
 }
 
 
+dc_status_t
+garmin_device_set_index (dc_device_t *abstract, const char *filename)
+{
+	garmin_device_t *device = (garmin_device_t *)abstract;
+	char *indexname = NULL;
+
+	if (!ISINSTANCE (abstract))
+		return DC_STATUS_INVALIDARGS;
+
+	if (filename) {
+		indexname = strdup(filename);
+		if (indexname == NULL) {
+			ERROR (abstract->context, "Failed to allocate memory.");
+			return DC_STATUS_NOMEMORY;
+		}
+	}
+
+	free(device->indexname);
+	device->indexname = indexname;
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+dc_status_t
+garmin_device_set_threads (dc_device_t *abstract, unsigned int nthreads)
+{
+	garmin_device_t *device = (garmin_device_t *)abstract;
+
+	if (!ISINSTANCE (abstract))
+		return DC_STATUS_INVALIDARGS;
+
+	if (nthreads > GARMIN_MAX_THREADS)
+		nthreads = GARMIN_MAX_THREADS;
+
+	device->nthreads = nthreads;
+
+	return DC_STATUS_SUCCESS;
+}
+
+
 static dc_status_t
 garmin_device_close (dc_device_t *abstract)
 {
-	dc_status_t status = DC_STATUS_SUCCESS;
 	garmin_device_t *device = (garmin_device_t *) abstract;
 
+	free(device->indexname);
+
 	return DC_STATUS_SUCCESS;
 }
 
-struct file_list {
+/*
+ * The index remembers whether a FIT file is a dive, keyed by the file
+ * name, size and modification time, such that the files that are not
+ * dives only need a stat on the next download, instead of being read
+ * and parsed again.
+ *
+ * It's stored as a plain text file, with one "name size mtime is_dive"
+ * line per file. Lines from older index files, without the mtime, are
+ * still accepted, but never match until the file is parsed again.
+ */
+struct index_entry {
+	char name[FIT_NAME_SIZE];
+	unsigned long size;
+	long long mtime;
+	int is_dive;
+};
+
+struct file_index {
 	int nr, allocated;
+	int nsorted, modified;
+	struct index_entry *array;
+};
+
+static int index_cmp(const void *a, const void *b)
+{
+	return strcmp(((const struct index_entry *) a)->name, ((const struct index_entry *) b)->name);
+}
+
+static struct index_entry *index_lookup(struct file_index *index, const char *name)
+{
+	struct index_entry key;
+
+	// Only the entries loaded from the index file are sorted. The new
+	// entries are appended, and never need to be looked up again.
+	if (!index->nsorted)
+		return NULL;
+
+	memcpy(key.name, name, FIT_NAME_SIZE);
+	return bsearch(&key, index->array, index->nsorted, sizeof(struct index_entry), index_cmp);
+}
+
+static int index_add(struct file_index *index, const char *name, unsigned long size, long long mtime, int is_dive)
+{
+	struct index_entry *entry;
+
+	if (index->nr == index->allocated) {
+		int n = 3*(index->allocated + 8)/2;
+		struct index_entry *array = realloc(index->array, n * sizeof(array[0]));
+		if (!array)
+			return 0;
+
+		index->array = array;
+		index->allocated = n;
+	}
+
+	entry = index->array + index->nr++;
+	memset(entry->name, 0, FIT_NAME_SIZE);
+	strncpy(entry->name, name, FIT_NAME_SIZE - 1);
+	entry->size = size;
+	entry->mtime = mtime;
+	entry->is_dive = is_dive;
+
+	return 1;
+}
+
+static void index_load(dc_context_t *context, const char *filename, struct file_index *index)
+{
+	char line[128];
+	char name[FIT_NAME_SIZE];
+	unsigned long size;
+	long long mtime;
+	int is_dive;
+	FILE *fp;
+
+	fp = fopen(filename, "r");
+	if (!fp)
+		return;
+
+	while (fgets(line, sizeof(line), fp)) {
+		int n = sscanf(line, "%23s %lu %lld %d", name, &size, &mtime, &is_dive);
+		if (n == 3) {
+			is_dive = (int) mtime;
+			mtime = -1;
+		} else if (n != 4) {
+			break;
+		}
+		if (!index_add(index, name, size, mtime, is_dive))
+			break;
+	}
+	fclose(fp);
+
+	qsort(index->array, index->nr, sizeof(struct index_entry), index_cmp);
+	index->nsorted = index->nr;
+	DEBUG (context, "Loaded %d entries from the index %s.", index->nr, filename);
+}
+
+static void index_save(dc_context_t *context, const char *filename, struct file_index *index)
+{
+	FILE *fp;
+
+	if (!index->modified)
+		return;
+
+	fp = fopen(filename, "w");
+	if (!fp) {
+		WARNING (context, "Failed to write the index %s.", filename);
+		return;
+	}
+
+	for (int i = 0; i < index->nr; i++) {
+		const struct index_entry *entry = index->array + i;
+		fprintf(fp, "%s %lu %lld %d\n", entry->name, entry->size, entry->mtime, entry->is_dive);
+	}
+	fclose(fp);
+}
+
+/*
+ * Look up (or remember) whether a file is a dive. Returns -1 if the
+ * file is not in the index.
+ */
+static int index_get(struct file_index *index, const char *name, unsigned long size, long long mtime)
+{
+	struct index_entry *entry = index_lookup(index, name);
+
+	if (!entry || entry->size != size || entry->mtime != mtime)
+		return -1;
+
+	return entry->is_dive;
+}
+
+static void index_set(struct file_index *index, const char *name, unsigned long size, long long mtime, int is_dive)
+{
+	struct index_entry *entry = index_lookup(index, name);
+
+	if (entry) {
+		if (entry->size == size && entry->mtime == mtime && entry->is_dive == is_dive)
+			return;
+		entry->size = size;
+		entry->mtime = mtime;
+		entry->is_dive = is_dive;
+	} else if (!index_add(index, name, size, mtime, is_dive)) {
+		return;
+	}
+
+	index->modified = 1;
+}
+
+struct file_list {
+	int nr, allocated, nomem;
 	struct fit_name *array;
 };
 
@@ -119,128 +321,237 @@ static int name_cmp(const void *a, const void *b)
 	return strcmp(b,a);
 }
 
+// The actual dives are under the "Garmin/Activity/" directory
+// as FIT files, with names like "2018-08-20-10-23-30.fit".
+#define ACTIVITY "Garmin/Activity"
+
+static int add_file(const char *name, void *userdata)
+{
+	struct file_list *files = (struct file_list *) userdata;
+	int len = strlen(name);
+	struct fit_name *entry;
+
+	if (len < 5)
+		return 1;
+	if (len >= FIT_NAME_SIZE)
+		return 1;
+	if (strncasecmp(name + len - 4, ".FIT", 4))
+		return 1;
+
+	if (files->nr == files->allocated) {
+		struct fit_name *array;
+		int n = 3*(files->allocated + 8)/2;
+		size_t new_size;
+
+		new_size = n * sizeof(array[0]);
+		array = realloc(files->array, new_size);
+		if (!array) {
+			files->nomem = 1;
+			return 0;
+		}
+
+		files->array = array;
+		files->allocated = n;
+	}
+
+	/*
+	 * NOTE! The name is zero-padded to the full size, because
+	 * the whole name is used as the fingerprint.
+	 */
+	entry = files->array + files->nr++;
+	memset(entry->name, 0, FIT_NAME_SIZE);
+	memcpy(entry->name, name, len);
+	return 1;
+}
+
 /*
  * Get the FIT file list and sort it.
  *
  * Return number of files found.
 */
-static int get_file_list(DIR *dir, struct file_list *files)
+static int get_file_list(dc_usb_storage_fs_t *fs, struct file_list *files)
 {
-	struct dirent *de;
+	dc_status_t rc;
 
-	while ((de = readdir(dir)) != NULL) {
-		int len = strlen(de->d_name);
-		struct fit_name *entry;
+	rc = dc_usb_storage_fs_list(fs, ACTIVITY, add_file, files);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+	if (files->nomem)
+		return DC_STATUS_NOMEMORY;
 
-		if (len < 5)
-			continue;
-		if (len >= FIT_NAME_SIZE)
-			continue;
-		if (strncasecmp(de->d_name + len - 4, ".FIT", 4))
-			continue;
+	qsort(files->array, files->nr, sizeof(struct fit_name), name_cmp);
+	return DC_STATUS_SUCCESS;
+}
 
-		if (files->nr == files->allocated) {
-			struct fit_name *array;
-			int n = 3*(files->allocated + 8)/2;
-			size_t new_size;
+static const char *
+file_path(char *pathname, const char *name)
+{
+	memcpy(pathname, ACTIVITY "/", strlen(ACTIVITY "/"));
+	memcpy(pathname + strlen(ACTIVITY "/"), name, FIT_NAME_SIZE);
+	return pathname;
+}
 
-			new_size = n * sizeof(array[0]);
-			array = realloc(files->array, new_size);
-			if (!array)
-				return DC_STATUS_NOMEMORY;
+static int
+file_stat(dc_usb_storage_fs_t *fs, const char *name, unsigned long *size, long long *mtime)
+{
+	char pathname[sizeof(ACTIVITY "/") + FIT_NAME_SIZE];
+	unsigned long long filesize = 0;
 
-			files->array = array;
-			files->allocated = n;
-		}
+	if (dc_usb_storage_fs_stat(fs, file_path(pathname, name), &filesize, mtime) != DC_STATUS_SUCCESS)
+		return 0;
 
-		/*
-		 * NOTE! This depends on the zero-padding that strncpy does.
-		 *
-		 * strncpy() doesn't just limit the size of the copy, it
-		 * will zero-pad the end of the result buffer.
-		 */
-		entry = files->array + files->nr++;
-		strncpy(entry->name, de->d_name, FIT_NAME_SIZE);
-	}
+	*size = filesize;
+	return 1;
+}
 
-	qsort(files->array, files->nr, sizeof(struct fit_name), name_cmp);
-	return DC_STATUS_SUCCESS;
+static dc_status_t
+read_file(dc_usb_storage_fs_t *fs, const char *name, dc_buffer_t *file)
+{
+	char pathname[sizeof(ACTIVITY "/") + FIT_NAME_SIZE];
+
+	return dc_usb_storage_fs_read(fs, file_path(pathname, name), file);
 }
 
-#ifndef O_BINARY
-#define O_BINARY 0
-#endif
+/*
+ * The result of reading and classifying a single FIT file.
+ */
+struct fit_job {
+	dc_buffer_t *buffer;
+	dc_status_t status;
+	dc_event_devinfo_t devinfo;
+	unsigned long size;
+	long long mtime;
+	int is_dive;
+	int parsed;
+	int ready;
+};
 
-static dc_status_t
-read_file(char *pathname, int pathlen, const char *name, dc_buffer_t *file)
+static void
+process_file(dc_usb_storage_fs_t *fs, const char *name, dc_parser_t *parser, const struct file_index *index, int want_devinfo, struct fit_job *job)
 {
-	int fd, rc;
+	unsigned long filesize = 0;
+	long long mtime = -1;
+	int is_dive = -1;
+	int known;
+
+	job->status = DC_STATUS_SUCCESS;
+	job->parsed = 0;
+
+	// Check the index for files we have classified before. The
+	// first file is always parsed, because we need the devinfo.
+	known = file_stat(fs, name, &filesize, &mtime);
+	if (known && index->nsorted && !want_devinfo) {
+		is_dive = index_get((struct file_index *) index, name, filesize, mtime);
+		if (is_dive == 0) {
+			job->is_dive = 0;
+			return;
+		}
+	}
 
-	pathname[pathlen] = '/';
-	memcpy(pathname+pathlen+1, name, FIT_NAME_SIZE);
-	fd = open(pathname, O_RDONLY | O_BINARY);
+	// Reset the membuffer, read the data
+	dc_buffer_clear(job->buffer);
+	dc_buffer_append(job->buffer, (const unsigned char *) name, FIT_NAME_SIZE);
 
-	if (fd < 0)
-		return DC_STATUS_IO;
+	job->status = read_file(fs, name, job->buffer);
+	if (job->status != DC_STATUS_SUCCESS)
+		return;
 
-	rc = DC_STATUS_SUCCESS;
-	for (;;) {
-		char buffer[4096];
-		int n;
+	if (is_dive < 0) {
+		const unsigned char *data = dc_buffer_get_data(job->buffer);
+		unsigned int size = dc_buffer_get_size(job->buffer);
 
-		n = read(fd, buffer, sizeof(buffer));
-		if (!n)
+		is_dive = garmin_parser_is_dive(parser, data, size, want_devinfo ? &job->devinfo : NULL);
+		job->size = size - FIT_NAME_SIZE;
+		job->mtime = known && job->size == filesize ? mtime : -1;
+		job->parsed = 1;
+	}
+
+	job->is_dive = is_dive;
+}
+
+#ifdef USE_THREADS
+/*
+ * The files are read and classified by a pool of worker threads, while
+ * the dives are delivered to the callback by the calling thread, in the
+ * original order. The workers never get more than the number of job
+ * slots ahead of the calling thread, which bounds the memory usage.
+ */
+struct worker_pool {
+	dc_usb_storage_fs_t *fs;
+	const struct file_list *files;
+	const struct file_index *index;
+	struct fit_job *jobs;
+	unsigned int njobs;
+	int next, consumed, abort;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+};
+
+struct worker {
+	pthread_t thread;
+	struct worker_pool *pool;
+	dc_parser_t *parser;
+	int started;
+};
+
+static void *
+worker_run(void *arg)
+{
+	struct worker *worker = (struct worker *) arg;
+	struct worker_pool *pool = worker->pool;
+
+	for (;;) {
+		int i;
+
+		pthread_mutex_lock(&pool->lock);
+		while (!pool->abort && pool->next < pool->files->nr &&
+			pool->next >= pool->consumed + (int) pool->njobs)
+			pthread_cond_wait(&pool->cond, &pool->lock);
+		if (pool->abort || pool->next >= pool->files->nr) {
+			pthread_mutex_unlock(&pool->lock);
 			break;
-		if (n > 0) {
-			dc_buffer_append(file, buffer, n);
-			continue;
 		}
-		rc = DC_STATUS_IO;
-		break;
+		i = pool->next++;
+		pthread_mutex_unlock(&pool->lock);
+
+		struct fit_job *job = pool->jobs + i % pool->njobs;
+		process_file(pool->fs, pool->files->array[i].name,
+			worker->parser, pool->index, i == 0, job);
+
+		pthread_mutex_lock(&pool->lock);
+		job->ready = 1;
+		pthread_cond_broadcast(&pool->cond);
+		pthread_mutex_unlock(&pool->lock);
 	}
 
-	close(fd);
-	return rc;
+	return NULL;
 }
+#endif
 
 static dc_status_t
 garmin_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, void *userdata)
 {
 	dc_status_t status = DC_STATUS_SUCCESS;
 	garmin_device_t *device = (garmin_device_t *) abstract;
-	dc_parser_t *parser;
-	char pathname[PATH_MAX];
-	size_t pathlen;
-	struct file_list files = { 0, 0, NULL };
-	dc_buffer_t *file;
-	DIR *dir;
+	dc_parser_t *parser = NULL;
+	dc_usb_storage_fs_t *fs = NULL;
+	struct file_list files = { 0, 0, 0, NULL };
+	struct file_index index = { 0, 0, 0, 0, NULL };
+	struct fit_job jobs[2 * GARMIN_MAX_THREADS] = {{0}};
+	unsigned int njobs = 1;
+	unsigned int nthreads = 0;
 	int rc;
 
-	// Read the directory name from the iostream
-	rc = dc_iostream_read(device->iostream, &pathname, sizeof(pathname), &pathlen);
+	// Access the files of the device
+	rc = dc_usb_storage_fs_open(&fs, abstract->context, device->iostream);
 	if (rc != DC_STATUS_SUCCESS)
 		return rc;
 
-	// The actual dives are under the "Garmin/Activity/" directory
-	// as FIT files, with names like "2018-08-20-10-23-30.fit".
-	// Make sure our buffer is big enough.
-	if (pathlen + strlen("/Garmin/Activity/") + FIT_NAME_SIZE + 2 > PATH_MAX)
-		return DC_STATUS_IO;
-
-	if (pathlen && pathname[pathlen-1] != '/')
-		pathname[pathlen++] = '/';
-	strcpy(pathname + pathlen, "Garmin/Activity");
-	pathlen += strlen("Garmin/Activity");
-
-	dir = opendir(pathname);
-	if (!dir)
-		return DC_STATUS_IO;
-
 	// Get the list of FIT files
-	rc = get_file_list(dir, &files);
-	closedir(dir);
+	rc = get_file_list(fs, &files);
 	if (rc != DC_STATUS_SUCCESS || !files.nr) {
 		free(files.array);
+		dc_usb_storage_fs_close(fs);
 		return rc;
 	}
 
@@ -256,68 +567,181 @@ garmin_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, void
 		break;
 	}
 
+	// Drop the files of the dives which are already known.
+	if (abstract->fingerprints) {
+		int nr = 0;
+		for (int i = 0; i < files.nr; i++) {
+			const char *name = files.array[i].name;
+
+			if (device_is_known(abstract, (const unsigned char *) name, FIT_NAME_SIZE))
+				continue;
+
+			files.array[nr++] = files.array[i];
+		}
+		files.nr = nr;
+	}
+
 	// Enable progress notifications.
 	dc_event_progress_t progress = EVENT_PROGRESS_INITIALIZER;
 	progress.maximum = files.nr;
 	progress.current = 0;
 	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
 
-	file = dc_buffer_new (16384);
-	if (file == NULL) {
-		ERROR (abstract->context, "Insufficient buffer space available.");
-		free(files.array);
-		return DC_STATUS_NOMEMORY;
+	if (device->indexname)
+		index_load(abstract->context, device->indexname, &index);
+
+#ifdef USE_THREADS
+	struct worker workers[GARMIN_MAX_THREADS] = {{0}};
+	struct worker_pool pool;
+
+	// There is no point in starting more threads than files.
+	nthreads = device->nthreads;
+	if (nthreads > (unsigned int) files.nr)
+		nthreads = files.nr;
+	if (nthreads > 1)
+		njobs = 2 * nthreads;
+	else
+		nthreads = 0;
+#endif
+
+	for (unsigned int i = 0; i < njobs; i++) {
+		jobs[i].buffer = dc_buffer_new (16384);
+		if (jobs[i].buffer == NULL) {
+			ERROR (abstract->context, "Insufficient buffer space available.");
+			status = DC_STATUS_NOMEMORY;
+			goto cleanup;
+		}
 	}
+
 	if ((rc = garmin_parser_create(&parser, abstract->context) != DC_STATUS_SUCCESS)) {
 		ERROR (abstract->context, "Failed to create parser for dive verification.");
-		free(files.array);
-		return rc;
+		status = rc;
+		goto cleanup;
 	}
 
-	dc_event_devinfo_t devinfo;
-	dc_event_devinfo_t *devinfo_p = &devinfo;
-	for (int i = 0; i < files.nr; i++) {
+#ifdef USE_THREADS
+	if (nthreads) {
+		pool.fs = fs;
+		pool.files = &files;
+		pool.index = &index;
+		pool.jobs = jobs;
+		pool.njobs = njobs;
+		pool.next = 0;
+		pool.consumed = 0;
+		pool.abort = 0;
+		pthread_mutex_init(&pool.lock, NULL);
+		pthread_cond_init(&pool.cond, NULL);
+
+		// Every worker needs its own parser. The first one re-uses the
+		// parser of the calling thread, which is otherwise unused.
+		for (unsigned int i = 0; i < nthreads; i++) {
+			workers[i].pool = &pool;
+			if (i == 0) {
+				workers[i].parser = parser;
+			} else if (garmin_parser_create(&workers[i].parser, abstract->context) != DC_STATUS_SUCCESS) {
+				workers[i].parser = NULL;
+				break;
+			}
+			if (pthread_create(&workers[i].thread, NULL, worker_run, workers + i) != 0)
+				break;
+			workers[i].started = 1;
+		}
+
+		if (!workers[0].started) {
+			// Fall back to reading the files in the calling thread.
+			pthread_cond_destroy(&pool.cond);
+			pthread_mutex_destroy(&pool.lock);
+			nthreads = 0;
+		}
+	}
+#endif
+
+	int i;
+	for (i = 0; i < files.nr; i++) {
 		const char *name = files.array[i].name;
-		const unsigned char *data;
-		unsigned int size;
-		short is_dive = 0;
+		struct fit_job *job = jobs + i % njobs;
 
 		if (device_is_cancelled(abstract)) {
 			status = DC_STATUS_CANCELLED;
 			break;
 		}
 
-		// Reset the membuffer, read the data
-		dc_buffer_clear(file);
-		dc_buffer_append(file, name, FIT_NAME_SIZE);
+#ifdef USE_THREADS
+		if (nthreads) {
+			pthread_mutex_lock(&pool.lock);
+			while (!job->ready)
+				pthread_cond_wait(&pool.cond, &pool.lock);
+			pthread_mutex_unlock(&pool.lock);
+		} else
+#endif
+		process_file(fs, name, parser, &index, i == 0, job);
 
-		status = read_file(pathname, pathlen, name, file);
+		status = job->status;
 		if (status != DC_STATUS_SUCCESS)
 			break;
 
-		data = dc_buffer_get_data(file);
-		size = dc_buffer_get_size(file);
+		if (job->parsed)
+			index_set(&index, name, job->size, job->mtime, job->is_dive);
 
-		is_dive = garmin_parser_is_dive(parser, data, size, devinfo_p);
-		if (devinfo_p) {
+		if (i == 0) {
 			// first time we came through here, let's emit the
 			// devinfo and vendor events
-			device_event_emit (abstract, DC_EVENT_DEVINFO, devinfo_p);
-			devinfo_p = NULL;
+			device_event_emit (abstract, DC_EVENT_DEVINFO, &job->devinfo);
 		}
-		if (!is_dive) {
+
+		if (!job->is_dive) {
 			DEBUG (abstract->context, "decided %s isn't a dive.", name);
-			continue;
+		} else {
+			const unsigned char *data = dc_buffer_get_data(job->buffer);
+			unsigned int size = dc_buffer_get_size(job->buffer);
+
+			if (callback && !callback(data, size, name, FIT_NAME_SIZE, userdata))
+				break;
+
+			progress.current++;
+			device_event_emit(abstract, DC_EVENT_PROGRESS, &progress);
 		}
 
-		if (callback && !callback(data, size, name, FIT_NAME_SIZE, userdata))
-			break;
+#ifdef USE_THREADS
+		if (nthreads) {
+			// Hand the job slot back to the workers.
+			pthread_mutex_lock(&pool.lock);
+			job->ready = 0;
+			pool.consumed = i + 1;
+			pthread_cond_broadcast(&pool.cond);
+			pthread_mutex_unlock(&pool.lock);
+		}
+#endif
+	}
+
+#ifdef USE_THREADS
+	if (nthreads) {
+		pthread_mutex_lock(&pool.lock);
+		pool.abort = 1;
+		pthread_cond_broadcast(&pool.cond);
+		pthread_mutex_unlock(&pool.lock);
+
+		for (unsigned int n = 0; n < nthreads; n++) {
+			if (workers[n].started)
+				pthread_join(workers[n].thread, NULL);
+			if (n && workers[n].parser)
+				dc_parser_destroy(workers[n].parser);
+		}
 
-		progress.current++;
-		device_event_emit(abstract, DC_EVENT_PROGRESS, &progress);
+		pthread_cond_destroy(&pool.cond);
+		pthread_mutex_destroy(&pool.lock);
 	}
+#endif
+
+	if (device->indexname)
+		index_save(abstract->context, device->indexname, &index);
 
+cleanup:
+	for (unsigned int n = 0; n < njobs; n++)
+		dc_buffer_free(jobs[n].buffer);
+	free(index.array);
 	free(files.array);
 	dc_parser_destroy(parser);
+	dc_usb_storage_fs_close(fs);
 	return status;
 }
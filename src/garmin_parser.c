@@ -19,6 +19,8 @@
  * MA 02110-1301 USA
  */
 
+#define LOG_SUBSYSTEM DC_LOGSUBSYSTEM_PARSER
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdarg.h>
@@ -28,19 +30,36 @@
 #include "context-private.h"
 #include "parser-private.h"
 #include "array.h"
+#include "checksum.h"
+#include "pool.h"
 
 #define C_ARRAY_SIZE(a) (sizeof(a) / sizeof(*(a)))
 
 #define MAXFIELDS 128
 
 struct msg_desc;
+struct field_desc;
+
+#define MSG_NAME_LEN 16
+
+// Decoding plan for a single field of a local type, resolved once
+// when the definition record is seen.
+struct field_plan {
+	const struct field_desc *desc;	// NULL for unknown fields
+	unsigned int len;		// a skipped run can span several fields
+	unsigned char field_nr, base_type;
+	unsigned char is_string, skip;
+};
 
 // Local types
 struct type_desc {
 	const char *msg_name;
+	char unknown_name[MSG_NAME_LEN];
 	const struct msg_desc *msg_desc;
-	unsigned char nrfields;
-	unsigned char fields[MAXFIELDS][3];
+	unsigned char nrfields;		// compiled plan entries, not FIT fields
+	unsigned char invalid;
+	unsigned int size;		// total size of a data record
+	struct field_plan plan[MAXFIELDS];
 };
 
 // Positions are signed 32-bit values, turning
@@ -49,6 +68,8 @@ struct pos {
 	int lat, lon;
 };
 
+#define SEMICIRCLES (180.0 / 2147483648.0)
+
 #define MAXTYPE 16
 #define MAXGASES 16
 #define MAXSTRINGS 32
@@ -59,6 +80,9 @@ struct record_data {
 	unsigned int pending;
 	unsigned int time;
 
+	// The last full timestamp, which the compressed ones are relative to
+	unsigned int timestamp;
+
 	// RECORD_DECO
 	int stop_time;
 	double ceiling;
@@ -76,6 +100,9 @@ struct record_data {
 
 	// RECORD_DECO_MODEL
 	unsigned char model, gf_low, gf_high;
+
+	// RECORD_LOCATION
+	struct pos pos;
 };
 
 #define RECORD_GASMIX		1
@@ -83,6 +110,11 @@ struct record_data {
 #define RECORD_EVENT		4
 #define RECORD_DEVICE_INFO	8
 #define RECORD_DECO_MODEL	16
+#define RECORD_LOCATION		32
+
+// Messages required by the dive pre-filter
+#define FOUND_SPORT		1
+#define FOUND_DEVICE_INFO	2
 
 typedef struct garmin_parser_t {
 	dc_parser_t base;
@@ -95,6 +127,13 @@ typedef struct garmin_parser_t {
 
 	struct type_desc type_desc[MAXTYPE];
 
+	// Storage for the string fields, interned across dives.
+	dc_strpool_t strings;
+
+	// Stop traversing the data as soon as all the wanted messages
+	// have been found. Zero means walk all the data.
+	unsigned int wanted, found;
+
 	// Field cache
 	struct {
 		unsigned int initialized;
@@ -231,8 +270,10 @@ static void flush_pending_record(struct garmin_parser_t *garmin)
 {
 	struct record_data *record = &garmin->record_data;
 	unsigned int pending = record->pending;
+	struct pos pos = record->pos;
 
 	record->pending = 0;
+	record->pos.lat = record->pos.lon = 0;
 	if (!garmin->callback) {
 		if (pending & RECORD_GASMIX) {
 			// 0 - disabled, 1 - enabled, 2 - backup
@@ -250,6 +291,7 @@ static void flush_pending_record(struct garmin_parser_t *garmin)
 			garmin->cache.firmware = record->firmware;
 			garmin->cache.serial = record->serial;
 			garmin->cache.product = record->product;
+			garmin->found |= FOUND_DEVICE_INFO;
 		}
 		if (pending & RECORD_DECO_MODEL)
 			add_string_fmt(garmin, "Deco model", "Buhlmann ZHL-16C %u/%u", record->gf_low, record->gf_high);
@@ -268,6 +310,14 @@ static void flush_pending_record(struct garmin_parser_t *garmin)
 		garmin_event(garmin, record->event_nr, record->event_type,
 			record->event_group, record->event_data, record->event_unknown);
 	}
+
+	// A track point needs both coordinates.
+	if ((pending & RECORD_LOCATION) && pos.lat && pos.lon) {
+		dc_sample_value_t sample = {0};
+		sample.location.latitude = pos.lat * SEMICIRCLES;
+		sample.location.longitude = pos.lon * SEMICIRCLES;
+		garmin->callback(DC_SAMPLE_LOCATION, sample, garmin->userdata);
+	}
 }
 
 
@@ -275,6 +325,8 @@ static dc_status_t garmin_parser_set_data (dc_parser_t *abstract, const unsigned
 static dc_status_t garmin_parser_get_datetime (dc_parser_t *abstract, dc_datetime_t *datetime);
 static dc_status_t garmin_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, unsigned int flags, void *value);
 static dc_status_t garmin_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t callback, void *userdata);
+static dc_status_t garmin_parser_destroy (dc_parser_t *abstract);
+static dc_status_t garmin_parser_verify (dc_parser_t *abstract);
 
 static const dc_parser_vtable_t garmin_parser_vtable = {
 	sizeof(garmin_parser_t),
@@ -283,7 +335,10 @@ static const dc_parser_vtable_t garmin_parser_vtable = {
 	garmin_parser_get_datetime, /* datetime */
 	garmin_parser_get_field, /* fields */
 	garmin_parser_samples_foreach, /* samples_foreach */
-	NULL /* destroy */
+	garmin_parser_destroy, /* destroy */
+	NULL, /* samples_batch */
+	NULL, /* samples_append */
+	garmin_parser_verify /* verify */
 };
 
 dc_status_t
@@ -301,6 +356,10 @@ garmin_parser_create (dc_parser_t **out, dc_context_t *context)
 		return DC_STATUS_NOMEMORY;
 	}
 
+	dc_strpool_init (&parser->strings, context);
+	parser->wanted = 0;
+	parser->found = 0;
+
 	*out = (dc_parser_t *) parser;
 
 	return DC_STATUS_SUCCESS;
@@ -316,7 +375,7 @@ static void add_string(garmin_parser_t *garmin, const char *desc, const char *va
 		if (str->desc)
 			continue;
 		str->desc = desc;
-		str->value = strdup(value);
+		str->value = dc_strpool_intern(&garmin->strings, value);
 		break;
 	}
 }
@@ -334,28 +393,32 @@ static void add_string_fmt(garmin_parser_t *garmin, const char *desc, const char
 	add_string(garmin, desc, buffer);
 }
 
-#define DECLARE_FIT_TYPE(name, ctype, inval) \
+// The second argument is the FIT base type number (the index in the
+// base_type_info table below), such that the type of a field can be
+// checked with an integer compare rather than a string compare.
+#define DECLARE_FIT_TYPE(name, nr, ctype, inval) \
 	typedef ctype name;	\
+	enum { name##_BASE_TYPE = nr }; \
 	static const name name##_INVAL = inval
 
-DECLARE_FIT_TYPE(ENUM, unsigned char, 0xff);
-DECLARE_FIT_TYPE(UINT8, unsigned char, 0xff);
-DECLARE_FIT_TYPE(UINT16, unsigned short, 0xffff);
-DECLARE_FIT_TYPE(UINT32, unsigned int, 0xffffffff);
-DECLARE_FIT_TYPE(UINT64, unsigned long long, 0xffffffffffffffffull);
+DECLARE_FIT_TYPE(ENUM, 0, unsigned char, 0xff);
+DECLARE_FIT_TYPE(UINT8, 2, unsigned char, 0xff);
+DECLARE_FIT_TYPE(UINT16, 4, unsigned short, 0xffff);
+DECLARE_FIT_TYPE(UINT32, 6, unsigned int, 0xffffffff);
+DECLARE_FIT_TYPE(UINT64, 15, unsigned long long, 0xffffffffffffffffull);
 
-DECLARE_FIT_TYPE(UINT8Z, unsigned char, 0);
-DECLARE_FIT_TYPE(UINT16Z, unsigned short, 0);
-DECLARE_FIT_TYPE(UINT32Z, unsigned int, 0);
+DECLARE_FIT_TYPE(UINT8Z, 10, unsigned char, 0);
+DECLARE_FIT_TYPE(UINT16Z, 11, unsigned short, 0);
+DECLARE_FIT_TYPE(UINT32Z, 12, unsigned int, 0);
 
-DECLARE_FIT_TYPE(SINT8, signed char, 0x7f);
-DECLARE_FIT_TYPE(SINT16, signed short, 0x7fff);
-DECLARE_FIT_TYPE(SINT32, signed int, 0x7fffffff);
-DECLARE_FIT_TYPE(SINT64, signed long long, 0x7fffffffffffffffll);
+DECLARE_FIT_TYPE(SINT8, 1, signed char, 0x7f);
+DECLARE_FIT_TYPE(SINT16, 3, signed short, 0x7fff);
+DECLARE_FIT_TYPE(SINT32, 5, signed int, 0x7fffffff);
+DECLARE_FIT_TYPE(SINT64, 14, signed long long, 0x7fffffffffffffffll);
 
-DECLARE_FIT_TYPE(FLOAT, unsigned int, 0xffffffff);
-DECLARE_FIT_TYPE(DOUBLE, unsigned long long, 0xffffffffffffffffll);
-DECLARE_FIT_TYPE(STRING, char *, NULL);
+DECLARE_FIT_TYPE(FLOAT, 8, unsigned int, 0xffffffff);
+DECLARE_FIT_TYPE(DOUBLE, 9, unsigned long long, 0xffffffffffffffffll);
+DECLARE_FIT_TYPE(STRING, 7, char *, NULL);
 
 static const struct {
 	const char *type_name;
@@ -400,12 +463,13 @@ struct field_desc {
 	static void parse_##name(struct garmin_parser_t *, const type); \
 	static void parse_##name##_##type(struct garmin_parser_t *g, unsigned char base_type, const unsigned char *p) \
 	{ \
-		if (strcmp(#type, base_type_info[base_type].type_name)) \
+		type val; \
+		if (base_type != type##_BASE_TYPE) \
 			fprintf(stderr, "%s: %s should be %s\n", #name, #type, base_type_info[base_type].type_name); \
-		type val = *(type *)p; \
+		memcpy(&val, p, sizeof(val)); \
 		if (val == type##_INVAL) return; \
 		DEBUG(g->base.context, "%s (%s): %lld", #name, #type, (long long)val); \
-		parse_##name(g, *(type *)p); \
+		parse_##name(g, val); \
 	} \
 	static const struct field_desc name##_field_##type = { #name, parse_##name##_##type }; \
 	static void parse_##name(struct garmin_parser_t *garmin, type data)
@@ -415,6 +479,7 @@ struct field_desc {
 // Convert to "standard epoch time" by adding 631065600.
 DECLARE_FIELD(ANY, timestamp, UINT32)
 {
+	garmin->record_data.timestamp = data;
 	if (garmin->callback) {
 		dc_sample_value_t sample = {0};
 
@@ -468,8 +533,18 @@ DECLARE_FIELD(LAP, other_pos_lat, SINT32)	{ garmin->cache.gps.LAP.other.lat = da
 DECLARE_FIELD(LAP, other_pos_long, SINT32)	{ garmin->cache.gps.LAP.other.lon = data; }
 
 // RECORD msg
-DECLARE_FIELD(RECORD, position_lat, SINT32)	{ garmin->cache.gps.RECORD.lat = data; }
-DECLARE_FIELD(RECORD, position_long, SINT32)	{ garmin->cache.gps.RECORD.lon = data; }
+DECLARE_FIELD(RECORD, position_lat, SINT32)
+{
+	garmin->cache.gps.RECORD.lat = data;
+	garmin->record_data.pending |= RECORD_LOCATION;
+	garmin->record_data.pos.lat = data;
+}
+DECLARE_FIELD(RECORD, position_long, SINT32)
+{
+	garmin->cache.gps.RECORD.lon = data;
+	garmin->record_data.pending |= RECORD_LOCATION;
+	garmin->record_data.pos.lon = data;
+}
 DECLARE_FIELD(RECORD, altitude, UINT16) { }		// 5 *m + 500 ?
 DECLARE_FIELD(RECORD, heart_rate, UINT8)		// bpm
 {
@@ -562,7 +637,7 @@ DECLARE_FIELD(DEVICE_INFO, firmware, UINT16)
 }
 
 // SPORT
-DECLARE_FIELD(SPORT, sub_sport, ENUM) { garmin->cache.sub_sport = (ENUM) data; }
+DECLARE_FIELD(SPORT, sub_sport, ENUM) { garmin->cache.sub_sport = (ENUM) data; garmin->found |= FOUND_SPORT; }
 
 // DIVE_GAS - uses msg index
 DECLARE_FIELD(DIVE_GAS, helium, UINT8)
@@ -877,14 +952,15 @@ static const struct {
 	SET_MESG(268, DIVE_SUMMARY),
 };
 
-#define MSG_NAME_LEN 16
-static const struct msg_desc *lookup_msg_desc(unsigned short msg, int local, const char **namep)
-{
-	static struct msg_desc local_array[16];
-	static char local_name[16][MSG_NAME_LEN];
-	struct msg_desc *desc;
-	char *name;
+static const struct msg_desc unknown_msg_desc = { 0 };
 
+/*
+ * Unknown messages share an empty descriptor, and get their name
+ * formatted into the per-parser buffer, so no global state is modified
+ * and several parsers can be used concurrently.
+ */
+static const struct msg_desc *lookup_msg_desc(unsigned short msg, char name[MSG_NAME_LEN], const char **namep)
+{
 	/* Do we have a real one? */
 	if (msg < C_ARRAY_SIZE(message_array) && message_array[msg].name) {
 		*namep = message_array[msg].name;
@@ -892,21 +968,9 @@ static const struct msg_desc *lookup_msg_desc(unsigned short msg, int local, con
 	}
 
 	/* If not, fake it */
-	desc = &local_array[local];
-	memset(desc, 0, sizeof(*desc));
-
-	name = local_name[local];
 	snprintf(name, MSG_NAME_LEN, "msg-%d", msg);
 	*namep = name;
-	return desc;
-}
-
-static int traverse_compressed(struct garmin_parser_t *garmin,
-	const unsigned char *data, unsigned int size,
-	unsigned char type, unsigned int time)
-{
-	fprintf(stderr, "Compressed record for local type %d:\n", type);
-	return -1;
+	return &unknown_msg_desc;
 }
 
 static int all_data_inval(const unsigned char *data, int base_type, int len)
@@ -975,51 +1039,32 @@ static void unknown_field(struct garmin_parser_t *garmin, const unsigned char *d
 
 static int traverse_regular(struct garmin_parser_t *garmin,
 	const unsigned char *data, unsigned int size,
-	unsigned char type, unsigned int *timep)
+	unsigned char type)
 {
-	unsigned int total_len = 0;
 	struct type_desc *desc = garmin->type_desc + type;
-	const struct msg_desc *msg_desc = desc->msg_desc;
 	const char *msg_name = desc->msg_name;
 
-	if (!msg_desc) {
+	if (!desc->msg_desc) {
 		ERROR(garmin->base.context, "Uninitialized type descriptor %d\n", type);
 		return -1;
 	}
 
-	for (int i = 0; i < desc->nrfields; i++) {
-		const unsigned char *field = desc->fields[i];
-		unsigned int field_nr = field[0];
-		unsigned int len = field[1];
-		unsigned int base_type = field[2] & 0x7f;
-		const struct field_desc *field_desc;
-		unsigned int base_size;
+	// Errors in the definition were already reported
+	if (desc->invalid)
+		return -1;
 
-		if (!len) {
-			ERROR(garmin->base.context, "field with zero length\n");
-			return -1;
-		}
+	if (size < desc->size) {
+		ERROR(garmin->base.context, "Data traversal size bigger than remaining data (%d vs %d)\n", desc->size, size);
+		return -1;
+	}
 
-		if (size < len) {
-			ERROR(garmin->base.context, "Data traversal size bigger than remaining data (%d vs %d)\n", len, size);
-			return -1;
-		}
+	for (int i = 0; i < desc->nrfields; i++) {
+		const struct field_plan *plan = desc->plan + i;
+		unsigned int len = plan->len;
 
-		if (base_type > 16) {
-			ERROR(garmin->base.context, "Unknown base type %d\n", base_type);
-			data += size;
-			len -= size;
-			total_len += size;
-			continue;
-		}
-		base_size = base_type_info[base_type].type_size;
-		if (len % base_size) {
-			ERROR(garmin->base.context, "Data traversal size not a multiple of base size (%d vs %d)\n", len, base_size);
-			return -1;
-		}
 		// String
-		if (base_type == 7) {
-			int string_len = strnlen(data, size);
+		if (plan->is_string) {
+			int string_len = strnlen((const char *) data, size);
 			if (string_len >= size) {
 				ERROR(garmin->base.context, "Data traversal string bigger than remaining data\n");
 				return -1;
@@ -1030,37 +1075,36 @@ static int traverse_regular(struct garmin_parser_t *garmin,
 			}
 		}
 
-
-
-		// Certain field numbers have fixed meaning across all messages
-		switch (field_nr) {
-		case 250:
-			field_desc = &ANY_part_index_field_UINT32;
-			break;
-		case 253:
-			field_desc = &ANY_timestamp_field_UINT32;
-			break;
-		case 254:
-			field_desc = &ANY_message_index_field_UINT16;
-			break;
-		default:
-			field_desc = NULL;
-			if (field_nr < msg_desc->maxfield)
-				field_desc = msg_desc->field[field_nr];
-		}
-
-		if (field_desc) {
-			field_desc->parse(garmin, base_type, data);
-		} else {
-			unknown_field(garmin, data, msg_name, field_nr, base_type, len);
+		if (plan->desc) {
+			plan->desc->parse(garmin, plan->base_type, data);
+		} else if (!plan->skip) {
+			unknown_field(garmin, data, msg_name, plan->field_nr, plan->base_type, len);
 		}
 
 		data += len;
-		total_len += len;
 		size -= len;
 	}
 
-	return total_len;
+	return desc->size;
+}
+
+/*
+ * A compressed timestamp record is a regular data record for one of the
+ * local types 0-3, with the five low bits of the timestamp in the record
+ * header instead of a timestamp field. Those bits are an offset from the
+ * last full timestamp, which rolls over at most once in between, so the
+ * full timestamp is just the last one plus the difference modulo 32.
+ */
+static int traverse_compressed(struct garmin_parser_t *garmin,
+	const unsigned char *data, unsigned int size,
+	unsigned char record)
+{
+	unsigned int timestamp = garmin->record_data.timestamp;
+	unsigned int offset = record & 0x1f;
+
+	parse_ANY_timestamp(garmin, timestamp + ((offset - timestamp) & 0x1f));
+
+	return traverse_regular(garmin, data, size, (record >> 5) & 3);
 }
 
 /*
@@ -1082,7 +1126,12 @@ static int traverse_regular(struct garmin_parser_t *garmin,
  * Followed *optionally* by developer definitions (if record header & 0x20):
  *
  *	- 1x number of developer definitions
- *	- 3 bytes each
+ *	- 3 bytes each (field number, size in bytes, developer data index)
+ *
+ * We have no use for the developer fields, nor for the regular fields we
+ * don't know about (unless they get logged), so every run of them
+ * compiles to a single plan entry which skips over all of it at once,
+ * and the developer data is simply part of the record size.
  */
 static int traverse_definition(struct garmin_parser_t *garmin,
 	const unsigned char *data, unsigned int size,
@@ -1091,10 +1140,11 @@ static int traverse_definition(struct garmin_parser_t *garmin,
 	unsigned short msg;
 	unsigned char type = record & 0xf;
 	struct type_desc *desc = garmin->type_desc + type;
-	int fields, devfields, len;
+	int debug = DEBUG_ENABLED(garmin->base.context);
+	int fields, devfields, len, n;
 
 	msg = array_uint16_le(data+2);
-	desc->msg_desc = lookup_msg_desc(msg, type, &desc->msg_name);
+	desc->msg_desc = lookup_msg_desc(msg, desc->unknown_name, &desc->msg_name);
 	fields = data[4];
 
 	DEBUG(garmin->base.context, "Define local type %d: %02x %02x %04x %02x %s",
@@ -1109,20 +1159,94 @@ static int traverse_definition(struct garmin_parser_t *garmin,
 		ERROR(garmin->base.context, "Too many fields in description: %d (max %d)\n", fields, MAXFIELDS);
 		return -1;
 	}
-	desc->nrfields = fields;
 	len = 5 + fields*3;
 	devfields = 0;
 	if (record & 0x20) {
+		if (size < len + 1)
+			return -1;
 		devfields = data[len];
 		len += 1 + devfields*3;
-		ERROR(garmin->base.context, "NO support for developer fields yet\n");
-		return -1;
 	}
 
+	if (size < len)
+		return -1;
+
+	// Compile the field definitions into a decoding plan, such that all
+	// the validation and the handler lookups are done only once, and not
+	// again for every data record.
+	desc->invalid = 0;
+	desc->size = 0;
+	n = 0;
 	for (int i = 0; i < fields; i++) {
-		unsigned char *field = desc->fields[i];
-		memcpy(field, data + (5+i*3), 3);
+		const unsigned char *field = data + (5+i*3);
+		struct field_plan *plan = desc->plan + n++;
+		unsigned int field_nr = field[0];
+		unsigned int flen = field[1];
+		unsigned int base_type = field[2] & 0x7f;
+
 		DEBUG(garmin->base.context, "  %d: %02x %02x %02x", i, field[0], field[1], field[2]);
+
+		plan->desc = NULL;
+		plan->field_nr = field_nr;
+		plan->len = flen;
+		plan->base_type = base_type;
+		plan->is_string = base_type == 7;
+		plan->skip = 0;
+		desc->size += flen;
+
+		if (!flen) {
+			ERROR(garmin->base.context, "field with zero length\n");
+			desc->invalid = 1;
+			continue;
+		}
+
+		if (base_type > 16) {
+			ERROR(garmin->base.context, "Unknown base type %d\n", base_type);
+			plan->is_string = 0;
+			plan->skip = 1;
+			continue;
+		}
+
+		if (flen % base_type_info[base_type].type_size) {
+			ERROR(garmin->base.context, "Data traversal size not a multiple of base size (%d vs %d)\n", flen, base_type_info[base_type].type_size);
+			desc->invalid = 1;
+			continue;
+		}
+
+		// Certain field numbers have fixed meaning across all messages
+		switch (field_nr) {
+		case 250:
+			plan->desc = &ANY_part_index_field_UINT32;
+			break;
+		case 253:
+			plan->desc = &ANY_timestamp_field_UINT32;
+			break;
+		case 254:
+			plan->desc = &ANY_message_index_field_UINT16;
+			break;
+		default:
+			if (desc->msg_desc && field_nr < desc->msg_desc->maxfield)
+				plan->desc = desc->msg_desc->field[field_nr];
+		}
+
+		if (!plan->desc && !debug) {
+			plan->is_string = 0;
+			plan->skip = 1;
+		}
+
+		// Merge into the previous skipped run
+		if (plan->skip && n > 1 && plan[-1].skip) {
+			plan[-1].len += flen;
+			n--;
+		}
+	}
+	desc->nrfields = n;
+
+	for (int i = 0; i < devfields; i++) {
+		const unsigned char *field = data + (5+fields*3+1+i*3);
+
+		DEBUG(garmin->base.context, "  dev %d: %02x %02x %02x", i, field[0], field[1], field[2]);
+		desc->size += field[1];
 	}
 
 	return len;
@@ -1135,7 +1259,6 @@ traverse_data(struct garmin_parser_t *garmin)
 	const unsigned char *data = garmin->base.data;
 	int len = garmin->base.size;
 	unsigned int hdrsize, protocol, profile, datasize;
-	unsigned int time;
 
 	// Reset the time and type descriptors before walking
 	memset(&garmin->record_data, 0, sizeof(garmin->record_data));
@@ -1167,7 +1290,6 @@ traverse_data(struct garmin_parser_t *garmin)
 	garmin->cache.profile = profile;
 
 	data += hdrsize;
-	time = 0;
 
 	while (datasize > 0) {
 		unsigned char record = data[0];
@@ -1177,20 +1299,11 @@ traverse_data(struct garmin_parser_t *garmin)
 		datasize--;
 
 		if (record & 0x80) {		// Compressed record?
-			unsigned int newtime;
-			unsigned char type;
-
-			type = (record >> 5) & 3;
-			newtime = (record & 0x1f) | (time & ~0x1f);
-			if (newtime < time)
-				newtime += 0x20;
-			time = newtime;
-
-			len = traverse_compressed(garmin, data, datasize, type, time);
+			len = traverse_compressed(garmin, data, datasize, record);
 		} else if (record & 0x40) {	// Definition record?
 			len = traverse_definition(garmin, data, datasize, record);
 		} else {			// Normal data record
-			len = traverse_regular(garmin, data, datasize, record, &time);
+			len = traverse_regular(garmin, data, datasize, record & 0xf);
 		}
 		if (len <= 0 || len > datasize)
 			return DC_STATUS_IO;
@@ -1200,6 +1313,10 @@ traverse_data(struct garmin_parser_t *garmin)
 		// Flush pending data on record boundaries
 		if (garmin->record_data.pending)
 			flush_pending_record(garmin);
+
+		// Early exit once everything we were looking for is known
+		if (garmin->wanted && (garmin->found & garmin->wanted) == garmin->wanted)
+			break;
 	}
 	return DC_STATUS_SUCCESS;
 }
@@ -1244,9 +1361,17 @@ static void add_gps_string(garmin_parser_t *garmin, const char *desc, struct pos
 int
 garmin_parser_is_dive (dc_parser_t *abstract, const unsigned char *data, unsigned int size, dc_event_devinfo_t *devinfo_p)
 {
+	garmin_parser_t *garmin = (garmin_parser_t *) abstract;
+
+	// Only the sport message (and the device info, if requested) is
+	// needed to decide whether this is a dive, so stop the traversal
+	// as soon as those have been seen instead of walking all the data.
+	garmin->wanted = FOUND_SPORT;
+	if (devinfo_p)
+		garmin->wanted |= FOUND_DEVICE_INFO;
+
 	// set up the parser and extract data
 	dc_parser_set_data(abstract, data, size);
-	garmin_parser_t *garmin = (garmin_parser_t *) abstract;
 
 	if (devinfo_p) {
 		devinfo_p->firmware = garmin->cache.firmware;
@@ -1265,9 +1390,17 @@ garmin_parser_set_data (dc_parser_t *abstract, const unsigned char *data, unsign
 	garmin->callback = NULL;
 	garmin->userdata = NULL;
 	memset(&garmin->cache, 0, sizeof(garmin->cache));
+	dc_strpool_trim(&garmin->strings);
+	garmin->found = 0;
 
 	traverse_data(garmin);
+
+	// The early exit only applies to a single walk.
+	garmin->wanted = 0;
 	// These seem to be the "real" GPS dive coordinates
+	if (garmin->cache.gps.SESSION.entry.lat && garmin->cache.gps.SESSION.entry.lon)
+		garmin->cache.initialized |= 1 << DC_FIELD_LOCATION;
+
 	add_gps_string(garmin, "GPS1", &garmin->cache.gps.SESSION.entry);
 	add_gps_string(garmin, "GPS2", &garmin->cache.gps.SESSION.exit);
 
@@ -1285,6 +1418,57 @@ garmin_parser_set_data (dc_parser_t *abstract, const unsigned char *data, unsign
 }
 
 
+static dc_status_t
+garmin_parser_destroy (dc_parser_t *abstract)
+{
+	garmin_parser_t *garmin = (garmin_parser_t *) abstract;
+
+	dc_strpool_cleanup(&garmin->strings);
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+/*
+ * A FIT file ends with a crc over the header and the data. The longer
+ * 14 byte header also has a crc of its own, which is optional, and
+ * zero when not present.
+ */
+static dc_status_t
+garmin_parser_verify (dc_parser_t *abstract)
+{
+	const unsigned char *data = abstract->data;
+	unsigned int size = abstract->size;
+
+	if (size < FIT_NAME_SIZE + 12)
+		return DC_STATUS_DATAFORMAT;
+
+	data += FIT_NAME_SIZE;
+	size -= FIT_NAME_SIZE;
+
+	unsigned int hdrsize = data[0];
+	unsigned int datasize = array_uint32_le(data+4);
+	if (hdrsize < 12 || hdrsize > size || datasize > size - hdrsize || size - hdrsize - datasize < 2)
+		return DC_STATUS_DATAFORMAT;
+
+	if (hdrsize >= 14) {
+		unsigned short crc = array_uint16_le(data+12);
+		if (crc && crc != checksum_crc16r_ansi(data, 12, 0)) {
+			ERROR(abstract->context, "Unexpected FIT header checksum.");
+			return DC_STATUS_DATAFORMAT;
+		}
+	}
+
+	unsigned short crc = array_uint16_le(data+hdrsize+datasize);
+	if (crc != checksum_crc16r_ansi(data, hdrsize+datasize, 0)) {
+		ERROR(abstract->context, "Unexpected FIT file checksum.");
+		return DC_STATUS_DATAFORMAT;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+
 static dc_status_t
 garmin_parser_get_datetime (dc_parser_t *abstract, dc_datetime_t *datetime)
 {
@@ -1353,6 +1537,14 @@ garmin_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, unsigned i
 		return DC_STATUS_UNSUPPORTED;
 	case DC_FIELD_STRING:
 		return get_string_field(garmin->cache.strings, flags, (dc_field_string_t *)value);
+	case DC_FIELD_LOCATION:
+		{
+			dc_location_t *location = (dc_location_t *) value;
+			location->latitude = garmin->cache.gps.SESSION.entry.lat * SEMICIRCLES;
+			location->longitude = garmin->cache.gps.SESSION.entry.lon * SEMICIRCLES;
+			location->altitude = 0.0;
+		}
+		return DC_STATUS_SUCCESS;
 	default:
 		return DC_STATUS_UNSUPPORTED;
 	}
@@ -0,0 +1,78 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#include <string.h>
+
+#include "gastable.h"
+
+// The buckets contain the index plus one, such that zero marks an
+// empty bucket.
+#define EMPTY 0
+
+static unsigned int
+dc_gastable_hash (unsigned int key)
+{
+	return (key * 2654435761u) >> 27;
+}
+
+void
+dc_gastable_init (dc_gastable_t *table)
+{
+	table->count = 0;
+	memset (table->key, 0, sizeof (table->key));
+	memset (table->bucket, EMPTY, sizeof (table->bucket));
+}
+
+unsigned int
+dc_gastable_find (const dc_gastable_t *table, unsigned int key)
+{
+	unsigned int n = dc_gastable_hash (key);
+	while (table->bucket[n] != EMPTY) {
+		unsigned int idx = table->bucket[n] - 1;
+		if (table->key[idx] == key)
+			return idx;
+		n = (n + 1) % GASTABLE_BUCKETS;
+	}
+
+	return table->count;
+}
+
+unsigned int
+dc_gastable_add (dc_gastable_t *table, unsigned int key)
+{
+	if (table->count >= GASTABLE_MAX)
+		return GASTABLE_MAX;
+
+	unsigned int idx = table->count++;
+	table->key[idx] = key;
+
+	// Only the first occurrence of a key is indexed. With at most half
+	// of the buckets in use, there is always an empty bucket.
+	unsigned int n = dc_gastable_hash (key);
+	while (table->bucket[n] != EMPTY) {
+		if (table->key[table->bucket[n] - 1] == key)
+			return idx;
+		n = (n + 1) % GASTABLE_BUCKETS;
+	}
+	table->bucket[n] = idx + 1;
+
+	return idx;
+}
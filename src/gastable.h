@@ -0,0 +1,66 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef GASTABLE_H
+#define GASTABLE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#define GASTABLE_MAX     16
+#define GASTABLE_BUCKETS 32
+
+#define GASTABLE_KEY(o2,he,type) (((unsigned int) (type) << 16) | ((unsigned int) (he) << 8) | (unsigned int) (o2))
+
+/*
+ * An index of the gas mixes of a dive. The table only stores the keys,
+ * and the position of each key matches the index in the gas mix array
+ * of the parser. Duplicate keys are allowed, but a lookup always
+ * returns the first one.
+ */
+typedef struct dc_gastable_t {
+	unsigned int count;
+	unsigned int key[GASTABLE_MAX];
+	unsigned char bucket[GASTABLE_BUCKETS];
+} dc_gastable_t;
+
+void
+dc_gastable_init (dc_gastable_t *table);
+
+/*
+ * Returns the index of the key, or the number of entries if the key is
+ * not present.
+ */
+unsigned int
+dc_gastable_find (const dc_gastable_t *table, unsigned int key);
+
+/*
+ * Append the key at the end of the table. Returns the index of the new
+ * entry, or GASTABLE_MAX if the table is full.
+ */
+unsigned int
+dc_gastable_add (dc_gastable_t *table, unsigned int key);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* GASTABLE_H */
@@ -0,0 +1,64 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_HOTPLUG_PRIVATE_H
+#define DC_HOTPLUG_PRIVATE_H
+
+#include <libdivecomputer/hotplug.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+typedef struct dc_usbhid_hotplug_t dc_usbhid_hotplug_t;
+typedef struct dc_serial_hotplug_t dc_serial_hotplug_t;
+
+/*
+ * Report an arrival to the application, and return the id assigned to
+ * the device. The ownership of the device is transferred to the
+ * application.
+ */
+unsigned int
+dc_hotplug_arrived (dc_hotplug_t *hotplug, dc_transport_t transport, void *device);
+
+void
+dc_hotplug_left (dc_hotplug_t *hotplug, dc_transport_t transport, unsigned int id);
+
+/*
+ * The transport specific backends. A backend returns
+ * DC_STATUS_UNSUPPORTED when it's not available on this platform.
+ */
+dc_status_t
+dc_usbhid_hotplug_new (dc_usbhid_hotplug_t **out, dc_hotplug_t *hotplug, dc_context_t *context, dc_descriptor_t *descriptor);
+
+void
+dc_usbhid_hotplug_free (dc_usbhid_hotplug_t *backend);
+
+dc_status_t
+dc_serial_hotplug_new (dc_serial_hotplug_t **out, dc_hotplug_t *hotplug, dc_context_t *context, dc_descriptor_t *descriptor);
+
+void
+dc_serial_hotplug_free (dc_serial_hotplug_t *backend);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_HOTPLUG_PRIVATE_H */
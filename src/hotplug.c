@@ -0,0 +1,159 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+#include "hotplug-private.h"
+#include "context-private.h"
+
+struct dc_hotplug_t {
+	dc_context_t *context;
+	dc_hotplug_callback_t callback;
+	void *userdata;
+	// The id of the next arrival.
+	unsigned int id;
+#ifdef HAVE_PTHREAD_H
+	// Serializes the callbacks of the different backends.
+	pthread_mutex_t lock;
+#endif
+	dc_usbhid_hotplug_t *usbhid;
+	dc_serial_hotplug_t *serial;
+};
+
+static void
+dc_hotplug_lock (dc_hotplug_t *hotplug)
+{
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_lock (&hotplug->lock);
+#endif
+}
+
+static void
+dc_hotplug_unlock (dc_hotplug_t *hotplug)
+{
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_unlock (&hotplug->lock);
+#endif
+}
+
+unsigned int
+dc_hotplug_arrived (dc_hotplug_t *hotplug, dc_transport_t transport, void *device)
+{
+	dc_hotplug_lock (hotplug);
+
+	unsigned int id = hotplug->id++;
+
+	hotplug->callback (DC_HOTPLUG_ARRIVED, transport, id, device, hotplug->userdata);
+
+	dc_hotplug_unlock (hotplug);
+
+	return id;
+}
+
+void
+dc_hotplug_left (dc_hotplug_t *hotplug, dc_transport_t transport, unsigned int id)
+{
+	dc_hotplug_lock (hotplug);
+
+	hotplug->callback (DC_HOTPLUG_LEFT, transport, id, NULL, hotplug->userdata);
+
+	dc_hotplug_unlock (hotplug);
+}
+
+dc_status_t
+dc_hotplug_new (dc_hotplug_t **out, dc_context_t *context, dc_descriptor_t *descriptor, unsigned int transports, dc_hotplug_callback_t callback, void *userdata)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_hotplug_t *hotplug = NULL;
+
+	if (out == NULL || callback == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	hotplug = (dc_hotplug_t *) dc_malloc (context, sizeof (dc_hotplug_t));
+	if (hotplug == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	hotplug->context = context;
+	hotplug->callback = callback;
+	hotplug->userdata = userdata;
+	hotplug->id = 0;
+	hotplug->usbhid = NULL;
+	hotplug->serial = NULL;
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_init (&hotplug->lock, NULL);
+#endif
+
+	if (transports & DC_TRANSPORT_USBHID) {
+		status = dc_usbhid_hotplug_new (&hotplug->usbhid, hotplug, context, descriptor);
+		if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED) {
+			goto error_free;
+		}
+	}
+
+	if (transports & DC_TRANSPORT_SERIAL) {
+		status = dc_serial_hotplug_new (&hotplug->serial, hotplug, context, descriptor);
+		if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED) {
+			goto error_free;
+		}
+	}
+
+	if (hotplug->usbhid == NULL && hotplug->serial == NULL) {
+		ERROR (context, "None of the transports supports hotplug events.");
+		status = DC_STATUS_UNSUPPORTED;
+		goto error_free;
+	}
+
+	*out = hotplug;
+
+	return DC_STATUS_SUCCESS;
+
+error_free:
+	dc_hotplug_free (hotplug);
+	return status;
+}
+
+dc_status_t
+dc_hotplug_free (dc_hotplug_t *hotplug)
+{
+	if (hotplug == NULL)
+		return DC_STATUS_SUCCESS;
+
+	dc_usbhid_hotplug_free (hotplug->usbhid);
+	dc_serial_hotplug_free (hotplug->serial);
+
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_destroy (&hotplug->lock);
+#endif
+
+	dc_free (hotplug->context, hotplug);
+
+	return DC_STATUS_SUCCESS;
+}
@@ -52,6 +52,11 @@
 #define INIT       0xBB
 #define EXIT       0xFF
 
+typedef struct hw_frog_dive_t {
+	unsigned int index;
+	unsigned int length;
+} hw_frog_dive_t;
+
 typedef struct hw_frog_device_t {
 	dc_device_t base;
 	dc_iostream_t *iostream;
@@ -111,6 +116,8 @@ hw_frog_transfer (hw_frog_device_t *device,
 	if (device_is_cancelled (abstract))
 		return DC_STATUS_CANCELLED;
 
+	dc_usecs_t start = device_latency_start (abstract);
+
 	// Send the command.
 	unsigned char command[1] = {cmd};
 	status = dc_iostream_write (device->iostream, command, sizeof (command), NULL);
@@ -193,6 +200,8 @@ hw_frog_transfer (hw_frog_device_t *device,
 		}
 	}
 
+	device_latency_emit (abstract, cmd, output ? osize : 0, start);
+
 	return DC_STATUS_SUCCESS;
 }
 
@@ -373,10 +382,13 @@ hw_frog_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, void
 		count++;
 	}
 
-	// Calculate the total and maximum size.
+	// Plan the download of the new dives, with the index and length of
+	// each profile, and the total and maximum size.
+	hw_frog_dive_t plan[RB_LOGBOOK_COUNT];
 	unsigned int ndives = 0;
 	unsigned int size = 0;
 	unsigned int maxsize = 0;
+	unsigned int used = 0;
 	for (unsigned int i = 0; i < count; ++i) {
 		unsigned int idx = (latest + RB_LOGBOOK_COUNT - i) % RB_LOGBOOK_COUNT;
 		unsigned int offset = idx * RB_LOGBOOK_SIZE;
@@ -394,13 +406,24 @@ hw_frog_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, void
 			return DC_STATUS_DATAFORMAT;
 		}
 
-		// Calculate the profile length.
-		unsigned int length = RB_LOGBOOK_SIZE + RB_PROFILE_DISTANCE (begin, end) - 6;
-
 		// Check the fingerprint data.
 		if (memcmp (header + offset + 9, device->fingerprint, sizeof (device->fingerprint)) == 0)
 			break;
 
+		// The profiles of the older dives are partially overwritten
+		// once the newer dives fill the entire ringbuffer.
+		unsigned int distance = RB_PROFILE_DISTANCE (begin, end);
+		if (used + distance > RB_PROFILE_END - RB_PROFILE_BEGIN) {
+			WARNING (abstract->context, "Profile ringbuffer full, skipping the older dives.");
+			break;
+		}
+		used += distance;
+
+		// Calculate the profile length.
+		unsigned int length = RB_LOGBOOK_SIZE + distance - 6;
+
+		plan[ndives].index = idx;
+		plan[ndives].length = length;
 		if (length > maxsize)
 			maxsize = length;
 		size += length;
@@ -427,15 +450,9 @@ hw_frog_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, void
 
 	// Download the dives.
 	for (unsigned int i = 0; i < ndives; ++i) {
-		unsigned int idx = (latest + RB_LOGBOOK_COUNT - i) % RB_LOGBOOK_COUNT;
+		unsigned int idx = plan[i].index;
 		unsigned int offset = idx * RB_LOGBOOK_SIZE;
-
-		// Get the ringbuffer pointers.
-		unsigned int begin = array_uint24_le (header + offset + 2);
-		unsigned int end   = array_uint24_le (header + offset + 5);
-
-		// Calculate the profile length.
-		unsigned int length = RB_LOGBOOK_SIZE + RB_PROFILE_DISTANCE (begin, end) - 6;
+		unsigned int length = plan[i].length;
 
 		// Download the dive.
 		unsigned char number[1] = {idx};
@@ -453,8 +470,7 @@ hw_frog_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, void
 			ERROR (abstract->context, "Unexpected profile header.");
 			free (profile);
 			free (header);
-			return rc;
-
+			return DC_STATUS_DATAFORMAT;
 		}
 
 		if (callback && !callback (profile, length, profile + 9, sizeof (device->fingerprint), userdata))
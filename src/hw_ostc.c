@@ -83,9 +83,6 @@ static const dc_device_vtable_t hw_ostc_device_vtable = {
 	NULL /* close */
 };
 
-static dc_status_t
-hw_ostc_extract_dives (dc_device_t *device, const unsigned char data[], unsigned int size, dc_dive_callback_t callback, void *userdata);
-
 static dc_status_t
 hw_ostc_send (hw_ostc_device_t *device, unsigned char cmd, unsigned int echo)
 {
@@ -196,7 +193,10 @@ hw_ostc_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 	progress.maximum = SZ_HEADER + SZ_FW_NEW;
 	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
 
-	// Send the command.
+	// Send the command. The answer is always the header, with a copy of
+	// the eeprom, followed by the entire profile memory. There is no
+	// command to skip a part, and no checksum to verify the data. The
+	// md2 hash identifies the firmware, not the memory contents.
 	unsigned char command[1] = {'a'};
 	status = dc_iostream_write (device->iostream, command, sizeof (command), NULL);
 	if (status != DC_STATUS_SUCCESS) {
@@ -602,7 +602,7 @@ hw_ostc_device_screenshot (dc_device_t *abstract, dc_buffer_t *buffer, hw_ostc_f
 }
 
 
-static dc_status_t
+dc_status_t
 hw_ostc_extract_dives (dc_device_t *abstract, const unsigned char data[], unsigned int size, dc_dive_callback_t callback, void *userdata)
 {
 	hw_ostc_device_t *device = (hw_ostc_device_t *) abstract;
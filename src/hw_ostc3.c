@@ -21,15 +21,17 @@
  */
 
 #include <string.h> // memcmp, memcpy
-#include <stdlib.h> // malloc, free
 #include <stdio.h>  // FILE, fopen
 
+#include <libdivecomputer/ble.h>
+
 #include "hw_ostc3.h"
 #include "context-private.h"
 #include "device-private.h"
 #include "array.h"
 #include "aes.h"
 #include "platform.h"
+#include "buffered.h"
 
 #define ISINSTANCE(device) dc_device_isinstance((device), &hw_ostc3_device_vtable)
 
@@ -43,6 +45,7 @@
 #define SZ_FWINFO     4
 #define SZ_FIRMWARE   0x01E000        // 120KB
 #define SZ_FIRMWARE_BLOCK    0x1000   //   4KB
+#define SZ_MEMORY_BLOCK      0x10000  //  64KB
 #define FIRMWARE_AREA      0x3E0000
 
 #define RB_LOGBOOK_SIZE_COMPACT  16
@@ -81,6 +84,9 @@
 
 #define NODELAY 0
 
+#define SZ_BLEPACKET (DC_BLE_MTU_DEFAULT - 3)
+#define SZ_BLECACHE  2048
+
 typedef enum hw_ostc3_state_t {
 	OPEN,
 	DOWNLOAD,
@@ -91,14 +97,26 @@ typedef enum hw_ostc3_state_t {
 typedef struct hw_ostc3_device_t {
 	dc_device_t base;
 	dc_iostream_t *iostream;
+	dc_iostream_t *buffered;
 	unsigned int hardware;
 	unsigned int feature;
 	unsigned int model;
 	unsigned char fingerprint[5];
-	hw_ostc3_state_t state;
-	unsigned char cache[20];
+	unsigned char cache[SZ_BLECACHE];
 	unsigned int available;
 	unsigned int offset;
+	unsigned int packetsize;
+	// Selection of the dives to download.
+	unsigned int selective;
+	hw_ostc3_query_t query;
+	unsigned int *numbers;
+	// Cached compact logbook headers.
+	unsigned char *cache_logbook;
+	unsigned int cache_valid;
+	// Memory for the logbook headers and the profile data, kept for the
+	// whole session.
+	dc_buffer_t *arena;
+	size_t arena_charged;
 } hw_ostc3_device_t;
 
 typedef struct hw_ostc3_logbook_t {
@@ -187,9 +205,13 @@ hw_ostc3_read (hw_ostc3_device_t *device, dc_event_progress_t *progress, unsigne
 	while (nbytes < size) {
 		if (transport == DC_TRANSPORT_BLE) {
 			if (device->available == 0) {
-				// Read a packet into the cache.
+				// Read all queued packets into the cache at once.
 				size_t len = 0;
-				rc = dc_iostream_read (device->iostream, device->cache, sizeof(device->cache), &len);
+				rc = dc_ble_read_packets (device->iostream, device->cache, sizeof(device->cache), NULL, 0, NULL, &len);
+				if (rc == DC_STATUS_UNSUPPORTED) {
+					// Read a single packet from a custom I/O stream.
+					rc = dc_iostream_read (device->iostream, device->cache, sizeof(device->cache), &len);
+				}
 				if (rc != DC_STATUS_SUCCESS)
 					return rc;
 
@@ -238,7 +260,7 @@ hw_ostc3_write (hw_ostc3_device_t *device, dc_event_progress_t *progress, const
 	size_t nbytes = 0;
 	while (nbytes < size) {
 		// Set the maximum packet size.
-		size_t length = (transport == DC_TRANSPORT_BLE) ? sizeof(device->cache) : 64;
+		size_t length = (transport == DC_TRANSPORT_BLE) ? device->packetsize : 64;
 
 		// Limit the packet size to the total size.
 		if (nbytes + length > size)
@@ -261,25 +283,15 @@ hw_ostc3_write (hw_ostc3_device_t *device, dc_event_progress_t *progress, const
 	return rc;
 }
 
+/*
+ * Send the command byte, and verify the echo.
+ */
 static dc_status_t
-hw_ostc3_transfer (hw_ostc3_device_t *device,
-                  dc_event_progress_t *progress,
-                  unsigned char cmd,
-                  const unsigned char input[],
-                  unsigned int isize,
-                  unsigned char output[],
-                  unsigned int osize,
-                  unsigned int delay)
+hw_ostc3_command (hw_ostc3_device_t *device, unsigned char cmd, unsigned char ready)
 {
 	dc_device_t *abstract = (dc_device_t *) device;
 	dc_status_t status = DC_STATUS_SUCCESS;
 
-	if (device_is_cancelled (abstract))
-		return DC_STATUS_CANCELLED;
-
-	// Get the correct ready byte for the current state.
-	const unsigned char ready = (device->state == SERVICE ? S_READY : READY);
-
 	// Send the command.
 	unsigned char command[1] = {cmd};
 	status = hw_ostc3_write (device, NULL, command, sizeof (command));
@@ -307,37 +319,23 @@ hw_ostc3_transfer (hw_ostc3_device_t *device,
 		}
 	}
 
-	if (input) {
-		// Send the input data packet.
-		status = hw_ostc3_write (device, progress, input, isize);
-		if (status != DC_STATUS_SUCCESS) {
-			ERROR (abstract->context, "Failed to send the data packet.");
-			return status;
-		}
-	}
-
-	if (output) {
-		// Read the ouput data packet.
-		status = hw_ostc3_read (device, progress, output, osize);
-		if (status != DC_STATUS_SUCCESS) {
-			ERROR (abstract->context, "Failed to receive the answer.");
-			return status;
-		}
-	}
-
-	if (delay) {
-		unsigned int count = delay / 100;
-		for (unsigned int i = 0; i < count; ++i) {
-			if (device->available)
-				break;
+	return DC_STATUS_SUCCESS;
+}
 
-			size_t available = 0;
-			status = dc_iostream_get_available (device->iostream, &available);
-			if (status == DC_STATUS_SUCCESS && available > 0)
-				break;
+/*
+ * Wait for the device to finish the command, and verify the ready byte.
+ */
+static dc_status_t
+hw_ostc3_ready (hw_ostc3_device_t *device, unsigned char cmd, unsigned char ready, unsigned int delay)
+{
+	dc_device_t *abstract = (dc_device_t *) device;
+	dc_status_t status = DC_STATUS_SUCCESS;
 
-			dc_iostream_sleep (device->iostream, 100);
-		}
+	if (delay && !device->available) {
+		// Wait for the device, but no longer than necessary.
+		status = dc_iostream_wait_readable (device->iostream, delay);
+		if (status == DC_STATUS_UNSUPPORTED)
+			dc_iostream_sleep (device->iostream, delay);
 	}
 
 	if (cmd != EXIT) {
@@ -359,6 +357,57 @@ hw_ostc3_transfer (hw_ostc3_device_t *device,
 	return DC_STATUS_SUCCESS;
 }
 
+static dc_status_t
+hw_ostc3_transfer (hw_ostc3_device_t *device,
+                  dc_event_progress_t *progress,
+                  unsigned char cmd,
+                  const unsigned char input[],
+                  unsigned int isize,
+                  unsigned char output[],
+                  unsigned int osize,
+                  unsigned int delay)
+{
+	dc_device_t *abstract = (dc_device_t *) device;
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (device_is_cancelled (abstract))
+		return DC_STATUS_CANCELLED;
+
+	// Get the correct ready byte for the current state.
+	const unsigned char ready = (device_session_mode (&device->base) == SERVICE ? S_READY : READY);
+
+	dc_usecs_t start = device_latency_start (abstract);
+
+	// Send the command.
+	status = hw_ostc3_command (device, cmd, ready);
+	if (status != DC_STATUS_SUCCESS) {
+		return status;
+	}
+
+	if (input) {
+		// Send the input data packet.
+		status = hw_ostc3_write (device, progress, input, isize);
+		if (status != DC_STATUS_SUCCESS) {
+			ERROR (abstract->context, "Failed to send the data packet.");
+			return status;
+		}
+	}
+
+	if (output) {
+		// Read the ouput data packet.
+		status = hw_ostc3_read (device, progress, output, osize);
+		if (status != DC_STATUS_SUCCESS) {
+			ERROR (abstract->context, "Failed to receive the answer.");
+			return status;
+		}
+	}
+
+	device_latency_emit (abstract, cmd, output ? osize : 0, start);
+
+	// Wait for the ready byte.
+	return hw_ostc3_ready (device, cmd, ready, delay);
+}
+
 
 dc_status_t
 hw_ostc3_device_open (dc_device_t **out, dc_context_t *context, dc_iostream_t *iostream)
@@ -378,6 +427,7 @@ hw_ostc3_device_open (dc_device_t **out, dc_context_t *context, dc_iostream_t *i
 
 	// Set the default values.
 	device->iostream = iostream;
+	device->buffered = NULL;
 	device->hardware = INVALID;
 	device->feature = 0;
 	device->model = 0;
@@ -385,6 +435,24 @@ hw_ostc3_device_open (dc_device_t **out, dc_context_t *context, dc_iostream_t *i
 	memset (device->cache, 0, sizeof (device->cache));
 	device->available = 0;
 	device->offset = 0;
+	device->packetsize = SZ_BLEPACKET;
+	device->selective = 0;
+	memset (&device->query, 0, sizeof (device->query));
+	device->numbers = NULL;
+	device->cache_logbook = NULL;
+	device->cache_valid = 0;
+	device->arena = NULL;
+	device->arena_charged = 0;
+
+	// Buffer the small reads on the serial port.
+	if (dc_iostream_get_transport (iostream) == DC_TRANSPORT_SERIAL) {
+		status = dc_buffered_open (&device->buffered, context, iostream, 0);
+		if (status != DC_STATUS_SUCCESS) {
+			ERROR (context, "Failed to open the buffered I/O stream.");
+			goto error_free;
+		}
+		device->iostream = device->buffered;
+	}
 
 	// Set the serial communication protocol (115200 8N1).
 	status = dc_iostream_configure (device->iostream, 115200, 8, DC_PARITY_NONE, DC_STOPBITS_ONE, DC_FLOWCONTROL_NONE);
@@ -400,17 +468,30 @@ hw_ostc3_device_open (dc_device_t **out, dc_context_t *context, dc_iostream_t *i
 		goto error_free;
 	}
 
+	// Prepare the BLE link for bulk transfers. Missing support for the
+	// negotiation is not an error.
+	if (dc_iostream_get_transport (device->iostream) == DC_TRANSPORT_BLE) {
+		unsigned int mtu = 0;
+		dc_ble_request_mtu (device->iostream, DC_BLE_MTU_MAX);
+		dc_ble_set_interval (device->iostream, DC_BLE_INTERVAL_MIN, 2 * DC_BLE_INTERVAL_MIN);
+		dc_ble_set_phy (device->iostream, DC_BLE_PHY_2M);
+		dc_ble_set_write_type (device->iostream, DC_BLE_WRITE_WITHOUT_RESPONSE);
+		if (dc_ble_get_mtu (device->iostream, &mtu) == DC_STATUS_SUCCESS)
+			device->packetsize = mtu - 3;
+	}
+
 	// Make sure everything is in a sane state.
 	dc_iostream_sleep (device->iostream, 300);
 	dc_iostream_purge (device->iostream, DC_DIRECTION_ALL);
 
-	device->state = OPEN;
+	device_session_set_mode (&device->base, OPEN);
 
 	*out = (dc_device_t *) device;
 
 	return DC_STATUS_SUCCESS;
 
 error_free:
+	dc_iostream_close (device->buffered);
 	dc_device_deallocate ((dc_device_t *) device);
 	return status;
 }
@@ -456,7 +537,7 @@ hw_ostc3_device_init_download (hw_ostc3_device_t *device)
 		return status;
 	}
 
-	device->state = DOWNLOAD;
+	device_session_set_mode (abstract, DOWNLOAD);
 
 	return DC_STATUS_SUCCESS;
 }
@@ -497,7 +578,7 @@ hw_ostc3_device_init_service (hw_ostc3_device_t *device)
 		return DC_STATUS_PROTOCOL;
 	}
 
-	device->state = SERVICE;
+	device_session_set_mode (abstract, SERVICE);
 
 	return DC_STATUS_SUCCESS;
 }
@@ -508,11 +589,12 @@ hw_ostc3_device_init (hw_ostc3_device_t *device, hw_ostc3_state_t state)
 {
 	dc_status_t rc = DC_STATUS_SUCCESS;
 	dc_device_t *abstract = (dc_device_t *) device;
+	hw_ostc3_state_t current = (hw_ostc3_state_t) device_session_mode (abstract);
 
-	if (device->state == state) {
+	if (current == state) {
 		// No change.
 		rc = DC_STATUS_SUCCESS;
-	} else if (device->state == OPEN) {
+	} else if (current == OPEN) {
 		// Change to download or service mode.
 		if (state == DOWNLOAD) {
 			rc = hw_ostc3_device_init_download(device);
@@ -521,7 +603,7 @@ hw_ostc3_device_init (hw_ostc3_device_t *device, hw_ostc3_state_t state)
 		} else {
 			rc = DC_STATUS_INVALIDARGS;
 		}
-	} else if (device->state == SERVICE && state == DOWNLOAD) {
+	} else if (current == SERVICE && state == DOWNLOAD) {
 		// Switching between service and download mode is not possible.
 		// But in service mode, all download commands are supported too,
 		// so there is no need to change the state.
@@ -562,7 +644,8 @@ hw_ostc3_device_close (dc_device_t *abstract)
 	dc_status_t rc = DC_STATUS_SUCCESS;
 
 	// Send the exit command
-	if (device->state == DOWNLOAD || device->state == SERVICE) {
+	hw_ostc3_state_t state = (hw_ostc3_state_t) device_session_mode (abstract);
+	if (state == DOWNLOAD || state == SERVICE) {
 		rc = hw_ostc3_transfer (device, NULL, EXIT, NULL, 0, NULL, 0, NODELAY);
 		if (rc != DC_STATUS_SUCCESS) {
 			ERROR (abstract->context, "Failed to send the command.");
@@ -570,6 +653,16 @@ hw_ostc3_device_close (dc_device_t *abstract)
 		}
 	}
 
+	device_free (abstract, device->numbers);
+	device_free (abstract, device->cache_logbook);
+	device_memory_release (abstract, device->arena_charged);
+	dc_buffer_free (device->arena);
+
+	rc = dc_iostream_close (device->buffered);
+	if (rc != DC_STATUS_SUCCESS) {
+		dc_status_set_error(&status, rc);
+	}
+
 	return status;
 }
 
@@ -606,11 +699,20 @@ hw_ostc3_device_version (dc_device_t *abstract, unsigned char data[], unsigned i
 	if (rc != DC_STATUS_SUCCESS)
 		return rc;
 
+	// The version data doesn't change during the session.
+	const unsigned char *cached = device_session_id (abstract, size);
+	if (cached) {
+		memcpy (data, cached, size);
+		return DC_STATUS_SUCCESS;
+	}
+
 	// Send the command.
 	rc = hw_ostc3_transfer (device, NULL, IDENTITY, NULL, 0, data, size, NODELAY);
 	if (rc != DC_STATUS_SUCCESS)
 		return rc;
 
+	device_session_set_id (abstract, data, size);
+
 	return DC_STATUS_SUCCESS;
 }
 
@@ -639,6 +741,136 @@ hw_ostc3_device_hardware (dc_device_t *abstract, unsigned char data[], unsigned
 }
 
 
+static unsigned int
+hw_ostc3_profile_length (const unsigned char header[], const hw_ostc3_logbook_t *logbook, unsigned int compact)
+{
+	unsigned int length = RB_LOGBOOK_SIZE_FULL + array_uint24_le (header + logbook->profile) - 3;
+	if (!compact) {
+		// Workaround for a bug in older firmware versions.
+		unsigned int firmware = array_uint16_be (header + 0x30);
+		if (firmware < 93)
+			length -= 3;
+	}
+
+	return length;
+}
+
+/*
+ * Locate the most recent dive, and return the number of dives.
+ *
+ * The device maintains an internal counter which is incremented for every
+ * dive, and the current value at the time of the dive is stored in the
+ * dive header. Thus the most recent dive will have the highest value.
+ */
+static unsigned int
+hw_ostc3_logbook_latest (hw_ostc3_device_t *device, const unsigned char header[], const hw_ostc3_logbook_t *logbook, unsigned int *latest, unsigned int *maximum)
+{
+	unsigned int count = 0;
+
+	*latest = 0;
+	*maximum = 0;
+	for (unsigned int i = 0; i < RB_LOGBOOK_COUNT; ++i) {
+		unsigned int offset = i * logbook->size;
+
+		// Ignore uninitialized header entries.
+		if (array_isequal (header + offset, logbook->size, 0xFF))
+			continue;
+
+		// Get the internal dive number.
+		unsigned int current = array_uint16_le (header + offset + logbook->number);
+		if (current > *maximum || device->hardware == OSTC4) {
+			*maximum = current;
+			*latest = i;
+		}
+
+		count++;
+	}
+
+	return count;
+}
+
+/*
+ * Convert a date and time into the number of minutes since the start of
+ * the year 2000, with a fixed 31 day month. That's good enough for
+ * comparing timestamps.
+ */
+static long long
+hw_ostc3_datetime_key (int year, int month, int day, int hour, int minute)
+{
+	return ((((long long) (year - 2000) * 12 + (month - 1)) * 31 + (day - 1)) * 24 + hour) * 60 + minute;
+}
+
+static int
+hw_ostc3_device_select (hw_ostc3_device_t *device, const unsigned char header[], const hw_ostc3_logbook_t *logbook, unsigned int nselected)
+{
+	const hw_ostc3_query_t *query = &device->query;
+	const unsigned char *datetime = header + logbook->fingerprint;
+
+	// Skip the dives which are already known to the application.
+	if (device_is_known (&device->base, datetime, sizeof (device->fingerprint)))
+		return 0;
+
+	if (!device->selective)
+		return 1;
+
+	if (query->limit && nselected >= query->limit)
+		return 0;
+
+	if (query->nnumbers) {
+		unsigned int number = array_uint16_le (header + logbook->number);
+		unsigned int found = 0;
+		for (unsigned int i = 0; i < query->nnumbers; ++i) {
+			if (query->numbers[i] == number) {
+				found = 1;
+				break;
+			}
+		}
+		if (!found)
+			return 0;
+	}
+
+	long long key = hw_ostc3_datetime_key (datetime[0] + 2000, datetime[1], datetime[2], datetime[3], datetime[4]);
+
+	if (query->begin.year != 0 &&
+		key < hw_ostc3_datetime_key (query->begin.year, query->begin.month, query->begin.day, query->begin.hour, query->begin.minute))
+		return 0;
+
+	if (query->end.year != 0 &&
+		key >= hw_ostc3_datetime_key (query->end.year, query->end.month, query->end.day, query->end.hour, query->end.minute))
+		return 0;
+
+	return 1;
+}
+
+
+/*
+ * Resize the arena, and charge the memory to the session. The arena
+ * never shrinks, so only the growth of the capacity is charged.
+ */
+static dc_status_t
+hw_ostc3_arena_resize (hw_ostc3_device_t *device, size_t size)
+{
+	dc_device_t *abstract = (dc_device_t *) device;
+
+	if (size > device->arena_charged && !device_memory_fits (abstract, size - device->arena_charged)) {
+		ERROR (abstract->context, "Memory budget exceeded (%lu bytes).", (unsigned long) size);
+		return DC_STATUS_NOMEMORY;
+	}
+
+	if (!dc_buffer_resize (device->arena, size)) {
+		ERROR (abstract->context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	size_t capacity = dc_buffer_get_capacity (device->arena);
+	if (capacity > device->arena_charged) {
+		device_memory_charge (abstract, capacity - device->arena_charged);
+		device->arena_charged = capacity;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
 static dc_status_t
 hw_ostc3_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, void *userdata)
 {
@@ -649,11 +881,13 @@ hw_ostc3_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, voi
 	progress.maximum = SZ_MEMORY;
 	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
 
+	device_profile_phase (abstract, DC_PHASE_HANDSHAKE);
 	dc_status_t rc = hw_ostc3_device_init (device, DOWNLOAD);
 	if (rc != DC_STATUS_SUCCESS)
 		return rc;
 
 	// Download the version data.
+	device_profile_phase (abstract, DC_PHASE_VERSION);
 	unsigned char id[SZ_VERSION] = {0};
 	rc = hw_ostc3_device_version (abstract, id, sizeof (id));
 	if (rc != DC_STATUS_SUCCESS) {
@@ -680,19 +914,33 @@ hw_ostc3_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, voi
 	}
 	device_event_emit (abstract, DC_EVENT_DEVINFO, &devinfo);
 
-	// Allocate memory.
-	unsigned char *header = (unsigned char *) malloc (RB_LOGBOOK_SIZE_FULL * RB_LOGBOOK_COUNT);
-	if (header == NULL) {
-		ERROR (abstract->context, "Failed to allocate memory.");
-		return DC_STATUS_NOMEMORY;
+	// Allocate memory. The arena is reused for all downloads of the
+	// session, and only grows when a larger dive shows up.
+	if (device->arena == NULL) {
+		device->arena = dc_buffer_new (0);
 	}
+	rc = hw_ostc3_arena_resize (device, RB_LOGBOOK_SIZE_FULL * RB_LOGBOOK_COUNT);
+	if (rc != DC_STATUS_SUCCESS) {
+		return rc;
+	}
+
+	unsigned char *header = dc_buffer_get_data (device->arena);
 
 	// Download the compact logbook headers. If the firmware doesn't support
 	// compact headers yet, fallback to downloading the full logbook headers.
-	// This is slower, but also works for older firmware versions.
+	// This is slower, but also works for older firmware versions. If the
+	// cached headers are still up to date, there is nothing to download.
+	device_profile_phase (abstract, DC_PHASE_LOGBOOK);
 	unsigned int compact = 1;
-	rc = hw_ostc3_transfer (device, &progress, COMPACT,
-              NULL, 0, header, RB_LOGBOOK_SIZE_COMPACT * RB_LOGBOOK_COUNT, NODELAY);
+	if (device->cache_valid) {
+		memcpy (header, device->cache_logbook, RB_LOGBOOK_SIZE_COMPACT * RB_LOGBOOK_COUNT);
+		progress.current += RB_LOGBOOK_SIZE_COMPACT * RB_LOGBOOK_COUNT;
+		device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
+		rc = DC_STATUS_SUCCESS;
+	} else {
+		rc = hw_ostc3_transfer (device, &progress, COMPACT,
+		          NULL, 0, header, RB_LOGBOOK_SIZE_COMPACT * RB_LOGBOOK_COUNT, NODELAY);
+	}
 	if (rc == DC_STATUS_UNSUPPORTED) {
 		compact = 0;
 		rc = hw_ostc3_transfer (device, &progress, HEADER,
@@ -700,7 +948,6 @@ hw_ostc3_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, voi
 	}
 	if (rc != DC_STATUS_SUCCESS) {
 		ERROR (abstract->context, "Failed to read the header.");
-		free (header);
 		return rc;
 	}
 
@@ -712,31 +959,23 @@ hw_ostc3_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, voi
 		logbook = &hw_ostc3_logbook_full;
 	}
 
+	// Keep the compact headers for the application.
+	if (compact && !device->cache_valid) {
+		if (device->cache_logbook == NULL)
+			device->cache_logbook = (unsigned char *) device_malloc (abstract, RB_LOGBOOK_SIZE_COMPACT * RB_LOGBOOK_COUNT);
+		if (device->cache_logbook)
+			memcpy (device->cache_logbook, header, RB_LOGBOOK_SIZE_COMPACT * RB_LOGBOOK_COUNT);
+	}
+
 	// Locate the most recent dive.
-	// The device maintains an internal counter which is incremented for every
-	// dive, and the current value at the time of the dive is stored in the
-	// dive header. Thus the most recent dive will have the highest value.
-	unsigned int count = 0;
 	unsigned int latest = 0;
 	unsigned int maximum = 0;
-	for (unsigned int i = 0; i < RB_LOGBOOK_COUNT; ++i) {
-		unsigned int offset = i * logbook->size;
-
-		// Ignore uninitialized header entries.
-		if (array_isequal (header + offset, logbook->size, 0xFF))
-			continue;
-
-		// Get the internal dive number.
-		unsigned int current = array_uint16_le (header + offset + logbook->number);
-		if (current > maximum || device->hardware == OSTC4) {
-			maximum = current;
-			latest = i;
-		}
-
-		count++;
-	}
+	unsigned int count = hw_ostc3_logbook_latest (device, header, logbook, &latest, &maximum);
 
-	// Calculate the total and maximum size.
+	// Calculate the total and maximum size. Only the selected dives are
+	// downloaded, and count towards the size.
+	unsigned char selected[RB_LOGBOOK_COUNT] = {0};
+	unsigned int nselected = 0;
 	unsigned int ndives = 0;
 	unsigned int size = 0;
 	unsigned int maxsize = 0;
@@ -753,16 +992,9 @@ hw_ostc3_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, voi
 		}
 
 		// Calculate the profile length.
-		unsigned int length = RB_LOGBOOK_SIZE_FULL + array_uint24_le (header + offset + logbook->profile) - 3;
-		if (!compact) {
-			// Workaround for a bug in older firmware versions.
-			unsigned int firmware = array_uint16_be (header + offset + 0x30);
-			if (firmware < 93)
-				length -= 3;
-		}
+		unsigned int length = hw_ostc3_profile_length (header + offset, logbook, compact);
 		if (length < RB_LOGBOOK_SIZE_FULL) {
 			ERROR (abstract->context, "Invalid profile length (%u bytes).", length);
-			free (header);
 			return DC_STATUS_DATAFORMAT;
 		}
 
@@ -770,43 +1002,82 @@ hw_ostc3_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, voi
 		if (memcmp (header + offset + logbook->fingerprint, device->fingerprint, sizeof (device->fingerprint)) == 0)
 			break;
 
+		ndives++;
+
+		if (!hw_ostc3_device_select (device, header + offset, logbook, nselected))
+			continue;
+
+		selected[i] = 1;
+		nselected++;
+
 		if (length > maxsize)
 			maxsize = length;
 		size += length;
-		ndives++;
+	}
+
+	// Skip the dives that were already downloaded before the download got
+	// interrupted. The resume token contains the fingerprint of the last
+	// dive that was passed to the application.
+	unsigned int first = 0;
+	unsigned int remaining = nselected;
+	const unsigned char *resume = device_resume_get (abstract, sizeof (device->fingerprint));
+	if (resume) {
+		unsigned int skipped = 0, nskipped = 0;
+		for (unsigned int i = 0; i < ndives; ++i) {
+			unsigned int idx = (latest + RB_LOGBOOK_COUNT - i) % RB_LOGBOOK_COUNT;
+			unsigned int offset = idx * logbook->size;
+
+			if (selected[i]) {
+				skipped += hw_ostc3_profile_length (header + offset, logbook, compact);
+				nskipped++;
+			}
+
+			if (memcmp (header + offset + logbook->fingerprint, resume, sizeof (device->fingerprint)) == 0) {
+				INFO (abstract->context, "Resuming the download after %u dives.", i + 1);
+				first = i + 1;
+				size -= skipped;
+				remaining -= nskipped;
+				break;
+			}
+		}
+
+		if (first == 0) {
+			WARNING (abstract->context, "Resume token not found, downloading all dives.");
+		}
 	}
 
 	// Update and emit a progress event.
-	progress.maximum = (logbook->size * RB_LOGBOOK_COUNT) + size + ndives;
+	progress.maximum = (logbook->size * RB_LOGBOOK_COUNT) + size + remaining;
 	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
 
 	// Finish immediately if there are no dives available.
-	if (ndives == 0) {
-		free (header);
+	if (remaining == 0) {
 		return DC_STATUS_SUCCESS;
 	}
 
-	// Allocate enough memory for the largest dive.
-	unsigned char *profile = (unsigned char *) malloc (maxsize);
-	if (profile == NULL) {
-		ERROR (abstract->context, "Failed to allocate memory.");
-		free (header);
-		return DC_STATUS_NOMEMORY;
+	// Allocate enough memory for the largest dive, behind the headers.
+	// The dives are downloaded in place, and passed to the application
+	// without copying.
+	rc = hw_ostc3_arena_resize (device, RB_LOGBOOK_SIZE_FULL * RB_LOGBOOK_COUNT + maxsize);
+	if (rc != DC_STATUS_SUCCESS) {
+		return rc;
 	}
 
+	header = dc_buffer_get_data (device->arena);
+	unsigned char *profile = header + RB_LOGBOOK_SIZE_FULL * RB_LOGBOOK_COUNT;
+
 	// Download the dives.
-	for (unsigned int i = 0; i < ndives; ++i) {
+	device_profile_phase (abstract, DC_PHASE_PROFILE);
+	for (unsigned int i = first; i < ndives; ++i) {
 		unsigned int idx = (latest + RB_LOGBOOK_COUNT - i) % RB_LOGBOOK_COUNT;
 		unsigned int offset = idx * logbook->size;
 
+		// Skip the dives which are not selected.
+		if (!selected[i])
+			continue;
+
 		// Calculate the profile length.
-		unsigned int length = RB_LOGBOOK_SIZE_FULL + array_uint24_le (header + offset + logbook->profile) - 3;
-		if (!compact) {
-			// Workaround for a bug in older firmware versions.
-			unsigned int firmware = array_uint16_be (header + offset + 0x30);
-			if (firmware < 93)
-				length -= 3;
-		}
+		unsigned int length = hw_ostc3_profile_length (header + offset, logbook, compact);
 
 		// Download the dive.
 		unsigned char number[1] = {idx};
@@ -814,16 +1085,12 @@ hw_ostc3_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, voi
 			number, sizeof (number), profile, length, NODELAY);
 		if (rc != DC_STATUS_SUCCESS) {
 			ERROR (abstract->context, "Failed to read the dive.");
-			free (profile);
-			free (header);
 			return rc;
 		}
 
 		// Verify the header in the logbook and profile are identical.
 		if (!compact && memcmp (profile, header + offset, logbook->size) != 0) {
 			ERROR (abstract->context, "Unexpected profile header.");
-			free (profile);
-			free (header);
 			return rc;
 		}
 
@@ -849,10 +1116,11 @@ hw_ostc3_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, voi
 
 		if (callback && !callback (profile, length, profile + 12, sizeof (device->fingerprint), userdata))
 			break;
+
+		// Emit a checkpoint to resume after this dive.
+		device_event_emit_checkpoint (abstract, header + offset + logbook->fingerprint, sizeof (device->fingerprint));
 	}
 
-	free (profile);
-	free (header);
 
 	return DC_STATUS_SUCCESS;
 }
@@ -931,6 +1199,9 @@ hw_ostc3_device_customtext (dc_device_t *abstract, const char *text)
 	if (rc != DC_STATUS_SUCCESS)
 		return rc;
 
+	// The custom text is part of the cached version data.
+	device_session_set_id (abstract, NULL, 0);
+
 	// Send the command.
 	rc = hw_ostc3_transfer (device, NULL, CUSTOMTEXT, packet, sizeof (packet), NULL, 0, NODELAY);
 	if (rc != DC_STATUS_SUCCESS)
@@ -1013,12 +1284,13 @@ hw_ostc3_device_config_reset (dc_device_t *abstract)
 }
 
 // This is a variant of fletcher16 with a 16 bit sum instead of an 8 bit sum,
-// and modulo 2^16 instead of 2^16-1
+// and modulo 2^16 instead of 2^16-1. The checksum of the previous data is
+// passed in, to continue the calculation, or zero to start a new one.
 static unsigned int
-hw_ostc3_firmware_checksum (const unsigned char data[], unsigned int size)
+hw_ostc3_firmware_checksum (unsigned int checksum, const unsigned char data[], unsigned int size)
 {
-	unsigned short low = 0;
-	unsigned short high = 0;
+	unsigned short low = checksum & 0xFFFF;
+	unsigned short high = checksum >> 16;
 	for (unsigned int i = 0; i < size; i++) {
 		low  += data[i];
 		high += low;
@@ -1027,45 +1299,75 @@ hw_ostc3_firmware_checksum (const unsigned char data[], unsigned int size)
 }
 
 static dc_status_t
-hw_ostc3_firmware_readline (FILE *fp, dc_context_t *context, unsigned int addr, unsigned char data[], unsigned int size)
+hw_ostc3_firmware_load (dc_buffer_t *buffer, dc_context_t *context, const char *filename)
+{
+	FILE *fp = NULL;
+
+	// Open the file.
+	fp = fopen (filename, "rb");
+	if (fp == NULL) {
+		ERROR (context, "Failed to open the file.");
+		return DC_STATUS_IO;
+	}
+
+	// Read the entire file into the buffer.
+	size_t n = 0;
+	unsigned char block[1024] = {0};
+	while ((n = fread (block, 1, sizeof (block), fp)) > 0) {
+		if (!dc_buffer_append (buffer, block, n)) {
+			ERROR (context, "Insufficient buffer space available.");
+			fclose (fp);
+			return DC_STATUS_NOMEMORY;
+		}
+	}
+
+	// Close the file.
+	fclose (fp);
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+hw_ostc3_firmware_readline (const unsigned char buffer[], size_t size, size_t *offset, dc_context_t *context, unsigned int addr, unsigned char data[], unsigned int n)
 {
-	unsigned char ascii[39];
+	const unsigned char *ascii = NULL;
 	unsigned char faddr_byte[3];
 	unsigned int faddr = 0;
-	int n = 0;
 
-	if (size > 16) {
+	if (n > 16) {
 		ERROR (context, "Invalid arguments.");
 		return DC_STATUS_INVALIDARGS;
 	}
 
-	// Read the start code.
+	// Find the start code.
 	while (1) {
-		n = fread (ascii, 1, 1, fp);
-		if (n != 1) {
+		if (*offset >= size) {
 			ERROR (context, "Failed to read the start code.");
 			return DC_STATUS_IO;
 		}
 
-		if (ascii[0] == ':')
+		unsigned char c = buffer[(*offset)++];
+		if (c == ':')
 			break;
 
 		// Ignore CR and LF characters.
-		if (ascii[0] != '\n' && ascii[0] != '\r') {
-			ERROR (context, "Unexpected character (0x%02x).", ascii[0]);
+		if (c != '\n' && c != '\r') {
+			ERROR (context, "Unexpected character (0x%02x).", c);
 			return DC_STATUS_DATAFORMAT;
 		}
 	}
 
-	// Read the payload.
-	n = fread (ascii + 1, 1, 6 + size * 2, fp);
-	if (n != 6 + size * 2) {
+	// Get the payload.
+	if (size - *offset < 6 + n * 2) {
 		ERROR (context, "Failed to read the data.");
 		return DC_STATUS_IO;
 	}
 
+	ascii = buffer + *offset;
+	*offset += 6 + n * 2;
+
 	// Convert the address to binary representation.
-	if (array_convert_hex2bin(ascii + 1, 6, faddr_byte, sizeof(faddr_byte)) != 0) {
+	if (array_convert_hex2bin(ascii, 6, faddr_byte, sizeof(faddr_byte)) != 0) {
 		ERROR (context, "Invalid hexadecimal character.");
 		return DC_STATUS_DATAFORMAT;
 	}
@@ -1078,7 +1380,7 @@ hw_ostc3_firmware_readline (FILE *fp, dc_context_t *context, unsigned int addr,
 	}
 
 	// Convert the payload to binary representation.
-	if (array_convert_hex2bin (ascii + 1 + 6, size * 2, data, size) != 0) {
+	if (array_convert_hex2bin (ascii + 6, n * 2, data, n) != 0) {
 		ERROR (context, "Invalid hexadecimal character.");
 		return DC_STATUS_DATAFORMAT;
 	}
@@ -1091,10 +1393,9 @@ static dc_status_t
 hw_ostc3_firmware_readfile3 (hw_ostc3_firmware_t *firmware, dc_context_t *context, const char *filename)
 {
 	dc_status_t rc = DC_STATUS_SUCCESS;
-	FILE *fp = NULL;
+	dc_buffer_t *buffer = NULL;
+	size_t offset = 0;
 	unsigned char iv[16] = {0};
-	unsigned char tmpbuf[16] = {0};
-	unsigned char encrypted[16] = {0};
 	unsigned int bytes = 0, addr = 0;
 	unsigned char checksum[4];
 
@@ -1107,51 +1408,54 @@ hw_ostc3_firmware_readfile3 (hw_ostc3_firmware_t *firmware, dc_context_t *contex
 	memset (firmware->data, 0xFF, sizeof (firmware->data));
 	firmware->checksum = 0;
 
-	fp = fopen (filename, "rb");
-	if (fp == NULL) {
-		ERROR (context, "Failed to open the file.");
-		return DC_STATUS_IO;
+	// Read the entire file into memory.
+	buffer = dc_buffer_new (0);
+	if (buffer == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	rc = hw_ostc3_firmware_load (buffer, context, filename);
+	if (rc != DC_STATUS_SUCCESS) {
+		dc_buffer_free (buffer);
+		return rc;
 	}
 
-	rc = hw_ostc3_firmware_readline (fp, context, 0, iv, sizeof(iv));
+	const unsigned char *data = dc_buffer_get_data (buffer);
+	size_t size = dc_buffer_get_size (buffer);
+
+	rc = hw_ostc3_firmware_readline (data, size, &offset, context, 0, iv, sizeof(iv));
 	if (rc != DC_STATUS_SUCCESS) {
 		ERROR (context, "Failed to parse header.");
-		fclose (fp);
+		dc_buffer_free (buffer);
 		return rc;
 	}
 	bytes += 16;
 
-	// Load the iv for AES-FCB-mode
-	AES128_ECB_encrypt (iv, ostc3_key, tmpbuf);
-
 	for (addr = 0; addr < SZ_FIRMWARE; addr += 16, bytes += 16) {
-		rc = hw_ostc3_firmware_readline (fp, context, bytes, encrypted, sizeof(encrypted));
+		rc = hw_ostc3_firmware_readline (data, size, &offset, context, bytes, firmware->data + addr, 16);
 		if (rc != DC_STATUS_SUCCESS) {
 			ERROR (context, "Failed to parse file data.");
-			fclose (fp);
+			dc_buffer_free (buffer);
 			return rc;
 		}
-
-		// Decrypt AES-FCB data
-		for (unsigned int i = 0; i < 16; i++)
-			firmware->data[addr + i] = encrypted[i] ^ tmpbuf[i];
-
-		// Run the next round of encryption
-		AES128_ECB_encrypt (encrypted, ostc3_key, tmpbuf);
 	}
 
+	// Decrypt the AES-CFB data in place.
+	AES128_CFB_decrypt_buffer (firmware->data, firmware->data, SZ_FIRMWARE, ostc3_key, iv);
+
 	// This file format contains a tail with the checksum in
-	rc = hw_ostc3_firmware_readline (fp, context, bytes, checksum, sizeof(checksum));
+	rc = hw_ostc3_firmware_readline (data, size, &offset, context, bytes, checksum, sizeof(checksum));
 	if (rc != DC_STATUS_SUCCESS) {
 		ERROR (context, "Failed to parse file tail.");
-		fclose (fp);
+		dc_buffer_free (buffer);
 		return rc;
 	}
 
-	fclose (fp);
+	dc_buffer_free (buffer);
 
 	unsigned int csum1 = array_uint32_le (checksum);
-	unsigned int csum2 = hw_ostc3_firmware_checksum (firmware->data, sizeof(firmware->data));
+	unsigned int csum2 = hw_ostc3_firmware_checksum (0, firmware->data, sizeof(firmware->data));
 	if (csum1 != csum2) {
 		ERROR (context, "Failed to verify file checksum.");
 		return DC_STATUS_DATAFORMAT;
@@ -1162,56 +1466,65 @@ hw_ostc3_firmware_readfile3 (hw_ostc3_firmware_t *firmware, dc_context_t *contex
 	return DC_STATUS_SUCCESS;
 }
 
+/*
+ * Verify the checksum at the end of the file, reading the file in blocks
+ * instead of loading it into memory. On success, the file position is
+ * back at the start, and the size excludes the checksum.
+ */
 static dc_status_t
-hw_ostc3_firmware_readfile4 (dc_buffer_t *buffer, dc_context_t *context, const char *filename)
+hw_ostc3_firmware_verify4 (FILE *fp, dc_context_t *context, unsigned int *size)
 {
-	FILE *fp = NULL;
-
-	if (buffer == NULL) {
-		ERROR (context, "Invalid arguments.");
-		return DC_STATUS_INVALIDARGS;
-	}
-
-	// Open the file.
-	fp = fopen (filename, "rb");
-	if (fp == NULL) {
-		ERROR (context, "Failed to open the file.");
+	// Get the file size.
+	long length = 0;
+	if (fseek (fp, 0, SEEK_END) != 0 || (length = ftell (fp)) < 0 ||
+		fseek (fp, 0, SEEK_SET) != 0) {
+		ERROR (context, "Failed to get the file size.");
 		return DC_STATUS_IO;
 	}
 
-	// Read the entire file into the buffer.
-	size_t n = 0;
-	unsigned char block[1024] = {0};
-	while ((n = fread (block, 1, sizeof (block), fp)) > 0) {
-		if (!dc_buffer_append (buffer, block, n)) {
-			ERROR (context, "Insufficient buffer space available.");
-			fclose (fp);
-			return DC_STATUS_NOMEMORY;
-		}
-	}
-
-	// Close the file.
-	fclose (fp);
-
 	// Verify the minimum size.
-	size_t size = dc_buffer_get_size (buffer);
-	if (size < 4) {
+	if (length < 4 || (unsigned long) length > UINT_MAX) {
 		ERROR (context, "Invalid file size.");
 		return DC_STATUS_DATAFORMAT;
+	}
+
+	// Calculate the checksum of the data.
+	unsigned int checksum = 0;
+	unsigned int nbytes = 0;
+	unsigned int remaining = length - 4;
+	unsigned char block[SZ_FIRMWARE_BLOCK];
+	while (nbytes < remaining) {
+		unsigned int len = sizeof (block);
+		if (nbytes + len > remaining)
+			len = remaining - nbytes;
+
+		if (fread (block, 1, len, fp) != len) {
+			ERROR (context, "Failed to read the file.");
+			return DC_STATUS_IO;
+		}
 
+		checksum = hw_ostc3_firmware_checksum (checksum, block, len);
+		nbytes += len;
 	}
 
 	// Verify the checksum.
-	const unsigned char *data = dc_buffer_get_data (buffer);
-	unsigned int csum1 = array_uint32_le (data + size - 4);
-	unsigned int csum2 = hw_ostc3_firmware_checksum (data, size - 4);
-	if (csum1 != csum2) {
+	unsigned char trailer[4] = {0};
+	if (fread (trailer, 1, sizeof (trailer), fp) != sizeof (trailer)) {
+		ERROR (context, "Failed to read the file.");
+		return DC_STATUS_IO;
+	}
+
+	if (array_uint32_le (trailer) != checksum) {
 		ERROR (context, "Failed to verify file checksum.");
 		return DC_STATUS_DATAFORMAT;
 	}
 
-	// Remove the checksum.
-	dc_buffer_slice (buffer, 0, size - 4);
+	if (fseek (fp, 0, SEEK_SET) != 0) {
+		ERROR (context, "Failed to rewind the file.");
+		return DC_STATUS_IO;
+	}
+
+	*size = remaining;
 
 	return DC_STATUS_SUCCESS;
 }
@@ -1240,6 +1553,38 @@ hw_ostc3_firmware_block_read (hw_ostc3_device_t *device, unsigned int addr, unsi
 	return hw_ostc3_transfer (device, NULL, S_BLOCK_READ, buffer, sizeof (buffer), block, block_size, NODELAY);
 }
 
+/*
+ * Read a range of the flash memory in service mode. The block read
+ * command accepts almost any size, so the range is read with a few
+ * large blocks, instead of a round trip for every 4KB page.
+ */
+static dc_status_t
+hw_ostc3_memory_read (hw_ostc3_device_t *device, dc_event_progress_t *progress, unsigned int addr, unsigned char data[], unsigned int size)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	unsigned int nbytes = 0;
+	while (nbytes < size) {
+		unsigned int len = size - nbytes;
+		if (len > SZ_MEMORY_BLOCK)
+			len = SZ_MEMORY_BLOCK;
+
+		unsigned char buffer[6];
+		array_uint24_be_set (buffer, addr + nbytes);
+		array_uint24_be_set (buffer + 3, len);
+
+		status = hw_ostc3_transfer (device, progress, S_BLOCK_READ, buffer, sizeof (buffer), data + nbytes, len, NODELAY);
+		if (status != DC_STATUS_SUCCESS) {
+			ERROR (device->base.context, "Failed to read block.");
+			return status;
+		}
+
+		nbytes += len;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
 static dc_status_t
 hw_ostc3_firmware_block_write (hw_ostc3_device_t *device, unsigned int addr, const unsigned char block[], unsigned int block_size)
 {
@@ -1278,7 +1623,9 @@ hw_ostc3_firmware_upgrade (dc_device_t *abstract, unsigned int checksum)
 	}
 
 	// Now the device resets, and if everything is well, it reprograms.
-	device->state = REBOOTING;
+	// The cached version data is no longer valid afterwards.
+	device_session_reset (abstract);
+	device_session_set_mode (abstract, REBOOTING);
 
 	return DC_STATUS_SUCCESS;
 }
@@ -1292,13 +1639,13 @@ hw_ostc3_device_fwupdate3 (dc_device_t *abstract, const char *filename)
 	dc_context_t *context = (abstract ? abstract->context : NULL);
 
 	// Enable progress notifications.
-	// load, erase, upload FZ, verify FZ, reprogram
+	// load, compare FZ, upload FZ, reprogram
 	dc_event_progress_t progress = EVENT_PROGRESS_INITIALIZER;
-	progress.maximum = 3 + SZ_FIRMWARE * 2 / SZ_FIRMWARE_BLOCK;
+	progress.maximum = 2 + SZ_FIRMWARE * 2 / SZ_FIRMWARE_BLOCK;
 	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
 
 	// Allocate memory for the firmware data.
-	hw_ostc3_firmware_t *firmware = (hw_ostc3_firmware_t *) malloc (sizeof (hw_ostc3_firmware_t));
+	hw_ostc3_firmware_t *firmware = (hw_ostc3_firmware_t *) device_malloc (abstract, sizeof (hw_ostc3_firmware_t));
 	if (firmware == NULL) {
 		ERROR (context, "Failed to allocate memory.");
 		return DC_STATUS_NOMEMORY;
@@ -1307,7 +1654,7 @@ hw_ostc3_device_fwupdate3 (dc_device_t *abstract, const char *filename)
 	// Read the hex file.
 	rc = hw_ostc3_firmware_readfile3 (firmware, context, filename);
 	if (rc != DC_STATUS_SUCCESS) {
-		free (firmware);
+		device_free (abstract, firmware);
 		return rc;
 	}
 
@@ -1315,68 +1662,74 @@ hw_ostc3_device_fwupdate3 (dc_device_t *abstract, const char *filename)
 	progress.current++;
 	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
 
-	hw_ostc3_device_display (abstract, " Erasing FW...");
-
-	rc = hw_ostc3_firmware_erase (device, FIRMWARE_AREA, SZ_FIRMWARE);
-	if (rc != DC_STATUS_SUCCESS) {
-		ERROR (context, "Failed to erase old firmware");
-		free (firmware);
-		return rc;
-	}
-
-	// Memory erased
-	progress.current++;
-	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
-
 	hw_ostc3_device_display (abstract, " Uploading...");
 
+	// The flash area usually still contains the previous upload, so only
+	// the blocks which differ are erased and written. Every block is read
+	// back and compared, so the entire area is still verified before the
+	// bootloader takes over.
+	unsigned int nwritten = 0;
 	for (unsigned int len = 0; len < SZ_FIRMWARE; len += SZ_FIRMWARE_BLOCK) {
+		unsigned char block[SZ_FIRMWARE_BLOCK];
 		char status[SZ_DISPLAY + 1]; // Status message on the display
 		snprintf (status, sizeof(status), " Uploading %2d%%", (100 * len) / SZ_FIRMWARE);
 		hw_ostc3_device_display (abstract, status);
 
-		rc = hw_ostc3_firmware_block_write (device, FIRMWARE_AREA + len, firmware->data + len, SZ_FIRMWARE_BLOCK);
+		rc = hw_ostc3_firmware_block_read (device, FIRMWARE_AREA + len, block, sizeof (block));
 		if (rc != DC_STATUS_SUCCESS) {
-			ERROR (context, "Failed to write block to device");
-			free(firmware);
+			ERROR (context, "Failed to read block.");
+			device_free (abstract, firmware);
 			return rc;
 		}
-		// One block uploaded
+
+		// One block compared
 		progress.current++;
 		device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
-	}
 
-	hw_ostc3_device_display (abstract, " Verifying...");
+		if (memcmp (firmware->data + len, block, sizeof (block)) != 0) {
+			rc = hw_ostc3_firmware_erase (device, FIRMWARE_AREA + len, SZ_FIRMWARE_BLOCK);
+			if (rc != DC_STATUS_SUCCESS) {
+				ERROR (context, "Failed to erase old firmware");
+				device_free (abstract, firmware);
+				return rc;
+			}
 
-	for (unsigned int len = 0; len < SZ_FIRMWARE; len += SZ_FIRMWARE_BLOCK) {
-		unsigned char block[SZ_FIRMWARE_BLOCK];
-		char status[SZ_DISPLAY + 1]; // Status message on the display
-		snprintf (status, sizeof(status), " Verifying %2d%%", (100 * len) / SZ_FIRMWARE);
-		hw_ostc3_device_display (abstract, status);
+			rc = hw_ostc3_firmware_block_write (device, FIRMWARE_AREA + len, firmware->data + len, SZ_FIRMWARE_BLOCK);
+			if (rc != DC_STATUS_SUCCESS) {
+				ERROR (context, "Failed to write block to device");
+				device_free (abstract, firmware);
+				return rc;
+			}
 
-		rc = hw_ostc3_firmware_block_read (device, FIRMWARE_AREA + len, block, sizeof (block));
-		if (rc != DC_STATUS_SUCCESS) {
-			ERROR (context, "Failed to read block.");
-			free (firmware);
-			return rc;
-		}
-		if (memcmp (firmware->data + len, block, sizeof (block)) != 0) {
-			ERROR (context, "Failed verify.");
-			hw_ostc3_device_display (abstract, " Verify FAILED");
-			free (firmware);
-			return DC_STATUS_PROTOCOL;
+			rc = hw_ostc3_firmware_block_read (device, FIRMWARE_AREA + len, block, sizeof (block));
+			if (rc != DC_STATUS_SUCCESS) {
+				ERROR (context, "Failed to read block.");
+				device_free (abstract, firmware);
+				return rc;
+			}
+			if (memcmp (firmware->data + len, block, sizeof (block)) != 0) {
+				ERROR (context, "Failed verify.");
+				hw_ostc3_device_display (abstract, " Verify FAILED");
+				device_free (abstract, firmware);
+				return DC_STATUS_PROTOCOL;
+			}
+
+			nwritten++;
 		}
-		// One block verified
+
+		// One block uploaded
 		progress.current++;
 		device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
 	}
 
+	INFO (context, "Uploaded %u of %u blocks.", nwritten, SZ_FIRMWARE / SZ_FIRMWARE_BLOCK);
+
 	hw_ostc3_device_display (abstract, " Programming...");
 
 	rc = hw_ostc3_firmware_upgrade (abstract, firmware->checksum);
 	if (rc != DC_STATUS_SUCCESS) {
 		ERROR (context, "Failed to start programing");
-		free (firmware);
+		device_free (abstract, firmware);
 		return rc;
 	}
 
@@ -1384,12 +1737,72 @@ hw_ostc3_device_fwupdate3 (dc_device_t *abstract, const char *filename)
 	progress.current++;
 	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
 
-	free (firmware);
+	device_free (abstract, firmware);
 
 	// Finished!
 	return DC_STATUS_SUCCESS;
 }
 
+/*
+ * Upload a firmware blob straight from the file, in blocks. The header
+ * of the blob has already been read from the file, and the file position
+ * is right after it.
+ */
+static dc_status_t
+hw_ostc3_firmware_upload4 (hw_ostc3_device_t *device, dc_event_progress_t *progress, FILE *fp, const unsigned char header[], unsigned int hsize, unsigned int length, unsigned int delay)
+{
+	dc_device_t *abstract = (dc_device_t *) device;
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (device_is_cancelled (abstract))
+		return DC_STATUS_CANCELLED;
+
+	const unsigned char ready = S_READY;
+
+	dc_usecs_t start = device_latency_start (abstract);
+
+	// Send the command.
+	status = hw_ostc3_command (device, S_UPLOAD, ready);
+	if (status != DC_STATUS_SUCCESS) {
+		return status;
+	}
+
+	// Send the blob one block at a time. The blocks contain a whole
+	// number of packets, such that the packets are identical to those of
+	// a single write with the entire blob.
+	unsigned char block[SZ_FIRMWARE_BLOCK];
+	size_t packetsize = (dc_iostream_get_transport (device->iostream) == DC_TRANSPORT_BLE) ? device->packetsize : 64;
+	unsigned int blocksize = sizeof (block) - sizeof (block) % packetsize;
+	unsigned int available = hsize;
+	unsigned int nbytes = 0;
+	memcpy (block, header, hsize);
+	while (nbytes < length) {
+		unsigned int len = blocksize;
+		if (nbytes + len > length)
+			len = length - nbytes;
+
+		// Read the data following the header, if any.
+		if (fread (block + available, 1, len - available, fp) != len - available) {
+			ERROR (abstract->context, "Failed to read the file.");
+			return DC_STATUS_IO;
+		}
+
+		status = hw_ostc3_write (device, progress, block, len);
+		if (status != DC_STATUS_SUCCESS) {
+			ERROR (abstract->context, "Failed to send the data packet.");
+			return status;
+		}
+
+		nbytes += len;
+		available = 0;
+	}
+
+	device_latency_emit (abstract, S_UPLOAD, 0, start);
+
+	// Wait for the ready byte.
+	return hw_ostc3_ready (device, S_UPLOAD, ready, delay);
+}
+
 static dc_status_t
 hw_ostc3_device_fwupdate4 (dc_device_t *abstract, const char *filename)
 {
@@ -1397,40 +1810,52 @@ hw_ostc3_device_fwupdate4 (dc_device_t *abstract, const char *filename)
 	hw_ostc3_device_t *device = (hw_ostc3_device_t *) abstract;
 	dc_context_t *context = (abstract ? abstract->context : NULL);
 
-	// Allocate memory for the firmware data.
-	dc_buffer_t *buffer = dc_buffer_new (0);
-	if (buffer == NULL) {
-		ERROR (context, "Failed to allocate memory.");
-		status = DC_STATUS_NOMEMORY;
-		goto error;
+	// Open the firmware file. The file is read in blocks, and never
+	// loaded into memory entirely.
+	FILE *fp = fopen (filename, "rb");
+	if (fp == NULL) {
+		ERROR (context, "Failed to open the file.");
+		return DC_STATUS_IO;
 	}
 
-	// Read the firmware file.
-	status = hw_ostc3_firmware_readfile4 (buffer, context, filename);
+	// Verify the firmware file. The checksum covers the entire file,
+	// and is verified before anything is uploaded.
+	unsigned int size = 0;
+	status = hw_ostc3_firmware_verify4 (fp, context, &size);
 	if (status != DC_STATUS_SUCCESS) {
 		goto error;
 	}
 
 	// Enable progress notifications.
 	dc_event_progress_t progress = EVENT_PROGRESS_INITIALIZER;
-	progress.maximum = dc_buffer_get_size (buffer);
+	progress.maximum = size;
 	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
 
-	// Cache the pointer and size.
-	const unsigned char *data = dc_buffer_get_data (buffer);
-	unsigned int size = dc_buffer_get_size (buffer);
-
 	unsigned int offset = 0;
 	while (offset + 4 <= size) {
+		// Read the header of the firmware blob.
+		unsigned char header[SZ_FWINFO + 12] = {0};
+		if (fread (header, 1, 4, fp) != 4) {
+			ERROR (context, "Failed to read the file.");
+			status = DC_STATUS_IO;
+			goto error;
+		}
+
 		// Get the length of the firmware blob.
-		unsigned int length = array_uint32_be(data + offset) + 20;
-		if (offset + length > size) {
+		unsigned int length = array_uint32_be(header) + 20;
+		if (length < sizeof (header) || length > size - offset) {
 			status = DC_STATUS_DATAFORMAT;
 			goto error;
 		}
 
+		if (fread (header + 4, 1, sizeof (header) - 4, fp) != sizeof (header) - 4) {
+			ERROR (context, "Failed to read the file.");
+			status = DC_STATUS_IO;
+			goto error;
+		}
+
 		// Get the blob type.
-		unsigned char type = data[offset + 4];
+		unsigned char type = header[4];
 
 		// Estimate the required delay.
 		// After uploading the firmware blob, the device writes the data
@@ -1453,7 +1878,7 @@ hw_ostc3_device_fwupdate4 (dc_device_t *abstract, const char *filename)
 		// Read the firmware version info.
 		unsigned char fwinfo[SZ_FWINFO] = {0};
 		status = hw_ostc3_transfer (device, NULL, S_FWINFO,
-			data + offset + 4, 1, fwinfo, sizeof(fwinfo), NODELAY);
+			header + 4, 1, fwinfo, sizeof(fwinfo), NODELAY);
 		if (status != DC_STATUS_SUCCESS) {
 			ERROR (abstract->context, "Failed to read the firmware info.");
 			goto error;
@@ -1462,15 +1887,22 @@ hw_ostc3_device_fwupdate4 (dc_device_t *abstract, const char *filename)
 		// Upload the firmware blob.
 		// The update is skipped if the two versions are already
 		// identical, or if the blob is not present on the device.
-		if (memcmp(data + offset + 12, fwinfo, sizeof(fwinfo)) != 0 &&
+		if (memcmp(header + 12, fwinfo, sizeof(fwinfo)) != 0 &&
 			!array_isequal(fwinfo, sizeof(fwinfo), 0xFF))
 		{
-			status = hw_ostc3_transfer (device, &progress, S_UPLOAD,
-				data + offset, length, NULL, 0, usecs / 1000);
+			status = hw_ostc3_firmware_upload4 (device, &progress, fp,
+				header, sizeof (header), length, usecs / 1000);
 			if (status != DC_STATUS_SUCCESS) {
 				goto error;
 			}
 		} else {
+			// Skip the remainder of the blob.
+			if (fseek (fp, length - sizeof (header), SEEK_CUR) != 0) {
+				ERROR (context, "Failed to seek the file.");
+				status = DC_STATUS_IO;
+				goto error;
+			}
+
 			// Update and emit a progress event.
 			progress.current += length;
 			device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
@@ -1480,7 +1912,7 @@ hw_ostc3_device_fwupdate4 (dc_device_t *abstract, const char *filename)
 	}
 
 error:
-	dc_buffer_free (buffer);
+	fclose (fp);
 	return status;
 }
 
@@ -1506,6 +1938,108 @@ hw_ostc3_device_fwupdate (dc_device_t *abstract, const char *filename)
 	}
 }
 
+dc_status_t
+hw_ostc3_device_get_logbook (dc_device_t *abstract, unsigned char data[], unsigned int size, unsigned int *counter)
+{
+	hw_ostc3_device_t *device = (hw_ostc3_device_t *) abstract;
+
+	if (!ISINSTANCE (abstract))
+		return DC_STATUS_INVALIDARGS;
+
+	if (size != HW_OSTC3_LOGBOOK_SIZE)
+		return DC_STATUS_INVALIDARGS;
+
+	if (device->cache_logbook == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	unsigned int latest = 0, maximum = 0;
+	hw_ostc3_logbook_latest (device, device->cache_logbook, &hw_ostc3_logbook_compact, &latest, &maximum);
+
+	memcpy (data, device->cache_logbook, HW_OSTC3_LOGBOOK_SIZE);
+	if (counter)
+		*counter = maximum;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+hw_ostc3_device_set_logbook (dc_device_t *abstract, const unsigned char data[], unsigned int size, unsigned int counter)
+{
+	hw_ostc3_device_t *device = (hw_ostc3_device_t *) abstract;
+
+	if (!ISINSTANCE (abstract))
+		return DC_STATUS_INVALIDARGS;
+
+	if (data == NULL) {
+		device->cache_valid = 0;
+		return DC_STATUS_SUCCESS;
+	}
+
+	if (size != HW_OSTC3_LOGBOOK_SIZE)
+		return DC_STATUS_INVALIDARGS;
+
+	// The cached headers are only used when the most recent dive still
+	// matches the internal dive counter of the device. Otherwise they
+	// are downloaded again, because the protocol has no command to read
+	// only the new entries.
+	unsigned int latest = 0, maximum = 0;
+	hw_ostc3_logbook_latest (device, data, &hw_ostc3_logbook_compact, &latest, &maximum);
+	if (maximum != counter) {
+		INFO (abstract->context, "Cached logbook is outdated (%u != %u).", maximum, counter);
+		device->cache_valid = 0;
+		return DC_STATUS_SUCCESS;
+	}
+
+	if (device->cache_logbook == NULL) {
+		device->cache_logbook = (unsigned char *) device_malloc (abstract, HW_OSTC3_LOGBOOK_SIZE);
+		if (device->cache_logbook == NULL) {
+			ERROR (abstract->context, "Failed to allocate memory.");
+			return DC_STATUS_NOMEMORY;
+		}
+	}
+
+	memcpy (device->cache_logbook, data, HW_OSTC3_LOGBOOK_SIZE);
+	device->cache_valid = 1;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+hw_ostc3_device_set_query (dc_device_t *abstract, const hw_ostc3_query_t *query)
+{
+	hw_ostc3_device_t *device = (hw_ostc3_device_t *) abstract;
+
+	if (!ISINSTANCE (abstract))
+		return DC_STATUS_INVALIDARGS;
+
+	if (query && query->nnumbers && query->numbers == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	unsigned int *numbers = NULL;
+	if (query && query->nnumbers) {
+		numbers = (unsigned int *) device_malloc (abstract, query->nnumbers * sizeof (unsigned int));
+		if (numbers == NULL) {
+			ERROR (abstract->context, "Failed to allocate memory.");
+			return DC_STATUS_NOMEMORY;
+		}
+		memcpy (numbers, query->numbers, query->nnumbers * sizeof (unsigned int));
+	}
+
+	device_free (abstract, device->numbers);
+	device->numbers = numbers;
+
+	if (query) {
+		device->selective = 1;
+		device->query = *query;
+		device->query.numbers = numbers;
+	} else {
+		device->selective = 0;
+		memset (&device->query, 0, sizeof (device->query));
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
 static dc_status_t
 hw_ostc3_device_read (dc_device_t *abstract, unsigned int address, unsigned char data[], unsigned int size)
 {
@@ -1528,19 +2062,7 @@ hw_ostc3_device_read (dc_device_t *abstract, unsigned int address, unsigned char
 		return DC_STATUS_UNSUPPORTED;
 	}
 
-	unsigned int nbytes = 0;
-	while (nbytes < size) {
-		// Read a memory page.
-		status = hw_ostc3_firmware_block_read (device, address + nbytes, data + nbytes, SZ_FIRMWARE_BLOCK);
-		if (status != DC_STATUS_SUCCESS) {
-			ERROR (abstract->context, "Failed to read block.");
-			return status;
-		}
-
-		nbytes += SZ_FIRMWARE_BLOCK;
-	}
-
-	return DC_STATUS_SUCCESS;
+	return hw_ostc3_memory_read (device, NULL, address, data, size);
 }
 
 static dc_status_t
@@ -1609,26 +2131,5 @@ hw_ostc3_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 		return DC_STATUS_NOMEMORY;
 	}
 
-	unsigned char *data = dc_buffer_get_data (buffer);
-
-	unsigned int nbytes = 0;
-	while (nbytes < SZ_MEMORY) {
-		// packet size. Can be almost arbetary size.
-		unsigned int len = SZ_FIRMWARE_BLOCK;
-
-		// Read a block
-		rc = hw_ostc3_firmware_block_read (device, nbytes, data + nbytes, len);
-		if (rc != DC_STATUS_SUCCESS) {
-			ERROR (abstract->context, "Failed to read block.");
-			return rc;
-		}
-
-		// Update and emit a progress event.
-		progress.current += len;
-		device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
-
-		nbytes += len;
-	}
-
-	return DC_STATUS_SUCCESS;
+	return hw_ostc3_memory_read (device, &progress, 0, dc_buffer_get_data (buffer), SZ_MEMORY);
 }
@@ -19,6 +19,8 @@
  * MA 02110-1301 USA
  */
 
+#define LOG_SUBSYSTEM DC_LOGSUBSYSTEM_PARSER
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -34,11 +36,15 @@
 #include "context-private.h"
 #include "parser-private.h"
 #include "array.h"
+#include "gastable.h"
+#include "pool.h"
 
 #define ISINSTANCE(parser) dc_parser_isinstance((parser), &hw_ostc_parser_vtable)
 
 #define MAXCONFIG 7
+#define MAXPERIOD 64
 #define NGASMIXES 15
+#define BUFLEN    32
 
 #define UNDEFINED 0xFFFFFFFF
 
@@ -81,6 +87,19 @@ typedef struct hw_ostc_sample_info_t {
 	unsigned int size;
 } hw_ostc_sample_info_t;
 
+/*
+ * Decode schedule for the extended sample info of one sample: the
+ * fields to decode (in profile order), their offset and size, and the
+ * total number of bytes (including the fields that are skipped).
+ */
+typedef struct hw_ostc_schedule_t {
+	unsigned int count;
+	unsigned int size;
+	unsigned char type[MAXCONFIG];
+	unsigned char width[MAXCONFIG];
+	unsigned short offset[MAXCONFIG];
+} hw_ostc_schedule_t;
+
 typedef struct hw_ostc_layout_t {
 	unsigned int datetime;
 	unsigned int maxdepth;
@@ -120,12 +139,29 @@ typedef struct hw_ostc_parser_t {
 	unsigned int initial_setpoint;
 	unsigned int initial_cns;
 	hw_ostc_gasmix_t gasmix[NGASMIXES];
+	dc_gastable_t gastable;
+	// Cached profile layout.
+	unsigned int scheduled;
+	unsigned int profile;
+	unsigned int samplerate;
+	double hydrostatic;
+	unsigned int firmware;
+	unsigned int nconfig;
+	hw_ostc_sample_info_t info[MAXCONFIG];
+	// The schedules repeat with a period equal to the least common
+	// multiple of the divisors. A zero period indicates the schedule is
+	// too long to precompute.
+	unsigned int period;
+	hw_ostc_schedule_t schedule[MAXPERIOD];
+	// Storage for the string fields, interned across dives.
+	dc_strpool_t strings;
 } hw_ostc_parser_t;
 
 static dc_status_t hw_ostc_parser_set_data (dc_parser_t *abstract, const unsigned char *data, unsigned int size);
 static dc_status_t hw_ostc_parser_get_datetime (dc_parser_t *abstract, dc_datetime_t *datetime);
 static dc_status_t hw_ostc_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, unsigned int flags, void *value);
 static dc_status_t hw_ostc_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t callback, void *userdata);
+static dc_status_t hw_ostc_parser_destroy (dc_parser_t *abstract);
 
 static const dc_parser_vtable_t hw_ostc_parser_vtable = {
 	sizeof(hw_ostc_parser_t),
@@ -134,7 +170,7 @@ static const dc_parser_vtable_t hw_ostc_parser_vtable = {
 	hw_ostc_parser_get_datetime, /* datetime */
 	hw_ostc_parser_get_field, /* fields */
 	hw_ostc_parser_samples_foreach, /* samples_foreach */
-	NULL /* destroy */
+	hw_ostc_parser_destroy /* destroy */
 };
 
 static const hw_ostc_layout_t hw_ostc_layout_ostc = {
@@ -191,27 +227,6 @@ static const hw_ostc_layout_t hw_ostc_layout_ostc3 = {
         59,  /* battery percentage */
 };
 
-static unsigned int
-hw_ostc_find_gasmix (hw_ostc_parser_t *parser, unsigned int o2, unsigned int he, unsigned int type)
-{
-	unsigned int offset = 0;
-	unsigned int count = parser->ngasmixes;
-	if (type == FIXED) {
-		count = parser->nfixed;
-	} else if (type == MANUAL) {
-		offset = parser->nfixed;
-	}
-
-	unsigned int i = offset;
-	while (i < count) {
-		if (o2 == parser->gasmix[i].oxygen && he == parser->gasmix[i].helium)
-			break;
-		i++;
-	}
-
-	return i;
-}
-
 static dc_status_t
 hw_ostc_parser_cache (hw_ostc_parser_t *parser)
 {
@@ -322,14 +337,214 @@ hw_ostc_parser_cache (hw_ostc_parser_t *parser)
 	parser->initial = initial;
 	parser->initial_setpoint = initial_setpoint;
 	parser->initial_cns = initial_cns;
+	dc_gastable_init (&parser->gastable);
 	for (unsigned int i = 0; i < ngasmixes; ++i) {
 		parser->gasmix[i] = gasmix[i];
+		dc_gastable_add (&parser->gastable, GASTABLE_KEY (gasmix[i].oxygen, gasmix[i].helium, FIXED));
 	}
 	parser->cached = HEADER;
 
 	return DC_STATUS_SUCCESS;
 }
 
+static void
+hw_ostc_parser_schedule (hw_ostc_parser_t *parser, hw_ostc_schedule_t *schedule, unsigned int nsamples)
+{
+	schedule->count = 0;
+	schedule->size = 0;
+
+	for (unsigned int i = 0; i < parser->nconfig; ++i) {
+		const hw_ostc_sample_info_t *info = parser->info + i;
+		if (info->divisor == 0 || (nsamples % info->divisor) != 0)
+			continue;
+
+		unsigned int decode = 0;
+		switch (info->type) {
+		case 0: // Temperature
+		case 3: // ppO2
+		case 5: // CNS
+		case 6: // Tank pressure
+			decode = 1;
+			break;
+		case 1: // Deco / NDL
+			// Due to a firmware bug, the deco/ndl info is incorrect for
+			// all OSTC4 dives with a firmware older than version 1.0.8.
+			decode = parser->model != OSTC4 || parser->firmware >= 0x0810;
+			break;
+		default: // Not yet used.
+			break;
+		}
+
+		if (decode) {
+			unsigned int n = schedule->count++;
+			schedule->type[n] = info->type;
+			schedule->width[n] = info->size;
+			schedule->offset[n] = schedule->size;
+		}
+
+		schedule->size += info->size;
+	}
+}
+
+static unsigned int
+hw_ostc_gcd (unsigned int a, unsigned int b)
+{
+	while (b) {
+		unsigned int t = a % b;
+		a = b;
+		b = t;
+	}
+
+	return a;
+}
+
+static dc_status_t
+hw_ostc_parser_cache_samples (hw_ostc_parser_t *parser)
+{
+	dc_parser_t *abstract = (dc_parser_t *) parser;
+	const unsigned char *data = abstract->data;
+	unsigned int size = abstract->size;
+
+	if (parser->scheduled) {
+		return DC_STATUS_SUCCESS;
+	}
+
+	unsigned int version = parser->version;
+	unsigned int header = parser->header;
+	const hw_ostc_layout_t *layout = parser->layout;
+
+	// Exit if no profile data available.
+	if (size == header || (size == header + 2 &&
+		data[header] == 0xFD && data[header + 1] == 0xFD)) {
+		parser->profile = 0;
+		parser->scheduled = 1;
+		return DC_STATUS_SUCCESS;
+	}
+
+	// Check the header length.
+	if (version == 0x23 || version == 0x24) {
+		if (size < header + 5) {
+			ERROR (abstract->context, "Buffer overflow detected!");
+			return DC_STATUS_DATAFORMAT;
+		}
+	}
+
+	// Get the sample rate.
+	unsigned int samplerate = 0;
+	if (version == 0x23 || version == 0x24)
+		samplerate = data[header + 3];
+	else
+		samplerate = data[36];
+
+	// Get the salinity factor.
+	unsigned int salinity = data[layout->salinity];
+	if (version == 0x23 || version == 0x24)
+		salinity += 100;
+	if (salinity < 100 || salinity > 104)
+		salinity = 100;
+	double hydrostatic = GRAVITY * salinity * 10.0;
+
+	// Get the number of sample descriptors.
+	unsigned int nconfig = 0;
+	if (version == 0x23 || version == 0x24)
+		nconfig = data[header + 4];
+	else
+		nconfig = 6;
+	if (nconfig > MAXCONFIG) {
+		ERROR(abstract->context, "Too many sample descriptors.");
+		return DC_STATUS_DATAFORMAT;
+	}
+
+	// Check the header length.
+	if (version == 0x23 || version == 0x24) {
+		if (size < header + 5 + 3 * nconfig) {
+			ERROR (abstract->context, "Buffer overflow detected!");
+			return DC_STATUS_DATAFORMAT;
+		}
+	}
+
+	// Get the extended sample configuration.
+	hw_ostc_sample_info_t info[MAXCONFIG] = {{0}};
+	for (unsigned int i = 0; i < nconfig; ++i) {
+		if (version == 0x23 || version == 0x24) {
+			info[i].type    = data[header + 5 + 3 * i + 0];
+			info[i].size    = data[header + 5 + 3 * i + 1];
+			info[i].divisor = data[header + 5 + 3 * i + 2];
+		} else {
+			info[i].type    = i;
+			info[i].divisor = (data[37 + i] & 0x0F);
+			info[i].size    = (data[37 + i] & 0xF0) >> 4;
+		}
+
+		if (info[i].divisor) {
+			switch (info[i].type) {
+			case 0: // Temperature
+			case 1: // Deco / NDL
+			case 6: // Tank pressure
+				if (info[i].size != 2) {
+					ERROR(abstract->context, "Unexpected sample size.");
+					return DC_STATUS_DATAFORMAT;
+				}
+				break;
+			case 3: // ppO2
+				if (info[i].size != 3 && info[i].size != 9) {
+					ERROR(abstract->context, "Unexpected sample size.");
+					return DC_STATUS_DATAFORMAT;
+				}
+				break;
+			case 5: // CNS
+				if (info[i].size != 1 && info[i].size != 2) {
+					ERROR(abstract->context, "Unexpected sample size.");
+					return DC_STATUS_DATAFORMAT;
+				}
+				break;
+			default: // Not yet used.
+				break;
+			}
+		}
+	}
+
+	// Get the firmware version.
+	unsigned int firmware = 0;
+	if (parser->model == OSTC4) {
+		firmware = array_uint16_le (data + layout->firmware);
+	} else {
+		firmware = array_uint16_be (data + layout->firmware);
+	}
+
+	// Get the offset of the first sample.
+	unsigned int profile = header;
+	if (version == 0x23 || version == 0x24)
+		profile += 5 + 3 * nconfig;
+
+	// Cache the data for later use.
+	parser->profile = profile;
+	parser->samplerate = samplerate;
+	parser->hydrostatic = hydrostatic;
+	parser->firmware = firmware;
+	parser->nconfig = nconfig;
+	for (unsigned int i = 0; i < nconfig; ++i) {
+		parser->info[i] = info[i];
+	}
+
+	// Precompute the schedules for one period.
+	unsigned int period = 1;
+	for (unsigned int i = 0; i < nconfig && period; ++i) {
+		if (info[i].divisor == 0)
+			continue;
+		period = period / hw_ostc_gcd (period, info[i].divisor) * info[i].divisor;
+		if (period > MAXPERIOD)
+			period = 0;
+	}
+	for (unsigned int i = 0; i < period; ++i) {
+		hw_ostc_parser_schedule (parser, parser->schedule + i, i);
+	}
+	parser->period = period;
+	parser->scheduled = 1;
+
+	return DC_STATUS_SUCCESS;
+}
+
 static dc_status_t
 hw_ostc_parser_create_internal (dc_parser_t **out, dc_context_t *context, unsigned int serial, unsigned int hwos, unsigned int model)
 {
@@ -361,7 +576,10 @@ hw_ostc_parser_create_internal (dc_parser_t **out, dc_context_t *context, unsign
 		parser->gasmix[i].oxygen = 0;
 		parser->gasmix[i].helium = 0;
 	}
+	dc_gastable_init (&parser->gastable);
+	parser->scheduled = 0;
 	parser->serial = serial;
+	dc_strpool_init (&parser->strings, context);
 
 	*out = (dc_parser_t *) parser;
 
@@ -400,6 +618,19 @@ hw_ostc_parser_set_data (dc_parser_t *abstract, const unsigned char *data, unsig
 		parser->gasmix[i].oxygen = 0;
 		parser->gasmix[i].helium = 0;
 	}
+	dc_gastable_init (&parser->gastable);
+	parser->scheduled = 0;
+	dc_strpool_trim (&parser->strings);
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+hw_ostc_parser_destroy (dc_parser_t *abstract)
+{
+	hw_ostc_parser_t *parser = (hw_ostc_parser_t *) abstract;
+
+	dc_strpool_cleanup (&parser->strings);
 
 	return DC_STATUS_SUCCESS;
 }
@@ -466,8 +697,6 @@ hw_ostc_parser_get_datetime (dc_parser_t *abstract, dc_datetime_t *datetime)
 	return DC_STATUS_SUCCESS;
 }
 
-#define BUFLEN 32
-
 static dc_status_t
 hw_ostc_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, unsigned int flags, void *value)
 {
@@ -666,7 +895,9 @@ hw_ostc_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, unsigned
 			default:
 				return DC_STATUS_UNSUPPORTED;
 			}
-			string->value = strdup(buf);
+			string->value = dc_strpool_intern (&parser->strings, buf);
+			if (string->value == NULL)
+				return DC_STATUS_NOMEMORY;
 			break;
 		default:
 			return DC_STATUS_UNSUPPORTED;
@@ -690,114 +921,27 @@ hw_ostc_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t call
 		return rc;
 
 	unsigned int version = parser->version;
-	unsigned int header = parser->header;
-	const hw_ostc_layout_t *layout = parser->layout;
+
+	// Cache the profile layout.
+	rc = hw_ostc_parser_cache_samples (parser);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
 
 	// Exit if no profile data available.
-	if (size == header || (size == header + 2 &&
-		data[header] == 0xFD && data[header + 1] == 0xFD)) {
+	if (parser->profile == 0) {
 		parser->cached = PROFILE;
 		return DC_STATUS_SUCCESS;
 	}
 
-	// Check the header length.
-	if (version == 0x23 || version == 0x24) {
-		if (size < header + 5) {
-			ERROR (abstract->context, "Buffer overflow detected!");
-			return DC_STATUS_DATAFORMAT;
-		}
-	}
-
-	// Get the sample rate.
-	unsigned int samplerate = 0;
-	if (version == 0x23 || version == 0x24)
-		samplerate = data[header + 3];
-	else
-		samplerate = data[36];
-
-	// Get the salinity factor.
-	unsigned int salinity = data[layout->salinity];
-	if (version == 0x23 || version == 0x24)
-		salinity += 100;
-	if (salinity < 100 || salinity > 104)
-		salinity = 100;
-	double hydrostatic = GRAVITY * salinity * 10.0;
-
-	// Get the number of sample descriptors.
-	unsigned int nconfig = 0;
-	if (version == 0x23 || version == 0x24)
-		nconfig = data[header + 4];
-	else
-		nconfig = 6;
-	if (nconfig > MAXCONFIG) {
-		ERROR(abstract->context, "Too many sample descriptors.");
-		return DC_STATUS_DATAFORMAT;
-	}
-
-	// Check the header length.
-	if (version == 0x23 || version == 0x24) {
-		if (size < header + 5 + 3 * nconfig) {
-			ERROR (abstract->context, "Buffer overflow detected!");
-			return DC_STATUS_DATAFORMAT;
-		}
-	}
-
-	// Get the extended sample configuration.
-	hw_ostc_sample_info_t info[MAXCONFIG] = {{0}};
-	for (unsigned int i = 0; i < nconfig; ++i) {
-		if (version == 0x23 || version == 0x24) {
-			info[i].type    = data[header + 5 + 3 * i + 0];
-			info[i].size    = data[header + 5 + 3 * i + 1];
-			info[i].divisor = data[header + 5 + 3 * i + 2];
-		} else {
-			info[i].type    = i;
-			info[i].divisor = (data[37 + i] & 0x0F);
-			info[i].size    = (data[37 + i] & 0xF0) >> 4;
-		}
-
-		if (info[i].divisor) {
-			switch (info[i].type) {
-			case 0: // Temperature
-			case 1: // Deco / NDL
-			case 6: // Tank pressure
-				if (info[i].size != 2) {
-					ERROR(abstract->context, "Unexpected sample size.");
-					return DC_STATUS_DATAFORMAT;
-				}
-				break;
-			case 3: // ppO2
-				if (info[i].size != 3 && info[i].size != 9) {
-					ERROR(abstract->context, "Unexpected sample size.");
-					return DC_STATUS_DATAFORMAT;
-				}
-				break;
-			case 5: // CNS
-				if (info[i].size != 1 && info[i].size != 2) {
-					ERROR(abstract->context, "Unexpected sample size.");
-					return DC_STATUS_DATAFORMAT;
-				}
-				break;
-			default: // Not yet used.
-				break;
-			}
-		}
-	}
-
-	// Get the firmware version.
-	unsigned int firmware = 0;
-	if (parser->model == OSTC4) {
-		firmware = array_uint16_le (data + layout->firmware);
-	} else {
-		firmware = array_uint16_be (data + layout->firmware);
-	}
+	unsigned int samplerate = parser->samplerate;
+	double hydrostatic = parser->hydrostatic;
 
 	unsigned int time = 0;
 	unsigned int nsamples = 0;
 	unsigned int tank = parser->initial != UNDEFINED ? parser->initial : 0;
+	hw_ostc_schedule_t current;
 
-	unsigned int offset = header;
-	if (version == 0x23 || version == 0x24)
-		offset += 5 + 3 * nconfig;
+	unsigned int offset = parser->profile;
 	while (offset + 3 <= size) {
 		dc_sample_value_t sample = {0};
 
@@ -898,12 +1042,13 @@ hw_ostc_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t call
 			}
 			unsigned int o2 = data[offset];
 			unsigned int he = data[offset + 1];
-			unsigned int idx = hw_ostc_find_gasmix (parser, o2, he, MANUAL);
+			unsigned int idx = dc_gastable_find (&parser->gastable, GASTABLE_KEY (o2, he, MANUAL));
 			if (idx >= parser->ngasmixes) {
 				if (idx >= NGASMIXES) {
 					ERROR (abstract->context, "Maximum number of gas mixes reached.");
 					return DC_STATUS_NOMEMORY;
 				}
+				dc_gastable_add (&parser->gastable, GASTABLE_KEY (o2, he, MANUAL));
 				parser->gasmix[idx].oxygen = o2;
 				parser->gasmix[idx].helium = he;
 				parser->ngasmixes = idx + 1;
@@ -956,12 +1101,13 @@ hw_ostc_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t call
 
 				unsigned int o2 = data[offset];
 				unsigned int he = data[offset + 1];
-				unsigned int idx = hw_ostc_find_gasmix (parser, o2, he, MANUAL);
+				unsigned int idx = dc_gastable_find (&parser->gastable, GASTABLE_KEY (o2, he, MANUAL));
 				if (idx >= parser->ngasmixes) {
 					if (idx >= NGASMIXES) {
 						ERROR (abstract->context, "Maximum number of gas mixes reached.");
 						return DC_STATUS_NOMEMORY;
 					}
+					dc_gastable_add (&parser->gastable, GASTABLE_KEY (o2, he, MANUAL));
 					parser->gasmix[idx].oxygen = o2;
 					parser->gasmix[idx].helium = he;
 					parser->ngasmixes = idx + 1;
@@ -975,77 +1121,77 @@ hw_ostc_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t call
 		}
 
 		// Extended sample info.
-		for (unsigned int i = 0; i < nconfig; ++i) {
-			if (info[i].divisor && (nsamples % info[i].divisor) == 0) {
-				if (length < info[i].size) {
-					ERROR (abstract->context, "Buffer overflow detected!");
-					return DC_STATUS_DATAFORMAT;
+		const hw_ostc_schedule_t *schedule = parser->schedule;
+		if (parser->period) {
+			schedule += nsamples % parser->period;
+		} else {
+			hw_ostc_parser_schedule (parser, &current, nsamples);
+			schedule = &current;
+		}
+		unsigned int nfields = schedule->count;
+		if (length < schedule->size) {
+			// Decode only the fields that are still available.
+			while (nfields && schedule->offset[nfields - 1] + schedule->width[nfields - 1] > length)
+				nfields--;
+		}
+		for (unsigned int i = 0; i < nfields; ++i) {
+			const unsigned char *p = data + offset + schedule->offset[i];
+			unsigned int ppo2[3] = {0};
+			unsigned int count = 0;
+			unsigned int value = 0;
+			switch (schedule->type[i]) {
+			case 0: // Temperature (0.1 °C).
+				value = array_uint16_le (p);
+				sample.temperature = value / 10.0;
+				if (callback) callback (DC_SAMPLE_TEMPERATURE, sample, userdata);
+				break;
+			case 1: // Deco / NDL
+				if (p[0]) {
+					sample.deco.type = DC_DECO_DECOSTOP;
+					sample.deco.depth = p[0];
+				} else {
+					sample.deco.type = DC_DECO_NDL;
+					sample.deco.depth = 0.0;
 				}
-
-				unsigned int ppo2[3] = {0};
-				unsigned int count = 0;
-				unsigned int value = 0;
-				switch (info[i].type) {
-				case 0: // Temperature (0.1 °C).
-					value = array_uint16_le (data + offset);
-					sample.temperature = value / 10.0;
-					if (callback) callback (DC_SAMPLE_TEMPERATURE, sample, userdata);
-					break;
-				case 1: // Deco / NDL
-					// Due to a firmware bug, the deco/ndl info is incorrect for
-					// all OSTC4 dives with a firmware older than version 1.0.8.
-					if (parser->model == OSTC4 && firmware < 0x0810)
-						break;
-					if (data[offset]) {
-						sample.deco.type = DC_DECO_DECOSTOP;
-						sample.deco.depth = data[offset];
-					} else {
-						sample.deco.type = DC_DECO_NDL;
-						sample.deco.depth = 0.0;
-					}
-					sample.deco.time = data[offset + 1] * 60;
-					if (callback) callback (DC_SAMPLE_DECO, sample, userdata);
-					break;
-				case 3: // ppO2 (0.01 bar).
+				sample.deco.time = p[1] * 60;
+				if (callback) callback (DC_SAMPLE_DECO, sample, userdata);
+				break;
+			case 3: // ppO2 (0.01 bar).
+				for (unsigned int j = 0; j < 3; ++j) {
+					ppo2[j] = p[j * (schedule->width[i] / 3)];
+					if (ppo2[j] != 0)
+						count++;
+				}
+				if (count) {
 					for (unsigned int j = 0; j < 3; ++j) {
-						if (info[i].size == 3) {
-							ppo2[j] = data[offset + j];
-						} else {
-							ppo2[j] = data[offset + j * 3];
-						}
-						if (ppo2[j] != 0)
-							count++;
-					}
-					if (count) {
-						for (unsigned int j = 0; j < 3; ++j) {
-							sample.ppo2 = ppo2[j] / 100.0;
-							if (callback) callback (DC_SAMPLE_PPO2, sample, userdata);
-						}
-					}
-					break;
-				case 5: // CNS
-					if (info[i].size == 2)
-						sample.cns = array_uint16_le (data + offset) / 100.0;
-					else
-						sample.cns = data[offset] / 100.0;
-					if (callback) callback (DC_SAMPLE_CNS, sample, userdata);
-					break;
-				case 6: // Tank pressure
-					value = array_uint16_le (data + offset);
-					if (value != 0) {
-						sample.pressure.tank = tank;
-						sample.pressure.value = value / 10.0;
-						if (callback) callback (DC_SAMPLE_PRESSURE, sample, userdata);
+						sample.ppo2 = ppo2[j] / 100.0;
+						if (callback) callback (DC_SAMPLE_PPO2, sample, userdata);
 					}
-					break;
-				default: // Not yet used.
-					break;
 				}
-
-				offset += info[i].size;
-				length -= info[i].size;
+				break;
+			case 5: // CNS
+				if (schedule->width[i] == 2)
+					sample.cns = array_uint16_le (p) / 100.0;
+				else
+					sample.cns = p[0] / 100.0;
+				if (callback) callback (DC_SAMPLE_CNS, sample, userdata);
+				break;
+			case 6: // Tank pressure
+				value = array_uint16_le (p);
+				if (value != 0) {
+					sample.pressure.tank = tank;
+					sample.pressure.value = value / 10.0;
+					if (callback) callback (DC_SAMPLE_PRESSURE, sample, userdata);
+				}
+				break;
 			}
 		}
+		if (length < schedule->size) {
+			ERROR (abstract->context, "Buffer overflow detected!");
+			return DC_STATUS_DATAFORMAT;
+		}
+		offset += schedule->size;
+		length -= schedule->size;
 
 		if (version != 0x23 && version != 0x24) {
 			// SetPoint Change
@@ -1069,12 +1215,13 @@ hw_ostc_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t call
 
 				unsigned int o2 = data[offset];
 				unsigned int he = data[offset + 1];
-				unsigned int idx = hw_ostc_find_gasmix (parser, o2, he, MANUAL);
+				unsigned int idx = dc_gastable_find (&parser->gastable, GASTABLE_KEY (o2, he, MANUAL));
 				if (idx >= parser->ngasmixes) {
 					if (idx >= NGASMIXES) {
 						ERROR (abstract->context, "Maximum number of gas mixes reached.");
 						return DC_STATUS_NOMEMORY;
 					}
+					dc_gastable_add (&parser->gastable, GASTABLE_KEY (o2, he, MANUAL));
 					parser->gasmix[idx].oxygen = o2;
 					parser->gasmix[idx].helium = he;
 					parser->ngasmixes = idx + 1;
@@ -1094,7 +1241,8 @@ hw_ostc_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t call
 		offset += length;
 	}
 
-	if (offset + 2 > size || data[offset] != 0xFD || data[offset + 1] != 0xFD) {
+	if (!(abstract->flags & DC_PARSER_FLAG_TRUSTED) &&
+		(offset + 2 > size || data[offset] != 0xFD || data[offset + 1] != 0xFD)) {
 		ERROR (abstract->context, "Invalid end marker found!");
 		return DC_STATUS_DATAFORMAT;
 	}
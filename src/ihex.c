@@ -29,15 +29,20 @@
 #include "checksum.h"
 #include "array.h"
 
+#define BLOCKSIZE 65536
+
 struct dc_ihex_file_t {
 	dc_context_t *context;
-	FILE *fp;
+	unsigned char *data;
+	size_t size;
+	size_t offset;
 };
 
 dc_status_t
 dc_ihex_file_open (dc_ihex_file_t **result, dc_context_t *context, const char *filename)
 {
 	dc_ihex_file_t *file = NULL;
+	FILE *fp = NULL;
 
 	if (result == NULL || filename == NULL) {
 		ERROR (context, "Invalid arguments.");
@@ -51,14 +56,51 @@ dc_ihex_file_open (dc_ihex_file_t **result, dc_context_t *context, const char *f
 	}
 
 	file->context = context;
+	file->data = NULL;
+	file->size = 0;
+	file->offset = 0;
 
-	file->fp = fopen (filename, "rb");
-	if (file->fp == NULL) {
+	fp = fopen (filename, "rb");
+	if (fp == NULL) {
 		ERROR (context, "Failed to open the file.");
 		free (file);
 		return DC_STATUS_IO;
 	}
 
+	/* Read the entire file into memory. The records are parsed directly
+	 * from the buffer, instead of reading them character by character. */
+	size_t capacity = 0;
+	while (1) {
+		if (file->size == capacity) {
+			unsigned char *data = (unsigned char *) realloc (file->data, capacity + BLOCKSIZE);
+			if (data == NULL) {
+				ERROR (context, "Failed to allocate memory.");
+				fclose (fp);
+				free (file->data);
+				free (file);
+				return DC_STATUS_NOMEMORY;
+			}
+			file->data = data;
+			capacity += BLOCKSIZE;
+		}
+
+		size_t n = fread (file->data + file->size, 1, capacity - file->size, fp);
+		if (n == 0) {
+			if (ferror (fp)) {
+				ERROR (context, "Failed to read the file.");
+				fclose (fp);
+				free (file->data);
+				free (file);
+				return DC_STATUS_IO;
+			}
+			break;
+		}
+
+		file->size += n;
+	}
+
+	fclose (fp);
+
 	*result = file;
 
 	return DC_STATUS_SUCCESS;
@@ -67,48 +109,40 @@ dc_ihex_file_open (dc_ihex_file_t **result, dc_context_t *context, const char *f
 dc_status_t
 dc_ihex_file_read (dc_ihex_file_t *file, dc_ihex_entry_t *entry)
 {
-	unsigned char ascii[9 + 2 * 255 + 2] = {0};
 	unsigned char data[4 + 255 + 1] = {0};
 	unsigned int type, length, address;
 	unsigned char csum_a, csum_b;
-	size_t n;
 
 	if (file == NULL || entry == NULL) {
 		ERROR (file ? file->context : NULL, "Invalid arguments.");
 		return DC_STATUS_INVALIDARGS;
 	}
 
-	/* Read the start code. */
+	/* Find the start code. */
 	while (1) {
-		n = fread (ascii, 1, 1, file->fp);
-		if (n != 1) {
-			if (feof (file->fp)) {
-				return DC_STATUS_DONE;
-			} else {
-				ERROR (file->context, "Failed to read the start code.");
-				return DC_STATUS_IO;
-			}
-		}
+		if (file->offset >= file->size)
+			return DC_STATUS_DONE;
 
-		if (ascii[0] == ':')
+		unsigned char c = file->data[file->offset++];
+		if (c == ':')
 			break;
 
 		/* Ignore CR and LF characters. */
-		if (ascii[0] != '\n' && ascii[0] != '\r') {
-			ERROR (file->context, "Unexpected character (0x%02x).", ascii[0]);
+		if (c != '\n' && c != '\r') {
+			ERROR (file->context, "Unexpected character (0x%02x).", c);
 			return DC_STATUS_DATAFORMAT;
 		}
 	}
 
-	/* Read the record length, address and type. */
-	n = fread (ascii + 1, 1, 8, file->fp);
-	if (n != 8) {
+	/* Get the record length, address and type. */
+	const unsigned char *ascii = file->data + file->offset;
+	if (file->size - file->offset < 8) {
 		ERROR (file->context, "Failed to read the header.");
 		return DC_STATUS_IO;
 	}
 
 	/* Convert to binary representation. */
-	if (array_convert_hex2bin (ascii + 1, 8, data, 4) != 0) {
+	if (array_convert_hex2bin (ascii, 8, data, 4) != 0) {
 		ERROR (file->context, "Invalid hexadecimal character.");
 		return DC_STATUS_DATAFORMAT;
 	}
@@ -116,19 +150,20 @@ dc_ihex_file_read (dc_ihex_file_t *file, dc_ihex_entry_t *entry)
 	/* Get the record length. */
 	length = data[0];
 
-	/* Read the record payload. */
-	n = fread (ascii + 9, 1, 2 * length + 2, file->fp);
-	if (n != 2 * length + 2) {
+	/* Get the record payload. */
+	if (file->size - file->offset < 8 + 2 * length + 2) {
 		ERROR (file->context, "Failed to read the data.");
 		return DC_STATUS_IO;
 	}
 
 	/* Convert to binary representation. */
-	if (array_convert_hex2bin (ascii + 9, 2 * length + 2, data + 4, length + 1) != 0) {
+	if (array_convert_hex2bin (ascii + 8, 2 * length + 2, data + 4, length + 1) != 0) {
 		ERROR (file->context, "Invalid hexadecimal character.");
 		return DC_STATUS_DATAFORMAT;
 	}
 
+	file->offset += 8 + 2 * length + 2;
+
 	/* Verify the checksum. */
 	csum_a = data[4 + length];
 	csum_b = ~checksum_add_uint8 (data, 4 + length, 0x00) + 1;
@@ -189,7 +224,7 @@ dc_ihex_file_reset (dc_ihex_file_t *file)
 		return DC_STATUS_INVALIDARGS;
 	}
 
-	rewind (file->fp);
+	file->offset = 0;
 
 	return DC_STATUS_SUCCESS;
 }
@@ -198,7 +233,7 @@ dc_status_t
 dc_ihex_file_close (dc_ihex_file_t *file)
 {
 	if (file) {
-		fclose (file->fp);
+		free (file->data);
 		free (file);
 	}
 
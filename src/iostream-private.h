@@ -32,10 +32,13 @@ extern "C" {
 
 typedef struct dc_iostream_vtable_t dc_iostream_vtable_t;
 
+struct dc_iostream_counters_t;
+
 struct dc_iostream_t {
 	const dc_iostream_vtable_t *vtable;
 	dc_context_t *context;
 	dc_transport_t transport;
+	struct dc_iostream_counters_t *counters;
 };
 
 struct dc_iostream_vtable_t {
@@ -70,6 +73,20 @@ struct dc_iostream_vtable_t {
 	dc_status_t (*close) (dc_iostream_t *iostream);
 
 	const char *(*get_name) (dc_iostream_t *iostream);
+
+	dc_status_t (*read_async) (dc_iostream_t *iostream, void *data, size_t size, dc_iostream_callback_t callback, void *userdata);
+
+	dc_status_t (*write_async) (dc_iostream_t *iostream, const void *data, size_t size, dc_iostream_callback_t callback, void *userdata);
+
+	dc_status_t (*cancel) (dc_iostream_t *iostream);
+
+	dc_status_t (*readv) (dc_iostream_t *iostream, const dc_iovec_t iov[], size_t count, size_t *actual);
+
+	dc_status_t (*writev) (dc_iostream_t *iostream, const dc_iovec_t iov[], size_t count, size_t *actual);
+
+	dc_status_t (*interrupt) (dc_iostream_t *iostream);
+
+	dc_status_t (*wait_readable) (dc_iostream_t *iostream, int timeout);
 };
 
 dc_iostream_t *
@@ -81,6 +98,14 @@ dc_iostream_deallocate (dc_iostream_t *iostream);
 int
 dc_iostream_isinstance (dc_iostream_t *iostream, const dc_iostream_vtable_t *vtable);
 
+/*
+ * Check whether the statistics are enabled, and at least the specified
+ * interval (in milliseconds) elapsed since the last time this function
+ * returned true.
+ */
+int
+dc_iostream_stats_expired (dc_iostream_t *iostream, unsigned int interval);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
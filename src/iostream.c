@@ -19,13 +19,41 @@
  * MA 02110-1301 USA
  */
 
+#define LOG_SUBSYSTEM DC_LOGSUBSYSTEM_IOSTREAM
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
 #include <stddef.h>
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#define USE_SHIM
+#endif
 
 #include "iostream-private.h"
 #include "context-private.h"
+#include "perfstats.h"
 #include "platform.h"
+#include "timer.h"
+#include "tracepoint.h"
+
+#define NBINS DC_IOSTREAM_STATS_NBINS
+
+// Interval for polling the input buffer, without native wait support.
+#define POLLINTERVAL 10
+
+struct dc_iostream_counters_t {
+	dc_timer_t *timer;
+	dc_usecs_t reported;
+	/* End of the last write, not yet answered by a read. */
+	dc_usecs_t lastwrite;
+	int pending;
+	dc_iostream_stats_t stats;
+};
 
 dc_iostream_t *
 dc_iostream_allocate (dc_context_t *context, const dc_iostream_vtable_t *vtable, dc_transport_t transport)
@@ -36,7 +64,7 @@ dc_iostream_allocate (dc_context_t *context, const dc_iostream_vtable_t *vtable,
 	assert(vtable->size >= sizeof(dc_iostream_t));
 
 	// Allocate memory.
-	iostream = (dc_iostream_t *) malloc (vtable->size);
+	iostream = (dc_iostream_t *) dc_malloc (context, vtable->size);
 	if (iostream == NULL) {
 		ERROR (context, "Failed to allocate memory.");
 		return iostream;
@@ -46,6 +74,7 @@ dc_iostream_allocate (dc_context_t *context, const dc_iostream_vtable_t *vtable,
 	iostream->vtable = vtable;
 	iostream->context = context;
 	iostream->transport = transport;
+	iostream->counters = NULL;
 
 	return iostream;
 }
@@ -53,7 +82,15 @@ dc_iostream_allocate (dc_context_t *context, const dc_iostream_vtable_t *vtable,
 void
 dc_iostream_deallocate (dc_iostream_t *iostream)
 {
-	free (iostream);
+	if (iostream == NULL)
+		return;
+
+	if (iostream->counters) {
+		dc_timer_free (iostream->counters->timer);
+		dc_free (iostream->context, iostream->counters);
+	}
+
+	dc_free (iostream->context, iostream);
 }
 
 int
@@ -65,6 +102,82 @@ dc_iostream_isinstance (dc_iostream_t *iostream, const dc_iostream_vtable_t *vta
 	return iostream->vtable == vtable;
 }
 
+static dc_usecs_t
+dc_iostream_stats_begin (dc_iostream_t *iostream)
+{
+	dc_usecs_t now = 0;
+
+	if (iostream->counters)
+		dc_timer_now (iostream->counters->timer, &now);
+
+	return now;
+}
+
+static void
+dc_iostream_stats_end (dc_iostream_t *iostream, dc_direction_t direction, dc_status_t status, size_t nbytes, dc_usecs_t start)
+{
+	struct dc_iostream_counters_t *counters = iostream->counters;
+
+	if (counters == NULL)
+		return;
+
+	if (status == DC_STATUS_TIMEOUT)
+		counters->stats.timeouts++;
+
+	dc_usecs_t now = start;
+	dc_timer_now (counters->timer, &now);
+	if (now < start)
+		now = start;
+
+	if (direction == DC_DIRECTION_INPUT) {
+
+		// Select the power of two bin for the elapsed milliseconds.
+		unsigned int bin = 0;
+		dc_usecs_t elapsed = (now - start) / 1000;
+		while (elapsed && bin < NBINS - 1) {
+			elapsed >>= 1;
+			bin++;
+		}
+
+		counters->stats.nread += nbytes;
+		counters->stats.readcalls++;
+		counters->stats.readtime += now - start;
+		counters->stats.histogram[bin]++;
+
+		if (counters->pending && nbytes) {
+			counters->stats.transactions++;
+			counters->stats.turnaround += now - counters->lastwrite;
+			counters->pending = 0;
+		}
+	} else {
+		counters->stats.nwritten += nbytes;
+		counters->stats.writecalls++;
+
+		if (nbytes) {
+			counters->lastwrite = now;
+			counters->pending = 1;
+		}
+	}
+}
+
+int
+dc_iostream_stats_expired (dc_iostream_t *iostream, unsigned int interval)
+{
+	if (iostream == NULL || iostream->counters == NULL)
+		return 0;
+
+	dc_usecs_t now = 0;
+	if (dc_timer_now (iostream->counters->timer, &now) != DC_STATUS_SUCCESS)
+		return 0;
+
+	if (now - iostream->counters->reported < (dc_usecs_t) interval * 1000)
+		return 0;
+
+	iostream->counters->reported = now;
+
+	return 1;
+}
+
 dc_transport_t
 dc_iostream_get_transport (dc_iostream_t *iostream)
 {
@@ -171,6 +284,58 @@ out:
 	return status;
 }
 
+/*
+ * Emulate the wait by polling the input buffer.
+ */
+static dc_status_t
+dc_iostream_poll_available (dc_iostream_t *iostream, int timeout)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	unsigned int elapsed = 0;
+
+	if (iostream->vtable->get_available == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	while (1) {
+		size_t available = 0;
+		status = iostream->vtable->get_available (iostream, &available);
+		if (status != DC_STATUS_SUCCESS)
+			return status;
+
+		if (available)
+			return DC_STATUS_SUCCESS;
+
+		if (timeout >= 0 && elapsed >= (unsigned int) timeout)
+			return DC_STATUS_TIMEOUT;
+
+		unsigned int delay = POLLINTERVAL;
+		if (timeout >= 0 && delay > timeout - elapsed)
+			delay = timeout - elapsed;
+
+		if (iostream->vtable->sleep) {
+			status = iostream->vtable->sleep (iostream, delay);
+			if (status != DC_STATUS_SUCCESS)
+				return status;
+		}
+
+		elapsed += delay;
+	}
+}
+
+dc_status_t
+dc_iostream_wait_readable (dc_iostream_t *iostream, int timeout)
+{
+	if (iostream == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	INFO (iostream->context, "Wait: value=%i", timeout);
+
+	if (iostream->vtable->wait_readable == NULL)
+		return dc_iostream_poll_available (iostream, timeout);
+
+	return iostream->vtable->wait_readable (iostream, timeout);
+}
+
 dc_status_t
 dc_iostream_configure (dc_iostream_t *iostream, unsigned int baudrate, unsigned int databits, dc_parity_t parity, dc_stopbits_t stopbits, dc_flowcontrol_t flowcontrol)
 {
@@ -183,12 +348,111 @@ dc_iostream_configure (dc_iostream_t *iostream, unsigned int baudrate, unsigned
 	return iostream->vtable->configure (iostream, baudrate, databits, parity, stopbits, flowcontrol);
 }
 
-dc_status_t
-dc_iostream_read (dc_iostream_t *iostream, void *data, size_t size, size_t *actual)
+#ifdef USE_SHIM
+/*
+ * Blocking shim for transports which implement only the asynchronous
+ * slots. The transfer is started, and the calling thread waits for the
+ * completion callback.
+ */
+typedef struct dc_iostream_shim_t {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int done;
+	dc_status_t status;
+	size_t actual;
+} dc_iostream_shim_t;
+
+static void
+dc_iostream_shim_callback (dc_iostream_t *iostream, dc_status_t status, size_t actual, void *userdata)
+{
+	dc_iostream_shim_t *shim = (dc_iostream_shim_t *) userdata;
+
+	pthread_mutex_lock (&shim->lock);
+	shim->status = status;
+	shim->actual = actual;
+	shim->done = 1;
+	pthread_cond_signal (&shim->cond);
+	pthread_mutex_unlock (&shim->lock);
+}
+
+static dc_status_t
+dc_iostream_shim (dc_iostream_t *iostream, dc_direction_t direction, void *data, size_t size, size_t *actual)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_iostream_shim_t shim;
+
+	pthread_mutex_init (&shim.lock, NULL);
+	pthread_cond_init (&shim.cond, NULL);
+	shim.done = 0;
+	shim.status = DC_STATUS_SUCCESS;
+	shim.actual = 0;
+
+	if (direction == DC_DIRECTION_INPUT)
+		status = iostream->vtable->read_async (iostream, data, size, dc_iostream_shim_callback, &shim);
+	else
+		status = iostream->vtable->write_async (iostream, data, size, dc_iostream_shim_callback, &shim);
+
+	if (status == DC_STATUS_SUCCESS) {
+		pthread_mutex_lock (&shim.lock);
+		while (!shim.done)
+			pthread_cond_wait (&shim.cond, &shim.lock);
+		pthread_mutex_unlock (&shim.lock);
+
+		status = shim.status;
+		if (actual)
+			*actual = shim.actual;
+	}
+
+	pthread_cond_destroy (&shim.cond);
+	pthread_mutex_destroy (&shim.lock);
+
+	return status;
+}
+#endif
+
+/*
+ * Size of the temporary buffer for the scatter/gather fallback. Larger
+ * transfers allocate the buffer on the heap.
+ */
+#define IOVEC_BUFSIZE 256
+
+static size_t
+dc_iovec_size (const dc_iovec_t iov[], size_t count)
+{
+	size_t size = 0;
+	for (size_t i = 0; i < count; ++i)
+		size += iov[i].size;
+	return size;
+}
+
+static void
+dc_iovec_hexdump (dc_context_t *context, const char *prefix, const dc_iovec_t iov[], size_t count, size_t nbytes)
+{
+	for (size_t i = 0; i < count && nbytes; ++i) {
+		size_t n = iov[i].size < nbytes ? iov[i].size : nbytes;
+		HEXDUMP (context, DC_LOGLEVEL_INFO, prefix, (const unsigned char *) iov[i].data, n);
+		nbytes -= n;
+	}
+}
+
+static dc_status_t
+dc_iostream_read_internal (dc_iostream_t *iostream, void *data, size_t size, size_t *actual)
 {
 	if (actual)
 		*actual = 0;
 
+#ifdef USE_SHIM
+	if (iostream && iostream->vtable->read == NULL && iostream->vtable->read_async) {
+		size_t nbytes = 0;
+		dc_usecs_t start = dc_iostream_stats_begin (iostream);
+		dc_status_t status = dc_iostream_shim (iostream, DC_DIRECTION_INPUT, data, size, &nbytes);
+		dc_iostream_stats_end (iostream, DC_DIRECTION_INPUT, status, nbytes, start);
+		if (actual)
+			*actual = nbytes;
+		return status;
+	}
+#endif
+
 	if (iostream == NULL || iostream->vtable->read == NULL)
 		return DC_STATUS_IO;
 
@@ -196,7 +460,9 @@ dc_iostream_read (dc_iostream_t *iostream, void *data, size_t size, size_t *actu
 		dc_status_t status;
 		size_t nbytes = 0;
 
+		dc_usecs_t start = dc_iostream_stats_begin (iostream);
 		status = iostream->vtable->read (iostream, data, size, &nbytes);
+		dc_iostream_stats_end (iostream, DC_DIRECTION_INPUT, status, nbytes, start);
 		HEXDUMP (iostream->context, DC_LOGLEVEL_INFO, "Read", (unsigned char *) data, nbytes);
 
 		/*
@@ -226,11 +492,42 @@ dc_iostream_read (dc_iostream_t *iostream, void *data, size_t size, size_t *actu
 }
 
 dc_status_t
-dc_iostream_write (dc_iostream_t *iostream, const void *data, size_t size, size_t *actual)
+dc_iostream_read (dc_iostream_t *iostream, void *data, size_t size, size_t *actual)
+{
+	PERFSTATS_ADD (iostream_reads, 1);
+
+#if TRACEPOINTS_ENABLED
+	size_t nbytes = 0;
+	TRACEPOINT2 (iostream__read__start, iostream, size);
+	dc_status_t status = dc_iostream_read_internal (iostream, data, size, actual ? &nbytes : NULL);
+	if (actual)
+		*actual = nbytes;
+	else if (status == DC_STATUS_SUCCESS)
+		nbytes = size;
+	TRACEPOINT4 (iostream__read__done, iostream, size, nbytes, status);
+	return status;
+#else
+	return dc_iostream_read_internal (iostream, data, size, actual);
+#endif
+}
+
+static dc_status_t
+dc_iostream_write_internal (dc_iostream_t *iostream, const void *data, size_t size, size_t *actual)
 {
 	if (actual)
 		*actual = 0;
 
+#ifdef USE_SHIM
+	if (iostream && iostream->vtable->write == NULL && iostream->vtable->write_async) {
+		size_t nbytes = 0;
+		dc_status_t status = dc_iostream_shim (iostream, DC_DIRECTION_OUTPUT, (void *) data, size, &nbytes);
+		dc_iostream_stats_end (iostream, DC_DIRECTION_OUTPUT, status, nbytes, 0);
+		if (actual)
+			*actual = nbytes;
+		return status;
+	}
+#endif
+
 	if (iostream == NULL || iostream->vtable->write == NULL)
 		return DC_STATUS_IO;
 
@@ -239,6 +536,7 @@ dc_iostream_write (dc_iostream_t *iostream, const void *data, size_t size, size_
 		size_t nbytes = 0;
 
 		status = iostream->vtable->write (iostream, data, size, &nbytes);
+		dc_iostream_stats_end (iostream, DC_DIRECTION_OUTPUT, status, nbytes, 0);
 		HEXDUMP (iostream->context, DC_LOGLEVEL_INFO, "Write", (const unsigned char *) data, nbytes);
 
 		if (actual) {
@@ -256,6 +554,270 @@ dc_iostream_write (dc_iostream_t *iostream, const void *data, size_t size, size_
 	return DC_STATUS_SUCCESS;
 }
 
+dc_status_t
+dc_iostream_write (dc_iostream_t *iostream, const void *data, size_t size, size_t *actual)
+{
+#if TRACEPOINTS_ENABLED
+	size_t nbytes = 0;
+	TRACEPOINT2 (iostream__write__start, iostream, size);
+	dc_status_t status = dc_iostream_write_internal (iostream, data, size, actual ? &nbytes : NULL);
+	if (actual)
+		*actual = nbytes;
+	else if (status == DC_STATUS_SUCCESS)
+		nbytes = size;
+	TRACEPOINT4 (iostream__write__done, iostream, size, nbytes, status);
+	return status;
+#else
+	return dc_iostream_write_internal (iostream, data, size, actual);
+#endif
+}
+
+dc_status_t
+dc_iostream_readv (dc_iostream_t *iostream, const dc_iovec_t iov[], size_t count, size_t *actual)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	unsigned char stack[IOVEC_BUFSIZE];
+	unsigned char *buffer = stack;
+	size_t nbytes = 0;
+
+	if (actual)
+		*actual = 0;
+
+	if (iostream == NULL)
+		return DC_STATUS_IO;
+
+	if (iov == NULL && count)
+		return DC_STATUS_INVALIDARGS;
+
+	if (iostream->vtable->readv) {
+		dc_usecs_t start = dc_iostream_stats_begin (iostream);
+		status = iostream->vtable->readv (iostream, iov, count, &nbytes);
+		if (status != DC_STATUS_UNSUPPORTED) {
+			dc_iostream_stats_end (iostream, DC_DIRECTION_INPUT, status, nbytes, start);
+			dc_iovec_hexdump (iostream->context, "Read", iov, count, nbytes);
+			if (actual)
+				*actual = nbytes;
+			return status;
+		}
+		nbytes = 0;
+	}
+
+	// Fallback to reading into a temporary buffer.
+	size_t size = dc_iovec_size (iov, count);
+	if (size > sizeof (stack)) {
+		buffer = (unsigned char *) malloc (size);
+		if (buffer == NULL) {
+			ERROR (iostream->context, "Failed to allocate memory.");
+			return DC_STATUS_NOMEMORY;
+		}
+	}
+
+	status = dc_iostream_read (iostream, buffer, size, actual ? &nbytes : NULL);
+	if (actual == NULL && status == DC_STATUS_SUCCESS)
+		nbytes = size;
+
+	// Scatter the data over the buffers.
+	size_t offset = 0;
+	for (size_t i = 0; i < count && offset < nbytes; ++i) {
+		size_t n = iov[i].size < nbytes - offset ? iov[i].size : nbytes - offset;
+		memcpy (iov[i].data, buffer + offset, n);
+		offset += n;
+	}
+
+	if (actual)
+		*actual = nbytes;
+
+	if (buffer != stack)
+		free (buffer);
+
+	return status;
+}
+
+dc_status_t
+dc_iostream_writev (dc_iostream_t *iostream, const dc_iovec_t iov[], size_t count, size_t *actual)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	unsigned char stack[IOVEC_BUFSIZE];
+	unsigned char *buffer = stack;
+	size_t nbytes = 0;
+
+	if (actual)
+		*actual = 0;
+
+	if (iostream == NULL)
+		return DC_STATUS_IO;
+
+	if (iov == NULL && count)
+		return DC_STATUS_INVALIDARGS;
+
+	if (iostream->vtable->writev) {
+		status = iostream->vtable->writev (iostream, iov, count, &nbytes);
+		if (status != DC_STATUS_UNSUPPORTED) {
+			dc_iostream_stats_end (iostream, DC_DIRECTION_OUTPUT, status, nbytes, 0);
+			dc_iovec_hexdump (iostream->context, "Write", iov, count, nbytes);
+			if (actual)
+				*actual = nbytes;
+			return status;
+		}
+		nbytes = 0;
+	}
+
+	// Fallback to gathering the data into a temporary buffer.
+	size_t size = dc_iovec_size (iov, count);
+	if (size > sizeof (stack)) {
+		buffer = (unsigned char *) malloc (size);
+		if (buffer == NULL) {
+			ERROR (iostream->context, "Failed to allocate memory.");
+			return DC_STATUS_NOMEMORY;
+		}
+	}
+
+	size_t offset = 0;
+	for (size_t i = 0; i < count; ++i) {
+		memcpy (buffer + offset, iov[i].data, iov[i].size);
+		offset += iov[i].size;
+	}
+
+	status = dc_iostream_write (iostream, buffer, size, actual);
+
+	if (buffer != stack)
+		free (buffer);
+
+	return status;
+}
+
+dc_status_t
+dc_iostream_set_stats (dc_iostream_t *iostream, unsigned int value)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	struct dc_iostream_counters_t *counters = NULL;
+
+	if (iostream == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	if (value == 0) {
+		counters = iostream->counters;
+		if (counters) {
+			dc_timer_free (counters->timer);
+			dc_free (iostream->context, counters);
+			iostream->counters = NULL;
+		}
+		return DC_STATUS_SUCCESS;
+	}
+
+	counters = iostream->counters;
+	if (counters == NULL) {
+		counters = (struct dc_iostream_counters_t *) dc_malloc (iostream->context, sizeof (struct dc_iostream_counters_t));
+		if (counters == NULL) {
+			ERROR (iostream->context, "Failed to allocate memory.");
+			return DC_STATUS_NOMEMORY;
+		}
+
+		status = dc_timer_new (&counters->timer);
+		if (status != DC_STATUS_SUCCESS) {
+			ERROR (iostream->context, "Failed to create a high resolution timer.");
+			dc_free (iostream->context, counters);
+			return status;
+		}
+	}
+
+	memset (&counters->stats, 0, sizeof (counters->stats));
+	counters->lastwrite = 0;
+	counters->pending = 0;
+	counters->reported = 0;
+	dc_timer_now (counters->timer, &counters->reported);
+
+	iostream->counters = counters;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_iostream_get_stats (dc_iostream_t *iostream, dc_iostream_stats_t *stats)
+{
+	if (iostream == NULL || stats == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	if (iostream->counters == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	*stats = iostream->counters->stats;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_iostream_read_async (dc_iostream_t *iostream, void *data, size_t size, dc_iostream_callback_t callback, void *userdata)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (iostream == NULL || callback == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	if (iostream->vtable->read_async) {
+		status = iostream->vtable->read_async (iostream, data, size, callback, userdata);
+		if (status != DC_STATUS_UNSUPPORTED)
+			return status;
+	}
+
+	// Fallback to a synchronous transfer.
+	size_t nbytes = 0;
+	status = dc_iostream_read (iostream, data, size, &nbytes);
+	if (status == DC_STATUS_SUCCESS && nbytes != size)
+		status = DC_STATUS_TIMEOUT;
+
+	callback (iostream, status, nbytes, userdata);
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_iostream_write_async (dc_iostream_t *iostream, const void *data, size_t size, dc_iostream_callback_t callback, void *userdata)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (iostream == NULL || callback == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	if (iostream->vtable->write_async) {
+		status = iostream->vtable->write_async (iostream, data, size, callback, userdata);
+		if (status != DC_STATUS_UNSUPPORTED)
+			return status;
+	}
+
+	// Fallback to a synchronous transfer.
+	size_t nbytes = 0;
+	status = dc_iostream_write (iostream, data, size, &nbytes);
+	if (status == DC_STATUS_SUCCESS && nbytes != size)
+		status = DC_STATUS_TIMEOUT;
+
+	callback (iostream, status, nbytes, userdata);
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_iostream_cancel (dc_iostream_t *iostream)
+{
+	if (iostream == NULL || iostream->vtable->cancel == NULL)
+		return DC_STATUS_SUCCESS;
+
+	INFO (iostream->context, "Cancel");
+
+	return iostream->vtable->cancel (iostream);
+}
+
+dc_status_t
+dc_iostream_interrupt (dc_iostream_t *iostream)
+{
+	if (iostream == NULL || iostream->vtable->interrupt == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	// No logging, because the context isn't safe to use from another
+	// thread.
+	return iostream->vtable->interrupt (iostream);
+}
+
 dc_status_t
 dc_iostream_flush (dc_iostream_t *iostream)
 {
@@ -275,6 +837,9 @@ dc_iostream_purge (dc_iostream_t *iostream, dc_direction_t direction)
 
 	INFO (iostream->context, "Purge: direction=%u", direction);
 
+	if (iostream->counters)
+		iostream->counters->stats.purges++;
+
 	return iostream->vtable->purge (iostream, direction);
 }
 
@@ -19,6 +19,8 @@
  * MA 02110-1301 USA
  */
 
+#define LOG_SUBSYSTEM DC_LOGSUBSYSTEM_IOSTREAM
+
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif
@@ -74,6 +76,7 @@ struct dc_irda_device_t {
 
 #ifdef IRDA
 static dc_status_t dc_irda_iterator_next (dc_iterator_t *iterator, void *item);
+static dc_status_t dc_irda_iterator_next_batch (dc_iterator_t *iterator, void *items[], size_t n, size_t *count);
 
 typedef struct dc_irda_iterator_t {
 	dc_iterator_t base;
@@ -86,6 +89,8 @@ static const dc_iterator_vtable_t dc_irda_iterator_vtable = {
 	sizeof(dc_irda_iterator_t),
 	dc_irda_iterator_next,
 	NULL,
+	dc_irda_iterator_next_batch,
+	NULL,
 };
 
 static const dc_iostream_vtable_t dc_irda_vtable = {
@@ -104,6 +109,13 @@ static const dc_iostream_vtable_t dc_irda_vtable = {
 	NULL, /* purge */
 	dc_socket_sleep, /* sleep */
 	dc_socket_close, /* close */
+	NULL, /* get_name */
+	dc_socket_read_async, /* read_async */
+	dc_socket_write_async, /* write_async */
+	dc_socket_cancel, /* cancel */
+	dc_socket_readv, /* readv */
+	dc_socket_writev, /* writev */
+	dc_socket_interrupt, /* interrupt */	dc_socket_wait_readable, /* wait_readable */
 };
 #endif
 
@@ -285,6 +297,22 @@ dc_irda_iterator_next (dc_iterator_t *abstract, void *out)
 
 	return DC_STATUS_SUCCESS;
 }
+
+static dc_status_t
+dc_irda_iterator_next_batch (dc_iterator_t *abstract, void *items[], size_t n, size_t *count)
+{
+	dc_irda_iterator_t *iterator = (dc_irda_iterator_t *) abstract;
+	size_t nitems = 0;
+
+	// The discovery results are handed out directly, without a copy.
+	while (nitems < n && iterator->current < iterator->count) {
+		items[nitems++] = &iterator->items[iterator->current++];
+	}
+
+	*count = nitems;
+
+	return nitems ? DC_STATUS_SUCCESS : DC_STATUS_DONE;
+}
 #endif
 
 dc_status_t
@@ -333,6 +361,17 @@ dc_irda_open (dc_iostream_t **out, dc_context_t *context, unsigned int address,
 		goto error_close;
 	}
 
+#ifndef _WIN32
+	// The IrLAP window and frame size are negotiated by the kernel, to the
+	// largest values supported by both sides, and can't be changed for a
+	// stream socket. Only the resulting data size is reported.
+	int sdu = 0;
+	s_socklen_t optlen = sizeof (sdu);
+	if (getsockopt (device->fd, SOL_IRLMP, IRTTP_MAX_SDU_SIZE, (char *) &sdu, &optlen) == 0) {
+		INFO (context, "Connected: max_sdu_size=%d", sdu);
+	}
+#endif
+
 	*out = (dc_iostream_t *) device;
 
 	return DC_STATUS_SUCCESS;
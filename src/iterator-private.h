@@ -34,12 +34,25 @@ typedef struct dc_iterator_vtable_t dc_iterator_vtable_t;
 struct dc_iterator_t {
 	const dc_iterator_vtable_t *vtable;
 	dc_context_t *context;
+	/* Items of the last batch, when emulated with the next function. */
+	void **batch;
+	size_t nbatch;
+	size_t capacity;
 };
 
+/*
+ * The next_batch function is optional. An iterator which implements it
+ * hands out items from storage it owns itself, and keeps them valid until
+ * the next batch, or until the iterator is freed. Without it, the batch
+ * is emulated with the next function, and the items are freed with the
+ * release function when they are no longer needed.
+ */
 struct dc_iterator_vtable_t {
 	size_t size;
 	dc_status_t (*next) (dc_iterator_t *iterator, void *item);
 	dc_status_t (*free) (dc_iterator_t *iterator);
+	dc_status_t (*next_batch) (dc_iterator_t *iterator, void *items[], size_t n, size_t *count);
+	void (*release) (void *item);
 };
 
 dc_iterator_t *
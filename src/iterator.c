@@ -43,6 +43,9 @@ dc_iterator_allocate (dc_context_t *context, const dc_iterator_vtable_t *vtable)
 
 	iterator->vtable = vtable;
 	iterator->context = context;
+	iterator->batch = NULL;
+	iterator->nbatch = 0;
+	iterator->capacity = 0;
 
 	return iterator;
 }
@@ -50,9 +53,22 @@ dc_iterator_allocate (dc_context_t *context, const dc_iterator_vtable_t *vtable)
 void
 dc_iterator_deallocate (dc_iterator_t *iterator)
 {
+	free (iterator->batch);
 	free (iterator);
 }
 
+static void
+dc_iterator_release (dc_iterator_t *iterator)
+{
+	if (iterator->vtable->release) {
+		for (size_t i = 0; i < iterator->nbatch; ++i) {
+			iterator->vtable->release (iterator->batch[i]);
+		}
+	}
+
+	iterator->nbatch = 0;
+}
+
 int
 dc_iterator_isinstance (dc_iterator_t *iterator, const dc_iterator_vtable_t *vtable)
 {
@@ -74,6 +90,66 @@ dc_iterator_next (dc_iterator_t *iterator, void *item)
 	return iterator->vtable->next (iterator, item);
 }
 
+dc_status_t
+dc_iterator_next_batch (dc_iterator_t *iterator, void *items[], size_t n, size_t *count)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	size_t nitems = 0;
+
+	if (count)
+		*count = 0;
+
+	if (iterator == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (items == NULL || n == 0)
+		return DC_STATUS_INVALIDARGS;
+
+	if (iterator->vtable->next_batch) {
+		status = iterator->vtable->next_batch (iterator, items, n, &nitems);
+		goto out;
+	}
+
+	if (iterator->vtable->next == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	// The items of the previous batch are no longer needed.
+	dc_iterator_release (iterator);
+
+	if (n > iterator->capacity) {
+		void **batch = (void **) realloc (iterator->batch, n * sizeof (void *));
+		if (batch == NULL) {
+			ERROR (iterator->context, "Failed to allocate memory.");
+			return DC_STATUS_NOMEMORY;
+		}
+
+		iterator->batch = batch;
+		iterator->capacity = n;
+	}
+
+	while (nitems < n) {
+		void *item = NULL;
+		status = iterator->vtable->next (iterator, &item);
+		if (status != DC_STATUS_SUCCESS)
+			break;
+
+		iterator->batch[iterator->nbatch++] = item;
+		items[nitems++] = item;
+	}
+
+out:
+	// A partial batch is returned first. The end of the enumeration, or
+	// the error, is reported again by the next call.
+	if (nitems) {
+		status = DC_STATUS_SUCCESS;
+	}
+
+	if (count)
+		*count = nitems;
+
+	return status;
+}
+
 dc_status_t
 dc_iterator_free (dc_iterator_t *iterator)
 {
@@ -82,6 +158,8 @@ dc_iterator_free (dc_iterator_t *iterator)
 	if (iterator == NULL)
 		return DC_STATUS_SUCCESS;
 
+	dc_iterator_release (iterator);
+
 	if (iterator->vtable->free) {
 		status = iterator->vtable->free (iterator);
 	}
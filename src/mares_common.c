@@ -25,8 +25,8 @@
 
 #include "context-private.h"
 #include "mares_common.h"
-#include "checksum.h"
 #include "array.h"
+#include "ringbuffer.h"
 
 #define MAXRETRIES 4
 
@@ -66,11 +66,9 @@ mares_common_make_ascii (const unsigned char raw[], unsigned int rsize, unsigned
 	// Header
 	ascii[0] = '<';
 
-	// Data
-	array_convert_bin2hex (raw, rsize, ascii + 1, 2 * rsize);
-
-	// Checksum
-	unsigned char checksum = checksum_add_uint8 (ascii + 1, 2 * rsize, 0x00);
+	// Data and checksum
+	unsigned char checksum = 0x00;
+	array_convert_bin2hex_sum (raw, rsize, ascii + 1, 2 * rsize, &checksum);
 	array_convert_bin2hex (&checksum, 1, ascii + 1 + 2 * rsize, 2);
 
 	// Trailer
@@ -78,8 +76,12 @@ mares_common_make_ascii (const unsigned char raw[], unsigned int rsize, unsigned
 }
 
 
+/*
+ * Send the command and receive the ascii answer. The payload of the
+ * answer is decoded into the data buffer, while verifying the checksum.
+ */
 static dc_status_t
-mares_common_packet (mares_common_device_t *device, const unsigned char command[], unsigned int csize, unsigned char answer[], unsigned int asize)
+mares_common_packet (mares_common_device_t *device, const unsigned char command[], unsigned int csize, unsigned char answer[], unsigned int asize, unsigned char data[])
 {
 	dc_status_t status = DC_STATUS_SUCCESS;
 	dc_device_t *abstract = (dc_device_t *) device;
@@ -91,6 +93,8 @@ mares_common_packet (mares_common_device_t *device, const unsigned char command[
 		dc_iostream_sleep (device->iostream, device->delay);
 	}
 
+	dc_usecs_t start = device_latency_start (abstract);
+
 	// Send the command to the device.
 	status = dc_iostream_write (device->iostream, command, csize, NULL);
 	if (status != DC_STATUS_SUCCESS) {
@@ -126,25 +130,48 @@ mares_common_packet (mares_common_device_t *device, const unsigned char command[
 		return DC_STATUS_PROTOCOL;
 	}
 
-	// Verify the checksum of the packet.
-	unsigned char crc = 0;
-	unsigned char ccrc = checksum_add_uint8 (answer + 1, asize - 4, 0x00);
-	array_convert_hex2bin (answer + asize - 3, 2, &crc, 1);
+	// Extract the payload and verify the checksum of the packet.
+	unsigned char crc = 0, ccrc = 0x00;
+	if (array_convert_hex2bin_sum (answer + 1, asize - 4, data, (asize - 4) / 2, &ccrc) != 0 ||
+		array_convert_hex2bin (answer + asize - 3, 2, &crc, 1) != 0) {
+		ERROR (abstract->context, "Unexpected answer character.");
+		return DC_STATUS_PROTOCOL;
+	}
+
 	if (crc != ccrc) {
 		ERROR (abstract->context, "Unexpected answer checksum.");
 		return DC_STATUS_PROTOCOL;
 	}
 
+	// Report the opcode of the raw command, after the ascii header.
+	unsigned char opcode = 0;
+	array_convert_hex2bin (command + 1, 2, &opcode, 1);
+	device_latency_emit (abstract, opcode, (asize - 4) / 2, start);
+
 	return DC_STATUS_SUCCESS;
 }
 
 
 static dc_status_t
-mares_common_transfer (mares_common_device_t *device, const unsigned char command[], unsigned int csize, unsigned char answer[], unsigned int asize)
+mares_common_transfer (mares_common_device_t *device, const unsigned char command[], unsigned int csize, unsigned char answer[], unsigned int asize, unsigned char data[])
 {
+	dc_device_t *abstract = (dc_device_t *) device;
 	unsigned int nretries = 0;
 	dc_status_t rc = DC_STATUS_SUCCESS;
-	while ((rc = mares_common_packet (device, command, csize, answer, asize)) != DC_STATUS_SUCCESS) {
+	while (1) {
+		// Adapt the timeout to the number of attempts.
+		rc = device_rtt_set_timeout (abstract, device->iostream, nretries);
+		if (rc != DC_STATUS_SUCCESS)
+			return rc;
+
+		dc_usecs_t start = device_rtt_start (abstract);
+		rc = mares_common_packet (device, command, csize, answer, asize, data);
+		if (rc == DC_STATUS_SUCCESS) {
+			if (nretries == 0)
+				device_rtt_sample (abstract, start);
+			break;
+		}
+
 		// Automatically discard a corrupted packet,
 		// and request a new one.
 		if (rc != DC_STATUS_PROTOCOL && rc != DC_STATUS_TIMEOUT)
@@ -155,7 +182,7 @@ mares_common_transfer (mares_common_device_t *device, const unsigned char comman
 			return rc;
 
 		// Discard any garbage bytes.
-		dc_iostream_sleep (device->iostream, 100);
+		dc_iostream_sleep (device->iostream, device_rtt_backoff (abstract, nretries, 100));
 		dc_iostream_purge (device->iostream, DC_DIRECTION_INPUT);
 	}
 
@@ -187,13 +214,10 @@ mares_common_device_read (dc_device_t *abstract, unsigned int address, unsigned
 
 		// Send the command and receive the answer.
 		unsigned char answer[2 * (PACKETSIZE + 2)] = {0};
-		dc_status_t rc = mares_common_transfer (device, command, sizeof (command), answer, 2 * (len + 2));
+		dc_status_t rc = mares_common_transfer (device, command, sizeof (command), answer, 2 * (len + 2), data);
 		if (rc != DC_STATUS_SUCCESS)
 			return rc;
 
-		// Extract the raw data from the packet.
-		array_convert_hex2bin (answer + 1, 2 * len, data, len);
-
 		nbytes += len;
 		address += len;
 		data += len;
@@ -232,8 +256,13 @@ mares_common_extract_dives (dc_context_t *context, const mares_common_layout_t *
 		return DC_STATUS_NOMEMORY;
 	}
 
-	memcpy (buffer + 0, data + eop, layout->rb_profile_end - eop);
-	memcpy (buffer + layout->rb_profile_end - eop, data + layout->rb_profile_begin, eop - layout->rb_profile_begin);
+	ringbuffer_span_t spans[2];
+	unsigned int nspans = ringbuffer_span (eop, eop, 1, layout->rb_profile_begin, layout->rb_profile_end, spans);
+	unsigned int n = 0;
+	for (unsigned int i = 0; i < nspans; ++i) {
+		memcpy (buffer + n, data + spans[i].address, spans[i].size);
+		n += spans[i].size;
+	}
 
 	// For a freedive session, the Mares Nemo stores all the freedives of
 	// that session in a single logbook entry, and each sample is actually
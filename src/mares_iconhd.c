@@ -28,6 +28,7 @@
 #include "device-private.h"
 #include "array.h"
 #include "rbstream.h"
+#include "buffered.h"
 
 #define C_ARRAY_SIZE(array) (sizeof (array) / sizeof *(array))
 
@@ -47,6 +48,9 @@
 
 #define MAXRETRIES 4
 
+// Read cache page size (a multiple of all packet sizes).
+#define CACHE_PAGESIZE 4096
+
 #define ACK 0xAA
 #define EOF 0xEA
 
@@ -66,14 +70,23 @@ typedef struct mares_iconhd_model_t {
 	unsigned int id;
 } mares_iconhd_model_t;
 
+typedef struct mares_iconhd_config_t {
+	unsigned int model;
+	const mares_iconhd_layout_t *layout;
+	unsigned int packetsize;
+	unsigned int maxpacketsize;
+} mares_iconhd_config_t;
+
 typedef struct mares_iconhd_device_t {
 	dc_device_t base;
 	dc_iostream_t *iostream;
+	dc_iostream_t *buffered;
 	const mares_iconhd_layout_t *layout;
 	unsigned char fingerprint[10];
 	unsigned char version[140];
 	unsigned int model;
 	unsigned int packetsize;
+	unsigned int pipelining;
 	unsigned char cache[20];
 	unsigned int available;
 	unsigned int offset;
@@ -83,6 +96,7 @@ static dc_status_t mares_iconhd_device_set_fingerprint (dc_device_t *abstract, c
 static dc_status_t mares_iconhd_device_read (dc_device_t *abstract, unsigned int address, unsigned char data[], unsigned int size);
 static dc_status_t mares_iconhd_device_dump (dc_device_t *abstract, dc_buffer_t *buffer);
 static dc_status_t mares_iconhd_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, void *userdata);
+static dc_status_t mares_iconhd_device_close (dc_device_t *abstract);
 
 static const dc_device_vtable_t mares_iconhd_device_vtable = {
 	sizeof(mares_iconhd_device_t),
@@ -93,7 +107,8 @@ static const dc_device_vtable_t mares_iconhd_device_vtable = {
 	mares_iconhd_device_dump, /* dump */
 	mares_iconhd_device_foreach, /* foreach */
 	NULL, /* timesync */
-	NULL /* close */
+	mares_iconhd_device_close, /* close */
+	CACHE_PAGESIZE /* pagesize */
 };
 
 static const mares_iconhd_layout_t mares_iconhd_layout = {
@@ -120,6 +135,25 @@ static const mares_iconhd_layout_t mares_nemowide2_layout = {
 	0x40000, /* rb_profile_end */
 };
 
+/*
+ * The packet size and the maximum packet size over BLE. The Quad Air and
+ * Smart Air support larger packets over BLE, which is detected at runtime.
+ * The last entry is used for unknown models.
+ */
+static const mares_iconhd_config_t mares_iconhd_configs[] = {
+	{MATRIX,     &mares_matrix_layout,     256,  256},
+	{PUCKPRO,    &mares_nemowide2_layout,  256,  256},
+	{PUCK2,      &mares_nemowide2_layout,  256,  256},
+	{NEMOWIDE2,  &mares_nemowide2_layout,  256,  256},
+	{SMART,      &mares_nemowide2_layout,  256,  256},
+	{SMARTAPNEA, &mares_nemowide2_layout,  256,  256},
+	{QUAD,       &mares_nemowide2_layout,  256,  256},
+	{QUADAIR,    &mares_iconhdnet_layout,  256,  4096},
+	{SMARTAIR,   &mares_iconhdnet_layout,  256,  4096},
+	{ICONHDNET,  &mares_iconhdnet_layout,  4096, 4096},
+	{ICONHD,     &mares_iconhd_layout,     4096, 4096},
+};
+
 static unsigned int
 mares_iconhd_get_model (mares_iconhd_device_t *device)
 {
@@ -196,6 +230,26 @@ mares_iconhd_read (mares_iconhd_device_t *device, unsigned char data[], size_t s
 	return rc;
 }
 
+static dc_status_t
+mares_iconhd_readv (mares_iconhd_device_t *device, const dc_iovec_t iov[], size_t count)
+{
+	dc_status_t rc = DC_STATUS_SUCCESS;
+	dc_transport_t transport = dc_iostream_get_transport(device->iostream);
+
+	// Without the BLE packet cache, all buffers are filled with a
+	// single read.
+	if (transport != DC_TRANSPORT_BLE)
+		return dc_iostream_readv (device->iostream, iov, count, NULL);
+
+	for (size_t i = 0; i < count; ++i) {
+		rc = mares_iconhd_read (device, (unsigned char *) iov[i].data, iov[i].size);
+		if (rc != DC_STATUS_SUCCESS)
+			return rc;
+	}
+
+	return rc;
+}
+
 static dc_status_t
 mares_iconhd_write (mares_iconhd_device_t *device, const unsigned char data[], size_t size)
 {
@@ -235,6 +289,8 @@ mares_iconhd_packet (mares_iconhd_device_t *device,
 	if (device_is_cancelled (abstract))
 		return DC_STATUS_CANCELLED;
 
+	dc_usecs_t start = device_latency_start (abstract);
+
 	// Send the command header to the dive computer.
 	status = mares_iconhd_write (device, command, 2);
 	if (status != DC_STATUS_SUCCESS) {
@@ -265,16 +321,12 @@ mares_iconhd_packet (mares_iconhd_device_t *device,
 		}
 	}
 
-	// Read the packet.
-	status = mares_iconhd_read (device, answer, asize);
-	if (status != DC_STATUS_SUCCESS) {
-		ERROR (abstract->context, "Failed to receive the answer.");
-		return status;
-	}
-
-	// Receive the trailer byte.
+	// Read the packet and the trailer byte.
 	unsigned char trailer[1] = {0};
-	status = mares_iconhd_read (device, trailer, sizeof (trailer));
+	dc_iovec_t iov[] = {
+		{answer, asize},
+		{trailer, sizeof (trailer)}};
+	status = mares_iconhd_readv (device, iov, C_ARRAY_SIZE (iov));
 	if (status != DC_STATUS_SUCCESS) {
 		ERROR (abstract->context, "Failed to receive the answer.");
 		return status;
@@ -286,15 +338,31 @@ mares_iconhd_packet (mares_iconhd_device_t *device,
 		return DC_STATUS_PROTOCOL;
 	}
 
+	device_latency_emit (abstract, command[0], asize, start);
+
 	return DC_STATUS_SUCCESS;
 }
 
 static dc_status_t
 mares_iconhd_transfer (mares_iconhd_device_t *device, const unsigned char command[], unsigned int csize, unsigned char answer[], unsigned int asize)
 {
+	dc_device_t *abstract = (dc_device_t *) device;
 	unsigned int nretries = 0;
 	dc_status_t rc = DC_STATUS_SUCCESS;
-	while ((rc = mares_iconhd_packet (device, command, csize, answer, asize)) != DC_STATUS_SUCCESS) {
+	while (1) {
+		// Adapt the timeout to the number of attempts.
+		rc = device_rtt_set_timeout (abstract, device->iostream, nretries);
+		if (rc != DC_STATUS_SUCCESS)
+			return rc;
+
+		dc_usecs_t start = device_rtt_start (abstract);
+		rc = mares_iconhd_packet (device, command, csize, answer, asize);
+		if (rc == DC_STATUS_SUCCESS) {
+			if (nretries == 0)
+				device_rtt_sample (abstract, start);
+			break;
+		}
+
 		// Automatically discard a corrupted packet,
 		// and request a new one.
 		if (rc != DC_STATUS_PROTOCOL && rc != DC_STATUS_TIMEOUT)
@@ -311,6 +379,167 @@ mares_iconhd_transfer (mares_iconhd_device_t *device, const unsigned char comman
 	return DC_STATUS_SUCCESS;
 }
 
+static void
+mares_iconhd_command (unsigned char command[10], unsigned int address, unsigned int length)
+{
+	command[0] = 0xE7;
+	command[1] = 0x42;
+	array_uint32_le_set (command + 2, address);
+	array_uint32_le_set (command + 6, length);
+}
+
+/*
+ * Read one packet with the header of the next request already sent. The
+ * device acknowledges the queued header right after the trailer of the
+ * current packet, so the acknowledgement is received together with the
+ * packet, and the round trip for the next header is saved.
+ */
+static dc_status_t
+mares_iconhd_pipelined (mares_iconhd_device_t *device,
+	const unsigned char command[], const unsigned char next[], unsigned int *pending,
+	unsigned char answer[], unsigned int asize)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_device_t *abstract = (dc_device_t *) device;
+
+	if (device_is_cancelled (abstract))
+		return DC_STATUS_CANCELLED;
+
+	// Send the command header, unless it's already in flight.
+	if (!*pending) {
+		status = mares_iconhd_write (device, command, 2);
+		if (status != DC_STATUS_SUCCESS) {
+			ERROR (abstract->context, "Failed to send the command.");
+			return status;
+		}
+
+		unsigned char header[1] = {0};
+		status = mares_iconhd_read (device, header, sizeof (header));
+		if (status != DC_STATUS_SUCCESS) {
+			ERROR (abstract->context, "Failed to receive the answer.");
+			return status;
+		}
+
+		if (header[0] != ACK) {
+			ERROR (abstract->context, "Unexpected answer byte.");
+			return DC_STATUS_PROTOCOL;
+		}
+	}
+
+	// Send the command payload to the dive computer.
+	*pending = 0;
+	status = mares_iconhd_write (device, command + 2, 8);
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR (abstract->context, "Failed to send the command.");
+		return status;
+	}
+
+	// Send the header of the next request ahead of the answer.
+	if (next) {
+		status = mares_iconhd_write (device, next, 2);
+		if (status != DC_STATUS_SUCCESS) {
+			ERROR (abstract->context, "Failed to send the command.");
+			return status;
+		}
+		*pending = 1;
+	}
+
+	// Read the packet, the trailer byte and the header byte of the next
+	// request.
+	unsigned char trailer[2] = {0};
+	dc_iovec_t iov[] = {
+		{answer, asize},
+		{trailer, next ? 2 : 1}};
+	status = mares_iconhd_readv (device, iov, C_ARRAY_SIZE (iov));
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR (abstract->context, "Failed to receive the answer.");
+		return status;
+	}
+
+	// Verify the trailer and header bytes.
+	if (trailer[0] != EOF || (next && trailer[1] != ACK)) {
+		ERROR (abstract->context, "Unexpected answer byte.");
+		return DC_STATUS_PROTOCOL;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+/*
+ * Complete the request which is still in flight after a failure, and
+ * discard the answer, to leave the device waiting for a new command.
+ */
+static void
+mares_iconhd_discard (mares_iconhd_device_t *device, const unsigned char next[], unsigned int size)
+{
+	mares_iconhd_write (device, next + 2, 8);
+
+	unsigned char discard[4096 + 1];
+	if (size + 1 <= sizeof (discard))
+		mares_iconhd_read (device, discard, size + 1);
+
+	dc_iostream_purge (device->iostream, DC_DIRECTION_INPUT);
+}
+
+/*
+ * Find the largest packet size supported over BLE. A block of memory is
+ * read with the default packet size as the reference, and then with each
+ * larger packet size, until one returns the same data. The result is
+ * cached in the context, per model and firmware, to avoid probing again
+ * on the next connection.
+ */
+static unsigned int
+mares_iconhd_device_probe (mares_iconhd_device_t *device, unsigned int maxpacketsize)
+{
+	dc_device_t *abstract = (dc_device_t *) device;
+	static const unsigned int packetsizes[] = {4096, 1024};
+
+	unsigned char key[4 + sizeof (device->version)];
+	array_uint32_le_set (key, device->model);
+	memcpy (key + 4, device->version, sizeof (device->version));
+
+	unsigned int packetsize = device->packetsize;
+	if (dc_context_cache_get (abstract->context, key, sizeof (key), &packetsize))
+		return packetsize;
+
+	unsigned char reference[4096] = {0};
+	dc_status_t rc = mares_iconhd_device_read (abstract, 0, reference, sizeof (reference));
+	if (rc != DC_STATUS_SUCCESS)
+		return device->packetsize;
+
+	for (unsigned int i = 0; i < C_ARRAY_SIZE (packetsizes); ++i) {
+		unsigned int size = packetsizes[i];
+		if (size > maxpacketsize || size <= device->packetsize)
+			continue;
+
+		// A single attempt, with the maximum timeout.
+		rc = device_rtt_set_timeout (abstract, device->iostream, MAXRETRIES);
+		if (rc != DC_STATUS_SUCCESS)
+			break;
+
+		unsigned char command[10];
+		unsigned char data[4096] = {0};
+		mares_iconhd_command (command, 0, size);
+		rc = mares_iconhd_packet (device, command, sizeof (command), data, size);
+		if (rc == DC_STATUS_SUCCESS && memcmp (data, reference, size) == 0) {
+			packetsize = size;
+			break;
+		}
+
+		if (rc == DC_STATUS_CANCELLED)
+			break;
+
+		dc_iostream_purge (device->iostream, DC_DIRECTION_INPUT);
+	}
+
+	if (rc != DC_STATUS_CANCELLED) {
+		INFO (abstract->context, "Detected a packet size of %u bytes.", packetsize);
+		dc_context_cache_set (abstract->context, key, sizeof (key), packetsize);
+	}
+
+	return packetsize;
+}
+
 dc_status_t
 mares_iconhd_device_open (dc_device_t **out, dc_context_t *context, dc_iostream_t *iostream)
 {
@@ -329,15 +558,27 @@ mares_iconhd_device_open (dc_device_t **out, dc_context_t *context, dc_iostream_
 
 	// Set the default values.
 	device->iostream = iostream;
+	device->buffered = NULL;
 	device->layout = NULL;
 	memset (device->fingerprint, 0, sizeof (device->fingerprint));
 	memset (device->version, 0, sizeof (device->version));
 	device->model = 0;
 	device->packetsize = 0;
+	device->pipelining = 0;
 	memset (device->cache, 0, sizeof (device->cache));
 	device->available = 0;
 	device->offset = 0;
 
+	// Buffer the small reads on the serial port.
+	if (dc_iostream_get_transport (iostream) == DC_TRANSPORT_SERIAL) {
+		status = dc_buffered_open (&device->buffered, context, iostream, 0);
+		if (status != DC_STATUS_SUCCESS) {
+			ERROR (context, "Failed to open the buffered I/O stream.");
+			goto error_free;
+		}
+		device->iostream = device->buffered;
+	}
+
 	// Set the serial communication protocol (115200 8E1).
 	status = dc_iostream_configure (device->iostream, 115200, 8, DC_PARITY_EVEN, DC_STOPBITS_ONE, DC_FLOWCONTROL_NONE);
 	if (status != DC_STATUS_SUCCESS) {
@@ -352,6 +593,9 @@ mares_iconhd_device_open (dc_device_t **out, dc_context_t *context, dc_iostream_
 		goto error_free;
 	}
 
+	// Adapt the timeout to the observed round-trip time.
+	device_rtt_init ((dc_device_t *) device, 250, 1000);
+
 	// Clear the DTR line.
 	status = dc_iostream_set_dtr (device->iostream, 0);
 	if (status != DC_STATUS_SUCCESS) {
@@ -381,34 +625,21 @@ mares_iconhd_device_open (dc_device_t **out, dc_context_t *context, dc_iostream_
 	device->model = mares_iconhd_get_model (device);
 
 	// Load the correct memory layout.
-	switch (device->model) {
-	case MATRIX:
-		device->layout = &mares_matrix_layout;
-		device->packetsize = 256;
-		break;
-	case PUCKPRO:
-	case PUCK2:
-	case NEMOWIDE2:
-	case SMART:
-	case SMARTAPNEA:
-	case QUAD:
-		device->layout = &mares_nemowide2_layout;
-		device->packetsize = 256;
-		break;
-	case QUADAIR:
-	case SMARTAIR:
-		device->layout = &mares_iconhdnet_layout;
-		device->packetsize = 256;
-		break;
-	case ICONHDNET:
-		device->layout = &mares_iconhdnet_layout;
-		device->packetsize = 4096;
-		break;
-	case ICONHD:
-	default:
-		device->layout = &mares_iconhd_layout;
-		device->packetsize = 4096;
-		break;
+	const mares_iconhd_config_t *config = &mares_iconhd_configs[C_ARRAY_SIZE (mares_iconhd_configs) - 1];
+	for (unsigned int i = 0; i < C_ARRAY_SIZE (mares_iconhd_configs); ++i) {
+		if (mares_iconhd_configs[i].model == device->model) {
+			config = &mares_iconhd_configs[i];
+			break;
+		}
+	}
+
+	device->layout = config->layout;
+	device->packetsize = config->packetsize;
+
+	// Use the largest packet size the firmware supports.
+	if (dc_iostream_get_transport (device->iostream) == DC_TRANSPORT_BLE &&
+		config->maxpacketsize > config->packetsize) {
+		device->packetsize = mares_iconhd_device_probe (device, config->maxpacketsize);
 	}
 
 	*out = (dc_device_t *) device;
@@ -416,11 +647,21 @@ mares_iconhd_device_open (dc_device_t **out, dc_context_t *context, dc_iostream_
 	return DC_STATUS_SUCCESS;
 
 error_free:
+	dc_iostream_close (device->buffered);
 	dc_device_deallocate ((dc_device_t *) device);
 	return status;
 }
 
 
+static dc_status_t
+mares_iconhd_device_close (dc_device_t *abstract)
+{
+	mares_iconhd_device_t *device = (mares_iconhd_device_t *) abstract;
+
+	return dc_iostream_close (device->buffered);
+}
+
+
 static dc_status_t
 mares_iconhd_device_set_fingerprint (dc_device_t *abstract, const unsigned char data[], unsigned int size)
 {
@@ -438,12 +679,29 @@ mares_iconhd_device_set_fingerprint (dc_device_t *abstract, const unsigned char
 }
 
 
+dc_status_t
+mares_iconhd_device_set_pipelining (dc_device_t *abstract, unsigned int value)
+{
+	mares_iconhd_device_t *device = (mares_iconhd_device_t *) abstract;
+
+	if (!ISINSTANCE (abstract))
+		return DC_STATUS_INVALIDARGS;
+
+	device->pipelining = value;
+
+	return DC_STATUS_SUCCESS;
+}
+
+
 static dc_status_t
 mares_iconhd_device_read (dc_device_t *abstract, unsigned int address, unsigned char data[], unsigned int size)
 {
 	dc_status_t rc = DC_STATUS_SUCCESS;
 	mares_iconhd_device_t *device = (mares_iconhd_device_t *) abstract;
 
+	unsigned int pipelining = device->pipelining;
+	unsigned int pending = 0;
+
 	unsigned int nbytes = 0;
 	while (nbytes < size) {
 		// Calculate the packet size.
@@ -452,16 +710,37 @@ mares_iconhd_device_read (dc_device_t *abstract, unsigned int address, unsigned
 			len = device->packetsize;
 
 		// Read the packet.
-		unsigned char command[] = {0xE7, 0x42,
-			(address      ) & 0xFF,
-			(address >>  8) & 0xFF,
-			(address >> 16) & 0xFF,
-			(address >> 24) & 0xFF,
-			(len      ) & 0xFF,
-			(len >>  8) & 0xFF,
-			(len >> 16) & 0xFF,
-			(len >> 24) & 0xFF};
-		rc = mares_iconhd_transfer (device, command, sizeof (command), data, len);
+		unsigned char command[10];
+		mares_iconhd_command (command, address, len);
+
+		if (pipelining) {
+			// Calculate the size of the next packet.
+			unsigned int nlen = size - nbytes - len;
+			if (nlen > device->packetsize)
+				nlen = device->packetsize;
+
+			unsigned char next[10];
+			mares_iconhd_command (next, address + len, nlen);
+
+			rc = device_rtt_set_timeout (abstract, device->iostream, 0);
+			if (rc != DC_STATUS_SUCCESS)
+				return rc;
+
+			rc = mares_iconhd_pipelined (device, command, nlen ? next : NULL, &pending, data, len);
+			if (rc == DC_STATUS_PROTOCOL || rc == DC_STATUS_TIMEOUT) {
+				// Fall back to the normal transfers, with retries,
+				// for the remainder of the read.
+				if (pending)
+					mares_iconhd_discard (device, next, nlen);
+				else
+					dc_iostream_purge (device->iostream, DC_DIRECTION_INPUT);
+				pending = 0;
+				pipelining = 0;
+				rc = mares_iconhd_transfer (device, command, sizeof (command), data, len);
+			}
+		} else {
+			rc = mares_iconhd_transfer (device, command, sizeof (command), data, len);
+		}
 		if (rc != DC_STATUS_SUCCESS)
 			return rc;
 
@@ -581,7 +860,7 @@ mares_iconhd_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback,
 
 	// Create the ringbuffer stream.
 	dc_rbstream_t *rbstream = NULL;
-	rc = dc_rbstream_new (&rbstream, abstract, 1, device->packetsize, layout->rb_profile_begin, layout->rb_profile_end, eop);
+	rc = dc_rbstream_new (&rbstream, abstract, 1, device->packetsize, layout->rb_profile_begin, layout->rb_profile_end, eop, DC_RBSTREAM_BACKWARD);
 	if (rc != DC_STATUS_SUCCESS) {
 		ERROR (abstract->context, "Failed to create the ringbuffer stream.");
 		return rc;
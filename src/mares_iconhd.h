@@ -26,6 +26,7 @@
 #include <libdivecomputer/iostream.h>
 #include <libdivecomputer/device.h>
 #include <libdivecomputer/parser.h>
+#include <libdivecomputer/mares_iconhd.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -19,6 +19,8 @@
  * MA 02110-1301 USA
  */
 
+#define LOG_SUBSYSTEM DC_LOGSUBSYSTEM_PARSER
+
 #include <stdlib.h>
 
 #include <libdivecomputer/units.h>
@@ -45,11 +47,27 @@
 #define NITROX    2
 #define FREEDIVE  3
 
+typedef struct mares_iconhd_parser_layout_t {
+	unsigned int header;
+	unsigned int swapped;
+	unsigned int headersize;
+	unsigned int samplesize;
+	unsigned int headersize_freedive;
+	unsigned int samplesize_freedive;
+	unsigned int footer;
+	unsigned int datetime;
+	unsigned int datetime_freedive;
+	unsigned int apnea;
+	unsigned int pressure;
+	unsigned int tanks;
+} mares_iconhd_parser_layout_t;
+
 typedef struct mares_iconhd_parser_t mares_iconhd_parser_t;
 
 struct mares_iconhd_parser_t {
 	dc_parser_t base;
 	unsigned int model;
+	const mares_iconhd_parser_layout_t *layout;
 	// Cached fields.
 	unsigned int cached;
 	unsigned int mode;
@@ -79,6 +97,96 @@ static const dc_parser_vtable_t mares_iconhd_parser_vtable = {
 	NULL /* destroy */
 };
 
+static const mares_iconhd_parser_layout_t mares_iconhd_parser_layout = {
+	0x5C, /* header */
+	0,    /* swapped */
+	0x5C, /* headersize */
+	8,    /* samplesize */
+	0x5C, /* headersize_freedive */
+	8,    /* samplesize_freedive */
+	4,    /* footer */
+	6,    /* datetime */
+	6,    /* datetime_freedive */
+	0,    /* apnea */
+	0,    /* pressure */
+	0x5C, /* tanks */
+};
+
+static const mares_iconhd_parser_layout_t mares_iconhdnet_parser_layout = {
+	0x80, /* header */
+	0,    /* swapped */
+	0x80, /* headersize */
+	12,   /* samplesize */
+	0x80, /* headersize_freedive */
+	12,   /* samplesize_freedive */
+	4,    /* footer */
+	6,    /* datetime */
+	6,    /* datetime_freedive */
+	0,    /* apnea */
+	1,    /* pressure */
+	0x58, /* tanks */
+};
+
+static const mares_iconhd_parser_layout_t mares_quadair_parser_layout = {
+	0x84, /* header */
+	0,    /* swapped */
+	0x84, /* headersize */
+	12,   /* samplesize */
+	0x84, /* headersize_freedive */
+	12,   /* samplesize_freedive */
+	4,    /* footer */
+	6,    /* datetime */
+	6,    /* datetime_freedive */
+	0,    /* apnea */
+	1,    /* pressure */
+	0x5C, /* tanks */
+};
+
+static const mares_iconhd_parser_layout_t mares_smart_parser_layout = {
+	4,    /* header (type and number of samples only) */
+	1,    /* swapped */
+	0x5C, /* headersize */
+	8,    /* samplesize */
+	0x2E, /* headersize_freedive */
+	6,    /* samplesize_freedive */
+	0,    /* footer */
+	2,    /* datetime */
+	0x20, /* datetime_freedive */
+	0,    /* apnea */
+	0,    /* pressure */
+	0x5C, /* tanks */
+};
+
+static const mares_iconhd_parser_layout_t mares_smartapnea_parser_layout = {
+	6,    /* header (type and number of samples only) */
+	1,    /* swapped */
+	0x50, /* headersize */
+	14,   /* samplesize */
+	0x50, /* headersize_freedive */
+	14,   /* samplesize_freedive */
+	0,    /* footer */
+	0x40, /* datetime */
+	0x40, /* datetime_freedive */
+	1,    /* apnea */
+	0,    /* pressure */
+	0x5C, /* tanks */
+};
+
+static const mares_iconhd_parser_layout_t mares_smartair_parser_layout = {
+	4,    /* header (type and number of samples only) */
+	1,    /* swapped */
+	0x84, /* headersize */
+	12,   /* samplesize */
+	0x84, /* headersize_freedive */
+	12,   /* samplesize_freedive */
+	0,    /* footer */
+	2,    /* datetime */
+	2,    /* datetime_freedive */
+	0,    /* apnea */
+	1,    /* pressure */
+	0x5C, /* tanks */
+};
+
 static dc_status_t
 mares_iconhd_parser_cache (mares_iconhd_parser_t *parser)
 {
@@ -90,15 +198,8 @@ mares_iconhd_parser_cache (mares_iconhd_parser_t *parser)
 		return DC_STATUS_SUCCESS;
 	}
 
-	unsigned int header = 0x5C;
-	if (parser->model == ICONHDNET)
-		header = 0x80;
-	else if (parser->model == QUADAIR)
-		header = 0x84;
-	else if (parser->model == SMART || parser->model == SMARTAIR)
-		header = 4; // Type and number of samples only!
-	else if (parser->model == SMARTAPNEA)
-		header = 6; // Type and number of samples only!
+	const mares_iconhd_parser_layout_t *layout = parser->layout;
+	unsigned int header = layout->header;
 
 	if (size < header + 4) {
 		ERROR (abstract->context, "Buffer overflow detected!");
@@ -113,7 +214,7 @@ mares_iconhd_parser_cache (mares_iconhd_parser_t *parser)
 
 	// Get the number of samples in the profile data.
 	unsigned int type = 0, nsamples = 0;
-	if (parser->model == SMART || parser->model == SMARTAPNEA || parser->model == SMARTAIR) {
+	if (layout->swapped) {
 		type     = array_uint16_le (data + length - header + 2);
 		nsamples = array_uint16_le (data + length - header + 0);
 	} else {
@@ -125,25 +226,11 @@ mares_iconhd_parser_cache (mares_iconhd_parser_t *parser)
 	unsigned int mode = type & 0x03;
 
 	// Get the header and sample size.
-	unsigned int headersize = 0x5C;
-	unsigned int samplesize = 8;
-	if (parser->model == ICONHDNET) {
-		headersize = 0x80;
-		samplesize = 12;
-	} else if (parser->model == QUADAIR || parser->model == SMARTAIR) {
-		headersize = 0x84;
-		samplesize = 12;
-	} else if (parser->model == SMART) {
-		if (mode == FREEDIVE) {
-			headersize = 0x2E;
-			samplesize = 6;
-		} else {
-			headersize = 0x5C;
-			samplesize = 8;
-		}
-	} else if (parser->model == SMARTAPNEA) {
-		headersize = 0x50;
-		samplesize = 14;
+	unsigned int headersize = layout->headersize;
+	unsigned int samplesize = layout->samplesize;
+	if (mode == FREEDIVE) {
+		headersize = layout->headersize_freedive;
+		samplesize = layout->samplesize_freedive;
 	}
 
 	if (length < headersize) {
@@ -151,14 +238,11 @@ mares_iconhd_parser_cache (mares_iconhd_parser_t *parser)
 		return DC_STATUS_DATAFORMAT;
 	}
 
-	const unsigned char *p = data + length - headersize;
-	if (parser->model != SMART && parser->model != SMARTAPNEA && parser->model != SMARTAIR) {
-		p += 4;
-	}
+	const unsigned char *p = data + length - headersize + layout->footer;
 
 	// Get the dive settings.
 	unsigned int settings = 0;
-	if (parser->model == SMARTAPNEA) {
+	if (layout->apnea) {
 		settings = array_uint16_le (p + 0x1C);
 	} else if (parser->mode == FREEDIVE) {
 		settings = array_uint16_le (p + 0x08);
@@ -169,7 +253,7 @@ mares_iconhd_parser_cache (mares_iconhd_parser_t *parser)
 	// Get the sample interval.
 	unsigned int interval = 0;
 	unsigned int samplerate = 0;
-	if (parser->model == SMARTAPNEA) {
+	if (layout->apnea) {
 		unsigned int idx = (settings & 0x0600) >> 9;
 		interval = 1;
 		samplerate = 1 << idx;
@@ -182,9 +266,9 @@ mares_iconhd_parser_cache (mares_iconhd_parser_t *parser)
 
 	// Calculate the total number of bytes for this dive.
 	unsigned int nbytes = 4 + headersize + nsamples * samplesize;
-	if (parser->model == ICONHDNET || parser->model == QUADAIR || parser->model == SMARTAIR) {
+	if (layout->pressure) {
 		nbytes += (nsamples / 4) * 8;
-	} else if (parser->model == SMARTAPNEA) {
+	} else if (layout->apnea) {
 		unsigned int divetime = array_uint32_le (p + 0x24);
 		nbytes += divetime * samplerate * 2;
 	}
@@ -216,8 +300,8 @@ mares_iconhd_parser_cache (mares_iconhd_parser_t *parser)
 
 	// Tanks
 	unsigned int ntanks = 0;
-	if (parser->model == ICONHDNET || parser->model == QUADAIR || parser->model == SMARTAIR) {
-		unsigned int tankoffset = (parser->model == ICONHDNET) ? 0x58 : 0x5C;
+	if (layout->pressure) {
+		unsigned int tankoffset = layout->tanks;
 		while (ntanks < NTANKS) {
 			unsigned int beginpressure = array_uint16_le (p + tankoffset + ntanks * 4 + 0);
 			unsigned int endpressure   = array_uint16_le (p + tankoffset + ntanks * 4 + 2);
@@ -263,6 +347,19 @@ mares_iconhd_parser_create (dc_parser_t **out, dc_context_t *context, unsigned i
 
 	// Set the default values.
 	parser->model = model;
+	if (model == ICONHDNET) {
+		parser->layout = &mares_iconhdnet_parser_layout;
+	} else if (model == QUADAIR) {
+		parser->layout = &mares_quadair_parser_layout;
+	} else if (model == SMART) {
+		parser->layout = &mares_smart_parser_layout;
+	} else if (model == SMARTAPNEA) {
+		parser->layout = &mares_smartapnea_parser_layout;
+	} else if (model == SMARTAIR) {
+		parser->layout = &mares_smartair_parser_layout;
+	} else {
+		parser->layout = &mares_iconhd_parser_layout;
+	}
 	parser->cached = 0;
 	parser->mode = AIR;
 	parser->nsamples = 0;
@@ -317,19 +414,13 @@ mares_iconhd_parser_get_datetime (dc_parser_t *abstract, dc_datetime_t *datetime
 	if (rc != DC_STATUS_SUCCESS)
 		return rc;
 
+	const mares_iconhd_parser_layout_t *layout = parser->layout;
+
 	const unsigned char *p = abstract->data + parser->footer;
-	if (parser->model == SMART) {
-		if (parser->mode == FREEDIVE) {
-			p += 0x20;
-		} else {
-			p += 2;
-		}
-	} else if (parser->model == SMARTAPNEA) {
-		p += 0x40;
-	} else if (parser->model == SMARTAIR) {
-		p += 2;
+	if (parser->mode == FREEDIVE) {
+		p += layout->datetime_freedive;
 	} else {
-		p += 6;
+		p += layout->datetime;
 	}
 
 	if (datetime) {
@@ -356,10 +447,9 @@ mares_iconhd_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, unsi
 	if (rc != DC_STATUS_SUCCESS)
 		return rc;
 
-	const unsigned char *p = abstract->data + parser->footer;
-	if (parser->model != SMART && parser->model != SMARTAPNEA && parser->model != SMARTAIR) {
-		p += 4;
-	}
+	const mares_iconhd_parser_layout_t *layout = parser->layout;
+
+	const unsigned char *p = abstract->data + parser->footer + layout->footer;
 
 	unsigned int volume = 0, workpressure = 0;
 	unsigned int tankoffset = 0;
@@ -371,7 +461,7 @@ mares_iconhd_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, unsi
 	if (value) {
 		switch (type) {
 		case DC_FIELD_DIVETIME:
-			if (parser->model == SMARTAPNEA) {
+			if (layout->apnea) {
 				*((unsigned int *) value) = array_uint16_le (p + 0x24);
 			} else if (parser->mode == FREEDIVE) {
 				unsigned int divetime = 0;
@@ -386,7 +476,7 @@ mares_iconhd_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, unsi
 			}
 			break;
 		case DC_FIELD_MAXDEPTH:
-			if (parser->model == SMARTAPNEA)
+			if (layout->apnea)
 				*((double *) value) = array_uint16_le (p + 0x3A) / 10.0;
 			else if (parser->mode == FREEDIVE)
 				*((double *) value) = array_uint16_le (p + 0x1A) / 10.0;
@@ -405,7 +495,7 @@ mares_iconhd_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, unsi
 			*((unsigned int *) value) = parser->ntanks;
 			break;
 		case DC_FIELD_TANK:
-			tankoffset = (parser->model == ICONHDNET) ? 0x58 : 0x5C;
+			tankoffset = layout->tanks;
 			volume = array_uint16_le (p + tankoffset + 0x0C + flags * 8 + 0);
 			workpressure = array_uint16_le (p + tankoffset + 0x0C + flags * 8 + 2);
 			if (parser->settings & 0x0100) {
@@ -430,7 +520,7 @@ mares_iconhd_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, unsi
 			break;
 		case DC_FIELD_ATMOSPHERIC:
 			// Pressure (1/8 millibar)
-			if (parser->model == SMARTAPNEA)
+			if (layout->apnea)
 				*((double *) value) = array_uint16_le (p + 0x38) / 1000.0;
 			else if (parser->mode == FREEDIVE)
 				*((double *) value) = array_uint16_le (p + 0x18) / 1000.0;
@@ -438,7 +528,7 @@ mares_iconhd_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, unsi
 				*((double *) value) = array_uint16_le (p + 0x22) / 8000.0;
 			break;
 		case DC_FIELD_SALINITY:
-			if (parser->model == SMARTAPNEA) {
+			if (layout->apnea) {
 				unsigned int salinity = parser->settings & 0x003F;
 				if (salinity == 0) {
 					water->type = DC_WATER_FRESH;
@@ -456,7 +546,7 @@ mares_iconhd_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, unsi
 			}
 			break;
 		case DC_FIELD_TEMPERATURE_MINIMUM:
-			if (parser->model == SMARTAPNEA)
+			if (layout->apnea)
 				*((double *) value) = (signed short) array_uint16_le (p + 0x3E) / 10.0;
 			else if (parser->mode == FREEDIVE)
 				*((double *) value) = (signed short) array_uint16_le (p + 0x1C) / 10.0;
@@ -464,7 +554,7 @@ mares_iconhd_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, unsi
 				*((double *) value) = (signed short) array_uint16_le (p + 0x42) / 10.0;
 			break;
 		case DC_FIELD_TEMPERATURE_MAXIMUM:
-			if (parser->model == SMARTAPNEA)
+			if (layout->apnea)
 				*((double *) value) = (signed short) array_uint16_le (p + 0x3C) / 10.0;
 			else if (parser->mode == FREEDIVE)
 				*((double *) value) = (signed short) array_uint16_le (p + 0x1E) / 10.0;
@@ -506,6 +596,7 @@ mares_iconhd_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t
 	if (rc != DC_STATUS_SUCCESS)
 		return rc;
 
+	const mares_iconhd_parser_layout_t *layout = parser->layout;
 	const unsigned char *data = abstract->data;
 
 	if (parser->samplerate > 1) {
@@ -525,7 +616,7 @@ mares_iconhd_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t
 	while (nsamples < parser->nsamples) {
 		dc_sample_value_t sample = {0};
 
-		if (parser->model == SMARTAPNEA) {
+		if (layout->apnea) {
 			unsigned int maxdepth = array_uint16_le (data + offset + 0);
 			unsigned int divetime = array_uint16_le (data + offset + 2);
 			unsigned int surftime = array_uint16_le (data + offset + 4);
@@ -614,8 +705,7 @@ mares_iconhd_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t
 			nsamples++;
 
 			// Some extra data.
-			if ((parser->model == ICONHDNET || parser->model == QUADAIR || parser->model == SMARTAIR) &&
-				(nsamples % 4) == 0) {
+			if (layout->pressure && (nsamples % 4) == 0) {
 				// Pressure (1/100 bar).
 				unsigned int pressure = array_uint16_le(data + offset);
 				if (gasmix < parser->ntanks) {
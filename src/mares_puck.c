@@ -121,6 +121,9 @@ mares_puck_device_open (dc_device_t **out, dc_context_t *context, dc_iostream_t
 		goto error_free;
 	}
 
+	// Adapt the timeout to the observed round-trip time.
+	device_rtt_init ((dc_device_t *) device, 250, 1000);
+
 	// Clear the DTR line.
 	status = dc_iostream_set_dtr (device->base.iostream, 0);
 	if (status != DC_STATUS_SUCCESS) {
@@ -22,6 +22,8 @@
 #include <string.h> // memcpy
 #include <stdlib.h> // malloc, free
 
+#include <libdivecomputer/ble.h>
+
 #include "oceanic_atom2.h"
 #include "oceanic_common.h"
 #include "context-private.h"
@@ -30,6 +32,8 @@
 #include "ringbuffer.h"
 #include "checksum.h"
 
+#define C_ARRAY_SIZE(array) (sizeof (array) / sizeof *(array))
+
 #define ISINSTANCE(device) dc_device_isinstance((device), &oceanic_atom2_device_vtable.base)
 
 #define PROPLUSX   0x4552
@@ -54,6 +58,9 @@
 #define ACK 0x5A
 #define NAK 0xA5
 
+#define SZ_BLECACHE 2048
+#define NBLEPACKETS 128
+
 typedef struct oceanic_atom2_device_t {
 	oceanic_common_device_t base;
 	dc_iostream_t *iostream;
@@ -63,6 +70,10 @@ typedef struct oceanic_atom2_device_t {
 	unsigned char cache[256];
 	unsigned int cached_page;
 	unsigned int cached_highmem;
+	// Queued BLE packets, stored back to back.
+	unsigned char packets[SZ_BLECACHE];
+	size_t lengths[NBLEPACKETS];
+	unsigned int npackets, packet, offset;
 } oceanic_atom2_device_t;
 
 static dc_status_t oceanic_atom2_device_read (dc_device_t *abstract, unsigned int address, unsigned char data[], unsigned int size);
@@ -551,6 +562,8 @@ oceanic_atom2_packet (oceanic_atom2_device_t *device, const unsigned char comman
 		dc_iostream_sleep (device->iostream, device->delay);
 	}
 
+	dc_usecs_t start = device_latency_start (abstract);
+
 	// Send the command to the dive computer.
 	status = dc_iostream_write (device->iostream, command, csize, NULL);
 	if (status != DC_STATUS_SUCCESS) {
@@ -601,6 +614,8 @@ oceanic_atom2_packet (oceanic_atom2_device_t *device, const unsigned char comman
 		}
 	}
 
+	device_latency_emit (abstract, command[0], asize, start);
+
 	return DC_STATUS_SUCCESS;
 }
 
@@ -614,9 +629,23 @@ oceanic_atom2_serial_transfer (oceanic_atom2_device_t *device, const unsigned ch
 	// a NAK byte, we try to resend the command a number of times before
 	// returning an error.
 
+	dc_device_t *abstract = (dc_device_t *) device;
 	unsigned int nretries = 0;
 	dc_status_t rc = DC_STATUS_SUCCESS;
-	while ((rc = oceanic_atom2_packet (device, command, csize, answer, asize, crc_size)) != DC_STATUS_SUCCESS) {
+	while (1) {
+		// Adapt the timeout to the number of attempts.
+		rc = device_rtt_set_timeout (abstract, device->iostream, nretries);
+		if (rc != DC_STATUS_SUCCESS)
+			return rc;
+
+		dc_usecs_t start = device_rtt_start (abstract);
+		rc = oceanic_atom2_packet (device, command, csize, answer, asize, crc_size);
+		if (rc == DC_STATUS_SUCCESS) {
+			if (nretries == 0)
+				device_rtt_sample (abstract, start);
+			break;
+		}
+
 		if (rc != DC_STATUS_TIMEOUT && rc != DC_STATUS_PROTOCOL)
 			return rc;
 
@@ -629,7 +658,7 @@ oceanic_atom2_serial_transfer (oceanic_atom2_device_t *device, const unsigned ch
 			device->delay++;
 
 		// Delay the next attempt.
-		dc_iostream_sleep (device->iostream, 100);
+		dc_iostream_sleep (device->iostream, device_rtt_backoff (abstract, nretries, 100));
 		dc_iostream_purge (device->iostream, DC_DIRECTION_INPUT);
 	}
 
@@ -683,12 +712,46 @@ oceanic_atom2_ble_write(oceanic_atom2_device_t *device, const unsigned char comm
 	return DC_STATUS_SUCCESS;
 }
 
+/*
+ * Get the next GATT packet. All the notifications which are already
+ * queued are read at once, and then handed out one by one, instead of
+ * a separate read for every 20 byte packet.
+ */
 static dc_status_t
-oceanic_atom2_ble_read(oceanic_atom2_device_t *device, unsigned char **result_p, unsigned int *size_p)
+oceanic_atom2_ble_packet(oceanic_atom2_device_t *device, const unsigned char **packet, size_t *size)
 {
-	unsigned char *result = NULL;
-	unsigned int size = 0, allocated = 0;
-	unsigned char buf[20];
+	dc_status_t ret = DC_STATUS_SUCCESS;
+
+	if (device->packet == device->npackets) {
+		size_t npackets = 0, actual = 0;
+		ret = dc_ble_read_packets(device->iostream, device->packets, sizeof(device->packets),
+			device->lengths, C_ARRAY_SIZE(device->lengths), &npackets, NULL);
+		if (ret == DC_STATUS_UNSUPPORTED) {
+			// Read a single packet from a custom I/O stream.
+			ret = dc_iostream_read(device->iostream, device->packets, sizeof(device->packets), &actual);
+			device->lengths[0] = actual;
+			npackets = 1;
+		}
+		if (ret != DC_STATUS_SUCCESS)
+			return ret;
+
+		device->npackets = npackets;
+		device->packet = 0;
+		device->offset = 0;
+	}
+
+	*packet = device->packets + device->offset;
+	*size = device->lengths[device->packet];
+	device->offset += *size;
+	device->packet++;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+oceanic_atom2_ble_read(oceanic_atom2_device_t *device, unsigned char result[], unsigned int allocated, unsigned int *size_p)
+{
+	unsigned int size = 0;
 	unsigned char cmd_seq = device->sequence;
 	unsigned char pkt_seq;
 	dc_status_t ret = DC_STATUS_SUCCESS;
@@ -696,8 +759,9 @@ oceanic_atom2_ble_read(oceanic_atom2_device_t *device, unsigned char **result_p,
 	pkt_seq = 0;
 	for (;;) {
 		unsigned char status, expect;
+		const unsigned char *buf = NULL;
 		size_t transferred = 0;
-		ret = dc_iostream_read(device->iostream, buf, sizeof(buf), &transferred);
+		ret = oceanic_atom2_ble_packet(device, &buf, &transferred);
 		if (ret != DC_STATUS_SUCCESS)
 			break;
 
@@ -734,14 +798,8 @@ oceanic_atom2_ble_read(oceanic_atom2_device_t *device, unsigned char **result_p,
 		}
 
 		if (size + expect > allocated) {
-			unsigned int newsize = size + expect + 100;
-			unsigned char *newalloc = realloc(result, newsize);
-			if (!newalloc) {
-				ret = DC_STATUS_NOMEMORY;
-				break;
-			}
-			result = newalloc;
-			allocated = newsize;
+			ERROR(device->base.base.context, "Reply too large (more than %u bytes)", allocated);
+			break;
 		}
 
 		memcpy(result + size, buf+4, expect);
@@ -756,12 +814,8 @@ oceanic_atom2_ble_read(oceanic_atom2_device_t *device, unsigned char **result_p,
 		break;
 	}
 
-	if (ret != DC_STATUS_SUCCESS) {
-		free(result);
+	if (ret != DC_STATUS_SUCCESS)
 		size = 0;
-		result = NULL;
-	}
-	*result_p = result;
 	*size_p = size;
 	return ret;
 }
@@ -779,9 +833,8 @@ oceanic_atom2_ble_read(oceanic_atom2_device_t *device, unsigned char **result_p,
 static dc_status_t
 oceanic_atom2_ble_transfer (oceanic_atom2_device_t *device, const unsigned char command[], unsigned int csize, unsigned char answer[], unsigned int asize, unsigned int crc_size)
 {
-	unsigned char buf[20];
-	unsigned char cmd_seq = device->sequence;
-	unsigned char pkt_seq;
+	// The ACK byte, up to 16 pages and a 2 byte checksum.
+	unsigned char buf[1 + 256 + 2];
 	dc_status_t ret = DC_STATUS_SUCCESS;
 	int retry = 3;
 
@@ -797,15 +850,16 @@ retry:
 	if (--retry < 0)
 		return ret;
 
+	// Packets which are still queued belong to an earlier command.
+	device->npackets = device->packet = 0;
+
 	ret = oceanic_atom2_ble_write(device, command, csize);
 	if (ret != DC_STATUS_SUCCESS)
 		return ret;
 
-	pkt_seq = 0;
 	if (answer) {
-		unsigned char *buf;
 		unsigned int size;
-		ret = oceanic_atom2_ble_read(device, &buf, &size);
+		ret = oceanic_atom2_ble_read(device, buf, sizeof(buf), &size);
 		if (ret != DC_STATUS_SUCCESS)
 			goto retry;
 		if (size > asize && buf[0] == ACK) {
@@ -816,7 +870,6 @@ retry:
 			ret = DC_STATUS_IO;
 			goto retry;
 		}
-		free(buf);
 	}
 
 	return ret;
@@ -844,6 +897,69 @@ oceanic_atom2_quit (oceanic_atom2_device_t *device)
 }
 
 
+/*
+ * Find the largest multi-page read command supported by the firmware. The
+ * first page is read with the single page command as the reference, and
+ * then with each multi-page command, until one returns the same data. A
+ * device that doesn't support a command responds with a NAK, or not at
+ * all. The result is cached in the context, per model and firmware, to
+ * avoid probing again on the next connection.
+ */
+static unsigned int
+oceanic_atom2_device_probe (oceanic_atom2_device_t *device, unsigned int model)
+{
+	dc_device_t *abstract = (dc_device_t *) device;
+	static const unsigned int bigpages[] = {16, 8};
+
+	unsigned char key[4 + PAGESIZE];
+	array_uint32_le_set (key, model);
+	memcpy (key + 4, device->base.version, PAGESIZE);
+
+	unsigned int bigpage = 1;
+	if (dc_context_cache_get (abstract->context, key, sizeof (key), &bigpage))
+		return bigpage;
+
+	unsigned char reference[PAGESIZE] = {0};
+	device->bigpage = 1;
+	device->cached_page = INVALID;
+	dc_status_t rc = oceanic_atom2_device_read (abstract, 0, reference, sizeof (reference));
+	if (rc != DC_STATUS_SUCCESS)
+		return 1;
+
+	// A failed attempt shouldn't slow down the rest of the download.
+	unsigned int delay = device->delay;
+
+	for (unsigned int i = 0; i < C_ARRAY_SIZE (bigpages); ++i) {
+		unsigned char data[PAGESIZE] = {0};
+		device->bigpage = bigpages[i];
+		device->cached_page = INVALID;
+		rc = oceanic_atom2_device_read (abstract, 0, data, sizeof (data));
+		if (rc == DC_STATUS_SUCCESS && memcmp (data, reference, sizeof (data)) == 0) {
+			bigpage = bigpages[i];
+			break;
+		}
+
+		if (rc == DC_STATUS_CANCELLED) {
+			bigpage = 1;
+			break;
+		}
+
+		dc_iostream_purge (device->iostream, DC_DIRECTION_INPUT);
+	}
+
+	device->delay = delay;
+	device->bigpage = 1;
+	device->cached_page = INVALID;
+
+	if (rc != DC_STATUS_CANCELLED) {
+		INFO (abstract->context, "Detected a read size of %u pages.", bigpage);
+		dc_context_cache_set (abstract->context, key, sizeof (key), bigpage);
+	}
+
+	return bigpage;
+}
+
+
 dc_status_t
 oceanic_atom2_device_open (dc_device_t **out, dc_context_t *context, dc_iostream_t *iostream, unsigned int model)
 {
@@ -871,6 +987,9 @@ oceanic_atom2_device_open (dc_device_t **out, dc_context_t *context, dc_iostream
 	device->cached_page = INVALID;
 	device->cached_highmem = INVALID;
 	memset(device->cache, 0, sizeof(device->cache));
+	device->npackets = 0;
+	device->packet = 0;
+	device->offset = 0;
 
 	// Get the correct baudrate.
 	unsigned int baudrate = 38400;
@@ -892,6 +1011,15 @@ oceanic_atom2_device_open (dc_device_t **out, dc_context_t *context, dc_iostream
 		goto error_free;
 	}
 
+	// Adapt the timeout to the observed round-trip time.
+	device_rtt_init ((dc_device_t *) device, 250, 1000);
+
+	// Every page is a separate command, so the download time is dominated
+	// by the BLE connection interval. Missing support is not an error.
+	if (dc_iostream_get_transport (device->iostream) == DC_TRANSPORT_BLE) {
+		dc_ble_set_interval (device->iostream, DC_BLE_INTERVAL_MIN, 2 * DC_BLE_INTERVAL_MIN);
+	}
+
 	// Set the DTR line.
 	status = dc_iostream_set_dtr (device->iostream, 1);
 	if (status != DC_STATUS_SUCCESS) {
@@ -1001,6 +1129,9 @@ oceanic_atom2_device_open (dc_device_t **out, dc_context_t *context, dc_iostream
 		} else {
 			device->base.layout = &oceanic_default_layout;
 		}
+
+		// Use the fastest read command the firmware supports.
+		device->bigpage = oceanic_atom2_device_probe (device, model);
 	}
 
 	*out = (dc_device_t*) device;
@@ -19,6 +19,8 @@
  * MA 02110-1301 USA
  */
 
+#define LOG_SUBSYSTEM DC_LOGSUBSYSTEM_PARSER
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -99,7 +101,63 @@
 #define NGASMIXES 6
 
 #define HEADER  1
-#define PROFILE 2
+
+#define TANK_DATAMASK 0
+#define TANK_A300CS   1
+#define TANK_ATOM2    2
+#define TANK_DEFAULT  3
+
+#define TEMPERATURE_BYTE  0
+#define TEMPERATURE_VT4   1
+#define TEMPERATURE_DELTA 2
+
+#define PRESSURE_UINT16 0
+#define PRESSURE_VT4    1
+#define PRESSURE_DELTA  2
+
+#define DEPTH_UINT16 0
+#define DEPTH_ATOM1  1
+
+typedef struct oceanic_atom2_sample_layout_t {
+	// Sample interval and size.
+	unsigned int interval;
+	unsigned int samplerate;
+	unsigned int samplesize;
+	unsigned int samplesize_freedive;
+	// Tank pressure.
+	unsigned int pressure;
+	unsigned int pressure_initial;
+	unsigned int pressure_type;
+	unsigned int pressure_offset;
+	unsigned int pressure_mask;
+	unsigned int tankswitch;
+	// Temperature.
+	unsigned int temperature_type;
+	unsigned int temperature_offset;
+	unsigned int sign_offset;
+	unsigned int sign_mask;
+	unsigned int sign_invert;
+	// Depth.
+	unsigned int depth_type;
+	unsigned int depth_offset;
+	// Absolute timestamps.
+	unsigned int timestamp;
+	// Gas mix.
+	unsigned int gasmix;
+	// NDL / Deco.
+	unsigned int deco;
+	unsigned int decostop_offset;
+	unsigned int decostop_mask;
+	unsigned int decostop_shift;
+	unsigned int decotime_offset;
+	unsigned int decotime_mask;
+	// Remaining bottom time.
+	unsigned int rbt;
+	unsigned int rbt_offset;
+	unsigned int rbt_mask;
+	// Bookmarks.
+	unsigned int bookmark;
+} oceanic_atom2_sample_layout_t;
 
 typedef struct oceanic_atom2_parser_t oceanic_atom2_parser_t;
 
@@ -109,6 +167,7 @@ struct oceanic_atom2_parser_t {
 	unsigned int headersize;
 	unsigned int footersize;
 	unsigned int serial;
+	oceanic_atom2_sample_layout_t layout;
 	// Cached fields.
 	unsigned int cached;
 	unsigned int header;
@@ -117,8 +176,6 @@ struct oceanic_atom2_parser_t {
 	unsigned int ngasmixes;
 	unsigned int oxygen[NGASMIXES];
 	unsigned int helium[NGASMIXES];
-	unsigned int divetime;
-	double maxdepth;
 };
 
 static dc_status_t oceanic_atom2_parser_set_data (dc_parser_t *abstract, const unsigned char *data, unsigned int size);
@@ -137,6 +194,217 @@ static const dc_parser_vtable_t oceanic_atom2_parser_vtable = {
 };
 
 
+static void
+oceanic_atom2_parser_layout (oceanic_atom2_sample_layout_t *layout, unsigned int model)
+{
+	// Sample interval and size.
+	layout->interval = 0x17;
+	if (model == A300CS || model == VTX ||
+		model == I450T || model == I750TC ||
+		model == PROPLUSX || model == I770R)
+		layout->interval = 0x1f;
+	layout->samplerate = (model == F11A || model == F11B);
+
+	layout->samplesize = PAGESIZE / 2;
+	if (model == OC1A || model == OC1B ||
+		model == OC1C || model == OCI ||
+		model == TX1 || model == A300CS ||
+		model == VTX || model == I450T ||
+		model == I750TC || model == PROPLUSX ||
+		model == I770R)
+		layout->samplesize = PAGESIZE;
+	layout->samplesize_freedive = 4;
+	if (model == F10A || model == F10B ||
+		model == F11A || model == F11B ||
+		model == MUNDIAL2 || model == MUNDIAL3)
+		layout->samplesize_freedive = 2;
+
+	// Tank pressure.
+	layout->pressure = 1;
+	if (model == VEO30 || model == OCS ||
+		model == ELEMENT2 || model == VEO20 ||
+		model == A300 || model == ZEN ||
+		model == GEO || model == GEO20 ||
+		model == MANTA || model == I300 ||
+		model == I200 || model == I100 ||
+		model == I300C)
+		layout->pressure = 0;
+
+	layout->pressure_initial = 2;
+	if (model == A300CS || model == VTX ||
+		model == I750TC || model == I770R)
+		layout->pressure_initial = 16;
+
+	layout->pressure_type = PRESSURE_DELTA;
+	layout->pressure_offset = 0;
+	layout->pressure_mask = 0;
+	if (model == OC1A || model == OC1B ||
+		model == OC1C || model == OCI ||
+		model == I450T) {
+		layout->pressure_type = PRESSURE_UINT16;
+		layout->pressure_offset = 10;
+		layout->pressure_mask = 0x0FFF;
+	} else if (model == VT4 || model == VT41||
+		model == ATOM3 || model == ATOM31 ||
+		model == ZENAIR ||model == A300AI ||
+		model == DG03 || model == PROPLUS3 ||
+		model == AMPHOSAIR || model == I550 ||
+		model == VISION || model == XPAIR) {
+		layout->pressure_type = PRESSURE_VT4;
+	} else if (model == TX1 || model == A300CS ||
+		model == VTX || model == I750TC ||
+		model == PROPLUSX || model == I770R) {
+		layout->pressure_type = PRESSURE_UINT16;
+		layout->pressure_offset = 4;
+		layout->pressure_mask = 0xFFFF;
+	}
+
+	layout->tankswitch = TANK_DEFAULT;
+	if (model == DATAMASK || model == COMPUMASK)
+		layout->tankswitch = TANK_DATAMASK;
+	else if (model == A300CS || model == VTX ||
+		model == I750TC || model == I770R)
+		layout->tankswitch = TANK_A300CS;
+	else if (model == ATOM2 || model == EPICA || model == EPICB)
+		layout->tankswitch = TANK_ATOM2;
+
+	// Temperature.
+	layout->temperature_type = TEMPERATURE_DELTA;
+	layout->temperature_offset = 0;
+	layout->sign_offset = 0;
+	layout->sign_mask = 0x80;
+	layout->sign_invert = 0xFF;
+	if (model == GEO || model == ATOM1 ||
+		model == ELEMENT2 || model == MANTA ||
+		model == ZEN) {
+		layout->temperature_type = TEMPERATURE_BYTE;
+		layout->temperature_offset = 6;
+	} else if (model == GEO20 || model == VEO20 ||
+		model == VEO30 || model == OC1A ||
+		model == OC1B || model == OC1C ||
+		model == OCI || model == A300 ||
+		model == I450T || model == I300 ||
+		model == I200 || model == I100 ||
+		model == I300C) {
+		layout->temperature_type = TEMPERATURE_BYTE;
+		layout->temperature_offset = 3;
+	} else if (model == OCS || model == TX1) {
+		layout->temperature_type = TEMPERATURE_BYTE;
+		layout->temperature_offset = 1;
+	} else if (model == VT4 || model == VT41 ||
+		model == ATOM3 || model == ATOM31 ||
+		model == A300AI || model == VISION ||
+		model == XPAIR) {
+		layout->temperature_type = TEMPERATURE_VT4;
+	} else if (model == A300CS || model == VTX ||
+		model == I750TC || model == PROPLUSX ||
+		model == I770R) {
+		layout->temperature_type = TEMPERATURE_BYTE;
+		layout->temperature_offset = 11;
+	} else if (model == DG03 || model == PROPLUS3 ||
+		model == I550) {
+		layout->sign_offset = 5;
+		layout->sign_mask = 0x04;
+		layout->sign_invert = 0xFF;
+	} else if (model == VOYAGER2G || model == AMPHOS ||
+		model == AMPHOSAIR || model == ZENAIR) {
+		layout->sign_offset = 5;
+		layout->sign_mask = 0x04;
+		layout->sign_invert = 0x00;
+	} else if (model == ATOM2 || model == PROPLUS21 ||
+		model == EPICA || model == EPICB ||
+		model == ATMOSAI2 ||
+		model == WISDOM2 || model == WISDOM3) {
+		layout->sign_offset = 0;
+		layout->sign_mask = 0x80;
+		layout->sign_invert = 0x00;
+	}
+
+	// Depth.
+	layout->depth_type = DEPTH_UINT16;
+	layout->depth_offset = 2;
+	if (model == GEO20 || model == VEO20 ||
+		model == VEO30 || model == OC1A ||
+		model == OC1B || model == OC1C ||
+		model == OCI || model == A300 ||
+		model == I450T || model == I300 ||
+		model == I200 || model == I100 ||
+		model == I300C)
+		layout->depth_offset = 4;
+	else if (model == ATOM1)
+		layout->depth_type = DEPTH_ATOM1;
+
+	// Absolute timestamps.
+	layout->timestamp = (model == I450T);
+
+	// Gas mix.
+	layout->gasmix = (model == TX1);
+
+	// NDL / Deco.
+	layout->deco = 1;
+	layout->decostop_shift = 4;
+	layout->decotime_offset = 6;
+	layout->decotime_mask = 0x0FFF;
+	if (model == A300CS || model == VTX ||
+		model == I750TC ||
+		model == PROPLUSX || model == I770R) {
+		layout->decostop_offset = 15;
+		layout->decostop_mask = 0x70;
+		layout->decotime_mask = 0x03FF;
+	} else if (model == ZEN || model == DG03) {
+		layout->decostop_offset = 5;
+		layout->decostop_mask = 0xF0;
+		layout->decotime_offset = 4;
+	} else if (model == TX1) {
+		layout->decostop_offset = 10;
+		layout->decostop_mask = 0xFF;
+		layout->decostop_shift = 0;
+		layout->decotime_mask = 0xFFFF;
+	} else if (model == ATOM31 || model == VISION ||
+		model == XPAIR || model == I550) {
+		layout->decostop_offset = 5;
+		layout->decostop_mask = 0xF0;
+		layout->decotime_offset = 4;
+		layout->decotime_mask = 0x03FF;
+	} else if (model == I200 || model == I300 ||
+		model == OC1A || model == OC1B ||
+		model == OC1C || model == OCI ||
+		model == I100 || model == I300C ||
+		model == I450T) {
+		layout->decostop_offset = 7;
+		layout->decostop_mask = 0xF0;
+	} else {
+		layout->deco = 0;
+		layout->decostop_offset = 0;
+		layout->decostop_mask = 0;
+	}
+
+	// Remaining bottom time.
+	layout->rbt = 1;
+	if (model == ATOM31) {
+		layout->rbt_offset = 6;
+		layout->rbt_mask = 0x01FF;
+	} else if (model == I450T || model == OC1A ||
+		model == OC1B || model == OC1C ||
+		model == OCI || model == PROPLUSX ||
+		model == I770R) {
+		layout->rbt_offset = 8;
+		layout->rbt_mask = 0x01FF;
+	} else if (model == VISION || model == XPAIR ||
+		model == I550) {
+		layout->rbt_offset = 6;
+		layout->rbt_mask = 0x03FF;
+	} else {
+		layout->rbt = 0;
+		layout->rbt_offset = 0;
+		layout->rbt_mask = 0;
+	}
+
+	// Bookmarks.
+	layout->bookmark = (model == OC1A || model == OC1B ||
+		model == OC1C || model == OCI);
+}
+
 dc_status_t
 oceanic_atom2_parser_create (dc_parser_t **out, dc_context_t *context, unsigned int model, unsigned int serial)
 {
@@ -186,6 +454,8 @@ oceanic_atom2_parser_create (dc_parser_t **out, dc_context_t *context, unsigned
 		parser->headersize = 3 * PAGESIZE;
 	}
 
+	oceanic_atom2_parser_layout (&parser->layout, model);
+
 	parser->serial = serial;
 	parser->cached = 0;
 	parser->header = 0;
@@ -196,8 +466,6 @@ oceanic_atom2_parser_create (dc_parser_t **out, dc_context_t *context, unsigned
 		parser->oxygen[i] = 0;
 		parser->helium[i] = 0;
 	}
-	parser->divetime = 0;
-	parser->maxdepth = 0.0;
 
 	*out = (dc_parser_t*) parser;
 
@@ -220,8 +488,6 @@ oceanic_atom2_parser_set_data (dc_parser_t *abstract, const unsigned char *data,
 		parser->oxygen[i] = 0;
 		parser->helium[i] = 0;
 	}
-	parser->divetime = 0;
-	parser->maxdepth = 0.0;
 
 	return DC_STATUS_SUCCESS;
 }
@@ -364,7 +630,7 @@ oceanic_atom2_parser_get_datetime (dc_parser_t *abstract, dc_datetime_t *datetim
 		if (datetime->year < 2010) {
 			// Retrieve the current year.
 			dc_datetime_t now = {0};
-			if (dc_datetime_localtime (&now, dc_datetime_now ()) &&
+			if (dc_context_localtime (abstract->context, &now, dc_datetime_now ()) &&
 				now.year >= 2010)
 			{
 				// Guess the correct decade.
@@ -511,18 +777,11 @@ oceanic_atom2_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, uns
 	if (status != DC_STATUS_SUCCESS)
 		return status;
 
-	// Cache the profile data.
-	if (parser->cached < PROFILE) {
-		sample_statistics_t statistics = SAMPLE_STATISTICS_INITIALIZER;
-		status = oceanic_atom2_parser_samples_foreach (
-			abstract, sample_statistics_cb, &statistics);
-		if (status != DC_STATUS_SUCCESS)
-			return status;
-
-		parser->cached = PROFILE;
-		parser->divetime = statistics.divetime;
-		parser->maxdepth = statistics.maxdepth;
-	}
+	// Get the sample statistics.
+	sample_statistics_t statistics = SAMPLE_STATISTICS_INITIALIZER;
+	status = parser_get_statistics (abstract, &statistics);
+	if (status != DC_STATUS_SUCCESS)
+		return status;
 
 	dc_gasmix_t *gasmix = (dc_gasmix_t *) value;
 	dc_salinity_t *water = (dc_salinity_t *) value;
@@ -538,7 +797,7 @@ oceanic_atom2_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, uns
 				parser->model == MUNDIAL2 || parser->model == MUNDIAL3)
 				*((unsigned int *) value) = bcd2dec (data[2]) + bcd2dec (data[3]) * 60;
 			else
-				*((unsigned int *) value) = parser->divetime;
+				*((unsigned int *) value) = statistics.divetime;
 			break;
 		case DC_FIELD_MAXDEPTH:
 			if (parser->model == F10A || parser->model == F10B ||
@@ -595,6 +854,21 @@ oceanic_atom2_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, uns
 			}
 			string->value = strdup(buf);
 			break;
+		case DC_FIELD_AVGDEPTH:
+			if (statistics.ndepths == 0)
+				return DC_STATUS_UNSUPPORTED;
+			*((double *) value) = statistics.avgdepth;
+			break;
+		case DC_FIELD_TEMPERATURE_MINIMUM:
+			if (statistics.ntemperatures == 0)
+				return DC_STATUS_UNSUPPORTED;
+			*((double *) value) = statistics.temperature_minimum;
+			break;
+		case DC_FIELD_TEMPERATURE_MAXIMUM:
+			if (statistics.ntemperatures == 0)
+				return DC_STATUS_UNSUPPORTED;
+			*((double *) value) = statistics.temperature_maximum;
+			break;
 		default:
 			return DC_STATUS_UNSUPPORTED;
 		}
@@ -653,17 +927,14 @@ oceanic_atom2_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_
 	if (status != DC_STATUS_SUCCESS)
 		return status;
 
+	const oceanic_atom2_sample_layout_t *layout = &parser->layout;
+
 	unsigned int extratime = 0;
 	unsigned int time = 0;
 	unsigned int interval = 1;
 	unsigned int samplerate = 1;
 	if (parser->mode != FREEDIVE) {
-		unsigned int idx = 0x17;
-		if (parser->model == A300CS || parser->model == VTX ||
-			parser->model == I450T || parser->model == I750TC ||
-			parser->model == PROPLUSX || parser->model == I770R)
-			idx = 0x1f;
-		switch (data[idx] & 0x03) {
+		switch (data[layout->interval] & 0x03) {
 		case 0:
 			interval = 2;
 			break;
@@ -677,7 +948,7 @@ oceanic_atom2_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_
 			interval = 60;
 			break;
 		}
-	} else if (parser->model == F11A || parser->model == F11B) {
+	} else if (layout->samplerate) {
 		unsigned int idx = 0x29;
 		switch (data[idx] & 0x03) {
 		case 0:
@@ -703,36 +974,14 @@ oceanic_atom2_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_
 		}
 	}
 
-	unsigned int samplesize = PAGESIZE / 2;
-	if (parser->mode == FREEDIVE) {
-		if (parser->model == F10A || parser->model == F10B ||
-			parser->model == F11A || parser->model == F11B ||
-			parser->model == MUNDIAL2 || parser->model == MUNDIAL3) {
-			samplesize = 2;
-		} else {
-			samplesize = 4;
-		}
-	} else if (parser->model == OC1A || parser->model == OC1B ||
-		parser->model == OC1C || parser->model == OCI ||
-		parser->model == TX1 || parser->model == A300CS ||
-		parser->model == VTX || parser->model == I450T ||
-		parser->model == I750TC || parser->model == PROPLUSX ||
-		parser->model == I770R) {
-		samplesize = PAGESIZE;
-	}
+	unsigned int samplesize = layout->samplesize;
+	if (parser->mode == FREEDIVE)
+		samplesize = layout->samplesize_freedive;
 
-	unsigned int have_temperature = 1, have_pressure = 1;
+	unsigned int have_temperature = 1, have_pressure = layout->pressure;
 	if (parser->mode == FREEDIVE) {
 		have_temperature = 0;
 		have_pressure = 0;
-	} else if (parser->model == VEO30 || parser->model == OCS ||
-		parser->model == ELEMENT2 || parser->model == VEO20 ||
-		parser->model == A300 || parser->model == ZEN ||
-		parser->model == GEO || parser->model == GEO20 ||
-		parser->model == MANTA || parser->model == I300 ||
-		parser->model == I200 || parser->model == I100 ||
-		parser->model == I300C) {
-		have_pressure = 0;
 	}
 
 	// Initial temperature.
@@ -745,11 +994,7 @@ oceanic_atom2_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_
 	unsigned int tank = 0;
 	unsigned int pressure = 0;
 	if (have_pressure) {
-		unsigned int idx = 2;
-		if (parser->model == A300CS || parser->model == VTX ||
-			parser->model == I750TC || parser->model == I770R)
-			idx = 16;
-		pressure = array_uint16_le(data + parser->header + idx);
+		pressure = array_uint16_le(data + parser->header + layout->pressure_initial);
 		if (pressure == 10000)
 			have_pressure = 0;
 	}
@@ -795,22 +1040,27 @@ oceanic_atom2_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_
 
 		// Check for a tank switch sample.
 		if (sampletype == 0xAA) {
-			if (parser->model == DATAMASK || parser->model == COMPUMASK) {
+			switch (layout->tankswitch) {
+			case TANK_DATAMASK:
 				// Tank pressure (1 psi) and number
 				tank = 0;
 				pressure = (((data[offset + 7] << 8) + data[offset + 6]) & 0x0FFF);
-			} else if (parser->model == A300CS || parser->model == VTX ||
-				parser->model == I750TC || parser->model == I770R) {
+				break;
+			case TANK_A300CS:
 				// Tank pressure (1 psi) and number (one based index)
 				tank = (data[offset + 1] & 0x03) - 1;
 				pressure = ((data[offset + 7] << 8) + data[offset + 6]) & 0x0FFF;
-			} else {
+				break;
+			case TANK_ATOM2:
 				// Tank pressure (2 psi) and number (one based index)
 				tank = (data[offset + 1] & 0x03) - 1;
-				if (parser->model == ATOM2 || parser->model == EPICA || parser->model == EPICB)
-					pressure = (((data[offset + 3] << 8) + data[offset + 4]) & 0x0FFF) * 2;
-				else
-					pressure = (((data[offset + 4] << 8) + data[offset + 5]) & 0x0FFF) * 2;
+				pressure = (((data[offset + 3] << 8) + data[offset + 4]) & 0x0FFF) * 2;
+				break;
+			default:
+				// Tank pressure (2 psi) and number (one based index)
+				tank = (data[offset + 1] & 0x03) - 1;
+				pressure = (((data[offset + 4] << 8) + data[offset + 5]) & 0x0FFF) * 2;
+				break;
 			}
 		} else if (sampletype == 0xBB) {
 			// The surface time is not always a nice multiple of the samplerate.
@@ -849,12 +1099,12 @@ oceanic_atom2_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_
 			}
 
 			// Time.
-			if (parser->model == I450T) {
+			if (layout->timestamp) {
 				unsigned int minute = bcd2dec(data[offset + 0]);
 				unsigned int hour   = bcd2dec(data[offset + 1] & 0x0F);
 				unsigned int second = bcd2dec(data[offset + 2]);
 				unsigned int timestamp = (hour * 3600) + (minute * 60 ) + second + extratime;
-				if (timestamp < time) {
+				if (timestamp < time && !(abstract->flags & DC_PARSER_FLAG_TRUSTED)) {
 					ERROR (abstract->context, "Timestamp moved backwards.");
 					return DC_STATUS_DATAFORMAT;
 				} else 	if (timestamp == time) {
@@ -877,48 +1127,19 @@ oceanic_atom2_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_
 
 			// Temperature (°F)
 			if (have_temperature) {
-				if (parser->model == GEO || parser->model == ATOM1 ||
-					parser->model == ELEMENT2 || parser->model == MANTA ||
-					parser->model == ZEN) {
-					temperature = data[offset + 6];
-				} else if (parser->model == GEO20 || parser->model == VEO20 ||
-					parser->model == VEO30 || parser->model == OC1A ||
-					parser->model == OC1B || parser->model == OC1C ||
-					parser->model == OCI || parser->model == A300 ||
-					parser->model == I450T || parser->model == I300 ||
-					parser->model == I200 || parser->model == I100 ||
-					parser->model == I300C) {
-					temperature = data[offset + 3];
-				} else if (parser->model == OCS || parser->model == TX1) {
-					temperature = data[offset + 1];
-				} else if (parser->model == VT4 || parser->model == VT41 ||
-					parser->model == ATOM3 || parser->model == ATOM31 ||
-					parser->model == A300AI || parser->model == VISION ||
-					parser->model == XPAIR) {
+				switch (layout->temperature_type) {
+				case TEMPERATURE_BYTE:
+					temperature = data[offset + layout->temperature_offset];
+					break;
+				case TEMPERATURE_VT4:
 					temperature = ((data[offset + 7] & 0xF0) >> 4) | ((data[offset + 7] & 0x0C) << 2) | ((data[offset + 5] & 0x0C) << 4);
-				} else if (parser->model == A300CS || parser->model == VTX ||
-					parser->model == I750TC || parser->model == PROPLUSX ||
-					parser->model == I770R) {
-					temperature = data[offset + 11];
-				} else {
-					unsigned int sign;
-					if (parser->model == DG03 || parser->model == PROPLUS3 ||
-						parser->model == I550)
-						sign = (~data[offset + 5] & 0x04) >> 2;
-					else if (parser->model == VOYAGER2G || parser->model == AMPHOS ||
-						parser->model == AMPHOSAIR || parser->model == ZENAIR)
-						sign = (data[offset + 5] & 0x04) >> 2;
-					else if (parser->model == ATOM2 || parser->model == PROPLUS21 ||
-						parser->model == EPICA || parser->model == EPICB ||
-						parser->model == ATMOSAI2 ||
-						parser->model == WISDOM2 || parser->model == WISDOM3)
-						sign = (data[offset + 0] & 0x80) >> 7;
-					else
-						sign = (~data[offset + 0] & 0x80) >> 7;
-					if (sign)
+					break;
+				default:
+					if ((data[offset + layout->sign_offset] ^ layout->sign_invert) & layout->sign_mask)
 						temperature -= (data[offset + 7] & 0x0C) >> 2;
 					else
 						temperature += (data[offset + 7] & 0x0C) >> 2;
+					break;
 				}
 				sample.temperature = (temperature - 32.0) * (5.0 / 9.0);
 				if (callback) callback (DC_SAMPLE_TEMPERATURE, sample, userdata);
@@ -926,23 +1147,17 @@ oceanic_atom2_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_
 
 			// Tank Pressure (psi)
 			if (have_pressure) {
-				if (parser->model == OC1A || parser->model == OC1B ||
-					parser->model == OC1C || parser->model == OCI ||
-					parser->model == I450T)
-					pressure = (data[offset + 10] + (data[offset + 11] << 8)) & 0x0FFF;
-				else if (parser->model == VT4 || parser->model == VT41||
-					parser->model == ATOM3 || parser->model == ATOM31 ||
-					parser->model == ZENAIR ||parser->model == A300AI ||
-					parser->model == DG03 || parser->model == PROPLUS3 ||
-					parser->model == AMPHOSAIR || parser->model == I550 ||
-					parser->model == VISION || parser->model == XPAIR)
+				switch (layout->pressure_type) {
+				case PRESSURE_UINT16:
+					pressure = array_uint16_le (data + offset + layout->pressure_offset) & layout->pressure_mask;
+					break;
+				case PRESSURE_VT4:
 					pressure = (((data[offset + 0] & 0x03) << 8) + data[offset + 1]) * 5;
-				else if (parser->model == TX1 || parser->model == A300CS ||
-					parser->model == VTX || parser->model == I750TC ||
-					parser->model == PROPLUSX || parser->model == I770R)
-					pressure = array_uint16_le (data + offset + 4);
-				else
+					break;
+				default:
 					pressure -= data[offset + 1];
+					break;
+				}
 				sample.pressure.tank = tank;
 				sample.pressure.value = pressure * PSI / BAR;
 				if (callback) callback (DC_SAMPLE_PRESSURE, sample, userdata);
@@ -952,25 +1167,17 @@ oceanic_atom2_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_
 			unsigned int depth;
 			if (parser->mode == FREEDIVE)
 				depth = array_uint16_le (data + offset);
-			else if (parser->model == GEO20 || parser->model == VEO20 ||
-				parser->model == VEO30 || parser->model == OC1A ||
-				parser->model == OC1B || parser->model == OC1C ||
-				parser->model == OCI || parser->model == A300 ||
-				parser->model == I450T || parser->model == I300 ||
-				parser->model == I200 || parser->model == I100 ||
-				parser->model == I300C)
-				depth = (data[offset + 4] + (data[offset + 5] << 8)) & 0x0FFF;
-			else if (parser->model == ATOM1)
+			else if (layout->depth_type == DEPTH_ATOM1)
 				depth = data[offset + 3] * 16;
 			else
-				depth = (data[offset + 2] + (data[offset + 3] << 8)) & 0x0FFF;
+				depth = array_uint16_le (data + offset + layout->depth_offset) & 0x0FFF;
 			sample.depth = depth / 16.0 * FEET;
 			if (callback) callback (DC_SAMPLE_DEPTH, sample, userdata);
 
 			// Gas mix
 			unsigned int have_gasmix = 0;
 			unsigned int gasmix = 0;
-			if (parser->model == TX1) {
+			if (layout->gasmix) {
 				gasmix = data[offset] & 0x07;
 				have_gasmix = 1;
 			}
@@ -985,37 +1192,9 @@ oceanic_atom2_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_
 			}
 
 			// NDL / Deco
-			unsigned int have_deco = 0;
-			unsigned int decostop = 0, decotime = 0;
-			if (parser->model == A300CS || parser->model == VTX ||
-				parser->model == I750TC ||
-				parser->model == PROPLUSX || parser->model == I770R) {
-				decostop = (data[offset + 15] & 0x70) >> 4;
-				decotime = array_uint16_le(data + offset + 6) & 0x03FF;
-				have_deco = 1;
-			} else if (parser->model == ZEN || parser->model == DG03) {
-				decostop = (data[offset + 5] & 0xF0) >> 4;
-				decotime = array_uint16_le(data + offset + 4) & 0x0FFF;
-				have_deco = 1;
-			} else if (parser->model == TX1) {
-				decostop = data[offset + 10];
-				decotime = array_uint16_le(data + offset + 6);
-				have_deco = 1;
-			} else if (parser->model == ATOM31 || parser->model == VISION ||
-				parser->model == XPAIR || parser->model == I550) {
-				decostop = (data[offset + 5] & 0xF0) >> 4;
-				decotime = array_uint16_le(data + offset + 4) & 0x03FF;
-				have_deco = 1;
-			} else if (parser->model == I200 || parser->model == I300 ||
-				parser->model == OC1A || parser->model == OC1B ||
-				parser->model == OC1C || parser->model == OCI ||
-				parser->model == I100 || parser->model == I300C ||
-				parser->model == I450T) {
-				decostop = (data[offset + 7] & 0xF0) >> 4;
-				decotime = array_uint16_le(data + offset + 6) & 0x0FFF;
-				have_deco = 1;
-			}
-			if (have_deco) {
+			if (layout->deco) {
+				unsigned int decostop = (data[offset + layout->decostop_offset] & layout->decostop_mask) >> layout->decostop_shift;
+				unsigned int decotime = array_uint16_le(data + offset + layout->decotime_offset) & layout->decotime_mask;
 				if (decostop) {
 					sample.deco.type = DC_DECO_DECOSTOP;
 					sample.deco.depth = decostop * 10 * FEET;
@@ -1027,34 +1206,14 @@ oceanic_atom2_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_
 				if (callback) callback (DC_SAMPLE_DECO, sample, userdata);
 			}
 
-			unsigned int have_rbt = 0;
-			unsigned int rbt = 0;
-			if (parser->model == ATOM31) {
-				rbt = array_uint16_le(data + offset + 6) & 0x01FF;
-				have_rbt = 1;
-			} else if (parser->model == I450T || parser->model == OC1A ||
-				parser->model == OC1B || parser->model == OC1C ||
-				parser->model == OCI || parser->model == PROPLUSX ||
-				parser->model == I770R) {
-				rbt = array_uint16_le(data + offset + 8) & 0x01FF;
-				have_rbt = 1;
-			} else if (parser->model == VISION || parser->model == XPAIR ||
-				parser->model == I550) {
-				rbt = array_uint16_le(data + offset + 6) & 0x03FF;
-				have_rbt = 1;
-			}
-			if (have_rbt) {
-				sample.rbt = rbt;
+			// Remaining bottom time
+			if (layout->rbt) {
+				sample.rbt = array_uint16_le(data + offset + layout->rbt_offset) & layout->rbt_mask;
 				if (callback) callback (DC_SAMPLE_RBT, sample, userdata);
 			}
 
 			// Bookmarks
-			unsigned int have_bookmark = 0;
-			if (parser->model == OC1A || parser->model == OC1B ||
-				parser->model == OC1C || parser->model == OCI) {
-				have_bookmark = data[offset + 12] & 0x80;
-			}
-			if (have_bookmark) {
+			if (layout->bookmark && (data[offset + 12] & 0x80)) {
 				sample.event.type = SAMPLE_EVENT_BOOKMARK;
 				sample.event.time = 0;
 				sample.event.flags = 0;
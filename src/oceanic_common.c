@@ -132,6 +132,59 @@ oceanic_common_device_init (oceanic_common_device_t *device)
 	memset (device->fingerprint, 0, sizeof (device->fingerprint));
 	device->layout = NULL;
 	device->multipage = 1;
+	device->maxpages = 0;
+}
+
+
+unsigned int
+oceanic_common_device_probe (oceanic_common_device_t *device, dc_iostream_t *iostream, const unsigned int maxpages[], unsigned int count)
+{
+	dc_device_t *abstract = (dc_device_t *) device;
+
+	unsigned char key[4 + PAGESIZE];
+	array_uint32_le_set (key, dc_device_get_type (abstract));
+	memcpy (key + 4, device->version, PAGESIZE);
+
+	unsigned int result = device->multipage;
+	if (dc_context_cache_get (abstract->context, key, sizeof (key), &result))
+		return result;
+
+	if (count == 0 || maxpages[0] > MAXPAGES)
+		return device->multipage;
+
+	// Read the reference data with the default packet size.
+	unsigned char reference[MAXPAGES * PAGESIZE] = {0};
+	device->maxpages = 0;
+	dc_status_t rc = dc_device_read (abstract, 0, reference, maxpages[0] * PAGESIZE);
+	if (rc != DC_STATUS_SUCCESS)
+		return device->multipage;
+
+	for (unsigned int i = 0; i < count; ++i) {
+		if (maxpages[i] <= device->multipage)
+			break;
+
+		unsigned char data[MAXPAGES * PAGESIZE] = {0};
+		device->maxpages = maxpages[i];
+		rc = dc_device_read (abstract, 0, data, maxpages[i] * PAGESIZE);
+		if (rc == DC_STATUS_SUCCESS && memcmp (data, reference, maxpages[i] * PAGESIZE) == 0) {
+			result = maxpages[i];
+			break;
+		}
+
+		if (rc == DC_STATUS_CANCELLED)
+			break;
+
+		dc_iostream_purge (iostream, DC_DIRECTION_INPUT);
+	}
+
+	device->maxpages = 0;
+
+	if (rc != DC_STATUS_CANCELLED) {
+		INFO (abstract->context, "Detected a read size of %u pages.", result);
+		dc_context_cache_set (abstract->context, key, sizeof (key), result);
+	}
+
+	return result;
 }
 
 
@@ -178,8 +231,12 @@ oceanic_common_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 	vendor.size = sizeof (device->version);
 	device_event_emit (abstract, DC_EVENT_VENDOR, &vendor);
 
+	unsigned int npages = device->multipage;
+	if (device->maxpages > npages)
+		npages = device->maxpages;
+
 	return device_dump_read (abstract, dc_buffer_get_data (buffer),
-		dc_buffer_get_size (buffer), PAGESIZE * device->multipage);
+		dc_buffer_get_size (buffer), PAGESIZE * npages);
 }
 
 
@@ -271,12 +328,22 @@ oceanic_common_device_logbook (dc_device_t *abstract, dc_event_progress_t *progr
 
 	// Create the ringbuffer stream.
 	dc_rbstream_t *rbstream = NULL;
-	rc = dc_rbstream_new (&rbstream, abstract, PAGESIZE, PAGESIZE * device->multipage, layout->rb_logbook_begin, layout->rb_logbook_end, rb_logbook_end);
+	rc = dc_rbstream_new (&rbstream, abstract, PAGESIZE, PAGESIZE * device->multipage, layout->rb_logbook_begin, layout->rb_logbook_end, rb_logbook_end, DC_RBSTREAM_BACKWARD);
 	if (rc != DC_STATUS_SUCCESS) {
 		ERROR (abstract->context, "Failed to create the ringbuffer stream.");
 		return rc;
 	}
 
+	// Combine consecutive packets into larger reads.
+	if (device->maxpages > device->multipage) {
+		rc = dc_rbstream_set_maxsize (rbstream, PAGESIZE * device->maxpages);
+		if (rc != DC_STATUS_SUCCESS) {
+			ERROR (abstract->context, "Failed to set the read-ahead size.");
+			dc_rbstream_free (rbstream);
+			return rc;
+		}
+	}
+
 	// The logbook ringbuffer is read backwards to retrieve the most recent
 	// entries first. If an already downloaded entry is identified (by means
 	// of its fingerprint), the transfer is aborted immediately to reduce
@@ -419,12 +486,22 @@ oceanic_common_device_profile (dc_device_t *abstract, dc_event_progress_t *progr
 
 	// Create the ringbuffer stream.
 	dc_rbstream_t *rbstream = NULL;
-	rc = dc_rbstream_new (&rbstream, abstract, PAGESIZE, PAGESIZE * device->multipage, layout->rb_profile_begin, layout->rb_profile_end, rb_profile_end);
+	rc = dc_rbstream_new (&rbstream, abstract, PAGESIZE, PAGESIZE * device->multipage, layout->rb_profile_begin, layout->rb_profile_end, rb_profile_end, DC_RBSTREAM_BACKWARD);
 	if (rc != DC_STATUS_SUCCESS) {
 		ERROR (abstract->context, "Failed to create the ringbuffer stream.");
 		return rc;
 	}
 
+	// Combine consecutive packets into larger reads.
+	if (device->maxpages > device->multipage) {
+		rc = dc_rbstream_set_maxsize (rbstream, PAGESIZE * device->maxpages);
+		if (rc != DC_STATUS_SUCCESS) {
+			ERROR (abstract->context, "Failed to set the read-ahead size.");
+			dc_rbstream_free (rbstream);
+			return rc;
+		}
+	}
+
 	// Memory buffer for the profile data.
 	unsigned char *profiles = (unsigned char *) malloc (rb_profile_size + rb_logbook_size);
 	if (profiles == NULL) {
@@ -485,11 +562,39 @@ oceanic_common_device_profile (dc_device_t *abstract, dc_event_progress_t *progr
 			break;
 		}
 
+		// Remove padding from the profile. The logbook entry already
+		// contains the amount of profile data, so the padding doesn't
+		// have to be read at all.
+		unsigned int length = rb_entry_size;
+		if (layout->highmem) {
+			const unsigned char *profile = logbooks + entry;
+			// profile+12 and the bottom 4 bits of profile+13 and the top 3 bits of profile+13
+			// is the number of pages of profile data until the start of the footer
+			// (not including the prepended logbook entry).
+			unsigned int high_part = array_uint16_le (profile + 12) & 0xE000;
+			unsigned int low_part = array_uint16_le (profile + 12) & 0x0FFF;
+			unsigned int npages = ((high_part >> 1) | low_part) + 1;
+			// INFO (abstract->context, "profile npages: 0x%X (%d)", npages, npages);
+			if (length > npages * PAGESIZE) {
+				length = npages * PAGESIZE;
+			}
+		}
+
+		// Skip the gap after the dive and the padding. Pages which
+		// contain no profile data are never read.
+		rc = dc_rbstream_skip (rbstream, progress, gap + rb_entry_size - length);
+		if (rc != DC_STATUS_SUCCESS) {
+			ERROR (abstract->context, "Failed to skip the unused data.");
+			dc_rbstream_free (rbstream);
+			free (profiles);
+			return rc;
+		}
+
 		// Move to the start of the current dive.
-		offset -= rb_entry_size + gap;
+		offset -= length;
 
 		// Read the dive.
-		rc = dc_rbstream_read (rbstream, progress, profiles + offset, rb_entry_size + gap);
+		rc = dc_rbstream_read (rbstream, progress, profiles + offset, length);
 		if (rc != DC_STATUS_SUCCESS) {
 			ERROR (abstract->context, "Failed to read the dive.");
 			dc_rbstream_free (rbstream);
@@ -505,24 +610,8 @@ oceanic_common_device_profile (dc_device_t *abstract, dc_event_progress_t *progr
 		offset -= layout->rb_logbook_entry_size;
 		memcpy (profiles + offset, logbooks + entry, layout->rb_logbook_entry_size);
 
-		// Remove padding from the profile.
-		if (layout->highmem) {
-			unsigned char *profile = profiles + offset;
-			// profile+12 and the bottom 4 bits of profile+13 and the top 3 bits of profile+13
-			// is the number of pages of profile data until the start of the footer
-			// (not including the prepended logbook entry).
-			unsigned int high_part = array_uint16_le (profile + 12) & 0xE000;
-			unsigned int low_part = array_uint16_le (profile + 12) & 0x0FFF;
-			unsigned int npages = ((high_part >> 1) | low_part) + 1;
-			// INFO (abstract->context, "profile npages: 0x%X (%d)", npages, npages);
-			unsigned int length = npages * PAGESIZE;
-			if (rb_entry_size > length) {
-				rb_entry_size = length;
-			}
-		}
-
 		unsigned char *p = profiles + offset;
-		if (callback && !callback (p, rb_entry_size + layout->rb_logbook_entry_size, p, layout->rb_logbook_entry_size, userdata)) {
+		if (callback && !callback (p, length + layout->rb_logbook_entry_size, p, layout->rb_logbook_entry_size, userdata)) {
 			break;
 		}
 	}
@@ -558,6 +647,7 @@ oceanic_common_device_foreach (dc_device_t *abstract, dc_dive_callback_t callbac
 	device_event_emit (abstract, DC_EVENT_VENDOR, &vendor);
 
 	// Read the device id.
+	device_profile_phase (abstract, DC_PHASE_VERSION);
 	unsigned char id[PAGESIZE] = {0};
 	dc_status_t rc = dc_device_read (abstract, layout->cf_devinfo, id, sizeof (id));
 	if (rc != DC_STATUS_SUCCESS) {
@@ -591,6 +681,7 @@ oceanic_common_device_foreach (dc_device_t *abstract, dc_dive_callback_t callbac
 	}
 
 	// Download the logbook ringbuffer.
+	device_profile_phase (abstract, DC_PHASE_LOGBOOK);
 	rc = VTABLE(abstract)->logbook (abstract, &progress, logbook);
 	if (rc != DC_STATUS_SUCCESS) {
 		dc_buffer_free (logbook);
@@ -604,6 +695,7 @@ oceanic_common_device_foreach (dc_device_t *abstract, dc_dive_callback_t callbac
 	}
 
 	// Download the profile ringbuffer.
+	device_profile_phase (abstract, DC_PHASE_PROFILE);
 	rc = VTABLE(abstract)->profile (abstract, &progress, logbook, callback, userdata);
 	if (rc != DC_STATUS_SUCCESS) {
 		dc_buffer_free (logbook);
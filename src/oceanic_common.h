@@ -30,6 +30,7 @@ extern "C" {
 
 #define PAGESIZE 0x10
 #define FPMAXSIZE 0x20
+#define MAXPAGES 16
 
 #define OCEANIC_COMMON_MATCH(version,patterns) \
 	oceanic_common_match ((version), (patterns), \
@@ -65,6 +66,7 @@ typedef struct oceanic_common_device_t {
 	unsigned char fingerprint[FPMAXSIZE];
 	const oceanic_common_layout_t *layout;
 	unsigned int multipage;
+	unsigned int maxpages;
 } oceanic_common_device_t;
 
 typedef struct oceanic_common_device_vtable_t {
@@ -81,6 +83,16 @@ oceanic_common_match (const unsigned char *version, const oceanic_common_version
 void
 oceanic_common_device_init (oceanic_common_device_t *device);
 
+/*
+ * Find the largest number of pages the firmware returns for a single
+ * multi-page read command, from the given candidates in decreasing
+ * order. Consecutive packets are then combined into reads of up to
+ * that many pages. The result is cached in the context, per family and
+ * firmware version.
+ */
+unsigned int
+oceanic_common_device_probe (oceanic_common_device_t *device, dc_iostream_t *iostream, const unsigned int maxpages[], unsigned int count);
+
 dc_status_t
 oceanic_common_device_logbook (dc_device_t *device, dc_event_progress_t *progress, dc_buffer_t *logbook);
 
@@ -31,6 +31,8 @@
 
 #define ISINSTANCE(device) dc_device_isinstance((device), &oceanic_veo250_device_vtable.base)
 
+#define C_ARRAY_SIZE(array) (sizeof (array) / sizeof *(array))
+
 #define MAXRETRIES 2
 #define MULTIPAGE  4
 
@@ -56,7 +58,8 @@ static const oceanic_common_device_vtable_t oceanic_veo250_device_vtable = {
 		oceanic_common_device_dump, /* dump */
 		oceanic_common_device_foreach, /* foreach */
 		NULL, /* timesync */
-		oceanic_veo250_device_close /* close */
+		oceanic_veo250_device_close, /* close */
+		PAGESIZE /* pagesize */
 	},
 	oceanic_common_device_logbook,
 	oceanic_common_device_profile,
@@ -73,6 +76,9 @@ static const oceanic_common_version_t oceanic_veo250_version[] = {
 	{"HO DGO2 R\0\0 256K"},
 };
 
+// Multi-page read sizes to probe for, in addition to the default.
+static const unsigned int oceanic_veo250_maxpages[] = {16, 8};
+
 static const oceanic_common_layout_t oceanic_veo250_layout = {
 	0x8000, /* memsize */
 	0, /* highmem */
@@ -324,6 +330,10 @@ oceanic_veo250_device_open (dc_device_t **out, dc_context_t *context, dc_iostrea
 		device->base.layout = &oceanic_veo250_layout;
 	}
 
+	// Detect the largest supported multi-page read.
+	device->base.maxpages = oceanic_common_device_probe (&device->base, device->iostream,
+		oceanic_veo250_maxpages, C_ARRAY_SIZE (oceanic_veo250_maxpages));
+
 	*out = (dc_device_t*) device;
 
 	return DC_STATUS_SUCCESS;
@@ -418,17 +428,21 @@ oceanic_veo250_device_read (dc_device_t *abstract, unsigned int address, unsigne
 		(size    % PAGESIZE != 0))
 		return DC_STATUS_INVALIDARGS;
 
+	unsigned int maxpages = device->base.multipage;
+	if (device->base.maxpages > maxpages)
+		maxpages = device->base.maxpages;
+
 	unsigned int nbytes = 0;
 	while (nbytes < size) {
 		// Calculate the number of packages.
 		unsigned int npackets = (size - nbytes) / PAGESIZE;
-		if (npackets > MULTIPAGE)
-			npackets = MULTIPAGE;
+		if (npackets > maxpages)
+			npackets = maxpages;
 
 		// Read the package.
 		unsigned int first =  address / PAGESIZE;
 		unsigned int last  = first + npackets - 1;
-		unsigned char answer[(PAGESIZE + 1) * MULTIPAGE + 1] = {0};
+		unsigned char answer[(PAGESIZE + 1) * MAXPAGES + 1] = {0};
 		unsigned char command[6] = {0x20,
 				(first     ) & 0xFF, // low
 				(first >> 8) & 0xFF, // high
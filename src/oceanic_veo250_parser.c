@@ -19,6 +19,8 @@
  * MA 02110-1301 USA
  */
 
+#define LOG_SUBSYSTEM DC_LOGSUBSYSTEM_PARSER
+
 #include <stdlib.h>
 
 #include <libdivecomputer/units.h>
@@ -42,10 +44,6 @@ typedef struct oceanic_veo250_parser_t oceanic_veo250_parser_t;
 struct oceanic_veo250_parser_t {
 	dc_parser_t base;
 	unsigned int model;
-	// Cached fields.
-	unsigned int cached;
-	unsigned int divetime;
-	double maxdepth;
 };
 
 static dc_status_t oceanic_veo250_parser_set_data (dc_parser_t *abstract, const unsigned char *data, unsigned int size);
@@ -81,9 +79,6 @@ oceanic_veo250_parser_create (dc_parser_t **out, dc_context_t *context, unsigned
 
 	// Set the default values.
 	parser->model = model;
-	parser->cached = 0;
-	parser->divetime = 0;
-	parser->maxdepth = 0.0;
 
 	*out = (dc_parser_t*) parser;
 
@@ -94,13 +89,6 @@ oceanic_veo250_parser_create (dc_parser_t **out, dc_context_t *context, unsigned
 static dc_status_t
 oceanic_veo250_parser_set_data (dc_parser_t *abstract, const unsigned char *data, unsigned int size)
 {
-	oceanic_veo250_parser_t *parser = (oceanic_veo250_parser_t *) abstract;
-
-	// Reset the cache.
-	parser->cached = 0;
-	parser->divetime = 0;
-	parser->maxdepth = 0.0;
-
 	return DC_STATUS_SUCCESS;
 }
 
@@ -137,25 +125,17 @@ oceanic_veo250_parser_get_datetime (dc_parser_t *abstract, dc_datetime_t *dateti
 static dc_status_t
 oceanic_veo250_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, unsigned int flags, void *value)
 {
-	oceanic_veo250_parser_t *parser = (oceanic_veo250_parser_t *) abstract;
-
 	const unsigned char *data = abstract->data;
 	unsigned int size = abstract->size;
 
 	if (size < 7 * PAGESIZE / 2)
 		return DC_STATUS_DATAFORMAT;
 
-	if (!parser->cached) {
-		sample_statistics_t statistics = SAMPLE_STATISTICS_INITIALIZER;
-		dc_status_t rc = oceanic_veo250_parser_samples_foreach (
-			abstract, sample_statistics_cb, &statistics);
-		if (rc != DC_STATUS_SUCCESS)
-			return rc;
-
-		parser->cached = 1;
-		parser->divetime = statistics.divetime;
-		parser->maxdepth = statistics.maxdepth;
-	}
+	// Get the sample statistics.
+	sample_statistics_t statistics = SAMPLE_STATISTICS_INITIALIZER;
+	dc_status_t rc = parser_get_statistics (abstract, &statistics);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
 
 	unsigned int footer = size - PAGESIZE;
 
@@ -167,7 +147,7 @@ oceanic_veo250_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, un
 			*((unsigned int *) value) = data[footer + 3] * 60 + data[footer + 4] * 3600;
 			break;
 		case DC_FIELD_MAXDEPTH:
-			*((double *) value) = parser->maxdepth;
+			*((double *) value) = statistics.maxdepth;
 			break;
 		case DC_FIELD_GASMIX_COUNT:
 				*((unsigned int *) value) = 1;
@@ -180,6 +160,21 @@ oceanic_veo250_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, un
 				gasmix->oxygen = 0.21;
 			gasmix->nitrogen = 1.0 - gasmix->oxygen - gasmix->helium;
 			break;
+		case DC_FIELD_AVGDEPTH:
+			if (statistics.ndepths == 0)
+				return DC_STATUS_UNSUPPORTED;
+			*((double *) value) = statistics.avgdepth;
+			break;
+		case DC_FIELD_TEMPERATURE_MINIMUM:
+			if (statistics.ntemperatures == 0)
+				return DC_STATUS_UNSUPPORTED;
+			*((double *) value) = statistics.temperature_minimum;
+			break;
+		case DC_FIELD_TEMPERATURE_MAXIMUM:
+			if (statistics.ntemperatures == 0)
+				return DC_STATUS_UNSUPPORTED;
+			*((double *) value) = statistics.temperature_maximum;
+			break;
 		default:
 			return DC_STATUS_UNSUPPORTED;
 		}
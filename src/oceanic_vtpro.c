@@ -33,6 +33,8 @@
 
 #define ISINSTANCE(device) dc_device_isinstance((device), &oceanic_vtpro_device_vtable.base)
 
+#define C_ARRAY_SIZE(array) (sizeof (array) / sizeof *(array))
+
 #define MAXRETRIES 2
 #define MULTIPAGE  4
 
@@ -68,7 +70,8 @@ static const oceanic_common_device_vtable_t oceanic_vtpro_device_vtable = {
 		oceanic_common_device_dump, /* dump */
 		oceanic_common_device_foreach, /* foreach */
 		NULL, /* timesync */
-		oceanic_vtpro_device_close /* close */
+		oceanic_vtpro_device_close, /* close */
+		PAGESIZE /* pagesize */
 	},
 	oceanic_vtpro_device_logbook,
 	oceanic_common_device_profile,
@@ -87,6 +90,9 @@ static const oceanic_common_version_t oceanic_wisdom_version[] = {
 	{"WISDOM r\0\0  256K"},
 };
 
+// Multi-page read sizes to probe for, in addition to the default.
+static const unsigned int oceanic_vtpro_maxpages[] = {16, 8};
+
 static const oceanic_common_layout_t oceanic_vtpro_layout = {
 	0x8000, /* memsize */
 	0, /* highmem */
@@ -180,6 +186,7 @@ oceanic_vtpro_transfer (oceanic_vtpro_device_t *device, const unsigned char comm
 
 	unsigned int nretries = 0;
 	dc_status_t rc = DC_STATUS_SUCCESS;
+	dc_usecs_t start = device_latency_start (abstract);
 	while ((rc = oceanic_vtpro_send (device, command, csize)) != DC_STATUS_SUCCESS) {
 		if (rc != DC_STATUS_TIMEOUT && rc != DC_STATUS_PROTOCOL)
 			return rc;
@@ -187,6 +194,9 @@ oceanic_vtpro_transfer (oceanic_vtpro_device_t *device, const unsigned char comm
 		// Abort if the maximum number of retries is reached.
 		if (nretries++ >= MAXRETRIES)
 			return rc;
+
+		// Only time the successful attempt.
+		start = device_latency_start (abstract);
 	}
 
 	if (asize) {
@@ -198,6 +208,8 @@ oceanic_vtpro_transfer (oceanic_vtpro_device_t *device, const unsigned char comm
 		}
 	}
 
+	device_latency_emit (abstract, command[0], asize, start);
+
 	return DC_STATUS_SUCCESS;
 }
 
@@ -503,6 +515,10 @@ oceanic_vtpro_device_open (dc_device_t **out, dc_context_t *context, dc_iostream
 		device->base.layout = &oceanic_vtpro_layout;
 	}
 
+	// Detect the largest supported multi-page read.
+	device->base.maxpages = oceanic_common_device_probe (&device->base, device->iostream,
+		oceanic_vtpro_maxpages, C_ARRAY_SIZE (oceanic_vtpro_maxpages));
+
 	*out = (dc_device_t*) device;
 
 	return DC_STATUS_SUCCESS;
@@ -629,17 +645,21 @@ oceanic_vtpro_device_read (dc_device_t *abstract, unsigned int address, unsigned
 		(size    % PAGESIZE != 0))
 		return DC_STATUS_INVALIDARGS;
 
+	unsigned int maxpages = device->base.multipage;
+	if (device->base.maxpages > maxpages)
+		maxpages = device->base.maxpages;
+
 	unsigned int nbytes = 0;
 	while (nbytes < size) {
 		// Calculate the number of packages.
 		unsigned int npackets = (size - nbytes) / PAGESIZE;
-		if (npackets > MULTIPAGE)
-			npackets = MULTIPAGE;
+		if (npackets > maxpages)
+			npackets = maxpages;
 
 		// Read the package.
 		unsigned int first =  address / PAGESIZE;
 		unsigned int last  = first + npackets - 1;
-		unsigned char answer[(PAGESIZE + 1) * MULTIPAGE] = {0};
+		unsigned char answer[(PAGESIZE + 1) * MAXPAGES] = {0};
 		unsigned char command[6] = {0x34,
 				(first >> 8) & 0xFF, // high
 				(first     ) & 0xFF, // low
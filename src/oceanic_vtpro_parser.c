@@ -19,6 +19,8 @@
  * MA 02110-1301 USA
  */
 
+#define LOG_SUBSYSTEM DC_LOGSUBSYSTEM_PARSER
+
 #include <stdlib.h>
 
 #include <libdivecomputer/units.h>
@@ -38,10 +40,6 @@ typedef struct oceanic_vtpro_parser_t oceanic_vtpro_parser_t;
 struct oceanic_vtpro_parser_t {
 	dc_parser_t base;
 	unsigned int model;
-	// Cached fields.
-	unsigned int cached;
-	unsigned int divetime;
-	double maxdepth;
 };
 
 static dc_status_t oceanic_vtpro_parser_set_data (dc_parser_t *abstract, const unsigned char *data, unsigned int size);
@@ -77,9 +75,6 @@ oceanic_vtpro_parser_create (dc_parser_t **out, dc_context_t *context, unsigned
 
 	// Set the default values.
 	parser->model = model;
-	parser->cached = 0;
-	parser->divetime = 0;
-	parser->maxdepth = 0.0;
 
 	*out = (dc_parser_t*) parser;
 
@@ -90,13 +85,6 @@ oceanic_vtpro_parser_create (dc_parser_t **out, dc_context_t *context, unsigned
 static dc_status_t
 oceanic_vtpro_parser_set_data (dc_parser_t *abstract, const unsigned char *data, unsigned int size)
 {
-	oceanic_vtpro_parser_t *parser = (oceanic_vtpro_parser_t *) abstract;
-
-	// Reset the cache.
-	parser->cached = 0;
-	parser->divetime = 0;
-	parser->maxdepth = 0.0;
-
 	return DC_STATUS_SUCCESS;
 }
 
@@ -158,17 +146,11 @@ oceanic_vtpro_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, uns
 	if (size < 7 * PAGESIZE / 2)
 		return DC_STATUS_DATAFORMAT;
 
-	if (!parser->cached) {
-		sample_statistics_t statistics = SAMPLE_STATISTICS_INITIALIZER;
-		dc_status_t rc = oceanic_vtpro_parser_samples_foreach (
-			abstract, sample_statistics_cb, &statistics);
-		if (rc != DC_STATUS_SUCCESS)
-			return rc;
-
-		parser->cached = 1;
-		parser->divetime = statistics.divetime;
-		parser->maxdepth = statistics.maxdepth;
-	}
+	// Get the sample statistics.
+	sample_statistics_t statistics = SAMPLE_STATISTICS_INITIALIZER;
+	dc_status_t rc = parser_get_statistics (abstract, &statistics);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
 
 	unsigned int footer = size - PAGESIZE;
 
@@ -190,7 +172,7 @@ oceanic_vtpro_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, uns
 	if (value) {
 		switch (type) {
 		case DC_FIELD_DIVETIME:
-			*((unsigned int *) value) = parser->divetime;
+			*((unsigned int *) value) = statistics.divetime;
 			break;
 		case DC_FIELD_MAXDEPTH:
 			*((double *) value) = maxdepth * FEET;
@@ -220,6 +202,21 @@ oceanic_vtpro_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, uns
 			tank->beginpressure = beginpressure * 2 * PSI / BAR;
 			tank->endpressure = endpressure * 2 * PSI / BAR;
 			break;
+		case DC_FIELD_AVGDEPTH:
+			if (statistics.ndepths == 0)
+				return DC_STATUS_UNSUPPORTED;
+			*((double *) value) = statistics.avgdepth;
+			break;
+		case DC_FIELD_TEMPERATURE_MINIMUM:
+			if (statistics.ntemperatures == 0)
+				return DC_STATUS_UNSUPPORTED;
+			*((double *) value) = statistics.temperature_minimum;
+			break;
+		case DC_FIELD_TEMPERATURE_MAXIMUM:
+			if (statistics.ntemperatures == 0)
+				return DC_STATUS_UNSUPPORTED;
+			*((double *) value) = statistics.temperature_maximum;
+			break;
 		default:
 			return DC_STATUS_UNSUPPORTED;
 		}
@@ -272,7 +269,7 @@ oceanic_vtpro_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_
 
 		// Get the current timestamp.
 		unsigned int current = bcd2dec (data[offset + 1] & 0x0F) * 60 + bcd2dec (data[offset + 0]);
-		if (current < timestamp) {
+		if (current < timestamp && !(abstract->flags & DC_PARSER_FLAG_TRUSTED)) {
 			ERROR (abstract->context, "Timestamp moved backwards.");
 			return DC_STATUS_DATAFORMAT;
 		}
@@ -0,0 +1,307 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "pagecache.h"
+#include "context-private.h"
+#include "device-private.h"
+
+#define NBUCKETS 1024
+
+typedef struct dc_page_t {
+	// Next page in the same hash bucket.
+	struct dc_page_t *hnext;
+	// Neighbours in the LRU list (most recently used first).
+	struct dc_page_t *prev;
+	struct dc_page_t *next;
+	unsigned int address;
+	unsigned char data[];
+} dc_page_t;
+
+struct dc_pagecache_t {
+	dc_device_t *device;
+	unsigned int pagesize;
+	unsigned int maxpages;
+	unsigned int npages;
+	unsigned int hits;
+	unsigned int misses;
+	dc_page_t *head;
+	dc_page_t *tail;
+	dc_page_t *buckets[NBUCKETS];
+};
+
+static unsigned int
+ifloor (unsigned int x, unsigned int n)
+{
+	// Round down to next lower multiple.
+	return (x / n) * n;
+}
+
+static unsigned int
+iceil (unsigned int x, unsigned int n)
+{
+	// Round up to next higher multiple.
+	return ((x + n - 1) / n) * n;
+}
+
+static dc_page_t **
+dc_pagecache_bucket (dc_pagecache_t *cache, unsigned int address)
+{
+	return cache->buckets + (address / cache->pagesize) % NBUCKETS;
+}
+
+static dc_page_t *
+dc_pagecache_lookup (dc_pagecache_t *cache, unsigned int address)
+{
+	dc_page_t *page = *dc_pagecache_bucket (cache, address);
+	while (page && page->address != address)
+		page = page->hnext;
+	return page;
+}
+
+static void
+dc_pagecache_unlink (dc_pagecache_t *cache, dc_page_t *page)
+{
+	// Remove from the hash bucket.
+	dc_page_t **p = dc_pagecache_bucket (cache, page->address);
+	while (*p != page)
+		p = &(*p)->hnext;
+	*p = page->hnext;
+
+	// Remove from the LRU list.
+	if (page->prev)
+		page->prev->next = page->next;
+	else
+		cache->head = page->next;
+	if (page->next)
+		page->next->prev = page->prev;
+	else
+		cache->tail = page->prev;
+}
+
+static void
+dc_pagecache_insert (dc_pagecache_t *cache, dc_page_t *page)
+{
+	// Add to the hash bucket.
+	dc_page_t **p = dc_pagecache_bucket (cache, page->address);
+	page->hnext = *p;
+	*p = page;
+
+	// Add to the front of the LRU list.
+	page->prev = NULL;
+	page->next = cache->head;
+	if (cache->head)
+		cache->head->prev = page;
+	else
+		cache->tail = page;
+	cache->head = page;
+}
+
+static dc_page_t *
+dc_pagecache_alloc (dc_pagecache_t *cache)
+{
+	dc_page_t *page = NULL;
+
+	if (cache->npages < cache->maxpages) {
+		page = (dc_page_t *) dc_malloc (cache->device->context, sizeof (dc_page_t) + cache->pagesize);
+		if (page != NULL) {
+			cache->npages++;
+			return page;
+		}
+	}
+
+	// Recycle the least recently used page.
+	page = cache->tail;
+	if (page != NULL) {
+		dc_pagecache_unlink (cache, page);
+	}
+
+	return page;
+}
+
+static void
+dc_pagecache_copy (dc_pagecache_t *cache, unsigned int pageaddr, const unsigned char *pagedata, unsigned int address, unsigned char data[], unsigned int size)
+{
+	// Copy the part of the page overlapping with the requested range.
+	unsigned int begin = pageaddr > address ? pageaddr : address;
+	unsigned int end = pageaddr + cache->pagesize < address + size ?
+		pageaddr + cache->pagesize : address + size;
+
+	memcpy (data + (begin - address), pagedata + (begin - pageaddr), end - begin);
+}
+
+dc_status_t
+dc_pagecache_new (dc_pagecache_t **out, dc_device_t *device, unsigned int pagesize, unsigned int maxsize)
+{
+	dc_pagecache_t *cache = NULL;
+
+	if (out == NULL || device == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	// The cache should hold at least one page.
+	if (pagesize == 0 || maxsize < pagesize) {
+		ERROR (device->context, "Invalid page or cache size!");
+		return DC_STATUS_INVALIDARGS;
+	}
+
+	cache = (dc_pagecache_t *) dc_malloc (device->context, sizeof (*cache));
+	if (cache == NULL) {
+		ERROR (device->context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	cache->device = device;
+	cache->pagesize = pagesize;
+	cache->maxpages = maxsize / pagesize;
+	cache->npages = 0;
+	cache->hits = 0;
+	cache->misses = 0;
+	cache->head = NULL;
+	cache->tail = NULL;
+	memset (cache->buckets, 0, sizeof (cache->buckets));
+
+	*out = cache;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_pagecache_read (dc_pagecache_t *cache, unsigned int address, unsigned char data[], unsigned int size)
+{
+	dc_status_t rc = DC_STATUS_SUCCESS;
+	dc_device_t *device = cache->device;
+	unsigned int pagesize = cache->pagesize;
+
+	if (size == 0)
+		return DC_STATUS_SUCCESS;
+
+	// Requests which can't be cached are passed through unchanged.
+	if ((size - 1) / pagesize + 2 > cache->maxpages ||
+		address > UINT_MAX - size - pagesize)
+		return device->vtable->read (device, address, data, size);
+
+	unsigned int begin = ifloor (address, pagesize);
+	unsigned int end = iceil (address + size, pagesize);
+
+	unsigned char *scratch = NULL;
+
+	unsigned int pageaddr = begin;
+	while (pageaddr < end) {
+		dc_page_t *page = dc_pagecache_lookup (cache, pageaddr);
+		if (page != NULL) {
+			// Move to the front of the LRU list.
+			dc_pagecache_unlink (cache, page);
+			dc_pagecache_insert (cache, page);
+
+			dc_pagecache_copy (cache, pageaddr, page->data, address, data, size);
+
+			cache->hits++;
+			pageaddr += pagesize;
+			continue;
+		}
+
+		// Find the run of consecutive missing pages, and read them all
+		// at once to keep the number of transfers low.
+		unsigned int runend = pageaddr + pagesize;
+		while (runend < end && dc_pagecache_lookup (cache, runend) == NULL)
+			runend += pagesize;
+
+		if (scratch == NULL) {
+			scratch = (unsigned char *) dc_malloc (device->context, end - begin);
+			if (scratch == NULL) {
+				ERROR (device->context, "Failed to allocate memory.");
+				return DC_STATUS_NOMEMORY;
+			}
+		}
+
+		rc = device->vtable->read (device, pageaddr, scratch, runend - pageaddr);
+		if (rc != DC_STATUS_SUCCESS)
+			break;
+
+		for (unsigned int offset = 0; pageaddr + offset < runend; offset += pagesize) {
+			dc_pagecache_copy (cache, pageaddr + offset, scratch + offset, address, data, size);
+
+			page = dc_pagecache_alloc (cache);
+			if (page != NULL) {
+				page->address = pageaddr + offset;
+				memcpy (page->data, scratch + offset, pagesize);
+				dc_pagecache_insert (cache, page);
+			}
+
+			cache->misses++;
+		}
+
+		pageaddr = runend;
+	}
+
+	dc_free (device->context, scratch);
+
+	return rc;
+}
+
+void
+dc_pagecache_invalidate (dc_pagecache_t *cache, unsigned int address, unsigned int size)
+{
+	if (cache == NULL || size == 0)
+		return;
+
+	dc_page_t *page = cache->head;
+	while (page) {
+		dc_page_t *next = page->next;
+		if (page->address < address + size &&
+			address < page->address + cache->pagesize) {
+			dc_pagecache_unlink (cache, page);
+			dc_free (cache->device->context, page);
+			cache->npages--;
+		}
+		page = next;
+	}
+}
+
+void
+dc_pagecache_get_stats (dc_pagecache_t *cache, unsigned int *hits, unsigned int *misses)
+{
+	if (hits)
+		*hits = cache ? cache->hits : 0;
+	if (misses)
+		*misses = cache ? cache->misses : 0;
+}
+
+dc_status_t
+dc_pagecache_free (dc_pagecache_t *cache)
+{
+	if (cache == NULL)
+		return DC_STATUS_SUCCESS;
+
+	dc_page_t *page = cache->head;
+	while (page) {
+		dc_page_t *next = page->next;
+		dc_free (cache->device->context, page);
+		page = next;
+	}
+
+	dc_free (cache->device->context, cache);
+
+	return DC_STATUS_SUCCESS;
+}
@@ -0,0 +1,100 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_PAGECACHE_H
+#define DC_PAGECACHE_H
+
+#include <libdivecomputer/device.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/**
+ * Opaque object representing a page cache.
+ */
+typedef struct dc_pagecache_t dc_pagecache_t;
+
+/**
+ * Create a new page cache.
+ *
+ * The cache sits in front of the read function of the device backend.
+ * Data is always fetched in whole pages, aligned to the page size, and
+ * the least recently used pages are discarded once the maximum size is
+ * reached.
+ *
+ * @param[out]  pagecache  A location to store the page cache.
+ * @param[in]   device     A valid device object.
+ * @param[in]   pagesize   The page size in bytes.
+ * @param[in]   maxsize    The maximum size of the cache in bytes.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_pagecache_new (dc_pagecache_t **pagecache, dc_device_t *device, unsigned int pagesize, unsigned int maxsize);
+
+/**
+ * Read data through the page cache.
+ *
+ * @param[in]  pagecache  A valid page cache.
+ * @param[in]  address    The start address.
+ * @param[out] data       The memory buffer to read the data into.
+ * @param[in]  size       The number of bytes to read.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_pagecache_read (dc_pagecache_t *pagecache, unsigned int address, unsigned char data[], unsigned int size);
+
+/**
+ * Discard all cached pages overlapping with the address range.
+ *
+ * @param[in]  pagecache  A valid page cache.
+ * @param[in]  address    The start address.
+ * @param[in]  size       The number of bytes.
+ */
+void
+dc_pagecache_invalidate (dc_pagecache_t *pagecache, unsigned int address, unsigned int size);
+
+/**
+ * Get the hit and miss counters of the page cache.
+ *
+ * @param[in]  pagecache  A valid page cache.
+ * @param[out] hits       The number of pages found in the cache.
+ * @param[out] misses     The number of pages read from the device.
+ */
+void
+dc_pagecache_get_stats (dc_pagecache_t *pagecache, unsigned int *hits, unsigned int *misses);
+
+/**
+ * Destroy the page cache.
+ *
+ * @param[in]  pagecache  A valid page cache.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_pagecache_free (dc_pagecache_t *pagecache);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_PAGECACHE_H */
@@ -24,6 +24,7 @@
 
 #include <libdivecomputer/context.h>
 #include <libdivecomputer/parser.h>
+#include <libdivecomputer/buffer.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -34,11 +35,56 @@ struct dc_parser_vtable_t;
 
 typedef struct dc_parser_vtable_t dc_parser_vtable_t;
 
+typedef struct sample_statistics_t {
+	unsigned int divetime;
+	double maxdepth;
+	double avgdepth;
+	double temperature_minimum;
+	double temperature_maximum;
+	// Number of depth and temperature samples.
+	unsigned int ndepths;
+	unsigned int ntemperatures;
+} sample_statistics_t;
+
+#define SAMPLE_STATISTICS_INITIALIZER {0, 0.0, 0.0, 0.0, 0.0, 0, 0}
+
+#define PARSER_SAMPLE_ALL 0xFFFFFFFFu
+
+typedef struct parser_sample_t {
+	dc_sample_type_t type;
+	dc_sample_value_t value;
+} parser_sample_t;
+
 struct dc_parser_t {
 	const dc_parser_vtable_t *vtable;
 	dc_context_t *context;
 	const unsigned char *data;
 	unsigned int size;
+	// Cached sample statistics.
+	unsigned int statistics_cached;
+	sample_statistics_t statistics;
+	// Cached summary, with the arrays stored in the buffer.
+	unsigned int summary_cached;
+	dc_parser_summary_t summary;
+	dc_buffer_t *summary_data;
+	// Materialized samples (parser_sample_t).
+	unsigned int materialized;
+	dc_buffer_t *samples;
+	// Sample types wanted by the application (1 << DC_SAMPLE_xxx).
+	// Backends may skip decoding the other types, but the unwanted
+	// samples are also filtered out afterwards.
+	unsigned int samplemask;
+	// Parser flags (DC_PARSER_FLAG_xxx).
+	unsigned int flags;
+	// Downsampling of the profile.
+	dc_decimation_t decimation;
+	unsigned int decimation_value;
+	dc_buffer_t *bucket;
+	// Position of the time samples in the materialized samples.
+	unsigned int indexed;
+	dc_buffer_t *rows;
+	// Number of samples already passed by dc_parser_append_data.
+	unsigned int appended;
 };
 
 struct dc_parser_vtable_t {
@@ -55,6 +101,17 @@ struct dc_parser_vtable_t {
 	dc_status_t (*samples_foreach) (dc_parser_t *parser, dc_sample_callback_t callback, void *userdata);
 
 	dc_status_t (*destroy) (dc_parser_t *parser);
+
+	dc_status_t (*samples_batch) (dc_parser_t *parser, unsigned int offset, dc_sample_batch_t *batch);
+
+	// Continue decoding the samples where the previous call stopped,
+	// after more data has been appended. The backend keeps its own
+	// resume state, which is reset by set_data.
+	dc_status_t (*samples_append) (dc_parser_t *parser, dc_sample_callback_t callback, void *userdata);
+
+	// Recompute the integrity checks stored in the dive data itself.
+	// The samples are decoded afterwards by dc_parser_verify.
+	dc_status_t (*verify) (dc_parser_t *parser);
 };
 
 dc_parser_t *
@@ -66,15 +123,22 @@ dc_parser_deallocate (dc_parser_t *parser);
 int
 dc_parser_isinstance (dc_parser_t *parser, const dc_parser_vtable_t *vtable);
 
-typedef struct sample_statistics_t {
-	unsigned int divetime;
-	double maxdepth;
-} sample_statistics_t;
+void
+sample_statistics_cb (dc_sample_type_t type, dc_sample_value_t value, void *userdata);
 
-#define SAMPLE_STATISTICS_INITIALIZER {0, 0.0}
+/*
+ * Get the statistics of the sample data. The samples are only traversed
+ * the first time, and the result is cached until the next
+ * dc_parser_set_data call.
+ */
+dc_status_t
+parser_get_statistics (dc_parser_t *parser, sample_statistics_t *statistics);
 
+/*
+ * Reset all columns of the given row of the batch to zero.
+ */
 void
-sample_statistics_cb (dc_sample_type_t type, dc_sample_value_t value, void *userdata);
+sample_batch_clear (dc_sample_batch_t *batch, unsigned int row);
 
 #ifdef __cplusplus
 }
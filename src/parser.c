@@ -19,51 +19,22 @@
  * MA 02110-1301 USA
  */
 
+#define LOG_SUBSYSTEM DC_LOGSUBSYSTEM_PARSER
+
 #include <stdlib.h>
+#include <string.h>
+#include <limits.h>
 #include <assert.h>
-
-#include "suunto_d9.h"
-#include "suunto_eon.h"
-#include "suunto_eonsteel.h"
-#include "suunto_solution.h"
-#include "suunto_vyper2.h"
-#include "suunto_vyper.h"
-#include "reefnet_sensus.h"
-#include "reefnet_sensuspro.h"
-#include "reefnet_sensusultra.h"
-#include "uwatec_aladin.h"
-#include "uwatec_memomouse.h"
-#include "uwatec_smart.h"
-#include "oceanic_atom2.h"
-#include "oceanic_atom2.h"
-#include "oceanic_veo250.h"
-#include "oceanic_vtpro.h"
-#include "mares_darwin.h"
-#include "mares_iconhd.h"
-#include "mares_nemo.h"
-#include "mares_puck.h"
-#include "hw_frog.h"
-#include "hw_ostc.h"
-#include "hw_ostc3.h"
-#include "cressi_edy.h"
-#include "cressi_leonardo.h"
-#include "cressi_goa.h"
-#include "zeagle_n2ition3.h"
-#include "atomics_cobalt.h"
-#include "shearwater_petrel.h"
-#include "shearwater_predator.h"
-#include "diverite_nitekq.h"
-#include "citizen_aqualand.h"
-#include "divesystem_idive.h"
-#include "cochran_commander.h"
-#include "tecdiving_divecomputereu.h"
-#include "garmin.h"
+#include <math.h>
 
 #include "context-private.h"
 #include "parser-private.h"
 #include "device-private.h"
+#include "family.h"
+#include "perfstats.h"
+#include "tracepoint.h"
 
-#define REACTPROWHITE 0x4354
+#define C_ARRAY_SIZE(array) (sizeof (array) / sizeof *(array))
 
 static dc_status_t
 dc_parser_new_internal (dc_parser_t **out, dc_context_t *context, dc_family_t family, unsigned int model, unsigned int serial, unsigned int devtime, dc_ticks_t systime)
@@ -74,111 +45,11 @@ dc_parser_new_internal (dc_parser_t **out, dc_context_t *context, dc_family_t fa
 	if (out == NULL)
 		return DC_STATUS_INVALIDARGS;
 
-	switch (family) {
-	case DC_FAMILY_SUUNTO_SOLUTION:
-		rc = suunto_solution_parser_create (&parser, context);
-		break;
-	case DC_FAMILY_SUUNTO_EON:
-		rc = suunto_eon_parser_create (&parser, context, 0);
-		break;
-	case DC_FAMILY_SUUNTO_VYPER:
-		if (model == 0x01)
-			rc = suunto_eon_parser_create (&parser, context, 1);
-		else
-			rc = suunto_vyper_parser_create (&parser, context);
-		break;
-	case DC_FAMILY_SUUNTO_VYPER2:
-	case DC_FAMILY_SUUNTO_D9:
-		rc = suunto_d9_parser_create (&parser, context, model, serial);
-		break;
-	case DC_FAMILY_SUUNTO_EONSTEEL:
-		rc = suunto_eonsteel_parser_create(&parser, context, model);
-		break;
-	case DC_FAMILY_UWATEC_ALADIN:
-	case DC_FAMILY_UWATEC_MEMOMOUSE:
-		rc = uwatec_memomouse_parser_create (&parser, context, devtime, systime);
-		break;
-	case DC_FAMILY_UWATEC_SMART:
-		rc = uwatec_smart_parser_create (&parser, context, model, devtime, systime);
-		break;
-	case DC_FAMILY_REEFNET_SENSUS:
-		rc = reefnet_sensus_parser_create (&parser, context, devtime, systime);
-		break;
-	case DC_FAMILY_REEFNET_SENSUSPRO:
-		rc = reefnet_sensuspro_parser_create (&parser, context, devtime, systime);
-		break;
-	case DC_FAMILY_REEFNET_SENSUSULTRA:
-		rc = reefnet_sensusultra_parser_create (&parser, context, devtime, systime);
-		break;
-	case DC_FAMILY_OCEANIC_VTPRO:
-		rc = oceanic_vtpro_parser_create (&parser, context, model);
-		break;
-	case DC_FAMILY_OCEANIC_VEO250:
-		rc = oceanic_veo250_parser_create (&parser, context, model);
-		break;
-	case DC_FAMILY_OCEANIC_ATOM2:
-		if (model == REACTPROWHITE)
-			rc = oceanic_veo250_parser_create (&parser, context, model);
-		else
-			rc = oceanic_atom2_parser_create (&parser, context, model, serial);
-		break;
-	case DC_FAMILY_MARES_NEMO:
-	case DC_FAMILY_MARES_PUCK:
-		rc = mares_nemo_parser_create (&parser, context, model);
-		break;
-	case DC_FAMILY_MARES_DARWIN:
-		rc = mares_darwin_parser_create (&parser, context, model);
-		break;
-	case DC_FAMILY_MARES_ICONHD:
-		rc = mares_iconhd_parser_create (&parser, context, model);
-		break;
-	case DC_FAMILY_HW_OSTC:
-		rc = hw_ostc_parser_create (&parser, context, serial, 0);
-		break;
-	case DC_FAMILY_HW_FROG:
-	case DC_FAMILY_HW_OSTC3:
-		rc = hw_ostc3_parser_create (&parser, context, serial, model);
-		break;
-	case DC_FAMILY_CRESSI_EDY:
-	case DC_FAMILY_ZEAGLE_N2ITION3:
-		rc = cressi_edy_parser_create (&parser, context, model);
-		break;
-	case DC_FAMILY_CRESSI_LEONARDO:
-		rc = cressi_leonardo_parser_create (&parser, context, model);
-		break;
-	case DC_FAMILY_CRESSI_GOA:
-		rc = cressi_goa_parser_create (&parser, context, model);
-		break;
-	case DC_FAMILY_ATOMICS_COBALT:
-		rc = atomics_cobalt_parser_create (&parser, context);
-		break;
-	case DC_FAMILY_SHEARWATER_PREDATOR:
-		rc = shearwater_predator_parser_create (&parser, context, model, serial);
-		break;
-	case DC_FAMILY_SHEARWATER_PETREL:
-		rc = shearwater_petrel_parser_create (&parser, context, model, serial);
-		break;
-	case DC_FAMILY_DIVERITE_NITEKQ:
-		rc = diverite_nitekq_parser_create (&parser, context);
-		break;
-	case DC_FAMILY_CITIZEN_AQUALAND:
-		rc = citizen_aqualand_parser_create (&parser, context);
-		break;
-	case DC_FAMILY_DIVESYSTEM_IDIVE:
-		rc = divesystem_idive_parser_create (&parser, context, model);
-		break;
-	case DC_FAMILY_COCHRAN_COMMANDER:
-		rc = cochran_commander_parser_create (&parser, context, model);
-		break;
-	case DC_FAMILY_TECDIVING_DIVECOMPUTEREU:
-		rc = tecdiving_divecomputereu_parser_create (&parser, context);
-		break;
-	case DC_FAMILY_GARMIN:
-		rc = garmin_parser_create (&parser, context);
-		break;
-	default:
+	const dc_family_entry_t *entry = dc_family_lookup (family);
+	if (entry == NULL)
 		return DC_STATUS_INVALIDARGS;
-	}
+
+	rc = entry->parser_create (&parser, context, model, serial, devtime, systime);
 
 	*out = parser;
 
@@ -217,7 +88,7 @@ dc_parser_allocate (dc_context_t *context, const dc_parser_vtable_t *vtable)
 	assert(vtable->size >= sizeof(dc_parser_t));
 
 	// Allocate memory.
-	parser = (dc_parser_t *) malloc (vtable->size);
+	parser = (dc_parser_t *) dc_malloc (context, vtable->size);
 	if (parser == NULL) {
 		ERROR (context, "Failed to allocate memory.");
 		return parser;
@@ -228,6 +99,19 @@ dc_parser_allocate (dc_context_t *context, const dc_parser_vtable_t *vtable)
 	parser->context = context;
 	parser->data = NULL;
 	parser->size = 0;
+	parser->statistics_cached = 0;
+	parser->summary_cached = 0;
+	parser->summary_data = NULL;
+	parser->materialized = 0;
+	parser->samples = NULL;
+	parser->samplemask = PARSER_SAMPLE_ALL;
+	parser->flags = 0;
+	parser->decimation = DC_DECIMATION_NONE;
+	parser->decimation_value = 0;
+	parser->bucket = NULL;
+	parser->indexed = 0;
+	parser->rows = NULL;
+	parser->appended = 0;
 
 	return parser;
 }
@@ -235,7 +119,14 @@ dc_parser_allocate (dc_context_t *context, const dc_parser_vtable_t *vtable)
 void
 dc_parser_deallocate (dc_parser_t *parser)
 {
-	free (parser);
+	if (parser == NULL)
+		return;
+
+	dc_buffer_free (parser->rows);
+	dc_buffer_free (parser->bucket);
+	dc_buffer_free (parser->samples);
+	dc_buffer_free (parser->summary_data);
+	dc_free (parser->context, parser);
 }
 
 int
@@ -269,11 +160,24 @@ dc_parser_set_data (dc_parser_t *parser, const unsigned char *data, unsigned int
 
 	parser->data = data;
 	parser->size = size;
+	parser->statistics_cached = 0;
+	parser->summary_cached = 0;
+	parser->materialized = 0;
+	parser->indexed = 0;
+	parser->appended = 0;
+	dc_buffer_clear (parser->samples);
+
+	TRACEPOINT2 (parser__data__start, parser->vtable->type, size);
+
+	dc_status_t status = parser->vtable->set_data (parser, data, size);
+
+	TRACEPOINT3 (parser__data__done, parser->vtable->type, size, status);
 
-	return parser->vtable->set_data (parser, data, size);
+	return status;
 }
 
 
+
 dc_status_t
 dc_parser_get_datetime (dc_parser_t *parser, dc_datetime_t *datetime)
 {
@@ -298,17 +202,953 @@ dc_parser_get_field (dc_parser_t *parser, dc_field_type_t type, unsigned int fla
 	return parser->vtable->field (parser, type, flags, value);
 }
 
+/*
+ * Get a single field of the summary. The fields which the backend
+ * doesn't support or fails to decode are not considered an error.
+ */
+static dc_status_t
+parser_summary_field (dc_parser_t *parser, dc_parser_summary_t *summary, dc_field_type_t type, unsigned int flags, void *value)
+{
+	dc_status_t rc = parser->vtable->field (parser, type, flags, value);
+	if (rc == DC_STATUS_SUCCESS)
+		summary->fields |= 1u << type;
+	else if (rc == DC_STATUS_UNSUPPORTED || rc == DC_STATUS_DATAFORMAT)
+		rc = DC_STATUS_UNSUPPORTED;
+
+	return rc;
+}
+
+// Upper limit for the number of strings, in case a backend never
+// reports the end of the list.
+#define SUMMARY_MAXSTRINGS 256
+
+static dc_status_t
+parser_summary_collect (dc_parser_t *parser, dc_parser_summary_t *summary)
+{
+	dc_status_t rc = DC_STATUS_SUCCESS;
+
+	memset (summary, 0, sizeof (*summary));
+
+	if (parser->summary_data == NULL) {
+		parser->summary_data = dc_buffer_new (0);
+		if (parser->summary_data == NULL)
+			return DC_STATUS_NOMEMORY;
+	} else {
+		dc_buffer_clear (parser->summary_data);
+	}
+
+	if (parser->vtable->datetime) {
+		rc = parser->vtable->datetime (parser, &summary->datetime);
+		if (rc == DC_STATUS_SUCCESS)
+			summary->has_datetime = 1;
+		else if (rc != DC_STATUS_UNSUPPORTED && rc != DC_STATUS_DATAFORMAT)
+			return rc;
+		else
+			memset (&summary->datetime, 0, sizeof (summary->datetime));
+	}
+
+	if (parser->vtable->field == NULL)
+		return DC_STATUS_SUCCESS;
+
+	struct {
+		dc_field_type_t type;
+		void *value;
+	} scalars[] = {
+		{DC_FIELD_DIVETIME, &summary->divetime},
+		{DC_FIELD_MAXDEPTH, &summary->maxdepth},
+		{DC_FIELD_AVGDEPTH, &summary->avgdepth},
+		{DC_FIELD_SALINITY, &summary->salinity},
+		{DC_FIELD_ATMOSPHERIC, &summary->atmospheric},
+		{DC_FIELD_TEMPERATURE_SURFACE, &summary->temperature_surface},
+		{DC_FIELD_TEMPERATURE_MINIMUM, &summary->temperature_minimum},
+		{DC_FIELD_TEMPERATURE_MAXIMUM, &summary->temperature_maximum},
+		{DC_FIELD_DIVEMODE, &summary->divemode},
+		{DC_FIELD_LOCATION, &summary->location},
+	};
+
+	for (unsigned int i = 0; i < C_ARRAY_SIZE (scalars); ++i) {
+		rc = parser_summary_field (parser, summary, scalars[i].type, 0, scalars[i].value);
+		if (rc != DC_STATUS_SUCCESS && rc != DC_STATUS_UNSUPPORTED)
+			return rc;
+	}
+
+	// The arrays are appended to the buffer, and only located at the
+	// end, because the buffer can be reallocated while growing. All
+	// element sizes are a multiple of the alignment of a double.
+	dc_buffer_t *buffer = parser->summary_data;
+
+	unsigned int ngasmixes = 0;
+	rc = parser_summary_field (parser, summary, DC_FIELD_GASMIX_COUNT, 0, &ngasmixes);
+	if (rc != DC_STATUS_SUCCESS && rc != DC_STATUS_UNSUPPORTED)
+		return rc;
+	for (unsigned int i = 0; i < ngasmixes; ++i) {
+		dc_gasmix_t gasmix = {0};
+		rc = parser_summary_field (parser, summary, DC_FIELD_GASMIX, i, &gasmix);
+		if (rc == DC_STATUS_UNSUPPORTED) {
+			summary->fields &= ~(1u << DC_FIELD_GASMIX);
+			break;
+		} else if (rc != DC_STATUS_SUCCESS) {
+			return rc;
+		}
+		if (!dc_buffer_append (buffer, (const unsigned char *) &gasmix, sizeof (gasmix)))
+			return DC_STATUS_NOMEMORY;
+		summary->ngasmixes++;
+	}
+
+	unsigned int ntanks = 0;
+	rc = parser_summary_field (parser, summary, DC_FIELD_TANK_COUNT, 0, &ntanks);
+	if (rc != DC_STATUS_SUCCESS && rc != DC_STATUS_UNSUPPORTED)
+		return rc;
+	for (unsigned int i = 0; i < ntanks; ++i) {
+		dc_tank_t tank = {0};
+		rc = parser_summary_field (parser, summary, DC_FIELD_TANK, i, &tank);
+		if (rc == DC_STATUS_UNSUPPORTED) {
+			summary->fields &= ~(1u << DC_FIELD_TANK);
+			break;
+		} else if (rc != DC_STATUS_SUCCESS) {
+			return rc;
+		}
+		if (!dc_buffer_append (buffer, (const unsigned char *) &tank, sizeof (tank)))
+			return DC_STATUS_NOMEMORY;
+		summary->ntanks++;
+	}
+
+	for (unsigned int i = 0; i < SUMMARY_MAXSTRINGS; ++i) {
+		dc_field_string_t string = {NULL, NULL};
+		rc = parser_summary_field (parser, summary, DC_FIELD_STRING, i, &string);
+		if (rc == DC_STATUS_UNSUPPORTED)
+			break;
+		else if (rc != DC_STATUS_SUCCESS)
+			return rc;
+		if (!dc_buffer_append (buffer, (const unsigned char *) &string, sizeof (string)))
+			return DC_STATUS_NOMEMORY;
+		summary->nstrings++;
+	}
+
+	const unsigned char *data = dc_buffer_get_data (buffer);
+	summary->gasmixes = summary->ngasmixes ? (const dc_gasmix_t *) data : NULL;
+	data += summary->ngasmixes * sizeof (dc_gasmix_t);
+	summary->tanks = summary->ntanks ? (const dc_tank_t *) data : NULL;
+	data += summary->ntanks * sizeof (dc_tank_t);
+	summary->strings = summary->nstrings ? (const dc_field_string_t *) data : NULL;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_parser_get_summary (dc_parser_t *parser, dc_parser_summary_t *summary)
+{
+	if (parser == NULL || summary == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	if (parser->vtable->datetime == NULL && parser->vtable->field == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (!parser->summary_cached) {
+		dc_status_t rc = parser_summary_collect (parser, &parser->summary);
+		if (rc != DC_STATUS_SUCCESS)
+			return rc;
+
+		parser->summary_cached = 1;
+	}
+
+	*summary = parser->summary;
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+dc_status_t
+dc_parser_set_sample_mask (dc_parser_t *parser, unsigned int mask)
+{
+	if (parser == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	parser->samplemask = mask;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_parser_set_flags (dc_parser_t *parser, unsigned int flags)
+{
+	if (parser == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	parser->flags = flags;
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+typedef struct sample_filter_t {
+	unsigned int mask;
+	dc_sample_callback_t callback;
+	void *userdata;
+} sample_filter_t;
+
+static void
+sample_filter_cb (dc_sample_type_t type, dc_sample_value_t value, void *userdata)
+{
+	sample_filter_t *filter = (sample_filter_t *) userdata;
+
+	if (type < 32 && (filter->mask & (1u << type)) == 0)
+		return;
+
+	filter->callback (type, value, filter->userdata);
+}
+
+#ifdef ENABLE_PERF_STATS
+typedef struct sample_count_t {
+	int emitted;
+	dc_sample_callback_t callback;
+	void *userdata;
+} sample_count_t;
+
+static void
+sample_count_cb (dc_sample_type_t type, dc_sample_value_t value, void *userdata)
+{
+	sample_count_t *count = (sample_count_t *) userdata;
+
+	if (count->emitted)
+		PERFSTATS_ADD (samples, 1);
+	else
+		PERFSTATS_ADD (callbacks, 1);
+
+	count->callback (type, value, count->userdata);
+}
+#endif
+
+dc_status_t
+dc_parser_set_decimation (dc_parser_t *parser, dc_decimation_t type, unsigned int value)
+{
+	if (parser == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (type > DC_DECIMATION_MINMAX || (type != DC_DECIMATION_NONE && value == 0))
+		return DC_STATUS_INVALIDARGS;
+
+	if (type == DC_DECIMATION_MINMAX && parser->bucket == NULL) {
+		parser->bucket = dc_buffer_new (0);
+		if (parser->bucket == NULL) {
+			ERROR (parser->context, "Failed to allocate memory.");
+			return DC_STATUS_NOMEMORY;
+		}
+	}
+
+	parser->decimation = type;
+	parser->decimation_value = value;
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+typedef struct sample_decimate_t {
+	dc_decimation_t type;
+	unsigned int value;
+	dc_sample_callback_t callback;
+	void *userdata;
+	unsigned int nrows;
+	unsigned int bucket;
+	unsigned int keep;
+	// Samples of the current time slot (min/max only), with the ranges
+	// of the first, shallowest and deepest row.
+	dc_buffer_t *buffer;
+	size_t row;
+	unsigned int hasdepth;
+	double depth;
+	unsigned int ndepths;
+	double mindepth, maxdepth;
+	size_t first[2], min[2], max[2];
+	unsigned int error;
+} sample_decimate_t;
+
+static void
+sample_decimate_emit (sample_decimate_t *decimate, const parser_sample_t samples[], const size_t range[2])
+{
+	for (size_t i = range[0]; i < range[1]; ++i) {
+		decimate->callback (samples[i].type, samples[i].value, decimate->userdata);
+	}
+}
+
+static void
+sample_decimate_row (sample_decimate_t *decimate)
+{
+	size_t end = dc_buffer_get_size (decimate->buffer) / sizeof (parser_sample_t);
+	if (end == decimate->row)
+		return;
+
+	if (decimate->row == 0) {
+		decimate->first[0] = 0;
+		decimate->first[1] = end;
+	}
+
+	if (decimate->hasdepth) {
+		if (decimate->ndepths == 0 || decimate->depth < decimate->mindepth) {
+			decimate->mindepth = decimate->depth;
+			decimate->min[0] = decimate->row;
+			decimate->min[1] = end;
+		}
+		if (decimate->ndepths == 0 || decimate->depth > decimate->maxdepth) {
+			decimate->maxdepth = decimate->depth;
+			decimate->max[0] = decimate->row;
+			decimate->max[1] = end;
+		}
+		decimate->ndepths++;
+	}
+
+	decimate->row = end;
+	decimate->hasdepth = 0;
+}
+
+static void
+sample_decimate_flush (sample_decimate_t *decimate)
+{
+	sample_decimate_row (decimate);
+
+	const parser_sample_t *samples = (const parser_sample_t *) dc_buffer_get_data (decimate->buffer);
+	if (decimate->row == 0)
+		return;
+
+	if (decimate->ndepths == 0) {
+		sample_decimate_emit (decimate, samples, decimate->first);
+	} else if (decimate->min[0] == decimate->max[0]) {
+		sample_decimate_emit (decimate, samples, decimate->min);
+	} else if (decimate->min[0] < decimate->max[0]) {
+		sample_decimate_emit (decimate, samples, decimate->min);
+		sample_decimate_emit (decimate, samples, decimate->max);
+	} else {
+		sample_decimate_emit (decimate, samples, decimate->max);
+		sample_decimate_emit (decimate, samples, decimate->min);
+	}
+
+	dc_buffer_clear (decimate->buffer);
+	decimate->row = 0;
+	decimate->ndepths = 0;
+}
+
+static void
+sample_decimate_cb (dc_sample_type_t type, dc_sample_value_t value, void *userdata)
+{
+	sample_decimate_t *decimate = (sample_decimate_t *) userdata;
+
+	if (decimate->type != DC_DECIMATION_MINMAX) {
+		if (type == DC_SAMPLE_TIME) {
+			if (decimate->type == DC_DECIMATION_NTH) {
+				decimate->keep = (decimate->nrows % decimate->value) == 0;
+			} else {
+				unsigned int bucket = value.time / decimate->value;
+				decimate->keep = decimate->nrows == 0 || bucket != decimate->bucket;
+				decimate->bucket = bucket;
+			}
+			decimate->nrows++;
+		}
+
+		if (decimate->keep)
+			decimate->callback (type, value, decimate->userdata);
+		return;
+	}
+
+	if (type == DC_SAMPLE_TIME) {
+		unsigned int bucket = value.time / decimate->value;
+		if (decimate->nrows && bucket != decimate->bucket) {
+			sample_decimate_flush (decimate);
+		} else {
+			sample_decimate_row (decimate);
+		}
+		decimate->bucket = bucket;
+		decimate->nrows++;
+	} else if (decimate->nrows == 0) {
+		// Samples before the first row are passed unmodified.
+		decimate->callback (type, value, decimate->userdata);
+		return;
+	} else if (type == DC_SAMPLE_EVENT || type == DC_SAMPLE_VENDOR) {
+		return;
+	} else if (type == DC_SAMPLE_DEPTH) {
+		decimate->hasdepth = 1;
+		decimate->depth = value.depth;
+	}
+
+	parser_sample_t sample;
+	sample.type = type;
+	sample.value = value;
+	if (!dc_buffer_append (decimate->buffer, (const unsigned char *) &sample, sizeof (sample)))
+		decimate->error = 1;
+}
+
+/*
+ * Traverse all samples, regardless of the sample mask. Used internally,
+ * for the results which are cached for the application.
+ */
+static dc_status_t
+parser_samples_foreach_all (dc_parser_t *parser, dc_sample_callback_t callback, void *userdata)
+{
+	unsigned int mask = parser->samplemask;
+
+	parser->samplemask = PARSER_SAMPLE_ALL;
+	dc_status_t status = parser->vtable->samples_foreach (parser, callback, userdata);
+	parser->samplemask = mask;
+
+	return status;
+}
+
+typedef struct sample_range_t {
+	unsigned int begin;
+	unsigned int end;
+	unsigned int keep;
+	dc_sample_callback_t callback;
+	void *userdata;
+} sample_range_t;
+
+static void
+sample_range_cb (dc_sample_type_t type, dc_sample_value_t value, void *userdata)
+{
+	sample_range_t *range = (sample_range_t *) userdata;
+
+	if (type == DC_SAMPLE_TIME)
+		range->keep = value.time >= range->begin && value.time <= range->end;
+
+	if (range->keep)
+		range->callback (type, value, range->userdata);
+}
+
+/*
+ * Build the index with the position of every time sample in the
+ * materialized samples, and locate the rows within the time range.
+ */
+static dc_status_t
+parser_samples_seek (dc_parser_t *parser, unsigned int begin, unsigned int end, size_t *first, size_t *last)
+{
+	const parser_sample_t *samples = (const parser_sample_t *) dc_buffer_get_data (parser->samples);
+	size_t nsamples = dc_buffer_get_size (parser->samples) / sizeof (parser_sample_t);
+
+	if (!parser->indexed) {
+		if (parser->rows == NULL) {
+			parser->rows = dc_buffer_new (0);
+			if (parser->rows == NULL) {
+				ERROR (parser->context, "Failed to allocate memory.");
+				return DC_STATUS_NOMEMORY;
+			}
+		}
+
+		dc_buffer_clear (parser->rows);
+		for (size_t i = 0; i < nsamples; ++i) {
+			if (samples[i].type != DC_SAMPLE_TIME)
+				continue;
+			if (!dc_buffer_append (parser->rows, (const unsigned char *) &i, sizeof (i))) {
+				ERROR (parser->context, "Failed to allocate memory.");
+				dc_buffer_clear (parser->rows);
+				return DC_STATUS_NOMEMORY;
+			}
+		}
+
+		parser->indexed = 1;
+	}
+
+	const size_t *rows = (const size_t *) dc_buffer_get_data (parser->rows);
+	size_t nrows = dc_buffer_get_size (parser->rows) / sizeof (size_t);
+
+	// Find the first row past the begin and end time.
+	size_t lo = 0, hi = nrows;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (samples[rows[mid]].value.time < begin)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	size_t a = lo;
+
+	hi = nrows;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (samples[rows[mid]].value.time <= end)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	size_t b = lo;
+
+	// The samples before the first row belong to time zero.
+	*first = (a == 0 && begin == 0) ? 0 : (a < nrows ? rows[a] : nsamples);
+	*last = b < nrows ? rows[b] : nsamples;
+	if (*last < *first)
+		*last = *first;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+parser_samples_dispatch (dc_parser_t *parser, unsigned int begin, unsigned int end, dc_sample_callback_t callback, void *userdata)
+{
+	if (parser == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (parser->vtable->samples_foreach == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+#ifdef ENABLE_PERF_STATS
+	// Count the samples passed to the application.
+	sample_count_t delivered = {0, callback, userdata};
+	if (callback) {
+		callback = sample_count_cb;
+		userdata = &delivered;
+	}
+#endif
+
+	// Backends that ignore the sample mask still emit everything, so the
+	// unwanted samples are dropped here.
+	sample_filter_t filter = {parser->samplemask, callback, userdata};
+	if (callback && parser->samplemask != PARSER_SAMPLE_ALL) {
+		callback = sample_filter_cb;
+		userdata = &filter;
+	}
+
+	sample_decimate_t decimate;
+	memset (&decimate, 0, sizeof (decimate));
+	if (callback && parser->decimation != DC_DECIMATION_NONE) {
+		decimate.type = parser->decimation;
+		decimate.value = parser->decimation_value;
+		decimate.callback = callback;
+		decimate.userdata = userdata;
+		decimate.keep = 1;
+		decimate.buffer = parser->bucket;
+		dc_buffer_clear (parser->bucket);
+		callback = sample_decimate_cb;
+		userdata = &decimate;
+	}
+
+	unsigned int ranged = begin != 0 || end != UINT_MAX;
+
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (parser->materialized) {
+		// Replay the materialized samples.
+		const parser_sample_t *samples = (const parser_sample_t *) dc_buffer_get_data (parser->samples);
+		size_t first = 0, last = dc_buffer_get_size (parser->samples) / sizeof (parser_sample_t);
+		if (ranged) {
+			status = parser_samples_seek (parser, begin, end, &first, &last);
+			if (status != DC_STATUS_SUCCESS)
+				return status;
+		}
+		for (size_t i = first; i < last; ++i) {
+			if (callback) callback (samples[i].type, samples[i].value, userdata);
+		}
+	} else {
+		// Without an index, the entire profile is decoded, but only the
+		// rows within the time range are passed.
+		sample_range_t range = {begin, end, begin == 0, callback, userdata};
+		if (callback && ranged) {
+			callback = sample_range_cb;
+			userdata = &range;
+		}
+#ifdef ENABLE_PERF_STATS
+		// Count the samples decoded by the backend.
+		sample_count_t emitted = {1, callback, userdata};
+		if (callback) {
+			callback = sample_count_cb;
+			userdata = &emitted;
+		}
+#endif
+		status = parser->vtable->samples_foreach (parser, callback, userdata);
+	}
+
+	if (decimate.type == DC_DECIMATION_MINMAX) {
+		if (status == DC_STATUS_SUCCESS)
+			sample_decimate_flush (&decimate);
+		dc_buffer_clear (parser->bucket);
+		if (status == DC_STATUS_SUCCESS && decimate.error) {
+			ERROR (parser->context, "Failed to allocate memory.");
+			status = DC_STATUS_NOMEMORY;
+		}
+	}
+
+	return status;
+}
 
 dc_status_t
 dc_parser_samples_foreach (dc_parser_t *parser, dc_sample_callback_t callback, void *userdata)
+{
+	TRACEPOINT1 (parser__samples__start, dc_parser_get_type (parser));
+
+	dc_status_t status = parser_samples_dispatch (parser, 0, UINT_MAX, callback, userdata);
+
+	TRACEPOINT2 (parser__samples__done, dc_parser_get_type (parser), status);
+
+	return status;
+}
+
+dc_status_t
+dc_parser_samples_range (dc_parser_t *parser, unsigned int begin, unsigned int end, dc_sample_callback_t callback, void *userdata)
+{
+	if (parser && begin > end)
+		return DC_STATUS_INVALIDARGS;
+
+	return parser_samples_dispatch (parser, begin, end, callback, userdata);
+}
+
+
+typedef struct sample_skip_t {
+	unsigned int skip;
+	unsigned int count;
+	dc_sample_callback_t callback;
+	void *userdata;
+} sample_skip_t;
+
+static void
+sample_skip_cb (dc_sample_type_t type, dc_sample_value_t value, void *userdata)
+{
+	sample_skip_t *skip = (sample_skip_t *) userdata;
+
+	if (skip->count++ < skip->skip)
+		return;
+
+	if (skip->callback)
+		skip->callback (type, value, skip->userdata);
+}
+
+dc_status_t
+dc_parser_append_data (dc_parser_t *parser, const unsigned char *data, unsigned int size, dc_sample_callback_t callback, void *userdata)
+{
+	if (parser == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (parser->vtable->set_data == NULL || parser->vtable->samples_foreach == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (size < parser->size)
+		return DC_STATUS_INVALIDARGS;
+
+	parser->data = data;
+	parser->size = size;
+	parser->statistics_cached = 0;
+	parser->summary_cached = 0;
+	parser->materialized = 0;
+	parser->indexed = 0;
+	dc_buffer_clear (parser->samples);
+
+	sample_filter_t filter = {parser->samplemask, callback, userdata};
+	if (callback && parser->samplemask != PARSER_SAMPLE_ALL) {
+		callback = sample_filter_cb;
+		userdata = &filter;
+	}
+
+	if (parser->vtable->samples_append)
+		return parser->vtable->samples_append (parser, callback, userdata);
+
+	// Without support in the backend, the entire profile is decoded
+	// again, and the samples that were already passed are skipped.
+	dc_status_t status = parser->vtable->set_data (parser, data, size);
+	if (status != DC_STATUS_SUCCESS)
+		return status;
+
+	sample_skip_t skip = {parser->appended, 0, callback, userdata};
+	status = parser_samples_foreach_all (parser, sample_skip_cb, &skip);
+	if (skip.count > parser->appended)
+		parser->appended = skip.count;
+
+	return status;
+}
+
+
+static void
+parser_count_cb (dc_sample_type_t type, dc_sample_value_t value, void *userdata)
+{
+	size_t *count = (size_t *) userdata;
+
+	(*count)++;
+}
+
+static void
+parser_materialize_cb (dc_sample_type_t type, dc_sample_value_t value, void *userdata)
+{
+	dc_buffer_t *samples = (dc_buffer_t *) userdata;
+
+	parser_sample_t sample;
+	sample.type = type;
+	sample.value = value;
+
+	// A failed append is detected afterwards from the size.
+	dc_buffer_append (samples, (const unsigned char *) &sample, sizeof (sample));
+}
+
+dc_status_t
+dc_parser_materialize (dc_parser_t *parser, size_t *memsize)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (parser == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (parser->vtable->samples_foreach == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (!parser->materialized) {
+		if (parser->samples == NULL) {
+			parser->samples = dc_buffer_new (0);
+			if (parser->samples == NULL) {
+				ERROR (parser->context, "Failed to allocate memory.");
+				return DC_STATUS_NOMEMORY;
+			}
+		}
+
+		// Count the samples first, to allocate the array only once.
+		size_t count = 0;
+		status = parser_samples_foreach_all (parser, parser_count_cb, &count);
+		if (status != DC_STATUS_SUCCESS)
+			return status;
+
+		dc_buffer_clear (parser->samples);
+		if (!dc_buffer_reserve (parser->samples, count * sizeof (parser_sample_t))) {
+			ERROR (parser->context, "Failed to allocate memory.");
+			return DC_STATUS_NOMEMORY;
+		}
+
+		status = parser_samples_foreach_all (parser, parser_materialize_cb, parser->samples);
+		if (status != DC_STATUS_SUCCESS) {
+			dc_buffer_clear (parser->samples);
+			return status;
+		}
+
+		if (dc_buffer_get_size (parser->samples) != count * sizeof (parser_sample_t)) {
+			ERROR (parser->context, "Failed to allocate memory.");
+			dc_buffer_clear (parser->samples);
+			return DC_STATUS_NOMEMORY;
+		}
+
+		parser->materialized = 1;
+	}
+
+	if (memsize)
+		*memsize = dc_buffer_get_size (parser->samples);
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+static int
+sample_batch_fixed (double value, double scale)
+{
+	if (!isfinite (value))
+		return 0;
+
+	return lround (value * scale);
+}
+
+typedef struct sample_batch_t {
+	dc_sample_batch_t *batch;
+	unsigned int offset;
+	unsigned int nsamples;
+	unsigned int row;
+} sample_batch_t;
+
+void
+sample_batch_clear (dc_sample_batch_t *batch, unsigned int row)
+{
+	if (batch->mask)
+		batch->mask[row] = 0;
+	if (batch->time)
+		batch->time[row] = 0;
+	if (batch->depth)
+		batch->depth[row] = 0.0;
+	if (batch->temperature)
+		batch->temperature[row] = 0.0;
+	if (batch->pressure) {
+		for (unsigned int i = 0; i < batch->ntanks; ++i)
+			batch->pressure[i * batch->capacity + row] = 0.0;
+	}
+	if (batch->ppo2)
+		batch->ppo2[row] = 0.0;
+	if (batch->setpoint)
+		batch->setpoint[row] = 0.0;
+	if (batch->cns)
+		batch->cns[row] = 0.0;
+	if (batch->rbt)
+		batch->rbt[row] = 0;
+	if (batch->heartbeat)
+		batch->heartbeat[row] = 0;
+	if (batch->bearing)
+		batch->bearing[row] = 0;
+	if (batch->gasmix)
+		batch->gasmix[row] = 0;
+	if (batch->deco_type)
+		batch->deco_type[row] = 0;
+	if (batch->deco_time)
+		batch->deco_time[row] = 0;
+	if (batch->deco_depth)
+		batch->deco_depth[row] = 0.0;
+	if (batch->tts)
+		batch->tts[row] = 0;
+	if (batch->depth_mm)
+		batch->depth_mm[row] = 0;
+	if (batch->temperature_mk)
+		batch->temperature_mk[row] = 0;
+	if (batch->pressure_mbar) {
+		for (unsigned int i = 0; i < batch->ntanks; ++i)
+			batch->pressure_mbar[i * batch->capacity + row] = 0;
+	}
+	if (batch->ppo2_mbar)
+		batch->ppo2_mbar[row] = 0;
+	if (batch->setpoint_mbar)
+		batch->setpoint_mbar[row] = 0;
+	if (batch->deco_depth_mm)
+		batch->deco_depth_mm[row] = 0;
+}
+
+static void
+sample_batch_cb (dc_sample_type_t type, dc_sample_value_t value, void *userdata)
+{
+	sample_batch_t *state = (sample_batch_t *) userdata;
+	dc_sample_batch_t *batch = state->batch;
+
+	// A time sample starts a new row.
+	if (type == DC_SAMPLE_TIME) {
+		state->nsamples++;
+		if (state->nsamples <= state->offset ||
+			state->nsamples > state->offset + batch->capacity)
+			return;
+
+		state->row = state->nsamples - state->offset - 1;
+		sample_batch_clear (batch, state->row);
+		batch->count = state->row + 1;
+	}
+
+	// Ignore samples outside the requested range.
+	if (state->nsamples <= state->offset ||
+		state->nsamples > state->offset + batch->capacity)
+		return;
+
+	unsigned int row = state->row;
+
+	switch (type) {
+	case DC_SAMPLE_TIME:
+		if (batch->time)
+			batch->time[row] = value.time;
+		break;
+	case DC_SAMPLE_DEPTH:
+		if (batch->depth)
+			batch->depth[row] = value.depth;
+		if (batch->depth_mm)
+			batch->depth_mm[row] = sample_batch_fixed (value.depth, 1000.0);
+		break;
+	case DC_SAMPLE_TEMPERATURE:
+		if (batch->temperature)
+			batch->temperature[row] = value.temperature;
+		if (batch->temperature_mk)
+			batch->temperature_mk[row] = sample_batch_fixed (value.temperature, 1000.0) + 273150;
+		break;
+	case DC_SAMPLE_PRESSURE:
+		if (batch->pressure && value.pressure.tank < batch->ntanks)
+			batch->pressure[value.pressure.tank * batch->capacity + row] = value.pressure.value;
+		if (batch->pressure_mbar && value.pressure.tank < batch->ntanks)
+			batch->pressure_mbar[value.pressure.tank * batch->capacity + row] = sample_batch_fixed (value.pressure.value, 1000.0);
+		break;
+	case DC_SAMPLE_PPO2:
+		if (batch->ppo2)
+			batch->ppo2[row] = value.ppo2;
+		if (batch->ppo2_mbar)
+			batch->ppo2_mbar[row] = sample_batch_fixed (value.ppo2, 1000.0);
+		break;
+	case DC_SAMPLE_SETPOINT:
+		if (batch->setpoint)
+			batch->setpoint[row] = value.setpoint;
+		if (batch->setpoint_mbar)
+			batch->setpoint_mbar[row] = sample_batch_fixed (value.setpoint, 1000.0);
+		break;
+	case DC_SAMPLE_CNS:
+		if (batch->cns)
+			batch->cns[row] = value.cns;
+		break;
+	case DC_SAMPLE_RBT:
+		if (batch->rbt)
+			batch->rbt[row] = value.rbt;
+		break;
+	case DC_SAMPLE_HEARTBEAT:
+		if (batch->heartbeat)
+			batch->heartbeat[row] = value.heartbeat;
+		break;
+	case DC_SAMPLE_BEARING:
+		if (batch->bearing)
+			batch->bearing[row] = value.bearing;
+		break;
+	case DC_SAMPLE_GASMIX:
+		if (batch->gasmix)
+			batch->gasmix[row] = value.gasmix;
+		break;
+	case DC_SAMPLE_DECO:
+		if (batch->deco_type)
+			batch->deco_type[row] = value.deco.type;
+		if (batch->deco_time)
+			batch->deco_time[row] = value.deco.time;
+		if (batch->deco_depth)
+			batch->deco_depth[row] = value.deco.depth;
+		if (batch->deco_depth_mm)
+			batch->deco_depth_mm[row] = sample_batch_fixed (value.deco.depth, 1000.0);
+		break;
+	case DC_SAMPLE_TTS:
+		if (batch->tts)
+			batch->tts[row] = value.time;
+		break;
+	default:
+		return;
+	}
+
+	if (batch->mask)
+		batch->mask[row] |= (1u << type);
+}
+
+dc_status_t
+dc_parser_samples_get_batch (dc_parser_t *parser, unsigned int offset, dc_sample_batch_t *batch)
 {
 	if (parser == NULL)
 		return DC_STATUS_UNSUPPORTED;
 
+	if (batch == NULL || (batch->pressure && batch->ntanks == 0))
+		return DC_STATUS_INVALIDARGS;
+
+	batch->count = 0;
+
+	if (batch->capacity == 0)
+		return DC_STATUS_SUCCESS;
+
+	if (parser->vtable->samples_batch)
+		return parser->vtable->samples_batch (parser, offset, batch);
+
+	// Generic fallback on top of the sample callback. The entire
+	// profile is traversed, but only the requested rows are stored.
 	if (parser->vtable->samples_foreach == NULL)
 		return DC_STATUS_UNSUPPORTED;
 
-	return parser->vtable->samples_foreach (parser, callback, userdata);
+	sample_batch_t state = {batch, offset, 0, 0};
+	return dc_parser_samples_foreach (parser, sample_batch_cb, &state);
+}
+
+
+dc_status_t
+dc_parser_verify (dc_parser_t *parser)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (parser == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (parser->data == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	unsigned int flags = parser->flags;
+	parser->flags &= ~DC_PARSER_FLAG_TRUSTED;
+
+	if (parser->vtable->verify)
+		status = parser->vtable->verify (parser);
+
+	// Decode all the samples directly, and not from the materialized
+	// copy, such that every check of the backend runs again.
+	if (status == DC_STATUS_SUCCESS && parser->vtable->samples_foreach)
+		status = parser_samples_foreach_all (parser, NULL, NULL);
+
+	parser->flags = flags;
+
+	return status;
 }
 
 
@@ -342,8 +1182,43 @@ sample_statistics_cb (dc_sample_type_t type, dc_sample_value_t value, void *user
 	case DC_SAMPLE_DEPTH:
 		if (statistics->maxdepth < value.depth)
 			statistics->maxdepth = value.depth;
+		statistics->ndepths++;
+		statistics->avgdepth += (value.depth - statistics->avgdepth) / statistics->ndepths;
+		break;
+	case DC_SAMPLE_TEMPERATURE:
+		if (statistics->ntemperatures == 0 || statistics->temperature_minimum > value.temperature)
+			statistics->temperature_minimum = value.temperature;
+		if (statistics->ntemperatures == 0 || statistics->temperature_maximum < value.temperature)
+			statistics->temperature_maximum = value.temperature;
+		statistics->ntemperatures++;
 		break;
 	default:
 		break;
 	}
 }
+
+
+dc_status_t
+parser_get_statistics (dc_parser_t *parser, sample_statistics_t *statistics)
+{
+	if (parser == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (!parser->statistics_cached) {
+		if (parser->vtable->samples_foreach == NULL)
+			return DC_STATUS_UNSUPPORTED;
+
+		sample_statistics_t result = SAMPLE_STATISTICS_INITIALIZER;
+		dc_status_t rc = parser_samples_foreach_all (parser, sample_statistics_cb, &result);
+		if (rc != DC_STATUS_SUCCESS)
+			return rc;
+
+		parser->statistics = result;
+		parser->statistics_cached = 1;
+	}
+
+	if (statistics)
+		*statistics = parser->statistics;
+
+	return DC_STATUS_SUCCESS;
+}
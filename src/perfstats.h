@@ -0,0 +1,55 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_PERFSTATS_H
+#define DC_PERFSTATS_H
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <libdivecomputer/context.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * Hot path counters. Without the --enable-perf-stats build option, the
+ * macro compiles to nothing, and the arguments are not evaluated.
+ */
+#ifdef ENABLE_PERF_STATS
+#define PERFSTATS_ENABLED 1
+extern dc_context_stats_t g_perfstats;
+#if defined(__GNUC__)
+#define PERFSTATS_ADD(counter, value) ((void) __atomic_fetch_add (&g_perfstats.counter, (value), __ATOMIC_RELAXED))
+#else
+#define PERFSTATS_ADD(counter, value) ((void) (g_perfstats.counter += (value)))
+#endif
+#else
+#define PERFSTATS_ENABLED 0
+#define PERFSTATS_ADD(counter, value) ((void) 0)
+#endif
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_PERFSTATS_H */
@@ -0,0 +1,223 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "pool.h"
+#include "context-private.h"
+
+#define BLOCKSIZE 1024
+#define ALIGNMENT sizeof(void *)
+
+// Number of interned strings, above which trimming drops them all.
+#define STRPOOL_MAX 1024
+
+struct dc_pool_block_t {
+	dc_pool_block_t *next;
+	size_t size;
+	size_t used;
+	unsigned char data[];
+};
+
+struct dc_strpool_entry_t {
+	dc_strpool_entry_t *next;
+	unsigned int hash;
+	size_t size;
+	char value[];
+};
+
+void
+dc_pool_init (dc_pool_t *pool, dc_context_t *context)
+{
+	if (pool == NULL)
+		return;
+
+	pool->context = context;
+	pool->head = NULL;
+	pool->current = NULL;
+}
+
+void
+dc_pool_reset (dc_pool_t *pool)
+{
+	if (pool == NULL)
+		return;
+
+	for (dc_pool_block_t *block = pool->head; block; block = block->next) {
+		block->used = 0;
+	}
+
+	pool->current = pool->head;
+}
+
+void
+dc_pool_cleanup (dc_pool_t *pool)
+{
+	if (pool == NULL)
+		return;
+
+	dc_pool_block_t *block = pool->head;
+	while (block) {
+		dc_pool_block_t *next = block->next;
+		dc_free (pool->context, block);
+		block = next;
+	}
+
+	pool->head = NULL;
+	pool->current = NULL;
+}
+
+void *
+dc_pool_alloc (dc_pool_t *pool, size_t size)
+{
+	if (pool == NULL)
+		return NULL;
+
+	// Round up to keep the allocations aligned.
+	size = (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+
+	// Find a block with enough free space, starting from the current
+	// one. Blocks are reused in the same order after a reset.
+	dc_pool_block_t *block = pool->current;
+	while (block && block->size - block->used < size) {
+		block = block->next;
+	}
+
+	if (block == NULL) {
+		size_t blocksize = size > BLOCKSIZE ? size : BLOCKSIZE;
+
+		block = (dc_pool_block_t *) dc_malloc (pool->context, sizeof (dc_pool_block_t) + blocksize);
+		if (block == NULL)
+			return NULL;
+
+		block->size = blocksize;
+		block->used = 0;
+
+		// Insert the new block after the current one, to keep the
+		// blocks that are already in use in front of it.
+		if (pool->current) {
+			block->next = pool->current->next;
+			pool->current->next = block;
+		} else {
+			block->next = pool->head;
+			pool->head = block;
+		}
+	}
+
+	void *p = block->data + block->used;
+	block->used += size;
+	pool->current = block;
+
+	return p;
+}
+
+char *
+dc_pool_strndup (dc_pool_t *pool, const char *str, size_t size)
+{
+	if (str == NULL)
+		return NULL;
+
+	char *p = (char *) dc_pool_alloc (pool, size + 1);
+	if (p == NULL)
+		return NULL;
+
+	memcpy (p, str, size);
+	p[size] = 0;
+
+	return p;
+}
+
+char *
+dc_pool_strdup (dc_pool_t *pool, const char *str)
+{
+	if (str == NULL)
+		return NULL;
+
+	return dc_pool_strndup (pool, str, strlen (str));
+}
+
+void
+dc_strpool_init (dc_strpool_t *strpool, dc_context_t *context)
+{
+	if (strpool == NULL)
+		return;
+
+	dc_pool_init (&strpool->pool, context);
+	memset (strpool->buckets, 0, sizeof (strpool->buckets));
+	strpool->count = 0;
+}
+
+void
+dc_strpool_trim (dc_strpool_t *strpool)
+{
+	if (strpool == NULL || strpool->count <= STRPOOL_MAX)
+		return;
+
+	dc_pool_reset (&strpool->pool);
+	memset (strpool->buckets, 0, sizeof (strpool->buckets));
+	strpool->count = 0;
+}
+
+void
+dc_strpool_cleanup (dc_strpool_t *strpool)
+{
+	if (strpool == NULL)
+		return;
+
+	dc_pool_cleanup (&strpool->pool);
+	memset (strpool->buckets, 0, sizeof (strpool->buckets));
+	strpool->count = 0;
+}
+
+const char *
+dc_strpool_intern (dc_strpool_t *strpool, const char *str)
+{
+	if (strpool == NULL || str == NULL)
+		return NULL;
+
+	// FNV-1a
+	unsigned int hash = 2166136261u;
+	size_t size = 0;
+	while (str[size]) {
+		hash ^= (unsigned char) str[size++];
+		hash *= 16777619u;
+	}
+
+	dc_strpool_entry_t **bucket = strpool->buckets + hash % DC_STRPOOL_BUCKETS;
+	for (dc_strpool_entry_t *entry = *bucket; entry; entry = entry->next) {
+		if (entry->hash == hash && entry->size == size && memcmp (entry->value, str, size) == 0)
+			return entry->value;
+	}
+
+	dc_strpool_entry_t *entry = (dc_strpool_entry_t *) dc_pool_alloc (&strpool->pool, sizeof (dc_strpool_entry_t) + size + 1);
+	if (entry == NULL)
+		return NULL;
+
+	entry->hash = hash;
+	entry->size = size;
+	memcpy (entry->value, str, size + 1);
+	entry->next = *bucket;
+	*bucket = entry;
+	strpool->count++;
+
+	return entry->value;
+}
@@ -0,0 +1,103 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_POOL_H
+#define DC_POOL_H
+
+#include <stddef.h>
+
+#include <libdivecomputer/context.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+typedef struct dc_pool_block_t dc_pool_block_t;
+
+/*
+ * A simple memory pool for small allocations that share the same
+ * lifetime, like the strings of a parser field cache. Memory is
+ * allocated in blocks, which are never moved, and thus all pointers
+ * remain valid until the pool is reset or freed. Resetting the pool
+ * invalidates the contents, but keeps the blocks for reuse, such that
+ * in the steady state no further memory allocations are needed. The
+ * blocks are obtained from the allocator of the context.
+ */
+typedef struct dc_pool_t {
+	dc_context_t *context;
+	dc_pool_block_t *head;
+	dc_pool_block_t *current;
+} dc_pool_t;
+
+#define DC_POOL_INITIALIZER {NULL, NULL, NULL}
+
+void
+dc_pool_init (dc_pool_t *pool, dc_context_t *context);
+
+void
+dc_pool_reset (dc_pool_t *pool);
+
+void
+dc_pool_cleanup (dc_pool_t *pool);
+
+void *
+dc_pool_alloc (dc_pool_t *pool, size_t size);
+
+char *
+dc_pool_strndup (dc_pool_t *pool, const char *str, size_t size);
+
+char *
+dc_pool_strdup (dc_pool_t *pool, const char *str);
+
+typedef struct dc_strpool_entry_t dc_strpool_entry_t;
+
+#define DC_STRPOOL_BUCKETS 64
+
+/*
+ * A pool of interned strings, for the string fields of a parser. Each
+ * distinct string is stored only once, and interning the same value
+ * again (e.g. the serial number of the next dive) returns the same
+ * pointer without any new allocation. Unlike a plain pool, the strings
+ * are kept across dives, and only dropped once there are too many of
+ * them, when the pool is trimmed.
+ */
+typedef struct dc_strpool_t {
+	dc_pool_t pool;
+	dc_strpool_entry_t *buckets[DC_STRPOOL_BUCKETS];
+	unsigned int count;
+} dc_strpool_t;
+
+void
+dc_strpool_init (dc_strpool_t *strpool, dc_context_t *context);
+
+void
+dc_strpool_trim (dc_strpool_t *strpool);
+
+void
+dc_strpool_cleanup (dc_strpool_t *strpool);
+
+const char *
+dc_strpool_intern (dc_strpool_t *strpool, const char *str);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_POOL_H */
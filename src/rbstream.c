@@ -23,11 +23,14 @@
 #include <string.h>
 
 #include "rbstream.h"
+#include "ringbuffer.h"
 #include "context-private.h"
 #include "device-private.h"
+#include "tracepoint.h"
 
 struct dc_rbstream_t {
 	dc_device_t *device;
+	dc_rbstream_direction_t direction;
 	unsigned int pagesize;
 	unsigned int packetsize;
 	unsigned int begin;
@@ -35,7 +38,10 @@ struct dc_rbstream_t {
 	unsigned int address;
 	unsigned int available;
 	unsigned int skip;
-	unsigned char cache[];
+	unsigned int readahead;
+	unsigned int maxsize;
+	unsigned int cached;
+	unsigned char *cache;
 };
 
 static unsigned int
@@ -53,7 +59,7 @@ iceil (unsigned int x, unsigned int n)
 }
 
 dc_status_t
-dc_rbstream_new (dc_rbstream_t **out, dc_device_t *device, unsigned int pagesize, unsigned int packetsize, unsigned int begin, unsigned int end, unsigned int address)
+dc_rbstream_new (dc_rbstream_t **out, dc_device_t *device, unsigned int pagesize, unsigned int packetsize, unsigned int begin, unsigned int end, unsigned int address, dc_rbstream_direction_t direction)
 {
 	dc_rbstream_t *rbstream = NULL;
 
@@ -84,21 +90,42 @@ dc_rbstream_new (dc_rbstream_t **out, dc_device_t *device, unsigned int pagesize
 		return DC_STATUS_INVALIDARGS;
 	}
 
+	if (direction != DC_RBSTREAM_FORWARD && direction != DC_RBSTREAM_BACKWARD) {
+		ERROR (device->context, "Invalid direction!");
+		return DC_STATUS_INVALIDARGS;
+	}
+
 	// Allocate memory.
-	rbstream = (dc_rbstream_t *) malloc (sizeof(*rbstream) + packetsize);
+	rbstream = (dc_rbstream_t *) malloc (sizeof(*rbstream));
 	if (rbstream == NULL) {
 		ERROR (device->context, "Failed to allocate memory.");
 		return DC_STATUS_NOMEMORY;
 	}
 
+	rbstream->cache = (unsigned char *) malloc (packetsize);
+	if (rbstream->cache == NULL) {
+		ERROR (device->context, "Failed to allocate memory.");
+		free (rbstream);
+		return DC_STATUS_NOMEMORY;
+	}
+
 	rbstream->device = device;
+	rbstream->direction = direction;
 	rbstream->pagesize = pagesize;
 	rbstream->packetsize = packetsize;
 	rbstream->begin = begin;
 	rbstream->end = end;
-	rbstream->address = iceil(address, pagesize);
+	if (direction == DC_RBSTREAM_FORWARD) {
+		rbstream->address = ifloor(address, pagesize);
+		rbstream->skip = address - rbstream->address;
+	} else {
+		rbstream->address = iceil(address, pagesize);
+		rbstream->skip = rbstream->address - address;
+	}
 	rbstream->available = 0;
-	rbstream->skip = rbstream->address - address;
+	rbstream->readahead = packetsize;
+	rbstream->maxsize = packetsize;
+	rbstream->cached = 0;
 
 	*out = rbstream;
 
@@ -106,13 +133,120 @@ dc_rbstream_new (dc_rbstream_t **out, dc_device_t *device, unsigned int pagesize
 }
 
 dc_status_t
-dc_rbstream_read (dc_rbstream_t *rbstream, dc_event_progress_t *progress, unsigned char data[], unsigned int size)
+dc_rbstream_set_maxsize (dc_rbstream_t *rbstream, unsigned int maxsize)
 {
-	dc_status_t rc = DC_STATUS_SUCCESS;
-
 	if (rbstream == NULL)
 		return DC_STATUS_INVALIDARGS;
 
+	// Maximum size should be a multiple of the packet size.
+	if (maxsize < rbstream->packetsize || maxsize % rbstream->packetsize != 0) {
+		ERROR (rbstream->device->context, "Maximum size not a multiple of the packet size!");
+		return DC_STATUS_INVALIDARGS;
+	}
+
+	unsigned char *cache = (unsigned char *) realloc (rbstream->cache, maxsize);
+	if (cache == NULL) {
+		ERROR (rbstream->device->context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	rbstream->cache = cache;
+	rbstream->maxsize = maxsize;
+	if (rbstream->readahead > maxsize)
+		rbstream->readahead = maxsize;
+
+	return DC_STATUS_SUCCESS;
+}
+
+/*
+ * Double the amount of read-ahead on every refill, until the maximum
+ * size supported by the backend is reached. Short downloads stay cheap,
+ * long ones need fewer round trips.
+ */
+static void
+dc_rbstream_grow (dc_rbstream_t *rbstream)
+{
+	if (rbstream->readahead < rbstream->maxsize) {
+		rbstream->readahead *= 2;
+		if (rbstream->readahead > rbstream->maxsize)
+			rbstream->readahead = rbstream->maxsize;
+	}
+}
+
+static dc_status_t
+dc_rbstream_read_forward (dc_rbstream_t *rbstream, dc_event_progress_t *progress, unsigned char data[], unsigned int size)
+{
+	dc_status_t rc = DC_STATUS_SUCCESS;
+
+	unsigned int address = rbstream->address;
+	unsigned int available = rbstream->available;
+	unsigned int skip = rbstream->skip;
+
+	unsigned int nbytes = 0;
+	while (nbytes < size) {
+		if (available == 0) {
+			// Handle the ringbuffer wrap point.
+			if (address == rbstream->end)
+				address = rbstream->begin;
+
+			// Calculate the packet size.
+			unsigned int len = rbstream->readahead;
+			if (address + len > rbstream->end)
+				len = rbstream->end - address;
+
+			// A short packet at the wrap point is extended backwards, to
+			// read a full packet without crossing the end.
+			unsigned int extra = 0;
+			if (len < rbstream->packetsize) {
+				extra = rbstream->packetsize - len;
+				if (extra > address - rbstream->begin)
+					extra = address - rbstream->begin;
+			}
+
+			// Read the packet into the cache.
+			rc = dc_device_read (rbstream->device, address - extra, rbstream->cache, len + extra);
+			if (rc != DC_STATUS_SUCCESS)
+				return rc;
+
+			// Move to the end of the current packet.
+			address += len;
+
+			rbstream->cached = len + extra;
+			available = len - skip;
+			skip = 0;
+
+			dc_rbstream_grow (rbstream);
+		}
+
+		unsigned int length = available;
+		if (nbytes + length > size)
+			length = size - nbytes;
+
+		memcpy (data + nbytes, rbstream->cache + rbstream->cached - available, length);
+
+		available -= length;
+
+		// Update and emit a progress event.
+		if (progress) {
+			progress->current += length;
+			device_event_emit (rbstream->device, DC_EVENT_PROGRESS, progress);
+		}
+
+		nbytes += length;
+	}
+
+	rbstream->address = address;
+	rbstream->available = available;
+	rbstream->skip = skip;
+
+	return rc;
+}
+
+static dc_status_t
+dc_rbstream_read_backward (dc_rbstream_t *rbstream, dc_event_progress_t *progress, unsigned char data[], unsigned int size)
+{
+	dc_status_t rc = DC_STATUS_SUCCESS;
+
 	unsigned int address = rbstream->address;
 	unsigned int available = rbstream->available;
 	unsigned int skip = rbstream->skip;
@@ -126,7 +260,7 @@ dc_rbstream_read (dc_rbstream_t *rbstream, dc_event_progress_t *progress, unsign
 				address = rbstream->end;
 
 			// Calculate the packet size.
-			unsigned int len = rbstream->packetsize;
+			unsigned int len = rbstream->readahead;
 			if (rbstream->begin + len > address)
 				len = address - rbstream->begin;
 
@@ -134,12 +268,15 @@ dc_rbstream_read (dc_rbstream_t *rbstream, dc_event_progress_t *progress, unsign
 			address -= len;
 
 			// Read the packet into the cache.
-			rc = dc_device_read (rbstream->device, address, rbstream->cache, rbstream->packetsize);
+			rc = dc_device_read (rbstream->device, address, rbstream->cache,
+				len > rbstream->packetsize ? len : rbstream->packetsize);
 			if (rc != DC_STATUS_SUCCESS)
 				return rc;
 
 			available = len - skip;
 			skip = 0;
+
+			dc_rbstream_grow (rbstream);
 		}
 
 		unsigned int length = available;
@@ -167,9 +304,255 @@ dc_rbstream_read (dc_rbstream_t *rbstream, dc_event_progress_t *progress, unsign
 	return rc;
 }
 
+dc_status_t
+dc_rbstream_read (dc_rbstream_t *rbstream, dc_event_progress_t *progress, unsigned char data[], unsigned int size)
+{
+	if (rbstream == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	TRACEPOINT2 (rbstream__read__start, rbstream->address, size);
+
+	dc_status_t status = DC_STATUS_SUCCESS;
+	if (rbstream->direction == DC_RBSTREAM_FORWARD)
+		status = dc_rbstream_read_forward (rbstream, progress, data, size);
+	else
+		status = dc_rbstream_read_backward (rbstream, progress, data, size);
+
+	TRACEPOINT3 (rbstream__read__done, rbstream->address, size, status);
+
+	return status;
+}
+
+dc_status_t
+dc_rbstream_skip (dc_rbstream_t *rbstream, dc_event_progress_t *progress, unsigned int size)
+{
+	if (rbstream == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	// Discard the cached data first.
+	unsigned int length = rbstream->available;
+	if (length > size)
+		length = size;
+
+	rbstream->available -= length;
+
+	// Move the current position backwards, without reading the data. An
+	// unaligned position is handled the same way as an unaligned start
+	// address, by skipping the excess bytes of the next packet.
+	unsigned int nbytes = size - length;
+	if (nbytes && rbstream->direction == DC_RBSTREAM_FORWARD) {
+		unsigned int position = rbstream->address + rbstream->skip;
+		while (nbytes) {
+			// Handle the ringbuffer wrap point.
+			if (position == rbstream->end)
+				position = rbstream->begin;
+
+			unsigned int n = rbstream->end - position;
+			if (n > nbytes)
+				n = nbytes;
+
+			position += n;
+			nbytes -= n;
+		}
+
+		rbstream->address = ifloor (position, rbstream->pagesize);
+		rbstream->skip = position - rbstream->address;
+	} else if (nbytes) {
+		unsigned int position = rbstream->address - rbstream->skip;
+		while (nbytes) {
+			// Handle the ringbuffer wrap point.
+			if (position == rbstream->begin)
+				position = rbstream->end;
+
+			unsigned int n = position - rbstream->begin;
+			if (n > nbytes)
+				n = nbytes;
+
+			position -= n;
+			nbytes -= n;
+		}
+
+		rbstream->address = iceil (position, rbstream->pagesize);
+		rbstream->skip = rbstream->address - position;
+	}
+
+	// Update and emit a progress event.
+	if (progress) {
+		progress->current += size;
+		device_event_emit (rbstream->device, DC_EVENT_PROGRESS, progress);
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+static int
+dc_rbstream_span_cmp (const void *a, const void *b)
+{
+	const ringbuffer_span_t *span_a = (const ringbuffer_span_t *) a;
+	const ringbuffer_span_t *span_b = (const ringbuffer_span_t *) b;
+
+	if (span_a->address < span_b->address)
+		return -1;
+	if (span_a->address > span_b->address)
+		return 1;
+	return 0;
+}
+
+dc_status_t
+dc_rbstream_read_extents (dc_rbstream_t *rbstream, dc_event_progress_t *progress, dc_rbstream_extent_t extents[], unsigned int count, dc_buffer_t *buffer)
+{
+	dc_status_t rc = DC_STATUS_SUCCESS;
+
+	if (rbstream == NULL || (count && extents == NULL) || buffer == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	unsigned int begin = rbstream->begin;
+	unsigned int end = rbstream->end;
+
+	ringbuffer_span_t *spans = (ringbuffer_span_t *) malloc ((2 * count + 1) * sizeof (ringbuffer_span_t));
+	if (spans == NULL) {
+		ERROR (rbstream->device->context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	// Split the ranges into contiguous spans, aligned to the page size.
+	// The linearized copies of the wrapped ranges are stored after the
+	// data of the spans.
+	unsigned int nspans = 0;
+	unsigned int wrapped = 0;
+	for (unsigned int i = 0; i < count; ++i) {
+		extents[i].data = NULL;
+
+		if (extents[i].size == 0)
+			continue;
+
+		if (extents[i].address < begin || extents[i].address >= end ||
+			extents[i].size > end - begin) {
+			ERROR (rbstream->device->context, "Range outside the ringbuffer (0x%08x %u).",
+				extents[i].address, extents[i].size);
+			free (spans);
+			return DC_STATUS_INVALIDARGS;
+		}
+
+		unsigned int last = ringbuffer_increment (extents[i].address, extents[i].size, begin, end);
+		unsigned int n = ringbuffer_span (extents[i].address, last, 1, begin, end, spans + nspans);
+		for (unsigned int j = nspans; j < nspans + n; ++j) {
+			unsigned int first = ifloor (spans[j].address, rbstream->pagesize);
+			spans[j].size = iceil (spans[j].address + spans[j].size, rbstream->pagesize) - first;
+			spans[j].address = first;
+		}
+
+		if (n > 1)
+			wrapped += extents[i].size;
+
+		nspans += n;
+	}
+
+	// Merge the overlapping spans, and the spans separated by less than
+	// a packet, because that costs less than an extra request.
+	qsort (spans, nspans, sizeof (ringbuffer_span_t), dc_rbstream_span_cmp);
+
+	unsigned int nmerged = 0;
+	unsigned int total = 0;
+	for (unsigned int i = 0; i < nspans; ++i) {
+		if (nmerged) {
+			ringbuffer_span_t *previous = spans + nmerged - 1;
+			unsigned int last = previous->address + previous->size;
+			if (spans[i].address <= last + rbstream->packetsize) {
+				unsigned int next = spans[i].address + spans[i].size;
+				if (next > last) {
+					total += next - last;
+					previous->size = next - previous->address;
+				}
+				continue;
+			}
+		}
+
+		spans[nmerged++] = spans[i];
+		total += spans[i].size;
+	}
+
+	if (!dc_buffer_clear (buffer) || !dc_buffer_resize (buffer, total + wrapped)) {
+		ERROR (rbstream->device->context, "Insufficient buffer space available.");
+		free (spans);
+		return DC_STATUS_NOMEMORY;
+	}
+
+	unsigned char *data = dc_buffer_get_data (buffer);
+
+	// Read the merged spans, with requests of the maximum size.
+	unsigned int offset = 0;
+	for (unsigned int i = 0; i < nmerged; ++i) {
+		unsigned int nbytes = 0;
+		while (nbytes < spans[i].size) {
+			unsigned int len = spans[i].size - nbytes;
+			if (len > rbstream->maxsize)
+				len = rbstream->maxsize;
+
+			rc = dc_device_read (rbstream->device, spans[i].address + nbytes, data + offset + nbytes, len);
+			if (rc != DC_STATUS_SUCCESS) {
+				free (spans);
+				return rc;
+			}
+
+			// Update and emit a progress event.
+			if (progress) {
+				progress->current += len;
+				device_event_emit (rbstream->device, DC_EVENT_PROGRESS, progress);
+			}
+
+			nbytes += len;
+		}
+
+		offset += spans[i].size;
+	}
+
+	// Locate the data of each range. The wrapped ranges are copied.
+	unsigned int tail = total;
+	for (unsigned int i = 0; i < count; ++i) {
+		if (extents[i].size == 0)
+			continue;
+
+		ringbuffer_span_t parts[2];
+		unsigned int last = ringbuffer_increment (extents[i].address, extents[i].size, begin, end);
+		unsigned int nparts = ringbuffer_span (extents[i].address, last, 1, begin, end, parts);
+
+		unsigned char *copy = data + tail;
+		for (unsigned int j = 0; j < nparts; ++j) {
+			// Find the merged span containing the part.
+			const unsigned char *p = data;
+			for (unsigned int k = 0; k < nmerged; ++k) {
+				if (parts[j].address < spans[k].address + spans[k].size) {
+					p += parts[j].address - spans[k].address;
+					break;
+				}
+				p += spans[k].size;
+			}
+
+			if (nparts == 1) {
+				extents[i].data = p;
+			} else {
+				memcpy (data + tail, p, parts[j].size);
+				tail += parts[j].size;
+			}
+		}
+
+		if (nparts > 1)
+			extents[i].data = copy;
+	}
+
+	free (spans);
+
+	return DC_STATUS_SUCCESS;
+}
+
 dc_status_t
 dc_rbstream_free (dc_rbstream_t *rbstream)
 {
+	if (rbstream == NULL)
+		return DC_STATUS_SUCCESS;
+
+	free (rbstream->cache);
 	free (rbstream);
 
 	return DC_STATUS_SUCCESS;
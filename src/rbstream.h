@@ -23,6 +23,7 @@
 #define DC_RBSTREAM_H
 
 #include <libdivecomputer/device.h>
+#include <libdivecomputer/buffer.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -33,6 +34,23 @@ extern "C" {
  */
 typedef struct dc_rbstream_t dc_rbstream_t;
 
+/**
+ * Direction of the ringbuffer stream.
+ */
+typedef enum dc_rbstream_direction_t {
+	DC_RBSTREAM_FORWARD,  /**< Towards the end, starting at the address. */
+	DC_RBSTREAM_BACKWARD, /**< Towards the begin, ending at the address. */
+} dc_rbstream_direction_t;
+
+/**
+ * A range of the ringbuffer for #dc_rbstream_read_extents.
+ */
+typedef struct dc_rbstream_extent_t {
+	unsigned int address;       /**< The start address (input). */
+	unsigned int size;          /**< The number of bytes, which may wrap around the end (input). */
+	const unsigned char *data;  /**< The location of the data (output). */
+} dc_rbstream_extent_t;
+
 /**
  * Create a new ringbuffer stream.
  *
@@ -43,15 +61,37 @@ typedef struct dc_rbstream_t dc_rbstream_t;
  * @param[in]   begin       The ringbuffer begin address.
  * @param[in]   end         The ringbuffer end address.
  * @param[in]   address     The stream start address.
+ * @param[in]   direction   The stream direction.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_rbstream_new (dc_rbstream_t **rbstream, dc_device_t *device, unsigned int pagesize, unsigned int packetsize, unsigned int begin, unsigned int end, unsigned int address, dc_rbstream_direction_t direction);
+
+/**
+ * Set the maximum amount of data to read ahead.
+ *
+ * By default, the ringbuffer stream reads a single packet at a time.
+ * With a larger maximum size, the amount of data requested with each
+ * read is doubled after every read, up to the maximum size. Backends
+ * should only use this if their read function can transfer the maximum
+ * size efficiently, preferably with a single request.
+ *
+ * @param[in]  rbstream  A valid ringbuffer stream.
+ * @param[in]  maxsize   The maximum read size in bytes (a multiple of
+ *                       the packet size).
  * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
  * on failure.
  */
 dc_status_t
-dc_rbstream_new (dc_rbstream_t **rbstream, dc_device_t *device, unsigned int pagesize, unsigned int packetsize, unsigned int begin, unsigned int end, unsigned int address);
+dc_rbstream_set_maxsize (dc_rbstream_t *rbstream, unsigned int maxsize);
 
 /**
  * Read data from the ringbuffer stream.
  *
+ * In the backward direction, the data is stored in the same order as in
+ * memory, and thus the buffer is filled from the end towards the start.
+ *
  * @param[in]  rbstream  A valid ringbuffer stream.
  * @param[in]  progress  An (optional) progress event structure.
  * @param[out] data      The memory buffer to read the data into.
@@ -62,6 +102,45 @@ dc_rbstream_new (dc_rbstream_t **rbstream, dc_device_t *device, unsigned int pag
 dc_status_t
 dc_rbstream_read (dc_rbstream_t *rbstream, dc_event_progress_t *progress, unsigned char data[], unsigned int size);
 
+/**
+ * Skip data in the ringbuffer stream.
+ *
+ * The data is skipped without reading it from the device, except for
+ * the part that is already cached. Packets which are only partially
+ * skipped are still read as a whole by the next read.
+ *
+ * @param[in]  rbstream  A valid ringbuffer stream.
+ * @param[in]  progress  An (optional) progress event structure.
+ * @param[in]  size      The number of bytes to skip.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_rbstream_skip (dc_rbstream_t *rbstream, dc_event_progress_t *progress, unsigned int size);
+
+/**
+ * Read a list of ranges from the ringbuffer.
+ *
+ * The ranges are read independently of the current stream position,
+ * with as few reads as possible: overlapping and nearby ranges are
+ * merged, and each merged range is read with requests of the maximum
+ * size. The data of all ranges ends up in the buffer, and the data
+ * pointer of each range points to its contiguous data in the buffer,
+ * also for a range that wraps around the end. The pointers remain
+ * valid until the buffer is modified. The ranges should preferably be
+ * sorted in the order the device reads most efficiently.
+ *
+ * @param[in]  rbstream  A valid ringbuffer stream.
+ * @param[in]  progress  An (optional) progress event structure.
+ * @param[in]  extents   The ranges to read.
+ * @param[in]  count     The number of ranges.
+ * @param[in]  buffer    The memory buffer to read the data into.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_rbstream_read_extents (dc_rbstream_t *rbstream, dc_event_progress_t *progress, dc_rbstream_extent_t extents[], unsigned int count, dc_buffer_t *buffer);
+
 /**
  * Destroy the ringbuffer stream.
  *
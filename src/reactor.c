@@ -0,0 +1,480 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#define LOG_SUBSYSTEM DC_LOGSUBSYSTEM_IOSTREAM
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+
+#if defined(HAVE_PTHREAD_H) && !defined(_WIN32)
+#define USE_REACTOR
+#endif
+
+#ifdef USE_REACTOR
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#endif
+
+#include "reactor.h"
+#include "context-private.h"
+#include "iostream-private.h"
+#include "timer.h"
+
+#ifdef USE_REACTOR
+
+typedef struct dc_reactor_op_t {
+	struct dc_reactor_op_t *next;
+	dc_iostream_t *iostream;
+	int fd;
+	int socket;
+	dc_direction_t direction;
+	unsigned char *data;
+	size_t size;
+	size_t nbytes;
+	int timeout;
+	dc_usecs_t deadline;
+	int cancelled;
+	int done;
+	dc_status_t status;
+	dc_iostream_callback_t callback;
+	void *userdata;
+} dc_reactor_op_t;
+
+typedef struct dc_reactor_t {
+	pthread_mutex_t lock;
+	pthread_cond_t idle;
+	pthread_t thread;
+	int started;
+	int wakeup[2];
+	dc_timer_t *timer;
+	// Pending transfers.
+	dc_reactor_op_t *ops;
+	// The I/O stream whose callback is currently running.
+	dc_iostream_t *busy;
+	// Poll descriptors (the first one is the wakeup pipe).
+	struct pollfd *pfds;
+	dc_reactor_op_t **pops;
+	size_t capacity;
+} dc_reactor_t;
+
+static dc_reactor_t g_reactor = {
+	PTHREAD_MUTEX_INITIALIZER,
+	PTHREAD_COND_INITIALIZER,
+};
+
+static dc_status_t
+dc_reactor_syserror (int errcode)
+{
+	switch (errcode) {
+	case EINVAL:
+		return DC_STATUS_INVALIDARGS;
+	case ENOMEM:
+		return DC_STATUS_NOMEMORY;
+	case ENOENT:
+	case ENODEV:
+		return DC_STATUS_NODEVICE;
+	case EACCES:
+	case EBUSY:
+		return DC_STATUS_NOACCESS;
+	default:
+		return DC_STATUS_IO;
+	}
+}
+
+static void
+dc_reactor_wakeup (dc_reactor_t *reactor)
+{
+	const unsigned char c = 0;
+	ssize_t n = write (reactor->wakeup[1], &c, 1);
+	(void) n; // A full pipe already guarantees a wakeup.
+}
+
+static void
+dc_reactor_transfer (dc_reactor_op_t *op)
+{
+	ssize_t n = 0;
+	void *data = op->data + op->nbytes;
+	size_t size = op->size - op->nbytes;
+
+	if (op->direction == DC_DIRECTION_INPUT) {
+		if (op->socket)
+			n = recv (op->fd, data, size, MSG_DONTWAIT);
+		else
+			n = read (op->fd, data, size);
+	} else {
+		if (op->socket)
+			n = send (op->fd, data, size, MSG_DONTWAIT);
+		else
+			n = write (op->fd, data, size);
+	}
+
+	if (n < 0) {
+		int errcode = errno;
+		if (errcode == EINTR || errcode == EAGAIN || errcode == EWOULDBLOCK)
+			return; // Retry.
+		SYSERROR (op->iostream->context, errcode);
+		op->status = dc_reactor_syserror (errcode);
+		op->done = 1;
+	} else if (n == 0) {
+		op->status = DC_STATUS_TIMEOUT; // EOF.
+		op->done = 1;
+	} else {
+		op->nbytes += n;
+		if (op->nbytes == op->size) {
+			op->status = DC_STATUS_SUCCESS;
+			op->done = 1;
+		}
+	}
+}
+
+static void
+dc_reactor_complete (dc_reactor_op_t *op)
+{
+	HEXDUMP (op->iostream->context, DC_LOGLEVEL_INFO,
+		op->direction == DC_DIRECTION_INPUT ? "Read" : "Write",
+		op->data, op->nbytes);
+
+	op->callback (op->iostream, op->status, op->nbytes, op->userdata);
+}
+
+static void *
+dc_reactor_run (void *arg)
+{
+	dc_reactor_t *reactor = (dc_reactor_t *) arg;
+
+	pthread_mutex_lock (&reactor->lock);
+
+	while (1) {
+		// Make sure the poll descriptor arrays are large enough.
+		size_t count = 1;
+		for (dc_reactor_op_t *op = reactor->ops; op; op = op->next)
+			count++;
+
+		if (count > reactor->capacity) {
+			struct pollfd *pfds = (struct pollfd *) realloc (reactor->pfds, count * sizeof (*pfds));
+			if (pfds)
+				reactor->pfds = pfds;
+			dc_reactor_op_t **pops = (dc_reactor_op_t **) realloc (reactor->pops, count * sizeof (*pops));
+			if (pops)
+				reactor->pops = pops;
+			if (pfds && pops)
+				reactor->capacity = count;
+		}
+
+		dc_usecs_t now = 0;
+		dc_timer_now (reactor->timer, &now);
+
+		// Collect the descriptors and the nearest deadline.
+		reactor->pfds[0].fd = reactor->wakeup[0];
+		reactor->pfds[0].events = POLLIN;
+		reactor->pfds[0].revents = 0;
+
+		int timeout = -1;
+		size_t npfds = 1;
+		for (dc_reactor_op_t *op = reactor->ops; op && npfds < reactor->capacity; op = op->next) {
+			if (op->cancelled) {
+				timeout = 0;
+			} else if (op->timeout >= 0) {
+				int remaining = op->deadline > now ? (int) ((op->deadline - now + 999) / 1000) : 0;
+				if (timeout < 0 || remaining < timeout)
+					timeout = remaining;
+			}
+
+			reactor->pfds[npfds].fd = op->fd;
+			reactor->pfds[npfds].events = op->direction == DC_DIRECTION_INPUT ? POLLIN : POLLOUT;
+			reactor->pfds[npfds].revents = 0;
+			reactor->pops[npfds] = op;
+			npfds++;
+		}
+
+		pthread_mutex_unlock (&reactor->lock);
+
+		int rc = poll (reactor->pfds, npfds, timeout);
+
+		pthread_mutex_lock (&reactor->lock);
+
+		if (rc < 0) {
+			// Retry on EINTR. Other errors can only be caused by the
+			// descriptors themselves, which are checked below.
+			if (errno == EINTR)
+				continue;
+		}
+
+		if (reactor->pfds[0].revents & POLLIN) {
+			unsigned char buffer[64];
+			while (read (reactor->wakeup[0], buffer, sizeof (buffer)) > 0);
+		}
+
+		dc_timer_now (reactor->timer, &now);
+
+		// Service the descriptors. The transfers registered during the
+		// poll are not in the array yet, and are picked up next time.
+		for (size_t i = 1; i < npfds; ++i) {
+			dc_reactor_op_t *op = reactor->pops[i];
+
+			if (op->cancelled) {
+				op->status = DC_STATUS_CANCELLED;
+				op->done = 1;
+				continue;
+			}
+
+			if (reactor->pfds[i].revents & POLLNVAL) {
+				op->status = DC_STATUS_IO;
+				op->done = 1;
+				continue;
+			}
+
+			if (reactor->pfds[i].revents)
+				dc_reactor_transfer (op);
+
+			if (!op->done && op->timeout >= 0 && now >= op->deadline) {
+				op->status = DC_STATUS_TIMEOUT;
+				op->done = 1;
+			}
+		}
+
+		// Remove the finished transfers from the list.
+		dc_reactor_op_t *completed = NULL, **last = &completed;
+		dc_reactor_op_t **p = &reactor->ops;
+		while (*p) {
+			dc_reactor_op_t *op = *p;
+			if (op->done) {
+				*p = op->next;
+				op->next = NULL;
+				*last = op;
+				last = &op->next;
+			} else {
+				p = &op->next;
+			}
+		}
+
+		// Invoke the callbacks, without holding the lock.
+		while (completed) {
+			dc_reactor_op_t *op = completed;
+			completed = op->next;
+
+			reactor->busy = op->iostream;
+			pthread_mutex_unlock (&reactor->lock);
+			dc_reactor_complete (op);
+			free (op);
+			pthread_mutex_lock (&reactor->lock);
+			reactor->busy = NULL;
+			pthread_cond_broadcast (&reactor->idle);
+		}
+	}
+
+	return NULL;
+}
+
+static dc_status_t
+dc_reactor_start (dc_reactor_t *reactor)
+{
+	if (reactor->started)
+		return DC_STATUS_SUCCESS;
+
+	if (dc_timer_new (&reactor->timer) != DC_STATUS_SUCCESS)
+		return DC_STATUS_IO;
+
+	if (pipe (reactor->wakeup) != 0) {
+		dc_timer_free (reactor->timer);
+		return DC_STATUS_IO;
+	}
+
+	fcntl (reactor->wakeup[0], F_SETFL, O_NONBLOCK);
+	fcntl (reactor->wakeup[1], F_SETFL, O_NONBLOCK);
+
+	reactor->capacity = 16;
+	reactor->pfds = (struct pollfd *) malloc (reactor->capacity * sizeof (*reactor->pfds));
+	reactor->pops = (dc_reactor_op_t **) malloc (reactor->capacity * sizeof (*reactor->pops));
+	if (reactor->pfds == NULL || reactor->pops == NULL)
+		goto error;
+
+	if (pthread_create (&reactor->thread, NULL, dc_reactor_run, reactor) != 0)
+		goto error;
+
+	pthread_detach (reactor->thread);
+	reactor->started = 1;
+
+	return DC_STATUS_SUCCESS;
+
+error:
+	free (reactor->pfds);
+	free (reactor->pops);
+	reactor->pfds = NULL;
+	reactor->pops = NULL;
+	reactor->capacity = 0;
+	close (reactor->wakeup[0]);
+	close (reactor->wakeup[1]);
+	dc_timer_free (reactor->timer);
+	return DC_STATUS_NOMEMORY;
+}
+
+#endif
+
+dc_status_t
+dc_reactor_submit (dc_iostream_t *iostream, int fd, int socket, dc_direction_t direction, void *data, size_t size, int timeout, dc_iostream_callback_t callback, void *userdata)
+{
+#ifdef USE_REACTOR
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_reactor_t *reactor = &g_reactor;
+
+	if (iostream == NULL || callback == NULL ||
+		(direction != DC_DIRECTION_INPUT && direction != DC_DIRECTION_OUTPUT))
+		return DC_STATUS_INVALIDARGS;
+
+	dc_reactor_op_t *op = (dc_reactor_op_t *) malloc (sizeof (*op));
+	if (op == NULL) {
+		ERROR (iostream->context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	op->next = NULL;
+	op->iostream = iostream;
+	op->fd = fd;
+	op->socket = socket;
+	op->direction = direction;
+	op->data = (unsigned char *) data;
+	op->size = size;
+	op->nbytes = 0;
+	op->timeout = timeout;
+	op->deadline = 0;
+	op->cancelled = 0;
+	op->done = 0;
+	op->status = DC_STATUS_SUCCESS;
+	op->callback = callback;
+	op->userdata = userdata;
+
+	pthread_mutex_lock (&reactor->lock);
+
+	status = dc_reactor_start (reactor);
+	if (status != DC_STATUS_SUCCESS) {
+		pthread_mutex_unlock (&reactor->lock);
+		ERROR (iostream->context, "Failed to start the I/O thread.");
+		free (op);
+		return status;
+	}
+
+	if (timeout >= 0) {
+		dc_timer_now (reactor->timer, &op->deadline);
+		op->deadline += (dc_usecs_t) timeout * 1000;
+	}
+
+	// Append to keep the transfers in submission order.
+	dc_reactor_op_t **p = &reactor->ops;
+	while (*p)
+		p = &(*p)->next;
+	*p = op;
+
+	dc_reactor_wakeup (reactor);
+
+	pthread_mutex_unlock (&reactor->lock);
+
+	return DC_STATUS_SUCCESS;
+#else
+	return DC_STATUS_UNSUPPORTED;
+#endif
+}
+
+dc_status_t
+dc_reactor_cancel (dc_iostream_t *iostream)
+{
+#ifdef USE_REACTOR
+	dc_reactor_t *reactor = &g_reactor;
+
+	if (iostream == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	pthread_mutex_lock (&reactor->lock);
+
+	if (!reactor->started) {
+		pthread_mutex_unlock (&reactor->lock);
+		return DC_STATUS_SUCCESS;
+	}
+
+	if (pthread_equal (pthread_self (), reactor->thread)) {
+		// Called from a callback. The I/O thread doesn't reference
+		// any transfer at this point, so they can be completed here.
+		dc_reactor_op_t *cancelled = NULL, **last = &cancelled;
+		dc_reactor_op_t **p = &reactor->ops;
+		while (*p) {
+			dc_reactor_op_t *op = *p;
+			if (op->iostream == iostream) {
+				*p = op->next;
+				op->next = NULL;
+				*last = op;
+				last = &op->next;
+			} else {
+				p = &op->next;
+			}
+		}
+
+		pthread_mutex_unlock (&reactor->lock);
+
+		while (cancelled) {
+			dc_reactor_op_t *op = cancelled;
+			cancelled = op->next;
+			op->status = DC_STATUS_CANCELLED;
+			dc_reactor_complete (op);
+			free (op);
+		}
+
+		return DC_STATUS_SUCCESS;
+	}
+
+	// Mark the transfers, and wait for the I/O thread to complete them.
+	int pending = 0;
+	for (dc_reactor_op_t *op = reactor->ops; op; op = op->next) {
+		if (op->iostream == iostream) {
+			op->cancelled = 1;
+			pending = 1;
+		}
+	}
+
+	if (pending)
+		dc_reactor_wakeup (reactor);
+
+	while (1) {
+		pending = reactor->busy == iostream;
+		for (dc_reactor_op_t *op = reactor->ops; op && !pending; op = op->next) {
+			if (op->iostream == iostream)
+				pending = 1;
+		}
+		if (!pending)
+			break;
+
+		pthread_cond_wait (&reactor->idle, &reactor->lock);
+	}
+
+	pthread_mutex_unlock (&reactor->lock);
+
+	return DC_STATUS_SUCCESS;
+#else
+	return DC_STATUS_SUCCESS;
+#endif
+}
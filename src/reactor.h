@@ -0,0 +1,75 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_REACTOR_H
+#define DC_REACTOR_H
+
+#include <libdivecomputer/iostream.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/**
+ * Submit an asynchronous transfer on a file descriptor.
+ *
+ * All transfers are serviced by a single background thread, which waits
+ * for every registered descriptor with poll() and invokes the completion
+ * callback from that thread. A read completes once all bytes have been
+ * received, and a write once all bytes have been handed to the driver.
+ * If the timeout (in milliseconds) expires first, the callback receives
+ * #DC_STATUS_TIMEOUT and the number of bytes transferred so far.
+ *
+ * @param[in]  iostream   The I/O stream which owns the descriptor.
+ * @param[in]  fd         A file descriptor in non-blocking mode, or a
+ *                        socket.
+ * @param[in]  socket     Non-zero for a socket descriptor.
+ * @param[in]  direction  Either #DC_DIRECTION_INPUT or #DC_DIRECTION_OUTPUT.
+ * @param[in]  data       The memory buffer, valid until the completion.
+ * @param[in]  size       The number of bytes to transfer.
+ * @param[in]  timeout    The timeout in milliseconds, or negative to wait
+ *                        forever.
+ * @param[in]  callback   The completion callback.
+ * @param[in]  userdata   Pointer to user data passed to the callback.
+ * @returns #DC_STATUS_SUCCESS on success, #DC_STATUS_UNSUPPORTED if the
+ * platform has no reactor, or another #dc_status_t code on failure.
+ */
+dc_status_t
+dc_reactor_submit (dc_iostream_t *iostream, int fd, int socket, dc_direction_t direction, void *data, size_t size, int timeout, dc_iostream_callback_t callback, void *userdata);
+
+/**
+ * Cancel all pending transfers of the I/O stream.
+ *
+ * The callbacks of the cancelled transfers receive #DC_STATUS_CANCELLED.
+ * When this function returns, no callback for the I/O stream is running
+ * anymore, unless it is called from such a callback itself.
+ *
+ * @param[in]  iostream  The I/O stream.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_reactor_cancel (dc_iostream_t *iostream);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_REACTOR_H */
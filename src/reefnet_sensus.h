@@ -38,6 +38,9 @@ reefnet_sensus_device_open (dc_device_t **device, dc_context_t *context, dc_iost
 dc_status_t
 reefnet_sensus_parser_create (dc_parser_t **parser, dc_context_t *context, unsigned int devtime, dc_ticks_t systime);
 
+dc_status_t
+reefnet_sensus_extract_dives (dc_device_t *device, const unsigned char data[], unsigned int size, dc_dive_callback_t callback, void *userdata);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
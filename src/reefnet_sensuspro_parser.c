@@ -19,6 +19,8 @@
  * MA 02110-1301 USA
  */
 
+#define LOG_SUBSYSTEM DC_LOGSUBSYSTEM_PARSER
+
 #include <stdlib.h>
 #include <string.h>	// memcmp
 
@@ -134,7 +136,7 @@ reefnet_sensuspro_parser_get_datetime (dc_parser_t *abstract, dc_datetime_t *dat
 
 	dc_ticks_t ticks = parser->systime - (parser->devtime - timestamp);
 
-	if (!dc_datetime_localtime (datetime, ticks))
+	if (!dc_context_localtime (abstract->context, datetime, ticks))
 		return DC_STATUS_DATAFORMAT;
 
 	return DC_STATUS_SUCCESS;
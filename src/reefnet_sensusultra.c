@@ -28,6 +28,7 @@
 #include "device-private.h"
 #include "checksum.h"
 #include "array.h"
+#include "buffered.h"
 
 #define ISINSTANCE(device) dc_device_isinstance((device), &reefnet_sensusultra_device_vtable)
 
@@ -36,6 +37,7 @@
 #define SZ_USER      16384
 #define SZ_HANDSHAKE 24
 #define SZ_SENSE     6
+#define SZ_FOREACH   (32 * SZ_PACKET)
 
 #define MAXRETRIES 2
 #define PROMPT 0xA5
@@ -45,6 +47,7 @@
 typedef struct reefnet_sensusultra_device_t {
 	dc_device_t base;
 	dc_iostream_t *iostream;
+	dc_iostream_t *buffered;
 	unsigned char handshake[SZ_HANDSHAKE];
 	unsigned int timestamp;
 	unsigned int devtime;
@@ -54,6 +57,7 @@ typedef struct reefnet_sensusultra_device_t {
 static dc_status_t reefnet_sensusultra_device_set_fingerprint (dc_device_t *abstract, const unsigned char data[], unsigned int size);
 static dc_status_t reefnet_sensusultra_device_dump (dc_device_t *abstract, dc_buffer_t *buffer);
 static dc_status_t reefnet_sensusultra_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, void *userdata);
+static dc_status_t reefnet_sensusultra_device_close (dc_device_t *abstract);
 
 static const dc_device_vtable_t reefnet_sensusultra_device_vtable = {
 	sizeof(reefnet_sensusultra_device_t),
@@ -64,7 +68,7 @@ static const dc_device_vtable_t reefnet_sensusultra_device_vtable = {
 	reefnet_sensusultra_device_dump, /* dump */
 	reefnet_sensusultra_device_foreach, /* foreach */
 	NULL, /* timesync */
-	NULL /* close */
+	reefnet_sensusultra_device_close /* close */
 };
 
 
@@ -86,11 +90,22 @@ reefnet_sensusultra_device_open (dc_device_t **out, dc_context_t *context, dc_io
 
 	// Set the default values.
 	device->iostream = iostream;
+	device->buffered = NULL;
 	device->timestamp = 0;
 	device->systime = (dc_ticks_t) -1;
 	device->devtime = 0;
 	memset (device->handshake, 0, sizeof (device->handshake));
 
+	// Buffer the small reads on the serial port.
+	if (dc_iostream_get_transport (iostream) == DC_TRANSPORT_SERIAL) {
+		status = dc_buffered_open (&device->buffered, context, iostream, 0);
+		if (status != DC_STATUS_SUCCESS) {
+			ERROR (context, "Failed to open the buffered I/O stream.");
+			goto error_free;
+		}
+		device->iostream = device->buffered;
+	}
+
 	// Set the serial communication protocol (115200 8N1).
 	status = dc_iostream_configure (device->iostream, 115200, 8, DC_PARITY_NONE, DC_STOPBITS_ONE, DC_FLOWCONTROL_NONE);
 	if (status != DC_STATUS_SUCCESS) {
@@ -113,11 +128,21 @@ reefnet_sensusultra_device_open (dc_device_t **out, dc_context_t *context, dc_io
 	return DC_STATUS_SUCCESS;
 
 error_free:
+	dc_iostream_close (device->buffered);
 	dc_device_deallocate ((dc_device_t *) device);
 	return status;
 }
 
 
+static dc_status_t
+reefnet_sensusultra_device_close (dc_device_t *abstract)
+{
+	reefnet_sensusultra_device_t *device = (reefnet_sensusultra_device_t *) abstract;
+
+	return dc_iostream_close (device->buffered);
+}
+
+
 dc_status_t
 reefnet_sensusultra_device_get_handshake (dc_device_t *abstract, unsigned char data[], unsigned int size)
 {
@@ -644,7 +669,11 @@ reefnet_sensusultra_device_foreach (dc_device_t *abstract, dc_dive_callback_t ca
 {
 	reefnet_sensusultra_device_t *device = (reefnet_sensusultra_device_t*) abstract;
 
-	dc_buffer_t *buffer = dc_buffer_new (SZ_MEMORY);
+	// The dives are parsed as the pages arrive, and the transfer stops at
+	// the first known dive. Because a routine download only needs the
+	// newest pages, the buffer starts small and grows on demand, instead
+	// of reserving the full memory size upfront.
+	dc_buffer_t *buffer = dc_buffer_new (SZ_FOREACH);
 	if (buffer == NULL) {
 		ERROR (abstract->context, "Failed to allocate memory.");
 		return DC_STATUS_NOMEMORY;
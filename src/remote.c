@@ -0,0 +1,785 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#define LOG_SUBSYSTEM DC_LOGSUBSYSTEM_IOSTREAM
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h> // malloc, free
+#include <string.h>
+#include <stdint.h> // SIZE_MAX
+
+#include <libdivecomputer/remote.h>
+#include <libdivecomputer/tcp.h>
+#include <libdivecomputer/buffer.h>
+
+#include "common-private.h"
+#include "context-private.h"
+#include "iostream-private.h"
+#include "array.h"
+
+#define ISINSTANCE(device) dc_iostream_isinstance((device), &dc_remote_vtable)
+
+/*
+ * Every request consists of a five byte header, with the command and
+ * the length of the payload, followed by the payload. Only the READ,
+ * AVAILABLE and LINES commands are answered by the server.
+ */
+#define CMD_TIMEOUT   0x01
+#define CMD_LATENCY   0x02
+#define CMD_BREAK     0x03
+#define CMD_DTR       0x04
+#define CMD_RTS       0x05
+#define CMD_CONFIGURE 0x06
+#define CMD_WRITE     0x07
+#define CMD_FLUSH     0x08
+#define CMD_PURGE     0x09
+#define CMD_SLEEP     0x0A
+#define CMD_READ      0x0B
+#define CMD_AVAILABLE 0x0C
+#define CMD_LINES     0x0D
+
+#define NSETTINGS  CMD_CONFIGURE
+#define SZ_SETTING 20
+
+#define SZ_HEADER 5
+#define SZ_REPLY  16
+#define SZ_HELLO  8
+
+#define MAGIC "DCR1"
+
+// Maximum size of the queued requests.
+#define MAXBATCH 16384
+
+// Maximum number of bytes returned in excess of a read request.
+#define MAXPREFETCH 4096
+
+// Maximum size of a single read request.
+#define MAXREAD (1024 * 1024)
+
+// Additional time to wait for the server, on top of the read timeout.
+#define MARGIN 30000
+
+typedef struct dc_remote_t {
+	dc_iostream_t base;
+	dc_iostream_t *connection;
+	/* Queued requests. */
+	dc_buffer_t *output;
+	size_t lastwrite;
+	/* Data received in excess of the read requests. */
+	dc_buffer_t *input;
+	size_t offset;
+	/* Last value of all settings. */
+	unsigned char settings[NSETTINGS][SZ_SETTING];
+	unsigned int valid;
+	int timeout;
+	int ctimeout;
+} dc_remote_t;
+
+static dc_status_t dc_remote_set_timeout (dc_iostream_t *iostream, int timeout);
+static dc_status_t dc_remote_set_latency (dc_iostream_t *iostream, unsigned int value);
+static dc_status_t dc_remote_set_break (dc_iostream_t *iostream, unsigned int value);
+static dc_status_t dc_remote_set_dtr (dc_iostream_t *iostream, unsigned int value);
+static dc_status_t dc_remote_set_rts (dc_iostream_t *iostream, unsigned int value);
+static dc_status_t dc_remote_get_lines (dc_iostream_t *iostream, unsigned int *value);
+static dc_status_t dc_remote_get_available (dc_iostream_t *iostream, size_t *value);
+static dc_status_t dc_remote_configure (dc_iostream_t *iostream, unsigned int baudrate, unsigned int databits, dc_parity_t parity, dc_stopbits_t stopbits, dc_flowcontrol_t flowcontrol);
+static dc_status_t dc_remote_read (dc_iostream_t *iostream, void *data, size_t size, size_t *actual);
+static dc_status_t dc_remote_write (dc_iostream_t *iostream, const void *data, size_t size, size_t *actual);
+static dc_status_t dc_remote_flush (dc_iostream_t *iostream);
+static dc_status_t dc_remote_purge (dc_iostream_t *iostream, dc_direction_t direction);
+static dc_status_t dc_remote_sleep (dc_iostream_t *iostream, unsigned int milliseconds);
+static dc_status_t dc_remote_close (dc_iostream_t *iostream);
+static dc_status_t dc_remote_interrupt (dc_iostream_t *iostream);
+
+static const dc_iostream_vtable_t dc_remote_vtable = {
+	sizeof(dc_remote_t),
+	dc_remote_set_timeout, /* set_timeout */
+	dc_remote_set_latency, /* set_latency */
+	dc_remote_set_break, /* set_break */
+	dc_remote_set_dtr, /* set_dtr */
+	dc_remote_set_rts, /* set_rts */
+	dc_remote_get_lines, /* get_lines */
+	dc_remote_get_available, /* get_available */
+	dc_remote_configure, /* configure */
+	dc_remote_read, /* read */
+	dc_remote_write, /* write */
+	dc_remote_flush, /* flush */
+	dc_remote_purge, /* purge */
+	dc_remote_sleep, /* sleep */
+	dc_remote_close, /* close */
+	NULL, /* get_name */
+	NULL, /* read_async */
+	NULL, /* write_async */
+	NULL, /* cancel */
+	NULL, /* readv */
+	NULL, /* writev */
+	dc_remote_interrupt, /* interrupt */	NULL, /* wait_readable */
+};
+
+dc_status_t
+dc_remote_open (dc_iostream_t **out, dc_context_t *context, const char *hostname, unsigned int port)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_iostream_t *connection = NULL;
+	dc_remote_t *device = NULL;
+
+	if (out == NULL || hostname == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	INFO (context, "Open: hostname=%s, port=%u", hostname, port);
+
+	// Connect to the server.
+	status = dc_tcp_open (&connection, context, hostname, port);
+	if (status != DC_STATUS_SUCCESS) {
+		return status;
+	}
+
+	// Receive the greeting with the transport type.
+	unsigned char hello[SZ_HELLO] = {0};
+	dc_iostream_set_timeout (connection, MARGIN);
+	status = dc_iostream_read (connection, hello, sizeof (hello), NULL);
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR (context, "Failed to receive the greeting.");
+		goto error_close;
+	}
+
+	if (memcmp (hello, MAGIC, 4) != 0) {
+		ERROR (context, "Unexpected greeting.");
+		status = DC_STATUS_PROTOCOL;
+		goto error_close;
+	}
+
+	// Allocate memory.
+	device = (dc_remote_t *) dc_iostream_allocate (context, &dc_remote_vtable, array_uint32_le (hello + 4));
+	if (device == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		status = DC_STATUS_NOMEMORY;
+		goto error_close;
+	}
+
+	device->connection = connection;
+	device->output = dc_buffer_new (MAXBATCH);
+	device->lastwrite = SIZE_MAX;
+	device->input = dc_buffer_new (MAXPREFETCH);
+	device->offset = 0;
+	device->valid = 0;
+	device->timeout = -1;
+	device->ctimeout = MARGIN;
+	if (device->output == NULL || device->input == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		status = DC_STATUS_NOMEMORY;
+		goto error_free;
+	}
+
+	*out = (dc_iostream_t *) device;
+
+	return DC_STATUS_SUCCESS;
+
+error_free:
+	dc_buffer_free (device->input);
+	dc_buffer_free (device->output);
+	dc_iostream_deallocate ((dc_iostream_t *) device);
+error_close:
+	dc_iostream_close (connection);
+	return status;
+}
+
+static dc_status_t
+dc_remote_queue (dc_remote_t *device, unsigned int cmd, const unsigned char data[], size_t size)
+{
+	unsigned char header[SZ_HEADER];
+	header[0] = cmd;
+	array_uint32_le_set (header + 1, size);
+
+	if (!dc_buffer_append (device->output, header, sizeof (header)) ||
+		!dc_buffer_append (device->output, data, size)) {
+		ERROR (device->base.context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	device->lastwrite = SIZE_MAX;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_remote_send (dc_remote_t *device)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	size_t size = dc_buffer_get_size (device->output);
+
+	if (size == 0)
+		return DC_STATUS_SUCCESS;
+
+	status = dc_iostream_write (device->connection, dc_buffer_get_data (device->output), size, NULL);
+
+	dc_buffer_clear (device->output);
+	device->lastwrite = SIZE_MAX;
+
+	return status;
+}
+
+/*
+ * Queue a setting, unless the value is the same as the last time.
+ */
+static dc_status_t
+dc_remote_setting (dc_remote_t *device, unsigned int cmd, const unsigned char data[], size_t size)
+{
+	unsigned int mask = 1u << (cmd - 1);
+	unsigned char *setting = device->settings[cmd - 1];
+
+	if ((device->valid & mask) && memcmp (setting, data, size) == 0)
+		return DC_STATUS_SUCCESS;
+
+	memcpy (setting, data, size);
+	device->valid |= mask;
+
+	return dc_remote_queue (device, cmd, data, size);
+}
+
+static dc_status_t
+dc_remote_setting_uint (dc_iostream_t *abstract, unsigned int cmd, unsigned int value)
+{
+	unsigned char data[4];
+	array_uint32_le_set (data, value);
+
+	return dc_remote_setting ((dc_remote_t *) abstract, cmd, data, sizeof (data));
+}
+
+/*
+ * Send all queued requests, followed by a request which is answered by
+ * the server. The data of the answer is appended to the input buffer.
+ */
+static dc_status_t
+dc_remote_request (dc_remote_t *device, unsigned int cmd, unsigned int argument, unsigned int *value)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_context_t *context = device->base.context;
+
+	// Wait at least as long as the server, before giving up.
+	int timeout = device->timeout < 0 ? -1 : device->timeout + MARGIN;
+	if (device->ctimeout != timeout) {
+		status = dc_iostream_set_timeout (device->connection, timeout);
+		if (status != DC_STATUS_SUCCESS)
+			return status;
+		device->ctimeout = timeout;
+	}
+
+	unsigned char payload[4];
+	array_uint32_le_set (payload, argument);
+	status = dc_remote_queue (device, cmd, payload, cmd == CMD_READ ? sizeof (payload) : 0);
+	if (status != DC_STATUS_SUCCESS)
+		return status;
+
+	status = dc_remote_send (device);
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR (context, "Failed to send the request.");
+		return status;
+	}
+
+	unsigned char reply[SZ_REPLY];
+	status = dc_iostream_read (device->connection, reply, sizeof (reply), NULL);
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR (context, "Failed to receive the reply.");
+		return DC_STATUS_IO;
+	}
+
+	dc_status_t result = (dc_status_t) (int) array_uint32_le (reply + 0);
+	dc_status_t deferred = (dc_status_t) (int) array_uint32_le (reply + 4);
+	unsigned int length = array_uint32_le (reply + 12);
+
+	if (length > MAXREAD + MAXPREFETCH) {
+		ERROR (context, "Unexpected reply length (%u).", length);
+		return DC_STATUS_PROTOCOL;
+	}
+
+	// Drop the data that is already consumed.
+	if (device->offset) {
+		dc_buffer_slice (device->input, device->offset, dc_buffer_get_size (device->input) - device->offset);
+		device->offset = 0;
+	}
+
+	size_t size = dc_buffer_get_size (device->input);
+	if (!dc_buffer_resize (device->input, size + length)) {
+		ERROR (context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	status = dc_iostream_read (device->connection, dc_buffer_get_data (device->input) + size, length, NULL);
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR (context, "Failed to receive the reply data.");
+		dc_buffer_resize (device->input, size);
+		return DC_STATUS_IO;
+	}
+
+	if (value)
+		*value = array_uint32_le (reply + 8);
+
+	if (result == DC_STATUS_SUCCESS && deferred != DC_STATUS_SUCCESS) {
+		WARNING (context, "Queued operation failed.");
+		result = deferred;
+	}
+
+	return result;
+}
+
+static dc_status_t
+dc_remote_set_timeout (dc_iostream_t *abstract, int timeout)
+{
+	dc_remote_t *device = (dc_remote_t *) abstract;
+
+	device->timeout = timeout;
+
+	return dc_remote_setting_uint (abstract, CMD_TIMEOUT, (unsigned int) timeout);
+}
+
+static dc_status_t
+dc_remote_set_latency (dc_iostream_t *abstract, unsigned int value)
+{
+	return dc_remote_setting_uint (abstract, CMD_LATENCY, value);
+}
+
+static dc_status_t
+dc_remote_set_break (dc_iostream_t *abstract, unsigned int value)
+{
+	return dc_remote_setting_uint (abstract, CMD_BREAK, value);
+}
+
+static dc_status_t
+dc_remote_set_dtr (dc_iostream_t *abstract, unsigned int value)
+{
+	return dc_remote_setting_uint (abstract, CMD_DTR, value);
+}
+
+static dc_status_t
+dc_remote_set_rts (dc_iostream_t *abstract, unsigned int value)
+{
+	return dc_remote_setting_uint (abstract, CMD_RTS, value);
+}
+
+static dc_status_t
+dc_remote_configure (dc_iostream_t *abstract, unsigned int baudrate, unsigned int databits, dc_parity_t parity, dc_stopbits_t stopbits, dc_flowcontrol_t flowcontrol)
+{
+	unsigned char data[SZ_SETTING];
+	array_uint32_le_set (data +  0, baudrate);
+	array_uint32_le_set (data +  4, databits);
+	array_uint32_le_set (data +  8, parity);
+	array_uint32_le_set (data + 12, stopbits);
+	array_uint32_le_set (data + 16, flowcontrol);
+
+	return dc_remote_setting ((dc_remote_t *) abstract, CMD_CONFIGURE, data, sizeof (data));
+}
+
+static dc_status_t
+dc_remote_get_lines (dc_iostream_t *abstract, unsigned int *value)
+{
+	return dc_remote_request ((dc_remote_t *) abstract, CMD_LINES, 0, value);
+}
+
+static dc_status_t
+dc_remote_get_available (dc_iostream_t *abstract, size_t *value)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_remote_t *device = (dc_remote_t *) abstract;
+	unsigned int available = 0;
+
+	status = dc_remote_request (device, CMD_AVAILABLE, 0, &available);
+	if (status != DC_STATUS_SUCCESS)
+		return status;
+
+	if (value)
+		*value = dc_buffer_get_size (device->input) - device->offset + available;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static size_t
+dc_remote_consume (dc_remote_t *device, unsigned char data[], size_t size)
+{
+	size_t available = dc_buffer_get_size (device->input) - device->offset;
+	if (size > available)
+		size = available;
+
+	memcpy (data, dc_buffer_get_data (device->input) + device->offset, size);
+	device->offset += size;
+
+	return size;
+}
+
+static dc_status_t
+dc_remote_read (dc_iostream_t *abstract, void *data, size_t size, size_t *actual)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_remote_t *device = (dc_remote_t *) abstract;
+
+	// Use the data received with a previous request first.
+	size_t nbytes = dc_remote_consume (device, (unsigned char *) data, size);
+
+	if (nbytes < size) {
+		size_t remaining = size - nbytes;
+		if (remaining > MAXREAD)
+			remaining = MAXREAD;
+
+		status = dc_remote_request (device, CMD_READ, remaining, NULL);
+		nbytes += dc_remote_consume (device, (unsigned char *) data + nbytes, size - nbytes);
+		if (status == DC_STATUS_SUCCESS && nbytes != size)
+			status = DC_STATUS_TIMEOUT;
+	}
+
+	if (actual)
+		*actual = nbytes;
+
+	return status;
+}
+
+static dc_status_t
+dc_remote_write (dc_iostream_t *abstract, const void *data, size_t size, size_t *actual)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_remote_t *device = (dc_remote_t *) abstract;
+
+	if (device->lastwrite != SIZE_MAX) {
+		// Append to the previous write request.
+		unsigned char *header = dc_buffer_get_data (device->output) + device->lastwrite;
+		array_uint32_le_set (header + 1, array_uint32_le (header + 1) + size);
+		if (!dc_buffer_append (device->output, (const unsigned char *) data, size)) {
+			ERROR (abstract->context, "Failed to allocate memory.");
+			return DC_STATUS_NOMEMORY;
+		}
+	} else {
+		size_t lastwrite = dc_buffer_get_size (device->output);
+		status = dc_remote_queue (device, CMD_WRITE, (const unsigned char *) data, size);
+		if (status != DC_STATUS_SUCCESS)
+			return status;
+		device->lastwrite = lastwrite;
+	}
+
+	if (dc_buffer_get_size (device->output) >= MAXBATCH) {
+		status = dc_remote_send (device);
+		if (status != DC_STATUS_SUCCESS)
+			return status;
+	}
+
+	if (actual)
+		*actual = size;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_remote_flush (dc_iostream_t *abstract)
+{
+	return dc_remote_queue ((dc_remote_t *) abstract, CMD_FLUSH, NULL, 0);
+}
+
+static dc_status_t
+dc_remote_purge (dc_iostream_t *abstract, dc_direction_t direction)
+{
+	dc_remote_t *device = (dc_remote_t *) abstract;
+
+	if (direction & DC_DIRECTION_INPUT) {
+		dc_buffer_clear (device->input);
+		device->offset = 0;
+	}
+
+	unsigned char data[4];
+	array_uint32_le_set (data, direction);
+
+	return dc_remote_queue (device, CMD_PURGE, data, sizeof (data));
+}
+
+static dc_status_t
+dc_remote_sleep (dc_iostream_t *abstract, unsigned int milliseconds)
+{
+	unsigned char data[4];
+	array_uint32_le_set (data, milliseconds);
+
+	// The sleep is executed on the server, to preserve the timing
+	// relative to the queued operations.
+	return dc_remote_queue ((dc_remote_t *) abstract, CMD_SLEEP, data, sizeof (data));
+}
+
+static dc_status_t
+dc_remote_close (dc_iostream_t *abstract)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_remote_t *device = (dc_remote_t *) abstract;
+	dc_status_t rc = DC_STATUS_SUCCESS;
+
+	// Send the remaining requests.
+	rc = dc_remote_send (device);
+	if (rc != DC_STATUS_SUCCESS) {
+		dc_status_set_error(&status, rc);
+	}
+
+	rc = dc_iostream_close (device->connection);
+	if (rc != DC_STATUS_SUCCESS) {
+		dc_status_set_error(&status, rc);
+	}
+
+	dc_buffer_free (device->input);
+	dc_buffer_free (device->output);
+
+	return status;
+}
+
+static dc_status_t
+dc_remote_interrupt (dc_iostream_t *abstract)
+{
+	dc_remote_t *device = (dc_remote_t *) abstract;
+
+	// Only the connection to the server blocks.
+	return dc_iostream_interrupt (device->connection);
+}
+
+static dc_status_t
+dc_remote_reply (dc_iostream_t *connection, dc_buffer_t *buffer, dc_status_t status, dc_status_t deferred, unsigned int value)
+{
+	unsigned char *reply = dc_buffer_get_data (buffer);
+	array_uint32_le_set (reply +  0, (unsigned int) status);
+	array_uint32_le_set (reply +  4, (unsigned int) deferred);
+	array_uint32_le_set (reply +  8, value);
+	array_uint32_le_set (reply + 12, dc_buffer_get_size (buffer) - SZ_REPLY);
+
+	return dc_iostream_write (connection, reply, dc_buffer_get_size (buffer), NULL);
+}
+
+static dc_status_t
+dc_remote_serve_read (dc_iostream_t *iostream, dc_buffer_t *reply, size_t size)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	size_t nbytes = 0, available = 0;
+
+	if (!dc_buffer_resize (reply, SZ_REPLY + size)) {
+		ERROR (iostream->context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	status = dc_iostream_read (iostream, dc_buffer_get_data (reply) + SZ_REPLY, size, &nbytes);
+	dc_buffer_resize (reply, SZ_REPLY + nbytes);
+	if (status != DC_STATUS_SUCCESS)
+		return status;
+
+	// Return the data that is already available as well, to answer the
+	// next small reads without a network round trip.
+	if (dc_iostream_get_available (iostream, &available) != DC_STATUS_SUCCESS || available == 0)
+		return DC_STATUS_SUCCESS;
+
+	if (available > MAXPREFETCH)
+		available = MAXPREFETCH;
+
+	if (!dc_buffer_resize (reply, SZ_REPLY + nbytes + available))
+		return DC_STATUS_SUCCESS;
+
+	size_t n = 0;
+	dc_iostream_read (iostream, dc_buffer_get_data (reply) + SZ_REPLY + nbytes, available, &n);
+	dc_buffer_resize (reply, SZ_REPLY + nbytes + n);
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_remote_serve (dc_iostream_t *connection, dc_iostream_t *iostream)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_context_t *context = NULL;
+	dc_buffer_t *request = NULL, *reply = NULL;
+	dc_status_t deferred = DC_STATUS_SUCCESS;
+
+	if (connection == NULL || iostream == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	context = iostream->context;
+
+	request = dc_buffer_new (MAXBATCH);
+	reply = dc_buffer_new (SZ_REPLY + MAXPREFETCH);
+	if (request == NULL || reply == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		status = DC_STATUS_NOMEMORY;
+		goto cleanup;
+	}
+
+	// Wait for the client without a timeout.
+	status = dc_iostream_set_timeout (connection, -1);
+	if (status != DC_STATUS_SUCCESS)
+		goto cleanup;
+
+	// Send the greeting with the transport type.
+	unsigned char hello[SZ_HELLO];
+	memcpy (hello, MAGIC, 4);
+	array_uint32_le_set (hello + 4, dc_iostream_get_transport (iostream));
+	status = dc_iostream_write (connection, hello, sizeof (hello), NULL);
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR (context, "Failed to send the greeting.");
+		goto cleanup;
+	}
+
+	while (1) {
+		unsigned char header[SZ_HEADER];
+		size_t nbytes = 0;
+		status = dc_iostream_read (connection, header, sizeof (header), &nbytes);
+		if (status != DC_STATUS_SUCCESS) {
+			if (status == DC_STATUS_TIMEOUT && nbytes == 0) {
+				INFO (context, "Connection closed by the client.");
+				status = DC_STATUS_SUCCESS;
+			} else {
+				ERROR (context, "Failed to receive the request.");
+			}
+			break;
+		}
+
+		unsigned int cmd = header[0];
+		unsigned int length = array_uint32_le (header + 1);
+		if (length > MAXREAD) {
+			ERROR (context, "Unexpected request length (%u).", length);
+			status = DC_STATUS_PROTOCOL;
+			break;
+		}
+
+		if (!dc_buffer_resize (request, length)) {
+			ERROR (context, "Failed to allocate memory.");
+			status = DC_STATUS_NOMEMORY;
+			break;
+		}
+
+		unsigned char *data = dc_buffer_get_data (request);
+		status = dc_iostream_read (connection, data, length, NULL);
+		if (status != DC_STATUS_SUCCESS) {
+			ERROR (context, "Failed to receive the request data.");
+			break;
+		}
+
+		// Verify the length of the payload.
+		unsigned int expected = 0;
+		switch (cmd) {
+		case CMD_TIMEOUT:
+		case CMD_LATENCY:
+		case CMD_BREAK:
+		case CMD_DTR:
+		case CMD_RTS:
+		case CMD_PURGE:
+		case CMD_SLEEP:
+		case CMD_READ:
+			expected = 4;
+			break;
+		case CMD_CONFIGURE:
+			expected = 20;
+			break;
+		case CMD_WRITE:
+			expected = length;
+			break;
+		case CMD_FLUSH:
+		case CMD_AVAILABLE:
+		case CMD_LINES:
+			expected = 0;
+			break;
+		default:
+			ERROR (context, "Unknown request (0x%02x).", cmd);
+			status = DC_STATUS_PROTOCOL;
+			goto cleanup;
+		}
+
+		if (length != expected) {
+			ERROR (context, "Unexpected request length (%u).", length);
+			status = DC_STATUS_PROTOCOL;
+			break;
+		}
+
+		unsigned int argument = length >= 4 ? array_uint32_le (data) : 0;
+
+		dc_status_t rc = DC_STATUS_SUCCESS;
+		unsigned int value = 0;
+		size_t available = 0;
+		switch (cmd) {
+		case CMD_TIMEOUT:
+			rc = dc_iostream_set_timeout (iostream, (int) argument);
+			break;
+		case CMD_LATENCY:
+			rc = dc_iostream_set_latency (iostream, argument);
+			break;
+		case CMD_BREAK:
+			rc = dc_iostream_set_break (iostream, argument);
+			break;
+		case CMD_DTR:
+			rc = dc_iostream_set_dtr (iostream, argument);
+			break;
+		case CMD_RTS:
+			rc = dc_iostream_set_rts (iostream, argument);
+			break;
+		case CMD_CONFIGURE:
+			rc = dc_iostream_configure (iostream,
+				array_uint32_le (data +  0),
+				array_uint32_le (data +  4),
+				array_uint32_le (data +  8),
+				array_uint32_le (data + 12),
+				array_uint32_le (data + 16));
+			break;
+		case CMD_WRITE:
+			rc = dc_iostream_write (iostream, data, length, NULL);
+			break;
+		case CMD_FLUSH:
+			rc = dc_iostream_flush (iostream);
+			break;
+		case CMD_PURGE:
+			rc = dc_iostream_purge (iostream, argument);
+			break;
+		case CMD_SLEEP:
+			rc = dc_iostream_sleep (iostream, argument);
+			break;
+		case CMD_READ:
+			if (argument > MAXREAD) {
+				ERROR (context, "Unexpected read size (%u).", argument);
+				status = DC_STATUS_PROTOCOL;
+				goto cleanup;
+			}
+			rc = dc_remote_serve_read (iostream, reply, argument);
+			break;
+		case CMD_AVAILABLE:
+			rc = dc_iostream_get_available (iostream, &available);
+			value = available;
+			dc_buffer_resize (reply, SZ_REPLY);
+			break;
+		case CMD_LINES:
+			rc = dc_iostream_get_lines (iostream, &value);
+			dc_buffer_resize (reply, SZ_REPLY);
+			break;
+		}
+
+		if (cmd == CMD_READ || cmd == CMD_AVAILABLE || cmd == CMD_LINES) {
+			status = dc_remote_reply (connection, reply, rc, deferred, value);
+			if (status != DC_STATUS_SUCCESS) {
+				ERROR (context, "Failed to send the reply.");
+				break;
+			}
+			deferred = DC_STATUS_SUCCESS;
+		} else if (rc != DC_STATUS_SUCCESS && deferred == DC_STATUS_SUCCESS) {
+			deferred = rc;
+		}
+	}
+
+cleanup:
+	dc_buffer_free (reply);
+	dc_buffer_free (request);
+	return status;
+}
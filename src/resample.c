@@ -0,0 +1,385 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <libdivecomputer/resample.h>
+
+#define MAXSIZE (1U << 30)
+
+#define PI 3.14159265358979323846
+
+/*
+ * For every grid time, the rows on both sides and the weight of the
+ * second one. The values are interpolated in a separate pass over each
+ * column, without branches, so the compiler can vectorize the loops.
+ * The grid is computed once for all the columns with the same sample
+ * type, or once for all columns without a mask.
+ */
+typedef struct resample_grid_t {
+	unsigned int begin;
+	unsigned int interval;
+	unsigned int count;
+	int type;
+	unsigned int *lo;
+	unsigned int *hi;
+	double *weight;
+	unsigned char *linear;
+	unsigned char *hold;
+} resample_grid_t;
+
+static void
+resample_grid_build (resample_grid_t *grid, const dc_sample_batch_t *input, int type)
+{
+	const unsigned int *mask = type >= 0 ? input->mask : NULL;
+	const unsigned int bit = type >= 0 ? 1u << type : 0;
+	const unsigned int n = input->count;
+
+	if (grid->type == type)
+		return;
+
+	unsigned int row = 0, next = 0, last = 0;
+	int have = 0;
+	for (unsigned int i = 0; i < grid->count; ++i) {
+		unsigned int t = grid->begin + i * grid->interval;
+
+		// The last row at or before the grid time.
+		while (row < n && input->time[row] <= t) {
+			if (mask == NULL || (mask[row] & bit)) {
+				last = row;
+				have = 1;
+			}
+			row++;
+		}
+
+		// The first row after the grid time.
+		if (next < row)
+			next = row;
+		while (next < n && mask && (mask[next] & bit) == 0)
+			next++;
+
+		grid->lo[i] = grid->hi[i] = last;
+		grid->weight[i] = 0.0;
+		grid->hold[i] = have;
+		grid->linear[i] = 0;
+		if (have) {
+			if (input->time[last] == t) {
+				grid->linear[i] = 1;
+			} else if (next < n) {
+				grid->hi[i] = next;
+				grid->weight[i] = (double) (t - input->time[last]) / (input->time[next] - input->time[last]);
+				grid->linear[i] = 1;
+			}
+		}
+	}
+
+	grid->type = type;
+}
+
+static void
+resample_mask (const resample_grid_t *grid, const unsigned char valid[], int type, dc_sample_batch_t *output)
+{
+	if (output->mask == NULL)
+		return;
+
+	for (unsigned int i = 0; i < grid->count; ++i) {
+		output->mask[i] |= (unsigned int) valid[i] << type;
+	}
+}
+
+static void
+resample_linear (const resample_grid_t *grid, const double in[], double out[])
+{
+	for (unsigned int i = 0; i < grid->count; ++i) {
+		double a = in[grid->lo[i]], b = in[grid->hi[i]];
+		out[i] = (a + grid->weight[i] * (b - a)) * grid->linear[i];
+	}
+}
+
+static void
+resample_linear_fixed (const resample_grid_t *grid, const int in[], int out[])
+{
+	for (unsigned int i = 0; i < grid->count; ++i) {
+		double a = in[grid->lo[i]], b = in[grid->hi[i]];
+		out[i] = (int) floor ((a + grid->weight[i] * (b - a)) * grid->linear[i] + 0.5);
+	}
+}
+
+static void
+resample_hold (const resample_grid_t *grid, const double in[], double out[])
+{
+	for (unsigned int i = 0; i < grid->count; ++i) {
+		out[i] = in[grid->lo[i]] * grid->hold[i];
+	}
+}
+
+static void
+resample_hold_fixed (const resample_grid_t *grid, const int in[], int out[])
+{
+	for (unsigned int i = 0; i < grid->count; ++i) {
+		out[i] = in[grid->lo[i]] * grid->hold[i];
+	}
+}
+
+static void
+resample_hold_uint (const resample_grid_t *grid, const unsigned int in[], unsigned int out[])
+{
+	for (unsigned int i = 0; i < grid->count; ++i) {
+		out[i] = in[grid->lo[i]] * grid->hold[i];
+	}
+}
+
+#define RESAMPLE(func,column,type,valid) \
+	if (input->column && output->column) { \
+		resample_grid_build (&grid, input, input->mask ? (type) : -1); \
+		func (&grid, input->column, output->column); \
+		resample_mask (&grid, grid.valid, type, output); \
+	}
+
+dc_status_t
+dc_resample_batch (const dc_sample_batch_t *input, unsigned int begin, unsigned int interval, dc_sample_batch_t *output)
+{
+	resample_grid_t grid;
+
+	if (input == NULL || output == NULL || interval == 0)
+		return DC_STATUS_INVALIDARGS;
+
+	if (input->count && input->time == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	output->count = 0;
+
+	if (input->count == 0 || output->capacity == 0 ||
+		begin > input->time[input->count - 1])
+		return DC_STATUS_SUCCESS;
+
+	unsigned int count = (input->time[input->count - 1] - begin) / interval + 1;
+	if (count > output->capacity)
+		count = output->capacity;
+
+	// The index arrays are allocated in a single block.
+	unsigned char *buffer = (unsigned char *) malloc (count * (2 * sizeof (unsigned int) + sizeof (double) + 2));
+	if (buffer == NULL)
+		return DC_STATUS_NOMEMORY;
+
+	grid.begin = begin;
+	grid.interval = interval;
+	grid.count = count;
+	grid.type = -2;
+	grid.weight = (double *) buffer;
+	grid.lo = (unsigned int *) (grid.weight + count);
+	grid.hi = grid.lo + count;
+	grid.linear = (unsigned char *) (grid.hi + count);
+	grid.hold = grid.linear + count;
+
+	if (output->mask) {
+		memset (output->mask, 0, count * sizeof (unsigned int));
+	}
+
+	if (output->time) {
+		for (unsigned int i = 0; i < count; ++i) {
+			output->time[i] = begin + i * interval;
+		}
+	}
+	if (output->mask) {
+		for (unsigned int i = 0; i < count; ++i) {
+			output->mask[i] |= 1u << DC_SAMPLE_TIME;
+		}
+	}
+
+	RESAMPLE (resample_linear,       depth,          DC_SAMPLE_DEPTH,       linear);
+	RESAMPLE (resample_linear_fixed, depth_mm,       DC_SAMPLE_DEPTH,       linear);
+	RESAMPLE (resample_linear,       temperature,    DC_SAMPLE_TEMPERATURE, linear);
+	RESAMPLE (resample_linear_fixed, temperature_mk, DC_SAMPLE_TEMPERATURE, linear);
+	RESAMPLE (resample_linear,       ppo2,           DC_SAMPLE_PPO2,        linear);
+	RESAMPLE (resample_linear_fixed, ppo2_mbar,      DC_SAMPLE_PPO2,        linear);
+	RESAMPLE (resample_linear,       cns,            DC_SAMPLE_CNS,         linear);
+	RESAMPLE (resample_hold,         setpoint,       DC_SAMPLE_SETPOINT,    hold);
+	RESAMPLE (resample_hold_fixed,   setpoint_mbar,  DC_SAMPLE_SETPOINT,    hold);
+	RESAMPLE (resample_hold_uint,    rbt,            DC_SAMPLE_RBT,         hold);
+	RESAMPLE (resample_hold_uint,    heartbeat,      DC_SAMPLE_HEARTBEAT,   hold);
+	RESAMPLE (resample_hold_uint,    bearing,        DC_SAMPLE_BEARING,     hold);
+	RESAMPLE (resample_hold_uint,    gasmix,         DC_SAMPLE_GASMIX,      hold);
+	RESAMPLE (resample_hold_uint,    deco_type,      DC_SAMPLE_DECO,        hold);
+	RESAMPLE (resample_hold_uint,    deco_time,      DC_SAMPLE_DECO,        hold);
+	RESAMPLE (resample_hold,         deco_depth,     DC_SAMPLE_DECO,        hold);
+	RESAMPLE (resample_hold_fixed,   deco_depth_mm,  DC_SAMPLE_DECO,        hold);
+	RESAMPLE (resample_hold_uint,    tts,            DC_SAMPLE_TTS,         hold);
+
+	// The pressure columns have one sub-column per tank.
+	unsigned int ntanks = input->ntanks < output->ntanks ? input->ntanks : output->ntanks;
+	for (unsigned int i = 0; i < ntanks; ++i) {
+		if (input->pressure && output->pressure) {
+			resample_grid_build (&grid, input, input->mask ? DC_SAMPLE_PRESSURE : -1);
+			resample_linear (&grid,
+				input->pressure + i * input->capacity,
+				output->pressure + i * output->capacity);
+			resample_mask (&grid, grid.linear, DC_SAMPLE_PRESSURE, output);
+		}
+		if (input->pressure_mbar && output->pressure_mbar) {
+			resample_grid_build (&grid, input, input->mask ? DC_SAMPLE_PRESSURE : -1);
+			resample_linear_fixed (&grid,
+				input->pressure_mbar + i * input->capacity,
+				output->pressure_mbar + i * output->capacity);
+			resample_mask (&grid, grid.linear, DC_SAMPLE_PRESSURE, output);
+		}
+	}
+
+	output->count = count;
+
+	free (buffer);
+
+	return DC_STATUS_SUCCESS;
+}
+
+/*
+ * Iterative radix-2 FFT, in place. The twiddle factors are the cosine
+ * and sine of 2πk/n, for k = 0 to n/2 - 1.
+ */
+static void
+resample_fft (double re[], double im[], const double cosine[], const double sine[], size_t n, int inverse)
+{
+	for (size_t i = 1, j = 0; i < n; ++i) {
+		size_t bit = n >> 1;
+		for (; j & bit; bit >>= 1)
+			j ^= bit;
+		j ^= bit;
+
+		if (i < j) {
+			double tmp = re[i]; re[i] = re[j]; re[j] = tmp;
+			tmp = im[i]; im[i] = im[j]; im[j] = tmp;
+		}
+	}
+
+	for (size_t len = 2; len <= n; len <<= 1) {
+		size_t half = len / 2, step = n / len;
+		for (size_t i = 0; i < n; i += len) {
+			for (size_t k = 0; k < half; ++k) {
+				double wr = cosine[k * step];
+				double wi = inverse ? sine[k * step] : -sine[k * step];
+				size_t a = i + k, b = a + half;
+				double xr = re[b] * wr - im[b] * wi;
+				double xi = re[b] * wi + im[b] * wr;
+				re[b] = re[a] - xr;
+				im[b] = im[a] - xi;
+				re[a] += xr;
+				im[a] += xi;
+			}
+		}
+	}
+}
+
+dc_status_t
+dc_resample_align (const double a[], unsigned int na, const double b[], unsigned int nb, unsigned int maxlag, int *lag, double *score)
+{
+	if (a == NULL || b == NULL || na == 0 || nb == 0 || lag == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	if (na > MAXSIZE || nb > MAXSIZE)
+		return DC_STATUS_INVALIDARGS;
+
+	// The transform is large enough to avoid the circular wrap around
+	// for all the lags.
+	size_t n = 2;
+	while (n < (size_t) na + nb - 1)
+		n <<= 1;
+
+	double *buffer = (double *) malloc (5 * n * sizeof (double));
+	if (buffer == NULL)
+		return DC_STATUS_NOMEMORY;
+
+	double *zr = buffer, *zi = zr + n;
+	double *cr = zi + n, *ci = cr + n;
+	double *cosine = ci + n, *sine = cosine + n / 2;
+
+	for (size_t k = 0; k < n / 2; ++k) {
+		cosine[k] = cos (2.0 * PI * k / n);
+		sine[k] = sin (2.0 * PI * k / n);
+	}
+
+	// Both real series are transformed at once, as the real and
+	// imaginary part of a single complex series.
+	double ea = 0.0, eb = 0.0;
+	memset (zr, 0, 2 * n * sizeof (double));
+	for (unsigned int i = 0; i < na; ++i) {
+		zr[i] = a[i];
+		ea += a[i] * a[i];
+	}
+	for (unsigned int i = 0; i < nb; ++i) {
+		zi[i] = b[i];
+		eb += b[i] * b[i];
+	}
+
+	resample_fft (zr, zi, cosine, sine, n, 0);
+
+	// Split the spectrum into the spectra A and B of both series, and
+	// multiply A with the complex conjugate of B.
+	for (size_t k = 0; k < n; ++k) {
+		size_t m = (n - k) & (n - 1);
+		double ar = (zr[k] + zr[m]) / 2, ai = (zi[k] - zi[m]) / 2;
+		double br = (zi[k] + zi[m]) / 2, bi = (zr[m] - zr[k]) / 2;
+		cr[k] = ar * br + ai * bi;
+		ci[k] = ai * br - ar * bi;
+	}
+
+	resample_fft (cr, ci, cosine, sine, n, 1);
+
+	// The correlation for lag k is at index k, and at index n + k for
+	// the negative lags.
+	long min = -(long) (nb - 1), max = (long) (na - 1);
+	if (maxlag) {
+		if (min < -(long) maxlag)
+			min = -(long) maxlag;
+		if (max > (long) maxlag)
+			max = (long) maxlag;
+	}
+
+	long best = 0;
+	double value = -INFINITY;
+	for (long k = min; k <= max; ++k) {
+		double c = cr[k < 0 ? n + k : (size_t) k] / n;
+		if (c > value || (c == value && labs (k) < labs (best))) {
+			value = c;
+			best = k;
+		}
+	}
+
+	free (buffer);
+
+	if (ea == 0.0 || eb == 0.0) {
+		best = 0;
+		value = 0.0;
+	} else {
+		value /= sqrt (ea * eb);
+	}
+
+	*lag = best;
+	if (score)
+		*score = value;
+
+	return DC_STATUS_SUCCESS;
+}
@@ -100,3 +100,35 @@ ringbuffer_decrement (unsigned int a, unsigned int delta, unsigned int begin, un
 
 	return decrement (a - begin, delta, end - begin) + begin;
 }
+
+
+unsigned int
+ringbuffer_span (unsigned int a, unsigned int b, int mode, unsigned int begin, unsigned int end, ringbuffer_span_t span[2])
+{
+	assert (end > begin);
+	assert (a >= begin);
+	assert (b >= begin);
+
+	unsigned int size = end - begin;
+	unsigned int length = distance (a, b, mode, size);
+	unsigned int address = normalize (a - begin, size) + begin;
+
+	if (length == 0)
+		return 0;
+
+	// The first span ends at the wrap point, or earlier.
+	unsigned int head = end - address;
+	if (head > length)
+		head = length;
+
+	span[0].address = address;
+	span[0].size = head;
+	if (head == length)
+		return 1;
+
+	// The second span continues at the begin.
+	span[1].address = begin;
+	span[1].size = length - head;
+
+	return 2;
+}
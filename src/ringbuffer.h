@@ -26,6 +26,11 @@
 extern "C" {
 #endif /* __cplusplus */
 
+typedef struct ringbuffer_span_t {
+	unsigned int address;
+	unsigned int size;
+} ringbuffer_span_t;
+
 unsigned int
 ringbuffer_normalize (unsigned int a, unsigned int begin, unsigned int end);
 
@@ -38,6 +43,16 @@ ringbuffer_increment (unsigned int a, unsigned int delta, unsigned int begin, un
 unsigned int
 ringbuffer_decrement (unsigned int a, unsigned int delta, unsigned int begin, unsigned int end);
 
+/*
+ * Split the region from address a up to address b into contiguous
+ * spans. Because the region wraps around at most once, there are at
+ * most two spans. The mode has the same meaning as for the distance:
+ * with equal addresses, the region is empty (zero) or covers the entire
+ * ringbuffer (non-zero). Returns the number of spans.
+ */
+unsigned int
+ringbuffer_span (unsigned int a, unsigned int b, int mode, unsigned int begin, unsigned int end, ringbuffer_span_t span[2]);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -0,0 +1,289 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#define SCAN_THREADS
+#endif
+
+#include <libdivecomputer/scan.h>
+#include <libdivecomputer/serial.h>
+#include <libdivecomputer/irda.h>
+#include <libdivecomputer/bluetooth.h>
+#include <libdivecomputer/usbhid.h>
+
+#include "context-private.h"
+#include "iterator-private.h"
+#include "timer.h"
+
+typedef struct dc_scan_t {
+	dc_context_t *context;
+	dc_descriptor_t *descriptor;
+	unsigned int flags;
+	dc_scan_callback_t callback;
+	void *userdata;
+	dc_timer_t *timer;
+	dc_usecs_t timeout;
+	unsigned int stopped;
+	unsigned int expired;
+	dc_status_t status;
+#ifdef SCAN_THREADS
+	// Protects the flags and the status, and serializes the callbacks.
+	pthread_mutex_t lock;
+#endif
+} dc_scan_t;
+
+typedef struct dc_scan_job_t {
+	dc_scan_t *scan;
+	dc_transport_t transport;
+#ifdef SCAN_THREADS
+	pthread_t thread;
+	unsigned int started;
+#endif
+} dc_scan_job_t;
+
+// The fast transports first, for the sequential scan.
+static const dc_transport_t g_transports[] = {
+	DC_TRANSPORT_USBHID,
+	DC_TRANSPORT_SERIAL,
+	DC_TRANSPORT_IRDA,
+	DC_TRANSPORT_BLUETOOTH,
+};
+
+#define NTRANSPORTS (sizeof (g_transports) / sizeof (g_transports[0]))
+
+static void
+dc_scan_lock (dc_scan_t *scan)
+{
+#ifdef SCAN_THREADS
+	pthread_mutex_lock (&scan->lock);
+#endif
+}
+
+static void
+dc_scan_unlock (dc_scan_t *scan)
+{
+#ifdef SCAN_THREADS
+	pthread_mutex_unlock (&scan->lock);
+#endif
+}
+
+static dc_status_t
+dc_scan_iterator_new (dc_scan_t *scan, dc_transport_t transport, dc_iterator_t **iterator)
+{
+	switch (transport) {
+	case DC_TRANSPORT_SERIAL:
+		return dc_serial_iterator_new (iterator, scan->context, scan->descriptor);
+	case DC_TRANSPORT_IRDA:
+		return dc_irda_iterator_new (iterator, scan->context, scan->descriptor);
+	case DC_TRANSPORT_BLUETOOTH:
+		return dc_bluetooth_iterator_new2 (iterator, scan->context, scan->descriptor, scan->flags);
+	case DC_TRANSPORT_USBHID:
+		return dc_usbhid_iterator_new (iterator, scan->context, scan->descriptor);
+	default:
+		return DC_STATUS_UNSUPPORTED;
+	}
+}
+
+static void
+dc_scan_device_free (dc_transport_t transport, void *device)
+{
+	switch (transport) {
+	case DC_TRANSPORT_SERIAL:
+		dc_serial_device_free ((dc_serial_device_t *) device);
+		break;
+	case DC_TRANSPORT_IRDA:
+		dc_irda_device_free ((dc_irda_device_t *) device);
+		break;
+	case DC_TRANSPORT_BLUETOOTH:
+		dc_bluetooth_device_free ((dc_bluetooth_device_t *) device);
+		break;
+	case DC_TRANSPORT_USBHID:
+		dc_usbhid_device_free ((dc_usbhid_device_t *) device);
+		break;
+	default:
+		break;
+	}
+}
+
+/*
+ * Check whether the scan should stop. Must be called with the lock held.
+ */
+static int
+dc_scan_done (dc_scan_t *scan)
+{
+	if (scan->stopped)
+		return 1;
+
+	if (scan->timeout) {
+		dc_usecs_t now = 0;
+		if (dc_timer_now (scan->timer, &now) == DC_STATUS_SUCCESS && now >= scan->timeout) {
+			scan->stopped = 1;
+			scan->expired = 1;
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+static void
+dc_scan_run (dc_scan_job_t *job)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_scan_t *scan = job->scan;
+	dc_iterator_t *iterator = NULL;
+
+	status = dc_scan_iterator_new (scan, job->transport, &iterator);
+	if (status == DC_STATUS_SUCCESS) {
+		while (1) {
+			dc_scan_lock (scan);
+			int done = dc_scan_done (scan);
+			dc_scan_unlock (scan);
+			if (done)
+				break;
+
+			void *device = NULL;
+			status = dc_iterator_next (iterator, &device);
+			if (status != DC_STATUS_SUCCESS)
+				break;
+
+			// The timeout is checked again, because a bluetooth inquiry
+			// can take much longer than the remaining time.
+			dc_scan_lock (scan);
+			done = dc_scan_done (scan);
+			if (!done && !scan->callback (job->transport, device, scan->userdata))
+				scan->stopped = 1;
+			dc_scan_unlock (scan);
+
+			if (done)
+				dc_scan_device_free (job->transport, device);
+		}
+
+		dc_iterator_free (iterator);
+	}
+
+	// Transports which are not available on this platform are skipped.
+	if (status == DC_STATUS_DONE || status == DC_STATUS_UNSUPPORTED)
+		status = DC_STATUS_SUCCESS;
+
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR (scan->context, "Failed to scan transport 0x%02x.", job->transport);
+	}
+
+	dc_scan_lock (scan);
+	if (scan->status == DC_STATUS_SUCCESS)
+		scan->status = status;
+	dc_scan_unlock (scan);
+}
+
+#ifdef SCAN_THREADS
+static void *
+dc_scan_thread (void *data)
+{
+	dc_scan_run ((dc_scan_job_t *) data);
+	return NULL;
+}
+#endif
+
+dc_status_t
+dc_scan_all (dc_context_t *context, dc_descriptor_t *descriptor, unsigned int transports, unsigned int flags, unsigned int timeout, dc_scan_callback_t callback, void *userdata)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_scan_job_t jobs[NTRANSPORTS];
+	unsigned int njobs = 0;
+	dc_scan_t scan;
+
+	if (callback == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	scan.context = context;
+	scan.descriptor = descriptor;
+	scan.flags = flags;
+	scan.callback = callback;
+	scan.userdata = userdata;
+	scan.timer = NULL;
+	scan.timeout = 0;
+	scan.stopped = 0;
+	scan.expired = 0;
+	scan.status = DC_STATUS_SUCCESS;
+
+	if (timeout) {
+		status = dc_timer_new (&scan.timer);
+		if (status != DC_STATUS_SUCCESS) {
+			ERROR (context, "Failed to create the timer.");
+			return status;
+		}
+
+		// The timer starts at zero, so the deadline is the timeout itself.
+		scan.timeout = (dc_usecs_t) timeout * 1000;
+	}
+
+	for (unsigned int i = 0; i < NTRANSPORTS; ++i) {
+		if (transports & g_transports[i]) {
+			jobs[njobs].scan = &scan;
+			jobs[njobs].transport = g_transports[i];
+			njobs++;
+		}
+	}
+
+#ifdef SCAN_THREADS
+	if (pthread_mutex_init (&scan.lock, NULL) != 0) {
+		ERROR (context, "Failed to initialize the lock.");
+		dc_timer_free (scan.timer);
+		return DC_STATUS_NOMEMORY;
+	}
+
+	// A transport without a thread is scanned after the others started.
+	for (unsigned int i = 0; i < njobs; ++i) {
+		jobs[i].started = pthread_create (&jobs[i].thread, NULL, dc_scan_thread, jobs + i) == 0;
+	}
+
+	for (unsigned int i = 0; i < njobs; ++i) {
+		if (!jobs[i].started)
+			dc_scan_run (jobs + i);
+	}
+
+	for (unsigned int i = 0; i < njobs; ++i) {
+		if (jobs[i].started)
+			pthread_join (jobs[i].thread, NULL);
+	}
+
+	pthread_mutex_destroy (&scan.lock);
+#else
+	for (unsigned int i = 0; i < njobs; ++i) {
+		dc_scan_run (jobs + i);
+	}
+#endif
+
+	dc_timer_free (scan.timer);
+
+	if (scan.expired)
+		return DC_STATUS_TIMEOUT;
+
+	return scan.status;
+}
@@ -19,6 +19,8 @@
  * MA 02110-1301 USA
  */
 
+#define LOG_SUBSYSTEM DC_LOGSUBSYSTEM_IOSTREAM
+
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif
@@ -27,9 +29,11 @@
 #include <string.h>	// strerror
 #include <errno.h>	// errno
 #include <unistd.h>	// open, close, read, write
+#include <sys/uio.h>	// readv, writev
 #include <fcntl.h>	// fcntl
 #include <termios.h>	// tcgetattr, tcsetattr, cfsetispeed, cfsetospeed, tcflush, tcsendbreak
 #include <sys/ioctl.h>	// ioctl
+#include <poll.h>	// poll
 #include <time.h>	// nanosleep
 #ifdef HAVE_LINUX_SERIAL_H
 #include <linux/serial.h>
@@ -41,6 +45,11 @@
 #include <sys/types.h>
 #include <dirent.h>
 #include <fnmatch.h>
+#if defined(HAVE_SYS_INOTIFY_H) && defined(HAVE_PTHREAD_H)
+#include <sys/inotify.h>
+#include <pthread.h>
+#define USE_HOTPLUG
+#endif
 
 #ifndef TIOCINQ
 #define TIOCINQ FIONREAD
@@ -59,12 +68,29 @@
 #include "iostream-private.h"
 #include "iterator-private.h"
 #include "descriptor-private.h"
+#include "hotplug-private.h"
 #include "timer.h"
+#include "reactor.h"
 
 #define DIRNAME "/dev"
 
+#if defined (__linux__)
+#define USE_LATENCY_TIMER
+#define SYSFSDIR "/sys/bus/usb-serial/devices"
+#endif
+
+// Lowest and highest value of the latency timer (milliseconds).
+#define LATENCY_MIN 1
+#define LATENCY_MAX 255
+
+#define C_ARRAY_SIZE(array) (sizeof (array) / sizeof *(array))
+
+// Maximum number of buffers for the native scatter/gather transfers.
+#define MAXIOV 16
+
 static dc_status_t dc_serial_iterator_next (dc_iterator_t *iterator, void *item);
 static dc_status_t dc_serial_iterator_free (dc_iterator_t *iterator);
+static void dc_serial_iterator_release (void *item);
 
 static dc_status_t dc_serial_set_timeout (dc_iostream_t *iostream, int timeout);
 static dc_status_t dc_serial_set_latency (dc_iostream_t *iostream, unsigned int value);
@@ -80,17 +106,43 @@ static dc_status_t dc_serial_flush (dc_iostream_t *iostream);
 static dc_status_t dc_serial_purge (dc_iostream_t *iostream, dc_direction_t direction);
 static dc_status_t dc_serial_sleep (dc_iostream_t *iostream, unsigned int milliseconds);
 static dc_status_t dc_serial_close (dc_iostream_t *iostream);
+static dc_status_t dc_serial_read_async (dc_iostream_t *iostream, void *data, size_t size, dc_iostream_callback_t callback, void *userdata);
+static dc_status_t dc_serial_write_async (dc_iostream_t *iostream, const void *data, size_t size, dc_iostream_callback_t callback, void *userdata);
+static dc_status_t dc_serial_cancel (dc_iostream_t *iostream);
+static dc_status_t dc_serial_readv (dc_iostream_t *iostream, const dc_iovec_t iov[], size_t count, size_t *actual);
+static dc_status_t dc_serial_writev (dc_iostream_t *iostream, const dc_iovec_t iov[], size_t count, size_t *actual);
+static dc_status_t dc_serial_interrupt (dc_iostream_t *iostream);
+static dc_status_t dc_serial_wait_readable (dc_iostream_t *iostream, int timeout);
 
 struct dc_serial_device_t {
 	char name[256];
 };
 
+static const char * const g_patterns[] = {
+#if defined (__APPLE__)
+	"tty.*",
+#else
+	"ttyS*",
+	"ttyUSB*",
+	"ttyACM*",
+	"rfcomm*",
+#endif
+};
+
 typedef struct dc_serial_iterator_t {
 	dc_iterator_t base;
 	dc_filter_t filter;
 	DIR *dp;
 } dc_serial_iterator_t;
 
+typedef struct dc_serial_config_t {
+	unsigned int baudrate;
+	unsigned int databits;
+	dc_parity_t parity;
+	dc_stopbits_t stopbits;
+	dc_flowcontrol_t flowcontrol;
+} dc_serial_config_t;
+
 typedef struct dc_serial_t {
 	dc_iostream_t base;
 	/*
@@ -99,18 +151,47 @@ typedef struct dc_serial_t {
 	int fd;
 	int timeout;
 	dc_timer_t *timer;
+	/*
+	 * Self-pipe to interrupt the blocking transfers from another
+	 * thread. Once a byte has been written, the read end remains
+	 * readable, and all subsequent transfers are aborted as well.
+	 */
+	int pipe[2];
+	volatile int interrupted;
+	/*
+	 * The low latency settings are applied automatically. The initial
+	 * state of the low latency flag and the latency timer of the USB
+	 * serial converter are restored when the serial port is closed. A
+	 * negative value means the setting is not available.
+	 */
+	int lowlatency;
+	int latency_timer;
+	char latency_path[128];
 	/*
 	 * Serial port settings are saved into this variable immediately
 	 * after the port is opened. These settings are restored when the
 	 * serial port is closed.
 	 */
 	struct termios tty;
+	/*
+	 * The settings which were applied last, to skip the requests that
+	 * wouldn't change anything. The state of the modem control lines is
+	 * unknown (negative) until the lines are set explicitly, and after
+	 * each change of the configuration, which may change them as well.
+	 */
+	int configured;
+	dc_serial_config_t config;
+	int dtr;
+	int rts;
+	int brk;
 } dc_serial_t;
 
 static const dc_iterator_vtable_t dc_serial_iterator_vtable = {
 	sizeof(dc_serial_iterator_t),
 	dc_serial_iterator_next,
 	dc_serial_iterator_free,
+	NULL,
+	dc_serial_iterator_release,
 };
 
 static const dc_iostream_vtable_t dc_serial_vtable = {
@@ -129,6 +210,13 @@ static const dc_iostream_vtable_t dc_serial_vtable = {
 	dc_serial_purge, /* purge */
 	dc_serial_sleep, /* sleep */
 	dc_serial_close, /* close */
+	NULL, /* get_name */
+	dc_serial_read_async, /* read_async */
+	dc_serial_write_async, /* write_async */
+	dc_serial_cancel, /* cancel */
+	dc_serial_readv, /* readv */
+	dc_serial_writev, /* writev */
+	dc_serial_interrupt, /* interrupt */	dc_serial_wait_readable, /* wait_readable */
 };
 
 static dc_status_t
@@ -198,52 +286,63 @@ error_free:
 	return status;
 }
 
+/*
+ * Create a device object for an entry of the device directory, if the
+ * name looks like a serial port and is accepted by the filter. Otherwise
+ * DC_STATUS_DONE is returned.
+ */
 static dc_status_t
-dc_serial_iterator_next (dc_iterator_t *abstract, void *out)
+dc_serial_device_new (dc_serial_device_t **out, dc_context_t *context, const char *name, dc_filter_t filter)
 {
-	dc_serial_iterator_t *iterator = (dc_serial_iterator_t *) abstract;
 	dc_serial_device_t *device = NULL;
 
-	struct dirent *ep = NULL;
-	const char *patterns[] = {
-#if defined (__APPLE__)
-		"tty.*",
-#else
-		"ttyS*",
-		"ttyUSB*",
-		"ttyACM*",
-		"rfcomm*",
-#endif
-		NULL
-	};
+	for (size_t i = 0; i < C_ARRAY_SIZE(g_patterns); ++i) {
+		if (fnmatch (g_patterns[i], name, 0) != 0)
+			continue;
 
-	while ((ep = readdir (iterator->dp)) != NULL) {
-		for (size_t i = 0; patterns[i] != NULL; ++i) {
-			if (fnmatch (patterns[i], ep->d_name, 0) != 0)
-				continue;
+		char filename[sizeof(device->name)];
+		int n = snprintf (filename, sizeof (filename), "%s/%s", DIRNAME, name);
+		if (n < 0 || (size_t) n >= sizeof (filename)) {
+			return DC_STATUS_NOMEMORY;
+		}
 
-			char filename[sizeof(device->name)];
-			int n = snprintf (filename, sizeof (filename), "%s/%s", DIRNAME, ep->d_name);
-			if (n < 0 || (size_t) n >= sizeof (filename)) {
-				return DC_STATUS_NOMEMORY;
-			}
+		if (filter && !filter (DC_TRANSPORT_SERIAL, filename)) {
+			return DC_STATUS_DONE;
+		}
 
-			if (iterator->filter && !iterator->filter (DC_TRANSPORT_SERIAL, filename)) {
-				continue;
-			}
+		device = (dc_serial_device_t *) malloc (sizeof(dc_serial_device_t));
+		if (device == NULL) {
+			SYSERROR (context, ENOMEM);
+			return DC_STATUS_NOMEMORY;
+		}
 
-			device = (dc_serial_device_t *) malloc (sizeof(dc_serial_device_t));
-			if (device == NULL) {
-				SYSERROR (abstract->context, ENOMEM);
-				return DC_STATUS_NOMEMORY;
-			}
+		strncpy(device->name, filename, sizeof(device->name));
+
+		*out = device;
 
-			strncpy(device->name, filename, sizeof(device->name));
+		return DC_STATUS_SUCCESS;
+	}
 
-			*(dc_serial_device_t **) out = device;
+	return DC_STATUS_DONE;
+}
 
-			return DC_STATUS_SUCCESS;
-		}
+static dc_status_t
+dc_serial_iterator_next (dc_iterator_t *abstract, void *out)
+{
+	dc_serial_iterator_t *iterator = (dc_serial_iterator_t *) abstract;
+	dc_serial_device_t *device = NULL;
+
+	struct dirent *ep = NULL;
+	while ((ep = readdir (iterator->dp)) != NULL) {
+		dc_status_t status = dc_serial_device_new (&device, abstract->context, ep->d_name, iterator->filter);
+		if (status == DC_STATUS_DONE)
+			continue;
+		if (status != DC_STATUS_SUCCESS)
+			return status;
+
+		*(dc_serial_device_t **) out = device;
+
+		return DC_STATUS_SUCCESS;
 	}
 
 	return DC_STATUS_DONE;
@@ -259,6 +358,427 @@ dc_serial_iterator_free (dc_iterator_t *abstract)
 	return DC_STATUS_SUCCESS;
 }
 
+static void
+dc_serial_iterator_release (void *item)
+{
+	dc_serial_device_free ((dc_serial_device_t *) item);
+}
+
+#ifdef USE_HOTPLUG
+typedef struct dc_serial_hotplug_entry_t {
+	char name[256];
+	unsigned int id;
+	int seen;
+} dc_serial_hotplug_entry_t;
+
+struct dc_serial_hotplug_t {
+	dc_hotplug_t *hotplug;
+	dc_context_t *context;
+	dc_filter_t filter;
+	int fd;
+	int pipe[2];
+	pthread_t thread;
+	// The devices reported to the application. Once the thread runs,
+	// they are only accessed from that thread.
+	dc_serial_hotplug_entry_t *entries;
+	size_t count;
+	size_t capacity;
+};
+
+static dc_serial_hotplug_entry_t *
+dc_serial_hotplug_find (dc_serial_hotplug_t *backend, const char *name)
+{
+	for (size_t i = 0; i < backend->count; ++i) {
+		if (strcmp (backend->entries[i].name, name) == 0)
+			return backend->entries + i;
+	}
+
+	return NULL;
+}
+
+static void
+dc_serial_hotplug_arrived (dc_serial_hotplug_t *backend, const char *name)
+{
+	dc_serial_hotplug_entry_t *entry = dc_serial_hotplug_find (backend, name);
+	if (entry) {
+		entry->seen = 1;
+		return;
+	}
+
+	if (strlen (name) >= sizeof (entry->name))
+		return;
+
+	if (backend->count >= backend->capacity) {
+		size_t capacity = backend->capacity ? backend->capacity * 2 : 4;
+		dc_serial_hotplug_entry_t *entries = (dc_serial_hotplug_entry_t *) realloc (
+			backend->entries, capacity * sizeof (dc_serial_hotplug_entry_t));
+		if (entries == NULL) {
+			SYSERROR (backend->context, ENOMEM);
+			return;
+		}
+		backend->entries = entries;
+		backend->capacity = capacity;
+	}
+
+	dc_serial_device_t *device = NULL;
+	dc_status_t status = dc_serial_device_new (&device, backend->context, name, backend->filter);
+	if (status != DC_STATUS_SUCCESS)
+		return;
+
+	entry = backend->entries + backend->count++;
+	strcpy (entry->name, name);
+	entry->seen = 1;
+	entry->id = dc_hotplug_arrived (backend->hotplug, DC_TRANSPORT_SERIAL, device);
+}
+
+static void
+dc_serial_hotplug_left (dc_serial_hotplug_t *backend, const char *name)
+{
+	dc_serial_hotplug_entry_t *entry = dc_serial_hotplug_find (backend, name);
+	if (entry == NULL)
+		return;
+
+	unsigned int id = entry->id;
+	*entry = backend->entries[--backend->count];
+
+	dc_hotplug_left (backend->hotplug, DC_TRANSPORT_SERIAL, id);
+}
+
+/*
+ * Synchronize with the contents of the device directory. This is used
+ * for the initial enumeration, and to recover from an overflow of the
+ * inotify queue.
+ */
+static void
+dc_serial_hotplug_scan (dc_serial_hotplug_t *backend)
+{
+	DIR *dp = opendir (DIRNAME);
+	if (dp == NULL) {
+		SYSERROR (backend->context, errno);
+		return;
+	}
+
+	for (size_t i = 0; i < backend->count; ++i) {
+		backend->entries[i].seen = 0;
+	}
+
+	struct dirent *ep = NULL;
+	while ((ep = readdir (dp)) != NULL) {
+		dc_serial_hotplug_arrived (backend, ep->d_name);
+	}
+
+	closedir (dp);
+
+	size_t i = 0;
+	while (i < backend->count) {
+		if (backend->entries[i].seen) {
+			i++;
+		} else {
+			dc_serial_hotplug_left (backend, backend->entries[i].name);
+		}
+	}
+}
+
+static void *
+dc_serial_hotplug_run (void *userdata)
+{
+	dc_serial_hotplug_t *backend = (dc_serial_hotplug_t *) userdata;
+
+	union {
+		struct inotify_event event;
+		char data[4096];
+	} buffer;
+
+	for (;;) {
+		struct pollfd fds[2] = {
+			{backend->fd, POLLIN, 0},
+			{backend->pipe[0], POLLIN, 0},
+		};
+
+		int rc = poll (fds, C_ARRAY_SIZE(fds), -1);
+		if (rc < 0) {
+			if (errno == EINTR)
+				continue;
+			SYSERROR (backend->context, errno);
+			break;
+		}
+
+		// Stop requested.
+		if (fds[1].revents)
+			break;
+
+		ssize_t n = read (backend->fd, buffer.data, sizeof (buffer.data));
+		if (n < 0) {
+			if (errno == EINTR || errno == EAGAIN)
+				continue;
+			SYSERROR (backend->context, errno);
+			break;
+		}
+
+		size_t offset = 0;
+		while (offset + sizeof (struct inotify_event) <= (size_t) n) {
+			const struct inotify_event *event = (const struct inotify_event *) (buffer.data + offset);
+			offset += sizeof (struct inotify_event) + event->len;
+
+			if (event->mask & IN_Q_OVERFLOW) {
+				WARNING (backend->context, "Lost hotplug events, rescanning the devices.");
+				dc_serial_hotplug_scan (backend);
+			} else if (event->len == 0 || (event->mask & IN_ISDIR)) {
+				continue;
+			} else if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+				dc_serial_hotplug_arrived (backend, event->name);
+			} else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+				dc_serial_hotplug_left (backend, event->name);
+			}
+		}
+	}
+
+	return NULL;
+}
+#endif
+
+dc_status_t
+dc_serial_hotplug_new (dc_serial_hotplug_t **out, dc_hotplug_t *hotplug, dc_context_t *context, dc_descriptor_t *descriptor)
+{
+#ifdef USE_HOTPLUG
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_serial_hotplug_t *backend = NULL;
+
+	if (out == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	backend = (dc_serial_hotplug_t *) malloc (sizeof(dc_serial_hotplug_t));
+	if (backend == NULL) {
+		SYSERROR (context, ENOMEM);
+		return DC_STATUS_NOMEMORY;
+	}
+
+	backend->hotplug = hotplug;
+	backend->context = context;
+	backend->filter = dc_descriptor_get_filter (descriptor);
+	backend->entries = NULL;
+	backend->count = 0;
+	backend->capacity = 0;
+
+	backend->fd = inotify_init1 (IN_NONBLOCK | IN_CLOEXEC);
+	if (backend->fd == -1) {
+		int errcode = errno;
+		SYSERROR (context, errcode);
+		status = syserror (errcode);
+		goto error_free;
+	}
+
+	// The watch is added before the initial enumeration, so no device
+	// can get lost in between.
+	if (inotify_add_watch (backend->fd, DIRNAME, IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO) == -1) {
+		int errcode = errno;
+		SYSERROR (context, errcode);
+		status = syserror (errcode);
+		goto error_close;
+	}
+
+	if (pipe (backend->pipe) != 0) {
+		int errcode = errno;
+		SYSERROR (context, errcode);
+		status = syserror (errcode);
+		goto error_close;
+	}
+
+	dc_serial_hotplug_scan (backend);
+
+	if (pthread_create (&backend->thread, NULL, dc_serial_hotplug_run, backend) != 0) {
+		ERROR (context, "Failed to start the hotplug thread.");
+		status = DC_STATUS_IO;
+		goto error_pipe;
+	}
+
+	*out = backend;
+
+	return DC_STATUS_SUCCESS;
+
+error_pipe:
+	close (backend->pipe[0]);
+	close (backend->pipe[1]);
+error_close:
+	close (backend->fd);
+error_free:
+	free (backend->entries);
+	free (backend);
+	return status;
+#else
+	UNUSED (out);
+	UNUSED (hotplug);
+	UNUSED (context);
+	UNUSED (descriptor);
+	return DC_STATUS_UNSUPPORTED;
+#endif
+}
+
+void
+dc_serial_hotplug_free (dc_serial_hotplug_t *backend)
+{
+#ifdef USE_HOTPLUG
+	if (backend == NULL)
+		return;
+
+	// Wake up the thread.
+	char c = 0;
+	while (write (backend->pipe[1], &c, 1) < 0 && errno == EINTR)
+		;
+
+	pthread_join (backend->thread, NULL);
+
+	close (backend->pipe[0]);
+	close (backend->pipe[1]);
+	close (backend->fd);
+
+	free (backend->entries);
+	free (backend);
+#else
+	UNUSED (backend);
+#endif
+}
+
+#ifdef USE_LATENCY_TIMER
+/*
+ * Locate the latency timer of the USB serial converter. Only some
+ * drivers (for example ftdi_sio) provide one.
+ */
+static int
+dc_serial_latency_timer_path (const char *name, char path[], size_t size)
+{
+	char *resolved = realpath (name, NULL);
+	if (resolved == NULL)
+		return -1;
+
+	const char *basename = strrchr (resolved, '/');
+	basename = basename ? basename + 1 : resolved;
+
+	int n = snprintf (path, size, SYSFSDIR "/%s/latency_timer", basename);
+	free (resolved);
+	if (n < 0 || (size_t) n >= size)
+		return -1;
+
+	return access (path, F_OK);
+}
+
+static int
+dc_serial_latency_timer_read (const char *path)
+{
+	FILE *fp = fopen (path, "r");
+	if (fp == NULL)
+		return -1;
+
+	int value = -1;
+	if (fscanf (fp, "%d", &value) != 1)
+		value = -1;
+
+	fclose (fp);
+
+	return value;
+}
+
+static int
+dc_serial_latency_timer_write (const char *path, unsigned int value)
+{
+	FILE *fp = fopen (path, "w");
+	if (fp == NULL)
+		return errno;
+
+	int errcode = 0;
+	if (fprintf (fp, "%u\n", value) < 0)
+		errcode = errno;
+
+	if (fclose (fp) != 0 && errcode == 0)
+		errcode = errno;
+
+	return errcode;
+}
+#endif
+
+/*
+ * Apply the latency settings. Returns zero on success, or the error
+ * code of the first failure.
+ */
+static int
+dc_serial_apply_latency (dc_serial_t *device, unsigned int milliseconds)
+{
+#if defined(TIOCGSERIAL) && defined(TIOCSSERIAL) && !defined(__ANDROID__)
+	// Get the current settings.
+	struct serial_struct ss;
+	if (ioctl (device->fd, TIOCGSERIAL, &ss) != 0) {
+		if (NOPTY)
+			return errno;
+	} else {
+		// Set or clear the low latency flag.
+		if (milliseconds == 0) {
+			ss.flags |= ASYNC_LOW_LATENCY;
+		} else {
+			ss.flags &= ~ASYNC_LOW_LATENCY;
+		}
+
+		// Apply the new settings.
+		if (ioctl (device->fd, TIOCSSERIAL, &ss) != 0 && NOPTY)
+			return errno;
+	}
+#elif defined(IOSSDATALAT)
+	// Set the receive latency in microseconds. Serial drivers use this
+	// value to determine how often to dequeue characters received by
+	// the hardware. A value of zero restores the default value.
+	unsigned long usec = (milliseconds == 0 ? 1 : milliseconds * 1000);
+	if (ioctl (device->fd, IOSSDATALAT, &usec) != 0 && NOPTY)
+		return errno;
+#endif
+
+#ifdef USE_LATENCY_TIMER
+	// The latency timer of the USB serial converter delays every short
+	// response (16 milliseconds by default). Writing it usually requires
+	// extra permissions, so a failure is not an error.
+	if (device->latency_timer >= 0) {
+		unsigned int value = milliseconds;
+		if (value < LATENCY_MIN)
+			value = LATENCY_MIN;
+		if (value > LATENCY_MAX)
+			value = LATENCY_MAX;
+
+		int errcode = dc_serial_latency_timer_write (device->latency_path, value);
+		if (errcode) {
+			DEBUG (device->base.context, "Failed to set the latency timer (%s).", strerror (errcode));
+		}
+	}
+#endif
+
+	return 0;
+}
+
+/*
+ * Restore the initial latency settings.
+ */
+static void
+dc_serial_restore_latency (dc_serial_t *device)
+{
+#if defined(TIOCGSERIAL) && defined(TIOCSSERIAL) && !defined(__ANDROID__)
+	struct serial_struct ss;
+	if (device->lowlatency >= 0 && ioctl (device->fd, TIOCGSERIAL, &ss) == 0) {
+		if (device->lowlatency) {
+			ss.flags |= ASYNC_LOW_LATENCY;
+		} else {
+			ss.flags &= ~ASYNC_LOW_LATENCY;
+		}
+		ioctl (device->fd, TIOCSSERIAL, &ss);
+	}
+#elif defined(IOSSDATALAT)
+	unsigned long usec = 0;
+	ioctl (device->fd, IOSSDATALAT, &usec);
+#endif
+
+#ifdef USE_LATENCY_TIMER
+	if (device->latency_timer >= 0) {
+		dc_serial_latency_timer_write (device->latency_path, device->latency_timer);
+	}
+#endif
+}
+
 dc_status_t
 dc_serial_open (dc_iostream_t **out, dc_context_t *context, const char *name)
 {
@@ -279,6 +799,15 @@ dc_serial_open (dc_iostream_t **out, dc_context_t *context, const char *name)
 
 	// Default to blocking reads.
 	device->timeout = -1;
+	device->configured = 0;
+	memset (&device->config, 0, sizeof (device->config));
+	device->dtr = -1;
+	device->rts = -1;
+	device->brk = -1;
+	device->interrupted = 0;
+	device->lowlatency = -1;
+	device->latency_timer = -1;
+	device->latency_path[0] = 0;
 
 	// Create a high resolution timer.
 	status = dc_timer_new (&device->timer);
@@ -287,6 +816,13 @@ dc_serial_open (dc_iostream_t **out, dc_context_t *context, const char *name)
 		goto error_free;
 	}
 
+	if (pipe (device->pipe) != 0) {
+		int errcode = errno;
+		SYSERROR (context, errcode);
+		status = syserror (errcode);
+		goto error_timer_free;
+	}
+
 	// Open the device in non-blocking mode, to return immediately
 	// without waiting for the modem connection to complete.
 	device->fd = open (name, O_RDWR | O_NOCTTY | O_NONBLOCK);
@@ -294,7 +830,7 @@ dc_serial_open (dc_iostream_t **out, dc_context_t *context, const char *name)
 		int errcode = errno;
 		SYSERROR (context, errcode);
 		status = syserror (errcode);
-		goto error_timer_free;
+		goto error_pipe;
 	}
 
 #ifndef ENABLE_PTY
@@ -318,12 +854,35 @@ dc_serial_open (dc_iostream_t **out, dc_context_t *context, const char *name)
 		goto error_close;
 	}
 
+	// Remember the initial latency settings.
+#if defined(TIOCGSERIAL) && defined(TIOCSSERIAL) && !defined(__ANDROID__)
+	struct serial_struct ss;
+	if (ioctl (device->fd, TIOCGSERIAL, &ss) == 0) {
+		device->lowlatency = (ss.flags & ASYNC_LOW_LATENCY) != 0;
+	}
+#endif
+#ifdef USE_LATENCY_TIMER
+	if (dc_serial_latency_timer_path (name, device->latency_path, sizeof (device->latency_path)) == 0) {
+		device->latency_timer = dc_serial_latency_timer_read (device->latency_path);
+	}
+#endif
+
+	// Enable the low latency mode, to avoid a delay on every short
+	// request and response. Not all drivers support it.
+	int errcode = dc_serial_apply_latency (device, 0);
+	if (errcode) {
+		DEBUG (context, "Failed to enable the low latency mode (%s).", strerror (errcode));
+	}
+
 	*out = (dc_iostream_t *) device;
 
 	return DC_STATUS_SUCCESS;
 
 error_close:
 	close (device->fd);
+error_pipe:
+	close (device->pipe[0]);
+	close (device->pipe[1]);
 error_timer_free:
 	dc_timer_free (device->timer);
 error_free:
@@ -337,6 +896,12 @@ dc_serial_close (dc_iostream_t *abstract)
 	dc_status_t status = DC_STATUS_SUCCESS;
 	dc_serial_t *device = (dc_serial_t *) abstract;
 
+	// Cancel the pending asynchronous transfers.
+	dc_reactor_cancel (abstract);
+
+	// Restore the initial latency settings.
+	dc_serial_restore_latency (device);
+
 	// Restore the initial terminal attributes.
 	if (tcsetattr (device->fd, TCSANOW, &device->tty) != 0) {
 		int errcode = errno;
@@ -360,6 +925,9 @@ dc_serial_close (dc_iostream_t *abstract)
 		dc_status_set_error(&status, syserror (errcode));
 	}
 
+	close (device->pipe[0]);
+	close (device->pipe[1]);
+
 	dc_timer_free (device->timer);
 
 	return status;
@@ -370,6 +938,20 @@ dc_serial_configure (dc_iostream_t *abstract, unsigned int baudrate, unsigned in
 {
 	dc_serial_t *device = (dc_serial_t *) abstract;
 
+	// Skip the request if the settings are already applied.
+	if (device->configured &&
+		device->config.baudrate == baudrate &&
+		device->config.databits == databits &&
+		device->config.parity == parity &&
+		device->config.stopbits == stopbits &&
+		device->config.flowcontrol == flowcontrol)
+		return DC_STATUS_SUCCESS;
+
+	// The state is unknown until the new settings are applied.
+	device->configured = 0;
+	device->dtr = -1;
+	device->rts = -1;
+
 	// Retrieve the current settings.
 	struct termios tty;
 	memset (&tty, 0, sizeof (tty));
@@ -608,6 +1190,13 @@ dc_serial_configure (dc_iostream_t *abstract, unsigned int baudrate, unsigned in
 #endif
 	}
 
+	device->config.baudrate = baudrate;
+	device->config.databits = databits;
+	device->config.parity = parity;
+	device->config.stopbits = stopbits;
+	device->config.flowcontrol = flowcontrol;
+	device->configured = 1;
+
 	return DC_STATUS_SUCCESS;
 }
 
@@ -626,93 +1215,82 @@ dc_serial_set_latency (dc_iostream_t *abstract, unsigned int milliseconds)
 {
 	dc_serial_t *device = (dc_serial_t *) abstract;
 
-#if defined(TIOCGSERIAL) && defined(TIOCSSERIAL) && !defined(__ANDROID__)
-	// Get the current settings.
-	struct serial_struct ss;
-	if (ioctl (device->fd, TIOCGSERIAL, &ss) != 0 && NOPTY) {
-		int errcode = errno;
+	int errcode = dc_serial_apply_latency (device, milliseconds);
+	if (errcode) {
 		SYSERROR (abstract->context, errcode);
 		return syserror (errcode);
 	}
 
-	// Set or clear the low latency flag.
-	if (milliseconds == 0) {
-		ss.flags |= ASYNC_LOW_LATENCY;
-	} else {
-		ss.flags &= ~ASYNC_LOW_LATENCY;
-	}
+	return DC_STATUS_SUCCESS;
+}
 
-	// Apply the new settings.
-	if (ioctl (device->fd, TIOCSSERIAL, &ss) != 0 && NOPTY) {
-		int errcode = errno;
-		SYSERROR (abstract->context, errcode);
-		return syserror (errcode);
-	}
-#elif defined(IOSSDATALAT)
-	// Set the receive latency in microseconds. Serial drivers use this
-	// value to determine how often to dequeue characters received by
-	// the hardware. A value of zero restores the default value.
-	unsigned long usec = (milliseconds == 0 ? 1 : milliseconds * 1000);
-	if (ioctl (device->fd, IOSSDATALAT, &usec) != 0 && NOPTY) {
-		int errcode = errno;
-		SYSERROR (abstract->context, errcode);
-		return syserror (errcode);
+static size_t
+dc_serial_iovec_size (const struct iovec iov[], int count)
+{
+	size_t size = 0;
+	for (int i = 0; i < count; ++i)
+		size += iov[i].iov_len;
+	return size;
+}
+
+static void
+dc_serial_iovec_advance (struct iovec **iov, int *count, size_t n)
+{
+	while (*count && n >= (*iov)->iov_len) {
+		n -= (*iov)->iov_len;
+		(*iov)++;
+		(*count)--;
 	}
-#endif
 
-	return DC_STATUS_SUCCESS;
+	if (*count && n) {
+		(*iov)->iov_base = (char *) (*iov)->iov_base + n;
+		(*iov)->iov_len -= n;
+	}
 }
 
 static dc_status_t
-dc_serial_read (dc_iostream_t *abstract, void *data, size_t size, size_t *actual)
+dc_serial_transfer_read (dc_iostream_t *abstract, struct iovec iov[], int count, size_t *actual)
 {
 	dc_status_t status = DC_STATUS_SUCCESS;
 	dc_serial_t *device = (dc_serial_t *) abstract;
 	size_t nbytes = 0;
+	size_t size = dc_serial_iovec_size (iov, count);
 
-	// The absolute target time.
+	// The absolute target time, on the monotonic clock.
 	dc_usecs_t target = 0;
+	if (device->timeout > 0) {
+		status = dc_timer_now (device->timer, &target);
+		if (status != DC_STATUS_SUCCESS) {
+			goto out;
+		}
+
+		target += (dc_usecs_t) device->timeout * 1000;
+	}
 
-	int init = 1;
 	while (nbytes < size) {
-		fd_set fds;
-		FD_ZERO (&fds);
-		FD_SET (device->fd, &fds);
+		struct pollfd pfd[2] = {
+			{device->fd, POLLIN, 0},
+			{device->pipe[0], POLLIN, 0},
+		};
 
-		struct timeval tv, *ptv = NULL;
+		int timeout = device->timeout;
 		if (device->timeout > 0) {
-			dc_usecs_t timeout = 0;
-
 			dc_usecs_t now = 0;
 			status = dc_timer_now (device->timer, &now);
 			if (status != DC_STATUS_SUCCESS) {
 				goto out;
 			}
 
-			if (init) {
-				// Calculate the initial timeout.
-				timeout = (dc_usecs_t) device->timeout * 1000;
-				// Calculate the target time.
-				target = now + timeout;
-				init = 0;
+			// Calculate the remaining timeout (rounded up to the next
+			// millisecond, to avoid waking up just before the deadline).
+			if (now < target) {
+				timeout = (target - now + 999) / 1000;
 			} else {
-				// Calculate the remaining timeout.
-				if (now < target) {
-					timeout = target - now;
-				} else {
-					timeout = 0;
-				}
+				timeout = 0;
 			}
-			tv.tv_sec  = timeout / 1000000;
-			tv.tv_usec = timeout % 1000000;
-			ptv = &tv;
-		} else if (device->timeout == 0) {
-			tv.tv_sec  = 0;
-			tv.tv_usec = 0;
-			ptv = &tv;
 		}
 
-		int rc = select (device->fd + 1, &fds, NULL, NULL, ptv);
+		int rc = poll (pfd, C_ARRAY_SIZE(pfd), timeout);
 		if (rc < 0) {
 			int errcode = errno;
 			if (errcode == EINTR)
@@ -722,9 +1300,12 @@ dc_serial_read (dc_iostream_t *abstract, void *data, size_t size, size_t *actual
 			goto out;
 		} else if (rc == 0) {
 			break; // Timeout.
+		} else if (pfd[1].revents) {
+			status = DC_STATUS_CANCELLED;
+			goto out;
 		}
 
-		ssize_t n = read (device->fd, (char *) data + nbytes, size - nbytes);
+		ssize_t n = readv (device->fd, iov, count);
 		if (n < 0) {
 			int errcode = errno;
 			if (errcode == EINTR || errcode == EAGAIN)
@@ -737,6 +1318,7 @@ dc_serial_read (dc_iostream_t *abstract, void *data, size_t size, size_t *actual
 		}
 
 		nbytes += n;
+		dc_serial_iovec_advance (&iov, &count, n);
 	}
 
 	if (nbytes != size) {
@@ -751,18 +1333,20 @@ out:
 }
 
 static dc_status_t
-dc_serial_write (dc_iostream_t *abstract, const void *data, size_t size, size_t *actual)
+dc_serial_transfer_write (dc_iostream_t *abstract, struct iovec iov[], int count, size_t *actual)
 {
 	dc_status_t status = DC_STATUS_SUCCESS;
 	dc_serial_t *device = (dc_serial_t *) abstract;
 	size_t nbytes = 0;
+	size_t size = dc_serial_iovec_size (iov, count);
 
 	while (nbytes < size) {
-		fd_set fds;
-		FD_ZERO (&fds);
-		FD_SET (device->fd, &fds);
+		struct pollfd pfd[2] = {
+			{device->fd, POLLOUT, 0},
+			{device->pipe[0], POLLIN, 0},
+		};
 
-		int rc = select (device->fd + 1, NULL, &fds, NULL, NULL);
+		int rc = poll (pfd, C_ARRAY_SIZE(pfd), -1);
 		if (rc < 0) {
 			int errcode = errno;
 			if (errcode == EINTR)
@@ -772,9 +1356,12 @@ dc_serial_write (dc_iostream_t *abstract, const void *data, size_t size, size_t
 			goto out;
 		} else if (rc == 0) {
 			break; // Timeout.
+		} else if (pfd[1].revents) {
+			status = DC_STATUS_CANCELLED;
+			goto out;
 		}
 
-		ssize_t n = write (device->fd, (const char *) data + nbytes, size - nbytes);
+		ssize_t n = writev (device->fd, iov, count);
 		if (n < 0) {
 			int errcode = errno;
 			if (errcode == EINTR || errcode == EAGAIN)
@@ -787,6 +1374,7 @@ dc_serial_write (dc_iostream_t *abstract, const void *data, size_t size, size_t
 		}
 
 		nbytes += n;
+		dc_serial_iovec_advance (&iov, &count, n);
 	}
 
 	// Wait until all data has been transmitted.
@@ -811,6 +1399,86 @@ out:
 	return status;
 }
 
+static dc_status_t
+dc_serial_read (dc_iostream_t *abstract, void *data, size_t size, size_t *actual)
+{
+	struct iovec iov;
+	iov.iov_base = data;
+	iov.iov_len = size;
+
+	return dc_serial_transfer_read (abstract, &iov, 1, actual);
+}
+
+static dc_status_t
+dc_serial_write (dc_iostream_t *abstract, const void *data, size_t size, size_t *actual)
+{
+	struct iovec iov;
+	iov.iov_base = (void *) data;
+	iov.iov_len = size;
+
+	return dc_serial_transfer_write (abstract, &iov, 1, actual);
+}
+
+static dc_status_t
+dc_serial_readv (dc_iostream_t *abstract, const dc_iovec_t iov[], size_t count, size_t *actual)
+{
+	struct iovec buffer[MAXIOV];
+
+	if (count > MAXIOV)
+		return DC_STATUS_UNSUPPORTED;
+
+	for (size_t i = 0; i < count; ++i) {
+		buffer[i].iov_base = iov[i].data;
+		buffer[i].iov_len = iov[i].size;
+	}
+
+	return dc_serial_transfer_read (abstract, buffer, count, actual);
+}
+
+static dc_status_t
+dc_serial_writev (dc_iostream_t *abstract, const dc_iovec_t iov[], size_t count, size_t *actual)
+{
+	struct iovec buffer[MAXIOV];
+
+	if (count > MAXIOV)
+		return DC_STATUS_UNSUPPORTED;
+
+	for (size_t i = 0; i < count; ++i) {
+		buffer[i].iov_base = iov[i].data;
+		buffer[i].iov_len = iov[i].size;
+	}
+
+	return dc_serial_transfer_write (abstract, buffer, count, actual);
+}
+
+static dc_status_t
+dc_serial_wait_readable (dc_iostream_t *abstract, int timeout)
+{
+	dc_serial_t *device = (dc_serial_t *) abstract;
+
+	while (1) {
+		struct pollfd pfd[2] = {
+			{device->fd, POLLIN, 0},
+			{device->pipe[0], POLLIN, 0},
+		};
+
+		int rc = poll (pfd, C_ARRAY_SIZE(pfd), timeout);
+		if (rc < 0) {
+			int errcode = errno;
+			if (errcode == EINTR)
+				continue; // Retry.
+			SYSERROR (abstract->context, errcode);
+			return syserror (errcode);
+		} else if (rc == 0) {
+			return DC_STATUS_TIMEOUT;
+		} else if (pfd[1].revents) {
+			return DC_STATUS_CANCELLED;
+		}
+
+		return DC_STATUS_SUCCESS;
+	}
+}
+
 static dc_status_t
 dc_serial_purge (dc_iostream_t *abstract, dc_direction_t direction)
 {
@@ -852,6 +1520,13 @@ dc_serial_set_break (dc_iostream_t *abstract, unsigned int level)
 {
 	dc_serial_t *device = (dc_serial_t *) abstract;
 
+	// Skip the request if the state doesn't change.
+	int state = (level != 0);
+	if (device->brk == state)
+		return DC_STATUS_SUCCESS;
+
+	device->brk = -1;
+
 	unsigned long action = (level ? TIOCSBRK : TIOCCBRK);
 
 	if (ioctl (device->fd, action, NULL) != 0 && NOPTY) {
@@ -860,6 +1535,8 @@ dc_serial_set_break (dc_iostream_t *abstract, unsigned int level)
 		return syserror (errcode);
 	}
 
+	device->brk = state;
+
 	return DC_STATUS_SUCCESS;
 }
 
@@ -868,6 +1545,13 @@ dc_serial_set_dtr (dc_iostream_t *abstract, unsigned int level)
 {
 	dc_serial_t *device = (dc_serial_t *) abstract;
 
+	// Skip the request if the state doesn't change.
+	int state = (level != 0);
+	if (device->dtr == state)
+		return DC_STATUS_SUCCESS;
+
+	device->dtr = -1;
+
 	unsigned long action = (level ? TIOCMBIS : TIOCMBIC);
 
 	int value = TIOCM_DTR;
@@ -877,6 +1561,8 @@ dc_serial_set_dtr (dc_iostream_t *abstract, unsigned int level)
 		return syserror (errcode);
 	}
 
+	device->dtr = state;
+
 	return DC_STATUS_SUCCESS;
 }
 
@@ -885,6 +1571,13 @@ dc_serial_set_rts (dc_iostream_t *abstract, unsigned int level)
 {
 	dc_serial_t *device = (dc_serial_t *) abstract;
 
+	// Skip the request if the state doesn't change.
+	int state = (level != 0);
+	if (device->rts == state)
+		return DC_STATUS_SUCCESS;
+
+	device->rts = -1;
+
 	unsigned long action = (level ? TIOCMBIS : TIOCMBIC);
 
 	int value = TIOCM_RTS;
@@ -894,6 +1587,8 @@ dc_serial_set_rts (dc_iostream_t *abstract, unsigned int level)
 		return syserror (errcode);
 	}
 
+	device->rts = state;
+
 	return DC_STATUS_SUCCESS;
 }
 
@@ -946,17 +1641,82 @@ dc_serial_get_lines (dc_iostream_t *abstract, unsigned int *value)
 static dc_status_t
 dc_serial_sleep (dc_iostream_t *abstract, unsigned int timeout)
 {
-	struct timespec ts;
-	ts.tv_sec  = (timeout / 1000);
-	ts.tv_nsec = (timeout % 1000) * 1000000;
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_serial_t *device = (dc_serial_t *) abstract;
 
-	while (nanosleep (&ts, &ts) != 0) {
-		int errcode = errno;
-		if (errcode != EINTR ) {
+	// The absolute target time, on the monotonic clock.
+	dc_usecs_t target = 0;
+	status = dc_timer_now (device->timer, &target);
+	if (status != DC_STATUS_SUCCESS)
+		return status;
+
+	target += (dc_usecs_t) timeout * 1000;
+
+	// Wait on the self-pipe, to be able to interrupt the sleep.
+	for (;;) {
+		dc_usecs_t now = 0;
+		status = dc_timer_now (device->timer, &now);
+		if (status != DC_STATUS_SUCCESS)
+			return status;
+
+		if (now >= target)
+			break;
+
+		struct pollfd pfd = {device->pipe[0], POLLIN, 0};
+		int rc = poll (&pfd, 1, (target - now + 999) / 1000);
+		if (rc < 0) {
+			int errcode = errno;
+			if (errcode == EINTR)
+				continue; // Retry.
 			SYSERROR (abstract->context, errcode);
 			return syserror (errcode);
+		} else if (rc > 0) {
+			return DC_STATUS_CANCELLED;
 		}
 	}
 
 	return DC_STATUS_SUCCESS;
 }
+
+static dc_status_t
+dc_serial_interrupt (dc_iostream_t *abstract)
+{
+	dc_serial_t *device = (dc_serial_t *) abstract;
+
+	// A single byte is enough, because it's never read.
+	if (device->interrupted)
+		return DC_STATUS_SUCCESS;
+
+	device->interrupted = 1;
+
+	char c = 0;
+	while (write (device->pipe[1], &c, 1) < 0) {
+		int errcode = errno;
+		if (errcode != EINTR)
+			return syserror (errcode);
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_serial_read_async (dc_iostream_t *abstract, void *data, size_t size, dc_iostream_callback_t callback, void *userdata)
+{
+	dc_serial_t *device = (dc_serial_t *) abstract;
+
+	return dc_reactor_submit (abstract, device->fd, 0, DC_DIRECTION_INPUT, data, size, device->timeout, callback, userdata);
+}
+
+static dc_status_t
+dc_serial_write_async (dc_iostream_t *abstract, const void *data, size_t size, dc_iostream_callback_t callback, void *userdata)
+{
+	dc_serial_t *device = (dc_serial_t *) abstract;
+
+	return dc_reactor_submit (abstract, device->fd, 0, DC_DIRECTION_OUTPUT, (void *) data, size, -1, callback, userdata);
+}
+
+static dc_status_t
+dc_serial_cancel (dc_iostream_t *abstract)
+{
+	return dc_reactor_cancel (abstract);
+}
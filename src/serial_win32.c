@@ -19,7 +19,10 @@
  * MA 02110-1301 USA
  */
 
+#define LOG_SUBSYSTEM DC_LOGSUBSYSTEM_IOSTREAM
+
 #include <stdlib.h>
+#include <string.h>
 
 #define NOGDI
 #include <windows.h>
@@ -31,9 +34,19 @@
 #include "iostream-private.h"
 #include "iterator-private.h"
 #include "descriptor-private.h"
+#include "hotplug-private.h"
+#include "timer.h"
+
+// Size of the internal read-ahead buffer.
+#define RXSIZE 4096
+
+// Maximum time a read-ahead request waits for the first byte, before it
+// completes without any data and gets submitted again (milliseconds).
+#define RXIDLE 1000
 
 static dc_status_t dc_serial_iterator_next (dc_iterator_t *iterator, void *item);
 static dc_status_t dc_serial_iterator_free (dc_iterator_t *iterator);
+static void dc_serial_iterator_release (void *item);
 
 static dc_status_t dc_serial_set_timeout (dc_iostream_t *iostream, int timeout);
 static dc_status_t dc_serial_set_latency (dc_iostream_t *iostream, unsigned int value);
@@ -49,6 +62,7 @@ static dc_status_t dc_serial_flush (dc_iostream_t *iostream);
 static dc_status_t dc_serial_purge (dc_iostream_t *iostream, dc_direction_t direction);
 static dc_status_t dc_serial_sleep (dc_iostream_t *iostream, unsigned int milliseconds);
 static dc_status_t dc_serial_close (dc_iostream_t *iostream);
+static dc_status_t dc_serial_interrupt (dc_iostream_t *iostream);
 
 struct dc_serial_device_t {
 	char name[256];
@@ -62,12 +76,39 @@ typedef struct dc_serial_iterator_t {
 	DWORD current;
 } dc_serial_iterator_t;
 
+typedef struct dc_serial_config_t {
+	unsigned int baudrate;
+	unsigned int databits;
+	dc_parity_t parity;
+	dc_stopbits_t stopbits;
+	dc_flowcontrol_t flowcontrol;
+} dc_serial_config_t;
+
 typedef struct dc_serial_t {
 	dc_iostream_t base;
 	/*
 	 * The file descriptor corresponding to the serial port.
 	 */
 	HANDLE hFile;
+	/*
+	 * All transfers are overlapped. A read-ahead request is kept
+	 * pending, and completes as soon as some data arrives. That data is
+	 * buffered until it's consumed. A timeout only abandons the wait,
+	 * not the request itself, so no data is lost between two reads.
+	 */
+	OVERLAPPED rx;
+	int rxpending;
+	DWORD rxoffset;
+	DWORD rxsize;
+	unsigned char rxbuffer[RXSIZE];
+	OVERLAPPED tx;
+	/*
+	 * Manual-reset event, signalled to interrupt the blocking transfers
+	 * from another thread. Once signalled, it remains signalled.
+	 */
+	HANDLE hInterrupt;
+	dc_timer_t *timer;
+	int timeout;
 	/*
 	 * Serial port settings are saved into this variables immediately
 	 * after the port is opened. These settings are restored when the
@@ -75,12 +116,25 @@ typedef struct dc_serial_t {
 	 */
 	DCB dcb;
 	COMMTIMEOUTS timeouts;
+	/*
+	 * The settings which were applied last, to skip the requests that
+	 * wouldn't change anything. The state of the modem control lines is
+	 * unknown (negative) until the lines are set explicitly, and after
+	 * each change of the configuration, which may change them as well.
+	 */
+	int configured;
+	dc_serial_config_t config;
+	int dtr;
+	int rts;
+	int brk;
 } dc_serial_t;
 
 static const dc_iterator_vtable_t dc_serial_iterator_vtable = {
 	sizeof(dc_serial_iterator_t),
 	dc_serial_iterator_next,
 	dc_serial_iterator_free,
+	NULL,
+	dc_serial_iterator_release,
 };
 
 static const dc_iostream_vtable_t dc_serial_vtable = {
@@ -99,6 +153,13 @@ static const dc_iostream_vtable_t dc_serial_vtable = {
 	dc_serial_purge, /* purge */
 	dc_serial_sleep, /* sleep */
 	dc_serial_close, /* close */
+	NULL, /* get_name */
+	NULL, /* read_async */
+	NULL, /* write_async */
+	NULL, /* cancel */
+	NULL, /* readv */
+	NULL, /* writev */
+	dc_serial_interrupt, /* interrupt */	NULL, /* wait_readable */
 };
 
 static dc_status_t
@@ -118,6 +179,107 @@ syserror(DWORD errcode)
 	}
 }
 
+/*
+ * Wait until the event is signalled, the timeout (in milliseconds, or
+ * INFINITE) expires, or the transfers are interrupted.
+ */
+static dc_status_t
+dc_serial_wait (dc_serial_t *device, HANDLE hEvent, DWORD timeout)
+{
+	// The interrupt goes first, to take precedence over the event.
+	HANDLE handles[2] = {device->hInterrupt, hEvent};
+
+	DWORD rc = WaitForMultipleObjects (2, handles, FALSE, timeout);
+	switch (rc) {
+	case WAIT_OBJECT_0:
+		return DC_STATUS_CANCELLED;
+	case WAIT_OBJECT_0 + 1:
+		return DC_STATUS_SUCCESS;
+	case WAIT_TIMEOUT:
+		return DC_STATUS_TIMEOUT;
+	default:
+		break;
+	}
+
+	DWORD errcode = GetLastError ();
+	SYSERROR (device->base.context, errcode);
+	return syserror (errcode);
+}
+
+/*
+ * Submit the read-ahead request, unless there is one pending already, or
+ * there is still buffered data. A request which completes immediately
+ * signals the event as well, so both cases are handled the same way.
+ */
+static dc_status_t
+dc_serial_rx_submit (dc_serial_t *device)
+{
+	if (device->rxpending || device->rxoffset < device->rxsize)
+		return DC_STATUS_SUCCESS;
+
+	device->rxoffset = 0;
+	device->rxsize = 0;
+	device->rx.Offset = 0;
+	device->rx.OffsetHigh = 0;
+
+	if (!ReadFile (device->hFile, device->rxbuffer, sizeof (device->rxbuffer), NULL, &device->rx)) {
+		DWORD errcode = GetLastError ();
+		if (errcode != ERROR_IO_PENDING) {
+			SYSERROR (device->base.context, errcode);
+			return syserror (errcode);
+		}
+	}
+
+	device->rxpending = 1;
+
+	return DC_STATUS_SUCCESS;
+}
+
+/*
+ * Collect the result of the read-ahead request. With the wait flag, the
+ * request is allowed to be still in progress.
+ */
+static dc_status_t
+dc_serial_rx_complete (dc_serial_t *device, BOOL wait)
+{
+	DWORD dwRead = 0;
+
+	device->rxpending = 0;
+
+	if (!GetOverlappedResult (device->hFile, &device->rx, &dwRead, wait)) {
+		DWORD errcode = GetLastError ();
+		// A purged request completes without any data.
+		if (errcode != ERROR_OPERATION_ABORTED) {
+			SYSERROR (device->base.context, errcode);
+			return syserror (errcode);
+		}
+		dwRead = 0;
+	}
+
+	device->rxoffset = 0;
+	device->rxsize = dwRead;
+
+	return DC_STATUS_SUCCESS;
+}
+
+/*
+ * Abort the pending read-ahead request, and wait until it has finished,
+ * because it writes into the buffer.
+ */
+static void
+dc_serial_rx_abort (dc_serial_t *device)
+{
+	if (device->rxpending) {
+		DWORD dwRead = 0;
+		CancelIo (device->hFile);
+		GetOverlappedResult (device->hFile, &device->rx, &dwRead, TRUE);
+		device->rxpending = 0;
+	}
+
+	device->rxoffset = 0;
+	device->rxsize = 0;
+}
+
 const char *
 dc_serial_device_get_name (dc_serial_device_t *device)
 {
@@ -251,6 +413,28 @@ dc_serial_iterator_free (dc_iterator_t *abstract)
 	return DC_STATUS_SUCCESS;
 }
 
+static void
+dc_serial_iterator_release (void *item)
+{
+	dc_serial_device_free ((dc_serial_device_t *) item);
+}
+
+dc_status_t
+dc_serial_hotplug_new (dc_serial_hotplug_t **out, dc_hotplug_t *hotplug, dc_context_t *context, dc_descriptor_t *descriptor)
+{
+	UNUSED (out);
+	UNUSED (hotplug);
+	UNUSED (context);
+	UNUSED (descriptor);
+	return DC_STATUS_UNSUPPORTED;
+}
+
+void
+dc_serial_hotplug_free (dc_serial_hotplug_t *backend)
+{
+	UNUSED (backend);
+}
+
 dc_status_t
 dc_serial_open (dc_iostream_t **out, dc_context_t *context, const char *name)
 {
@@ -282,18 +466,48 @@ dc_serial_open (dc_iostream_t **out, dc_context_t *context, const char *name)
 		return DC_STATUS_NOMEMORY;
 	}
 
+	device->rxpending = 0;
+	device->rxoffset = 0;
+	device->rxsize = 0;
+	device->timeout = -1;
+	device->configured = 0;
+	memset (&device->config, 0, sizeof (device->config));
+	device->dtr = -1;
+	device->rts = -1;
+	device->brk = -1;
+	memset (&device->rx, 0, sizeof (device->rx));
+	memset (&device->tx, 0, sizeof (device->tx));
+
+	// Create the timer.
+	status = dc_timer_new (&device->timer);
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR (context, "Failed to create a high resolution timer.");
+		goto error_free;
+	}
+
+	// Create the events. Overlapped transfers need manual-reset events.
+	device->rx.hEvent = CreateEventA (NULL, TRUE, FALSE, NULL);
+	device->tx.hEvent = CreateEventA (NULL, TRUE, FALSE, NULL);
+	device->hInterrupt = CreateEventA (NULL, TRUE, FALSE, NULL);
+	if (device->rx.hEvent == NULL || device->tx.hEvent == NULL || device->hInterrupt == NULL) {
+		DWORD errcode = GetLastError ();
+		SYSERROR (context, errcode);
+		status = syserror (errcode);
+		goto error_events;
+	}
+
 	// Open the device.
 	device->hFile = CreateFileA (devname,
 			GENERIC_READ | GENERIC_WRITE, 0,
 			NULL, // No security attributes.
 			OPEN_EXISTING,
-			0, // Non-overlapped I/O.
+			FILE_FLAG_OVERLAPPED,
 			NULL);
 	if (device->hFile == INVALID_HANDLE_VALUE) {
 		DWORD errcode = GetLastError ();
 		SYSERROR (context, errcode);
 		status = syserror (errcode);
-		goto error_free;
+		goto error_events;
 	}
 
 	// Retrieve the current communication settings and timeouts,
@@ -308,12 +522,37 @@ dc_serial_open (dc_iostream_t **out, dc_context_t *context, const char *name)
 		goto error_close;
 	}
 
+	// The timeouts are fixed, and only apply to the read-ahead request:
+	// it returns immediately with the bytes already received, or waits
+	// at most RXIDLE milliseconds for the first byte to arrive. The real
+	// timeout is applied when waiting for the request to complete.
+	COMMTIMEOUTS timeouts;
+	timeouts.ReadIntervalTimeout = MAXDWORD;
+	timeouts.ReadTotalTimeoutMultiplier = MAXDWORD;
+	timeouts.ReadTotalTimeoutConstant = RXIDLE;
+	timeouts.WriteTotalTimeoutMultiplier = 0;
+	timeouts.WriteTotalTimeoutConstant = 0;
+	if (!SetCommTimeouts (device->hFile, &timeouts)) {
+		DWORD errcode = GetLastError ();
+		SYSERROR (context, errcode);
+		status = syserror (errcode);
+		goto error_close;
+	}
+
 	*out = (dc_iostream_t *) device;
 
 	return DC_STATUS_SUCCESS;
 
 error_close:
 	CloseHandle (device->hFile);
+error_events:
+	if (device->hInterrupt)
+		CloseHandle (device->hInterrupt);
+	if (device->tx.hEvent)
+		CloseHandle (device->tx.hEvent);
+	if (device->rx.hEvent)
+		CloseHandle (device->rx.hEvent);
+	dc_timer_free (device->timer);
 error_free:
 	dc_iostream_deallocate ((dc_iostream_t *) device);
 	return status;
@@ -325,6 +564,9 @@ dc_serial_close (dc_iostream_t *abstract)
 	dc_status_t status = DC_STATUS_SUCCESS;
 	dc_serial_t *device = (dc_serial_t *) abstract;
 
+	// Finish the pending read-ahead request.
+	dc_serial_rx_abort (device);
+
 	// Restore the initial communication settings and timeouts.
 	if (!SetCommState (device->hFile, &device->dcb) ||
 		!SetCommTimeouts (device->hFile, &device->timeouts)) {
@@ -340,6 +582,12 @@ dc_serial_close (dc_iostream_t *abstract)
 		dc_status_set_error(&status, syserror (errcode));
 	}
 
+	CloseHandle (device->hInterrupt);
+	CloseHandle (device->tx.hEvent);
+	CloseHandle (device->rx.hEvent);
+
+	dc_timer_free (device->timer);
+
 	return status;
 }
 
@@ -348,6 +596,20 @@ dc_serial_configure (dc_iostream_t *abstract, unsigned int baudrate, unsigned in
 {
 	dc_serial_t *device = (dc_serial_t *) abstract;
 
+	// Skip the request if the settings are already applied.
+	if (device->configured &&
+		device->config.baudrate == baudrate &&
+		device->config.databits == databits &&
+		device->config.parity == parity &&
+		device->config.stopbits == stopbits &&
+		device->config.flowcontrol == flowcontrol)
+		return DC_STATUS_SUCCESS;
+
+	// The state is unknown until the new settings are applied.
+	device->configured = 0;
+	device->dtr = -1;
+	device->rts = -1;
+
 	// Retrieve the current settings.
 	DCB dcb;
 	if (!GetCommState (device->hFile, &dcb)) {
@@ -446,6 +708,13 @@ dc_serial_configure (dc_iostream_t *abstract, unsigned int baudrate, unsigned in
 		return syserror (errcode);
 	}
 
+	device->config.baudrate = baudrate;
+	device->config.databits = databits;
+	device->config.parity = parity;
+	device->config.stopbits = stopbits;
+	device->config.flowcontrol = flowcontrol;
+	device->configured = 1;
+
 	return DC_STATUS_SUCCESS;
 }
 
@@ -454,44 +723,9 @@ dc_serial_set_timeout (dc_iostream_t *abstract, int timeout)
 {
 	dc_serial_t *device = (dc_serial_t *) abstract;
 
-	// Retrieve the current timeouts.
-	COMMTIMEOUTS timeouts;
-	if (!GetCommTimeouts (device->hFile, &timeouts)) {
-		DWORD errcode = GetLastError ();
-		SYSERROR (abstract->context, errcode);
-		return syserror (errcode);
-	}
-
-	// Update the settings.
-	if (timeout < 0) {
-		// Blocking mode.
-		timeouts.ReadIntervalTimeout = 0;
-		timeouts.ReadTotalTimeoutMultiplier = 0;
-		timeouts.ReadTotalTimeoutConstant = 0;
-		timeouts.WriteTotalTimeoutMultiplier = 0;
-		timeouts.WriteTotalTimeoutConstant = 0;
-	} else if (timeout == 0) {
-		// Non-blocking mode.
-		timeouts.ReadIntervalTimeout = MAXDWORD;
-		timeouts.ReadTotalTimeoutMultiplier = 0;
-		timeouts.ReadTotalTimeoutConstant = 0;
-		timeouts.WriteTotalTimeoutMultiplier = 0;
-		timeouts.WriteTotalTimeoutConstant = 0;
-	} else {
-		// Standard timeout mode.
-		timeouts.ReadIntervalTimeout = 0;
-		timeouts.ReadTotalTimeoutMultiplier = 0;
-		timeouts.ReadTotalTimeoutConstant = timeout;
-		timeouts.WriteTotalTimeoutMultiplier = 0;
-		timeouts.WriteTotalTimeoutConstant = 0;
-	}
-
-	// Activate the new timeouts.
-	if (!SetCommTimeouts (device->hFile, &timeouts)) {
-		DWORD errcode = GetLastError ();
-		SYSERROR (abstract->context, errcode);
-		return syserror (errcode);
-	}
+	// The timeout is applied when waiting for the transfers, so the
+	// communication timeouts remain untouched.
+	device->timeout = timeout;
 
 	return DC_STATUS_SUCCESS;
 }
@@ -507,22 +741,80 @@ dc_serial_read (dc_iostream_t *abstract, void *data, size_t size, size_t *actual
 {
 	dc_status_t status = DC_STATUS_SUCCESS;
 	dc_serial_t *device = (dc_serial_t *) abstract;
-	DWORD dwRead = 0;
+	unsigned char *buffer = (unsigned char *) data;
+	size_t nbytes = 0;
+
+	// The absolute target time.
+	dc_usecs_t target = 0;
+	if (device->timeout > 0) {
+		dc_usecs_t now = 0;
+		status = dc_timer_now (device->timer, &now);
+		if (status != DC_STATUS_SUCCESS) {
+			goto out;
+		}
 
-	if (!ReadFile (device->hFile, data, size, &dwRead, NULL)) {
-		DWORD errcode = GetLastError ();
-		SYSERROR (abstract->context, errcode);
-		status = syserror (errcode);
-		goto out;
+		target = now + (dc_usecs_t) device->timeout * 1000;
 	}
 
-	if (dwRead != size) {
+	while (nbytes < size) {
+		// Consume the buffered data first.
+		DWORD available = device->rxsize - device->rxoffset;
+		if (available) {
+			size_t n = size - nbytes;
+			if (n > available)
+				n = available;
+
+			memcpy (buffer + nbytes, device->rxbuffer + device->rxoffset, n);
+			device->rxoffset += n;
+			nbytes += n;
+			continue;
+		}
+
+		status = dc_serial_rx_submit (device);
+		if (status != DC_STATUS_SUCCESS) {
+			goto out;
+		}
+
+		// Calculate the remaining timeout.
+		DWORD timeout = INFINITE;
+		if (device->timeout == 0) {
+			timeout = 0;
+		} else if (device->timeout > 0) {
+			dc_usecs_t now = 0;
+			status = dc_timer_now (device->timer, &now);
+			if (status != DC_STATUS_SUCCESS) {
+				goto out;
+			}
+
+			if (now >= target) {
+				timeout = 0;
+			} else {
+				timeout = (target - now + 999) / 1000;
+			}
+		}
+
+		// Wait for the read-ahead request. On timeout, the request
+		// remains pending, and its data goes to the next read.
+		status = dc_serial_wait (device, device->rx.hEvent, timeout);
+		if (status == DC_STATUS_TIMEOUT) {
+			break;
+		} else if (status != DC_STATUS_SUCCESS) {
+			goto out;
+		}
+
+		status = dc_serial_rx_complete (device, FALSE);
+		if (status != DC_STATUS_SUCCESS) {
+			goto out;
+		}
+	}
+
+	if (nbytes != size) {
 		status = DC_STATUS_TIMEOUT;
 	}
 
 out:
 	if (actual)
-		*actual = dwRead;
+		*actual = nbytes;
 
 	return status;
 }
@@ -534,14 +826,36 @@ dc_serial_write (dc_iostream_t *abstract, const void *data, size_t size, size_t
 	dc_serial_t *device = (dc_serial_t *) abstract;
 	DWORD dwWritten = 0;
 
-	if (!WriteFile (device->hFile, data, size, &dwWritten, NULL)) {
+	device->tx.Offset = 0;
+	device->tx.OffsetHigh = 0;
+
+	if (!WriteFile (device->hFile, data, size, NULL, &device->tx)) {
 		DWORD errcode = GetLastError ();
-		SYSERROR (abstract->context, errcode);
-		status = syserror (errcode);
+		if (errcode != ERROR_IO_PENDING) {
+			SYSERROR (abstract->context, errcode);
+			status = syserror (errcode);
+			goto out;
+		}
+	}
+
+	status = dc_serial_wait (device, device->tx.hEvent, INFINITE);
+	if (status != DC_STATUS_SUCCESS) {
+		// The data must remain valid until the request has finished.
+		// This also aborts the read-ahead request, which completes
+		// without any data.
+		CancelIo (device->hFile);
+	}
+
+	if (!GetOverlappedResult (device->hFile, &device->tx, &dwWritten, TRUE)) {
+		DWORD errcode = GetLastError ();
+		if (status == DC_STATUS_SUCCESS) {
+			SYSERROR (abstract->context, errcode);
+			status = syserror (errcode);
+		}
 		goto out;
 	}
 
-	if (dwWritten != size) {
+	if (status == DC_STATUS_SUCCESS && dwWritten != size) {
 		status = DC_STATUS_TIMEOUT;
 	}
 
@@ -579,6 +893,12 @@ dc_serial_purge (dc_iostream_t *abstract, dc_direction_t direction)
 		return syserror (errcode);
 	}
 
+	// The pending read-ahead request is aborted by the purge. Wait for
+	// it to finish, and drop the buffered data as well.
+	if (flags & PURGE_RXCLEAR) {
+		dc_serial_rx_abort (device);
+	}
+
 	return DC_STATUS_SUCCESS;
 }
 
@@ -601,6 +921,13 @@ dc_serial_set_break (dc_iostream_t *abstract, unsigned int level)
 {
 	dc_serial_t *device = (dc_serial_t *) abstract;
 
+	// Skip the request if the state doesn't change.
+	int state = (level != 0);
+	if (device->brk == state)
+		return DC_STATUS_SUCCESS;
+
+	device->brk = -1;
+
 	if (level) {
 		if (!SetCommBreak (device->hFile)) {
 			DWORD errcode = GetLastError ();
@@ -615,6 +942,8 @@ dc_serial_set_break (dc_iostream_t *abstract, unsigned int level)
 		}
 	}
 
+	device->brk = state;
+
 	return DC_STATUS_SUCCESS;
 }
 
@@ -623,6 +952,13 @@ dc_serial_set_dtr (dc_iostream_t *abstract, unsigned int level)
 {
 	dc_serial_t *device = (dc_serial_t *) abstract;
 
+	// Skip the request if the state doesn't change.
+	int state = (level != 0);
+	if (device->dtr == state)
+		return DC_STATUS_SUCCESS;
+
+	device->dtr = -1;
+
 	int status = (level ? SETDTR : CLRDTR);
 
 	if (!EscapeCommFunction (device->hFile, status)) {
@@ -631,6 +967,8 @@ dc_serial_set_dtr (dc_iostream_t *abstract, unsigned int level)
 		return syserror (errcode);
 	}
 
+	device->dtr = state;
+
 	return DC_STATUS_SUCCESS;
 }
 
@@ -639,6 +977,13 @@ dc_serial_set_rts (dc_iostream_t *abstract, unsigned int level)
 {
 	dc_serial_t *device = (dc_serial_t *) abstract;
 
+	// Skip the request if the state doesn't change.
+	int state = (level != 0);
+	if (device->rts == state)
+		return DC_STATUS_SUCCESS;
+
+	device->rts = -1;
+
 	int status = (level ? SETRTS : CLRRTS);
 
 	if (!EscapeCommFunction (device->hFile, status)) {
@@ -647,6 +992,8 @@ dc_serial_set_rts (dc_iostream_t *abstract, unsigned int level)
 		return syserror (errcode);
 	}
 
+	device->rts = state;
+
 	return DC_STATUS_SUCCESS;
 }
 
@@ -657,6 +1004,13 @@ dc_serial_get_available (dc_iostream_t *abstract, size_t *value)
 
 	COMSTAT stats;
 
+	// Collect the read-ahead request, if it has completed already.
+	if (device->rxpending && HasOverlappedIoCompleted (&device->rx)) {
+		dc_status_t status = dc_serial_rx_complete (device, FALSE);
+		if (status != DC_STATUS_SUCCESS)
+			return status;
+	}
+
 	if (!ClearCommError (device->hFile, NULL, &stats)) {
 		DWORD errcode = GetLastError ();
 		SYSERROR (abstract->context, errcode);
@@ -664,7 +1018,7 @@ dc_serial_get_available (dc_iostream_t *abstract, size_t *value)
 	}
 
 	if (value)
-		*value = stats.cbInQue;
+		*value = stats.cbInQue + device->rxsize - device->rxoffset;
 
 	return DC_STATUS_SUCCESS;
 }
@@ -700,7 +1054,31 @@ dc_serial_get_lines (dc_iostream_t *abstract, unsigned int *value)
 static dc_status_t
 dc_serial_sleep (dc_iostream_t *abstract, unsigned int timeout)
 {
-	Sleep (timeout);
+	dc_serial_t *device = (dc_serial_t *) abstract;
+
+	// Wait on the interrupt event, to be able to interrupt the sleep.
+	DWORD rc = WaitForSingleObject (device->hInterrupt, timeout);
+	if (rc == WAIT_OBJECT_0) {
+		return DC_STATUS_CANCELLED;
+	} else if (rc != WAIT_TIMEOUT) {
+		DWORD errcode = GetLastError ();
+		SYSERROR (abstract->context, errcode);
+		return syserror (errcode);
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_serial_interrupt (dc_iostream_t *abstract)
+{
+	dc_serial_t *device = (dc_serial_t *) abstract;
+
+	if (!SetEvent (device->hInterrupt)) {
+		DWORD errcode = GetLastError ();
+		SYSERROR (abstract->context, errcode);
+		return syserror (errcode);
+	}
 
 	return DC_STATUS_SUCCESS;
 }
@@ -0,0 +1,388 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#define SESSION_THREADS
+#endif
+
+#include <libdivecomputer/session.h>
+
+#include "context-private.h"
+
+// The progress of a single job, in the aggregate progress.
+#define PROGRESS_UNIT 1000
+
+typedef struct dc_session_entry_t {
+	dc_session_t *session;
+	dc_session_job_t job;
+	dc_status_t status;
+	dc_event_progress_t progress;
+	unsigned int done;
+} dc_session_entry_t;
+
+struct dc_session_t {
+	dc_context_t *context;
+	unsigned int nthreads;
+	dc_session_entry_t *entries;
+	unsigned int count;
+	unsigned int capacity;
+	// Index of the next job to run.
+	unsigned int next;
+	unsigned int running;
+	unsigned int cancelled;
+#ifdef SESSION_THREADS
+	// Protects the job queue, the progress and the cancel flag.
+	pthread_mutex_t lock;
+#endif
+};
+
+static void
+dc_session_lock (dc_session_t *session)
+{
+#ifdef SESSION_THREADS
+	pthread_mutex_lock (&session->lock);
+#endif
+}
+
+static void
+dc_session_unlock (dc_session_t *session)
+{
+#ifdef SESSION_THREADS
+	pthread_mutex_unlock (&session->lock);
+#endif
+}
+
+static int
+dc_session_cancel_cb (void *userdata)
+{
+	dc_session_t *session = (dc_session_t *) userdata;
+
+	dc_session_lock (session);
+	int cancelled = session->cancelled;
+	dc_session_unlock (session);
+
+	return cancelled;
+}
+
+static void
+dc_session_event_cb (dc_device_t *device, dc_event_type_t event, const void *data, void *userdata)
+{
+	dc_session_entry_t *entry = (dc_session_entry_t *) userdata;
+
+	if (event == DC_EVENT_PROGRESS) {
+		const dc_event_progress_t *progress = (const dc_event_progress_t *) data;
+		dc_session_lock (entry->session);
+		entry->progress = *progress;
+		dc_session_unlock (entry->session);
+	}
+
+	if ((entry->job.events & event) && entry->job.event_callback) {
+		entry->job.event_callback (device, event, data, entry->job.userdata);
+	}
+}
+
+static dc_status_t
+dc_session_execute (dc_session_t *session, dc_session_entry_t *entry)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_device_t *device = NULL;
+
+	status = dc_device_open (&device, session->context, entry->job.descriptor, entry->job.iostream);
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR (session->context, "Failed to open the device.");
+		return status;
+	}
+
+	dc_device_set_cancel (device, dc_session_cancel_cb, session);
+	dc_device_set_events (device, entry->job.events | DC_EVENT_PROGRESS, dc_session_event_cb, entry);
+
+	if (entry->job.fingerprint && entry->job.fsize) {
+		status = dc_device_set_fingerprint (device, entry->job.fingerprint, entry->job.fsize);
+		if (status != DC_STATUS_SUCCESS) {
+			ERROR (session->context, "Failed to register the fingerprint.");
+			dc_device_close (device);
+			return status;
+		}
+	}
+
+	status = dc_device_foreach (device, entry->job.dive_callback, entry->job.userdata);
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR (session->context, "Failed to download the dives.");
+	}
+
+	dc_device_close (device);
+
+	return status;
+}
+
+static void *
+dc_session_worker (void *userdata)
+{
+	dc_session_t *session = (dc_session_t *) userdata;
+
+	for (;;) {
+		dc_session_lock (session);
+		if (session->next >= session->count) {
+			dc_session_unlock (session);
+			break;
+		}
+		dc_session_entry_t *entry = session->entries + session->next++;
+		int cancelled = session->cancelled;
+		dc_session_unlock (session);
+
+		dc_status_t status = DC_STATUS_CANCELLED;
+		if (!cancelled) {
+			status = dc_session_execute (session, entry);
+		}
+
+		dc_session_lock (session);
+		entry->status = status;
+		entry->done = 1;
+		dc_session_unlock (session);
+	}
+
+	return NULL;
+}
+
+dc_status_t
+dc_session_new (dc_session_t **out, dc_context_t *context, unsigned int nthreads)
+{
+	dc_session_t *session = NULL;
+
+	if (out == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	session = (dc_session_t *) dc_malloc (context, sizeof (dc_session_t));
+	if (session == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	session->context = context;
+	session->nthreads = nthreads;
+	session->entries = NULL;
+	session->count = 0;
+	session->capacity = 0;
+	session->next = 0;
+	session->running = 0;
+	session->cancelled = 0;
+#ifdef SESSION_THREADS
+	pthread_mutex_init (&session->lock, NULL);
+#endif
+
+	*out = session;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_session_add (dc_session_t *session, const dc_session_job_t *job, unsigned int *id)
+{
+	if (session == NULL || job == NULL || job->descriptor == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	dc_session_lock (session);
+
+	if (session->running) {
+		dc_session_unlock (session);
+		ERROR (session->context, "The session is already running.");
+		return DC_STATUS_INVALIDARGS;
+	}
+
+	if (session->count >= session->capacity) {
+		unsigned int capacity = session->capacity ? session->capacity * 2 : 8;
+		dc_session_entry_t *entries = (dc_session_entry_t *) dc_realloc (session->context,
+			session->entries, capacity * sizeof (dc_session_entry_t));
+		if (entries == NULL) {
+			dc_session_unlock (session);
+			ERROR (session->context, "Failed to allocate memory.");
+			return DC_STATUS_NOMEMORY;
+		}
+		session->entries = entries;
+		session->capacity = capacity;
+	}
+
+	dc_session_entry_t *entry = session->entries + session->count;
+	entry->session = session;
+	entry->job = *job;
+	entry->status = DC_STATUS_SUCCESS;
+	entry->progress.current = 0;
+	entry->progress.maximum = 0;
+	entry->done = 0;
+
+	if (id)
+		*id = session->count;
+
+	session->count++;
+
+	dc_session_unlock (session);
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_session_run (dc_session_t *session)
+{
+	if (session == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	dc_session_lock (session);
+	if (session->running) {
+		dc_session_unlock (session);
+		ERROR (session->context, "The session is already running.");
+		return DC_STATUS_INVALIDARGS;
+	}
+	session->running = 1;
+	unsigned int count = session->count - session->next;
+	dc_session_unlock (session);
+
+#ifdef SESSION_THREADS
+	unsigned int nthreads = session->nthreads;
+	if (nthreads == 0 || nthreads > count)
+		nthreads = count;
+
+	pthread_t *threads = NULL;
+	if (nthreads > 1) {
+		threads = (pthread_t *) dc_malloc (session->context, nthreads * sizeof (pthread_t));
+		if (threads == NULL)
+			nthreads = 1;
+	}
+
+	// Start the extra workers. If a thread can't be created, the
+	// remaining jobs are simply shared by fewer workers.
+	unsigned int nstarted = 0;
+	for (unsigned int i = 1; i < nthreads; ++i) {
+		if (pthread_create (&threads[nstarted], NULL, dc_session_worker, session) != 0) {
+			WARNING (session->context, "Failed to create a worker thread.");
+			break;
+		}
+		nstarted++;
+	}
+
+	// The calling thread is one of the workers.
+	dc_session_worker (session);
+
+	for (unsigned int i = 0; i < nstarted; ++i) {
+		pthread_join (threads[i], NULL);
+	}
+
+	dc_free (session->context, threads);
+#else
+	UNUSED (count);
+
+	dc_session_worker (session);
+#endif
+
+	dc_session_lock (session);
+	session->running = 0;
+	dc_session_unlock (session);
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_session_cancel (dc_session_t *session)
+{
+	if (session == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	dc_session_lock (session);
+	session->cancelled = 1;
+	dc_session_unlock (session);
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_session_get_status (dc_session_t *session, unsigned int id, dc_status_t *status)
+{
+	if (session == NULL || status == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	dc_session_lock (session);
+
+	if (id >= session->count) {
+		dc_session_unlock (session);
+		return DC_STATUS_INVALIDARGS;
+	}
+
+	*status = session->entries[id].status;
+
+	dc_session_unlock (session);
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_session_get_progress (dc_session_t *session, dc_event_progress_t *progress)
+{
+	if (session == NULL || progress == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	dc_session_lock (session);
+
+	unsigned int current = 0;
+	for (unsigned int i = 0; i < session->count; ++i) {
+		const dc_session_entry_t *entry = session->entries + i;
+		if (entry->done) {
+			current += PROGRESS_UNIT;
+		} else if (entry->progress.current >= entry->progress.maximum) {
+			current += entry->progress.maximum ? PROGRESS_UNIT : 0;
+		} else {
+			current += (unsigned long long) entry->progress.current * PROGRESS_UNIT / entry->progress.maximum;
+		}
+	}
+
+	progress->current = current;
+	progress->maximum = session->count * PROGRESS_UNIT;
+
+	dc_session_unlock (session);
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_session_free (dc_session_t *session)
+{
+	if (session == NULL)
+		return DC_STATUS_SUCCESS;
+
+	if (session->running) {
+		ERROR (session->context, "The session is still running.");
+		return DC_STATUS_INVALIDARGS;
+	}
+
+#ifdef SESSION_THREADS
+	pthread_mutex_destroy (&session->lock);
+#endif
+
+	dc_free (session->context, session->entries);
+	dc_free (session->context, session);
+
+	return DC_STATUS_SUCCESS;
+}
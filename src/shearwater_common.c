@@ -22,12 +22,16 @@
 #include <string.h> // memcmp, memcpy
 #include <stdlib.h> // malloc, free
 
+#include <libdivecomputer/ble.h>
+
 #include "shearwater_common.h"
 
 #include "context-private.h"
 #include "platform.h"
 #include "array.h"
 
+#define C_ARRAY_SIZE(array) (sizeof (array) / sizeof *(array))
+
 #define SZ_PACKET  254
 
 // SLIP special character codes
@@ -42,6 +46,11 @@ shearwater_common_setup (shearwater_common_device_t *device, dc_context_t *conte
 	dc_status_t status = DC_STATUS_SUCCESS;
 
 	device->iostream = iostream;
+	device->window = 1;
+	device->rxoffset = 0;
+	device->rxsize = 0;
+	device->rxpacket = 0;
+	device->rxnpackets = 0;
 
 	// Set the serial communication protocol (115200 8N1).
 	status = dc_iostream_configure (device->iostream, 115200, 8, DC_PARITY_NONE, DC_STOPBITS_ONE, DC_FLOWCONTROL_NONE);
@@ -57,16 +66,29 @@ shearwater_common_setup (shearwater_common_device_t *device, dc_context_t *conte
 		return status;
 	}
 
+	// Prepare the BLE link for bulk transfers. Missing support for the
+	// negotiation is not an error.
+	if (dc_iostream_get_transport (device->iostream) == DC_TRANSPORT_BLE) {
+		dc_ble_request_mtu (device->iostream, DC_BLE_MTU_MAX);
+		dc_ble_set_interval (device->iostream, DC_BLE_INTERVAL_MIN, 2 * DC_BLE_INTERVAL_MIN);
+		dc_ble_set_phy (device->iostream, DC_BLE_PHY_2M);
+		dc_ble_set_write_type (device->iostream, DC_BLE_WRITE_WITHOUT_RESPONSE);
+	}
+
 	// Make sure everything is in a sane state.
 	dc_iostream_sleep (device->iostream, 300);
 	dc_iostream_purge (device->iostream, DC_DIRECTION_ALL);
+	device->rxoffset = 0;
+	device->rxsize = 0;
+	device->rxpacket = 0;
+	device->rxnpackets = 0;
 
 	return DC_STATUS_SUCCESS;
 }
 
 
 static int
-shearwater_common_decompress_lre (unsigned char *data, unsigned int size, dc_buffer_t *buffer, unsigned int *isfinal)
+shearwater_common_decompress_lre (const unsigned char *data, unsigned int size, dc_buffer_t *buffer, unsigned int *isfinal)
 {
 	// The RLE decompression algorithm does interpret the binary data as a
 	// stream of 9 bit values. Therefore, the total number of bits needs to be
@@ -75,54 +97,120 @@ shearwater_common_decompress_lre (unsigned char *data, unsigned int size, dc_buf
 	if (nbits % 9 != 0)
 		return -1;
 
+	// The output is written directly into the buffer, which is grown
+	// geometrically whenever the next value doesn't fit.
+	size_t length = dc_buffer_get_size (buffer);
+	size_t capacity = length + 2 * (size_t) size;
+	if (!dc_buffer_resize (buffer, capacity))
+		return -1;
+	unsigned char *out = dc_buffer_get_data (buffer);
+
+	unsigned long long bits = 0;
+	unsigned int nbuffered = 0;
 	unsigned int offset = 0;
-	while (offset + 9 <= nbits) {
-		// Extract the 9 bit value.
-		unsigned int byte = offset / 8;
-		unsigned int bit  = offset % 8;
-		unsigned int shift = 16 - (bit + 9);
-		unsigned int value = (array_uint16_be (data + byte) >> shift) & 0x1FF;
+
+	unsigned int count = nbits / 9;
+	for (unsigned int i = 0; i < count; ++i) {
+		// Refill the bit buffer, and extract the 9 bit value.
+		while (nbuffered <= 56 && offset < size) {
+			bits = (bits << 8) | data[offset++];
+			nbuffered += 8;
+		}
+		nbuffered -= 9;
+		unsigned int value = (bits >> nbuffered) & 0x1FF;
 
 		// The 9th bit indicates whether the remaining 8 bits represent
 		// a run of zero bytes or not. If the bit is set, the value is
 		// not a run and doesn’t need expansion. If the bit is not set,
 		// the value contains the number of zero bytes in the run. A
 		// zero-length run indicates the end of the compressed stream.
-		if (value & 0x100) {
-			// Append the data byte directly.
-			unsigned char c = value & 0xFF;
-			if (!dc_buffer_append (buffer, &c, 1))
-				return -1;
-		} else if (value == 0) {
+		if (value == 0) {
 			// Reached the end of the compressed stream.
 			if (isfinal)
 				*isfinal = 1;
 			break;
-		} else {
-			// Expand the run with zero bytes.
-			if (!dc_buffer_resize (buffer, dc_buffer_get_size (buffer) + value))
+		}
+
+		unsigned int n = (value & 0x100) ? 1 : value;
+		if (length + n > capacity) {
+			capacity = 2 * capacity > length + n ? 2 * capacity : length + n;
+			if (!dc_buffer_resize (buffer, capacity))
 				return -1;
+			out = dc_buffer_get_data (buffer);
 		}
 
-		offset += 9;
+		// Each block of 32 bytes is XOR'ed with the previous block,
+		// except for the first block, which is passed through unchanged.
+		// Thus a run of zero bytes repeats the previous block.
+		if (value & 0x100) {
+			unsigned char c = value & 0xFF;
+			if (length >= 32)
+				c ^= out[length - 32];
+			out[length++] = c;
+		} else {
+			if (length < 32) {
+				unsigned int len = 32 - length < n ? 32 - length : n;
+				memset (out + length, 0, len);
+				length += len;
+				n -= len;
+			}
+			while (n) {
+				unsigned int len = n < 32 ? n : 32;
+				memcpy (out + length, out + length - 32, len);
+				length += len;
+				n -= len;
+			}
+		}
 	}
 
+	if (!dc_buffer_resize (buffer, length))
+		return -1;
+
 	return 0;
 }
 
 
+/*
+ * Check whether a block of compressed data contains the end of the
+ * compressed stream, without decompressing it.
+ */
 static int
-shearwater_common_decompress_xor (unsigned char *data, unsigned int size)
+shearwater_common_compressed_final (const unsigned char *data, unsigned int size)
 {
-	// Each block of 32 bytes is XOR'ed (in-place) with the previous block,
-	// except for the first block, which is passed through unchanged.
-	for (unsigned int i = 32; i < size; ++i) {
-		data[i] ^= data[i - 32];
+	unsigned int nbits = size * 8;
+
+	for (unsigned int offset = 0; offset + 9 <= nbits; offset += 9) {
+		unsigned int byte = offset / 8;
+		unsigned int bit  = offset % 8;
+		unsigned int shift = 16 - (bit + 9);
+		unsigned int value = (array_uint16_be (data + byte) >> shift) & 0x1FF;
+		if (value == 0)
+			return 1;
 	}
 
 	return 0;
 }
 
+
+dc_status_t
+shearwater_common_decompress (dc_context_t *context, const unsigned char data[], unsigned int size, dc_buffer_t *buffer)
+{
+	if (!dc_buffer_clear (buffer)) {
+		ERROR (context, "Insufficient buffer space available.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	// Every block is a whole number of 9 bit values, so the blocks
+	// together form a single stream. The XOR phase is applied while
+	// decoding.
+	if (shearwater_common_decompress_lre (data, size, buffer, NULL) != 0) {
+		ERROR (context, "Decompression error (LRE phase).");
+		return DC_STATUS_PROTOCOL;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
 static dc_status_t
 shearwater_common_slip_write (shearwater_common_device_t *device, const unsigned char data[], unsigned int size)
 {
@@ -216,38 +304,101 @@ shearwater_common_slip_write (shearwater_common_device_t *device, const unsigned
 }
 
 
+/*
+ * Refill the receive buffer with BLE packets. All the packets which are
+ * already queued are read at once. Without support for that, a single
+ * packet is read.
+ */
+static dc_status_t
+shearwater_common_ble_fill (shearwater_common_device_t *device)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	size_t npackets = 0;
+
+	device->rxoffset = 0;
+	device->rxsize = 0;
+	device->rxpacket = 0;
+	device->rxnpackets = 0;
+
+	status = dc_ble_read_packets (device->iostream, device->rxbuf, sizeof(device->rxbuf),
+		device->rxlengths, C_ARRAY_SIZE(device->rxlengths), &npackets, NULL);
+	if (status == DC_STATUS_UNSUPPORTED) {
+		status = dc_iostream_read (device->iostream, device->rxbuf, sizeof(device->rxbuf), &device->rxlengths[0]);
+		npackets = 1;
+	}
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR (device->base.context, "Failed to receive the packet.");
+		return status;
+	}
+
+	device->rxnpackets = npackets;
+
+	return DC_STATUS_SUCCESS;
+}
+
 static dc_status_t
 shearwater_common_slip_read (shearwater_common_device_t *device, unsigned char data[], unsigned int size, unsigned int *actual)
 {
 	dc_status_t status = DC_STATUS_SUCCESS;
 	dc_transport_t transport = dc_iostream_get_transport(device->iostream);
-	unsigned char buffer[256];
 	unsigned int escaped = 0;
 	unsigned int nbytes = 0;
 
-	// Get the packet size.
-	size_t packetsize = (transport == DC_TRANSPORT_BLE) ? sizeof(buffer) : 1;
-
 	// Read bytes until a complete packet has been received. If the
 	// buffer runs out of space, bytes are dropped. The caller can
 	// detect this condition because the return value will be larger
 	// than the supplied buffer size.
 	while (1) {
+		unsigned char *buffer = NULL;
 		size_t transferred = 0;
-		status = dc_iostream_read (device->iostream, buffer, packetsize, &transferred);
-		if (status != DC_STATUS_SUCCESS) {
-			ERROR (device->base.context, "Failed to receive the packet.");
-			return status;
-		}
-
 		size_t offset = 0;
+
 		if (transport == DC_TRANSPORT_BLE) {
+			if (device->rxpacket >= device->rxnpackets) {
+				status = shearwater_common_ble_fill (device);
+				if (status != DC_STATUS_SUCCESS)
+					return status;
+			}
+
+			// Take the next BLE packet from the receive buffer.
+			buffer = device->rxbuf + device->rxoffset;
+			transferred = device->rxlengths[device->rxpacket++];
+			device->rxoffset += transferred;
+
 			if (transferred < 2) {
 				ERROR (device->base.context, "Invalid packet length (" DC_PRINTF_SIZE ").", transferred);
 				return DC_STATUS_PROTOCOL;
 			}
 
 			offset = 2;
+		} else {
+			if (device->rxoffset >= device->rxsize) {
+				// Read all the bytes which are already available, but
+				// at least one byte to wait for the next data.
+				size_t available = 0;
+				if (dc_iostream_get_available (device->iostream, &available) != DC_STATUS_SUCCESS ||
+					available == 0)
+					available = 1;
+				if (available > sizeof(device->rxbuf))
+					available = sizeof(device->rxbuf);
+
+				device->rxoffset = 0;
+				device->rxsize = 0;
+
+				status = dc_iostream_read (device->iostream, device->rxbuf, available, &transferred);
+				if (status != DC_STATUS_SUCCESS) {
+					ERROR (device->base.context, "Failed to receive the packet.");
+					return status;
+				}
+
+				device->rxsize = transferred;
+			}
+
+			// Use the remaining bytes in the receive buffer.
+			buffer = device->rxbuf;
+			offset = device->rxoffset;
+			transferred = device->rxsize;
+			device->rxoffset = device->rxsize;
 		}
 
 		for (size_t i = offset; i < transferred; ++i) {
@@ -268,6 +419,9 @@ shearwater_common_slip_read (shearwater_common_device_t *device, unsigned char d
 					// packets generated by the duplicate END characters which
 					// are sent to try to detect line noise.
 					if (nbytes) {
+						// Keep the remaining bytes for the next packet.
+						if (transport != DC_TRANSPORT_BLE)
+							device->rxoffset = i + 1;
 						goto done;
 					}
 				} else {
@@ -338,15 +492,14 @@ shearwater_common_command (shearwater_common_device_t *device, const unsigned ch
 
 
 
-dc_status_t
-shearwater_common_transfer (shearwater_common_device_t *device, const unsigned char input[], unsigned int isize, unsigned char output[], unsigned int osize, unsigned int *actual)
+static dc_status_t
+shearwater_common_request (shearwater_common_device_t *device, const unsigned char input[], unsigned int isize)
 {
 	dc_status_t status = DC_STATUS_SUCCESS;
 	dc_device_t *abstract = (dc_device_t *) device;
 	unsigned char packet[SZ_PACKET + 4];
-	unsigned int n = 0;
 
-	if (isize > SZ_PACKET || osize > SZ_PACKET)
+	if (isize > SZ_PACKET)
 		return DC_STATUS_INVALIDARGS;
 
 	if (device_is_cancelled (abstract))
@@ -366,12 +519,20 @@ shearwater_common_transfer (shearwater_common_device_t *device, const unsigned c
 		return status;
 	}
 
-	// Return early if no response packet is requested.
-	if (osize == 0) {
-		if (actual)
-			*actual = 0;
-		return DC_STATUS_SUCCESS;
-	}
+	return DC_STATUS_SUCCESS;
+}
+
+
+static dc_status_t
+shearwater_common_response (shearwater_common_device_t *device, unsigned char output[], unsigned int osize, unsigned int *actual)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_device_t *abstract = (dc_device_t *) device;
+	unsigned char packet[SZ_PACKET + 4];
+	unsigned int n = 0;
+
+	if (osize > SZ_PACKET)
+		return DC_STATUS_INVALIDARGS;
 
 	// Receive the response packet.
 	status = shearwater_common_slip_read (device, packet, sizeof (packet), &n);
@@ -400,6 +561,43 @@ shearwater_common_transfer (shearwater_common_device_t *device, const unsigned c
 	return DC_STATUS_SUCCESS;
 }
 
+
+dc_status_t
+shearwater_common_transfer (shearwater_common_device_t *device, const unsigned char input[], unsigned int isize, unsigned char output[], unsigned int osize, unsigned int *actual)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (isize > SZ_PACKET || osize > SZ_PACKET)
+		return DC_STATUS_INVALIDARGS;
+
+	dc_usecs_t start = device_latency_start ((dc_device_t *) device);
+
+	// Send the request packet.
+	status = shearwater_common_request (device, input, isize);
+	if (status != DC_STATUS_SUCCESS)
+		return status;
+
+	// Return early if no response packet is requested.
+	if (osize == 0) {
+		if (actual)
+			*actual = 0;
+		return DC_STATUS_SUCCESS;
+	}
+
+	// Receive the response packet.
+	unsigned int nbytes = 0;
+	status = shearwater_common_response (device, output, osize, &nbytes);
+	if (status != DC_STATUS_SUCCESS)
+		return status;
+
+	device_latency_emit ((dc_device_t *) device, isize ? input[0] : 0, nbytes, start);
+
+	if (actual)
+		*actual = nbytes;
+
+	return DC_STATUS_SUCCESS;
+}
+
 dc_status_t
 shearwater_common_download (shearwater_common_device_t *device, dc_buffer_t *buffer, unsigned int address, unsigned int size, unsigned int compression, dc_event_progress_t *progress)
 {
@@ -454,17 +652,36 @@ shearwater_common_download (shearwater_common_device_t *device, dc_buffer_t *buf
 		device_event_emit (abstract, DC_EVENT_PROGRESS, progress);
 	}
 
+	// Keep up to window block requests outstanding. The next request is
+	// already on its way while the current block is being processed.
+	unsigned int window = device->window ? device->window : 1;
+
 	unsigned int done = 0;
 	unsigned char block = 1;
+	unsigned char requested = 1;
+	unsigned int outstanding = 0;
 	unsigned int nbytes = 0;
 	while (nbytes < size && !done) {
-		// Transfer the block request.
-		req_block[1] = block;
-		rc = shearwater_common_transfer (device, req_block, sizeof (req_block), response, sizeof (response), &n);
+		// Send the block requests.
+		while (outstanding < window) {
+			req_block[1] = requested;
+			rc = shearwater_common_request (device, req_block, sizeof (req_block));
+			if (rc != DC_STATUS_SUCCESS) {
+				return rc;
+			}
+
+			requested++;
+			outstanding++;
+		}
+
+		// Receive the block response.
+		rc = shearwater_common_response (device, response, sizeof (response), &n);
 		if (rc != DC_STATUS_SUCCESS) {
 			return rc;
 		}
 
+		outstanding--;
+
 		// Verify the block header.
 		if (n < 2 || response[0] != 0x76 || response[1] != block) {
 			ERROR (abstract->context, "Unexpected response packet.");
@@ -486,26 +703,32 @@ shearwater_common_download (shearwater_common_device_t *device, dc_buffer_t *buf
 		}
 
 		if (compression) {
-			if (shearwater_common_decompress_lre (response + 2, length, buffer, &done) != 0) {
+			// The compressed stream consists of 9 bit values.
+			if ((length * 8) % 9 != 0) {
 				ERROR (abstract->context, "Decompression error (LRE phase).");
 				return DC_STATUS_PROTOCOL;
 			}
-		} else {
-			if (!dc_buffer_append (buffer, response + 2, length)) {
-				ERROR (abstract->context, "Insufficient buffer space available.");
-				return DC_STATUS_PROTOCOL;
-			}
+
+			done = shearwater_common_compressed_final (response + 2, length);
+		}
+
+		if (!dc_buffer_append (buffer, response + 2, length)) {
+			ERROR (abstract->context, "Insufficient buffer space available.");
+			return DC_STATUS_PROTOCOL;
 		}
 
 		nbytes += length;
 		block++;
 	}
 
-	if (compression) {
-		if (shearwater_common_decompress_xor (dc_buffer_get_data (buffer), dc_buffer_get_size (buffer)) != 0) {
-			ERROR (abstract->context, "Decompression error (XOR phase).");
-			return DC_STATUS_PROTOCOL;
+	// Discard the responses to the requests beyond the end of the data.
+	while (outstanding) {
+		rc = shearwater_common_response (device, response, sizeof (response), &n);
+		if (rc != DC_STATUS_SUCCESS) {
+			return rc;
 		}
+
+		outstanding--;
 	}
 
 	// Transfer the quit request.
@@ -43,12 +43,24 @@ extern "C" {
 #define NERD2    7
 #define TERIC    8
 
+#define RXBUF_SIZE  2048
+#define RXPACKETS   16
+
 #define NSTEPS    10000
 #define STEP(i,n) ((NSTEPS * (i) + (n) / 2) / (n))
 
 typedef struct shearwater_common_device_t {
 	dc_device_t base;
 	dc_iostream_t *iostream;
+	unsigned int window;
+	// Receive buffer. With BLE, it contains a number of packets, stored
+	// back to back.
+	unsigned char rxbuf[RXBUF_SIZE];
+	unsigned int rxoffset;
+	unsigned int rxsize;
+	size_t rxlengths[RXPACKETS];
+	unsigned int rxpacket;
+	unsigned int rxnpackets;
 } shearwater_common_device_t;
 
 dc_status_t
@@ -60,9 +72,18 @@ shearwater_common_command (shearwater_common_device_t *device, const unsigned ch
 dc_status_t
 shearwater_common_transfer (shearwater_common_device_t *device, const unsigned char input[], unsigned int isize, unsigned char output[], unsigned int osize, unsigned int *actual);
 
+/*
+ * Download a memory area. With compression, the buffer receives the
+ * compressed data as is, which is decompressed afterwards with
+ * shearwater_common_decompress(). That doesn't need the device, so it
+ * can run on another thread, overlapped with the next download.
+ */
 dc_status_t
 shearwater_common_download (shearwater_common_device_t *device, dc_buffer_t *buffer, unsigned int address, unsigned int size, unsigned int compression, dc_event_progress_t *progress);
 
+dc_status_t
+shearwater_common_decompress (dc_context_t *context, const unsigned char data[], unsigned int size, dc_buffer_t *buffer);
+
 dc_status_t
 shearwater_common_identifier (shearwater_common_device_t *device, dc_buffer_t *buffer, unsigned int id);
 
@@ -19,9 +19,18 @@
  * MA 02110-1301 USA
  */
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
 #include <string.h> // memcmp, memcpy
 #include <stdlib.h> // malloc, free
 
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#define USE_WORKER
+#endif
+
 #include "shearwater_petrel.h"
 #include "shearwater_common.h"
 #include "context-private.h"
@@ -31,6 +40,8 @@
 
 #define ISINSTANCE(device) dc_device_isinstance((device), &shearwater_petrel_device_vtable)
 
+#define C_ARRAY_SIZE(array) (sizeof (array) / sizeof *(array))
+
 #define MANIFEST_ADDR 0xE0000000
 #define MANIFEST_SIZE 0x600
 
@@ -39,11 +50,31 @@
 #define RECORD_SIZE   0x20
 #define RECORD_COUNT  (MANIFEST_SIZE / RECORD_SIZE)
 
+#define MAXWINDOW     16
+
 typedef struct shearwater_petrel_device_t {
 	shearwater_common_device_t base;
 	unsigned char fingerprint[4];
+	shearwater_petrel_filter_t filter;
+	void *filter_userdata;
 } shearwater_petrel_device_t;
 
+/*
+ * A downloaded dive. The compressed data is decompressed on a worker
+ * thread, while the next dive is being downloaded.
+ */
+typedef struct shearwater_petrel_dive_t {
+	dc_context_t *context;
+	dc_buffer_t *compressed;
+	dc_buffer_t *data;
+	unsigned int record;
+	dc_status_t status;
+#ifdef USE_WORKER
+	pthread_t thread;
+	int active;
+#endif
+} shearwater_petrel_dive_t;
+
 static dc_status_t shearwater_petrel_device_set_fingerprint (dc_device_t *abstract, const unsigned char data[], unsigned int size);
 static dc_status_t shearwater_petrel_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, void *userdata);
 static dc_status_t shearwater_petrel_device_close (dc_device_t *abstract);
@@ -94,6 +125,8 @@ shearwater_petrel_device_open (dc_device_t **out, dc_context_t *context, dc_iost
 
 	// Set the default values.
 	memset (device->fingerprint, 0, sizeof (device->fingerprint));
+	device->filter = NULL;
+	device->filter_userdata = NULL;
 
 	// Setup the device.
 	status = shearwater_common_setup (&device->base, context, iostream);
@@ -111,6 +144,117 @@ error_free:
 }
 
 
+dc_status_t
+shearwater_petrel_device_set_window (dc_device_t *abstract, unsigned int window)
+{
+	shearwater_common_device_t *device = (shearwater_common_device_t *) abstract;
+
+	if (!ISINSTANCE (abstract))
+		return DC_STATUS_INVALIDARGS;
+
+	if (window == 0 || window > MAXWINDOW)
+		return DC_STATUS_INVALIDARGS;
+
+	device->window = window;
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+dc_status_t
+shearwater_petrel_device_set_filter (dc_device_t *abstract, shearwater_petrel_filter_t filter, void *userdata)
+{
+	shearwater_petrel_device_t *device = (shearwater_petrel_device_t *) abstract;
+
+	if (!ISINSTANCE (abstract))
+		return DC_STATUS_INVALIDARGS;
+
+	device->filter = filter;
+	device->filter_userdata = userdata;
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+static void *
+shearwater_petrel_decompress_run (void *arg)
+{
+	shearwater_petrel_dive_t *dive = (shearwater_petrel_dive_t *) arg;
+
+	dive->status = shearwater_common_decompress (dive->context,
+		dc_buffer_get_data (dive->compressed),
+		dc_buffer_get_size (dive->compressed),
+		dive->data);
+
+	return NULL;
+}
+
+
+static void
+shearwater_petrel_decompress_start (dc_device_t *abstract, shearwater_petrel_dive_t *dive)
+{
+#ifdef USE_WORKER
+	if (pthread_create (&dive->thread, NULL, shearwater_petrel_decompress_run, dive) == 0) {
+		dive->active = 1;
+		return;
+	}
+#endif
+
+	// Fallback to decompressing the dive immediately.
+	dc_phase_t phase = device_profile_phase (abstract, DC_PHASE_DECOMPRESS);
+	shearwater_petrel_decompress_run (dive);
+	device_profile_phase (abstract, phase);
+}
+
+
+static dc_status_t
+shearwater_petrel_decompress_wait (dc_device_t *abstract, shearwater_petrel_dive_t *dive)
+{
+#ifdef USE_WORKER
+	if (dive->active) {
+		dc_phase_t phase = device_profile_phase (abstract, DC_PHASE_DECOMPRESS);
+		pthread_join (dive->thread, NULL);
+		device_profile_phase (abstract, phase);
+		dive->active = 0;
+	}
+#else
+	UNUSED (abstract);
+#endif
+
+	return dive->status;
+}
+
+
+static dc_status_t
+shearwater_petrel_deliver (dc_device_t *abstract, shearwater_petrel_dive_t *dive, const unsigned char manifest[], dc_dive_callback_t callback, void *userdata, unsigned int *stop)
+{
+	shearwater_petrel_device_t *device = (shearwater_petrel_device_t *) abstract;
+
+	dc_status_t rc = shearwater_petrel_decompress_wait (abstract, dive);
+	if (rc != DC_STATUS_SUCCESS) {
+		ERROR (abstract->context, "Failed to decompress the dive.");
+		return rc;
+	}
+
+	unsigned char *buf = dc_buffer_get_data (dive->data);
+	unsigned int len = dc_buffer_get_size (dive->data);
+	if (len < 12 + sizeof (device->fingerprint)) {
+		ERROR (abstract->context, "Unexpected dive size (%u bytes).", len);
+		return DC_STATUS_DATAFORMAT;
+	}
+
+	if (callback && !callback (buf, len, buf + 12, sizeof (device->fingerprint), userdata)) {
+		*stop = 1;
+		return DC_STATUS_SUCCESS;
+	}
+
+	// Emit a checkpoint to resume after this dive.
+	device_event_emit_checkpoint (abstract, manifest + dive->record + 4, sizeof (device->fingerprint));
+
+	return DC_STATUS_SUCCESS;
+}
+
+
 static dc_status_t
 shearwater_petrel_device_close (dc_device_t *abstract)
 {
@@ -168,6 +312,7 @@ shearwater_petrel_device_foreach (dc_device_t *abstract, dc_dive_callback_t call
 	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
 
 	// Read the serial number.
+	device_profile_phase (abstract, DC_PHASE_VERSION);
 	rc = shearwater_common_identifier (&device->base, buffer, ID_SERIAL);
 	if (rc != DC_STATUS_SUCCESS) {
 		ERROR (abstract->context, "Failed to read the serial number.");
@@ -291,6 +436,7 @@ shearwater_petrel_device_foreach (dc_device_t *abstract, dc_dive_callback_t call
 	}
 
 	// Read the manifest pages
+	device_profile_phase (abstract, DC_PHASE_LOGBOOK);
 	while (1) {
 		// Update the progress state.
 		// Assume the worst case scenario of a full manifest, and adjust the
@@ -314,7 +460,7 @@ shearwater_petrel_device_foreach (dc_device_t *abstract, dc_dive_callback_t call
 		unsigned int size = dc_buffer_get_size (buffer);
 
 		// Process the records in the manifest.
-		unsigned int count = 0, deleted = 0;
+		unsigned int count = 0, deleted = 0, selected = 0;
 		unsigned int offset = 0;
 		while (offset < size) {
 			// Check for a valid dive header.
@@ -332,68 +478,143 @@ shearwater_petrel_device_foreach (dc_device_t *abstract, dc_dive_callback_t call
 			if (memcmp (data + offset + 4, device->fingerprint, sizeof (device->fingerprint)) == 0)
 				break;
 
+			// Append the selected records to the main buffer.
+			if (device->filter == NULL ||
+				device->filter (array_uint16_be (data + offset + 2),
+				array_uint32_be (data + offset + 4), device->filter_userdata))
+			{
+				if (!dc_buffer_append (manifests, data + offset, RECORD_SIZE)) {
+					ERROR (abstract->context, "Insufficient buffer space available.");
+					dc_buffer_free (buffer);
+					dc_buffer_free (manifests);
+					return DC_STATUS_NOMEMORY;
+				}
+				selected++;
+			}
+
 			offset += RECORD_SIZE;
 			count++;
 		}
 
 		// Update the progress state.
 		current += 1;
-		maximum -= RECORD_COUNT - count - deleted;
-
-		// Append the manifest records to the main buffer.
-		if (!dc_buffer_append (manifests, data, count * RECORD_SIZE)) {
-			ERROR (abstract->context, "Insufficient buffer space available.");
-			dc_buffer_free (buffer);
-			dc_buffer_free (manifests);
-			return DC_STATUS_NOMEMORY;
-		}
+		maximum -= RECORD_COUNT - selected;
 
 		// Stop downloading manifest if there are no more records.
 		if (count + deleted != RECORD_COUNT)
 			break;
 	}
 
-	// Update and emit a progress event.
-	progress.current = NSTEPS * current;
-	progress.maximum = NSTEPS * maximum;
-	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
-
 	// Cache the buffer pointer and size.
 	unsigned char *data = dc_buffer_get_data (manifests);
 	unsigned int size = dc_buffer_get_size (manifests);
 
+	// Skip the dives that were already downloaded before the download got
+	// interrupted. The resume token contains the fingerprint of the last
+	// dive that was passed to the application.
 	unsigned int offset = 0;
-	while (offset < size) {
-		// skip deleted dives
-		if (array_uint16_be(data + offset) == 0x5A23) {
+	const unsigned char *resume = device_resume_get (abstract, sizeof (device->fingerprint));
+	if (resume) {
+		unsigned int skipped = 0;
+		unsigned int found = 0;
+		while (offset < size) {
+			skipped++;
+			found = memcmp (data + offset + 4, resume, sizeof (device->fingerprint)) == 0;
+
 			offset += RECORD_SIZE;
-			continue;
+
+			if (found)
+				break;
 		}
+
+		if (found) {
+			INFO (abstract->context, "Resuming the download after %u dives.", skipped);
+			maximum -= skipped;
+		} else {
+			WARNING (abstract->context, "Resume token not found, downloading all dives.");
+			offset = 0;
+		}
+	}
+
+	// Update and emit a progress event.
+	progress.current = NSTEPS * current;
+	progress.maximum = NSTEPS * maximum;
+	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
+
+	// Allocate memory buffers for the dives.
+	shearwater_petrel_dive_t dives[2];
+	memset (dives, 0, sizeof (dives));
+	for (unsigned int i = 0; i < C_ARRAY_SIZE (dives); ++i) {
+		dives[i].context = abstract->context;
+		dives[i].compressed = dc_buffer_new (0);
+		dives[i].data = dc_buffer_new (0);
+		dives[i].status = DC_STATUS_SUCCESS;
+		if (dives[i].compressed == NULL || dives[i].data == NULL)
+			rc = DC_STATUS_NOMEMORY;
+	}
+	if (rc != DC_STATUS_SUCCESS) {
+		ERROR (abstract->context, "Insufficient buffer space available.");
+		for (unsigned int i = 0; i < C_ARRAY_SIZE (dives); ++i) {
+			dc_buffer_free (dives[i].compressed);
+			dc_buffer_free (dives[i].data);
+		}
+		dc_buffer_free (buffer);
+		dc_buffer_free (manifests);
+		return rc;
+	}
+
+	// Each dive is decompressed while the next one is being downloaded,
+	// and passed to the application afterwards.
+	device_profile_phase (abstract, DC_PHASE_PROFILE);
+	unsigned int idx = 0, pending = 0, stop = 0;
+	while (offset < size) {
 		// Get the address of the dive.
 		unsigned int address = array_uint32_be (data + offset + 20);
 
 		// Download the dive.
 		progress.current = NSTEPS * current;
 		progress.maximum = NSTEPS * maximum;
-		rc = shearwater_common_download (&device->base, buffer, base_addr + address, DIVE_SIZE, 1, &progress);
+		rc = shearwater_common_download (&device->base, dives[idx].compressed, base_addr + address, DIVE_SIZE, 1, &progress);
 		if (rc != DC_STATUS_SUCCESS) {
 			ERROR (abstract->context, "Failed to download the dive.");
-			dc_buffer_free (buffer);
-			dc_buffer_free (manifests);
-			return rc;
+			break;
 		}
 
 		// Update the progress state.
 		current += 1;
 
-		unsigned char *buf = dc_buffer_get_data (buffer);
-		unsigned int len = dc_buffer_get_size (buffer);
-		if (callback && !callback (buf, len, buf + 12, sizeof (device->fingerprint), userdata))
-			break;
+		// Decompress the dive in the background.
+		dives[idx].record = offset;
+		shearwater_petrel_decompress_start (abstract, &dives[idx]);
 
+		// Pass the previous dive to the application.
+		if (pending) {
+			pending = 0;
+			rc = shearwater_petrel_deliver (abstract, &dives[idx ^ 1], data, callback, userdata, &stop);
+			if (rc != DC_STATUS_SUCCESS || stop)
+				break;
+		}
+
+		pending = 1;
+		idx ^= 1;
 		offset += RECORD_SIZE;
 	}
 
+	// Pass the last dive to the application. After a failed download,
+	// that's still the previous dive.
+	if (pending) {
+		dc_status_t status = shearwater_petrel_deliver (abstract, &dives[idx ^ 1], data, callback, userdata, &stop);
+		if (rc == DC_STATUS_SUCCESS)
+			rc = status;
+	}
+
+	// Wait for the workers, before releasing the buffers.
+	for (unsigned int i = 0; i < C_ARRAY_SIZE (dives); ++i) {
+		shearwater_petrel_decompress_wait (abstract, &dives[i]);
+		dc_buffer_free (dives[i].compressed);
+		dc_buffer_free (dives[i].data);
+	}
+
 	// Update and emit a progress event.
 	progress.current = NSTEPS * current;
 	progress.maximum = NSTEPS * maximum;
@@ -37,6 +37,9 @@ shearwater_predator_device_open (dc_device_t **device, dc_context_t *context, dc
 dc_status_t
 shearwater_predator_parser_create (dc_parser_t **parser, dc_context_t *context, unsigned int model, unsigned int serial);
 
+dc_status_t
+shearwater_predator_extract_dives (dc_device_t *device, const unsigned char data[], unsigned int size, dc_dive_callback_t callback, void *userdata);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -19,6 +19,8 @@
  * MA 02110-1301 USA
  */
 
+#define LOG_SUBSYSTEM DC_LOGSUBSYSTEM_PARSER
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -35,6 +37,8 @@
 #include "context-private.h"
 #include "parser-private.h"
 #include "array.h"
+#include "gastable.h"
+#include "pool.h"
 
 #define ISINSTANCE(parser)	( \
 	dc_parser_isinstance((parser), &shearwater_predator_parser_vtable) || \
@@ -86,6 +90,11 @@
 
 #define UNDEFINED 0xFFFFFFFF
 
+// Cache tiers.
+#define CACHE_HEADER  0x01
+#define CACHE_SAMPLES 0x02
+#define CACHE_STRINGS 0x04
+
 typedef struct shearwater_predator_parser_t shearwater_predator_parser_t;
 
 struct shearwater_predator_parser_t {
@@ -105,8 +114,12 @@ struct shearwater_predator_parser_t {
 	unsigned int ngasmixes;
 	unsigned int oxygen[NGASMIXES];
 	unsigned int helium[NGASMIXES];
+	dc_gastable_t gastable;
 	unsigned int calibrated;
+	unsigned int voted;
 	double calibration[3];
+	unsigned int t1_battery;
+	unsigned int t2_battery;
 	unsigned int serial;
 	dc_divemode_t mode;
 	unsigned int units;
@@ -115,14 +128,18 @@ struct shearwater_predator_parser_t {
 
 	/* String fields */
 	dc_field_string_t strings[MAXSTRINGS];
+	dc_strpool_t strpool;
 };
 
 static dc_status_t shearwater_predator_parser_set_data (dc_parser_t *abstract, const unsigned char *data, unsigned int size);
 static dc_status_t shearwater_predator_parser_get_datetime (dc_parser_t *abstract, dc_datetime_t *datetime);
 static dc_status_t shearwater_predator_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, unsigned int flags, void *value);
 static dc_status_t shearwater_predator_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t callback, void *userdata);
+static dc_status_t shearwater_predator_parser_destroy (dc_parser_t *abstract);
 
 static dc_status_t shearwater_predator_parser_cache (shearwater_predator_parser_t *parser);
+static dc_status_t shearwater_predator_parser_cache_samples (shearwater_predator_parser_t *parser);
+static dc_status_t shearwater_predator_parser_cache_strings (shearwater_predator_parser_t *parser);
 
 static const dc_parser_vtable_t shearwater_predator_parser_vtable = {
 	sizeof(shearwater_predator_parser_t),
@@ -131,7 +148,7 @@ static const dc_parser_vtable_t shearwater_predator_parser_vtable = {
 	shearwater_predator_parser_get_datetime, /* datetime */
 	shearwater_predator_parser_get_field, /* fields */
 	shearwater_predator_parser_samples_foreach, /* samples_foreach */
-	NULL /* destroy */
+	shearwater_predator_parser_destroy /* destroy */
 };
 
 static const dc_parser_vtable_t shearwater_petrel_parser_vtable = {
@@ -141,24 +158,10 @@ static const dc_parser_vtable_t shearwater_petrel_parser_vtable = {
 	shearwater_predator_parser_get_datetime, /* datetime */
 	shearwater_predator_parser_get_field, /* fields */
 	shearwater_predator_parser_samples_foreach, /* samples_foreach */
-	NULL /* destroy */
+	shearwater_predator_parser_destroy /* destroy */
 };
 
 
-static unsigned int
-shearwater_predator_find_gasmix (shearwater_predator_parser_t *parser, unsigned int o2, unsigned int he)
-{
-	unsigned int i = 0;
-	while (i < parser->ngasmixes) {
-		if (o2 == parser->oxygen[i] && he == parser->helium[i])
-			break;
-		i++;
-	}
-
-	return i;
-}
-
-
 static dc_status_t
 shearwater_common_parser_create (dc_parser_t **out, dc_context_t *context, unsigned int model, unsigned int serial, unsigned int petrel)
 {
@@ -206,14 +209,20 @@ shearwater_common_parser_create (dc_parser_t **out, dc_context_t *context, unsig
 		parser->oxygen[i] = 0;
 		parser->helium[i] = 0;
 	}
+	dc_gastable_init (&parser->gastable);
 	parser->calibrated = 0;
+	parser->voted = 0;
 	for (unsigned int i = 0; i < 3; ++i) {
 		parser->calibration[i] = 0.0;
 	}
+	parser->t1_battery = 0;
+	parser->t2_battery = 0;
 	parser->mode = DC_DIVEMODE_OC;
 	parser->units = METRIC;
 	parser->density = 1025;
 	parser->atmospheric = ATM / (BAR / 1000);
+	memset (parser->strings, 0, sizeof (parser->strings));
+	dc_strpool_init (&parser->strpool, context);
 
 	*out = (dc_parser_t *) parser;
 
@@ -256,10 +265,14 @@ shearwater_predator_parser_set_data (dc_parser_t *abstract, const unsigned char
 		parser->oxygen[i] = 0;
 		parser->helium[i] = 0;
 	}
+	dc_gastable_init (&parser->gastable);
 	parser->calibrated = 0;
+	parser->voted = 0;
 	for (unsigned int i = 0; i < 3; ++i) {
 		parser->calibration[i] = 0.0;
 	}
+	parser->t1_battery = 0;
+	parser->t2_battery = 0;
 	parser->mode = DC_DIVEMODE_OC;
 	parser->units = METRIC;
 	parser->density = 1025;
@@ -269,6 +282,17 @@ shearwater_predator_parser_set_data (dc_parser_t *abstract, const unsigned char
 }
 
 
+static dc_status_t
+shearwater_predator_parser_destroy (dc_parser_t *abstract)
+{
+	shearwater_predator_parser_t *parser = (shearwater_predator_parser_t *) abstract;
+
+	dc_strpool_cleanup (&parser->strpool);
+
+	return DC_STATUS_SUCCESS;
+}
+
+
 static dc_status_t
 shearwater_predator_parser_get_datetime (dc_parser_t *abstract, dc_datetime_t *datetime)
 {
@@ -306,7 +330,7 @@ add_string(shearwater_predator_parser_t *parser, const char *desc, const char *v
 		if (str->desc)
 			continue;
 		str->desc = desc;
-		str->value = strdup(value);
+		str->value = dc_strpool_intern(&parser->strpool, value);
 		break;
 	}
 }
@@ -442,10 +466,9 @@ shearwater_predator_parser_cache (shearwater_predator_parser_t *parser)
 	const unsigned char *data = parser->base.data;
 	unsigned int size = parser->base.size;
 
-	if (parser->cached) {
+	if (parser->cached & CACHE_HEADER) {
 		return DC_STATUS_SUCCESS;
 	}
-	memset(parser->strings, 0, sizeof(parser->strings));
 
 	// Verify the minimum length.
 	if (size < 2) {
@@ -489,8 +512,104 @@ shearwater_predator_parser_cache (shearwater_predator_parser_t *parser)
 			parser->opening[i] = 0;
 			parser->closing[i] = size - footersize;
 		}
+	} else {
+		// Locate the opening and closing records, which are interleaved
+		// with the samples. Only the record type needs to be inspected.
+		unsigned int offset = 0;
+		while (offset + parser->samplesize <= size) {
+			unsigned int type = data[offset];
+			if (type >= LOG_RECORD_OPENING_0 && type <= LOG_RECORD_OPENING_7) {
+				// Opening record
+				parser->opening[type - LOG_RECORD_OPENING_0] = offset;
+			} else if (type >= LOG_RECORD_CLOSING_0 && type <= LOG_RECORD_CLOSING_7) {
+				// Closing record
+				parser->closing[type - LOG_RECORD_CLOSING_0] = offset;
+			} else if (type == LOG_RECORD_FINAL) {
+				// Final record
+				parser->final = offset;
+			}
+
+			offset += parser->samplesize;
+		}
+	}
+
+	// Verify the required opening/closing records.
+	for (unsigned int i = 0; i < NRECORDS - 2; ++i) {
+		if (parser->opening[i] == UNDEFINED || parser->closing[i] == UNDEFINED) {
+			ERROR (abstract->context, "Opening or closing record %u not found.", i);
+			return DC_STATUS_DATAFORMAT;
+		}
 	}
 
+	// Log versions before 6 weren't reliably stored in the data, but
+	// 6 is also the oldest version that we assume in our code
+	unsigned int logversion = data[parser->opening[4] + (pnf ? 16 : 127)];
+
+	// Cache sensor calibration for later use
+	unsigned int nsensors = 0, ndefaults = 0;
+	unsigned int base = parser->opening[3] + (pnf ? 6 : 86);
+	for (size_t i = 0; i < 3; ++i) {
+		unsigned int calibration = array_uint16_be(data + base + 1 + i * 2);
+		parser->calibration[i] = calibration / 100000.0;
+		if (parser->model == PREDATOR) {
+			// The Predator expects the mV output of the cells to be
+			// within 30mV to 70mV in 100% O2 at 1 atmosphere. If the
+			// calibration value is scaled with a factor 2.2, then the
+			// sensors lines up and matches the average.
+			parser->calibration[i] *= 2.2;
+		}
+		if (data[base] & (1 << i)) {
+			if (calibration == 2100) {
+				ndefaults++;
+			}
+			nsensors++;
+		}
+	}
+	if (nsensors && nsensors == ndefaults) {
+		// If all (calibrated) sensors still have their factory default
+		// calibration values (2100), they are probably not calibrated
+		// properly. To avoid returning incorrect ppO2 values to the
+		// application, they are manually disabled (e.g. marked as
+		// uncalibrated).
+		WARNING (abstract->context, "Disabled all O2 sensors due to a default calibration value.");
+		parser->calibrated = 0;
+		parser->voted = 1;
+	} else {
+		parser->calibrated = data[base];
+		parser->voted = 0;
+	}
+
+	// Cache the data for later use.
+	parser->pnf = pnf;
+	parser->logversion = logversion;
+	parser->headersize = headersize;
+	parser->footersize = footersize;
+	parser->units = data[parser->opening[0] + 8];
+	parser->atmospheric = array_uint16_be (data + parser->opening[1] + (parser->pnf ? 16 : 47));
+	parser->density = array_uint16_be (data + parser->opening[3] + (parser->pnf ? 3 : 83));
+	parser->cached |= CACHE_HEADER;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+shearwater_predator_parser_cache_samples (shearwater_predator_parser_t *parser)
+{
+	dc_parser_t *abstract = (dc_parser_t *) parser;
+	const unsigned char *data = parser->base.data;
+	unsigned int size = parser->base.size;
+
+	if (parser->cached & CACHE_SAMPLES) {
+		return DC_STATUS_SUCCESS;
+	}
+
+	// Cache the header data.
+	dc_status_t rc = shearwater_predator_parser_cache (parser);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	unsigned int pnf = parser->pnf;
+
 	// Default dive mode.
 	dc_divemode_t mode = DC_DIVEMODE_OC;
 
@@ -499,12 +618,14 @@ shearwater_predator_parser_cache (shearwater_predator_parser_t *parser)
 	unsigned int oxygen[NGASMIXES] = {0};
 	unsigned int helium[NGASMIXES] = {0};
 	unsigned int o2_previous = 0, he_previous = 0;
+	dc_gastable_t gastable;
+	dc_gastable_init (&gastable);
 
 	// Transmitter battery levels
 	unsigned int t1_battery = 0, t2_battery = 0;
 
-	unsigned int offset = headersize;
-	unsigned int length = size - footersize;
+	unsigned int offset = parser->headersize;
+	unsigned int length = size - parser->footersize;
 	while (offset + parser->samplesize <= length) {
 		// Ignore empty samples.
 		if (array_isequal (data + offset, parser->samplesize, 0x00)) {
@@ -527,12 +648,7 @@ shearwater_predator_parser_cache (shearwater_predator_parser_t *parser)
 			unsigned int he = data[offset + 8 + pnf];
 			if (o2 != o2_previous || he != he_previous) {
 				// Find the gasmix in the list.
-				unsigned int idx = 0;
-				while (idx < ngasmixes) {
-					if (o2 == oxygen[idx] && he == helium[idx])
-						break;
-					idx++;
-				}
+				unsigned int idx = dc_gastable_find (&gastable, GASTABLE_KEY (o2, he, 0));
 
 				// Add it to list if not found.
 				if (idx >= ngasmixes) {
@@ -540,6 +656,7 @@ shearwater_predator_parser_cache (shearwater_predator_parser_t *parser)
 						ERROR (abstract->context, "Maximum number of gas mixes reached.");
 						return DC_STATUS_NOMEMORY;
 					}
+					dc_gastable_add (&gastable, GASTABLE_KEY (o2, he, 0));
 					oxygen[idx] = o2;
 					helium[idx] = he;
 					ngasmixes = idx + 1;
@@ -556,99 +673,61 @@ shearwater_predator_parser_cache (shearwater_predator_parser_t *parser)
 		} else if (type == LOG_RECORD_FREEDIVE_SAMPLE) {
 			// Freedive record
 			mode = DC_DIVEMODE_FREEDIVE;
-		} else if (type >= LOG_RECORD_OPENING_0 && type <= LOG_RECORD_OPENING_7) {
-			// Opening record
-			parser->opening[type - LOG_RECORD_OPENING_0] = offset;
-		} else if (type >= LOG_RECORD_CLOSING_0 && type <= LOG_RECORD_CLOSING_7) {
-			// Closing record
-			parser->closing[type - LOG_RECORD_CLOSING_0] = offset;
-		} else if (type == LOG_RECORD_FINAL) {
-			// Final record
-			parser->final = offset;
 		}
 
 		offset += parser->samplesize;
 	}
 
-	// Verify the required opening/closing records.
-	for (unsigned int i = 0; i < NRECORDS - 2; ++i) {
-		if (parser->opening[i] == UNDEFINED || parser->closing[i] == UNDEFINED) {
-			ERROR (abstract->context, "Opening or closing record %u not found.", i);
-			return DC_STATUS_DATAFORMAT;
-		}
-	}
-
-	// Log versions before 6 weren't reliably stored in the data, but
-	// 6 is also the oldest version that we assume in our code
-	unsigned int logversion = data[parser->opening[4] + (pnf ? 16 : 127)];
-	add_string_fmt(parser, "Logversion", "%d%s", logversion, pnf ? "(PNF)" : "");
-
 	// The transmitter battery levels are only valid for logversion 7+
-	if (logversion < 7) {
+	if (parser->logversion < 7) {
 		t1_battery = 0;
 		t2_battery = 0;
 	}
 
-	// Cache sensor calibration for later use
-	unsigned int nsensors = 0, ndefaults = 0;
-	unsigned int base = parser->opening[3] + (pnf ? 6 : 86);
-	for (size_t i = 0; i < 3; ++i) {
-		unsigned int calibration = array_uint16_be(data + base + 1 + i * 2);
-		parser->calibration[i] = calibration / 100000.0;
-		if (parser->model == PREDATOR) {
-			// The Predator expects the mV output of the cells to be
-			// within 30mV to 70mV in 100% O2 at 1 atmosphere. If the
-			// calibration value is scaled with a factor 2.2, then the
-			// sensors lines up and matches the average.
-			parser->calibration[i] *= 2.2;
-		}
-		if (data[base] & (1 << i)) {
-			if (calibration == 2100) {
-				ndefaults++;
-			}
-			nsensors++;
-		}
-	}
-	if (nsensors && nsensors == ndefaults) {
-		// If all (calibrated) sensors still have their factory default
-		// calibration values (2100), they are probably not calibrated
-		// properly. To avoid returning incorrect ppO2 values to the
-		// application, they are manually disabled (e.g. marked as
-		// uncalibrated).
-		WARNING (abstract->context, "Disabled all O2 sensors due to a default calibration value.");
-		parser->calibrated = 0;
-		if (mode != DC_DIVEMODE_OC)
-			add_string(parser, "PPO2 source", "voted/averaged");
-	} else {
-		parser->calibrated = data[base];
-		if (mode != DC_DIVEMODE_OC)
-			add_string(parser, "PPO2 source", "cells");
-	}
-
 	// Cache the data for later use.
-	parser->pnf = pnf;
-	parser->logversion = logversion;
-	parser->headersize = headersize;
-	parser->footersize = footersize;
 	parser->ngasmixes = ngasmixes;
 	for (unsigned int i = 0; i < ngasmixes; ++i) {
 		parser->oxygen[i] = oxygen[i];
 		parser->helium[i] = helium[i];
 	}
+	parser->gastable = gastable;
 	parser->mode = mode;
-	parser->units = data[parser->opening[0] + 8];
-	parser->atmospheric = array_uint16_be (data + parser->opening[1] + (parser->pnf ? 16 : 47));
-	parser->density = array_uint16_be (data + parser->opening[3] + (parser->pnf ? 3 : 83));
-	parser->cached = 1;
+	parser->t1_battery = t1_battery;
+	parser->t2_battery = t2_battery;
+	parser->cached |= CACHE_SAMPLES;
 
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+shearwater_predator_parser_cache_strings (shearwater_predator_parser_t *parser)
+{
+	const unsigned char *data = parser->base.data;
+
+	if (parser->cached & CACHE_STRINGS) {
+		return DC_STATUS_SUCCESS;
+	}
+
+	// Cache the sample data (which includes the header data).
+	dc_status_t rc = shearwater_predator_parser_cache_samples (parser);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	memset(parser->strings, 0, sizeof(parser->strings));
+	dc_strpool_trim(&parser->strpool);
+
+	add_string_fmt(parser, "Logversion", "%d%s", parser->logversion, parser->pnf ? "(PNF)" : "");
+	if (parser->mode != DC_DIVEMODE_OC)
+		add_string(parser, "PPO2 source", parser->voted ? "voted/averaged" : "cells");
 	add_string_fmt(parser, "Serial", "%08x", parser->serial);
 	// bytes 1-31 are identical in all formats
 	add_string_fmt(parser, "FW Version", "%2x", data[19]);
 	add_deco_model(parser, data);
 	add_battery_type(parser, data);
 	add_string_fmt(parser, "Battery at end", "%.1f V", data[9] / 10.0);
-	add_battery_info(parser, "T1 battery", t1_battery);
-	add_battery_info(parser, "T2 battery", t2_battery);
+	add_battery_info(parser, "T1 battery", parser->t1_battery);
+	add_battery_info(parser, "T2 battery", parser->t2_battery);
+	parser->cached |= CACHE_STRINGS;
 
 	return DC_STATUS_SUCCESS;
 }
@@ -660,8 +739,21 @@ shearwater_predator_parser_get_field (dc_parser_t *abstract, dc_field_type_t typ
 
 	const unsigned char *data = abstract->data;
 
-	// Cache the parser data.
-	dc_status_t rc = shearwater_predator_parser_cache (parser);
+	// Cache only the data needed for the requested field.
+	dc_status_t rc = DC_STATUS_SUCCESS;
+	switch (type) {
+	case DC_FIELD_GASMIX_COUNT:
+	case DC_FIELD_GASMIX:
+	case DC_FIELD_DIVEMODE:
+		rc = shearwater_predator_parser_cache_samples (parser);
+		break;
+	case DC_FIELD_STRING:
+		rc = shearwater_predator_parser_cache_strings (parser);
+		break;
+	default:
+		rc = shearwater_predator_parser_cache (parser);
+		break;
+	}
 	if (rc != DC_STATUS_SUCCESS)
 		return rc;
 
@@ -733,7 +825,7 @@ shearwater_predator_parser_samples_foreach (dc_parser_t *abstract, dc_sample_cal
 	unsigned int size = abstract->size;
 
 	// Cache the parser data.
-	dc_status_t rc = shearwater_predator_parser_cache (parser);
+	dc_status_t rc = shearwater_predator_parser_cache_samples (parser);
 	if (rc != DC_STATUS_SUCCESS)
 		return rc;
 
@@ -876,7 +968,7 @@ shearwater_predator_parser_samples_foreach (dc_parser_t *abstract, dc_sample_cal
 			unsigned int o2 = data[offset + pnf + 7];
 			unsigned int he = data[offset + pnf + 8];
 			if (o2 != o2_previous || he != he_previous) {
-				unsigned int idx = shearwater_predator_find_gasmix (parser, o2, he);
+				unsigned int idx = dc_gastable_find (&parser->gastable, GASTABLE_KEY (o2, he, 0));
 				if (idx >= parser->ngasmixes) {
 					ERROR (abstract->context, "Invalid gas mix.");
 					return DC_STATUS_DATAFORMAT;
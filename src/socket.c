@@ -19,10 +19,16 @@
  * MA 02110-1301 USA
  */
 
+#define LOG_SUBSYSTEM DC_LOGSUBSYSTEM_IOSTREAM
+
 #include "socket.h"
 
 #include "common-private.h"
 #include "context-private.h"
+#include "reactor.h"
+
+// Maximum number of buffers for the native scatter/gather transfers.
+#define MAXIOV 16
 
 dc_status_t
 dc_socket_syserror (s_errcode_t errcode)
@@ -90,6 +96,7 @@ dc_socket_open (dc_iostream_t *abstract, int family, int type, int protocol)
 
 	// Default to blocking reads.
 	device->timeout = -1;
+	device->interrupted = 0;
 
 	// Initialize the socket library.
 	status = dc_socket_init (abstract->context);
@@ -120,6 +127,9 @@ dc_socket_close (dc_iostream_t *abstract)
 	dc_socket_t *socket = (dc_socket_t *) abstract;
 	dc_status_t rc = DC_STATUS_SUCCESS;
 
+	// Cancel the pending asynchronous transfers.
+	dc_reactor_cancel (abstract);
+
 	// Terminate all send and receive operations.
 	shutdown (socket->fd, 0);
 
@@ -187,27 +197,126 @@ dc_socket_get_available (dc_iostream_t *abstract, size_t *value)
 }
 
 dc_status_t
-dc_socket_read (dc_iostream_t *abstract, void *data, size_t size, size_t *actual)
+dc_socket_set_option (dc_iostream_t *abstract, int level, int name, int value)
+{
+	dc_socket_t *socket = (dc_socket_t *) abstract;
+
+	if (setsockopt (socket->fd, level, name, (const char *) &value, sizeof (value)) != 0) {
+		s_errcode_t errcode = S_ERRNO;
+		SYSERROR (abstract->context, errcode);
+		return dc_socket_syserror(errcode);
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+/*
+ * Wait until the socket is ready for reading or writing. A poll on a
+ * single descriptor has no FD_SETSIZE limit, and doesn't need to rebuild
+ * the descriptor set on every call. Winsock only has a reliable select.
+ */
+static int
+dc_socket_wait (s_socket_t fd, int output, int timeout)
+{
+#ifdef _WIN32
+	fd_set fds;
+	FD_ZERO (&fds);
+	FD_SET (fd, &fds);
+
+	struct timeval tvt;
+	if (timeout > 0) {
+		tvt.tv_sec  = (timeout / 1000);
+		tvt.tv_usec = (timeout % 1000) * 1000;
+	} else if (timeout == 0) {
+		timerclear (&tvt);
+	}
+
+	return select (fd + 1, output ? NULL : &fds, output ? &fds : NULL, NULL, timeout >= 0 ? &tvt : NULL);
+#else
+	struct pollfd pfd;
+	pfd.fd = fd;
+	pfd.events = output ? POLLOUT : POLLIN;
+	pfd.revents = 0;
+
+	return poll (&pfd, 1, timeout);
+#endif
+}
+
+static size_t
+dc_socket_iovec_size (const dc_iovec_t iov[], size_t count)
+{
+	size_t size = 0;
+	for (size_t i = 0; i < count; ++i)
+		size += iov[i].size;
+	return size;
+}
+
+static void
+dc_socket_iovec_advance (dc_iovec_t **iov, size_t *count, size_t n)
+{
+	while (*count && n >= (*iov)->size) {
+		n -= (*iov)->size;
+		(*iov)++;
+		(*count)--;
+	}
+
+	if (*count && n) {
+		(*iov)->data = (char *) (*iov)->data + n;
+		(*iov)->size -= n;
+	}
+}
+
+static s_ssize_t
+dc_socket_recvv (s_socket_t fd, const dc_iovec_t iov[], size_t count)
+{
+#ifdef _WIN32
+	// Receive into the first buffer only.
+	return recv (fd, (char *) iov[0].data, iov[0].size, 0);
+#else
+	struct iovec buffer[MAXIOV];
+	for (size_t i = 0; i < count; ++i) {
+		buffer[i].iov_base = iov[i].data;
+		buffer[i].iov_len = iov[i].size;
+	}
+
+	return readv (fd, buffer, count);
+#endif
+}
+
+static s_ssize_t
+dc_socket_sendv (s_socket_t fd, const dc_iovec_t iov[], size_t count)
+{
+#ifdef _WIN32
+	// Send from the first buffer only.
+	return send (fd, (const char *) iov[0].data, iov[0].size, 0);
+#else
+	struct iovec buffer[MAXIOV];
+	for (size_t i = 0; i < count; ++i) {
+		buffer[i].iov_base = iov[i].data;
+		buffer[i].iov_len = iov[i].size;
+	}
+
+	return writev (fd, buffer, count);
+#endif
+}
+
+static dc_status_t
+dc_socket_transfer_read (dc_iostream_t *abstract, dc_iovec_t iov[], size_t count, size_t *actual)
 {
 	dc_status_t status = DC_STATUS_SUCCESS;
 	dc_socket_t *socket = (dc_socket_t *) abstract;
 	size_t nbytes = 0;
+	size_t size = dc_socket_iovec_size (iov, count);
 
-	while (nbytes < size) {
-		fd_set fds;
-		FD_ZERO (&fds);
-		FD_SET (socket->fd, &fds);
-
-		struct timeval tvt;
-		if (socket->timeout > 0) {
-			tvt.tv_sec  = (socket->timeout / 1000);
-			tvt.tv_usec = (socket->timeout % 1000) * 1000;
-		} else if (socket->timeout == 0) {
-			timerclear (&tvt);
-		}
+	// Skip the empty buffers.
+	dc_socket_iovec_advance (&iov, &count, 0);
 
-		int rc = select (socket->fd + 1, &fds, NULL, NULL, socket->timeout >= 0 ? &tvt : NULL);
-		if (rc < 0) {
+	while (nbytes < size) {
+		int rc = dc_socket_wait (socket->fd, 0, socket->timeout);
+		if (socket->interrupted) {
+			status = DC_STATUS_CANCELLED;
+			goto out;
+		} else if (rc < 0) {
 			s_errcode_t errcode = S_ERRNO;
 			if (errcode == S_EINTR)
 				continue; // Retry.
@@ -218,7 +327,7 @@ dc_socket_read (dc_iostream_t *abstract, void *data, size_t size, size_t *actual
 			break; // Timeout.
 		}
 
-		s_ssize_t n = recv (socket->fd, (char *) data + nbytes, size - nbytes, 0);
+		s_ssize_t n = dc_socket_recvv (socket->fd, iov, count);
 		if (n < 0) {
 			s_errcode_t errcode = S_ERRNO;
 			if (errcode == S_EINTR || errcode == S_EAGAIN)
@@ -231,6 +340,7 @@ dc_socket_read (dc_iostream_t *abstract, void *data, size_t size, size_t *actual
 		}
 
 		nbytes += n;
+		dc_socket_iovec_advance (&iov, &count, n);
 	}
 
 	if (nbytes != size) {
@@ -244,20 +354,23 @@ out:
 	return status;
 }
 
-dc_status_t
-dc_socket_write (dc_iostream_t *abstract, const void *data, size_t size, size_t *actual)
+static dc_status_t
+dc_socket_transfer_write (dc_iostream_t *abstract, dc_iovec_t iov[], size_t count, size_t *actual)
 {
 	dc_status_t status = DC_STATUS_SUCCESS;
 	dc_socket_t *socket = (dc_socket_t *) abstract;
 	size_t nbytes = 0;
+	size_t size = dc_socket_iovec_size (iov, count);
 
-	while (nbytes < size) {
-		fd_set fds;
-		FD_ZERO (&fds);
-		FD_SET (socket->fd, &fds);
+	// Skip the empty buffers.
+	dc_socket_iovec_advance (&iov, &count, 0);
 
-		int rc = select (socket->fd + 1, NULL, &fds, NULL, NULL);
-		if (rc < 0) {
+	while (nbytes < size) {
+		int rc = dc_socket_wait (socket->fd, 1, -1);
+		if (socket->interrupted) {
+			status = DC_STATUS_CANCELLED;
+			goto out;
+		} else if (rc < 0) {
 			s_errcode_t errcode = S_ERRNO;
 			if (errcode == S_EINTR)
 				continue; // Retry.
@@ -268,7 +381,7 @@ dc_socket_write (dc_iostream_t *abstract, const void *data, size_t size, size_t
 			break; // Timeout.
 		}
 
-		s_ssize_t n = send (socket->fd, (const char *) data + nbytes, size - nbytes, 0);
+		s_ssize_t n = dc_socket_sendv (socket->fd, iov, count);
 		if (n < 0) {
 			s_errcode_t errcode = S_ERRNO;
 			if (errcode == S_EINTR || errcode == S_EAGAIN)
@@ -281,6 +394,7 @@ dc_socket_write (dc_iostream_t *abstract, const void *data, size_t size, size_t
 		}
 
 		nbytes += n;
+		dc_socket_iovec_advance (&iov, &count, n);
 	}
 
 	if (nbytes != size) {
@@ -294,6 +408,116 @@ out:
 	return status;
 }
 
+dc_status_t
+dc_socket_read (dc_iostream_t *abstract, void *data, size_t size, size_t *actual)
+{
+	dc_iovec_t iov = {data, size};
+
+	return dc_socket_transfer_read (abstract, &iov, 1, actual);
+}
+
+dc_status_t
+dc_socket_write (dc_iostream_t *abstract, const void *data, size_t size, size_t *actual)
+{
+	dc_iovec_t iov = {(void *) data, size};
+
+	return dc_socket_transfer_write (abstract, &iov, 1, actual);
+}
+
+dc_status_t
+dc_socket_readv (dc_iostream_t *abstract, const dc_iovec_t iov[], size_t count, size_t *actual)
+{
+	dc_iovec_t buffer[MAXIOV];
+
+	if (count > MAXIOV)
+		return DC_STATUS_UNSUPPORTED;
+
+	for (size_t i = 0; i < count; ++i)
+		buffer[i] = iov[i];
+
+	return dc_socket_transfer_read (abstract, buffer, count, actual);
+}
+
+dc_status_t
+dc_socket_writev (dc_iostream_t *abstract, const dc_iovec_t iov[], size_t count, size_t *actual)
+{
+	dc_iovec_t buffer[MAXIOV];
+
+	if (count > MAXIOV)
+		return DC_STATUS_UNSUPPORTED;
+
+	for (size_t i = 0; i < count; ++i)
+		buffer[i] = iov[i];
+
+	return dc_socket_transfer_write (abstract, buffer, count, actual);
+}
+
+dc_status_t
+dc_socket_read_async (dc_iostream_t *abstract, void *data, size_t size, dc_iostream_callback_t callback, void *userdata)
+{
+#ifdef _WIN32
+	return DC_STATUS_UNSUPPORTED;
+#else
+	dc_socket_t *socket = (dc_socket_t *) abstract;
+
+	return dc_reactor_submit (abstract, socket->fd, 1, DC_DIRECTION_INPUT, data, size, socket->timeout, callback, userdata);
+#endif
+}
+
+dc_status_t
+dc_socket_write_async (dc_iostream_t *abstract, const void *data, size_t size, dc_iostream_callback_t callback, void *userdata)
+{
+#ifdef _WIN32
+	return DC_STATUS_UNSUPPORTED;
+#else
+	dc_socket_t *socket = (dc_socket_t *) abstract;
+
+	return dc_reactor_submit (abstract, socket->fd, 1, DC_DIRECTION_OUTPUT, (void *) data, size, -1, callback, userdata);
+#endif
+}
+
+dc_status_t
+dc_socket_cancel (dc_iostream_t *abstract)
+{
+	return dc_reactor_cancel (abstract);
+}
+
+dc_status_t
+dc_socket_interrupt (dc_iostream_t *abstract)
+{
+	dc_socket_t *socket = (dc_socket_t *) abstract;
+
+	// Shutting down the socket wakes up the blocked transfers, which
+	// notice the flag before they touch the socket again.
+	socket->interrupted = 1;
+	if (shutdown (socket->fd, 2) != 0) {
+		return dc_socket_syserror (S_ERRNO);
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_socket_wait_readable (dc_iostream_t *abstract, int timeout)
+{
+	dc_socket_t *socket = (dc_socket_t *) abstract;
+
+	while (1) {
+		int rc = dc_socket_wait (socket->fd, 0, timeout);
+		if (socket->interrupted) {
+			return DC_STATUS_CANCELLED;
+		} else if (rc < 0) {
+			s_errcode_t errcode = S_ERRNO;
+			if (errcode == S_EINTR)
+				continue; // Retry.
+			SYSERROR (abstract->context, errcode);
+			return dc_socket_syserror(errcode);
+		}
+
+		return rc ? DC_STATUS_SUCCESS : DC_STATUS_TIMEOUT;
+	}
+}
+
 dc_status_t
 dc_socket_sleep (dc_iostream_t *abstract, unsigned int timeout)
 {
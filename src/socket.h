@@ -31,8 +31,9 @@
 #include <unistd.h>     // close
 #include <sys/types.h>  // socket, getsockopt
 #include <sys/socket.h> // socket, getsockopt
-#include <sys/select.h> // select
+#include <poll.h>       // poll
 #include <sys/ioctl.h>  // ioctl
+#include <sys/uio.h>    // readv, writev
 #include <sys/time.h>
 #include <time.h>
 #endif
@@ -82,6 +83,7 @@ typedef struct dc_socket_t {
 	dc_iostream_t base;
 	s_socket_t fd;
 	int timeout;
+	volatile int interrupted;
 } dc_socket_t;
 
 dc_status_t
@@ -105,6 +107,9 @@ dc_socket_connect (dc_iostream_t *iostream, const struct sockaddr *addr, s_sockl
 dc_status_t
 dc_socket_set_timeout (dc_iostream_t *iostream, int timeout);
 
+dc_status_t
+dc_socket_set_option (dc_iostream_t *iostream, int level, int name, int value);
+
 dc_status_t
 dc_socket_get_available (dc_iostream_t *iostream, size_t *value);
 
@@ -114,9 +119,30 @@ dc_socket_read (dc_iostream_t *iostream, void *data, size_t size, size_t *actual
 dc_status_t
 dc_socket_write (dc_iostream_t *iostream, const void *data, size_t size, size_t *actual);
 
+dc_status_t
+dc_socket_readv (dc_iostream_t *iostream, const dc_iovec_t iov[], size_t count, size_t *actual);
+
+dc_status_t
+dc_socket_writev (dc_iostream_t *iostream, const dc_iovec_t iov[], size_t count, size_t *actual);
+
 dc_status_t
 dc_socket_sleep (dc_iostream_t *abstract, unsigned int timeout);
 
+dc_status_t
+dc_socket_read_async (dc_iostream_t *iostream, void *data, size_t size, dc_iostream_callback_t callback, void *userdata);
+
+dc_status_t
+dc_socket_write_async (dc_iostream_t *iostream, const void *data, size_t size, dc_iostream_callback_t callback, void *userdata);
+
+dc_status_t
+dc_socket_cancel (dc_iostream_t *iostream);
+
+dc_status_t
+dc_socket_interrupt (dc_iostream_t *iostream);
+
+dc_status_t
+dc_socket_wait_readable (dc_iostream_t *iostream, int timeout);
+
 dc_status_t
 dc_socket_close (dc_iostream_t *iostream);
 
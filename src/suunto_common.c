@@ -59,6 +59,42 @@ suunto_common_device_set_fingerprint (dc_device_t *abstract, const unsigned char
 }
 
 
+/*
+ * Find the start of the previous dive, below the current position. A
+ * dive starts where the end of dive marker of the next dive is found,
+ * a fixed number of bytes earlier. The markers are located with a
+ * backward search, rather than testing every byte.
+ */
+static int
+suunto_common_find_dive (const unsigned char buffer[], unsigned int length, unsigned int first, unsigned int peek, unsigned int *current)
+{
+	const unsigned char marker = 0x80;
+	unsigned int lower = first > peek ? first : peek;
+	unsigned int position = *current;
+
+	if (position > lower) {
+		const unsigned char *p = array_search_backward (buffer + lower - peek, position - lower, &marker, 1);
+		if (p) {
+			*current = (p - buffer - 1) + peek;
+			return 1;
+		}
+		position = lower;
+	}
+
+	// The marker of the dives at the very start of the linear buffer
+	// wraps around to the end of the ringbuffer.
+	while (position > first) {
+		position--;
+		if (position < peek && buffer[length + position - peek] == marker) {
+			*current = position;
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+
 dc_status_t
 suunto_common_extract_dives (suunto_common_device_t *device, const suunto_common_layout_t *layout, const unsigned char data[], dc_dive_callback_t callback, void *userdata)
 {
@@ -71,12 +107,9 @@ suunto_common_extract_dives (suunto_common_device_t *device, const suunto_common
 	} else {
 		// Get the end-of-profile pointer by searching for the
 		// end-of-profile marker in the profile ringbuffer.
-		eop = layout->rb_profile_begin;
-		while (eop < layout->rb_profile_end) {
-			if (data[eop] == 0x82)
-				break;
-			eop++;
-		}
+		const unsigned char *p = (const unsigned char *) memchr (data + layout->rb_profile_begin, 0x82,
+			layout->rb_profile_end - layout->rb_profile_begin);
+		eop = p ? p - data : layout->rb_profile_end;
 	}
 
 	// Validate the end-of-profile pointer.
@@ -87,56 +120,47 @@ suunto_common_extract_dives (suunto_common_device_t *device, const suunto_common
 		return DC_STATUS_DATAFORMAT;
 	}
 
-	// Memory buffer for the profile ringbuffer.
+	// Make the ringbuffer linear, ending with the end-of-profile marker.
+	// Every dive is then a contiguous block, which can be passed to the
+	// callback directly. A few zero bytes are appended to keep the
+	// fingerprint of a truncated dive within the buffer.
 	unsigned int length = layout->rb_profile_end - layout->rb_profile_begin;
-	unsigned char *buffer = (unsigned char *) malloc (length);
+	unsigned int padding = layout->fp_offset + sizeof (device->fingerprint);
+	unsigned char *buffer = (unsigned char *) malloc (length + padding);
 	if (buffer == NULL)
 		return DC_STATUS_NOMEMORY;
 
-	unsigned int current = eop;
-	unsigned int previous = eop;
-	for (unsigned int i = 0; i < length; ++i) {
-		// Move backwards through the ringbuffer.
-		if (current == layout->rb_profile_begin)
-			current = layout->rb_profile_end;
-		current--;
-
-		// Check for an end of profile marker.
-		if (data[current] == 0x82)
-			break;
-
-		// Check for an end of dive marker (of the next dive),
-		// to find the start of the current dive.
-		unsigned int idx = RB_PROFILE_PEEK (current, layout);
-		if (data[idx] == 0x80) {
-			unsigned int len = RB_PROFILE_DISTANCE (current, previous, layout);
-			if (current + len > layout->rb_profile_end) {
-				unsigned int a = layout->rb_profile_end - current;
-				unsigned int b = (current + len) - layout->rb_profile_end;
-				memcpy (buffer + 0, data + current, a);
-				memcpy (buffer + a, data + layout->rb_profile_begin,   b);
-			} else {
-				memcpy (buffer, data + current, len);
-			}
-
-			if (device && memcmp (buffer + layout->fp_offset, device->fingerprint, sizeof (device->fingerprint)) == 0) {
-				free (buffer);
-				return DC_STATUS_SUCCESS;
-			}
-
-			if (callback && !callback (buffer, len, buffer + layout->fp_offset, sizeof (device->fingerprint), userdata)) {
-				free (buffer);
-				return DC_STATUS_SUCCESS;
-			}
-
-			previous = current;
+	unsigned int tail = layout->rb_profile_end - (eop + 1);
+	memcpy (buffer, data + eop + 1, tail);
+	memcpy (buffer + tail, data + layout->rb_profile_begin, length - tail);
+	memset (buffer + length, 0, padding);
+
+	// Moving backwards from the end-of-profile pointer, the previous
+	// end-of-profile marker (if any) marks the end of the oldest data.
+	const unsigned char eopmarker = 0x82;
+	const unsigned char *p = array_search_backward (buffer, length - 1, &eopmarker, 1);
+	unsigned int first = p ? p - buffer : 0;
+
+	unsigned int previous = length - 1;
+	unsigned int current = previous;
+	while (suunto_common_find_dive (buffer, length, first, layout->peek, &current)) {
+		unsigned int len = previous - current;
+		unsigned char *dive = buffer + current;
+
+		if (device && memcmp (dive + layout->fp_offset, device->fingerprint, sizeof (device->fingerprint)) == 0) {
+			free (buffer);
+			return DC_STATUS_SUCCESS;
 		}
+
+		if (callback && !callback (dive, len, dive + layout->fp_offset, sizeof (device->fingerprint), userdata)) {
+			free (buffer);
+			return DC_STATUS_SUCCESS;
+		}
+
+		previous = current;
 	}
 
 	free (buffer);
 
-	if (data[current] != 0x82)
-		return DC_STATUS_DATAFORMAT;
-
 	return DC_STATUS_SUCCESS;
 }
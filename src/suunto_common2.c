@@ -67,6 +67,7 @@ suunto_common2_transfer (dc_device_t *abstract, const unsigned char command[], u
 
 	unsigned int nretries = 0;
 	dc_status_t rc = DC_STATUS_SUCCESS;
+	dc_usecs_t start = device_latency_start (abstract);
 	while ((rc = VTABLE (abstract)->packet (abstract, command, csize, answer, asize, size)) != DC_STATUS_SUCCESS) {
 		// Automatically discard a corrupted packet,
 		// and request a new one.
@@ -76,8 +77,13 @@ suunto_common2_transfer (dc_device_t *abstract, const unsigned char command[], u
 		// Abort if the maximum number of retries is reached.
 		if (nretries++ >= MAXRETRIES)
 			return rc;
+
+		// Only time the successful attempt.
+		start = device_latency_start (abstract);
 	}
 
+	device_latency_emit (abstract, command[0], size, start);
+
 	return rc;
 }
 
@@ -205,21 +211,184 @@ suunto_common2_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 	assert (device != NULL);
 	assert (device->layout != NULL);
 
-	// Erase the current contents of the buffer and
-	// allocate the required amount of memory.
-	if (!dc_buffer_clear (buffer) || !dc_buffer_resize (buffer, device->layout->memsize)) {
+	const suunto_common2_layout_t *layout = device->layout;
+
+	// Emit a vendor event.
+	dc_event_vendor_t vendor;
+	vendor.data = device->version;
+	vendor.size = sizeof (device->version);
+	device_event_emit (abstract, DC_EVENT_VENDOR, &vendor);
+
+	// Read the header bytes.
+	unsigned char header[8] = {0};
+	dc_status_t rc = suunto_common2_device_read (abstract, 0x0190, header, sizeof (header));
+	if (rc != DC_STATUS_SUCCESS) {
+		ERROR (abstract->context, "Failed to read the memory header.");
+		return rc;
+	}
+
+	// Obtain the pointers from the header.
+	unsigned int count = array_uint16_le (header + 2);
+	unsigned int end   = array_uint16_le (header + 4);
+	unsigned int begin = array_uint16_le (header + 6);
+
+	// The free space of the profile ringbuffer, from the end of the most
+	// recent dive to the begin of the oldest dive, is not downloaded. With
+	// invalid pointers, the entire memory is downloaded instead.
+	device_range_t unused[2];
+	unsigned int nunused = 0;
+	if (end >= layout->rb_profile_begin && end < layout->rb_profile_end &&
+		begin >= layout->rb_profile_begin && begin < layout->rb_profile_end &&
+		(begin != end || count == 0))
+	{
+		ringbuffer_span_t spans[2];
+		unsigned int nspans = ringbuffer_span (end, begin, count == 0,
+			layout->rb_profile_begin, layout->rb_profile_end, spans);
+
+		// The ranges must be sorted by address.
+		for (unsigned int i = nspans; i-- > 0; ) {
+			unused[nunused].address = spans[i].address;
+			unused[nunused].size = spans[i].size;
+			nunused++;
+		}
+	}
+
+	return device_dump_read_sparse (abstract, buffer, layout->memsize,
+		SZ_PACKET, unused, nunused, 0xFF);
+}
+
+
+dc_status_t
+suunto_common2_device_dump_incremental (dc_device_t *abstract, dc_buffer_t *previous, dc_buffer_t *buffer)
+{
+	suunto_common2_device_t *device = (suunto_common2_device_t *) abstract;
+
+	assert (device != NULL);
+	assert (device->layout != NULL);
+
+	const suunto_common2_layout_t *layout = device->layout;
+
+	// The previous image must have the same memory layout.
+	if (dc_buffer_get_size (previous) != layout->memsize) {
+		WARNING (abstract->context, "Unexpected size of the previous memory dump.");
+		return DC_STATUS_UNSUPPORTED;
+	}
+
+	const unsigned char *image = dc_buffer_get_data (previous);
+
+	// Obtain the pointers from the previous image.
+	unsigned int old_last  = array_uint16_le (image + 0x0190 + 0);
+	unsigned int old_count = array_uint16_le (image + 0x0190 + 2);
+	unsigned int old_end   = array_uint16_le (image + 0x0190 + 4);
+	if (old_last < layout->rb_profile_begin ||
+		old_last >= layout->rb_profile_end ||
+		old_end < layout->rb_profile_begin ||
+		old_end >= layout->rb_profile_end)
+	{
+		WARNING (abstract->context, "Invalid ringbuffer pointer in the previous memory dump (0x%04x 0x%04x %u).", old_last, old_end, old_count);
+		return DC_STATUS_UNSUPPORTED;
+	}
+
+	// Read the header bytes.
+	unsigned char header[8] = {0};
+	dc_status_t rc = suunto_common2_device_read (abstract, 0x0190, header, sizeof (header));
+	if (rc != DC_STATUS_SUCCESS) {
+		ERROR (abstract->context, "Failed to read the memory header.");
+		return rc;
+	}
+
+	// Obtain the pointers from the header.
+	unsigned int last  = array_uint16_le (header + 0);
+	unsigned int count = array_uint16_le (header + 2);
+	unsigned int end   = array_uint16_le (header + 4);
+	if (last < layout->rb_profile_begin ||
+		last >= layout->rb_profile_end ||
+		end < layout->rb_profile_begin ||
+		end >= layout->rb_profile_end)
+	{
+		ERROR (abstract->context, "Invalid ringbuffer pointer detected (0x%04x 0x%04x %u).", last, end, count);
+		return DC_STATUS_DATAFORMAT;
+	}
+
+	// A decreasing dive counter indicates the memory has been erased.
+	if (count < old_count) {
+		WARNING (abstract->context, "Dive counter decreased (%u %u).", old_count, count);
+		return DC_STATUS_UNSUPPORTED;
+	}
+
+	// New dives are appended after the most recent dive of the previous
+	// image. Because the header of that dive contains the pointer to the
+	// next dive, it needs to be downloaded again as well.
+	unsigned int unchanged = (last == old_last && end == old_end && count == old_count);
+	unsigned int dirty = unchanged ? 0 : RB_PROFILE_DISTANCE (layout, old_last, end, 0);
+	unsigned int known = RB_PROFILE_DISTANCE (layout, old_last, old_end, 0);
+	if (!unchanged && (dirty == 0 || known > dirty)) {
+		WARNING (abstract->context, "Unexpected ringbuffer pointers (0x%04x 0x%04x 0x%04x 0x%04x).", old_last, old_end, last, end);
+		return DC_STATUS_UNSUPPORTED;
+	}
+
+	// Start from a copy of the previous image.
+	if (!dc_buffer_clear (buffer) || !dc_buffer_append (buffer, image, layout->memsize)) {
 		ERROR (abstract->context, "Insufficient buffer space available.");
 		return DC_STATUS_NOMEMORY;
 	}
 
+	unsigned char *data = dc_buffer_get_data (buffer);
+
 	// Emit a vendor event.
 	dc_event_vendor_t vendor;
 	vendor.data = device->version;
 	vendor.size = sizeof (device->version);
 	device_event_emit (abstract, DC_EVENT_VENDOR, &vendor);
 
-	return device_dump_read (abstract, dc_buffer_get_data (buffer),
-		dc_buffer_get_size (buffer), SZ_PACKET);
+	// Enable progress notifications.
+	dc_event_progress_t progress = EVENT_PROGRESS_INITIALIZER;
+	progress.maximum = layout->rb_profile_begin + dirty +
+		(layout->memsize - layout->rb_profile_end);
+	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
+
+	// Read the memory before the profile ringbuffer.
+	rc = device_dump_read_range (abstract, &progress, 0,
+		data, layout->rb_profile_begin, SZ_PACKET);
+	if (rc != DC_STATUS_SUCCESS) {
+		ERROR (abstract->context, "Failed to read the memory header.");
+		return rc;
+	}
+
+	// Read the modified part of the profile ringbuffer, which
+	// requires two reads if it wraps around the end.
+	ringbuffer_span_t spans[2];
+	unsigned int nspans = unchanged ? 0 : ringbuffer_span (old_last, end, 0,
+		layout->rb_profile_begin, layout->rb_profile_end, spans);
+	for (unsigned int i = 0; i < nspans; ++i) {
+		rc = device_dump_read_range (abstract, &progress, spans[i].address,
+			data + spans[i].address, spans[i].size, SZ_PACKET);
+		if (rc != DC_STATUS_SUCCESS) {
+			ERROR (abstract->context, "Failed to read the profile ringbuffer.");
+			return rc;
+		}
+	}
+
+	// Read the memory after the profile ringbuffer.
+	rc = device_dump_read_range (abstract, &progress, layout->rb_profile_end,
+		data + layout->rb_profile_end, layout->memsize - layout->rb_profile_end, SZ_PACKET);
+	if (rc != DC_STATUS_SUCCESS) {
+		ERROR (abstract->context, "Failed to read the memory.");
+		return rc;
+	}
+
+	// Except for the dive pointers, the most recent dive of the previous
+	// image should still be intact. If not, the ringbuffer has wrapped
+	// around completely, and the other dives can't be trusted either.
+	for (unsigned int i = 4; i < known; ++i) {
+		unsigned int address = ringbuffer_increment (old_last, i, layout->rb_profile_begin, layout->rb_profile_end);
+		if (data[address] != image[address]) {
+			WARNING (abstract->context, "Previous dive has been overwritten.");
+			return DC_STATUS_UNSUPPORTED;
+		}
+	}
+
+	return DC_STATUS_SUCCESS;
 }
 
 
@@ -249,6 +418,7 @@ suunto_common2_device_foreach (dc_device_t *abstract, dc_dive_callback_t callbac
 	device_event_emit (abstract, DC_EVENT_VENDOR, &vendor);
 
 	// Read the serial number.
+	device_profile_phase (abstract, DC_PHASE_VERSION);
 	unsigned char serial[SZ_MINIMUM > 4 ? SZ_MINIMUM : 4] = {0};
 	dc_status_t rc = suunto_common2_device_read (abstract, layout->serial, serial, sizeof (serial));
 	if (rc != DC_STATUS_SUCCESS) {
@@ -272,6 +442,7 @@ suunto_common2_device_foreach (dc_device_t *abstract, dc_dive_callback_t callbac
 	device_event_emit (abstract, DC_EVENT_DEVINFO, &devinfo);
 
 	// Read the header bytes.
+	device_profile_phase (abstract, DC_PHASE_LOGBOOK);
 	unsigned char header[8] = {0};
 	rc = suunto_common2_device_read (abstract, 0x0190, header, sizeof (header));
 	if (rc != DC_STATUS_SUCCESS) {
@@ -310,8 +481,9 @@ suunto_common2_device_foreach (dc_device_t *abstract, dc_dive_callback_t callbac
 	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
 
 	// Create the ringbuffer stream.
+	device_profile_phase (abstract, DC_PHASE_PROFILE);
 	dc_rbstream_t *rbstream = NULL;
-	rc = dc_rbstream_new (&rbstream, abstract, 1, SZ_PACKET, layout->rb_profile_begin, layout->rb_profile_end, end);
+	rc = dc_rbstream_new (&rbstream, abstract, 1, SZ_PACKET, layout->rb_profile_begin, layout->rb_profile_end, end, DC_RBSTREAM_BACKWARD);
 	if (rc != DC_STATUS_SUCCESS) {
 		ERROR (abstract->context, "Failed to create the ringbuffer stream.");
 		return rc;
@@ -325,6 +497,9 @@ suunto_common2_device_foreach (dc_device_t *abstract, dc_dive_callback_t callbac
 		return DC_STATUS_NOMEMORY;
 	}
 
+	// Only check the fingerprint in advance if there is one.
+	unsigned int known = !array_isequal (device->fingerprint, sizeof (device->fingerprint), 0x00);
+
 	// The ring buffer is traversed backwards to retrieve the most recent
 	// dives first. This allows us to download only the new dives.
 	unsigned int current = last;
@@ -341,6 +516,31 @@ suunto_common2_device_foreach (dc_device_t *abstract, dc_dive_callback_t callbac
 			return DC_STATUS_DATAFORMAT;
 		}
 
+		// Check the fingerprint before reading the dive. The protocol is
+		// half-duplex, and limited to small packets, so reading a known
+		// dive only to compare its fingerprint is expensive. A single
+		// small read is enough to detect it. For dives which fit in a
+		// single packet, that wouldn't save anything.
+		unsigned int fp_offset = layout->fingerprint + 4;
+		if (known && size > SZ_PACKET &&
+			current + fp_offset + sizeof (device->fingerprint) <= layout->rb_profile_end)
+		{
+			unsigned char fingerprint[sizeof (device->fingerprint)] = {0};
+			rc = suunto_common2_device_read (abstract, current + fp_offset, fingerprint, sizeof (fingerprint));
+			if (rc != DC_STATUS_SUCCESS) {
+				ERROR (abstract->context, "Failed to read the fingerprint.");
+				dc_rbstream_free (rbstream);
+				free (data);
+				return rc;
+			}
+
+			if (memcmp (fingerprint, device->fingerprint, sizeof (device->fingerprint)) == 0) {
+				dc_rbstream_free (rbstream);
+				free (data);
+				return DC_STATUS_SUCCESS;
+			}
+		}
+
 		// Move to the begin of the current dive.
 		offset -= size;
 
@@ -374,7 +574,6 @@ suunto_common2_device_foreach (dc_device_t *abstract, dc_dive_callback_t callbac
 		}
 
 		if (next != current) {
-			unsigned int fp_offset = layout->fingerprint + 4;
 			if (memcmp (p + fp_offset, device->fingerprint, sizeof (device->fingerprint)) == 0) {
 				dc_rbstream_free (rbstream);
 				free (data);
@@ -70,6 +70,9 @@ suunto_common2_device_write (dc_device_t *device, unsigned int address, const un
 dc_status_t
 suunto_common2_device_dump (dc_device_t *device, dc_buffer_t *buffer);
 
+dc_status_t
+suunto_common2_device_dump_incremental (dc_device_t *device, dc_buffer_t *previous, dc_buffer_t *buffer);
+
 dc_status_t
 suunto_common2_device_foreach (dc_device_t *device, dc_dive_callback_t callback, void *userdata);
 
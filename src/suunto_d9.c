@@ -58,7 +58,9 @@ static const suunto_common2_device_vtable_t suunto_d9_device_vtable = {
 		suunto_common2_device_dump, /* dump */
 		suunto_common2_device_foreach, /* foreach */
 		NULL, /* timesync */
-		NULL /* close */
+		NULL, /* close */
+		0, /* pagesize */
+		suunto_common2_device_dump_incremental /* dump_incremental */
 	},
 	suunto_d9_device_packet
 };
@@ -88,14 +90,22 @@ static const suunto_common2_layout_t suunto_dx_layout = {
 };
 
 
+static dc_status_t
+suunto_d9_device_verify (dc_device_t *abstract, unsigned int baudrate, void *userdata)
+{
+	suunto_d9_device_t *device = (suunto_d9_device_t *) abstract;
+
+	// Try reading the version info.
+	return suunto_common2_device_version (abstract, device->base.version, sizeof (device->base.version));
+}
+
 static dc_status_t
 suunto_d9_device_autodetect (suunto_d9_device_t *device, unsigned int model)
 {
-	dc_status_t status = DC_STATUS_SUCCESS;
 	dc_device_t *abstract = (dc_device_t *) device;
 
 	// The list with possible baudrates.
-	const int baudrates[] = {9600, 115200};
+	const unsigned int baudrates[] = {9600, 115200};
 
 	// Use the model number as a hint to speedup the detection.
 	unsigned int hint = 0;
@@ -104,24 +114,16 @@ suunto_d9_device_autodetect (suunto_d9_device_t *device, unsigned int model)
 		model == D4F)
 		hint = 1;
 
+	// Use the baudrate array as circular array, starting from the hint.
+	unsigned int candidates[C_ARRAY_SIZE(baudrates)];
 	for (unsigned int i = 0; i < C_ARRAY_SIZE(baudrates); ++i) {
-		// Use the baudrate array as circular array, starting from the hint.
-		unsigned int idx = (hint + i) % C_ARRAY_SIZE(baudrates);
-
-		// Adjust the baudrate.
-		status = dc_iostream_configure (device->iostream, baudrates[idx], 8, DC_PARITY_NONE, DC_STOPBITS_ONE, DC_FLOWCONTROL_NONE);
-		if (status != DC_STATUS_SUCCESS) {
-			ERROR (abstract->context, "Failed to set the terminal attributes.");
-			return status;
-		}
-
-		// Try reading the version info.
-		status = suunto_common2_device_version ((dc_device_t *) device, device->base.version, sizeof (device->base.version));
-		if (status == DC_STATUS_SUCCESS)
-			break;
+		candidates[i] = baudrates[(hint + i) % C_ARRAY_SIZE(baudrates)];
 	}
 
-	return status;
+	return device_negotiate_baudrate (abstract, device->iostream,
+		candidates, C_ARRAY_SIZE(candidates),
+		8, DC_PARITY_NONE, DC_STOPBITS_ONE, DC_FLOWCONTROL_NONE,
+		NULL, suunto_d9_device_verify, NULL, NULL);
 }
 
 
@@ -19,6 +19,8 @@
  * MA 02110-1301 USA
  */
 
+#define LOG_SUBSYSTEM DC_LOGSUBSYSTEM_PARSER
+
 #include <stdlib.h>
 #include <string.h>	// memcmp, strdup
 #include <stdio.h>	// snprintf
@@ -27,6 +29,7 @@
 #include "context-private.h"
 #include "parser-private.h"
 #include "array.h"
+#include "gastable.h"
 
 #define ISINSTANCE(parser) dc_parser_isinstance((parser), &suunto_d9_parser_vtable)
 
@@ -70,6 +73,13 @@
 
 typedef struct suunto_d9_parser_t suunto_d9_parser_t;
 
+typedef struct sample_info_t {
+	dc_sample_type_t type;
+	unsigned int size;
+	unsigned int interval;
+	double divisor;
+} sample_info_t;
+
 struct suunto_d9_parser_t {
 	dc_parser_t base;
 	unsigned int model;
@@ -84,14 +94,14 @@ struct suunto_d9_parser_t {
 	unsigned int helium[NGASMIXES];
 	unsigned int gasmix;
 	unsigned int config;
-};
-
-typedef struct sample_info_t {
-	unsigned int type;
-	unsigned int size;
+	// Sample layout.
+	dc_status_t layout;
+	unsigned int nparams;
+	sample_info_t info[MAXPARAMS];
+	unsigned int profile;
 	unsigned int interval;
-	unsigned int divisor;
-} sample_info_t;
+	dc_gastable_t gastable;
+};
 
 static dc_status_t suunto_d9_parser_set_data (dc_parser_t *abstract, const unsigned char *data, unsigned int size);
 static dc_status_t suunto_d9_parser_get_datetime (dc_parser_t *abstract, dc_datetime_t *datetime);
@@ -108,18 +118,98 @@ static const dc_parser_vtable_t suunto_d9_parser_vtable = {
 	NULL /* destroy */
 };
 
-static unsigned int
-suunto_d9_parser_find_gasmix (suunto_d9_parser_t *parser, unsigned int o2, unsigned int he)
+/*
+ * Compile the sample configuration of the dive into the list of
+ * parameters which are actually recorded, together with the offset to
+ * the profile data and the sample interval.
+ */
+static dc_status_t
+suunto_d9_parser_layout (suunto_d9_parser_t *parser)
 {
-	// Find the gasmix in the list.
-	unsigned int i = parser->nccr;
-	while (i < parser->ngasmixes) {
-		if (o2 == parser->oxygen[i] && he == parser->helium[i])
+	const unsigned char *data = parser->base.data;
+	unsigned int size = parser->base.size;
+
+	// Number of parameters in the configuration data.
+	unsigned int nparams = data[parser->config];
+	if (nparams == 0 || nparams > MAXPARAMS) {
+		ERROR (parser->base.context, "Invalid number of parameters.");
+		return DC_STATUS_DATAFORMAT;
+	}
+
+	// Available divisor values.
+	const unsigned int divisors[] = {1, 2, 4, 5, 10, 50, 100, 1000};
+
+	// Get the sample configuration. Parameters without an interval
+	// are never stored, and are left out.
+	parser->nparams = 0;
+	for (unsigned int i = 0; i < nparams; ++i) {
+		unsigned int idx = parser->config + 2 + i * 3;
+		if (idx + 3 > size) {
+			ERROR (parser->base.context, "Buffer overflow detected!");
+			return DC_STATUS_DATAFORMAT;
+		}
+
+		sample_info_t *info = parser->info + parser->nparams;
+		unsigned int type = data[idx + 0];
+		info->interval = data[idx + 1];
+		info->divisor  = divisors[(data[idx + 2] & 0x1C) >> 2];
+		switch (type) {
+		case 0x64: // Depth
+			info->type = DC_SAMPLE_DEPTH;
+			info->size = 2;
 			break;
-		i++;
+		case 0x68: // Pressure
+			info->type = DC_SAMPLE_PRESSURE;
+			info->size = 2;
+			break;
+		case 0x74: // Temperature
+			info->type = DC_SAMPLE_TEMPERATURE;
+			info->size = 1;
+			break;
+		default: // Unknown sample type
+			ERROR (parser->base.context, "Unknown sample type 0x%02x.", type);
+			return DC_STATUS_DATAFORMAT;
+		}
+
+		if (info->interval)
+			parser->nparams++;
 	}
 
-	return i;
+	// Offset to the profile data.
+	unsigned int profile = parser->config + 2 + nparams * 3;
+	if (profile + 5 > size) {
+		ERROR (parser->base.context, "Buffer overflow detected!");
+		return DC_STATUS_DATAFORMAT;
+	}
+
+	// HelO2 dives can have an additional data block.
+	const unsigned char sequence[] = {0x01, 0x00, 0x00};
+	if (parser->model == HELO2 && memcmp (data + profile, sequence, sizeof (sequence)) != 0)
+		profile += 12;
+	if (profile + 5 > size) {
+		ERROR (parser->base.context, "Buffer overflow detected!");
+		return DC_STATUS_DATAFORMAT;
+	}
+
+	// Sample recording interval.
+	unsigned int interval_sample_offset = 0x18;
+	if (parser->model == HELO2 || parser->model == D4i ||
+		parser->model == D6i || parser->model == D9tx ||
+		parser->model == ZOOPNOVO || parser->model == VYPERNOVO ||
+		parser->model == D4F)
+		interval_sample_offset = 0x1E;
+	else if (parser->model == DX)
+		interval_sample_offset = 0x22;
+	unsigned int interval_sample = data[interval_sample_offset];
+	if (interval_sample == 0) {
+		ERROR (parser->base.context, "Invalid sample interval.");
+		return DC_STATUS_DATAFORMAT;
+	}
+
+	parser->profile = profile;
+	parser->interval = interval_sample;
+
+	return DC_STATUS_SUCCESS;
 }
 
 static dc_status_t
@@ -240,6 +330,16 @@ suunto_d9_parser_cache (suunto_d9_parser_t *parser)
 	}
 	parser->config = config;
 	parser->id = id;
+
+	// The diluents are kept apart from the open circuit mixes.
+	dc_gastable_init (&parser->gastable);
+	for (unsigned int i = 0; i < parser->ngasmixes; ++i) {
+		dc_gastable_add (&parser->gastable, GASTABLE_KEY (parser->oxygen[i], parser->helium[i], i < parser->nccr));
+	}
+
+	// An invalid sample layout is only reported when parsing the
+	// samples, not for the summary fields.
+	parser->layout = suunto_d9_parser_layout (parser);
 	parser->cached = 1;
 
 	return DC_STATUS_SUCCESS;
@@ -274,6 +374,11 @@ suunto_d9_parser_create (dc_parser_t **out, dc_context_t *context, unsigned int
 	}
 	parser->gasmix = 0;
 	parser->config = 0;
+	parser->layout = DC_STATUS_SUCCESS;
+	parser->nparams = 0;
+	parser->profile = 0;
+	parser->interval = 0;
+	dc_gastable_init (&parser->gastable);
 
 	*out = (dc_parser_t*) parser;
 
@@ -298,6 +403,11 @@ suunto_d9_parser_set_data (dc_parser_t *abstract, const unsigned char *data, uns
 	}
 	parser->gasmix = 0;
 	parser->config = 0;
+	parser->layout = DC_STATUS_SUCCESS;
+	parser->nparams = 0;
+	parser->profile = 0;
+	parser->interval = 0;
+	dc_gastable_init (&parser->gastable);
 
 	return DC_STATUS_SUCCESS;
 }
@@ -445,67 +555,16 @@ suunto_d9_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t ca
 	if (rc != DC_STATUS_SUCCESS)
 		return rc;
 
-	// Number of parameters in the configuration data.
-	unsigned int nparams = data[parser->config];
-	if (nparams == 0 || nparams > MAXPARAMS) {
-		ERROR (abstract->context, "Invalid number of parameters.");
-		return DC_STATUS_DATAFORMAT;
-	}
-
-	// Available divisor values.
-	const unsigned int divisors[] = {1, 2, 4, 5, 10, 50, 100, 1000};
-
-	// Get the sample configuration.
-	sample_info_t info[MAXPARAMS] = {{0}};
-	for (unsigned int i = 0; i < nparams; ++i) {
-		unsigned int idx = parser->config + 2 + i * 3;
-		info[i].type     = data[idx + 0];
-		info[i].interval = data[idx + 1];
-		info[i].divisor  = divisors[(data[idx + 2] & 0x1C) >> 2];
-		switch (info[i].type) {
-		case 0x64: // Depth
-		case 0x68: // Pressure
-			info[i].size = 2;
-			break;
-		case 0x74: // Temperature
-			info[i].size = 1;
-			break;
-		default: // Unknown sample type
-			ERROR (abstract->context, "Unknown sample type 0x%02x.", info[i].type);
-			return DC_STATUS_DATAFORMAT;
-		}
-	}
-
-	// Offset to the profile data.
-	unsigned int profile = parser->config + 2 + nparams * 3;
-	if (profile + 5 > size) {
-		ERROR (abstract->context, "Buffer overflow detected!");
-		return DC_STATUS_DATAFORMAT;
-	}
+	if (parser->layout != DC_STATUS_SUCCESS)
+		return parser->layout;
 
-	// HelO2 dives can have an additional data block.
-	const unsigned char sequence[] = {0x01, 0x00, 0x00};
-	if (parser->model == HELO2 && memcmp (data + profile, sequence, sizeof (sequence)) != 0)
-		profile += 12;
-	if (profile + 5 > size) {
-		ERROR (abstract->context, "Buffer overflow detected!");
-		return DC_STATUS_DATAFORMAT;
-	}
+	const sample_info_t *info = parser->info;
+	unsigned int nparams = parser->nparams;
+	unsigned int profile = parser->profile;
+	unsigned int interval_sample = parser->interval;
 
-	// Sample recording interval.
-	unsigned int interval_sample_offset = 0x18;
-	if (parser->model == HELO2 || parser->model == D4i ||
-		parser->model == D6i || parser->model == D9tx ||
-		parser->model == ZOOPNOVO || parser->model == VYPERNOVO ||
-		parser->model == D4F)
-		interval_sample_offset = 0x1E;
-	else if (parser->model == DX)
-		interval_sample_offset = 0x22;
-	unsigned int interval_sample = data[interval_sample_offset];
-	if (interval_sample == 0) {
-		ERROR (abstract->context, "Invalid sample interval.");
-		return DC_STATUS_DATAFORMAT;
-	}
+	// Number of samples until the next value of each parameter.
+	unsigned int phase[MAXPARAMS] = {0};
 
 	// Offset to the first marker position.
 	unsigned int marker = array_uint16_le (data + profile + 3);
@@ -523,38 +582,35 @@ suunto_d9_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t ca
 
 		// Sample data.
 		for (unsigned int i = 0; i < nparams; ++i) {
-			if (info[i].interval && (nsamples % info[i].interval) == 0) {
-				if (offset + info[i].size > size) {
-					ERROR (abstract->context, "Buffer overflow detected!");
-					return DC_STATUS_DATAFORMAT;
-				}
+			if (phase[i]) {
+				phase[i]--;
+				continue;
+			}
+			phase[i] = info[i].interval - 1;
 
-				unsigned int value = 0;
-				switch (info[i].type) {
-				case 0x64: // Depth
-					value = array_uint16_le (data + offset);
-					sample.depth = value / (double) info[i].divisor;
-					if (callback) callback (DC_SAMPLE_DEPTH, sample, userdata);
-					break;
-				case 0x68: // Pressure
-					value = array_uint16_le (data + offset);
-					if (value != 0xFFFF) {
-						sample.pressure.tank = 0;
-						sample.pressure.value = value / (double) info[i].divisor;
-						if (callback) callback (DC_SAMPLE_PRESSURE, sample, userdata);
-					}
-					break;
-				case 0x74: // Temperature
-					sample.temperature = (signed char) data[offset] / (double) info[i].divisor;
-					if (callback) callback (DC_SAMPLE_TEMPERATURE, sample, userdata);
-					break;
-				default: // Unknown sample type
-					ERROR (abstract->context, "Unknown sample type 0x%02x.", info[i].type);
-					return DC_STATUS_DATAFORMAT;
-				}
+			if (offset + info[i].size > size) {
+				ERROR (abstract->context, "Buffer overflow detected!");
+				return DC_STATUS_DATAFORMAT;
+			}
 
-				offset += info[i].size;
+			unsigned int value = 0;
+			if (info[i].type == DC_SAMPLE_DEPTH) {
+				value = array_uint16_le (data + offset);
+				sample.depth = value / info[i].divisor;
+				if (callback) callback (DC_SAMPLE_DEPTH, sample, userdata);
+			} else if (info[i].type == DC_SAMPLE_PRESSURE) {
+				value = array_uint16_le (data + offset);
+				if (value != 0xFFFF) {
+					sample.pressure.tank = 0;
+					sample.pressure.value = value / info[i].divisor;
+					if (callback) callback (DC_SAMPLE_PRESSURE, sample, userdata);
+				}
+			} else {
+				sample.temperature = (signed char) data[offset] / info[i].divisor;
+				if (callback) callback (DC_SAMPLE_TEMPERATURE, sample, userdata);
 			}
+
+			offset += info[i].size;
 		}
 
 		// Initial gasmix.
@@ -740,7 +796,7 @@ suunto_d9_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t ca
 					}
 					o2 = data[offset + 0];
 					seconds = data[offset + 1];
-					idx = suunto_d9_parser_find_gasmix(parser, o2, 0);
+					idx = dc_gastable_find (&parser->gastable, GASTABLE_KEY (o2, 0, 0));
 					if (idx >= parser->ngasmixes) {
 						ERROR (abstract->context, "Invalid gas mix.");
 						return DC_STATUS_DATAFORMAT;
@@ -19,10 +19,21 @@
  * MA 02110-1301 USA
  */
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#define USE_PREFETCH
+#endif
+
+#include <libdivecomputer/ble.h>
+
 #include "suunto_eonsteel.h"
 #include "context-private.h"
 #include "device-private.h"
@@ -33,6 +44,14 @@
 #define EONSTEEL 0
 #define EONCORE  1
 
+// The largest BLE notification payload (ATT MTU of 515 bytes), and the
+// size of the receive buffer, which can hold several notifications.
+#define BLE_PACKET_SIZE 512
+#define RXBUF_SIZE      (4 * BLE_PACKET_SIZE)
+
+// The BLE packet size before the MTU is negotiated.
+#define BLE_PACKET_DEFAULT (DC_BLE_MTU_DEFAULT - 3)
+
 typedef struct suunto_eonsteel_device_t {
 	dc_device_t base;
 	dc_iostream_t *iostream;
@@ -41,6 +60,10 @@ typedef struct suunto_eonsteel_device_t {
 	unsigned short seq;
 	unsigned char version[0x30];
 	unsigned char fingerprint[4];
+	unsigned char rxbuf[RXBUF_SIZE];
+	unsigned int rxoffset;
+	unsigned int rxsize;
+	unsigned int txsize;
 } suunto_eonsteel_device_t;
 
 // The EON Steel implements a small filesystem
@@ -48,10 +71,19 @@ typedef struct suunto_eonsteel_device_t {
 #define DIRTYPE_DIR  0x0002
 
 struct directory_entry {
-	struct directory_entry *next;
-	int type;
-	int namelen;
-	char name[1];
+	unsigned int type;
+	const char *name;
+};
+
+/*
+ * The directory listing, sorted with the most recent dive first. The
+ * entries point into a single buffer with the raw records, which avoids
+ * an allocation per entry.
+ */
+struct directory {
+	dc_buffer_t *records;
+	struct directory_entry *entries;
+	unsigned int count;
 };
 
 // EON Steel command numbers and other magic field values
@@ -75,6 +107,9 @@ struct directory_entry {
 #define CMD_SET_DATE	0x0203
 #define CMD_GET_DATE	0x0303
 
+// Initial size of the directory listing, when no previous size is known.
+#define SZ_LISTING 4096
+
 #define PACKET_SIZE 64
 #define HEADER_SIZE 12
 #define MAXDATA_SIZE 2048
@@ -103,29 +138,16 @@ static const dc_device_vtable_t suunto_eonsteel_device_vtable = {
 
 static const char dive_directory[] = "0:/dives";
 
-static void file_list_free (struct directory_entry *de)
+static void file_list_free (dc_context_t *context, struct directory *dir)
 {
-	while (de) {
-		struct directory_entry *next = de->next;
-		free (de);
-		de = next;
-	}
+	dc_buffer_free (dir->records);
+	dc_free (context, dir->entries);
+	dir->records = NULL;
+	dir->entries = NULL;
+	dir->count = 0;
 }
 
-static struct directory_entry *alloc_dirent(int type, int len, const char *name)
-{
-	struct directory_entry *res;
 
-	res = (struct directory_entry *) malloc(offsetof(struct directory_entry, name) + len + 1);
-	if (res) {
-		res->next = NULL;
-		res->type = type;
-		res->namelen = len;
-		memcpy(res->name, name, len);
-		res->name[len] = 0;
-	}
-	return res;
-}
 
 static void put_le16(unsigned short val, unsigned char *p)
 {
@@ -145,7 +167,7 @@ static dc_status_t
 suunto_eonsteel_hdlc_write (suunto_eonsteel_device_t *device, const unsigned char data[], size_t size, size_t *actual)
 {
 	dc_status_t status = DC_STATUS_SUCCESS;
-	unsigned char buffer[20];
+	unsigned char buffer[BLE_PACKET_SIZE];
 	size_t nbytes = 0;
 
 	// Start of the packet.
@@ -159,7 +181,7 @@ suunto_eonsteel_hdlc_write (suunto_eonsteel_device_t *device, const unsigned cha
 			buffer[nbytes++] = ESC;
 
 			// Flush the buffer if necessary.
-			if (nbytes >= sizeof(buffer)) {
+			if (nbytes >= device->txsize) {
 				status = dc_iostream_write(device->iostream, buffer, nbytes, NULL);
 				if (status != DC_STATUS_SUCCESS) {
 					ERROR(device->base.context, "Failed to send the packet.");
@@ -177,7 +199,7 @@ suunto_eonsteel_hdlc_write (suunto_eonsteel_device_t *device, const unsigned cha
 		buffer[nbytes++] = c;
 
 		// Flush the buffer if necessary.
-		if (nbytes >= sizeof(buffer)) {
+		if (nbytes >= device->txsize) {
 			status = dc_iostream_write(device->iostream, buffer, nbytes, NULL);
 			if (status != DC_STATUS_SUCCESS) {
 				ERROR(device->base.context, "Failed to send the packet.");
@@ -205,67 +227,124 @@ suunto_eonsteel_hdlc_write (suunto_eonsteel_device_t *device, const unsigned cha
 
 }
 
+/*
+ * Refill the receive buffer. The notifications are read with a buffer
+ * large enough for the biggest MTU the transport may have negotiated, and
+ * as long as the transport reports more data to be available, additional
+ * notifications are drained in the same call.
+ */
 static dc_status_t
-suunto_eonsteel_hdlc_read (suunto_eonsteel_device_t *device, unsigned char data[], size_t size, size_t *actual)
+suunto_eonsteel_hdlc_fill (suunto_eonsteel_device_t *device)
 {
 	dc_status_t status = DC_STATUS_SUCCESS;
-	unsigned char buffer[20];
-	unsigned int initialized = 0;
-	unsigned int escaped = 0;
-	size_t nbytes = 0;
 
-	while (1) {
-		// Read a single data packet.
+	device->rxoffset = 0;
+	device->rxsize = 0;
+
+	// A BLE I/O stream drains the queue by itself.
+	size_t actual = 0;
+	status = dc_ble_read_packets(device->iostream, device->rxbuf, sizeof(device->rxbuf), NULL, 0, NULL, &actual);
+	if (status != DC_STATUS_UNSUPPORTED) {
+		if (status != DC_STATUS_SUCCESS) {
+			ERROR(device->base.context, "Failed to receive the packet.");
+			return status;
+		}
+
+		device->rxsize = actual;
+		return DC_STATUS_SUCCESS;
+	}
+
+	while (device->rxsize + BLE_PACKET_SIZE <= sizeof(device->rxbuf)) {
 		size_t transferred = 0;
-		status = dc_iostream_read(device->iostream, buffer, sizeof(buffer), &transferred);
+		status = dc_iostream_read(device->iostream, device->rxbuf + device->rxsize, BLE_PACKET_SIZE, &transferred);
 		if (status != DC_STATUS_SUCCESS) {
 			ERROR(device->base.context, "Failed to receive the packet.");
 			return status;
 		}
 
-		for (size_t i = 0; i < transferred; ++i) {
-			unsigned char c = buffer[i];
+		device->rxsize += transferred;
 
-			if (c == END) {
-				if (escaped) {
-					ERROR (device->base.context, "HDLC frame escaped the special character %02x.", c);
-					return DC_STATUS_PROTOCOL;
-				}
+		size_t available = 0;
+		if (dc_iostream_get_available(device->iostream, &available) != DC_STATUS_SUCCESS ||
+			available == 0)
+			break;
+	}
 
-				if (initialized) {
-					goto done;
-				}
+	return DC_STATUS_SUCCESS;
+}
 
-				initialized = 1;
-				continue;
-			}
+static dc_status_t
+suunto_eonsteel_hdlc_read (suunto_eonsteel_device_t *device, unsigned char data[], size_t size, size_t *actual)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	unsigned int initialized = 0;
+	unsigned int escaped = 0;
+	size_t nbytes = 0;
 
-			if (!initialized) {
-				continue;
-			}
+	while (1) {
+		if (device->rxoffset >= device->rxsize) {
+			status = suunto_eonsteel_hdlc_fill(device);
+			if (status != DC_STATUS_SUCCESS)
+				return status;
+			continue;
+		}
 
-			if (c == ESC) {
-				if (escaped) {
-					ERROR (device->base.context, "HDLC frame escaped the special character %02x.", c);
-					return DC_STATUS_PROTOCOL;
-				}
-				escaped = 1;
+		const unsigned char *p = device->rxbuf + device->rxoffset;
+		size_t length = device->rxsize - device->rxoffset;
+
+		if (!initialized) {
+			// Skip everything up to the start of the frame.
+			const unsigned char *end = memchr(p, END, length);
+			if (end == NULL) {
+				device->rxoffset = device->rxsize;
 				continue;
 			}
 
-			if (escaped) {
-				c ^= ESC_BIT;
-				escaped = 0;
+			device->rxoffset += end - p + 1;
+			initialized = 1;
+			continue;
+		}
+
+		if (escaped) {
+			unsigned char c = p[0];
+			if (c == END || c == ESC) {
+				ERROR (device->base.context, "HDLC frame escaped the special character %02x.", c);
+				return DC_STATUS_PROTOCOL;
 			}
 
 			if (nbytes < size)
-				data[nbytes] = c;
+				data[nbytes] = c ^ ESC_BIT;
 			nbytes++;
 
+			device->rxoffset++;
+			escaped = 0;
+			continue;
+		}
+
+		// Copy the run of plain characters up to the next special one.
+		const unsigned char *end = memchr(p, END, length);
+		size_t n = end ? (size_t) (end - p) : length;
+		const unsigned char *esc = memchr(p, ESC, n);
+		if (esc)
+			n = esc - p;
+
+		if (nbytes < size) {
+			size_t ncopy = n < size - nbytes ? n : size - nbytes;
+			memcpy(data + nbytes, p, ncopy);
+		}
+		nbytes += n;
+		device->rxoffset += n;
+
+		if (esc) {
+			device->rxoffset++;
+			escaped = 1;
+		} else if (end) {
+			// Leave any remaining data for the next frame.
+			device->rxoffset++;
+			break;
 		}
 	}
 
-done:
 	if (nbytes > size) {
 		ERROR(device->base.context, "Insufficient buffer space available.");
 		return DC_STATUS_PROTOCOL;
@@ -453,6 +532,8 @@ suunto_eonsteel_transfer(suunto_eonsteel_device_t *device,
 	unsigned char header[HEADER_SIZE + MAXDATA_SIZE];
 	unsigned int len = 0;
 
+	dc_usecs_t start = device_latency_start(&device->base);
+
 	// Send the command.
 	rc = suunto_eonsteel_send(device, cmd, data, size);
 	if (rc != DC_STATUS_SUCCESS)
@@ -547,6 +628,8 @@ suunto_eonsteel_transfer(suunto_eonsteel_device_t *device,
 	if (actual)
 		*actual = nbytes;
 
+	device_latency_emit(&device->base, cmd, nbytes, start);
+
 	return DC_STATUS_SUCCESS;
 }
 
@@ -585,6 +668,12 @@ read_file(suunto_eonsteel_device_t *eon, const char *filename, dc_buffer_t *buf)
 	size = array_uint32_le(result+4);
 	offset = 0;
 
+	// Pre-allocate the required amount of memory.
+	if (!dc_buffer_reserve (buf, dc_buffer_get_size (buf) + size)) {
+		ERROR (eon->base.context, "Insufficient buffer space available.");
+		return DC_STATUS_NOMEMORY;
+	}
+
 	while (size > 0) {
 		unsigned int ask, got, at;
 
@@ -642,17 +731,14 @@ read_file(suunto_eonsteel_device_t *eon, const char *filename, dc_buffer_t *buf)
 }
 
 /*
- * NOTE! This will create the list of dirent's in reverse order,
- * with the last dirent first. That's intentional: for dives,
- * we will want to look up the last dive first.
+ * Append the entries of a readdir packet to the listing. Each record
+ * consists of the 4-byte type, followed by the nul terminated name.
  */
-static struct directory_entry *parse_dirent(suunto_eonsteel_device_t *eon, int nr, const unsigned char *p, unsigned int len, struct directory_entry *old)
+static void parse_dirent(suunto_eonsteel_device_t *eon, int nr, const unsigned char *p, unsigned int len, struct directory *dir)
 {
 	while (len > 8) {
-		unsigned int type = array_uint32_le(p);
 		unsigned int namelen = array_uint32_le(p+4);
 		const unsigned char *name = p+8;
-		struct directory_entry *entry;
 
 		if (namelen + 8 + 1 > len || name[namelen] != 0) {
 			ERROR(eon->base.context, "corrupt dirent entry");
@@ -660,29 +746,97 @@ static struct directory_entry *parse_dirent(suunto_eonsteel_device_t *eon, int n
 		}
 		HEXDUMP(eon->base.context, DC_LOGLEVEL_DEBUG, "dir entry", p, 8);
 
-		p += 8 + namelen + 1;
-		len -= 8 + namelen + 1;
-		entry = alloc_dirent(type, namelen, (const char *) name);
-		if (!entry) {
+		if (!dc_buffer_append(dir->records, p, 4) ||
+			!dc_buffer_append(dir->records, name, namelen + 1)) {
 			ERROR(eon->base.context, "out of memory");
 			break;
 		}
-		entry->next = old;
-		old = entry;
+		dir->count++;
+
+		p += 8 + namelen + 1;
+		len -= 8 + namelen + 1;
+	}
+}
+
+/*
+ * The filename represent the time of the dive, encoded as a hexadecimal
+ * number. Thus sorting the filenames alphabetically, in descending
+ * order, puts the most recent dive first.
+ */
+static int
+dirent_compare(const void *a, const void *b)
+{
+	const struct directory_entry *x = (const struct directory_entry *) a;
+	const struct directory_entry *y = (const struct directory_entry *) b;
+
+	return strcmp(y->name, x->name);
+}
+
+/*
+ * Build the sorted array of entries on top of the raw records.
+ */
+static dc_status_t
+index_file_list(suunto_eonsteel_device_t *eon, struct directory *dir)
+{
+	const unsigned char *data = dc_buffer_get_data(dir->records);
+	size_t size = dc_buffer_get_size(dir->records);
+	size_t offset = 0;
+
+	if (dir->count == 0)
+		return DC_STATUS_SUCCESS;
+
+	dir->entries = (struct directory_entry *) dc_malloc(eon->base.context, dir->count * sizeof(struct directory_entry));
+	if (dir->entries == NULL) {
+		ERROR(eon->base.context, "out of memory");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	for (unsigned int i = 0; i < dir->count; ++i) {
+		dir->entries[i].type = array_uint32_le(data + offset);
+		dir->entries[i].name = (const char *) data + offset + 4;
+		offset += 4 + strlen(dir->entries[i].name) + 1;
+	}
+
+	if (offset != size) {
+		ERROR(eon->base.context, "inconsistent directory listing");
+		return DC_STATUS_PROTOCOL;
 	}
-	return old;
+
+	qsort(dir->entries, dir->count, sizeof(struct directory_entry), dirent_compare);
+
+	return DC_STATUS_SUCCESS;
 }
 
+/*
+ * The size of the listing of the previous session is remembered per
+ * device serial number, such that the records buffer can be allocated
+ * at once. A listing only ever changes by a few dives in between two
+ * sessions.
+ */
 static dc_status_t
-get_file_list(suunto_eonsteel_device_t *eon, struct directory_entry **res)
+get_file_list(suunto_eonsteel_device_t *eon, struct directory *dir)
 {
 	dc_status_t rc = DC_STATUS_SUCCESS;
-	struct directory_entry *de = NULL;
 	unsigned char cmd[64];
 	unsigned char result[2048];
 	unsigned int n = 0;
 	unsigned int cmdlen;
 
+	unsigned char key[4 + 16];
+	array_uint32_le_set(key, DC_FAMILY_SUUNTO_EONSTEEL);
+	memcpy(key + 4, eon->version + 0x10, 16);
+
+	unsigned int capacity = SZ_LISTING;
+	dc_context_cache_get(eon->base.context, key, sizeof(key), &capacity);
+
+	dir->records = dc_buffer_new(capacity);
+	dir->entries = NULL;
+	dir->count = 0;
+	if (dir->records == NULL) {
+		ERROR(eon->base.context, "out of memory");
+		return DC_STATUS_NOMEMORY;
+	}
+
 	put_le32(0, cmd);
 	memcpy(cmd + 4, dive_directory, sizeof(dive_directory));
 	cmdlen = 4 + sizeof(dive_directory);
@@ -690,6 +844,7 @@ get_file_list(suunto_eonsteel_device_t *eon, struct directory_entry **res)
 		cmd, cmdlen, result, sizeof(result), &n);
 	if (rc != DC_STATUS_SUCCESS) {
 		ERROR(eon->base.context, "cmd DIR_LOOKUP failed");
+		file_list_free(eon->base.context, dir);
 		return rc;
 	}
 	HEXDUMP(eon->base.context, DC_LOGLEVEL_DEBUG, "DIR_LOOKUP", result, n);
@@ -701,19 +856,19 @@ get_file_list(suunto_eonsteel_device_t *eon, struct directory_entry **res)
 			NULL, 0, result, sizeof(result), &n);
 		if (rc != DC_STATUS_SUCCESS) {
 			ERROR(eon->base.context, "readdir failed");
-			file_list_free(de);
+			file_list_free(eon->base.context, dir);
 			return rc;
 		}
 		if (n < 8) {
 			ERROR(eon->base.context, "short readdir result");
-			file_list_free(de);
+			file_list_free(eon->base.context, dir);
 			return DC_STATUS_PROTOCOL;
 		}
 		nr = array_uint32_le(result);
 		last = array_uint32_le(result+4);
 		HEXDUMP(eon->base.context, DC_LOGLEVEL_DEBUG, "dir packet", result, 8);
 
-		de = parse_dirent(eon, nr, result+8, n-8, de);
+		parse_dirent(eon, nr, result+8, n-8, dir);
 		if (last)
 			break;
 	}
@@ -722,11 +877,17 @@ get_file_list(suunto_eonsteel_device_t *eon, struct directory_entry **res)
 		NULL, 0, result, sizeof(result), NULL);
 	if (rc != DC_STATUS_SUCCESS) {
 		ERROR(eon->base.context, "dir close failed");
-		file_list_free(de);
+		file_list_free(eon->base.context, dir);
 		return rc;
 	}
 
-	*res = de;
+	rc = index_file_list(eon, dir);
+	if (rc != DC_STATUS_SUCCESS) {
+		file_list_free(eon->base.context, dir);
+		return rc;
+	}
+
+	dc_context_cache_set(eon->base.context, key, sizeof(key), dc_buffer_get_size(dir->records));
 
 	return DC_STATUS_SUCCESS;
 }
@@ -751,6 +912,9 @@ suunto_eonsteel_device_open(dc_device_t **out, dc_context_t *context, dc_iostrea
 	eon->seq = INIT_SEQ;
 	memset (eon->version, 0, sizeof (eon->version));
 	memset (eon->fingerprint, 0, sizeof (eon->fingerprint));
+	eon->rxoffset = 0;
+	eon->rxsize = 0;
+	eon->txsize = BLE_PACKET_DEFAULT;
 
 	status = dc_iostream_set_timeout(eon->iostream, 5000);
 	if (status != DC_STATUS_SUCCESS) {
@@ -758,6 +922,18 @@ suunto_eonsteel_device_open(dc_device_t **out, dc_context_t *context, dc_iostrea
 		goto error_free;
 	}
 
+	// Prepare the BLE link for bulk transfers. Missing support for the
+	// negotiation is not an error.
+	if (dc_iostream_get_transport(eon->iostream) == DC_TRANSPORT_BLE) {
+		unsigned int mtu = 0;
+		dc_ble_request_mtu(eon->iostream, DC_BLE_MTU_MAX);
+		dc_ble_set_interval(eon->iostream, DC_BLE_INTERVAL_MIN, 2 * DC_BLE_INTERVAL_MIN);
+		dc_ble_set_phy(eon->iostream, DC_BLE_PHY_2M);
+		dc_ble_set_write_type(eon->iostream, DC_BLE_WRITE_WITHOUT_RESPONSE);
+		if (dc_ble_get_mtu(eon->iostream, &mtu) == DC_STATUS_SUCCESS)
+			eon->txsize = mtu - 3 < BLE_PACKET_SIZE ? mtu - 3 : BLE_PACKET_SIZE;
+	}
+
 	const unsigned char init[] = {0x02, 0x00, 0x2a, 0x00};
 	status = suunto_eonsteel_transfer(eon, CMD_INIT,
 		init, sizeof(init), eon->version, sizeof(eon->version), NULL);
@@ -771,7 +947,7 @@ suunto_eonsteel_device_open(dc_device_t **out, dc_context_t *context, dc_iostrea
 	return DC_STATUS_SUCCESS;
 
 error_free:
-	free(eon);
+	dc_device_deallocate((dc_device_t *) eon);
 	return status;
 }
 
@@ -791,18 +967,129 @@ suunto_eonsteel_device_set_fingerprint (dc_device_t *abstract, const unsigned ch
 	return DC_STATUS_SUCCESS;
 }
 
+/*
+ * Check whether a directory entry is a dive file that needs to be
+ * downloaded. Returns 1 if it does (with the fingerprint and the full
+ * path filled in), 0 if it doesn't, and -1 when the fingerprint of a
+ * previously downloaded dive is found. Dives in the set of known
+ * fingerprints are skipped.
+ */
+static int
+prepare_dive_file(suunto_eonsteel_device_t *eon, const struct directory_entry *de, unsigned char buf[4], char *pathname, size_t size, dc_status_t *status)
+{
+	unsigned int time;
+	int len;
+
+	if (de->type != DIRTYPE_FILE)
+		return 0;
+
+	if (sscanf(de->name, "%x.LOG", &time) != 1) {
+		dc_status_set_error(status, DC_STATUS_PROTOCOL);
+		return 0;
+	}
+
+	put_le32(time, buf);
+
+	if (memcmp (buf, eon->fingerprint, sizeof (eon->fingerprint)) == 0)
+		return -1;
+
+	if (device_is_known (&eon->base, buf, sizeof (eon->fingerprint)))
+		return 0;
+
+	len = snprintf(pathname, size, "%s/%s", dive_directory, de->name);
+	if (len < 0 || (unsigned int) len >= size) {
+		dc_status_set_error(status, DC_STATUS_PROTOCOL);
+		return 0;
+	}
+
+	return 1;
+}
+
+static dc_status_t
+download_dive_file(suunto_eonsteel_device_t *eon, const unsigned char buf[4], const char *pathname, dc_buffer_t *file)
+{
+	// Reset the membuffer, put the 4-byte length at the head.
+	dc_buffer_clear(file);
+	dc_buffer_append(file, buf, 4);
+
+	// Then read the filename into the rest of the buffer
+	return read_file(eon, pathname, file);
+}
+
+#ifdef USE_PREFETCH
+/*
+ * While the application processes a dive in the callback, the next dive
+ * file is already downloaded in a background thread. Only one transfer
+ * is ever in flight, so the protocol itself remains strictly sequential.
+ */
+struct prefetch {
+	suunto_eonsteel_device_t *eon;
+	unsigned int index;
+	dc_buffer_t *buffer;
+	dc_status_t status;
+	unsigned char buf[4];
+	char pathname[64];
+	pthread_t thread;
+	int active;
+};
+
+static void *
+prefetch_run(void *arg)
+{
+	struct prefetch *prefetch = (struct prefetch *) arg;
+
+	prefetch->status = download_dive_file(prefetch->eon, prefetch->buf, prefetch->pathname, prefetch->buffer);
+
+	return NULL;
+}
+
+static void
+prefetch_start(struct prefetch *prefetch, suunto_eonsteel_device_t *eon, const struct directory *dir, unsigned int index, dc_buffer_t *buffer)
+{
+	dc_status_t ignored = DC_STATUS_SUCCESS;
+
+	// Find the next dive file, without passing the fingerprint.
+	while (index < dir->count) {
+		int rc = prepare_dive_file(eon, &dir->entries[index], prefetch->buf, prefetch->pathname, sizeof(prefetch->pathname), &ignored);
+		if (rc < 0)
+			return;
+		if (rc > 0)
+			break;
+		index++;
+	}
+	if (index >= dir->count)
+		return;
+
+	prefetch->eon = eon;
+	prefetch->index = index;
+	prefetch->buffer = buffer;
+	prefetch->status = DC_STATUS_SUCCESS;
+	if (pthread_create(&prefetch->thread, NULL, prefetch_run, prefetch) == 0)
+		prefetch->active = 1;
+}
+
+static void
+prefetch_wait(struct prefetch *prefetch)
+{
+	if (!prefetch->active)
+		return;
+
+	pthread_join(prefetch->thread, NULL);
+	prefetch->active = 0;
+}
+#endif
+
 static dc_status_t
 suunto_eonsteel_device_foreach(dc_device_t *abstract, dc_dive_callback_t callback, void *userdata)
 {
 	dc_status_t status = DC_STATUS_SUCCESS;
 	dc_status_t rc = DC_STATUS_SUCCESS;
 	int skip = 0;
-	struct directory_entry *de;
+	struct directory dir;
 	suunto_eonsteel_device_t *eon = (suunto_eonsteel_device_t *) abstract;
-	dc_buffer_t *file;
+	dc_buffer_t *file[2] = {NULL, NULL};
+	unsigned int current = 0;
 	char pathname[64];
-	unsigned int time;
-	unsigned int count = 0;
 	dc_event_progress_t progress = EVENT_PROGRESS_INITIALIZER;
 
 	// Emit a device info event.
@@ -812,116 +1099,90 @@ suunto_eonsteel_device_foreach(dc_device_t *abstract, dc_dive_callback_t callbac
 	devinfo.serial = array_convert_str2num(eon->version + 0x10, 16);
 	device_event_emit (abstract, DC_EVENT_DEVINFO, &devinfo);
 
-	rc = get_file_list(eon, &de);
+	rc = get_file_list(eon, &dir);
 	if (rc != DC_STATUS_SUCCESS)
 		return rc;
 
-	if (de == NULL) {
+	if (dir.count == 0) {
+		file_list_free (abstract->context, &dir);
 		return DC_STATUS_SUCCESS;
 	}
 
-	// Locate the most recent dive.
-	// The filename represent the time of the dive, encoded as a hexadecimal
-	// number. Thus the most recent dive can be found by simply sorting the
-	// filenames alphabetically.
-	struct directory_entry *head = de, *tail = de, *latest = de;
-	while (de) {
-		if (strcmp (de->name, latest->name) > 0) {
-			latest = de;
-		}
-		tail = de;
-		count++;
-		de = de->next;
-	}
-
-	// Make the most recent dive the head of the list.
-	// The linked list is made circular, by attaching the head to the tail and
-	// then cut open again just before the most recent dive.
-	de = head;
-	while (de) {
-		if (de->next == latest) {
-			de->next = NULL;
-			tail->next = head;
-			break;
-		}
-
-		de = de->next;
-	}
-
-	file = dc_buffer_new (16384);
-	if (file == NULL) {
+	file[0] = dc_buffer_new (16384);
+	file[1] = dc_buffer_new (16384);
+	if (file[0] == NULL || file[1] == NULL) {
 		ERROR (abstract->context, "Insufficient buffer space available.");
-		file_list_free (latest);
+		dc_buffer_free (file[0]);
+		dc_buffer_free (file[1]);
+		file_list_free (abstract->context, &dir);
 		return DC_STATUS_NOMEMORY;
 	}
 
-	progress.maximum = count;
+#ifdef USE_PREFETCH
+	struct prefetch prefetch;
+	memset(&prefetch, 0, sizeof(prefetch));
+#endif
+
+	progress.maximum = dir.count;
 	progress.current = 0;
 	device_event_emit(abstract, DC_EVENT_PROGRESS, &progress);
 
-	de = latest;
-	while (de) {
-		int len;
-		struct directory_entry *next = de->next;
+	for (unsigned int i = 0; i < dir.count; ++i) {
+		const struct directory_entry *de = &dir.entries[i];
 		unsigned char buf[4];
 		const unsigned char *data = NULL;
 		unsigned int size = 0;
+		int fetch = 0;
 
 		if (device_is_cancelled(abstract)) {
 			dc_status_set_error(&status, DC_STATUS_CANCELLED);
 			skip = 1;
 		}
 
-		switch (de->type) {
-		case DIRTYPE_DIR:
-			/* Ignore subdirectories in the dive directory */
-			break;
-		case DIRTYPE_FILE:
-			if (skip)
-				break;
-
-			if (sscanf(de->name, "%x.LOG", &time) != 1) {
-				dc_status_set_error(&status, DC_STATUS_PROTOCOL);
-				break;
-			}
-
-			put_le32(time, buf);
-
-			if (memcmp (buf, eon->fingerprint, sizeof (eon->fingerprint)) == 0) {
+		if (!skip) {
+			fetch = prepare_dive_file(eon, de, buf, pathname, sizeof(pathname), &status);
+			if (fetch < 0)
 				skip = 1;
-				break;
-			}
-
-			len = snprintf(pathname, sizeof(pathname), "%s/%s", dive_directory, de->name);
-			if (len < 0 || (unsigned int) len >= sizeof(pathname)) {
-				dc_status_set_error(&status, DC_STATUS_PROTOCOL);
-				break;
-			}
+		}
 
-			// Reset the membuffer, put the 4-byte length at the head.
-			dc_buffer_clear(file);
-			dc_buffer_append(file, buf, 4);
+		if (fetch > 0) {
+#ifdef USE_PREFETCH
+			if (prefetch.active && prefetch.index == i) {
+				// The file was already downloaded in the background.
+				prefetch_wait(&prefetch);
+				current ^= 1;
+				rc = prefetch.status;
+			} else
+#endif
+			rc = download_dive_file(eon, buf, pathname, file[current]);
 
-			// Then read the filename into the rest of the buffer
-			rc = read_file(eon, pathname, file);
 			if (rc != DC_STATUS_SUCCESS) {
 				dc_status_set_error(&status, rc);
-				break;
+			} else {
+				data = dc_buffer_get_data(file[current]);
+				size = dc_buffer_get_size(file[current]);
+
+#ifdef USE_PREFETCH
+				// Start downloading the next dive, while the
+				// application is processing this one.
+				prefetch_start(&prefetch, eon, &dir, i + 1, file[current ^ 1]);
+#endif
+
+				if (callback && !callback(data, size, data, sizeof(eon->fingerprint), userdata))
+					skip = 1;
 			}
-
-			data = dc_buffer_get_data(file);
-			size = dc_buffer_get_size(file);
-
-			if (callback && !callback(data, size, data, sizeof(eon->fingerprint), userdata))
-				skip = 1;
 		}
 		progress.current++;
 		device_event_emit(abstract, DC_EVENT_PROGRESS, &progress);
-
-		free(de);
-		de = next;
 	}
-	dc_buffer_free(file);
+
+#ifdef USE_PREFETCH
+	prefetch_wait(&prefetch);
+#endif
+
+	dc_buffer_free(file[0]);
+	dc_buffer_free(file[1]);
+	file_list_free(abstract->context, &dir);
 
 	return status;
 }
@@ -19,6 +19,8 @@
  * MA 02110-1301 USA
  */
 
+#define LOG_SUBSYSTEM DC_LOGSUBSYSTEM_PARSER
+
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
@@ -37,6 +39,7 @@
 #include "parser-private.h"
 #include "array.h"
 #include "platform.h"
+#include "pool.h"
 
 #define C_ARRAY_SIZE(a) (sizeof(a) / sizeof(*(a)))
 
@@ -67,6 +70,40 @@ enum eon_sample {
 	ES_setpoint_po2,	// uint32
 	ES_setpoint_automatic,	// bool
 	ES_bookmark,
+	ES_ntypes
+};
+
+/*
+ * The number of bytes read by the handler of each sample type, or zero
+ * for the types without a handler.
+ */
+static const unsigned char sample_size[ES_ntypes] = {
+	0, /* ES_none */
+	2, /* ES_dtime */
+	2, /* ES_depth */
+	2, /* ES_temp */
+	2, /* ES_ndl */
+	2, /* ES_ceiling */
+	2, /* ES_tts */
+	2, /* ES_heading */
+	2, /* ES_abspressure */
+	2, /* ES_gastime */
+	2, /* ES_ventilation */
+	1, /* ES_gasnr */
+	2, /* ES_pressure */
+	1, /* ES_state */
+	1, /* ES_state_active */
+	1, /* ES_notify */
+	1, /* ES_notify_active */
+	1, /* ES_warning */
+	1, /* ES_warning_active */
+	1, /* ES_alarm */
+	1, /* ES_alarm_active */
+	2, /* ES_gasswitch */
+	1, /* ES_setpoint_type */
+	4, /* ES_setpoint_po2 */
+	1, /* ES_setpoint_automatic */
+	2, /* ES_bookmark */
 };
 
 #define EON_MAX_GROUP 16
@@ -74,16 +111,56 @@ enum eon_sample {
 struct type_desc {
 	char *desc, *format, *mod;
 	unsigned int size;
+	// Names of the enumeration values, indexed by value.
+	const char **enums;
+	unsigned int nenums;
 	enum eon_sample type[EON_MAX_GROUP];
+	// Decoding plan for the samples, resolved together with the type:
+	// the number of sub-entries with a handler, their offsets and the
+	// total number of bytes the handlers read.
+	unsigned int nsamples;
+	unsigned int used;
+	unsigned char offset[EON_MAX_GROUP];
 };
 
 #define MAXTYPE 512
 #define MAXGASES 16
 #define MAXSTRINGS 32
 
+/*
+ * Resolved type descriptors, keyed by the descriptor text. Dives from
+ * the same firmware repeat the same descriptors, so they only need to
+ * be parsed and matched against the sample type table once.
+ */
+#define DESC_CACHE_BUCKETS 256
+#define DESC_CACHE_MAX 4096
+
+struct desc_cache_entry {
+	struct desc_cache_entry *next;
+	unsigned int hash, len;
+	const char *text;
+	struct type_desc desc;
+};
+
+/*
+ * Position in the data, at the start of an entry or at the next record
+ * of the current entry.
+ */
+struct eon_cursor {
+	unsigned int offset;
+	unsigned int inentry;
+};
+
 typedef struct suunto_eonsteel_parser_t {
 	dc_parser_t base;
 	struct type_desc type_desc[MAXTYPE];
+	// Storage for the string field data, which is interned across dives.
+	dc_strpool_t strings;
+	// Descriptor cache, which is kept across dives. The storage is only
+	// recycled when the cache grows too large.
+	dc_pool_t descpool;
+	struct desc_cache_entry *desc_cache[DESC_CACHE_BUCKETS];
+	unsigned int desc_cache_count;
 	// field cache
 	struct {
 		unsigned int initialized;
@@ -103,6 +180,16 @@ typedef struct suunto_eonsteel_parser_t {
 		double tanksize[MAXGASES];
 		double tankworkingpressure[MAXGASES];
 	} cache;
+	// Position of the field cache in the data.
+	struct eon_cursor fieldpos;
+	// Sample state, kept between the dc_parser_append_data calls.
+	struct {
+		struct eon_cursor pos;
+		unsigned int time;
+		int gasnr;
+		const char *state_type, *notify_type;
+		const char *warning_type, *alarm_type;
+	} resume;
 } suunto_eonsteel_parser_t;
 
 typedef int (*eon_data_cb_t)(unsigned short type, const struct type_desc *desc, const unsigned char *data, int len, void *user);
@@ -140,6 +227,35 @@ static const struct {
 	{ "Events.DiveTimer.Time",		ES_none },
 };
 
+/*
+ * Perfect hash of the names in the type_translation table above. The
+ * slots contain the index in that table, or -1 for unused slots. The
+ * table was generated by searching for the smallest seed for which the
+ * hash of all known names maps to distinct slots. Names which are not
+ * found this way (unknown names, or a stale table after adding a new
+ * name) are still resolved with the linear search.
+ */
+#define TYPE_HASH_SEED 254
+#define TYPE_HASH_SIZE 64
+
+static const signed char type_hash_table[TYPE_HASH_SIZE] = {
+	-1, 24,  3, -1, 18, -1,  7, -1, -1, -1, -1,  0, -1, -1, 16,  9,
+	25,  8,  6, 22, 10, -1, -1, -1, 12, -1, -1, -1, -1,  5, -1, -1,
+	-1, 14, -1, -1, -1, -1,  4, -1, -1, 21, 17, -1, -1, -1, -1, 26,
+	 2, -1, 13, -1, 19, 20, -1, -1, -1, 15, -1,  1, -1, 11, -1, 23,
+};
+
+static unsigned int type_hash(const char *name)
+{
+	// FNV-1a, with a custom offset basis
+	unsigned int hash = TYPE_HASH_SEED;
+	while (*name) {
+		hash ^= (unsigned char) *name++;
+		hash *= 16777619u;
+	}
+	return (hash >> 16) % TYPE_HASH_SIZE;
+}
+
 static enum eon_sample lookup_descriptor_type(suunto_eonsteel_parser_t *eon, struct type_desc *desc)
 {
 	int i;
@@ -165,6 +281,11 @@ static enum eon_sample lookup_descriptor_type(suunto_eonsteel_parser_t *eon, str
 	name += 8;
 
 	// .. and look it up in the table of sample type strings
+	i = type_hash_table[type_hash(name)];
+	if (i >= 0 && !strcmp(name, type_translation[i].name))
+		return type_translation[i].type;
+
+	// Slow path for names that are not in the hash table
 	for (i = 0; i < C_ARRAY_SIZE(type_translation); i++) {
 		if (!strcmp(name, type_translation[i].name))
 			return type_translation[i].type;
@@ -268,35 +389,55 @@ static int fill_in_group_details(suunto_eonsteel_parser_t *eon, struct type_desc
  * base types) or are "GRP" types that are a group of said
  * types and are a set of numbers.
  */
+static void fill_in_sample_plan(struct type_desc *desc)
+{
+	unsigned int i, offset = 0;
+
+	for (i = 0; i < EON_MAX_GROUP; i++) {
+		unsigned int size = sample_size[desc->type[i]];
+		if (!size)
+			break;
+		desc->offset[i] = offset;
+		offset += size;
+	}
+	desc->nsamples = i;
+	desc->used = offset;
+}
+
 static int fill_in_desc_details(suunto_eonsteel_parser_t *eon, struct type_desc *desc)
 {
+	int rc = 0;
+
 	if (!desc->desc)
 		return 0;
 
-	if (isdigit(desc->desc[0]))
-		return fill_in_group_details(eon, desc);
+	if (isdigit(desc->desc[0])) {
+		rc = fill_in_group_details(eon, desc);
+	} else {
+		desc->size = lookup_descriptor_size(eon, desc);
+		desc->type[0] = lookup_descriptor_type(eon, desc);
+	}
 
-	desc->size = lookup_descriptor_size(eon, desc);
-	desc->type[0] = lookup_descriptor_type(eon, desc);
-	return 0;
+	fill_in_sample_plan(desc);
+	return rc;
 }
 
-static void
-desc_free (struct type_desc desc[], unsigned int count)
+static unsigned int desc_hash(const char *text, unsigned int len)
 {
-	for (unsigned int i = 0; i < count; ++i) {
-		free(desc[i].desc);
-		free(desc[i].format);
-		free(desc[i].mod);
+	// FNV-1a
+	unsigned int hash = 2166136261u;
+	for (unsigned int i = 0; i < len; i++) {
+		hash ^= (unsigned char) text[i];
+		hash *= 16777619u;
 	}
+	return hash;
 }
 
-static int record_type(suunto_eonsteel_parser_t *eon, unsigned short type, const char *name, int namelen)
+static int parse_type(suunto_eonsteel_parser_t *eon, struct type_desc *desc, const char *name)
 {
-	struct type_desc desc;
 	const char *next;
 
-	memset(&desc, 0, sizeof(desc));
+	memset(desc, 0, sizeof(*desc));
 	do {
 		int len;
 		char *p;
@@ -315,57 +456,193 @@ static int record_type(suunto_eonsteel_parser_t *eon, unsigned short type, const
 			ERROR(eon->base.context, "Unexpected type description: %.*s", len, name);
 			return -1;
 		}
-		p = (char *) malloc(len-4);
+		p = dc_pool_strndup(&eon->descpool, name+5, len-5);
 		if (!p) {
 			ERROR(eon->base.context, "out of memory");
-			desc_free(&desc, 1);
 			return -1;
 		}
-		memcpy(p, name+5, len-5);
-		p[len-5] = 0;
 
 		// PTH, GRP, FRM, MOD
 		switch (name[1]) {
 		case 'P':
 		case 'G':
-			desc.desc = p;
+			desc->desc = p;
 			break;
 		case 'F':
-			desc.format = p;
+			desc->format = p;
 			break;
 		case 'M':
-			desc.mod = p;
+			desc->mod = p;
 			break;
 		default:
 			ERROR(eon->base.context, "Unknown type descriptor: %.*s", len, name);
-			desc_free(&desc, 1);
-			free(p);
 			return -1;
 		}
 	} while ((name = next) != NULL);
 
+	return 0;
+}
+
+/*
+ * Build the table with the enumeration values.
+ *
+ * Enumerations have the enum values in the "format" string,
+ * and all start with "enum:" followed by a comma-separated list
+ * of enumeration values and strings. Example:
+ *
+ * "enum:0=NoFly Time,1=Depth,2=Surface Time,3=..."
+ *
+ * The list is copied once, with the commas replaced by terminators,
+ * and the table points to the strings in that copy. That way the
+ * samples can look up the names without allocating anything.
+ */
+static int parse_enum(suunto_eonsteel_parser_t *eon, struct type_desc *desc)
+{
+	const char *names[100] = {0};
+	unsigned int count = 0;
+	char *str;
+	unsigned char c;
+
+	if (!desc->format || strncmp(desc->format, "enum:", 5))
+		return 0;
+
+	str = dc_pool_strndup(&eon->descpool, desc->format + 5, strlen(desc->format + 5));
+	if (!str) {
+		ERROR(eon->base.context, "out of memory");
+		return -1;
+	}
+
+	while ((c = *str) != 0) {
+		unsigned char n;
+		char *begin;
+
+		str++;
+		if (!isdigit(c))
+			continue;
+		n = c - '0';
+
+		// We only handle one or two digits
+		if (isdigit(*str)) {
+			n = n*10 + *str - '0';
+			str++;
+		}
+
+		begin = str;
+		while ((c = *str) != 0) {
+			if (c == ',') {
+				*str++ = 0;
+				break;
+			}
+			str++;
+		}
+
+		// Verify that it has the 'n=string' format and skip the equals sign
+		if (*begin != '=')
+			continue;
+
+		// Duplicate values keep the first string.
+		if (names[n])
+			continue;
+
+		names[n] = begin + 1;
+		if (count <= n)
+			count = n + 1;
+	}
+
+	if (!count)
+		return 0;
+
+	desc->enums = (const char **) dc_pool_alloc(&eon->descpool, count * sizeof(*desc->enums));
+	if (!desc->enums) {
+		ERROR(eon->base.context, "out of memory");
+		return -1;
+	}
+
+	memcpy(desc->enums, names, count * sizeof(*desc->enums));
+	desc->nenums = count;
+	return 0;
+}
+
+static int record_type(suunto_eonsteel_parser_t *eon, unsigned short type, const char *name, int namelen)
+{
+	struct desc_cache_entry *entry;
+	struct type_desc desc;
+	unsigned int len = namelen > 0 ? strnlen(name, namelen) : 0;
+	unsigned int hash = desc_hash(name, len);
+	unsigned int bucket = hash % DESC_CACHE_BUCKETS;
+
+	for (entry = eon->desc_cache[bucket]; entry; entry = entry->next) {
+		if (entry->hash == hash && entry->len == len && !memcmp(entry->text, name, len))
+			break;
+	}
+
+	if (entry) {
+		desc = entry->desc;
+	} else {
+		if (parse_type(eon, &desc, name) < 0)
+			return -1;
+
+		if (parse_enum(eon, &desc) < 0)
+			return -1;
+
+		if (desc.desc && !isdigit(desc.desc[0]))
+			fill_in_desc_details(eon, &desc);
+
+		// Remember the descriptor for the next time. A failure to
+		// allocate just means it will be parsed again.
+		entry = (struct desc_cache_entry *) dc_pool_alloc(&eon->descpool, sizeof(*entry));
+		char *text = dc_pool_strndup(&eon->descpool, name, len);
+		if (entry && text) {
+			entry->hash = hash;
+			entry->len = len;
+			entry->text = text;
+			entry->desc = desc;
+			entry->next = eon->desc_cache[bucket];
+			eon->desc_cache[bucket] = entry;
+			eon->desc_cache_count++;
+		}
+	}
+
 	if (type >= MAXTYPE) {
 		ERROR(eon->base.context, "Type out of range (%04x: '%s' '%s' '%s')",
 			type,
 			desc.desc ? desc.desc : "",
 			desc.format ? desc.format : "",
 			desc.mod ? desc.mod : "");
-		desc_free(&desc, 1);
 		return -1;
 	}
 
-	fill_in_desc_details(eon, &desc);
+	// Group descriptors refer to other types by index, so they are
+	// resolved again against the current set of types.
+	if (desc.desc && isdigit(desc.desc[0])) {
+		desc.size = 0;
+		memset(desc.type, 0, sizeof(desc.type));
+		fill_in_desc_details(eon, &desc);
+	}
 
-	desc_free(eon->type_desc + type, 1);
 	eon->type_desc[type] = desc;
 	return 0;
 }
 
-static int traverse_entry(suunto_eonsteel_parser_t *eon, const unsigned char *p, int len, eon_data_cb_t callback, void *user)
+static void desc_cache_reset(suunto_eonsteel_parser_t *eon)
 {
-	const unsigned char *name, *data, *end, *last, *one_past_end = p + len;
+	memset(eon->desc_cache, 0, sizeof(eon->desc_cache));
+	eon->desc_cache_count = 0;
+	dc_pool_reset(&eon->descpool);
+}
+
+/*
+ * Parse the header of an entry, with the type descriptor. Returns the
+ * size of the header, zero if it's incomplete, or a negative value for
+ * a bad entry.
+ */
+static int traverse_header(suunto_eonsteel_parser_t *eon, const unsigned char *p, int len)
+{
+	const unsigned char *name, *one_past_end = p + len;
 	int textlen, type;
-	int rc;
+
+	if (len < 2)
+		return 0;
 
 	// First two bytes: zero and text length
 	if (p[0]) {
@@ -377,59 +654,77 @@ static int traverse_entry(suunto_eonsteel_parser_t *eon, const unsigned char *p,
 
 	name = p + 2;
 	if (textlen == 0xff) {
+		if (len < 6)
+			return 0;
 		textlen = array_uint32_le(name);
 		name += 4;
 	}
+	if (textlen > one_past_end - name)
+		return 0;
 
 	// Two bytes of 'type' followed by the name/descriptor, followed by the data
-	data = name + textlen;
 	type = array_uint16_le(name);
-	name += 2;
-
-	if (*name != '<') {
+	if (textlen < 3 || name[2] != '<') {
 		HEXDUMP(eon->base.context, DC_LOGLEVEL_DEBUG, "bad", p, 16);
 		return -1;
 	}
 
-	record_type(eon, type, (const char *) name, textlen-3);
-
-	end = data;
-	last = data;
-	while (end < one_past_end && *end) {
-		const unsigned char *begin = end;
-		unsigned int type = *end++;
-		unsigned int len;
-		if (type == 0xff) {
-			type = array_uint16_le(end);
-			end += 2;
-		}
-		len = *end++;
-
-		// I've never actually seen this case yet..
-		// Just assuming from the other cases.
-		if (len == 0xff) {
-			HEXDUMP(eon->base.context, DC_LOGLEVEL_DEBUG, "len-ff", end, 8);
-			len = array_uint32_le(end);
-			end += 4;
-		}
+	record_type(eon, type, (const char *) name + 2, textlen-3);
 
-		if (type >= MAXTYPE || !eon->type_desc[type].desc) {
-			HEXDUMP(eon->base.context, DC_LOGLEVEL_DEBUG, "last", last, 16);
-			HEXDUMP(eon->base.context, DC_LOGLEVEL_DEBUG, "this", begin, 16);
-		} else {
-			rc = callback(type, eon->type_desc+type, end, len, user);
-			if (rc < 0)
-				return rc;
-		}
+	return name + textlen - p;
+}
 
-		last = begin;
-		end += len;
+/*
+ * Parse a single data record. Returns the size of the record, zero if
+ * it's incomplete, or the negative value returned by the callback.
+ */
+static int traverse_record(suunto_eonsteel_parser_t *eon, const unsigned char *p, int len, eon_data_cb_t callback, void *user)
+{
+	const unsigned char *end = p, *one_past_end = p + len;
+	unsigned int type, size;
+	int rc;
+
+	type = *end++;
+	if (type == 0xff) {
+		if (one_past_end - end < 2)
+			return 0;
+		type = array_uint16_le(end);
+		end += 2;
+	}
+	if (end >= one_past_end)
+		return 0;
+	size = *end++;
+
+	// I've never actually seen this case yet..
+	// Just assuming from the other cases.
+	if (size == 0xff) {
+		if (one_past_end - end < 4)
+			return 0;
+		HEXDUMP(eon->base.context, DC_LOGLEVEL_DEBUG, "len-ff", end, 4);
+		size = array_uint32_le(end);
+		end += 4;
 	}
+	if (size > (unsigned int) (one_past_end - end))
+		return 0;
 
-	return end - p;
+	if (type >= MAXTYPE || !eon->type_desc[type].desc) {
+		HEXDUMP(eon->base.context, DC_LOGLEVEL_DEBUG, "this", p, end + size - p);
+	} else {
+		rc = callback(type, eon->type_desc+type, end, size, user);
+		if (rc < 0)
+			return rc;
+	}
+
+	return end + size - p;
 }
 
-static int traverse_data(suunto_eonsteel_parser_t *eon, eon_data_cb_t callback, void *user)
+/*
+ * Traverse the entries and records after the cursor, up to the first
+ * one that is incomplete. On return, the cursor points to the first
+ * part that wasn't traversed, such that the traversal can continue
+ * once more data is available.
+ */
+static int traverse_data_from(suunto_eonsteel_parser_t *eon, struct eon_cursor *cursor, eon_data_cb_t callback, void *user)
 {
 	const unsigned char *data = eon->base.data;
 	int len = eon->base.size;
@@ -437,34 +732,72 @@ static int traverse_data(suunto_eonsteel_parser_t *eon, eon_data_cb_t callback,
 	// Dive files start with "SBEM" and four NUL characters
 	// Additionally, we've prepended the time as an extra
 	// 4-byte pre-header
-	if (len < 12 || memcmp(data+4, "SBEM", 4))
-		return 0;
+	if (cursor->offset == 0) {
+		if (len < 12 || memcmp(data+4, "SBEM", 4))
+			return 0;
+		cursor->offset = 12;
+		cursor->inentry = 0;
+	}
 
-	data += 12;
-	len -= 12;
+	for (;;) {
+		const unsigned char *p = data + cursor->offset;
+		int avail = len - cursor->offset;
+		int n;
 
-	while (len > 4) {
-		int i = traverse_entry(eon, data, len, callback, user);
-		if (i < 0)
-			return 1;
-		len -= i;
-		data += i;
+		if (!cursor->inentry) {
+			if (avail <= 4)
+				break;
+			n = traverse_header(eon, p, avail);
+			if (n < 0)
+				return 1;
+			if (n == 0)
+				break;
+			cursor->inentry = 1;
+		} else {
+			if (avail <= 0)
+				break;
+			// The zero byte is the start of the next entry.
+			if (*p == 0) {
+				cursor->inentry = 0;
+				continue;
+			}
+			n = traverse_record(eon, p, avail, callback, user);
+			if (n < 0)
+				return 1;
+			if (n == 0)
+				break;
+		}
+
+		cursor->offset += n;
 	}
+
 	return 0;
 }
 
+static int traverse_data(suunto_eonsteel_parser_t *eon, eon_data_cb_t callback, void *user)
+{
+	struct eon_cursor cursor = {0, 0};
+
+	return traverse_data_from(eon, &cursor, callback, user);
+}
+
 struct sample_data {
 	suunto_eonsteel_parser_t *eon;
 	dc_sample_callback_t callback;
 	void *userdata;
 	unsigned int time;
-	char *state_type, *notify_type;
-	char *warning_type, *alarm_type;
+	const char *state_type, *notify_type;
+	const char *warning_type, *alarm_type;
 
 	/* We gather up deco and cylinder pressure information */
 	int gasnr;
+
+	/* The sample types wanted by the application */
+	unsigned int mask;
 };
 
+#define WANTED(info, type) ((info)->mask & (1u << (type)))
+
 static void sample_time(struct sample_data *info, unsigned short time_delta)
 {
 	dc_sample_value_t sample = {0};
@@ -611,66 +944,13 @@ static void sample_gas_switch_event(struct sample_data *info, unsigned short idx
 
 /*
  * Look up the string from an enumeration.
- *
- * Enumerations have the enum values in the "format" string,
- * and all start with "enum:" followed by a comma-separated list
- * of enumeration values and strings. Example:
- *
- * "enum:0=NoFly Time,1=Depth,2=Surface Time,3=..."
  */
-static char *lookup_enum(const struct type_desc *desc, unsigned char value)
+static const char *lookup_enum(const struct type_desc *desc, unsigned char value)
 {
-	const char *str = desc->format;
-	unsigned char c;
-
-	if (!str)
+	if (value >= desc->nenums)
 		return NULL;
-	if (strncmp(str, "enum:", 5))
-		return NULL;
-	str += 5;
-
-	while ((c = *str) != 0) {
-		unsigned char n;
-		const char *begin, *end;
-		char *ret;
-
-		str++;
-		if (!isdigit(c))
-			continue;
-		n = c - '0';
-
-		// We only handle one or two digits
-		if (isdigit(*str)) {
-			n = n*10 + *str - '0';
-			str++;
-		}
-
-		begin = end = str;
-		while ((c = *str) != 0) {
-			str++;
-			if (c == ',')
-				break;
-			end = str;
-		}
-
-		// Verify that it has the 'n=string' format and skip the equals sign
-		if (*begin != '=')
-			continue;
-		begin++;
-
-		// Is it the value we're looking for?
-		if (n != value)
-			continue;
-
-		ret = (char *)malloc(end - begin + 1);
-		if (!ret)
-			break;
 
-		memcpy(ret, begin, end-begin);
-		ret[end-begin] = 0;
-		return ret;
-	}
-	return NULL;
+	return desc->enums[value];
 }
 
 /*
@@ -679,8 +959,7 @@ static char *lookup_enum(const struct type_desc *desc, unsigned char value)
  */
 static void sample_event_state_type(const struct type_desc *desc, struct sample_data *info, unsigned char type)
 {
-	free(info->state_type);
-	info->state_type = lookup_enum(desc, type);
+	info->state_type = WANTED(info, DC_SAMPLE_EVENT) ? lookup_enum(desc, type) : NULL;
 }
 
 static void sample_event_state_value(const struct type_desc *desc, struct sample_data *info, unsigned char value)
@@ -702,8 +981,7 @@ static void sample_event_state_value(const struct type_desc *desc, struct sample
 
 static void sample_event_notify_type(const struct type_desc *desc, struct sample_data *info, unsigned char type)
 {
-	free(info->notify_type);
-	info->notify_type = lookup_enum(desc, type);
+	info->notify_type = WANTED(info, DC_SAMPLE_EVENT) ? lookup_enum(desc, type) : NULL;
 }
 
 static void sample_event_notify_value(const struct type_desc *desc, struct sample_data *info, unsigned char value)
@@ -726,8 +1004,7 @@ static void sample_event_notify_value(const struct type_desc *desc, struct sampl
 
 static void sample_event_warning_type(const struct type_desc *desc, struct sample_data *info, unsigned char type)
 {
-	free(info->warning_type);
-	info->warning_type = lookup_enum(desc, type);
+	info->warning_type = WANTED(info, DC_SAMPLE_EVENT) ? lookup_enum(desc, type) : NULL;
 }
 
 static void sample_event_warning_value(const struct type_desc *desc, struct sample_data *info, unsigned char value)
@@ -749,8 +1026,7 @@ static void sample_event_warning_value(const struct type_desc *desc, struct samp
 
 static void sample_event_alarm_type(const struct type_desc *desc, struct sample_data *info, unsigned char type)
 {
-	free(info->alarm_type);
-	info->alarm_type = lookup_enum(desc, type);
+	info->alarm_type = WANTED(info, DC_SAMPLE_EVENT) ? lookup_enum(desc, type) : NULL;
 }
 
 
@@ -775,8 +1051,12 @@ static void sample_event_alarm_value(const struct type_desc *desc, struct sample
 static void sample_setpoint_type(const struct type_desc *desc, struct sample_data *info, unsigned char value)
 {
 	dc_sample_value_t sample = {0};
-	char *type = lookup_enum(desc, value);
+	const char *type;
+
+	if (!WANTED(info, DC_SAMPLE_SETPOINT))
+		return;
 
+	type = lookup_enum(desc, value);
 	if (!type) {
 		DEBUG(info->eon->base.context, "sample_setpoint_type(%u) did not match anything in %s", value, desc->format);
 		return;
@@ -790,12 +1070,10 @@ static void sample_setpoint_type(const struct type_desc *desc, struct sample_dat
 		sample.ppo2 = info->eon->cache.customsetpoint;
 	else {
 		DEBUG(info->eon->base.context, "sample_setpoint_type(%u) unknown type '%s'", value, type);
-		free(type);
 		return;
 	}
 
 	if (info->callback) info->callback(DC_SAMPLE_SETPOINT, sample, info->userdata);
-	free(type);
 }
 
 // uint32
@@ -811,111 +1089,111 @@ static void sample_setpoint_automatic(struct sample_data *info, unsigned char va
 	DEBUG(info->eon->base.context, "sample_setpoint_automatic(%u)", value);
 }
 
-static int handle_sample_type(const struct type_desc *desc, struct sample_data *info, enum eon_sample type, const unsigned char *data)
+static void handle_sample_type(const struct type_desc *desc, struct sample_data *info, enum eon_sample type, const unsigned char *data)
 {
 	switch (type) {
 	case ES_dtime:
 		sample_time(info, array_uint16_le(data));
-		return 2;
+		break;
 
 	case ES_depth:
 		sample_depth(info, array_uint16_le(data));
-		return 2;
+		break;
 
 	case ES_temp:
 		sample_temp(info, array_uint16_le(data));
-		return 2;
+		break;
 
 	case ES_ndl:
 		sample_ndl(info, array_uint16_le(data));
-		return 2;
+		break;
 
 	case ES_ceiling:
 		sample_ceiling(info, array_uint16_le(data));
-		return 2;
+		break;
 
 	case ES_tts:
 		sample_tts(info, array_uint16_le(data));
-		return 2;
+		break;
 
 	case ES_heading:
 		sample_heading(info, array_uint16_le(data));
-		return 2;
+		break;
 
 	case ES_abspressure:
 		sample_abspressure(info, array_uint16_le(data));
-		return 2;
+		break;
 
 	case ES_gastime:
 		sample_gastime(info, array_uint16_le(data));
-		return 2;
+		break;
 
 	case ES_ventilation:
 		sample_ventilation(info, array_uint16_le(data));
-		return 2;
+		break;
 
 	case ES_gasnr:
 		sample_gasnr(info, *data);
-		return 1;
+		break;
 
 	case ES_pressure:
 		sample_pressure(info, array_uint16_le(data));
-		return 2;
+		break;
 
 	case ES_state:
 		sample_event_state_type(desc, info, data[0]);
-		return 1;
+		break;
 
 	case ES_state_active:
 		sample_event_state_value(desc, info, data[0]);
-		return 1;
+		break;
 
 	case ES_notify:
 		sample_event_notify_type(desc, info, data[0]);
-		return 1;
+		break;
 
 	case ES_notify_active:
 		sample_event_notify_value(desc, info, data[0]);
-		return 1;
+		break;
 
 	case ES_warning:
 		sample_event_warning_type(desc, info, data[0]);
-		return 1;
+		break;
 
 	case ES_warning_active:
 		sample_event_warning_value(desc, info, data[0]);
-		return 1;
+		break;
 
 	case ES_alarm:
 		sample_event_alarm_type(desc, info, data[0]);
-		return 1;
+		break;
 
 	case ES_alarm_active:
 		sample_event_alarm_value(desc, info, data[0]);
-		return 1;
+		break;
 
 	case ES_bookmark:
 		sample_bookmark_event(info, array_uint16_le(data));
-		return 2;
+		break;
 
 	case ES_gasswitch:
 		sample_gas_switch_event(info, array_uint16_le(data));
-		return 2;
+		break;
 
 	case ES_setpoint_type:
 		sample_setpoint_type(desc, info, data[0]);
-		return 1;
+		break;
 
 	case ES_setpoint_po2:
 		sample_setpoint_po2(info, array_uint32_le(data));
-		return 4;
+		break;
 
 	case ES_setpoint_automatic:	// bool
 		sample_setpoint_automatic(info, data[0]);
-		return 1;
+		break;
 
 	default:
-		return 0;
+		break;
 	}
 }
 
@@ -923,29 +1201,21 @@ static int traverse_samples(unsigned short type, const struct type_desc *desc, c
 {
 	struct sample_data *info = (struct sample_data *) user;
 	suunto_eonsteel_parser_t *eon = info->eon;
-	int i, used = 0;
-
-	if (desc->size > len)
-		ERROR(eon->base.context, "Got %d bytes of data for '%s' that wants %d bytes", len, desc->desc, desc->size);
+	unsigned int i;
 
-	for (i = 0; i < EON_MAX_GROUP; i++) {
-		enum eon_sample type = desc->type[i];
-		int bytes = handle_sample_type(desc, info, type, data);
-
-		if (!bytes)
-			break;
-		if (bytes > len) {
-			ERROR(eon->base.context, "Wanted %d bytes of data, only had %d bytes ('%s' idx %d)", bytes, len, desc->desc, i);
-			break;
-		}
-		data += bytes;
-		len -= bytes;
-		used += bytes;
+	// The sub-entries of the record are resolved in advance, so a
+	// single check covers all of them.
+	if ((int) desc->used > len) {
+		ERROR(eon->base.context, "Got %d bytes of data for '%s' that wants %u bytes", len, desc->desc, desc->used);
+		return 0;
 	}
 
+	for (i = 0; i < desc->nsamples; i++)
+		handle_sample_type(desc, info, desc->type[i], data + desc->offset[i]);
+
 	// Warn if there are left-over bytes for something we did use part of
-	if (used && len)
-		ERROR(eon->base.context, "Entry for '%s' had %d bytes, only used %d", desc->desc, len+used, used);
+	if (desc->used && len > (int) desc->used)
+		ERROR(eon->base.context, "Entry for '%s' had %d bytes, only used %u", desc->desc, len, desc->used);
 	return 0;
 }
 
@@ -955,12 +1225,10 @@ suunto_eonsteel_parser_samples_foreach(dc_parser_t *abstract, dc_sample_callback
 	suunto_eonsteel_parser_t *eon = (suunto_eonsteel_parser_t *) abstract;
 	struct sample_data data = { eon, callback, userdata, 0 };
 
+	data.mask = abstract->samplemask;
+
 	traverse_data(eon, traverse_samples, &data);
 
-	free(data.state_type);
-	free(data.notify_type);
-	free(data.warning_type);
-	free(data.alarm_type);
 
 	return DC_STATUS_SUCCESS;
 }
@@ -995,7 +1263,9 @@ suunto_eonsteel_parser_get_field(dc_parser_t *parser, dc_field_type_t type, unsi
 
 	switch (type) {
 	case DC_FIELD_DIVETIME:
-		field_value(value, eon->cache.divetime);
+		// The internal time fields are in ms and have to be added up
+		// like that. Only the result is translated back to seconds.
+		*((unsigned int *) value) = eon->cache.divetime / 1000;
 		break;
 	case DC_FIELD_MAXDEPTH:
 		field_value(value, eon->cache.maxdepth);
@@ -1112,7 +1382,7 @@ static int add_gas_type(suunto_eonsteel_parser_t *eon, const struct type_desc *d
 {
 	int idx = eon->cache.ngases;
 	dc_tankinfo_t tankinfo = DC_TANKINFO_METRIC;
-	char *name;
+	const char *name;
 
 	if (idx >= MAXGASES)
 		return 0;
@@ -1134,7 +1404,6 @@ static int add_gas_type(suunto_eonsteel_parser_t *eon, const struct type_desc *d
 
 	eon->cache.initialized |= 1 << DC_FIELD_GASMIX_COUNT;
 	eon->cache.initialized |= 1 << DC_FIELD_TANK_COUNT;
-	free(name);
 	return 0;
 }
 
@@ -1187,7 +1456,7 @@ static int add_string(suunto_eonsteel_parser_t *eon, const char *desc, const cha
 		if (str->desc)
 			continue;
 		str->desc = desc;
-		str->value = strdup(value);
+		str->value = dc_strpool_intern(&eon->strings, value);
 		break;
 	}
 	return 0;
@@ -1455,19 +1724,20 @@ static int traverse_dynamic_fields(suunto_eonsteel_parser_t *eon, const struct t
  */
 static int traverse_sample_fields(suunto_eonsteel_parser_t *eon, const struct type_desc *desc, const unsigned char *data, int len)
 {
-	int i;
+	unsigned int i;
 
-	for (i = 0; i < EON_MAX_GROUP; i++) {
-		enum eon_sample type = desc->type[i];
+	if ((int) desc->used > len)
+		return 0;
+
+	for (i = 0; i < desc->nsamples; i++) {
+		const unsigned char *p = data + desc->offset[i];
 
-		switch (type) {
+		switch (desc->type[i]) {
 		case ES_dtime:
-			add_time_field(eon, array_uint16_le(data));
-			data += 2;
+			add_time_field(eon, array_uint16_le(p));
 			continue;
 		case ES_depth:
-			set_depth_field(eon, array_uint16_le(data));
-			data += 2;
+			set_depth_field(eon, array_uint16_le(p));
 			continue;
 		default:
 			break;
@@ -1491,16 +1761,20 @@ static int traverse_fields(unsigned short type, const struct type_desc *desc, co
 }
 
 
+static void resume_reset(suunto_eonsteel_parser_t *eon)
+{
+	memset(&eon->resume, 0, sizeof(eon->resume));
+}
+
 static void initialize_field_caches(suunto_eonsteel_parser_t *eon)
 {
 	memset(&eon->cache, 0, sizeof(eon->cache));
 	eon->cache.initialized = 1 << DC_FIELD_DIVETIME;
 
-	traverse_data(eon, traverse_fields, eon);
-
-	// The internal time fields are in ms and have to be added up
-	// like that. At the end, we translate it back to seconds.
-	eon->cache.divetime /= 1000;
+	// The field cache is updated incrementally when more data is
+	// appended, so the position is remembered.
+	memset(&eon->fieldpos, 0, sizeof(eon->fieldpos));
+	traverse_data_from(eon, &eon->fieldpos, traverse_fields, eon);
 }
 
 static void show_descriptor(suunto_eonsteel_parser_t *eon, int nr, struct type_desc *desc)
@@ -1528,13 +1802,52 @@ static void show_all_descriptors(suunto_eonsteel_parser_t *eon)
 		show_descriptor(eon, i, eon->type_desc+i);
 }
 
+/*
+ * Continue with the entries that were added since the previous call.
+ * An entry that is still incomplete is left for the next call.
+ */
+static dc_status_t
+suunto_eonsteel_parser_samples_append(dc_parser_t *abstract, dc_sample_callback_t callback, void *userdata)
+{
+	suunto_eonsteel_parser_t *eon = (suunto_eonsteel_parser_t *) abstract;
+	struct sample_data data = { eon, callback, userdata, eon->resume.time };
+
+	data.state_type = eon->resume.state_type;
+	data.notify_type = eon->resume.notify_type;
+	data.warning_type = eon->resume.warning_type;
+	data.alarm_type = eon->resume.alarm_type;
+	data.gasnr = eon->resume.gasnr;
+	data.mask = abstract->samplemask;
+
+	traverse_data_from(eon, &eon->fieldpos, traverse_fields, eon);
+	traverse_data_from(eon, &eon->resume.pos, traverse_samples, &data);
+
+	eon->resume.time = data.time;
+	eon->resume.gasnr = data.gasnr;
+	eon->resume.state_type = data.state_type;
+	eon->resume.notify_type = data.notify_type;
+	eon->resume.warning_type = data.warning_type;
+	eon->resume.alarm_type = data.alarm_type;
+
+	return DC_STATUS_SUCCESS;
+}
+
 static dc_status_t
 suunto_eonsteel_parser_set_data(dc_parser_t *parser, const unsigned char *data, unsigned int size)
 {
 	suunto_eonsteel_parser_t *eon = (suunto_eonsteel_parser_t *) parser;
 
-	desc_free(eon->type_desc, MAXTYPE);
+	// Invalidate the previous dive. The interned strings are kept, unless
+	// there are too many of them.
+	dc_strpool_trim(&eon->strings);
 	memset(eon->type_desc, 0, sizeof(eon->type_desc));
+
+	// The descriptor cache is normally kept for the next dive. It's only
+	// flushed here, when none of the descriptors are in use.
+	if (eon->desc_cache_count > DESC_CACHE_MAX)
+		desc_cache_reset(eon);
+
+	resume_reset(eon);
 	initialize_field_caches(eon);
 	show_all_descriptors(eon);
 	return DC_STATUS_SUCCESS;
@@ -1545,7 +1858,9 @@ suunto_eonsteel_parser_destroy(dc_parser_t *parser)
 {
 	suunto_eonsteel_parser_t *eon = (suunto_eonsteel_parser_t *) parser;
 
-	desc_free(eon->type_desc, MAXTYPE);
+	resume_reset(eon);
+	dc_strpool_cleanup(&eon->strings);
+	dc_pool_cleanup(&eon->descpool);
 
 	return DC_STATUS_SUCCESS;
 }
@@ -1557,7 +1872,9 @@ static const dc_parser_vtable_t suunto_eonsteel_parser_vtable = {
 	suunto_eonsteel_parser_get_datetime, /* datetime */
 	suunto_eonsteel_parser_get_field, /* fields */
 	suunto_eonsteel_parser_samples_foreach, /* samples_foreach */
-	suunto_eonsteel_parser_destroy /* destroy */
+	suunto_eonsteel_parser_destroy, /* destroy */
+	NULL, /* samples_batch */
+	suunto_eonsteel_parser_samples_append /* samples_append */
 };
 
 dc_status_t
@@ -1576,6 +1893,11 @@ suunto_eonsteel_parser_create(dc_parser_t **out, dc_context_t *context, unsigned
 
 	memset(&parser->type_desc, 0, sizeof(parser->type_desc));
 	memset(&parser->cache, 0, sizeof(parser->cache));
+	memset(&parser->resume, 0, sizeof(parser->resume));
+	dc_strpool_init(&parser->strings, context);
+	dc_pool_init(&parser->descpool, context);
+	memset(parser->desc_cache, 0, sizeof(parser->desc_cache));
+	parser->desc_cache_count = 0;
 
 	*out = (dc_parser_t *) parser;
 
@@ -199,6 +199,8 @@ suunto_vyper_transfer (suunto_vyper_device_t *device, const unsigned char comman
 	if (device_is_cancelled (abstract))
 		return DC_STATUS_CANCELLED;
 
+	dc_usecs_t start = device_latency_start (abstract);
+
 	// Send the command to the dive computer.
 	dc_status_t rc = suunto_vyper_send (device, command, csize);
 	if (rc != DC_STATUS_SUCCESS) {
@@ -227,6 +229,8 @@ suunto_vyper_transfer (suunto_vyper_device_t *device, const unsigned char comman
 		return DC_STATUS_PROTOCOL;
 	}
 
+	device_latency_emit (abstract, command[0], size, start);
+
 	return DC_STATUS_SUCCESS;
 }
 
@@ -388,12 +392,17 @@ suunto_vyper_read_dive (dc_device_t *abstract, dc_buffer_t *buffer, int init, dc
 			device_event_emit (abstract, DC_EVENT_PROGRESS, progress);
 		}
 
-		// Append the package to the output buffer.
+		// The DC traverses its internal ring buffer backwards. The most
+		// recent dive is send first (which allows you to download only the
+		// new dives), but also the contents of each dive is reversed.
+		// Therefore, the package is reversed and prepended to the output
+		// buffer, which assembles the dive in the correct order.
 		// Reporting of buffer errors is delayed until the entire
 		// transfer is finished. This approach leaves no data behind in
 		// the serial receive buffer, and if this packet is part of the
 		// last incomplete dive, no error has to be reported at all.
-		dc_buffer_append (buffer, answer + 2, len);
+		array_reverse_bytes (answer + 2, len);
+		dc_buffer_prepend (buffer, answer + 2, len);
 
 		nbytes += len;
 
@@ -413,12 +422,6 @@ suunto_vyper_read_dive (dc_device_t *abstract, dc_buffer_t *buffer, int init, dc
 		return DC_STATUS_NOMEMORY;
 	}
 
-	// The DC traverses its internal ring buffer backwards. The most recent
-	// dive is send first (which allows you to download only the new dives),
-	// but also the contents of each dive is reversed. Therefore, we reverse
-	// the bytes again before returning them to the application.
-	array_reverse_bytes (dc_buffer_get_data (buffer), dc_buffer_get_size (buffer));
-
 	return DC_STATUS_SUCCESS;
 }
 
@@ -52,7 +52,9 @@ static const suunto_common2_device_vtable_t suunto_vyper2_device_vtable = {
 		suunto_common2_device_dump, /* dump */
 		suunto_common2_device_foreach, /* foreach */
 		NULL, /* timesync */
-		suunto_vyper2_device_close /* close */
+		suunto_vyper2_device_close, /* close */
+		0, /* pagesize */
+		suunto_common2_device_dump_incremental /* dump_incremental */
 	},
 	suunto_vyper2_device_packet
 };
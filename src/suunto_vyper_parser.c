@@ -19,6 +19,8 @@
  * MA 02110-1301 USA
  */
 
+#define LOG_SUBSYSTEM DC_LOGSUBSYSTEM_PARSER
+
 #include <stdlib.h>
 
 #include <libdivecomputer/units.h>
@@ -26,6 +28,7 @@
 #include "suunto_vyper.h"
 #include "context-private.h"
 #include "parser-private.h"
+#include "gastable.h"
 
 #define ISINSTANCE(parser) dc_parser_isinstance((parser), &suunto_vyper_parser_vtable)
 
@@ -42,6 +45,7 @@ struct suunto_vyper_parser_t {
 	unsigned int marker;
 	unsigned int ngasmixes;
 	unsigned int oxygen[NGASMIXES];
+	dc_gastable_t gastable;
 };
 
 static dc_status_t suunto_vyper_parser_set_data (dc_parser_t *abstract, const unsigned char *data, unsigned int size);
@@ -59,19 +63,6 @@ static const dc_parser_vtable_t suunto_vyper_parser_vtable = {
 	NULL /* destroy */
 };
 
-static unsigned int
-suunto_vyper_parser_find_gasmix (suunto_vyper_parser_t *parser, unsigned int o2)
-{
-	unsigned int i = 0;
-	while (i < parser->ngasmixes) {
-		if (o2 == parser->oxygen[i])
-			break;
-		i++;
-	}
-
-	return i;
-}
-
 static dc_status_t
 suunto_vyper_parser_cache (suunto_vyper_parser_t *parser)
 {
@@ -93,6 +84,9 @@ suunto_vyper_parser_cache (suunto_vyper_parser_t *parser)
 		oxygen[0] = data[6];
 	else
 		oxygen[0] = 21;
+	dc_gastable_t gastable;
+	dc_gastable_init (&gastable);
+	dc_gastable_add (&gastable, GASTABLE_KEY (oxygen[0], 0, 0));
 
 	// Parse the samples.
 	unsigned int interval = data[3];
@@ -118,12 +112,7 @@ suunto_vyper_parser_cache (suunto_vyper_parser_t *parser)
 			unsigned int o2 = data[offset++];
 
 			// Find the gasmix in the list.
-			unsigned int i = 0;
-			while (i < ngasmixes) {
-				if (o2 == oxygen[i])
-					break;
-				i++;
-			}
+			unsigned int i = dc_gastable_find (&gastable, GASTABLE_KEY (o2, 0, 0));
 
 			// Add it to list if not found.
 			if (i >= ngasmixes) {
@@ -131,6 +120,7 @@ suunto_vyper_parser_cache (suunto_vyper_parser_t *parser)
 					ERROR (abstract->context, "Maximum number of gas mixes reached.");
 					return DC_STATUS_DATAFORMAT;
 				}
+				dc_gastable_add (&gastable, GASTABLE_KEY (o2, 0, 0));
 				oxygen[i] = o2;
 				ngasmixes = i + 1;
 			}
@@ -152,6 +142,7 @@ suunto_vyper_parser_cache (suunto_vyper_parser_t *parser)
 	for (unsigned int i = 0; i < ngasmixes; ++i) {
 		parser->oxygen[i] = oxygen[i];
 	}
+	parser->gastable = gastable;
 	parser->cached = 1;
 
 	return DC_STATUS_SUCCESS;
@@ -182,6 +173,7 @@ suunto_vyper_parser_create (dc_parser_t **out, dc_context_t *context)
 	for (unsigned int i = 0; i < NGASMIXES; ++i) {
 		parser->oxygen[i] = 0;
 	}
+	dc_gastable_init (&parser->gastable);
 
 	*out = (dc_parser_t*) parser;
 
@@ -203,6 +195,7 @@ suunto_vyper_parser_set_data (dc_parser_t *abstract, const unsigned char *data,
 	for (unsigned int i = 0; i < NGASMIXES; ++i) {
 		parser->oxygen[i] = 0;
 	}
+	dc_gastable_init (&parser->gastable);
 
 	return DC_STATUS_SUCCESS;
 }
@@ -395,7 +388,7 @@ suunto_vyper_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t
 					return DC_STATUS_DATAFORMAT;
 
 				o2 = data[offset++];
-				idx = suunto_vyper_parser_find_gasmix (parser, o2);
+				idx = dc_gastable_find (&parser->gastable, GASTABLE_KEY (o2, 0, 0));
 				if (idx >= parser->ngasmixes) {
 					ERROR (abstract->context, "Maximum number of gas mixes reached.");
 					return DC_STATUS_DATAFORMAT;
@@ -0,0 +1,300 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#define LOG_SUBSYSTEM DC_LOGSUBSYSTEM_IOSTREAM
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h> // malloc, free
+#include <stdio.h>  // snprintf
+#include <string.h>
+#include <limits.h> // INT_MAX
+
+#include "socket.h"
+
+#ifdef _WIN32
+#include <ws2tcpip.h>
+#else
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#endif
+
+#include <libdivecomputer/tcp.h>
+
+#include "common-private.h"
+#include "context-private.h"
+#include "iostream-private.h"
+
+#define ISINSTANCE(device) dc_iostream_isinstance((device), &dc_tcp_vtable)
+
+static dc_status_t dc_tcp_purge (dc_iostream_t *iostream, dc_direction_t direction);
+
+static const dc_iostream_vtable_t dc_tcp_vtable = {
+	sizeof(dc_socket_t),
+	dc_socket_set_timeout, /* set_timeout */
+	NULL, /* set_latency */
+	NULL, /* set_break */
+	NULL, /* set_dtr */
+	NULL, /* set_rts */
+	NULL, /* get_lines */
+	dc_socket_get_available, /* get_available */
+	NULL, /* configure */
+	dc_socket_read, /* read */
+	dc_socket_write, /* write */
+	NULL, /* flush */
+	dc_tcp_purge, /* purge */
+	dc_socket_sleep, /* sleep */
+	dc_socket_close, /* close */
+	NULL, /* get_name */
+	dc_socket_read_async, /* read_async */
+	dc_socket_write_async, /* write_async */
+	dc_socket_cancel, /* cancel */
+	dc_socket_readv, /* readv */
+	dc_socket_writev, /* writev */
+	dc_socket_interrupt, /* interrupt */	dc_socket_wait_readable, /* wait_readable */
+};
+
+dc_status_t
+dc_tcp_open (dc_iostream_t **out, dc_context_t *context, const char *hostname, unsigned int port)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_socket_t *device = NULL;
+	struct addrinfo hints, *addresses = NULL;
+	char service[16];
+
+	if (out == NULL || hostname == NULL || port == 0 || port > 0xFFFF)
+		return DC_STATUS_INVALIDARGS;
+
+	INFO (context, "Open: hostname=%s, port=%u", hostname, port);
+
+	// Allocate memory.
+	device = (dc_socket_t *) dc_iostream_allocate (context, &dc_tcp_vtable, DC_TRANSPORT_SERIAL);
+	if (device == NULL) {
+		SYSERROR (context, S_ENOMEM);
+		return DC_STATUS_NOMEMORY;
+	}
+
+	// Initialize the socket library for the name resolution.
+	status = dc_socket_init (context);
+	if (status != DC_STATUS_SUCCESS) {
+		goto error_free;
+	}
+
+	// Resolve the host name.
+	memset (&hints, 0, sizeof (hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_protocol = IPPROTO_TCP;
+	snprintf (service, sizeof (service), "%u", port);
+	int rc = getaddrinfo (hostname, service, &hints, &addresses);
+	if (rc != 0) {
+		ERROR (context, "Failed to resolve the host name (%s).", gai_strerror (rc));
+		status = DC_STATUS_IO;
+		goto error_exit;
+	}
+
+	// Try all addresses until a connection succeeds.
+	status = DC_STATUS_IO;
+	for (struct addrinfo *ai = addresses; ai != NULL; ai = ai->ai_next) {
+		status = dc_socket_open (&device->base, ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+		if (status != DC_STATUS_SUCCESS)
+			continue;
+
+		status = dc_socket_connect (&device->base, ai->ai_addr, ai->ai_addrlen);
+		if (status == DC_STATUS_SUCCESS)
+			break;
+
+		dc_socket_close (&device->base);
+	}
+
+	freeaddrinfo (addresses);
+
+	if (status != DC_STATUS_SUCCESS) {
+		goto error_exit;
+	}
+
+	// Send the small request packets immediately.
+	status = dc_socket_set_option (&device->base, IPPROTO_TCP, TCP_NODELAY, 1);
+	if (status != DC_STATUS_SUCCESS) {
+		goto error_close;
+	}
+
+	dc_socket_exit (context);
+
+	*out = (dc_iostream_t *) device;
+
+	return DC_STATUS_SUCCESS;
+
+error_close:
+	dc_socket_close (&device->base);
+error_exit:
+	dc_socket_exit (context);
+error_free:
+	dc_iostream_deallocate ((dc_iostream_t *) device);
+	return status;
+}
+
+dc_status_t
+dc_tcp_accept (dc_iostream_t **out, dc_context_t *context, unsigned int port)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_socket_t *device = NULL;
+	s_socket_t fd = S_INVALID;
+
+	if (out == NULL || port == 0 || port > 0xFFFF)
+		return DC_STATUS_INVALIDARGS;
+
+	INFO (context, "Accept: port=%u", port);
+
+	// Allocate memory.
+	device = (dc_socket_t *) dc_iostream_allocate (context, &dc_tcp_vtable, DC_TRANSPORT_SERIAL);
+	if (device == NULL) {
+		SYSERROR (context, S_ENOMEM);
+		return DC_STATUS_NOMEMORY;
+	}
+
+	// Open the listening socket.
+	status = dc_socket_open (&device->base, AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (status != DC_STATUS_SUCCESS) {
+		goto error_free;
+	}
+
+	// Allow to listen again immediately after the previous client.
+	status = dc_socket_set_option (&device->base, SOL_SOCKET, SO_REUSEADDR, 1);
+	if (status != DC_STATUS_SUCCESS) {
+		goto error_close;
+	}
+
+	struct sockaddr_in sa;
+	memset (&sa, 0, sizeof (sa));
+	sa.sin_family = AF_INET;
+	sa.sin_addr.s_addr = htonl (INADDR_ANY);
+	sa.sin_port = htons (port);
+	if (bind (device->fd, (struct sockaddr *) &sa, sizeof (sa)) != 0 ||
+		listen (device->fd, 1) != 0) {
+		s_errcode_t errcode = S_ERRNO;
+		SYSERROR (context, errcode);
+		status = dc_socket_syserror (errcode);
+		goto error_close;
+	}
+
+	// Wait for the client.
+	while (1) {
+		fd = accept (device->fd, NULL, NULL);
+		if (fd != S_INVALID)
+			break;
+
+		s_errcode_t errcode = S_ERRNO;
+		if (errcode == S_EINTR)
+			continue; // Retry.
+		SYSERROR (context, errcode);
+		status = dc_socket_syserror (errcode);
+		goto error_close;
+	}
+
+	// Replace the listening socket with the connection.
+	S_CLOSE (device->fd);
+	device->fd = fd;
+
+	// Send the small packets immediately.
+	status = dc_socket_set_option (&device->base, IPPROTO_TCP, TCP_NODELAY, 1);
+	if (status != DC_STATUS_SUCCESS) {
+		goto error_close;
+	}
+
+	*out = (dc_iostream_t *) device;
+
+	return DC_STATUS_SUCCESS;
+
+error_close:
+	dc_socket_close (&device->base);
+error_free:
+	dc_iostream_deallocate ((dc_iostream_t *) device);
+	return status;
+}
+
+dc_status_t
+dc_tcp_set_nodelay (dc_iostream_t *iostream, unsigned int value)
+{
+	if (!ISINSTANCE (iostream))
+		return DC_STATUS_INVALIDARGS;
+
+	INFO (iostream->context, "Nodelay: value=%u", value);
+
+	return dc_socket_set_option (iostream, IPPROTO_TCP, TCP_NODELAY, value ? 1 : 0);
+}
+
+dc_status_t
+dc_tcp_set_bufsize (dc_iostream_t *iostream, unsigned int input, unsigned int output)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (!ISINSTANCE (iostream) || input > INT_MAX || output > INT_MAX)
+		return DC_STATUS_INVALIDARGS;
+
+	INFO (iostream->context, "Bufsize: input=%u, output=%u", input, output);
+
+	if (input) {
+		status = dc_socket_set_option (iostream, SOL_SOCKET, SO_RCVBUF, input);
+		if (status != DC_STATUS_SUCCESS)
+			return status;
+	}
+
+	if (output) {
+		status = dc_socket_set_option (iostream, SOL_SOCKET, SO_SNDBUF, output);
+		if (status != DC_STATUS_SUCCESS)
+			return status;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_tcp_purge (dc_iostream_t *iostream, dc_direction_t direction)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if ((direction & DC_DIRECTION_INPUT) == 0)
+		return DC_STATUS_SUCCESS;
+
+	// Discard the data that is already received. Data which is still in
+	// transit, or buffered on the remote side, can't be purged.
+	while (1) {
+		unsigned char buffer[256];
+		size_t available = 0;
+
+		status = dc_socket_get_available (iostream, &available);
+		if (status != DC_STATUS_SUCCESS || available == 0)
+			break;
+
+		if (available > sizeof (buffer))
+			available = sizeof (buffer);
+
+		status = dc_socket_read (iostream, buffer, available, NULL);
+		if (status != DC_STATUS_SUCCESS)
+			break;
+	}
+
+	return status;
+}
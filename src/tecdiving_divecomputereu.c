@@ -20,7 +20,7 @@
  */
 
 #include <string.h> // memcmp, memcpy
-#include <stdlib.h> // malloc, free
+#include <stdlib.h>
 
 #include "tecdiving_divecomputereu.h"
 #include "context-private.h"
@@ -139,8 +139,13 @@ tecdiving_divecomputereu_send (tecdiving_divecomputereu_device_t *device, unsign
 	return DC_STATUS_SUCCESS;
 }
 
+/*
+ * Receive a packet with a payload of at most the given size. With a
+ * buffer, the payload is stored in the buffer, which is resized to the
+ * length announced in the packet header, instead of the data array.
+ */
 static dc_status_t
-tecdiving_divecomputereu_receive (tecdiving_divecomputereu_device_t *device, unsigned char rsp, unsigned char data[], size_t size, size_t *actual)
+tecdiving_divecomputereu_receive_packet (tecdiving_divecomputereu_device_t *device, unsigned char rsp, unsigned char data[], size_t size, size_t *actual, dc_buffer_t *buffer)
 {
 	dc_status_t status = DC_STATUS_SUCCESS;
 	dc_device_t *abstract = (dc_device_t *) device;
@@ -209,6 +214,14 @@ tecdiving_divecomputereu_receive (tecdiving_divecomputereu_device_t *device, uns
 		return DC_STATUS_PROTOCOL;
 	}
 
+	if (buffer) {
+		if (!dc_buffer_resize (buffer, length)) {
+			ERROR (abstract->context, "Insufficient buffer space available.");
+			return DC_STATUS_NOMEMORY;
+		}
+		data = dc_buffer_get_data (buffer);
+	}
+
 	size_t nbytes = 0;
 	while (nbytes < length) {
 		// Set the maximum packet size.
@@ -260,6 +273,12 @@ tecdiving_divecomputereu_receive (tecdiving_divecomputereu_device_t *device, uns
 	return DC_STATUS_SUCCESS;
 }
 
+static dc_status_t
+tecdiving_divecomputereu_receive (tecdiving_divecomputereu_device_t *device, unsigned char rsp, unsigned char data[], size_t size, size_t *actual)
+{
+	return tecdiving_divecomputereu_receive_packet (device, rsp, data, size, actual, NULL);
+}
+
 static dc_status_t
 tecdiving_divecomputereu_readdive (dc_device_t *abstract, dc_event_progress_t *progress, unsigned int idx, dc_buffer_t *buffer)
 {
@@ -435,6 +454,7 @@ tecdiving_divecomputereu_device_foreach (dc_device_t *abstract, dc_dive_callback
 {
 	dc_status_t status = DC_STATUS_SUCCESS;
 	tecdiving_divecomputereu_device_t *device = (tecdiving_divecomputereu_device_t *) abstract;
+	size_t charged = 0;
 
 	// Enable progress notifications.
 	dc_event_progress_t progress = EVENT_PROGRESS_INITIALIZER;
@@ -453,10 +473,10 @@ tecdiving_divecomputereu_device_foreach (dc_device_t *abstract, dc_dive_callback
 	vendor.size = sizeof(device->version);
 	device_event_emit (abstract, DC_EVENT_VENDOR, &vendor);
 
-	// Allocate memory for the dive list.
-	size_t length = SZ_LIST;
-	unsigned char *logbook = (unsigned char *) malloc (length);
-	if (logbook == NULL) {
+	// Allocate memory for the dive list. The buffer is sized from the
+	// length of the packet, rather than for the maximum number of dives.
+	dc_buffer_t *list = dc_buffer_new (0);
+	if (list == NULL) {
 		status = DC_STATUS_NOMEMORY;
 		goto error_exit;
 	}
@@ -469,13 +489,19 @@ tecdiving_divecomputereu_device_foreach (dc_device_t *abstract, dc_dive_callback
 	}
 
 	// Read the dive list.
-	status = tecdiving_divecomputereu_receive (device, RSP_LIST, logbook, length, &length);
+	size_t length = 0;
+	status = tecdiving_divecomputereu_receive_packet (device, RSP_LIST, NULL, SZ_LIST, &length, list);
 	if (status != DC_STATUS_SUCCESS) {
 		ERROR (abstract->context, "Failed to receive the logbook.");
 		goto error_logbook_free;
 	}
 
+	// Account the memory of the dive list.
+	charged = dc_buffer_get_capacity (list);
+	device_memory_charge (abstract, charged);
+
 	// Verify the minimum length.
+	const unsigned char *logbook = dc_buffer_get_data (list);
 	if (length < 2) {
 		status = DC_STATUS_DATAFORMAT;
 		goto error_logbook_free;
@@ -520,6 +546,13 @@ tecdiving_divecomputereu_device_foreach (dc_device_t *abstract, dc_dive_callback
 			goto error_buffer_free;
 		}
 
+		// Account the growth of the dive buffer.
+		size_t capacity = dc_buffer_get_capacity (list) + dc_buffer_get_capacity (buffer);
+		if (capacity > charged) {
+			device_memory_charge (abstract, capacity - charged);
+			charged = capacity;
+		}
+
 		// Cache the pointer.
 		unsigned char *data = dc_buffer_get_data(buffer);
 		unsigned int size = dc_buffer_get_size(buffer);
@@ -539,7 +572,8 @@ tecdiving_divecomputereu_device_foreach (dc_device_t *abstract, dc_dive_callback
 error_buffer_free:
 	dc_buffer_free (buffer);
 error_logbook_free:
-	free (logbook);
+	dc_buffer_free (list);
+	device_memory_release (abstract, charged);
 error_exit:
 	return status;
 }
@@ -0,0 +1,84 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_TRACEPOINT_H
+#define DC_TRACEPOINT_H
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef ENABLE_TRACEPOINTS
+#include <sys/sdt.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * Static tracepoints (USDT) for attaching bpftrace, SystemTap or DTrace
+ * to a running application. The probes are registered under the
+ * libdivecomputer provider:
+ *
+ *   iostream__read__start (iostream, size)
+ *   iostream__read__done (iostream, size, actual, status)
+ *   iostream__write__start (iostream, size)
+ *   iostream__write__done (iostream, size, actual, status)
+ *   device__read__start (family, address, size)
+ *   device__read__done (family, address, size, status)
+ *   transfer__start (family)
+ *   transfer__done (family, command, size)
+ *   rbstream__read__start (address, size)
+ *   rbstream__read__done (address, size, status)
+ *   dive__callback__start (family, size)
+ *   dive__callback__done (family, size, result)
+ *   parser__data__start (family, size)
+ *   parser__data__done (family, size, status)
+ *   parser__samples__start (family)
+ *   parser__samples__done (family, status)
+ *
+ * Without the sys/sdt.h header, or with the --disable-tracepoints build
+ * option, the macros compile to nothing, and the arguments are not
+ * evaluated. An enabled probe that is not attached costs a single nop.
+ * The probes carry no timestamps: the latency of an operation is the
+ * time between its start and done probes, as measured by the tracer.
+ */
+#ifdef ENABLE_TRACEPOINTS
+#define TRACEPOINTS_ENABLED 1
+#define TRACEPOINT0(name) DTRACE_PROBE (libdivecomputer, name)
+#define TRACEPOINT1(name,a) DTRACE_PROBE1 (libdivecomputer, name, a)
+#define TRACEPOINT2(name,a,b) DTRACE_PROBE2 (libdivecomputer, name, a, b)
+#define TRACEPOINT3(name,a,b,c) DTRACE_PROBE3 (libdivecomputer, name, a, b, c)
+#define TRACEPOINT4(name,a,b,c,d) DTRACE_PROBE4 (libdivecomputer, name, a, b, c, d)
+#else
+#define TRACEPOINTS_ENABLED 0
+#define TRACEPOINT0(name) ((void) 0)
+#define TRACEPOINT1(name,a) ((void) 0)
+#define TRACEPOINT2(name,a,b) ((void) 0)
+#define TRACEPOINT3(name,a,b,c) ((void) 0)
+#define TRACEPOINT4(name,a,b,c,d) ((void) 0)
+#endif
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_TRACEPOINT_H */
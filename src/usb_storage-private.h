@@ -0,0 +1,78 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_USB_STORAGE_PRIVATE_H
+#define DC_USB_STORAGE_PRIVATE_H
+
+#include <libdivecomputer/context.h>
+#include <libdivecomputer/iostream.h>
+#include <libdivecomputer/buffer.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * Access to the files of a usb storage device. For a usb storage (or
+ * custom usb storage) stream, the files are accessed through the
+ * stream. Any other stream is expected to return the pathname of the
+ * mount point with a single read, like the usb storage stream did
+ * before, and the files are accessed directly.
+ *
+ * All names are relative to the mount point, with '/' as the separator.
+ * The functions can be called from multiple threads at the same time.
+ */
+typedef struct dc_usb_storage_fs_t dc_usb_storage_fs_t;
+
+dc_status_t
+dc_usb_storage_fs_open (dc_usb_storage_fs_t **out, dc_context_t *context, dc_iostream_t *iostream);
+
+/*
+ * Call the callback with the name of each entry in the directory, until
+ * the callback returns zero.
+ */
+dc_status_t
+dc_usb_storage_fs_list (dc_usb_storage_fs_t *fs, const char *dirname, dc_usb_storage_list_callback_t callback, void *userdata);
+
+dc_status_t
+dc_usb_storage_fs_stat (dc_usb_storage_fs_t *fs, const char *filename, unsigned long long *size, long long *mtime);
+
+/*
+ * Append the contents of the file to the buffer. Native files are
+ * mapped into memory when possible, to avoid the intermediate copies.
+ */
+dc_status_t
+dc_usb_storage_fs_read (dc_usb_storage_fs_t *fs, const char *filename, dc_buffer_t *buffer);
+
+/*
+ * Read a range of the file. At the end of the file, fewer bytes than
+ * requested are returned.
+ */
+dc_status_t
+dc_usb_storage_fs_read_range (dc_usb_storage_fs_t *fs, const char *filename, unsigned long long offset, void *data, size_t size, size_t *actual);
+
+void
+dc_usb_storage_fs_close (dc_usb_storage_fs_t *fs);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_USB_STORAGE_PRIVATE_H */
@@ -19,6 +19,8 @@
  * MA 02110-1301 USA
  */
 
+#define LOG_SUBSYSTEM DC_LOGSUBSYSTEM_IOSTREAM
+
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif
@@ -27,27 +29,51 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <dirent.h>
+#include <unistd.h>
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_MMAP)
+#include <sys/mman.h>
+#define USE_MMAP
+#endif
 
 #include "common-private.h"
 #include "context-private.h"
 #include "iostream-private.h"
 #include "iterator-private.h"
 #include "descriptor-private.h"
+#include "usb_storage-private.h"
 #include "timer.h"
 
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
 // Fake "device" that just contains the directory name that
-// you can read out of the iostream. All the actual IO is
-// up to you.
+// you can read out of the iostream. The files are accessed
+// with the dc_usb_storage_fs functions, either directly or
+// through the callbacks of a custom device.
 typedef struct dc_usbstorage_t {
 	dc_iostream_t base;
 	char pathname[PATH_MAX];
+	const dc_usb_storage_cbs_t *callbacks;
+	void *userdata;
 } dc_usbstorage_t;
 
+struct dc_usb_storage_fs_t {
+	dc_context_t *context;
+	char root[PATH_MAX];
+	const dc_usb_storage_cbs_t *callbacks;
+	void *userdata;
+};
+
 static dc_status_t
 dc_usb_storage_read (dc_iostream_t *iostream, void *data, size_t size, size_t *actual);
+static dc_status_t
+dc_usb_storage_close (dc_iostream_t *iostream);
 
 static const dc_iostream_vtable_t dc_usbstorage_vtable = {
 	sizeof(dc_usbstorage_t),
@@ -64,7 +90,7 @@ static const dc_iostream_vtable_t dc_usbstorage_vtable = {
 	NULL, /* flush */
 	NULL, /* purge */
 	NULL, /* sleep */
-	NULL, /* close */
+	dc_usb_storage_close, /* close */
 };
 
 dc_status_t
@@ -89,6 +115,34 @@ dc_usb_storage_open (dc_iostream_t **out, dc_context_t *context, const char *nam
 
 	strncpy(device->pathname, name, PATH_MAX);
 	device->pathname[PATH_MAX-1] = 0;
+	device->callbacks = NULL;
+	device->userdata = NULL;
+
+	*out = (dc_iostream_t *) device;
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_usb_storage_custom_open (dc_iostream_t **out, dc_context_t *context, const dc_usb_storage_cbs_t *callbacks, void *userdata)
+{
+	dc_usbstorage_t *device = NULL;
+
+	if (out == NULL || callbacks == NULL ||
+		callbacks->list == NULL || callbacks->read == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	INFO (context, "Open: custom");
+
+	// Allocate memory.
+	device = (dc_usbstorage_t *) dc_iostream_allocate (context, &dc_usbstorage_vtable, DC_TRANSPORT_USBSTORAGE);
+	if (device == NULL) {
+		SYSERROR (context, ENOMEM);
+		return DC_STATUS_NOMEMORY;
+	}
+
+	device->pathname[0] = 0;
+	device->callbacks = callbacks;
+	device->userdata = userdata;
 
 	*out = (dc_iostream_t *) device;
 	return DC_STATUS_SUCCESS;
@@ -100,6 +154,10 @@ dc_usb_storage_read (dc_iostream_t *iostream, void *data, size_t size, size_t *a
 	dc_usbstorage_t *device = (dc_usbstorage_t *) iostream;
 	size_t len = strlen(device->pathname);
 
+	// A custom device has no pathname.
+	if (device->callbacks)
+		return DC_STATUS_UNSUPPORTED;
+
 	if (size <= len)
 		return DC_STATUS_IO;
 	memcpy(data, device->pathname, len+1);
@@ -107,3 +165,288 @@ dc_usb_storage_read (dc_iostream_t *iostream, void *data, size_t size, size_t *a
 		*actual = len;
 	return DC_STATUS_SUCCESS;
 }
+
+static dc_status_t
+dc_usb_storage_close (dc_iostream_t *iostream)
+{
+	dc_usbstorage_t *device = (dc_usbstorage_t *) iostream;
+
+	if (device->callbacks && device->callbacks->close)
+		return device->callbacks->close (device->userdata);
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_usb_storage_fs_open (dc_usb_storage_fs_t **out, dc_context_t *context, dc_iostream_t *iostream)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_usb_storage_fs_t *fs = NULL;
+
+	if (out == NULL || iostream == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	fs = (dc_usb_storage_fs_t *) malloc (sizeof (*fs));
+	if (fs == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	fs->context = context;
+	fs->root[0] = 0;
+	fs->callbacks = NULL;
+	fs->userdata = NULL;
+
+	if (dc_iostream_isinstance (iostream, &dc_usbstorage_vtable)) {
+		dc_usbstorage_t *device = (dc_usbstorage_t *) iostream;
+		strcpy (fs->root, device->pathname);
+		fs->callbacks = device->callbacks;
+		fs->userdata = device->userdata;
+	} else {
+		// Read the directory name from the iostream.
+		size_t len = 0;
+		status = dc_iostream_read (iostream, fs->root, sizeof (fs->root) - 1, &len);
+		if (status != DC_STATUS_SUCCESS) {
+			free (fs);
+			return status;
+		}
+		fs->root[len] = 0;
+	}
+
+	// Remove the trailing separator.
+	size_t len = strlen (fs->root);
+	if (len > 1 && fs->root[len - 1] == '/')
+		fs->root[len - 1] = 0;
+
+	*out = fs;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_usb_storage_fs_path (dc_usb_storage_fs_t *fs, const char *name, char path[PATH_MAX])
+{
+	int n = snprintf (path, PATH_MAX, "%s/%s", fs->root, name);
+	if (n < 0 || n >= PATH_MAX) {
+		ERROR (fs->context, "Pathname too long (%s).", name);
+		return DC_STATUS_IO;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_usb_storage_fs_list (dc_usb_storage_fs_t *fs, const char *dirname, dc_usb_storage_list_callback_t callback, void *userdata)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	char path[PATH_MAX];
+
+	if (fs == NULL || dirname == NULL || callback == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	if (fs->callbacks)
+		return fs->callbacks->list (fs->userdata, dirname, callback, userdata);
+
+	status = dc_usb_storage_fs_path (fs, dirname, path);
+	if (status != DC_STATUS_SUCCESS)
+		return status;
+
+	DIR *dir = opendir (path);
+	if (dir == NULL)
+		return DC_STATUS_IO;
+
+	struct dirent *de;
+	while ((de = readdir (dir)) != NULL) {
+		if (!callback (de->d_name, userdata))
+			break;
+	}
+
+	closedir (dir);
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_usb_storage_fs_stat (dc_usb_storage_fs_t *fs, const char *filename, unsigned long long *size, long long *mtime)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	char path[PATH_MAX];
+	struct stat st;
+
+	if (fs == NULL || filename == NULL || size == NULL || mtime == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	if (fs->callbacks) {
+		if (fs->callbacks->stat == NULL)
+			return DC_STATUS_UNSUPPORTED;
+		return fs->callbacks->stat (fs->userdata, filename, size, mtime);
+	}
+
+	status = dc_usb_storage_fs_path (fs, filename, path);
+	if (status != DC_STATUS_SUCCESS)
+		return status;
+
+	if (stat (path, &st) < 0)
+		return DC_STATUS_IO;
+
+	*size = st.st_size;
+	*mtime = st.st_mtime;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_usb_storage_fs_read (dc_usb_storage_fs_t *fs, const char *filename, dc_buffer_t *buffer)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	char path[PATH_MAX];
+
+	if (fs == NULL || filename == NULL || buffer == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	if (fs->callbacks) {
+		// Pre-allocate the required amount of memory, when the file
+		// size is known, and read the data straight into the buffer.
+		unsigned long long size = 0;
+		long long mtime = 0;
+		if (fs->callbacks->stat && fs->callbacks->stat (fs->userdata, filename, &size, &mtime) == DC_STATUS_SUCCESS) {
+			if (!dc_buffer_reserve (buffer, dc_buffer_get_size (buffer) + size))
+				return DC_STATUS_NOMEMORY;
+		}
+
+		unsigned long long offset = 0;
+		for (;;) {
+			size_t n = dc_buffer_get_size (buffer);
+			size_t len = size > offset ? size - offset : 4096;
+			if (!dc_buffer_resize (buffer, n + len))
+				return DC_STATUS_NOMEMORY;
+
+			size_t nbytes = 0;
+			status = fs->callbacks->read (fs->userdata, filename, offset,
+				dc_buffer_get_data (buffer) + n, len, &nbytes);
+			if (status != DC_STATUS_SUCCESS || nbytes > len)
+				nbytes = 0;
+			dc_buffer_resize (buffer, n + nbytes);
+			if (status != DC_STATUS_SUCCESS)
+				return status;
+			if (nbytes == 0)
+				break;
+
+			offset += nbytes;
+		}
+
+		return DC_STATUS_SUCCESS;
+	}
+
+	status = dc_usb_storage_fs_path (fs, filename, path);
+	if (status != DC_STATUS_SUCCESS)
+		return status;
+
+	int fd = open (path, O_RDONLY | O_BINARY);
+	if (fd < 0)
+		return DC_STATUS_IO;
+
+	// Pre-allocate the required amount of memory, when the file size is
+	// known. Otherwise the buffer is expanded while reading the data.
+	struct stat st;
+	if (fstat (fd, &st) == 0 && st.st_size > 0) {
+		if (!dc_buffer_reserve (buffer, dc_buffer_get_size (buffer) + st.st_size)) {
+			close (fd);
+			return DC_STATUS_NOMEMORY;
+		}
+
+#ifdef USE_MMAP
+		// Map the file into memory, and copy the contents with a single
+		// append. If mapping fails (e.g. on filesystems without mmap
+		// support), fall back to the read loop below.
+		void *map = mmap (NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (map != MAP_FAILED) {
+			if (!dc_buffer_append (buffer, map, st.st_size))
+				status = DC_STATUS_NOMEMORY;
+			munmap (map, st.st_size);
+			close (fd);
+			return status;
+		}
+#endif
+	}
+
+	for (;;) {
+		unsigned char data[4096];
+
+		ssize_t n = read (fd, data, sizeof (data));
+		if (n == 0)
+			break;
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			status = DC_STATUS_IO;
+			break;
+		}
+
+		if (!dc_buffer_append (buffer, data, n)) {
+			status = DC_STATUS_NOMEMORY;
+			break;
+		}
+	}
+
+	close (fd);
+
+	return status;
+}
+
+dc_status_t
+dc_usb_storage_fs_read_range (dc_usb_storage_fs_t *fs, const char *filename, unsigned long long offset, void *data, size_t size, size_t *actual)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	char path[PATH_MAX];
+	size_t nbytes = 0;
+
+	if (fs == NULL || filename == NULL || (data == NULL && size))
+		return DC_STATUS_INVALIDARGS;
+
+	if (fs->callbacks) {
+		status = fs->callbacks->read (fs->userdata, filename, offset, data, size, &nbytes);
+		goto out;
+	}
+
+	status = dc_usb_storage_fs_path (fs, filename, path);
+	if (status != DC_STATUS_SUCCESS)
+		goto out;
+
+	int fd = open (path, O_RDONLY | O_BINARY);
+	if (fd < 0) {
+		status = DC_STATUS_IO;
+		goto out;
+	}
+
+	if (lseek (fd, offset, SEEK_SET) == (off_t) -1) {
+		status = DC_STATUS_IO;
+	} else {
+		while (nbytes < size) {
+			ssize_t n = read (fd, (unsigned char *) data + nbytes, size - nbytes);
+			if (n == 0)
+				break;
+			if (n < 0) {
+				if (errno == EINTR)
+					continue;
+				status = DC_STATUS_IO;
+				break;
+			}
+			nbytes += n;
+		}
+	}
+
+	close (fd);
+
+out:
+	if (actual)
+		*actual = nbytes;
+
+	return status;
+}
+
+void
+dc_usb_storage_fs_close (dc_usb_storage_fs_t *fs)
+{
+	free (fs);
+}
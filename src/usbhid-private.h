@@ -0,0 +1,105 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_USBHID_PRIVATE_H
+#define DC_USBHID_PRIVATE_H
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+// The usbhid transport uses libusb, unless hidapi is available.
+#if !defined(HAVE_HIDAPI) && defined(HAVE_LIBUSB) && !defined(__APPLE__)
+#define USBHID_LIBUSB
+#endif
+
+#ifdef USBHID_LIBUSB
+#ifdef _WIN32
+#define NOGDI
+#endif
+#include <libusb.h>
+#endif
+
+#include <libdivecomputer/context.h>
+
+#include "timer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * The session of the usbhid transport. With libusb, it's also used by
+ * the backends which use libusb directly, and when available, the
+ * events of all transfers are handled by the event thread of the
+ * session.
+ */
+typedef struct dc_usbhid_session_t dc_usbhid_session_t;
+
+dc_status_t
+dc_usbhid_session_new (dc_usbhid_session_t **out, dc_context_t *context);
+
+/*
+ * Start the event thread, if not already running. If that fails, the
+ * transfers keep handling the events from the calling thread.
+ */
+void
+dc_usbhid_session_start (dc_usbhid_session_t *session, dc_context_t *context);
+
+dc_status_t
+dc_usbhid_session_unref (dc_usbhid_session_t *session);
+
+#ifdef USBHID_LIBUSB
+
+/*
+ * An asynchronous transfer. The transfer is filled with
+ * dc_usbhid_transfer_callback as the callback, and the report as the
+ * user data.
+ */
+typedef struct dc_usbhid_report_t {
+	dc_usbhid_session_t *session;
+	struct libusb_transfer *transfer;
+	int submitted;
+	int completed;
+} dc_usbhid_report_t;
+
+libusb_context *
+dc_usbhid_session_get_handle (dc_usbhid_session_t *session);
+
+void LIBUSB_CALL
+dc_usbhid_transfer_callback (struct libusb_transfer *transfer);
+
+int
+dc_usbhid_transfer_submit (dc_usbhid_report_t *report);
+
+/*
+ * Wait until the transfer has completed, or the timeout (in
+ * milliseconds, or zero to wait forever) expires. Without an event
+ * thread, the libusb events are handled by the calling thread.
+ */
+int
+dc_usbhid_transfer_wait (dc_usbhid_report_t *report, dc_timer_t *timer, unsigned int timeout);
+#endif
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_USBHID_PRIVATE_H */
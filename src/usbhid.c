@@ -19,6 +19,8 @@
  * MA 02110-1301 USA
  */
 
+#define LOG_SUBSYSTEM DC_LOGSUBSYSTEM_IOSTREAM
+
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif
@@ -27,18 +29,25 @@
 #include <string.h>
 #ifdef HAVE_PTHREAD_H
 #include <pthread.h>
+#include <errno.h>
+#include <time.h>
 #endif
 #ifdef _WIN32
 #define NOGDI
 #include <windows.h>
 #endif
 
+#include "usbhid-private.h"
+
 #if defined(HAVE_HIDAPI)
 #define USE_HIDAPI
 #define USBHID
-#elif defined(HAVE_LIBUSB) && !defined(__APPLE__)
+#elif defined(USBHID_LIBUSB)
 #define USE_LIBUSB
 #define USBHID
+#if defined(HAVE_PTHREAD_H) && !defined(_WIN32)
+#define USE_EVENTTHREAD
+#endif
 #endif
 
 #if defined(USE_LIBUSB)
@@ -50,6 +59,10 @@
 #include <hidapi.h>
 #endif
 
+#if defined(USE_EVENTTHREAD) && defined(LIBUSB_HOTPLUG_MATCH_ANY)
+#define USE_HOTPLUG
+#endif
+
 #include <libdivecomputer/usbhid.h>
 
 #include "common-private.h"
@@ -57,7 +70,9 @@
 #include "iostream-private.h"
 #include "descriptor-private.h"
 #include "iterator-private.h"
+#include "hotplug-private.h"
 #include "platform.h"
+#include "timer.h"
 
 #ifdef _WIN32
 typedef LONG dc_mutex_t;
@@ -69,12 +84,36 @@ typedef pthread_mutex_t dc_mutex_t;
 
 #define ISINSTANCE(device) dc_iostream_isinstance((device), &dc_usbhid_vtable)
 
-typedef struct dc_usbhid_session_t {
+#if defined(USE_LIBUSB)
+// Number of interrupt IN transfers that are kept submitted.
+#define NTRANSFERS 8
+// Fallback report size, when the endpoint descriptor is not available.
+#define REPORTSIZE 64
+// Maximum time the event thread blocks, before checking for a stop request.
+#define EVENTTIMEOUT 100000
+// Number of devices in the descriptor cache.
+#define NCACHE 32
+// Maximum depth of a port path, as allowed by the USB 3.0 specification.
+#define MAXDEPTH 7
+#endif
+
+struct dc_usbhid_session_t {
 	size_t refcount;
 #if defined(USE_LIBUSB)
 	libusb_context *handle;
 #endif
-} dc_usbhid_session_t;
+#ifdef USE_EVENTTHREAD
+	// The libusb events of all devices in the session are handled by a
+	// single background thread, and the completion of the transfers is
+	// signalled through the condition variable. The lock protects the
+	// reference count and the state of the transfers.
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	pthread_t thread;
+	int started;
+	int stop;
+#endif
+};
 
 struct dc_usbhid_device_t {
 	unsigned short vid, pid;
@@ -91,12 +130,16 @@ struct dc_usbhid_device_t {
 
 #ifdef USBHID
 static dc_status_t dc_usbhid_iterator_next (dc_iterator_t *iterator, void *item);
+static dc_status_t dc_usbhid_iterator_next_batch (dc_iterator_t *iterator, void *items[], size_t n, size_t *count);
 static dc_status_t dc_usbhid_iterator_free (dc_iterator_t *iterator);
 
 static dc_status_t dc_usbhid_set_timeout (dc_iostream_t *iostream, int timeout);
 static dc_status_t dc_usbhid_read (dc_iostream_t *iostream, void *data, size_t size, size_t *actual);
 static dc_status_t dc_usbhid_write (dc_iostream_t *iostream, const void *data, size_t size, size_t *actual);
 static dc_status_t dc_usbhid_close (dc_iostream_t *iostream);
+#if defined(USE_LIBUSB)
+static dc_status_t dc_usbhid_interrupt (dc_iostream_t *iostream);
+#endif
 
 typedef struct dc_usbhid_iterator_t {
 	dc_iterator_t base;
@@ -109,6 +152,9 @@ typedef struct dc_usbhid_iterator_t {
 #elif defined(USE_HIDAPI)
 	struct hid_device_info *devices, *current;
 #endif
+	/* Storage for the items of a batch. */
+	dc_usbhid_device_t *arena;
+	size_t capacity;
 } dc_usbhid_iterator_t;
 
 typedef struct dc_usbhid_t {
@@ -122,6 +168,14 @@ typedef struct dc_usbhid_t {
 	unsigned char endpoint_in;
 	unsigned char endpoint_out;
 	unsigned int timeout;
+	dc_timer_t *timer;
+	/* Ring of interrupt IN transfers. */
+	dc_usbhid_report_t reports[NTRANSFERS];
+	unsigned int head;
+	/* Interrupt OUT transfer. */
+	dc_usbhid_report_t output;
+	/* Set from another thread, to abort all transfers. */
+	volatile int interrupted;
 #elif defined(USE_HIDAPI)
 	hid_device *handle;
 	int timeout;
@@ -132,6 +186,8 @@ static const dc_iterator_vtable_t dc_usbhid_iterator_vtable = {
 	sizeof(dc_usbhid_iterator_t),
 	dc_usbhid_iterator_next,
 	dc_usbhid_iterator_free,
+	dc_usbhid_iterator_next_batch,
+	NULL,
 };
 
 static const dc_iostream_vtable_t dc_usbhid_vtable = {
@@ -150,6 +206,18 @@ static const dc_iostream_vtable_t dc_usbhid_vtable = {
 	NULL, /* purge */
 	NULL, /* sleep */
 	dc_usbhid_close, /* close */
+	NULL, /* get_name */
+	NULL, /* read_async */
+	NULL, /* write_async */
+	NULL, /* cancel */
+	NULL, /* readv */
+	NULL, /* writev */
+#if defined(USE_LIBUSB)
+	dc_usbhid_interrupt, /* interrupt */
+#else
+	NULL, /* interrupt */
+#endif
+	NULL, /* wait_readable */
 };
 
 #ifdef USE_HIDAPI
@@ -157,6 +225,24 @@ static dc_mutex_t g_usbhid_mutex = DC_MUTEX_INIT;
 static dc_usbhid_session_t *g_usbhid_session = NULL;
 #endif
 
+#if defined(USE_LIBUSB)
+typedef struct dc_usbhid_cache_entry_t {
+	unsigned char bus;
+	unsigned char address;
+	unsigned char depth;
+	unsigned char ports[MAXDEPTH];
+	unsigned short vid, pid;
+	int interface;
+	unsigned char endpoint_in;
+	unsigned char endpoint_out;
+} dc_usbhid_cache_entry_t;
+
+static dc_mutex_t g_usbhid_cache_mutex = DC_MUTEX_INIT;
+static dc_usbhid_cache_entry_t g_usbhid_cache[NCACHE];
+static size_t g_usbhid_cache_count = 0;
+static size_t g_usbhid_cache_oldest = 0;
+#endif
+
 #if defined(USE_LIBUSB)
 static dc_status_t
 syserror(int errcode)
@@ -174,13 +260,280 @@ syserror(int errcode)
 		return DC_STATUS_NOACCESS;
 	case LIBUSB_ERROR_TIMEOUT:
 		return DC_STATUS_TIMEOUT;
+	case LIBUSB_ERROR_INTERRUPTED:
+		return DC_STATUS_CANCELLED;
 	default:
 		return DC_STATUS_IO;
 	}
 }
+
+static int
+dc_usbhid_transfer_error (enum libusb_transfer_status status)
+{
+	switch (status) {
+	case LIBUSB_TRANSFER_COMPLETED:
+		return LIBUSB_SUCCESS;
+	case LIBUSB_TRANSFER_TIMED_OUT:
+		return LIBUSB_ERROR_TIMEOUT;
+	case LIBUSB_TRANSFER_STALL:
+		return LIBUSB_ERROR_PIPE;
+	case LIBUSB_TRANSFER_NO_DEVICE:
+		return LIBUSB_ERROR_NO_DEVICE;
+	case LIBUSB_TRANSFER_OVERFLOW:
+		return LIBUSB_ERROR_OVERFLOW;
+	case LIBUSB_TRANSFER_CANCELLED:
+		return LIBUSB_ERROR_INTERRUPTED;
+	default:
+		return LIBUSB_ERROR_IO;
+	}
+}
+
+static void
+dc_usbhid_session_lock (dc_usbhid_session_t *session)
+{
+#ifdef USE_EVENTTHREAD
+	pthread_mutex_lock (&session->lock);
 #endif
+}
 
-#ifdef USE_HIDAPI
+static void
+dc_usbhid_session_unlock (dc_usbhid_session_t *session)
+{
+#ifdef USE_EVENTTHREAD
+	pthread_mutex_unlock (&session->lock);
+#endif
+}
+
+void LIBUSB_CALL
+dc_usbhid_transfer_callback (struct libusb_transfer *transfer)
+{
+	dc_usbhid_report_t *report = (dc_usbhid_report_t *) transfer->user_data;
+
+	dc_usbhid_session_lock (report->session);
+	report->submitted = 0;
+	report->completed = 1;
+#ifdef USE_EVENTTHREAD
+	pthread_cond_broadcast (&report->session->cond);
+#endif
+	dc_usbhid_session_unlock (report->session);
+}
+
+int
+dc_usbhid_transfer_submit (dc_usbhid_report_t *report)
+{
+	// Mark the transfer as submitted first, because the event thread
+	// may already complete it before libusb_submit_transfer returns.
+	dc_usbhid_session_lock (report->session);
+	report->submitted = 1;
+	report->completed = 0;
+	dc_usbhid_session_unlock (report->session);
+
+	int rc = libusb_submit_transfer (report->transfer);
+	if (rc != LIBUSB_SUCCESS) {
+		dc_usbhid_session_lock (report->session);
+		report->submitted = 0;
+		dc_usbhid_session_unlock (report->session);
+		return rc;
+	}
+
+	return LIBUSB_SUCCESS;
+}
+
+int
+dc_usbhid_transfer_wait (dc_usbhid_report_t *report, dc_timer_t *timer, unsigned int timeout)
+{
+	dc_usbhid_session_t *session = report->session;
+	int rc = LIBUSB_SUCCESS;
+
+#ifdef USE_EVENTTHREAD
+	if (session->started) {
+		struct timespec deadline;
+		if (timeout) {
+			clock_gettime (CLOCK_MONOTONIC, &deadline);
+			deadline.tv_sec += timeout / 1000;
+			deadline.tv_nsec += (long) (timeout % 1000) * 1000000;
+			if (deadline.tv_nsec >= 1000000000) {
+				deadline.tv_sec++;
+				deadline.tv_nsec -= 1000000000;
+			}
+		}
+
+		pthread_mutex_lock (&session->lock);
+		while (!report->completed) {
+			if (timeout) {
+				if (pthread_cond_timedwait (&session->cond, &session->lock, &deadline) == ETIMEDOUT)
+					break;
+			} else {
+				pthread_cond_wait (&session->cond, &session->lock);
+			}
+		}
+		int completed = report->completed;
+		pthread_mutex_unlock (&session->lock);
+
+		return completed ? LIBUSB_SUCCESS : LIBUSB_ERROR_TIMEOUT;
+	}
+#endif
+
+	// The absolute target time, on the monotonic clock.
+	dc_usecs_t target = 0;
+	if (timeout) {
+		if (dc_timer_now (timer, &target) != DC_STATUS_SUCCESS)
+			return LIBUSB_ERROR_IO;
+		target += (dc_usecs_t) timeout * 1000;
+	}
+
+	while (!report->completed) {
+		if (timeout) {
+			dc_usecs_t now = 0;
+			if (dc_timer_now (timer, &now) != DC_STATUS_SUCCESS)
+				return LIBUSB_ERROR_IO;
+
+			if (now >= target)
+				return LIBUSB_ERROR_TIMEOUT;
+
+			struct timeval tv;
+			tv.tv_sec  = (target - now) / 1000000;
+			tv.tv_usec = (target - now) % 1000000;
+			rc = libusb_handle_events_timeout_completed (session->handle, &tv, &report->completed);
+		} else {
+			rc = libusb_handle_events_completed (session->handle, &report->completed);
+		}
+
+		if (rc != LIBUSB_SUCCESS && rc != LIBUSB_ERROR_INTERRUPTED) {
+			return rc;
+		}
+	}
+
+	return LIBUSB_SUCCESS;
+}
+
+static void
+dc_usbhid_transfer_cancel (dc_usbhid_t *usbhid)
+{
+	dc_usbhid_report_t *reports[NTRANSFERS + 1];
+	for (unsigned int i = 0; i < NTRANSFERS; ++i) {
+		reports[i] = usbhid->reports + i;
+	}
+	reports[NTRANSFERS] = &usbhid->output;
+
+	// Cancel all pending transfers.
+	for (unsigned int i = 0; i < NTRANSFERS + 1; ++i) {
+		if (reports[i]->submitted) {
+			libusb_cancel_transfer (reports[i]->transfer);
+		}
+	}
+
+	// Wait until the cancellation has been processed, because the
+	// transfers can't be freed while they are still in flight.
+	for (unsigned int i = 0; i < NTRANSFERS + 1; ++i) {
+		if (reports[i]->submitted) {
+			dc_usbhid_transfer_wait (reports[i], usbhid->timer, 1000);
+		}
+	}
+}
+
+static void
+dc_usbhid_transfer_free (dc_usbhid_t *usbhid)
+{
+	for (unsigned int i = 0; i < NTRANSFERS; ++i) {
+		struct libusb_transfer *transfer = usbhid->reports[i].transfer;
+		if (transfer == NULL)
+			continue;
+
+		// Transfers that are still in flight are leaked on purpose,
+		// because freeing them would result in a use after free.
+		if (usbhid->reports[i].submitted)
+			continue;
+
+		free (transfer->buffer);
+		libusb_free_transfer (transfer);
+		usbhid->reports[i].transfer = NULL;
+	}
+
+	// The buffer of the output transfer is owned by the caller.
+	if (usbhid->output.transfer && !usbhid->output.submitted) {
+		libusb_free_transfer (usbhid->output.transfer);
+		usbhid->output.transfer = NULL;
+	}
+}
+
+static dc_status_t
+dc_usbhid_transfer_init (dc_usbhid_t *usbhid, dc_usbhid_device_t *device)
+{
+	dc_context_t *context = usbhid->base.context;
+
+	// Use the maximum packet size of the endpoint as the report size.
+	int length = libusb_get_max_packet_size (device->handle, device->endpoint_in);
+	if (length <= 0) {
+		WARNING (context, "Failed to get the maximum packet size (%s).",
+			libusb_error_name (length));
+		length = REPORTSIZE;
+	}
+
+	for (unsigned int i = 0; i < NTRANSFERS; ++i) {
+		usbhid->reports[i].session = usbhid->session;
+		usbhid->reports[i].transfer = NULL;
+		usbhid->reports[i].submitted = 0;
+		usbhid->reports[i].completed = 0;
+	}
+
+	usbhid->output.session = usbhid->session;
+	usbhid->output.submitted = 0;
+	usbhid->output.completed = 0;
+	usbhid->output.transfer = libusb_alloc_transfer (0);
+	if (usbhid->output.transfer == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		goto error;
+	}
+
+	for (unsigned int i = 0; i < NTRANSFERS; ++i) {
+		dc_usbhid_report_t *report = usbhid->reports + i;
+
+		report->transfer = libusb_alloc_transfer (0);
+		if (report->transfer == NULL) {
+			ERROR (context, "Failed to allocate memory.");
+			goto error;
+		}
+
+		unsigned char *buffer = (unsigned char *) malloc (length);
+		if (buffer == NULL) {
+			ERROR (context, "Failed to allocate memory.");
+			libusb_free_transfer (report->transfer);
+			report->transfer = NULL;
+			goto error;
+		}
+
+		libusb_fill_interrupt_transfer (report->transfer, usbhid->handle,
+			device->endpoint_in, buffer, length,
+			dc_usbhid_transfer_callback, report, 0);
+	}
+
+	// Submit all transfers. Because the host controller completes the
+	// transfers of an endpoint in submission order, and each completed
+	// transfer is resubmitted after it has been consumed, the ring
+	// always remains in order.
+	for (unsigned int i = 0; i < NTRANSFERS; ++i) {
+		int rc = dc_usbhid_transfer_submit (usbhid->reports + i);
+		if (rc != LIBUSB_SUCCESS) {
+			ERROR (context, "Failed to submit the usb transfer (%s).",
+				libusb_error_name (rc));
+			dc_usbhid_transfer_cancel (usbhid);
+			dc_usbhid_transfer_free (usbhid);
+			return syserror (rc);
+		}
+	}
+
+	usbhid->head = 0;
+
+	return DC_STATUS_SUCCESS;
+
+error:
+	dc_usbhid_transfer_free (usbhid);
+	return DC_STATUS_NOMEMORY;
+}
+#endif
+
+#ifdef USBHID
 static void
 dc_mutex_lock (dc_mutex_t *mutex)
 {
@@ -204,7 +557,7 @@ dc_mutex_unlock (dc_mutex_t *mutex)
 }
 #endif
 
-static dc_status_t
+dc_status_t
 dc_usbhid_session_new (dc_usbhid_session_t **out, dc_context_t *context)
 {
 	dc_status_t status = DC_STATUS_SUCCESS;
@@ -241,6 +594,17 @@ dc_usbhid_session_new (dc_usbhid_session_t **out, dc_context_t *context)
 		status = syserror (rc);
 		goto error_free;
 	}
+
+#ifdef USE_EVENTTHREAD
+	pthread_condattr_t attr;
+	pthread_condattr_init (&attr);
+	pthread_condattr_setclock (&attr, CLOCK_MONOTONIC);
+	pthread_cond_init (&session->cond, &attr);
+	pthread_condattr_destroy (&attr);
+	pthread_mutex_init (&session->lock, NULL);
+	session->started = 0;
+	session->stop = 0;
+#endif
 #elif defined(USE_HIDAPI)
 	int rc = hid_init();
 	if (rc < 0) {
@@ -275,18 +639,60 @@ dc_usbhid_session_ref (dc_usbhid_session_t *session)
 
 #ifdef USE_HIDAPI
 	dc_mutex_lock (&g_usbhid_mutex);
+#else
+	dc_usbhid_session_lock (session);
 #endif
 
 	session->refcount++;
 
 #ifdef USE_HIDAPI
 	dc_mutex_unlock (&g_usbhid_mutex);
+#else
+	dc_usbhid_session_unlock (session);
 #endif
 
 	return session;
 }
 
-static dc_status_t
+#ifdef USE_EVENTTHREAD
+static void *
+dc_usbhid_session_run (void *userdata)
+{
+	dc_usbhid_session_t *session = (dc_usbhid_session_t *) userdata;
+
+	for (;;) {
+		pthread_mutex_lock (&session->lock);
+		int stop = session->stop;
+		pthread_mutex_unlock (&session->lock);
+
+		if (stop)
+			break;
+
+		struct timeval tv = {0, EVENTTIMEOUT};
+		libusb_handle_events_timeout_completed (session->handle, &tv, NULL);
+	}
+
+	return NULL;
+}
+#endif
+
+void
+dc_usbhid_session_start (dc_usbhid_session_t *session, dc_context_t *context)
+{
+#ifdef USE_EVENTTHREAD
+	pthread_mutex_lock (&session->lock);
+	if (!session->started) {
+		if (pthread_create (&session->thread, NULL, dc_usbhid_session_run, session) == 0) {
+			session->started = 1;
+		} else {
+			WARNING (context, "Failed to start the usb event thread.");
+		}
+	}
+	pthread_mutex_unlock (&session->lock);
+#endif
+}
+
+dc_status_t
 dc_usbhid_session_unref (dc_usbhid_session_t *session)
 {
 	if (session == NULL)
@@ -294,24 +700,52 @@ dc_usbhid_session_unref (dc_usbhid_session_t *session)
 
 #ifdef USE_HIDAPI
 	dc_mutex_lock (&g_usbhid_mutex);
+#else
+	dc_usbhid_session_lock (session);
 #endif
 
-	if (--session->refcount == 0) {
+	size_t refcount = --session->refcount;
+
 #if defined(USE_LIBUSB)
+	dc_usbhid_session_unlock (session);
+
+	if (refcount == 0) {
+#ifdef USE_EVENTTHREAD
+		if (session->started) {
+			pthread_mutex_lock (&session->lock);
+			session->stop = 1;
+			pthread_mutex_unlock (&session->lock);
+#if defined(LIBUSB_API_VERSION) && (LIBUSB_API_VERSION >= 0x01000105)
+			libusb_interrupt_event_handler (session->handle);
+#endif
+			pthread_join (session->thread, NULL);
+		}
+		pthread_cond_destroy (&session->cond);
+		pthread_mutex_destroy (&session->lock);
+#endif
 		libusb_exit (session->handle);
+		free (session);
+	}
 #elif defined(USE_HIDAPI)
+	if (refcount == 0) {
 		hid_exit ();
 		g_usbhid_session = NULL;
-#endif
 		free (session);
 	}
 
-#ifdef USE_HIDAPI
 	dc_mutex_unlock (&g_usbhid_mutex);
 #endif
 
 	return DC_STATUS_SUCCESS;
 }
+
+#if defined(USE_LIBUSB)
+libusb_context *
+dc_usbhid_session_get_handle (dc_usbhid_session_t *session)
+{
+	return session->handle;
+}
+#endif
 #endif
 
 unsigned int
@@ -396,6 +830,8 @@ dc_usbhid_iterator_new (dc_iterator_t **out, dc_context_t *context, dc_descripto
 	iterator->current = devices;
 #endif
 	iterator->filter = dc_descriptor_get_filter (descriptor);
+	iterator->arena = NULL;
+	iterator->capacity = 0;
 
 	*out = (dc_iterator_t *) iterator;
 
@@ -411,101 +847,294 @@ error_free:
 #endif
 }
 
-#ifdef USBHID
-static dc_status_t
-dc_usbhid_iterator_next (dc_iterator_t *abstract, void *out)
+#if defined(USE_LIBUSB)
+/*
+ * The interface and endpoints of the recently probed devices are cached,
+ * to avoid fetching the configuration descriptor again on every
+ * enumeration. A device is identified by its bus, port path and address.
+ * Because the address changes when a device is plugged in again, a stale
+ * entry is unlikely, but the hotplug monitor removes the entries anyway.
+ */
+static int
+dc_usbhid_cache_key (struct libusb_device *handle, dc_usbhid_cache_entry_t *entry)
 {
-	dc_usbhid_iterator_t *iterator = (dc_usbhid_iterator_t *) abstract;
-	dc_usbhid_device_t *device = NULL;
+	int depth = libusb_get_port_numbers (handle, entry->ports, sizeof (entry->ports));
+	if (depth < 0)
+		return -1;
 
-#if defined(USE_LIBUSB)
-	while (iterator->current < iterator->count) {
-		struct libusb_device *current = iterator->devices[iterator->current++];
+	entry->bus = libusb_get_bus_number (handle);
+	entry->address = libusb_get_device_address (handle);
+	entry->depth = depth;
 
-		// Get the device descriptor.
-		struct libusb_device_descriptor dev;
-		int rc = libusb_get_device_descriptor (current, &dev);
-		if (rc < 0) {
-			ERROR (abstract->context, "Failed to get the device descriptor (%s).",
-				libusb_error_name (rc));
-			return syserror (rc);
+	return 0;
+}
+
+static int
+dc_usbhid_cache_match (const dc_usbhid_cache_entry_t *a, const dc_usbhid_cache_entry_t *b)
+{
+	return a->bus == b->bus &&
+		a->address == b->address &&
+		a->depth == b->depth &&
+		memcmp (a->ports, b->ports, a->depth) == 0;
+}
+
+static int
+dc_usbhid_cache_lookup (dc_usbhid_cache_entry_t *entry)
+{
+	int found = 0;
+
+	dc_mutex_lock (&g_usbhid_cache_mutex);
+	for (size_t i = 0; i < g_usbhid_cache_count; ++i) {
+		const dc_usbhid_cache_entry_t *current = &g_usbhid_cache[i];
+		if (dc_usbhid_cache_match (current, entry) &&
+			current->vid == entry->vid && current->pid == entry->pid) {
+			*entry = *current;
+			found = 1;
+			break;
 		}
+	}
+	dc_mutex_unlock (&g_usbhid_cache_mutex);
 
-		dc_usb_desc_t usb = {dev.idVendor, dev.idProduct};
-		if (iterator->filter && !iterator->filter (DC_TRANSPORT_USBHID, &usb)) {
-			continue;
+	return found;
+}
+
+static void
+dc_usbhid_cache_insert (const dc_usbhid_cache_entry_t *entry)
+{
+	dc_mutex_lock (&g_usbhid_cache_mutex);
+
+	size_t i = 0;
+	while (i < g_usbhid_cache_count && !dc_usbhid_cache_match (&g_usbhid_cache[i], entry))
+		i++;
+
+	if (i == g_usbhid_cache_count) {
+		if (g_usbhid_cache_count < NCACHE) {
+			g_usbhid_cache_count++;
+		} else {
+			// Replace the oldest entry.
+			i = g_usbhid_cache_oldest;
+			g_usbhid_cache_oldest = (g_usbhid_cache_oldest + 1) % NCACHE;
 		}
+	}
 
-		// Get the active configuration descriptor.
-		struct libusb_config_descriptor *config = NULL;
-		rc = libusb_get_active_config_descriptor (current, &config);
-		if (rc != LIBUSB_SUCCESS) {
-			ERROR (abstract->context, "Failed to get the configuration descriptor (%s).",
-				libusb_error_name (rc));
-			return syserror (rc);
+	g_usbhid_cache[i] = *entry;
+
+	dc_mutex_unlock (&g_usbhid_cache_mutex);
+}
+
+#ifdef USE_HOTPLUG
+static void
+dc_usbhid_cache_remove (struct libusb_device *handle)
+{
+	dc_usbhid_cache_entry_t key;
+	if (dc_usbhid_cache_key (handle, &key) != 0)
+		return;
+
+	dc_mutex_lock (&g_usbhid_cache_mutex);
+	for (size_t i = 0; i < g_usbhid_cache_count; ++i) {
+		if (dc_usbhid_cache_match (&g_usbhid_cache[i], &key)) {
+			g_usbhid_cache[i] = g_usbhid_cache[--g_usbhid_cache_count];
+			break;
 		}
+	}
+	dc_mutex_unlock (&g_usbhid_cache_mutex);
+}
+#endif
+
+/*
+ * Find the first HID interface, with an input and output interrupt
+ * endpoint. If there is none, the interface is set to -1.
+ */
+static dc_status_t
+dc_usbhid_device_probe (dc_context_t *context, struct libusb_device *handle, dc_usbhid_cache_entry_t *entry)
+{
+	// Get the active configuration descriptor.
+	struct libusb_config_descriptor *config = NULL;
+	int rc = libusb_get_active_config_descriptor (handle, &config);
+	if (rc != LIBUSB_SUCCESS) {
+		ERROR (context, "Failed to get the configuration descriptor (%s).",
+			libusb_error_name (rc));
+		return syserror (rc);
+	}
+
+	entry->interface = -1;
 
-		// Find the first HID interface.
-		const struct libusb_interface_descriptor *interface = NULL;
-		for (unsigned int i = 0; i < config->bNumInterfaces; i++) {
-			const struct libusb_interface *iface = &config->interface[i];
-			for (int j = 0; j < iface->num_altsetting; j++) {
-				const struct libusb_interface_descriptor *desc = &iface->altsetting[j];
-				if (desc->bInterfaceClass == LIBUSB_CLASS_HID && interface == NULL) {
-					interface = desc;
-				}
+	// Find the first HID interface.
+	const struct libusb_interface_descriptor *interface = NULL;
+	for (unsigned int i = 0; i < config->bNumInterfaces; i++) {
+		const struct libusb_interface *iface = &config->interface[i];
+		for (int j = 0; j < iface->num_altsetting; j++) {
+			const struct libusb_interface_descriptor *desc = &iface->altsetting[j];
+			if (desc->bInterfaceClass == LIBUSB_CLASS_HID && interface == NULL) {
+				interface = desc;
 			}
 		}
+	}
+
+	if (interface == NULL) {
+		libusb_free_config_descriptor (config);
+		return DC_STATUS_SUCCESS;
+	}
+
+	// Find the first input and output interrupt endpoints.
+	const struct libusb_endpoint_descriptor *ep_in = NULL, *ep_out = NULL;
+	for (unsigned int i = 0; i < interface->bNumEndpoints; i++) {
+		const struct libusb_endpoint_descriptor *desc = &interface->endpoint[i];
 
-		if (interface == NULL) {
-			libusb_free_config_descriptor (config);
+		unsigned int type = desc->bmAttributes & LIBUSB_TRANSFER_TYPE_MASK;
+		unsigned int direction = desc->bEndpointAddress & LIBUSB_ENDPOINT_DIR_MASK;
+
+		if (type != LIBUSB_TRANSFER_TYPE_INTERRUPT) {
 			continue;
 		}
 
-		// Find the first input and output interrupt endpoints.
-		const struct libusb_endpoint_descriptor *ep_in = NULL, *ep_out = NULL;
-		for (unsigned int i = 0; i < interface->bNumEndpoints; i++) {
-			const struct libusb_endpoint_descriptor *desc = &interface->endpoint[i];
+		if (direction == LIBUSB_ENDPOINT_IN && ep_in == NULL) {
+			ep_in = desc;
+		}
 
-			unsigned int type = desc->bmAttributes & LIBUSB_TRANSFER_TYPE_MASK;
-			unsigned int direction = desc->bEndpointAddress & LIBUSB_ENDPOINT_DIR_MASK;
+		if (direction == LIBUSB_ENDPOINT_OUT && ep_out == NULL) {
+			ep_out = desc;
+		}
+	}
 
-			if (type != LIBUSB_TRANSFER_TYPE_INTERRUPT) {
-				continue;
-			}
+	if (ep_in == NULL || ep_out == NULL) {
+		libusb_free_config_descriptor (config);
+		return DC_STATUS_SUCCESS;
+	}
 
-			if (direction == LIBUSB_ENDPOINT_IN && ep_in == NULL) {
-				ep_in = desc;
-			}
+	entry->interface = interface->bInterfaceNumber;
+	entry->endpoint_in = ep_in->bEndpointAddress;
+	entry->endpoint_out = ep_out->bEndpointAddress;
 
-			if (direction == LIBUSB_ENDPOINT_OUT && ep_out == NULL) {
-				ep_out = desc;
-			}
-		}
+	libusb_free_config_descriptor (config);
 
-		if (ep_in == NULL || ep_out == NULL) {
-			libusb_free_config_descriptor (config);
-			continue;
-		}
+	return DC_STATUS_SUCCESS;
+}
 
-		device = (dc_usbhid_device_t *) malloc (sizeof(dc_usbhid_device_t));
-		if (device == NULL) {
-			ERROR (abstract->context, "Failed to allocate memory.");
-			libusb_free_config_descriptor (config);
-			return DC_STATUS_NOMEMORY;
+/*
+ * Fill a device object for a usb device, if it is accepted by the filter
+ * and has a suitable HID interface. Otherwise DC_STATUS_DONE is returned.
+ *
+ * No references are taken. The device object is only valid as long as
+ * the session and the libusb device are kept alive by the caller.
+ */
+static dc_status_t
+dc_usbhid_device_init (dc_usbhid_device_t *device, dc_context_t *context, dc_usbhid_session_t *session, struct libusb_device *handle, dc_filter_t filter)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	// Get the device descriptor.
+	struct libusb_device_descriptor dev;
+	int rc = libusb_get_device_descriptor (handle, &dev);
+	if (rc < 0) {
+		ERROR (context, "Failed to get the device descriptor (%s).",
+			libusb_error_name (rc));
+		return syserror (rc);
+	}
+
+	dc_usb_desc_t usb = {dev.idVendor, dev.idProduct};
+	if (filter && !filter (DC_TRANSPORT_USBHID, &usb)) {
+		return DC_STATUS_DONE;
+	}
+
+	dc_usbhid_cache_entry_t entry;
+	int cacheable = dc_usbhid_cache_key (handle, &entry) == 0;
+	entry.vid = dev.idVendor;
+	entry.pid = dev.idProduct;
+
+	if (!cacheable || !dc_usbhid_cache_lookup (&entry)) {
+		status = dc_usbhid_device_probe (context, handle, &entry);
+		if (status != DC_STATUS_SUCCESS)
+			return status;
+
+		if (cacheable) {
+			dc_usbhid_cache_insert (&entry);
 		}
+	}
 
-		device->session = dc_usbhid_session_ref (iterator->session);
-		device->vid = dev.idVendor;
-		device->pid = dev.idProduct;
-		device->handle = libusb_ref_device (current);
-		device->interface = interface->bInterfaceNumber;
-		device->endpoint_in = ep_in->bEndpointAddress;
-		device->endpoint_out = ep_out->bEndpointAddress;
+	if (entry.interface < 0) {
+		return DC_STATUS_DONE;
+	}
 
-		*(dc_usbhid_device_t **) out = device;
+	device->session = session;
+	device->vid = dev.idVendor;
+	device->pid = dev.idProduct;
+	device->handle = handle;
+	device->interface = entry.interface;
+	device->endpoint_in = entry.endpoint_in;
+	device->endpoint_out = entry.endpoint_out;
 
-		libusb_free_config_descriptor (config);
+	return DC_STATUS_SUCCESS;
+}
+#elif defined(USE_HIDAPI)
+static dc_status_t
+dc_usbhid_device_init (dc_usbhid_device_t *device, dc_context_t *context, dc_usbhid_session_t *session, struct hid_device_info *info, dc_filter_t filter)
+{
+	dc_usb_desc_t usb = {info->vendor_id, info->product_id};
+	if (filter && !filter (DC_TRANSPORT_USBHID, &usb)) {
+		return DC_STATUS_DONE;
+	}
+
+	device->session = session;
+	device->vid = info->vendor_id;
+	device->pid = info->product_id;
+	device->path = info->path;
+
+	return DC_STATUS_SUCCESS;
+}
+#endif
+
+#ifdef USBHID
+/*
+ * Create a device object, which is owned by the caller. Unlike
+ * dc_usbhid_device_init(), the references are taken.
+ */
+static dc_status_t
+dc_usbhid_device_new (dc_usbhid_device_t **out, dc_context_t *context, dc_usbhid_session_t *session, void *handle, dc_filter_t filter)
+{
+	dc_usbhid_device_t tmp;
+	dc_status_t status = dc_usbhid_device_init (&tmp, context, session, handle, filter);
+	if (status != DC_STATUS_SUCCESS)
+		return status;
+
+	dc_usbhid_device_t *device = (dc_usbhid_device_t *) malloc (sizeof(dc_usbhid_device_t));
+	if (device == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	*device = tmp;
+	device->session = dc_usbhid_session_ref (session);
+#if defined(USE_LIBUSB)
+	device->handle = libusb_ref_device (tmp.handle);
+#elif defined(USE_HIDAPI)
+	device->path = strdup (tmp.path);
+#endif
+
+	*out = device;
+
+	return DC_STATUS_SUCCESS;
+}
+#endif
+
+#ifdef USBHID
+static dc_status_t
+dc_usbhid_iterator_next (dc_iterator_t *abstract, void *out)
+{
+	dc_usbhid_iterator_t *iterator = (dc_usbhid_iterator_t *) abstract;
+	dc_usbhid_device_t *device = NULL;
+
+#if defined(USE_LIBUSB)
+	while (iterator->current < iterator->count) {
+		struct libusb_device *current = iterator->devices[iterator->current++];
+
+		dc_status_t status = dc_usbhid_device_new (&device, abstract->context, iterator->session, current, iterator->filter);
+		if (status == DC_STATUS_DONE)
+			continue;
+		if (status != DC_STATUS_SUCCESS)
+			return status;
+
+		*(dc_usbhid_device_t **) out = device;
 
 		return DC_STATUS_SUCCESS;
 	}
@@ -514,29 +1143,69 @@ dc_usbhid_iterator_next (dc_iterator_t *abstract, void *out)
 		struct hid_device_info *current = iterator->current;
 		iterator->current = current->next;
 
-		dc_usb_desc_t usb = {current->vendor_id, current->product_id};
-		if (iterator->filter && !iterator->filter (DC_TRANSPORT_USBHID, &usb)) {
+		dc_status_t status = dc_usbhid_device_new (&device, abstract->context, iterator->session, current, iterator->filter);
+		if (status == DC_STATUS_DONE)
 			continue;
-		}
+		if (status != DC_STATUS_SUCCESS)
+			return status;
 
-		device = (dc_usbhid_device_t *) malloc (sizeof(dc_usbhid_device_t));
-		if (device == NULL) {
+		*(dc_usbhid_device_t **) out = device;
+
+		return DC_STATUS_SUCCESS;
+	}
+#endif
+
+	return DC_STATUS_DONE;
+}
+
+/*
+ * The items of a batch are stored in an arena owned by the iterator.
+ * They borrow the session and the enumerated devices from the iterator,
+ * which keeps them alive, so no references need to be taken or dropped.
+ */
+static dc_status_t
+dc_usbhid_iterator_next_batch (dc_iterator_t *abstract, void *items[], size_t n, size_t *count)
+{
+	dc_usbhid_iterator_t *iterator = (dc_usbhid_iterator_t *) abstract;
+	dc_status_t status = DC_STATUS_DONE;
+	size_t nitems = 0;
+
+	if (n > iterator->capacity) {
+		dc_usbhid_device_t *arena = (dc_usbhid_device_t *) realloc (iterator->arena, n * sizeof (dc_usbhid_device_t));
+		if (arena == NULL) {
 			ERROR (abstract->context, "Failed to allocate memory.");
 			return DC_STATUS_NOMEMORY;
 		}
 
-		device->session = dc_usbhid_session_ref (iterator->session);
-		device->vid = current->vendor_id;
-		device->pid = current->product_id;
-		device->path = strdup (current->path);
+		iterator->arena = arena;
+		iterator->capacity = n;
+	}
 
-		*(dc_usbhid_device_t **) out = device;
+#if defined(USE_LIBUSB)
+	while (nitems < n && iterator->current < iterator->count) {
+		struct libusb_device *current = iterator->devices[iterator->current++];
+#elif defined(USE_HIDAPI)
+	while (nitems < n && iterator->current) {
+		struct hid_device_info *current = iterator->current;
+		iterator->current = current->next;
+#endif
+		dc_usbhid_device_t *device = &iterator->arena[nitems];
 
-		return DC_STATUS_SUCCESS;
+		status = dc_usbhid_device_init (device, abstract->context, iterator->session, current, iterator->filter);
+		if (status == DC_STATUS_DONE)
+			continue;
+		if (status != DC_STATUS_SUCCESS)
+			break;
+
+		items[nitems++] = device;
 	}
-#endif
 
-	return DC_STATUS_DONE;
+	*count = nitems;
+
+	if (nitems)
+		return DC_STATUS_SUCCESS;
+
+	return status;
 }
 
 static dc_status_t
@@ -550,11 +1219,204 @@ dc_usbhid_iterator_free (dc_iterator_t *abstract)
 	hid_free_enumeration (iterator->devices);
 #endif
 	dc_usbhid_session_unref (iterator->session);
+	free (iterator->arena);
 
 	return DC_STATUS_SUCCESS;
 }
 #endif
 
+#ifdef USE_HOTPLUG
+typedef struct dc_usbhid_hotplug_entry_t {
+	struct libusb_device *handle;
+	unsigned int id;
+} dc_usbhid_hotplug_entry_t;
+
+struct dc_usbhid_hotplug_t {
+	dc_hotplug_t *hotplug;
+	dc_context_t *context;
+	dc_usbhid_session_t *session;
+	dc_filter_t filter;
+	libusb_hotplug_callback_handle handle;
+	// The devices reported to the application. The lock protects them
+	// against the initial enumeration, which runs on the calling thread.
+	pthread_mutex_t lock;
+	dc_usbhid_hotplug_entry_t *entries;
+	size_t count;
+	size_t capacity;
+};
+
+static void
+dc_usbhid_hotplug_arrived (dc_usbhid_hotplug_t *backend, struct libusb_device *handle)
+{
+	// A new device may reuse the position and address of an old one.
+	dc_usbhid_cache_remove (handle);
+
+	if (backend->count >= backend->capacity) {
+		size_t capacity = backend->capacity ? backend->capacity * 2 : 4;
+		dc_usbhid_hotplug_entry_t *entries = (dc_usbhid_hotplug_entry_t *) realloc (
+			backend->entries, capacity * sizeof (dc_usbhid_hotplug_entry_t));
+		if (entries == NULL) {
+			ERROR (backend->context, "Failed to allocate memory.");
+			return;
+		}
+		backend->entries = entries;
+		backend->capacity = capacity;
+	}
+
+	dc_usbhid_device_t *device = NULL;
+	dc_status_t status = dc_usbhid_device_new (&device, backend->context, backend->session, handle, backend->filter);
+	if (status != DC_STATUS_SUCCESS) {
+		if (status != DC_STATUS_DONE) {
+			WARNING (backend->context, "Failed to report the new usb device.");
+		}
+		return;
+	}
+
+	// The reference keeps the libusb device, and thus its address, unique
+	// until the removal.
+	dc_usbhid_hotplug_entry_t *entry = backend->entries + backend->count++;
+	entry->handle = libusb_ref_device (handle);
+	entry->id = dc_hotplug_arrived (backend->hotplug, DC_TRANSPORT_USBHID, device);
+}
+
+static void
+dc_usbhid_hotplug_left (dc_usbhid_hotplug_t *backend, struct libusb_device *handle)
+{
+	dc_usbhid_cache_remove (handle);
+
+	for (size_t i = 0; i < backend->count; ++i) {
+		if (backend->entries[i].handle != handle)
+			continue;
+
+		unsigned int id = backend->entries[i].id;
+		libusb_unref_device (backend->entries[i].handle);
+		backend->entries[i] = backend->entries[--backend->count];
+
+		dc_hotplug_left (backend->hotplug, DC_TRANSPORT_USBHID, id);
+		break;
+	}
+}
+
+static int LIBUSB_CALL
+dc_usbhid_hotplug_callback (libusb_context *context, struct libusb_device *handle, libusb_hotplug_event event, void *userdata)
+{
+	dc_usbhid_hotplug_t *backend = (dc_usbhid_hotplug_t *) userdata;
+
+	UNUSED (context);
+
+	pthread_mutex_lock (&backend->lock);
+	if (event == LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED) {
+		dc_usbhid_hotplug_arrived (backend, handle);
+	} else if (event == LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT) {
+		dc_usbhid_hotplug_left (backend, handle);
+	}
+	pthread_mutex_unlock (&backend->lock);
+
+	// Keep the callback registered.
+	return 0;
+}
+#endif
+
+dc_status_t
+dc_usbhid_hotplug_new (dc_usbhid_hotplug_t **out, dc_hotplug_t *hotplug, dc_context_t *context, dc_descriptor_t *descriptor)
+{
+#ifdef USE_HOTPLUG
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_usbhid_hotplug_t *backend = NULL;
+
+	if (out == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	if (!libusb_has_capability (LIBUSB_CAP_HAS_HOTPLUG)) {
+		return DC_STATUS_UNSUPPORTED;
+	}
+
+	backend = (dc_usbhid_hotplug_t *) malloc (sizeof(dc_usbhid_hotplug_t));
+	if (backend == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	backend->hotplug = hotplug;
+	backend->context = context;
+	backend->filter = dc_descriptor_get_filter (descriptor);
+	backend->entries = NULL;
+	backend->count = 0;
+	backend->capacity = 0;
+	pthread_mutex_init (&backend->lock, NULL);
+
+	status = dc_usbhid_session_new (&backend->session, context);
+	if (status != DC_STATUS_SUCCESS) {
+		goto error_free;
+	}
+
+	// The hotplug events are delivered by the event thread, so
+	// without that thread there is nothing to report.
+	dc_usbhid_session_start (backend->session, context);
+	if (!backend->session->started) {
+		status = DC_STATUS_IO;
+		goto error_session_unref;
+	}
+
+	int rc = libusb_hotplug_register_callback (backend->session->handle,
+		LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED | LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT,
+		LIBUSB_HOTPLUG_ENUMERATE,
+		LIBUSB_HOTPLUG_MATCH_ANY, LIBUSB_HOTPLUG_MATCH_ANY, LIBUSB_HOTPLUG_MATCH_ANY,
+		dc_usbhid_hotplug_callback, backend, &backend->handle);
+	if (rc != LIBUSB_SUCCESS) {
+		ERROR (context, "Failed to register the hotplug callback (%s).",
+			libusb_error_name (rc));
+		status = syserror (rc);
+		goto error_session_unref;
+	}
+
+	*out = backend;
+
+	return DC_STATUS_SUCCESS;
+
+error_session_unref:
+	for (size_t i = 0; i < backend->count; ++i) {
+		libusb_unref_device (backend->entries[i].handle);
+	}
+	dc_usbhid_session_unref (backend->session);
+error_free:
+	pthread_mutex_destroy (&backend->lock);
+	free (backend->entries);
+	free (backend);
+	return status;
+#else
+	UNUSED (out);
+	UNUSED (hotplug);
+	UNUSED (context);
+	UNUSED (descriptor);
+	return DC_STATUS_UNSUPPORTED;
+#endif
+}
+
+void
+dc_usbhid_hotplug_free (dc_usbhid_hotplug_t *backend)
+{
+#ifdef USE_HOTPLUG
+	if (backend == NULL)
+		return;
+
+	// Once deregistered, libusb no longer calls the callback.
+	libusb_hotplug_deregister_callback (backend->session->handle, backend->handle);
+
+	for (size_t i = 0; i < backend->count; ++i) {
+		libusb_unref_device (backend->entries[i].handle);
+	}
+
+	dc_usbhid_session_unref (backend->session);
+
+	pthread_mutex_destroy (&backend->lock);
+	free (backend->entries);
+	free (backend);
+#else
+	UNUSED (backend);
+#endif
+}
+
 dc_status_t
 dc_usbhid_open (dc_iostream_t **out, dc_context_t *context, dc_usbhid_device_t *device)
 {
@@ -610,6 +1472,24 @@ dc_usbhid_open (dc_iostream_t **out, dc_context_t *context, dc_usbhid_device_t *
 	usbhid->endpoint_in = device->endpoint_in;
 	usbhid->endpoint_out = device->endpoint_out;
 	usbhid->timeout = 0;
+	usbhid->interrupted = 0;
+
+	// Create a high resolution timer.
+	status = dc_timer_new (&usbhid->timer);
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR (context, "Failed to create a high resolution timer.");
+		goto error_usb_release;
+	}
+
+	// Handle the events of all devices in the background.
+	dc_usbhid_session_start (usbhid->session, context);
+
+	// Keep the interrupt IN transfers permanently submitted, such that
+	// the incoming reports are received as soon as they are available.
+	status = dc_usbhid_transfer_init (usbhid, device);
+	if (status != DC_STATUS_SUCCESS) {
+		goto error_timer_free;
+	}
 
 #elif defined(USE_HIDAPI)
 	INFO (context, "Open: path=%s", device->path);
@@ -630,6 +1510,10 @@ dc_usbhid_open (dc_iostream_t **out, dc_context_t *context, dc_usbhid_device_t *
 	return DC_STATUS_SUCCESS;
 
 #if defined(USE_LIBUSB)
+error_timer_free:
+	dc_timer_free (usbhid->timer);
+error_usb_release:
+	libusb_release_interface (usbhid->handle, usbhid->interface);
 error_usb_close:
 	libusb_close (usbhid->handle);
 #endif
@@ -651,6 +1535,9 @@ dc_usbhid_close (dc_iostream_t *abstract)
 	dc_usbhid_t *usbhid = (dc_usbhid_t *) abstract;
 
 #if defined(USE_LIBUSB)
+	dc_usbhid_transfer_cancel (usbhid);
+	dc_usbhid_transfer_free (usbhid);
+	dc_timer_free (usbhid->timer);
 	libusb_release_interface (usbhid->handle, usbhid->interface);
 	libusb_close (usbhid->handle);
 #elif defined(USE_HIDAPI)
@@ -685,6 +1572,26 @@ dc_usbhid_set_timeout (dc_iostream_t *abstract, int timeout)
 	return DC_STATUS_SUCCESS;
 }
 
+#if defined(USE_LIBUSB)
+static dc_status_t
+dc_usbhid_interrupt (dc_iostream_t *abstract)
+{
+	dc_usbhid_t *usbhid = (dc_usbhid_t *) abstract;
+
+	// Cancelling the transfers wakes up the blocked read or write. The
+	// flag prevents that new transfers are submitted. Transfers which
+	// are not in flight are simply ignored by libusb.
+	usbhid->interrupted = 1;
+
+	for (unsigned int i = 0; i < NTRANSFERS; ++i) {
+		libusb_cancel_transfer (usbhid->reports[i].transfer);
+	}
+	libusb_cancel_transfer (usbhid->output.transfer);
+
+	return DC_STATUS_SUCCESS;
+}
+#endif
+
 static dc_status_t
 dc_usbhid_read (dc_iostream_t *abstract, void *data, size_t size, size_t *actual)
 {
@@ -693,7 +1600,62 @@ dc_usbhid_read (dc_iostream_t *abstract, void *data, size_t size, size_t *actual
 	int nbytes = 0;
 
 #if defined(USE_LIBUSB)
-	int rc = libusb_interrupt_transfer (usbhid->handle, usbhid->endpoint_in, data, size, &nbytes, usbhid->timeout);
+	dc_usbhid_report_t *report = usbhid->reports + usbhid->head;
+	int rc = LIBUSB_SUCCESS;
+
+	if (usbhid->interrupted) {
+		status = DC_STATUS_CANCELLED;
+		goto out;
+	}
+
+	// Resubmit the transfer, if that failed after the previous read.
+	if (!report->submitted && !report->completed) {
+		rc = dc_usbhid_transfer_submit (report);
+		if (rc != LIBUSB_SUCCESS) {
+			ERROR (abstract->context, "Usb read interrupt transfer failed (%s).",
+				libusb_error_name (rc));
+			status = syserror (rc);
+			goto out;
+		}
+
+		// The interrupt may have missed the new transfer.
+		if (usbhid->interrupted) {
+			libusb_cancel_transfer (report->transfer);
+		}
+	}
+
+	// Wait for the oldest transfer to complete.
+	rc = dc_usbhid_transfer_wait (report, usbhid->timer, usbhid->timeout);
+	if (rc != LIBUSB_SUCCESS) {
+		ERROR (abstract->context, "Usb read interrupt transfer failed (%s).",
+			libusb_error_name (rc));
+		status = syserror (rc);
+		goto out;
+	}
+
+	// Consume the report.
+	struct libusb_transfer *transfer = report->transfer;
+	rc = dc_usbhid_transfer_error (transfer->status);
+	if (rc == LIBUSB_SUCCESS) {
+		nbytes = transfer->actual_length;
+		if ((size_t) nbytes > size) {
+			WARNING (abstract->context, "Report truncated (%i > " DC_PRINTF_SIZE ").", nbytes, size);
+			nbytes = size;
+		}
+		memcpy (data, transfer->buffer, nbytes);
+	}
+
+	// Resubmit the transfer, and advance to the next one.
+	report->completed = 0;
+	usbhid->head = (usbhid->head + 1) % NTRANSFERS;
+	if (!usbhid->interrupted) {
+		int rc2 = dc_usbhid_transfer_submit (report);
+		if (rc2 != LIBUSB_SUCCESS) {
+			WARNING (abstract->context, "Failed to resubmit the usb transfer (%s).",
+				libusb_error_name (rc2));
+		}
+	}
+
 	if (rc != LIBUSB_SUCCESS) {
 		ERROR (abstract->context, "Usb read interrupt transfer failed (%s).",
 			libusb_error_name (rc));
@@ -739,7 +1701,29 @@ dc_usbhid_write (dc_iostream_t *abstract, const void *data, size_t size, size_t
 		length--;
 	}
 
-	int rc = libusb_interrupt_transfer (usbhid->handle, usbhid->endpoint_out, (void *) buffer, length, &nbytes, 0);
+	if (usbhid->interrupted) {
+		status = DC_STATUS_CANCELLED;
+		goto out;
+	}
+
+	dc_usbhid_report_t *output = &usbhid->output;
+	libusb_fill_interrupt_transfer (output->transfer, usbhid->handle,
+		usbhid->endpoint_out, (unsigned char *) buffer, length,
+		dc_usbhid_transfer_callback, output, 0);
+
+	int rc = dc_usbhid_transfer_submit (output);
+	if (rc == LIBUSB_SUCCESS) {
+		// The interrupt may have missed the new transfer.
+		if (usbhid->interrupted) {
+			libusb_cancel_transfer (output->transfer);
+		}
+
+		rc = dc_usbhid_transfer_wait (output, usbhid->timer, 0);
+		if (rc == LIBUSB_SUCCESS) {
+			rc = dc_usbhid_transfer_error (output->transfer->status);
+			nbytes = output->transfer->actual_length;
+		}
+	}
 	if (rc != LIBUSB_SUCCESS) {
 		ERROR (abstract->context, "Usb write interrupt transfer failed (%s).",
 			libusb_error_name (rc));
@@ -60,9 +60,6 @@ static const dc_device_vtable_t uwatec_memomouse_device_vtable = {
 	NULL /* close */
 };
 
-static dc_status_t
-uwatec_memomouse_extract_dives (dc_device_t *device, const unsigned char data[], unsigned int size, dc_dive_callback_t callback, void *userdata);
-
 dc_status_t
 uwatec_memomouse_device_open (dc_device_t **out, dc_context_t *context, dc_iostream_t *iostream)
 {
@@ -175,13 +172,10 @@ uwatec_memomouse_read_packet (uwatec_memomouse_device_t *device, unsigned char d
 		return status;
 	}
 
-	// Reverse the bits.
-	array_reverse_bits (data + 1, len + 1);
-
-	// Verify the checksum of the package.
-	unsigned char crc = data[len + 1];
-	unsigned char ccrc = checksum_xor_uint8 (data, len + 1, 0x00);
-	if (crc != ccrc) {
+	// Reverse the bits and verify the checksum of the package. With the
+	// checksum byte included, the xor of all bytes is zero.
+	unsigned char ccrc = array_reverse_bits_xor (data + 1, len + 1, data[0]);
+	if (ccrc != 0) {
 		ERROR (abstract->context, "Unexpected answer checksum.");
 		return DC_STATUS_PROTOCOL;
 	}
@@ -235,6 +229,7 @@ uwatec_memomouse_read_packet_inner (uwatec_memomouse_device_t *device, dc_buffer
 
 	unsigned int nbytes = 0;
 	unsigned int total = PACKETSIZE;
+	unsigned char ccrc = 0x00;
 	while (nbytes < total) {
 		// Calculate the packet size.
 		unsigned int length = total - nbytes;
@@ -280,19 +275,20 @@ uwatec_memomouse_read_packet_inner (uwatec_memomouse_device_t *device, dc_buffer
 			device_event_emit (&device->base, DC_EVENT_PROGRESS, progress);
 		}
 
+		// Update the checksum of the inner packet. The xor of all bytes
+		// of the outer packet is zero, so the xor of its payload equals
+		// the xor of the length and checksum bytes.
+		ccrc ^= packet[0] ^ packet[length + 1];
+
 		// Append the packet to the buffer.
 		dc_buffer_append (buffer, packet + 1, length);
 
 		nbytes += length;
 	}
 
-	// Obtain the pointer to the buffer contents.
-	unsigned char *data = dc_buffer_get_data (buffer);
-
-	// Verify the checksum.
-	unsigned char crc = data[total - 1];
-	unsigned char ccrc = checksum_xor_uint8 (data, total - 1, 0x00);
-	if (crc != ccrc) {
+	// Verify the checksum. With the checksum byte included, the xor of
+	// all bytes is zero.
+	if (ccrc != 0) {
 		ERROR (abstract->context, "Unexpected answer checksum.");
 		return DC_STATUS_PROTOCOL;
 	}
@@ -331,7 +327,10 @@ uwatec_memomouse_dump_internal (uwatec_memomouse_device_t *device, dc_buffer_t *
 			return status;
 		}
 
-		dc_iostream_sleep (device->iostream, 300);
+		// Give the device some time to answer.
+		status = dc_iostream_wait_readable (device->iostream, 300);
+		if (status == DC_STATUS_UNSUPPORTED)
+			dc_iostream_sleep (device->iostream, 300);
 	}
 
 	// Read the ID string.
@@ -385,12 +384,11 @@ uwatec_memomouse_dump_internal (uwatec_memomouse_device_t *device, dc_buffer_t *
 	}
 
 	// Wait for the data packet.
-	while (dc_iostream_get_available (device->iostream, &available) == DC_STATUS_SUCCESS && available == 0) {
+	while (dc_iostream_wait_readable (device->iostream, 100) == DC_STATUS_TIMEOUT) {
 		if (device_is_cancelled (abstract))
 			return DC_STATUS_CANCELLED;
 
 		device_event_emit (&device->base, DC_EVENT_WAITING, NULL);
-		dc_iostream_sleep (device->iostream, 100);
 	}
 
 	// Fetch the current system time.
@@ -469,7 +467,7 @@ uwatec_memomouse_device_foreach (dc_device_t *abstract, dc_dive_callback_t callb
 }
 
 
-static dc_status_t
+dc_status_t
 uwatec_memomouse_extract_dives (dc_device_t *abstract, const unsigned char data[], unsigned int size, dc_dive_callback_t callback, void *userdata)
 {
 	if (abstract && !ISINSTANCE (abstract))
@@ -37,6 +37,9 @@ uwatec_memomouse_device_open (dc_device_t **device, dc_context_t *context, dc_io
 dc_status_t
 uwatec_memomouse_parser_create (dc_parser_t **parser, dc_context_t *context, unsigned int devtime, dc_ticks_t systime);
 
+dc_status_t
+uwatec_memomouse_extract_dives (dc_device_t *device, const unsigned char data[], unsigned int size, dc_dive_callback_t callback, void *userdata);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -19,6 +19,8 @@
  * MA 02110-1301 USA
  */
 
+#define LOG_SUBSYSTEM DC_LOGSUBSYSTEM_PARSER
+
 #include <stdlib.h>
 
 #include <libdivecomputer/units.h>
@@ -98,7 +100,7 @@ uwatec_memomouse_parser_get_datetime (dc_parser_t *abstract, dc_datetime_t *date
 
 	dc_ticks_t ticks = parser->systime - (parser->devtime - timestamp) / 2;
 
-	if (!dc_datetime_localtime (datetime, ticks))
+	if (!dc_context_localtime (abstract->context, datetime, ticks))
 		return DC_STATUS_DATAFORMAT;
 
 	return DC_STATUS_SUCCESS;
@@ -51,6 +51,16 @@
 
 typedef struct uwatec_smart_device_t uwatec_smart_device_t;
 
+typedef struct uwatec_smart_stream_t {
+	const unsigned char *data;
+	unsigned int size;
+	unsigned int offset;
+	dc_dive_callback_t callback;
+	void *userdata;
+	unsigned int stopped;
+	dc_status_t status;
+} uwatec_smart_stream_t;
+
 typedef dc_status_t (*uwatec_smart_receive_t) (uwatec_smart_device_t *device, dc_event_progress_t *progress, unsigned char cmd, unsigned char data[], size_t size);
 typedef dc_status_t (*uwatec_smart_send_t) (uwatec_smart_device_t *device, unsigned char cmd, const unsigned char data[], size_t size);
 
@@ -62,6 +72,8 @@ struct uwatec_smart_device_t {
 	unsigned int timestamp;
 	unsigned int devtime;
 	dc_ticks_t systime;
+	unsigned int streaming;
+	uwatec_smart_stream_t *stream;
 };
 
 static dc_status_t uwatec_smart_device_set_fingerprint (dc_device_t *device, const unsigned char data[], unsigned int size);
@@ -80,8 +92,53 @@ static const dc_device_vtable_t uwatec_smart_device_vtable = {
 	NULL /* close */
 };
 
-static dc_status_t
-uwatec_smart_extract_dives (dc_device_t *device, const unsigned char data[], unsigned int size, dc_dive_callback_t callback, void *userdata);
+static const unsigned char uwatec_smart_marker[4] = {0xa5, 0xa5, 0x5a, 0x5a};
+
+/*
+ * Pass the dives which are completely received to the application. The
+ * dives are stored back to back, starting with the oldest dive. Each one
+ * starts with a marker and its total length, which is enough to detect
+ * the end of a dive before the rest of the data has arrived.
+ */
+static void
+uwatec_smart_stream_feed (uwatec_smart_device_t *device, size_t available)
+{
+	dc_device_t *abstract = (dc_device_t *) device;
+	uwatec_smart_stream_t *stream = device->stream;
+
+	if (stream == NULL)
+		return;
+
+	while (!stream->stopped) {
+		unsigned int offset = stream->offset;
+		if (offset + 8 > available)
+			break;
+
+		// Skip any data in front of the start marker.
+		if (memcmp (stream->data + offset, uwatec_smart_marker, sizeof (uwatec_smart_marker)) != 0) {
+			stream->offset++;
+			continue;
+		}
+
+		// Get the length of the profile data.
+		unsigned int len = array_uint32_le (stream->data + offset + 4);
+		if (len < 12 || len > stream->size - offset) {
+			ERROR (abstract->context, "Invalid dive length (%u bytes).", len);
+			stream->status = DC_STATUS_DATAFORMAT;
+			stream->stopped = 1;
+			break;
+		}
+
+		// Wait for the remainder of the dive.
+		if (offset + len > available)
+			break;
+
+		stream->offset += len;
+
+		if (stream->callback && !stream->callback (stream->data + offset, len, stream->data + offset + 8, 4, stream->userdata))
+			stream->stopped = 1;
+	}
+}
 
 static dc_status_t
 uwatec_smart_irda_send (uwatec_smart_device_t *device, unsigned char cmd, const unsigned char data[], size_t size)
@@ -119,8 +176,9 @@ uwatec_smart_irda_receive (uwatec_smart_device_t *device, dc_event_progress_t *p
 
 	size_t nbytes = 0;
 	while (nbytes < size) {
-		// Set the minimum packet size.
-		size_t len = 32;
+		// Set the minimum packet size. The stream socket returns the data
+		// of several IrLAP frames with a single read.
+		size_t len = 1024;
 
 		// Increase the packet size if more data is immediately available.
 		size_t available = 0;
@@ -145,6 +203,8 @@ uwatec_smart_irda_receive (uwatec_smart_device_t *device, dc_event_progress_t *p
 		}
 
 		nbytes += len;
+
+		uwatec_smart_stream_feed (device, nbytes);
 	}
 
 	return DC_STATUS_SUCCESS;
@@ -265,6 +325,8 @@ uwatec_smart_serial_receive (uwatec_smart_device_t *device, dc_event_progress_t
 		}
 
 		nbytes += len - 1;
+
+		uwatec_smart_stream_feed (device, nbytes);
 	}
 
 	return DC_STATUS_SUCCESS;
@@ -314,8 +376,19 @@ uwatec_smart_usbhid_receive (uwatec_smart_device_t *device, dc_event_progress_t
 
 	size_t nbytes = 0;
 	while (nbytes < size) {
+		// When the remaining space can hold an entire report, the report
+		// is read directly into the destination, with the length byte on
+		// top of the last byte of the previous payload. That byte is
+		// restored afterwards, and the payload ends up in place without
+		// a copy. Only the first and the last few reports are staged.
+		unsigned char *packet = buf, saved = 0;
+		if (nbytes && size - nbytes + 1 >= sizeof(buf)) {
+			packet = data + nbytes - 1;
+			saved = packet[0];
+		}
+
 		size_t transferred = 0;
-		rc = dc_iostream_read (device->iostream, buf, sizeof(buf), &transferred);
+		rc = dc_iostream_read (device->iostream, packet, sizeof(buf), &transferred);
 		if (rc != DC_STATUS_SUCCESS) {
 			ERROR (abstract->context, "Failed to receive the packet.");
 			return rc;
@@ -364,13 +437,16 @@ uwatec_smart_usbhid_receive (uwatec_smart_device_t *device, dc_event_progress_t
 		 *
 		 * It may be just an oddly implemented sequence number. Whatever.
 		 */
-		unsigned int len = buf[0];
+		unsigned int len = packet[0];
 		if (len + 1 > transferred)
 			len = transferred-1;
 
-		HEXDUMP (abstract->context, DC_LOGLEVEL_DEBUG, "rcv", buf + 1, len);
+		if (packet != buf)
+			packet[0] = saved;
+
+		HEXDUMP (abstract->context, DC_LOGLEVEL_DEBUG, "rcv", packet + 1, len);
 
-		if (len > size) {
+		if (len > size - nbytes) {
 			ERROR (abstract->context, "Insufficient buffer space available.");
 			return DC_STATUS_PROTOCOL;
 		}
@@ -381,8 +457,11 @@ uwatec_smart_usbhid_receive (uwatec_smart_device_t *device, dc_event_progress_t
 			device_event_emit (abstract, DC_EVENT_PROGRESS, progress);
 		}
 
-		memcpy(data + nbytes, buf + 1, len);
+		if (packet == buf)
+			memcpy(data + nbytes, buf + 1, len);
 		nbytes += len;
+
+		uwatec_smart_stream_feed (device, nbytes);
 	}
 
 	return DC_STATUS_SUCCESS;
@@ -394,6 +473,7 @@ uwatec_smart_transfer (uwatec_smart_device_t *device, unsigned char cmd, const u
 {
 	dc_status_t status = DC_STATUS_SUCCESS;
 	dc_device_t *abstract = (dc_device_t *) device;
+	dc_usecs_t start = device_latency_start (abstract);
 
 	status = device->send (device, cmd, command, csize);
 	if (status != DC_STATUS_SUCCESS) {
@@ -407,6 +487,8 @@ uwatec_smart_transfer (uwatec_smart_device_t *device, unsigned char cmd, const u
 		return status;
 	}
 
+	device_latency_emit (abstract, cmd, asize, start);
+
 	return DC_STATUS_SUCCESS;
 }
 
@@ -469,6 +551,8 @@ uwatec_smart_device_open (dc_device_t **out, dc_context_t *context, dc_iostream_
 	device->timestamp = 0;
 	device->systime = (dc_ticks_t) -1;
 	device->devtime = 0;
+	device->streaming = 0;
+	device->stream = NULL;
 
 	// Set the serial communication protocol (57600 8N1).
 	status = dc_iostream_configure (device->iostream, 57600, 8, DC_PARITY_NONE, DC_STOPBITS_ONE, DC_FLOWCONTROL_NONE);
@@ -526,6 +610,20 @@ error_free:
 }
 
 
+dc_status_t
+uwatec_smart_device_set_streaming (dc_device_t *abstract, unsigned int value)
+{
+	uwatec_smart_device_t *device = (uwatec_smart_device_t *) abstract;
+
+	if (!ISINSTANCE (abstract))
+		return DC_STATUS_INVALIDARGS;
+
+	device->streaming = value;
+
+	return DC_STATUS_SUCCESS;
+}
+
+
 static dc_status_t
 uwatec_smart_device_set_fingerprint (dc_device_t *abstract, const unsigned char data[], unsigned int size)
 {
@@ -548,6 +646,10 @@ uwatec_smart_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 {
 	uwatec_smart_device_t *device = (uwatec_smart_device_t*) abstract;
 	dc_status_t rc = DC_STATUS_SUCCESS;
+	uwatec_smart_stream_t *stream = device->stream;
+
+	// The stream is only active for the data itself.
+	device->stream = NULL;
 
 	// Enable progress notifications.
 	dc_event_progress_t progress = EVENT_PROGRESS_INITIALIZER;
@@ -642,7 +744,15 @@ uwatec_smart_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 		return DC_STATUS_PROTOCOL;
 	}
 
+	if (stream) {
+		stream->data = data;
+		stream->size = length;
+		stream->offset = 0;
+		device->stream = stream;
+	}
+
 	rc = device->receive (device, &progress, CMD_DATA, data, length);
+	device->stream = NULL;
 	if (rc != DC_STATUS_SUCCESS) {
 		ERROR (abstract->context, "Failed to receive the answer.");
 		return rc;
@@ -655,16 +765,30 @@ uwatec_smart_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 static dc_status_t
 uwatec_smart_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, void *userdata)
 {
+	uwatec_smart_device_t *device = (uwatec_smart_device_t *) abstract;
+
 	dc_buffer_t *buffer = dc_buffer_new (0);
 	if (buffer == NULL)
 		return DC_STATUS_NOMEMORY;
 
+	// In streaming mode, the dives are passed to the application while
+	// the data is still being received.
+	uwatec_smart_stream_t stream = {NULL, 0, 0, callback, userdata, 0, DC_STATUS_SUCCESS};
+	if (device->streaming) {
+		device->stream = &stream;
+	}
+
 	dc_status_t rc = uwatec_smart_device_dump (abstract, buffer);
 	if (rc != DC_STATUS_SUCCESS) {
 		dc_buffer_free (buffer);
 		return rc;
 	}
 
+	if (device->streaming) {
+		dc_buffer_free (buffer);
+		return stream.status;
+	}
+
 	rc = uwatec_smart_extract_dives (abstract,
 		dc_buffer_get_data (buffer), dc_buffer_get_size (buffer), callback, userdata);
 
@@ -674,7 +798,7 @@ uwatec_smart_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback,
 }
 
 
-static dc_status_t
+dc_status_t
 uwatec_smart_extract_dives (dc_device_t *abstract, const unsigned char data[], unsigned int size, dc_dive_callback_t callback, void *userdata)
 {
 	if (abstract && !ISINSTANCE (abstract))
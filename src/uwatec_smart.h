@@ -26,6 +26,7 @@
 #include <libdivecomputer/iostream.h>
 #include <libdivecomputer/device.h>
 #include <libdivecomputer/parser.h>
+#include <libdivecomputer/uwatec_smart.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -37,6 +38,9 @@ uwatec_smart_device_open (dc_device_t **device, dc_context_t *context, dc_iostre
 dc_status_t
 uwatec_smart_parser_create (dc_parser_t **parser, dc_context_t *context, unsigned int model, unsigned int devtime, dc_ticks_t systime);
 
+dc_status_t
+uwatec_smart_extract_dives (dc_device_t *device, const unsigned char data[], unsigned int size, dc_dive_callback_t callback, void *userdata);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -19,8 +19,11 @@
  * MA 02110-1301 USA
  */
 
+#define LOG_SUBSYSTEM DC_LOGSUBSYSTEM_PARSER
+
 #include <stdlib.h>
 #include <string.h>	// memcmp
+#include <assert.h>
 
 #include <libdivecomputer/units.h>
 
@@ -28,6 +31,7 @@
 #include "context-private.h"
 #include "parser-private.h"
 #include "array.h"
+#include "gastable.h"
 
 #define ISINSTANCE(parser) dc_parser_isinstance((parser), &uwatec_smart_parser_vtable)
 
@@ -56,6 +60,11 @@
 
 #define NEVENTS   3
 #define NGASMIXES 10
+#define NTYPES    20
+
+// Special values in the type dispatch table.
+#define TYPE_NEXT    0xFE
+#define TYPE_INVALID 0xFF
 
 #define HEADER  1
 #define PROFILE 2
@@ -115,6 +124,18 @@ typedef struct uwatec_smart_sample_info_t {
 	unsigned int extrabytes;
 } uwatec_smart_sample_info_t;
 
+typedef struct uwatec_smart_sample_decode_t {
+	unsigned int skip;    // Number of type bytes without data bits.
+	unsigned int partial; // Last type byte contains data bits.
+	unsigned int mask;    // Mask of the data bits in the last type byte.
+	unsigned int nbits;   // Total number of data bits.
+} uwatec_smart_sample_decode_t;
+
+typedef struct uwatec_smart_record_t {
+	dc_sample_type_t type;
+	dc_sample_value_t value;
+} uwatec_smart_record_t;
+
 typedef struct uwatec_smart_event_info_t {
 	uwatec_smart_event_t type;
 	unsigned int mask;
@@ -145,6 +166,9 @@ struct uwatec_smart_parser_t {
 	const uwatec_smart_header_info_t *header;
 	unsigned int headersize;
 	unsigned int nsamples;
+	// Compiled sample decoding tables.
+	unsigned char dispatch[256];
+	uwatec_smart_sample_decode_t decode[NTYPES];
 	const uwatec_smart_event_info_t *events[NEVENTS];
 	unsigned int nevents[NEVENTS];
 	unsigned int trimix;
@@ -154,16 +178,24 @@ struct uwatec_smart_parser_t {
 	uwatec_smart_gasmix_t gasmix[NGASMIXES];
 	unsigned int ntanks;
 	uwatec_smart_tank_t tank[NGASMIXES];
+	// Gas mixes and tanks, indexed by id.
+	dc_gastable_t gasmixes;
+	dc_gastable_t tanks;
 	dc_water_t watertype;
 	dc_divemode_t divemode;
+	// Decoded samples (uwatec_smart_record_t).
+	dc_buffer_t *records;
+	unsigned int materialized;
 };
 
 static dc_status_t uwatec_smart_parser_set_data (dc_parser_t *abstract, const unsigned char *data, unsigned int size);
 static dc_status_t uwatec_smart_parser_get_datetime (dc_parser_t *abstract, dc_datetime_t *datetime);
 static dc_status_t uwatec_smart_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, unsigned int flags, void *value);
 static dc_status_t uwatec_smart_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t callback, void *userdata);
+static dc_status_t uwatec_smart_parser_destroy (dc_parser_t *abstract);
 
 static dc_status_t uwatec_smart_parse (uwatec_smart_parser_t *parser, dc_sample_callback_t callback, void *userdata);
+static void uwatec_smart_compile (uwatec_smart_parser_t *parser);
 
 static const dc_parser_vtable_t uwatec_smart_parser_vtable = {
 	sizeof(uwatec_smart_parser_t),
@@ -172,7 +204,7 @@ static const dc_parser_vtable_t uwatec_smart_parser_vtable = {
 	uwatec_smart_parser_get_datetime, /* datetime */
 	uwatec_smart_parser_get_field, /* fields */
 	uwatec_smart_parser_samples_foreach, /* samples_foreach */
-	NULL /* destroy */
+	uwatec_smart_parser_destroy /* destroy */
 };
 
 static const
@@ -412,32 +444,6 @@ uwatec_smart_event_info_t uwatec_smart_trimix_events_2[] = {
 	{EV_GASMIX,           0xF0, 4},
 };
 
-static unsigned int
-uwatec_smart_find_gasmix (uwatec_smart_parser_t *parser, unsigned int id)
-{
-       unsigned int i = 0;
-       while (i < parser->ngasmixes) {
-               if (id == parser->gasmix[i].id)
-                       break;
-               i++;
-       }
-
-       return i;
-}
-
-static unsigned int
-uwatec_smart_find_tank (uwatec_smart_parser_t *parser, unsigned int id)
-{
-       unsigned int i = 0;
-       while (i < parser->ntanks) {
-               if (id == parser->tank[i].id)
-                       break;
-               i++;
-       }
-
-       return i;
-}
-
 static dc_status_t
 uwatec_smart_parser_cache (uwatec_smart_parser_t *parser)
 {
@@ -504,6 +510,9 @@ uwatec_smart_parser_cache (uwatec_smart_parser_t *parser)
 	unsigned int ngasmixes = 0;
 	uwatec_smart_tank_t tank[NGASMIXES] = {{0}};
 	uwatec_smart_gasmix_t gasmix[NGASMIXES] = {{0}};
+	dc_gastable_t gasmixes, tanks;
+	dc_gastable_init (&gasmixes);
+	dc_gastable_init (&tanks);
 	if (header->gasmix != UNSUPPORTED) {
 		for (unsigned int i = 0; i < header->ngases; ++i) {
 			unsigned int idx = DC_GASMIX_UNKNOWN;
@@ -516,6 +525,7 @@ uwatec_smart_parser_cache (uwatec_smart_parser_t *parser)
 
 			if (o2 != 0) {
 				idx = ngasmixes;
+				dc_gastable_add (&gasmixes, i);
 				gasmix[ngasmixes].id = i;
 				gasmix[ngasmixes].oxygen = o2;
 				gasmix[ngasmixes].helium = 0;
@@ -542,6 +552,7 @@ uwatec_smart_parser_cache (uwatec_smart_parser_t *parser)
 			}
 			if ((beginpressure != 0 || endpressure != 0) &&
 				(beginpressure != 0xFFFF) && (endpressure != 0xFFFF)) {
+				dc_gastable_add (&tanks, i);
 				tank[ntanks].id = i;
 				tank[ntanks].beginpressure = beginpressure;
 				tank[ntanks].endpressure = endpressure;
@@ -560,6 +571,8 @@ uwatec_smart_parser_cache (uwatec_smart_parser_t *parser)
 	for (unsigned int i = 0; i < ntanks; ++i) {
 		parser->tank[i] = tank[i];
 	}
+	parser->gasmixes = gasmixes;
+	parser->tanks = tanks;
 	parser->watertype = watertype;
 	parser->divemode = divemode;
 	parser->cached = HEADER;
@@ -677,6 +690,8 @@ uwatec_smart_parser_create (dc_parser_t **out, dc_context_t *context, unsigned i
 		goto error_free;
 	}
 
+	uwatec_smart_compile (parser);
+
 	parser->cached = 0;
 	parser->ngasmixes = 0;
 	parser->ntanks = 0;
@@ -689,8 +704,12 @@ uwatec_smart_parser_create (dc_parser_t **out, dc_context_t *context, unsigned i
 		parser->tank[i].endpressure = 0;
 		parser->tank[i].gasmix = 0;
 	}
+	dc_gastable_init (&parser->gasmixes);
+	dc_gastable_init (&parser->tanks);
 	parser->watertype = DC_WATER_FRESH;
 	parser->divemode = DC_DIVEMODE_OC;
+	parser->records = NULL;
+	parser->materialized = 0;
 
 	*out = (dc_parser_t*) parser;
 
@@ -720,8 +739,76 @@ uwatec_smart_parser_set_data (dc_parser_t *abstract, const unsigned char *data,
 		parser->tank[i].endpressure = 0;
 		parser->tank[i].gasmix = 0;
 	}
+	dc_gastable_init (&parser->gasmixes);
+	dc_gastable_init (&parser->tanks);
 	parser->watertype = DC_WATER_FRESH;
 	parser->divemode = DC_DIVEMODE_OC;
+	parser->materialized = 0;
+	dc_buffer_clear (parser->records);
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+static dc_status_t
+uwatec_smart_parser_destroy (dc_parser_t *abstract)
+{
+	uwatec_smart_parser_t *parser = (uwatec_smart_parser_t *) abstract;
+
+	dc_buffer_free (parser->records);
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+static void
+uwatec_smart_parser_record (dc_sample_type_t type, dc_sample_value_t value, void *userdata)
+{
+	uwatec_smart_parser_t *parser = (uwatec_smart_parser_t *) userdata;
+
+	if (!parser->materialized)
+		return;
+
+	uwatec_smart_record_t record;
+	record.type = type;
+	record.value = value;
+
+	if (!dc_buffer_append (parser->records, (const unsigned char *) &record, sizeof (record))) {
+		// Without the decoded samples, the profile is simply
+		// decoded again for every samples_foreach call.
+		WARNING (parser->base.context, "Failed to store the decoded samples.");
+		dc_buffer_clear (parser->records);
+		parser->materialized = 0;
+	}
+}
+
+
+static dc_status_t
+uwatec_smart_parser_analyze (uwatec_smart_parser_t *parser)
+{
+	// Cache the parser data.
+	dc_status_t rc = uwatec_smart_parser_cache (parser);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	if (parser->cached >= PROFILE)
+		return DC_STATUS_SUCCESS;
+
+	// Decode the profile only once. The gas mixes and tanks are collected
+	// along the way, and the decoded samples are stored for replaying
+	// them to the application.
+	if (parser->records == NULL) {
+		parser->records = dc_buffer_new (0);
+	}
+	dc_buffer_clear (parser->records);
+	parser->materialized = parser->records != NULL;
+
+	rc = uwatec_smart_parse (parser, uwatec_smart_parser_record, parser);
+	if (rc != DC_STATUS_SUCCESS) {
+		dc_buffer_clear (parser->records);
+		parser->materialized = 0;
+		return rc;
+	}
 
 	return DC_STATUS_SUCCESS;
 }
@@ -756,7 +843,7 @@ uwatec_smart_parser_get_datetime (dc_parser_t *abstract, dc_datetime_t *datetime
 	} else {
 		// For devices without timezone support, the current timezone of
 		// the host system is used.
-		if (!dc_datetime_localtime (datetime, ticks))
+		if (!dc_context_localtime (abstract->context, datetime, ticks))
 			return DC_STATUS_DATAFORMAT;
 	}
 
@@ -769,18 +856,11 @@ uwatec_smart_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, unsi
 {
 	uwatec_smart_parser_t *parser = (uwatec_smart_parser_t *) abstract;
 
-	// Cache the parser data.
-	dc_status_t rc = uwatec_smart_parser_cache (parser);
+	// Cache the parser and profile data.
+	dc_status_t rc = uwatec_smart_parser_analyze (parser);
 	if (rc != DC_STATUS_SUCCESS)
 		return rc;
 
-	// Cache the profile data.
-	if (parser->cached < PROFILE) {
-		rc = uwatec_smart_parse (parser, NULL, NULL);
-		if (rc != DC_STATUS_SUCCESS)
-			return rc;
-	}
-
 	const uwatec_smart_header_info_t *table = parser->header;
 	const unsigned char *data = abstract->data;
 
@@ -888,6 +968,66 @@ uwatec_galileo_identify (unsigned char value)
 }
 
 
+static int
+uwatec_smart_is_galileo (unsigned int model)
+{
+	return model == GALILEO || model == GALILEOTRIMIX ||
+		model == ALADIN2G || model == MERIDIAN ||
+		model == CHROMIS || model == MANTIS2 ||
+		model == G2 || model == ALADINSPORTMATRIX ||
+		model == ALADINSQUARE || model == G2HUD;
+}
+
+
+static void
+uwatec_smart_compile (uwatec_smart_parser_t *parser)
+{
+	const uwatec_smart_sample_info_t *table = parser->samples;
+	unsigned int entries = parser->nsamples;
+	int galileo = uwatec_smart_is_galileo (parser->model);
+
+	assert (entries <= NTYPES);
+
+	// Map every possible first byte to the sample type. For the Smart
+	// models, the type bits of some samples continue in the second byte.
+	// Those are marked here, and resolved with a second lookup, because
+	// the type is then simply eight plus the type of the second byte.
+	for (unsigned int i = 0; i < sizeof (parser->dispatch); ++i) {
+		unsigned char value = i;
+		unsigned int id = 0;
+		if (galileo) {
+			id = uwatec_galileo_identify (value);
+		} else {
+			id = uwatec_smart_identify (&value, 1);
+		}
+
+		if (id == (unsigned int) -1) {
+			parser->dispatch[i] = TYPE_NEXT;
+		} else if (id >= entries) {
+			parser->dispatch[i] = TYPE_INVALID;
+		} else {
+			parser->dispatch[i] = id;
+		}
+	}
+
+	// Pre-calculate the bit manipulations for every sample type.
+	for (unsigned int i = 0; i < entries; ++i) {
+		unsigned int n = table[i].ntypebits % NBITS;
+		uwatec_smart_sample_decode_t *decode = parser->decode + i;
+		decode->skip = table[i].ntypebits / NBITS;
+		decode->partial = n > 0;
+		decode->mask = 0;
+		decode->nbits = table[i].extrabytes * NBITS;
+		if (n > 0 && !table[i].ignoretype) {
+			// Ignore any data bits that are stored in
+			// the last type byte for certain samples.
+			decode->mask = 0xFF >> n;
+			decode->nbits += NBITS - n;
+		}
+	}
+}
+
+
 static unsigned int
 uwatec_smart_fixsignbit (unsigned int x, unsigned int n)
 {
@@ -960,39 +1100,27 @@ uwatec_smart_parse (uwatec_smart_parser_t *parser, dc_sample_callback_t callback
 		dc_sample_value_t sample = {0};
 
 		// Process the type bits in the bitstream.
-		unsigned int id = 0;
-		if (parser->model == GALILEO || parser->model == GALILEOTRIMIX ||
-			parser->model == ALADIN2G || parser->model == MERIDIAN ||
-			parser->model == CHROMIS || parser->model == MANTIS2 ||
-			parser->model == G2 || parser->model == ALADINSPORTMATRIX ||
-			parser->model == ALADINSQUARE || parser->model == G2HUD) {
-			// Uwatec Galileo
-			id = uwatec_galileo_identify (data[offset]);
-		} else {
-			// Uwatec Smart
-			id = uwatec_smart_identify (data + offset, size - offset);
+		unsigned int id = parser->dispatch[data[offset]];
+		if (id == TYPE_NEXT) {
+			id = TYPE_INVALID;
+			if (offset + 1 < size && parser->dispatch[data[offset + 1]] != TYPE_NEXT) {
+				id = NBITS + parser->dispatch[data[offset + 1]];
+			}
 		}
 		if (id >= entries) {
 			ERROR (abstract->context, "Invalid type bits.");
 			return DC_STATUS_DATAFORMAT;
 		}
 
+		const uwatec_smart_sample_decode_t *decode = parser->decode + id;
+
 		// Skip the processed type bytes.
-		offset += table[id].ntypebits / NBITS;
+		offset += decode->skip;
 
 		// Process the remaining data bits.
-		unsigned int nbits = 0;
 		unsigned int value = 0;
-		unsigned int n = table[id].ntypebits % NBITS;
-		if (n > 0) {
-			nbits = NBITS - n;
-			value = data[offset] & (0xFF >> n);
-			if (table[id].ignoretype) {
-				// Ignore any data bits that are stored in
-				// the last type byte for certain samples.
-				nbits = 0;
-				value = 0;
-			}
+		if (decode->partial) {
+			value = data[offset] & decode->mask;
 			offset++;
 		}
 
@@ -1004,14 +1132,13 @@ uwatec_smart_parse (uwatec_smart_parser_t *parser, dc_sample_callback_t callback
 
 		// Process the extra data bytes.
 		for (unsigned int i = 0; i < table[id].extrabytes; ++i) {
-			nbits += NBITS;
 			value <<= NBITS;
 			value += data[offset];
 			offset++;
 		}
 
 		// Fix the sign bit.
-		signed int svalue = uwatec_smart_fixsignbit (value, nbits);
+		signed int svalue = uwatec_smart_fixsignbit (value, decode->nbits);
 
 		// Parse the value.
 		unsigned int idx = 0;
@@ -1135,12 +1262,13 @@ uwatec_smart_parse (uwatec_smart_parser_t *parser, dc_sample_callback_t callback
 				unsigned int endpressure   = array_uint16_le (data + offset + 7);
 
 				if (o2 != 0 || he != 0) {
-					idx = uwatec_smart_find_gasmix (parser, mixid);
+					idx = dc_gastable_find (&parser->gasmixes, mixid);
 					if (idx >= parser->ngasmixes) {
 						if (idx >= NGASMIXES) {
 							ERROR (abstract->context, "Maximum number of gas mixes reached.");
 							return DC_STATUS_NOMEMORY;
 						}
+						dc_gastable_add (&parser->gasmixes, mixid);
 						parser->gasmix[idx].id = mixid;
 						parser->gasmix[idx].oxygen = o2;
 						parser->gasmix[idx].helium = he;
@@ -1151,12 +1279,13 @@ uwatec_smart_parse (uwatec_smart_parser_t *parser, dc_sample_callback_t callback
 
 				if ((beginpressure != 0 || endpressure != 0) &&
 					(beginpressure != 0xFFFF) && (endpressure != 0xFFFF)) {
-					idx = uwatec_smart_find_tank (parser, mixid);
+					idx = dc_gastable_find (&parser->tanks, mixid);
 					if (idx >= parser->ntanks) {
 						if (idx >= NGASMIXES) {
 							ERROR (abstract->context, "Maximum number of tanks reached.");
 							return DC_STATUS_NOMEMORY;
 						}
+						dc_gastable_add (&parser->tanks, mixid);
 						parser->tank[idx].id = mixid;
 						parser->tank[idx].beginpressure = beginpressure;
 						parser->tank[idx].endpressure = endpressure;
@@ -1178,7 +1307,7 @@ uwatec_smart_parse (uwatec_smart_parser_t *parser, dc_sample_callback_t callback
 			if (callback) callback (DC_SAMPLE_TIME, sample, userdata);
 
 			if (parser->ngasmixes && gasmix != gasmix_previous) {
-				idx = uwatec_smart_find_gasmix (parser, gasmix);
+				idx = dc_gastable_find (&parser->gasmixes, gasmix);
 				if (idx >= parser->ngasmixes) {
 					ERROR (abstract->context, "Invalid gas mix index.");
 					return DC_STATUS_DATAFORMAT;
@@ -1207,7 +1336,7 @@ uwatec_smart_parse (uwatec_smart_parser_t *parser, dc_sample_callback_t callback
 			}
 
 			if (have_pressure) {
-				idx = uwatec_smart_find_tank(parser, tank);
+				idx = dc_gastable_find (&parser->tanks, tank);
 				if (idx < parser->ntanks) {
 					sample.pressure.tank = idx;
 					sample.pressure.value = pressure;
@@ -1247,17 +1376,20 @@ uwatec_smart_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t
 {
 	uwatec_smart_parser_t *parser = (uwatec_smart_parser_t *) abstract;
 
-	// Cache the parser data.
-	dc_status_t rc = uwatec_smart_parser_cache (parser);
+	// Cache the parser and profile data.
+	dc_status_t rc = uwatec_smart_parser_analyze (parser);
 	if (rc != DC_STATUS_SUCCESS)
 		return rc;
 
-	// Cache the profile data.
-	if (parser->cached < PROFILE) {
-		rc = uwatec_smart_parse (parser, NULL, NULL);
-		if (rc != DC_STATUS_SUCCESS)
-			return rc;
+	if (!parser->materialized)
+		return uwatec_smart_parse (parser, callback, userdata);
+
+	// Replay the decoded samples.
+	const uwatec_smart_record_t *records = (const uwatec_smart_record_t *) dc_buffer_get_data (parser->records);
+	unsigned int nrecords = dc_buffer_get_size (parser->records) / sizeof (uwatec_smart_record_t);
+	for (unsigned int i = 0; i < nrecords; ++i) {
+		if (callback) callback (records[i].type, records[i].value, userdata);
 	}
 
-	return uwatec_smart_parse (parser, callback, userdata);
+	return DC_STATUS_SUCCESS;
 }